@@ -0,0 +1,94 @@
+# frei0r_bundle (name dir...)
+#
+# Builds the shared library name with all the plugins (module libraries)
+# defined in the directories dir and below, in addition to the plugins
+# themselves, and installs it to CMAKE_INSTALL_LIBDIR. The plugins'
+# objects are reused: each plugin's objects are linked into one
+# relocatable object, its f0r_ functions renamed frei0r_bundle_<plugin>_f0r_
+# and all its other symbols made local, so that plugins can't clash. The
+# table of src/frei0r-all.c.in lists them for f0r_get_plugin_by_index.
+#
+# That needs a GNU compatible linker and objcopy, and ELF objects.
+
+if (CMAKE_VERSION VERSION_LESS 3.9)
+  message (FATAL_ERROR "FREI0R_BUNDLE needs CMake 3.9 or later")
+endif ()
+if (NOT CMAKE_OBJCOPY OR NOT CMAKE_LINKER OR APPLE OR WIN32)
+  message (FATAL_ERROR "FREI0R_BUNDLE needs an ELF platform with ld and objcopy")
+endif ()
+# objcopy can't rename the symbols of objects that hold compiler IR
+if (CMAKE_INTERPROCEDURAL_OPTIMIZATION)
+  message (FATAL_ERROR "FREI0R_BUNDLE can't be combined with ENABLE_LTO")
+endif ()
+
+include (Frei0rPlugins)
+
+set (FREI0R_BUNDLE_FUNCTIONS
+  init deinit get_plugin_info get_plugin_info2 get_param_info
+  construct destruct set_param_value get_param_value
+  update update2 update_slice update_stride update_batch get_stats
+  set_allocator update_view set_frame_history update_layers seek
+  update_float update_planar get_footprint update_tile get_region
+  set_async_depth update_async wait_async set_executor clone
+  save_state load_state set_param_curve is_identity
+  set_quality get_row_map get_active_rect trim resize
+  get_memory_usage set_deadline get_quality reset set_proxy)
+
+function (frei0r_bundle name)
+  set (work ${CMAKE_CURRENT_BINARY_DIR}/${name}.dir)
+  set (objects)
+  set (libs)
+  set (declarations)
+  set (tables)
+
+  frei0r_plugins (plugins ${ARGN})
+  foreach (plugin ${plugins})
+    string (MAKE_C_IDENTIFIER ${plugin} id)
+    set (syms)
+    set (keep)
+    foreach (fn ${FREI0R_BUNDLE_FUNCTIONS})
+      set (syms "${syms}f0r_${fn} frei0r_bundle_${id}_f0r_${fn}\n")
+      set (keep "${keep}frei0r_bundle_${id}_f0r_${fn}\n")
+    endforeach ()
+    file (WRITE ${work}/${plugin}.syms "${syms}")
+    file (WRITE ${work}/${plugin}.keep "${keep}")
+
+    # the section groups go as well: the linker would otherwise keep only
+    # one of the inline functions of the same name from all the plugins,
+    # which their local symbols can't refer to
+    add_custom_command (
+      OUTPUT ${work}/${plugin}.o
+      COMMAND ${CMAKE_LINKER} -r -o ${work}/${plugin}.r.o $<TARGET_OBJECTS:${plugin}>
+      COMMAND ${CMAKE_OBJCOPY} --remove-section=.group
+              --redefine-syms=${work}/${plugin}.syms
+              --keep-global-symbols=${work}/${plugin}.keep
+              ${work}/${plugin}.r.o ${work}/${plugin}.o
+      DEPENDS ${plugin} ${work}/${plugin}.syms ${work}/${plugin}.keep
+      COMMAND_EXPAND_LISTS
+      VERBATIM)
+    set_source_files_properties (${work}/${plugin}.o PROPERTIES
+      EXTERNAL_OBJECT TRUE GENERATED TRUE)
+    list (APPEND objects ${work}/${plugin}.o)
+
+    get_target_property (plugin_libs ${plugin} LINK_LIBRARIES)
+    if (plugin_libs)
+      list (APPEND libs ${plugin_libs})
+    endif ()
+
+    set (declarations "${declarations}FREI0R_BUNDLE_DECLARE(${id})\n")
+    set (tables "${tables}  FREI0R_BUNDLE_TABLE(${id}, \"${plugin}\")\n")
+  endforeach ()
+
+  set (FREI0R_BUNDLE_DECLARATIONS "${declarations}")
+  set (FREI0R_BUNDLE_TABLES "${tables}")
+  configure_file (${CMAKE_SOURCE_DIR}/src/frei0r-all.c.in ${work}/${name}.c @ONLY)
+
+  if (libs)
+    list (REMOVE_DUPLICATES libs)
+  endif ()
+  add_library (${name} SHARED ${work}/${name}.c ${objects})
+  # plugins written in C++ need its runtime
+  set_target_properties (${name} PROPERTIES LINKER_LANGUAGE CXX)
+  target_link_libraries (${name} ${libs})
+  install (TARGETS ${name} LIBRARY DESTINATION ${CMAKE_INSTALL_LIBDIR})
+endfunction ()
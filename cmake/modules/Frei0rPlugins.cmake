@@ -0,0 +1,33 @@
+# frei0r_plugins (var dir...)
+#
+# Sets var to the plugins (module libraries) defined in the directories
+# dir and below, relative to the current source directory unless they
+# are absolute. Needs CMake
+# 3.7 or later for the BUILDSYSTEM_TARGETS of a directory.
+
+function (frei0r_plugins_below var dir)
+  set (plugins)
+  get_property (targets DIRECTORY ${dir} PROPERTY BUILDSYSTEM_TARGETS)
+  foreach (target ${targets})
+    get_target_property (type ${target} TYPE)
+    if (type STREQUAL "MODULE_LIBRARY")
+      list (APPEND plugins ${target})
+    endif ()
+  endforeach ()
+  get_property (subdirs DIRECTORY ${dir} PROPERTY SUBDIRECTORIES)
+  foreach (subdir ${subdirs})
+    frei0r_plugins_below (sub ${subdir})
+    list (APPEND plugins ${sub})
+  endforeach ()
+  set (${var} ${plugins} PARENT_SCOPE)
+endfunction ()
+
+function (frei0r_plugins var)
+  set (plugins)
+  foreach (dir ${ARGN})
+    get_filename_component (dir ${dir} ABSOLUTE)
+    frei0r_plugins_below (sub ${dir})
+    list (APPEND plugins ${sub})
+  endforeach ()
+  set (${var} ${plugins} PARENT_SCOPE)
+endfunction ()
@@ -25,7 +25,12 @@
 #include <assert.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "frei0r.h"
+#include "frei0r_thread.h"
 
 #define SIZE_RGBA 4
 
@@ -65,66 +70,210 @@ typedef struct squareblur_instance
   unsigned int width;
   unsigned int height;
   double kernel; /* the kernel size, as a percentage of the biggest of width and height */
-  uint32_t *mem; /* memory accumulation matrix of uint32_t (size = acc_width*acc_height*SIZE_RGBA) */
-  uint32_t **acc; /* accumulation matrix of pointers to SIZE_RGBA consecutive uint32_t in mem (size = acc_width*acc_height) */
+  uint32_t *mem; /* summed area table, acc_width*acc_height cells of SIZE_RGBA consecutive uint32_t */
 } squareblur_instance_t;
 
-/* Updates the summed area table. */
-static void update_summed_area_table(squareblur_instance_t *inst, const uint32_t *src)
+/* A band of rows [y0,y1) of the image, for the threads. */
+typedef struct blur_job
 {
-  register unsigned char *iter_data;
-  register uint32_t *iter_mem;
-  register unsigned int i, x, y;
-
-  uint32_t acc_buffer[SIZE_RGBA]; /* accumulation buffer */
+  squareblur_instance_t *inst;
+  const uint32_t *src;
+  unsigned char *dst;
+  unsigned int y0, y1;
+  unsigned int kernel_size;
+} blur_job_t;
 
-  unsigned int row_width;
-  unsigned int width, height;
-  unsigned int cell_size;
-  
-  /* Compute basic params. */
-  width = inst->width+1;
-  height = inst->height+1;
-  row_width = SIZE_RGBA * width;
-  cell_size = SIZE_RGBA * sizeof(uint32_t);
-  
-  /* Init iterators. */
-  iter_data = (unsigned char*) src;
-  iter_mem  = inst->mem;
+/* Sums the rows of a band into rows y0+1...y1 of the summed area table,
+   as if the rows above the band were all zeros. */
+static void* summed_area_rows(void *arg)
+{
+  blur_job_t *job = (blur_job_t*)arg;
+  unsigned int width = job->inst->width;
+  unsigned int row_width = SIZE_RGBA * (width+1);
+  unsigned int x, y;
 
-  /* Process first row (all zeros). */
-  memset(iter_mem, 0, row_width * cell_size);
-  iter_mem += row_width;
-  
-  if (height >= 1)
+  for (y=job->y0; y<job->y1; ++y)
   {
-    /* Process second row. */
-    memset(acc_buffer, 0, cell_size);
-    memset(iter_mem,   0, cell_size); /* first column is void */
-    iter_mem += SIZE_RGBA;
-    for (x=1; x<width; ++x)
+    const unsigned char *iter_data = (const unsigned char*)(job->src + y*width);
+    uint32_t *row = job->inst->mem + (y+1)*row_width;
+    const uint32_t *up = (y > job->y0) ? row - row_width : 0;
+
+    memset(row, 0, SIZE_RGBA*sizeof(uint32_t)); /* first column is void */
+    row += SIZE_RGBA;
+#if defined(__SSE2__)
     {
-      for (i=0; i<SIZE_RGBA; ++i)
-        *iter_mem++ = (acc_buffer[i] += *iter_data++);
+      /* the four channels of a cell are one vector, the running sum of
+         the row is added to the cell above */
+      __m128i zero = _mm_setzero_si128();
+      __m128i acc_buffer = zero;
+      for (x=0; x<width; ++x)
+      {
+        __m128i px = _mm_cvtsi32_si128(*(const int*)(iter_data + SIZE_RGBA*x));
+        px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+        acc_buffer = _mm_add_epi32(acc_buffer, px);
+        _mm_storeu_si128((__m128i*)(row + SIZE_RGBA*x),
+                         up ? _mm_add_epi32(acc_buffer, _mm_loadu_si128((const __m128i*)(up + SIZE_RGBA*(x+1))))
+                            : acc_buffer);
+      }
     }
-    
-    /* Process other rows. */
-    for (y=2; y<height; ++y)
+#else
     {
-      /* Copy upper line. */
-      memcpy(iter_mem, iter_mem - row_width, row_width * sizeof(uint32_t));
-      
-      /* Process row. */
-      memset(acc_buffer, 0, cell_size);
-      memset(iter_mem,   0, cell_size); /* first column is void */
-      iter_mem += SIZE_RGBA;
-      for (x=1; x<width; ++x)
+      uint32_t acc_buffer[SIZE_RGBA] = {0, 0, 0, 0}; /* accumulation buffer */
+      unsigned int i;
+      for (x=0; x<width; ++x)
       {
         for (i=0; i<SIZE_RGBA; ++i)
-          *iter_mem++ += (acc_buffer[i] += *iter_data++);
+        {
+          acc_buffer[i] += *iter_data++;
+          row[SIZE_RGBA*x + i] = acc_buffer[i] + (up ? up[SIZE_RGBA*(x+1) + i] : 0);
+        }
+      }
+    }
+#endif
+  }
+  return 0;
+}
+
+/* Adds the (final) row y0 of the summed area table to rows y0+1...y1-1,
+   the last row of the band has been done already. */
+static void* summed_area_carry(void *arg)
+{
+  blur_job_t *job = (blur_job_t*)arg;
+  unsigned int row_width = SIZE_RGBA * (job->inst->width+1);
+  const uint32_t *carry = job->inst->mem + job->y0*row_width;
+  unsigned int x, y;
+
+  for (y=job->y0+1; y<job->y1; ++y)
+  {
+    uint32_t *row = job->inst->mem + y*row_width;
+    for (x=SIZE_RGBA; x<row_width; ++x)
+      row[x] += carry[x];
+  }
+  return 0;
+}
+
+/* Updates the summed area table. The bands of rows are summed in
+   parallel, then each band adds the last row of the band above it. The
+   sums wrap around like the serial ones, so the result is the same for
+   any number of threads. */
+static void update_summed_area_table(squareblur_instance_t *inst, const uint32_t *src)
+{
+  blur_job_t jobs[FREI0R_MAX_THREADS];
+  unsigned int row_width = SIZE_RGBA * (inst->width+1);
+  int n = frei0r_thread_count((long)inst->width * inst->height);
+  int k;
+
+  if (n > (int)inst->height)
+    n = inst->height;
+  if (n < 1)
+    n = 1;
+
+  /* Process first row (all zeros). */
+  memset(inst->mem, 0, row_width * sizeof(uint32_t));
+
+  for (k=0; k<n; ++k)
+  {
+    jobs[k].inst = inst;
+    jobs[k].src = src;
+    jobs[k].y0 = (unsigned int)((unsigned long)inst->height * k / n);
+    jobs[k].y1 = (unsigned int)((unsigned long)inst->height * (k+1) / n);
+  }
+  frei0r_thread_run(summed_area_rows, jobs, sizeof(blur_job_t), n);
+  if (n == 1)
+    return;
+
+  /* The last rows of the bands, top to bottom, then the rest of them. */
+  for (k=1; k<n; ++k)
+  {
+    uint32_t *row = inst->mem + jobs[k].y1*row_width;
+    const uint32_t *carry = inst->mem + jobs[k].y0*row_width;
+    unsigned int x;
+    for (x=SIZE_RGBA; x<row_width; ++x)
+      row[x] += carry[x];
+  }
+  frei0r_thread_run(summed_area_carry, jobs + 1, sizeof(blur_job_t), n-1);
+}
+
+/* Takes the mean of each kernel for the rows of a band. */
+static void* blur_rows(void *arg)
+{
+  blur_job_t *job = (blur_job_t*)arg;
+  squareblur_instance_t *inst = job->inst;
+  unsigned int width = inst->width;
+  unsigned int height = inst->height;
+  unsigned int row_width = SIZE_RGBA * (width+1);
+  unsigned int kernel_size = job->kernel_size;
+  unsigned char *dst = job->dst + SIZE_RGBA*job->y0*width;
+
+  unsigned int x, y;
+  unsigned int x0, x1, y0, y1;
+  unsigned int area;
+#if defined(__SSE2__)
+  unsigned int last_area = 0;
+  __m128d scale = _mm_setzero_pd();
+  const __m128i sign = _mm_set1_epi32((int)0x80000000);
+  const __m128d unsign = _mm_set1_pd(2147483648.0 + 0.5);
+#else
+  uint32_t sum[SIZE_RGBA];
+#endif
+
+  for (y=job->y0; y<job->y1; y++)
+  {
+    const uint32_t *row0, *row1;
+
+    y0 = MAX(y - kernel_size, 0);
+    y1 = MIN(y + kernel_size + 1, height);
+    row0 = inst->mem + y0*row_width;
+    row1 = inst->mem + y1*row_width;
+
+    for (x=0; x<width; x++)
+    {
+      /* The kernel's coordinates. */
+      x0 = SIZE_RGBA * MAX(x - kernel_size, 0);
+      x1 = SIZE_RGBA * MIN(x + kernel_size + 1, width);
+
+      area = (x1-x0)/SIZE_RGBA*(y1-y0);
+
+#if defined(__SSE2__)
+      {
+        /* it is assumed that (x0,y0) <= (x1,y1) */
+        __m128i s = _mm_loadu_si128((const __m128i*)(row1 + x1));
+        __m128i lo, hi;
+        s = _mm_sub_epi32(s, _mm_loadu_si128((const __m128i*)(row1 + x0)));
+        s = _mm_sub_epi32(s, _mm_loadu_si128((const __m128i*)(row0 + x1)));
+        s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(row0 + x0)));
+
+        /* The sums are divided in double, (sum + 0.5) * (1 / area) is
+           always on the same side of the next integer as sum / area,
+           so truncating it gives the integer quotient. */
+        if (area != last_area)
+        {
+          scale = _mm_set1_pd(1.0 / area);
+          last_area = area;
+        }
+        s = _mm_xor_si128(s, sign);
+        lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(_mm_cvtepi32_pd(s), unsign), scale));
+        hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(s, 0xEE)), unsign), scale));
+        s = _mm_unpacklo_epi64(lo, hi);
+        s = _mm_packs_epi32(s, s);
+        *(int*)dst = _mm_cvtsi128_si32(_mm_packus_epi16(s, s));
       }
+#else
+      /* it is assumed that (x0,y0) <= (x1,y1) */
+      memcpy(sum, row1 + x1, SIZE_RGBA*sizeof(uint32_t));
+      subtract_acc(sum, row1 + x0);
+      subtract_acc(sum, row0 + x1);
+      add_acc(sum, row0 + x0);
+
+      /* Take the mean and copy it to output. */
+      divide(dst, sum, area);
+#endif
+
+      /* Increment iterator. */
+      dst += SIZE_RGBA;
     }
   }
+  return 0;
 }
 
 static void blur_get_param_info(f0r_param_info_t* info, int param_index)
@@ -143,25 +292,13 @@ static f0r_instance_t blur_construct(unsigned int width, unsigned int height)
 {
   squareblur_instance_t* inst = 
     (squareblur_instance_t*)malloc(sizeof(squareblur_instance_t));
-  unsigned int i;
-  unsigned int acc_width, acc_height = height+1;
-  uint32_t*  iter_mem;
-  uint32_t** iter_acc;
+  unsigned int acc_width, acc_height;
   /* set params */
   inst->width = width; inst->height = height;
   acc_width = width+1; acc_height = height+1;
   inst->kernel = 0.0;
   /* allocate memory for the summed-area-table */
   inst->mem = (uint32_t*) malloc(acc_width*acc_height*SIZE_RGBA*sizeof(uint32_t));
-  inst->acc = (uint32_t**) malloc(acc_width*acc_height*sizeof(uint32_t*));
-  /* point at the right place */
-  iter_mem = inst->mem;
-  iter_acc = inst->acc;
-  for (i=0; i<acc_width*acc_height; ++i)
-  {
-    *iter_acc++ = iter_mem;
-    iter_mem += SIZE_RGBA;
-  }
   return (f0r_instance_t)inst;
 }
 
@@ -169,7 +306,6 @@ static void blur_destruct(f0r_instance_t instance)
 {
   squareblur_instance_t* inst = 
     (squareblur_instance_t*)instance;
-  free(inst->acc);
   free(inst->mem);
   free(instance);
 }
@@ -211,13 +347,8 @@ static void blur_update(f0r_instance_t instance, double time,
   
   unsigned int width = inst->width;
   unsigned int height = inst->height;
-  unsigned int acc_width = width+1; /* width of the summed area table */
   unsigned int max = MAX(width, height);
   unsigned int kernel_size = (unsigned int) (inst->kernel * max / 2.0);
-
-  unsigned int x, y;
-  unsigned int x0, x1, y0, y1;
-  unsigned int area;
   
   if (kernel_size <= 0)
   {
@@ -226,45 +357,26 @@ static void blur_update(f0r_instance_t instance, double time,
   }
   else
   {
-    assert(inst->acc);
-    unsigned char* dst = (unsigned char*)outframe;
-    uint32_t** acc = inst->acc;
-    uint32_t sum[SIZE_RGBA];
-    unsigned int y0_offset, y1_offset;
-    
+    blur_job_t jobs[FREI0R_MAX_THREADS];
+    int n = frei0r_thread_count((long)width * height);
+    int k;
+
+    assert(inst->mem);
+    if (n > (int)height)
+      n = height;
+
     /* Compute the summed area table. */
     update_summed_area_table(inst, inframe);
     
-    /* Loop through the image's pixels. */
-    for (y=0;y<height;y++)
+    /* Loop through the image's pixels, a band of rows per thread. */
+    for (k=0; k<n; ++k)
     {
-      for (x=0;x<width;x++)
-      {
-        /* The kernel's coordinates. */
-        x0 = MAX(x - kernel_size, 0);
-        x1 = MIN(x + kernel_size + 1, width);
-        y0 = MAX(y - kernel_size, 0);
-        y1 = MIN(y + kernel_size + 1, height);
-        
-        /* Get the sum in the current kernel. */
-        area = (x1-x0)*(y1-y0);
-        
-        y0_offset = y0*acc_width;
-        y1_offset = y1*acc_width;
-        
-        /* it is assumed that (x0,y0) <= (x1,y1) */
-        memcpy(sum, acc[y1_offset + x1], SIZE_RGBA*sizeof(uint32_t));
-        subtract_acc(sum, acc[y1_offset + x0]);
-        subtract_acc(sum, acc[y0_offset + x1]);
-        add_acc(sum, acc[y0_offset + x0]);
-        
-        /* Take the mean and copy it to output. */
-        divide(dst, sum, area);
-        
-        /* Increment iterator. */
-        dst += SIZE_RGBA;
-      }
+      jobs[k].inst = inst;
+      jobs[k].dst = (unsigned char*)outframe;
+      jobs[k].y0 = (unsigned int)((unsigned long)height * k / n);
+      jobs[k].y1 = (unsigned int)((unsigned long)height * (k+1) / n);
+      jobs[k].kernel_size = kernel_size;
     }
+    frei0r_thread_run(blur_rows, jobs, sizeof(blur_job_t), n);
   }
 }
-
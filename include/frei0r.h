@@ -40,6 +40,43 @@
  *
  * @section sec_changes Changes
  *
+ * @subsection sec_changes_ext Optional extensions to frei0r 1.2
+ *   - added optional \ref f0r_update_slice for slice-threaded processing
+ *   - added optional \ref f0r_get_plugin_info2 and \ref PLUGIN_CAPS
+ *   - added \ref sec_inplace
+ *   - added optional \ref f0r_update_stride for frames with padded rows
+ *   - added optional \ref f0r_update_batch for several frames per call
+ *   - added optional \ref f0r_get_stats for per-stage timings
+ *   - added optional \ref f0r_set_allocator for host-provided memory
+ *   - added optional \ref f0r_update_view for results kept by the effect
+ *   - added optional \ref f0r_set_frame_history for shared input history
+ *   - added \ref F0R_PLUGIN_TYPE_MIXERN and \ref f0r_update_layers
+ *   - added optional \ref f0r_seek for rendering from any frame
+ *   - added \ref f0r_get_plugin_by_index for bundles of plugins
+ *   - added \ref F0R_COLOR_MODEL_RGBA_FLOAT and \ref f0r_update_float
+ *   - added planar YUV color models and \ref f0r_update_planar
+ *   - added optional \ref f0r_get_footprint and \ref f0r_update_tile
+ *   - added optional \ref f0r_get_region for effects on part of the frame
+ *   - added optional \ref f0r_update_async for pipelined applications
+ *   - added optional \ref f0r_set_executor for the application's threads
+ *   - added optional \ref f0r_clone to branch an instance with its state
+ *   - added optional \ref f0r_save_state and \ref f0r_load_state
+ *   - added optional \ref f0r_set_param_curve for animated parameters
+ *   - added optional \ref f0r_is_identity for effects that change nothing
+ *   - added optional \ref f0r_set_quality for draft previews
+ *   - added optional \ref f0r_get_row_map for effects that only move rows
+ *   - added optional \ref f0r_get_active_rect for effects that add borders
+ *   - added optional \ref f0r_trim for instances that are kept idle
+ *   - added optional \ref f0r_resize for streams that change size
+ *   - added optional \ref f0r_get_memory_usage for the memory of instances
+ *   - added optional \ref f0r_set_deadline and \ref f0r_get_quality for
+ *     effects that keep to a time budget
+ *   - added optional \ref f0r_reset for instances that are reused
+ *   - added optional \ref f0r_set_proxy for statistics taken from a
+ *     downscaled input
+ *   - added \ref F0R_CAP_RB_SYMMETRIC for effects that take either order
+ *     of red and blue
+ *
  * @subsection sec_changes_1_1_1_2 From frei0r 1.1 to frei0r 1.2
  *   - make <vendor> in plugin path optional
  *   - added section on FREI0R_PATH environment variable
@@ -176,6 +213,12 @@
  * concurrent calls are allowed.
  *
  *
+ * - \ref f0r_set_executor
+ *
+ * This method may only be called while no other method of the plugin
+ * runs.
+ *
+ *
  * - \ref f0r_get_plugin_info
  * - \ref f0r_get_param_info
  * - \ref f0r_construct
@@ -188,10 +231,66 @@
  * - \ref f0r_get_param_value
  * - \ref f0r_update
  * - \ref f0r_update2
+ * - \ref f0r_update_stride
+ * - \ref f0r_update_batch
+ * - \ref f0r_get_stats
+ * - \ref f0r_set_allocator
+ * - \ref f0r_update_view
+ * - \ref f0r_set_frame_history
+ * - \ref f0r_seek
+ * - \ref f0r_update_float
+ * - \ref f0r_update_planar
+ * - \ref f0r_get_footprint
+ * - \ref f0r_get_region
+ * - \ref f0r_set_async_depth
+ * - \ref f0r_update_async
+ * - \ref f0r_wait_async
+ * - \ref f0r_clone
+ * - \ref f0r_save_state
+ * - \ref f0r_load_state
+ * - \ref f0r_set_param_curve
+ * - \ref f0r_is_identity
+ * - \ref f0r_set_quality
+ * - \ref f0r_get_row_map
+ * - \ref f0r_get_active_rect
+ * - \ref f0r_trim
+ * - \ref f0r_resize
+ * - \ref f0r_get_memory_usage
+ * - \ref f0r_set_deadline
+ * - \ref f0r_get_quality
+ * - \ref f0r_reset
+ * - \ref f0r_set_proxy
  *
  * If a thread is in one of these methods its allowed for another thread to
  * enter one of theses methods for a different effect instance. But for one
  * effect instance only one thread is allowed to execute any of these methods. 
+ *
+ *
+ * - \ref f0r_update_slice
+ *
+ * Several threads may call this method at the same time for one effect
+ * instance, as long as all of them work on the same frame (same time and
+ * frame pointers) and on disjoint row ranges. No other method may be called
+ * for that instance until all slices of the frame have returned.
+ *
+ *
+ * - \ref f0r_update_tile
+ *
+ * The same holds for the tiles of one frame: several threads may update
+ * disjoint tiles of the same output frame at the same time.
+ */
+
+/**
+ * \addtogroup inplace In-place processing
+ * @section sec_inplace In-place processing
+ *
+ * Unless the effect reports \ref F0R_CAP_INPLACE, inframe (inframe1 for
+ * \ref f0r_update2) and outframe must not overlap.
+ * If the flag is set, the application may pass the same buffer as inframe
+ * and outframe and the effect must produce the same result as with
+ * separate buffers. Other overlaps (e.g. frames shifted against each other)
+ * are never allowed. For mixers, the flag allows outframe to be the same
+ * buffer as any of the input frames.
  */
 
 
@@ -200,7 +299,7 @@
  * \brief This file defines the frei0r api, version 1.2.
  *
  * A conforming plugin must implement and export all functions declared in
- * this header.
+ * this header, except for the ones marked as optional.
  *
  * A conforming application must accept only those plugins which use
  * allowed values for the described fields.
@@ -210,6 +309,15 @@
 #define INCLUDED_FREI0R_H
 
 #include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * The functions declared here are the ones a plugin exports, also when it
+ * is built with hidden visibility for everything else (-fvisibility=hidden).
+ */
+#if defined(__GNUC__) && !defined(_WIN32)
+#pragma GCC visibility push(default)
+#endif
 
 /**
  * The frei0r API major version
@@ -235,11 +343,47 @@ int f0r_init(void);
  */
 void f0r_deinit(void);
 
+/**
+ * Threads of an application for effects that split their work, see
+ * \ref f0r_set_executor.
+ */
+typedef struct f0r_executor
+{
+  void* host;      /**< Passed on to parallel_for */
+  int concurrency; /**< How many indices parallel_for runs at once */
+  /**
+   * Calls fn(ctx, index) for every index of [begin, end), on any of the
+   * threads of the application and in any order, and returns when all
+   * calls have returned. The calling thread may take part.
+   */
+  void (*parallel_for)(void* host, int begin, int end,
+                       void (*fn)(void* ctx, int index), void* ctx);
+} f0r_executor_t;
+
+/**
+ * Optional function that hands the plugin the thread pool of the
+ * application. Effects that split frames over several threads then run
+ * the parts with executor->parallel_for, at most executor->concurrency at
+ * once, instead of starting threads of their own: with a chain of many
+ * effects on many cores one scheduler owns the cores and there are no
+ * more threads than cores. A concurrency of 1 makes the effects run
+ * serially.
+ *
+ * It holds for all instances of the plugin, and for all effects of a
+ * bundle whose table has it. The executor must stay valid until it is
+ * replaced, or until \ref f0r_deinit; 0 makes the effects use threads of
+ * their own again. Applications find this function with dlsym(); plugins
+ * that don't start threads don't have it.
+ *
+ * \param executor the thread pool of the application, or 0
+ */
+void f0r_set_executor(const f0r_executor_t* executor);
+
 //---------------------------------------------------------------------------
 
 /** \addtogroup PLUGIN_TYPE Type of the Plugin
  * These defines determine whether the plugin is a
- * source, a filter or one of the two mixer types
+ * source, a filter or one of the mixer types
  *  @{
  */
 
@@ -251,6 +395,8 @@ void f0r_deinit(void);
 #define F0R_PLUGIN_TYPE_MIXER2 2
 /** three inputs and one output */
 #define F0R_PLUGIN_TYPE_MIXER3 3
+/** any number of inputs and one output, see \ref f0r_update_layers */
+#define F0R_PLUGIN_TYPE_MIXERN 4
 
 /** @} */
 
@@ -318,8 +464,45 @@ void f0r_deinit(void);
  * only on pixels (for example a mirror effect).
  *
  * Note that source effects must not use this color model.
+ *
+ * Effects that work on the color components but treat red and blue
+ * alike, like an inversion or a blend mode, can't use PACKED32, which
+ * may also be YUV. They use RGBA8888 or BGRA8888 and report
+ * \ref F0R_CAP_RB_SYMMETRIC, so that applications can give them frames
+ * in the other of the two models without converting them.
  */
 #define F0R_COLOR_MODEL_PACKED32 2
+
+/**
+ * In RGBA_FLOAT, each pixel is represented by 4 consecutive floats,
+ * red, green, blue and alpha, where 0.0 and 1.0 correspond to the byte
+ * values 0 and 255 of RGBA8888. Values outside of this range are allowed,
+ * so that chains of effects keep what the 8 bit models would clip. A
+ * pixel takes 16 bytes, the other constraints above apply as they are.
+ *
+ * This color model is only used for the frames of \ref f0r_update_float;
+ * the color_model of an effect still names the 8 bit model of its
+ * \ref f0r_update, so that older applications don't ignore it.
+ */
+#define F0R_COLOR_MODEL_RGBA_FLOAT 3
+
+/**
+ * In YUV420P (I420), a frame consists of three planes of bytes: luma
+ * (Y) at full size, then the U and V chroma planes at half the width and
+ * half the height. Chroma is centered on 128. The effects process the
+ * values as they come, whatever the range and matrix of the video.
+ *
+ * Like NV12, this color model is only used for the frames of
+ * \ref f0r_update_planar, see \ref f0r_planar_frame_t.
+ */
+#define F0R_COLOR_MODEL_YUV420P 4
+
+/**
+ * In NV12, a frame consists of the luma plane at full size and a single
+ * chroma plane at half the height, in which U and V alternate, U first.
+ * Otherwise it is the same as \ref F0R_COLOR_MODEL_YUV420P.
+ */
+#define F0R_COLOR_MODEL_NV12 5
 /*@}*/
 
 /**
@@ -362,6 +545,61 @@ typedef struct f0r_plugin_info
  */
 void f0r_get_plugin_info(f0r_plugin_info_t* info);
 
+/** \addtogroup PLUGIN_CAPS Plugin Capabilities
+ * Bit flags describing how an effect may be scheduled by the application.
+ * They are reported by the optional \ref f0r_get_plugin_info2.
+ * If a flag is not set, the application must assume the conservative
+ * behaviour.
+ *  @{
+ */
+
+/** different instances may be updated by different threads at the same time */
+#define F0R_CAP_REENTRANT 0x1
+/** the output frame may be the same buffer as the first input frame */
+#define F0R_CAP_INPLACE   0x2
+/** the output depends on previously processed frames */
+#define F0R_CAP_TEMPORAL  0x4
+/** the instances support \ref f0r_update_slice */
+#define F0R_CAP_SLICE     0x8
+/** the instances support \ref f0r_seek */
+#define F0R_CAP_SEEK      0x10
+/** the instances support \ref f0r_update_float */
+#define F0R_CAP_FLOAT     0x20
+/** the instances support \ref f0r_update_planar */
+#define F0R_CAP_PLANAR    0x40
+/** the instances support \ref f0r_update_tile for any tile */
+#define F0R_CAP_TILE      0x80
+/** the instances support \ref f0r_update_async */
+#define F0R_CAP_ASYNC     0x100
+/** the instances support \ref f0r_clone */
+#define F0R_CAP_CLONE     0x200
+/** the instances support \ref f0r_save_state and \ref f0r_load_state */
+#define F0R_CAP_STATE     0x400
+/** red and blue are treated alike and no parameter is a color: the
+ *  effect may be given BGRA8888 frames instead of RGBA8888 ones or the
+ *  reverse, and gives the same results with red and blue swapped */
+#define F0R_CAP_RB_SYMMETRIC 0x800
+
+/** @} */
+
+/**
+ * Extended plugin information, see \ref f0r_get_plugin_info2.
+ */
+typedef struct f0r_plugin_info2
+{
+  f0r_plugin_info_t info;    /**< The same as filled in by f0r_get_plugin_info */
+  unsigned int capabilities; /**< Bitwise or of \ref PLUGIN_CAPS flags      */
+} f0r_plugin_info2_t;
+
+/**
+ * Optional extended version of \ref f0r_get_plugin_info, which in addition
+ * reports the capabilities of the effect. Applications find this function
+ * with dlsym(). If it is not exported, no capability may be assumed.
+ *
+ * \param info Pointer to an info struct allocated by the application.
+ */
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info);
+
 //---------------------------------------------------------------------------
 
 /** \addtogroup PARAM_TYPE Parameter Types
@@ -556,6 +794,9 @@ void f0r_get_param_value(f0r_instance_t instance,
  * inframe and outframe must be aligned to an integer multiple of 16 bytes
  * in memory.
  *
+ * The rules of \ref sec_inplace say when inframe and outframe may be the
+ * same buffer.
+ *
  * This function should not alter the parameters of the effect in any
  * way (\ref f0r_get_param_value should return the same values after a call
  * to \ref f0r_update as before the call).
@@ -609,4 +850,1067 @@ void f0r_update2(f0r_instance_t instance,
 		 uint32_t* outframe);
 //---------------------------------------------------------------------------
 
+/**
+ * Optional slice-based variant of \ref f0r_update2. Instead of the whole
+ * frame only the rows [row_begin, row_end) of outframe are computed. The
+ * frame pointers always point to the start of the full frames, so effects
+ * may read rows outside the slice from the input frames.
+ *
+ * Applications find this function with dlsym() and may split a frame into
+ * slices that are processed by different threads (see \ref concurrency).
+ * An effect only supports slices if all of its output rows can be computed
+ * independently of each other and of the order in which the slices are
+ * processed. An effect that can't do this returns 0, in which case the
+ * application must use \ref f0r_update or \ref f0r_update2 for the whole
+ * frame instead. Calling it with row_begin == row_end does no work and can
+ * be used to probe an instance.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds, the same for all slices of
+ *        a frame
+ * \param inframe1 the first incoming video frame (can be zero for sources)
+ * \param inframe2 the second incoming video frame
+ *        (can be zero for sources and filters)
+ * \param inframe3 the third incoming video frame
+ *        (can be zero for sources, filters and mixer2)
+ * \param outframe the resulting video frame
+ * \param row_begin the first row of the slice
+ * \param row_end one past the last row of the slice, at most the height
+ * \param thread_index index of the calling worker thread, starting at 0.
+ *        It is unique among the threads working on one frame, so effects
+ *        may use it to pick per-thread scratch memory.
+ * \returns 1 if the slice was processed, 0 if the instance does not
+ *        support slices
+ *
+ * \see f0r_update2
+ */
+int f0r_update_slice(f0r_instance_t instance,
+		     double time,
+		     const uint32_t* inframe1,
+		     const uint32_t* inframe2,
+		     const uint32_t* inframe3,
+		     uint32_t* outframe,
+		     unsigned int row_begin,
+		     unsigned int row_end,
+		     unsigned int thread_index);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional variant of \ref f0r_update2 for frames whose rows are not
+ * tightly packed, e.g. decoder surfaces with padding at the end of each
+ * row or sub-rectangles of a larger image. Each frame comes with a stride,
+ * the distance in bytes from the start of one row to the start of the
+ * next. A stride must be a multiple of 16 and its absolute value at least
+ * width*4. A negative stride means the rows are stored bottom-up, the
+ * frame pointer still points to the first (top) row.
+ *
+ * Applications find this function with dlsym(). An effect that can't
+ * handle the given strides returns 0 without touching outframe, in which
+ * case the application must repack the frames and use \ref f0r_update2.
+ * With strides of width*4 this function behaves like \ref f0r_update2.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframe1 the first incoming video frame (can be zero for sources)
+ * \param inframe1_stride the stride of inframe1 in bytes
+ * \param inframe2 the second incoming video frame
+ *        (can be zero for sources and filters)
+ * \param inframe2_stride the stride of inframe2 in bytes
+ * \param inframe3 the third incoming video frame
+ *        (can be zero for sources, filters and mixer2)
+ * \param inframe3_stride the stride of inframe3 in bytes
+ * \param outframe the resulting video frame
+ * \param outframe_stride the stride of outframe in bytes
+ * \returns 1 if the frame was processed, 0 if the instance does not
+ *        support these strides
+ *
+ * \see f0r_update2
+ */
+int f0r_update_stride(f0r_instance_t instance,
+		      double time,
+		      const uint32_t* inframe1, int inframe1_stride,
+		      const uint32_t* inframe2, int inframe2_stride,
+		      const uint32_t* inframe3, int inframe3_stride,
+		      uint32_t* outframe, int outframe_stride);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional batch variant of \ref f0r_update2 that processes count frames
+ * in one call. It must give the same results as count calls of
+ * \ref f0r_update2 with times[i], inframes1[i], inframes2[i],
+ * inframes3[i] and outframes[i], in this order, so temporal effects see
+ * the frames in sequence. It lets effects do their per-call setup only
+ * once per batch.
+ *
+ * Applications find this function with dlsym(). An array may be zero when
+ * the corresponding frames would all be zero for \ref f0r_update2. The
+ * rules of \ref sec_inplace apply to each frame of the batch; apart from
+ * that an output frame must not overlap with any other frame of the batch.
+ *
+ * \param instance the effect instance
+ * \param count the number of frames in the batch
+ * \param times the application time of each frame in seconds
+ * \param inframes1 the first incoming video frames
+ *        (can be zero for sources)
+ * \param inframes2 the second incoming video frames
+ *        (can be zero for sources and filters)
+ * \param inframes3 the third incoming video frames
+ *        (can be zero for sources, filters and mixer2)
+ * \param outframes the resulting video frames
+ *
+ * \see f0r_update2
+ */
+void f0r_update_batch(f0r_instance_t instance,
+		      unsigned int count,
+		      const double* times,
+		      const uint32_t* const* inframes1,
+		      const uint32_t* const* inframes2,
+		      const uint32_t* const* inframes3,
+		      uint32_t* const* outframes);
+//---------------------------------------------------------------------------
+
+/**
+ * Timing of one internal stage of an effect, see \ref f0r_get_stats.
+ */
+typedef struct f0r_stat_info
+{
+  const char* name;    /**< The name of the stage */
+  unsigned long calls; /**< How often the stage ran */
+  double seconds;      /**< Total time spent in the stage, in seconds */
+  double max_seconds;  /**< Longest single run of the stage, in seconds */
+} f0r_stat_info_t;
+
+/**
+ * Optional query for the time an effect instance spent in each of its
+ * internal stages (e.g. mask generation, blurring) since it was
+ * constructed. It helps applications to find out which part of an
+ * expensive effect eats the frame budget.
+ *
+ * Applications find this function with dlsym(). Effects usually only
+ * export it when they were built with instrumentation enabled. The
+ * returned names stay valid until the instance is destructed.
+ *
+ * \param instance the effect instance
+ * \param stats array that receives the timings of at most count stages
+ * \param count the number of elements in stats, may be 0
+ * \returns the number of stages of the instance, which may be greater
+ *        than count
+ */
+int f0r_get_stats(f0r_instance_t instance,
+		  f0r_stat_info_t* stats,
+		  int count);
+//---------------------------------------------------------------------------
+
+/**
+ * Memory callbacks of an application, see \ref f0r_set_allocator.
+ */
+typedef struct f0r_allocator
+{
+  /** Returns size bytes aligned to alignment (a power of two), or 0 */
+  void* (*alloc)(void* opaque, size_t size, size_t alignment);
+  /** Releases memory returned by alloc */
+  void (*free)(void* opaque, void* ptr);
+  /** Passed to alloc and free */
+  void* opaque;
+} f0r_allocator_t;
+
+/**
+ * Optional function that makes an effect instance take the scratch memory
+ * it needs during updates from the application, e.g. from a per-thread
+ * pool, instead of from the C library. Effects keep this memory in an
+ * arena that they reset at the start of every update, so once the arena
+ * is big enough for a frame they don't allocate anymore.
+ *
+ * Applications find this function with dlsym(). The effect releases all
+ * memory it got from the previous allocator before it returns, and uses
+ * the new one until the instance is destructed or this function is called
+ * again. The allocator must stay usable until then. Memory for the
+ * instance itself is not affected.
+ *
+ * \param instance the effect instance
+ * \param allocator the callbacks to use, or 0 to use the C library again.
+ *        The effect keeps a copy of it.
+ */
+void f0r_set_allocator(f0r_instance_t instance,
+		       const f0r_allocator_t* allocator);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional variant of \ref f0r_update2 for effects that keep their result
+ * in a frame of their own, e.g. delay lines. Instead of copying it to an
+ * output frame the effect returns a pointer to it.
+ *
+ * Applications find this function with dlsym(). The returned frame must
+ * not be written to and stays valid until the next call of an update
+ * function or \ref f0r_destruct for this instance. If the effect can't
+ * provide such a frame right now, it returns 0 without doing anything,
+ * and the application must use \ref f0r_update2 for this frame instead.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframe1 the first incoming video frame (can be zero for sources)
+ * \param inframe2 the second incoming video frame
+ *        (can be zero for sources and filters)
+ * \param inframe3 the third incoming video frame
+ *        (can be zero for sources, filters and mixer2)
+ * \returns the resulting video frame, or 0
+ *
+ * \see f0r_update2
+ */
+const uint32_t* f0r_update_view(f0r_instance_t instance,
+				double time,
+				const uint32_t* inframe1,
+				const uint32_t* inframe2,
+				const uint32_t* inframe3);
+//---------------------------------------------------------------------------
+
+/**
+ * Access to the application's history of an input stream, see
+ * \ref f0r_set_frame_history.
+ */
+typedef struct f0r_frame_history
+{
+  /**
+   * Returns the frame of the stream that came age frames before the
+   * current one; age 0 is the frame passed to the current update. The
+   * frame's time is stored in *time unless time is 0. Returns 0 if the
+   * application doesn't keep that frame.
+   */
+  const uint32_t* (*get_frame)(void* opaque, unsigned int age, double* time);
+  /** Passed to get_frame */
+  void* opaque;
+} f0r_frame_history_t;
+
+/**
+ * Optional function for temporal effects that keep copies of their past
+ * input frames. If the application keeps the recent frames of the first
+ * input stream anyway, e.g. because several temporal effects are applied
+ * to it, it can hand them out through history. The effect then reads past
+ * frames from there instead of keeping its own copies, so the history of
+ * one stream is stored only once.
+ *
+ * Applications find this function with dlsym(). The frames must have the
+ * size of the instance, and get_frame must only be called from within
+ * the effect's update functions. Frame 0 must be the frame the effect
+ * gets as inframe1.
+ *
+ * \param instance the effect instance
+ * \param history the application's history, or 0 to make the effect keep
+ *        its own copies again. The effect keeps a copy of the struct.
+ * \returns the number of frames, including the current one, the effect
+ *        asks for, so that the application knows how many to keep; 0 if
+ *        the effect doesn't use a history of its input
+ */
+int f0r_set_frame_history(f0r_instance_t instance,
+			  const f0r_frame_history_t* history);
+//---------------------------------------------------------------------------
+
+/**
+ * Update function for effects of type \ref F0R_PLUGIN_TYPE_MIXERN, which
+ * combine any number of input frames into one, e.g. a stack of layers in
+ * a single pass instead of a chain of mixer2 effects with an intermediate
+ * frame between each pair. Like \ref f0r_update_slice only the rows
+ * [row_begin, row_end) of outframe are computed; the application passes
+ * 0 and the height of the frame to update the whole frame.
+ *
+ * If the effect reports \ref F0R_CAP_SLICE, different slices of a frame
+ * may be processed by different threads at the same time. If it reports
+ * \ref F0R_CAP_INPLACE, outframe may be the same buffer as inframes[0];
+ * it must never overlap with any of the other input frames.
+ *
+ * Effects of this type also export \ref f0r_update2, which uses the
+ * non-zero frames among inframe1, inframe2 and inframe3 as the inputs.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframes the incoming video frames, none of them zero
+ * \param count the number of incoming video frames, at least 1
+ * \param outframe the resulting video frame
+ * \param row_begin the first row of the slice
+ * \param row_end one past the last row of the slice, at most the height
+ * \returns 1 if the frames were processed, 0 if the instance does not
+ *        support this call
+ */
+int f0r_update_layers(f0r_instance_t instance,
+		      double time,
+		      const uint32_t* const* inframes,
+		      unsigned int count,
+		      uint32_t* outframe,
+		      unsigned int row_begin,
+		      unsigned int row_end);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function for effects whose output depends on the frames they
+ * made before, e.g. generators that run a simulation one step per
+ * update. It brings the instance into the state it would have after
+ * f0r_construct and one update for each of the frames 0 to frame - 1,
+ * with the current parameter values, so that the next update gives frame
+ * number frame of that render. Effects find the state in closed form
+ * where they can, or run their steps without drawing them.
+ *
+ * This lets an application start a render anywhere, e.g. to split a long
+ * render into chunks for several machines, without updating every frame
+ * from the start. Effects that support it report \ref F0R_CAP_SEEK.
+ *
+ * \param instance the effect instance
+ * \param time the application time of the next update in seconds
+ * \param frame the number of the next update, counting from 0 for the
+ *        first update after f0r_construct
+ * \returns 1 if the instance is now at frame, 0 if it can't seek and the
+ *        application has to update all frames before instead
+ */
+int f0r_seek(f0r_instance_t instance, double time, uint64_t frame);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional variant of \ref f0r_update2 for frames in the
+ * \ref F0R_COLOR_MODEL_RGBA_FLOAT color model. Effects that work in
+ * floating point anyway report \ref F0R_CAP_FLOAT and provide it, so that
+ * an application that runs a chain of them can pass float frames from one
+ * to the next instead of rounding to 8 bits and converting back between
+ * each two. Given the frames of \ref f0r_update2 converted to float, the
+ * result is that of \ref f0r_update2 before it is rounded to 8 bits.
+ *
+ * Applications find this function with dlsym(). An effect that can't
+ * process float frames with its current parameters returns 0 without
+ * touching outframe, and the application must use \ref f0r_update2 for
+ * this frame instead. The rules of \ref sec_inplace apply.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframe1 the first incoming video frame (can be zero for sources)
+ * \param inframe2 the second incoming video frame
+ *        (can be zero for sources and filters)
+ * \param inframe3 the third incoming video frame
+ *        (can be zero for sources, filters and mixer2)
+ * \param outframe the resulting video frame
+ * \returns 1 if the frame was processed, 0 if not
+ *
+ * \see f0r_update2
+ */
+int f0r_update_float(f0r_instance_t instance,
+		     double time,
+		     const float* inframe1,
+		     const float* inframe2,
+		     const float* inframe3,
+		     float* outframe);
+//---------------------------------------------------------------------------
+
+/**
+ * A frame of a planar color model, see \ref f0r_update_planar. The
+ * planes need not be adjacent, and each has a stride of its own, the
+ * distance in bytes from the start of one row to the start of the next.
+ * Strides are positive and at least the width of a row of the plane.
+ */
+typedef struct f0r_planar_frame
+{
+  int color_model;    /**< \ref F0R_COLOR_MODEL_YUV420P or \ref F0R_COLOR_MODEL_NV12 */
+  uint8_t* planes[3]; /**< Y, U and V, or Y, UV and 0 for NV12 */
+  int strides[3];     /**< The stride of each plane in bytes */
+} f0r_planar_frame_t;
+
+/**
+ * Optional variant of \ref f0r_update for filters, on frames in a planar
+ * YUV color model as video decoders and encoders use them. Effects that
+ * only work on luma, or on each channel by itself, report
+ * \ref F0R_CAP_PLANAR and provide it, so that an application can run them
+ * without converting each frame to RGBA and back. The result is that of
+ * the effect applied to the YUV frame: e.g. a grayscale effect keeps luma
+ * and sets chroma to 128, which isn't exactly what it computes from RGB.
+ *
+ * Applications find this function with dlsym(). inframe and outframe
+ * must have the same color model. An effect that doesn't support the
+ * color model, or can't process it with its current parameters, returns
+ * 0 without touching outframe, and the application must convert the
+ * frame and use \ref f0r_update instead. The rules of \ref sec_inplace
+ * apply to each plane.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframe the incoming video frame, which is not changed
+ * \param outframe the resulting video frame
+ * \returns 1 if the frame was processed, 0 if not
+ *
+ * \see f0r_update
+ */
+int f0r_update_planar(f0r_instance_t instance,
+		      double time,
+		      const f0r_planar_frame_t* inframe,
+		      const f0r_planar_frame_t* outframe);
+//---------------------------------------------------------------------------
+
+/** \ref f0r_get_footprint of effects that may read the whole input frame */
+#define F0R_FOOTPRINT_FULL (-1)
+
+/**
+ * Optional function that tells how far from an output pixel the input
+ * pixels lie that it depends on, with the current parameters: 0 for
+ * pointwise effects, 1 for 3x3 kernels, the radius for blurs, and
+ * \ref F0R_FOOTPRINT_FULL for effects that may read anywhere, like warps
+ * and effects that use statistics of the whole frame. An application
+ * that runs a chain of effects tile by tile, so that the tiles stay in
+ * the cache, grows each tile by this halo for the effect before.
+ *
+ * Applications find this function with dlsym(), if it is missing the
+ * footprint is \ref F0R_FOOTPRINT_FULL. It may change when parameters are
+ * set.
+ *
+ * \param instance the effect instance
+ * \returns the halo in pixels in each direction, or
+ *          \ref F0R_FOOTPRINT_FULL
+ */
+int f0r_get_footprint(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/**
+ * A rectangle of a frame, in pixels from its top left corner.
+ */
+typedef struct f0r_rect
+{
+  int x;      /**< The first column */
+  int y;      /**< The first row */
+  int width;  /**< The number of columns */
+  int height; /**< The number of rows */
+} f0r_rect_t;
+
+/**
+ * Optional variant of \ref f0r_update for filters that computes one tile
+ * of the output frame, the rectangle outrect, from the part inrect of
+ * the input frame. inrect must contain outrect grown by
+ * \ref f0r_get_footprint on each side, as far as that lies in the frame.
+ * inframe points to the first pixel of inrect and outframe to the first
+ * pixel of outrect, the strides are the distances in bytes between the
+ * rows and multiples of 4. The tiles of one frame may come in any order,
+ * all with the same time, and give the frame that \ref f0r_update would.
+ *
+ * Applications find this function with dlsym(). Effects report
+ * \ref F0R_CAP_TILE if they handle any tile. Without it, or for a tile the
+ * effect can't handle, it returns 0 without touching outframe, and the
+ * application must use \ref f0r_update for the whole frame instead.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframe the first pixel of inrect in the incoming video frame
+ * \param inframe_stride the stride of inframe in bytes
+ * \param inrect the part of the incoming video frame at inframe
+ * \param outframe the first pixel of outrect in the resulting video frame
+ * \param outframe_stride the stride of outframe in bytes
+ * \param outrect the tile to compute
+ * \returns 1 if the tile was computed, 0 if not
+ *
+ * \see f0r_get_footprint
+ */
+int f0r_update_tile(f0r_instance_t instance,
+		    double time,
+		    const uint32_t* inframe, int inframe_stride,
+		    const f0r_rect_t* inrect,
+		    uint32_t* outframe, int outframe_stride,
+		    const f0r_rect_t* outrect);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function for effects that only change part of the frame, like
+ * overlays and masks of a small shape: it gives the rectangle outside of
+ * which the output of the next update is the input, with the current
+ * parameters. The application then copies the rest of the frame, or
+ * leaves it as it is when updating in place, and only computes the
+ * rectangle, with \ref f0r_update_tile if the effect has it. An empty
+ * rectangle means that the output is the input.
+ *
+ * Applications find this function with dlsym(). Without it, or when it
+ * returns 0, the whole frame may change. Effects that make data for the
+ * next update when parameters were set, like a mask, may do that here,
+ * so that the tiles of the rectangle can be computed on several threads
+ * afterwards.
+ *
+ * \param instance the effect instance
+ * \param rect the rectangle of the frame that may change
+ * \returns 1 if rect was set, 0 if the whole frame may change
+ *
+ * \see f0r_update_tile
+ */
+int f0r_get_region(f0r_instance_t instance, f0r_rect_t* rect);
+//---------------------------------------------------------------------------
+
+/**
+ * Called by the effect when a frame of \ref f0r_update_async is done, on
+ * a thread of the effect, with the arguments of the submission.
+ */
+typedef void (*f0r_async_done_t)(void* user, double time, uint32_t* outframe);
+
+/**
+ * Optional function that sets how many frames of \ref f0r_update_async
+ * may be in flight at once, 1 by default. A larger depth lets the effect
+ * work ahead while the application fills the next frames, at the cost of
+ * keeping more frames alive. Only called with no frames in flight.
+ *
+ * \param instance the effect instance
+ * \param depth the wanted number of frames in flight
+ * \returns the number the effect allows, at least 1, or 0 if it
+ *          doesn't support \ref f0r_update_async
+ */
+int f0r_set_async_depth(f0r_instance_t instance, int depth);
+
+/**
+ * Optional variant of \ref f0r_update2 that returns before the frame is
+ * done, so that an application can decode and encode other frames while
+ * the effect works, without a thread of its own for every instance. The
+ * effect computes the frames in the order they are submitted and calls
+ * done for each of them when outframe is complete; the frames must stay
+ * valid until then. When as many frames as the depth of
+ * \ref f0r_set_async_depth are in flight, the call waits for the first
+ * of them to be done.
+ *
+ * While frames are in flight the application may call
+ * \ref f0r_set_param_value, which takes effect for the frames submitted
+ * after it, \ref f0r_update_async and \ref f0r_wait_async. Everything
+ * else waits for \ref f0r_wait_async first.
+ *
+ * Applications find this function with dlsym(). Effects report
+ * \ref F0R_CAP_ASYNC if they support it; without it, or if it returns 0,
+ * the application calls \ref f0r_update or \ref f0r_update2 instead.
+ *
+ * \param instance the effect instance
+ * \param time the application time in seconds
+ * \param inframe1 the first incoming video frame (can be zero for sources)
+ * \param inframe2 the second incoming video frame
+ *        (can be zero for sources and filters)
+ * \param inframe3 the third incoming video frame
+ *        (can be zero for sources, filters and mixer2)
+ * \param outframe the resulting video frame
+ * \param done called when outframe is complete
+ * \param user passed on to done
+ * \returns 1 if the frame was submitted, 0 if not
+ *
+ * \see f0r_wait_async
+ */
+int f0r_update_async(f0r_instance_t instance,
+		     double time,
+		     const uint32_t* inframe1,
+		     const uint32_t* inframe2,
+		     const uint32_t* inframe3,
+		     uint32_t* outframe,
+		     f0r_async_done_t done,
+		     void* user);
+
+/**
+ * Waits until all frames of \ref f0r_update_async are done.
+ *
+ * \param instance the effect instance
+ */
+void f0r_wait_async(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function that creates a new instance of the same size as
+ * instance, with the same parameter values and the same internal state,
+ * e.g. the frames a temporal effect keeps. Both instances are then
+ * independent: updating either gives the frames the original would
+ * have given, so an application can render alternate takes from any
+ * point without constructing an instance and updating all the frames
+ * before once more.
+ *
+ * The clone shares a history of \ref f0r_set_frame_history with the
+ * original; the application calls f0r_set_frame_history again for it to
+ * give it another one. Effects that support it report
+ * \ref F0R_CAP_CLONE. The clone is destroyed with \ref f0r_destruct.
+ *
+ * \param instance the effect instance to copy
+ * \returns the new instance, or 0 if the effect can't copy its state
+ *          and the application has to construct the instance anew
+ */
+f0r_instance_t f0r_clone(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function that saves the internal state of an instance, e.g.
+ * the frames a temporal effect keeps, so that an instance of the same
+ * effect and size, possibly in another process or on another machine,
+ * continues from it with \ref f0r_load_state. This lets an application
+ * that splits a render into chunks start each chunk with the state the
+ * one before ended with, instead of updating frames before the chunk.
+ *
+ * The parameters are not part of the state, the application sets them
+ * itself. The format of the state belongs to the effect and its
+ * version, and only machines of the same byte order can exchange it.
+ * Effects that support it report \ref F0R_CAP_STATE.
+ *
+ * \param instance the effect instance
+ * \param buffer where the state is written, or 0 to ask for its size
+ * \param size the bytes at buffer
+ * \returns the size of the state in bytes, which is only complete in
+ *          buffer if it is not more than size, or 0 if the effect can't
+ *          save its state
+ */
+size_t f0r_save_state(f0r_instance_t instance, void* buffer, size_t size);
+
+/**
+ * Optional function that continues an instance from a state of
+ * \ref f0r_save_state.
+ *
+ * \param instance the effect instance
+ * \param buffer the state
+ * \param size the bytes of the state
+ * \returns 1 if the state was loaded, 0 if not. A state of another
+ *          effect, version or frame size leaves the instance unchanged;
+ *          after a damaged one the application constructs it anew.
+ */
+int f0r_load_state(f0r_instance_t instance, const void* buffer, size_t size);
+//---------------------------------------------------------------------------
+
+/** \addtogroup PARAM_KEYS Interpolation of parameter curves
+ * How the value of a key of \ref f0r_set_param_curve goes on to the
+ * next one.
+ * @{
+ */
+
+/** the value stays until the next key */
+#define F0R_KEY_HOLD   0
+/** straight to the value of the next key */
+#define F0R_KEY_LINEAR 1
+/** to the next value, starting and arriving slowly (smoothstep) */
+#define F0R_KEY_SMOOTH 2
+
+/** @} */
+
+/**
+ * A key of a parameter curve.
+ */
+typedef struct f0r_param_key
+{
+  double time;       /**< the application time of the key in seconds */
+  double value[3];   /**< the value: a double or bool in value[0], a
+                          color's r, g and b or a position's x and y */
+  int interpolation; /**< one of \ref PARAM_KEYS */
+} f0r_param_key_t;
+
+/**
+ * Optional function that animates a parameter with a curve through the
+ * given keys, instead of a call of \ref f0r_set_param_value for every
+ * frame. Before every update the effect sets the parameter to the value
+ * of the curve at the time argument of the update: the value of the
+ * first key before it, the value of the last key after it, and in
+ * between the interpolation of the key before. Effects can tell which
+ * parameters are animated and prepare for the values to come.
+ *
+ * The curves are evaluated by the update functions that process a whole
+ * frame. \ref f0r_update_slice, \ref f0r_update_tile and
+ * \ref f0r_update_layers, which several threads may call for parts of
+ * one frame, use the values of the last other update; applications keep
+ * calling \ref f0r_set_param_value for those.
+ *
+ * \param instance the effect instance
+ * \param param_index index of the parameter, which is not a string
+ * \param keys the keys, by increasing time; copied by the effect
+ * \param count the number of keys. 0 ends the animation, the parameter
+ *        keeps its last value.
+ * \returns 1 if the parameter is animated now, or not any more if count
+ *          is 0, and 0 if the effect doesn't support it for the parameter
+ */
+int f0r_set_param_curve(f0r_instance_t instance, int param_index,
+                        const f0r_param_key_t* keys, unsigned int count);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function that tells whether the effect, with its parameters
+ * as they are now, leaves the frame as it is: the next update would
+ * write inframe1 to outframe unchanged, alpha included. Applications can
+ * then skip the update and use the input frame, or copy it if they need
+ * the output in outframe. Effects that keep a state over frames only
+ * say so if skipping the update doesn't change their output later.
+ *
+ * Parameters animated by \ref f0r_set_param_curve may change at the
+ * next update, so an effect with curves isn't an identity.
+ *
+ * \param instance the effect instance
+ * \returns 1 if the next update would copy the frame, 0 if not or if
+ *          the effect can't tell
+ */
+int f0r_is_identity(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/** \addtogroup QUALITY Render quality
+ * The quality an application asks for with \ref f0r_set_quality.
+ * @{
+ */
+
+/** fast previews, e.g. while scrubbing the timeline */
+#define F0R_QUALITY_DRAFT  0
+/** the quality of effects that know nothing of it, the default */
+#define F0R_QUALITY_NORMAL 1
+/** the final render, where time matters least */
+#define F0R_QUALITY_FINAL  2
+
+/** @} */
+
+/**
+ * Optional function that trades quality for speed. In draft quality an
+ * effect may take shortcuts that show, like a cheaper interpolation,
+ * subsampled masks or a smaller search, to render previews faster. In
+ * final quality it may take more time than usual. Normal quality, which
+ * instances start with, is the output of effects without this function.
+ *
+ * The quality can change between any two updates. Effects that keep a
+ * state over frames may restart it when they leave draft quality.
+ *
+ * \param instance the effect instance
+ * \param quality one of \ref QUALITY
+ * \returns 1 if the output of the effect depends on the quality, 0 if
+ *          it renders the same in all of them
+ */
+int f0r_set_quality(f0r_instance_t instance, int quality);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function that tells whether the next update would only move
+ * whole rows: row y of outframe would be a copy of row rows[y] of
+ * inframe1, alpha included. Applications that take frames as rows can
+ * then skip the update and point each output row at its input row, or
+ * copy the rows themselves. A map of rows in reverse order, like that
+ * of a vertical flip, is the input frame read bottom-up, with a negative
+ * stride. Effects that keep a state over frames only say so if skipping
+ * the update doesn't change their output later.
+ *
+ * Parameters animated by \ref f0r_set_param_curve may change at the
+ * next update, so an effect with curves has no row map.
+ *
+ * \param instance the effect instance
+ * \param rows the input row of each output row, height entries filled
+ *        by the effect
+ * \returns 1 if the next update would copy the rows in rows, 0 if not
+ *          or if the effect can't tell; rows is undefined then
+ */
+int f0r_get_row_map(f0r_instance_t instance, unsigned int* rows);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function for effects that fill the frame around a picture
+ * with one color, like letterboxes and frames: it gives the rectangle of
+ * the output of the next update that holds the picture, every pixel
+ * outside of which will be fill. Applications can pass the rectangle on,
+ * so that the effects after this one only process the picture and copy
+ * or keep the borders, and can draw the borders themselves when
+ * compositing.
+ *
+ * Parameters animated by \ref f0r_set_param_curve may change at the
+ * next update, so an effect with curves has no active rectangle.
+ *
+ * \param instance the effect instance
+ * \param rect the rectangle of the frame with the picture, filled by the
+ *        effect; it may be empty
+ * \param fill the pixel outside of rect, in the color model of the effect
+ * \returns 1 if rect and fill were set, 0 if the whole frame may be
+ *          picture
+ */
+int f0r_get_active_rect(f0r_instance_t instance, f0r_rect_t* rect,
+                        uint32_t* fill);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function that frees the memory an instance allocates for its
+ * updates: frame buffers, histories and scratch memory. Effects allocate
+ * such memory at their first update rather than in \ref f0r_construct,
+ * so instances that are only constructed to list their parameters or to
+ * render a single thumbnail stay small; applications that keep instances
+ * around, like an effect browser or a timeline with inactive clips, call
+ * this once an instance has not been rendered for as long as they
+ * choose, and the next update allocates again.
+ *
+ * Parameters are kept. Whatever an effect kept from earlier frames is
+ * lost, so temporal effects start over at the next update as after
+ * \ref f0r_construct.
+ *
+ * \param instance the effect instance
+ * \returns 1 if the effect freed memory it had, 0 otherwise
+ */
+int f0r_trim(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function that changes the frame size of an instance, for
+ * streams whose size changes, like adaptive bitrate renditions. Without
+ * it applications destruct the instance and construct one of the new
+ * size, which builds the tables and loads the models the effect derives
+ * from its parameters again. With it the effect keeps those and only
+ * reallocates what depends on the size.
+ *
+ * Parameters are kept, as after \ref f0r_trim. Frames kept from earlier
+ * updates are of the old size, so temporal effects start over at the
+ * next update as after \ref f0r_construct. A history shared with
+ * \ref f0r_set_frame_history is forgotten and has to be set again.
+ *
+ * If the function returns 0 the instance is unchanged, still of the old
+ * size, and the application constructs a new one as before. Resizing to
+ * the size the instance already has changes nothing.
+ *
+ * \param instance the effect instance
+ * \param width the new width, a multiple of 8 like in \ref f0r_construct
+ * \param height the new height, a multiple of 8
+ * \returns 1 if the instance is now of the new size, 0 if the effect
+ *          can't change its size
+ */
+int f0r_resize(f0r_instance_t instance,
+               unsigned int width, unsigned int height);
+//---------------------------------------------------------------------------
+
+/**
+ * The memory of an instance, see \ref f0r_get_memory_usage.
+ */
+typedef struct f0r_memory_usage
+{
+  size_t resident; /**< bytes the instance holds between updates */
+  size_t touched;  /**< bytes an update of a whole frame reads or writes,
+                        its input and output frames included */
+} f0r_memory_usage_t;
+
+/**
+ * Optional function that tells how much memory an instance holds and
+ * how much of it an update works on, for applications that place
+ * instances on machines or threads by their memory and bandwidth.
+ *
+ * resident counts the frame buffers, histories, tables and scratch
+ * memory the instance has allocated so far, not the instance's own
+ * structure nor memory shared by all instances. Effects allocate at
+ * their first update, so resident grows then, and shrinks after
+ * \ref f0r_trim. touched is what the next update is expected to read
+ * and write with the current parameters, the frames passed to it
+ * included; memory read several times counts once.
+ *
+ * Without this function applications can only assume the frames of an
+ * update, which is too little for temporal effects.
+ *
+ * \param instance the effect instance
+ * \param usage receives the memory of the instance
+ * \returns 1 if usage was set, 0 if the effect can't tell
+ */
+int f0r_get_memory_usage(f0r_instance_t instance, f0r_memory_usage_t* usage);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function for live use, where a late frame is worse than a
+ * softer one. It gives the effect a time budget for each update: the
+ * effect times its own updates and, while their recent average is over
+ * the budget, renders in a lower quality (see \ref f0r_set_quality),
+ * down to draft. When it is well under the budget again it returns
+ * step by step to the quality set with \ref f0r_set_quality, never
+ * above it. A budget of 0, which instances start with, turns this off.
+ *
+ * Only effects whose speed depends on the quality have this function.
+ * The budget holds for the update functions that render whole frames
+ * (\ref f0r_update, \ref f0r_update2).
+ *
+ * \param instance the effect instance
+ * \param seconds the time budget of an update, 0 for none
+ * \returns 1 if the effect keeps to the budget, 0 if it can't
+ */
+int f0r_set_deadline(f0r_instance_t instance, double seconds);
+
+/**
+ * Optional function that tells the quality the effect rendered the last
+ * frame in, one of \ref QUALITY: the one of \ref f0r_set_quality, or a
+ * lower one chosen to keep to the budget of \ref f0r_set_deadline.
+ * Applications can report it, or mark the frames.
+ *
+ * \param instance the effect instance
+ * \returns the quality of the last update
+ */
+int f0r_get_quality(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function for applications that keep instances in a pool and
+ * reuse them for the next clip. It makes a temporal effect
+ * (\ref F0R_CAP_TEMPORAL) forget its earlier frames and everything it
+ * learned from them, so that the next update is like the first one after
+ * \ref f0r_construct with the current parameter values. The instance
+ * keeps its buffers and the tables it computed from the parameters, so
+ * this is much cheaper than constructing a new one.
+ *
+ * Effects without \ref F0R_CAP_TEMPORAL have nothing to forget and need
+ * not be reset.
+ *
+ * \param instance the effect instance
+ * \returns 1 if the instance starts over with the next update, 0 if it
+ *          can't; the application constructs a new instance then
+ */
+int f0r_reset(f0r_instance_t instance);
+//---------------------------------------------------------------------------
+
+/**
+ * Optional function for applications that have a downscaled copy of the
+ * input at hand anyway, e.g. from the scaler of their decoder or the
+ * preview. Effects that only take statistics of the input, like the
+ * histograms of an equalizer or the range of a normalizer, take them
+ * from the proxy, which has a fraction of the pixels, and apply them to
+ * the full input. On large frames this saves most of their time.
+ *
+ * proxy is the first input frame of the next update, scaled down to
+ * width x height, in the color model of the effect and without padding
+ * between rows. Its aspect ratio should be about that of the input. It
+ * belongs to the next call of \ref f0r_update or \ref f0r_update2 only
+ * and must stay valid until that returns; the effect forgets it after.
+ * A proxy of 0, or one larger than the input, is not used.
+ *
+ * The statistics of a proxy differ a little from those of the input, so
+ * the output does too; applications that need the output of the full
+ * input don't call this.
+ *
+ * \param instance the effect instance
+ * \param proxy the downscaled first input of the next update, or 0
+ * \param width the width of proxy
+ * \param height the height of proxy
+ * \returns 1 if the effect uses the proxy, 0 if it reads the input
+ */
+int f0r_set_proxy(f0r_instance_t instance, const uint32_t* proxy,
+                  unsigned int width, unsigned int height);
+//---------------------------------------------------------------------------
+
+/**
+ * The entry points of one effect in a plugin bundle, see
+ * \ref f0r_get_plugin_by_index. Each member is the function of the same
+ * name without the f0r_ prefix; the optional functions the effect does
+ * not implement are 0, as are those of f0r_update and f0r_update2 that
+ * it doesn't need for its type.
+ */
+typedef struct f0r_plugin_table
+{
+  const char* file; /**< name of the effect's own plugin file, e.g. "flippo" */
+  int (*init)(void);
+  void (*deinit)(void);
+  void (*get_plugin_info)(f0r_plugin_info_t* info);
+  void (*get_plugin_info2)(f0r_plugin_info2_t* info);
+  void (*get_param_info)(f0r_param_info_t* info, int param_index);
+  f0r_instance_t (*construct)(unsigned int width, unsigned int height);
+  void (*destruct)(f0r_instance_t instance);
+  void (*set_param_value)(f0r_instance_t instance,
+			  f0r_param_t param, int param_index);
+  void (*get_param_value)(f0r_instance_t instance,
+			  f0r_param_t param, int param_index);
+  void (*update)(f0r_instance_t instance,
+		 double time, const uint32_t* inframe, uint32_t* outframe);
+  void (*update2)(f0r_instance_t instance,
+		  double time,
+		  const uint32_t* inframe1,
+		  const uint32_t* inframe2,
+		  const uint32_t* inframe3,
+		  uint32_t* outframe);
+  int (*update_slice)(f0r_instance_t instance,
+		      double time,
+		      const uint32_t* inframe1,
+		      const uint32_t* inframe2,
+		      const uint32_t* inframe3,
+		      uint32_t* outframe,
+		      unsigned int row_begin,
+		      unsigned int row_end,
+		      unsigned int thread_index);
+  int (*update_stride)(f0r_instance_t instance,
+		       double time,
+		       const uint32_t* inframe1, int inframe1_stride,
+		       const uint32_t* inframe2, int inframe2_stride,
+		       const uint32_t* inframe3, int inframe3_stride,
+		       uint32_t* outframe, int outframe_stride);
+  void (*update_batch)(f0r_instance_t instance,
+		       unsigned int count,
+		       const double* times,
+		       const uint32_t* const* inframes1,
+		       const uint32_t* const* inframes2,
+		       const uint32_t* const* inframes3,
+		       uint32_t* const* outframes);
+  int (*get_stats)(f0r_instance_t instance,
+		   f0r_stat_info_t* stats,
+		   int count);
+  void (*set_allocator)(f0r_instance_t instance,
+			const f0r_allocator_t* allocator);
+  const uint32_t* (*update_view)(f0r_instance_t instance,
+				 double time,
+				 const uint32_t* inframe1,
+				 const uint32_t* inframe2,
+				 const uint32_t* inframe3);
+  int (*set_frame_history)(f0r_instance_t instance,
+			   const f0r_frame_history_t* history);
+  int (*update_layers)(f0r_instance_t instance,
+		       double time,
+		       const uint32_t* const* inframes,
+		       unsigned int count,
+		       uint32_t* outframe,
+		       unsigned int row_begin,
+		       unsigned int row_end);
+  int (*seek)(f0r_instance_t instance, double time, uint64_t frame);
+  int (*update_float)(f0r_instance_t instance,
+		      double time,
+		      const float* inframe1,
+		      const float* inframe2,
+		      const float* inframe3,
+		      float* outframe);
+  int (*update_planar)(f0r_instance_t instance,
+		       double time,
+		       const f0r_planar_frame_t* inframe,
+		       const f0r_planar_frame_t* outframe);
+  int (*get_footprint)(f0r_instance_t instance);
+  int (*update_tile)(f0r_instance_t instance,
+		     double time,
+		     const uint32_t* inframe, int inframe_stride,
+		     const f0r_rect_t* inrect,
+		     uint32_t* outframe, int outframe_stride,
+		     const f0r_rect_t* outrect);
+  int (*get_region)(f0r_instance_t instance, f0r_rect_t* rect);
+  int (*set_async_depth)(f0r_instance_t instance, int depth);
+  int (*update_async)(f0r_instance_t instance,
+		      double time,
+		      const uint32_t* inframe1,
+		      const uint32_t* inframe2,
+		      const uint32_t* inframe3,
+		      uint32_t* outframe,
+		      f0r_async_done_t done,
+		      void* user);
+  void (*wait_async)(f0r_instance_t instance);
+  void (*set_executor)(const f0r_executor_t* executor);
+  f0r_instance_t (*clone)(f0r_instance_t instance);
+  size_t (*save_state)(f0r_instance_t instance, void* buffer, size_t size);
+  int (*load_state)(f0r_instance_t instance, const void* buffer, size_t size);
+  int (*set_param_curve)(f0r_instance_t instance, int param_index,
+                         const f0r_param_key_t* keys, unsigned int count);
+  int (*is_identity)(f0r_instance_t instance);
+  int (*set_quality)(f0r_instance_t instance, int quality);
+  int (*get_row_map)(f0r_instance_t instance, unsigned int* rows);
+  int (*get_active_rect)(f0r_instance_t instance, f0r_rect_t* rect,
+                         uint32_t* fill);
+  int (*trim)(f0r_instance_t instance);
+  int (*resize)(f0r_instance_t instance,
+                unsigned int width, unsigned int height);
+  int (*get_memory_usage)(f0r_instance_t instance,
+                          f0r_memory_usage_t* usage);
+  int (*set_deadline)(f0r_instance_t instance, double seconds);
+  int (*get_quality)(f0r_instance_t instance);
+  int (*reset)(f0r_instance_t instance);
+  int (*set_proxy)(f0r_instance_t instance, const uint32_t* proxy,
+                   unsigned int width, unsigned int height);
+} f0r_plugin_table_t;
+
+/**
+ * A plugin bundle is a single library with many effects, e.g. all the
+ * effects of the frei0r distribution in libfrei0r-all when it is built
+ * with the FREI0R_BUNDLE option. It saves applications that use all of
+ * them from loading a library for each. A bundle exports
+ * f0r_get_plugin_count and f0r_get_plugin_by_index instead of the
+ * functions of this header, and the application calls those of each
+ * effect through its table, as if the effect was a plugin of its own:
+ * init once before anything else, deinit once at the end.
+ *
+ * \returns the number of effects in the bundle
+ */
+int f0r_get_plugin_count(void);
+
+/**
+ * \param index the effect, from 0 to f0r_get_plugin_count() - 1
+ * \returns the entry points of the effect, 0 if there is no such effect
+ */
+const f0r_plugin_table_t* f0r_get_plugin_by_index(int index);
+//---------------------------------------------------------------------------
+
+#if defined(__GNUC__) && !defined(_WIN32)
+#pragma GCC visibility pop
+#endif
+
 #endif
@@ -1,12 +1,22 @@
 extern "C" 
 {
   #include "frei0r.h"
+  #include "frei0r_stats.h"
+  #include "frei0r_arena.h"
+  #include "frei0r_pages.h"
+  #include "frei0r_deadline.h"
+  #include "frei0r_state.h"
 }
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <list>
 #include <vector>
 #include <string>
 #include <iostream>
+#include <utility>
 
 
 namespace frei0r
@@ -20,6 +30,7 @@ namespace frei0r
   static std::pair<int,int> s_version;
   static unsigned int s_effect_type;
   static unsigned int s_color_model;
+  static unsigned int s_capabilities;
 
   static  fx* (*s_build) (unsigned int, unsigned int);
 
@@ -35,6 +46,633 @@ namespace frei0r
   
   static std::vector<param_info> s_params;
 
+  // Set while construct builds its probe instance at load time: only the
+  // register_param() calls of that one fill s_params. Instances built
+  // later, maybe by several threads at once, leave all of the above alone.
+  static bool s_registering;
+
+  // start of row y of a frame whose rows are stride bytes apart
+  inline uint32_t* frame_row(uint32_t* frame, int stride, unsigned int y)
+  {
+    if (!frame)
+      return 0;
+    return reinterpret_cast<uint32_t*>(reinterpret_cast<char*>(frame)
+                                       + static_cast<std::ptrdiff_t>(stride) * y);
+  }
+
+  inline const uint32_t* frame_row(const uint32_t* frame, int stride,
+                                   unsigned int y)
+  {
+    return frame_row(const_cast<uint32_t*>(frame), stride, y);
+  }
+
+  // comparison of the keys of a curve by time, for std::upper_bound
+  inline bool param_key_before(double time, const f0r_param_key_t& key)
+  {
+    return time < key.time;
+  }
+
+  // The value of a curve of f0r_set_param_curve() at time.
+  inline void param_curve_value(const std::vector<f0r_param_key_t>& keys,
+                                double time, double value[3])
+  {
+    std::vector<f0r_param_key_t>::const_iterator next
+      = std::upper_bound(keys.begin(), keys.end(), time, param_key_before);
+    if (next == keys.begin() || next == keys.end())
+      {
+        const f0r_param_key_t& key = next == keys.begin() ? keys.front()
+                                                          : keys.back();
+        std::copy(key.value, key.value + 3, value);
+        return;
+      }
+    const f0r_param_key_t& a = *(next - 1);
+    const f0r_param_key_t& b = *next;
+    double t = (time - a.time) / (b.time - a.time);
+    if (a.interpolation == F0R_KEY_HOLD)
+      t = 0.0;
+    else if (a.interpolation == F0R_KEY_SMOOTH)
+      t = t * t * (3.0 - 2.0 * t);
+    for (int i = 0; i < 3; ++i)
+      value[i] = a.value[i] + (b.value[i] - a.value[i]) * t;
+  }
+
+  // Saves or loads the internal state of an effect, see fx::serialize().
+  // The same calls do both, loading() tells which.
+  class state
+  {
+  public:
+    explicit state(frei0r_state_t& s) : m_s(s) {}
+
+    bool loading() const { return m_s.load != 0; }
+    // false once loading ran past the end of the state
+    bool ok() const { return frei0r_state_ok(&m_s) != 0; }
+
+    void bytes(void* p, std::size_t n) { frei0r_state_bytes(&m_s, p, n); }
+
+    template <typename T>
+    void value(T& v) { bytes(&v, sizeof(T)); }
+
+    template <typename T>
+    void vector(std::vector<T>& v)
+    {
+      uint64_t n = v.size();
+      value(n);
+      if (loading() && ok())
+        v.resize(static_cast<std::size_t>(n));
+      if (n && ok())
+        bytes(&v[0], static_cast<std::size_t>(n) * sizeof(T));
+    }
+
+  private:
+    frei0r_state_t& m_s;
+  };
+
+  // A width x height plane of T (uint32_t pixels, floats, ...) for the
+  // internal buffers of effects. Every row starts on a 64 byte boundary,
+  // so vector loads never split a cache line. Optional guard columns and
+  // rows around the plane let filters read their neighbourhood at the
+  // edges without branches; they are initialised to zero.
+  //
+  // Without guards the rows are tightly packed (stride() == width()), so
+  // the plane can be used like an ordinary frame, e.g. with std::copy.
+  // Planes are not copyable; they can be swapped and, in C++11, moved.
+  // Large planes, like the frames of 4K and 8K histories, are put on
+  // huge pages where the system has them (frei0r_pages.h).
+  //
+  // State that an effect allocates in its constructor is better sized
+  // with resize_deferred() and zeroed by touch() at the start of update:
+  // the pages are then first written, and on NUMA machines placed, by
+  // the thread that renders the instance rather than the one that
+  // constructed it.
+  template <typename T>
+  class aligned_frame
+  {
+  public:
+    enum { alignment = 64 };
+
+    aligned_frame()
+      : m_block(0), m_data(0), m_width(0), m_height(0), m_stride(0),
+        m_guard_x(0), m_guard_y(0), m_size(0), m_untouched(false)
+    {
+    }
+
+    aligned_frame(unsigned int width, unsigned int height,
+                  unsigned int guard_x = 0, unsigned int guard_y = 0)
+      : m_block(0), m_data(0), m_width(0), m_height(0), m_stride(0),
+        m_guard_x(0), m_guard_y(0), m_size(0), m_untouched(false)
+    {
+      resize(width, height, guard_x, guard_y);
+    }
+
+#if __cplusplus >= 201103L
+    aligned_frame(aligned_frame&& other)
+      : m_block(0), m_data(0), m_width(0), m_height(0), m_stride(0),
+        m_guard_x(0), m_guard_y(0), m_size(0), m_untouched(false)
+    {
+      swap(other);
+    }
+
+    aligned_frame& operator=(aligned_frame&& other)
+    {
+      swap(other);
+      return *this;
+    }
+#endif
+
+    ~aligned_frame()
+    {
+      std::free(m_block);
+    }
+
+    // Reallocates the plane with at least guard_x columns left and right
+    // of each row and guard_y rows above and below it. All elements,
+    // guards included, are zero afterwards.
+    void resize(unsigned int width, unsigned int height,
+                unsigned int guard_x = 0, unsigned int guard_y = 0)
+    {
+      resize_deferred(width, height, guard_x, guard_y);
+      clear();
+    }
+
+    // Like resize(), but leaves the memory alone until touch(). Elements
+    // that are written before they are read need no touch() at all.
+    void resize_deferred(unsigned int width, unsigned int height,
+                         unsigned int guard_x = 0, unsigned int guard_y = 0)
+    {
+      const std::size_t per_line = alignment / sizeof(T);
+      unsigned int stride = width;
+      if (guard_x)
+        {
+          // round the left guard up so that column 0 stays aligned
+          guard_x = static_cast<unsigned int>
+            ((guard_x + per_line - 1) / per_line * per_line);
+          stride = static_cast<unsigned int>
+            ((width + 2 * guard_x + per_line - 1) / per_line * per_line);
+        }
+      const std::size_t size = static_cast<std::size_t>(stride)
+        * (height + 2 * guard_y);
+
+      std::free(m_block);
+      m_block = static_cast<char*>(frei0r_pages_alloc(size * sizeof(T)
+                                                      + alignment - 1));
+      if (!m_block)
+        {
+          m_data = 0;
+          m_width = m_height = m_stride = m_guard_x = m_guard_y = 0;
+          m_size = 0;
+          m_untouched = false;
+          return;
+        }
+      char* base = m_block + (alignment - reinterpret_cast<std::size_t>(m_block)
+                              % alignment) % alignment;
+      m_data = reinterpret_cast<T*>(base)
+        + static_cast<std::size_t>(stride) * guard_y + guard_x;
+      m_width = width;
+      m_height = height;
+      m_stride = stride;
+      m_guard_x = guard_x;
+      m_guard_y = guard_y;
+      m_size = size;
+      m_untouched = true;
+    }
+
+    // Frees the plane, which is empty afterwards, as if default
+    // constructed.
+    void release()
+    {
+      std::free(m_block);
+      m_block = 0;
+      m_data = 0;
+      m_width = m_height = m_stride = m_guard_x = m_guard_y = 0;
+      m_size = 0;
+      m_untouched = false;
+    }
+
+    // Sets all elements, guards included, to zero.
+    void clear()
+    {
+      if (m_block)
+        std::memset(m_data - static_cast<std::size_t>(m_stride) * m_guard_y
+                    - m_guard_x, 0, m_size * sizeof(T));
+      m_untouched = false;
+    }
+
+    // Makes the plane a copy of other, guards included.
+    void assign(const aligned_frame& other)
+    {
+      if (&other == this)
+        return;
+      resize_deferred(other.m_width, other.m_height,
+                      other.m_guard_x, other.m_guard_y);
+      if (m_block && other.m_block)
+        std::memcpy(m_data - static_cast<std::size_t>(m_stride) * m_guard_y
+                    - m_guard_x,
+                    other.m_data - static_cast<std::size_t>(other.m_stride)
+                    * other.m_guard_y - other.m_guard_x,
+                    m_size * sizeof(T));
+      m_untouched = other.m_untouched;
+    }
+
+    // Saves or loads the plane, guards included, resizing it to the one
+    // saved.
+    void serialize(state& s)
+    {
+      unsigned int size[4] = { m_width, m_height, m_guard_x, m_guard_y };
+      s.value(size);
+      if (!s.ok())
+        return;
+      if (s.loading())
+        {
+          if (size[0] != m_width || size[1] != m_height
+              || size[2] != m_guard_x || size[3] != m_guard_y)
+            resize_deferred(size[0], size[1], size[2], size[3]);
+          m_untouched = false;
+        }
+      else
+        touch();
+      if (m_block)
+        s.bytes(m_data - static_cast<std::size_t>(m_stride) * m_guard_y
+                - m_guard_x, m_size * sizeof(T));
+    }
+
+    // Zeroes the plane on the first call after resize_deferred(), which
+    // has to come before anything is written to it.
+    void touch()
+    {
+      if (m_untouched)
+        clear();
+    }
+
+    void swap(aligned_frame& other)
+    {
+      std::swap(m_block, other.m_block);
+      std::swap(m_data, other.m_data);
+      std::swap(m_width, other.m_width);
+      std::swap(m_height, other.m_height);
+      std::swap(m_stride, other.m_stride);
+      std::swap(m_guard_x, other.m_guard_x);
+      std::swap(m_guard_y, other.m_guard_y);
+      std::swap(m_size, other.m_size);
+      std::swap(m_untouched, other.m_untouched);
+    }
+
+    unsigned int width() const { return m_width; }
+    unsigned int height() const { return m_height; }
+    // the memory of the plane, guards included, see f0r_get_memory_usage()
+    std::size_t bytes() const { return m_block ? m_size * sizeof(T) : 0; }
+    // distance between two rows, in elements
+    unsigned int stride() const { return m_stride; }
+    unsigned int guard_x() const { return m_guard_x; }
+    unsigned int guard_y() const { return m_guard_y; }
+
+    // first element of row 0
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+
+    // Row y, -guard_y() <= y < height() + guard_y(). Columns
+    // -guard_x() to width() + guard_x() - 1 of it may be accessed.
+    T* row(int y)
+    {
+      return m_data + static_cast<std::ptrdiff_t>(m_stride) * y;
+    }
+    const T* row(int y) const
+    {
+      return m_data + static_cast<std::ptrdiff_t>(m_stride) * y;
+    }
+
+    // i-th element counted from data(), e.g. pixel i of a packed plane
+    T& operator[](std::size_t i) { return m_data[i]; }
+    const T& operator[](std::size_t i) const { return m_data[i]; }
+
+  private:
+#if __cplusplus >= 201103L
+    aligned_frame(const aligned_frame&) = delete;
+    aligned_frame& operator=(const aligned_frame&) = delete;
+#else
+    aligned_frame(const aligned_frame&);
+    aligned_frame& operator=(const aligned_frame&);
+#endif
+
+    char* m_block;
+    T* m_data;
+    unsigned int m_width;
+    unsigned int m_height;
+    unsigned int m_stride;
+    unsigned int m_guard_x;
+    unsigned int m_guard_y;
+    std::size_t m_size; // elements including guards
+    bool m_untouched;   // not zeroed since resize_deferred()
+  };
+
+  // The recent input frames of a temporal effect by age: frame 0 is the
+  // current input, frame 1 the one before it and so on, up to depth - 1.
+  // If the host shares its own history of the input stream through
+  // f0r_set_frame_history(), the frames are read from there. Otherwise
+  // they are copied into a ring, which is only allocated on first use.
+  //
+  // Effects register their history with fx::register_history() and
+  // call push() at the start of every update.
+  class frame_history
+  {
+  public:
+    frame_history(unsigned int width, unsigned int height,
+                  unsigned int depth)
+      : m_width(width), m_height(height), m_depth(depth), m_frames(0),
+        m_times(depth, 0.0), m_newest(0), m_count(0), m_has_host(false)
+    {
+    }
+
+    ~frame_history()
+    {
+      delete[] m_frames;
+    }
+
+    // the number of frames the effect asks for, including the current one
+    unsigned int depth() const { return m_depth; }
+
+    // Makes the history read frames from host, or copy them again if
+    // host is 0. Frames pushed before are forgotten.
+    void set_host(const f0r_frame_history_t* host)
+    {
+      m_has_host = host && host->get_frame;
+      if (m_has_host)
+        {
+          m_host = *host;
+          delete[] m_frames;
+          m_frames = 0;
+        }
+      m_count = 0;
+    }
+
+    // Forgets the pushed frames but keeps their memory, see f0r_reset().
+    void forget()
+    {
+      m_count = 0;
+    }
+
+    // Frees the copied frames and forgets them, see f0r_trim(); the next
+    // push() allocates them again.
+    void release()
+    {
+      delete[] m_frames;
+      m_frames = 0;
+      m_count = 0;
+    }
+
+    // Changes the size of the frames, see f0r_resize(). The copied frames
+    // are freed like by release(), and a history of the host, which has
+    // frames of the old size, is forgotten.
+    void resize(unsigned int width, unsigned int height)
+    {
+      release();
+      m_width = width;
+      m_height = height;
+      m_has_host = false;
+    }
+
+    void push(double time, const uint32_t* frame)
+    {
+      if (m_count < m_depth)
+        ++m_count;
+      // the host knows which frames it has, they need not have been
+      // pushed here, e.g. after a seek
+      if (m_has_host)
+        {
+          m_count = m_depth;
+          return;
+        }
+
+      if (!m_frames)
+        {
+          m_frames = new aligned_frame<uint32_t>[m_depth];
+          for (unsigned int i = 0; i < m_depth; ++i)
+            m_frames[i].resize(m_width, m_height);
+        }
+      m_newest = (m_newest + 1) % m_depth;
+      std::copy(frame, frame + m_width * m_height, m_frames[m_newest].data());
+      m_times[m_newest] = time;
+    }
+
+    // the number of frames pushed so far, at most depth(); depth() once
+    // a frame is pushed if the host provides them
+    unsigned int size() const { return m_count; }
+
+    // the memory of the copied frames, 0 while the host provides them
+    std::size_t bytes() const
+    {
+      return m_frames ? m_depth * m_frames[0].bytes() : 0;
+    }
+
+    // Makes this history, of the same size and depth, a copy of other,
+    // for fx::clone_state(). A host history is shared.
+    void assign(const frame_history& other)
+    {
+      if (&other == this)
+        return;
+      delete[] m_frames;
+      m_frames = 0;
+      if (other.m_frames)
+        {
+          m_frames = new aligned_frame<uint32_t>[m_depth];
+          for (unsigned int i = 0; i < m_depth; ++i)
+            m_frames[i].assign(other.m_frames[i]);
+        }
+      m_times = other.m_times;
+      m_newest = other.m_newest;
+      m_count = other.m_count;
+      m_has_host = other.m_has_host;
+      m_host = other.m_host;
+    }
+
+    // Saves or loads the frames and their times, for fx::serialize().
+    void serialize(state& s)
+    {
+      unsigned char frames = (m_frames != 0);
+      s.value(m_count);
+      s.value(m_newest);
+      s.bytes(&m_times[0], m_depth * sizeof(double));
+      s.value(frames);
+      if (!s.ok())
+        return;
+      if (s.loading() && frames != (m_frames != 0))
+        {
+          delete[] m_frames;
+          m_frames = frames ? new aligned_frame<uint32_t>[m_depth] : 0;
+        }
+      if (m_frames)
+        for (unsigned int i = 0; i < m_depth; ++i)
+          m_frames[i].serialize(s);
+      if (m_count > m_depth || m_newest >= m_depth)
+        m_count = m_newest = 0;
+    }
+
+    // Returns the frame of the given age, or the oldest one there is if
+    // the history doesn't go back that far yet. Its time is stored in
+    // *time unless time is 0.
+    const uint32_t* at(unsigned int age, double* time = 0) const
+    {
+      if (m_count == 0)
+        return 0;
+      if (age >= m_count)
+        age = m_count - 1;
+      if (m_has_host)
+        {
+          for (;; --age)
+            {
+              const uint32_t* frame = m_host.get_frame(m_host.opaque, age,
+                                                       time);
+              if (frame || age == 0)
+                return frame;
+            }
+        }
+      const unsigned int i = (m_newest + m_depth - age) % m_depth;
+      if (time)
+        *time = m_times[i];
+      return m_frames[i].data();
+    }
+
+    // Returns the newest frame that is not newer than time, or the oldest
+    // one there is.
+    const uint32_t* at_time(double time, double* frame_time = 0) const
+    {
+      const uint32_t* frame = 0;
+      for (unsigned int age = 0; age < m_count; ++age)
+        {
+          double t;
+          const uint32_t* f = at(age, &t);
+          if (!f)
+            break;
+          frame = f;
+          if (frame_time)
+            *frame_time = t;
+          if (t <= time)
+            break;
+        }
+      return frame;
+    }
+
+  private:
+    frame_history(const frame_history&);
+    frame_history& operator=(const frame_history&);
+
+    unsigned int m_width;
+    unsigned int m_height;
+    unsigned int m_depth;
+    aligned_frame<uint32_t>* m_frames;
+    std::vector<double> m_times;
+    unsigned int m_newest; // index of frame 0 in m_frames
+    unsigned int m_count;
+    bool m_has_host;
+    f0r_frame_history_t m_host;
+  };
+
+
+  // The last frames of an effect that sets fx::memoize. A sample of the
+  // input frames spots a repeated input cheaply; only once one came are
+  // the input and output frames copied, so that the output can be
+  // returned again for as long as the input stays the same.
+  class frame_memo
+  {
+  public:
+    frame_memo()
+      : m_inputs(0), m_size(0), m_hash(0), m_generation(0),
+        m_repeat(false), m_kept(false)
+    {
+    }
+
+    // Copies the output of the last update to out and returns true if
+    // the inputs and the parameter generation are those of that update.
+    bool lookup(unsigned int generation, unsigned int size,
+                const uint32_t* const* in, unsigned int inputs,
+                uint32_t* out)
+    {
+      const uint64_t hash = sample(in, inputs, size);
+      m_repeat = hash == m_hash && generation == m_generation
+        && size == m_size && inputs == m_inputs;
+      m_hash = hash;
+      m_generation = generation;
+      m_size = size;
+      m_inputs = inputs;
+      if (!m_repeat)
+        {
+          m_kept = false;
+          return false;
+        }
+      if (!m_kept)
+        return false;
+      for (unsigned int i = 0; i < inputs; ++i)
+        if (std::memcmp(in[i], &m_in[i][0], size * sizeof(uint32_t)) != 0)
+          {
+            m_kept = false;
+            return false;
+          }
+      if (size)
+        std::memcpy(out, &m_out[0], size * sizeof(uint32_t));
+      return true;
+    }
+
+    // Whether the update after lookup() is to be kept, the input looking
+    // like that of the update before.
+    bool repeat() const
+    {
+      return m_repeat;
+    }
+
+    // Keeps the inputs, before the update since the output may be one of
+    // them.
+    void keep_inputs(const uint32_t* const* in)
+    {
+      for (unsigned int i = 0; i < m_inputs; ++i)
+        m_in[i].assign(in[i], in[i] + m_size);
+    }
+
+    void keep_output(const uint32_t* out)
+    {
+      m_out.assign(out, out + m_size);
+      m_kept = true;
+    }
+
+    // the memory of the kept frames
+    std::size_t bytes() const
+    {
+      std::size_t n = m_out.capacity();
+      for (unsigned int i = 0; i < 3; ++i)
+        n += m_in[i].capacity();
+      return n * sizeof(uint32_t);
+    }
+
+    // Frees the kept frames, see f0r_trim().
+    void release()
+    {
+      for (unsigned int i = 0; i < 3; ++i)
+        std::vector<uint32_t>().swap(m_in[i]);
+      std::vector<uint32_t>().swap(m_out);
+      m_kept = false;
+    }
+
+  private:
+    // about 1000 pixels spread over each frame
+    static uint64_t sample(const uint32_t* const* in, unsigned int inputs,
+                           unsigned int size)
+    {
+      const unsigned int step = size / 1024 + 1;
+      uint64_t hash = 14695981039346656037ULL; // FNV-1a
+      for (unsigned int i = 0; i < inputs; ++i)
+        for (unsigned int p = i; p < size; p += step)
+          hash = (hash ^ in[i][p]) * 1099511628211ULL;
+      return hash;
+    }
+
+    unsigned int m_inputs;
+    unsigned int m_size;
+    uint64_t m_hash;
+    unsigned int m_generation;
+    bool m_repeat; // the last lookup() saw the input of the update before
+    bool m_kept; // m_in and m_out hold the last update
+    std::vector<uint32_t> m_in[3];
+    std::vector<uint32_t> m_out;
+  };
+
   
   class fx
   {
@@ -45,9 +683,60 @@ namespace frei0r
     unsigned int size; // = width * height
     std::vector<void*> param_ptrs;
 
-    fx()
+    // Set by effects whose output pixels only depend on the input pixels
+    // at the same position. Their update_slice() is then also used for
+    // frames with padded rows, one row at a time (see update_stride()).
+    bool pointwise;
+
+    // Set by effects whose output only depends on the input frames and
+    // the parameters: not on the time nor on earlier frames. Updates of
+    // whole frames then return the last output again, without update(),
+    // when the same input comes again with the same parameters, as it
+    // does for still frames and freeze frames (see frame_memo).
+    bool memoize;
+
+    // incremented on every parameter change, see on_params_changed()
+    unsigned int param_generation;
+
+    // set by register_history(), see f0r_set_frame_history()
+    frame_history* history;
+
+    // the keys of the parameters animated by f0r_set_param_curve(), by
+    // parameter index, see animated()
+    std::vector<std::vector<f0r_param_key_t> > param_curves;
+
+    // Scratch memory for update(). It is reset before every frame, so
+    // buffers from frei0r_arena_alloc() need not be freed. Not to be used
+    // in update_slice() or update_tile(), which may run on several threads.
+    frei0r_arena_t arena;
+
+#ifdef FREI0R_ENABLE_STATS
+    // stage timings reported by f0r_get_stats(), see stage_timer
+    frei0r_stats_t stats;
+#endif
+
+    // the last frames if memoize is set
+    frame_memo memo;
+
+    // the budget of f0r_set_deadline() and the quality set_quality() was
+    // last called with
+    frei0r_deadline_t deadline;
+
+    // the downscaled input of f0r_set_proxy() for the current update, 0
+    // if there is none; effects that override uses_proxy() take their
+    // statistics from it
+    const uint32_t* proxy;
+    unsigned int proxy_width;
+    unsigned int proxy_height;
+
+    fx() : pointwise(false), memoize(false), param_generation(0), history(0),
+           proxy(0), proxy_width(0), proxy_height(0)
     {
-      s_params.clear(); // reinit static params 
+      frei0r_arena_init(&arena);
+      frei0r_deadline_init(&deadline);
+#ifdef FREI0R_ENABLE_STATS
+      stats.count = 0;
+#endif
     }
     
     virtual unsigned int effect_type()=0;
@@ -57,7 +746,8 @@ namespace frei0r
 			const std::string& desc)
     {
       param_ptrs.push_back(&p_loc);
-      s_params.push_back(param_info(name,desc,F0R_PARAM_COLOR));
+      if (s_registering)
+        s_params.push_back(param_info(name,desc,F0R_PARAM_COLOR));
     }
     
     void register_param(double& p_loc,
@@ -65,7 +755,8 @@ namespace frei0r
 			const std::string& desc)
     {
       param_ptrs.push_back(&p_loc);
-      s_params.push_back(param_info(name,desc,F0R_PARAM_DOUBLE));
+      if (s_registering)
+        s_params.push_back(param_info(name,desc,F0R_PARAM_DOUBLE));
     }
 
     void register_param(bool& p_loc,
@@ -73,7 +764,8 @@ namespace frei0r
 			const std::string& desc)
     {
       param_ptrs.push_back(&p_loc);
-      s_params.push_back(param_info(name,desc,F0R_PARAM_BOOL));
+      if (s_registering)
+        s_params.push_back(param_info(name,desc,F0R_PARAM_BOOL));
     }
 
     void register_param(f0r_param_position& p_loc,
@@ -81,7 +773,8 @@ namespace frei0r
 			const std::string& desc)
     {
       param_ptrs.push_back(&p_loc);
-      s_params.push_back(param_info(name,desc,F0R_PARAM_POSITION));
+      if (s_registering)
+        s_params.push_back(param_info(name,desc,F0R_PARAM_POSITION));
     }
     
     void register_param(std::string& p_loc,
@@ -89,7 +782,8 @@ namespace frei0r
 			const std::string& desc)
     {
       param_ptrs.push_back(&p_loc);
-      s_params.push_back(param_info(name,desc,F0R_PARAM_STRING));
+      if (s_registering)
+        s_params.push_back(param_info(name,desc,F0R_PARAM_STRING));
     }
     
     
@@ -101,7 +795,7 @@ namespace frei0r
 	{
 	case F0R_PARAM_BOOL :
 	  *static_cast<f0r_param_bool*>(param)
-	    = *static_cast<f0r_param_bool*>(ptr) > 0.5 ? 1.0 : 0.0;
+	    = *static_cast<bool*>(ptr) ? 1.0 : 0.0;
 	  break;
 	case F0R_PARAM_DOUBLE:
 	  *static_cast<f0r_param_double*>(param)
@@ -126,31 +820,215 @@ namespace frei0r
     void set_param_value(f0r_param_t param, int param_index)
     {
       void* ptr = param_ptrs[param_index];
+      bool changed = false;
       
       switch (s_params[param_index].m_type)
 	{
 	case F0R_PARAM_BOOL :
-	  *static_cast<bool*>(ptr)
-	    = (*static_cast<f0r_param_bool*>(param) > 0.5) ;
+	  {
+	    bool value = (*static_cast<f0r_param_bool*>(param) > 0.5);
+	    changed = (*static_cast<bool*>(ptr) != value);
+	    *static_cast<bool*>(ptr) = value;
+	  }
 	  break;
 	case F0R_PARAM_DOUBLE:
-	  *static_cast<f0r_param_double*>(ptr)
-	    = *static_cast<f0r_param_double*>(param);
+	  {
+	    f0r_param_double value = *static_cast<f0r_param_double*>(param);
+	    changed = (*static_cast<f0r_param_double*>(ptr) != value);
+	    *static_cast<f0r_param_double*>(ptr) = value;
+	  }
 	  break;
 	case F0R_PARAM_COLOR:
-	  *static_cast<f0r_param_color*>(ptr)
-	    = *static_cast<f0r_param_color*>(param);
+	  {
+	    f0r_param_color& old_value = *static_cast<f0r_param_color*>(ptr);
+	    const f0r_param_color& value = *static_cast<f0r_param_color*>(param);
+	    changed = (old_value.r != value.r || old_value.g != value.g
+		       || old_value.b != value.b);
+	    old_value = value;
+	  }
 	  break;
 	case F0R_PARAM_POSITION:
-	  *static_cast<f0r_param_position*>(ptr)
-	    =  *static_cast<f0r_param_position*>(param);
-	    break;
+	  {
+	    f0r_param_position& old_value = *static_cast<f0r_param_position*>(ptr);
+	    const f0r_param_position& value = *static_cast<f0r_param_position*>(param);
+	    changed = (old_value.x != value.x || old_value.y != value.y);
+	    old_value = value;
+	  }
+	  break;
 	case F0R_PARAM_STRING:
-	    *static_cast<std::string*>(ptr)
-	      = *static_cast<f0r_param_string*>(param);
-	    break;
+	  {
+	    std::string& old_value = *static_cast<std::string*>(ptr);
+	    const char* value = *static_cast<f0r_param_string*>(param);
+	    changed = (old_value != value);
+	    old_value = value;
+	  }
+	  break;
 	}
-      
+
+      if (changed)
+	{
+	  ++param_generation;
+	  on_params_changed();
+	}
+    }
+
+    // Animates parameter index along keys, see f0r_set_param_curve().
+    bool set_param_curve(int index, const f0r_param_key_t* keys,
+                         unsigned int count)
+    {
+      if (index < 0 || index >= static_cast<int>(param_ptrs.size())
+          || s_params[index].m_type == F0R_PARAM_STRING)
+        return false;
+      for (unsigned int i = 1; i < count; ++i)
+        if (keys[i].time < keys[i - 1].time)
+          return false;
+      param_curves.resize(param_ptrs.size());
+      param_curves[index].assign(keys, keys + count);
+      return true;
+    }
+
+    // Whether parameter index follows a curve of f0r_set_param_curve().
+    // Effects that derive tables from it can look ahead along
+    // param_curves[index] rather than wait for the values one by one.
+    bool animated(int index) const
+    {
+      return index >= 0
+        && static_cast<std::size_t>(index) < param_curves.size()
+        && !param_curves[index].empty();
+    }
+
+    // Sets the animated parameters to their values at time, through
+    // set_param_value(), so on_params_changed() sees them like any other
+    // change. Called by begin_frame().
+    void apply_param_curves(double time)
+    {
+      for (std::size_t i = 0; i < param_curves.size(); ++i)
+        {
+          if (param_curves[i].empty())
+            continue;
+          double v[3] = { 0, 0, 0 };
+          param_curve_value(param_curves[i], time, v);
+          union
+          {
+            f0r_param_double d;
+            f0r_param_color_t color;
+            f0r_param_position_t position;
+          } value;
+          switch (s_params[i].m_type)
+            {
+            case F0R_PARAM_COLOR:
+              value.color.r = static_cast<float>(v[0]);
+              value.color.g = static_cast<float>(v[1]);
+              value.color.b = static_cast<float>(v[2]);
+              break;
+            case F0R_PARAM_POSITION:
+              value.position.x = v[0];
+              value.position.y = v[1];
+              break;
+            default:
+              value.d = v[0];
+              break;
+            }
+          set_param_value(&value, static_cast<int>(i));
+        }
+    }
+
+    // The steps around every update of a whole frame, whichever entry
+    // point it comes through: begin_frame() resets the scratch memory,
+    // applies the parameter curves and starts the time budget,
+    // end_frame() ends the budget and drops the proxy, which was for this
+    // update only.
+    void begin_frame(double time)
+    {
+      frei0r_arena_reset(&arena);
+      apply_param_curves(time);
+      if (frei0r_deadline_begin(&deadline))
+        {
+          set_quality(deadline.current);
+          ++param_generation;
+        }
+    }
+
+    void end_frame()
+    {
+      frei0r_deadline_end(&deadline);
+      proxy = 0;
+    }
+
+    // Lets the host provide the frames of h, see f0r_set_frame_history().
+    void register_history(frame_history& h)
+    {
+      history = &h;
+    }
+
+    // Brings the effect into the state it would have before the update of
+    // frame number frame, see f0r_seek(). Effects whose output depends on
+    // earlier frames override this and return true if they can; stateless
+    // ones just return true. Both declare F0R_CAP_SEEK in construct.
+    virtual bool seek(double time, uint64_t frame)
+    {
+      (void)time; (void)frame; // unused
+      return false;
+    }
+
+    // Forgets the state of earlier frames but keeps the buffers, see
+    // f0r_reset(); the frames of register_history() are forgotten
+    // anyway. Temporal effects override this and return true; the
+    // default returns false, the instance has to be constructed again.
+    virtual bool reset()
+    {
+      return false;
+    }
+
+    // Effects that take statistics of their input override this and
+    // return true; their update() then takes them from proxy when it is
+    // set, see f0r_set_proxy().
+    virtual bool uses_proxy() const
+    {
+      return false;
+    }
+
+    // Copies the internal state of other, an instance of the same effect
+    // and size whose parameters and history are already copied, for
+    // f0r_clone().
+    // Temporal effects override this, return true and declare
+    // F0R_CAP_CLONE in construct; the default returns false, the effect
+    // can't be cloned. It may be called with the effect itself.
+    virtual bool clone_state(const fx& other)
+    {
+      (void)other; // unused
+      return false;
+    }
+
+    // Saves or loads the internal state, except for the parameters and
+    // the history, for f0r_save_state() and f0r_load_state(). Temporal
+    // effects override this, return true and declare F0R_CAP_STATE in
+    // construct; the same code does both, see frei0r::state. The default
+    // returns false, the effect has no state to save.
+    virtual bool serialize(state& s)
+    {
+      (void)s; // unused
+      return false;
+    }
+
+    // Called by set_param_value() whenever a parameter got a new value,
+    // but not when the host sets the value it already had. Effects that
+    // derive tables from their parameters rebuild them here instead of in
+    // every update().
+    virtual void on_params_changed()
+    {
+    }
+
+    // Adds a named stage for stage_timer and returns its index. Without
+    // FREI0R_ENABLE_STATS this does nothing.
+    int register_stage(const char* name)
+    {
+#ifdef FREI0R_ENABLE_STATS
+      return frei0r_stats_register(&stats, name);
+#else
+      (void)name; // unused
+      return 0;
+#endif
     }
       
     virtual void update(double time,
@@ -158,12 +1036,320 @@ namespace frei0r
               const uint32_t* in1,
               const uint32_t* in2,
               const uint32_t* in3) = 0;
+
+    // Computes only the rows [row_begin, row_end) of out. Effects whose
+    // output rows don't depend on each other override this and return true,
+    // so that the host may process one frame on several threads at once.
+    virtual bool update_slice(double time,
+                              uint32_t* out,
+                              const uint32_t* in1,
+                              const uint32_t* in2,
+                              const uint32_t* in3,
+                              unsigned int row_begin,
+                              unsigned int row_end)
+    {
+      (void)time; (void)out; (void)in1; (void)in2; (void)in3; // unused
+      (void)row_begin; (void)row_end; // unused
+      return false;
+    }
+
+    // Like update(), but the rows of each frame are stride bytes apart.
+    // Effects that can address padded rows themselves override this. The
+    // default handles tightly packed frames and pointwise effects and
+    // returns false for everything else.
+    virtual bool update_stride(double time,
+                               uint32_t* out, int out_stride,
+                               const uint32_t* in1, int in1_stride,
+                               const uint32_t* in2, int in2_stride,
+                               const uint32_t* in3, int in3_stride)
+    {
+      const int packed = static_cast<int>(width * sizeof(uint32_t));
+      if (out_stride == packed
+          && (!in1 || in1_stride == packed)
+          && (!in2 || in2_stride == packed)
+          && (!in3 || in3_stride == packed))
+        {
+          update(time, out, in1, in2, in3);
+          return true;
+        }
+      if (!pointwise)
+        return false;
+      for (unsigned int y = 0; y < height; ++y)
+        if (!update_slice(time,
+                          frame_row(out, out_stride, y),
+                          frame_row(in1, in1_stride, y),
+                          frame_row(in2, in2_stride, y),
+                          frame_row(in3, in3_stride, y),
+                          0, 1))
+          return false;
+      return true;
+    }
+
+    // Like update(), but returns a frame owned by the effect that holds
+    // the result, valid until the next update. Effects that keep their
+    // result in a frame of their own override this to save the copy to
+    // out. The default does nothing and returns 0.
+    virtual const uint32_t* update_view(double time,
+                                        const uint32_t* in1,
+                                        const uint32_t* in2,
+                                        const uint32_t* in3)
+    {
+      (void)time; (void)in1; (void)in2; (void)in3; // unused
+      return 0;
+    }
+
+    // Like update(), but on frames of F0R_COLOR_MODEL_RGBA_FLOAT, see
+    // f0r_update_float(). Effects that compute in floating point override
+    // this, return true and declare F0R_CAP_FLOAT in construct, so that
+    // chains of them skip the 8 bit round trips. The default returns
+    // false.
+    virtual bool update_float(double time,
+                              float* out,
+                              const float* in1,
+                              const float* in2,
+                              const float* in3)
+    {
+      (void)time; (void)out; (void)in1; (void)in2; (void)in3; // unused
+      return false;
+    }
+
+    // How far from an output pixel the input pixels lie that it depends
+    // on, see f0r_get_footprint(): 0 for pointwise effects and
+    // F0R_FOOTPRINT_FULL for all others, unless the effect knows better.
+    virtual int footprint()
+    {
+      return pointwise ? 0 : F0R_FOOTPRINT_FULL;
+    }
+
+    // Computes the tile outrect of out from the part inrect of in1, see
+    // f0r_update_tile(); out and in1 point to the first pixel of their
+    // rectangle. Filters that compute any tile override this, return true
+    // and declare F0R_CAP_TILE in construct. The default handles the whole
+    // frame, and bands of whole rows of pointwise effects.
+    virtual bool update_tile(double time,
+                             uint32_t* out, int out_stride,
+                             const f0r_rect_t& outrect,
+                             const uint32_t* in1, int in1_stride,
+                             const f0r_rect_t& inrect)
+    {
+      if (outrect.width <= 0 || outrect.height <= 0
+          || outrect.x != 0 || outrect.width != static_cast<int>(width))
+        return false;
+      if (outrect.y == 0 && outrect.height == static_cast<int>(height)
+          && inrect.y == 0 && inrect.height == static_cast<int>(height))
+        return update_stride(time, out, out_stride, in1, in1_stride,
+                             0, 0, 0, 0);
+      if (!pointwise || inrect.x != 0)
+        return false;
+      in1 = frame_row(in1, in1_stride, outrect.y - inrect.y);
+      for (int y = 0; y < outrect.height; ++y)
+        if (!update_slice(time,
+                          frame_row(out, out_stride, y),
+                          frame_row(in1, in1_stride, y),
+                          0, 0, 0, 1))
+          return false;
+      return true;
+    }
+
+    // Sets rect to the part of the frame the next update may change, see
+    // f0r_get_region(). Effects that only draw over part of the frame
+    // override this; the default returns false, the whole frame.
+    virtual bool region(f0r_rect_t& rect)
+    {
+      (void)rect; // unused
+      return false;
+    }
+
+    // Whether the next update would copy the input frame unchanged, see
+    // f0r_is_identity(). Effects override this for the parameters that
+    // make them neutral; the default returns false.
+    virtual bool identity()
+    {
+      return false;
+    }
+
+    // Sets rows to the input row of each output row if the next update
+    // would only move rows, see f0r_get_row_map(). Effects that rearrange
+    // rows override this; the default returns false.
+    virtual bool row_map(unsigned int* rows)
+    {
+      (void)rows; // unused
+      return false;
+    }
+
+    // Sets rect to the part of the next output with the picture and fill
+    // to the pixel around it, see f0r_get_active_rect(). Effects that add
+    // borders override this; the default returns false.
+    virtual bool active_rect(f0r_rect_t* rect, uint32_t* fill)
+    {
+      (void)rect; // unused
+      (void)fill; // unused
+      return false;
+    }
+
+    // Frees the memory of the effect's updates that the next update
+    // allocates again, see f0r_trim(); what it kept from earlier frames
+    // has been forgotten by reset() before. Effects with such memory of
+    // their own override this and return true if they had any; the
+    // history, the memo and the scratch memory are freed either way.
+    virtual bool trim()
+    {
+      return false;
+    }
+
+    // Adds the memory the effect allocated of its own to resident, and
+    // what the next update reads and writes of it to touched, see
+    // f0r_get_memory_usage(). Effects with buffers, tables or frames of
+    // their own override this; the default adds nothing. The frames of
+    // the update, the history, the memo and the scratch memory are
+    // counted either way.
+    virtual void memory_usage(std::size_t& resident, std::size_t& touched)
+    {
+      (void)resident; (void)touched; // unused
+    }
+
+    // Adapts the effect to frames of new_width x new_height, see
+    // f0r_resize(); width, height and size are still the old ones and
+    // become the new ones if this returns true. Effects override this to
+    // reallocate what depends on the size, keep what doesn't and restart
+    // what they kept from earlier frames. The default returns false and
+    // the host constructs a new instance. The history, the memo and the
+    // scratch memory are taken care of either way.
+    virtual bool resize(unsigned int new_width, unsigned int new_height)
+    {
+      (void)new_width; (void)new_height; // unused
+      return false;
+    }
+
+    // Sets the quality of the next updates, one of F0R_QUALITY_, see
+    // f0r_set_quality(). Effects with a faster draft mode override this,
+    // keep the quality for update() and return true; the default returns
+    // false, the output is the same in all qualities. With a budget of
+    // f0r_set_deadline() it is also called between updates with lower
+    // qualities than the one the application set.
+    virtual bool set_quality(int quality)
+    {
+      (void)quality; // unused
+      return false;
+    }
+
+    // Combines count input frames into the rows [row_begin, row_end) of
+    // out, see f0r_update_layers(). Only effects of type mixern override
+    // this; the default returns false.
+    virtual bool update_layers(double time,
+                               uint32_t* out,
+                               const uint32_t* const* in,
+                               unsigned int count,
+                               unsigned int row_begin,
+                               unsigned int row_end)
+    {
+      (void)time; (void)out; (void)in; (void)count; // unused
+      (void)row_begin; (void)row_end; // unused
+      return false;
+    }
+
+    // update(), or a copy of the last output for memoizing effects.
+    void update_memoized(double time,
+                         uint32_t* out,
+                         const uint32_t* in1,
+                         const uint32_t* in2,
+                         const uint32_t* in3)
+    {
+      unsigned int inputs;
+      switch (effect_type())
+        {
+        case F0R_PLUGIN_TYPE_SOURCE: inputs = 0; break;
+        case F0R_PLUGIN_TYPE_FILTER: inputs = 1; break;
+        case F0R_PLUGIN_TYPE_MIXER2: inputs = 2; break;
+        case F0R_PLUGIN_TYPE_MIXER3: inputs = 3; break;
+        default: inputs = 4; break;
+        }
+      if (!memoize || inputs > 3)
+        {
+          update(time, out, in1, in2, in3);
+          return;
+        }
+      const uint32_t* in[3] = { in1, in2, in3 };
+      if (memo.lookup(param_generation, size, in, inputs, out))
+        return;
+      const bool keep = memo.repeat();
+      if (keep)
+        memo.keep_inputs(in);
+      update(time, out, in1, in2, in3);
+      if (keep)
+        memo.keep_output(out);
+    }
+
+    // Processes count frames as if update() was called for each of them
+    // in turn. Effects with expensive per-call setup may override this to
+    // do the setup once per batch.
+    virtual void update_batch(unsigned int count,
+                              const double* times,
+                              uint32_t* const* out,
+                              const uint32_t* const* in1,
+                              const uint32_t* const* in2,
+                              const uint32_t* const* in3)
+    {
+      for (unsigned int i = 0; i < count; ++i)
+        {
+          begin_frame(times[i]);
+          update_memoized(times[i], out[i],
+                 in1 ? in1[i] : 0,
+                 in2 ? in2[i] : 0,
+                 in3 ? in3[i] : 0);
+          end_frame();
+        }
+    }
     
     virtual ~fx()
     {
+      frei0r_arena_release(&arena);
     }
   };
   
+  // Adds the time until the end of the enclosing scope, or until stop(),
+  // to a stage of an effect:
+  //
+  //   { frei0r::stage_timer timer(*this, m_stage_blur); blur(); }
+  //
+  // Without FREI0R_ENABLE_STATS it compiles to nothing.
+  class stage_timer
+  {
+  public:
+#ifdef FREI0R_ENABLE_STATS
+    stage_timer(fx& effect, int stage)
+      : m_stats(&effect.stats), m_stage(stage),
+        m_start(frei0r_stats_now())
+    {
+    }
+
+    ~stage_timer()
+    {
+      stop();
+    }
+
+    void stop()
+    {
+      if (m_stats)
+        frei0r_stats_add(m_stats, m_stage, frei0r_stats_now() - m_start);
+      m_stats = 0;
+    }
+
+  private:
+    frei0r_stats_t* m_stats;
+    int m_stage;
+    double m_start;
+#else
+    stage_timer(fx&, int)
+    {
+    }
+
+    void stop()
+    {
+    }
+#endif
+  };
+
   class source : public fx
     {
     protected:
@@ -171,7 +1357,28 @@ namespace frei0r
       
     public:
       virtual unsigned int effect_type(){ return F0R_PLUGIN_TYPE_SOURCE; }
-      virtual void update(double time, uint32_t* out) = 0;
+      // Effects implement update() or update_slice(); one that does
+      // neither stops here rather than put out an untouched frame.
+      virtual void update(double time, uint32_t* out)
+      {
+        if (!update_slice(time, out, 0, height))
+          std::abort();
+      }
+      virtual bool update_slice(double time, uint32_t* out,
+                                unsigned int row_begin, unsigned int row_end)
+      {
+        (void)time; (void)out; (void)row_begin; (void)row_end; // unused
+        return false;
+      }
+      virtual bool update_stride(double time, uint32_t* out, int out_stride)
+      {
+        return fx::update_stride(time, out, out_stride, 0, 0, 0, 0, 0, 0);
+      }
+      virtual bool update_float(double time, float* out)
+      {
+        (void)time; (void)out; // unused
+        return false;
+      }
 
     private:
       virtual void update(double time,
@@ -184,6 +1391,38 @@ namespace frei0r
           (void)in3; // unused
           update(time, out);
       }
+      virtual bool update_slice(double time,
+                                uint32_t* out,
+                                const uint32_t* in1,
+                                const uint32_t* in2,
+                                const uint32_t* in3,
+                                unsigned int row_begin,
+                                unsigned int row_end) {
+          (void)in1; // unused
+          (void)in2; // unused
+          (void)in3; // unused
+          return update_slice(time, out, row_begin, row_end);
+      }
+      virtual bool update_stride(double time,
+                                 uint32_t* out, int out_stride,
+                                 const uint32_t* in1, int in1_stride,
+                                 const uint32_t* in2, int in2_stride,
+                                 const uint32_t* in3, int in3_stride) {
+          (void)in1; (void)in1_stride; // unused
+          (void)in2; (void)in2_stride; // unused
+          (void)in3; (void)in3_stride; // unused
+          return update_stride(time, out, out_stride);
+      }
+      virtual bool update_float(double time,
+                                float* out,
+                                const float* in1,
+                                const float* in2,
+                                const float* in3) {
+          (void)in1; // unused
+          (void)in2; // unused
+          (void)in3; // unused
+          return update_float(time, out);
+      }
   };
 
   class filter : public fx
@@ -193,7 +1432,31 @@ namespace frei0r
     
   public:
     virtual unsigned int effect_type(){ return F0R_PLUGIN_TYPE_FILTER; }
-    virtual void update(double time, uint32_t* out, const uint32_t* in1) = 0;
+    // Effects implement update() or update_slice(); one that does
+    // neither stops here rather than put out an untouched frame.
+    virtual void update(double time, uint32_t* out, const uint32_t* in1)
+    {
+      if (!update_slice(time, out, in1, 0, height))
+        std::abort();
+    }
+    virtual bool update_slice(double time, uint32_t* out, const uint32_t* in1,
+                              unsigned int row_begin, unsigned int row_end)
+    {
+      (void)time; (void)out; (void)in1; // unused
+      (void)row_begin; (void)row_end; // unused
+      return false;
+    }
+    virtual bool update_stride(double time, uint32_t* out, int out_stride,
+                               const uint32_t* in1, int in1_stride)
+    {
+      return fx::update_stride(time, out, out_stride, in1, in1_stride,
+                               0, 0, 0, 0);
+    }
+    virtual bool update_float(double time, float* out, const float* in1)
+    {
+      (void)time; (void)out; (void)in1; // unused
+      return false;
+    }
 
   private:
     virtual void update(double time,
@@ -205,6 +1468,35 @@ namespace frei0r
         (void)in3; // unused
         update(time, out, in1);
     }
+    virtual bool update_slice(double time,
+                              uint32_t* out,
+                              const uint32_t* in1,
+                              const uint32_t* in2,
+                              const uint32_t* in3,
+                              unsigned int row_begin,
+                              unsigned int row_end) {
+        (void)in2; // unused
+        (void)in3; // unused
+        return update_slice(time, out, in1, row_begin, row_end);
+    }
+    virtual bool update_stride(double time,
+                               uint32_t* out, int out_stride,
+                               const uint32_t* in1, int in1_stride,
+                               const uint32_t* in2, int in2_stride,
+                               const uint32_t* in3, int in3_stride) {
+        (void)in2; (void)in2_stride; // unused
+        (void)in3; (void)in3_stride; // unused
+        return update_stride(time, out, out_stride, in1, in1_stride);
+    }
+    virtual bool update_float(double time,
+                              float* out,
+                              const float* in1,
+                              const float* in2,
+                              const float* in3) {
+        (void)in2; // unused
+        (void)in3; // unused
+        return update_float(time, out, in1);
+    }
   };
 
   class mixer2 : public fx
@@ -214,7 +1506,34 @@ namespace frei0r
       
   public:
     virtual unsigned int effect_type(){ return F0R_PLUGIN_TYPE_MIXER2; }
-    virtual void update(double time, uint32_t* out, const uint32_t* in1, const uint32_t* in2) = 0;
+    // Effects implement update() or update_slice(); one that does
+    // neither stops here rather than put out an untouched frame.
+    virtual void update(double time, uint32_t* out, const uint32_t* in1, const uint32_t* in2)
+    {
+      if (!update_slice(time, out, in1, in2, 0, height))
+        std::abort();
+    }
+    virtual bool update_slice(double time, uint32_t* out,
+                              const uint32_t* in1, const uint32_t* in2,
+                              unsigned int row_begin, unsigned int row_end)
+    {
+      (void)time; (void)out; (void)in1; (void)in2; // unused
+      (void)row_begin; (void)row_end; // unused
+      return false;
+    }
+    virtual bool update_stride(double time, uint32_t* out, int out_stride,
+                               const uint32_t* in1, int in1_stride,
+                               const uint32_t* in2, int in2_stride)
+    {
+      return fx::update_stride(time, out, out_stride, in1, in1_stride,
+                               in2, in2_stride, 0, 0);
+    }
+    virtual bool update_float(double time, float* out,
+                              const float* in1, const float* in2)
+    {
+      (void)time; (void)out; (void)in1; (void)in2; // unused
+      return false;
+    }
 
   private:
     virtual void update(double time,
@@ -225,6 +1544,107 @@ namespace frei0r
         (void)in3; // unused
         update(time, out, in1, in2);
     }
+    virtual bool update_slice(double time,
+                              uint32_t* out,
+                              const uint32_t* in1,
+                              const uint32_t* in2,
+                              const uint32_t* in3,
+                              unsigned int row_begin,
+                              unsigned int row_end) {
+        (void)in3; // unused
+        return update_slice(time, out, in1, in2, row_begin, row_end);
+    }
+    virtual bool update_stride(double time,
+                               uint32_t* out, int out_stride,
+                               const uint32_t* in1, int in1_stride,
+                               const uint32_t* in2, int in2_stride,
+                               const uint32_t* in3, int in3_stride) {
+        (void)in3; (void)in3_stride; // unused
+        return update_stride(time, out, out_stride, in1, in1_stride,
+                             in2, in2_stride);
+    }
+    virtual bool update_float(double time,
+                              float* out,
+                              const float* in1,
+                              const float* in2,
+                              const float* in3) {
+        (void)in3; // unused
+        return update_float(time, out, in1, in2);
+    }
+  };
+
+  // Per-channel blend modes like the gimp layer modes. A mode is a
+  // struct deriving from blend_op<itself> with
+  //
+  //   static uint8_t channel(int a, int b);
+  //
+  // giving one color channel of the result from the channels a of in1
+  // and b of in2 (both in [0, 255]). The plugin class then only needs
+  //
+  //   class overlay : public frei0r::blend_mixer<overlay_op> { ... };
+  //
+  // blend_mixer runs the mode over slices of the frame, the output alpha
+  // is the minimum of both input alphas. channel() is evaluated once for
+  // all 256x256 inputs when the plugin is loaded, so every mode costs the
+  // same three table lookups per pixel. Modes that have a vector kernel
+  // in frei0r_simd.h hide init() and row() with their own instead.
+  template<class Op>
+  struct blend_op
+  {
+    static uint8_t table[256][256];
+
+    static void init()
+    {
+      for (unsigned int a = 0; a < 256; ++a)
+        for (unsigned int b = 0; b < 256; ++b)
+          table[a][b] = Op::channel(a, b);
+    }
+
+    static void row(uint32_t* dst, const uint32_t* src1,
+                    const uint32_t* src2, unsigned int n)
+    {
+      for (unsigned int i = 0; i < n; ++i)
+        {
+          uint32_t a = src1[i], b = src2[i];
+          uint32_t aa = a >> 24, ba = b >> 24;
+          dst[i] = table[a & 0xff][b & 0xff]
+            | (table[(a >> 8) & 0xff][(b >> 8) & 0xff] << 8)
+            | (table[(a >> 16) & 0xff][(b >> 16) & 0xff] << 16)
+            | (std::min(aa, ba) << 24);
+        }
+    }
+  };
+
+  template<class Op>
+  uint8_t blend_op<Op>::table[256][256];
+
+  template<class Op>
+  class blend_mixer : public mixer2
+  {
+  protected:
+    blend_mixer()
+    {
+      pointwise = true;
+      // the first instance is made by construct<> while loading the plugin
+      static bool initialized = false;
+      if (!initialized)
+        {
+          Op::init();
+          initialized = true;
+        }
+    }
+
+  public:
+    virtual bool update_slice(double time, uint32_t* out,
+                              const uint32_t* in1, const uint32_t* in2,
+                              unsigned int row_begin, unsigned int row_end)
+    {
+      (void)time; // unused
+      const unsigned int offset = width * row_begin;
+      Op::row(out + offset, in1 + offset, in2 + offset,
+              width * (row_end - row_begin));
+      return true;
+    }
   };
 
   
@@ -237,6 +1657,43 @@ namespace frei0r
     virtual unsigned int effect_type(){ return F0R_PLUGIN_TYPE_MIXER3; }
   };
 
+
+  // Effects with any number of inputs. They implement update_layers(),
+  // update() and update_slice() pass the non-zero frames among in1, in2
+  // and in3 on to it. update_layers() must accept count == 0 as a probe
+  // and return whether it supports slices.
+  class mixern : public fx
+  {
+  protected:
+    mixern() {}
+
+  public:
+    virtual unsigned int effect_type(){ return F0R_PLUGIN_TYPE_MIXERN; }
+
+  private:
+    virtual void update(double time,
+              uint32_t* out,
+              const uint32_t* in1,
+              const uint32_t* in2,
+              const uint32_t* in3) {
+        update_slice(time, out, in1, in2, in3, 0, height);
+    }
+    virtual bool update_slice(double time,
+                              uint32_t* out,
+                              const uint32_t* in1,
+                              const uint32_t* in2,
+                              const uint32_t* in3,
+                              unsigned int row_begin,
+                              unsigned int row_end) {
+        const uint32_t* in[3];
+        unsigned int count = 0;
+        if (in1) in[count++] = in1;
+        if (in2) in[count++] = in2;
+        if (in3) in[count++] = in3;
+        return update_layers(time, out, in, count, row_begin, row_end);
+    }
+  };
+
   
   // register stuff
   template<class T>
@@ -248,9 +1705,13 @@ namespace frei0r
               const std::string& author,
               const int& major_version,
               const int& minor_version,
-              unsigned int color_model = F0R_COLOR_MODEL_BGRA8888)
+              unsigned int color_model = F0R_COLOR_MODEL_BGRA8888,
+              unsigned int capabilities = 0)
     {
+      s_params.clear();
+      s_registering=true;
       T a(0,0);
+      s_registering=false;
       
       s_name=name; 
       s_explanation=explanation;
@@ -260,6 +1721,13 @@ namespace frei0r
       
       s_effect_type=a.effect_type();
       s_color_model=color_model;
+
+      // the effect declares what it implements (e.g. F0R_CAP_INPLACE,
+      // F0R_CAP_TEMPORAL, F0R_CAP_SEEK, F0R_CAP_FLOAT, F0R_CAP_TILE,
+      // F0R_CAP_CLONE or F0R_CAP_STATE), only slices are found out here
+      s_capabilities=capabilities | F0R_CAP_REENTRANT;
+      if (static_cast<fx&>(a).update_slice(0, 0, 0, 0, 0, 0, 0))
+        s_capabilities|=F0R_CAP_SLICE;
     }
 
   private:
@@ -295,6 +1763,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
   info->num_params =  static_cast<int>(frei0r::s_params.size()); 
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = frei0r::s_capabilities;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   info->name=frei0r::s_params[param_index].m_name.c_str();
@@ -334,12 +1808,378 @@ void f0r_update2(f0r_instance_t instance, double time,
 		 const uint32_t* inframe3,
 		 uint32_t* outframe)
 {
-  static_cast<frei0r::fx*>(instance)->update(time,
-                                             outframe,
-                                             inframe1,
-                                             inframe2,
-                                             inframe3);
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  fx->begin_frame(time);
+  fx->update_memoized(time, outframe, inframe1, inframe2, inframe3);
+  fx->end_frame();
+}
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+		     const uint32_t* inframe1,
+		     const uint32_t* inframe2,
+		     const uint32_t* inframe3,
+		     uint32_t* outframe,
+		     unsigned int row_begin,
+		     unsigned int row_end,
+		     unsigned int thread_index)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  (void)thread_index; // unused
+  if (row_begin > row_end || row_end > fx->height)
+    return 0;
+  return fx->update_slice(time, outframe, inframe1, inframe2, inframe3,
+                          row_begin, row_end) ? 1 : 0;
+}
+
+int f0r_update_stride(f0r_instance_t instance, double time,
+		      const uint32_t* inframe1, int inframe1_stride,
+		      const uint32_t* inframe2, int inframe2_stride,
+		      const uint32_t* inframe3, int inframe3_stride,
+		      uint32_t* outframe, int outframe_stride)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  fx->begin_frame(time);
+  const bool done = fx->update_stride(time,
+                                      outframe, outframe_stride,
+                                      inframe1, inframe1_stride,
+                                      inframe2, inframe2_stride,
+                                      inframe3, inframe3_stride);
+  fx->end_frame();
+  return done ? 1 : 0;
+}
+
+const uint32_t* f0r_update_view(f0r_instance_t instance,
+				double time,
+				const uint32_t* inframe1,
+				const uint32_t* inframe2,
+				const uint32_t* inframe3)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  fx->begin_frame(time);
+  const uint32_t* view = fx->update_view(time, inframe1, inframe2, inframe3);
+  fx->end_frame();
+  return view;
+}
+
+int f0r_set_frame_history(f0r_instance_t instance,
+			  const f0r_frame_history_t* history)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  if (!fx->history)
+    return 0;
+  fx->history->set_host(history);
+  return static_cast<int>(fx->history->depth());
+}
+
+int f0r_seek(f0r_instance_t instance, double time, uint64_t frame)
+{
+  return static_cast<frei0r::fx*>(instance)->seek(time, frame) ? 1 : 0;
+}
+
+int f0r_update_float(f0r_instance_t instance, double time,
+		     const float* inframe1,
+		     const float* inframe2,
+		     const float* inframe3,
+		     float* outframe)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  fx->begin_frame(time);
+  const bool done = fx->update_float(time, outframe,
+                                     inframe1, inframe2, inframe3);
+  fx->end_frame();
+  return done ? 1 : 0;
+}
+
+int f0r_get_footprint(f0r_instance_t instance)
+{
+  return static_cast<frei0r::fx*>(instance)->footprint();
+}
+
+int f0r_update_tile(f0r_instance_t instance, double time,
+		    const uint32_t* inframe, int inframe_stride,
+		    const f0r_rect_t* inrect,
+		    uint32_t* outframe, int outframe_stride,
+		    const f0r_rect_t* outrect)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  const int w = static_cast<int>(fx->width), h = static_cast<int>(fx->height);
+  const int halo = fx->footprint();
+  // the tile and the part of the input it needs, in the frame
+  if (outrect->x < 0 || outrect->y < 0 || outrect->width < 0
+      || outrect->height < 0 || outrect->x + outrect->width > w
+      || outrect->y + outrect->height > h
+      || inrect->x < 0 || inrect->y < 0
+      || inrect->x + inrect->width > w || inrect->y + inrect->height > h)
+    return 0;
+  if (halo == F0R_FOOTPRINT_FULL
+      ? inrect->x != 0 || inrect->y != 0
+        || inrect->width != w || inrect->height != h
+      : inrect->x > std::max(outrect->x - halo, 0)
+        || inrect->y > std::max(outrect->y - halo, 0)
+        || inrect->x + inrect->width < std::min(outrect->x + outrect->width + halo, w)
+        || inrect->y + inrect->height < std::min(outrect->y + outrect->height + halo, h))
+    return 0;
+  return fx->update_tile(time, outframe, outframe_stride, *outrect,
+                         inframe, inframe_stride, *inrect) ? 1 : 0;
+}
+
+int f0r_get_region(f0r_instance_t instance, f0r_rect_t* rect)
+{
+  return static_cast<frei0r::fx*>(instance)->region(*rect) ? 1 : 0;
+}
+
+f0r_instance_t f0r_clone(f0r_instance_t instance)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  frei0r::fx* nfx = static_cast<frei0r::fx*>(f0r_construct(fx->width,
+                                                           fx->height));
+  for (int i = 0; i < static_cast<int>(fx->param_ptrs.size()); ++i)
+    {
+      union
+      {
+        f0r_param_double d;
+        f0r_param_color_t color;
+        f0r_param_position_t position;
+        f0r_param_string string;
+      } value;
+      fx->get_param_value(&value, i);
+      nfx->set_param_value(&value, i);
+    }
+  nfx->param_curves = fx->param_curves;
+  if (fx->history && nfx->history)
+    nfx->history->assign(*fx->history);
+  if (!nfx->clone_state(*fx))
+    {
+      delete nfx;
+      return 0;
+    }
+  return nfx;
+}
+
+// the format of the state is that of the effect's version
+static uint32_t frei0r_state_version()
+{
+  return (static_cast<uint32_t>(frei0r::s_version.first) << 16)
+    | static_cast<uint32_t>(frei0r::s_version.second);
+}
+
+size_t f0r_save_state(f0r_instance_t instance, void* buffer, size_t size)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  if (!(frei0r::s_capabilities & F0R_CAP_STATE))
+    return 0;
+  frei0r_state_t s;
+  frei0r_state_save(&s, buffer, size, frei0r_state_version(),
+                    fx->width, fx->height);
+  frei0r::state st(s);
+  if (fx->history)
+    fx->history->serialize(st);
+  return fx->serialize(st) && st.ok() ? frei0r_state_size(&s) : 0;
+}
+
+int f0r_load_state(f0r_instance_t instance, const void* buffer, size_t size)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  if (!(frei0r::s_capabilities & F0R_CAP_STATE))
+    return 0;
+  frei0r_state_t s;
+  frei0r_state_load(&s, buffer, size, frei0r_state_version(),
+                    fx->width, fx->height);
+  frei0r::state st(s);
+  if (!st.ok())
+    return 0;
+  if (fx->history)
+    fx->history->serialize(st);
+  return fx->serialize(st) && frei0r_state_end(&s) ? 1 : 0;
+}
+
+int f0r_set_param_curve(f0r_instance_t instance, int param_index,
+                        const f0r_param_key_t* keys, unsigned int count)
+{
+  return static_cast<frei0r::fx*>(instance)->set_param_curve(param_index,
+                                                             keys, count)
+    ? 1 : 0;
+}
+
+int f0r_is_identity(f0r_instance_t instance)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  for (int i = 0; i < static_cast<int>(fx->param_curves.size()); ++i)
+    if (fx->animated(i))
+      return 0;
+  return fx->identity() ? 1 : 0;
+}
+
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  frei0r_deadline_t deadline = fx->deadline;
+  frei0r_deadline_request(&deadline, quality);
+  if (!fx->set_quality(deadline.current))
+    return 0;
+  fx->deadline = deadline;
+  // the output changes like with a new parameter value, see memoize
+  ++fx->param_generation;
+  return 1;
+}
+
+int f0r_set_deadline(f0r_instance_t instance, double seconds)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  // only effects with qualities can keep to a budget
+  if (!fx->set_quality(fx->deadline.current))
+    return 0;
+  frei0r_deadline_set(&fx->deadline, seconds);
+  return 1;
+}
+
+int f0r_get_quality(f0r_instance_t instance)
+{
+  return static_cast<frei0r::fx*>(instance)->deadline.current;
+}
+
+int f0r_reset(f0r_instance_t instance)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  if (fx->history)
+    fx->history->forget();
+  // only the effect knows what else it keeps from earlier frames
+  return fx->reset() ? 1 : 0;
+}
+
+int f0r_set_proxy(f0r_instance_t instance, const uint32_t* proxy,
+                  unsigned int width, unsigned int height)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  fx->proxy = 0;
+  if (!fx->uses_proxy())
+    return 0;
+  if (!proxy || !width || !height
+      || width > fx->width || height > fx->height)
+    return 0;
+  fx->proxy = proxy;
+  fx->proxy_width = width;
+  fx->proxy_height = height;
+  return 1;
+}
+
+int f0r_get_row_map(f0r_instance_t instance, unsigned int* rows)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  for (int i = 0; i < static_cast<int>(fx->param_curves.size()); ++i)
+    if (fx->animated(i))
+      return 0;
+  return fx->row_map(rows) ? 1 : 0;
+}
+
+int f0r_get_active_rect(f0r_instance_t instance, f0r_rect_t* rect,
+                        uint32_t* fill)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  for (int i = 0; i < static_cast<int>(fx->param_curves.size()); ++i)
+    if (fx->animated(i))
+      return 0;
+  return fx->active_rect(rect, fill) ? 1 : 0;
+}
+
+int f0r_trim(f0r_instance_t instance)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  // temporal effects start over, as after f0r_reset()
+  fx->reset();
+  const bool had = frei0r_arena_bytes(&fx->arena) + fx->memo.bytes()
+    + (fx->history ? fx->history->bytes() : 0) != 0;
+  frei0r_arena_release(&fx->arena);
+  fx->memo.release();
+  if (fx->history)
+    fx->history->release();
+  return fx->trim() || had ? 1 : 0;
+}
+
+int f0r_resize(f0r_instance_t instance,
+               unsigned int width, unsigned int height)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  if (width == fx->width && height == fx->height)
+    return 1;
+  if (!fx->resize(width, height))
+    return 0;
+  fx->width = width;
+  fx->height = height;
+  fx->size = width * height;
+  frei0r_arena_release(&fx->arena);
+  fx->memo.release();
+  if (fx->history)
+    fx->history->resize(width, height);
+  return 1;
+}
+
+int f0r_get_memory_usage(f0r_instance_t instance, f0r_memory_usage_t* usage)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  std::size_t inputs;
+  switch (fx->effect_type())
+    {
+    case F0R_PLUGIN_TYPE_SOURCE: inputs = 0; break;
+    case F0R_PLUGIN_TYPE_FILTER: inputs = 1; break;
+    case F0R_PLUGIN_TYPE_MIXER3: inputs = 3; break;
+    default: inputs = 2; break; // mixers of n layers: at least two
+    }
+  const std::size_t kept = frei0r_arena_bytes(&fx->arena) + fx->memo.bytes()
+    + (fx->history ? fx->history->bytes() : 0);
+  usage->resident = kept;
+  usage->touched = kept + (inputs + 1) * fx->size * sizeof(uint32_t);
+  fx->memory_usage(usage->resident, usage->touched);
+  return 1;
+}
+
+void f0r_update_batch(f0r_instance_t instance,
+		      unsigned int count,
+		      const double* times,
+		      const uint32_t* const* inframes1,
+		      const uint32_t* const* inframes2,
+		      const uint32_t* const* inframes3,
+		      uint32_t* const* outframes)
+{
+  static_cast<frei0r::fx*>(instance)->update_batch(count,
+                                                   times,
+                                                   outframes,
+                                                   inframes1,
+                                                   inframes2,
+                                                   inframes3);
+}
+
+int f0r_update_layers(f0r_instance_t instance,
+		      double time,
+		      const uint32_t* const* inframes,
+		      unsigned int count,
+		      uint32_t* outframe,
+		      unsigned int row_begin,
+		      unsigned int row_end)
+{
+  frei0r::fx* fx = static_cast<frei0r::fx*>(instance);
+  if (!count || row_begin > row_end || row_end > fx->height)
+    return 0;
+  return fx->update_layers(time, outframe, inframes, count,
+                           row_begin, row_end) ? 1 : 0;
+}
+
+void f0r_set_allocator(f0r_instance_t instance,
+		       const f0r_allocator_t* allocator)
+{
+  frei0r_arena_set_allocator(&static_cast<frei0r::fx*>(instance)->arena,
+                             allocator);
+}
+
+#ifdef FREI0R_ENABLE_STATS
+int f0r_get_stats(f0r_instance_t instance,
+		  f0r_stat_info_t* stats,
+		  int count)
+{
+  return frei0r_stats_get(&static_cast<frei0r::fx*>(instance)->stats,
+                          stats, count);
 }
+#endif
 
 // compability for frei0r 1.0 
 void f0r_update(f0r_instance_t instance, 
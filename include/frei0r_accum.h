@@ -0,0 +1,314 @@
+#ifndef INCLUDED_FREI0R_ACCUM_H
+#define INCLUDED_FREI0R_ACCUM_H
+
+/*
+
+  Running buffers for effects that accumulate frames over time (moving
+  averages of the background, fading trails, long exposures). A buffer
+  holds one uint16_t per byte of a packed pixel, the byte b as b * 257,
+  so that the high byte of each entry is the byte again and 65535 is
+  full. That is half the memory of float buffers, and eight entries fit
+  one SSE2 register. The kernels work on n pixels, 4 * n entries, of a
+  buffer acc and a frame src:
+
+  frei0r_accum_load   acc = src
+  frei0r_accum_ema    acc += (src - acc) * w / 65536, rounded; an
+                      exponential moving average with w from 0 (acc is
+                      kept) to 65536 (acc = src)
+  frei0r_accum_decay  acc = acc * w / 65536, w from 0 to 65536
+  frei0r_accum_max    acc = MAX(acc, src)
+  frei0r_accum_add    acc = MIN(acc + src * w / 65536, 65535), w from 0
+                      to 65536
+
+  frei0r_accum_decay() ignores src, frei0r_accum_load() and
+  frei0r_accum_max() ignore w. The results are the same with and without
+  SSE2. frei0r_accum_store(dst, acc, n) makes a frame of the high bytes.
+
+  frei0r_accum_run() splits a kernel over threads (frei0r_thread.h), and
+  frei0r_accum_run_store() the store:
+
+  frei0r_accum_run(frei0r_accum_ema, acc, in, w, width * height);
+  frei0r_accum_run_store(out, acc, width * height);
+
+  frei0r_accum_weight() gives the w of a factor from 0 to 1.
+
+*/
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_thread.h"
+
+typedef void (*frei0r_accum_fn)(uint16_t* acc, const uint32_t* src,
+                                unsigned int w, unsigned int n);
+
+static inline unsigned int frei0r_accum_weight(double f)
+{
+  if (!(f > 0))
+    return 0;
+  if (f >= 1)
+    return 65536;
+  return (unsigned int)(f * 65536 + 0.5);
+}
+
+/* the entry of byte b */
+#define FREI0R_ACCUM_ENTRY(b) ((uint16_t)((b) * 257))
+
+#if defined(__SSE2__)
+
+/* the entries of the bytes of the low or high two pixels of p */
+#define FREI0R_ACCUM_LO_(p) _mm_unpacklo_epi8(p, p)
+#define FREI0R_ACCUM_HI_(p) _mm_unpackhi_epi8(p, p)
+
+/* (d * w + 32768) >> 16, the rounding bit is the top of the low half */
+static inline __m128i frei0r_accum_mulr_8_(__m128i d, __m128i w)
+{
+  return _mm_add_epi16(_mm_mulhi_epu16(d, w),
+                       _mm_srli_epi16(_mm_mullo_epi16(d, w), 15));
+}
+
+/* one of the differences is 0, so the moving average doesn't overflow */
+static inline __m128i frei0r_accum_ema_8_(__m128i a, __m128i s, __m128i w)
+{
+  return _mm_sub_epi16(
+    _mm_add_epi16(a, frei0r_accum_mulr_8_(_mm_subs_epu16(s, a), w)),
+    frei0r_accum_mulr_8_(_mm_subs_epu16(a, s), w));
+}
+
+/* MAX(a, s) without _mm_max_epu16(), which needs SSE4.1 */
+static inline __m128i frei0r_accum_max_8_(__m128i a, __m128i s)
+{
+  return _mm_add_epi16(_mm_subs_epu16(a, s), s);
+}
+
+#endif
+
+static inline void frei0r_accum_load(uint16_t* acc, const uint32_t* src,
+                                     unsigned int w, unsigned int n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  unsigned int i = 0;
+
+  (void)w;
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4)
+    {
+      __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+      _mm_storeu_si128((__m128i*)(acc + 4 * i), FREI0R_ACCUM_LO_(p));
+      _mm_storeu_si128((__m128i*)(acc + 4 * i + 8), FREI0R_ACCUM_HI_(p));
+    }
+#endif
+  for (i *= 4; i < 4 * n; ++i)
+    acc[i] = FREI0R_ACCUM_ENTRY(s[i]);
+}
+
+static inline void frei0r_accum_ema(uint16_t* acc, const uint32_t* src,
+                                    unsigned int w, unsigned int n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  unsigned int i = 0;
+  unsigned int e;
+
+  if (w >= 65536)
+    {
+      frei0r_accum_load(acc, src, w, n);
+      return;
+    }
+  if (!w)
+    return;
+#if defined(__SSE2__)
+  {
+    const __m128i vw = _mm_set1_epi16((short)w);
+    __m128i p, *a;
+
+    for (; i + 4 <= n; i += 4)
+      {
+        p = _mm_loadu_si128((const __m128i*)(src + i));
+        a = (__m128i*)(acc + 4 * i);
+        _mm_storeu_si128(a, frei0r_accum_ema_8_(
+          _mm_loadu_si128(a), FREI0R_ACCUM_LO_(p), vw));
+        _mm_storeu_si128(a + 1, frei0r_accum_ema_8_(
+          _mm_loadu_si128(a + 1), FREI0R_ACCUM_HI_(p), vw));
+      }
+  }
+#endif
+  for (i *= 4; i < 4 * n; ++i)
+    {
+      e = FREI0R_ACCUM_ENTRY(s[i]);
+      if (e > acc[i])
+        acc[i] += ((e - acc[i]) * w + 32768) >> 16;
+      else
+        acc[i] -= ((acc[i] - e) * w + 32768) >> 16;
+    }
+}
+
+static inline void frei0r_accum_decay(uint16_t* acc, const uint32_t* src,
+                                      unsigned int w, unsigned int n)
+{
+  unsigned int i = 0;
+
+  (void)src;
+  if (w >= 65536)
+    return;
+#if defined(__SSE2__)
+  {
+    const __m128i vw = _mm_set1_epi16((short)w);
+    __m128i* a;
+
+    for (; i + 2 <= n; i += 2)
+      {
+        a = (__m128i*)(acc + 4 * i);
+        _mm_storeu_si128(a, _mm_mulhi_epu16(_mm_loadu_si128(a), vw));
+      }
+  }
+#endif
+  for (i *= 4; i < 4 * n; ++i)
+    acc[i] = (uint16_t)((acc[i] * w) >> 16);
+}
+
+static inline void frei0r_accum_max(uint16_t* acc, const uint32_t* src,
+                                    unsigned int w, unsigned int n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  unsigned int i = 0;
+  uint16_t e;
+
+  (void)w;
+#if defined(__SSE2__)
+  {
+    __m128i p, *a;
+
+    for (; i + 4 <= n; i += 4)
+      {
+        p = _mm_loadu_si128((const __m128i*)(src + i));
+        a = (__m128i*)(acc + 4 * i);
+        _mm_storeu_si128(a, frei0r_accum_max_8_(_mm_loadu_si128(a),
+                                                FREI0R_ACCUM_LO_(p)));
+        _mm_storeu_si128(a + 1, frei0r_accum_max_8_(_mm_loadu_si128(a + 1),
+                                                    FREI0R_ACCUM_HI_(p)));
+      }
+  }
+#endif
+  for (i *= 4; i < 4 * n; ++i)
+    {
+      e = FREI0R_ACCUM_ENTRY(s[i]);
+      if (e > acc[i])
+        acc[i] = e;
+    }
+}
+
+static inline void frei0r_accum_add(uint16_t* acc, const uint32_t* src,
+                                    unsigned int w, unsigned int n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  unsigned int i = 0;
+  unsigned int e;
+
+  if (!w)
+    return;
+#if defined(__SSE2__)
+  {
+    /* w = 65536 adds the entries themselves */
+    const __m128i vw = _mm_set1_epi16((short)(w < 65536 ? w : 0));
+    const __m128i all = _mm_set1_epi16(w < 65536 ? 0 : -1);
+    __m128i p, lo, hi, *a;
+
+    for (; i + 4 <= n; i += 4)
+      {
+        p = _mm_loadu_si128((const __m128i*)(src + i));
+        a = (__m128i*)(acc + 4 * i);
+        lo = FREI0R_ACCUM_LO_(p);
+        hi = FREI0R_ACCUM_HI_(p);
+        lo = _mm_or_si128(_mm_mulhi_epu16(lo, vw), _mm_and_si128(lo, all));
+        hi = _mm_or_si128(_mm_mulhi_epu16(hi, vw), _mm_and_si128(hi, all));
+        _mm_storeu_si128(a, _mm_adds_epu16(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_adds_epu16(_mm_loadu_si128(a + 1), hi));
+      }
+  }
+#endif
+  for (i *= 4; i < 4 * n; ++i)
+    {
+      e = acc[i] + ((FREI0R_ACCUM_ENTRY(s[i]) * w) >> 16);
+      acc[i] = (uint16_t)(e < 65535 ? e : 65535);
+    }
+}
+
+static inline void frei0r_accum_store(uint32_t* dst, const uint16_t* acc,
+                                      unsigned int n)
+{
+  uint8_t* d = (uint8_t*)dst;
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4)
+    {
+      const __m128i* a = (const __m128i*)(acc + 4 * i);
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(
+        _mm_srli_epi16(_mm_loadu_si128(a), 8),
+        _mm_srli_epi16(_mm_loadu_si128(a + 1), 8)));
+    }
+#endif
+  for (i *= 4; i < 4 * n; ++i)
+    d[i] = (uint8_t)(acc[i] >> 8);
+}
+
+typedef struct frei0r_accum_job
+{
+  frei0r_accum_fn fn;   /* 0 for the store */
+  uint16_t* acc;
+  const uint32_t* src;
+  uint32_t* dst;
+  unsigned int w, n;
+} frei0r_accum_job_t;
+
+static void* frei0r_accum_job_(void* arg)
+{
+  frei0r_accum_job_t* job = (frei0r_accum_job_t*)arg;
+  if (job->fn)
+    job->fn(job->acc, job->src, job->w, job->n);
+  else
+    frei0r_accum_store(job->dst, job->acc, job->n);
+  return 0;
+}
+
+/* the n pixels in bands of whole cache lines of acc, one per thread */
+static inline void frei0r_accum_split_(frei0r_accum_fn fn, uint16_t* acc,
+                                       const uint32_t* src, uint32_t* dst,
+                                       unsigned int w, unsigned int n)
+{
+  frei0r_accum_job_t jobs[FREI0R_MAX_THREADS];
+  int i, k = frei0r_thread_count(n);
+  unsigned int p0, p1;
+
+  for (i = 0; i < k; ++i)
+    {
+      p0 = (unsigned int)((unsigned long)n * i / k) & ~7u;
+      p1 = i + 1 < k ? (unsigned int)((unsigned long)n * (i + 1) / k) & ~7u
+                     : n;
+      jobs[i].fn = fn;
+      jobs[i].acc = acc + 4 * (unsigned long)p0;
+      jobs[i].src = src ? src + p0 : 0;
+      jobs[i].dst = dst ? dst + p0 : 0;
+      jobs[i].w = w;
+      jobs[i].n = p1 - p0;
+    }
+  frei0r_thread_run(frei0r_accum_job_, jobs, sizeof(frei0r_accum_job_t), k);
+}
+
+static inline void frei0r_accum_run(frei0r_accum_fn fn, uint16_t* acc,
+                                    const uint32_t* src, unsigned int w,
+                                    unsigned int n)
+{
+  frei0r_accum_split_(fn, acc, src, 0, w, n);
+}
+
+static inline void frei0r_accum_run_store(uint32_t* dst, uint16_t* acc,
+                                          unsigned int n)
+{
+  frei0r_accum_split_(0, acc, 0, dst, 0, n);
+}
+
+#endif
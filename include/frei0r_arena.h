@@ -0,0 +1,198 @@
+#ifndef INCLUDED_FREI0R_ARENA_H
+#define INCLUDED_FREI0R_ARENA_H
+
+/*
+
+  Per-instance scratch memory for plugins that need temporary buffers in
+  every update.
+
+  The arena hands out 16 byte aligned memory that stays valid until the
+  next frei0r_arena_reset(), which the plugin calls at the start of each
+  update instead of freeing its buffers one by one. Memory that doesn't
+  fit into the arena's block is allocated separately; on the next reset
+  these allocations are replaced by one block big enough for the whole
+  frame. After the first frame an update therefore doesn't allocate at
+  all, as long as the frame size and the parameters stay the same.
+
+  Memory comes from the host's f0r_allocator_t if it installed one with
+  f0r_set_allocator(), otherwise from the C library, large blocks on
+  huge pages (frei0r_pages.h):
+
+  void f0r_update(...)
+  {
+    float* tmp;
+
+    frei0r_arena_reset(&inst->arena);
+    tmp = frei0r_arena_alloc(&inst->arena, width*height*sizeof(float));
+    ...
+  }
+
+  void f0r_set_allocator(f0r_instance_t instance,
+                         const f0r_allocator_t* allocator)
+  {
+    frei0r_arena_set_allocator(&((inst*)instance)->arena, allocator);
+  }
+
+  The arena is not thread safe; slices processed concurrently must not
+  share one. C++ effects get an arena as frei0r::fx::arena, see
+  frei0r.hpp.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "frei0r.h"
+#include "frei0r_pages.h"
+
+#define FREI0R_ARENA_ALIGN 16
+
+/* header of an allocation that didn't fit into the block */
+typedef struct frei0r_arena_chunk
+{
+  struct frei0r_arena_chunk* next;
+  unsigned char pad[FREI0R_ARENA_ALIGN - sizeof(void*) % FREI0R_ARENA_ALIGN];
+} frei0r_arena_chunk_t;
+
+typedef struct frei0r_arena
+{
+  f0r_allocator_t allocator;    /* alloc == 0 for the C library */
+  unsigned char* block;
+  size_t size;                  /* size of block */
+  size_t used;                  /* bytes of block handed out */
+  size_t needed;                /* bytes requested since the last reset */
+  frei0r_arena_chunk_t* chunks; /* allocations outside block */
+} frei0r_arena_t;
+
+static inline void* frei0r_arena_system_alloc(frei0r_arena_t* arena,
+                                              size_t size)
+{
+  void* ptr = 0;
+
+  if (arena->allocator.alloc)
+    return arena->allocator.alloc(arena->allocator.opaque, size,
+                                  FREI0R_ARENA_ALIGN);
+#ifdef _WIN32
+  ptr = _aligned_malloc(size, FREI0R_ARENA_ALIGN);
+#else
+  if (size >= FREI0R_PAGES_MIN)
+    ptr = frei0r_pages_alloc(size);
+  else if (posix_memalign(&ptr, FREI0R_ARENA_ALIGN, size) != 0)
+    ptr = 0;
+#endif
+  return ptr;
+}
+
+static inline void frei0r_arena_system_free(frei0r_arena_t* arena,
+                                            void* ptr)
+{
+  if (!ptr)
+    return;
+  if (arena->allocator.alloc)
+    {
+      arena->allocator.free(arena->allocator.opaque, ptr);
+      return;
+    }
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+static inline void frei0r_arena_init(frei0r_arena_t* arena)
+{
+  memset(arena, 0, sizeof(*arena));
+}
+
+static inline void frei0r_arena_free_chunks(frei0r_arena_t* arena)
+{
+  while (arena->chunks)
+    {
+      frei0r_arena_chunk_t* next = arena->chunks->next;
+      frei0r_arena_system_free(arena, arena->chunks);
+      arena->chunks = next;
+    }
+}
+
+/* Gives all memory back to the allocator. */
+static inline void frei0r_arena_release(frei0r_arena_t* arena)
+{
+  frei0r_arena_free_chunks(arena);
+  frei0r_arena_system_free(arena, arena->block);
+  arena->block = 0;
+  arena->size = arena->used = arena->needed = 0;
+}
+
+/* The bytes the arena holds: its block and what didn't fit into it. */
+static inline size_t frei0r_arena_bytes(const frei0r_arena_t* arena)
+{
+  return arena->size + (arena->needed - arena->used);
+}
+
+/* Makes all memory handed out so far available again. If the last frame
+   didn't fit into the block, the block is grown to what it needed. */
+static inline void frei0r_arena_reset(frei0r_arena_t* arena)
+{
+  if (arena->chunks)
+    {
+      size_t needed = arena->needed;
+
+      frei0r_arena_release(arena);
+      arena->block = (unsigned char*)frei0r_arena_system_alloc(arena, needed);
+      if (arena->block)
+        arena->size = needed;
+    }
+  arena->used = arena->needed = 0;
+}
+
+/* Returns size bytes of 16 byte aligned memory, or 0 if out of memory. */
+static inline void* frei0r_arena_alloc(frei0r_arena_t* arena, size_t size)
+{
+  frei0r_arena_chunk_t* chunk;
+
+  size = (size + FREI0R_ARENA_ALIGN - 1) & ~(size_t)(FREI0R_ARENA_ALIGN - 1);
+  arena->needed += size;
+  if (size <= arena->size - arena->used)
+    {
+      void* ptr = arena->block + arena->used;
+      arena->used += size;
+      return ptr;
+    }
+
+  chunk = (frei0r_arena_chunk_t*)
+    frei0r_arena_system_alloc(arena, sizeof(frei0r_arena_chunk_t) + size);
+  if (!chunk)
+    return 0;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+  return chunk + 1;
+}
+
+/* Like frei0r_arena_alloc(), but the memory is cleared. */
+static inline void* frei0r_arena_calloc(frei0r_arena_t* arena,
+                                        size_t count, size_t size)
+{
+  void* ptr = frei0r_arena_alloc(arena, count * size);
+  if (ptr)
+    memset(ptr, 0, count * size);
+  return ptr;
+}
+
+/* Implements f0r_set_allocator(). Memory from the previous allocator is
+   released, so nothing obtained from the arena may be in use. */
+static inline void frei0r_arena_set_allocator(frei0r_arena_t* arena,
+                                              const f0r_allocator_t* allocator)
+{
+  frei0r_arena_release(arena);
+  if (allocator && allocator->alloc && allocator->free)
+    arena->allocator = *allocator;
+  else
+    memset(&arena->allocator, 0, sizeof(arena->allocator));
+}
+
+#endif
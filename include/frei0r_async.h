@@ -0,0 +1,321 @@
+#ifndef INCLUDED_FREI0R_ASYNC_H
+#define INCLUDED_FREI0R_ASYNC_H
+
+/*
+
+  Queue for plugins that implement f0r_update_async(): the frames and the
+  parameter changes between them are run in order on a thread of the
+  instance, by the plugin's own update and set_param_value functions, so
+  that these need not know about it. The instance keeps a queue:
+
+  typedef struct { ... frei0r_async_t async; } inst;
+
+  construct:  frei0r_async_init(&in->async, in, update2, set_param);
+  destruct:   frei0r_async_destroy(&in->async);
+
+  int f0r_set_async_depth(f0r_instance_t instance, int depth)
+  { return frei0r_async_set_depth(&((inst*)instance)->async, depth); }
+
+  int f0r_update_async(f0r_instance_t instance, double time,
+                       const uint32_t* inframe1, const uint32_t* inframe2,
+                       const uint32_t* inframe3, uint32_t* outframe,
+                       f0r_async_done_t done, void* user)
+  { return frei0r_async_submit(&((inst*)instance)->async, time, inframe1,
+                               inframe2, inframe3, outframe, done, user); }
+
+  void f0r_wait_async(f0r_instance_t instance)
+  { frei0r_async_wait(&((inst*)instance)->async); }
+
+  f0r_set_param_value() passes the value on with
+  frei0r_async_set_param(), which copies it and queues it when frames are
+  in flight, and calls set_param right away otherwise; f0r_update() and
+  f0r_get_param_value() call frei0r_async_wait() first. update2 has the
+  arguments of f0r_update2() and set_param those of
+  f0r_set_param_value().
+
+  The thread is started by the first frame. Without pthreads
+  (FREI0R_HAVE_PTHREAD, see frei0r_thread.h) frei0r_async_set_depth()
+  and frei0r_async_submit() return 0 and the application updates
+  synchronously.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FREI0R_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "frei0r.h"
+
+#define FREI0R_ASYNC_MAX_DEPTH 8
+
+typedef void (*frei0r_async_update_fn)(f0r_instance_t instance, double time,
+                                       const uint32_t* inframe1,
+                                       const uint32_t* inframe2,
+                                       const uint32_t* inframe3,
+                                       uint32_t* outframe);
+typedef void (*frei0r_async_param_fn)(f0r_instance_t instance,
+                                      f0r_param_t param, int param_index);
+
+/* a frame, or a parameter change if done is 0 */
+typedef struct frei0r_async_cmd_
+{
+  struct frei0r_async_cmd_* next;
+  double time;
+  const uint32_t* inframe[3];
+  uint32_t* outframe;
+  f0r_async_done_t done;
+  void* user;
+  int param_index;
+  int param_type;
+  union
+  {
+    f0r_param_double d;
+    f0r_param_color_t color;
+    f0r_param_position_t position;
+    f0r_param_string string;
+  } value;
+} frei0r_async_cmd_t;
+
+typedef struct frei0r_async
+{
+  f0r_instance_t instance;
+  frei0r_async_update_fn update;
+  frei0r_async_param_fn set_param;
+  int depth;
+#ifdef FREI0R_HAVE_PTHREAD
+  frei0r_async_cmd_t* head;
+  frei0r_async_cmd_t* tail;
+  int frames;   /* submitted and not done */
+  int busy;     /* the thread runs a command */
+  int started;
+  int stop;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t work;
+  pthread_cond_t done;
+#endif
+} frei0r_async_t;
+
+static inline void frei0r_async_init(frei0r_async_t* a, f0r_instance_t instance,
+                                     frei0r_async_update_fn update,
+                                     frei0r_async_param_fn set_param)
+{
+  memset(a, 0, sizeof(*a));
+  a->instance = instance;
+  a->update = update;
+  a->set_param = set_param;
+  a->depth = 1;
+#ifdef FREI0R_HAVE_PTHREAD
+  pthread_mutex_init(&a->mutex, NULL);
+  pthread_cond_init(&a->work, NULL);
+  pthread_cond_init(&a->done, NULL);
+#endif
+}
+
+#ifdef FREI0R_HAVE_PTHREAD
+
+static inline void frei0r_async_run_(frei0r_async_t* a, frei0r_async_cmd_t* c)
+{
+  if (c->done)
+    {
+      a->update(a->instance, c->time, c->inframe[0], c->inframe[1],
+                c->inframe[2], c->outframe);
+      c->done(c->user, c->time, c->outframe);
+    }
+  else
+    {
+      a->set_param(a->instance, &c->value, c->param_index);
+      if (c->param_type == F0R_PARAM_STRING)
+        free(c->value.string);
+    }
+}
+
+static inline void* frei0r_async_thread_(void* arg)
+{
+  frei0r_async_t* a = (frei0r_async_t*)arg;
+
+  pthread_mutex_lock(&a->mutex);
+  for (;;)
+    {
+      frei0r_async_cmd_t* c;
+
+      while (!a->head && !a->stop)
+        pthread_cond_wait(&a->work, &a->mutex);
+      if (!a->head)
+        break;
+      c = a->head;
+      a->head = c->next;
+      if (!a->head)
+        a->tail = 0;
+      a->busy = 1;
+      pthread_mutex_unlock(&a->mutex);
+
+      frei0r_async_run_(a, c);
+
+      pthread_mutex_lock(&a->mutex);
+      a->busy = 0;
+      if (c->done)
+        --a->frames;
+      free(c);
+      pthread_cond_broadcast(&a->done);
+    }
+  pthread_mutex_unlock(&a->mutex);
+  return 0;
+}
+
+/* appends c, with the mutex held */
+static inline void frei0r_async_push_(frei0r_async_t* a, frei0r_async_cmd_t* c)
+{
+  c->next = 0;
+  if (a->tail)
+    a->tail->next = c;
+  else
+    a->head = c;
+  a->tail = c;
+  pthread_cond_signal(&a->work);
+}
+
+#endif
+
+static inline int frei0r_async_set_depth(frei0r_async_t* a, int depth)
+{
+#ifdef FREI0R_HAVE_PTHREAD
+  if (depth < 1)
+    depth = 1;
+  if (depth > FREI0R_ASYNC_MAX_DEPTH)
+    depth = FREI0R_ASYNC_MAX_DEPTH;
+  a->depth = depth;
+  return depth;
+#else
+  (void)a; (void)depth;
+  return 0;
+#endif
+}
+
+/* Queues a frame; returns 0 if there are no threads or no memory. */
+static inline int frei0r_async_submit(frei0r_async_t* a, double time,
+                                      const uint32_t* inframe1,
+                                      const uint32_t* inframe2,
+                                      const uint32_t* inframe3,
+                                      uint32_t* outframe,
+                                      f0r_async_done_t done, void* user)
+{
+#ifdef FREI0R_HAVE_PTHREAD
+  frei0r_async_cmd_t* c;
+
+  if (!done || !(c = (frei0r_async_cmd_t*)calloc(1, sizeof(*c))))
+    return 0;
+  c->time = time;
+  c->inframe[0] = inframe1;
+  c->inframe[1] = inframe2;
+  c->inframe[2] = inframe3;
+  c->outframe = outframe;
+  c->done = done;
+  c->user = user;
+
+  pthread_mutex_lock(&a->mutex);
+  if (!a->started)
+    {
+      if (pthread_create(&a->thread, NULL, frei0r_async_thread_, a) != 0)
+        {
+          pthread_mutex_unlock(&a->mutex);
+          free(c);
+          return 0;
+        }
+      a->started = 1;
+    }
+  while (a->frames >= a->depth)
+    pthread_cond_wait(&a->done, &a->mutex);
+  ++a->frames;
+  frei0r_async_push_(a, c);
+  pthread_mutex_unlock(&a->mutex);
+  return 1;
+#else
+  (void)a; (void)time; (void)inframe1; (void)inframe2; (void)inframe3;
+  (void)outframe; (void)done; (void)user;
+  return 0;
+#endif
+}
+
+/* Sets a parameter of the given F0R_PARAM_ type after the frames in
+   flight. */
+static inline void frei0r_async_set_param(frei0r_async_t* a, f0r_param_t param,
+                                          int param_index, int type)
+{
+#ifdef FREI0R_HAVE_PTHREAD
+  frei0r_async_cmd_t* c = 0;
+
+  pthread_mutex_lock(&a->mutex);
+  if ((a->head || a->busy)
+      && (c = (frei0r_async_cmd_t*)calloc(1, sizeof(*c))))
+    {
+      c->param_index = param_index;
+      c->param_type = type;
+      switch (type)
+        {
+        case F0R_PARAM_BOOL:
+        case F0R_PARAM_DOUBLE:
+          c->value.d = *(f0r_param_double*)param;
+          break;
+        case F0R_PARAM_COLOR:
+          c->value.color = *(f0r_param_color_t*)param;
+          break;
+        case F0R_PARAM_POSITION:
+          c->value.position = *(f0r_param_position_t*)param;
+          break;
+        case F0R_PARAM_STRING:
+          {
+            const char* value = *(f0r_param_string*)param;
+            size_t len = strlen(value) + 1;
+
+            if ((c->value.string = (char*)malloc(len)))
+              memcpy(c->value.string, value, len);
+          }
+          break;
+        }
+      frei0r_async_push_(a, c);
+    }
+  pthread_mutex_unlock(&a->mutex);
+  if (c)
+    return;
+#else
+  (void)type;
+#endif
+  a->set_param(a->instance, param, param_index);
+}
+
+/* Waits until all queued frames and parameters are done. */
+static inline void frei0r_async_wait(frei0r_async_t* a)
+{
+#ifdef FREI0R_HAVE_PTHREAD
+  pthread_mutex_lock(&a->mutex);
+  while (a->head || a->busy)
+    pthread_cond_wait(&a->done, &a->mutex);
+  pthread_mutex_unlock(&a->mutex);
+#else
+  (void)a;
+#endif
+}
+
+static inline void frei0r_async_destroy(frei0r_async_t* a)
+{
+#ifdef FREI0R_HAVE_PTHREAD
+  frei0r_async_wait(a);
+  pthread_mutex_lock(&a->mutex);
+  a->stop = 1;
+  pthread_cond_signal(&a->work);
+  pthread_mutex_unlock(&a->mutex);
+  if (a->started)
+    pthread_join(a->thread, NULL);
+  pthread_cond_destroy(&a->done);
+  pthread_cond_destroy(&a->work);
+  pthread_mutex_destroy(&a->mutex);
+#else
+  (void)a;
+#endif
+}
+
+#endif
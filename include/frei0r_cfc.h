@@ -24,10 +24,25 @@
 //	using Spitzak type tables (upper 16 bits
 //	of a float value used as table index)
 //	see  http://mysite.verizon.net/spitzak/conversion/
+//
+//	RGBA8_2_float_lin() and float_2_RGBA8_lin() do the plain
+//	"multiply by a constant" / "multiply by 255 and truncate"
+//	conversions most float plugins use, vectorized with SSE2 or
+//	AVX2 when the compiler targets them, and giving bit-exact the
+//	results of the scalar loops
+
+#ifndef INCLUDED_FREI0R_CFC_H
+#define INCLUDED_FREI0R_CFC_H
 
 #include <math.h>
 #include <inttypes.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 typedef struct
 	{
@@ -242,6 +257,127 @@ for (i=0;i<w*h;i++)
 }
 
 
+//--------------------------------------------------------
+//convert from packed uchar RGBA to packed float RGBA,
+//multiplying each channel by s (s=1.0/255.0 maps to [0...1])
+//out[i].r = s*(float)r, computed in float, like the scalar loops
+//if rgb_only is set, ALPHA IS SKIPPED (out[i].a is left as it is)
+static inline void RGBA8_2_float_lin(const uint32_t *in, float_rgba *out, int w, int h, float s, int rgb_only)
+{
+int i=0,n=w*h;
+uint8_t *cin;
+
+#if defined(__AVX2__)
+const __m256 k=_mm256_set1_ps(s);
+const __m256 m=_mm256_castsi256_ps(rgb_only ?
+	_mm256_set_epi32(0,-1,-1,-1,0,-1,-1,-1) : _mm256_set1_epi32(-1));
+__m256 v;
+int j;
+
+for (;i+8<=n;i+=8)
+	for (j=0;j<8;j+=2)
+		{
+		v=_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i*)(in+i+j)))),k);
+		if (rgb_only)
+			v=_mm256_or_ps(_mm256_and_ps(m,v),
+				_mm256_andnot_ps(m,_mm256_loadu_ps(&out[i+j].r)));
+		_mm256_storeu_ps(&out[i+j].r,v);
+		}
+#elif defined(__SSE2__)
+const __m128 k=_mm_set1_ps(s);
+const __m128 m=_mm_castsi128_ps(rgb_only ?
+	_mm_set_epi32(0,-1,-1,-1) : _mm_set1_epi32(-1));
+const __m128i z=_mm_setzero_si128();
+__m128i p,q[4];
+__m128 v;
+int j;
+
+for (;i+4<=n;i+=4)
+	{
+	p=_mm_loadu_si128((const __m128i*)(in+i));
+	q[0]=_mm_unpacklo_epi8(p,z);
+	q[2]=_mm_unpackhi_epi8(p,z);
+	q[1]=_mm_unpackhi_epi16(q[0],z);
+	q[0]=_mm_unpacklo_epi16(q[0],z);
+	q[3]=_mm_unpackhi_epi16(q[2],z);
+	q[2]=_mm_unpacklo_epi16(q[2],z);
+	for (j=0;j<4;j++)
+		{
+		v=_mm_mul_ps(_mm_cvtepi32_ps(q[j]),k);
+		if (rgb_only)
+			v=_mm_or_ps(_mm_and_ps(m,v),
+				_mm_andnot_ps(m,_mm_loadu_ps(&out[i+j].r)));
+		_mm_storeu_ps(&out[i+j].r,v);
+		}
+	}
+#endif
+
+cin=(uint8_t *)(in+i);
+for (;i<n;i++)
+	{
+	out[i].r=s*(float)*cin++;
+	out[i].g=s*(float)*cin++;
+	out[i].b=s*(float)*cin++;
+	if (rgb_only)
+		cin++;
+	else
+		out[i].a=s*(float)*cin++;
+	}
+}
+
+//----------------------------------------------------------
+//convert from packed float RGBA to packed uchar RGBA,
+//*cout = (uint8_t)(in[i].r*255.0) for each channel
+//the product is done in double, and only the lowest byte of the
+//truncated result is kept, like the scalar casts do on x86,
+//so values outside [0...1] are NOT clamped
+static inline void float_2_RGBA8_lin(const float_rgba *in, uint32_t *out, int w, int h)
+{
+int i=0,n=w*h;
+uint8_t *cout;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+const __m128i b=_mm_set1_epi32(0xFF);
+__m128i q[4];
+int j;
+#if defined(__AVX2__)
+const __m256d k=_mm256_set1_pd(255.0);
+#else
+const __m128d k=_mm_set1_pd(255.0);
+__m128 v;
+#endif
+
+for (;i+4<=n;i+=4)
+	{
+	for (j=0;j<4;j++)
+		{
+#if defined(__AVX2__)
+		q[j]=_mm256_cvttpd_epi32(_mm256_mul_pd(
+			_mm256_cvtps_pd(_mm_loadu_ps(&in[i+j].r)),k));
+#else
+		v=_mm_loadu_ps(&in[i+j].r);
+		q[j]=_mm_unpacklo_epi64(
+			_mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(v),k)),
+			_mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(v,v)),k)));
+#endif
+		q[j]=_mm_and_si128(q[j],b);
+		}
+	_mm_storeu_si128((__m128i*)(out+i),_mm_packus_epi16(
+		_mm_packs_epi32(q[0],q[1]),_mm_packs_epi32(q[2],q[3])));
+	}
+#endif
+
+cout=(uint8_t *)(out+i);
+for (;i<n;i++)
+	{
+	*cout++=(uint8_t)(in[i].r*255.0);
+	*cout++=(uint8_t)(in[i].g*255.0);
+	*cout++=(uint8_t)(in[i].b*255.0);
+	*cout++=(uint8_t)(in[i].a*255.0);
+	}
+}
+
 //--------------------------------------------------------
 //in the following conversions, we can afford "direct" type punning
 //as the array already exists from well before (I hope :-)
@@ -317,3 +453,5 @@ return tab[((flint*)in)->i[1]];
 //return tab[((flint*)in)->i[0]];
 //}
 //#endif
+
+#endif
@@ -0,0 +1,553 @@
+#ifndef INCLUDED_FREI0R_CHAIN_HPP
+#define INCLUDED_FREI0R_CHAIN_HPP
+
+/*
+
+  Runs a chain of filters for an application, fused and on all cores.
+  Consecutive filters that compute tiles (F0R_CAP_TILE) with a small
+  footprint are run together strip by strip: each thread takes a band of
+  rows of the output frame, grows it by the footprints of the filters
+  and runs them one after the other on its band, with the intermediate
+  results in two scratch buffers that stay in the cache. All other
+  filters run on the whole frame, split into slices over the threads if
+  they report F0R_CAP_SLICE. Filters that only change part of the frame
+  (f0r_get_region) copy the rest and compute their rectangle in tiles,
+  so that they take time with its area.
+
+  frei0r::chain chain(width, height);
+
+  chain.add(table1, instance1);   // constructed for width x height
+  chain.add(table2, instance2);
+  ...
+  chain.update(time, inframe, outframe);
+
+  The tables are those of f0r_get_plugin_by_index for effects of a
+  bundle; for a single plugin the application fills one with dlsym(),
+  leaving the functions the plugin lacks 0. The chain doesn't own the
+  instances: the application sets their parameters between updates and
+  destructs them after the chain. inframe and outframe are frames of
+  width x height and must not overlap.
+
+  Filters that keep their result in a frame of their own and hand it
+  out (f0r_update_view), e.g. delay lines, aren't copied from: the next
+  filter reads their frame where it is, and only the last one of the
+  chain is copied to outframe.
+
+  Filters that say they leave the frame as it is (f0r_is_identity) are
+  left out. The footprints are asked for on every update, since they may
+  depend on the parameters. Filters whose footprint is larger than
+  FREI0R_CHAIN_MAX_HALO aren't fused, the strips would mostly be halo.
+
+  Outputs that send the top of a frame before its bottom exists, like
+  SDI, stream frames through the chain with update_rows() instead:
+
+  chain.update_rows(time, inframe, outframe,
+                    [&] { return wait_for_rows(); },  // rows of inframe
+                    [&](unsigned int rows) { send(outframe, rows); });
+
+  The first function returns how many rows from the top of inframe are
+  there, waiting until there are more than it returned the last time.
+  The second is called whenever more rows from the top of outframe are
+  final, with their number, the last time with the height. When all
+  filters are fused, the chain runs each strip as soon as the rows it
+  needs are in, so the output lags the input by a strip and the halos
+  instead of a frame per filter. Otherwise it waits for the whole frame
+  and updates it as update() does.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frei0r.h"
+
+#define FREI0R_CHAIN_MAX_HALO 16
+
+namespace frei0r
+{
+  class chain
+  {
+  public:
+    // threads 0 uses one per core
+    chain(unsigned int width, unsigned int height, unsigned int threads = 0)
+      : m_width(width), m_height(height), m_strip_rows(0),
+        m_fn(0), m_count(0), m_next(0), m_pending(0), m_generation(0),
+        m_stop(false)
+    {
+      if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      m_thread_count = threads;
+      // about 64 KiB a strip
+      set_strip_rows(std::max(8u, 16384 / std::max(1u, width)));
+    }
+
+    ~chain()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_wake.notify_all();
+      for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+    }
+
+    // Appends a filter; returns false if it isn't one.
+    bool add(const f0r_plugin_table_t* table, f0r_instance_t instance)
+    {
+      f0r_plugin_info_t info;
+      unsigned int capabilities = 0;
+
+      std::memset(&info, 0, sizeof(info));
+      if (table->get_plugin_info2)
+        {
+          f0r_plugin_info2_t info2;
+
+          std::memset(&info2, 0, sizeof(info2));
+          table->get_plugin_info2(&info2);
+          info = info2.info;
+          capabilities = info2.capabilities;
+        }
+      else
+        table->get_plugin_info(&info);
+      if (info.plugin_type != F0R_PLUGIN_TYPE_FILTER || !table->update)
+        return false;
+
+      stage s;
+      s.table = table;
+      s.instance = instance;
+      s.tile = (capabilities & F0R_CAP_TILE) && table->get_footprint
+        && table->update_tile;
+      s.slice = (capabilities & F0R_CAP_SLICE) && table->update_slice;
+      s.halo = 0;
+      s.partial = false;
+      m_stages.push_back(s);
+      return true;
+    }
+
+    // the number of rows of the strips of fused filters
+    void set_strip_rows(unsigned int rows)
+    {
+      m_strip_rows = std::max(1u, rows);
+    }
+
+    void update(double time, const uint32_t* inframe, uint32_t* outframe)
+    {
+      select_active();
+
+      const size_t n = m_active.size();
+      if (n == 0)
+        {
+          std::memcpy(outframe, inframe, frame_bytes());
+          return;
+        }
+
+      // groups of fused filters and single other ones, each from src to
+      // dst, the frames in between alternating between two buffers
+      const uint32_t* src = inframe;
+      size_t begin = 0, buffer = 0;
+      while (begin < n)
+        {
+          size_t end = begin + 1;
+          if (m_active[begin].halo >= 0)
+            while (end < n && m_active[end].halo >= 0)
+              ++end;
+          else if (const uint32_t* view = update_view(time, m_active[begin], src))
+            {
+              if (end == n)
+                std::memcpy(outframe, view, frame_bytes());
+              src = view;
+              begin = end;
+              continue;
+            }
+
+          uint32_t* dst = outframe;
+          if (end < n)
+            {
+              m_frames[buffer].resize(m_width * m_height);
+              dst = m_frames[buffer].data();
+              buffer = 1 - buffer;
+            }
+          if (m_active[begin].halo >= 0)
+            update_fused(time, begin, end, src, dst);
+          else if (m_active[begin].partial)
+            update_region(time, m_active[begin], src, dst);
+          else
+            update_whole(time, m_active[begin], src, dst);
+          src = dst;
+          begin = end;
+        }
+    }
+
+    // Updates a frame that comes and goes row by row, see above.
+    void update_rows(double time, const uint32_t* inframe, uint32_t* outframe,
+                     const std::function<unsigned int()>& rows_in,
+                     const std::function<void(unsigned int)>& rows_out)
+    {
+      const size_t w = m_width;
+      unsigned int in = 0, out = 0;
+
+      select_active();
+      for (size_t i = 0; i < m_active.size(); ++i)
+        if (m_active[i].halo < 0)
+          {
+            while (in < m_height)
+              in = std::max(in, std::min(rows_in(), m_height));
+            update(time, inframe, outframe);
+            rows_out(m_height);
+            return;
+          }
+
+      // the strips whose rows of the input are all there, in batches
+      const int halos = prepare_fused(0, m_active.size());
+      const unsigned int strips = (m_height + m_strip_rows - 1) / m_strip_rows;
+      unsigned int next = 0;
+      while (next < strips)
+        {
+          in = std::max(in, std::min(rows_in(), m_height));
+          unsigned int ready = next;
+          while (ready < strips
+                 && std::min(static_cast<size_t>(ready + 1) * m_strip_rows
+                             + halos, static_cast<size_t>(m_height)) <= in)
+            ++ready;
+          if (ready == next)
+            continue;
+
+          if (m_active.empty())
+            std::memcpy(outframe + out * w, inframe + out * w,
+                        (std::min(ready * m_strip_rows, m_height) - out)
+                        * w * sizeof(uint32_t));
+          else
+            {
+              std::atomic<bool> failed(false);
+              const unsigned int first = next;
+              parallel(ready - next, [&](unsigned int job, unsigned int thread)
+              {
+                if (!update_strip(time, 0, m_active.size(), inframe, outframe,
+                                  first + job, thread))
+                  failed = true;
+              });
+              if (failed)
+                {
+                  while (in < m_height)
+                    in = std::max(in, std::min(rows_in(), m_height));
+                  update_unfused(time, 0, m_active.size(), inframe, outframe);
+                  rows_out(m_height);
+                  return;
+                }
+            }
+          next = ready;
+          out = std::min(next * m_strip_rows, m_height);
+          rows_out(out);
+        }
+    }
+
+  private:
+    struct stage
+    {
+      const f0r_plugin_table_t* table;
+      f0r_instance_t instance;
+      bool tile;
+      bool slice;
+      int halo; // of this update, -1 if not fused
+      bool partial; // only rect changes in this update
+      f0r_rect_t rect;
+    };
+
+    // the two scratch buffers of a thread
+    struct scratch
+    {
+      std::vector<uint32_t> rows[2];
+    };
+
+    size_t frame_bytes() const
+    {
+      return static_cast<size_t>(m_width) * m_height * sizeof(uint32_t);
+    }
+
+    // the stages that change the frame in this update
+    void select_active()
+    {
+      m_active.clear();
+      for (size_t i = 0; i < m_stages.size(); ++i)
+        {
+          stage s = m_stages[i];
+          if (s.table->is_identity && s.table->is_identity(s.instance))
+            continue;
+          s.partial = s.table->get_region
+            && s.table->get_region(s.instance, &s.rect)
+            && (s.rect.width < static_cast<int>(m_width)
+                || s.rect.height < static_cast<int>(m_height));
+          s.halo = s.tile && !s.partial
+            ? s.table->get_footprint(s.instance) : -1;
+          if (s.halo > FREI0R_CHAIN_MAX_HALO)
+            s.halo = -1;
+          m_active.push_back(s);
+        }
+    }
+
+    void update_whole(double time, const stage& s,
+                      const uint32_t* src, uint32_t* dst)
+    {
+      const unsigned int threads = std::min(m_thread_count, m_height);
+
+      if (s.slice && threads > 1
+          && s.table->update_slice(s.instance, time, src, 0, 0, dst, 0, 0, 0))
+        {
+          parallel(threads, [&](unsigned int job, unsigned int thread)
+          {
+            s.table->update_slice(s.instance, time, src, 0, 0, dst,
+                                  m_height * job / threads,
+                                  m_height * (job + 1) / threads, thread);
+          });
+          return;
+        }
+      s.table->update(s.instance, time, src, dst);
+    }
+
+    // the stage's own frame of its result, or 0 if it has to write it
+    const uint32_t* update_view(double time, const stage& s,
+                                const uint32_t* src)
+    {
+      if (s.partial || !s.table->update_view)
+        return 0;
+      return s.table->update_view(s.instance, time, src, 0, 0);
+    }
+
+    // Copies the frame outside of the stage's rectangle and computes the
+    // rectangle in bands of rows, with the whole input frame at hand.
+    void update_region(double time, const stage& s,
+                       const uint32_t* src, uint32_t* dst)
+    {
+      const f0r_rect_t& r = s.rect;
+      const size_t w = m_width;
+
+      if (!s.table->update_tile)
+        {
+          update_whole(time, s, src, dst);
+          return;
+        }
+      std::memcpy(dst, src, r.y * w * sizeof(uint32_t));
+      for (int y = r.y; y < r.y + r.height; ++y)
+        {
+          const uint32_t* in = src + y * w;
+          uint32_t* out = dst + y * w;
+          std::copy(in, in + r.x, out);
+          std::copy(in + r.x + r.width, in + w, out + r.x + r.width);
+        }
+      std::memcpy(dst + (r.y + r.height) * w, src + (r.y + r.height) * w,
+                  (m_height - r.y - r.height) * w * sizeof(uint32_t));
+      if (r.width <= 0 || r.height <= 0)
+        return;
+
+      const f0r_rect_t frame = { 0, 0, static_cast<int>(m_width),
+                                 static_cast<int>(m_height) };
+      const unsigned int bands
+        = std::min(m_thread_count, static_cast<unsigned int>(r.height));
+      std::atomic<bool> failed(false);
+      parallel(bands, [&](unsigned int job, unsigned int)
+      {
+        f0r_rect_t band = r;
+        band.y = r.y + r.height * job / bands;
+        band.height = r.y + r.height * (job + 1) / bands - band.y;
+        if (!s.table->update_tile(s.instance, time, src, w * 4, &frame,
+                                  dst + band.y * w + band.x, w * 4, &band))
+          failed = true;
+      });
+      if (failed)
+        update_whole(time, s, src, dst);
+    }
+
+    // Runs the stages [begin, end) strip by strip. A strip of the last
+    // stage needs the rows of the one before grown by its halo, and so
+    // on back to the input frame.
+    void update_fused(double time, size_t begin, size_t end,
+                      const uint32_t* src, uint32_t* dst)
+    {
+      const unsigned int strips = (m_height + m_strip_rows - 1) / m_strip_rows;
+
+      prepare_fused(begin, end);
+      std::atomic<bool> failed(false);
+      parallel(strips, [&](unsigned int job, unsigned int thread)
+      {
+        if (!update_strip(time, begin, end, src, dst, job, thread))
+          failed = true;
+      });
+
+      // a filter that refuses a tile after all: run them one by one
+      if (failed)
+        update_unfused(time, begin, end, src, dst);
+    }
+
+    // Sizes the scratch buffers for the strips of the stages [begin, end)
+    // and returns the sum of their halos.
+    int prepare_fused(size_t begin, size_t end)
+    {
+      const int h = static_cast<int>(m_height);
+      const int strip = static_cast<int>(m_strip_rows);
+      int halos = 0;
+
+      for (size_t i = begin; i < end; ++i)
+        halos += m_active[i].halo;
+      m_scratch.resize(m_thread_count);
+      for (size_t t = 0; t < m_scratch.size(); ++t)
+        for (int b = 0; b < 2; ++b)
+          m_scratch[t].rows[b].resize(static_cast<size_t>(m_width)
+                                      * std::min(strip + 2 * halos, h));
+      return halos;
+    }
+
+    // Runs the stages [begin, end) on strip job of dst; returns false if
+    // one of them refuses the tile.
+    bool update_strip(double time, size_t begin, size_t end,
+                      const uint32_t* src, uint32_t* dst,
+                      unsigned int job, unsigned int thread)
+    {
+      const int w = static_cast<int>(m_width), h = static_cast<int>(m_height);
+      const int strip = static_cast<int>(m_strip_rows);
+      scratch& sc = m_scratch[thread];
+      std::vector<f0r_rect_t> rects(end - begin + 1);
+
+      // the rows of each stage's output, and of the input last
+      f0r_rect_t r = { 0, static_cast<int>(job) * strip, w, 0 };
+      r.height = std::min(strip, h - r.y);
+      for (size_t i = end; i-- > begin; )
+        {
+          rects[i - begin + 1] = r;
+          const int halo = m_active[i].halo;
+          const int y0 = std::max(r.y - halo, 0);
+          const int y1 = std::min(r.y + r.height + halo, h);
+          r.y = y0;
+          r.height = y1 - y0;
+        }
+      rects[0] = r;
+
+      const uint32_t* in = src + static_cast<size_t>(r.y) * w;
+      for (size_t i = begin; i < end; ++i)
+        {
+          const f0r_rect_t& inrect = rects[i - begin];
+          const f0r_rect_t& outrect = rects[i - begin + 1];
+          uint32_t* out = i + 1 == end
+            ? dst + static_cast<size_t>(outrect.y) * w
+            : sc.rows[(i - begin) & 1].data();
+          const stage& s = m_active[i];
+          if (!s.table->update_tile(s.instance, time,
+                                    in, w * 4, &inrect,
+                                    out, w * 4, &outrect))
+            return false;
+          in = out;
+        }
+      return true;
+    }
+
+    // Runs the stages [begin, end) one after the other on whole frames.
+    void update_unfused(double time, size_t begin, size_t end,
+                        const uint32_t* src, uint32_t* dst)
+    {
+      const uint32_t* in = src;
+      for (size_t i = begin; i < end; ++i)
+        {
+          uint32_t* out = dst;
+          if (i + 1 < end)
+            {
+              m_fallback[(i - begin) & 1].resize(m_width * m_height);
+              out = m_fallback[(i - begin) & 1].data();
+            }
+          update_whole(time, m_active[i], in, out);
+          in = out;
+        }
+    }
+
+    // Runs fn(job, thread) for the jobs [0, count) on the threads, the
+    // calling one being thread 0, and returns when all are done.
+    void parallel(unsigned int count,
+                  const std::function<void(unsigned int, unsigned int)>& fn)
+    {
+      const unsigned int threads = std::min(m_thread_count, count);
+
+      if (threads <= 1)
+        {
+          for (unsigned int job = 0; job < count; ++job)
+            fn(job, 0);
+          return;
+        }
+      while (m_threads.size() + 1 < m_thread_count)
+        m_threads.push_back(std::thread(&chain::work, this,
+                                        static_cast<unsigned int>(m_threads.size() + 1)));
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn = &fn;
+        m_count = count;
+        m_next = 0;
+        m_pending = static_cast<unsigned int>(m_threads.size());
+        ++m_generation;
+      }
+      m_wake.notify_all();
+      run_jobs(0);
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_done.wait(lock, [this] { return m_pending == 0; });
+      m_fn = 0;
+    }
+
+    void run_jobs(unsigned int thread)
+    {
+      unsigned int job;
+      while ((job = m_next++) < m_count)
+        (*m_fn)(job, thread);
+    }
+
+    void work(unsigned int thread)
+    {
+      unsigned long generation = 0;
+      for (;;)
+        {
+          {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+            if (m_stop)
+              return;
+            generation = m_generation;
+          }
+          run_jobs(thread);
+          {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_pending;
+          }
+          m_done.notify_one();
+        }
+    }
+
+    unsigned int m_width;
+    unsigned int m_height;
+    unsigned int m_thread_count;
+    unsigned int m_strip_rows;
+    std::vector<stage> m_stages;
+    std::vector<stage> m_active; // of the current update
+    std::vector<uint32_t> m_frames[2];
+    std::vector<uint32_t> m_fallback[2];
+    std::vector<scratch> m_scratch;
+
+    // the thread pool, started by the first parallel update
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(unsigned int, unsigned int)>* m_fn;
+    unsigned int m_count;
+    std::atomic<unsigned int> m_next;
+    unsigned int m_pending;
+    unsigned long m_generation;
+    bool m_stop;
+  };
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef INCLUDED_FREI0R_COLORMATRIX_H
+#define INCLUDED_FREI0R_COLORMATRIX_H
+
+/*
+
+  Linear color transforms of 8 bit per channel packed pixels in fixed
+  point. A plugin converts its float matrix once per parameter change:
+
+  frei0r_colormatrix_set(&inst->cm, mat);
+
+  and applies it per frame:
+
+  frei0r_colormatrix_apply(&inst->cm, dst, src, n);
+
+  The matrix uses the layout of the 4x4 matrices from Paul Haeberli's
+  matrix.c: mat[i][o] is the weight of input channel i in output channel
+  o, mat[3][o] is an offset added to output channel o. Channels are the
+  bytes 0, 1 and 2 of each pixel, so the kernel works for RGBA8888,
+  BGRA8888 and PACKED32 alike, byte 3 (alpha) is copied.
+
+  The weights are stored in Q12, so they must lie in [-8, 8). Every
+  output value is floor(sum) clamped to [0, 255], which matches the
+  truncating float code of matrix.c up to the rounding of the weights.
+
+  With SSE2 eight pixels are done per step, using pmaddwd on interleaved
+  r,g pairs. The scalar loop for the remaining pixels and other
+  architectures gives the same results.
+
+*/
+
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_math.h"
+
+#define FREI0R_COLORMATRIX_SHIFT 12
+
+typedef struct frei0r_colormatrix
+{
+  int32_t m[3][3];   /* [output][input] in Q12 */
+  int32_t offset[3]; /* per output in Q12 */
+} frei0r_colormatrix_t;
+
+static inline int32_t frei0r_colormatrix_fix_(float v)
+{
+  float s = v * (1 << FREI0R_COLORMATRIX_SHIFT);
+  s = CLAMP(s, -32768.f, 32767.f);
+  return (int32_t)(s < 0 ? s - .5f : s + .5f);
+}
+
+static inline void frei0r_colormatrix_set(frei0r_colormatrix_t* cm,
+                                          float mat[4][4])
+{
+  int i, o;
+  for (o = 0; o < 3; ++o)
+    {
+      for (i = 0; i < 3; ++i)
+        cm->m[o][i] = frei0r_colormatrix_fix_(mat[i][o]);
+      cm->offset[o] = (int32_t)floorf(mat[3][o]
+                                      * (1 << FREI0R_COLORMATRIX_SHIFT) + .5f);
+    }
+}
+
+/* the matrix leaves every pixel as it is */
+static inline int frei0r_colormatrix_is_identity(const frei0r_colormatrix_t* cm)
+{
+  int i, o;
+  for (o = 0; o < 3; ++o)
+    {
+      if (cm->offset[o] != 0)
+        return 0;
+      for (i = 0; i < 3; ++i)
+        if (cm->m[o][i] != (i == o ? 1 << FREI0R_COLORMATRIX_SHIFT : 0))
+          return 0;
+    }
+  return 1;
+}
+
+static inline uint32_t frei0r_colormatrix_px_(const frei0r_colormatrix_t* cm,
+                                              uint32_t p)
+{
+  int32_t c0 = p & 0xff, c1 = (p >> 8) & 0xff, c2 = (p >> 16) & 0xff;
+  uint32_t q = p & 0xff000000u;
+  int32_t v;
+  int o;
+
+  for (o = 0; o < 3; ++o)
+    {
+      v = (c0 * cm->m[o][0] + c1 * cm->m[o][1] + c2 * cm->m[o][2]
+           + cm->offset[o]) >> FREI0R_COLORMATRIX_SHIFT;
+      q |= (uint32_t)CLAMP(v, 0, 255) << (8 * o);
+    }
+  return q;
+}
+
+#if defined(__SSE2__)
+
+/* output channel o of the 8 pixels in c01 (c0,c1 pairs) and c2 */
+static inline __m128i frei0r_colormatrix_channel_(__m128i c01_lo,
+                                                  __m128i c01_hi,
+                                                  __m128i c2_lo,
+                                                  __m128i c2_hi,
+                                                  __m128i w01, __m128i w2,
+                                                  __m128i offset)
+{
+  __m128i lo = _mm_add_epi32(_mm_madd_epi16(c01_lo, w01),
+                             _mm_madd_epi16(c2_lo, w2));
+  __m128i hi = _mm_add_epi32(_mm_madd_epi16(c01_hi, w01),
+                             _mm_madd_epi16(c2_hi, w2));
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, offset), FREI0R_COLORMATRIX_SHIFT);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, offset), FREI0R_COLORMATRIX_SHIFT);
+  return _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+}
+
+#endif
+
+/* dst may be the same buffer as src */
+static inline void frei0r_colormatrix_apply(const frei0r_colormatrix_t* cm,
+                                            uint32_t* dst,
+                                            const uint32_t* src,
+                                            unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi32(0xff);
+  __m128i w01[3], w2[3], offset[3];
+  __m128i p0, p1, c0, c1, c2, c01_lo, c01_hi, c2_lo, c2_hi, o0, o1, o2, a;
+  int o;
+
+  for (o = 0; o < 3; ++o)
+    {
+      w01[o] = _mm_set1_epi32((int)(((uint32_t)cm->m[o][1] << 16)
+                                    | ((uint32_t)cm->m[o][0] & 0xffff)));
+      w2[o] = _mm_set1_epi32((int)((uint32_t)cm->m[o][2] & 0xffff));
+      offset[o] = _mm_set1_epi32(cm->offset[o]);
+    }
+
+  for (; i + 8 <= n; i += 8)
+    {
+      p0 = _mm_loadu_si128((const __m128i*)(src + i));
+      p1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+      c0 = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+      c1 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                           _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+      c2 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                           _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+      a = _mm_packus_epi16(_mm_packs_epi32(_mm_srli_epi32(p0, 24),
+                                           _mm_srli_epi32(p1, 24)), z);
+      c01_lo = _mm_unpacklo_epi16(c0, c1);
+      c01_hi = _mm_unpackhi_epi16(c0, c1);
+      c2_lo = _mm_unpacklo_epi16(c2, z);
+      c2_hi = _mm_unpackhi_epi16(c2, z);
+
+      o0 = frei0r_colormatrix_channel_(c01_lo, c01_hi, c2_lo, c2_hi,
+                                       w01[0], w2[0], offset[0]);
+      o1 = frei0r_colormatrix_channel_(c01_lo, c01_hi, c2_lo, c2_hi,
+                                       w01[1], w2[1], offset[1]);
+      o2 = frei0r_colormatrix_channel_(c01_lo, c01_hi, c2_lo, c2_hi,
+                                       w01[2], w2[2], offset[2]);
+
+      o0 = _mm_unpacklo_epi8(o0, o1);
+      o2 = _mm_unpacklo_epi8(o2, a);
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(o0, o2));
+      _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(o0, o2));
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_colormatrix_px_(cm, src[i]);
+}
+
+#endif
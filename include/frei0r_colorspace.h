@@ -20,9 +20,14 @@
 #ifndef INCLUDED_FREI0R_COLORSPACE_H
 #define INCLUDED_FREI0R_COLORSPACE_H
 
-#include "frei0r_math.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
+#include "frei0r_math.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // # Basic colorspace convert functions (from the Gimp gimpcolorspace.h) ####
 
@@ -413,4 +418,458 @@ cmyk_to_rgb_int (int *cyan,
 }
 
 
+// # Row conversions ########################################################
+
+/*  The row functions convert n packed RGBA8 pixels into separate float
+ *  arrays and back, so mixers can work on whole rows. H is in degrees
+ *  [0, 360), S, V and L are in [0, 1], grey pixels get H = S = 0.
+ *  Nothing is rounded between the conversions, so a round trip gives
+ *  back the input pixel.
+ *
+ *  The hue sector is picked with masks instead of branches. With SSE2
+ *  four pixels are converted at a time, the remaining pixels go through
+ *  the scalar code, which does the same float operations in the same
+ *  order. The *_to_rgba_row functions keep the alpha bytes of dst.
+ */
+
+/* pixels per call the mixers use for their stack buffers */
+#define FREI0R_COLORSPACE_CHUNK 256
+
+static inline float
+frei0r_cs_hue_ (float r, float g, float b, float max, float delta)
+{
+  float num, off, h;
+
+  if (delta == 0)
+    return 0;
+  num = r == max ? g - b : (g == max ? b - r : r - g);
+  off = r == max ? 0 : (g == max ? 120 : 240);
+  h = num * 60 / delta + off;
+  return h < 0 ? h + 360 : h;
+}
+
+/* channel value for the hue offset n (5, 3, 1 for r, g, b) */
+static inline uint8_t
+frei0r_cs_hsv_channel_ (float n, float hs, float v, float vs)
+{
+  float k = n + hs, t;
+
+  k = k >= 6 ? k - 6 : k;
+  t = MIN (k, 4 - k);
+  t = CLAMP (t, 0, 1);
+  return (int)((v - vs * t) * 255.f + .5f);
+}
+
+/* channel value for the hue offset n (0, 8, 4 for r, g, b) */
+static inline uint8_t
+frei0r_cs_hsl_channel_ (float n, float hs, float l, float a)
+{
+  float k = n + hs, t;
+
+  k = k >= 12 ? k - 12 : k;
+  t = MIN (k - 3, 9 - k);
+  t = CLAMP (t, -1, 1);
+  return (int)((l - a * t) * 255.f + .5f);
+}
+
+#if defined(__SSE2__)
+
+static inline __m128
+frei0r_cs_select_ (__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps (_mm_and_ps (mask, a), _mm_andnot_ps (mask, b));
+}
+
+static inline void
+frei0r_cs_load_ (const uint8_t *src, __m128 *r, __m128 *g, __m128 *b)
+{
+  const __m128i m = _mm_set1_epi32 (0xff);
+  __m128i px = _mm_loadu_si128 ((const __m128i*)src);
+
+  *r = _mm_cvtepi32_ps (_mm_and_si128 (px, m));
+  *g = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 8), m));
+  *b = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 16), m));
+}
+
+/* the color bytes of r, g, b in [0, 1], or-ed to px */
+static inline __m128i
+frei0r_cs_pack_ (__m128i px, __m128 r, __m128 g, __m128 b)
+{
+  const __m128 k = _mm_set1_ps (255.f), half = _mm_set1_ps (.5f);
+
+  px = _mm_or_si128 (px, _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (r, k), half)));
+  px = _mm_or_si128 (px, _mm_slli_epi32 (
+         _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (g, k), half)), 8));
+  return _mm_or_si128 (px, _mm_slli_epi32 (
+           _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (b, k), half)), 16));
+}
+
+/* stores r, g, b in [0, 1] to dst, keeping the alpha bytes of dst */
+static inline void
+frei0r_cs_store_ (uint8_t *dst, __m128 r, __m128 g, __m128 b)
+{
+  __m128i px = _mm_and_si128 (_mm_loadu_si128 ((const __m128i*)dst),
+                              _mm_set1_epi32 (0xff000000));
+
+  _mm_storeu_si128 ((__m128i*)dst, frei0r_cs_pack_ (px, r, g, b));
+}
+
+static inline __m128
+frei0r_cs_hue_ps_ (__m128 r, __m128 g, __m128 b, __m128 max, __m128 delta)
+{
+  const __m128 zero = _mm_setzero_ps ();
+  __m128 is_r = _mm_cmpeq_ps (r, max);
+  __m128 is_g = _mm_andnot_ps (is_r, _mm_cmpeq_ps (g, max));
+  __m128 grey = _mm_cmpeq_ps (delta, zero);
+  __m128 num, off, h;
+
+  num = frei0r_cs_select_ (is_r, _mm_sub_ps (g, b),
+          frei0r_cs_select_ (is_g, _mm_sub_ps (b, r), _mm_sub_ps (r, g)));
+  off = frei0r_cs_select_ (is_r, zero,
+          frei0r_cs_select_ (is_g, _mm_set1_ps (120), _mm_set1_ps (240)));
+  delta = frei0r_cs_select_ (grey, _mm_set1_ps (1), delta);
+  h = _mm_add_ps (_mm_div_ps (_mm_mul_ps (num, _mm_set1_ps (60)), delta), off);
+  h = _mm_add_ps (h, _mm_and_ps (_mm_cmplt_ps (h, zero), _mm_set1_ps (360)));
+  return _mm_andnot_ps (grey, h);
+}
+
+static inline __m128
+frei0r_cs_hsv_channel_ps_ (float n, __m128 hs, __m128 v, __m128 vs)
+{
+  const __m128 six = _mm_set1_ps (6), four = _mm_set1_ps (4);
+  __m128 k = _mm_add_ps (_mm_set1_ps (n), hs), t;
+
+  k = _mm_sub_ps (k, _mm_and_ps (_mm_cmpge_ps (k, six), six));
+  t = _mm_min_ps (k, _mm_sub_ps (four, k));
+  t = _mm_min_ps (_mm_max_ps (t, _mm_setzero_ps ()), _mm_set1_ps (1));
+  return _mm_sub_ps (v, _mm_mul_ps (vs, t));
+}
+
+static inline __m128
+frei0r_cs_hsl_channel_ps_ (float n, __m128 hs, __m128 l, __m128 a)
+{
+  const __m128 twelve = _mm_set1_ps (12), one = _mm_set1_ps (1);
+  __m128 k = _mm_add_ps (_mm_set1_ps (n), hs), t;
+
+  k = _mm_sub_ps (k, _mm_and_ps (_mm_cmpge_ps (k, twelve), twelve));
+  t = _mm_min_ps (_mm_sub_ps (k, _mm_set1_ps (3)),
+                  _mm_sub_ps (_mm_set1_ps (9), k));
+  t = _mm_min_ps (_mm_max_ps (t, _mm_sub_ps (_mm_setzero_ps (), one)), one);
+  return _mm_sub_ps (l, _mm_mul_ps (a, t));
+}
+
+#endif
+
+/**
+ * rgba_to_hsv_row
+ * @src: n packed RGBA8 pixels
+ * @h, @s, @v: return H [0, 360), S [0, 1] and V [0, 1] of each pixel
+ **/
+static inline void
+rgba_to_hsv_row (const uint8_t *src, float *h, float *s, float *v, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 one = _mm_set1_ps (1), k = _mm_set1_ps (255);
+  __m128 r, g, b, max, delta;
+
+  for (; i + 4 <= n; i += 4, src += 16)
+    {
+      frei0r_cs_load_ (src, &r, &g, &b);
+      max = _mm_max_ps (r, _mm_max_ps (g, b));
+      delta = _mm_sub_ps (max, _mm_min_ps (r, _mm_min_ps (g, b)));
+      _mm_storeu_ps (h + i, frei0r_cs_hue_ps_ (r, g, b, max, delta));
+      _mm_storeu_ps (s + i, _mm_div_ps (delta, _mm_max_ps (max, one)));
+      _mm_storeu_ps (v + i, _mm_div_ps (max, k));
+    }
+#endif
+
+  for (; i < n; i++, src += 4)
+    {
+      float r = src[0], g = src[1], b = src[2];
+      float max = MAX (r, MAX (g, b));
+      float delta = max - MIN (r, MIN (g, b));
+
+      h[i] = frei0r_cs_hue_ (r, g, b, max, delta);
+      s[i] = delta / MAX (max, 1.f);
+      v[i] = max / 255.f;
+    }
+}
+
+/**
+ * hsv_to_rgba_row
+ * @h, @s, @v: H [0, 360], S [0, 1] and V [0, 1] of n pixels
+ * @dst: returns the color bytes of n packed RGBA8 pixels
+ **/
+static inline void
+hsv_to_rgba_row (const float *h, const float *s, const float *v,
+                 uint8_t *dst, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 k = _mm_set1_ps (60);
+  __m128 hs, vv, vs;
+
+  for (; i + 4 <= n; i += 4, dst += 16)
+    {
+      hs = _mm_div_ps (_mm_loadu_ps (h + i), k);
+      vv = _mm_loadu_ps (v + i);
+      vs = _mm_mul_ps (vv, _mm_loadu_ps (s + i));
+      frei0r_cs_store_ (dst, frei0r_cs_hsv_channel_ps_ (5, hs, vv, vs),
+                        frei0r_cs_hsv_channel_ps_ (3, hs, vv, vs),
+                        frei0r_cs_hsv_channel_ps_ (1, hs, vv, vs));
+    }
+#endif
+
+  for (; i < n; i++, dst += 4)
+    {
+      float hs = h[i] / 60.f, vs = v[i] * s[i];
+
+      dst[0] = frei0r_cs_hsv_channel_ (5, hs, v[i], vs);
+      dst[1] = frei0r_cs_hsv_channel_ (3, hs, v[i], vs);
+      dst[2] = frei0r_cs_hsv_channel_ (1, hs, v[i], vs);
+    }
+}
+
+/**
+ * rgba_to_hsl_row
+ * @src: n packed RGBA8 pixels
+ * @h, @s, @l: return H [0, 360), S [0, 1] and L [0, 1] of each pixel
+ **/
+static inline void
+rgba_to_hsl_row (const uint8_t *src, float *h, float *s, float *l, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 one = _mm_set1_ps (1), k = _mm_set1_ps (510);
+  __m128 r, g, b, max, min, sum, den;
+
+  for (; i + 4 <= n; i += 4, src += 16)
+    {
+      frei0r_cs_load_ (src, &r, &g, &b);
+      max = _mm_max_ps (r, _mm_max_ps (g, b));
+      min = _mm_min_ps (r, _mm_min_ps (g, b));
+      sum = _mm_add_ps (max, min);
+      den = frei0r_cs_select_ (_mm_cmple_ps (sum, _mm_set1_ps (255)),
+                               sum, _mm_sub_ps (k, sum));
+      _mm_storeu_ps (h + i, frei0r_cs_hue_ps_ (r, g, b, max,
+                                               _mm_sub_ps (max, min)));
+      _mm_storeu_ps (s + i, _mm_div_ps (_mm_sub_ps (max, min),
+                                        _mm_max_ps (den, one)));
+      _mm_storeu_ps (l + i, _mm_div_ps (sum, k));
+    }
+#endif
+
+  for (; i < n; i++, src += 4)
+    {
+      float r = src[0], g = src[1], b = src[2];
+      float max = MAX (r, MAX (g, b));
+      float min = MIN (r, MIN (g, b));
+      float sum = max + min;
+      float den = sum <= 255 ? sum : 510 - sum;
+
+      h[i] = frei0r_cs_hue_ (r, g, b, max, max - min);
+      s[i] = (max - min) / MAX (den, 1.f);
+      l[i] = sum / 510.f;
+    }
+}
+
+/**
+ * hsl_to_rgba_row
+ * @h, @s, @l: H [0, 360], S [0, 1] and L [0, 1] of n pixels
+ * @dst: returns the color bytes of n packed RGBA8 pixels
+ **/
+static inline void
+hsl_to_rgba_row (const float *h, const float *s, const float *l,
+                 uint8_t *dst, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 k = _mm_set1_ps (30), one = _mm_set1_ps (1);
+  __m128 hs, ll, a;
+
+  for (; i + 4 <= n; i += 4, dst += 16)
+    {
+      hs = _mm_div_ps (_mm_loadu_ps (h + i), k);
+      ll = _mm_loadu_ps (l + i);
+      a = _mm_mul_ps (_mm_loadu_ps (s + i),
+                      _mm_min_ps (ll, _mm_sub_ps (one, ll)));
+      frei0r_cs_store_ (dst, frei0r_cs_hsl_channel_ps_ (0, hs, ll, a),
+                        frei0r_cs_hsl_channel_ps_ (8, hs, ll, a),
+                        frei0r_cs_hsl_channel_ps_ (4, hs, ll, a));
+    }
+#endif
+
+  for (; i < n; i++, dst += 4)
+    {
+      float hs = h[i] / 30.f, a = s[i] * MIN (l[i], 1 - l[i]);
+
+      dst[0] = frei0r_cs_hsl_channel_ (0, hs, l[i], a);
+      dst[1] = frei0r_cs_hsl_channel_ (8, hs, l[i], a);
+      dst[2] = frei0r_cs_hsl_channel_ (4, hs, l[i], a);
+    }
+}
+
+// # Component mixing #######################################################
+
+/*  The hue, saturation, value and color_only mixers give each pixel of
+ *  the first source some of the components of the pixel of the second.
+ *  The components that come from the second, in HSV or HSL:
+ */
+#define FREI0R_CS_HUE 1
+#define FREI0R_CS_SATURATION 2
+#define FREI0R_CS_VALUE 4     /* V of HSV, L of HSL */
+#define FREI0R_CS_HSL 8       /* HSL instead of HSV */
+
+/* the components of one source, as the row functions compute them */
+typedef struct frei0r_cs_hsx
+{
+  float h, s, x;
+} frei0r_cs_hsx_t;
+
+static inline frei0r_cs_hsx_t
+frei0r_cs_hsx_ (const uint8_t *p, int hsl)
+{
+  float r = p[0], g = p[1], b = p[2];
+  float max = MAX (r, MAX (g, b));
+  float min = MIN (r, MIN (g, b));
+  float sum = max + min;
+  float den = sum <= 255 ? sum : 510 - sum;
+  frei0r_cs_hsx_t c;
+
+  c.h = frei0r_cs_hue_ (r, g, b, max, max - min);
+  c.s = (max - min) / MAX (hsl ? den : max, 1.f);
+  c.x = hsl ? sum / 510.f : max / 255.f;
+  return c;
+}
+
+#if defined(__SSE2__)
+
+static inline void
+frei0r_cs_hsx_ps_ (__m128i px, int hsl, __m128 *h, __m128 *s, __m128 *x)
+{
+  const __m128i m = _mm_set1_epi32 (0xff);
+  __m128 r = _mm_cvtepi32_ps (_mm_and_si128 (px, m));
+  __m128 g = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 8), m));
+  __m128 b = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 16), m));
+  __m128 max = _mm_max_ps (r, _mm_max_ps (g, b));
+  __m128 min = _mm_min_ps (r, _mm_min_ps (g, b));
+  __m128 delta = _mm_sub_ps (max, min), sum, den;
+
+  *h = frei0r_cs_hue_ps_ (r, g, b, max, delta);
+  if (hsl)
+    {
+      sum = _mm_add_ps (max, min);
+      den = frei0r_cs_select_ (_mm_cmple_ps (sum, _mm_set1_ps (255)),
+                               sum, _mm_sub_ps (_mm_set1_ps (510), sum));
+      *s = _mm_div_ps (delta, _mm_max_ps (den, _mm_set1_ps (1)));
+      *x = _mm_div_ps (sum, _mm_set1_ps (510));
+    }
+  else
+    {
+      *s = _mm_div_ps (delta, _mm_max_ps (max, _mm_set1_ps (1)));
+      *x = _mm_div_ps (max, _mm_set1_ps (255));
+    }
+}
+
+#endif
+
+/**
+ * frei0r_cs_mix_row
+ * @src1, @src2: n packed RGBA8 pixels each
+ * @dst: returns the pixels of src1 with the components in @mode taken
+ *       from src2, and the smaller alpha of both; may be src1 or src2
+ * @mode: FREI0R_CS_HUE, FREI0R_CS_SATURATION and FREI0R_CS_VALUE or-ed,
+ *        and FREI0R_CS_HSL for HSL instead of HSV
+ *
+ * Grey pixels of src2 have no hue, so they leave the hue of src1 alone;
+ * otherwise black would be painted red (see bug #123296). The result is
+ * that of converting both rows with the row functions, picking the
+ * components and converting back, but four pixels stay in registers
+ * from the load to the store. The mixers pass a constant mode, so that
+ * only the components they use are computed.
+ **/
+static inline void
+frei0r_cs_mix_row (const uint8_t *src1, const uint8_t *src2, uint8_t *dst,
+                   int n, int mode)
+{
+  const int hsl = mode & FREI0R_CS_HSL;
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i alpha = _mm_set1_epi32 (0xff000000);
+  __m128i p1, p2;
+  __m128 h1, s1, x1, h2, s2, x2, hs, a;
+
+  for (; i + 4 <= n; i += 4, src1 += 16, src2 += 16, dst += 16)
+    {
+      p1 = _mm_loadu_si128 ((const __m128i*)src1);
+      p2 = _mm_loadu_si128 ((const __m128i*)src2);
+      frei0r_cs_hsx_ps_ (p1, hsl, &h1, &s1, &x1);
+      frei0r_cs_hsx_ps_ (p2, hsl, &h2, &s2, &x2);
+      if (mode & FREI0R_CS_HUE)
+        h1 = frei0r_cs_select_ (_mm_cmpeq_ps (s2, _mm_setzero_ps ()), h1, h2);
+      if (mode & FREI0R_CS_SATURATION)
+        s1 = s2;
+      if (mode & FREI0R_CS_VALUE)
+        x1 = x2;
+      /* the smaller alpha, as bytes */
+      p1 = _mm_and_si128 (_mm_min_epu8 (p1, p2), alpha);
+      if (hsl)
+        {
+          hs = _mm_div_ps (h1, _mm_set1_ps (30));
+          a = _mm_mul_ps (s1, _mm_min_ps (x1, _mm_sub_ps (_mm_set1_ps (1), x1)));
+          p1 = frei0r_cs_pack_ (p1, frei0r_cs_hsl_channel_ps_ (0, hs, x1, a),
+                                frei0r_cs_hsl_channel_ps_ (8, hs, x1, a),
+                                frei0r_cs_hsl_channel_ps_ (4, hs, x1, a));
+        }
+      else
+        {
+          hs = _mm_div_ps (h1, _mm_set1_ps (60));
+          a = _mm_mul_ps (x1, s1);
+          p1 = frei0r_cs_pack_ (p1, frei0r_cs_hsv_channel_ps_ (5, hs, x1, a),
+                                frei0r_cs_hsv_channel_ps_ (3, hs, x1, a),
+                                frei0r_cs_hsv_channel_ps_ (1, hs, x1, a));
+        }
+      _mm_storeu_si128 ((__m128i*)dst, p1);
+    }
+#endif
+
+  for (; i < n; i++, src1 += 4, src2 += 4, dst += 4)
+    {
+      frei0r_cs_hsx_t c1 = frei0r_cs_hsx_ (src1, hsl);
+      frei0r_cs_hsx_t c2 = frei0r_cs_hsx_ (src2, hsl);
+      uint8_t a1 = MIN (src1[3], src2[3]);
+      float hs, a;
+
+      if ((mode & FREI0R_CS_HUE) && c2.s != 0)
+        c1.h = c2.h;
+      if (mode & FREI0R_CS_SATURATION)
+        c1.s = c2.s;
+      if (mode & FREI0R_CS_VALUE)
+        c1.x = c2.x;
+      if (hsl)
+        {
+          hs = c1.h / 30.f;
+          a = c1.s * MIN (c1.x, 1 - c1.x);
+          dst[0] = frei0r_cs_hsl_channel_ (0, hs, c1.x, a);
+          dst[1] = frei0r_cs_hsl_channel_ (8, hs, c1.x, a);
+          dst[2] = frei0r_cs_hsl_channel_ (4, hs, c1.x, a);
+        }
+      else
+        {
+          hs = c1.h / 60.f;
+          a = c1.x * c1.s;
+          dst[0] = frei0r_cs_hsv_channel_ (5, hs, c1.x, a);
+          dst[1] = frei0r_cs_hsv_channel_ (3, hs, c1.x, a);
+          dst[2] = frei0r_cs_hsv_channel_ (1, hs, c1.x, a);
+        }
+      dst[3] = a1;
+    }
+}
+
 #endif
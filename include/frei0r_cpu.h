@@ -0,0 +1,76 @@
+#ifndef INCLUDED_FREI0R_CPU_H
+#define INCLUDED_FREI0R_CPU_H
+
+/*
+
+  Run-time CPU feature detection for plugins that ship several variants
+  of a hot loop in one binary.
+
+  A plugin writes its loop once as an always inlined function and wraps it
+  in one function per variant. The wrappers marked FREI0R_TARGET_AVX2 (or
+  FREI0R_TARGET_AVX512) are compiled for that instruction set regardless
+  of the compiler flags of the build, so no extra flags are needed. In
+  f0r_init() the plugin checks frei0r_cpu_features() once and stores the
+  best variant in a function pointer:
+
+  static void loop_generic(...) { loop_impl(...); }
+  #ifdef FREI0R_CPU_DISPATCH
+  FREI0R_TARGET_AVX2 static void loop_avx2(...) { loop_impl(...); }
+  #endif
+  static void (*loop)(...) = loop_generic;
+
+  int f0r_init()
+  {
+  #ifdef FREI0R_CPU_DISPATCH
+    if (frei0r_cpu_features() & FREI0R_CPU_AVX2)
+      loop = loop_avx2;
+  #endif
+    return 1;
+  }
+
+  Compilers without support for the target attribute (and architectures
+  other than x86) leave FREI0R_CPU_DISPATCH undefined and only build the
+  generic variant. NEON is part of the aarch64 baseline and therefore
+  never needs dispatching.
+
+*/
+
+#define FREI0R_CPU_SSE2   0x1
+#define FREI0R_CPU_AVX2   0x2
+#define FREI0R_CPU_AVX512 0x4 /* AVX-512 F and BW */
+#define FREI0R_CPU_NEON   0x8
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FREI0R_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define FREI0R_ALWAYS_INLINE inline
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+  && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define FREI0R_CPU_DISPATCH 1
+#define FREI0R_TARGET_AVX2 __attribute__((target("avx2")))
+#define FREI0R_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+/* Returns the FREI0R_CPU_* flags supported by this machine. */
+static inline unsigned int frei0r_cpu_features(void)
+{
+  unsigned int features = 0;
+#if defined(FREI0R_CPU_DISPATCH)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    features |= FREI0R_CPU_SSE2;
+  if (__builtin_cpu_supports("avx2"))
+    features |= FREI0R_CPU_AVX2;
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    features |= FREI0R_CPU_AVX512;
+#elif defined(__SSE2__)
+  features |= FREI0R_CPU_SSE2;
+#elif defined(__ARM_NEON)
+  features |= FREI0R_CPU_NEON;
+#endif
+  return features;
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef INCLUDED_FREI0R_DEADLINE_H
+#define INCLUDED_FREI0R_DEADLINE_H
+
+/*
+
+  The quality governor behind f0r_set_deadline() for effects that have
+  a quality knob (f0r_set_quality). The effect times its own updates;
+  while their moving average is over the budget it renders one quality
+  lower, down to draft, and when it has been well under the budget for
+  a while it tries the next higher one again, up to the quality the
+  application asked for. Without a budget it renders in the quality
+  asked for, as before.
+
+  The effect keeps a frei0r_deadline_t in its instance, applies
+  deadline.current wherever it applied the quality of f0r_set_quality()
+  and wraps its update:
+
+  int f0r_set_quality(f0r_instance_t instance, int quality)
+  {
+    frei0r_deadline_request(&inst->deadline, quality);
+    apply(inst, inst->deadline.current);
+    return 1;
+  }
+
+  void f0r_update(...)
+  {
+    if (frei0r_deadline_begin(&inst->deadline))
+      apply(inst, inst->deadline.current);
+    ...
+    frei0r_deadline_end(&inst->deadline);
+  }
+
+  int f0r_set_deadline(f0r_instance_t instance, double seconds)
+  {
+    frei0r_deadline_set(&inst->deadline, seconds);
+    return 1;
+  }
+
+  int f0r_get_quality(f0r_instance_t instance)
+  {
+    return inst->deadline.current;
+  }
+
+  C++ effects get this from frei0r.hpp through fx::set_quality().
+
+*/
+
+#include <time.h>
+
+#include "frei0r.h"
+
+/* updates a new quality is judged by, the weight of an update in the
+   average is 1/FREI0R_DEADLINE_SAMPLES */
+#define FREI0R_DEADLINE_SAMPLES 8
+/* updates after a step down before a step up is tried */
+#define FREI0R_DEADLINE_HOLD 50
+/* a step up is tried under this part of the budget */
+#define FREI0R_DEADLINE_HEADROOM 0.5
+
+typedef struct frei0r_deadline
+{
+  double budget;    /* seconds per update, 0 for none */
+  double average;   /* of the updates in the current quality */
+  double start;     /* of the current update */
+  int samples;      /* updates in average */
+  int hold;         /* updates until a step up may be tried */
+  int requested;    /* quality of f0r_set_quality() */
+  int current;      /* quality of the current or last update */
+} frei0r_deadline_t;
+
+static inline double frei0r_deadline_now(void)
+{
+#ifdef _WIN32
+  /* wall clock time with the C library of MSVC */
+  return (double)clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static inline void frei0r_deadline_init(frei0r_deadline_t* d)
+{
+  d->budget = 0.0;
+  d->average = 0.0;
+  d->start = 0.0;
+  d->samples = 0;
+  d->hold = 0;
+  d->requested = d->current = F0R_QUALITY_NORMAL;
+}
+
+/* The quality asked for by the application; it takes effect at once,
+   unless the budget keeps it lower. */
+static inline void frei0r_deadline_request(frei0r_deadline_t* d, int quality)
+{
+  d->requested = quality;
+  if (d->budget <= 0.0 || d->current > quality)
+    d->current = quality;
+  d->samples = 0;
+}
+
+/* The budget of an update in seconds, 0 for none. */
+static inline void frei0r_deadline_set(frei0r_deadline_t* d, double seconds)
+{
+  d->budget = seconds > 0.0 ? seconds : 0.0;
+  d->samples = 0;
+  d->hold = 0;
+}
+
+/* Starts the clock of an update and sets current to the quality it
+   renders in; returns 1 if that is another one than last time. */
+static inline int frei0r_deadline_begin(frei0r_deadline_t* d)
+{
+  int quality = d->current;
+
+  d->start = frei0r_deadline_now();
+  if (d->budget <= 0.0)
+    quality = d->requested;
+  else if (d->samples >= FREI0R_DEADLINE_SAMPLES)
+    {
+      if (d->average > d->budget && quality > F0R_QUALITY_DRAFT)
+        {
+          --quality;
+          d->hold = FREI0R_DEADLINE_HOLD;
+        }
+      else if (d->hold > 0)
+        --d->hold;
+      else if (d->average < d->budget * FREI0R_DEADLINE_HEADROOM
+               && quality < d->requested)
+        ++quality;
+    }
+  if (quality == d->current)
+    return 0;
+  d->current = quality;
+  d->samples = 0;
+  return 1;
+}
+
+static inline void frei0r_deadline_end(frei0r_deadline_t* d)
+{
+  double t = frei0r_deadline_now() - d->start;
+
+  if (d->samples == 0)
+    d->average = t;
+  else
+    d->average += (t - d->average) / FREI0R_DEADLINE_SAMPLES;
+  if (d->samples < FREI0R_DEADLINE_SAMPLES)
+    ++d->samples;
+}
+
+#endif
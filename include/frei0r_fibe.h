@@ -0,0 +1,1018 @@
+#ifndef INCLUDED_FREI0R_FIBE_H
+#define INCLUDED_FREI0R_FIBE_H
+
+/*
+
+  FIBE, the fast IIR blur engine by Marko Cebokli, for all plugins that
+  blur images or masks with it (IIRblur, alpha0ps, keyspillm0pup).
+
+  Copyright (C) 2011  Marko Cebokli    http://lea.hamradio.si/~s57uuu
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  Each filter comes in three flavours, which differ only in what they
+  filter:
+
+  fibe1o_8(in, out, s, w, h, a, ec)   8 bit RGBA frames; s is scratch
+                                       memory of w*h fibe_rgba, the
+                                       conversion from and to 8 bit is
+                                       done in the first and last pass.
+                                       Alpha isn't filtered and is 0 in
+                                       out.
+  fibe1o_rgba(s, w, h, a, ec)         float RGBA image, in place
+  fibe1o_f(s, w, h, a, ec)            float plane (mask, alpha), in place
+
+  and the same for fibe2o_* and fibe3_*:
+
+  fibe1o      one tap quadrilateral IIR filter, a from 0 to 1
+  fibe2o      two tap quadrilateral IIR filter, coefficients from
+              calcab_lp1() and the edge terms rd, rs, rc from rep()
+  fibe3       three tap quadrilateral IIR filter, Gauss approximation
+              with coefficients from young_vliet(). The 8 bit version
+              leaves the bottom 3 rows of out alone.
+
+  Rows and then columns are split over threads (frei0r_thread.h).
+
+  With ec != 0 the image is assumed to continue with the average of its
+  border instead of black beyond the edges (edge compensation).
+
+  All flavours run the same code, with the four channels of a pixel as
+  one SSE2 or NEON vector (fibe_v4) and a plane as plain floats.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "frei0r_cpu.h"
+#include "frei0r_thread.h"
+
+//edge compensation average size
+#define EDGEAVG 8
+
+#define FIBE_PI 3.14159265358979
+
+typedef struct
+{
+    float r;
+    float g;
+    float b;
+    float a;
+} fibe_rgba;
+
+//---------------------------------------------------------
+//koeficienti za biquad lowpass  iz f in q
+// f v Nyquistih    0.0 < f < 0.5
+static inline void calcab_lp1(float f, float q, float *a0, float *a1, float *a2, float *b0, float *b1, float *b2)
+{
+    float a,b;
+
+    a=sinf(FIBE_PI*f)/2.0/q;
+    b=cosf(FIBE_PI*f);
+    *b0=(1.0-b)/2.0;
+    *b1=1.0-b;
+    *b2=(1.0-b)/2.0;
+    *a0=1.0+a;
+    *a1=-2.0*b;
+    *a2=1.0-a;
+}
+
+//---------------------------------------------------------
+//3tap iir coefficients for Gauss approximation according to:
+//Ian T. Young, Lucas J. van Vliet:
+//Recursive implementation of the Gaussian filter
+//Signal Processing 44 (1995) 139-151
+// s=sigma    0.5 < s < 200.0
+static inline void young_vliet(float s, float *a0, float *a1, float *a2, float *a3)
+{
+    float q;
+
+    q=0.0;
+    if (s>2.5)
+    {
+        q = 0.98711*s - 0.96330;
+    }
+    else
+    {	//to velja za s>0.5 !!!!
+        q = 3.97156 - 4.14554*sqrtf(1.0-0.26891*s);
+    }
+
+    *a0 = 1.57825 + 2.44413*q + 1.4281*q*q + 0.422205*q*q*q;
+    *a1 = 2.44413*q + 2.85619*q*q + 1.26661*q*q*q;
+    *a2 = -1.4281*q*q - 1.26661*q*q*q;
+    *a3 = 0.422205*q*q*q;
+}
+
+//---------------------------------------------------
+//kompenzacija na desni
+//c=0.0 "odziv na zacetno stanje" (zunaj crno)
+//gain ni kompenziran
+static inline void rep(float v1, float v2, float c, float *i1, float *i2, int n,  float a1, float a2)
+{
+    int i;
+    float lb[8192];
+
+    lb[0]=v1;lb[1]=v2;
+    for (i=2;i<n-2;i++)
+    {
+        lb[i]=c-a1*lb[i-1]-a2*lb[i-2];
+    }
+
+    lb[n-2]=0.0;lb[n-1]=0.0;
+    for (i=n-3;i>=0;i--)
+    {
+        lb[i]=lb[i]-a1*lb[i+1]-a2*lb[i+2];
+    }
+
+    *i1=lb[0]; *i2=lb[1];
+}
+
+//---------------------------------------------------------
+//the four channels of a fibe_rgba as one vector
+//(SSE2 or NEON, plain floats elsewhere)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+typedef __m128 fibe_v4;
+#define fibe_v4_load(p) _mm_loadu_ps(&(p)->r)
+#define fibe_v4_store(p, v) _mm_storeu_ps(&(p)->r, v)
+#define fibe_v4_set1(f) _mm_set1_ps(f)
+#define fibe_v4_add(a, b) _mm_add_ps(a, b)
+#define fibe_v4_sub(a, b) _mm_sub_ps(a, b)
+#define fibe_v4_mul(a, b) _mm_mul_ps(a, b)
+#define fibe_v4_div(a, b) _mm_div_ps(a, b)
+#define fibe_v4_first(v) _mm_cvtss_f32(v)
+static inline fibe_v4 fibe_v4_clamp255(fibe_v4 v)
+{
+    return _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(255.0)), _mm_setzero_ps());
+}
+static inline fibe_v4 fibe_v4_from_8(uint32_t c)
+{
+    __m128i z = _mm_setzero_si128();
+    __m128i i = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)c), z), z);
+    return _mm_cvtepi32_ps(i);
+}
+static inline uint32_t fibe_v4_to_8(fibe_v4 v)
+{
+    __m128i i = _mm_and_si128(_mm_cvttps_epi32(v), _mm_set1_epi32(0xFF));
+    i = _mm_packus_epi16(_mm_packs_epi32(i, i), i);
+    return (uint32_t)_mm_cvtsi128_si32(i) & 0xFFFFFF;
+}
+//(x1+x2)*0.5*rs+(x1-x2)*rd, in double like the scalar expression
+static inline fibe_v4 fibe_v4_rep(fibe_v4 x1, fibe_v4 x2, float rs, float rd)
+{
+    __m128 sum = _mm_add_ps(x1, x2);
+    __m128 dif = _mm_mul_ps(_mm_sub_ps(x1, x2), _mm_set1_ps(rd));
+    __m128d h = _mm_set1_pd(0.5), r = _mm_set1_pd(rs);
+    __m128d lo = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_cvtps_pd(sum), h), r),
+                            _mm_cvtps_pd(dif));
+    __m128d hi = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(sum, sum)), h), r),
+                            _mm_cvtps_pd(_mm_movehl_ps(dif, dif)));
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t fibe_v4;
+#define fibe_v4_load(p) vld1q_f32(&(p)->r)
+#define fibe_v4_store(p, v) vst1q_f32(&(p)->r, v)
+#define fibe_v4_set1(f) vdupq_n_f32(f)
+#define fibe_v4_add(a, b) vaddq_f32(a, b)
+#define fibe_v4_sub(a, b) vsubq_f32(a, b)
+#define fibe_v4_mul(a, b) vmulq_f32(a, b)
+#define fibe_v4_first(v) vgetq_lane_f32(v, 0)
+static inline fibe_v4 fibe_v4_div(fibe_v4 a, fibe_v4 b)
+{
+#ifdef __aarch64__
+    return vdivq_f32(a, b);
+#else
+    float fa[4], fb[4];
+    int i;
+    vst1q_f32(fa, a); vst1q_f32(fb, b);
+    for (i = 0; i < 4; i++) fa[i] = fa[i] / fb[i];
+    return vld1q_f32(fa);
+#endif
+}
+static inline fibe_v4 fibe_v4_clamp255(fibe_v4 v)
+{
+    return vmaxq_f32(vminq_f32(v, vdupq_n_f32(255.0)), vdupq_n_f32(0.0));
+}
+static inline fibe_v4 fibe_v4_from_8(uint32_t c)
+{
+    uint8x8_t b = vreinterpret_u8_u32(vdup_n_u32(c));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(b))));
+}
+static inline uint32_t fibe_v4_to_8(fibe_v4 v)
+{
+    uint32x4_t i = vandq_u32(vreinterpretq_u32_s32(vcvtq_s32_f32(v)), vdupq_n_u32(0xFF));
+    return vgetq_lane_u32(i, 0) | (vgetq_lane_u32(i, 1) << 8) | (vgetq_lane_u32(i, 2) << 16);
+}
+static inline fibe_v4 fibe_v4_rep(fibe_v4 x1, fibe_v4 x2, float rs, float rd)
+{
+    float f1[4], f2[4];
+    int i;
+    vst1q_f32(f1, x1); vst1q_f32(f2, x2);
+    for (i = 0; i < 4; i++) f1[i] = (f1[i]+f2[i])*0.5*rs+(f1[i]-f2[i])*rd;
+    return vld1q_f32(f1);
+}
+#else
+typedef fibe_rgba fibe_v4;
+#define fibe_v4_load(p) (*(p))
+#define fibe_v4_store(p, v) (*(p) = (v))
+#define fibe_v4_first(v) ((v).r)
+static inline fibe_v4 fibe_v4_set1(float f)
+{
+    fibe_v4 v;
+    v.r = f; v.g = f; v.b = f; v.a = f;
+    return v;
+}
+#define FIBE_V4_OP(name, op) \
+static inline fibe_v4 name(fibe_v4 x, fibe_v4 y) \
+{ \
+    fibe_v4 v; \
+    v.r = x.r op y.r; v.g = x.g op y.g; v.b = x.b op y.b; v.a = x.a op y.a; \
+    return v; \
+}
+FIBE_V4_OP(fibe_v4_add, +)
+FIBE_V4_OP(fibe_v4_sub, -)
+FIBE_V4_OP(fibe_v4_mul, *)
+FIBE_V4_OP(fibe_v4_div, /)
+static inline float fibe_clamp255_(float f)
+{
+    if (f>255) f=255.0;
+    if (f<0.0) f=0.0;
+    return f;
+}
+static inline fibe_v4 fibe_v4_clamp255(fibe_v4 v)
+{
+    v.r = fibe_clamp255_(v.r); v.g = fibe_clamp255_(v.g);
+    v.b = fibe_clamp255_(v.b); v.a = fibe_clamp255_(v.a);
+    return v;
+}
+static inline fibe_v4 fibe_v4_from_8(uint32_t c)
+{
+    fibe_v4 v;
+    v.r = (float)(c&0xFF);
+    v.g = (float)((c&0xFF00)>>8);
+    v.b = (float)((c&0xFF0000)>>16);
+    v.a = (float)((c&0xFF000000)>>24);
+    return v;
+}
+static inline uint32_t fibe_v4_to_8(fibe_v4 v)
+{
+    return ((uint32_t)v.r&0xFF) + (((uint32_t)v.g&0xFF)<<8) + (((uint32_t)v.b&0xFF)<<16);
+}
+static inline fibe_v4 fibe_v4_rep(fibe_v4 x1, fibe_v4 x2, float rs, float rd)
+{
+    fibe_v4 v;
+    v.r = (x1.r+x2.r)*0.5*rs+(x1.r-x2.r)*rd;
+    v.g = (x1.g+x2.g)*0.5*rs+(x1.g-x2.g)*rd;
+    v.b = (x1.b+x2.b)*0.5*rs+(x1.b-x2.b)*rd;
+    v.a = (x1.a+x2.a)*0.5*rs+(x1.a-x2.a)*rd;
+    return v;
+}
+#endif
+
+//---------------------------------------------------------
+//what a filter works on, a compile time constant in the filters
+
+#define FIBE_8    0	//8 bit RGBA in and out, fibe_rgba scratch
+#define FIBE_RGBA 1	//fibe_rgba in place
+#define FIBE_MASK 2	//float in place
+
+//one pixel, v for four channels or f for a plane; only one of them is
+//used. Planes are plain floats, in a vector the compiler would keep
+//zeroing the unused lanes
+typedef struct
+{
+    fibe_v4 v;
+    float f;
+} fibe_px;
+
+#define FIBE_PX_OP(name, v4, op) \
+static FREI0R_ALWAYS_INLINE fibe_px name(fibe_px x, fibe_px y, const int kind) \
+{ \
+    fibe_px p; \
+    if (kind == FIBE_MASK) \
+        p.f = x.f op y.f; \
+    else \
+        p.v = v4(x.v, y.v); \
+    return p; \
+}
+FIBE_PX_OP(fibe_add, fibe_v4_add, +)
+FIBE_PX_OP(fibe_sub, fibe_v4_sub, -)
+FIBE_PX_OP(fibe_mul, fibe_v4_mul, *)
+FIBE_PX_OP(fibe_div, fibe_v4_div, /)
+
+static FREI0R_ALWAYS_INLINE fibe_px fibe_set1(float f, const int kind)
+{
+    fibe_px p;
+    if (kind == FIBE_MASK)
+        p.f = f;
+    else
+        p.v = fibe_v4_set1(f);
+    return p;
+}
+
+static FREI0R_ALWAYS_INLINE float fibe_first(fibe_px p, const int kind)
+{
+    return kind == FIBE_MASK ? p.f : fibe_v4_first(p.v);
+}
+
+static FREI0R_ALWAYS_INLINE fibe_px fibe_rep(fibe_px x1, fibe_px x2, float rs, float rd, const int kind)
+{
+    fibe_px p;
+    if (kind == FIBE_MASK)
+        p.f = (x1.f+x2.f)*0.5*rs+(x1.f-x2.f)*rd;
+    else
+        p.v = fibe_v4_rep(x1.v, x2.v, rs, rd);
+    return p;
+}
+
+static FREI0R_ALWAYS_INLINE fibe_px fibe_ld(void* s, long i, const int kind)
+{
+    fibe_px p;
+    if (kind == FIBE_MASK)
+        p.f = ((float*)s)[i];
+    else
+        p.v = fibe_v4_load((fibe_rgba*)s + i);
+    return p;
+}
+
+static FREI0R_ALWAYS_INLINE void fibe_st(void* s, long i, fibe_px p, const int kind)
+{
+    if (kind == FIBE_MASK)
+        ((float*)s)[i] = p.f;
+    else
+        fibe_v4_store((fibe_rgba*)s + i, p.v);
+}
+
+//first read of pixel i, converts from 8 bit
+static FREI0R_ALWAYS_INLINE fibe_px fibe_in(const uint32_t* in, void* s, long i, const int kind)
+{
+    fibe_px p;
+    if (kind != FIBE_8)
+        return fibe_ld(s, i, kind);
+    p.v = fibe_v4_from_8(in[i]);
+    return p;
+}
+
+//final value of pixel i, converts to 8 bit (clamped to 0..255 first
+//if clamp != 0; the clamped value is also what stays in s)
+static FREI0R_ALWAYS_INLINE void fibe_out(uint32_t* out, void* s, long i, fibe_px p, const int clamp, const int kind)
+{
+    if (kind == FIBE_8 && clamp)
+        p.v = fibe_v4_clamp255(p.v);
+    fibe_st(s, i, p, kind);
+    if (kind == FIBE_8)
+        out[i] = fibe_v4_to_8(p.v);
+}
+
+#define ADD(x, y) fibe_add(x, y, kind)
+#define SUB(x, y) fibe_sub(x, y, kind)
+#define MUL(x, y) fibe_mul(x, y, kind)
+#define DIV(x, y) fibe_div(x, y, kind)
+#define SET1(f) fibe_set1(f, kind)
+#define LD(i) fibe_ld(s, i, kind)
+#define ST(i, v) fibe_st(s, i, v, kind)
+#define IN(i) fibe_in(in, s, i, kind)
+
+//average of n pixels starting at i, step apart
+static FREI0R_ALWAYS_INLINE fibe_px fibe_sum(void* s, long i, long step, int n, const int kind)
+{
+    fibe_px c = SET1(0.0);
+    int k;
+
+    for (k=0;k<n;k++)
+        c = ADD(c, LD(i+k*step));
+    return c;
+}
+
+//x + a*y
+#define FIBE_MAC(x, a, y) ADD(x, MUL(a, y))
+//x - a1*y1 - a2*y2
+#define FIBE_STEP2(x, y1, y2) \
+    SUB(SUB(x, MUL(va1, y1)), MUL(va2, y2))
+//x - a1*y1 - a2*y2 - a3*y3
+#define FIBE_STEP3(x, y1, y2, y3) \
+    SUB(FIBE_STEP2(x, y1, y2), MUL(va3, y3))
+
+//---------------------------------------------------------
+//All filters run in two passes, each split over threads (frei0r_thread.h):
+//first the rows there and back, which don't depend on each other, then
+//the columns down and up, which don't either. The bands of columns are
+//whole multiples of FIBE_TILE, so that threads don't share cache lines.
+//fibe1o and fibe2o go down and up a band a row at a time, fibe3 works on
+//FIBE_TILE neighbouring columns at once, which turns its walk down a
+//column into reads of whole cache lines. The 8 bit conversions are in
+//the first and the last pass.
+
+#define FIBE_TILE 4	// columns per step of the fibe3 column pass
+
+typedef struct
+{
+    const uint32_t* in;
+    uint32_t* out;
+    void* s;
+    int w, h;
+    float a1, a2, a3;		//fibe1o has a in a1
+    float rd1, rd2, rs1, rs2, rc1, rc2;	//fibe2o edge terms
+    int ec;
+    int y0, y1;		//rows of the row pass
+    int x0, x1;		//columns of the column pass
+} fibe_job;
+
+//the thread functions of the passes of a filter, for one kind
+#define FIBE_PASSES(name, suffix, kind) \
+static inline void* name##_rows_##suffix(void* job) \
+{ \
+    name##_rows((const fibe_job*)job, kind); \
+    return NULL; \
+} \
+static inline void* name##_columns_##suffix(void* job) \
+{ \
+    name##_columns((const fibe_job*)job, kind); \
+    return NULL; \
+}
+
+//runs both passes with the parameters in par, the bands are set here
+static inline void fibe_run(void* (*rows)(void*), void* (*columns)(void*), const fibe_job* par)
+{
+    fibe_job jobs[FREI0R_MAX_THREADS];
+    const int w = par->w, h = par->h;
+    int i, n = frei0r_thread_count((long)w*h);
+    int cols = ((w+n-1)/n + FIBE_TILE-1) / FIBE_TILE * FIBE_TILE;
+
+    for (i=0;i<n;i++)
+    {
+        jobs[i] = *par;
+        jobs[i].y0 = h*i/n;
+        jobs[i].y1 = h*(i+1)/n;
+        jobs[i].x0 = i*cols<w ? i*cols : w;
+        jobs[i].x1 = (i+1)*cols<w ? (i+1)*cols : w;
+    }
+    frei0r_thread_run(rows, jobs, sizeof(fibe_job), n);
+    frei0r_thread_run(columns, jobs, sizeof(fibe_job), n);
+}
+
+//---------------------------------------------------------
+// 1-tap IIR v 4 smereh
+//optimized for speed
+
+//cr*g+b*(x-cr), edge compensated first or last pixel
+#define FIBE1_EDGE(x) FIBE_MAC(MUL(cr, vg), vb, SUB(x, cr))
+
+//m rows (1 or 2) from row i on there and back; two at once break the
+//dependency chain
+static FREI0R_ALWAYS_INLINE void fibe1o_row(const uint32_t* in, void* s, int w, int i, float a, int ec, const int m, const int kind)
+{
+    const float avg = EDGEAVG;	//koliko vzorcev za povprecje pri edge comp
+    float b,g;
+    int j,k,p[2];
+    fibe_px cr,x[2],va,vb,vg,vavg1;
+
+    g=1.0/(1.0-a);
+    //predpostavimo, da je "zunaj" crnina (nicle)
+    b=1.0/(1.0-a)/(1.0+a);
+    va=SET1(a); vb=SET1(b); vg=SET1(g);
+    vavg1=SET1(1.0/avg);
+
+    for (k=0;k<m;k++)
+    {
+        p[k]=(i+k)*w;
+        for (j=0;j<avg;j++)
+            ST(p[k]+j, IN(p[k]+j));
+        if (ec!=0)
+        {
+            cr=MUL(fibe_sum(s, p[k], 1, avg, kind), vavg1);
+            ST(p[k], FIBE1_EDGE(LD(p[k])));
+        }
+        x[k]=LD(p[k]);
+    }
+
+    for (j=1;j<avg;j++)	//tja
+        for (k=0;k<m;k++)
+        {
+            x[k]=FIBE_MAC(LD(p[k]+j), va, x[k]);
+            ST(p[k]+j, x[k]);
+        }
+    for (j=avg;j<w;j++)
+        for (k=0;k<m;k++)
+        {
+            x[k]=FIBE_MAC(IN(p[k]+j), va, x[k]);
+            ST(p[k]+j, x[k]);
+        }
+
+    for (k=0;k<m;k++)
+    {
+        if (ec!=0)
+        {
+            cr=MUL(fibe_sum(s, p[k]+w-avg, 1, avg, kind), vavg1);
+            ST(p[k]+w-1, FIBE1_EDGE(LD(p[k]+w-1)));
+        }
+        else
+            ST(p[k]+w-1, MUL(vb, LD(p[k]+w-1)));	//rep H
+        x[k]=LD(p[k]+w-1);
+    }
+
+    for (j=w-2;j>=0;j--)	//nazaj
+        for (k=0;k<m;k++)
+        {
+            x[k]=FIBE_MAC(LD(p[k]+j), va, x[k]);
+            ST(p[k]+j, x[k]);
+        }
+}
+
+//row pass over the rows [y0,y1)
+static FREI0R_ALWAYS_INLINE void fibe1o_rows(const fibe_job* job, const int kind)
+{
+    int i;
+
+    for (i=job->y0;i<job->y1-1;i+=2)	//po vrsticah, dve naenkrat
+        fibe1o_row(job->in, job->s, job->w, i, job->a1, job->ec, 2, kind);
+    if (i<job->y1)
+        fibe1o_row(job->in, job->s, job->w, i, job->a1, job->ec, 1, kind);
+}
+
+//column pass (dol in gor) over the columns [x0,x1)
+static FREI0R_ALWAYS_INLINE void fibe1o_columns(const fibe_job* job, const int kind)
+{
+    void* s = job->s;
+    const int w = job->w, h = job->h, x0 = job->x0, x1 = job->x1;
+    const float a = job->a1;
+    const float avg = EDGEAVG;
+    float b,g,g4,g4a,g4b;
+    int i,k,p;
+    fibe_px cr,x,va,vb,vg,vavg1,vg4,vg4a,vg4b;
+
+    g=1.0/(1.0-a);
+    g4=1.0/g/g/g/g;
+    b=1.0/(1.0-a)/(1.0+a);
+    g4b=g4*b;
+    g4a=g4/(1.0-a);
+    va=SET1(a); vb=SET1(b); vg=SET1(g);
+    vavg1=SET1(1.0/avg); vg4=SET1(g4);
+    vg4a=SET1(g4a); vg4b=SET1(g4b);
+
+    if (job->ec!=0)	//edge comp zgoraj
+        for (k=x0;k<x1;k++)
+        {
+            cr=MUL(fibe_sum(s, k, w, avg, kind), vavg1);
+            ST(k, FIBE1_EDGE(LD(k)));
+        }
+
+    for (i=1;i<h;i++)	//dol
+    {
+        p=i*w;
+        for (k=x0;k<x1;k++)
+            ST(p+k, FIBE_MAC(LD(p+k), va, LD(p-w+k)));
+    }
+
+    //zadnja vrstica (h-1)
+    p=(h-1)*w;
+    for (k=x0;k<x1;k++)
+    {
+        if (job->ec!=0)
+        {
+            cr=MUL(fibe_sum(s, k+w*(h-avg), w, avg, kind), vavg1);
+            x=FIBE_MAC(MUL(vg4a, cr), vg4b, SUB(LD(p+k), cr));
+        }
+        else
+            x=MUL(vg4b, LD(p+k));	//rep V
+        fibe_out(job->out, s, p+k, x, 0, kind);
+    }
+
+    for (i=h-2;i>=0;i--)	//gor
+    {
+        p=i*w;
+        for (k=x0;k<x1;k++)
+            fibe_out(job->out, s, p+k, FIBE_MAC(MUL(vg4, LD(p+k)), va, LD(p+w+k)), 0, kind);
+    }
+}
+
+#undef FIBE1_EDGE
+
+FIBE_PASSES(fibe1o, 8, FIBE_8)
+FIBE_PASSES(fibe1o, rgba, FIBE_RGBA)
+FIBE_PASSES(fibe1o, f, FIBE_MASK)
+
+//-------------------------------------------------------
+// 2-tap IIR v stirih smereh   a only verzija, a0=1.0
+//desno kompenzacijo izracuna direktno (rdx,rsx,rcx)
+//optimized for speed
+
+//m rows (1 or 2) from row j on there and back; two at once break the
+//dependency chain
+static FREI0R_ALWAYS_INLINE void fibe2o_row(const uint32_t* in, void* s, int w, int j, float a1, float a2, float rd1, float rd2, float rs1, float rs2, float rc1, float rc2, int ec, const int m, const int kind)
+{
+    const float avg=EDGEAVG;
+    const fibe_px va1=SET1(a1), va2=SET1(a2);
+    float g,g4,gavg;
+    fibe_px cr,cb[2],rep1,rep2,vg4;
+    int i,k,jw[2],jww;
+
+    g=1.0/(1.0+a1+a2);
+    g4=1.0/g/g/g/g;
+    gavg=g4/avg;
+    vg4=SET1(g4);
+
+    for (k=0;k<m;k++)
+    {
+        jw[k]=(j+k)*w;
+        cr=SET1(0.0);
+        for (i=0;i<avg;i++)
+            ST(jw[k]+i, IN(jw[k]+i));
+        if (ec!=0)	//edge comp (popvprecje prvih)
+            cr=MUL(fibe_sum(s, jw[k], 1, avg, kind), SET1(gavg));
+
+        ST(jw[k], SUB(MUL(vg4, LD(jw[k])), MUL(SET1((a1+a2)*g), cr)));
+        ST(jw[k]+1, SUB(SUB(MUL(vg4, LD(jw[k]+1)), MUL(va1, LD(jw[k]))),
+                             MUL(SET1(a2*g), cr)));
+
+        for (i=w-avg;i<w;i++)
+            ST(jw[k]+i, IN(jw[k]+i));
+        cb[k]=SET1(0.0);
+        if (ec!=0)	//edge comp za nazaj
+            cb[k]=MUL(fibe_sum(s, jw[k]+w-avg, 1, avg, kind), SET1(gavg));
+    }
+
+    for (i=2;i<w;i++)	//tja
+        for (k=0;k<m;k++)
+        {
+            fibe_px x = (kind==FIBE_8 && i>=avg && i<w-avg) ? IN(jw[k]+i) : LD(jw[k]+i);
+            ST(jw[k]+i, FIBE_STEP2(MUL(vg4, x), LD(jw[k]+i-1), LD(jw[k]+i-2)));
+        }
+
+    for (k=0;k<m;k++)
+    {
+        jww=jw[k]+w;
+        rep1=fibe_rep(LD(jww-1), LD(jww-2), rs1, rd1, kind);
+        rep2=fibe_rep(LD(jww-1), LD(jww-2), rs2, rd2, kind);
+
+        if (ec!=0)
+        {
+            rep1=FIBE_MAC(rep1, SET1(rc1), cb[k]);
+            rep2=FIBE_MAC(rep2, SET1(rc2), cb[k]);
+        }
+
+        ST(jww-1, FIBE_STEP2(LD(jww-1), rep1, rep2));
+        ST(jww-2, FIBE_STEP2(LD(jww-2), LD(jww-1), rep1));
+    }
+
+    for (i=w-3;i>=0;i--)	//nazaj
+        for (k=0;k<m;k++)
+            ST(jw[k]+i, FIBE_STEP2(LD(jw[k]+i), LD(jw[k]+i+1), LD(jw[k]+i+2)));
+}
+
+//row pass over the rows [y0,y1)
+static FREI0R_ALWAYS_INLINE void fibe2o_rows(const fibe_job* job, const int kind)
+{
+    int j;
+
+    for (j=job->y0;j<job->y1-1;j+=2)	//po vrsticah tja in nazaj, dve naenkrat
+        fibe2o_row(job->in, job->s, job->w, j, job->a1, job->a2,
+                   job->rd1, job->rd2, job->rs1, job->rs2, job->rc1, job->rc2,
+                   job->ec, 2, kind);
+    if (j<job->y1)
+        fibe2o_row(job->in, job->s, job->w, j, job->a1, job->a2,
+                   job->rd1, job->rd2, job->rs1, job->rs2, job->rc1, job->rc2,
+                   job->ec, 1, kind);
+}
+
+//column pass over the columns [x0,x1). The 8 bit version clamps the
+//result to 0..255
+static FREI0R_ALWAYS_INLINE void fibe2o_columns(const fibe_job* job, const int kind)
+{
+    void* s = job->s;
+    const int w = job->w, h = job->h, x0 = job->x0, x1 = job->x1;
+    const float a1 = job->a1, a2 = job->a2;
+    const float avg=EDGEAVG;	//koliko vzorcev za povprecje pri edge comp
+    const fibe_px va1=SET1(a1), va2=SET1(a2);
+    float g,avgg,iavg;
+    fibe_px cr,rep1,rep2,k1,k2;
+    int i,k;
+    int iw,h1w,h2w;
+
+    g=1.0/(1.0+a1+a2);
+    avgg=1.0/g/avg;
+    iavg=1.0/avg;
+    k1=SET1((a1+a2)*g);
+    k2=SET1(a2*g);
+    h1w=(h-1)*w; h2w=(h-2)*w;
+
+    //edge comp zgoraj za navzdol, zgornji vrstici
+    for (k=x0;k<x1;k++)
+    {
+        cr=SET1(0.0);
+        if (job->ec!=0)	//edge comp (popvprecje prvih)
+            cr=MUL(fibe_sum(s, k, w, avg, kind), SET1(iavg));
+
+        ST(k, SUB(LD(k), MUL(k1, cr)));
+        ST(k+w, SUB(SUB(LD(k+w), MUL(va1, LD(k))), MUL(k2, cr)));
+    }
+
+    for (i=2;i<h;i++)	//dol
+    {
+        iw=i*w;
+        for (k=x0;k<x1;k++)
+            ST(k+iw, FIBE_STEP2(LD(k+iw), LD(k+iw-w), LD(k+iw-w-w)));
+    }
+
+    //pa se navzgor, spodnji dve vrstici
+    cr=SET1(0.0);
+    for (k=x0;k<x1;k++)
+    {
+        if (job->ec!=0)	//edge comp za gor
+            cr=MUL(fibe_sum(s, k+w*(h-avg), w, avg, kind), SET1(avgg));
+
+        rep1=fibe_rep(LD(k+h1w), LD(k+h2w), job->rs1, job->rd1, kind);
+        rep2=fibe_rep(LD(k+h1w), LD(k+h2w), job->rs2, job->rd2, kind);
+
+        if (job->ec!=0)
+        {	//edge comp
+            rep1=FIBE_MAC(rep1, SET1(job->rc1), cr);
+            rep2=FIBE_MAC(rep2, SET1(job->rc2), cr);
+        }
+
+        fibe_out(job->out, s, k+h1w, FIBE_STEP2(LD(k+h1w), rep1, rep2), 1, kind);
+        fibe_out(job->out, s, k+h2w, FIBE_STEP2(LD(k+h2w), LD(k+h1w), rep1), 1, kind);
+    }
+
+    //ostale vrstice
+    for (i=h-3;i>=0;i--)	//gor
+    {
+        iw=i*w;
+        for (k=x0;k<x1;k++)
+            fibe_out(job->out, s, k+iw, FIBE_STEP2(LD(k+iw), LD(k+iw+w), LD(k+iw+w+w)), 1, kind);
+    }
+}
+
+FIBE_PASSES(fibe2o, 8, FIBE_8)
+FIBE_PASSES(fibe2o, rgba, FIBE_RGBA)
+FIBE_PASSES(fibe2o, f, FIBE_MASK)
+
+//-------------------------------------------------------
+// 3-tap IIR v stirih smereh
+//a only verzija, a0=1.0
+//edge efekt na desni kompenzira tako, da racuna 256 vzorcev
+//cez rob in in gre potem nazaj
+
+#define FIBE3_CEZ 256	// how many samples go right
+
+//row pass (tja in nazaj) over the rows [y0,y1)
+static FREI0R_ALWAYS_INLINE void fibe3_rows(const fibe_job* job, const int kind)
+{
+    const uint32_t* in = job->in;
+    void* s = job->s;
+    const int w = job->w, cez = FIBE3_CEZ;
+    const float a1 = job->a1, a2 = job->a2, a3 = job->a3;
+    const float avg = EDGEAVG; // how many samples for average at edge comp
+    const fibe_px va1 = SET1(a1), va2 = SET1(a2), va3 = SET1(a3);
+    float g, g4;
+    fibe_px c, x, vg4, vavg;
+    fibe_px *lb = (fibe_px*)malloc((w + cez) * sizeof(*lb));
+    int i, j;
+
+    g=1.0/(1.0+a1+a2+a3); g4=1.0/g/g/g/g;
+    vg4 = SET1(g4);
+    vavg = SET1(avg);
+
+    for (j=job->y0;j<job->y1;j++)	//po vrsticah
+    {
+        const int jw = j*w;
+
+        c = SET1(0.0);
+        for (i=0;i<avg;i++)
+            ST(jw+i, IN(jw+i));
+        if (job->ec!=0)	//edge comp (popvprecje prvih)
+            c = DIV(MUL(vg4, fibe_sum(s, jw, 1, avg, kind)), vavg);
+        x = MUL(vg4, LD(jw));
+        lb[0] = SUB(x, MUL(SET1((a1+a2+a3)*g), c));
+        x = MUL(vg4, LD(jw+1));
+        lb[1] = SUB(SUB(x, MUL(va1, lb[0])),
+                            MUL(SET1((a2+a3)*g), c));
+        x = MUL(vg4, LD(jw+2));
+        lb[2] = SUB(FIBE_STEP2(x, lb[1], lb[0]),
+                            MUL(SET1(a3*g), c));
+
+        for (i=3;i<avg;i++)	//tja  (ze pretvorjeni)
+            lb[i] = FIBE_STEP3(MUL(vg4, LD(jw+i)), lb[i-1], lb[i-2], lb[i-3]);
+
+        for (i=avg;i<w;i++)	//tja  (s pretvorbo)
+        {
+            x = IN(jw+i);
+            ST(jw+i, x);
+            lb[i] = FIBE_STEP3(MUL(vg4, x), lb[i-1], lb[i-2], lb[i-3]);
+        }
+
+        c = SET1(0.0);
+        if (job->ec!=0)
+        {	//edge comp
+            c = DIV(MUL(vg4, fibe_sum(s, jw+w-avg, 1, avg, kind)), vavg);
+            //all colors continue with the red average here
+            c = SET1(fibe_first(c, kind));
+        }
+
+        for (i=w;i<(w+cez);i++)	//naprej cez rob
+            lb[i] = FIBE_STEP3(c, lb[i-1], lb[i-2], lb[i-3]);
+        //nazaj do roba
+        lb[w+cez-2] = SUB(lb[w+cez-2], MUL(va1, lb[w+cez-1]));
+        lb[w+cez-3] = FIBE_STEP2(lb[w+cez-3], lb[w+cez-2], lb[w+cez-1]);
+        for (i=(w+cez-4);i>=w;i--)
+            lb[i] = FIBE_STEP3(lb[i], lb[i+1], lb[i+2], lb[i+3]);
+
+        lb[w-1] = FIBE_STEP3(lb[w-1], lb[w], lb[w+1], lb[w+2]);
+        lb[w-2] = FIBE_STEP3(lb[w-2], lb[w-1], lb[w], lb[w+1]);
+        lb[w-3] = FIBE_STEP3(lb[w-3], lb[w-2], lb[w-1], lb[w]);
+        for (i=w-4;i>=0;i--)		//nazaj
+            lb[i] = FIBE_STEP3(lb[i], lb[i+1], lb[i+2], lb[i+3]);
+        for (i=0;i<w;i++)
+            ST(jw+i, lb[i]);
+    }	//po vrsticah
+
+    free(lb);
+}
+
+//column pass (dol in gor) over the columns [x0,x1). The 8 bit version
+//doesn't write the bottom 3 rows of out
+static FREI0R_ALWAYS_INLINE void fibe3_columns(const fibe_job* job, const int kind)
+{
+    void* s = job->s;
+    const int w = job->w, h = job->h, cez = FIBE3_CEZ, T = FIBE_TILE;
+    const float a1 = job->a1, a2 = job->a2, a3 = job->a3;
+    const float avg = EDGEAVG;
+    const fibe_px va1 = SET1(a1), va2 = SET1(a2), va3 = SET1(a3);
+    float g;
+    fibe_px c[FIBE_TILE], vavg, k0, k1, k2;
+    fibe_px *lb = (fibe_px*)malloc((h + cez) * FIBE_TILE * sizeof(*lb));
+    int i, j, k, n;
+
+    g=1.0/(1.0+a1+a2+a3);
+    vavg = SET1(avg);
+    k0 = SET1((a1+a2+a3)*g);
+    k1 = SET1((a2+a3)*g);
+    k2 = SET1(a3*g);
+
+    for (j=job->x0;j<job->x1;j+=T)	//po stolpcih, T naenkrat
+    {
+        n = job->x1-j<T ? job->x1-j : T;
+
+        for (k=0;k<n;k++)
+        {
+            c[k] = SET1(0.0);
+            if (job->ec!=0)	//edge comp (popvprecje prvih)
+                c[k] = DIV(fibe_sum(s, j+k, w, avg, kind), vavg);
+            lb[k] = SUB(LD(j+k), MUL(k0, c[k]));
+            lb[T+k] = SUB(SUB(LD(j+k+w), MUL(va1, lb[k])),
+                                  MUL(k1, c[k]));
+            lb[2*T+k] = SUB(FIBE_STEP2(LD(j+k+2*w), lb[T+k], lb[k]),
+                                    MUL(k2, c[k]));
+        }
+
+        for (i=3;i<h;i++)		//dol
+            for (k=0;k<n;k++)
+                lb[i*T+k] = FIBE_STEP3(LD(j+k+w*i),
+                                       lb[(i-1)*T+k], lb[(i-2)*T+k], lb[(i-3)*T+k]);
+
+        for (k=0;k<n;k++)
+        {
+            c[k] = SET1(0.0);
+            if (job->ec!=0)	//edge comp
+                c[k] = DIV(fibe_sum(s, j+k+w*(h-avg), w, avg, kind), vavg);
+        }
+
+        for (i=h;i<(h+cez);i++)	//naprej cez rob
+            for (k=0;k<n;k++)
+                lb[i*T+k] = FIBE_STEP3(c[k], lb[(i-1)*T+k], lb[(i-2)*T+k], lb[(i-3)*T+k]);
+        for (k=0;k<n;k++)	//nazaj do roba
+        {
+            lb[(h+cez-2)*T+k] = SUB(lb[(h+cez-2)*T+k], MUL(va1, lb[(h+cez-1)*T+k]));
+            lb[(h+cez-3)*T+k] = FIBE_STEP2(lb[(h+cez-3)*T+k], lb[(h+cez-2)*T+k], lb[(h+cez-1)*T+k]);
+        }
+        for (i=(h+cez-4);i>=h;i--)
+            for (k=0;k<n;k++)
+                lb[i*T+k] = FIBE_STEP3(lb[i*T+k], lb[(i+1)*T+k], lb[(i+2)*T+k], lb[(i+3)*T+k]);
+
+        for (k=0;k<n;k++)
+        {
+            fibe_px s1, s2, s3;
+
+            s1 = FIBE_STEP3(lb[(h-1)*T+k], lb[h*T+k], lb[(h+1)*T+k], lb[(h+2)*T+k]);
+            s2 = FIBE_STEP3(lb[(h-2)*T+k], s1, lb[h*T+k], lb[(h+1)*T+k]);
+            s3 = FIBE_STEP3(lb[(h-3)*T+k], s2, s1, lb[h*T+k]);
+            ST(j+k+(h-1)*w, s1);
+            ST(j+k+(h-2)*w, s2);
+            ST(j+k+(h-3)*w, s3);
+        }
+
+        for (i=h-4;i>=0;i--)		//gor
+            for (k=0;k<n;k++)
+                fibe_out(job->out, s, j+k+w*i,
+                         FIBE_STEP3(lb[i*T+k], LD(j+k+w*(i+1)), LD(j+k+w*(i+2)), LD(j+k+w*(i+3))),
+                         0, kind);
+    }	//po stolpcih
+
+    free(lb);
+}
+
+FIBE_PASSES(fibe3, 8, FIBE_8)
+FIBE_PASSES(fibe3, rgba, FIBE_RGBA)
+FIBE_PASSES(fibe3, f, FIBE_MASK)
+
+#undef ADD
+#undef SUB
+#undef MUL
+#undef DIV
+#undef SET1
+#undef LD
+#undef ST
+#undef IN
+
+//---------------------------------------------------------
+//the filters
+
+static inline void fibe1o_run(void* (*rows)(void*), void* (*columns)(void*), const uint32_t* in, uint32_t* out, void* s, int w, int h, float a, int ec)
+{
+    fibe_job par = {0};
+
+    par.in = in; par.out = out; par.s = s;
+    par.w = w; par.h = h;
+    par.a1 = a;
+    par.ec = ec;
+    fibe_run(rows, columns, &par);
+}
+
+static inline void fibe2o_run(void* (*rows)(void*), void* (*columns)(void*), const uint32_t* in, uint32_t* out, void* s, int w, int h, float a1, float a2, float rd1, float rd2, float rs1, float rs2, float rc1, float rc2, int ec)
+{
+    fibe_job par = {0};
+
+    par.in = in; par.out = out; par.s = s;
+    par.w = w; par.h = h;
+    par.a1 = a1; par.a2 = a2;
+    par.rd1 = rd1; par.rd2 = rd2;
+    par.rs1 = rs1; par.rs2 = rs2;
+    par.rc1 = rc1; par.rc2 = rc2;
+    par.ec = ec;
+    fibe_run(rows, columns, &par);
+}
+
+static inline void fibe3_run(void* (*rows)(void*), void* (*columns)(void*), const uint32_t* in, uint32_t* out, void* s, int w, int h, float a1, float a2, float a3, int ec)
+{
+    fibe_job par = {0};
+
+    par.in = in; par.out = out; par.s = s;
+    par.w = w; par.h = h;
+    par.a1 = a1; par.a2 = a2; par.a3 = a3;
+    par.ec = ec;
+    fibe_run(rows, columns, &par);
+}
+
+static inline void fibe1o_8(const uint32_t* inframe, uint32_t* outframe, fibe_rgba* s, int w, int h, float a, int ec)
+{
+    fibe1o_run(fibe1o_rows_8, fibe1o_columns_8, inframe, outframe, s, w, h, a, ec);
+}
+
+static inline void fibe1o_rgba(fibe_rgba* s, int w, int h, float a, int ec)
+{
+    fibe1o_run(fibe1o_rows_rgba, fibe1o_columns_rgba, NULL, NULL, s, w, h, a, ec);
+}
+
+static inline void fibe1o_f(float* s, int w, int h, float a, int ec)
+{
+    fibe1o_run(fibe1o_rows_f, fibe1o_columns_f, NULL, NULL, s, w, h, a, ec);
+}
+
+static inline void fibe2o_8(const uint32_t* inframe, uint32_t* outframe, fibe_rgba* s, int w, int h, float a1, float a2, float rd1, float rd2, float rs1, float rs2, float rc1, float rc2, int ec)
+{
+    fibe2o_run(fibe2o_rows_8, fibe2o_columns_8, inframe, outframe, s, w, h, a1, a2, rd1, rd2, rs1, rs2, rc1, rc2, ec);
+}
+
+static inline void fibe2o_rgba(fibe_rgba* s, int w, int h, float a1, float a2, float rd1, float rd2, float rs1, float rs2, float rc1, float rc2, int ec)
+{
+    fibe2o_run(fibe2o_rows_rgba, fibe2o_columns_rgba, NULL, NULL, s, w, h, a1, a2, rd1, rd2, rs1, rs2, rc1, rc2, ec);
+}
+
+static inline void fibe2o_f(float* s, int w, int h, float a1, float a2, float rd1, float rd2, float rs1, float rs2, float rc1, float rc2, int ec)
+{
+    fibe2o_run(fibe2o_rows_f, fibe2o_columns_f, NULL, NULL, s, w, h, a1, a2, rd1, rd2, rs1, rs2, rc1, rc2, ec);
+}
+
+static inline void fibe3_8(const uint32_t* inframe, uint32_t* outframe, fibe_rgba* s, int w, int h, float a1, float a2, float a3, int ec)
+{
+    fibe3_run(fibe3_rows_8, fibe3_columns_8, inframe, outframe, s, w, h, a1, a2, a3, ec);
+}
+
+static inline void fibe3_rgba(fibe_rgba* s, int w, int h, float a1, float a2, float a3, int ec)
+{
+    fibe3_run(fibe3_rows_rgba, fibe3_columns_rgba, NULL, NULL, s, w, h, a1, a2, a3, ec);
+}
+
+static inline void fibe3_f(float* s, int w, int h, float a1, float a2, float a3, int ec)
+{
+    fibe3_run(fibe3_rows_f, fibe3_columns_f, NULL, NULL, s, w, h, a1, a2, a3, ec);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef INCLUDED_FREI0R_GRADE_H
+#define INCLUDED_FREI0R_GRADE_H
+
+/*
+
+  The tables and matrices of the basic color corrections, shared by
+  brightness, contrast0r, saturat0r, gamma and tint0r and by basicgrade,
+  which runs all of them in one pass, so that it gives the same results
+  as the chain of the separate effects:
+
+  frei0r_grade_brightness_lut   lut of brightness in [-256, 256]
+  frei0r_grade_contrast_lut     lut of contrast in [-256, 256]
+  frei0r_grade_gamma_lut        lut of the gamma parameter in [0, 1],
+                                which is 1 / (gamma * FREI0R_GRADE_MAX_GAMMA)
+                                as the exponent
+  frei0r_grade_saturation       frei0r_colormatrix_t of the saturation
+                                parameter in [0, 1], which is scaled by
+                                FREI0R_GRADE_MAX_SATURATION
+  frei0r_grade_tint             frei0r_colormatrix_t that maps the luma of
+                                each pixel from black to white and mixes
+                                that in by amount
+
+  The tables are applied with frei0r_lut_rgb() and the matrices with
+  frei0r_colormatrix_apply(); frei0r_grade_lut_is_identity() tells
+  whether a table changes nothing.
+
+*/
+
+#include <stdint.h>
+#include <math.h>
+
+#include "frei0r.h"
+#include "frei0r_math.h"
+#include "frei0r_colormatrix.h"
+
+#define FREI0R_GRADE_MAX_GAMMA 4.0
+#define FREI0R_GRADE_MAX_SATURATION 8.0
+
+static inline void frei0r_grade_brightness_lut(uint8_t* lut, int brightness)
+{
+  int i;
+
+  if (brightness < 0)
+    for (i = 0; i < 256; ++i)
+      lut[i] = CLAMP0255((i * (256 + brightness)) >> 8);
+  else
+    for (i = 0; i < 256; ++i)
+      lut[i] = CLAMP0255(i + (((256 - i) * brightness) >> 8));
+}
+
+static inline void frei0r_grade_contrast_lut(uint8_t* lut, int contrast)
+{
+  int i;
+
+  for (i = 0; i < 128; ++i)
+    lut[i] = CLAMP0255(i - (((128 - i) * contrast) >> 8));
+  for (i = 128; i < 256; ++i)
+    lut[i] = CLAMP0255(i + (((i - 128) * contrast) >> 8));
+}
+
+static inline void frei0r_grade_gamma_lut(uint8_t* lut, double gamma)
+{
+  double inv_gamma = 1.0 / (gamma * FREI0R_GRADE_MAX_GAMMA);
+  int i;
+
+  lut[0] = 0;
+  for (i = 1; i < 256; ++i)
+    lut[i] = CLAMP0255(ROUND(255.0 * pow((double)i / 255.0, inv_gamma)));
+}
+
+static inline int frei0r_grade_lut_is_identity(const uint8_t* lut)
+{
+  int i;
+
+  for (i = 0; i < 256; ++i)
+    if (lut[i] != i)
+      return 0;
+  return 1;
+}
+
+/* Mixes each channel with the luma, weighted by the saturation. The luma
+ * weights are the 16 bit ones of the former integer code of saturat0r,
+ * in byte order. */
+static inline void frei0r_grade_saturation(frei0r_colormatrix_t* cm,
+                                           double saturation)
+{
+  static const float lum[3] = { 7471 / 65536.f, 38470 / 65536.f,
+                                19595 / 65536.f };
+  float s = (float)(CLAMP(saturation, 0, 1) * FREI0R_GRADE_MAX_SATURATION);
+  float mat[4][4] = { { 0 } };
+  int i, o;
+
+  for (i = 0; i < 3; ++i)
+    for (o = 0; o < 3; ++o)
+      mat[i][o] = lum[i] * (1 - s) + (i == o ? s : 0);
+  frei0r_colormatrix_set(cm, mat);
+}
+
+/* Each channel becomes (1 - amount) * itself plus amount times the luma
+ * mapped linearly from the channel of black to that of white. */
+static inline void frei0r_grade_tint(frei0r_colormatrix_t* cm,
+                                     const f0r_param_color_t* black,
+                                     const f0r_param_color_t* white,
+                                     double amount)
+{
+  static const float lum[3] = { .299f, .587f, .114f };
+  const float lo[3] = { black->r, black->g, black->b };
+  const float hi[3] = { white->r, white->g, white->b };
+  float a = (float)amount;
+  float mat[4][4] = { { 0 } };
+  int i, o;
+
+  for (o = 0; o < 3; ++o)
+    {
+      for (i = 0; i < 3; ++i)
+        mat[i][o] = a * lum[i] * (hi[o] - lo[o]) + (i == o ? 1 - a : 0);
+      mat[3][o] = 255 * a * lo[o];
+    }
+  frei0r_colormatrix_set(cm, mat);
+}
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef INCLUDED_FREI0R_HISTOGRAM_H
+#define INCLUDED_FREI0R_HISTOGRAM_H
+
+/*
+
+  Statistics of 8 bit per channel packed pixels for effects that adapt to
+  their input, like equaliz0r and normaliz0r:
+
+  frei0r_histogram_t hist;
+  frei0r_histogram(&hist, src, width, height, step);
+
+  counts the values of each of the three color bytes of the pixels in
+  hist.count[byte][value] (alpha isn't counted, none of the effects
+  needs it and it costs a quarter more), and
+
+  frei0r_minmax_t mm;
+  frei0r_minmax(&mm, src, width, height);
+
+  finds the smallest and largest value of each byte. Byte 0 is red in
+  RGBA8888, blue in BGRA8888.
+
+  Rows are split over threads (see frei0r_thread.h), each counts into
+  histograms of its own which are added up at the end. Within a thread,
+  even and odd pixels are counted in two histograms whose counters are
+  interleaved, so that in runs of equal values an increment doesn't wait
+  for the one before it, without taking more cache lines than a single
+  histogram. That is up to twice as fast in flat areas and no slower on
+  noise; four histograms are slower again.
+
+  A step above 1 only counts every step-th pixel of every step-th row,
+  for statistics that don't need every pixel; hist.pixels is the number
+  counted.
+
+  frei0r_histogram_map(&hist, dst, src, width, height, lut);
+
+  maps the color bytes of the pixels through per-byte lookup tables,
+  copying alpha, and counts the histogram of src in the same pass. An
+  effect that builds its tables from the statistics of the previous
+  frame reads each frame only once that way. With a null hist it only
+  maps.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_thread.h"
+
+typedef struct frei0r_histogram
+{
+  uint32_t count[3][256]; /* count[b][v]: pixels whose byte b is v */
+  uint32_t pixels;        /* pixels counted */
+} frei0r_histogram_t;
+
+typedef struct frei0r_minmax
+{
+  uint8_t min[4];
+  uint8_t max[4];
+} frei0r_minmax_t;
+
+typedef struct frei0r_histogram_job_
+{
+  const uint32_t* src;
+  uint32_t* dst;
+  const uint8_t (*lut)[256];
+  unsigned int width, y0, y1, step;
+  int count;
+  frei0r_histogram_t hist;
+  frei0r_minmax_t mm;
+} frei0r_histogram_job_t;
+
+static inline void* frei0r_histogram_rows_(void* arg)
+{
+  frei0r_histogram_job_t* job = (frei0r_histogram_job_t*)arg;
+  uint32_t sub[3][256][2];
+  const unsigned int step = job->step;
+  unsigned int x, y, b, v;
+  const uint32_t* p;
+  uint32_t c0, c1;
+
+  memset(sub, 0, sizeof(sub));
+  job->hist.pixels = 0;
+  /* the rows of the job that are multiples of step */
+  for (y = (job->y0 + step - 1) / step * step; y < job->y1; y += step)
+    {
+      p = job->src + (size_t)y * job->width;
+      for (x = 0; x + step < job->width; x += 2 * step)
+        {
+          c0 = p[x];
+          c1 = p[x + step];
+          sub[0][c0 & 0xff][0]++;
+          sub[0][c1 & 0xff][1]++;
+          sub[1][(c0 >> 8) & 0xff][0]++;
+          sub[1][(c1 >> 8) & 0xff][1]++;
+          sub[2][(c0 >> 16) & 0xff][0]++;
+          sub[2][(c1 >> 16) & 0xff][1]++;
+        }
+      if (x < job->width)
+        {
+          c0 = p[x];
+          sub[0][c0 & 0xff][0]++;
+          sub[1][(c0 >> 8) & 0xff][0]++;
+          sub[2][(c0 >> 16) & 0xff][0]++;
+        }
+      job->hist.pixels += (job->width + step - 1) / step;
+    }
+  for (b = 0; b < 3; ++b)
+    for (v = 0; v < 256; ++v)
+      job->hist.count[b][v] = sub[b][v][0] + sub[b][v][1];
+  return 0;
+}
+
+static inline void frei0r_histogram(frei0r_histogram_t* hist,
+                                    const uint32_t* src, unsigned int width,
+                                    unsigned int height, unsigned int step)
+{
+  frei0r_histogram_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n;
+  unsigned int b, v;
+
+  if (step < 1)
+    step = 1;
+  n = frei0r_thread_count((long)width * height / (step * step));
+  for (i = 0; i < n; ++i)
+    {
+      jobs[i].src = src;
+      jobs[i].width = width;
+      jobs[i].y0 = height * i / n;
+      jobs[i].y1 = height * (i + 1) / n;
+      jobs[i].step = step;
+    }
+  frei0r_thread_run(frei0r_histogram_rows_, jobs,
+                    sizeof(frei0r_histogram_job_t), n);
+
+  *hist = jobs[0].hist;
+  for (i = 1; i < n; ++i)
+    {
+      for (b = 0; b < 3; ++b)
+        for (v = 0; v < 256; ++v)
+          hist->count[b][v] += jobs[i].hist.count[b][v];
+      hist->pixels += jobs[i].hist.pixels;
+    }
+}
+
+static inline void* frei0r_histogram_map_rows_(void* arg)
+{
+  frei0r_histogram_job_t* job = (frei0r_histogram_job_t*)arg;
+  const uint8_t (*lut)[256] = job->lut;
+  const size_t begin = (size_t)job->y0 * job->width;
+  const size_t end = (size_t)job->y1 * job->width;
+  const uint32_t* src = job->src;
+  uint32_t* dst = job->dst;
+  uint32_t sub[3][256][2];
+  size_t i = begin;
+  unsigned int b, v;
+  uint32_t c0, c1;
+
+#define FREI0R_HISTOGRAM_MAP_(c) \
+  (lut[0][(c) & 0xff] | ((uint32_t)lut[1][((c) >> 8) & 0xff] << 8) \
+   | ((uint32_t)lut[2][((c) >> 16) & 0xff] << 16) | ((c) & 0xff000000))
+
+  if (job->count)
+    {
+      memset(sub, 0, sizeof(sub));
+      for (; i + 2 <= end; i += 2)
+        {
+          c0 = src[i];
+          c1 = src[i + 1];
+          sub[0][c0 & 0xff][0]++;
+          sub[0][c1 & 0xff][1]++;
+          sub[1][(c0 >> 8) & 0xff][0]++;
+          sub[1][(c1 >> 8) & 0xff][1]++;
+          sub[2][(c0 >> 16) & 0xff][0]++;
+          sub[2][(c1 >> 16) & 0xff][1]++;
+          dst[i] = FREI0R_HISTOGRAM_MAP_(c0);
+          dst[i + 1] = FREI0R_HISTOGRAM_MAP_(c1);
+        }
+      if (i < end)
+        {
+          c0 = src[i];
+          sub[0][c0 & 0xff][0]++;
+          sub[1][(c0 >> 8) & 0xff][0]++;
+          sub[2][(c0 >> 16) & 0xff][0]++;
+          dst[i] = FREI0R_HISTOGRAM_MAP_(c0);
+        }
+      for (b = 0; b < 3; ++b)
+        for (v = 0; v < 256; ++v)
+          job->hist.count[b][v] = sub[b][v][0] + sub[b][v][1];
+      job->hist.pixels = (uint32_t)(end - begin);
+    }
+  else
+    for (; i < end; ++i)
+      {
+        c0 = src[i];
+        dst[i] = FREI0R_HISTOGRAM_MAP_(c0);
+      }
+
+#undef FREI0R_HISTOGRAM_MAP_
+  return 0;
+}
+
+/* dst may be src */
+static inline void frei0r_histogram_map(frei0r_histogram_t* hist,
+                                        uint32_t* dst, const uint32_t* src,
+                                        unsigned int width,
+                                        unsigned int height,
+                                        const uint8_t lut[3][256])
+{
+  frei0r_histogram_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)width * height);
+  unsigned int b, v;
+
+  for (i = 0; i < n; ++i)
+    {
+      jobs[i].src = src;
+      jobs[i].dst = dst;
+      jobs[i].lut = lut;
+      jobs[i].width = width;
+      jobs[i].y0 = height * i / n;
+      jobs[i].y1 = height * (i + 1) / n;
+      jobs[i].count = hist != 0;
+    }
+  frei0r_thread_run(frei0r_histogram_map_rows_, jobs,
+                    sizeof(frei0r_histogram_job_t), n);
+
+  if (!hist)
+    return;
+  *hist = jobs[0].hist;
+  for (i = 1; i < n; ++i)
+    {
+      for (b = 0; b < 3; ++b)
+        for (v = 0; v < 256; ++v)
+          hist->count[b][v] += jobs[i].hist.count[b][v];
+      hist->pixels += jobs[i].hist.pixels;
+    }
+}
+
+static inline void* frei0r_minmax_rows_(void* arg)
+{
+  frei0r_histogram_job_t* job = (frei0r_histogram_job_t*)arg;
+  const uint8_t* p = (const uint8_t*)(job->src + (size_t)job->y0 * job->width);
+  size_t n = (size_t)(job->y1 - job->y0) * job->width, i = 0;
+  uint8_t lo[16], hi[16];
+  int b, k;
+
+  memset(lo, 255, sizeof(lo));
+  memset(hi, 0, sizeof(hi));
+#if defined(__SSE2__)
+  {
+    __m128i vlo = _mm_set1_epi8((char)255), vhi = _mm_setzero_si128(), v;
+
+    for (; i + 4 <= n; i += 4)
+      {
+        v = _mm_loadu_si128((const __m128i*)(p + 4 * i));
+        vlo = _mm_min_epu8(vlo, v);
+        vhi = _mm_max_epu8(vhi, v);
+      }
+    _mm_storeu_si128((__m128i*)lo, vlo);
+    _mm_storeu_si128((__m128i*)hi, vhi);
+  }
+#endif
+  for (; i < n; ++i)
+    for (b = 0; b < 4; ++b)
+      {
+        if (p[4 * i + b] < lo[b]) lo[b] = p[4 * i + b];
+        if (p[4 * i + b] > hi[b]) hi[b] = p[4 * i + b];
+      }
+  for (b = 0; b < 4; ++b)
+    {
+      job->mm.min[b] = lo[b];
+      job->mm.max[b] = hi[b];
+      for (k = 1; k < 4; ++k)
+        {
+          if (lo[4 * k + b] < job->mm.min[b]) job->mm.min[b] = lo[4 * k + b];
+          if (hi[4 * k + b] > job->mm.max[b]) job->mm.max[b] = hi[4 * k + b];
+        }
+    }
+  return 0;
+}
+
+static inline void frei0r_minmax(frei0r_minmax_t* mm, const uint32_t* src,
+                                 unsigned int width, unsigned int height)
+{
+  frei0r_histogram_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)width * height), b;
+
+  for (i = 0; i < n; ++i)
+    {
+      jobs[i].src = src;
+      jobs[i].width = width;
+      jobs[i].y0 = height * i / n;
+      jobs[i].y1 = height * (i + 1) / n;
+    }
+  frei0r_thread_run(frei0r_minmax_rows_, jobs,
+                    sizeof(frei0r_histogram_job_t), n);
+
+  *mm = jobs[0].mm;
+  for (i = 1; i < n; ++i)
+    for (b = 0; b < 4; ++b)
+      {
+        if (jobs[i].mm.min[b] < mm->min[b]) mm->min[b] = jobs[i].mm.min[b];
+        if (jobs[i].mm.max[b] > mm->max[b]) mm->max[b] = jobs[i].mm.max[b];
+      }
+}
+
+#endif
@@ -1,7 +1,13 @@
-//interp.c
+#ifndef INCLUDED_FREI0R_INTERP_H
+#define INCLUDED_FREI0R_INTERP_H
+
 /*
+ * Interpolators and the plain remapping functions of the Frei0r
+ * plugins "c0rners" and "defish0r". Remapping many frames with the same
+ * map is faster with frei0r_remap.h, which uses these for the kernels it
+ * has no vector version of.
+ *
  * Copyright (C) 2010 Marko Cebokli   http://lea.hamradio.si/~s57uuu
- * This file is a part of the Frei0r plugin "defish0r"
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -56,7 +62,7 @@ typedef int (*interpp)(unsigned char*, int, int, float, float, unsigned char*);
 //  map = za vsak pixel izs pove, kje ga vzamemo is vhs
 //  bgc = background color
 //  interp = kazalec na interpolacijsko funkcijo
-void remap(int wi, int hi, int wo, int ho, unsigned char *vhs, unsigned char *izs, float *map, unsigned char bgc, interpp interp)
+static inline void remap(int wi, int hi, int wo, int ho, unsigned char *vhs, unsigned char *izs, float *map, unsigned char bgc, interpp interp)
 {
 	int i,j;
 	float x,y;
@@ -82,7 +88,7 @@ void remap(int wi, int hi, int wo, int ho, unsigned char *vhs, unsigned char *iz
 //  map = za vsak pixel izs pove, kje ga vzamemo is vhs
 //  bgc = background color
 //  interp = kazalec na interpolacijsko funkcijo
-void remap32(int wi, int hi, int wo, int ho, unsigned char *vhs, unsigned char *izs, float *map, uint32_t bgc, interpp interp)
+static inline void remap32(int wi, int hi, int wo, int ho, unsigned char *vhs, unsigned char *izs, float *map, uint32_t bgc, interpp interp)
 {
 	int i,j;
 	float x,y;
@@ -121,7 +127,7 @@ __inline const float roundf(float x){
 //	w,h dimenzija slike je wxh
 //	x,y tocka, za katero izracuna interpolirano vrednost
 //	*v interpolirana vrednost
-int interpNNpr_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+static inline int interpNNpr_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
 {
 	//printf("u=%5.2f v=%5.2f   ",x,y);
 	printf("u=%5.3f v=%5.3f     ",x/(w-1),y/(h-1));
@@ -136,166 +142,63 @@ int interpNNpr_b(unsigned char *sl, int w, int h, float x, float y, unsigned cha
 }
 
 //------------------------------------------------------
-//interpolacija "najblizji sosed" (ni prava interpolacija)
-//za byte (char) vrednosti
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-int interpNN_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	*v=sl[(int)roundf(x)+(int)roundf(y)*w];
-	return 0;
-}
+//Each interpolator is written once for nc interleaved channels
+//(1 for the _b, 4 for the _b32 variant). nc is a constant in the
+//wrappers, so the compiler unrolls the channel loop of each of them,
+//and inlines them wherever they are called directly instead of
+//through an interpp, as frei0r_remap.h does.
 
 //------------------------------------------------------
 //interpolacija "najblizji sosed" (ni prava interpolacija)
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
-//little endian !!
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-int interpNN_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-	//int index = (int)(x+0.5f)*4+(int)(y+0.5f)*4*w; //fast rounding
-	int index = (int)roundf(x)*4+(int)roundf(y)*4*w; //call once
-
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	v[0]=sl[index];
-	v[1]=sl[index+1];
-	v[2]=sl[index+2];
-	v[3]=sl[index+3];
-
-	return 0;
-}
-
-//------------------------------------------------------
-//bilinearna interpolacija
-//za byte (char) vrednosti
 //	*sl vhodni array (slika)
 //	w,h dimenzija slike je wxh
 //	x,y tocka, za katero izracuna interpolirano vrednost
 //	*v interpolirana vrednost
-int interpBL_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+//	nc stevilo kanalov
+static inline int interpNN_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
-	int m,n,k,l;
-	float a,b;
+	int b;
+	int index = nc*((int)roundf(x)+(int)roundf(y)*w); //call once
 
 #ifdef TEST_XY_LIMITS
 	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
 #endif
+	(void)h;
 
-	m=(int)floorf(x); n=(int)floorf(y);
-	k=n*w+m; l=(n+1)*w+m;
-	a=sl[k]+(sl[k+1]-sl[k])*(x-(float)m);
-	b=sl[l]+(sl[l+1]-sl[l])*(x-(float)m);
-	*v=a+(b-a)*(y-(float)n);
+	for (b=0;b<nc;b++)
+		v[b]=sl[index+b];
 	return 0;
 }
 
 //------------------------------------------------------
 //bilinearna interpolacija
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
-int interpBL_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+static inline int interpBL_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
-	int m,n,k,l,n1,l1,k1;
-	float a,b;
+	int b,m,n,k,l,k1,l1;
+	float a,c;
 
 #ifdef TEST_XY_LIMITS
 	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
 #endif
+	(void)h;
 
 	m=(int)floorf(x); n=(int)floorf(y);
-	k=n*w+m; l=(n+1)*w+m;
-	k1=4*(k+1); l1=4*(l+1); n1=4*((n+1)*w+m);
-	l=4*l; k=4*k;
-
-	a=sl[k]+(sl[k1]-sl[k])*(x-(float)m);
-	b=sl[l]+(sl[l1]-sl[n1])*(x-(float)m);
-	v[0]=a+(b-a)*(y-(float)n);
-
-	a=sl[k+1]+(sl[k1+1]-sl[k+1])*(x-(float)m);
-	b=sl[l+1]+(sl[l1+1]-sl[n1+1])*(x-(float)m);
-	v[1]=a+(b-a)*(y-(float)n);
-
-	a=sl[k+2]+(sl[k1+2]-sl[k+2])*(x-(float)m);
-	b=sl[l+2]+(sl[l1+2]-sl[n1+2])*(x-(float)m);
-	v[2]=a+(b-a)*(y-(float)n);
+	k=nc*(n*w+m); l=nc*((n+1)*w+m);
+	k1=k+nc; l1=l+nc;
 
-	a=sl[k+3]+(sl[k1+3]-sl[k+3])*(x-(float)m);
-	b=sl[l+3]+(sl[l1+3]-sl[n1+3])*(x-(float)m);
-	v[3]=a+(b-a)*(y-(float)n);
-
-
-	return 0;
-}
-
-//------------------------------------------------------
-//bikubicna interpolacija  "smooth"
-//za byte (char) vrednosti
-//kar Aitken-Neville formula iz Bronstajna
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-int interpBC_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-	int i,j,l,m,n;
-	float k;
-	float p[4],p1[4],p2[4],p3[4],p4[4];
-
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	m=(int)ceilf(x)-2; if (m<0) m=0; if ((m+5)>w) m=w-4;
-	n=(int)ceilf(y)-2; if (n<0) n=0; if ((n+5)>h) n=h-4;
-
-	//njaprej po y  (stiri stolpce)
-	for (i=0;i<4;i++)
+	for (b=0;b<nc;b++)
 	{
-		l=m+(i+n)*w;
-		p1[i]=sl[l];
-		p2[i]=sl[l+1];
-		p3[i]=sl[l+2];
-		p4[i]=sl[l+3];
+		a=sl[k+b]+(sl[k1+b]-sl[k+b])*(x-(float)m);
+		c=sl[l+b]+(sl[l1+b]-sl[l+b])*(x-(float)m);
+		v[b]=a+(c-a)*(y-(float)n);
 	}
-	for (j=1;j<4;j++)
-		for (i=3;i>=j;i--)
-		{
-		k=(y-i-n)/j;
-		p1[i]=p1[i]+k*(p1[i]-p1[i-1]);
-		p2[i]=p2[i]+k*(p2[i]-p2[i-1]);
-		p3[i]=p3[i]+k*(p3[i]-p3[i-1]);
-		p4[i]=p4[i]+k*(p4[i]-p4[i-1]);
-	}
-
-	//zdaj pa po x
-	p[0]=p1[3]; p[1]=p2[3]; p[2]=p3[3]; p[3]=p4[3];
-	for (j=1;j<4;j++)
-		for (i=3;i>=j;i--)
-			p[i]=p[i]+(x-i-m)/j*(p[i]-p[i-1]);
-
-	if (p[3]<0.0) p[3]=0.0;			//printf("p=%f ",p[3]);
-	if (p[3]>256.0) p[3]=255.0;		//printf("p=%f ",p[3]);
-
-	*v=p[3];
-
 	return 0;
 }
 
 //------------------------------------------------------
 //bikubicna interpolacija  "smooth"
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
-int interpBC_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+//kar Aitken-Neville formula iz Bronstajna
+static inline int interpBC_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
 	int i,j,b,l,m,n;
 	float k;
@@ -308,17 +211,16 @@ int interpBC_b32(unsigned char *sl, int w, int h, float x, float y, unsigned cha
 	m=(int)ceilf(x)-2; if (m<0) m=0; if ((m+5)>w) m=w-4;
 	n=(int)ceilf(y)-2; if (n<0) n=0; if ((n+5)>h) n=h-4;
 
-
-	for (b=0;b<4;b++)
+	for (b=0;b<nc;b++)
 	{
 		//njaprej po y  (stiri stolpce)
 		for (i=0;i<4;i++)
 		{
 			l=m+(i+n)*w;
-			p1[i]=sl[4*l+b];
-			p2[i]=sl[4*(l+1)+b];
-			p3[i]=sl[4*(l+2)+b];
-			p4[i]=sl[4*(l+3)+b];
+			p1[i]=sl[nc*l+b];
+			p2[i]=sl[nc*(l+1)+b];
+			p3[i]=sl[nc*(l+2)+b];
+			p4[i]=sl[nc*(l+3)+b];
 		}
 		for (j=1;j<4;j++)
 			for (i=3;i>=j;i--)
@@ -347,67 +249,10 @@ int interpBC_b32(unsigned char *sl, int w, int h, float x, float y, unsigned cha
 
 //------------------------------------------------------
 //bikubicna interpolacija  "sharp"
-//za byte (char) vrednosti
 //Helmut Dersch polinom
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-//!!! ODKOD SUM???  (ze po eni rotaciji v interp_test !!)
-//!!! v defish tega suma ni???
-int interpBC2_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-	int i,k,l,m,n;
-	float pp,p[4],wx[4],wy[4],xx;
-
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	m=(int)ceilf(x)-2; if (m<0) m=0; if ((m+5)>w) m=w-4;
-	n=(int)ceilf(y)-2; if (n<0) n=0; if ((n+5)>h) n=h-4;
-
-
-	//najprej po y (stiri stolpce)
-	xx=y-n;    wy[0]=(-0.75*(xx-5.0)*xx-6.0)*xx+3.0;
-	xx=xx-1.0; wy[1]=(1.25*xx-2.25)*xx*xx+1.0;
-	xx=1.0-xx; wy[2]=(1.25*xx-2.25)*xx*xx+1.0;
-	xx=xx+1.0; wy[3]=(-0.75*(xx-5.0)*xx-6.0)*xx+3.0;
-	//se po x
-	xx=x-m;    wx[0]=(-0.75*(xx-5.0)*xx-6.0)*xx+3.0;
-	xx=xx-1.0; wx[1]=(1.25*xx-2.25)*xx*xx+1.0;
-	xx=1.0-xx; wx[2]=(1.25*xx-2.25)*xx*xx+1.0;
-	xx=xx+1.0; wx[3]=(-0.75*(xx-5.0)*xx-6.0)*xx+3.0;
-
-	k=n*w+m;
-	for (i=0;i<4;i++)
-	{
-		p[i]=0.0;
-		l=k+i;
-		p[i]=wy[0]*sl[l]; l+=w;
-		p[i]+=wy[1]*sl[l]; l+=w;
-		p[i]+=wy[2]*sl[l]; l+=w;
-		p[i]+=wy[3]*sl[l];
-	}
-
-	pp=wx[0]*p[0];
-	pp+=wx[1]*p[1];
-	pp+=wx[2]*p[2];
-	pp+=wx[3]*p[3];
-
-	if (pp<0.0) pp=0.0;
-	if (pp>256.0) pp=255.0;
-
-	*v=pp;
-	return 0;
-}
-
-//------------------------------------------------------
-//bikubicna interpolacija  "sharp"
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
 //!!! ODKOD SUM???  (ze po eni rotaciji v interp_test !!)
 //!!! v defish tega suma ni???
-int interpBC2_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+static inline int interpBC2_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
 	int b,i,k,l,m,n,u;
 	float pp,p[4],wx[4],wy[4],xx;
@@ -430,13 +275,12 @@ int interpBC2_b32(unsigned char *sl, int w, int h, float x, float y, unsigned ch
 	xx=1.0-xx; wx[2]=(1.25*xx-2.25)*xx*xx+1.0;
 	xx=xx+1.0; wx[3]=(-0.75*(xx-5.0)*xx-6.0)*xx+3.0;
 
-	k=4*(n*w+m); u=4*w;
-	for (b=0;b<4;b++)
+	k=nc*(n*w+m); u=nc*w;
+	for (b=0;b<nc;b++)
 	{
 		for (i=0;i<4;i++)
 		{
-			p[i]=0.0;
-			l=k+4*i;
+			l=k+nc*i;
 			p[i]=wy[0]*sl[l]; l+=u;
 			p[i]+=wy[1]*sl[l]; l+=u;
 			p[i]+=wy[2]*sl[l]; l+=u;
@@ -460,59 +304,8 @@ int interpBC2_b32(unsigned char *sl, int w, int h, float x, float y, unsigned ch
 
 //------------------------------------------------------
 //spline 4x4 interpolacija
-//za byte (char) vrednosti
 //Helmut Dersch polinom
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-int interpSP4_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-	int i,j,m,n;
-	float pp,p[4],wx[4],wy[4],xx;
-
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	m=(int)ceilf(x)-2; if (m<0) m=0; if ((m+5)>w) m=w-4;
-	n=(int)ceilf(y)-2; if (n<0) n=0; if ((n+5)>h) n=h-4;
-
-	//najprej po y (stiri stolpce)
-	xx=y-n;    wy[0]=((-0.333333*(xx-1.0)+0.8)*(xx-1.0)-0.466667)*(xx-1.0);
-	xx=xx-1.0; wy[1]=((xx-1.8)*xx-0.2)*xx+1.0;
-	xx=1.0-xx; wy[2]=((xx-1.8)*xx-0.2)*xx+1.0;
-	xx=xx+1.0; wy[3]=((-0.333333*(xx-1.0)+0.8)*(xx-1.0)-0.466667)*(xx-1.0);
-	//se po x
-	xx=x-m;    wx[0]=((-0.333333*(xx-1.0)+0.8)*(xx-1.0)-0.466667)*(xx-1.0);
-	xx=xx-1.0; wx[1]=((xx-1.8)*xx-0.2)*xx+1.0;
-	xx=1.0-xx; wx[2]=((xx-1.8)*xx-0.2)*xx+1.0;
-	xx=xx+1.0; wx[3]=((-0.333333*(xx-1.0)+0.8)*(xx-1.0)-0.466667)*(xx-1.0);
-
-	for (i=0;i<4;i++)
-	{
-		p[i]=0.0;
-		for (j=0;j<4;j++)
-		{
-			p[i]=p[i]+wy[j]*sl[(j+n)*w+i+m];
-		}
-	}
-
-	pp=0.0;
-	for (i=0;i<4;i++)
-		pp=pp+wx[i]*p[i];
-
-	if (pp<0.0) pp=0.0;
-	if (pp>256.0) pp=255.0;
-
-	*v=pp;
-	return 0;
-}
-
-//------------------------------------------------------
-//spline 4x4 interpolacija
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
-int interpSP4_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+static inline int interpSP4_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
 	int i,j,m,n,b;
 	float pp,p[4],wx[4],wy[4],xx;
@@ -535,14 +328,14 @@ int interpSP4_b32(unsigned char *sl, int w, int h, float x, float y, unsigned ch
 	xx=1.0-xx; wx[2]=((xx-1.8)*xx-0.2)*xx+1.0;
 	xx=xx+1.0; wx[3]=((-0.333333*(xx-1.0)+0.8)*(xx-1.0)-0.466667)*(xx-1.0);
 
-	for (b=0;b<4;b++)
+	for (b=0;b<nc;b++)
 	{
 		for (i=0;i<4;i++)
 		{
 			p[i]=0.0;
 			for (j=0;j<4;j++)
 			{
-				p[i]=p[i]+wy[j]*sl[4*((j+n)*w+i+m)+b];
+				p[i]=p[i]+wy[j]*sl[nc*((j+n)*w+i+m)+b];
 			}
 		}
 
@@ -561,81 +354,10 @@ int interpSP4_b32(unsigned char *sl, int w, int h, float x, float y, unsigned ch
 
 //------------------------------------------------------
 //spline 6x6 interpolacija
-//za byte (char) vrednosti
 //Helmut Dersch polinom
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-//!!! PAZI, TOLE NE DELA CISTO PRAV ???   belina se siri
-//!!! zaenkrat sem dodal fudge factor...
-int interpSP6_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-	int i,j,m,n;
-	float pp,p[6],wx[6],wy[6],xx;
-
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	m=(int)ceilf(x)-3; if (m<0) m=0; if ((m+7)>w) m=w-6;
-	n=(int)ceilf(y)-3; if (n<0) n=0; if ((n+7)>h) n=h-6;
-
-	//najprej po y (sest stolpcev)
-	xx=y-n;
-	wy[0]=((0.090909*(xx-2.0)-0.215311)*(xx-2.0)+0.124402)*(xx-2.0);
-	xx=xx-1.0;
-	wy[1]=((-0.545455*(xx-1.0)+1.291866)*(xx-1.0)-0.746411)*(xx-1.0);
-	xx=xx-1.0;
-	wy[2]=((1.181818*xx-2.167464)*xx+0.014354)*xx+1.0;
-	xx=1.0-xx;
-	wy[3]=((1.181818*xx-2.167464)*xx+0.014354)*xx+1.0;
-	xx=xx+1.0;
-	wy[4]=((-0.545455*(xx-1.0)+1.291866)*(xx-1.0)-0.746411)*(xx-1.0);
-	xx=xx+1.0;
-	wy[5]=((0.090909*(xx-2.0)-0.215311)*(xx-2.0)+0.124402)*(xx-2.0);
-	//se po x
-	xx=x-m;
-	wx[0]=((0.090909*(xx-2.0)-0.215311)*(xx-2.0)+0.124402)*(xx-2.0);
-	xx=xx-1.0;
-	wx[1]=((-0.545455*(xx-1.0)+1.291866)*(xx-1.0)-0.746411)*(xx-1.0);
-	xx=xx-1.0;
-	wx[2]=((1.181818*xx-2.167464)*xx+0.014354)*xx+1.0;
-	xx=1.0-xx;
-	wx[3]=((1.181818*xx-2.167464)*xx+0.014354)*xx+1.0;
-	xx=xx+1.0;
-	wx[4]=((-0.545455*(xx-1.0)+1.291866)*(xx-1.0)-0.746411)*(xx-1.0);
-	xx=xx+1.0;
-	wx[5]=((0.090909*(xx-2.0)-0.215311)*(xx-2.0)+0.124402)*(xx-2.0);
-
-
-	for (i=0;i<6;i++)
-	{
-		p[i]=0.0;
-		for (j=0;j<6;j++)
-		{
-			p[i]=p[i]+wy[j]*sl[(j+n)*w+i+m];
-		}
-	}
-
-	pp=0.0;
-	for (i=0;i<6;i++)
-		pp=pp+wx[i]*p[i];
-
-	pp=0.947*pp;	//fudge factor...!!!    cca 0.947...
-	if (pp<0.0) pp=0.0;
-	if (pp>256.0) pp=255.0;
-
-	*v=pp;
-	return 0;
-}
-
-//------------------------------------------------------
-//spline 6x6 interpolacija
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
 //!!! PAZI, TOLE NE DELA CISTO PRAV ???   belina se siri
 //!!! zaenkrat sem dodal fudge factor...
-int interpSP6_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+static inline int interpSP6_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
 	int i,b,j,m,n;
 	float pp,p[6],wx[6],wy[6],xx;
@@ -675,14 +397,14 @@ int interpSP6_b32(unsigned char *sl, int w, int h, float x, float y, unsigned ch
 	wx[5]=((0.090909*(xx-2.0)-0.215311)*(xx-2.0)+0.124402)*(xx-2.0);
 
 
-	for (b=0;b<4;b++)
+	for (b=0;b<nc;b++)
 	{
 		for (i=0;i<6;i++)
 		{
 			p[i]=0.0;
 			for (j=0;j<6;j++)
 			{
-				p[i]=p[i]+wy[j]*sl[4*((j+n)*w+i+m)+b];
+				p[i]=p[i]+wy[j]*sl[nc*((j+n)*w+i+m)+b];
 			}
 		}
 
@@ -702,71 +424,7 @@ int interpSP6_b32(unsigned char *sl, int w, int h, float x, float y, unsigned ch
 
 //------------------------------------------------------
 //truncated sinc "lanczos" 16x16 interpolacija
-//za byte (char) vrednosti
-//	*sl vhodni array (slika)
-//	w,h dimenzija slike je wxh
-//	x,y tocka, za katero izracuna interpolirano vrednost
-//	*v interpolirana vrednost
-int interpSC16_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
-{
-	int i,j,m,n;
-	float pp,p[16],wx[16],wy[16],xx,xxx,x1;
-	float PI=3.141592654;
-
-#ifdef TEST_XY_LIMITS
-	if ((x<0)||(x>w)||(y<0)||(y>h)) return -1;
-#endif
-
-	m=(int)ceilf(x)-8; if (m<0) m=0; if ((m+17)>w) m=w-16;
-	n=(int)ceilf(y)-8; if (n<0) n=0; if ((n+17)>h) n=h-16;
-
-	//najprej po y
-	xx=y-n;
-	for (i=7;i>=0;i--)
-	{
-		x1=xx*PI;
-		wy[7-i]=(x1!=0)?(sin(x1)/(x1))*(sin(x1*0.125)/(x1*0.125)):1.0;
-		xxx=(float)(2*i+1)-xx;
-		x1=xxx*PI;
-		wy[8+i]=(x1!=0)?(sin(x1)/(x1))*(sin(x1*0.125)/(x1*0.125)):1.0;
-		xx=xx-1.0;
-	}
-	//se po x
-	xx=x-m;
-	for (i=7;i>=0;i--)
-	{
-		x1=xx*PI;
-		wx[7-i]=(x1!=0)?(sin(x1)/(x1))*(sin(x1*0.125)/(x1*0.125)):1.0;
-		xxx=(float)(2*i+1)-xx;
-		x1=xxx*PI;
-		wx[8+i]=(x1!=0)?(sin(x1)/(x1))*(sin(x1*0.125)/(x1*0.125)):1.0;
-		xx=xx-1.0;
-	}
-
-	for (i=0;i<16;i++)
-	{
-		p[i]=0.0;
-		for (j=0;j<16;j++)
-		{
-			p[i]=p[i]+wy[j]*sl[(j+n)*w+i+m];
-		}
-	}
-
-	pp=0.0;
-	for (i=0;i<16;i++)
-		pp=pp+wx[i]*p[i];
-
-	if (pp<0.0) pp=0.0;
-	if (pp>256.0) pp=255.0;
-
-	*v=pp;
-	return 0;
-}
-
-//------------------------------------------------------
-//truncated sinc "lanczos" 16x16 interpolacija
-//za byte (char) vrednosti  v packed color 32 bitnem formatu
-int interpSC16_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v)
+static inline int interpSC16_n(unsigned char *sl, int w, int h, float x, float y, unsigned char *v, const int nc)
 {
 	int i,j,m,b,n;
 	float pp,p[16],wx[16],wy[16],xx,xxx,x1;
@@ -802,14 +460,14 @@ int interpSC16_b32(unsigned char *sl, int w, int h, float x, float y, unsigned c
 		xx=xx-1.0;
 	}
 
-	for (b=0;b<4;b++)
+	for (b=0;b<nc;b++)
 	{
 		for (i=0;i<16;i++)
 		{
 			p[i]=0.0;
 			for (j=0;j<16;j++)
 			{
-				p[i]=p[i]+wy[j]*sl[4*((j+n)*w+i+m)+b];
+				p[i]=p[i]+wy[j]*sl[nc*((j+n)*w+i+m)+b];
 			}
 		}
 
@@ -825,3 +483,26 @@ int interpSC16_b32(unsigned char *sl, int w, int h, float x, float y, unsigned c
 
 	return 0;
 }
+
+//------------------------------------------------------
+//the interpolators for byte (char) values (_b) and for
+//byte values in packed 32 bit color, little endian (_b32)
+//	*sl vhodni array (slika)
+//	w,h dimenzija slike je wxh
+//	x,y tocka, za katero izracuna interpolirano vrednost
+//	*v interpolirana vrednost
+#define FREI0R_INTERP_VARIANTS(name) \
+static inline int name##_b(unsigned char *sl, int w, int h, float x, float y, unsigned char *v) \
+{ return name##_n(sl, w, h, x, y, v, 1); } \
+static inline int name##_b32(unsigned char *sl, int w, int h, float x, float y, unsigned char *v) \
+{ return name##_n(sl, w, h, x, y, v, 4); }
+
+FREI0R_INTERP_VARIANTS(interpNN)
+FREI0R_INTERP_VARIANTS(interpBL)
+FREI0R_INTERP_VARIANTS(interpBC)
+FREI0R_INTERP_VARIANTS(interpBC2)
+FREI0R_INTERP_VARIANTS(interpSP4)
+FREI0R_INTERP_VARIANTS(interpSP6)
+FREI0R_INTERP_VARIANTS(interpSC16)
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef INCLUDED_FREI0R_KEY_H
+#define INCLUDED_FREI0R_KEY_H
+
+/*
+
+  Kernels for color keyers on 8 bit RGBA8888 pixels, red in the lowest
+  byte of each uint32_t as on little endian machines:
+
+  frei0r_key_alpha_row   alpha from the squared distance d of the color
+                         to the key color: 0 up to transparent, 255 from
+                         opaque on, 256 * (d - transparent) / width
+                         between, truncated to 8 bits; optionally
+                         inverted, and with spill suppression of the
+                         colors in the same pass
+  frei0r_key_spill_row   spill suppression alone: green or blue is
+                         limited by the other one
+  frei0r_key_gray_row    the Euclidean distance to a key color, scaled
+                         and rounded, as gray; alpha is kept
+
+  Each works on a run of n pixels, so that plugins can call them per row
+  from f0r_update_slice(); dst may be the same buffer as src.
+
+  With SSE2 four pixels are done per step. The ramp is divided in double
+  like blur.h does: (x + 0.5) * (1 / width) truncates to the integer
+  quotient of x / width. The scalar loop for the remaining pixels and
+  other architectures gives the same results.
+
+*/
+
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FREI0R_KEY_SPILL_NONE 0
+#define FREI0R_KEY_SPILL_GREEN 1 /* green limited by blue */
+#define FREI0R_KEY_SPILL_BLUE 2  /* blue limited by green */
+
+typedef struct frei0r_key
+{
+  int r, g, b;          /* the key color */
+  uint32_t transparent; /* up to this squared distance alpha is 0 */
+  uint32_t opaque;      /* from this squared distance on alpha is 255 */
+  uint32_t width;       /* of the ramp between, see above */
+  int invert;           /* alpha is 255 - alpha */
+  int spill;            /* FREI0R_KEY_SPILL_ */
+} frei0r_key_t;
+
+static inline uint32_t frei0r_key_spill_px_(uint32_t p, int spill)
+{
+  uint32_t g = (p >> 8) & 0xff, b = (p >> 16) & 0xff;
+
+  if (spill == FREI0R_KEY_SPILL_GREEN && g > b)
+    return (p & 0xffff00ff) | (b << 8);
+  if (spill == FREI0R_KEY_SPILL_BLUE && b > g)
+    return (p & 0xff00ffff) | (g << 16);
+  return p;
+}
+
+static inline uint32_t frei0r_key_alpha_px_(const frei0r_key_t* key,
+                                            uint32_t p)
+{
+  int t;
+  uint32_t d = 0;
+  unsigned char a = 255;
+
+  t = (int)(p & 0xff) - key->r;
+  d += t * t;
+  t = (int)((p >> 8) & 0xff) - key->g;
+  d += t * t;
+  t = (int)((p >> 16) & 0xff) - key->b;
+  d += t * t;
+  if (d < key->opaque)
+    {
+      a = 0;
+      if (d > key->transparent)
+        a = 256 * (d - key->transparent) / key->width;
+    }
+  if (key->invert)
+    a = 255 - a;
+  return (frei0r_key_spill_px_(p, key->spill) & 0x00ffffff)
+    | ((uint32_t)a << 24);
+}
+
+static inline uint32_t frei0r_key_gray_px_(float r, float g, float b,
+                                           double scale, uint32_t p)
+{
+  float dr = r - (float)(p & 0xff);
+  float dg = g - (float)((p >> 8) & 0xff);
+  float db = b - (float)((p >> 16) & 0xff);
+  uint32_t l = (uint8_t)(int)rint(sqrtf(dr * dr + dg * dg + db * db) * scale);
+
+  return (p & 0xff000000) | (l << 16) | (l << 8) | l;
+}
+
+#if defined(__SSE2__)
+
+static inline __m128i frei0r_key_spill_4px_(__m128i p, int spill)
+{
+  if (spill == FREI0R_KEY_SPILL_GREEN)
+    return _mm_min_epu8(p, _mm_or_si128(_mm_srli_epi32(p, 8),
+                                        _mm_set1_epi32((int)0xffff00ff)));
+  if (spill == FREI0R_KEY_SPILL_BLUE)
+    return _mm_min_epu8(p, _mm_or_si128(_mm_slli_epi32(p, 8),
+                                        _mm_set1_epi32((int)0xff00ffff)));
+  return p;
+}
+
+/* the squared distances of two pixels in 16 bit lanes, in lanes 0 and 2 */
+static inline __m128i frei0r_key_distance_2px_(__m128i p, __m128i key)
+{
+  __m128i d = _mm_sub_epi16(p, key);
+  d = _mm_and_si128(d, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1));
+  d = _mm_madd_epi16(d, d);
+  return _mm_add_epi32(d, _mm_srli_epi64(d, 32));
+}
+
+/* the ramp of x in lanes 0 and 1 */
+static inline __m128i frei0r_key_ramp_2px_(__m128i x, __m128d inv)
+{
+  __m128d v = _mm_add_pd(_mm_cvtepi32_pd(x), _mm_set1_pd(0.5));
+  return _mm_cvttpd_epi32(_mm_mul_pd(v, inv));
+}
+
+#endif
+
+static inline void frei0r_key_alpha_row(const frei0r_key_t* key,
+                                        uint32_t* dst, const uint32_t* src,
+                                        unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  /* the vector code needs the differences in 16 bits, the distances in 31 */
+  if (key->r >= 0 && key->r <= 255 && key->g >= 0 && key->g <= 255
+      && key->b >= 0 && key->b <= 255 && key->width > 0
+      && key->transparent < 0x7fffffff && key->opaque < 0x7fffffff)
+    {
+      const __m128i z = _mm_setzero_si128();
+      const __m128i k = _mm_set_epi16(0, key->b, key->g, key->r,
+                                      0, key->b, key->g, key->r);
+      const __m128i lo = _mm_set1_epi32((int)key->transparent);
+      const __m128i hi = _mm_set1_epi32((int)key->opaque);
+      const __m128i c255 = _mm_set1_epi32(255);
+      const __m128i inv = _mm_set1_epi32(key->invert ? 255 : 0);
+      const __m128d rw = _mm_set1_pd(1.0 / key->width);
+      __m128i p, d, x, a, in_ramp, below;
+
+      for (; i + 4 <= n; i += 4)
+        {
+          p = _mm_loadu_si128((const __m128i*)(src + i));
+          d = _mm_unpacklo_epi64(
+                _mm_shuffle_epi32(
+                  frei0r_key_distance_2px_(_mm_unpacklo_epi8(p, z), k), 0x08),
+                _mm_shuffle_epi32(
+                  frei0r_key_distance_2px_(_mm_unpackhi_epi8(p, z), k), 0x08));
+          x = _mm_slli_epi32(_mm_sub_epi32(d, lo), 8);
+          a = _mm_unpacklo_epi64(
+                frei0r_key_ramp_2px_(x, rw),
+                frei0r_key_ramp_2px_(_mm_shuffle_epi32(x, 0xee), rw));
+          below = _mm_cmpgt_epi32(hi, d);
+          in_ramp = _mm_and_si128(_mm_cmpgt_epi32(d, lo), below);
+          a = _mm_or_si128(_mm_and_si128(_mm_and_si128(a, c255), in_ramp),
+                           _mm_andnot_si128(below, c255));
+          a = _mm_xor_si128(a, inv);
+          p = _mm_and_si128(frei0r_key_spill_4px_(p, key->spill),
+                            _mm_set1_epi32(0x00ffffff));
+          _mm_storeu_si128((__m128i*)(dst + i),
+                           _mm_or_si128(p, _mm_slli_epi32(a, 24)));
+        }
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_key_alpha_px_(key, src[i]);
+}
+
+static inline void frei0r_key_spill_row(int spill, uint32_t* dst,
+                                        const uint32_t* src, unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i*)(dst + i),
+                     frei0r_key_spill_4px_(
+                       _mm_loadu_si128((const __m128i*)(src + i)), spill));
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_key_spill_px_(src[i], spill);
+}
+
+/* r, g and b are the key color from 0 to 255 */
+static inline void frei0r_key_gray_row(float r, float g, float b,
+                                       double scale, uint32_t* dst,
+                                       const uint32_t* src, unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i c255 = _mm_set1_epi32(255);
+  const __m128 kr = _mm_set1_ps(r), kg = _mm_set1_ps(g), kb = _mm_set1_ps(b);
+  const __m128d s = _mm_set1_pd(scale);
+  __m128i p, l;
+  __m128 dr, dg, db, q;
+
+  for (; i + 4 <= n; i += 4)
+    {
+      p = _mm_loadu_si128((const __m128i*)(src + i));
+      dr = _mm_sub_ps(kr, _mm_cvtepi32_ps(_mm_and_si128(p, c255)));
+      dg = _mm_sub_ps(kg, _mm_cvtepi32_ps(
+                            _mm_and_si128(_mm_srli_epi32(p, 8), c255)));
+      db = _mm_sub_ps(kb, _mm_cvtepi32_ps(
+                            _mm_and_si128(_mm_srli_epi32(p, 16), c255)));
+      q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+                     _mm_mul_ps(db, db));
+      q = _mm_sqrt_ps(q);
+      /* rounded to nearest even like rint() */
+      l = _mm_unpacklo_epi64(
+            _mm_cvtpd_epi32(_mm_mul_pd(_mm_cvtps_pd(q), s)),
+            _mm_cvtpd_epi32(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(q, q)), s)));
+      l = _mm_and_si128(l, c255);
+      l = _mm_or_si128(l, _mm_or_si128(_mm_slli_epi32(l, 8),
+                                       _mm_slli_epi32(l, 16)));
+      p = _mm_and_si128(p, _mm_set1_epi32((int)0xff000000));
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(p, l));
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_key_gray_px_(r, g, b, scale, src[i]);
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef INCLUDED_FREI0R_LUT_H
+#define INCLUDED_FREI0R_LUT_H
+
+/*
+
+  Kernels for effects that map 8 bit values through a table of 256
+  entries, computed once per frame or parameter change instead of per
+  pixel, on packed pixels with the alpha channel in the highest byte:
+
+  frei0r_lut_rgb        the three colors of each pixel through one table,
+                        alpha is kept
+  frei0r_lut_rgb3       the same with a table per color byte
+  frei0r_lut_bytes      bytes through a table, for planes
+  frei0r_lut_luma       the luma of each pixel with a frei0r_luma_t, as
+                        bytes
+  frei0r_lut_gray       the same as gray pixels, alpha is kept
+  frei0r_lut_lightness  (MAX(r,g,b) + MIN(r,g,b) + 1) / 2 per pixel, as
+                        bytes
+  frei0r_lut_palette    pixels from a table of 256 pixels indexed by such
+                        bytes, or-ed with the alpha of the source pixels
+
+  Luma and lightness are computed four pixels at a time with SSE2. The
+  table look-ups stay scalar: neither SSE2 nor NEON can index 256 entries
+  per byte, and a pshufb over the 16 nibble tables takes more
+  instructions per byte than the loads. Effects run the kernels per row,
+  or per chunk of FREI0R_LUT_CHUNK pixels with the bytes in between on
+  the stack.
+
+*/
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FREI0R_LUT_CHUNK 256
+
+/* Luma weights: the luma of a pixel is (r * red + g * green + b * blue +
+   bias) >> shift. The weights fit 16 bit signed, the luma of white 8 bits. */
+typedef struct frei0r_luma
+{
+  int16_t r, g, b;
+  int shift;
+  int bias;
+} frei0r_luma_t;
+
+/* the standard weights in 15 fractional bits, rounded */
+#define FREI0R_LUMA_REC601 { 9798, 19235, 3735, 15, 1 << 14 }
+#define FREI0R_LUMA_REC709 { 6966, 23436, 2366, 15, 1 << 14 }
+#define FREI0R_LUMA_REC2020 { 8608, 22217, 1943, 15, 1 << 14 }
+
+static inline void frei0r_lut_rgb(const uint8_t* lut, uint32_t* dst,
+                                  const uint32_t* src, unsigned int n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  uint8_t* d = (uint8_t*)dst;
+
+  while (n--)
+    {
+      d[0] = lut[s[0]];
+      d[1] = lut[s[1]];
+      d[2] = lut[s[2]];
+      d[3] = s[3];
+      d += 4;
+      s += 4;
+    }
+}
+
+static inline void frei0r_lut_rgb3(const uint8_t (*lut)[256], uint32_t* dst,
+                                   const uint32_t* src, unsigned int n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  uint8_t* d = (uint8_t*)dst;
+
+  while (n--)
+    {
+      d[0] = lut[0][s[0]];
+      d[1] = lut[1][s[1]];
+      d[2] = lut[2][s[2]];
+      d[3] = s[3];
+      d += 4;
+      s += 4;
+    }
+}
+
+static inline void frei0r_lut_bytes(const uint8_t* lut, uint8_t* dst,
+                                    const uint8_t* src, unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i)
+    dst[i] = lut[src[i]];
+}
+
+#if defined(__SSE2__)
+
+/* the luma of four pixels in 32 bit lanes */
+static inline __m128i frei0r_lut_luma_4px_(__m128i p, __m128i w, __m128i bias,
+                                           __m128i shift)
+{
+  const __m128i z = _mm_setzero_si128();
+  /* r*wr + g*wg and b*wb of each pixel, added up in lanes 0 and 2 */
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(p, z), w);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(p, z), w);
+
+  lo = _mm_shuffle_epi32(_mm_add_epi32(lo, _mm_srli_epi64(lo, 32)), 0x08);
+  hi = _mm_shuffle_epi32(_mm_add_epi32(hi, _mm_srli_epi64(hi, 32)), 0x08);
+  return _mm_srl_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), bias), shift);
+}
+
+#endif
+
+static inline uint32_t frei0r_lut_luma_px_(const frei0r_luma_t* w, uint32_t p)
+{
+  return ((int)(p & 0xff) * w->r + (int)((p >> 8) & 0xff) * w->g
+          + (int)((p >> 16) & 0xff) * w->b + w->bias) >> w->shift;
+}
+
+static inline void frei0r_lut_luma(uint8_t* dst, const uint32_t* src,
+                                   unsigned int n, const frei0r_luma_t* w)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i wv = _mm_set_epi16(0, w->b, w->g, w->r, 0, w->b, w->g, w->r);
+  const __m128i bias = _mm_set1_epi32(w->bias);
+  const __m128i shift = _mm_cvtsi32_si128(w->shift);
+  __m128i l;
+
+  for (; i + 4 <= n; i += 4)
+    {
+      l = frei0r_lut_luma_4px_(_mm_loadu_si128((const __m128i*)(src + i)),
+                               wv, bias, shift);
+      l = _mm_packus_epi16(_mm_packs_epi32(l, l), l);
+      *(uint32_t*)(void*)(dst + i) = (uint32_t)_mm_cvtsi128_si32(l);
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = (uint8_t)frei0r_lut_luma_px_(w, src[i]);
+}
+
+static inline void frei0r_lut_gray(uint32_t* dst, const uint32_t* src,
+                                   unsigned int n, const frei0r_luma_t* w)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i wv = _mm_set_epi16(0, w->b, w->g, w->r, 0, w->b, w->g, w->r);
+  const __m128i bias = _mm_set1_epi32(w->bias);
+  const __m128i shift = _mm_cvtsi32_si128(w->shift);
+  const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+  __m128i p, l;
+
+  for (; i + 4 <= n; i += 4)
+    {
+      p = _mm_loadu_si128((const __m128i*)(src + i));
+      l = frei0r_lut_luma_4px_(p, wv, bias, shift);
+      l = _mm_or_si128(l, _mm_or_si128(_mm_slli_epi32(l, 8),
+                                       _mm_slli_epi32(l, 16)));
+      _mm_storeu_si128((__m128i*)(dst + i),
+                       _mm_or_si128(l, _mm_and_si128(p, alpha)));
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = (src[i] & 0xff000000) | (frei0r_lut_luma_px_(w, src[i]) * 0x010101);
+}
+
+static inline void frei0r_lut_lightness(uint8_t* dst, const uint32_t* src,
+                                        unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i c255 = _mm_set1_epi32(255);
+
+  for (; i + 4 <= n; i += 4)
+    {
+      __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i g = _mm_srli_epi32(p, 8), b = _mm_srli_epi32(p, 16);
+      __m128i hi = _mm_max_epu8(_mm_max_epu8(p, g), b);
+      __m128i lo = _mm_min_epu8(_mm_min_epu8(p, g), b);
+      /* the lowest byte of each pixel */
+      p = _mm_and_si128(_mm_avg_epu8(hi, lo), c255);
+      p = _mm_packus_epi16(_mm_packs_epi32(p, p), p);
+      *(uint32_t*)(void*)(dst + i) = (uint32_t)_mm_cvtsi128_si32(p);
+    }
+#endif
+
+  for (; i < n; ++i)
+    {
+      uint32_t p = src[i];
+      uint32_t r = p & 0xff, g = (p >> 8) & 0xff, b = (p >> 16) & 0xff;
+      uint32_t hi = r > g ? r : g, lo = r > g ? g : r;
+      hi = hi > b ? hi : b;
+      lo = lo < b ? lo : b;
+      dst[i] = (uint8_t)((hi + lo + 1) >> 1);
+    }
+}
+
+static inline void frei0r_lut_palette(const uint32_t* palette, uint32_t* dst,
+                                      const uint8_t* index,
+                                      const uint32_t* src, unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i)
+    dst[i] = palette[index[i]] | (src[i] & 0xff000000);
+}
+
+#endif
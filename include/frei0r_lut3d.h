@@ -0,0 +1,415 @@
+#ifndef INCLUDED_FREI0R_LUT3D_H
+#define INCLUDED_FREI0R_LUT3D_H
+
+/*
+
+  3D colour lookup tables for 8 bit RGBA frames, used by the lut3d filter
+  and by tools/frei0r-bake, which turns a chain of pointwise colour
+  filters into one table.
+
+  frei0r_lut3d_t lut;
+
+  frei0r_lut3d_init(&lut);
+  if (frei0r_lut3d_load_cube(&lut, "grade.cube") == 0)
+    frei0r_lut3d_apply(&lut, FREI0R_LUT3D_TETRAHEDRAL, src, dst, n);
+  frei0r_lut3d_free(&lut);
+
+  A table holds size^3 lattice points, red changing fastest, like in the
+  .cube files (Adobe / Resolve, LUT_3D_SIZE with optional DOMAIN_MIN,
+  DOMAIN_MAX and LUT_3D_INPUT_RANGE). Each point is kept as four floats
+  so it can be loaded as one SSE2 vector; the interpolation of a pixel
+  works on all three channels at once. Alpha is copied from the input.
+
+  To bake a table, fill a frame of size x size*size pixels with
+  frei0r_lut3d_identity(), run the filters on it and read the result
+  back with frei0r_lut3d_from_frame(). With size 18 or 52 the lattice
+  falls on exact 8 bit values, so the baked table reproduces the filters
+  exactly at the lattice points.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FREI0R_LUT3D_TRILINEAR   0
+#define FREI0R_LUT3D_TETRAHEDRAL 1
+
+#define FREI0R_LUT3D_MAX_SIZE 256
+
+typedef struct frei0r_lut3d
+{
+  int size;                /* lattice points per axis, 0 when empty */
+  float* point;            /* size^3 points of r, g, b, 0 */
+  float domain_min[3];
+  float domain_max[3];
+  /* for each 8 bit input value and channel: offset of the lower
+     lattice point (in points) and the weight of the upper one */
+  int offset[3][256];
+  float frac[3][256];
+} frei0r_lut3d_t;
+
+static inline void frei0r_lut3d_init(frei0r_lut3d_t* lut)
+{
+  memset(lut, 0, sizeof(*lut));
+}
+
+static inline void frei0r_lut3d_free(frei0r_lut3d_t* lut)
+{
+  free(lut->point);
+  frei0r_lut3d_init(lut);
+}
+
+/* Computes the per channel input tables, after the points or the domain
+   have changed. */
+static inline void frei0r_lut3d_prepare(frei0r_lut3d_t* lut)
+{
+  int c, v, i, stride = 1;
+
+  for (c = 0; c < 3; ++c)
+    {
+      float lo = lut->domain_min[c], hi = lut->domain_max[c];
+      float scale = (hi > lo) ? (lut->size - 1) / (hi - lo) : 0.0f;
+
+      for (v = 0; v < 256; ++v)
+        {
+          float x = (v / 255.0f - lo) * scale;
+
+          if (x < 0.0f)
+            x = 0.0f;
+          if (x > lut->size - 1)
+            x = lut->size - 1;
+          i = (int)x;
+          if (i > lut->size - 2)
+            i = lut->size - 2;
+          lut->offset[c][v] = i * stride;
+          lut->frac[c][v] = x - i;
+        }
+      stride *= lut->size;
+    }
+}
+
+/* Allocates a table of size^3 points with the [0,1] domain. Returns 0 on
+   success, -1 for an unsupported size or when out of memory. */
+static inline int frei0r_lut3d_alloc(frei0r_lut3d_t* lut, int size)
+{
+  float* point;
+  int c;
+
+  if (size < 2 || size > FREI0R_LUT3D_MAX_SIZE)
+    return -1;
+  point = (float*)calloc((size_t)size * size * size, 4 * sizeof(float));
+  if (!point)
+    return -1;
+  frei0r_lut3d_free(lut);
+  lut->size = size;
+  lut->point = point;
+  for (c = 0; c < 3; ++c)
+    {
+      lut->domain_min[c] = 0.0f;
+      lut->domain_max[c] = 1.0f;
+    }
+  return 0;
+}
+
+/* Loads a .cube file. Returns 0 on success; on failure -1 is returned
+   and lut is left as it was. */
+static inline int frei0r_lut3d_load_cube(frei0r_lut3d_t* lut,
+                                         const char* path)
+{
+  frei0r_lut3d_t t;
+  char line[512];
+  float lo[3] = { 0.0f, 0.0f, 0.0f }, hi[3] = { 1.0f, 1.0f, 1.0f };
+  long n = 0, total = 0;
+  int c, ok = 1;
+  FILE* f = fopen(path, "r");
+
+  if (!f)
+    return -1;
+  frei0r_lut3d_init(&t);
+  while (ok && fgets(line, sizeof(line), f))
+    {
+      float r, g, b;
+      int size;
+      char* s = line;
+
+      while (*s == ' ' || *s == '\t')
+        ++s;
+      if (*s == '#' || *s == '\n' || *s == '\r' || *s == 0
+          || !strncmp(s, "TITLE", 5))
+        continue;
+      if (sscanf(s, "LUT_3D_SIZE %d", &size) == 1)
+        {
+          ok = (t.size == 0 && frei0r_lut3d_alloc(&t, size) == 0);
+          total = (long)size * size * size;
+        }
+      else if (sscanf(s, "DOMAIN_MIN %f %f %f", &lo[0], &lo[1], &lo[2]) == 3
+               || sscanf(s, "DOMAIN_MAX %f %f %f", &hi[0], &hi[1], &hi[2]) == 3)
+        ;
+      else if (sscanf(s, "LUT_3D_INPUT_RANGE %f %f", &r, &g) == 2)
+        {
+          lo[0] = lo[1] = lo[2] = r;
+          hi[0] = hi[1] = hi[2] = g;
+        }
+      else if (sscanf(s, "%f %f %f", &r, &g, &b) == 3)
+        {
+          ok = (n < total);
+          if (ok)
+            {
+              t.point[4*n] = r;
+              t.point[4*n + 1] = g;
+              t.point[4*n + 2] = b;
+              ++n;
+            }
+        }
+      else
+        ok = 0;   /* LUT_1D_SIZE and anything else we don't know */
+    }
+  fclose(f);
+
+  if (!ok || t.size == 0 || n != total)
+    {
+      frei0r_lut3d_free(&t);
+      return -1;
+    }
+  for (c = 0; c < 3; ++c)
+    {
+      t.domain_min[c] = lo[c];
+      t.domain_max[c] = hi[c];
+    }
+  frei0r_lut3d_prepare(&t);
+  frei0r_lut3d_free(lut);
+  *lut = t;
+  return 0;
+}
+
+/* Writes lut as a .cube file. Returns 0 on success, -1 on failure. */
+static inline int frei0r_lut3d_save_cube(const frei0r_lut3d_t* lut,
+                                         const char* path,
+                                         const char* title)
+{
+  long i, total = (long)lut->size * lut->size * lut->size;
+  FILE* f = fopen(path, "w");
+  int ok;
+
+  if (!f)
+    return -1;
+  if (title)
+    fprintf(f, "TITLE \"%s\"\n", title);
+  fprintf(f, "LUT_3D_SIZE %d\n", lut->size);
+  fprintf(f, "DOMAIN_MIN %g %g %g\n",
+          lut->domain_min[0], lut->domain_min[1], lut->domain_min[2]);
+  fprintf(f, "DOMAIN_MAX %g %g %g\n",
+          lut->domain_max[0], lut->domain_max[1], lut->domain_max[2]);
+  for (i = 0; i < total; ++i)
+    fprintf(f, "%.6f %.6f %.6f\n",
+            lut->point[4*i], lut->point[4*i + 1], lut->point[4*i + 2]);
+  ok = !ferror(f);
+  return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+/* Fills frame, size pixels wide and size*size high, with the lattice
+   colours of a size^3 table with the [0,1] domain, in table order. */
+static inline void frei0r_lut3d_identity(uint32_t* frame, int size)
+{
+  int r, g, b;
+  uint8_t* p = (uint8_t*)frame;
+
+  for (b = 0; b < size; ++b)
+    for (g = 0; g < size; ++g)
+      for (r = 0; r < size; ++r)
+        {
+          *p++ = (r * 255 + (size - 1) / 2) / (size - 1);
+          *p++ = (g * 255 + (size - 1) / 2) / (size - 1);
+          *p++ = (b * 255 + (size - 1) / 2) / (size - 1);
+          *p++ = 0xff;
+        }
+}
+
+/* Makes lut a size^3 table from a frame filled by frei0r_lut3d_identity()
+   and processed by the filters to bake. Returns 0 on success. */
+static inline int frei0r_lut3d_from_frame(frei0r_lut3d_t* lut,
+                                          const uint32_t* frame, int size)
+{
+  long i, total = (long)size * size * size;
+  const uint8_t* p = (const uint8_t*)frame;
+
+  if (frei0r_lut3d_alloc(lut, size) != 0)
+    return -1;
+  for (i = 0; i < total; ++i, p += 4)
+    {
+      lut->point[4*i] = p[0] / 255.0f;
+      lut->point[4*i + 1] = p[1] / 255.0f;
+      lut->point[4*i + 2] = p[2] / 255.0f;
+    }
+  frei0r_lut3d_prepare(lut);
+  return 0;
+}
+
+/* Picks the four corners of the tetrahedron around a pixel and their
+   weights: the result is p0 + w[0]*(p1-p0) + w[1]*(p2-p1) + w[2]*(p3-p2),
+   with p1, p2, p3 at offsets o[0], o[1], o[2] from p0. */
+static inline void frei0r_lut3d_tetra_(const frei0r_lut3d_t* lut,
+                                       float fr, float fg, float fb,
+                                       int o[3], float w[3])
+{
+  int sr = 1, sg = lut->size, sb = lut->size * lut->size;
+
+  if (fr > fg)
+    {
+      if (fg > fb)
+        { o[0] = sr; o[1] = sr+sg; w[0] = fr; w[1] = fg; w[2] = fb; }
+      else if (fr > fb)
+        { o[0] = sr; o[1] = sr+sb; w[0] = fr; w[1] = fb; w[2] = fg; }
+      else
+        { o[0] = sb; o[1] = sr+sb; w[0] = fb; w[1] = fr; w[2] = fg; }
+    }
+  else
+    {
+      if (fb > fg)
+        { o[0] = sb; o[1] = sg+sb; w[0] = fb; w[1] = fg; w[2] = fr; }
+      else if (fb > fr)
+        { o[0] = sg; o[1] = sg+sb; w[0] = fg; w[1] = fb; w[2] = fr; }
+      else
+        { o[0] = sg; o[1] = sr+sg; w[0] = fg; w[1] = fr; w[2] = fb; }
+    }
+  o[2] = sr + sg + sb;
+}
+
+static inline uint8_t frei0r_lut3d_byte_(float v)
+{
+  v = v * 255.0f + 0.5f;
+  if (!(v >= 0.0f))   /* and NaN */
+    v = 0.0f;
+  if (v > 255.0f)
+    v = 255.0f;
+  return (uint8_t)v;
+}
+
+/* Maps n pixels of src through lut into dst, with FREI0R_LUT3D_TRILINEAR
+   or FREI0R_LUT3D_TETRAHEDRAL interpolation. dst may be src; an empty
+   table copies src. */
+static inline void frei0r_lut3d_apply(const frei0r_lut3d_t* lut, int method,
+                                      const uint32_t* src, uint32_t* dst,
+                                      long n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  uint8_t* d = (uint8_t*)dst;
+  int sg = lut->size, sb = lut->size * lut->size;
+  long i;
+
+#if defined(__SSE2__)
+  const __m128 k255 = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+  const __m128 zero = _mm_setzero_ps();
+#endif
+
+  if (lut->size == 0)
+    {
+      if (dst != src)
+        memcpy(dst, src, n * sizeof(uint32_t));
+      return;
+    }
+  for (i = 0; i < n; ++i, s += 4, d += 4)
+    {
+      const float* p = lut->point + 4 * (lut->offset[0][s[0]]
+                                         + lut->offset[1][s[1]]
+                                         + lut->offset[2][s[2]]);
+      float fr = lut->frac[0][s[0]], fg = lut->frac[1][s[1]];
+      float fb = lut->frac[2][s[2]];
+      uint8_t a = s[3];
+#if defined(__SSE2__)
+      __m128 c;
+      int px;
+
+      if (method == FREI0R_LUT3D_TETRAHEDRAL)
+        {
+          int o[3];
+          float w[3];
+          __m128 p0, p1, p2, p3;
+
+          frei0r_lut3d_tetra_(lut, fr, fg, fb, o, w);
+          p0 = _mm_loadu_ps(p);
+          p1 = _mm_loadu_ps(p + 4*o[0]);
+          p2 = _mm_loadu_ps(p + 4*o[1]);
+          p3 = _mm_loadu_ps(p + 4*o[2]);
+          c = _mm_add_ps(p0, _mm_mul_ps(_mm_set1_ps(w[0]), _mm_sub_ps(p1, p0)));
+          c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(w[1]), _mm_sub_ps(p2, p1)));
+          c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(w[2]), _mm_sub_ps(p3, p2)));
+        }
+      else
+        {
+          __m128 r = _mm_set1_ps(fr), g = _mm_set1_ps(fg);
+          __m128 c00, c10, c01, c11, a0, a1;
+
+          a0 = _mm_loadu_ps(p);
+          a1 = _mm_loadu_ps(p + 4);
+          c00 = _mm_add_ps(a0, _mm_mul_ps(r, _mm_sub_ps(a1, a0)));
+          a0 = _mm_loadu_ps(p + 4*sg);
+          a1 = _mm_loadu_ps(p + 4*sg + 4);
+          c10 = _mm_add_ps(a0, _mm_mul_ps(r, _mm_sub_ps(a1, a0)));
+          a0 = _mm_loadu_ps(p + 4*sb);
+          a1 = _mm_loadu_ps(p + 4*sb + 4);
+          c01 = _mm_add_ps(a0, _mm_mul_ps(r, _mm_sub_ps(a1, a0)));
+          a0 = _mm_loadu_ps(p + 4*(sg+sb));
+          a1 = _mm_loadu_ps(p + 4*(sg+sb) + 4);
+          c11 = _mm_add_ps(a0, _mm_mul_ps(r, _mm_sub_ps(a1, a0)));
+          c00 = _mm_add_ps(c00, _mm_mul_ps(g, _mm_sub_ps(c10, c00)));
+          c01 = _mm_add_ps(c01, _mm_mul_ps(g, _mm_sub_ps(c11, c01)));
+          c = _mm_add_ps(c00, _mm_mul_ps(_mm_set1_ps(fb), _mm_sub_ps(c01, c00)));
+        }
+      c = _mm_add_ps(_mm_mul_ps(c, k255), half);
+      c = _mm_min_ps(_mm_max_ps(c, zero), k255);
+      px = _mm_cvtsi128_si32(_mm_packus_epi16(
+             _mm_packs_epi32(_mm_cvttps_epi32(c), _mm_setzero_si128()),
+             _mm_setzero_si128()));
+      d[0] = (uint8_t)px;
+      d[1] = (uint8_t)(px >> 8);
+      d[2] = (uint8_t)(px >> 16);
+#else
+      float c[3];
+      int k;
+
+      if (method == FREI0R_LUT3D_TETRAHEDRAL)
+        {
+          int o[3];
+          float w[3];
+
+          frei0r_lut3d_tetra_(lut, fr, fg, fb, o, w);
+          for (k = 0; k < 3; ++k)
+            {
+              float p0 = p[k], p1 = p[4*o[0] + k];
+              float p2 = p[4*o[1] + k], p3 = p[4*o[2] + k];
+              c[k] = p0 + w[0] * (p1 - p0);
+              c[k] = c[k] + w[1] * (p2 - p1);
+              c[k] = c[k] + w[2] * (p3 - p2);
+            }
+        }
+      else
+        {
+          for (k = 0; k < 3; ++k)
+            {
+              const float* q = p + k;
+              float c00 = q[0] + fr * (q[4] - q[0]);
+              float c10 = q[4*sg] + fr * (q[4*sg + 4] - q[4*sg]);
+              float c01 = q[4*sb] + fr * (q[4*sb + 4] - q[4*sb]);
+              float c11 = q[4*(sg+sb)]
+                          + fr * (q[4*(sg+sb) + 4] - q[4*(sg+sb)]);
+              c00 = c00 + fg * (c10 - c00);
+              c01 = c01 + fg * (c11 - c01);
+              c[k] = c00 + fb * (c01 - c00);
+            }
+        }
+      d[0] = frei0r_lut3d_byte_(c[0]);
+      d[1] = frei0r_lut3d_byte_(c[1]);
+      d[2] = frei0r_lut3d_byte_(c[2]);
+#endif
+      d[3] = a;
+    }
+}
+
+#endif
@@ -0,0 +1,467 @@
+#ifndef INCLUDED_FREI0R_MANIFEST_H
+#define INCLUDED_FREI0R_MANIFEST_H
+
+/*
+
+  Reader for the plugin manifest, frei0r-manifest.json, that the build
+  installs next to the plugins. It has what f0r_get_plugin_info,
+  f0r_get_plugin_info2 and f0r_get_param_info return for every plugin of
+  the directory, so that an application can list the effects and their
+  parameters without loading any plugin:
+
+  frei0r_manifest_t manifest;
+
+  if (frei0r_manifest_load(&manifest, "/usr/lib/frei0r-1/frei0r-manifest.json"))
+    {
+      for (i = 0; i < manifest.count; ++i)
+        {
+          const frei0r_manifest_plugin_t* p = &manifest.plugins[i];
+          ... p->file, p->info.name, p->params[k].name ...
+        }
+      frei0r_manifest_free(&manifest);
+    }
+
+  file is the name of the plugin in the directory of the manifest, to be
+  loaded once the effect is used. The strings point into the manifest
+  and stay valid until frei0r_manifest_free.
+
+  The manifest is JSON, written by tools/frei0r-manifest:
+
+  { "frei0r_manifest": 1,
+    "plugins": [
+      { "file": "flippo.so", "name": "Flippo", "author": "...",
+        "plugin_type": 0, "color_model": 1, "frei0r_version": 1,
+        "major_version": 0, "minor_version": 1, "explanation": "...",
+        "capabilities": 0,
+        "params": [ { "name": "X axis", "type": 0, "explanation": "..." },
+                    ... ] },
+      ... ] }
+
+  with the members of f0r_plugin_info_t, the capabilities of
+  f0r_plugin_info2_t (0 for plugins without it) and the
+  f0r_param_info_t of each parameter; num_params is the length of
+  params. Members the reader doesn't know are skipped, so later versions
+  may add some.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frei0r.h"
+
+#define FREI0R_MANIFEST_VERSION 1
+
+typedef struct frei0r_manifest_plugin
+{
+  const char* file;
+  f0r_plugin_info_t info;
+  unsigned int capabilities;
+  f0r_param_info_t* params;  /* info.num_params of them */
+} frei0r_manifest_plugin_t;
+
+typedef struct frei0r_manifest
+{
+  int count;
+  frei0r_manifest_plugin_t* plugins;
+  char* text_;               /* the strings point into it */
+} frei0r_manifest_t;
+
+typedef struct frei0r_manifest_parser_
+{
+  char* p;
+  char* end;
+  int failed;
+} frei0r_manifest_parser_t;
+
+static inline void frei0r_manifest_space_(frei0r_manifest_parser_t* s)
+{
+  while (s->p < s->end
+         && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+    ++s->p;
+}
+
+/* Takes c, if it is the next character. */
+static inline int frei0r_manifest_take_(frei0r_manifest_parser_t* s, char c)
+{
+  frei0r_manifest_space_(s);
+  if (s->p < s->end && *s->p == c)
+    {
+      ++s->p;
+      return 1;
+    }
+  return 0;
+}
+
+static inline void frei0r_manifest_expect_(frei0r_manifest_parser_t* s, char c)
+{
+  if (!frei0r_manifest_take_(s, c))
+    s->failed = 1;
+}
+
+static inline int frei0r_manifest_hex_(const char* p)
+{
+  int i, v = 0;
+
+  for (i = 0; i < 4; ++i)
+    {
+      char c = p[i];
+
+      v <<= 4;
+      if (c >= '0' && c <= '9')
+        v |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        v |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        v |= c - 'A' + 10;
+      else
+        return -1;
+    }
+  return v;
+}
+
+/* A string, decoded in place (it only gets shorter) and terminated. */
+static inline char* frei0r_manifest_string_(frei0r_manifest_parser_t* s)
+{
+  char *start, *out;
+
+  if (!frei0r_manifest_take_(s, '"'))
+    {
+      s->failed = 1;
+      return 0;
+    }
+  start = out = s->p;
+  while (s->p < s->end && *s->p != '"')
+    {
+      char c = *s->p++;
+      long u;
+
+      if (c != '\\')
+        {
+          *out++ = c;
+          continue;
+        }
+      if (s->p == s->end)
+        break;
+      c = *s->p++;
+      switch (c)
+        {
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u':
+          if (s->end - s->p < 4 || (u = frei0r_manifest_hex_(s->p)) < 0)
+            {
+              s->failed = 1;
+              return 0;
+            }
+          s->p += 4;
+          /* a surrogate pair */
+          if (u >= 0xd800 && u < 0xdc00 && s->end - s->p >= 6
+              && s->p[0] == '\\' && s->p[1] == 'u')
+            {
+              long v = frei0r_manifest_hex_(s->p + 2);
+
+              if (v >= 0xdc00 && v < 0xe000)
+                {
+                  u = 0x10000 + ((u - 0xd800) << 10) + (v - 0xdc00);
+                  s->p += 6;
+                }
+            }
+          /* as UTF-8 */
+          if (u < 0x80)
+            *out++ = (char)u;
+          else if (u < 0x800)
+            {
+              *out++ = (char)(0xc0 | (u >> 6));
+              *out++ = (char)(0x80 | (u & 0x3f));
+            }
+          else if (u < 0x10000)
+            {
+              *out++ = (char)(0xe0 | (u >> 12));
+              *out++ = (char)(0x80 | ((u >> 6) & 0x3f));
+              *out++ = (char)(0x80 | (u & 0x3f));
+            }
+          else
+            {
+              *out++ = (char)(0xf0 | (u >> 18));
+              *out++ = (char)(0x80 | ((u >> 12) & 0x3f));
+              *out++ = (char)(0x80 | ((u >> 6) & 0x3f));
+              *out++ = (char)(0x80 | (u & 0x3f));
+            }
+          break;
+        default: *out++ = c; break;
+        }
+    }
+  if (s->p == s->end)
+    {
+      s->failed = 1;
+      return 0;
+    }
+  ++s->p;
+  *out = 0;
+  return start;
+}
+
+static inline double frei0r_manifest_number_(frei0r_manifest_parser_t* s)
+{
+  char* end;
+  double v;
+
+  frei0r_manifest_space_(s);
+  v = strtod(s->p, &end);
+  if (end == s->p || end > s->end)
+    s->failed = 1;
+  s->p = end;
+  return v;
+}
+
+/* Skips a value of any kind. */
+static inline void frei0r_manifest_skip_(frei0r_manifest_parser_t* s,
+                                         int depth)
+{
+  frei0r_manifest_space_(s);
+  if (depth > 64 || s->p == s->end)
+    s->failed = 1;
+  else if (*s->p == '"')
+    frei0r_manifest_string_(s);
+  else if (frei0r_manifest_take_(s, '{'))
+    {
+      if (frei0r_manifest_take_(s, '}'))
+        return;
+      do
+        {
+          frei0r_manifest_string_(s);
+          frei0r_manifest_expect_(s, ':');
+          frei0r_manifest_skip_(s, depth + 1);
+        }
+      while (!s->failed && frei0r_manifest_take_(s, ','));
+      frei0r_manifest_expect_(s, '}');
+    }
+  else if (frei0r_manifest_take_(s, '['))
+    {
+      if (frei0r_manifest_take_(s, ']'))
+        return;
+      do
+        frei0r_manifest_skip_(s, depth + 1);
+      while (!s->failed && frei0r_manifest_take_(s, ','));
+      frei0r_manifest_expect_(s, ']');
+    }
+  else if (*s->p == 't' || *s->p == 'f' || *s->p == 'n')
+    {
+      while (s->p < s->end && *s->p >= 'a' && *s->p <= 'z')
+        ++s->p;
+    }
+  else
+    frei0r_manifest_number_(s);
+}
+
+static inline void frei0r_manifest_param_(frei0r_manifest_parser_t* s,
+                                          f0r_param_info_t* param)
+{
+  memset(param, 0, sizeof(*param));
+  param->name = param->explanation = "";
+  frei0r_manifest_expect_(s, '{');
+  if (frei0r_manifest_take_(s, '}'))
+    return;
+  do
+    {
+      const char* key = frei0r_manifest_string_(s);
+
+      frei0r_manifest_expect_(s, ':');
+      if (s->failed)
+        return;
+      if (!strcmp(key, "name"))
+        param->name = frei0r_manifest_string_(s);
+      else if (!strcmp(key, "explanation"))
+        param->explanation = frei0r_manifest_string_(s);
+      else if (!strcmp(key, "type"))
+        param->type = (int)frei0r_manifest_number_(s);
+      else
+        frei0r_manifest_skip_(s, 0);
+    }
+  while (!s->failed && frei0r_manifest_take_(s, ','));
+  frei0r_manifest_expect_(s, '}');
+}
+
+static inline void frei0r_manifest_plugin_(frei0r_manifest_parser_t* s,
+                                           frei0r_manifest_plugin_t* plugin)
+{
+  int params = 0;
+
+  memset(plugin, 0, sizeof(*plugin));
+  plugin->file = plugin->info.name = plugin->info.author = "";
+  plugin->info.explanation = "";
+  frei0r_manifest_expect_(s, '{');
+  if (frei0r_manifest_take_(s, '}'))
+    return;
+  do
+    {
+      const char* key = frei0r_manifest_string_(s);
+
+      frei0r_manifest_expect_(s, ':');
+      if (s->failed)
+        return;
+      if (!strcmp(key, "file"))
+        plugin->file = frei0r_manifest_string_(s);
+      else if (!strcmp(key, "name"))
+        plugin->info.name = frei0r_manifest_string_(s);
+      else if (!strcmp(key, "author"))
+        plugin->info.author = frei0r_manifest_string_(s);
+      else if (!strcmp(key, "explanation"))
+        plugin->info.explanation = frei0r_manifest_string_(s);
+      else if (!strcmp(key, "plugin_type"))
+        plugin->info.plugin_type = (int)frei0r_manifest_number_(s);
+      else if (!strcmp(key, "color_model"))
+        plugin->info.color_model = (int)frei0r_manifest_number_(s);
+      else if (!strcmp(key, "frei0r_version"))
+        plugin->info.frei0r_version = (int)frei0r_manifest_number_(s);
+      else if (!strcmp(key, "major_version"))
+        plugin->info.major_version = (int)frei0r_manifest_number_(s);
+      else if (!strcmp(key, "minor_version"))
+        plugin->info.minor_version = (int)frei0r_manifest_number_(s);
+      else if (!strcmp(key, "capabilities"))
+        plugin->capabilities = (unsigned int)frei0r_manifest_number_(s);
+      else if (!strcmp(key, "params") && !plugin->params)
+        {
+          int size = 0;
+
+          frei0r_manifest_expect_(s, '[');
+          if (frei0r_manifest_take_(s, ']'))
+            continue;
+          do
+            {
+              if (params == size)
+                {
+                  f0r_param_info_t* grown;
+
+                  size = size ? 2 * size : 8;
+                  grown = (f0r_param_info_t*)realloc(plugin->params,
+                                                     size * sizeof(*grown));
+                  if (!grown)
+                    {
+                      s->failed = 1;
+                      return;
+                    }
+                  plugin->params = grown;
+                }
+              frei0r_manifest_param_(s, &plugin->params[params++]);
+            }
+          while (!s->failed && frei0r_manifest_take_(s, ','));
+          frei0r_manifest_expect_(s, ']');
+        }
+      else
+        frei0r_manifest_skip_(s, 0);
+    }
+  while (!s->failed && frei0r_manifest_take_(s, ','));
+  frei0r_manifest_expect_(s, '}');
+  /* num_params is the number of parameters actually listed */
+  plugin->info.num_params = params;
+}
+
+static inline void frei0r_manifest_free(frei0r_manifest_t* manifest)
+{
+  int i;
+
+  for (i = 0; i < manifest->count; ++i)
+    free(manifest->plugins[i].params);
+  free(manifest->plugins);
+  free(manifest->text_);
+  memset(manifest, 0, sizeof(*manifest));
+}
+
+/* Reads the manifest from the size bytes of text. Returns 0 if it is
+   not a manifest of a version this reader understands. */
+static inline int frei0r_manifest_parse(frei0r_manifest_t* manifest,
+                                        const char* text, size_t size)
+{
+  frei0r_manifest_parser_t s;
+  int version = 0, capacity = 0;
+
+  memset(manifest, 0, sizeof(*manifest));
+  manifest->text_ = (char*)malloc(size + 1);
+  if (!manifest->text_)
+    return 0;
+  memcpy(manifest->text_, text, size);
+  manifest->text_[size] = 0;
+  s.p = manifest->text_;
+  s.end = s.p + size;
+  s.failed = 0;
+
+  frei0r_manifest_expect_(&s, '{');
+  if (!frei0r_manifest_take_(&s, '}'))
+    do
+      {
+        const char* key = frei0r_manifest_string_(&s);
+
+        frei0r_manifest_expect_(&s, ':');
+        if (s.failed)
+          break;
+        if (!strcmp(key, "frei0r_manifest"))
+          version = (int)frei0r_manifest_number_(&s);
+        else if (!strcmp(key, "plugins") && !manifest->plugins)
+          {
+            frei0r_manifest_expect_(&s, '[');
+            if (frei0r_manifest_take_(&s, ']'))
+              continue;
+            do
+              {
+                if (manifest->count == capacity)
+                  {
+                    frei0r_manifest_plugin_t* grown;
+
+                    capacity = capacity ? 2 * capacity : 64;
+                    grown = (frei0r_manifest_plugin_t*)realloc(
+                      manifest->plugins, capacity * sizeof(*grown));
+                    if (!grown)
+                      {
+                        s.failed = 1;
+                        break;
+                      }
+                    manifest->plugins = grown;
+                  }
+                frei0r_manifest_plugin_(&s, &manifest->plugins[manifest->count++]);
+              }
+            while (!s.failed && frei0r_manifest_take_(&s, ','));
+            frei0r_manifest_expect_(&s, ']');
+          }
+        else
+          frei0r_manifest_skip_(&s, 0);
+      }
+    while (!s.failed && frei0r_manifest_take_(&s, ','));
+  frei0r_manifest_expect_(&s, '}');
+
+  if (s.failed || version < 1 || version > FREI0R_MANIFEST_VERSION)
+    {
+      frei0r_manifest_free(manifest);
+      return 0;
+    }
+  return 1;
+}
+
+/* Reads the manifest file at path, see frei0r_manifest_parse. */
+static inline int frei0r_manifest_load(frei0r_manifest_t* manifest,
+                                       const char* path)
+{
+  FILE* f = fopen(path, "rb");
+  char* text = 0;
+  long size;
+  int ok = 0;
+
+  memset(manifest, 0, sizeof(*manifest));
+  if (!f)
+    return 0;
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0
+      && fseek(f, 0, SEEK_SET) == 0
+      && (text = (char*)malloc(size + 1)) != 0
+      && fread(text, 1, size, f) == (size_t)size)
+    ok = frei0r_manifest_parse(manifest, text, (size_t)size);
+  free(text);
+  fclose(f);
+  return ok;
+}
+
+#endif
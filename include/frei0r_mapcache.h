@@ -0,0 +1,242 @@
+#ifndef INCLUDED_FREI0R_MAPCACHE_H
+#define INCLUDED_FREI0R_MAPCACHE_H
+
+/*
+
+  Disk cache for the tables of effects that compute them once from their
+  parameters and the frame size, like the remap tables of the lens and
+  corner effects. With the environment variable FREI0R_MAP_CACHE set to
+  an existing directory, an instance that needs a table first looks it
+  up there and maps the file read-only instead of computing the table,
+  so processes that render with the same lens share one copy of it in
+  the page cache. Without the variable the cache is off: get returns 0
+  and put does nothing.
+
+  frei0r_mapcache_t cache;
+
+  frei0r_mapcache_init(&cache);
+  ...
+  // whenever the parameters have changed
+  key = { width, height, parameters the table depends on };
+  table = frei0r_mapcache_get(&cache, "effect-1", &key, sizeof(key), bytes);
+  if (!table)
+    {
+      compute the table into memory of the instance
+      frei0r_mapcache_put("effect-1", &key, sizeof(key), computed, bytes);
+    }
+  ...
+  frei0r_mapcache_release(&cache);
+
+  The name identifies the effect and the version of its table: an
+  effect that computes its table differently changes the number, so
+  that tables of older versions are not used. The key is kept in the
+  file and compared in full as bytes, the hash in the file name only
+  finds it; a key struct is cleared with memset() before it is filled,
+  so that its padding compares too. A table stays mapped until the next
+  get or release of the same frei0r_mapcache_t, and is read-only.
+
+  Files are written to a temporary name first and renamed, so that
+  processes that store the same table at the same time don't see each
+  other's partial files. Nothing is ever removed; the directory can be
+  cleared whenever no process is starting.
+
+  The cache needs mmap() and is off on other systems.
+
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define FREI0R_MAPCACHE_MMAP 1
+#endif
+
+#define FREI0R_MAPCACHE_ENV "FREI0R_MAP_CACHE"
+
+/* the header of each file, followed by the key and the table, each
+   starting on a multiple of FREI0R_MAPCACHE_ALIGN */
+#define FREI0R_MAPCACHE_MAGIC "frei0r-map-1"
+#define FREI0R_MAPCACHE_ALIGN 64
+
+typedef struct frei0r_mapcache_header
+{
+  char magic[16];
+  uint64_t key_bytes;
+  uint64_t table_bytes;
+} frei0r_mapcache_header_t;
+
+typedef struct frei0r_mapcache
+{
+  void* addr;   /* the mapped file, or 0 */
+  size_t length;
+} frei0r_mapcache_t;
+
+static inline void frei0r_mapcache_init(frei0r_mapcache_t* c)
+{
+  c->addr = 0;
+  c->length = 0;
+}
+
+static inline void frei0r_mapcache_release(frei0r_mapcache_t* c)
+{
+#if defined(FREI0R_MAPCACHE_MMAP)
+  if (c->addr)
+    munmap(c->addr, c->length);
+#endif
+  frei0r_mapcache_init(c);
+}
+
+static inline size_t frei0r_mapcache_round_(size_t n)
+{
+  return (n + FREI0R_MAPCACHE_ALIGN - 1) & ~(size_t)(FREI0R_MAPCACHE_ALIGN - 1);
+}
+
+/* The file of name and key in the cache directory, 0 if the cache is
+   off or the path doesn't fit. */
+static inline const char* frei0r_mapcache_path_(char* path, size_t size,
+                                                const char* name,
+                                                const void* key,
+                                                size_t key_bytes)
+{
+#if defined(FREI0R_MAPCACHE_MMAP)
+  const char* dir = getenv(FREI0R_MAPCACHE_ENV);
+  const unsigned char* k = (const unsigned char*)key;
+  uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
+  size_t i;
+  int n;
+
+  if (!dir || !*dir)
+    return 0;
+  for (i = 0; i < key_bytes; ++i)
+    hash = (hash ^ k[i]) * 1099511628211ULL;
+  n = snprintf(path, size, "%s/%s-%016llx.map", dir, name,
+               (unsigned long long)hash);
+  return n > 0 && (size_t)n < size ? path : 0;
+#else
+  (void)path; (void)size; (void)name; (void)key; (void)key_bytes;
+  return 0;
+#endif
+}
+
+/* Maps the table of table_bytes bytes stored under name and key, and
+   returns it; 0 if there is none. Whatever c mapped before is
+   unmapped. */
+static inline const void* frei0r_mapcache_get(frei0r_mapcache_t* c,
+                                              const char* name,
+                                              const void* key,
+                                              size_t key_bytes,
+                                              size_t table_bytes)
+{
+#if defined(FREI0R_MAPCACHE_MMAP)
+  char buf[4096];
+  const char* path = frei0r_mapcache_path_(buf, sizeof(buf), name, key,
+                                           key_bytes);
+  size_t key_at = frei0r_mapcache_round_(sizeof(frei0r_mapcache_header_t));
+  size_t table_at = key_at + frei0r_mapcache_round_(key_bytes);
+  const frei0r_mapcache_header_t* h;
+  struct stat st;
+  void* addr;
+  int fd;
+
+  frei0r_mapcache_release(c);
+  if (!path)
+    return 0;
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != table_at + table_bytes)
+    {
+      close(fd);
+      return 0;
+    }
+  addr = mmap(0, table_at + table_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return 0;
+  h = (const frei0r_mapcache_header_t*)addr;
+  if (memcmp(h->magic, FREI0R_MAPCACHE_MAGIC, sizeof(FREI0R_MAPCACHE_MAGIC))
+      || h->key_bytes != key_bytes || h->table_bytes != table_bytes
+      || memcmp((const char*)addr + key_at, key, key_bytes))
+    {
+      munmap(addr, table_at + table_bytes);
+      return 0;
+    }
+  c->addr = addr;
+  c->length = table_at + table_bytes;
+  return (const char*)addr + table_at;
+#else
+  (void)name; (void)key; (void)key_bytes; (void)table_bytes;
+  frei0r_mapcache_release(c);
+  return 0;
+#endif
+}
+
+static inline int frei0r_mapcache_write_(int fd, const void* data, size_t n)
+{
+#if defined(FREI0R_MAPCACHE_MMAP)
+  const char* p = (const char*)data;
+  ssize_t w;
+
+  while (n)
+    {
+      w = write(fd, p, n);
+      if (w <= 0)
+        return 0;
+      p += w;
+      n -= (size_t)w;
+    }
+  return 1;
+#else
+  (void)fd; (void)data; (void)n;
+  return 0;
+#endif
+}
+
+/* Stores table, of table_bytes bytes, under name and key. Failures only
+   mean that the table is computed again next time. */
+static inline void frei0r_mapcache_put(const char* name, const void* key,
+                                       size_t key_bytes, const void* table,
+                                       size_t table_bytes)
+{
+#if defined(FREI0R_MAPCACHE_MMAP)
+  char buf[4096], tmp[4096 + 32];
+  const char* path = frei0r_mapcache_path_(buf, sizeof(buf), name, key,
+                                           key_bytes);
+  static const char zeros[FREI0R_MAPCACHE_ALIGN] = { 0 };
+  size_t key_at = frei0r_mapcache_round_(sizeof(frei0r_mapcache_header_t));
+  frei0r_mapcache_header_t h;
+  int fd, ok;
+
+  if (!path)
+    return;
+  snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+  fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, FREI0R_MAPCACHE_MAGIC, sizeof(FREI0R_MAPCACHE_MAGIC));
+  h.key_bytes = key_bytes;
+  h.table_bytes = table_bytes;
+  ok = frei0r_mapcache_write_(fd, &h, sizeof(h))
+    && frei0r_mapcache_write_(fd, zeros, key_at - sizeof(h))
+    && frei0r_mapcache_write_(fd, key, key_bytes)
+    && frei0r_mapcache_write_(fd, zeros,
+                              frei0r_mapcache_round_(key_bytes) - key_bytes)
+    && frei0r_mapcache_write_(fd, table, table_bytes);
+  if (close(fd) != 0)
+    ok = 0;
+  if (!ok || rename(tmp, path) != 0)
+    unlink(tmp);
+#else
+  (void)name; (void)key; (void)key_bytes; (void)table; (void)table_bytes;
+#endif
+}
+
+#endif
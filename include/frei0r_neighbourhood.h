@@ -0,0 +1,255 @@
+#ifndef INCLUDED_FREI0R_NEIGHBOURHOOD_H
+#define INCLUDED_FREI0R_NEIGHBOURHOOD_H
+
+/*
+
+  Engine for filters whose output pixel depends on the pixels around it,
+  like sobel, emboss or cartoon. The engine runs a row function once for
+  every row y of a frame, with the rows y - radius to y + radius of the
+  source at hand:
+
+  static void row(void* user, const uint8_t* const* rows, int y,
+                  void* scratch)
+  {
+    ... rows[radius + dy][bpp * (x + dx) + byte] ...
+  }
+
+  frei0r_neighbourhood_run(src, width, height, bpp, radius, row, user,
+                           scratch_size);
+
+  Pixels are bpp bytes, 4 for packed RGBA or 1 for 8 bit planes. Every
+  row is a copy of the source row padded by radius pixels on both sides,
+  and rows above and below the frame are copies of the first and last
+  one, so that a row function reads x + dx and y + dy without any
+  checks at the borders: pixels outside the frame are those of the
+  nearest border pixel. Each thread copies each source row it needs once
+  into a ring of 2 * radius + 1 rows, sliding down the frame.
+
+  The rows are split over threads in bands (see frei0r_thread.h), a row
+  function may write anything that only depends on its row. scratch is
+  scratch_size bytes of memory of the thread, aligned to 16 bytes, for
+  intermediate results of the row. The source must not be written while
+  the engine runs.
+
+  frei0r_neighbourhood_conv(acc, rows, n, bpp, r, kernel);
+
+  adds up the bytes of the rows weighted by a (2r + 1) x (2r + 1) kernel
+  of integers, acc[i] for the first n bytes of the row, each byte of a
+  pixel on its own. A 3x3 kernel has r = 1, 5x5 r = 2, no more. rows are the
+  rows y - r to y + r, rows + radius - r of the row function when the
+  engine radius is larger. The sums are 16 bit: the sum of the absolute
+  weights times 255 must stay below 32768.
+
+  frei0r_neighbourhood_abs_sum(dst, a, b, n);
+
+  gives MIN(|a[i]| + |b[i]|, 255), for gradient magnitudes like those of
+  sobel.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_thread.h"
+
+/* conv kernels are at most 5x5 */
+#define FREI0R_NEIGHBOURHOOD_MAX_TAPS 25
+
+typedef void (*frei0r_neighbourhood_fn)(void* user,
+                                        const uint8_t* const* rows, int y,
+                                        void* scratch);
+
+typedef struct frei0r_neighbourhood_job_
+{
+  const uint8_t* src;
+  int width, height, bpp, radius;
+  int y0, y1;
+  frei0r_neighbourhood_fn fn;
+  void* user;
+  size_t scratch_size;
+  int failed;
+} frei0r_neighbourhood_job_t;
+
+/* source row y, clamped to the frame, padded by radius pixels */
+static inline void frei0r_neighbourhood_load_(
+  const frei0r_neighbourhood_job_t* job, uint8_t* dst, int y)
+{
+  const int bpp = job->bpp, r = job->radius, w = job->width;
+  const uint8_t* s;
+  int i;
+
+  if (y < 0)
+    y = 0;
+  if (y >= job->height)
+    y = job->height - 1;
+  s = job->src + (size_t)y * w * bpp;
+  memcpy(dst + r * bpp, s, (size_t)w * bpp);
+  for (i = 0; i < r; ++i)
+    {
+      memcpy(dst + i * bpp, s, bpp);
+      memcpy(dst + (r + w + i) * bpp, s + (w - 1) * bpp, bpp);
+    }
+}
+
+static inline void* frei0r_neighbourhood_rows_(void* arg)
+{
+  frei0r_neighbourhood_job_t* job = (frei0r_neighbourhood_job_t*)arg;
+  const int r = job->radius, n = 2 * r + 1;
+  const size_t stride = ((size_t)(job->width + 2 * r) * job->bpp + 15) & ~(size_t)15;
+  /* the ring, the scratch and the row pointers in one block */
+  size_t ring = stride * n;
+  size_t scratch = (job->scratch_size + 15) & ~(size_t)15;
+  uint8_t* block = (uint8_t*)malloc(ring + scratch + n * sizeof(uint8_t*) + 15);
+  uint8_t* base;
+  const uint8_t** rows;
+  int y, j;
+
+  if (!block)
+    {
+      job->failed = 1;
+      return 0;
+    }
+  base = (uint8_t*)(((size_t)block + 15) & ~(size_t)15);
+  rows = (const uint8_t**)(base + ring + scratch);
+
+  /* slot (y mod n) holds row y */
+#define FREI0R_NEIGHBOURHOOD_SLOT_(y) (base + stride * (size_t)(((y) % n + n) % n))
+  for (y = job->y0 - r; y < job->y0 + r; ++y)
+    frei0r_neighbourhood_load_(job, FREI0R_NEIGHBOURHOOD_SLOT_(y), y);
+  for (y = job->y0; y < job->y1; ++y)
+    {
+      frei0r_neighbourhood_load_(job, FREI0R_NEIGHBOURHOOD_SLOT_(y + r), y + r);
+      for (j = 0; j < n; ++j)
+        rows[j] = FREI0R_NEIGHBOURHOOD_SLOT_(y - r + j) + r * job->bpp;
+      job->fn(job->user, rows, y, base + ring);
+    }
+#undef FREI0R_NEIGHBOURHOOD_SLOT_
+
+  free(block);
+  return 0;
+}
+
+/* Returns 0 if it couldn't allocate its buffers; rows may have been
+   done nevertheless. */
+static inline int frei0r_neighbourhood_run(const void* src, int width,
+                                           int height, int bpp, int radius,
+                                           frei0r_neighbourhood_fn fn,
+                                           void* user, size_t scratch_size)
+{
+  frei0r_neighbourhood_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)width * height), ok = 1;
+
+  if (width <= 0 || height <= 0)
+    return 1;
+  for (i = 0; i < n; ++i)
+    {
+      jobs[i].src = (const uint8_t*)src;
+      jobs[i].width = width;
+      jobs[i].height = height;
+      jobs[i].bpp = bpp;
+      jobs[i].radius = radius;
+      jobs[i].y0 = height * i / n;
+      jobs[i].y1 = height * (i + 1) / n;
+      jobs[i].fn = fn;
+      jobs[i].user = user;
+      jobs[i].scratch_size = scratch_size;
+      jobs[i].failed = 0;
+    }
+  frei0r_thread_run(frei0r_neighbourhood_rows_, jobs,
+                    sizeof(frei0r_neighbourhood_job_t), n);
+  for (i = 0; i < n; ++i)
+    if (jobs[i].failed)
+      ok = 0;
+  return ok;
+}
+
+static inline void frei0r_neighbourhood_conv(int16_t* acc,
+                                             const uint8_t* const* rows,
+                                             int n, int bpp, int r,
+                                             const int16_t* kernel)
+{
+  const int side = 2 * r + 1;
+  /* the taps of the kernel that aren't 0 */
+  const uint8_t* tap[FREI0R_NEIGHBOURHOOD_MAX_TAPS];
+  int16_t weight[FREI0R_NEIGHBOURHOOD_MAX_TAPS];
+  int taps = 0, i = 0, t, j, d;
+
+  for (j = 0; j < side; ++j)
+    for (d = -r; d <= r; ++d)
+      if (kernel[j * side + d + r] && taps < FREI0R_NEIGHBOURHOOD_MAX_TAPS)
+        {
+          tap[taps] = rows[j] + d * bpp;
+          weight[taps++] = kernel[j * side + d + r];
+        }
+
+#if defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vk[FREI0R_NEIGHBOURHOOD_MAX_TAPS];
+
+    for (t = 0; t < taps; ++t)
+      vk[t] = _mm_set1_epi16(weight[t]);
+    /* 16 bytes at a time; the padding of the rows covers the taps */
+    for (; i + 16 <= n; i += 16)
+      {
+        __m128i lo = zero, hi = zero;
+
+        for (t = 0; t < taps; ++t)
+          {
+            __m128i v = _mm_loadu_si128((const __m128i*)(tap[t] + i));
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), vk[t]));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), vk[t]));
+          }
+        _mm_storeu_si128((__m128i*)(acc + i), lo);
+        _mm_storeu_si128((__m128i*)(acc + i + 8), hi);
+      }
+  }
+#endif
+  for (; i < n; ++i)
+    {
+      int s = 0;
+
+      for (t = 0; t < taps; ++t)
+        s += weight[t] * tap[t][i];
+      acc[i] = (int16_t)s;
+    }
+}
+
+static inline void frei0r_neighbourhood_abs_sum(uint8_t* dst,
+                                                const int16_t* a,
+                                                const int16_t* b, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i a0 = _mm_loadu_si128((const __m128i*)(a + i));
+      __m128i a1 = _mm_loadu_si128((const __m128i*)(a + i + 8));
+      __m128i b0 = _mm_loadu_si128((const __m128i*)(b + i));
+      __m128i b1 = _mm_loadu_si128((const __m128i*)(b + i + 8));
+
+      a0 = _mm_max_epi16(a0, _mm_sub_epi16(zero, a0));
+      a1 = _mm_max_epi16(a1, _mm_sub_epi16(zero, a1));
+      b0 = _mm_max_epi16(b0, _mm_sub_epi16(zero, b0));
+      b1 = _mm_max_epi16(b1, _mm_sub_epi16(zero, b1));
+      _mm_storeu_si128((__m128i*)(dst + i),
+                       _mm_packus_epi16(_mm_adds_epi16(a0, b0),
+                                        _mm_adds_epi16(a1, b1)));
+    }
+#endif
+  for (; i < n; ++i)
+    {
+      int s = abs(a[i]) + abs(b[i]);
+      dst[i] = (uint8_t)(s > 255 ? 255 : s);
+    }
+}
+
+#endif
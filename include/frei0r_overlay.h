@@ -0,0 +1,98 @@
+#ifndef INCLUDED_FREI0R_OVERLAY_H
+#define INCLUDED_FREI0R_OVERLAY_H
+
+/*
+
+  Overlays like the graph of curves and the histogram of levels: a tile
+  of RGBA8888 pixels is drawn once when what it shows changes, and put
+  over each frame. The alpha byte of a tile pixel says what happens to
+  the frame pixel under it:
+
+  FREI0R_OVERLAY_KEEP      nothing
+  FREI0R_OVERLAY_TINT      its colors go half way to white, 127 + c / 2
+  FREI0R_OVERLAY_PAINT(c)  its colors become those of c
+
+  The alpha of the frame pixel is kept either way. These are the
+  operations the overlays always did per pixel, so the results are
+  unchanged.
+
+  frei0r_overlay_row(dst, src, tile, n)
+
+  puts n tile pixels over the n pixels of src into dst, which may be src,
+  and
+
+  frei0r_overlay_draw(dst, stride, tile, w, h)
+
+  puts a w x h tile over the frame at dst, whose rows are stride pixels
+  apart. With SSE2 four pixels are done per step.
+
+*/
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FREI0R_OVERLAY_KEEP 0x00000000u
+#define FREI0R_OVERLAY_TINT 0x80000000u
+/* c in RGBA8888 byte order: red in the lowest byte */
+#define FREI0R_OVERLAY_PAINT(c) (0xff000000u | ((uint32_t)(c) & 0x00ffffffu))
+
+static inline uint32_t frei0r_overlay_px_(uint32_t t, uint32_t s)
+{
+  switch (t >> 24)
+    {
+    case 0x80:
+      return (((s >> 1) & 0x007f7f7f) + 0x007f7f7f) | (s & 0xff000000);
+    case 0xff:
+      return (t & 0x00ffffff) | (s & 0xff000000);
+    default:
+      return s;
+    }
+}
+
+static inline void frei0r_overlay_row(uint32_t* dst, const uint32_t* src,
+                                      const uint32_t* tile, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+  const __m128i tint = _mm_set1_epi32((int)FREI0R_OVERLAY_TINT);
+  const __m128i c7f = _mm_set1_epi32(0x007f7f7f);
+  __m128i s, t, a, paint, half, tinted, painted;
+
+  for (; i + 4 <= n; i += 4)
+    {
+      s = _mm_loadu_si128((const __m128i*)(src + i));
+      t = _mm_loadu_si128((const __m128i*)(tile + i));
+      a = _mm_and_si128(t, alpha);
+      paint = _mm_cmpeq_epi32(a, alpha);
+      half = _mm_cmpeq_epi32(a, tint);
+      tinted = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(s, 1), c7f), c7f);
+      painted = _mm_andnot_si128(alpha, t);
+      s = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(paint, half),
+                                        _mm_andnot_si128(alpha, s)),
+                       _mm_and_si128(s, alpha));
+      s = _mm_or_si128(s, _mm_or_si128(_mm_and_si128(half, tinted),
+                                       _mm_and_si128(paint, painted)));
+      _mm_storeu_si128((__m128i*)(dst + i), s);
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_overlay_px_(tile[i], src[i]);
+}
+
+static inline void frei0r_overlay_draw(uint32_t* dst, int stride,
+                                       const uint32_t* tile, int w, int h)
+{
+  int y;
+
+  for (y = 0; y < h; ++y)
+    frei0r_overlay_row(dst + (long)y * stride, dst + (long)y * stride,
+                       tile + (long)y * w, w);
+}
+
+#endif
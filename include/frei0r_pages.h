@@ -0,0 +1,54 @@
+#ifndef INCLUDED_FREI0R_PAGES_H
+#define INCLUDED_FREI0R_PAGES_H
+
+/*
+
+  Allocation of the large per-instance buffers of effects (planes, frame
+  histories, remap tables) on huge pages where the system has them. A
+  4K frame is 32 MiB, and effects that read it out of order, like warps
+  and delay lines, miss the TLB on nearly every row with 4 KiB pages;
+  with 2 MiB pages a few dozen entries cover the whole frame.
+
+  void* p = frei0r_pages_alloc(size);
+  ...
+  free(p);
+
+  Buffers of FREI0R_PAGES_MIN bytes and more are aligned to
+  FREI0R_PAGES_HUGE and handed to transparent huge pages with
+  madvise(MADV_HUGEPAGE) on Linux; whether the kernel backs them with
+  huge pages is up to its settings (/sys/kernel/mm/transparent_hugepage),
+  and if it doesn't they are ordinary memory. Smaller buffers, and all
+  buffers on other systems, come from malloc(). Either way the memory
+  is released with free(), and it is at least 64 byte aligned when it
+  is a huge page buffer, and as malloc() aligns otherwise.
+
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#define FREI0R_PAGES_HUGE ((size_t)2 << 20)
+#define FREI0R_PAGES_MIN (4 * FREI0R_PAGES_HUGE)
+
+static inline void* frei0r_pages_alloc(size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  void* ptr;
+
+  if (size < FREI0R_PAGES_MIN)
+    return malloc(size);
+  if (posix_memalign(&ptr, FREI0R_PAGES_HUGE, size) != 0)
+    return 0;
+  /* only whole huge pages, the advice fails harmlessly without THP */
+  madvise(ptr, size & ~(FREI0R_PAGES_HUGE - 1), MADV_HUGEPAGE);
+  return ptr;
+#else
+  return malloc(size);
+#endif
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef INCLUDED_FREI0R_PLANAR_H
+#define INCLUDED_FREI0R_PLANAR_H
+
+/*
+
+  Helpers for filters that implement f0r_update_planar(). A filter that
+  only works on luma processes the Y plane and then either passes chroma
+  through or makes the frame gray:
+
+  int f0r_update_planar(f0r_instance_t instance, double time,
+                        const f0r_planar_frame_t* inframe,
+                        const f0r_planar_frame_t* outframe)
+  {
+    if (!frei0r_planar_check(inframe, outframe))
+      return 0;
+    for (y = 0; y < height; ++y)
+      process(inframe->planes[0] + y * inframe->strides[0],
+              outframe->planes[0] + y * outframe->strides[0], width);
+    frei0r_planar_gray(outframe, width, height);
+    return 1;
+  }
+
+  frei0r_planar_chroma_size gives the size of the chroma planes in bytes,
+  frei0r_planar_copy copies a plane, or nothing if both are the same.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "frei0r.h"
+
+/* inframe and outframe are both of the same planar color model */
+static inline int frei0r_planar_check(const f0r_planar_frame_t* inframe,
+                                      const f0r_planar_frame_t* outframe)
+{
+  return (inframe->color_model == F0R_COLOR_MODEL_YUV420P
+          || inframe->color_model == F0R_COLOR_MODEL_NV12)
+    && outframe->color_model == inframe->color_model;
+}
+
+/* The number of chroma planes, and the bytes per row and the rows of
+   each. */
+static inline int frei0r_planar_chroma_size(const f0r_planar_frame_t* frame,
+                                            unsigned int width,
+                                            unsigned int height,
+                                            unsigned int* row_bytes,
+                                            unsigned int* rows)
+{
+  *rows = (height + 1) / 2;
+  if (frame->color_model == F0R_COLOR_MODEL_NV12)
+    {
+      *row_bytes = (width + 1) / 2 * 2;
+      return 1;
+    }
+  *row_bytes = (width + 1) / 2;
+  return 2;
+}
+
+static inline void frei0r_planar_copy(const uint8_t* src, int src_stride,
+                                      uint8_t* dst, int dst_stride,
+                                      unsigned int row_bytes,
+                                      unsigned int rows)
+{
+  unsigned int y;
+
+  if (src == dst && src_stride == dst_stride)
+    return;
+  for (y = 0; y < rows; ++y)
+    memcpy(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride,
+           row_bytes);
+}
+
+/* passes the chroma planes through */
+static inline void frei0r_planar_copy_chroma(const f0r_planar_frame_t* inframe,
+                                             const f0r_planar_frame_t* outframe,
+                                             unsigned int width,
+                                             unsigned int height)
+{
+  unsigned int row_bytes, rows;
+  int i, n = frei0r_planar_chroma_size(inframe, width, height,
+                                       &row_bytes, &rows);
+
+  for (i = 1; i <= n; ++i)
+    frei0r_planar_copy(inframe->planes[i], inframe->strides[i],
+                       outframe->planes[i], outframe->strides[i],
+                       row_bytes, rows);
+}
+
+/* sets the chroma planes to 128, no color */
+static inline void frei0r_planar_gray(const f0r_planar_frame_t* frame,
+                                      unsigned int width,
+                                      unsigned int height)
+{
+  unsigned int row_bytes, rows, y;
+  int i, n = frei0r_planar_chroma_size(frame, width, height,
+                                       &row_bytes, &rows);
+
+  for (i = 1; i <= n; ++i)
+    for (y = 0; y < rows; ++y)
+      memset(frame->planes[i] + (size_t)y * frame->strides[i], 128,
+             row_bytes);
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef INCLUDED_FREI0R_PORTERDUFF_H
+#define INCLUDED_FREI0R_PORTERDUFF_H
+
+/*
+
+  Porter-Duff compositing of 8 bit per channel packed pixels whose color
+  is premultiplied by alpha. With premultiplied input every operator is
+
+  d = s1 * F1 + s2 * F2
+
+  for all four bytes of a pixel, alpha included, where F1 and F2 depend
+  only on the two alphas. So there are no divides and no special case for
+  transparent pixels:
+
+  operator   F1         F2
+  over       1          1 - a1
+  atop       a2         1 - a1
+  in         a2         0
+  out        1 - a2     0
+  xor        1 - a2     1 - a1
+
+  Alpha is byte 3 of each pixel, so the kernel works for RGBA8888 and
+  BGRA8888 alike. Products are rounded with INT_MULT and the sum saturates
+  at 255, which only matters for invalid input with color above alpha.
+
+  With SSE2 four pixels are done per step in 16 bit lanes. The scalar loop
+  for the remaining pixels and other architectures gives the same results.
+
+*/
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_math.h"
+
+typedef enum frei0r_porterduff_op
+{
+  FREI0R_PORTERDUFF_OVER,
+  FREI0R_PORTERDUFF_ATOP,
+  FREI0R_PORTERDUFF_IN,
+  FREI0R_PORTERDUFF_OUT,
+  FREI0R_PORTERDUFF_XOR
+} frei0r_porterduff_op_t;
+
+/* F1, the weight of src1, is 255, a2 or 255 - a2 */
+static inline uint32_t frei0r_porterduff_f1_(frei0r_porterduff_op_t op,
+                                             uint32_t a2)
+{
+  switch (op)
+    {
+    case FREI0R_PORTERDUFF_ATOP:
+    case FREI0R_PORTERDUFF_IN:
+      return a2;
+    case FREI0R_PORTERDUFF_OUT:
+    case FREI0R_PORTERDUFF_XOR:
+      return 255 - a2;
+    default:
+      return 255;
+    }
+}
+
+/* F2, the weight of src2, is 255 - a1 or 0 */
+static inline int frei0r_porterduff_has_f2_(frei0r_porterduff_op_t op)
+{
+  return op != FREI0R_PORTERDUFF_IN && op != FREI0R_PORTERDUFF_OUT;
+}
+
+static inline uint32_t frei0r_porterduff_px_(frei0r_porterduff_op_t op,
+                                             uint32_t p1, uint32_t p2)
+{
+  uint32_t f1 = frei0r_porterduff_f1_(op, p2 >> 24);
+  uint32_t f2 = 255 - (p1 >> 24);
+  uint32_t q = 0, v, t;
+  int b;
+
+  for (b = 0; b < 32; b += 8)
+    {
+      v = (p1 >> b) & 0xff;
+      if (op != FREI0R_PORTERDUFF_OVER)
+        v = INT_MULT(v, f1, t);
+      if (frei0r_porterduff_has_f2_(op))
+        v += INT_MULT((p2 >> b) & 0xff, f2, t);
+      q |= MIN(v, 255u) << b;
+    }
+  return q;
+}
+
+#if defined(__SSE2__)
+
+/* INT_MULT of 16 bit lanes */
+static inline __m128i frei0r_porterduff_mul_(__m128i a, __m128i b)
+{
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(0x80));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/* the alpha of each of the two pixels in x, in all four lanes */
+static inline __m128i frei0r_porterduff_alpha_(__m128i x)
+{
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xff), 0xff);
+}
+
+/* two pixels in 16 bit lanes */
+static inline __m128i frei0r_porterduff_2px_(frei0r_porterduff_op_t op,
+                                             __m128i s1, __m128i s2)
+{
+  const __m128i c255 = _mm_set1_epi16(0xff);
+  __m128i a2 = frei0r_porterduff_alpha_(s2);
+  __m128i d = s1;
+
+  switch (op)
+    {
+    case FREI0R_PORTERDUFF_ATOP:
+    case FREI0R_PORTERDUFF_IN:
+      d = frei0r_porterduff_mul_(s1, a2);
+      break;
+    case FREI0R_PORTERDUFF_OUT:
+    case FREI0R_PORTERDUFF_XOR:
+      d = frei0r_porterduff_mul_(s1, _mm_sub_epi16(c255, a2));
+      break;
+    default:
+      break;
+    }
+  if (frei0r_porterduff_has_f2_(op))
+    d = _mm_add_epi16(d, frei0r_porterduff_mul_(s2,
+          _mm_sub_epi16(c255, frei0r_porterduff_alpha_(s1))));
+  return d;
+}
+
+#endif
+
+/* dst may be the same buffer as src1 or src2 */
+static inline void frei0r_porterduff_row(frei0r_porterduff_op_t op,
+                                         uint32_t* dst,
+                                         const uint32_t* src1,
+                                         const uint32_t* src2,
+                                         unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  __m128i p1, p2, lo, hi;
+
+  for (; i + 4 <= n; i += 4)
+    {
+      p1 = _mm_loadu_si128((const __m128i*)(src1 + i));
+      p2 = _mm_loadu_si128((const __m128i*)(src2 + i));
+      lo = frei0r_porterduff_2px_(op, _mm_unpacklo_epi8(p1, z),
+                                  _mm_unpacklo_epi8(p2, z));
+      hi = frei0r_porterduff_2px_(op, _mm_unpackhi_epi8(p1, z),
+                                  _mm_unpackhi_epi8(p2, z));
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_porterduff_px_(op, src1[i], src2[i]);
+}
+
+#endif
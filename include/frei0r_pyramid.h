@@ -0,0 +1,422 @@
+#ifndef INCLUDED_FREI0R_PYRAMID_H
+#define INCLUDED_FREI0R_PYRAMID_H
+
+/*
+
+  Wide box blurs of packed 8 bit RGBA frames for glows and blooms:
+
+  frei0r_pyramid_t pyr;
+  frei0r_pyramid_init(&pyr, width, height);
+  ...
+  frei0r_pyramid_blur(&pyr, dst, src, radius);
+  ...
+  frei0r_pyramid_free(&pyr);
+
+  blurs like blur.h: each pixel becomes the mean of the pixels of the
+  (2 radius + 1) x (2 radius + 1) square around it that are inside the
+  frame, each byte on its own. Below 2 * FREI0R_PYRAMID_MIN_RADIUS the
+  result is exactly that of blur.h. The sums of the square are kept per
+  column and slide down the frame, so the cost doesn't grow with the
+  radius and no summed area table of the whole frame is needed.
+
+  Wider blurs don't show small details anyway. The frame is halved
+  (means of 2 x 2 pixels) until the radius is between
+  FREI0R_PYRAMID_MIN_RADIUS and twice that at the small size, blurred
+  there and scaled back up bilinearly. That costs about as much per
+  pixel for any radius, the halving and the scaling up only touch each
+  full size pixel once.
+
+  The passes are split over threads (see frei0r_thread.h), the buffers of
+  the small sizes are allocated on first use and kept. dst must not be
+  src.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_thread.h"
+
+#define FREI0R_PYRAMID_MIN_RADIUS 16
+#define FREI0R_PYRAMID_MAX_LEVELS 16
+
+typedef struct frei0r_pyramid
+{
+  int width, height;
+  /* level l is the frame halved l times, levels[0] is unused */
+  uint32_t* levels[FREI0R_PYRAMID_MAX_LEVELS];
+  uint32_t* blurred; /* the blurred smallest level */
+  size_t blurred_size;
+} frei0r_pyramid_t;
+
+typedef struct frei0r_pyramid_job_
+{
+  const uint32_t* src;
+  uint32_t* dst;
+  int sw, sh;  /* size of src */
+  int dw, dh;  /* size of dst */
+  int radius;
+  int y0, y1;  /* rows of dst */
+  int failed;
+} frei0r_pyramid_job_t;
+
+static inline void frei0r_pyramid_init(frei0r_pyramid_t* pyr, int width,
+                                       int height)
+{
+  memset(pyr, 0, sizeof(*pyr));
+  pyr->width = width;
+  pyr->height = height;
+}
+
+static inline void frei0r_pyramid_free(frei0r_pyramid_t* pyr)
+{
+  int l;
+
+  for (l = 0; l < FREI0R_PYRAMID_MAX_LEVELS; ++l)
+    free(pyr->levels[l]);
+  free(pyr->blurred);
+  memset(pyr->levels, 0, sizeof(pyr->levels));
+  pyr->blurred = 0;
+}
+
+/* width or height at level l */
+static inline int frei0r_pyramid_size_(int size, int l)
+{
+  while (l--)
+    size = (size + 1) / 2;
+  return size;
+}
+
+/* adds (sign 1) or subtracts (sign -1) the sliding sums of 2r+1 pixels
+   of a row, 4 bytes each and clamped to the row, to acc */
+static inline void frei0r_pyramid_row_sums_(uint32_t* acc, const uint8_t* p,
+                                            int w, int r, int sign)
+{
+  int x;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i s = zero;
+
+#define FREI0R_PYRAMID_PIXEL_(x) \
+  _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)(p + 4 * (x))), zero), zero)
+  for (x = 0; x < w && x < r; ++x)
+    s = _mm_add_epi32(s, FREI0R_PYRAMID_PIXEL_(x));
+  for (x = 0; x < w; ++x)
+    {
+      __m128i* a = (__m128i*)(acc + 4 * x);
+
+      if (x + r < w)
+        s = _mm_add_epi32(s, FREI0R_PYRAMID_PIXEL_(x + r));
+      if (sign > 0)
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), s));
+      else
+        _mm_storeu_si128(a, _mm_sub_epi32(_mm_loadu_si128(a), s));
+      if (x - r >= 0)
+        s = _mm_sub_epi32(s, FREI0R_PYRAMID_PIXEL_(x - r));
+    }
+#undef FREI0R_PYRAMID_PIXEL_
+#else
+  uint32_t s[4] = { 0, 0, 0, 0 };
+  int b;
+
+  for (x = 0; x < w && x < r; ++x)
+    for (b = 0; b < 4; ++b)
+      s[b] += p[4 * x + b];
+  for (x = 0; x < w; ++x)
+    for (b = 0; b < 4; ++b)
+      {
+        if (x + r < w)
+          s[b] += p[4 * (x + r) + b];
+        acc[4 * x + b] += sign > 0 ? s[b] : -s[b];
+        if (x - r >= 0)
+          s[b] -= p[4 * (x - r) + b];
+      }
+#endif
+}
+
+/* box blur of rows [y0, y1) of dst */
+static inline void* frei0r_pyramid_box_(void* arg)
+{
+  frei0r_pyramid_job_t* job = (frei0r_pyramid_job_t*)arg;
+  const int w = job->sw, h = job->sh, r = job->radius;
+  uint32_t* acc = (uint32_t*)calloc((size_t)w * 4, sizeof(uint32_t));
+  int x, y, cy;
+
+  if (!acc)
+    {
+      job->failed = 1;
+      return 0;
+    }
+  /* the sums of the rows above the first one */
+  for (y = job->y0 - r; y < job->y0 + r; ++y)
+    if (y >= 0 && y < h)
+      frei0r_pyramid_row_sums_(acc, (const uint8_t*)(job->src + (size_t)y * w), w, r, 1);
+
+  for (y = job->y0; y < job->y1; ++y)
+    {
+      uint8_t* dst = (uint8_t*)(job->dst + (size_t)y * w);
+#if defined(__SSE2__)
+      unsigned int last_area = 0;
+      __m128d scale = _mm_setzero_pd();
+      const __m128d half = _mm_set1_pd(0.5);
+#endif
+
+      if (y + r < h)
+        frei0r_pyramid_row_sums_(acc, (const uint8_t*)(job->src + (size_t)(y + r) * w), w, r, 1);
+      if (y - r - 1 >= 0)
+        frei0r_pyramid_row_sums_(acc, (const uint8_t*)(job->src + (size_t)(y - r - 1) * w), w, r, -1);
+      cy = (y + r < h ? y + r + 1 : h) - (y - r > 0 ? y - r : 0);
+      for (x = 0; x < w; ++x)
+        {
+          int cx = (x + r < w ? x + r + 1 : w) - (x - r > 0 ? x - r : 0);
+          unsigned int area = (unsigned int)(cx * cy);
+#if defined(__SSE2__)
+          /* (sum + 0.5) * (1 / area) truncated is the integer quotient,
+             as in blur.h */
+          __m128i s = _mm_loadu_si128((const __m128i*)(acc + 4 * x));
+          __m128i lo, hi;
+
+          if (area != last_area)
+            {
+              scale = _mm_set1_pd(1.0 / area);
+              last_area = area;
+            }
+          lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(_mm_cvtepi32_pd(s), half), scale));
+          hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(s, 0xEE)), half), scale));
+          s = _mm_unpacklo_epi64(lo, hi);
+          s = _mm_packs_epi32(s, s);
+          *(int*)(dst + 4 * x) = _mm_cvtsi128_si32(_mm_packus_epi16(s, s));
+#else
+          int i;
+
+          for (i = 0; i < 4; ++i)
+            dst[4 * x + i] = (uint8_t)(acc[4 * x + i] / area);
+#endif
+        }
+    }
+  free(acc);
+  return 0;
+}
+
+/* rows [y0, y1) of dst, the means of 2 x 2 pixels of src, whose last
+   row and column are repeated when there are an odd number of them */
+static inline void* frei0r_pyramid_down_(void* arg)
+{
+  frei0r_pyramid_job_t* job = (frei0r_pyramid_job_t*)arg;
+  const int sw = job->sw;
+  int x, y, b;
+
+  for (y = job->y0; y < job->y1; ++y)
+    {
+      const uint8_t* s0 = (const uint8_t*)(job->src + (size_t)(2 * y) * sw);
+      const uint8_t* s1 = 2 * y + 1 < job->sh ? s0 + 4 * sw : s0;
+      uint8_t* d = (uint8_t*)(job->dst + (size_t)y * job->dw);
+
+      x = 0;
+#if defined(__SSE2__)
+      {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+
+        /* two pixels of dst from four of each source row */
+        for (; 2 * x + 4 <= sw; x += 2)
+          {
+            __m128i a = _mm_loadu_si128((const __m128i*)(s0 + 8 * x));
+            __m128i c = _mm_loadu_si128((const __m128i*)(s1 + 8 * x));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero));
+
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+            _mm_storel_epi64((__m128i*)(d + 4 * x), _mm_packus_epi16(lo, lo));
+          }
+      }
+#endif
+      for (; x < job->dw; ++x)
+        {
+          const int x0 = 2 * x, x1 = 2 * x + 1 < sw ? 2 * x + 1 : 2 * x;
+
+          for (b = 0; b < 4; ++b)
+            d[4 * x + b] = (uint8_t)((s0[4 * x0 + b] + s0[4 * x1 + b]
+                                      + s1[4 * x0 + b] + s1[4 * x1 + b] + 2) >> 2);
+        }
+    }
+  return 0;
+}
+
+/* source sample i, i1 and the weight of i1 in 256ths for pixel d of n
+   scaled from size samples, pixel centers aligned */
+static inline void frei0r_pyramid_tap_(int d, int n, int size, int* i,
+                                       int* i1, int* w)
+{
+  double s = (d + 0.5) * size / n - 0.5;
+
+  *i = s < 0 ? 0 : (int)s;
+  *w = s < 0 ? 0 : (int)((s - *i) * 256 + 0.5);
+  if (*i >= size - 1)
+    {
+      *i = size - 1;
+      *w = 0;
+    }
+  *i1 = *i + 1 < size ? *i + 1 : *i;
+}
+
+/* rows [y0, y1) of dst, src scaled up bilinearly */
+static inline void* frei0r_pyramid_up_(void* arg)
+{
+  frei0r_pyramid_job_t* job = (frei0r_pyramid_job_t*)arg;
+  const int sw = job->sw, dw = job->dw;
+  /* the taps of the columns, then a row of src blended vertically in
+     15 bit fixed point */
+  int* tx = (int*)malloc((size_t)dw * 3 * sizeof(int) + (size_t)sw * 4 * sizeof(int16_t));
+  int16_t* v;
+  int x, y;
+
+  if (!tx)
+    {
+      job->failed = 1;
+      return 0;
+    }
+  v = (int16_t*)(tx + 3 * dw);
+  for (x = 0; x < dw; ++x)
+    frei0r_pyramid_tap_(x, dw, sw, &tx[3 * x], &tx[3 * x + 1], &tx[3 * x + 2]);
+
+  for (y = job->y0; y < job->y1; ++y)
+    {
+      const uint8_t *c0, *c1;
+      uint8_t* d = (uint8_t*)(job->dst + (size_t)y * dw);
+      int i, i1, wy;
+
+      frei0r_pyramid_tap_(y, job->dh, job->sh, &i, &i1, &wy);
+      c0 = (const uint8_t*)(job->src + (size_t)i * sw);
+      c1 = (const uint8_t*)(job->src + (size_t)i1 * sw);
+      for (x = 0; x < 4 * sw; ++x)
+        v[x] = (int16_t)((c0[x] * (256 - wy) + c1[x] * wy) >> 1);
+
+      for (x = 0; x < dw; ++x)
+        {
+          const int16_t* v0 = v + 4 * tx[3 * x];
+          const int16_t* v1 = v + 4 * tx[3 * x + 1];
+          const int wx = tx[3 * x + 2];
+#if defined(__SSE2__)
+          __m128i p = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)v0),
+                                         _mm_loadl_epi64((const __m128i*)v1));
+          p = _mm_madd_epi16(p, _mm_set1_epi32((wx << 16) | (256 - wx)));
+          p = _mm_srai_epi32(_mm_add_epi32(p, _mm_set1_epi32(1 << 14)), 15);
+          p = _mm_packs_epi32(p, p);
+          *(int*)(d + 4 * x) = _mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+#else
+          int b;
+
+          for (b = 0; b < 4; ++b)
+            d[4 * x + b] = (uint8_t)((v0[b] * (256 - wx) + v1[b] * wx + (1 << 14)) >> 15);
+#endif
+        }
+    }
+  free(tx);
+  return 0;
+}
+
+/* runs a pass over the rows of a dst of dw x dh; 0 if it failed */
+static inline int frei0r_pyramid_run_(void* (*pass)(void*), uint32_t* dst,
+                                      int dw, int dh, const uint32_t* src,
+                                      int sw, int sh, int radius)
+{
+  frei0r_pyramid_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)dw * dh), ok = 1;
+
+  for (i = 0; i < n; ++i)
+    {
+      jobs[i].src = src;
+      jobs[i].dst = dst;
+      jobs[i].sw = sw;
+      jobs[i].sh = sh;
+      jobs[i].dw = dw;
+      jobs[i].dh = dh;
+      jobs[i].radius = radius;
+      jobs[i].y0 = dh * i / n;
+      jobs[i].y1 = dh * (i + 1) / n;
+      jobs[i].failed = 0;
+    }
+  frei0r_thread_run(pass, jobs, sizeof(frei0r_pyramid_job_t), n);
+  for (i = 0; i < n; ++i)
+    if (jobs[i].failed)
+      ok = 0;
+  return ok;
+}
+
+/* how many times the frame is halved for a blur of the radius */
+static inline int frei0r_pyramid_levels(const frei0r_pyramid_t* pyr,
+                                        int radius)
+{
+  int l = 0;
+
+  while (l + 1 < FREI0R_PYRAMID_MAX_LEVELS
+         && (radius >> (l + 1)) >= FREI0R_PYRAMID_MIN_RADIUS
+         && frei0r_pyramid_size_(pyr->width, l + 1) > 1
+         && frei0r_pyramid_size_(pyr->height, l + 1) > 1)
+    ++l;
+  return l;
+}
+
+/* Returns 0 if it couldn't allocate its buffers. */
+static inline int frei0r_pyramid_blur(frei0r_pyramid_t* pyr, uint32_t* dst,
+                                      const uint32_t* src, int radius)
+{
+  const uint32_t* s = src;
+  int levels, l, w = pyr->width, h = pyr->height;
+  size_t size;
+
+  if (w <= 0 || h <= 0)
+    return 1;
+  /* any wider square covers the whole frame for every pixel */
+  if (radius > w && radius > h)
+    radius = w > h ? w : h;
+  if (radius <= 0)
+    {
+      memcpy(dst, src, (size_t)w * h * sizeof(uint32_t));
+      return 1;
+    }
+  levels = frei0r_pyramid_levels(pyr, radius);
+  if (levels == 0)
+    return frei0r_pyramid_run_(frei0r_pyramid_box_, dst, w, h, src, w, h, radius);
+
+  for (l = 1; l <= levels; ++l)
+    {
+      int lw = frei0r_pyramid_size_(pyr->width, l);
+      int lh = frei0r_pyramid_size_(pyr->height, l);
+
+      if (!pyr->levels[l])
+        pyr->levels[l] = (uint32_t*)malloc((size_t)lw * lh * sizeof(uint32_t));
+      if (!pyr->levels[l])
+        return 0;
+      frei0r_pyramid_run_(frei0r_pyramid_down_, pyr->levels[l], lw, lh, s, w, h, 0);
+      s = pyr->levels[l];
+      w = lw;
+      h = lh;
+    }
+
+  size = (size_t)w * h;
+  if (pyr->blurred_size < size)
+    {
+      free(pyr->blurred);
+      pyr->blurred = (uint32_t*)malloc(size * sizeof(uint32_t));
+      pyr->blurred_size = pyr->blurred ? size : 0;
+      if (!pyr->blurred)
+        return 0;
+    }
+  /* the radius at the small size, rounded */
+  radius = (radius + (1 << (levels - 1))) >> levels;
+  if (!frei0r_pyramid_run_(frei0r_pyramid_box_, pyr->blurred, w, h, s, w, h, radius))
+    return 0;
+  return frei0r_pyramid_run_(frei0r_pyramid_up_, dst, pyr->width, pyr->height,
+                             pyr->blurred, w, h, 0);
+}
+
+#endif
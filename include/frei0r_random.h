@@ -0,0 +1,237 @@
+#ifndef INCLUDED_FREI0R_RANDOM_H
+#define INCLUDED_FREI0R_RANDOM_H
+
+/*
+
+  Random numbers for noise effects, in independent streams that are
+  cheap to start. Noise effects use one stream per row and derive its
+  seed from the time of the frame, so rows can be done on several threads
+  and every frame comes out the same each time it is rendered:
+
+  frei0r_random_t r;
+  frei0r_random_init(&r, frei0r_random_frame_seed(seed, time), y);
+  frei0r_random_fill(&r, values, width);
+
+  where seed is a parameter of the effect, so that several instances can
+  make different noise. Nothing carries over from one frame to the next,
+  so frames can also be rendered out of order or on different machines.
+
+  frei0r_random_next gives one value at a time, frei0r_random_below one
+  in [0, n).
+
+  A stream is 8 xoshiro128+ generators (by David Blackman and Sebastiano
+  Vigna) run side by side, value i comes from generator i % 8. The lowest
+  bits are the weakest, take the top bits where fewer are needed. The
+  state is seeded through an integer hash (lowbias32 by Chris Wellons) of
+  the seed, the stream and the generator.
+
+  The vector code is chosen at compile time: 8 values per step with AVX2,
+  SSE2 or NEON. All paths give the same values.
+
+*/
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define FREI0R_RANDOM_LANES 8 /* the vector code assumes 8 */
+
+typedef struct frei0r_random
+{
+  uint32_t s[4][FREI0R_RANDOM_LANES]; /* word j of generator i is s[j][i] */
+  uint32_t buf[FREI0R_RANDOM_LANES];  /* for frei0r_random_next */
+  unsigned int pos;
+} frei0r_random_t;
+
+static inline uint32_t frei0r_random_mix_(uint32_t x)
+{
+  x ^= x >> 16; x *= 0x7feb352dU;
+  x ^= x >> 15; x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+/* stream of seed, e.g. one per row */
+static inline void frei0r_random_init(frei0r_random_t* r, uint32_t seed,
+                                      uint32_t stream)
+{
+  uint32_t k = frei0r_random_mix_(seed ^ frei0r_random_mix_(stream
+                                                            + 0x9e3779b9U));
+  int i, j;
+
+  for (j = 0; j < 4; ++j)
+    for (i = 0; i < FREI0R_RANDOM_LANES; ++i)
+      {
+        k += 0x9e3779b9U;
+        r->s[j][i] = frei0r_random_mix_(k);
+      }
+  /* an all zero state would only give zeros */
+  for (i = 0; i < FREI0R_RANDOM_LANES; ++i)
+    r->s[0][i] |= 1;
+  r->pos = FREI0R_RANDOM_LANES;
+}
+
+/* a seed for the frame at time, in steps of 10 microseconds */
+static inline uint32_t frei0r_random_time_seed(double time)
+{
+  uint64_t t = (uint64_t)(int64_t)(time * 100000.0);
+  return frei0r_random_mix_((uint32_t)t
+                            ^ frei0r_random_mix_((uint32_t)(t >> 32)));
+}
+
+/* a seed for the frame at time of an effect whose seed parameter is seed */
+static inline uint32_t frei0r_random_frame_seed(double seed, double time)
+{
+  uint64_t s = (uint64_t)(int64_t)(seed * 4294967296.0);
+  return frei0r_random_mix_(frei0r_random_time_seed(time)
+                            ^ frei0r_random_mix_((uint32_t)s
+                                                 + 0x632be5abU)
+                            ^ frei0r_random_mix_((uint32_t)(s >> 32)));
+}
+
+/* the next blocks values of each generator, generator i gives
+   dst[8 * b + i] */
+static inline void frei0r_random_blocks_(frei0r_random_t* r, uint32_t* dst,
+                                         unsigned int blocks)
+{
+  unsigned int b;
+#if defined(__AVX2__)
+  __m256i s0 = _mm256_loadu_si256((const __m256i*)r->s[0]);
+  __m256i s1 = _mm256_loadu_si256((const __m256i*)r->s[1]);
+  __m256i s2 = _mm256_loadu_si256((const __m256i*)r->s[2]);
+  __m256i s3 = _mm256_loadu_si256((const __m256i*)r->s[3]);
+
+  for (b = 0; b < blocks; ++b)
+    {
+      __m256i t = _mm256_slli_epi32(s1, 9);
+      _mm256_storeu_si256((__m256i*)(dst + 8 * b), _mm256_add_epi32(s0, s3));
+      s2 = _mm256_xor_si256(s2, s0);
+      s3 = _mm256_xor_si256(s3, s1);
+      s1 = _mm256_xor_si256(s1, s2);
+      s0 = _mm256_xor_si256(s0, s3);
+      s2 = _mm256_xor_si256(s2, t);
+      s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11),
+                           _mm256_srli_epi32(s3, 21));
+    }
+  _mm256_storeu_si256((__m256i*)r->s[0], s0);
+  _mm256_storeu_si256((__m256i*)r->s[1], s1);
+  _mm256_storeu_si256((__m256i*)r->s[2], s2);
+  _mm256_storeu_si256((__m256i*)r->s[3], s3);
+#elif defined(__SSE2__)
+  __m128i s0[2], s1[2], s2[2], s3[2], t;
+  int h;
+
+  for (h = 0; h < 2; ++h)
+    {
+      s0[h] = _mm_loadu_si128((const __m128i*)(r->s[0] + 4 * h));
+      s1[h] = _mm_loadu_si128((const __m128i*)(r->s[1] + 4 * h));
+      s2[h] = _mm_loadu_si128((const __m128i*)(r->s[2] + 4 * h));
+      s3[h] = _mm_loadu_si128((const __m128i*)(r->s[3] + 4 * h));
+    }
+  for (b = 0; b < blocks; ++b)
+    for (h = 0; h < 2; ++h)
+      {
+        t = _mm_slli_epi32(s1[h], 9);
+        _mm_storeu_si128((__m128i*)(dst + 8 * b + 4 * h),
+                         _mm_add_epi32(s0[h], s3[h]));
+        s2[h] = _mm_xor_si128(s2[h], s0[h]);
+        s3[h] = _mm_xor_si128(s3[h], s1[h]);
+        s1[h] = _mm_xor_si128(s1[h], s2[h]);
+        s0[h] = _mm_xor_si128(s0[h], s3[h]);
+        s2[h] = _mm_xor_si128(s2[h], t);
+        s3[h] = _mm_or_si128(_mm_slli_epi32(s3[h], 11),
+                             _mm_srli_epi32(s3[h], 21));
+      }
+  for (h = 0; h < 2; ++h)
+    {
+      _mm_storeu_si128((__m128i*)(r->s[0] + 4 * h), s0[h]);
+      _mm_storeu_si128((__m128i*)(r->s[1] + 4 * h), s1[h]);
+      _mm_storeu_si128((__m128i*)(r->s[2] + 4 * h), s2[h]);
+      _mm_storeu_si128((__m128i*)(r->s[3] + 4 * h), s3[h]);
+    }
+#elif defined(__ARM_NEON)
+  uint32x4_t s0[2], s1[2], s2[2], s3[2], t;
+  int h;
+
+  for (h = 0; h < 2; ++h)
+    {
+      s0[h] = vld1q_u32(r->s[0] + 4 * h);
+      s1[h] = vld1q_u32(r->s[1] + 4 * h);
+      s2[h] = vld1q_u32(r->s[2] + 4 * h);
+      s3[h] = vld1q_u32(r->s[3] + 4 * h);
+    }
+  for (b = 0; b < blocks; ++b)
+    for (h = 0; h < 2; ++h)
+      {
+        t = vshlq_n_u32(s1[h], 9);
+        vst1q_u32(dst + 8 * b + 4 * h, vaddq_u32(s0[h], s3[h]));
+        s2[h] = veorq_u32(s2[h], s0[h]);
+        s3[h] = veorq_u32(s3[h], s1[h]);
+        s1[h] = veorq_u32(s1[h], s2[h]);
+        s0[h] = veorq_u32(s0[h], s3[h]);
+        s2[h] = veorq_u32(s2[h], t);
+        s3[h] = vsriq_n_u32(vshlq_n_u32(s3[h], 11), s3[h], 21);
+      }
+  for (h = 0; h < 2; ++h)
+    {
+      vst1q_u32(r->s[0] + 4 * h, s0[h]);
+      vst1q_u32(r->s[1] + 4 * h, s1[h]);
+      vst1q_u32(r->s[2] + 4 * h, s2[h]);
+      vst1q_u32(r->s[3] + 4 * h, s3[h]);
+    }
+#else
+  int i;
+  for (b = 0; b < blocks; ++b)
+    for (i = 0; i < FREI0R_RANDOM_LANES; ++i)
+      {
+        uint32_t t = r->s[1][i] << 9;
+
+        dst[8 * b + i] = r->s[0][i] + r->s[3][i];
+        r->s[2][i] ^= r->s[0][i];
+        r->s[3][i] ^= r->s[1][i];
+        r->s[1][i] ^= r->s[2][i];
+        r->s[0][i] ^= r->s[3][i];
+        r->s[2][i] ^= t;
+        r->s[3][i] = (r->s[3][i] << 11) | (r->s[3][i] >> 21);
+      }
+#endif
+}
+
+/* n values, the stream moves on by n rounded up to a multiple of 8 */
+static inline void frei0r_random_fill(frei0r_random_t* r, uint32_t* dst,
+                                      unsigned int n)
+{
+  unsigned int i = n / FREI0R_RANDOM_LANES * FREI0R_RANDOM_LANES;
+  frei0r_random_blocks_(r, dst, n / FREI0R_RANDOM_LANES);
+  if (i < n)
+    {
+      uint32_t rest[FREI0R_RANDOM_LANES];
+      frei0r_random_blocks_(r, rest, 1);
+      for (; i < n; ++i)
+        dst[i] = rest[i % FREI0R_RANDOM_LANES];
+    }
+}
+
+static inline uint32_t frei0r_random_next(frei0r_random_t* r)
+{
+  if (r->pos == FREI0R_RANDOM_LANES)
+    {
+      frei0r_random_blocks_(r, r->buf, 1);
+      r->pos = 0;
+    }
+  return r->buf[r->pos++];
+}
+
+/* a value in [0, n), n > 0 */
+static inline uint32_t frei0r_random_below(frei0r_random_t* r, uint32_t n)
+{
+  return (uint32_t)(((uint64_t)frei0r_random_next(r) * n) >> 32);
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef INCLUDED_FREI0R_RASTER_H
+#define INCLUDED_FREI0R_RASTER_H
+
+/*
+
+  Drawing primitives for generators that draw their patterns into planes
+  of float values, like the test_pat plugins:
+
+  frei0r_raster_rect       fills a rectangle, clipped to the plane
+  frei0r_raster_ring       fills the pixels at a distance in [rmin, rmax]
+                           from a center, row by row in spans
+  frei0r_raster_cos        offset + amp * cos(phase) of an array of phases
+  frei0r_raster_wave       offset + amp * cos(p0 + i * dp), a sine wave
+
+  Rings are drawn as at most two spans per row. Their ends are found from
+  a square root per row and then checked with the same float expression
+  as the per pixel test
+
+  sqrtf(dy*dy + dx*dx*ar*ar) <= r
+
+  so the spans cover exactly the pixels that test covers. Plugins with
+  other pixel types get the spans from frei0r_raster_ring_spans. Edges
+  are not anti-aliased, since test patterns are meant to show the
+  filtering of whatever processes them, not their own.
+
+  The cosine is evaluated 4 values per step with SSE2, with the range
+  reduction and polynomials of the cephes cosf (as in sse_mathfun by
+  Julien Pommier); the scalar code for other architectures gives the
+  same results. It is accurate to about 1e-7 for phases up to a few
+  thousand radians and stays within about 1e-6 beyond. frei0r_raster_wave
+  reduces its phases in double precision first, so long waves keep
+  their accuracy.
+
+*/
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* values per block of frei0r_raster_wave */
+#define FREI0R_RASTER_BLOCK 64
+
+/* clips [*x0, *x1) x [*y0, *y1) to the plane, returns 0 if it's empty */
+static inline int frei0r_raster_clip(int w, int h, int* x0, int* y0,
+                                     int* x1, int* y1)
+{
+  if (*x0 < 0) *x0 = 0;
+  if (*y0 < 0) *y0 = 0;
+  if (*x1 > w) *x1 = w;
+  if (*y1 > h) *y1 = h;
+  return *x0 < *x1 && *y0 < *y1;
+}
+
+static inline void frei0r_raster_span(float* dst, int n, float v)
+{
+  int i;
+  for (i = 0; i < n; ++i)
+    dst[i] = v;
+}
+
+/* the wr x hr rectangle with its upper left corner at x, y */
+static inline void frei0r_raster_rect(float* sl, int w, int h, int x, int y,
+                                      int wr, int hr, float v)
+{
+  int x0 = x, y0 = y, x1 = x + wr, y1 = y + hr, i;
+
+  if (!frei0r_raster_clip(w, h, &x0, &y0, &x1, &y1))
+    return;
+  for (i = y0; i < y1; ++i)
+    frei0r_raster_span(sl + w * i + x0, x1 - x0, v);
+}
+
+/* whether sqrtf(dy*dy + dx*dx*ar*ar) is below r, or not above it */
+static inline int frei0r_raster_inside_(int dy, int dx, float ar, float r,
+                                        int strict)
+{
+  float rr = sqrtf(dy * dy + dx * dx * ar * ar);
+  return strict ? rr < r : rr <= r;
+}
+
+/* The largest dx >= 0 that is inside the circle of radius r on row dy,
+   or -1 if no pixel of the row is. strict excludes the circle itself. */
+static inline int frei0r_raster_disc_extent(int dy, float ar, float r,
+                                            int strict)
+{
+  float q = r * r - (float)dy * dy;
+  int dx;
+
+  if (ar <= 0) /* the whole row or nothing */
+    return frei0r_raster_inside_(dy, 0, ar, r, strict) ? 1 << 29 : -1;
+  dx = q < 0 ? 0 : (int)(sqrtf(q) / ar);
+  /* the square root only gives the neighbourhood, the pixel test has
+     the last word */
+  while (frei0r_raster_inside_(dy, dx + 1, ar, r, strict))
+    ++dx;
+  while (dx >= 0 && !frei0r_raster_inside_(dy, dx, ar, r, strict))
+    --dx;
+  return dx;
+}
+
+/* The columns of row y inside the ring of center x, y0 as [a, b) spans,
+   clipped to [x0, x1). Returns their number, 0 to 2. */
+static inline int frei0r_raster_ring_spans(int y, int x, int y0, float ar,
+                                           float rmin, float rmax,
+                                           int x0, int x1, int spans[4])
+{
+  int outer = frei0r_raster_disc_extent(y - y0, ar, rmax, 0);
+  int inner = frei0r_raster_disc_extent(y - y0, ar, rmin, 1);
+  int n = 0, a[2], b[2], i;
+
+  if (outer < 0)
+    return 0;
+  if (inner < 0)
+    {
+      a[0] = x - outer; b[0] = x + outer + 1;
+      a[1] = b[1] = 0;
+    }
+  else
+    {
+      a[0] = x - outer; b[0] = x - inner;
+      a[1] = x + inner + 1; b[1] = x + outer + 1;
+    }
+  for (i = 0; i < 2; ++i)
+    {
+      if (a[i] < x0) a[i] = x0;
+      if (b[i] > x1) b[i] = x1;
+      if (a[i] < b[i])
+        {
+          spans[2 * n] = a[i];
+          spans[2 * n + 1] = b[i];
+          ++n;
+        }
+    }
+  return n;
+}
+
+/* The pixels at a distance in [rmin, rmax] from x, y within the box
+   [x0, x1) x [y0, y1), which must lie in the plane. ar is the pixel
+   aspect ratio, horizontal distances are multiplied by it. */
+static inline void frei0r_raster_ring(float* sl, int w, int x0, int y0,
+                                      int x1, int y1, float ar, int x, int y,
+                                      float rmin, float rmax, float v)
+{
+  int spans[4], i, n, k;
+
+  for (i = y0; i < y1; ++i)
+    {
+      n = frei0r_raster_ring_spans(i, x, y, ar, rmin, rmax, x0, x1, spans);
+      for (k = 0; k < n; ++k)
+        frei0r_raster_span(sl + w * i + spans[2 * k],
+                           spans[2 * k + 1] - spans[2 * k], v);
+    }
+}
+
+/* cephes cosf: reduction to [-pi/4, pi/4] in three steps, and the
+   octant selects the sine or the cosine polynomial and the sign */
+#define FREI0R_RASTER_FOPI 1.27323954473516f
+#define FREI0R_RASTER_DP1 0.78515625f
+#define FREI0R_RASTER_DP2 2.4187564849853515625e-4f
+#define FREI0R_RASTER_DP3 3.77489497744594108e-8f
+
+static inline float frei0r_raster_cos_1_(float x)
+{
+  float y, z, c, s, r;
+  int j;
+
+  x = fabsf(x);
+  j = ((int)(x * FREI0R_RASTER_FOPI) + 1) & ~1;
+  y = (float)j;
+  j -= 2;
+  x = x - y * FREI0R_RASTER_DP1;
+  x = x - y * FREI0R_RASTER_DP2;
+  x = x - y * FREI0R_RASTER_DP3;
+  z = x * x;
+  c = 2.443315711809948e-5f;
+  c = c * z - 1.388731625493765e-3f;
+  c = c * z + 4.166664568298827e-2f;
+  c = c * z;
+  c = c * z;
+  c = c - z * 0.5f;
+  c = c + 1.0f;
+  s = -1.9515295891e-4f;
+  s = s * z + 8.3321608736e-3f;
+  s = s * z - 1.6666654611e-1f;
+  s = s * z;
+  s = s * x;
+  s = s + x;
+  r = (j & 2) ? c : s;
+  return (j & 4) ? r : -r;
+}
+
+#if defined(__SSE2__)
+
+static inline __m128 frei0r_raster_cos_4_(__m128 x)
+{
+  const __m128i c2 = _mm_set1_epi32(2);
+  __m128 y, z, c, s, poly, sign;
+  __m128i j;
+
+  x = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+  j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FREI0R_RASTER_FOPI)));
+  j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+  y = _mm_cvtepi32_ps(j);
+  j = _mm_sub_epi32(j, c2);
+  sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(j,
+                                           _mm_set1_epi32(4)), 29));
+  poly = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, c2),
+                                          _mm_setzero_si128()));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(FREI0R_RASTER_DP1)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(FREI0R_RASTER_DP2)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(FREI0R_RASTER_DP3)));
+  z = _mm_mul_ps(x, x);
+  c = _mm_set1_ps(2.443315711809948e-5f);
+  c = _mm_sub_ps(_mm_mul_ps(c, z), _mm_set1_ps(1.388731625493765e-3f));
+  c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+  c = _mm_mul_ps(c, z);
+  c = _mm_mul_ps(c, z);
+  c = _mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  c = _mm_add_ps(c, _mm_set1_ps(1.0f));
+  s = _mm_set1_ps(-1.9515295891e-4f);
+  s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(8.3321608736e-3f));
+  s = _mm_sub_ps(_mm_mul_ps(s, z), _mm_set1_ps(1.6666654611e-1f));
+  s = _mm_mul_ps(s, z);
+  s = _mm_mul_ps(s, x);
+  s = _mm_add_ps(s, x);
+  return _mm_xor_ps(_mm_or_ps(_mm_and_ps(poly, s), _mm_andnot_ps(poly, c)),
+                    sign);
+}
+
+#endif
+
+/* dst[i] = offset + amp * cos(phase[i]), dst may be phase */
+static inline void frei0r_raster_cos(float* dst, const float* phase, int n,
+                                     float offset, float amp)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 o = _mm_set1_ps(offset), a = _mm_set1_ps(amp);
+
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(dst + i,
+                  _mm_add_ps(o, _mm_mul_ps(a, frei0r_raster_cos_4_(
+                                               _mm_loadu_ps(phase + i)))));
+#endif
+  for (; i < n; ++i)
+    dst[i] = offset + amp * frei0r_raster_cos_1_(phase[i]);
+}
+
+/* dst[i] = offset + amp * cos(p0 + i * dp) for i in [0, n) */
+static inline void frei0r_raster_wave(float* dst, int n, double p0,
+                                      double dp, float offset, float amp)
+{
+  const double two_pi = 6.283185307179586;
+  float phase[FREI0R_RASTER_BLOCK];
+  int i, k, m;
+
+  for (i = 0; i < n; i += FREI0R_RASTER_BLOCK)
+    {
+      m = n - i < FREI0R_RASTER_BLOCK ? n - i : FREI0R_RASTER_BLOCK;
+      for (k = 0; k < m; ++k)
+        {
+          double p = p0 + (i + k) * dp;
+          phase[k] = (float)(p - two_pi * floor(p / two_pi + 0.5));
+        }
+      frei0r_raster_cos(dst + i, phase, m, offset, amp);
+    }
+}
+
+#endif
@@ -0,0 +1,492 @@
+#ifndef INCLUDED_FREI0R_REMAP_H
+#define INCLUDED_FREI0R_REMAP_H
+
+/*
+
+  Geometric warp engine for plugins that remap every frame with the
+  same map (c0rners, defish0r, perspective, lenscorrection).
+
+  A map made for remap32() of frei0r_interp.h (a pair of floats per
+  output pixel, x <= 0 for the background) is prepared once for the
+  interpolator, and then applied to each frame:
+
+  frei0r_remap_t remap;
+
+  frei0r_remap_init(&remap);
+  ...
+  // whenever the map or the interpolator has changed
+  frei0r_remap_prepare(&remap, wi, hi, wo, ho, map, interpBL_b32);
+  ...
+  frei0r_remap_run(&remap, inframe, outframe, bgc);
+  ...
+  frei0r_remap_free(&remap);
+
+  What the preparation does depends on the interpolator:
+
+  interpNN_b32    the map becomes one source pixel index per output pixel
+                  (-1 for the background), run() is a gather, with AVX2
+                  gather instructions when built for AVX2
+  interpBL_b32    source index and the x and y fractions per output
+                  pixel, run() interpolates the four channels of a pixel
+                  as one SSE2 vector
+  interpBC_b32    run() computes the interpolation inline, the four
+                  channels as one SSE2 vector
+  others          run() computes the interpolation for each pixel, like
+                  remap32(), with the kernels of frei0r_interp.h inlined
+                  (interpolators from elsewhere are called through the
+                  pointer)
+
+  Plugins that compute which source pixel to take themselves fill the
+  indices returned by frei0r_remap_index() instead of preparing a map,
+  or hand indices they keep elsewhere, e.g. in frei0r_mapcache.h, to
+  frei0r_remap_use_index().
+
+  All of them give exactly the results of remap32() with the same map
+  and interpolator, and split the frame into bands of rows over threads
+  (frei0r_thread.h), which go through their output in square tiles, so
+  that rotated warps find the source rows they read still cached. The
+  plain C interpolators remain the fallback without SSE2. The map passed
+  to frei0r_remap_prepare() is still used by run() for interpBC_b32 and
+  the other interpolators, so it has to stay valid until the next
+  preparation.
+
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_interp.h"
+#include "frei0r_pages.h"
+#include "frei0r_thread.h"
+
+#define FREI0R_REMAP_NEAREST  0  /* idx */
+#define FREI0R_REMAP_BILINEAR 1  /* idx and frac */
+#define FREI0R_REMAP_BICUBIC  2  /* map, interpBC_b32 inline */
+#define FREI0R_REMAP_GENERIC  3  /* map and interp */
+
+/* width and height of the output tiles run() goes through, and the
+   source rows an output row has to go over for run() to take tiles */
+#define FREI0R_REMAP_TILE 32
+#define FREI0R_REMAP_SLANT 1024
+
+typedef struct frei0r_remap
+{
+  int wi, hi;        /* size of the source */
+  int wo, ho;        /* size of the output */
+  int kind;
+  int32_t* idx;      /* source pixel of each output pixel, -1 for the background */
+  float* frac;       /* x and y fraction of each output pixel (bilinear) */
+  const float* map;  /* the map it was prepared from */
+  interpp interp;
+  int size;          /* output pixels idx is allocated for */
+  int borrowed;      /* idx is the caller's, see frei0r_remap_use_index() */
+} frei0r_remap_t;
+
+static inline void frei0r_remap_init(frei0r_remap_t* r)
+{
+  memset(r, 0, sizeof(*r));
+}
+
+static inline void frei0r_remap_free(frei0r_remap_t* r)
+{
+  if (!r->borrowed)
+    free(r->idx);
+  free(r->frac);
+  frei0r_remap_init(r);
+}
+
+/* (Re)allocates the indices for a wo x ho output and makes r a nearest
+   neighbour remap of a wi x hi source. The caller fills in the source
+   pixel (y*wi + x) of each output pixel, or -1 for the background. */
+static inline int32_t* frei0r_remap_index(frei0r_remap_t* r, int wi, int hi,
+                                          int wo, int ho)
+{
+  if (r->borrowed)
+    {
+      r->idx = 0;
+      r->borrowed = 0;
+    }
+  if (r->size != wo*ho || !r->idx)
+    {
+      free(r->idx);
+      free(r->frac);
+      r->idx = (int32_t*)frei0r_pages_alloc(sizeof(int32_t) * wo * ho);
+      r->frac = 0;
+      r->size = wo*ho;
+    }
+  r->wi = wi; r->hi = hi;
+  r->wo = wo; r->ho = ho;
+  r->kind = FREI0R_REMAP_NEAREST;
+  r->map = 0;
+  r->interp = interpNN_b32;
+  return r->idx;
+}
+
+/* Makes r a nearest neighbour remap of a wi x hi source with the indices
+   idx of a wo x ho output, as frei0r_remap_index() would have them. r
+   only reads them, so they have to stay valid until the next preparation
+   or frei0r_remap_free(). */
+static inline void frei0r_remap_use_index(frei0r_remap_t* r, int wi, int hi,
+                                          int wo, int ho, const int32_t* idx)
+{
+  if (!r->borrowed)
+    free(r->idx);
+  free(r->frac);
+  r->idx = (int32_t*)idx;
+  r->frac = 0;
+  r->size = 0;
+  r->borrowed = 1;
+  r->wi = wi; r->hi = hi;
+  r->wo = wo; r->ho = ho;
+  r->kind = FREI0R_REMAP_NEAREST;
+  r->map = 0;
+  r->interp = interpNN_b32;
+}
+
+typedef struct frei0r_remap_job
+{
+  const frei0r_remap_t* r;
+  const uint32_t* src;
+  uint32_t* dst;
+  uint32_t bgc;
+  int y0, y1;   /* output rows */
+} frei0r_remap_job_t;
+
+/* Runs fn on bands of the output rows of r, over threads. */
+static inline void frei0r_remap_bands(const frei0r_remap_t* r, void* (*fn)(void*),
+                                      const uint32_t* src, uint32_t* dst,
+                                      uint32_t bgc)
+{
+  frei0r_remap_job_t jobs[FREI0R_MAX_THREADS];
+  int n = frei0r_thread_count((long)r->wo * r->ho);
+  int k;
+
+  if (n > r->ho)
+    n = r->ho;
+  if (n < 1)
+    return;
+  for (k = 0; k < n; k++)
+    {
+      jobs[k].r = r;
+      jobs[k].src = src;
+      jobs[k].dst = dst;
+      jobs[k].bgc = bgc;
+      jobs[k].y0 = r->ho * k / n;
+      jobs[k].y1 = r->ho * (k+1) / n;
+    }
+  frei0r_thread_run(fn, jobs, sizeof(frei0r_remap_job_t), n);
+}
+
+/* the table entries of the output rows of one job */
+static void* frei0r_remap_prepare_rows(void* arg)
+{
+  frei0r_remap_job_t* job = (frei0r_remap_job_t*)arg;
+  const frei0r_remap_t* r = job->r;
+  const float* map = r->map;
+  int32_t* idx = r->idx;
+  float* frac = r->frac;
+  int wi = r->wi;
+  int i = job->y0 * r->wo, end = job->y1 * r->wo;
+
+  if (r->kind == FREI0R_REMAP_NEAREST)
+    {
+      for (; i < end; i++)
+        {
+          float x = map[2*i], y = map[2*i+1];
+          idx[i] = (x > 0) ? (int)roundf(x) + (int)roundf(y)*wi : -1;
+        }
+      return 0;
+    }
+  for (; i < end; i++)
+    {
+      float x = map[2*i], y = map[2*i+1];
+      int m, n;
+      if (!(x > 0))
+        {
+          idx[i] = -1;
+          continue;
+        }
+      /* floorf(), x is positive */
+      m = (int)x; n = (int)y;
+      if (y < (float)n)
+        n--;
+      idx[i] = n*wi + m;
+      frac[2*i] = x - (float)m;
+      frac[2*i+1] = y - (float)n;
+    }
+  return 0;
+}
+
+/* Prepares map (see remap32()) for remapping with interp. The tables
+   are filled in bands of rows over threads. */
+static inline void frei0r_remap_prepare(frei0r_remap_t* r, int wi, int hi,
+                                        int wo, int ho, const float* map,
+                                        interpp interp)
+{
+  frei0r_remap_index(r, wi, hi, wo, ho);
+  r->map = map;
+  r->interp = interp;
+  if (interp == interpNN_b32)
+    frei0r_remap_bands(r, frei0r_remap_prepare_rows, 0, 0, 0);
+  else if (interp == interpBL_b32)
+    {
+      r->kind = FREI0R_REMAP_BILINEAR;
+      if (!r->frac)
+        r->frac = (float*)frei0r_pages_alloc(sizeof(float) * 2 * wo * ho);
+      frei0r_remap_bands(r, frei0r_remap_prepare_rows, 0, 0, 0);
+    }
+  else if (interp == interpBC_b32)
+    r->kind = FREI0R_REMAP_BICUBIC;
+  else
+    r->kind = FREI0R_REMAP_GENERIC;
+}
+
+#if defined(__SSE2__)
+/* the four channels of a pixel as floats */
+static inline __m128 frei0r_remap_px(const uint32_t* src, int i)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i p = _mm_cvtsi32_si128((int)src[i]);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero));
+}
+
+/* converts like the assignment of a float to an unsigned char in the
+   interpolators: truncated, and only the low byte of the integer */
+static inline uint32_t frei0r_remap_pack(__m128 v)
+{
+  __m128i p = _mm_and_si128(_mm_cvttps_epi32(v), _mm_set1_epi32(0xff));
+  p = _mm_packs_epi32(p, p);
+  return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+}
+#endif
+
+/* Bilinear interpolation of source pixel i with the fractions fx, fy,
+   as interpBL_b32(). A zero fraction takes the neighbour's weight away
+   completely, so the neighbour isn't read then (it may be outside the
+   source at the right and bottom edges). */
+static inline uint32_t frei0r_remap_bilinear(const uint32_t* src, int wi,
+                                             int i, float fx, float fy)
+{
+  int i01 = i + (fx != 0.0f);
+  int i10 = i + ((fy != 0.0f) ? wi : 0);
+  int i11 = i10 + (fx != 0.0f);
+#if defined(__SSE2__)
+  __m128 x = _mm_set1_ps(fx), y = _mm_set1_ps(fy);
+  __m128 p00 = frei0r_remap_px(src, i), p01 = frei0r_remap_px(src, i01);
+  __m128 p10 = frei0r_remap_px(src, i10), p11 = frei0r_remap_px(src, i11);
+  __m128 a = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p01, p00), x));
+  __m128 b = _mm_add_ps(p10, _mm_mul_ps(_mm_sub_ps(p11, p10), x));
+  return frei0r_remap_pack(_mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), y)));
+#else
+  const unsigned char* s = (const unsigned char*)src;
+  unsigned char v[4];
+  uint32_t px;
+  float a, b;
+  int c;
+  for (c = 0; c < 4; c++)
+    {
+      a = s[4*i+c] + (s[4*i01+c] - s[4*i+c]) * fx;
+      b = s[4*i10+c] + (s[4*i11+c] - s[4*i10+c]) * fx;
+      v[c] = a + (b - a) * fy;
+    }
+  memcpy(&px, v, sizeof(px));
+  return px;
+#endif
+}
+
+#if defined(__SSE2__)
+/* interpBC_b32() with the four channels as one vector */
+static inline uint32_t frei0r_remap_bicubic(const uint32_t* src, int w, int h,
+                                            float x, float y)
+{
+  int i, j, l, m, n;
+  __m128 k, p[4], p1[4], p2[4], p3[4], p4[4];
+
+  m=(int)ceilf(x)-2; if (m<0) m=0; if ((m+5)>w) m=w-4;
+  n=(int)ceilf(y)-2; if (n<0) n=0; if ((n+5)>h) n=h-4;
+
+  for (i=0;i<4;i++)
+    {
+      l=m+(i+n)*w;
+      p1[i]=frei0r_remap_px(src, l);
+      p2[i]=frei0r_remap_px(src, l+1);
+      p3[i]=frei0r_remap_px(src, l+2);
+      p4[i]=frei0r_remap_px(src, l+3);
+    }
+  for (j=1;j<4;j++)
+    for (i=3;i>=j;i--)
+      {
+        k=_mm_set1_ps((y-i-n)/j);
+        p1[i]=_mm_add_ps(p1[i], _mm_mul_ps(k, _mm_sub_ps(p1[i], p1[i-1])));
+        p2[i]=_mm_add_ps(p2[i], _mm_mul_ps(k, _mm_sub_ps(p2[i], p2[i-1])));
+        p3[i]=_mm_add_ps(p3[i], _mm_mul_ps(k, _mm_sub_ps(p3[i], p3[i-1])));
+        p4[i]=_mm_add_ps(p4[i], _mm_mul_ps(k, _mm_sub_ps(p4[i], p4[i-1])));
+      }
+
+  p[0]=p1[3]; p[1]=p2[3]; p[2]=p3[3]; p[3]=p4[3];
+  for (j=1;j<4;j++)
+    for (i=3;i>=j;i--)
+      p[i]=_mm_add_ps(p[i], _mm_mul_ps(_mm_set1_ps((x-i-m)/j), _mm_sub_ps(p[i], p[i-1])));
+
+  /* if (p<0.0) p=0.0; if (p>256.0) p=255.0; */
+  p[3]=_mm_and_ps(p[3], _mm_cmpge_ps(p[3], _mm_setzero_ps()));
+  k=_mm_cmpgt_ps(p[3], _mm_set1_ps(256.0f));
+  p[3]=_mm_or_ps(_mm_andnot_ps(k, p[3]), _mm_and_ps(k, _mm_set1_ps(255.0f)));
+  return frei0r_remap_pack(p[3]);
+}
+#endif
+
+/* The row loop of the interpolators without a table, each with its
+   kernel inlined for four channels. */
+#define FREI0R_REMAP_KERNEL_ROWS(name) \
+static inline void frei0r_remap_rows_##name(const frei0r_remap_t* r, \
+                                            const uint32_t* src, uint32_t* dst, \
+                                            uint32_t bgc, int i, int end) \
+{ \
+  for (; i < end; i++) \
+    { \
+      float x = r->map[2*i], y = r->map[2*i+1]; \
+      if (x > 0) \
+        name##_n((unsigned char*)src, r->wi, r->hi, x, y, (unsigned char*)(dst + i), 4); \
+      else \
+        dst[i] = bgc; \
+    } \
+}
+
+FREI0R_REMAP_KERNEL_ROWS(interpBC)
+FREI0R_REMAP_KERNEL_ROWS(interpBC2)
+FREI0R_REMAP_KERNEL_ROWS(interpSP4)
+FREI0R_REMAP_KERNEL_ROWS(interpSP6)
+FREI0R_REMAP_KERNEL_ROWS(interpSC16)
+
+/* the output pixels i to end - 1 */
+static inline void frei0r_remap_span(const frei0r_remap_t* r,
+                                     const uint32_t* src, uint32_t* dst,
+                                     uint32_t bgc, int i, int end)
+{
+  switch (r->kind)
+    {
+    case FREI0R_REMAP_NEAREST:
+#if defined(__AVX2__)
+      {
+        __m256i bg = _mm256_set1_epi32((int)bgc);
+        __m256i none = _mm256_set1_epi32(-1);
+        for (; i + 8 <= end; i += 8)
+          {
+            __m256i id = _mm256_loadu_si256((const __m256i*)(r->idx + i));
+            __m256i valid = _mm256_cmpgt_epi32(id, none);
+            _mm256_storeu_si256((__m256i*)(dst + i),
+                                _mm256_mask_i32gather_epi32(bg, (const int*)src, id, valid, 4));
+          }
+      }
+#endif
+      for (; i < end; i++)
+        dst[i] = (r->idx[i] < 0) ? bgc : src[r->idx[i]];
+      break;
+    case FREI0R_REMAP_BILINEAR:
+      for (; i < end; i++)
+        dst[i] = (r->idx[i] < 0) ? bgc
+          : frei0r_remap_bilinear(src, r->wi, r->idx[i], r->frac[2*i], r->frac[2*i+1]);
+      break;
+    case FREI0R_REMAP_BICUBIC:
+#if defined(__SSE2__)
+      for (; i < end; i++)
+        {
+          float x = r->map[2*i], y = r->map[2*i+1];
+          dst[i] = (x > 0) ? frei0r_remap_bicubic(src, r->wi, r->hi, x, y) : bgc;
+        }
+      break;
+#endif
+      /* fall through, without SSE2 interpBC_b32 is inlined */
+    default:
+      if (r->interp == interpBC_b32)
+        frei0r_remap_rows_interpBC(r, src, dst, bgc, i, end);
+      else if (r->interp == interpBC2_b32)
+        frei0r_remap_rows_interpBC2(r, src, dst, bgc, i, end);
+      else if (r->interp == interpSP4_b32)
+        frei0r_remap_rows_interpSP4(r, src, dst, bgc, i, end);
+      else if (r->interp == interpSP6_b32)
+        frei0r_remap_rows_interpSP6(r, src, dst, bgc, i, end);
+      else if (r->interp == interpSC16_b32)
+        frei0r_remap_rows_interpSC16(r, src, dst, bgc, i, end);
+      else
+        for (; i < end; i++)
+          {
+            float x = r->map[2*i], y = r->map[2*i+1];
+            if (x > 0)
+              r->interp((unsigned char*)src, r->wi, r->hi, x, y, (unsigned char*)(dst + i));
+            else
+              dst[i] = bgc;
+          }
+      break;
+    }
+}
+
+/* the source row of output pixel i, -1 for the background */
+static inline int frei0r_remap_source_row(const frei0r_remap_t* r, int i)
+{
+  if (r->kind == FREI0R_REMAP_NEAREST || r->kind == FREI0R_REMAP_BILINEAR)
+    return (r->idx[i] >= 0) ? r->idx[i] / r->wi : -1;
+  return (r->map[2*i] > 0) ? (int)r->map[2*i+1] : -1;
+}
+
+/* the source rows output row y goes over, from its first to its last
+   pixel that isn't background */
+static inline int frei0r_remap_slant(const frei0r_remap_t* r, int y)
+{
+  int i = y * r->wo, end = i + r->wo, s0 = -1, s1 = -1;
+
+  while (i < end && (s0 = frei0r_remap_source_row(r, i)) < 0)
+    i++;
+  while (end > i && (s1 = frei0r_remap_source_row(r, end - 1)) < 0)
+    end--;
+  if (s0 < 0 || s1 < 0)
+    return 0;
+  return (s1 > s0) ? s1 - s0 : s0 - s1;
+}
+
+/* The output rows of one job. Warps that rotate read the source along
+   slanted lines, one source row after the other for each output row.
+   When an output row goes over more than FREI0R_REMAP_SLANT of them,
+   the cache lines it read are gone before the next output row needs
+   them, so the job takes tiles of FREI0R_REMAP_TILE x FREI0R_REMAP_TILE
+   pixels then, and whole rows otherwise. The middle row of the job
+   decides. */
+static void* frei0r_remap_rows(void* arg)
+{
+  frei0r_remap_job_t* job = (frei0r_remap_job_t*)arg;
+  const frei0r_remap_t* r = job->r;
+  int tile = r->wo, x, x1, y, y1, yy;
+
+  if (frei0r_remap_slant(r, (job->y0 + job->y1) / 2) > FREI0R_REMAP_SLANT)
+    tile = FREI0R_REMAP_TILE;
+  for (y = job->y0; y < job->y1; y += FREI0R_REMAP_TILE)
+    {
+      y1 = (y + FREI0R_REMAP_TILE < job->y1) ? y + FREI0R_REMAP_TILE : job->y1;
+      for (x = 0; x < r->wo; x += tile)
+        {
+          x1 = (x + tile < r->wo) ? x + tile : r->wo;
+          for (yy = y; yy < y1; yy++)
+            frei0r_remap_span(r, job->src, job->dst, job->bgc,
+                              yy * r->wo + x, yy * r->wo + x1);
+        }
+    }
+  return 0;
+}
+
+/* Remaps src (wi x hi) to dst (wo x ho), background pixels are set to
+   bgc (little endian, like remap32()). */
+static inline void frei0r_remap_run(const frei0r_remap_t* r, const uint32_t* src,
+                                    uint32_t* dst, uint32_t bgc)
+{
+  frei0r_remap_bands(r, frei0r_remap_rows, src, dst, bgc);
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef INCLUDED_FREI0R_RLE_H
+#define INCLUDED_FREI0R_RLE_H
+
+/*
+
+  Run-length encoded RGBA images compiled into plugins, like the
+  graticules of the scopes. Raw pixel dumps make the plugin file big and
+  get mapped by every process that merely loads the plugin to list it;
+  encoded, they are a fraction of that and are only decoded once the
+  plugin is used:
+
+  static frei0r_rle_shared_t background = { &vectorscope_image };
+
+  const uint8_t* pixels = frei0r_rle_acquire(&background);
+  ... in f0r_construct ...
+  frei0r_rle_release(&background);
+
+  decodes the image on the first acquire and shares the pixels between
+  the users, the last release frees them. Acquire and release may be
+  called from several threads when the plugin links FREI0R_THREAD_LIBS.
+
+  An image is runs of counts[i] pixels of value pixels[i], row after row.
+  A value has the bytes of the pixel from the lowest bits up, red in bits
+  0 to 7 and alpha in bits 24 to 31 for RGBA8888.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef FREI0R_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+typedef struct frei0r_rle_image
+{
+  unsigned int width, height;
+  unsigned int runs;
+  const uint16_t* counts;
+  const uint32_t* pixels;
+} frei0r_rle_image_t;
+
+/* width * height * 4 bytes */
+static inline void frei0r_rle_decode(const frei0r_rle_image_t* image,
+                                     uint8_t* dst)
+{
+  unsigned int i, k;
+
+  for (i = 0; i < image->runs; ++i)
+    {
+      uint32_t v = image->pixels[i];
+
+      for (k = 0; k < image->counts[i]; ++k, dst += 4)
+        {
+          dst[0] = (uint8_t)v;
+          dst[1] = (uint8_t)(v >> 8);
+          dst[2] = (uint8_t)(v >> 16);
+          dst[3] = (uint8_t)(v >> 24);
+        }
+    }
+}
+
+typedef struct frei0r_rle_shared
+{
+  const frei0r_rle_image_t* image;
+  uint8_t* pixels;
+  int users;
+} frei0r_rle_shared_t;
+
+#ifdef FREI0R_HAVE_PTHREAD
+static pthread_mutex_t frei0r_rle_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+#define FREI0R_RLE_LOCK_() pthread_mutex_lock(&frei0r_rle_mutex_)
+#define FREI0R_RLE_UNLOCK_() pthread_mutex_unlock(&frei0r_rle_mutex_)
+#else
+#define FREI0R_RLE_LOCK_()
+#define FREI0R_RLE_UNLOCK_()
+#endif
+
+/* the decoded pixels, null if they can't be allocated */
+static inline const uint8_t* frei0r_rle_acquire(frei0r_rle_shared_t* shared)
+{
+  const uint8_t* pixels;
+
+  FREI0R_RLE_LOCK_();
+  if (!shared->pixels)
+    {
+      shared->pixels = (uint8_t*)malloc((size_t)shared->image->width
+                                        * shared->image->height * 4);
+      if (shared->pixels)
+        frei0r_rle_decode(shared->image, shared->pixels);
+    }
+  if (shared->pixels)
+    ++shared->users;
+  pixels = shared->pixels;
+  FREI0R_RLE_UNLOCK_();
+  return pixels;
+}
+
+static inline void frei0r_rle_release(frei0r_rle_shared_t* shared)
+{
+  FREI0R_RLE_LOCK_();
+  if (--shared->users == 0)
+    {
+      free(shared->pixels);
+      shared->pixels = 0;
+    }
+  FREI0R_RLE_UNLOCK_();
+}
+
+#endif
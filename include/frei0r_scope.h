@@ -0,0 +1,172 @@
+#ifndef INCLUDED_FREI0R_SCOPE_H
+#define INCLUDED_FREI0R_SCOPE_H
+
+/*
+
+  Rendering of the grids of measuring scopes, like vectorscope and
+  rgbparade, at output resolution. A scope accumulates its trace into a
+  fixed size grid of 8 bit values and draws the grid into a rectangle of
+  the output, bilinearly filtered, from taps that are computed once per
+  instance:
+
+  frei0r_scope_tap_t tx[rect_w], ty[rect_h];
+  frei0r_scope_taps(tx, rect_w, grid_w);
+  frei0r_scope_taps(ty, rect_h, grid_h);
+
+  Each frame, the rows of the grid are resampled to the width of the
+  rectangle first, grid_h x rect_w values that any number of threads can
+  share out between them by rows of the grid:
+
+  frei0r_scope_columns(cols, grid, grid_w, 0, grid_h, tx, rect_w);
+
+  after which
+
+  frei0r_scope_sample(row, cols, rect_w, ty[y - rect_y]);
+
+  gives the values of output row y within the rectangle. As grids have
+  fewer rows than the rectangle, that filters most values in the cheap
+  direction, between whole rows. Pixel centers of the grid and the
+  rectangle are aligned, the border samples are repeated.
+
+  The graticule is an RGBA image at output resolution that is laid over
+  the scope. Most of it is transparent, so
+
+  frei0r_scope_mask_t mask;
+  frei0r_scope_mask_init(&mask, graticule, width, height);
+  ...
+  frei0r_scope_over(dst, graticule, &mask, y, width);
+
+  only blends the runs of each row that are not.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct frei0r_scope_tap
+{
+  int i;  /* samples i and i + 1 */
+  int w;  /* weight of sample i + 1, of 256 */
+} frei0r_scope_tap_t;
+
+/* taps of n output pixels over size samples, size >= 2 */
+static inline void frei0r_scope_taps(frei0r_scope_tap_t* taps, int n,
+                                     int size)
+{
+  int d;
+
+  for (d = 0; d < n; ++d)
+    {
+      double s = (d + 0.5) * size / n - 0.5;
+      int i = s < 0 ? 0 : (int)s;
+
+      taps[d].i = i;
+      taps[d].w = s < 0 ? 0 : (int)((s - i) * 256 + 0.5);
+      if (i >= size - 1)
+        {
+          taps[d].i = size - 2;
+          taps[d].w = 256;
+        }
+    }
+}
+
+/* rows [j0, j1) of a grid of width values per row, resampled to n
+   values per row in 8.8 fixed point */
+static inline void frei0r_scope_columns(uint16_t* cols, const uint8_t* grid,
+                                        int width, int j0, int j1,
+                                        const frei0r_scope_tap_t* tx, int n)
+{
+  int j, x;
+
+  for (j = j0; j < j1; ++j)
+    {
+      const uint8_t* r = grid + (long)j * width;
+      uint16_t* c = cols + (long)j * n;
+
+      for (x = 0; x < n; ++x)
+        c[x] = (uint16_t)(r[tx[x].i] * (256 - tx[x].w)
+                          + r[tx[x].i + 1] * tx[x].w);
+    }
+}
+
+/* n values of the row at ty of the resampled rows cols */
+static inline void frei0r_scope_sample(uint8_t* dst, const uint16_t* cols,
+                                       int n, frei0r_scope_tap_t ty)
+{
+  const uint16_t* c0 = cols + (long)ty.i * n;
+  const uint16_t* c1 = c0 + n;
+  int x;
+
+  for (x = 0; x < n; ++x)
+    dst[x] = (uint8_t)((c0[x] * (256 - ty.w) + c1[x] * ty.w + 32768) >> 16);
+}
+
+/* the runs of a row of an RGBA image whose alpha isn't 0 */
+typedef struct frei0r_scope_mask
+{
+  int* rows;   /* the runs of row y are runs[rows[y]] to runs[rows[y + 1]] */
+  int* runs;   /* as x0, x1 pairs, a run is [x0, x1) */
+} frei0r_scope_mask_t;
+
+static inline void frei0r_scope_mask_init(frei0r_scope_mask_t* mask,
+                                          const uint8_t* rgba, int width,
+                                          int height)
+{
+  int pass, x, y, n = 0;
+
+  mask->rows = (int*)malloc((height + 1) * sizeof(int));
+  mask->runs = 0;
+  /* count the runs, then store them */
+  for (pass = 0; pass < 2; ++pass)
+    {
+      n = 0;
+      for (y = 0; y < height; ++y)
+        {
+          const uint8_t* a = rgba + (long)y * width * 4 + 3;
+
+          if (pass)
+            mask->rows[y] = n;
+          for (x = 0; x < width; ++x)
+            if (a[4 * x] && (x == 0 || !a[4 * (x - 1)]))
+              {
+                if (pass)
+                  mask->runs[2 * n] = x;
+                while (x + 1 < width && a[4 * (x + 1)])
+                  ++x;
+                if (pass)
+                  mask->runs[2 * n + 1] = x + 1;
+                ++n;
+              }
+        }
+      if (!pass)
+        mask->runs = (int*)malloc((2 * n + 1) * sizeof(int));
+    }
+  mask->rows[height] = n;
+}
+
+static inline void frei0r_scope_mask_free(frei0r_scope_mask_t* mask)
+{
+  free(mask->rows);
+  free(mask->runs);
+}
+
+/* blends row y of an RGBA image over the row of dst where its mask says */
+static inline void frei0r_scope_over(uint32_t* dst, const uint8_t* rgba,
+                                     const frei0r_scope_mask_t* mask, int y,
+                                     int width)
+{
+  int k, x;
+
+  for (k = mask->rows[y]; k < mask->rows[y + 1]; ++k)
+    for (x = mask->runs[2 * k]; x < mask->runs[2 * k + 1]; ++x)
+      {
+        uint8_t* d = (uint8_t*)(dst + x);
+        const uint8_t* s = rgba + ((long)y * width + x) * 4;
+
+        d[0] = (((s[0] - d[0]) * 255 * s[3]) >> 16) + d[0];
+        d[1] = (((s[1] - d[1]) * 255 * s[3]) >> 16) + d[1];
+        d[2] = (((s[2] - d[2]) * 255 * s[3]) >> 16) + d[2];
+      }
+}
+
+#endif
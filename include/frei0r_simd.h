@@ -0,0 +1,761 @@
+#ifndef INCLUDED_FREI0R_SIMD_H
+#define INCLUDED_FREI0R_SIMD_H
+
+/*
+
+  Pixel kernels for 8 bit per channel packed pixels with the alpha
+  channel in the highest byte (BGRA8888, RGBA8888 and PACKED32 on little
+  endian machines). Each kernel combines n pixels of src1 and src2 into
+  dst and gives bit-exact the results of the scalar code in frei0r_math.h:
+
+  frei0r_simd_multiply    INT_MULT(a,b)
+  frei0r_simd_screen      255 - INT_MULT(255-a,255-b)
+  frei0r_simd_add         MIN(a+b,255)
+  frei0r_simd_subtract    MAX(a-b,0)
+  frei0r_simd_darken      MIN(a,b)
+  frei0r_simd_lighten     MAX(a,b)
+  frei0r_simd_difference  |a-b|
+  frei0r_simd_lerp        (a*(255-t) + b*t) / 255, on all four channels
+
+  All kernels except frei0r_simd_lerp set the alpha channel of dst to the
+  minimum of both alphas, like the gimp layer modes do. dst may be the
+  same buffer as src1 or src2.
+
+  The alpha kernels keep the colors of src1 and only combine the alphas,
+  for masks kept as pixels with the mask in the alpha channel:
+
+  frei0r_simd_alpha_copy      b
+  frei0r_simd_alpha_max       MAX(a,b)
+  frei0r_simd_alpha_min       MIN(a,b)
+  frei0r_simd_alpha_add       MIN(a+b,255)
+  frei0r_simd_alpha_subtract  MAX(a-b,0)
+
+  frei0r_simd_and masks src1 with src2 bitwise, on all four channels.
+
+  frei0r_simd_difference_stats is frei0r_simd_difference that also adds
+  up how much both sources differ, in the same pass, for effects that
+  measure motion; with dst 0 it only measures.
+
+  frei0r_simd_reverse copies n pixels of src to dst in reverse order, for
+  horizontal flips; dst may be src, to flip in place.
+
+  frei0r_simd_alpha_class tells whether a run of pixels is fully
+  transparent, fully opaque or neither, so that compositing effects can
+  copy or skip such runs instead of blending them.
+
+  The echo kernels fade an echo kept in dst by the bytes of fade, towards
+  black or white, and let src through wherever the faded echo no longer
+  covers it, as aech0r does:
+
+  frei0r_simd_echo_darker    e = MAX(dst-fade,0) per byte; dst = e where
+                             all four bytes of src are <= those of e,
+                             src otherwise
+  frei0r_simd_echo_brighter  e = MIN(dst+fade,255) per byte; dst = e
+                             where all four bytes of src are >= those
+                             of e, src otherwise
+
+  The vector code is chosen at compile time (AVX2, SSE2 or NEON), the
+  remaining pixels and other architectures use the scalar versions;
+  FREI0R_SIMD_SCALAR defined before the header selects those everywhere.
+  On x86 builds without AVX2, where FREI0R_SIMD_ECHO_AVX2 is defined, the
+  echo kernels also come as frei0r_simd_echo_*_avx2 compiled for AVX2,
+  for effects that pick them at run time with frei0r_cpu.h.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "frei0r_cpu.h"
+
+#if defined(FREI0R_SIMD_SCALAR)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(FREI0R_CPU_DISPATCH) && !defined(__AVX2__) \
+  && !defined(FREI0R_SIMD_SCALAR)
+#define FREI0R_SIMD_ECHO_AVX2 1
+#include <immintrin.h>
+#endif
+
+#include "frei0r_math.h"
+
+#define FREI0R_SIMD_ALPHA_MASK 0xff000000u
+
+/* keeps the color channels of c, alpha is the minimum of both alphas */
+static inline uint32_t frei0r_simd_min_alpha_(uint32_t c,
+                                              uint32_t a, uint32_t b)
+{
+  uint32_t aa = a >> 24, ba = b >> 24;
+  return (c & ~FREI0R_SIMD_ALPHA_MASK) | (MIN(aa, ba) << 24);
+}
+
+static inline uint32_t frei0r_simd_multiply_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i, t;
+  for (i = 0; i < 24; i += 8)
+    c |= INT_MULT((a >> i) & 0xff, (b >> i) & 0xff, t) << i;
+  return frei0r_simd_min_alpha_(c, a, b);
+}
+
+static inline uint32_t frei0r_simd_screen_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i, t;
+  for (i = 0; i < 24; i += 8)
+    c |= (255 - INT_MULT(255 - ((a >> i) & 0xff),
+                         255 - ((b >> i) & 0xff), t)) << i;
+  return frei0r_simd_min_alpha_(c, a, b);
+}
+
+static inline uint32_t frei0r_simd_add_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i, s;
+  for (i = 0; i < 24; i += 8)
+    {
+      s = ((a >> i) & 0xff) + ((b >> i) & 0xff);
+      c |= MIN(s, 255u) << i;
+    }
+  return frei0r_simd_min_alpha_(c, a, b);
+}
+
+static inline uint32_t frei0r_simd_subtract_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i;
+  int d;
+  for (i = 0; i < 24; i += 8)
+    {
+      d = (int)((a >> i) & 0xff) - (int)((b >> i) & 0xff);
+      c |= (uint32_t)MAX(d, 0) << i;
+    }
+  return frei0r_simd_min_alpha_(c, a, b);
+}
+
+static inline uint32_t frei0r_simd_darken_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i, x, y;
+  for (i = 0; i < 32; i += 8)
+    {
+      x = (a >> i) & 0xff;
+      y = (b >> i) & 0xff;
+      c |= MIN(x, y) << i;
+    }
+  return c;
+}
+
+static inline uint32_t frei0r_simd_lighten_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i, x, y;
+  for (i = 0; i < 24; i += 8)
+    {
+      x = (a >> i) & 0xff;
+      y = (b >> i) & 0xff;
+      c |= MAX(x, y) << i;
+    }
+  return frei0r_simd_min_alpha_(c, a, b);
+}
+
+static inline uint32_t frei0r_simd_difference_px_(uint32_t a, uint32_t b)
+{
+  uint32_t c = 0, i;
+  int d;
+  for (i = 0; i < 24; i += 8)
+    {
+      d = (int)((a >> i) & 0xff) - (int)((b >> i) & 0xff);
+      c |= (uint32_t)(d < 0 ? -d : d) << i;
+    }
+  return frei0r_simd_min_alpha_(c, a, b);
+}
+
+/* the colors of c with the alpha a */
+static inline uint32_t frei0r_simd_with_alpha_(uint32_t c, uint32_t a)
+{
+  return (c & ~FREI0R_SIMD_ALPHA_MASK) | (a << 24);
+}
+
+static inline uint32_t frei0r_simd_lerp_px_(uint32_t a, uint32_t b,
+                                            uint8_t t)
+{
+  uint32_t c = 0, i;
+  for (i = 0; i < 32; i += 8)
+    c |= ((((a >> i) & 0xff) * (255 - t) + ((b >> i) & 0xff) * t) / 255)
+         << i;
+  return c;
+}
+
+static inline uint32_t frei0r_simd_echo_darker_px_(uint32_t e, uint32_t s,
+                                                   uint32_t fade)
+{
+  uint32_t i, a, b;
+  for (i = 0; i < 32; i += 8)
+    {
+      a = (e >> i) & 0xff;
+      b = (fade >> i) & 0xff;
+      e = (e & ~(0xffu << i)) | ((a > b ? a - b : 0) << i);
+    }
+  for (i = 0; i < 32; i += 8)
+    if (((s >> i) & 0xff) > ((e >> i) & 0xff))
+      return s;
+  return e;
+}
+
+static inline uint32_t frei0r_simd_echo_brighter_px_(uint32_t e, uint32_t s,
+                                                     uint32_t fade)
+{
+  uint32_t i, a;
+  for (i = 0; i < 32; i += 8)
+    {
+      a = ((e >> i) & 0xff) + ((fade >> i) & 0xff);
+      e = (e & ~(0xffu << i)) | (MIN(a, 255u) << i);
+    }
+  for (i = 0; i < 32; i += 8)
+    if (((s >> i) & 0xff) < ((e >> i) & 0xff))
+      return s;
+  return e;
+}
+
+#if defined(FREI0R_SIMD_SCALAR)
+#elif defined(__AVX2__)
+
+#define FREI0R_SIMD_WIDTH 8
+typedef __m256i frei0r_simd_v_;
+
+static inline __m256i frei0r_simd_load_(const uint32_t* p)
+{
+  return _mm256_loadu_si256((const __m256i*)p);
+}
+
+static inline void frei0r_simd_store_(uint32_t* p, __m256i v)
+{
+  _mm256_storeu_si256((__m256i*)p, v);
+}
+
+/* a*b/255 with INT_MULT rounding on 16 bit lanes */
+static inline __m256i frei0r_simd_mul16_(__m256i a, __m256i b)
+{
+  __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, b),
+                               _mm256_set1_epi16(0x80));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+static inline __m256i frei0r_simd_vmul_(__m256i a, __m256i b)
+{
+  __m256i z = _mm256_setzero_si256();
+  __m256i lo = frei0r_simd_mul16_(_mm256_unpacklo_epi8(a, z),
+                                  _mm256_unpacklo_epi8(b, z));
+  __m256i hi = frei0r_simd_mul16_(_mm256_unpackhi_epi8(a, z),
+                                  _mm256_unpackhi_epi8(b, z));
+  return _mm256_packus_epi16(lo, hi);
+}
+
+/* (a*(255-t) + b*t) / 255, truncated like the scalar division */
+static inline __m256i frei0r_simd_vlerp_(__m256i a, __m256i b, uint8_t t)
+{
+  __m256i z = _mm256_setzero_si256();
+  __m256i wt = _mm256_set1_epi16(t);
+  __m256i wa = _mm256_set1_epi16(255 - t);
+  __m256i one = _mm256_set1_epi16(1);
+  __m256i lo = _mm256_add_epi16(
+    _mm256_mullo_epi16(_mm256_unpacklo_epi8(a, z), wa),
+    _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, z), wt));
+  __m256i hi = _mm256_add_epi16(
+    _mm256_mullo_epi16(_mm256_unpackhi_epi8(a, z), wa),
+    _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, z), wt));
+  lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one),
+                                          _mm256_srli_epi16(lo, 8)), 8);
+  hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one),
+                                          _mm256_srli_epi16(hi, 8)), 8);
+  return _mm256_packus_epi16(lo, hi);
+}
+
+#define frei0r_simd_vnot_(a) _mm256_xor_si256(a, _mm256_set1_epi8(-1))
+#define frei0r_simd_vadds_(a, b) _mm256_adds_epu8(a, b)
+#define frei0r_simd_vsubs_(a, b) _mm256_subs_epu8(a, b)
+#define frei0r_simd_vmin_(a, b) _mm256_min_epu8(a, b)
+#define frei0r_simd_vmax_(a, b) _mm256_max_epu8(a, b)
+#define frei0r_simd_vor_(a, b) _mm256_or_si256(a, b)
+#define frei0r_simd_vand_(a, b) _mm256_and_si256(a, b)
+#define frei0r_simd_vblend_(mask, a, b) \
+  _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b))
+#define frei0r_simd_valpha_() \
+  _mm256_set1_epi32((int)FREI0R_SIMD_ALPHA_MASK)
+#define frei0r_simd_vdup_(x) _mm256_set1_epi32((int)(x))
+#define frei0r_simd_vpxeq_(a, b) _mm256_cmpeq_epi32(a, b)
+#define frei0r_simd_vrev_(a) \
+  _mm256_permutevar8x32_epi32(a, _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7))
+
+#elif defined(__SSE2__)
+
+#define FREI0R_SIMD_WIDTH 4
+typedef __m128i frei0r_simd_v_;
+
+static inline __m128i frei0r_simd_load_(const uint32_t* p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+static inline void frei0r_simd_store_(uint32_t* p, __m128i v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+/* a*b/255 with INT_MULT rounding on 16 bit lanes */
+static inline __m128i frei0r_simd_mul16_(__m128i a, __m128i b)
+{
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(0x80));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static inline __m128i frei0r_simd_vmul_(__m128i a, __m128i b)
+{
+  __m128i z = _mm_setzero_si128();
+  __m128i lo = frei0r_simd_mul16_(_mm_unpacklo_epi8(a, z),
+                                  _mm_unpacklo_epi8(b, z));
+  __m128i hi = frei0r_simd_mul16_(_mm_unpackhi_epi8(a, z),
+                                  _mm_unpackhi_epi8(b, z));
+  return _mm_packus_epi16(lo, hi);
+}
+
+/* (a*(255-t) + b*t) / 255, truncated like the scalar division */
+static inline __m128i frei0r_simd_vlerp_(__m128i a, __m128i b, uint8_t t)
+{
+  __m128i z = _mm_setzero_si128();
+  __m128i wt = _mm_set1_epi16(t);
+  __m128i wa = _mm_set1_epi16(255 - t);
+  __m128i one = _mm_set1_epi16(1);
+  __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, z), wa),
+                             _mm_mullo_epi16(_mm_unpacklo_epi8(b, z), wt));
+  __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, z), wa),
+                             _mm_mullo_epi16(_mm_unpackhi_epi8(b, z), wt));
+  lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one),
+                                    _mm_srli_epi16(lo, 8)), 8);
+  hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one),
+                                    _mm_srli_epi16(hi, 8)), 8);
+  return _mm_packus_epi16(lo, hi);
+}
+
+#define frei0r_simd_vnot_(a) _mm_xor_si128(a, _mm_set1_epi8(-1))
+#define frei0r_simd_vadds_(a, b) _mm_adds_epu8(a, b)
+#define frei0r_simd_vsubs_(a, b) _mm_subs_epu8(a, b)
+#define frei0r_simd_vmin_(a, b) _mm_min_epu8(a, b)
+#define frei0r_simd_vmax_(a, b) _mm_max_epu8(a, b)
+#define frei0r_simd_vor_(a, b) _mm_or_si128(a, b)
+#define frei0r_simd_vand_(a, b) _mm_and_si128(a, b)
+#define frei0r_simd_vblend_(mask, a, b) \
+  _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+#define frei0r_simd_valpha_() _mm_set1_epi32((int)FREI0R_SIMD_ALPHA_MASK)
+#define frei0r_simd_vdup_(x) _mm_set1_epi32((int)(x))
+#define frei0r_simd_vpxeq_(a, b) _mm_cmpeq_epi32(a, b)
+#define frei0r_simd_vrev_(a) _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3))
+
+#elif defined(__ARM_NEON)
+
+#define FREI0R_SIMD_WIDTH 4
+typedef uint8x16_t frei0r_simd_v_;
+
+static inline uint8x16_t frei0r_simd_load_(const uint32_t* p)
+{
+  return vld1q_u8((const uint8_t*)p);
+}
+
+static inline void frei0r_simd_store_(uint32_t* p, uint8x16_t v)
+{
+  vst1q_u8((uint8_t*)p, v);
+}
+
+/* a*b/255 with INT_MULT rounding on 16 bit lanes */
+static inline uint8x8_t frei0r_simd_mul16_(uint8x8_t a, uint8x8_t b)
+{
+  uint16x8_t t = vaddq_u16(vmull_u8(a, b), vdupq_n_u16(0x80));
+  return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+static inline uint8x16_t frei0r_simd_vmul_(uint8x16_t a, uint8x16_t b)
+{
+  return vcombine_u8(frei0r_simd_mul16_(vget_low_u8(a), vget_low_u8(b)),
+                     frei0r_simd_mul16_(vget_high_u8(a), vget_high_u8(b)));
+}
+
+/* (a*(255-t) + b*t) / 255, truncated like the scalar division */
+static inline uint8x8_t frei0r_simd_lerp16_(uint8x8_t a, uint8x8_t b,
+                                            uint8_t t)
+{
+  uint16x8_t x = vmlal_u8(vmull_u8(a, vdup_n_u8(255 - t)), b, vdup_n_u8(t));
+  x = vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8));
+  return vshrn_n_u16(x, 8);
+}
+
+static inline uint8x16_t frei0r_simd_vlerp_(uint8x16_t a, uint8x16_t b,
+                                            uint8_t t)
+{
+  return vcombine_u8(frei0r_simd_lerp16_(vget_low_u8(a), vget_low_u8(b), t),
+                     frei0r_simd_lerp16_(vget_high_u8(a), vget_high_u8(b), t));
+}
+
+#define frei0r_simd_vnot_(a) vmvnq_u8(a)
+#define frei0r_simd_vadds_(a, b) vqaddq_u8(a, b)
+#define frei0r_simd_vsubs_(a, b) vqsubq_u8(a, b)
+#define frei0r_simd_vmin_(a, b) vminq_u8(a, b)
+#define frei0r_simd_vmax_(a, b) vmaxq_u8(a, b)
+#define frei0r_simd_vor_(a, b) vorrq_u8(a, b)
+#define frei0r_simd_vand_(a, b) vandq_u8(a, b)
+#define frei0r_simd_vblend_(mask, a, b) vbslq_u8(mask, a, b)
+#define frei0r_simd_valpha_() \
+  vreinterpretq_u8_u32(vdupq_n_u32(FREI0R_SIMD_ALPHA_MASK))
+#define frei0r_simd_vdup_(x) vreinterpretq_u8_u32(vdupq_n_u32(x))
+#define frei0r_simd_vpxeq_(a, b) \
+  vreinterpretq_u8_u32(vceqq_u32(vreinterpretq_u32_u8(a), \
+                                 vreinterpretq_u32_u8(b)))
+/* the pixels of each half swapped, then the halves */
+#define frei0r_simd_vrev_(a) \
+  vreinterpretq_u8_u32(vcombine_u32( \
+    vget_high_u32(vrev64q_u32(vreinterpretq_u32_u8(a))), \
+    vget_low_u32(vrev64q_u32(vreinterpretq_u32_u8(a)))))
+
+#endif
+
+/*
+  Defines frei0r_simd_<name>(dst, src1, src2, n). vexpr combines the
+  vectors a and b, pexpr the pixels a and b; with min_alpha set the alpha
+  channel is replaced by the minimum of both alphas afterwards.
+*/
+#ifdef FREI0R_SIMD_WIDTH
+#define FREI0R_SIMD_KERNEL_(name, vexpr, pexpr, min_alpha)               \
+static inline void frei0r_simd_##name(uint32_t* dst, const uint32_t* src1, \
+                                      const uint32_t* src2, unsigned int n) \
+{                                                                        \
+  unsigned int i = 0;                                                    \
+  const frei0r_simd_v_ amask = frei0r_simd_valpha_();                    \
+  for (; i + FREI0R_SIMD_WIDTH <= n; i += FREI0R_SIMD_WIDTH)             \
+    {                                                                    \
+      frei0r_simd_v_ a = frei0r_simd_load_(src1 + i);                    \
+      frei0r_simd_v_ b = frei0r_simd_load_(src2 + i);                    \
+      frei0r_simd_v_ c = vexpr;                                          \
+      if (min_alpha)                                                     \
+        c = frei0r_simd_vblend_(amask, frei0r_simd_vmin_(a, b), c);      \
+      frei0r_simd_store_(dst + i, c);                                    \
+    }                                                                    \
+  for (; i < n; ++i)                                                     \
+    {                                                                    \
+      uint32_t a = src1[i], b = src2[i];                                 \
+      dst[i] = pexpr;                                                    \
+    }                                                                    \
+}
+#else
+#define FREI0R_SIMD_KERNEL_(name, vexpr, pexpr, min_alpha)               \
+static inline void frei0r_simd_##name(uint32_t* dst, const uint32_t* src1, \
+                                      const uint32_t* src2, unsigned int n) \
+{                                                                        \
+  unsigned int i;                                                        \
+  for (i = 0; i < n; ++i)                                                \
+    {                                                                    \
+      uint32_t a = src1[i], b = src2[i];                                 \
+      dst[i] = pexpr;                                                    \
+    }                                                                    \
+}
+#endif
+
+FREI0R_SIMD_KERNEL_(multiply,
+                    frei0r_simd_vmul_(a, b),
+                    frei0r_simd_multiply_px_(a, b), 1)
+FREI0R_SIMD_KERNEL_(screen,
+                    frei0r_simd_vnot_(frei0r_simd_vmul_(frei0r_simd_vnot_(a),
+                                                        frei0r_simd_vnot_(b))),
+                    frei0r_simd_screen_px_(a, b), 1)
+FREI0R_SIMD_KERNEL_(add,
+                    frei0r_simd_vadds_(a, b),
+                    frei0r_simd_add_px_(a, b), 1)
+FREI0R_SIMD_KERNEL_(subtract,
+                    frei0r_simd_vsubs_(a, b),
+                    frei0r_simd_subtract_px_(a, b), 1)
+FREI0R_SIMD_KERNEL_(darken,
+                    frei0r_simd_vmin_(a, b),
+                    frei0r_simd_darken_px_(a, b), 0)
+FREI0R_SIMD_KERNEL_(lighten,
+                    frei0r_simd_vmax_(a, b),
+                    frei0r_simd_lighten_px_(a, b), 1)
+FREI0R_SIMD_KERNEL_(difference,
+                    frei0r_simd_vor_(frei0r_simd_vsubs_(a, b),
+                                     frei0r_simd_vsubs_(b, a)),
+                    frei0r_simd_difference_px_(a, b), 1)
+
+FREI0R_SIMD_KERNEL_(and,
+                    frei0r_simd_vand_(a, b),
+                    a & b, 0)
+
+FREI0R_SIMD_KERNEL_(alpha_copy,
+                    frei0r_simd_vblend_(amask, b, a),
+                    frei0r_simd_with_alpha_(a, b >> 24), 0)
+FREI0R_SIMD_KERNEL_(alpha_max,
+                    frei0r_simd_vblend_(amask, frei0r_simd_vmax_(a, b), a),
+                    frei0r_simd_with_alpha_(a, MAX(a >> 24, b >> 24)), 0)
+FREI0R_SIMD_KERNEL_(alpha_min,
+                    frei0r_simd_vblend_(amask, frei0r_simd_vmin_(a, b), a),
+                    frei0r_simd_with_alpha_(a, MIN(a >> 24, b >> 24)), 0)
+FREI0R_SIMD_KERNEL_(alpha_add,
+                    frei0r_simd_vblend_(amask, frei0r_simd_vadds_(a, b), a),
+                    frei0r_simd_with_alpha_(a, MIN((a >> 24) + (b >> 24),
+                                                   255u)), 0)
+FREI0R_SIMD_KERNEL_(alpha_subtract,
+                    frei0r_simd_vblend_(amask, frei0r_simd_vsubs_(a, b), a),
+                    frei0r_simd_with_alpha_(a, (a >> 24) > (b >> 24)
+                                            ? (a >> 24) - (b >> 24) : 0), 0)
+
+/* like the kernels above, t is the weight of src2 from 0 to 255, t = 0
+   and t = 255 copy src1 and src2 */
+static inline void frei0r_simd_lerp(uint32_t* dst, const uint32_t* src1,
+                                    const uint32_t* src2, unsigned int n,
+                                    uint8_t t)
+{
+  unsigned int i = 0;
+  if (t == 0 || t == 255)
+    {
+      const uint32_t* src = t ? src2 : src1;
+      if (dst != src)
+        memcpy(dst, src, n * sizeof(uint32_t));
+      return;
+    }
+#ifdef FREI0R_SIMD_WIDTH
+  for (; i + FREI0R_SIMD_WIDTH <= n; i += FREI0R_SIMD_WIDTH)
+    frei0r_simd_store_(dst + i,
+                       frei0r_simd_vlerp_(frei0r_simd_load_(src1 + i),
+                                          frei0r_simd_load_(src2 + i), t));
+#endif
+  for (; i < n; ++i)
+    dst[i] = frei0r_simd_lerp_px_(src1[i], src2[i], t);
+}
+
+/* the faded echo is kept where src is no brighter (no darker) in all four
+   bytes, which the vectors test as MIN(src,e) (MAX(src,e)) == src per
+   pixel */
+static inline void frei0r_simd_echo_darker(uint32_t* dst, const uint32_t* src,
+                                           uint32_t fade, unsigned int n)
+{
+  unsigned int i = 0;
+#ifdef FREI0R_SIMD_WIDTH
+  const frei0r_simd_v_ f = frei0r_simd_vdup_(fade);
+  for (; i + FREI0R_SIMD_WIDTH <= n; i += FREI0R_SIMD_WIDTH)
+    {
+      frei0r_simd_v_ s = frei0r_simd_load_(src + i);
+      frei0r_simd_v_ e = frei0r_simd_vsubs_(frei0r_simd_load_(dst + i), f);
+      frei0r_simd_store_(dst + i, frei0r_simd_vblend_(
+                           frei0r_simd_vpxeq_(frei0r_simd_vmin_(s, e), s),
+                           e, s));
+    }
+#endif
+  for (; i < n; ++i)
+    dst[i] = frei0r_simd_echo_darker_px_(dst[i], src[i], fade);
+}
+
+static inline void frei0r_simd_echo_brighter(uint32_t* dst,
+                                             const uint32_t* src,
+                                             uint32_t fade, unsigned int n)
+{
+  unsigned int i = 0;
+#ifdef FREI0R_SIMD_WIDTH
+  const frei0r_simd_v_ f = frei0r_simd_vdup_(fade);
+  for (; i + FREI0R_SIMD_WIDTH <= n; i += FREI0R_SIMD_WIDTH)
+    {
+      frei0r_simd_v_ s = frei0r_simd_load_(src + i);
+      frei0r_simd_v_ e = frei0r_simd_vadds_(frei0r_simd_load_(dst + i), f);
+      frei0r_simd_store_(dst + i, frei0r_simd_vblend_(
+                           frei0r_simd_vpxeq_(frei0r_simd_vmax_(s, e), s),
+                           e, s));
+    }
+#endif
+  for (; i < n; ++i)
+    dst[i] = frei0r_simd_echo_brighter_px_(dst[i], src[i], fade);
+}
+
+#ifdef FREI0R_SIMD_ECHO_AVX2
+
+FREI0R_TARGET_AVX2
+static inline void frei0r_simd_echo_darker_avx2(uint32_t* dst,
+                                                const uint32_t* src,
+                                                uint32_t fade, unsigned int n)
+{
+  unsigned int i = 0;
+  const __m256i f = _mm256_set1_epi32((int)fade);
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+      __m256i e = _mm256_subs_epu8(
+        _mm256_loadu_si256((const __m256i*)(dst + i)), f);
+      __m256i m = _mm256_cmpeq_epi32(_mm256_min_epu8(s, e), s);
+      _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(s, e, m));
+    }
+  for (; i < n; ++i)
+    dst[i] = frei0r_simd_echo_darker_px_(dst[i], src[i], fade);
+}
+
+FREI0R_TARGET_AVX2
+static inline void frei0r_simd_echo_brighter_avx2(uint32_t* dst,
+                                                  const uint32_t* src,
+                                                  uint32_t fade,
+                                                  unsigned int n)
+{
+  unsigned int i = 0;
+  const __m256i f = _mm256_set1_epi32((int)fade);
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+      __m256i e = _mm256_adds_epu8(
+        _mm256_loadu_si256((const __m256i*)(dst + i)), f);
+      __m256i m = _mm256_cmpeq_epi32(_mm256_max_epu8(s, e), s);
+      _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(s, e, m));
+    }
+  for (; i < n; ++i)
+    dst[i] = frei0r_simd_echo_brighter_px_(dst[i], src[i], fade);
+}
+
+#endif
+
+/* sums of the color differences |a-b| of a run of pixels */
+typedef struct frei0r_simd_diff_stats
+{
+  uint64_t sad;         /* the sum of all color differences */
+  uint32_t max;         /* the largest color difference */
+  uint32_t changed;     /* pixels with a color difference above threshold */
+} frei0r_simd_diff_stats_t;
+
+/* frei0r_simd_difference() of the n pixels, adding their differences to
+   st, threshold from 0 to 255; dst may be 0. The vectors are SSE2 ones,
+   also on AVX2 builds, where the measurement is not the bottleneck. */
+static inline void frei0r_simd_difference_stats(uint32_t* dst,
+                                                const uint32_t* src1,
+                                                const uint32_t* src2,
+                                                unsigned int n,
+                                                unsigned int threshold,
+                                                frei0r_simd_diff_stats_t* st)
+{
+  uint32_t a, b, c, m, k;
+  unsigned int i = 0;
+#if defined(__SSE2__) && !defined(FREI0R_SIMD_SCALAR)
+  if (n >= 4)
+    {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i cmask = _mm_set1_epi32(0x00ffffff);
+      const __m128i t = _mm_set1_epi8((char)MIN(threshold, 255u));
+      __m128i sad = zero, max = zero, same = zero, va, vb, vc;
+      uint32_t lanes[4];
+
+      for (; i + 4 <= n; i += 4)
+        {
+          va = _mm_loadu_si128((const __m128i*)(src1 + i));
+          vb = _mm_loadu_si128((const __m128i*)(src2 + i));
+          vc = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(va, vb),
+                                          _mm_subs_epu8(vb, va)), cmask);
+          if (dst)
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(vc,
+              _mm_andnot_si128(cmask, _mm_min_epu8(va, vb))));
+          sad = _mm_add_epi64(sad, _mm_sad_epu8(vc, zero));
+          max = _mm_max_epu8(max, vc);
+          /* -1 in the lanes of the pixels at or below the threshold */
+          same = _mm_add_epi32(same, _mm_cmpeq_epi32(
+            _mm_subs_epu8(vc, t), zero));
+        }
+      st->sad += (uint64_t)_mm_cvtsi128_si32(sad)
+        + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+      st->changed += i;
+      _mm_storeu_si128((__m128i*)lanes, same);
+      for (k = 0; k < 4; ++k)
+        st->changed += lanes[k];
+      max = _mm_max_epu8(max, _mm_srli_si128(max, 8));
+      max = _mm_max_epu8(max, _mm_srli_si128(max, 4));
+      m = (uint32_t)_mm_cvtsi128_si32(max);
+      for (k = 0; k < 24; k += 8)
+        st->max = MAX(st->max, (m >> k) & 0xff);
+    }
+#endif
+  for (; i < n; ++i)
+    {
+      a = src1[i]; b = src2[i];
+      c = frei0r_simd_difference_px_(a, b);
+      if (dst)
+        dst[i] = c;
+      m = 0;
+      for (k = 0; k < 24; k += 8)
+        {
+          st->sad += (c >> k) & 0xff;
+          m = MAX(m, (c >> k) & 0xff);
+        }
+      st->max = MAX(st->max, m);
+      st->changed += m > threshold;
+    }
+}
+
+/* from both ends towards the middle, so that each vector is loaded
+   before its place is stored to when dst is src */
+static inline void frei0r_simd_reverse(uint32_t* dst, const uint32_t* src,
+                                       unsigned int n)
+{
+  unsigned int i = 0, j = n;
+  uint32_t a;
+#ifdef FREI0R_SIMD_WIDTH
+  for (; i + 2 * FREI0R_SIMD_WIDTH <= j;
+       i += FREI0R_SIMD_WIDTH, j -= FREI0R_SIMD_WIDTH)
+    {
+      frei0r_simd_v_ lo = frei0r_simd_load_(src + i);
+      frei0r_simd_v_ hi = frei0r_simd_load_(src + j - FREI0R_SIMD_WIDTH);
+      frei0r_simd_store_(dst + i, frei0r_simd_vrev_(hi));
+      frei0r_simd_store_(dst + j - FREI0R_SIMD_WIDTH, frei0r_simd_vrev_(lo));
+    }
+#endif
+  for (; i + 1 < j; ++i, --j)
+    {
+      a = src[i];
+      dst[i] = src[j - 1];
+      dst[j - 1] = a;
+    }
+  if (i + 1 == j)
+    dst[i] = src[i];
+}
+
+#define FREI0R_SIMD_ALPHA_MIXED 0
+#define FREI0R_SIMD_ALPHA_CLEAR 1  /* all alphas are 0 */
+#define FREI0R_SIMD_ALPHA_OPAQUE 2 /* all alphas are 255 */
+
+/* one of the FREI0R_SIMD_ALPHA_ values for the n pixels of p, n > 0 */
+static inline int frei0r_simd_alpha_class(const uint32_t* p, unsigned int n)
+{
+  uint32_t lo = 255, hi = 0, a;
+  unsigned int i = 0;
+#ifdef FREI0R_SIMD_WIDTH
+  if (n >= FREI0R_SIMD_WIDTH)
+    {
+      frei0r_simd_v_ vlo = frei0r_simd_load_(p), vhi = vlo;
+      uint32_t l[FREI0R_SIMD_WIDTH], h[FREI0R_SIMD_WIDTH];
+      for (i = FREI0R_SIMD_WIDTH; i + FREI0R_SIMD_WIDTH <= n;
+           i += FREI0R_SIMD_WIDTH)
+        {
+          frei0r_simd_v_ v = frei0r_simd_load_(p + i);
+          vlo = frei0r_simd_vmin_(vlo, v);
+          vhi = frei0r_simd_vmax_(vhi, v);
+        }
+      frei0r_simd_store_(l, vlo);
+      frei0r_simd_store_(h, vhi);
+      for (a = 0; a < FREI0R_SIMD_WIDTH; ++a)
+        {
+          lo = MIN(lo, l[a] >> 24);
+          hi = MAX(hi, h[a] >> 24);
+        }
+    }
+#endif
+  for (; i < n; ++i)
+    {
+      a = p[i] >> 24;
+      lo = MIN(lo, a);
+      hi = MAX(hi, a);
+    }
+  if (hi == 0)
+    return FREI0R_SIMD_ALPHA_CLEAR;
+  if (lo == 255)
+    return FREI0R_SIMD_ALPHA_OPAQUE;
+  return FREI0R_SIMD_ALPHA_MIXED;
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef INCLUDED_FREI0R_STATE_H
+#define INCLUDED_FREI0R_STATE_H
+
+/*
+
+  Helpers for plugins that implement f0r_save_state() and
+  f0r_load_state(). One function walks over the state of the instance
+  for both, so that saving and loading can't get out of step:
+
+  static int inst_state(inst* in, frei0r_state_t* s)
+  {
+    frei0r_state_value(s, in->frame_num);
+    frei0r_state_bytes(s, in->history, sizeof(in->history));
+    frei0r_state_buffer(s, (void**)&in->reference, in->w*in->h*4);
+    return frei0r_state_ok(s);
+  }
+
+  size_t f0r_save_state(f0r_instance_t instance, void* buffer, size_t size)
+  {
+    inst* in = (inst*)instance;
+    frei0r_state_t s;
+    frei0r_state_save(&s, buffer, size, VERSION, in->w, in->h);
+    return inst_state(in, &s) ? frei0r_state_size(&s) : 0;
+  }
+
+  int f0r_load_state(f0r_instance_t instance, const void* buffer, size_t size)
+  {
+    inst* in = (inst*)instance;
+    frei0r_state_t s;
+    frei0r_state_load(&s, buffer, size, VERSION, in->w, in->h);
+    return inst_state(in, &s) && frei0r_state_end(&s);
+  }
+
+  The state begins with a header of the plugin's VERSION of the format
+  and the frame size; loading a state with another header fails before
+  anything of the instance is changed. Values are stored as they are in
+  memory, so states only move between machines of the same byte order.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FREI0R_STATE_MAGIC 0x53523046 /* "F0RS" */
+
+typedef struct frei0r_state
+{
+  unsigned char* data; /* 0 while only measuring */
+  size_t size;         /* bytes at data */
+  size_t pos;          /* bytes saved or loaded so far */
+  int load;
+  int failed;
+} frei0r_state_t;
+
+/* Saves or loads n bytes at p. Saving past the end of the buffer only
+   counts them, for frei0r_state_size(). */
+static inline void frei0r_state_bytes(frei0r_state_t* s, void* p, size_t n)
+{
+  if (s->failed)
+    return;
+  if (s->load)
+    {
+      if (n > s->size - s->pos)
+        {
+          s->failed = 1;
+          return;
+        }
+      memcpy(p, s->data + s->pos, n);
+    }
+  else if (s->data && n <= s->size - s->pos)
+    memcpy(s->data + s->pos, p, n);
+  else
+    s->data = 0;
+  s->pos += n;
+}
+
+#define frei0r_state_value(s, v) frei0r_state_bytes((s), &(v), sizeof(v))
+
+static inline void frei0r_state_header_(frei0r_state_t* s, uint32_t version,
+                                        unsigned int width, unsigned int height)
+{
+  uint32_t header[4];
+
+  header[0] = FREI0R_STATE_MAGIC;
+  header[1] = version;
+  header[2] = width;
+  header[3] = height;
+  if (s->load)
+    {
+      uint32_t saved[4];
+
+      frei0r_state_bytes(s, saved, sizeof(saved));
+      if (!s->failed && memcmp(saved, header, sizeof(header)) != 0)
+        s->failed = 1;
+    }
+  else
+    frei0r_state_bytes(s, header, sizeof(header));
+}
+
+/* Starts saving to the size bytes at buffer, which may be 0 to measure. */
+static inline void frei0r_state_save(frei0r_state_t* s, void* buffer,
+                                     size_t size, uint32_t version,
+                                     unsigned int width, unsigned int height)
+{
+  s->data = (unsigned char*)buffer;
+  s->size = buffer ? size : 0;
+  s->pos = 0;
+  s->load = 0;
+  s->failed = 0;
+  frei0r_state_header_(s, version, width, height);
+}
+
+static inline void frei0r_state_load(frei0r_state_t* s, const void* buffer,
+                                     size_t size, uint32_t version,
+                                     unsigned int width, unsigned int height)
+{
+  s->data = (unsigned char*)buffer;
+  s->size = buffer ? size : 0;
+  s->pos = 0;
+  s->load = 1;
+  s->failed = 0;
+  frei0r_state_header_(s, version, width, height);
+}
+
+/* Saves or loads a buffer of n bytes that is only allocated, with
+   malloc, once there is something in it; *p may be 0. */
+static inline void frei0r_state_buffer(frei0r_state_t* s, void** p, size_t n)
+{
+  unsigned char present = (*p != 0);
+
+  frei0r_state_value(s, present);
+  if (s->failed)
+    return;
+  if (s->load)
+    {
+      if (!present)
+        {
+          free(*p);
+          *p = 0;
+          return;
+        }
+      if (!*p && !(*p = malloc(n)))
+        {
+          s->failed = 1;
+          return;
+        }
+    }
+  if (present)
+    frei0r_state_bytes(s, *p, n);
+}
+
+static inline int frei0r_state_ok(const frei0r_state_t* s)
+{
+  return !s->failed;
+}
+
+/* the bytes of the whole state */
+static inline size_t frei0r_state_size(const frei0r_state_t* s)
+{
+  return s->pos;
+}
+
+/* the whole buffer was loaded */
+static inline int frei0r_state_end(const frei0r_state_t* s)
+{
+  return !s->failed && s->pos == s->size;
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef INCLUDED_FREI0R_STATS_H
+#define INCLUDED_FREI0R_STATS_H
+
+/*
+
+  Stage timers for plugins that export f0r_get_stats().
+
+  A plugin keeps a frei0r_stats_t in its instance, registers one stage per
+  part of its update it wants to be able to tell apart and wraps that part
+  in FREI0R_STAT_BEGIN / FREI0R_STAT_END:
+
+  enum { STAGE_MASK, STAGE_BLUR };
+
+  f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
+  {
+    ...
+  #ifdef FREI0R_ENABLE_STATS
+    frei0r_stats_register(&inst->stats, "mask");  // STAGE_MASK
+    frei0r_stats_register(&inst->stats, "blur");  // STAGE_BLUR
+  #endif
+  }
+
+  void f0r_update(...)
+  {
+    FREI0R_STAT_BEGIN(t);
+    make_mask(...);
+    FREI0R_STAT_END(&inst->stats, STAGE_MASK, t);
+    ...
+  }
+
+  #ifdef FREI0R_ENABLE_STATS
+  int f0r_get_stats(f0r_instance_t instance, f0r_stat_info_t* stats, int count)
+  {
+    return frei0r_stats_get(&((inst*)instance)->stats, stats, count);
+  }
+  #endif
+
+  The timers are only built when FREI0R_ENABLE_STATS is defined (cmake
+  -DENABLE_STATS=ON). Otherwise the macros expand to nothing, so the
+  release builds don't pay for reading the clock. C++ effects use
+  frei0r::fx::register_stage() and frei0r::stage_timer instead, see
+  frei0r.hpp.
+
+*/
+
+#include "frei0r.h"
+
+#ifdef FREI0R_ENABLE_STATS
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define FREI0R_STATS_MAX 16
+
+typedef struct frei0r_stats
+{
+  int count;
+  f0r_stat_info_t stages[FREI0R_STATS_MAX];
+} frei0r_stats_t;
+
+/* Monotonic time in seconds. */
+static inline double frei0r_stats_now(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Adds a stage named name (which must outlive stats) and returns its
+   index, or -1 if there are already FREI0R_STATS_MAX stages. */
+static inline int frei0r_stats_register(frei0r_stats_t* stats,
+                                        const char* name)
+{
+  f0r_stat_info_t* stage;
+
+  if (stats->count == FREI0R_STATS_MAX)
+    return -1;
+  stage = &stats->stages[stats->count];
+  stage->name = name;
+  stage->calls = 0;
+  stage->seconds = 0.0;
+  stage->max_seconds = 0.0;
+  return stats->count++;
+}
+
+static inline void frei0r_stats_add(frei0r_stats_t* stats, int stage,
+                                    double seconds)
+{
+  f0r_stat_info_t* s;
+
+  if (stage < 0 || stage >= stats->count)
+    return;
+  s = &stats->stages[stage];
+  s->calls++;
+  s->seconds += seconds;
+  if (seconds > s->max_seconds)
+    s->max_seconds = seconds;
+}
+
+/* Implements f0r_get_stats(). */
+static inline int frei0r_stats_get(const frei0r_stats_t* stats,
+                                   f0r_stat_info_t* out, int count)
+{
+  int i;
+
+  for (i = 0; i < count && i < stats->count; ++i)
+    out[i] = stats->stages[i];
+  return stats->count;
+}
+
+#define FREI0R_STAT_BEGIN(t) double t = frei0r_stats_now()
+#define FREI0R_STAT_END(stats, stage, t) \
+  frei0r_stats_add((stats), (stage), frei0r_stats_now() - (t))
+
+#else
+
+#define FREI0R_STAT_BEGIN(t)
+#define FREI0R_STAT_END(stats, stage, t) ((void)0)
+
+#endif
+
+#endif
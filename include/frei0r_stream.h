@@ -0,0 +1,142 @@
+#ifndef INCLUDED_FREI0R_STREAM_H
+#define INCLUDED_FREI0R_STREAM_H
+
+/*
+
+  Streaming stores for effects that write a whole output frame without
+  reading it back: generators, fills and plain copies. A frame larger
+  than the last level cache would only evict what the next effect of the
+  chain needs, so such frames are written with non-temporal stores that
+  go around the cache:
+
+  frei0r_stream_wanted   whether a frame of that many bytes is larger
+                         than the last level cache
+  frei0r_stream_copy     n pixels from src, streamed
+  frei0r_stream_fill     n pixels of one value, streamed
+  frei0r_stream_end      orders the streamed stores before the ones that
+                         follow; each thread that streamed calls it once
+                         after its last streaming store, before it tells
+                         anyone that the frame is done
+
+  frei0r_stream_frame_copy and frei0r_stream_frame_fill do a whole frame
+  of n pixels either way, streamed and ended if frei0r_stream_wanted(),
+  with memcpy or a loop otherwise.
+
+  Effects that compute their pixels write them to a chunk of
+  FREI0R_STREAM_CHUNK pixels on the stack first and stream the chunk.
+
+  Streaming needs SSE2; elsewhere the stores are plain ones. The cache
+  size comes from sysconf() where the C library knows it.
+
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#define FREI0R_STREAM_CHUNK 256
+
+/* for machines that don't tell */
+#define FREI0R_STREAM_DEFAULT_CACHE (8 << 20)
+
+static inline int frei0r_stream_wanted(size_t bytes)
+{
+#if defined(__SSE2__)
+  static size_t cache;
+
+  if (!cache)
+    {
+      long size = 0;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+      size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+      if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+      cache = size > 0 ? (size_t)size : FREI0R_STREAM_DEFAULT_CACHE;
+    }
+  return bytes > cache;
+#else
+  (void)bytes;
+  return 0;
+#endif
+}
+
+static inline void frei0r_stream_copy(uint32_t* dst, const uint32_t* src,
+                                      size_t n)
+{
+#if defined(__SSE2__)
+  size_t i = 0;
+
+  /* the streaming stores need 16 byte aligned addresses */
+  for (; i < n && ((uintptr_t)(dst + i) & 15); ++i)
+    dst[i] = src[i];
+  for (; i + 4 <= n; i += 4)
+    _mm_stream_si128((__m128i*)(dst + i),
+                     _mm_loadu_si128((const __m128i*)(src + i)));
+  for (; i < n; ++i)
+    dst[i] = src[i];
+#else
+  memcpy(dst, src, n * sizeof(uint32_t));
+#endif
+}
+
+static inline void frei0r_stream_fill(uint32_t* dst, uint32_t value, size_t n)
+{
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i v = _mm_set1_epi32((int)value);
+
+  for (; i < n && ((uintptr_t)(dst + i) & 15); ++i)
+    dst[i] = value;
+  for (; i + 4 <= n; i += 4)
+    _mm_stream_si128((__m128i*)(dst + i), v);
+#endif
+  for (; i < n; ++i)
+    dst[i] = value;
+}
+
+static inline void frei0r_stream_end(void)
+{
+#if defined(__SSE2__)
+  _mm_sfence();
+#endif
+}
+
+static inline void frei0r_stream_frame_copy(uint32_t* dst,
+                                            const uint32_t* src, size_t n)
+{
+  if (frei0r_stream_wanted(n * sizeof(uint32_t)))
+    {
+      frei0r_stream_copy(dst, src, n);
+      frei0r_stream_end();
+    }
+  else
+    memcpy(dst, src, n * sizeof(uint32_t));
+}
+
+static inline void frei0r_stream_frame_fill(uint32_t* dst, uint32_t value,
+                                            size_t n)
+{
+  size_t i;
+
+  if (frei0r_stream_wanted(n * sizeof(uint32_t)))
+    {
+      frei0r_stream_fill(dst, value, n);
+      frei0r_stream_end();
+    }
+  else
+    for (i = 0; i < n; ++i)
+      dst[i] = value;
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef INCLUDED_FREI0R_SWIZZLE_H
+#define INCLUDED_FREI0R_SWIZZLE_H
+
+/*
+
+  Channel routing of packed pixels: each byte of an output pixel is one
+  of the four bytes of its input pixel, 0 or 255. A plugin sets up the
+  routing once per parameter change, from one selector per output byte:
+
+  frei0r_swizzle_t sw;
+  int sel[4] = { 0, 0, 0, 3 };   // the first byte three times, alpha
+
+  frei0r_swizzle_set(&sw, sel);
+
+  or from a string of four of the letters r, g, b, a, 0 and 1, which name
+  the bytes of RGBA8888 and the two constants:
+
+  frei0r_swizzle_parse(&sw, "rrra");
+
+  and routes rows of pixels with
+
+  frei0r_swizzle_row(&sw, dst, src, n);
+
+  where dst may be src. With SSSE3 (or AVX2) a row takes one pshufb and
+  one or per 4 (or 8) pixels, NEON on aarch64 has tbl for the same; with
+  plain SSE2 each output byte is a shift and a mask of the input. On x86
+  builds without AVX2 the AVX2 version is also compiled, for plugins that
+  pick it at run time: frei0r_swizzle_select() returns the best function
+  for the machine, to be called once from f0r_init().
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "frei0r_cpu.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(FREI0R_CPU_DISPATCH) && !defined(__AVX2__)
+#define FREI0R_SWIZZLE_AVX2 1
+#include <immintrin.h>
+#endif
+
+/* the selectors of the constant output bytes */
+#define FREI0R_SWIZZLE_ZERO 4
+#define FREI0R_SWIZZLE_ONE 5
+
+typedef struct frei0r_swizzle
+{
+  int sel[4];               /* per output byte: 0..3 or a constant */
+  uint8_t shuffle[16];      /* pshufb control for 4 pixels, 0x80 is 0 */
+  uint32_t ones;            /* the output bytes that are 255 */
+} frei0r_swizzle_t;
+
+typedef void (*frei0r_swizzle_fn)(const frei0r_swizzle_t* sw, uint32_t* dst,
+                                  const uint32_t* src, unsigned int n);
+
+static inline void frei0r_swizzle_set(frei0r_swizzle_t* sw, const int sel[4])
+{
+  int i, k;
+
+  sw->ones = 0;
+  for (k = 0; k < 4; ++k)
+    {
+      sw->sel[k] = sel[k] >= 0 && sel[k] <= FREI0R_SWIZZLE_ONE
+        ? sel[k] : FREI0R_SWIZZLE_ZERO;
+      if (sw->sel[k] == FREI0R_SWIZZLE_ONE)
+        sw->ones |= 0xffu << (8 * k);
+      for (i = 0; i < 4; ++i)
+        sw->shuffle[4 * i + k] = sw->sel[k] < 4
+          ? (uint8_t)(4 * i + sw->sel[k]) : 0x80;
+    }
+}
+
+/* Sets sw from four of the letters rgba01, and returns 1; returns 0 and
+   leaves sw as it is if map is anything else. */
+static inline int frei0r_swizzle_parse(frei0r_swizzle_t* sw, const char* map)
+{
+  static const char letters[] = "rgba01";
+  const char* l;
+  int sel[4], k;
+
+  if (!map || strlen(map) != 4)
+    return 0;
+  for (k = 0; k < 4; ++k)
+    {
+      l = map[k] ? strchr(letters, map[k] | 0x20) : 0;
+      if (!l)
+        return 0;
+      sel[k] = (int)(l - letters);
+    }
+  frei0r_swizzle_set(sw, sel);
+  return 1;
+}
+
+/* every output byte is the input byte at its place */
+static inline int frei0r_swizzle_is_identity(const frei0r_swizzle_t* sw)
+{
+  return sw->sel[0] == 0 && sw->sel[1] == 1 && sw->sel[2] == 2
+    && sw->sel[3] == 3;
+}
+
+static inline uint32_t frei0r_swizzle_px_(const frei0r_swizzle_t* sw,
+                                          uint32_t p)
+{
+  uint32_t q = sw->ones;
+  int k;
+
+  for (k = 0; k < 4; ++k)
+    if (sw->sel[k] < 4)
+      q |= ((p >> (8 * sw->sel[k])) & 0xff) << (8 * k);
+  return q;
+}
+
+static inline void frei0r_swizzle_row(const frei0r_swizzle_t* sw,
+                                      uint32_t* dst, const uint32_t* src,
+                                      unsigned int n)
+{
+  unsigned int i = 0;
+
+#if defined(__AVX2__)
+  const __m256i shuffle = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((const __m128i*)sw->shuffle));
+  const __m256i ones = _mm256_set1_epi32((int)sw->ones);
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(
+      _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i)),
+                          shuffle), ones));
+#elif defined(__SSSE3__)
+  const __m128i shuffle = _mm_loadu_si128((const __m128i*)sw->shuffle);
+  const __m128i ones = _mm_set1_epi32((int)sw->ones);
+
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(
+      _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle),
+      ones));
+#elif defined(__SSE2__)
+  __m128i left[4], right[4], mask[4];
+  __m128i p, q;
+  int k, used = 0;
+
+  for (k = 0; k < 4; ++k)
+    if (sw->sel[k] < 4)
+      {
+        int d = 8 * (k - sw->sel[k]);
+        left[used] = _mm_cvtsi32_si128(d > 0 ? d : 0);
+        right[used] = _mm_cvtsi32_si128(d < 0 ? -d : 0);
+        mask[used] = _mm_set1_epi32((int)(0xffu << (8 * k)));
+        ++used;
+      }
+  for (; i + 4 <= n; i += 4)
+    {
+      p = _mm_loadu_si128((const __m128i*)(src + i));
+      q = _mm_set1_epi32((int)sw->ones);
+      for (k = 0; k < used; ++k)
+        q = _mm_or_si128(q, _mm_and_si128(
+          _mm_srl_epi32(_mm_sll_epi32(p, left[k]), right[k]), mask[k]));
+      _mm_storeu_si128((__m128i*)(dst + i), q);
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  const uint8x16_t shuffle = vld1q_u8(sw->shuffle);
+  const uint32x4_t ones = vdupq_n_u32(sw->ones);
+
+  /* tbl gives 0 for the indices 0x80 */
+  for (; i + 4 <= n; i += 4)
+    vst1q_u32(dst + i, vorrq_u32(vreinterpretq_u32_u8(vqtbl1q_u8(
+      vreinterpretq_u8_u32(vld1q_u32(src + i)), shuffle)), ones));
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = frei0r_swizzle_px_(sw, src[i]);
+}
+
+#ifdef FREI0R_SWIZZLE_AVX2
+
+FREI0R_TARGET_AVX2
+static inline void frei0r_swizzle_row_avx2(const frei0r_swizzle_t* sw,
+                                           uint32_t* dst, const uint32_t* src,
+                                           unsigned int n)
+{
+  unsigned int i = 0;
+  const __m256i shuffle = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((const __m128i*)sw->shuffle));
+  const __m256i ones = _mm256_set1_epi32((int)sw->ones);
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(
+      _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i)),
+                          shuffle), ones));
+  for (; i < n; ++i)
+    dst[i] = frei0r_swizzle_px_(sw, src[i]);
+}
+
+#endif
+
+static inline frei0r_swizzle_fn frei0r_swizzle_select(void)
+{
+#ifdef FREI0R_SWIZZLE_AVX2
+  if (frei0r_cpu_features() & FREI0R_CPU_AVX2)
+    return frei0r_swizzle_row_avx2;
+#endif
+  return frei0r_swizzle_row;
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef INCLUDED_FREI0R_THREAD_H
+#define INCLUDED_FREI0R_THREAD_H
+
+/*
+
+  Fork-join helper for plugins that split one frame over several threads
+  themselves, for passes that can't be expressed as f0r_update_slice()
+  row ranges (column passes, several passes per frame with a dependency
+  between them).
+
+  The plugin fills an array of job structures, one per thread, and runs a
+  function on each of them; frei0r_thread_run() returns when all of them
+  are done:
+
+  typedef struct { const uint32_t* src; uint32_t* dst; int x0, x1; } job_t;
+
+  static void* columns(void* arg)
+  {
+    job_t* job = (job_t*)arg;
+    ...
+    return 0;
+  }
+
+  job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count(width * height);
+
+  for (i = 0; i < n; ++i)
+    ...
+  frei0r_thread_run(columns, jobs, sizeof(job_t), n);
+
+  The first job runs in the calling thread. Threads are only available
+  when the build found pthreads (FREI0R_HAVE_PTHREAD, the plugin links
+  ${FREI0R_THREAD_LIBS}); otherwise frei0r_thread_count() is always 1 and
+  frei0r_thread_run() runs the jobs one after the other.
+
+  This header also defines the plugin's f0r_set_executor(): once the
+  application hands over its thread pool, the jobs run on that instead,
+  and frei0r_thread_count() gives at most its concurrency. It may
+  therefore only be included by one source file of a plugin.
+
+*/
+
+#include <stddef.h>
+
+#ifdef FREI0R_HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "frei0r.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define FREI0R_MAX_THREADS 8
+
+/* the executor of f0r_set_executor(), 0 for threads of the plugin */
+static inline const f0r_executor_t** frei0r_thread_executor_(void)
+{
+  static const f0r_executor_t* executor;
+  return &executor;
+}
+
+#ifdef __cplusplus
+extern "C"
+#endif
+void f0r_set_executor(const f0r_executor_t* executor)
+{
+  *frei0r_thread_executor_() = executor;
+}
+
+/* frames with fewer pixels aren't worth starting threads for */
+#define FREI0R_THREAD_MIN_PIXELS (256*256)
+
+/* Returns how many threads to split a frame of the given number of
+   pixels over: one per core, at most FREI0R_MAX_THREADS. */
+static inline int frei0r_thread_count(long pixels)
+{
+  const f0r_executor_t* executor = *frei0r_thread_executor_();
+  long n;
+
+  if (executor)
+    n = executor->concurrency;
+  else
+    {
+#ifdef FREI0R_HAVE_PTHREAD
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+      n = 1;
+#endif
+    }
+  if (pixels < FREI0R_THREAD_MIN_PIXELS || n < 1)
+    return 1;
+  return n > FREI0R_MAX_THREADS ? FREI0R_MAX_THREADS : (int)n;
+}
+
+typedef struct frei0r_thread_jobs_
+{
+  void* (*fn)(void*);
+  char* jobs;
+  size_t size;
+} frei0r_thread_jobs_t;
+
+static inline void frei0r_thread_job_(void* ctx, int index)
+{
+  frei0r_thread_jobs_t* t = (frei0r_thread_jobs_t*)ctx;
+  t->fn(t->jobs + index * t->size);
+}
+
+/* Runs fn on each of the n jobs of size bytes at jobs, at most
+   FREI0R_MAX_THREADS, and waits for all of them. */
+static inline void frei0r_thread_run(void* (*fn)(void*), void* jobs,
+                                     size_t size, int n)
+{
+  const f0r_executor_t* executor = *frei0r_thread_executor_();
+  char* job = (char*)jobs;
+  int i;
+#ifdef FREI0R_HAVE_PTHREAD
+  pthread_t threads[FREI0R_MAX_THREADS];
+  int started[FREI0R_MAX_THREADS];
+#endif
+
+  if (executor && n > 1)
+    {
+      frei0r_thread_jobs_t t;
+
+      t.fn = fn;
+      t.jobs = job;
+      t.size = size;
+      executor->parallel_for(executor->host, 0, n, frei0r_thread_job_, &t);
+      return;
+    }
+#ifdef FREI0R_HAVE_PTHREAD
+
+  for (i = 1; i < n; ++i)
+    started[i] = (pthread_create(&threads[i], NULL, fn, job + i*size) == 0);
+  fn(job);
+  for (i = 1; i < n; ++i)
+    {
+      if (started[i])
+        pthread_join(threads[i], NULL);
+      else
+        fn(job + i*size);
+    }
+#else
+  for (i = 0; i < n; ++i)
+    fn(job + i*size);
+#endif
+}
+
+#endif
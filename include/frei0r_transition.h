@@ -0,0 +1,73 @@
+#ifndef INCLUDED_FREI0R_TRANSITION_H
+#define INCLUDED_FREI0R_TRANSITION_H
+
+/*
+
+  Timing of transitions driven by the time argument of the update
+  functions, so that one instance runs a whole transition without the
+  host setting a parameter every frame. A transition starts at time
+  start and lasts duration seconds:
+
+  pos = frei0r_transition_position(time, start, duration, curve);
+
+  pos is 0 before the start, 1 after the end and follows the curve in
+  between:
+
+  FREI0R_TRANSITION_LINEAR    t
+  FREI0R_TRANSITION_SMOOTH    t * t * (3 - 2 * t)
+  FREI0R_TRANSITION_EASE_IN   t * t
+  FREI0R_TRANSITION_EASE_OUT  t * (2 - t)
+
+  frei0r_transition_curve maps the names "linear", "smooth", "ease-in"
+  and "ease-out" of a string parameter to these values, unknown names
+  give FREI0R_TRANSITION_LINEAR.
+
+*/
+
+#include <string.h>
+
+typedef enum frei0r_transition_curve
+{
+  FREI0R_TRANSITION_LINEAR,
+  FREI0R_TRANSITION_SMOOTH,
+  FREI0R_TRANSITION_EASE_IN,
+  FREI0R_TRANSITION_EASE_OUT
+} frei0r_transition_curve_t;
+
+static inline frei0r_transition_curve_t
+frei0r_transition_curve(const char* name)
+{
+  if (!strcmp(name, "smooth"))
+    return FREI0R_TRANSITION_SMOOTH;
+  if (!strcmp(name, "ease-in"))
+    return FREI0R_TRANSITION_EASE_IN;
+  if (!strcmp(name, "ease-out"))
+    return FREI0R_TRANSITION_EASE_OUT;
+  return FREI0R_TRANSITION_LINEAR;
+}
+
+/* duration must be above 0 */
+static inline double
+frei0r_transition_position(double time, double start, double duration,
+                           frei0r_transition_curve_t curve)
+{
+  double t = (time - start) / duration;
+
+  if (!(t > 0.0))
+    return 0.0;
+  if (t >= 1.0)
+    return 1.0;
+  switch (curve)
+    {
+    case FREI0R_TRANSITION_SMOOTH:
+      return t * t * (3.0 - 2.0 * t);
+    case FREI0R_TRANSITION_EASE_IN:
+      return t * t;
+    case FREI0R_TRANSITION_EASE_OUT:
+      return t * (2.0 - t);
+    default:
+      return t;
+    }
+}
+
+#endif
@@ -24,6 +24,7 @@
  */
 
 #include "frei0r.h"
+#include "frei0r_remap.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,16 +49,20 @@ typedef struct tdflippo_instance
 {
   unsigned int width,height,fsize;
   int *mask;
+  float *colx,*coly; /* m00*x and m10*x of the last matrix, per column */
+  frei0r_remap_t remap; /* the mask, with the pixels it leaves resolved */
   float flip[3],rate[3],center[2];
-  unsigned char invertrot,dontblank,fillblack,mustrecompute;
+  unsigned char invertrot,dontblank,fillblack,mustrecompute,mustremap;
 } tdflippo_instance_t;
 
-static float **newmat(unsigned char unit_flg);
-static void matfree(float **mat);
-static float **mat_translate(float tx,float ty,float tz);
-static float **mat_rotate(enum axis ax,float angle);
-static float **matmult(float **mat1,float **mat2);
-static void vetmat(float **mat,float *x,float *y,float *z);
+typedef struct tdflippo_mat
+{
+  float m[MSIZE][MSIZE];
+} tdflippo_mat_t;
+
+static void mat_translate(tdflippo_mat_t *mat,float tx,float ty,float tz);
+static void mat_rotate(tdflippo_mat_t *mat,enum axis ax,float angle);
+static void matmult(tdflippo_mat_t *mat1,const tdflippo_mat_t *mat2);
 static void recompute_mask(tdflippo_instance_t* inst);
 
 int f0r_init()
@@ -77,7 +82,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* flippoInfo)
   flippoInfo->color_model=F0R_COLOR_MODEL_PACKED32;
   flippoInfo->frei0r_version=FREI0R_MAJOR_VERSION;
   flippoInfo->major_version=0;
-  flippoInfo->minor_version=1;
+  flippoInfo->minor_version=2;
   flippoInfo->num_params=11;
   flippoInfo->explanation="Frame rotation in 3d-space";
 }
@@ -154,6 +159,11 @@ f0r_instance_t f0r_construct(unsigned int width,unsigned int height)
   inst->flip[0]=inst->flip[1]=inst->flip[2]=inst->rate[0]=inst->rate[1]=inst->rate[2]=0.5;
   
   inst->mask=(int*)malloc(sizeof(int)*inst->fsize);
+  memset(inst->mask,0xff,sizeof(int)*inst->fsize);
+  inst->colx=(float*)malloc(sizeof(float)*width);
+  inst->coly=(float*)malloc(sizeof(float)*width);
+  frei0r_remap_init(&inst->remap);
+  inst->mustremap=1;
 
   return (f0r_instance_t)inst;
 }
@@ -163,6 +173,9 @@ void f0r_destruct(f0r_instance_t instance)
   tdflippo_instance_t* inst=(tdflippo_instance_t*)instance;
 
   free(inst->mask);
+  free(inst->colx);
+  free(inst->coly);
+  frei0r_remap_free(&inst->remap);
   free(inst);
 }
 
@@ -207,6 +220,7 @@ void f0r_set_param_value(f0r_instance_t instance,
     break;
   case 10:
     inst->fillblack=(*((double*)param)>=0.5);
+    inst->mustremap=1;
     break;
   }
 
@@ -284,163 +298,179 @@ void f0r_update(f0r_instance_t instance,double time,
 	inst->flip[i]-=1.0;
     }
     recompute_mask(inst);
+    inst->mustremap=1;
   }
 
-  for(i=0;i<inst->fsize;i++)
+  if(inst->mustremap)
   {
-    if(inst->mask[i]>=0)
-      outframe[i]=inframe[inst->mask[i]];
-    else if(!inst->fillblack)
-      outframe[i]=inframe[i];
-    else
-      outframe[i]=0;
-  }
-}
-
-static float **newmat(unsigned char unit_flg)
-{
-  int i;
-  float **to_ret=(float**)malloc(sizeof(float *)*MSIZE);
+    int32_t *idx=frei0r_remap_index(&inst->remap,inst->width,inst->height,
+                                    inst->width,inst->height);
 
-  for(i=0;i<MSIZE;i++)
-  {
-    to_ret[i]=(float*)calloc(MSIZE,sizeof(float));
-    if(unit_flg)
-      to_ret[i][i]=1.0;
+    inst->mustremap=0;
+    for(i=0;i<(int)inst->fsize;i++)
+      idx[i]=(inst->mask[i]>=0 || inst->fillblack) ? inst->mask[i] : i;
   }
 
-  return to_ret;
+  frei0r_remap_run(&inst->remap,inframe,outframe,0);
 }
 
-static void matfree(float **mat)
+static void mat_unit(tdflippo_mat_t *mat)
 {
   int i;
 
+  memset(mat,0,sizeof(*mat));
   for(i=0;i<MSIZE;i++)
-    free(mat[i]);
-  
-  free(mat);
+    mat->m[i][i]=1.0;
 }
 
-static float **mat_translate(float tx,float ty,float tz)
+static void mat_translate(tdflippo_mat_t *mat,float tx,float ty,float tz)
 {
-  float **mat=newmat(1);
-
-  mat[0][3]=tx;
-  mat[1][3]=ty;
-  mat[2][3]=tz;
-
-  return mat;
+  mat_unit(mat);
+  mat->m[0][3]=tx;
+  mat->m[1][3]=ty;
+  mat->m[2][3]=tz;
 }
 
-static float **mat_rotate(enum axis ax,float angle)
+static void mat_rotate(tdflippo_mat_t *mat,enum axis ax,float angle)
 {
-  float **mat=newmat(1);
   float sf=sinf(angle);
   float cf=cosf(angle);
 
+  mat_unit(mat);
   switch(ax)
   {
     case AXIS_X:
-      mat[1][1]=cf;
-      mat[1][2]=-sf;
-      mat[2][1]=sf;
-      mat[2][2]=cf;
+      mat->m[1][1]=cf;
+      mat->m[1][2]=-sf;
+      mat->m[2][1]=sf;
+      mat->m[2][2]=cf;
       break;
     case AXIS_Y:
-      mat[0][0]=cf;
-      mat[0][2]=sf;
-      mat[2][0]=-sf;
-      mat[2][2]=cf;
+      mat->m[0][0]=cf;
+      mat->m[0][2]=sf;
+      mat->m[2][0]=-sf;
+      mat->m[2][2]=cf;
       break;
     case AXIS_Z:
-      mat[0][0]=cf;
-      mat[0][1]=-sf;
-      mat[1][0]=sf;
-      mat[1][1]=cf;
+      mat->m[0][0]=cf;
+      mat->m[0][1]=-sf;
+      mat->m[1][0]=sf;
+      mat->m[1][1]=cf;
       break;
   }
-  return mat;
 }  
 
-static float **matmult(float **mat1,float **mat2)
+/* mat1 = mat1 * mat2 */
+static void matmult(tdflippo_mat_t *mat1,const tdflippo_mat_t *mat2)
 {
-  float **mat=newmat(0);
+  tdflippo_mat_t mat;
   int i,j,k;
 
+  memset(&mat,0,sizeof(mat));
   for(i=0;i<MSIZE;i++)
     for(j=0;j<MSIZE;j++)
       for(k=0;k<MSIZE;k++)
-	mat[i][j]+=mat1[i][k]*mat2[k][j];
-  
-  matfree(mat1);
-  matfree(mat2);
+	mat.m[i][j]+=mat1->m[i][k]*mat2->m[k][j];
 
-  return mat;
+  *mat1=mat;
 }
 
-static void vetmat(float **mat,float *x,float *y,float *z)
+typedef struct tdflippo_job
 {
-  float v;
-  float vet[]={*x,*y,*z,1.0};
-  float *vetp[]={x,y,z,&v};
-  int i,j;
+  tdflippo_instance_t *inst;
+  float m[2][2]; /* rows 0 and 1 of the matrix, columns 1 and 3 */
+  int y0,y1;
+} tdflippo_job_t;
+
+/* The mask of rows y0 to y1. Pixels have z = 0, so only the x and y
+   rows of the matrix move them; the terms of x come from colx and coly,
+   those of y are added once per row. */
+static void *tdflippo_rows(void *arg)
+{
+  tdflippo_job_t *job=(tdflippo_job_t*)arg;
+  tdflippo_instance_t *inst=job->inst;
+  const float m01=job->m[0][0],m03=job->m[0][1];
+  const float m11=job->m[1][0],m13=job->m[1][1];
+  const float *colx=inst->colx,*coly=inst->coly;
+  const int w=inst->width,h=inst->height;
+  int *mask=inst->mask;
+  int x,y,nx,ny,pos;
 
-  for(i=0;i<MSIZE;i++)
+  for(y=job->y0;y<job->y1;y++)
   {
-    *(vetp[i])=0.0;
+    const float yf=(float)y,ax=m01*yf,ay=m11*yf;
 
-    for(j=0;j<MSIZE;j++)
-      *(vetp[i])+=mat[i][j]*vet[j];
+    pos=y*w;
+    for(x=0;x<w;x++,pos++)
+    {
+      nx=(int)((colx[x]+ax)+m03+0.5f);
+      ny=(int)((coly[x]+ay)+m13+0.5f);
+
+      if(nx>=0 && nx<w && ny>=0 && ny<h)
+      {
+	if(!inst->invertrot)
+	  mask[ny*w+nx]=pos;
+	else
+	  mask[pos]=ny*w+nx;
+      }
+    }
   }
+  return 0;
 }
-  
+
 static void recompute_mask(tdflippo_instance_t* inst)
 {
   float xpos=(float)inst->width*inst->center[0];
   float ypos=(float)inst->height*inst->center[1];
-  float **mat=mat_translate(xpos,ypos,0.0);
-  
+  tdflippo_mat_t mat,step;
+  tdflippo_job_t jobs[FREI0R_MAX_THREADS];
+  int k,n,x;
+
+  mat_translate(&mat,xpos,ypos,0.0);
   if(inst->flip[0]!=0.5)
-    mat=matmult(mat,mat_rotate(AXIS_X,(inst->flip[0]-0.5)*TWO_PI));
+  {
+    mat_rotate(&step,AXIS_X,(inst->flip[0]-0.5)*TWO_PI);
+    matmult(&mat,&step);
+  }
   if(inst->flip[1]!=0.5)
-    mat=matmult(mat,mat_rotate(AXIS_Y,(inst->flip[1]-0.5)*TWO_PI));
+  {
+    mat_rotate(&step,AXIS_Y,(inst->flip[1]-0.5)*TWO_PI);
+    matmult(&mat,&step);
+  }
   if(inst->flip[2]!=0.5)
-    mat=matmult(mat,mat_rotate(AXIS_Z,(inst->flip[2]-0.5)*TWO_PI));
-  
-  mat=matmult(mat,mat_translate(-xpos,-ypos,0.0));
-  
-#if 0
-  fprintf(stderr,"Resarra %.2f %.2f %.2f %.2f | %.2f %.2f %.2f %.2f | %.2f %.2f %.2f %.2f | %.2f %.2f %.2f %.2f\n",
-	  mat[0][0],mat[0][1],mat[0][2],mat[0][3],
-	  mat[1][0],mat[1][1],mat[1][2],mat[1][3],
-	  mat[2][0],mat[2][1],mat[2][2],mat[2][3],
-	  mat[3][0],mat[3][1],mat[3][2],mat[3][3]);
-#endif
+  {
+    mat_rotate(&step,AXIS_Z,(inst->flip[2]-0.5)*TWO_PI);
+    matmult(&mat,&step);
+  }
+  mat_translate(&step,-xpos,-ypos,0.0);
+  matmult(&mat,&step);
   
-  int x,y,nx,ny,pos;
-  float xf,yf,zf;
-
   if(!inst->dontblank)
     memset(inst->mask,0xff,sizeof(int)*inst->fsize);
 
-  for(y=0,pos=0;y<inst->height;y++)
-    for(x=0;x<inst->width;x++,pos++)
-    {
-      xf=x;
-      yf=y;
-      zf=0.0;
-      vetmat(mat,&xf,&yf,&zf);
-      nx=(int)(xf+0.5);
-      ny=(int)(yf+0.5);
-      
-      if(nx>=0 && nx<inst->width && ny>=0 && ny<inst->height)
-      {
-	if(!inst->invertrot) 
-	  inst->mask[ny*inst->width+nx]=pos;
-	else
-	  inst->mask[pos]=ny*inst->width+nx;
-      }
-    }
-  matfree(mat);
+  for(x=0;x<(int)inst->width;x++)
+  {
+    inst->colx[x]=mat.m[0][0]*(float)x;
+    inst->coly[x]=mat.m[1][0]*(float)x;
+  }
+  for(k=0;k<2;k++)
+  {
+    jobs[0].m[k][0]=mat.m[k][1];
+    jobs[0].m[k][1]=mat.m[k][3];
+  }
+
+  /* pixels moved to the same place are taken from the last one, so the
+     moves run in order; with the assignment inverted each pixel of the
+     mask is written once and the rows can be shared out */
+  n=inst->invertrot ? frei0r_thread_count((long)inst->fsize) : 1;
+  if(n>(int)inst->height)
+    n=inst->height;
+  for(k=0;k<n;k++)
+  {
+    jobs[k]=jobs[0];
+    jobs[k].inst=inst;
+    jobs[k].y0=inst->height*k/n;
+    jobs[k].y1=inst->height*(k+1)/n;
+  }
+  frei0r_thread_run(tdflippo_rows,jobs,sizeof(tdflippo_job_t),n);
 }
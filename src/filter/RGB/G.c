@@ -21,6 +21,8 @@
 #include <assert.h>
 
 #include "frei0r.h"
+#include "frei0r_swizzle.h"
+#include "frei0r_thread.h"
 
 typedef struct rgb_instance
 {
@@ -28,8 +30,23 @@ typedef struct rgb_instance
   unsigned int height;
 } rgb_instance_t;
 
+typedef struct rgb_job
+{
+  f0r_instance_t instance;
+  const uint32_t* inframe;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} rgb_job_t;
+
+/* Green in all three color channels, alpha is kept */
+static frei0r_swizzle_t swizzle;
+static frei0r_swizzle_fn swizzle_row = frei0r_swizzle_row;
+
 int f0r_init()
 {
+  static const int sel[4] = { 1, 1, 1, 3 };
+  frei0r_swizzle_set(&swizzle, sel);
+  swizzle_row = frei0r_swizzle_select();
   return 1;
 }
 
@@ -49,6 +66,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* rgbInfo)
   rgbInfo->explanation = "Extracts Green from Image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   /* no params */
@@ -74,20 +98,46 @@ void f0r_get_param_value(f0r_instance_t instance,
 			 f0r_param_t param, int param_index)
 { /* no params */ }
 
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  rgb_instance_t* inst = (rgb_instance_t*)instance;
+  const unsigned long offset = (unsigned long)inst->width * row_begin;
+
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+  swizzle_row(&swizzle, outframe + offset, inframe + offset,
+              inst->width * (row_end - row_begin));
+  return 1;
+}
+
+static void* rgb_rows(void* arg)
+{
+  rgb_job_t* job = (rgb_job_t*)arg;
+  f0r_update_slice(job->instance, 0.0, job->inframe, 0, 0, job->outframe,
+                   job->row_begin, job->row_end, 0);
+  return 0;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
   assert(instance);
   rgb_instance_t* inst = (rgb_instance_t*)instance;
-  unsigned int w = inst->width;
-  unsigned int h = inst->height;
-  unsigned int x,y;
-  
-  uint32_t* dst = outframe;
-  const uint32_t* src = inframe;
-  for(y=0;y<h;++y)
-      for(x=0;x<w;++x,++src) {
-	  *dst++ = ( 0xff00ff00 & (*src) ) | ( (0x0000ff00 & (*src)) << 8 ) | ( (0x0000ff00 & (*src)) >> 8 ) ; 
-      }
-}
+  rgb_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
 
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].instance = instance;
+    jobs[i].inframe = inframe;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(rgb_rows, jobs, sizeof(rgb_job_t), n);
+}
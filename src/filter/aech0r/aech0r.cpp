@@ -21,19 +21,21 @@
  * Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  *
  */
+////// Uncomment to force non optimisation version
+//~ #define FREI0R_SIMD_SCALAR
+
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_simd.h"
+#include "frei0r_thread.h"
 
 #include <string.h>
 #include <climits>
 
-////// Uncomment to force non optimisation version
-//~ #undef __SSE2__
-
 ////// TODO / IDEAS / ... //////
 // IDEA - directionnal echo ? (X/Y like parameter )
 // TODO RGB gradiant by fading influence need more love (See '//Fade by color layers')!
-// FIXME SSE2 version doesnt support RGB fading influence !
+// FIXME the fade kernels dont support RGB fading influence !
 
 // FIXME (Veejay specifics?) on activate/desactivate/activate/..., some buffers must be cleared!
 
@@ -47,21 +49,11 @@
 // EXPLORE ME a very high m_factor value give some interresting color result (      m_factor += (factor * 64) * m_skip;)
 
 
-/* Intrinsic declarations */
-#if defined(__SSE2__)
-#include <emmintrin.h>
-// TODO mmx support and others
-//  #elif defined(__MMX__)
-// #include <mmintrin.h>
-#endif
-
 #define SKIP_MAX_IMAGES 8
 #define M_FACTOR_MAV    127
 
-union px_t {
-  uint32_t u;
-  unsigned char c[4]; // 0=B, 1=G,2=R,3=A ? i think :P
-};
+typedef void (*echo_fn)(uint32_t* dst, const uint32_t* src, uint32_t fade,
+                        unsigned int n);
 
 class aech0r : public frei0r::filter {
 private:
@@ -97,19 +89,25 @@ private:
 
   //~ unsigned int m_rgb; //Fade by color layers
 
-#ifdef __SSE2__
-  long long int m_factor_sse2;
-
-  inline void tracesse2_add(uint32_t* out, const uint32_t* in);
-  inline void tracesse2_sub(uint32_t* out, const uint32_t* in);
-#else
-  unsigned int m_factor_r;
-  unsigned int m_factor_g;
-  unsigned int m_factor_b;
-
-  inline void trace_add(uint32_t* out, const uint32_t* in);
-  inline void trace_sub(uint32_t* out, const uint32_t* in);
-#endif
+  long long int m_fade; // fade of each byte, see frei0r_simd.h
+
+  // the kernels of frei0r_simd.h for this CPU
+  echo_fn trace_add;
+  echo_fn trace_sub;
+
+  // a band of pixels of the frame, one per thread
+  struct Job {
+    echo_fn trace;
+    uint32_t* out;
+    const uint32_t* in;
+    uint32_t fade;
+    unsigned int n;
+  };
+  static void* trace(void* arg) {
+    Job* job = (Job*)arg;
+    job->trace(job->out, job->in, job->fade, job->n);
+    return 0;
+  }
 public:
 
   aech0r(unsigned int width, unsigned int height) {
@@ -128,6 +126,15 @@ public:
     firsttime = true;
     m_skip_count = 0;
 
+    trace_add = frei0r_simd_echo_brighter;
+    trace_sub = frei0r_simd_echo_darker;
+#ifdef FREI0R_SIMD_ECHO_AVX2
+    if (frei0r_cpu_features() & FREI0R_CPU_AVX2) {
+      trace_add = frei0r_simd_echo_brighter_avx2;
+      trace_sub = frei0r_simd_echo_darker_avx2;
+    }
+#endif
+
     register_param(factor, "Fade Factor", "Disappearance rate of the echo"); // 0 No fade, 1 No Trace
     register_param(bright, "Direction", "Darker or Brighter echo"); // Add or Substract data
     register_param(flag_r, "Keep RED", "Influence on Red channel"); // 0 Fade canal, 1 Keep canal data
@@ -145,6 +152,21 @@ public:
   ~aech0r() {
   }
 
+  // the echo itself is kept in the output frame of the host
+  virtual bool clone_state(const frei0r::fx& other) {
+    const aech0r& o = static_cast<const aech0r&>(other);
+    firsttime = o.firsttime;
+    m_skip_count = o.m_skip_count;
+    return true;
+  }
+
+  // the next frame starts the echo again
+  virtual bool reset() {
+    firsttime = true;
+    m_skip_count = 0;
+    return true;
+  }
+
   virtual void update(double time,
                       uint32_t* out,
                       const uint32_t* in) {
@@ -168,17 +190,11 @@ public:
     //~ m_rgb = (fade_rgb * 8); //Fade by color layers
     m_factor = (factor * M_FACTOR_MAV);  //MAgic Value ;-)
 
-#ifdef __SSE2__
-    // sse2 mask for fade operation
-    m_factor_sse2 = 0;
-    m_factor_sse2 = (flag_r==true)?(bright_factor << 24):(m_factor << 16);
-    m_factor_sse2 += (flag_g==true)?(bright_factor << 16):(m_factor << 8);
-    m_factor_sse2 += (flag_b==true)?(bright_factor << 8):(m_factor << 0);
-#else
-    m_factor_r = (flag_r==true)?(bright_factor):(m_factor);
-    m_factor_g = (flag_g==true)?(bright_factor):(m_factor);
-    m_factor_b = (flag_b==true)?(bright_factor):(m_factor);
-#endif
+    // mask for fade operation
+    m_fade = 0;
+    m_fade = (flag_r==true)?(bright_factor << 24):(m_factor << 16);
+    m_fade += (flag_g==true)?(bright_factor << 16):(m_factor << 8);
+    m_fade += (flag_b==true)?(bright_factor << 8):(m_factor << 0);
 
     //~ m_factor_r = m_factor * factor_r;  //Fade by color layers
     //~ m_factor_g = m_factor * factor_g;
@@ -189,119 +205,26 @@ public:
     //~ m_flag_r = (m_flag_rgb & 4) == 4;
     //~ m_factor_sse2 = (m_factor << 16) + (m_factor << 8) + m_factor ;
 
-    if(bright) {
-      for(unsigned int i = 0 ; i < size ; i+=4) {
-#ifdef __SSE2__
-        tracesse2_sub(out+i, in+i);
-#else
-        trace_sub(out+i, in+i);
-        trace_sub(out+i+1, in+i+1);
-        trace_sub(out+i+2, in+i+2);
-        trace_sub(out+i+3, in+i+3);
-#endif
-      }
-    } else {
-      for(unsigned int i = 0 ; i < size ; i+=4) {
-#ifdef __SSE2__
-        tracesse2_add(out+i, in+i);
-#else
-        trace_add(out+i, in+i);
-        trace_add(out+i+1, in+i+1);
-        trace_add(out+i+2, in+i+2);
-        trace_add(out+i+3, in+i+3);
-#endif
-      }
+    Job jobs[FREI0R_MAX_THREADS];
+    int n = frei0r_thread_count(size);
+    for(int i = 0; i < n; i++) {
+      unsigned int p0 = (unsigned int)((unsigned long)size * i / n);
+      unsigned int p1 = (unsigned int)((unsigned long)size * (i + 1) / n);
+      jobs[i].trace = bright ? trace_sub : trace_add;
+      jobs[i].out = out + p0;
+      jobs[i].in = in + p0;
+      jobs[i].fade = (uint32_t)m_fade;
+      jobs[i].n = p1 - p0;
     }
+    frei0r_thread_run(trace, jobs, sizeof(Job), n);
 
   }
 };
 
-#ifdef __SSE2__
-inline void aech0r::tracesse2_sub(uint32_t* out, const uint32_t* in) {
-  __m128i aa = _mm_load_si128((__m128i*)in);
-  __m128i bb = _mm_load_si128((__m128i*)out);
-  // set a fade (rgb) computation
-  __m128i ff = _mm_set1_epi32(m_factor_sse2);
-  bb = _mm_subs_epu8(bb, ff);
-
-  // unsigned a < b
-  __m128i tmp = _mm_cmpeq_epi8( aa, _mm_min_epu8(aa, bb));
-
-  // create a bit mask
-  ff  = _mm_cmpeq_epi32 (tmp, _mm_set1_epi8(0xff));
-
-  bb = _mm_or_si128 (_mm_andnot_si128 (ff, aa),_mm_and_si128 (bb,ff));
-  _mm_store_si128((__m128i*)&out[0], bb);
-}
-
-inline void aech0r::tracesse2_add(uint32_t* out, const uint32_t* in) {
-  __m128i aa = _mm_load_si128((__m128i*)in);
-  __m128i bb = _mm_load_si128((__m128i*)out);
-
-  // set a fade (rgb) value
-  __m128i ff = _mm_set1_epi32(m_factor_sse2);
-  bb = _mm_adds_epu8(bb, ff);
-
-  // unsigned a >= b
-  __m128i tmp = _mm_cmpeq_epi8( aa, _mm_max_epu8(aa, bb));
-
-  // create a bit mask
-  ff  = _mm_cmpeq_epi32 (tmp, _mm_set1_epi8(0xff));
-
-  bb = _mm_or_si128 (_mm_andnot_si128 (ff, aa),_mm_and_si128 (bb,ff));
-  _mm_store_si128((__m128i*)&out[0], bb);
-}
-
-#else
-
-inline void aech0r::trace_sub(uint32_t* out, const uint32_t* in) {
-
-  px_t po, pi;
-  po.u = *out;
-  pi.u = *in;
-
-  //~ po.c[0]=(m_rgb & 4)?pi.c[0]:CLAMP0255(po.c[0] - m_factor_b);//Fade by color layers
-  //~ po.c[1]=(m_rgb & 2)?pi.c[1]:CLAMP0255(po.c[1] - m_factor_g);
-  //~ po.c[2]=(m_rgb & 1)?pi.c[2]:CLAMP0255(po.c[2] - m_factor_r);
-  //NOTA : BGR order come from Frei0r spec
-  po.c[0]=(CLAMP0255(po.c[0] - m_factor_b));
-  po.c[1]=(CLAMP0255(po.c[1] - m_factor_g));
-  po.c[2]=(CLAMP0255(po.c[2] - m_factor_r));
-  *out = po.u;
-  if( (po.c[0]<=pi.c[0]) |
-      (po.c[1]<=pi.c[1]) |
-      (po.c[2]<=pi.c[2]) ) {
-    *out = pi.u;
-  }
-}
-
-inline void aech0r::trace_add(uint32_t* out, const uint32_t* in) {
-
-  px_t po, pi;
-  po.u = *out;
-  pi.u = *in;
-
-  //NOTA : BGR order come from Frei0r spec
-  po.c[0] = CLAMP0255(po.c[0] + m_factor_b);
-  po.c[1] = CLAMP0255(po.c[1] + m_factor_g);
-  po.c[2] = CLAMP0255(po.c[2] + m_factor_r);
-  //~ po.c[0]=(m_rgb & 4)?pi.c[0]:CLAMP0255(po.c[0] + m_factor_b); //Fade by color layers
-  //~ po.c[1]=(m_rgb & 2)?pi.c[1]:CLAMP0255(po.c[1] + m_factor_g);
-  //~ po.c[2]=(m_rgb & 1)?pi.c[2]:CLAMP0255(po.c[2] + m_factor_r);
-  *out = po.u;
-  //~ if( ((po.c[0]>pi.c[0])&m_flag_b) | //Fade by color layers (why this test is here and not in trace_sub?)
-      //~ ((po.c[1]>pi.c[1])&m_flag_g) |
-      //~ ((po.c[2]>pi.c[2])&m_flag_r) ) {
-  if( ((po.c[0]>pi.c[0])) |
-      ((po.c[1]>pi.c[1])) |
-      ((po.c[2]>pi.c[2])) ) {
-    *out = pi.u;
-  }
-}
-
-#endif // __SSE2__
-
 frei0r::construct<aech0r> plugin("aech0r",
 									"analog video echo",
 									"d-j-a-y & vloop",
-									0,1);
+									0,1,
+									F0R_COLOR_MODEL_BGRA8888,
+									F0R_CAP_TEMPORAL | F0R_CAP_CLONE |
+									F0R_CAP_RB_SYMMETRIC);
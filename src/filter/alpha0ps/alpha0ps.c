@@ -37,10 +37,11 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 #include <frei0r.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
 
-#include "fibe_f.h"
+#include "frei0r_fibe.h"
 
 
 //----------------------------------------
@@ -215,135 +216,178 @@ void shave_alpha(float *sl, float *ab, int w, int h)
 
 
 //----------------------------------------------------------
-void grow_alpha(float *al, float *ab,
-                int w, int h, int mode)
+//soft grow, blend with the 3x3 maxima
+void grow_alpha(float *al, float *ab, int w, int h)
 {
 	int i,j,p;
 	float m,md;
 	
-	switch(mode)
+	for (i=1;i<h-1;i++)
 	{
-	case 0:
-		for (i=1;i<h-1;i++)
-		{
-			p=i*w+1;
-			for (j=1;j<w-1;j++)
-			{
-				ab[p]=al[p];
-				if (al[p]<al[p-1])
-					ab[p]=al[p-1];
-				if (al[p]<al[p+1])
-					ab[p]=al[p+1];
-				if (al[p]<al[p-w])
-					ab[p]=al[p-w];
-				if (al[p]<al[p+w])
-					ab[p]=al[p+w];
-				p++;
-			}
-		}
-		break;
-	case 1:
-		for (i=1;i<h-1;i++)
+		p=i*w+1;
+		for (j=1;j<w-1;j++)
 		{
-			p=i*w+1;
-			for (j=1;j<w-1;j++)
-			{
-				m=al[p];
-				if (al[p]<al[p-1])
-					m=al[p-1];
-				if (al[p]<al[p+1])
-					m=al[p+1];
-				if (al[p]<al[p-w])
-					m=al[p-w];
-				if (al[p]<al[p+w])
-					m=al[p+w];
-				md=al[p];
-				if (al[p]<al[p-1-w])
-					md=al[p-1-w];
-				if (al[p]<al[p+1-w])
-					md=al[p+1-w];
-				if (al[p]<al[p-1+w])
-					md=al[p-1+w];
-				if (al[p]<al[p+1+w])
-					md=al[p+1+w];
-				
-				ab[p]=0.4*al[p]+0.4*m+0.2*md;
-				//				ab[p]=0.3*al[p]+0.4*m+0.3*md;
-				p++;
-			}
+			m=al[p];
+			if (al[p]<al[p-1])
+				m=al[p-1];
+			if (al[p]<al[p+1])
+				m=al[p+1];
+			if (al[p]<al[p-w])
+				m=al[p-w];
+			if (al[p]<al[p+w])
+				m=al[p+w];
+			md=al[p];
+			if (al[p]<al[p-1-w])
+				md=al[p-1-w];
+			if (al[p]<al[p+1-w])
+				md=al[p+1-w];
+			if (al[p]<al[p-1+w])
+				md=al[p-1+w];
+			if (al[p]<al[p+1+w])
+				md=al[p+1+w];
+			
+			ab[p]=0.4*al[p]+0.4*m+0.2*md;
+			//				ab[p]=0.3*al[p]+0.4*m+0.3*md;
+			p++;
 		}
-		break;
 	}
 	
-	
-	
 	for (i=0;i<w*h;i++) al[i]=ab[i];
 }
 
 //----------------------------------------------------------
-void shrink_alpha(float *al, float *ab,
-                  int w, int h, int mode)
+//soft shrink, blend with the 3x3 minima
+void shrink_alpha(float *al, float *ab, int w, int h)
 {
 	int i,j,p;
 	float m,md;
 	
-	switch(mode)
+	for (i=1;i<h-1;i++)
 	{
-	case 0:
-		for (i=1;i<h-1;i++)
+		p=i*w+1;
+		for (j=1;j<w-1;j++)
 		{
-			p=i*w+1;
-			for (j=1;j<w-1;j++)
-			{
-				ab[p]=al[p];
-				if (al[p]>al[p-1])
-					ab[p]=al[p-1];
-				if (al[p]>al[p+1])
-					ab[p]=al[p+1];
-				if (al[p]>al[p-w])
-					ab[p]=al[p-w];
-				if (al[p]>al[p+w])
-					ab[p]=al[p+w];
-				p++;
-			}
+			m=al[p];
+			if (al[p]>al[p-1])
+				m=al[p-1];
+			if (al[p]>al[p+1])
+				m=al[p+1];
+			if (al[p]>al[p-w])
+				m=al[p-w];
+			if (al[p]>al[p+w])
+				m=al[p+w];
+			md=al[p];
+			if (al[p]>al[p-1-w])
+				md=al[p-1-w];
+			if (al[p]>al[p+1-w])
+				md=al[p+1-w];
+			if (al[p]>al[p-1+w])
+				md=al[p-1+w];
+			if (al[p]>al[p+1+w])
+				md=al[p+1+w];
+			
+			ab[p]=0.4*al[p]+0.4*m+0.2*md;
+			//				ab[p]=0.3*al[p]+0.4*m+0.3*md;
+			p++;
 		}
-		break;
-	case 1:
-		for (i=1;i<h-1;i++)
+	}
+	
+	for (i=0;i<w*h;i++) al[i]=ab[i];
+}
+
+//----------------------------------------------------------
+//van Herk/Gil-Werman maximum over a (2r+1)x(2r+1) square,
+//separably, a row and then a column pass. Each pass cuts the
+//line, padded by r zeros on both ends, into blocks of 2r+1, takes
+//the running maximum forward (g) and backward (b) within each
+//block, and then the window at x is max(b[x],g[x+2r]): three
+//comparisons per pixel and pass, whatever the radius.
+//The column pass goes over whole rows, so that it vectorizes.
+static void vhgw_max(uint8_t *al, int w, int h, int r)
+{
+	int i,j,k,n,x,y;
+	uint8_t *g,*b,*gr,*br;
+	
+	if (r<1) return;
+	k=2*r+1;
+	n=(w>h)?w:h;
+	n=(n+2*r+k-1)/k*k;
+	g=malloc((size_t)n*w);
+	b=malloc((size_t)n*(w+1));
+	
+	//rows, padded into the end of b first
+	n=(w+2*r+k-1)/k*k;
+	for (y=0;y<h;y++)
+	{
+		uint8_t *l=al+(size_t)y*w;
+		uint8_t *v=b+n;
+		
+		memset(v, 0, n);
+		memcpy(v+r, l, w);
+		for (i=0;i<n;i+=k)
 		{
-			p=i*w+1;
-			for (j=1;j<w-1;j++)
-			{
-				m=al[p];
-				if (al[p]>al[p-1])
-					m=al[p-1];
-				if (al[p]>al[p+1])
-					m=al[p+1];
-				if (al[p]>al[p-w])
-					m=al[p-w];
-				if (al[p]>al[p+w])
-					m=al[p+w];
-				md=al[p];
-				if (al[p]>al[p-1-w])
-					md=al[p-1-w];
-				if (al[p]>al[p+1-w])
-					md=al[p+1-w];
-				if (al[p]>al[p-1+w])
-					md=al[p-1+w];
-				if (al[p]>al[p+1+w])
-					md=al[p+1+w];
-				
-				ab[p]=0.4*al[p]+0.4*m+0.2*md;
-				//				ab[p]=0.3*al[p]+0.4*m+0.3*md;
-				p++;
-			}
+			g[i]=v[i];
+			for (j=i+1;j<i+k;j++)
+				g[j] = (g[j-1]>v[j]) ? g[j-1] : v[j];
+			b[i+k-1]=v[i+k-1];
+			for (j=i+k-2;j>=i;j--)
+				b[j] = (b[j+1]>v[j]) ? b[j+1] : v[j];
 		}
-		break;
+		for (x=0;x<w;x++)
+			l[x] = (b[x]>g[x+2*r]) ? b[x] : g[x+2*r];
 	}
 	
+	//columns
+	n=(h+2*r+k-1)/k*k;
+	for (i=0;i<n;i++)
+	{
+		y=i-r;
+		gr=g+(size_t)i*w;
+		if (y>=0 && y<h)
+			memcpy(gr, al+(size_t)y*w, w);
+		else
+			memset(gr, 0, w);
+		if (i%k!=0)
+			for (j=0;j<w;j++)
+				if (gr[j-w]>gr[j]) gr[j]=gr[j-w];
+	}
+	for (i=n-1;i>=0;i--)
+	{
+		y=i-r;
+		br=b+(size_t)i*w;
+		if (y>=0 && y<h)
+			memcpy(br, al+(size_t)y*w, w);
+		else
+			memset(br, 0, w);
+		if (i%k!=k-1)
+			for (j=0;j<w;j++)
+				if (br[j+w]>br[j]) br[j]=br[j+w];
+	}
+	for (y=0;y<h;y++)
+	{
+		uint8_t *l=al+(size_t)y*w;
+		
+		br=b+(size_t)y*w;
+		gr=g+(size_t)(y+2*r)*w;
+		for (x=0;x<w;x++)
+			l[x] = (br[x]>gr[x]) ? br[x] : gr[x];
+	}
 	
+	free(g);
+	free(b);
+}
+
+//----------------------------------------------------------
+//hard grow (max) or shrink (min) by r pixels in each direction
+void morph_alpha(uint8_t *al, int w, int h, int r, int shrink)
+{
+	int i;
 	
-	for (i=0;i<w*h;i++) al[i]=ab[i];
+	if (shrink)
+		for (i=0;i<w*h;i++) al[i]=255-al[i];
+	vhgw_max(al, w, h, r);
+	if (shrink)
+		for (i=0;i<w*h;i++) al[i]=255-al[i];
 }
 
 //---------------------------------------------------------
@@ -445,6 +489,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
 	info->explanation="Display and manipulation of the alpha channel";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -618,7 +668,7 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 	inst *in;
 	int i;
 	float *falpha, *ab;
-	uint8_t *infr, *oufr;
+	uint8_t *infr, *oufr, *a8;
 	
 	assert(instance);
 	in=(inst*)instance;
@@ -638,20 +688,23 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 			shave_alpha(falpha, ab, in->w, in->h);
 		break;
 	case 2:
-		for (i=0;i<in->sga;i++)
-			shrink_alpha(falpha, ab, in->w, in->h, 0);
+	case 4:
+		//as many pixels as the soft steps below
+		a8 = malloc(in->w * in->h);
+		for (i=0;i<in->w*in->h;i++)
+			a8[i] = infr[4*i+3];
+		morph_alpha(a8, in->w, in->h, (int)ceilf(in->sga), in->op==2);
+		for (i=0;i<in->w*in->h;i++)
+			falpha[i] = a8[i];
+		free(a8);
 		break;
 	case 3:
 		for (i=0;i<in->sga;i++)
-			shrink_alpha(falpha, ab, in->w, in->h, 1);
-		break;
-	case 4:
-		for (i=0;i<in->sga;i++)
-			grow_alpha(falpha, ab, in->w, in->h, 0);
+			shrink_alpha(falpha, ab, in->w, in->h);
 		break;
 	case 5:
 		for (i=0;i<in->sga;i++)
-			grow_alpha(falpha, ab, in->w, in->h, 1);
+			grow_alpha(falpha, ab, in->w, in->h);
 		break;
 	case 6:
 		threshold_alpha(falpha, in->w, in->h, 255.0*in->thr, 255.0, 0.0);
@@ -43,7 +43,8 @@ int h;
 int w;
 
 float poz,wdt,tilt,min,max;
-uint32_t *gr8;
+uint8_t *gr8;	//the gradient, redrawn in f0r_update after changes
+int dirty;
 int op;
 
 } inst;
@@ -63,7 +64,7 @@ wd=in->wdt*in->w;
 if (in->min==in->max)
 	{
 	for (i=0;i<in->h*in->w;i++)
-		in->gr8[i]=(((uint32_t)(in->min*255.0))<<24)&0xFF000000;
+		in->gr8[i]=(uint32_t)(in->min*255.0);
 	return;
 	}
 
@@ -84,7 +85,7 @@ for (i=0;i<in->h;i++)
 			a = in->min+(wd/2.0-d) / wd*(in->max-in->min);
 			}
 		a=255.0*a;
-		in->gr8[i*in->w+j] = (((uint32_t)a)<<24)&0xFF000000;
+		in->gr8[i*in->w+j] = (uint32_t)a;
 		}
 }
 
@@ -131,6 +132,12 @@ info->num_params=6;
 info->explanation="Fills alpha channel with a gradient";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -185,9 +192,8 @@ in->min=0.0;
 in->max=1.0;
 in->op=0;
 
-in->gr8 = (uint32_t*)calloc(in->w*in->h, sizeof(uint32_t));
-
-fill_grad(in);
+in->gr8 = (uint8_t*)calloc(in->w*in->h, sizeof(uint8_t));
+in->dirty=1;
 
 return (f0r_instance_t)in;
 }
@@ -242,14 +248,13 @@ switch(param_index)
 		break;
 	case 5:
                 tmpi=map_value_forward(*((double*)parm), 0.0, 4.9999);
-                if (p->op != tmpi) chg=1;
-                p->op=tmpi;
+                p->op=tmpi;	//doesn't change the gradient
 		break;
 	}
 
-if (chg==0) return;
-
-fill_grad(p);
+//hosts often set all parameters before each frame, so the gradient is
+//only redrawn once in f0r_update, and only if one of them changed
+if (chg!=0) p->dirty=1;
 }
 
 //--------------------------------------------------
@@ -288,44 +293,53 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 {
 inst *in;
 int i;
-uint32_t t;
+uint32_t t,a;
 
 assert(instance);
 in=(inst*)instance;
 
+if (in->dirty)
+	{
+	fill_grad(in);
+	in->dirty=0;
+	}
+
 switch (in->op)
 	{
 	case 0:		//write on clear
 		for (i=0;i<in->h*in->w;i++)
-			outframe[i] = (inframe[i]&0x00FFFFFF) | in->gr8[i];
+			outframe[i] = (inframe[i]&0x00FFFFFF) | ((uint32_t)in->gr8[i]<<24);
 		break;
 	case 1:		//max
 		for (i=0;i<in->h*in->w;i++)
 			{
-			t=((inframe[i]&0xFF000000)>in->gr8[i]) ? inframe[i]&0xFF000000 : in->gr8[i];
-			outframe[i] = (inframe[i]&0x00FFFFFF) | t;
+			a=inframe[i]>>24;
+			t=(a>in->gr8[i]) ? a : in->gr8[i];
+			outframe[i] = (inframe[i]&0x00FFFFFF) | (t<<24);
 			}
 		break;
 	case 2:		//min
 		for (i=0;i<in->h*in->w;i++)
 			{
-			t=((inframe[i]&0xFF000000)<in->gr8[i]) ? inframe[i]&0xFF000000 : in->gr8[i];
-			outframe[i] = (inframe[i]&0x00FFFFFF) | t;
+			a=inframe[i]>>24;
+			t=(a<in->gr8[i]) ? a : in->gr8[i];
+			outframe[i] = (inframe[i]&0x00FFFFFF) | (t<<24);
 			}
 		break;
 	case 3:		//add
 		for (i=0;i<in->h*in->w;i++)
 			{
-			t=((inframe[i]&0xFF000000)>>1)+(in->gr8[i]>>1);
-			t = (t>0x7F800000) ? 0xFF000000 : t<<1;
-			outframe[i] = (inframe[i]&0x00FFFFFF) | t;
+			t=(inframe[i]>>24)+in->gr8[i];
+			t = (t>255) ? 255 : t;
+			outframe[i] = (inframe[i]&0x00FFFFFF) | (t<<24);
 			}
 		break;
 	case 4:		//subtract
 		for (i=0;i<in->h*in->w;i++)
 			{
-			t= ((inframe[i]&0xFF000000)>in->gr8[i]) ? (inframe[i]&0xFF000000)-in->gr8[i] : 0;
-			outframe[i] = (inframe[i]&0x00FFFFFF) | t;
+			a=inframe[i]>>24;
+			t= (a>in->gr8[i]) ? a-in->gr8[i] : 0;
+			outframe[i] = (inframe[i]&0x00FFFFFF) | (t<<24);
 			}
 		break;
 	default:
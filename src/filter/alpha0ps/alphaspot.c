@@ -30,6 +30,7 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 //#include <stdio.h>
 #include <frei0r.h>
 #include <frei0r_math.h>
+#include <frei0r_simd.h>
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
@@ -46,14 +47,23 @@ typedef struct
     float pozx,pozy,sizx,sizy,wdt,tilt,min,max;
     int shp,op;
 
-    uint8_t *gr8;
+    uint32_t *spot; //the spot in the alpha channel, redrawn in f0r_update
+                    //after changes
+    int dirty;
 
 } inst;
 
 
+//----------------------------------------------------------
+//a pixel of the spot, with the value g in the alpha channel
+static inline uint32_t spot_px(float g)
+{
+    return (uint32_t)(uint8_t)(g * 255.0f) << 24;
+}
+
 //----------------------------------------------------------
 //general (rotated) rectangle with soft border
-void gen_rec_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
+void gen_rec_s(uint32_t* sl, int w, const int* box, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
 {
     int i,j;
     float d1,d2,d,db,st,ct,g,is1,is2;
@@ -64,8 +74,8 @@ void gen_rec_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
     is1 = 1.0f/siz1;
     is2 = 1.0f/siz2;
 
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++) {
+    for (i = box[1]; i < box[3]; i++) {
+        for (j = box[0]; j < box[2]; j++) {
             d1 = (i-pozy)*st+(j-pozx)*ct;
             d2 = (i-pozy)*ct-(j-pozx)*st;
             d1 = fabsf(d1)*is1;
@@ -82,14 +92,14 @@ void gen_rec_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
                     g = min + (1.0f - wb-db)/wb*(max-min);
                 }
             }
-            sl[i*w+j] = g * 255.0f;
+            sl[i*w+j] = spot_px(g);
         }
     }
 }
 
 //----------------------------------------------------------
 //general (rotated) ellipse with soft border
-void gen_eli_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
+void gen_eli_s(uint32_t* sl, int w, const int* box, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
 {
     int i,j;
     float d1,d2,d,db,st,ct,is1,is2,g;
@@ -100,8 +110,8 @@ void gen_eli_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
     is1 = 1.0f/siz1;
     is2 = 1.0f/siz2;
 
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++) {
+    for (i = box[1]; i < box[3]; i++) {
+        for (j = box[0]; j < box[2]; j++) {
             d1 = (i-pozy)*st+(j-pozx)*ct;
             d2 = (i-pozy)*ct-(j-pozx)*st;
             d = hypotf(d1*is1,d2*is2);
@@ -117,14 +127,14 @@ void gen_eli_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
                     g = min + (1.0f - wb-db)/wb*(max-min);
                 }
             }
-            sl[i*w+j] = g * 255.0f;
+            sl[i*w+j] = spot_px(g);
         }
     }
 }
 
 //----------------------------------------------------------
 //general (rotated) triangle with soft border
-void gen_tri_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
+void gen_tri_s(uint32_t* sl, int w, const int* box, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
 {
     int i,j;
     float d1,d2,d3,d4,d,st,ct,is1,is2,k5,lim,db,g;
@@ -137,8 +147,8 @@ void gen_tri_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
     k5 = 1.0f/sqrtf(5.0f);
     lim = 0.82f;
 
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++) {
+    for (i = box[1]; i < box[3]; i++) {
+        for (j = box[0]; j < box[2]; j++) {
             d1 = (i-pozy)*st+(j-pozx)*ct;
             d2 = (i-pozy)*ct-(j-pozx)*st;
             d1 = d1*is1;
@@ -162,14 +172,14 @@ void gen_tri_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
                     g = min + (lim-wb-db)/wb*(max-min);
                 }
             }
-            sl[i*w+j] = g * 255.0f;
+            sl[i*w+j] = spot_px(g);
         }
     }
 }
 
 //----------------------------------------------------------
 //general (rotated) diamond shape with soft border
-void gen_dia_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
+void gen_dia_s(uint32_t* sl, int w, const int* box, float siz1, float siz2, float tilt, float pozx, float pozy, float min, float max, float wb)
 {
     int i,j;
     float d1,d2,d,db,st,ct,is1,is2,g;
@@ -180,8 +190,8 @@ void gen_dia_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
     is1 = 1.0f/siz1;
     is2 = 1.0f/siz2;
 
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j++) {
+    for (i = box[1]; i < box[3]; i++) {
+        for (j = box[0]; j < box[2]; j++) {
             d1 = (i-pozy)*st+(j-pozx)*ct;
             d2 = (i-pozy)*ct-(j-pozx)*st;
             d = fabsf(d1*is1)+fabsf(d2*is2);
@@ -195,27 +205,64 @@ void gen_dia_s(uint8_t* sl, int w, int h, float siz1, float siz2, float tilt, fl
                     g = min + (1.0f - wb-db)/wb*(max-min);
                 }
             }
-            sl[i*w+j] = g * 255.0f;
+            sl[i*w+j] = spot_px(g);
         }
     }
 }
 
 //-----------------------------------------------------
+//the bounding box x0,y0,x1,y1 of the shape, clipped to the frame
+//all shapes lie within this distance of their center, the triangle
+//reaching furthest, and so does the transition, which is inside
+void spot_box(inst *in, int *box)
+{
+    float siz1, siz2, cx, cy, r;
+
+    siz1 = in->sizx * in->w;
+    siz2 = in->sizy * in->h;
+    r = hypotf(2.0f * siz1, siz2) + 1.0f;
+    cx = in->pozx * in->w;
+    cy = in->pozy * in->h;
+    box[0] = MAX(0, (int)floorf(cx - r));
+    box[1] = MAX(0, (int)floorf(cy - r));
+    box[2] = MIN(in->w, (int)ceilf(cx + r) + 1);
+    box[3] = MIN(in->h, (int)ceilf(cy + r) + 1);
+    if (box[0] >= box[2] || box[1] >= box[3]) {
+        box[0] = box[1] = box[2] = box[3] = 0;
+    }
+}
+
+//-----------------------------------------------------
+//the spot is min outside of the bounding box, only the box is drawn
 void draw(inst *in)
 {
+    int box[4], i;
+    float siz1, siz2, pozx, pozy;
+    uint32_t g;
+
+    siz1 = in->sizx * in->w;
+    siz2 = in->sizy * in->h;
+    if ((siz1 == 0.0f) || (siz2 == 0.0f)) return;
+    pozx = in->pozx * in->w;
+    pozy = in->pozy * in->h;
+    spot_box(in, box);
+    g = spot_px(in->min);
+    for (i = 0; i < in->w * in->h; i++)
+        in->spot[i] = g;
+
     switch (in->shp)
     {
     case 0:
-        gen_rec_s(in->gr8, in->w, in->h, in->sizx*in->w, in->sizy*in->h, in->tilt, in->pozx*in->w, in->pozy*in->h, in->min, in->max, in->wdt);
+        gen_rec_s(in->spot, in->w, box, siz1, siz2, in->tilt, pozx, pozy, in->min, in->max, in->wdt);
         break;
     case 1:
-        gen_eli_s(in->gr8, in->w, in->h, in->sizx*in->w, in->sizy*in->h, in->tilt, in->pozx*in->w, in->pozy*in->h, in->min, in->max, in->wdt);
+        gen_eli_s(in->spot, in->w, box, siz1, siz2, in->tilt, pozx, pozy, in->min, in->max, in->wdt);
         break;
     case 2:
-        gen_tri_s(in->gr8, in->w, in->h, in->sizx*in->w, in->sizy*in->h, in->tilt, in->pozx*in->w, in->pozy*in->h, in->min, in->max, in->wdt);
+        gen_tri_s(in->spot, in->w, box, siz1, siz2, in->tilt, pozx, pozy, in->min, in->max, in->wdt);
         break;
     case 3:
-        gen_dia_s(in->gr8, in->w, in->h, in->sizx*in->w, in->sizy*in->h, in->tilt, in->pozx*in->w, in->pozy*in->h, in->min, in->max, in->wdt);
+        gen_dia_s(in->spot, in->w, box, siz1, siz2, in->tilt, pozx, pozy, in->min, in->max, in->wdt);
         break;
     default:
         break;
@@ -265,6 +312,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
     info->explanation = "Draws simple shapes into the alpha channel";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+    f0r_get_plugin_info(&info->info);
+    info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -342,9 +395,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
     in->max = 1.0f;
     in->op = 0;
 
-    in->gr8 = calloc(in->w*in->h, sizeof(*in->gr8));
-
-    draw(in);
+    in->spot = calloc(in->w*in->h, sizeof(*in->spot));
+    in->dirty = 1;
 
     return (f0r_instance_t)in;
 }
@@ -356,7 +408,7 @@ void f0r_destruct(f0r_instance_t instance)
 
     in = (inst*) instance;
 
-    free(in->gr8);
+    free(in->spot);
     free(instance);
 }
 
@@ -418,15 +470,13 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
         break;
     case 9:
         tmpi = map_value_forward(*((double*)parm), 0.0f, 4.9999f);
-        if (p->op != tmpi) chg = 1;
-        p->op = tmpi;
+        p->op = tmpi;   //doesn't change the spot
         break;
     }
 
-    if (chg == 0) return;
-
-    draw(p);
-
+    //hosts often set all parameters before each frame, so the spot is
+    //only redrawn once in f0r_update, and only if one of them changed
+    if (chg != 0) p->dirty = 1;
 }
 
 //--------------------------------------------------
@@ -471,44 +521,132 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 }
 
 //-------------------------------------------------
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+//copies n pixels and combines their alpha with the spot
+void spot_row(int op, const uint32_t *inp, uint32_t *outp, const uint32_t *spot, int n)
 {
-    inst *in;
-    int i;
-    uint8_t *inp = (uint8_t*) inframe;
-    uint8_t *outp = (uint8_t*) outframe;
-
-    assert(instance);
-    in = (inst*)instance;
-    memcpy(outframe, inframe, sizeof(*inframe) * in->w * in->h);
-
-    switch (in->op) {
+    switch (op) {
     case 0:		//write on clear
-        for (i = 0; i < in->h*in->w; i++) {
-            outp[4*i+3] = in->gr8[i];
-        }
+        frei0r_simd_alpha_copy(outp, inp, spot, n);
         break;
     case 1:		//max
-        for (i = 0; i < in->h*in->w; i++) {
-            outp[4*i+3] = (inp[4*i+3] > in->gr8[i]) ? inp[4*i+3] : in->gr8[i];
-        }
+        frei0r_simd_alpha_max(outp, inp, spot, n);
         break;
     case 2:		//min
-        for (i = 0; i < in->h*in->w; i++) {
-            outp[4*i+3] = (inp[4*i+3] < in->gr8[i]) ? inp[4*i+3] : in->gr8[i];
-        }
+        frei0r_simd_alpha_min(outp, inp, spot, n);
         break;
     case 3:		//add
-        for (i = 0;i < in->h*in->w; i++) {
-            outp[4*i+3] = MAX255(inp[4*i+3] + in->gr8[i]);
-        }
+        frei0r_simd_alpha_add(outp, inp, spot, n);
         break;
     case 4:		//subtract
-        for (i = 0; i < in->h*in->w; i++) {
-            outp[4*i+3] = (inp[4*i+3] > in->gr8[i]) ? inp[4*i+3] - in->gr8[i] : 0;
-        }
+        frei0r_simd_alpha_subtract(outp, inp, spot, n);
         break;
     default:
+        if (outp != inp)
+            memcpy(outp, inp, 4 * n);
         break;
     }
 }
+
+//-------------------------------------------------
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+    inst *in;
+
+    assert(instance);
+    in = (inst*)instance;
+
+    if (in->dirty) {
+        draw(in);
+        in->dirty = 0;
+    }
+
+    spot_row(in->op, inframe, outframe, in->spot, in->w * in->h);
+}
+
+//-------------------------------------------------
+//outside of the bounding box of the shape the spot is min, which leaves
+//the alpha as it is for some operations
+int f0r_get_region(f0r_instance_t instance, f0r_rect_t* rect)
+{
+    inst *in;
+    uint8_t g;
+    int identity;
+    int box[4];
+
+    assert(instance);
+    in = (inst*)instance;
+
+    if (in->dirty) {
+        draw(in);
+        in->dirty = 0;
+    }
+
+    g = in->min * 255.0f;
+    switch (in->op) {
+    case 1:	//max
+    case 3:	//add
+    case 4:	//subtract
+        identity = (g == 0);
+        break;
+    case 2:	//min
+        identity = (g == 255);
+        break;
+    default:
+        identity = 0;
+        break;
+    }
+    if (!identity || in->sizx * in->w == 0.0f || in->sizy * in->h == 0.0f)
+        return 0;
+
+    spot_box(in, box);
+    rect->x = box[0];
+    rect->y = box[1];
+    rect->width = box[2] - box[0];
+    rect->height = box[3] - box[1];
+    return 1;
+}
+
+//-------------------------------------------------
+int f0r_get_footprint(f0r_instance_t instance)
+{
+    return 0;
+}
+
+//-------------------------------------------------
+//the spot is drawn by f0r_update or f0r_get_region, tiles may run on
+//several threads and can't draw it
+int f0r_update_tile(f0r_instance_t instance, double time,
+                    const uint32_t* inframe, int inframe_stride,
+                    const f0r_rect_t* inrect,
+                    uint32_t* outframe, int outframe_stride,
+                    const f0r_rect_t* outrect)
+{
+    inst *in;
+    const uint32_t *inp;
+    uint32_t *outp;
+    int y;
+
+    assert(instance);
+    in = (inst*)instance;
+
+    if (in->dirty
+        || outrect->x < inrect->x || outrect->y < inrect->y
+        || outrect->x + outrect->width > inrect->x + inrect->width
+        || outrect->y + outrect->height > inrect->y + inrect->height
+        || outrect->x < 0 || outrect->y < 0
+        || outrect->x + outrect->width > in->w
+        || outrect->y + outrect->height > in->h)
+        return 0;
+
+    inp = (const uint32_t*)((const uint8_t*)inframe
+                            + (outrect->y - inrect->y) * inframe_stride)
+        + (outrect->x - inrect->x);
+    outp = outframe;
+    for (y = 0; y < outrect->height; y++) {
+        spot_row(in->op, inp, outp,
+                 in->spot + (outrect->y + y) * in->w + outrect->x, outrect->width);
+        inp = (const uint32_t*)((const uint8_t*)inp + inframe_stride);
+        outp = (uint32_t*)((uint8_t*)outp + outframe_stride);
+    }
+    return 1;
+}
@@ -27,6 +27,11 @@
 #include <string.h>
 
 #include <frei0r.hpp>
+#include "frei0r_thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define PLANES 32
 
@@ -53,59 +58,138 @@ public:
                       uint32_t* out,
                       const uint32_t* in);
 
+  virtual bool clone_state(const frei0r::fx& other);
+  virtual bool trim();
+  virtual bool reset();
+  virtual void memory_usage(std::size_t& resident, std::size_t& touched);
+
 private:
   ScreenGeometry geo;
 
   void _init(int wdt, int hgt);
+
+  struct Job {
+    const uint32_t *src;
+    uint32_t *dst;
+    uint32_t *plane;        // the plane of this frame
+    const uint32_t *others[3];  // the other planes of its sum
+    int i0, i1;
+  };
+  static void* blit(void *arg);
   
-  uint32_t *planebuf;
-  uint32_t *planetable[PLANES];
+  frei0r::aligned_frame<uint32_t> planetable[PLANES];
   int plane;
   int pixels;
 };
 
 Baltan::Baltan(int wdt, int hgt) {
-  int i;
-    
   _init(wdt, hgt);
   pixels = geo.w*geo.h;
-  
-  planebuf =  (uint32_t*)calloc(geo.size, PLANES);
-    
-  for(i=0;i<PLANES;i++)
-    planetable[i] = &planebuf[pixels*i];
 
+  // the planes are allocated by the first update
   plane = 0;
 }
 
 Baltan::~Baltan() {
-  free(planebuf);
 }
 
-void Baltan::update(double time,
-                    uint32_t* out,
-                    const uint32_t* in) {
-  int i, cf;
+bool Baltan::clone_state(const frei0r::fx& other) {
+  const Baltan& o = static_cast<const Baltan&>(other);
+  for(int i = 0; i < PLANES; i++)
+    planetable[i].assign(o.planetable[i]);
+  plane = o.plane;
+  return true;
+}
 
-  uint32_t *src = (uint32_t*)in;
-  uint32_t *dst = (uint32_t*)out;
+bool Baltan::trim() {
+  bool had = planetable[0].width() != 0;
+  for(int i = 0; i < PLANES; i++)
+    planetable[i].release();
+  plane = 0;
+  return had;
+}
 
-  
-  for(i=0; i<pixels; i++)
-    planetable[plane][i] = (src[i] & 0xfcfcfc)>>2;
-  
+/* The planes are zero again, as the first update makes them. */
+bool Baltan::reset() {
+  for(int i = 0; i < PLANES; i++)
+    planetable[i].clear();
+  plane = 0;
+  return true;
+}
 
-  cf = plane & (STRIDE-1);
-  
-  for(i=0; i<pixels; i++) {
-    dst[i] = (src[i]&0xFF000000)
-      |(planetable[cf][i]
-	+ planetable[cf+STRIDE][i]
-	+ planetable[cf+STRIDE2][i]
-	+ planetable[cf+STRIDE3][i]);
-    planetable[plane][i] = (dst[i]&0xfcfcfc)>>2;
+/* An update reads three planes and writes the one of the frame. */
+void Baltan::memory_usage(std::size_t& resident, std::size_t& touched) {
+  for(int i = 0; i < PLANES; i++)
+    resident += planetable[i].bytes();
+  touched += 4 * (std::size_t)pixels * sizeof(uint32_t);
+}
+
+/* Pixels i0 to i1. A plane holds a quarter of each channel, so 4 of
+   them add up to a whole pixel without carries between the channels. */
+void* Baltan::blit(void *arg) {
+  Job *job = (Job*)arg;
+  const uint32_t *src = job->src;
+  uint32_t *dst = job->dst;
+  uint32_t *p = job->plane;
+  const uint32_t *a = job->others[0], *b = job->others[1], *c = job->others[2];
+  int i = job->i0;
+
+#if defined(__SSE2__)
+  const __m128i quarter = _mm_set1_epi32(0xfcfcfc);
+  const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+  for(; i + 4 <= job->i1; i += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i v = _mm_srli_epi32(_mm_and_si128(s, quarter), 2);
+    v = _mm_add_epi32(v, _mm_loadu_si128((const __m128i*)(a + i)));
+    v = _mm_add_epi32(v, _mm_loadu_si128((const __m128i*)(b + i)));
+    v = _mm_add_epi32(v, _mm_loadu_si128((const __m128i*)(c + i)));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(s, alpha), v));
+    _mm_storeu_si128((__m128i*)(p + i), _mm_srli_epi32(_mm_and_si128(v, quarter), 2));
+  }
+#endif
+  for(; i < job->i1; i++) {
+    uint32_t s = src[i];
+    uint32_t v = ((s & 0xfcfcfc)>>2) + a[i] + b[i] + c[i];
+    dst[i] = (s&0xFF000000) | v;
+    p[i] = (v&0xfcfcfc)>>2;
   }
+  return 0;
+}
 
+void Baltan::update(double time,
+                    uint32_t* out,
+                    const uint32_t* in) {
+  Job jobs[FREI0R_MAX_THREADS];
+  int i, j, k, n = frei0r_thread_count(pixels);
+  int cf = plane & (STRIDE-1);
+  const uint32_t *others[3];
+
+  // zeroed here, on the thread that renders
+  if(planetable[0].width() == 0)
+    for(i = 0; i < PLANES; i++)
+      planetable[i].resize_deferred(geo.w, geo.h);
+  for(i = 0; i < PLANES; i++)
+    planetable[i].touch();
+
+  // The current frame takes the place of its plane in the sum of the
+  // planes cf, cf+STRIDE, cf+STRIDE2 and cf+STRIDE3, and its plane
+  // becomes the result, in one pass.
+  for(j = cf, k = 0; j < PLANES; j += STRIDE)
+    if(j != plane)
+      others[k++] = planetable[j].data();
+
+  for(i = 0; i < n; i++) {
+    jobs[i].src = in;
+    jobs[i].dst = out;
+    jobs[i].plane = planetable[plane].data();
+    jobs[i].others[0] = others[0];
+    jobs[i].others[1] = others[1];
+    jobs[i].others[2] = others[2];
+    jobs[i].i0 = (int)((long)pixels * i / n);
+    jobs[i].i1 = (int)((long)pixels * (i + 1) / n);
+  }
+  frei0r_thread_run(blit, jobs, sizeof(Job), n);
 
   plane++;
   plane = plane & (PLANES-1);
@@ -122,4 +206,7 @@ void Baltan::_init(int wdt, int hgt) {
 frei0r::construct<Baltan> plugin("Baltan",
 				  "delayed alpha smoothed blit of time",
 				  "Kentaro, Jaromil",
-				  3,1);
+				  3,2,
+				  F0R_COLOR_MODEL_BGRA8888,
+				  F0R_CAP_TEMPORAL | F0R_CAP_CLONE |
+				  F0R_CAP_RB_SYMMETRIC);
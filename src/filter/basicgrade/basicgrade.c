@@ -0,0 +1,361 @@
+/* basicgrade.c
+ * Brightness, contrast, saturation, gamma and tint in one pass
+ * This file is a Frei0r plugin.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Brightness, contrast0r, saturat0r, gamma and tint0r in this order, in
+ * one pass over the frame. The parameters are those of the separate
+ * effects and the results are the same as those of the chain: the
+ * tables and matrices come from frei0r_grade.h, and the 8 bit values
+ * in between are kept. Brightness and contrast are one table, and each
+ * chunk of pixels goes through the stages on the stack, so the frame is
+ * read and written once. Stages that change nothing are left out. */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "frei0r.h"
+#include "frei0r_math.h"
+#include "frei0r_lut.h"
+#include "frei0r_grade.h"
+#include "frei0r_thread.h"
+
+enum
+{
+  STAGE_LEVELS = 1,     /* brightness and contrast */
+  STAGE_SATURATION = 2,
+  STAGE_GAMMA = 4,
+  STAGE_TINT = 8
+};
+
+typedef struct basicgrade_instance
+{
+  unsigned int width;
+  unsigned int height;
+  int brightness; /* [-256, 256] */
+  int contrast;   /* [-256, 256] */
+  double saturation;
+  double gamma;
+  f0r_param_color_t blackColor;
+  f0r_param_color_t whiteColor;
+  double amount;
+  uint8_t levels[256]; /* brightness, then contrast */
+  frei0r_colormatrix_t saturation_cm;
+  uint8_t gamma_lut[256];
+  frei0r_colormatrix_t tint_cm;
+  int stages; /* the STAGE_ flags of the stages that change something */
+} basicgrade_instance_t;
+
+typedef struct grade_job
+{
+  const basicgrade_instance_t* inst;
+  const uint32_t* src;
+  uint32_t* dst;
+  unsigned int len;
+} grade_job_t;
+
+static void update_stages(basicgrade_instance_t* inst)
+{
+  uint8_t contrast[256];
+  int i;
+
+  inst->stages = 0;
+  frei0r_grade_brightness_lut(inst->levels, inst->brightness);
+  frei0r_grade_contrast_lut(contrast, inst->contrast);
+  for (i = 0; i < 256; ++i)
+    inst->levels[i] = contrast[inst->levels[i]];
+  if (!frei0r_grade_lut_is_identity(inst->levels))
+    inst->stages |= STAGE_LEVELS;
+
+  frei0r_grade_saturation(&inst->saturation_cm, inst->saturation);
+  if (!frei0r_colormatrix_is_identity(&inst->saturation_cm))
+    inst->stages |= STAGE_SATURATION;
+
+  frei0r_grade_gamma_lut(inst->gamma_lut, inst->gamma);
+  if (!frei0r_grade_lut_is_identity(inst->gamma_lut))
+    inst->stages |= STAGE_GAMMA;
+
+  frei0r_grade_tint(&inst->tint_cm, &inst->blackColor, &inst->whiteColor,
+                    inst->amount);
+  if (inst->amount != 0.0)
+    inst->stages |= STAGE_TINT;
+}
+
+/* the last stage writes to dst, the others to the chunk on the stack */
+static void grade(const basicgrade_instance_t* inst, uint32_t* dst,
+                  const uint32_t* src, unsigned int len)
+{
+  uint32_t chunk[FREI0R_LUT_CHUNK];
+  const uint32_t* s;
+  uint32_t* d;
+  unsigned int i, n;
+  int left;
+
+  if (!inst->stages)
+  {
+    if (dst != src)
+      memcpy(dst, src, len * sizeof(uint32_t));
+    return;
+  }
+
+  for (i = 0; i < len; i += n)
+  {
+    n = MIN(len - i, FREI0R_LUT_CHUNK);
+    s = src + i;
+    left = inst->stages;
+    if (left & STAGE_LEVELS)
+    {
+      left &= ~STAGE_LEVELS;
+      d = left ? chunk : dst + i;
+      frei0r_lut_rgb(inst->levels, d, s, n);
+      s = d;
+    }
+    if (left & STAGE_SATURATION)
+    {
+      left &= ~STAGE_SATURATION;
+      d = left ? chunk : dst + i;
+      frei0r_colormatrix_apply(&inst->saturation_cm, d, s, n);
+      s = d;
+    }
+    if (left & STAGE_GAMMA)
+    {
+      left &= ~STAGE_GAMMA;
+      d = left ? chunk : dst + i;
+      frei0r_lut_rgb(inst->gamma_lut, d, s, n);
+      s = d;
+    }
+    if (left & STAGE_TINT)
+      frei0r_colormatrix_apply(&inst->tint_cm, dst + i, s, n);
+  }
+}
+
+static void* grade_rows(void* arg)
+{
+  grade_job_t* job = (grade_job_t*)arg;
+  grade(job->inst, job->dst, job->src, job->len);
+  return 0;
+}
+
+int f0r_init()
+{
+  return 1;
+}
+
+void f0r_deinit()
+{ /* no initialization required */ }
+
+void f0r_get_plugin_info(f0r_plugin_info_t* info)
+{
+  info->name = "Basic grade";
+  info->author = "frei0r";
+  info->plugin_type = F0R_PLUGIN_TYPE_FILTER;
+  info->color_model = F0R_COLOR_MODEL_RGBA8888;
+  info->frei0r_version = FREI0R_MAJOR_VERSION;
+  info->major_version = 0;
+  info->minor_version = 1;
+  info->num_params = 7;
+  info->explanation = "Brightness, contrast, saturation, gamma and tint in one pass";
+}
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
+void f0r_get_param_info(f0r_param_info_t* info, int param_index)
+{
+  switch(param_index)
+  {
+  case 0:
+    info->name = "Brightness";
+    info->type = F0R_PARAM_DOUBLE;
+    info->explanation = "The brightness value, as of Brightness";
+    break;
+  case 1:
+    info->name = "Contrast";
+    info->type = F0R_PARAM_DOUBLE;
+    info->explanation = "The contrast value, as of Contrast0r";
+    break;
+  case 2:
+    info->name = "Saturation";
+    info->type = F0R_PARAM_DOUBLE;
+    info->explanation = "The saturation value, as of Saturat0r";
+    break;
+  case 3:
+    info->name = "Gamma";
+    info->type = F0R_PARAM_DOUBLE;
+    info->explanation = "The gamma value, as of Gamma";
+    break;
+  case 4:
+    info->name = "Map black to";
+    info->type = F0R_PARAM_COLOR;
+    info->explanation = "The color to map source color with null luminance";
+    break;
+  case 5:
+    info->name = "Map white to";
+    info->type = F0R_PARAM_COLOR;
+    info->explanation = "The color to map source color with full luminance";
+    break;
+  case 6:
+    info->name = "Tint amount";
+    info->type = F0R_PARAM_DOUBLE;
+    info->explanation = "Amount of color";
+    break;
+  }
+}
+
+f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
+{
+  basicgrade_instance_t* inst =
+    (basicgrade_instance_t*)calloc(1, sizeof(*inst));
+  inst->width = width; inst->height = height;
+  /* every stage neutral */
+  inst->saturation = 1.0 / FREI0R_GRADE_MAX_SATURATION;
+  inst->gamma = 1.0 / FREI0R_GRADE_MAX_GAMMA;
+  inst->whiteColor.r = inst->whiteColor.g = inst->whiteColor.b = 1.0;
+  update_stages(inst);
+  return (f0r_instance_t)inst;
+}
+
+void f0r_destruct(f0r_instance_t instance)
+{
+  free(instance);
+}
+
+void f0r_set_param_value(f0r_instance_t instance,
+                         f0r_param_t param, int param_index)
+{
+  assert(instance);
+  basicgrade_instance_t* inst = (basicgrade_instance_t*)instance;
+
+  switch(param_index)
+  {
+  case 0:
+    /* remap to [-256, 256] */
+    inst->brightness = (int)((*((double*)param) - 0.5) * 512.0);
+    break;
+  case 1:
+    inst->contrast = (int)((*((double*)param) - 0.5) * 512.0);
+    break;
+  case 2:
+    inst->saturation = *((double*)param);
+    break;
+  case 3:
+    inst->gamma = *((double*)param);
+    break;
+  case 4:
+    inst->blackColor = *((f0r_param_color_t*)param);
+    break;
+  case 5:
+    inst->whiteColor = *((f0r_param_color_t*)param);
+    break;
+  case 6:
+    inst->amount = *((double*)param);
+    break;
+  default:
+    return;
+  }
+  update_stages(inst);
+}
+
+void f0r_get_param_value(f0r_instance_t instance,
+                         f0r_param_t param, int param_index)
+{
+  assert(instance);
+  basicgrade_instance_t* inst = (basicgrade_instance_t*)instance;
+
+  switch(param_index)
+  {
+  case 0:
+    *((double*)param) = (inst->brightness + 256.0) / 512.0;
+    break;
+  case 1:
+    *((double*)param) = (inst->contrast + 256.0) / 512.0;
+    break;
+  case 2:
+    *((double*)param) = inst->saturation;
+    break;
+  case 3:
+    *((double*)param) = inst->gamma;
+    break;
+  case 4:
+    *((f0r_param_color_t*)param) = inst->blackColor;
+    break;
+  case 5:
+    *((f0r_param_color_t*)param) = inst->whiteColor;
+    break;
+  case 6:
+    *((double*)param) = inst->amount;
+    break;
+  }
+}
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  basicgrade_instance_t* inst = (basicgrade_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  grade(inst, outframe + inst->width * row_begin,
+        inframe + inst->width * row_begin,
+        inst->width * (row_end - row_begin));
+  return 1;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  basicgrade_instance_t* inst = (basicgrade_instance_t*)instance;
+  grade_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+  unsigned int y0, y1;
+
+  for (i = 0; i < n; ++i)
+  {
+    y0 = inst->height * i / n;
+    y1 = inst->height * (i + 1) / n;
+    jobs[i].inst = inst;
+    jobs[i].src = inframe + inst->width * y0;
+    jobs[i].dst = outframe + inst->width * y0;
+    jobs[i].len = inst->width * (y1 - y0);
+  }
+  frei0r_thread_run(grade_rows, jobs, sizeof(grade_job_t), n);
+}
+
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return !((basicgrade_instance_t*)instance)->stages;
+}
+
+/* the tables and matrices are kept */
+int f0r_resize(f0r_instance_t instance,
+               unsigned int width, unsigned int height)
+{
+  assert(instance);
+  basicgrade_instance_t* inst = (basicgrade_instance_t*)instance;
+  inst->width = width; inst->height = height;
+  return 1;
+}
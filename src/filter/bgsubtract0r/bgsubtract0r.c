@@ -16,6 +16,8 @@
  *   reference image
  * - whether to remove "noise" (i.e. isolated pixels)
  * - optional blurring of edges
+ * - whether the reference slowly follows the background, for light that
+ *   changes over time
  *
  * Some recommendations:
  * - obviously the background should be of a (really) different color than the
@@ -42,7 +44,17 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "frei0r.h"
+#include "frei0r_thread.h"
+#include "frei0r_state.h"
+
+/* The mask has one bit per pixel, bit x & 63 of word x >> 6 of its row,
+ * so that denoising looks at 64 pixels at a time. Each pass over the
+ * frame is split over threads by rows. */
 
 typedef struct bgsubtract0r_instance
 {
@@ -51,10 +63,25 @@ typedef struct bgsubtract0r_instance
   uint8_t threshold;
   char denoise; /* Remove noise from mask. */
   uint32_t* reference; /* The reference image. */
-  uint8_t* mask; /* Where the mask is computed. */
+  uint16_t* background; /* Reference in 8.8 fixed point, when adapting. */
+  uint64_t* mask; /* Where the mask is computed. */
+  uint64_t* clean; /* Where it is denoised. */
+  unsigned int words; /* Words per row of the mask. */
   int blur; /* Width of alpha-channel blurring. */
+  double adapt; /* Rate at which the reference follows the background. */
+  char restart; /* The next frame is the reference, see f0r_reset. */
 } bgsubtract0r_instance_t;
 
+typedef struct bgsubtract0r_job
+{
+  bgsubtract0r_instance_t* inst;
+  const uint32_t* in;
+  uint32_t* out;
+  const uint64_t* src; /* mask read */
+  uint64_t* dst; /* mask written */
+  unsigned int y0, y1; /* rows of the job */
+} bgsubtract0r_job_t;
+
 int f0r_init()
 {
   return 1;
@@ -72,11 +99,18 @@ void f0r_get_plugin_info(f0r_plugin_info_t* bgsubtract0r_info)
   bgsubtract0r_info->color_model = F0R_COLOR_MODEL_RGBA8888;
   bgsubtract0r_info->frei0r_version = FREI0R_MAJOR_VERSION;
   bgsubtract0r_info->major_version = 0;
-  bgsubtract0r_info->minor_version = 3;
-  bgsubtract0r_info->num_params =  3;
+  bgsubtract0r_info->minor_version = 4;
+  bgsubtract0r_info->num_params =  4;
   bgsubtract0r_info->explanation = "Bluescreen the background of a static video.";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_TEMPORAL | F0R_CAP_CLONE
+    | F0R_CAP_STATE | F0R_CAP_RB_SYMMETRIC;
+}
+
 f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 {
   bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)calloc(1, sizeof(*inst));
@@ -85,8 +119,12 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->denoise = 1;
   inst->blur = 0;
   inst->threshold = 26;
+  inst->adapt = 0;
   inst->reference = NULL;
-  inst->mask = malloc(sizeof(uint8_t)*width*height);
+  inst->background = NULL;
+  inst->words = (width + 63) / 64;
+  inst->mask = (uint64_t*)calloc((size_t)inst->words * height, sizeof(uint64_t));
+  inst->clean = (uint64_t*)calloc((size_t)inst->words * height, sizeof(uint64_t));
   return (f0r_instance_t)inst;
 }
 
@@ -94,10 +132,76 @@ void f0r_destruct(f0r_instance_t instance)
 {
   bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
   free(inst->reference);
+  free(inst->background);
   free(inst->mask);
+  free(inst->clean);
   free(inst);
 }
 
+/* The reference and the background are the state, the masks are
+   computed anew for every frame. */
+f0r_instance_t f0r_clone(f0r_instance_t instance)
+{
+  bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
+  bgsubtract0r_instance_t* copy;
+  size_t len = (size_t)inst->width * inst->height;
+
+  copy = (bgsubtract0r_instance_t*)f0r_construct(inst->width, inst->height);
+  copy->threshold = inst->threshold;
+  copy->denoise = inst->denoise;
+  copy->blur = inst->blur;
+  copy->adapt = inst->adapt;
+  copy->restart = inst->restart;
+  if (inst->reference)
+  {
+    copy->reference = (uint32_t*)malloc(sizeof(uint32_t)*len);
+    memcpy(copy->reference, inst->reference, sizeof(uint32_t)*len);
+  }
+  if (inst->background)
+  {
+    copy->background = (uint16_t*)malloc(sizeof(uint16_t)*3*len);
+    memcpy(copy->background, inst->background, sizeof(uint16_t)*3*len);
+  }
+  return (f0r_instance_t)copy;
+}
+
+/* for f0r_save_state and f0r_load_state, version 1 */
+static int bgsubtract0r_state(bgsubtract0r_instance_t* inst, frei0r_state_t* s)
+{
+  size_t len = (size_t)inst->width * inst->height;
+
+  /* a reset instance has no reference, like a new one */
+  if (inst->restart)
+  {
+    free(inst->reference);
+    free(inst->background);
+    inst->reference = NULL;
+    inst->background = NULL;
+    inst->restart = 0;
+  }
+  frei0r_state_buffer(s, (void**)&inst->reference, sizeof(uint32_t)*len);
+  frei0r_state_buffer(s, (void**)&inst->background, sizeof(uint16_t)*3*len);
+  return frei0r_state_ok(s);
+}
+
+size_t f0r_save_state(f0r_instance_t instance, void* buffer, size_t size)
+{
+  bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
+  frei0r_state_t s;
+
+  frei0r_state_save(&s, buffer, size, 1, inst->width, inst->height);
+  return bgsubtract0r_state(inst, &s) ? frei0r_state_size(&s) : 0;
+}
+
+int f0r_load_state(f0r_instance_t instance, const void* buffer, size_t size)
+{
+  bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
+  frei0r_state_t s;
+
+  frei0r_state_load(&s, buffer, size, 1, inst->width, inst->height);
+  return bgsubtract0r_state(inst, &s) && frei0r_state_end(&s);
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -119,6 +223,12 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
     info->type = F0R_PARAM_DOUBLE;
     info->explanation = "Blur alpha channel by given radius (to remove sharp edges)";
     break;
+
+  case 3:
+    info->name = "adapt";
+    info->type = F0R_PARAM_DOUBLE;
+    info->explanation = "Rate at which the reference follows the background, 0 keeps the first frame";
+    break;
   }
 }
 
@@ -140,6 +250,12 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
   case 2:
     inst->blur = (int)(*((double*)param)+0.5);
     break;
+
+  case 3:
+    inst->adapt = *((double*)param);
+    if (inst->adapt < 0.) inst->adapt = 0.;
+    if (inst->adapt > 1.) inst->adapt = 1.;
+    break;
   }
 }
 
@@ -161,6 +277,10 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
   case 2:
     *((double*)param) = inst->blur;
     break;
+
+  case 3:
+    *((double*)param) = inst->adapt;
+    break;
   }
 }
 
@@ -179,86 +299,351 @@ inline static uint8_t dst(uint32_t x, uint32_t y)
   return d;
 }
 
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+#if defined(__SSE2__)
+/* 0 or ~0 in each lane, whether the largest color difference of the
+   four pixels is above the threshold */
+inline static __m128i dst4(const uint32_t* x, const uint32_t* y, __m128i t)
 {
-  assert(instance);
-  bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
+  __m128i a = _mm_loadu_si128((const __m128i*)x);
+  __m128i b = _mm_loadu_si128((const __m128i*)y);
+  __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+
+  d = _mm_and_si128(d, _mm_set1_epi32(0x00ffffff));
+  d = _mm_max_epu8(d, _mm_srli_epi32(d, 8));
+  d = _mm_max_epu8(d, _mm_srli_epi32(d, 16));
+  return _mm_cmpgt_epi32(_mm_and_si128(d, _mm_set1_epi32(0xff)), t);
+}
+#endif
+
+/* Pixels that differ from the reference. */
+static void* threshold_rows(void* arg)
+{
+  bgsubtract0r_job_t* job = (bgsubtract0r_job_t*)arg;
+  bgsubtract0r_instance_t* inst = job->inst;
+  unsigned int width = inst->width;
+  unsigned int x, y, k, b;
+  uint64_t w;
+#if defined(__SSE2__)
+  __m128i t = _mm_set1_epi32(inst->threshold);
+#endif
+
+  for (y=job->y0; y<job->y1; y++)
+  {
+    const uint32_t* ref = inst->reference + (size_t)width*y;
+    const uint32_t* in = job->in + (size_t)width*y;
+    uint64_t* m = job->dst + (size_t)inst->words*y;
+
+    for (k=0; k<inst->words; k++)
+    {
+      w = 0;
+      x = 64*k;
+#if defined(__SSE2__)
+      /* 16 pixels at a time */
+      for (b=0; b<64 && x+16<=width; b+=16, x+=16)
+      {
+        __m128i p = _mm_packs_epi16(
+          _mm_packs_epi32(dst4(ref+x, in+x, t), dst4(ref+x+4, in+x+4, t)),
+          _mm_packs_epi32(dst4(ref+x+8, in+x+8, t), dst4(ref+x+12, in+x+12, t)));
+        w |= (uint64_t)(uint16_t)_mm_movemask_epi8(p) << b;
+      }
+#else
+      b = 0;
+#endif
+      for (; b<64 && x<width; b++, x++)
+        if (dst(ref[x], in[x]) > inst->threshold)
+          w |= (uint64_t)1 << b;
+      m[k] = w;
+    }
+  }
+  return 0;
+}
+
+/* Isolated pixels of the mask flip: a pixel with at most 2 of its 8
+   neighbours set is cleared, one with at least 6 set is set. The border
+   pixels of the frame stay as they are. 64 pixels at a time, adding up
+   the neighbours bitwise. */
+static void* denoise_rows(void* arg)
+{
+  bgsubtract0r_job_t* job = (bgsubtract0r_job_t*)arg;
+  bgsubtract0r_instance_t* inst = job->inst;
+  unsigned int words = inst->words;
   unsigned int width = inst->width;
   unsigned int height = inst->height;
-  unsigned int len = width * height;
-  uint8_t *mask = inst->mask;
-  int blur = inst->blur;
-  int i;
-  int j;
-  int n;
-  uint8_t* pi;
-  uint8_t* po;
+  unsigned int y, k;
 
-  if (!inst->reference)
+  for (y=job->y0; y<job->y1; y++)
   {
-    int blen = sizeof(uint32_t)*len;
-    inst->reference = malloc(blen);
-    memmove(inst->reference, inframe, blen);
-    memset(mask, 0, sizeof(uint8_t)*len);
+    const uint64_t* cur = job->src + (size_t)words*y;
+    uint64_t* m = job->dst + (size_t)words*y;
+
+    if (y == 0 || y+1 >= height || width < 3)
+    {
+      memcpy(m, cur, words*sizeof(uint64_t));
+      continue;
+    }
+
+    const uint64_t* up = cur - words;
+    const uint64_t* dn = cur + words;
+
+    for (k=0; k<words; k++)
+    {
+      /* the neighbours to the left and right of each bit */
+#define LEFT(r) (((r)[k] << 1) | (k > 0 ? (r)[k-1] >> 63 : 0))
+#define RIGHT(r) (((r)[k] >> 1) | (k+1 < words ? (r)[k+1] << 63 : 0))
+      uint64_t n0 = LEFT(up), n1 = up[k], n2 = RIGHT(up);
+      uint64_t n3 = LEFT(cur), n4 = RIGHT(cur);
+      uint64_t n5 = LEFT(dn), n6 = dn[k], n7 = RIGHT(dn);
+#undef LEFT
+#undef RIGHT
+      uint64_t s1, c1, s2, c2, s3, c3, b0, c4, t, c5, b1, c6, b2, b3;
+      uint64_t le2, ge6, inner;
+      unsigned int x0 = 64*k;
+
+      /* the count of set neighbours, in the bits b3 b2 b1 b0 */
+      s1 = n0 ^ n1 ^ n2;  c1 = (n0 & n1) | (n2 & (n0 ^ n1));
+      s2 = n3 ^ n4 ^ n5;  c2 = (n3 & n4) | (n5 & (n3 ^ n4));
+      s3 = n6 ^ n7;       c3 = n6 & n7;
+      b0 = s1 ^ s2 ^ s3;  c4 = (s1 & s2) | (s3 & (s1 ^ s2));
+      t = c1 ^ c2 ^ c3;   c5 = (c1 & c2) | (c3 & (c1 ^ c2));
+      b1 = t ^ c4;        c6 = t & c4;
+      b2 = c5 ^ c6;       b3 = c5 & c6;
+
+      le2 = ~b3 & ~b2 & ~(b1 & b0);
+      ge6 = b3 | (b2 & b1);
+
+      /* the bits of the pixels 1 to width-2 */
+      inner = ~(uint64_t)0;
+      if (x0 == 0)
+        inner &= ~(uint64_t)1;
+      if (x0 + 64 > width - 1)
+        inner &= width - 1 - x0 >= 64 ? ~(uint64_t)0
+          : ((uint64_t)1 << (width - 1 - x0)) - 1;
+
+      m[k] = (((cur[k] & ~le2) | (~cur[k] & ge6)) & inner) | (cur[k] & ~inner);
+    }
   }
-  else
+  return 0;
+}
+
+#define MASK_BIT(m, words, x, y) (((m)[(size_t)(words)*(y) + ((x) >> 6)] >> ((x) & 63)) & 1)
+
+/* Background pixels move the reference towards them. */
+static void adapt_row(bgsubtract0r_instance_t* inst, const uint64_t* mask,
+                      const uint32_t* in, unsigned int y)
+{
+  unsigned int width = inst->width;
+  int64_t a = (int64_t)(inst->adapt * 65536. + 0.5);
+  uint16_t* bg = inst->background + (size_t)3*width*y;
+  uint8_t* ref = (uint8_t*)(inst->reference + (size_t)width*y);
+  const uint8_t* p = (const uint8_t*)(in + (size_t)width*y);
+  unsigned int x, c;
+  int v;
+
+  for (x=0; x<width; x++)
   {
-    for (i=0; i<len; i++)
-      mask[i] = (dst(inst->reference[i], inframe[i]) > inst->threshold) ? 0xff : 0;
+    if (MASK_BIT(mask, inst->words, x, y))
+      continue;
+    for (c=0; c<3; c++)
+    {
+      v = bg[3*x+c] + (int)((((int64_t)p[4*x+c] << 8) - bg[3*x+c]) * a >> 16);
+      bg[3*x+c] = v;
+      v = (v + 128) >> 8;
+      ref[4*x+c] = v > 255 ? 255 : v;
+    }
   }
+}
 
-  /* Clean up the mask. */
-  if (inst->denoise)
-    for (j=1; j<height-1; j++)
-      for (i=1; i<width-1; i++)
+/* Color of the input, alpha from the mask, blurred by a box of
+   2*blur+1 pixels where outside the frame counts as set; and the
+   reference update. */
+static void* output_rows(void* arg)
+{
+  bgsubtract0r_job_t* job = (bgsubtract0r_job_t*)arg;
+  bgsubtract0r_instance_t* inst = job->inst;
+  unsigned int width = inst->width;
+  unsigned int words = inst->words;
+  int height = inst->height;
+  int blur = inst->blur;
+  const uint64_t* mask = job->src;
+  unsigned int* col = NULL;
+  unsigned int x;
+  int y, dj;
+
+  if (blur)
+  {
+    /* the set pixels of each column in the rows y-blur to y+blur */
+    col = (unsigned int*)calloc(width, sizeof(unsigned int));
+    if (!col)
+      return 0;
+    for (dj=-blur; dj<blur; dj++)
+    {
+      y = (int)job->y0 + dj;
+      for (x=0; x<width; x++)
+        col[x] += (y < 0 || y >= height) ? 1 : MASK_BIT(mask, words, x, y);
+    }
+  }
+
+  for (y=job->y0; y<(int)job->y1; y++)
+  {
+    const uint8_t* pi = (const uint8_t*)(job->in + (size_t)width*y);
+    uint8_t* po = (uint8_t*)(job->out + (size_t)width*y);
+
+    if (inst->background)
+      adapt_row(inst, mask, job->in, y);
+
+    if (!blur)
+    {
+      for (x=0; x<width; x++)
       {
-        n = (mask[width*j+i-1]+mask[width*j+i+1]+mask[width*(j-1)+i]+mask[width*(j+1)+i]
-             + mask[width*(j-1)+i-1]+mask[width*(j-1)+i+1]+mask[width*(j+1)+i-1]+mask[width*(j+1)+i+1])/0xff;
-        if (mask[width*j+i])
-        {
-          if (n<=2) mask[width*j+i] = 0;
-        }
-        else
-        {
-          if (n>=6) mask[width*j+i] = 0xff;
-        }
+        po[4*x] = pi[4*x];
+        po[4*x+1] = pi[4*x+1];
+        po[4*x+2] = pi[4*x+2];
+        po[4*x+3] = MASK_BIT(mask, words, x, y) ? 0xff : 0;
       }
+      continue;
+    }
 
-  for (i=0; i<len; i++)
+    /* the row entering the window, then a window sliding along x */
     {
-      pi = (uint8_t*)&inframe[i];
-      po = (uint8_t*)&outframe[i];
-      po[0] = pi[0];
-      po[1] = pi[1];
-      po[2] = pi[2];
-      po[3] = mask[i];
+      int yi = y + blur, yo = y - blur;
+      unsigned int side = 2*blur+1, s = side*side;
+      unsigned int n = 0;
+      int i, ii;
+
+      for (x=0; x<width; x++)
+        col[x] += (yi >= height) ? 1 : MASK_BIT(mask, words, x, yi);
+      for (ii=-blur; ii<blur; ii++)
+        n += (ii < 0 || ii >= (int)width) ? side : col[ii];
+      for (i=0; i<(int)width; i++)
+      {
+        ii = i + blur;
+        n += (ii >= (int)width) ? side : col[ii];
+        po[4*i] = pi[4*i];
+        po[4*i+1] = pi[4*i+1];
+        po[4*i+2] = pi[4*i+2];
+        po[4*i+3] = 0xff * n / s;
+        ii = i - blur;
+        n -= (ii < 0) ? side : col[ii];
+      }
+      for (x=0; x<width; x++)
+        col[x] -= (yo < 0) ? 1 : MASK_BIT(mask, words, x, yo);
     }
+  }
+  free(col);
+  return 0;
+}
 
-  if (blur)
+static void run_rows(bgsubtract0r_instance_t* inst, void* (*fn)(void*),
+                     const uint32_t* in, uint32_t* out,
+                     const uint64_t* src, uint64_t* dst)
+{
+  bgsubtract0r_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+  for (i=0; i<n; i++)
   {
-    int ii, jj;
-    int di, dj;
-    unsigned int a;
-    // Number of pixels in the surface
-    unsigned int s = (2*blur+1)*(2*blur+1);
-
-    for (j=0; j<height; j++)
-      for (i=0; i<width; i++)
+    jobs[i].inst = inst;
+    jobs[i].in = in;
+    jobs[i].out = out;
+    jobs[i].src = src;
+    jobs[i].dst = dst;
+    jobs[i].y0 = inst->height * i / n;
+    jobs[i].y1 = inst->height * (i+1) / n;
+  }
+  frei0r_thread_run(fn, jobs, sizeof(bgsubtract0r_job_t), n);
+}
+
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
+  unsigned int len = inst->width * inst->height;
+  uint64_t* mask = inst->mask;
+  unsigned int i;
+  int first = !inst->reference || inst->restart;
+
+  if (first)
+  {
+    int blen = sizeof(uint32_t)*len;
+    if (!inst->reference)
+      inst->reference = (uint32_t*)malloc(blen);
+    memmove(inst->reference, inframe, blen);
+    memset(mask, 0, sizeof(uint64_t)*inst->words*inst->height);
+    inst->restart = 0;
+  }
+  else
+    run_rows(inst, threshold_rows, inframe, outframe, NULL, mask);
+
+  /* Follow the background from now on, starting from the reference. */
+  if (inst->adapt > 0. && (!inst->background || first))
+  {
+    const uint8_t* ref = (const uint8_t*)inst->reference;
+
+    if (!inst->background)
+      inst->background = (uint16_t*)malloc(sizeof(uint16_t)*3*len);
+    if (inst->background)
+      for (i=0; i<len; i++)
       {
-        a = 0;
-        for (dj=-blur; dj<=blur; dj++)
-          for (di=-blur; di<=blur; di++)
-          {
-            ii = i+di;
-            jj = j+dj;
-            if (ii < 0 || ii >= width || jj < 0 || jj >= height)
-              a += 0xff;
-            else
-              a += mask[width*jj+ii];
-          }
-        a /= s;
-        po = (uint8_t*)&outframe[width*j+i];
-        po[3] = a;
+        inst->background[3*i] = ref[4*i] << 8;
+        inst->background[3*i+1] = ref[4*i+1] << 8;
+        inst->background[3*i+2] = ref[4*i+2] << 8;
       }
   }
+  else if (inst->adapt == 0. && inst->background)
+  {
+    free(inst->background);
+    inst->background = NULL;
+  }
+
+  /* Clean up the mask. */
+  if (inst->denoise)
+  {
+    run_rows(inst, denoise_rows, inframe, outframe, mask, inst->clean);
+    mask = inst->clean;
+  }
+
+  run_rows(inst, output_rows, inframe, outframe, mask, NULL);
+}
+
+void f0r_update_batch(f0r_instance_t instance, unsigned int count,
+                      const double* times,
+                      const uint32_t* const* inframes1,
+                      const uint32_t* const* inframes2,
+                      const uint32_t* const* inframes3,
+                      uint32_t* const* outframes)
+{
+  unsigned int i;
+
+  /* The reference frame is taken from the first frame ever processed
+     and follows the background of the frames after it, so the frames
+     have to be handled in order. */
+  for (i=0; i<count; i++)
+    f0r_update(instance, times[i], inframes1[i], outframes[i]);
+}
+
+/* The buffers are kept, the next frame becomes the reference like the
+   first one. */
+int f0r_reset(f0r_instance_t instance)
+{
+  assert(instance);
+  ((bgsubtract0r_instance_t*)instance)->restart = 1;
+  return 1;
+}
+
+/* The reference, the background and the masks are all gone over in every
+   update. */
+int f0r_get_memory_usage(f0r_instance_t instance, f0r_memory_usage_t* usage)
+{
+  assert(instance);
+  bgsubtract0r_instance_t* inst = (bgsubtract0r_instance_t*)instance;
+  size_t len = (size_t)inst->width * inst->height;
+  size_t mask = sizeof(uint64_t) * inst->words * inst->height;
+
+  usage->resident = 2 * mask;
+  if (inst->reference)
+    usage->resident += sizeof(uint32_t) * len;
+  if (inst->background)
+    usage->resident += sizeof(uint16_t) * 3 * len;
+  usage->touched = usage->resident + 2 * sizeof(uint32_t) * len;
+  return 1;
 }
@@ -18,6 +18,7 @@
  *
  */
 #include "frei0r.hpp"
+#include "frei0r_key.h"
 
 #include <algorithm>
 #include <vector>
@@ -35,24 +36,11 @@ private:
 	double dist;
 	f0r_param_color color;
 	bool invert;
-	uint32_t r256,g256,b256;
 	
-	// returns the distance to 'color', but does not normalize
-	inline uint32_t distance(uint32_t pixel) {
-		uint32_t d = 0;
-		int t;
-		t = ((pixel&0x00FF0000) >> 16) - b256;
-		d += t*t;
-		t = ((pixel&0x0000FF00) >> 8)  - g256;
-		d += t*t;
-		t = ((pixel&0x000000FF) >> 0)  - r256;
-		d += t*t;
-		
-		return (uint32_t) d; // no sqrtf
-	}
 public:
 	bluescreen0r(unsigned int width, unsigned int height)
 	{
+		pointwise = true;
 		dist = 0.288;
 		
 		color.r = 0;
@@ -66,39 +54,29 @@ public:
 		register_param(invert, "Invert",   "Whether to produce the inverse of the effect on the alpha channel");
 	}
 
-	virtual void update(double time,
-	                    uint32_t* out,
-		            const uint32_t* in) {
-		const uint32_t* pixel	=in;
-		uint32_t* outpixel= out;
-		
-		uint32_t distInt = (uint32_t) (dist*dist*195075);
-		uint32_t distInt2 = distInt/2;
-		
-		r256=255*color.r;
-		g256=255*color.g;
-		b256=255*color.b;
+	virtual bool update_slice(double time,
+	                          uint32_t* out,
+	                          const uint32_t* in,
+	                          unsigned int row_begin,
+	                          unsigned int row_end) {
+		// the squared distance to 'color', without sqrtf; alpha ramps
+		// up over the outer half of 'dist'
+		frei0r_key_t key;
+		key.r = (int)(255*color.r);
+		key.g = (int)(255*color.g);
+		key.b = (int)(255*color.b);
+		key.opaque = (uint32_t) (dist*dist*195075);
+		key.transparent = key.opaque/2;
+		key.width = key.transparent;
+		key.invert = invert;
+		key.spill = FREI0R_KEY_SPILL_NONE;
 		
-		while(pixel != in+size) {
-			*outpixel= (*pixel & 0x00FFFFFF); // copy all except alpha
-			
-			uint32_t d = distance(*pixel); // get distance
-			unsigned char a = 255; // default alpha
-			if (d < distInt) {
-				a = 0;
-				if (d > distInt2) {
-					a = 256*(d-distInt2)/distInt2;
-				}
-			}
-			if (invert) a = 255 - a;
-			*outpixel |= (a<<24);
-			
-			++outpixel;
-			++pixel;
-		}
+		frei0r_key_alpha_row(&key, out + width*row_begin, in + width*row_begin,
+		                     width*(row_end-row_begin));
+		return true;
 	}
 };
 
 
-frei0r::construct<bluescreen0r> plugin("bluescreen0r", "Color to alpha (blit SRCALPHA)", "Hedde Bosman",0,4,F0R_COLOR_MODEL_RGBA8888);
+frei0r::construct<bluescreen0r> plugin("bluescreen0r", "Color to alpha (blit SRCALPHA)", "Hedde Bosman",0,4,F0R_COLOR_MODEL_RGBA8888,F0R_CAP_INPLACE);
 
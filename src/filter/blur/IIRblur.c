@@ -37,17 +37,8 @@ Copyright (C) 2011  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 #include <inttypes.h>
 #include <string.h>
 
-double PI=3.14159265358979;
-
-typedef struct
-{
-    float r;
-    float g;
-    float b;
-    float a;
-} float_rgba;
-
-#include "fibe.h"
+#include "frei0r_fibe.h"
+#include "frei0r_async.h"
 
 
 //----------------------------------------
@@ -64,12 +55,14 @@ typedef struct
     int ec;		//edge compensation (BOOL)
 
     //video buffers
-    float_rgba *img;
+    fibe_rgba *img;
 
     //internal variables
     float a1,a2,a3;
     float rd1,rd2,rs1,rs2,rc1,rc2;
 
+    frei0r_async_t async;	//frames of f0r_update_async
+
 } inst;
 
 //--------------------------------------------------------
@@ -141,6 +134,11 @@ double map_value_backward_log(float v, float min, float max)
     return logf(v/sr)/k+0.5;
 }
 
+static void iirblur_update(f0r_instance_t instance, double time,
+                           const uint32_t* inframe, const uint32_t* inframe2,
+                           const uint32_t* inframe3, uint32_t* outframe);
+static void iirblur_set_param(f0r_instance_t instance, f0r_param_t parm, int param_index);
+
 //***********************************************
 // OBVEZNE FREI0R FUNKCIJE
 
@@ -170,6 +168,15 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
     info->explanation="Three types of fast IIR blurring";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+    f0r_get_plugin_info(&info->info);
+    info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_RB_SYMMETRIC;
+#ifdef FREI0R_HAVE_PTHREAD
+    info->capabilities |= F0R_CAP_ASYNC;
+#endif
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -209,6 +216,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
     in->ty=1;
     in->ec=1;
 
+    frei0r_async_init(&in->async, in, iirblur_update, iirblur_set_param);
+
     return (f0r_instance_t)in;
 }
 
@@ -219,13 +228,15 @@ void f0r_destruct(f0r_instance_t instance)
 
     in=(inst*)instance;
 
+    frei0r_async_destroy(&in->async);
     free(in->img);
 
     free(instance);
 }
 
 //-----------------------------------------------------
-void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_index)
+//after the frames in flight, see f0r_set_param_value
+static void iirblur_set_param(f0r_instance_t instance, f0r_param_t parm, int param_index)
 {
     inst *p;
     double tmpf;
@@ -318,12 +329,19 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
     }
 }
 
+void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_index)
+{
+    frei0r_async_set_param(&((inst*)instance)->async, parm, param_index,
+                           param_index == 2 ? F0R_PARAM_BOOL : F0R_PARAM_DOUBLE);
+}
+
 //--------------------------------------------------
 void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_index)
 {
     inst *p;
 
     p=(inst*)instance;
+    frei0r_async_wait(&p->async);
 
     switch(param_index)
     {
@@ -341,7 +359,9 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 }
 
 //-------------------------------------------------
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+static void iirblur_update(f0r_instance_t instance, double time,
+                           const uint32_t* inframe, const uint32_t* inframe2,
+                           const uint32_t* inframe3, uint32_t* outframe)
 {
     inst *in;
     int i;
@@ -377,3 +397,30 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
         outframe[i]=(outframe[i]&0x00FFFFFF) | (inframe[i]&0xFF000000);
     }
 }
+
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+    assert(instance);
+    frei0r_async_wait(&((inst*)instance)->async);
+    iirblur_update(instance, time, inframe, 0, 0, outframe);
+}
+
+//-------------------------------------------------
+int f0r_set_async_depth(f0r_instance_t instance, int depth)
+{
+    return frei0r_async_set_depth(&((inst*)instance)->async, depth);
+}
+
+int f0r_update_async(f0r_instance_t instance, double time,
+                     const uint32_t* inframe1, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     f0r_async_done_t done, void* user)
+{
+    return frei0r_async_submit(&((inst*)instance)->async, time, inframe1,
+                               inframe2, inframe3, outframe, done, user);
+}
+
+void f0r_wait_async(f0r_instance_t instance)
+{
+    frei0r_async_wait(&((inst*)instance)->async);
+}
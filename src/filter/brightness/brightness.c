@@ -19,9 +19,11 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_grade.h"
 
 typedef struct brightness_instance
 {
@@ -29,25 +31,14 @@ typedef struct brightness_instance
   unsigned int height;
   int brightness; /* the brightness [-256, 256] */
   unsigned char lut[256]; /* look-up table */
+  int identity; /* the look-up table changes nothing */
 } brightness_instance_t;
 
 /* Updates the look-up-table. */
 void update_lut(brightness_instance_t *inst)
 {
-  int i;
-  unsigned char *lut = inst->lut;
-  int brightness = inst->brightness;
-
-  if (brightness < 0)
-  {
-    for (i=0; i<256; ++i)
-      lut[i] = CLAMP0255((i * (256 + brightness))>>8);
-  }
-  else
-  {
-    for (i=0; i<256; ++i)
-      lut[i] = CLAMP0255(i + (((256 - i) * brightness)>>8));
-  }
+  frei0r_grade_brightness_lut(inst->lut, inst->brightness);
+  inst->identity = frei0r_grade_lut_is_identity(inst->lut);
 }
 
 int f0r_init()
@@ -71,6 +62,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* brightness_info)
   brightness_info->explanation = "Adjusts the brightness of a source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -132,12 +130,27 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   brightness_instance_t* inst = (brightness_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  unsigned int len = inst->width * (row_end - row_begin);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
+
+  if (inst->identity)
+  {
+    if (outframe != inframe)
+      memcpy(outframe, inframe, len * sizeof(uint32_t));
+    return 1;
+  }
   
   unsigned char* lut = inst->lut;
   unsigned char* dst = (unsigned char*)outframe;
@@ -149,5 +162,20 @@ void f0r_update(f0r_instance_t instance, double time,
     *dst++ = lut[*src++];
     *dst++ = *src++;// copy alpha
   }
+  return 1;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  brightness_instance_t* inst = (brightness_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
 }
 
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return ((brightness_instance_t*)instance)->identity;
+}
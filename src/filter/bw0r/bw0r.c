@@ -1,4 +1,6 @@
 #include "frei0r.h"
+#include "frei0r_planar.h"
+#include "frei0r_lut.h"
 #include <stdlib.h>
 #include <assert.h>
 
@@ -29,6 +31,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* blackwhiteInfo)
   blackwhiteInfo->explanation = "Turns image black/white.";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_PLANAR | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   /* no params */
@@ -54,24 +63,49 @@ void f0r_get_param_value(f0r_instance_t instance,
 			 f0r_param_t param, int param_index)
 { /* no params */ }
 
+/* (r + g + b) / 3, exactly: 21846 / 65536 is too little more than a third
+   to reach the next integer for sums up to 765 */
+static const frei0r_luma_t blackwhite_luma = { 21846, 21846, 21846, 16, 0 };
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+		     const uint32_t* inframe, const uint32_t* inframe2,
+		     const uint32_t* inframe3, uint32_t* outframe,
+		     unsigned int row_begin, unsigned int row_end,
+		     unsigned int thread_index)
+{
+  assert(instance);
+  blackwhite_instance_t* inst = (blackwhite_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  frei0r_lut_gray(outframe + inst->width * row_begin,
+		  inframe + inst->width * row_begin,
+		  inst->width * (row_end - row_begin), &blackwhite_luma);
+  return 1;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
   assert(instance);
   blackwhite_instance_t* inst = (blackwhite_instance_t*)instance;
-  unsigned int w = inst->width;
-  unsigned int h = inst->height;
-  unsigned int x,y;
-  
-  uint32_t* dst = outframe;
-  const uint32_t* src = inframe;
-  for(y=h;y>0;--y)
-      for(x=w;x>0;--x,++src,++dst)
-	{
-	  int tmpbw;
-	  unsigned char* tmpc = (unsigned char*)src;
-	  tmpbw = (tmpc[0] + tmpc[1] + tmpc[2]) / 3;
-	  *dst = (tmpc[3] << 24) | (tmpbw << 16) | (tmpbw << 8) | tmpbw;
-	}
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+		   0, inst->height, 0);
 }
 
+/* YUV frames only need their chroma removed */
+int f0r_update_planar(f0r_instance_t instance, double time,
+		      const f0r_planar_frame_t* inframe,
+		      const f0r_planar_frame_t* outframe)
+{
+  assert(instance);
+  blackwhite_instance_t* inst = (blackwhite_instance_t*)instance;
+
+  if (!frei0r_planar_check(inframe, outframe))
+    return 0;
+  frei0r_planar_copy(inframe->planes[0], inframe->strides[0],
+		     outframe->planes[0], outframe->strides[0],
+		     inst->width, inst->height);
+  frei0r_planar_gray(outframe, inst->width, inst->height);
+  return 1;
+}
@@ -29,7 +29,19 @@
 #include <string.h>
 #include <math.h>
 #include "frei0r_math.h"
-#include "interp.h"
+#include "frei0r_remap.h"
+#include "frei0r_mapcache.h"
+#include "frei0r_deadline.h"
+
+//version 1 of the maps, see frei0r_mapcache.h
+#define MAP_NAME "c0rners-1"
+
+//2D point
+typedef struct		//tocka v ravnini
+{
+	float x;
+	float y;
+} tocka2;
 
 //----------------------------------------
 //structure for Frei0r instance
@@ -55,18 +67,20 @@ typedef struct
 
 	interpp interp;
 	float *map;
+	const float *mapp;	//the map in use: map, or one from the cache
+	frei0r_mapcache_t cache;
 	unsigned char *amap;
-	int mapIsDirty;
+	int mapIsDirty;		//corners or stretch changed
+	int intpIsDirty;	//map or interpolator changed
+	int alphaIsDirty;	//map or feather changed
+	int quality;		//F0R_QUALITY_*, see f0r_set_quality
+	frei0r_deadline_t deadline;	//see f0r_set_deadline
+	frei0r_remap_t remap;
+	tocka2 vog[4];		//corners of the current map, for the alpha map
+	int nots[4];
 } inst;
 
 
-//2D point
-typedef struct		//tocka v ravnini
-{
-	float x;
-	float y;
-} tocka2;
-
 //2D line
 typedef struct		//premica v ravnini
 {
@@ -166,15 +180,50 @@ int presecisce2(premica2 p1, premica2 p2, tocka2 *t)
 }
 
 // ------------------------------------------------ ---------------
-// generate mapping for a general quadrangle
-// wi, hi = input image size
-// wo, ho = output image size
-// vog [] = the four corners
-// str: 0 = no stretch 1 = do stretch
-// strx, stry: stretch values ​​[0 ... 1] 0.5 = no stretch
-void cetverokotnik4(int wi, int hi, int wo, int ho, tocka2 vog[], int str, float strx, float stry, float *map)
+//arguments of cetverokotnik4() / trikotnik1() for one band of rows
+typedef struct
+{
+	int wi, hi, wo, ho;
+	tocka2 *vog;
+	tocka2 R, S;
+	premica2 p12, p23, p34, p41;
+	int t12, t23;
+	int str;
+	float strx, stry;
+	float *map;
+	int y0, y1;
+} mapjob;
+
+//splits the rows of a map into bands over threads
+static void run_mapjobs(void* (*rows)(void*), mapjob *jb)
+{
+	mapjob jobs[FREI0R_MAX_THREADS];
+	int t, nt = frei0r_thread_count((long)jb->wo * jb->ho);
+
+	if (nt > jb->ho) nt = jb->ho;
+	for (t=0;t<nt;t++)
+	{
+		jobs[t] = *jb;
+		jobs[t].y0 = jb->ho * t / nt;
+		jobs[t].y1 = jb->ho * (t+1) / nt;
+	}
+	frei0r_thread_run(rows, jobs, sizeof(mapjob), nt);
+}
+
+//---------------------------------------------------------------
+//the rows y0...y1 of cetverokotnik4()
+//everything that doesn't depend on the pixel is computed once per
+//map or per row, in the same order of operations as per pixel
+static void* cetverokotnik4_rows(void *arg)
 {
+	mapjob *jb = (mapjob*)arg;
+	int wi = jb->wi, hi = jb->hi, wo = jb->wo;
+	tocka2 *vog = jb->vog;
+	int str = jb->str;
+	float strx = jb->strx, stry = jb->stry;
+	float *map = jb->map;
 	double a,b,c,d,e,f,g,h,a2,b2,c2,u,v,aa,bb,de,sde,v1,v2,u1,u2;
+	double edfc,eb,gb;
 	tocka2 T;
 	int x,y;
 	float kx,ky,k1,k2;
@@ -186,36 +235,44 @@ void cetverokotnik4(int wi, int hi, int wo, int ho, tocka2 vog[], int str, float
 	ky=4.0*2.0*fabsl(stry-0.5)+0.00005;
 	k2=1.0-1.0/(ky+1.0);
 
-	for (y=0;y<ho;y++)
+	//enacba za Xt, prva moznost
+	b=vog[1].x-vog[0].x;
+	c=vog[3].x-vog[0].x;
+	d=vog[2].x-vog[1].x-(vog[3].x-vog[0].x);
+	//enacba za Xt, druga moznost
+	//		b=vog[1].x-vog[0].x;
+	//		c=vog[2].x-vog[0].x;
+	//		d=vog[3].x-vog[2].x-(vog[1].x-vog[0].x);
+
+	//enacba za Yt, prva moznost
+	f=vog[1].y-vog[0].y;
+	g=vog[3].y-vog[0].y;
+	h=vog[2].y-vog[1].y-(vog[3].y-vog[0].y);
+	//enacba za Yt, druga moznost
+	//		f=vog[1].y-vog[0].y;
+	//		g=vog[2].y-vog[0].y;
+	//		h=vog[3].y-vog[2].y-(vog[1].y-vog[0].y);
+
+	a2=g*d-h*c; gb=g*b;
+
+	for (y=jb->y0;y<jb->y1;y++)
 	{
+		T.y=(float)y+0.5;
+		e=vog[0].y-T.y;
+		edfc=e*d-f*c; eb=e*b;
+
 		for (x=0;x<wo;x++)
 		{
-			T.x=(float)x+0.5;T.y=(float)y+0.5;
-
-			//enacba za Xt, prva moznost
-			a=vog[0].x-T.x; b=vog[1].x-vog[0].x;
-			c=vog[3].x-vog[0].x;
-			d=vog[2].x-vog[1].x-(vog[3].x-vog[0].x);
-			//enacba za Xt, druga moznost
-			//		a=vog[0].x-T.x; b=vog[1].x-vog[0].x;
-			//		c=vog[2].x-vog[0].x;
-			//		d=vog[3].x-vog[2].x-(vog[1].x-vog[0].x);
-
-			//enacba za Yt, prva moznost
-			e=vog[0].y-T.y; f=vog[1].y-vog[0].y;
-			g=vog[3].y-vog[0].y;
-			h=vog[2].y-vog[1].y-(vog[3].y-vog[0].y);
-			//enacba za Yt, druga moznost
-			//		e=vog[0].y-T.y; f=vog[1].y-vog[0].y;
-			//		g=vog[2].y-vog[0].y;
-			//		h=vog[3].y-vog[2].y-(vog[1].y-vog[0].y);
+			T.x=(float)x+0.5;
+			a=vog[0].x-T.x;
 
 			//resitev za v in u
-			a2=g*d-h*c; b2=e*d-f*c-h*a+g*b; c2=e*b-f*a;
+			//b2=e*d-f*c-h*a+g*b; c2=e*b-f*a;
+			b2=edfc-h*a+gb; c2=eb-f*a;
 			//linearni priblizek uporabim, ce je napaka < 1/10 piksla
-			//		if (fabsl(a2*c2*c2/(b2*b2*b2))< 0.1/wi)
+			//		if (fabs(a2*c2*c2/(b2*b2*b2))< 0.1/wi)
 			//dodaten pogoj za a2, da ni spranje v konkavnih
-			if ((fabsl(a2*c2*c2/(b2*b2*b2))< 0.1/wi) && (fabsl(a2)<1.0))
+			if ((fabs(a2*c2*c2/(b2*b2*b2))< 0.1/wi) && (fabs(a2)<1.0))
 			{
 				v1 = (b2!=0.0) ? -c2/b2 : 1000.0;
 				v2=1000.0;
@@ -292,13 +349,39 @@ void cetverokotnik4(int wi, int hi, int wo, int ho, tocka2 vog[], int str, float
 
 		}
 	}
+	return 0;
+}
 
+// generate mapping for a general quadrangle
+// wi, hi = input image size
+// wo, ho = output image size
+// vog [] = the four corners
+// str: 0 = no stretch 1 = do stretch
+// strx, stry: stretch values ​​[0 ... 1] 0.5 = no stretch
+void cetverokotnik4(int wi, int hi, int wo, int ho, tocka2 vog[], int str, float strx, float stry, float *map)
+{
+	mapjob jb;
+
+	memset(&jb, 0, sizeof(jb));
+	jb.wi=wi; jb.hi=hi; jb.wo=wo; jb.ho=ho;
+	jb.vog=vog;
+	jb.str=str; jb.strx=strx; jb.stry=stry;
+	jb.map=map;
+	run_mapjobs(cetverokotnik4_rows, &jb);
 }
 
 //---------------------------------------------------------------
-//generate mapping for a triangle
-void trikotnik1(int wi, int hi, int wo, int ho, tocka2 vog[], tocka2 R, tocka2 S, premica2 p12, premica2 p23, premica2 p34, premica2 p41, int t12, int t23, int str, float strx, float stry, float *map)
+//the rows y0...y1 of trikotnik1()
+static void* trikotnik1_rows(void *arg)
 {
+	mapjob *jb = (mapjob*)arg;
+	int wi = jb->wi, hi = jb->hi, wo = jb->wo;
+	tocka2 *vog = jb->vog, R = jb->R, S = jb->S;
+	premica2 p12 = jb->p12, p23 = jb->p23, p34 = jb->p34, p41 = jb->p41;
+	int t12 = jb->t12, t23 = jb->t23;
+	int str = jb->str;
+	float strx = jb->strx, stry = jb->stry;
+	float *map = jb->map;
 	int x,y;
 	tocka2 T,A,B;
 	premica2 p5,p6;
@@ -310,7 +393,7 @@ void trikotnik1(int wi, int hi, int wo, int ho, tocka2 vog[], tocka2 R, tocka2 S
 	ky=4.0*2.0*fabsl(stry-0.5)+0.00005;
 	k2=1.0-1.0/(ky+1.0);
 
-	for (y=0;y<ho;y++)
+	for (y=jb->y0;y<jb->y1;y++)
 	{
 		for (x=0;x<wo;x++)
 		{
@@ -377,6 +460,23 @@ void trikotnik1(int wi, int hi, int wo, int ho, tocka2 vog[], tocka2 R, tocka2 S
 			}
 		}
 	}
+	return 0;
+}
+
+//---------------------------------------------------------------
+//generate mapping for a triangle
+void trikotnik1(int wi, int hi, int wo, int ho, tocka2 vog[], tocka2 R, tocka2 S, premica2 p12, premica2 p23, premica2 p34, premica2 p41, int t12, int t23, int str, float strx, float stry, float *map)
+{
+	mapjob jb;
+
+	memset(&jb, 0, sizeof(jb));
+	jb.wi=wi; jb.hi=hi; jb.wo=wo; jb.ho=ho;
+	jb.vog=vog; jb.R=R; jb.S=S;
+	jb.p12=p12; jb.p23=p23; jb.p34=p34; jb.p41=p41;
+	jb.t12=t12; jb.t23=t23;
+	jb.str=str; jb.strx=strx; jb.stry=stry;
+	jb.map=map;
+	run_mapjobs(trikotnik1_rows, &jb);
 }
 
 //-------------------------------------------------------
@@ -387,19 +487,32 @@ void trikotnik1(int wi, int hi, int wo, int ho, tocka2 vog[], tocka2 R, tocka2 S
 //map = map generated by geom4c_b()
 //nots[] = flags for inner sides
 //for now it does not feather caustics on concaves an crossed sides
-void make_alphamap(unsigned char *amap, tocka2 vog[], int wo, int ho, float *map, float feath, int nots[])
+//arguments of make_alphamap() for one band of rows
+typedef struct
 {
+	unsigned char *amap;
+	int wo, ho;
+	const float *map;
+	float feath;
+	premica2 p12,p23,p34,p41;
+	int skip[4];
+	int i0, i1;
+} alphajob;
+
+static void* alphamap_rows(void *arg)
+{
+	alphajob *jb = (alphajob*)arg;
+	unsigned char *amap = jb->amap;
+	const float *map = jb->map;
+	float feath = jb->feath;
+	int wo = jb->wo;
+	premica2 p12 = jb->p12, p23 = jb->p23, p34 = jb->p34, p41 = jb->p41;
+	int s12 = jb->skip[0], s23 = jb->skip[1], s34 = jb->skip[2], s41 = jb->skip[3];
 	float r12, r23, r34, r41, rmin;
 	tocka2 t;
 	int i,j;
-	premica2 p12,p23,p34,p41;
 
-	premica2d(vog[0],vog[1],&p12);	//  1-2
-	premica2d(vog[2],vog[3],&p34);	//  3-4
-	premica2d(vog[3],vog[0],&p41);	//  4-1
-	premica2d(vog[1],vog[2],&p23);	//  2-3
-
-	for (i=0;i<ho;i++)
+	for (i=jb->i0;i<jb->i1;i++)
 		for (j=0;j<wo;j++)
 		{
 		t.x=(float)i+0.5; t.y=(float)j+0.5;
@@ -408,10 +521,10 @@ void make_alphamap(unsigned char *amap, tocka2 vog[], int wo, int ho, float *map
 		r34=fabsf(razd_t_p(t,p34));
 		r41=fabsf(razd_t_p(t,p41));
 		rmin=1.0E22;
-		if ((r12<rmin) && (nots[0]!=1)) rmin=r12;
-		if ((r23<rmin) && (nots[1]!=1)) rmin=r23;
-		if ((r34<rmin) && (nots[2]!=1)) rmin=r34;
-		if ((r41<rmin) && (nots[3]!=1)) rmin=r41;
+		if ((r12<rmin) && !s12) rmin=r12;
+		if ((r23<rmin) && !s23) rmin=r23;
+		if ((r34<rmin) && !s34) rmin=r34;
+		if ((r41<rmin) && !s41) rmin=r41;
 		if ((map[2*(i*wo+j)]>=0.0)&&(map[2*(i*wo+j)+1]>=0.0))
 		{	//inside
 			if (rmin<=feath) //border area
@@ -422,6 +535,33 @@ void make_alphamap(unsigned char *amap, tocka2 vog[], int wo, int ho, float *map
 		else		//outside
 			amap[i*wo+j]=0;
 	}
+	return 0;
+}
+
+void make_alphamap(unsigned char *amap, tocka2 vog[], int wo, int ho, const float *map, float feath, int nots[])
+{
+	alphajob jb, jobs[FREI0R_MAX_THREADS];
+	int k, nt = frei0r_thread_count((long)wo * ho);
+
+	memset(&jb, 0, sizeof(jb));
+	jb.amap=amap; jb.wo=wo; jb.ho=ho; jb.map=map; jb.feath=feath;
+
+	//a side with coincident corners has no line, it is not feathered
+	jb.skip[0]=(premica2d(vog[0],vog[1],&jb.p12)==-10);	//  1-2
+	jb.skip[2]=(premica2d(vog[2],vog[3],&jb.p34)==-10);	//  3-4
+	jb.skip[3]=(premica2d(vog[3],vog[0],&jb.p41)==-10);	//  4-1
+	jb.skip[1]=(premica2d(vog[1],vog[2],&jb.p23)==-10);	//  2-3
+	for (k=0;k<4;k++)
+		if (nots[k]==1) jb.skip[k]=1;
+
+	if (nt > ho) nt = ho;
+	for (k=0;k<nt;k++)
+	{
+		jobs[k] = jb;
+		jobs[k].i0 = ho * k / nt;
+		jobs[k].i1 = ho * (k+1) / nt;
+	}
+	frei0r_thread_run(alphamap_rows, jobs, sizeof(alphajob), nt);
 }
 
 //-------------------------------------------------------
@@ -625,6 +765,9 @@ int geom4c_b(int wi, int hi, int wo, int ho, tocka2 vog[], int str, float strx,
 //-------------------------------------------------------
 interpp set_intp(inst p)
 {
+	//drafts use bilinear instead of the slower interpolators
+	if ((p.quality==F0R_QUALITY_DRAFT)&&(p.intp>1))
+		return interpBL_b32;
 	switch (p.intp)	//katero interpolacijo bo uporabil
 	{
 		//	case -1:return interpNNpr_b;	//nearest neighbor+print
@@ -639,6 +782,44 @@ interpp set_intp(inst p)
 	}
 }
 
+//everything geom4c_b() depends on, for the map cache
+typedef struct
+{
+	int w;
+	int h;
+	tocka2 vog[4];
+	int stretchON;
+	float stretchx;
+	float stretchy;
+} mapkey;
+
+//-------------------------------------------------------
+//the map and nots[] of the corners vog, computed into p->map or taken
+//from the cache, in p->mapp
+void load_map(inst *p, tocka2 vog[])
+{
+	size_t bytes=sizeof(float)*p->w*p->h*2;
+	const char *cached;
+	mapkey k;
+
+	memset(&k, 0, sizeof(k));
+	k.w=p->w; k.h=p->h;
+	memcpy(k.vog, vog, sizeof(k.vog));
+	k.stretchON=p->stretchON; k.stretchx=p->stretchx; k.stretchy=p->stretchy;
+
+	cached=(const char*)frei0r_mapcache_get(&p->cache, MAP_NAME, &k, sizeof(k), bytes+sizeof(p->nots));
+	if (cached)
+	{
+		p->mapp=(const float*)cached;
+		memcpy(p->nots, cached+bytes, sizeof(p->nots));
+		return;
+	}
+	geom4c_b(p->w, p->h, p->w, p->h, vog, p->stretchON, p->stretchx, p->stretchy, p->map, p->nots);
+	memcpy((char*)p->map+bytes, p->nots, sizeof(p->nots));
+	frei0r_mapcache_put(MAP_NAME, &k, sizeof(k), p->map, bytes+sizeof(p->nots));
+	p->mapp=p->map;
+}
+
 //-----------------------------------------------------
 //stretch [0...1] to parameter range [min...max] linear
 float map_value_forward(double v, float min, float max)
@@ -683,6 +864,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
 	info->explanation="Four corners geometry engine";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -789,11 +976,16 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	in->transb=0;
 	in->feath=1.0;
         in->op=0;
+	in->quality=F0R_QUALITY_NORMAL;
+	frei0r_deadline_init(&in->deadline);
 
-	in->map=(float*)calloc(1, sizeof(float)*(in->w*in->h*2+2));
+	//nots[] follows the map in the cache
+	in->map=(float*)calloc(1, sizeof(float)*(in->w*in->h*2+2)+sizeof(in->nots));
 	in->amap=(unsigned char*)calloc(1, sizeof(char)*(in->w*in->h*2+2));
 	in->interp=set_intp(*in);
 	in->mapIsDirty=1;
+	frei0r_remap_init(&in->remap);
+	frei0r_mapcache_init(&in->cache);
 
 	return (f0r_instance_t)in;
 }
@@ -807,6 +999,8 @@ void f0r_destruct(f0r_instance_t instance)
 
 	free(p->map);
 	free(p->amap);
+	frei0r_remap_free(&p->remap);
+	frei0r_mapcache_release(&p->cache);
 	free(instance);
 }
 
@@ -864,7 +1058,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 		break;
 	case 8:		//Enable stretching
 		tmpf=map_value_forward(*((double*)parm), 0.0, 1.0);//BOOL!!
-		if (p->stretchON != tmpf) chg=1;
+		if (p->stretchON != (int)tmpf) chg=1;
 		p->stretchON = tmpf;
 		break;
 	case 9:		//Stretch X
@@ -879,8 +1073,12 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 		break;
 	case 11:		//Interpolation
 		tmpf=map_value_forward(*((double*)parm), 0.0, 6.999);
-		if (p->intp != tmpf) chg=1;
-		p->intp=tmpf;
+		if (p->intp != (int)tmpf)
+		{
+			p->intp=tmpf;
+			p->interp=set_intp(*p);
+			p->intpIsDirty=1;	//the map stays
+		}
 		break;
 	case 12:		//Transparent Background
 		tmpf=map_value_forward(*((double*)parm), 0.0, 1.0);//BOOL!!
@@ -889,7 +1087,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 		break;
 	case 13:		//Feather Alpha
 		tmpf=map_value_forward(*((double*)parm), 0.0, 100.0);
-		if (tmpf!=p->feath) chg=1;
+		if (tmpf!=p->feath) p->alphaIsDirty=1;
 		p->feath=tmpf;
 		break;
         case 14:                //Alpha operation
@@ -898,10 +1096,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 	}
 
 	if (chg!=0)
-	{
-		p->interp=set_intp(*p);
 		p->mapIsDirty = 1;
-	}
 
 }
 
@@ -976,6 +1171,18 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 #define EPSILON 1e-5f
 #define EQUIVALENT_FLOATS(x, y) (fabsf((x) - (y)) < EPSILON)
 
+//-------------------------------------------------
+//the interpolator of a quality, prepared with the next frame
+static void use_quality(inst *p, int quality)
+{
+	if (p->quality!=quality)
+	{
+		p->quality=quality;
+		p->interp=set_intp(*p);
+		p->intpIsDirty=1;
+	}
+}
+
 //-------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
@@ -983,6 +1190,8 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 	int bkgr;
 
 	p=(inst*)instance;
+	if (frei0r_deadline_begin(&p->deadline))
+		use_quality(p, p->deadline.current);
 
     if (EQUIVALENT_FLOATS(p->x1, 0.333333f) &&
         EQUIVALENT_FLOATS(p->y1, 0.333333f) &&
@@ -997,12 +1206,12 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
             EQUIVALENT_FLOATS(p->stretchy, 0.5f))))
     {
         memcpy(outframe, inframe, p->w * p->h * 4);
+        frei0r_deadline_end(&p->deadline);
         return;
     }
             
 	if (p->mapIsDirty) {
 		tocka2 vog[4];
-		int nots[4];
 		vog[0].x=(p->x1*3-1)*p->w;
 		vog[0].y=(p->y1*3-1)*p->h;
 		vog[1].x=(p->x2*3-1)*p->w;
@@ -1011,17 +1220,54 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 		vog[2].y=(p->y3*3-1)*p->h;
 		vog[3].x=(p->x4*3-1)*p->w;
 		vog[3].y=(p->y4*3-1)*p->h;
-		geom4c_b(p->w, p->h, p->w, p->h, vog, p->stretchON, p->stretchx, p->stretchy, p->map, nots);
-		make_alphamap(p->amap, vog, p->w, p->h, p->map, p->feath, nots);
+		load_map(p, vog);
+		memcpy(p->vog, vog, sizeof(vog));
 		p->mapIsDirty = 0;
+		p->intpIsDirty = 1;
+		p->alphaIsDirty = 1;
+	}
+	if (p->intpIsDirty) {
+		frei0r_remap_prepare(&p->remap, p->w, p->h, p->w, p->h, p->mapp, p->interp);
+		p->intpIsDirty = 0;
+	}
+	//the alpha map is only needed for a transparent background
+	if (p->alphaIsDirty && p->transb!=0) {
+		make_alphamap(p->amap, p->vog, p->w, p->h, p->mapp, p->feath, p->nots);
+		p->alphaIsDirty = 0;
 	}
 
 	//if (p->transb==0) bkgr=0xFF000000; else bkgr=0;
 	bkgr=0xFF000000;
 
-	remap32(p->w, p->h, p->w, p->h, (unsigned char*) inframe, (unsigned char *) outframe, p->map, bkgr, p->interp);
+	frei0r_remap_run(&p->remap, inframe, outframe, bkgr);
 
 	if (p->transb!=0)
 		apply_alphamap(outframe, p->w, p->h, p->amap, p->op);
 
+	frei0r_deadline_end(&p->deadline);
+}
+
+//-------------------------------------------------
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+	inst *p;
+
+	p=(inst*)instance;
+	frei0r_deadline_request(&p->deadline, quality);
+	use_quality(p, p->deadline.current);
+	return 1;
+}
+
+//-------------------------------------------------
+//drafts interpolate bilinearly instead of with the slower interpolators
+int f0r_set_deadline(f0r_instance_t instance, double seconds)
+{
+	frei0r_deadline_set(&((inst*)instance)->deadline, seconds);
+	return 1;
+}
+
+//-------------------------------------------------
+int f0r_get_quality(f0r_instance_t instance)
+{
+	return ((inst*)instance)->deadline.current;
 }
@@ -19,12 +19,23 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+/* The grid used to be drawn with Cairo, which scaled the input into the
+ * first cell. Now the first cell is the mean of the box of source pixels
+ * under each of its pixels, computed directly: the box rows are summed per
+ * source column in 16 bits, and the box columns of those sums in 32 bits.
+ * The other cells are copies of the first one. */
+
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
-#include <cairo.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "frei0r.h"
-#include "frei0r_cairo.h"
+#include "frei0r_math.h"
 
 #define MAX_ROWS    20
 #define MAX_COLUMNS 20 
@@ -35,6 +46,9 @@ typedef struct cairo_imagegrid_instance
   unsigned int height;
   double rows;
   double columns;
+  int* x_edge;     /* per cell column and one more, the first source column */
+  int* y_edge;     /* per cell row and one more, the first source row */
+  uint16_t* sums;  /* per source byte, the sum over the rows of a box */
 } cairo_imagegrid_instance_t;
 
 int f0r_init()
@@ -55,11 +69,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* cairo_gradient_info)
   cairo_gradient_info->color_model = F0R_COLOR_MODEL_RGBA8888;
   cairo_gradient_info->frei0r_version = FREI0R_MAJOR_VERSION;
   cairo_gradient_info->major_version = 0; 
-  cairo_gradient_info->minor_version = 9; 
+  cairo_gradient_info->minor_version = 10; 
   cairo_gradient_info->num_params =  2; 
   cairo_gradient_info->explanation = "Draws a grid of input images.";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch(param_index) {
@@ -83,11 +103,19 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->height = height;
   inst->rows = 2.0 / (MAX_ROWS - 1);
   inst->columns = 2.0 / (MAX_COLUMNS - 1);
+  inst->x_edge = (int*)malloc((width + 1) * sizeof(int));
+  inst->y_edge = (int*)malloc((height + 1) * sizeof(int));
+  /* 4 bytes per pixel and up to 15 more for the last vector */
+  inst->sums = (uint16_t*)malloc((4 * width + 15) * sizeof(uint16_t));
   return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  cairo_imagegrid_instance_t* inst = (cairo_imagegrid_instance_t*)instance;
+  free(inst->x_edge);
+  free(inst->y_edge);
+  free(inst->sums);
   free(instance);
 }
 
@@ -121,61 +149,109 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 	}
 }
 
-void draw_grid(cairo_imagegrid_instance_t* inst, unsigned char* dst, const unsigned char* src)
+/* adds n bytes of src to the sums */
+static void add_row(uint16_t* sums, const uint8_t* src, int n)
 {
-  int x, y;
-  int w = inst->width;
-  int h = inst->height;
-  int stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, w);
-
-  cairo_surface_t* dest_image = cairo_image_surface_create_for_data ((unsigned char*)dst,
-                                                                       CAIRO_FORMAT_ARGB32,
-                                                                       w,
-                                                                       h,
-                                                                       stride);
-  cairo_t *cr = cairo_create (dest_image);
-
-  cairo_surface_t *image = cairo_image_surface_create_for_data ((unsigned char*)src,
-                                               CAIRO_FORMAT_ARGB32,
-                                               w,
-                                               h,
-                                               stride);
-
-  cairo_pattern_t *pattern = cairo_pattern_create_for_surface (image);
-
-  double rows = 1 + (MAX_ROWS - 1) * inst->rows;
-  double columns = 1 + (MAX_ROWS - 1) * inst->columns;
-  int pw = (int)(w/columns);
-  int ph = (int)(h/rows);
-
-  if (w % pw != 0 || h % ph != 0) {
-    // Destination will have gaps - prefill with black.
-    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 1.0);
-    cairo_rectangle (cr, 0, 0, w, h);
-    cairo_fill (cr);
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i s, *d;
+
+  for (; i + 16 <= n; i += 16)
+  {
+    s = _mm_loadu_si128((const __m128i*)(src + i));
+    d = (__m128i*)(sums + i);
+    _mm_storeu_si128(d, _mm_add_epi16(_mm_loadu_si128(d),
+                                      _mm_unpacklo_epi8(s, zero)));
+    _mm_storeu_si128(d + 1, _mm_add_epi16(_mm_loadu_si128(d + 1),
+                                          _mm_unpackhi_epi8(s, zero)));
   }
+#endif
+
+  for (; i < n; ++i)
+    sums[i] += src[i];
+}
+
+/* the pixel of the columns [x0, x1) of the sums, divided by count */
+static uint32_t box_pixel(const uint16_t* sums, int x0, int x1, int count)
+{
+  const float inv = 1.0f / count;
+  int x;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = zero;
 
-  cairo_matrix_t   matrix;
-  cairo_matrix_init_scale (&matrix, columns, rows);
-  cairo_pattern_set_matrix (pattern, &matrix);
+  for (x = x0; x < x1; ++x)
+    sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(
+      _mm_loadl_epi64((const __m128i*)(sums + 4 * x)), zero));
+  sum = _mm_cvttps_epi32(_mm_add_ps(
+    _mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(inv)), _mm_set1_ps(0.5f)));
+  sum = _mm_packs_epi32(sum, sum);
+  return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+#else
+  uint32_t sum[4] = { 0, 0, 0, 0 };
+  uint8_t px[4];
+  int c;
 
-  cairo_set_source (cr, pattern);
+  for (x = x0; x < x1; ++x)
+    for (c = 0; c < 4; ++c)
+      sum[c] += sums[4 * x + c];
+  for (c = 0; c < 4; ++c)
+    px[c] = (uint8_t)(int)(sum[c] * inv + 0.5f);
+  memcpy(&sum[0], px, 4);
+  return sum[0];
+#endif
+}
+
+void draw_grid(cairo_imagegrid_instance_t* inst, uint32_t* dst, const uint32_t* src)
+{
+  int x, y, sy;
+  int w = inst->width;
+  int h = inst->height;
+
+  double rows = 1 + (MAX_ROWS - 1) * CLAMP(inst->rows, 0.0, 1.0);
+  double columns = 1 + (MAX_COLUMNS - 1) * CLAMP(inst->columns, 0.0, 1.0);
+  int pw = MAX((int)(w/columns), 1);
+  int ph = MAX((int)(h/rows), 1);
 
-  cairo_rectangle (cr, 0, 0, pw, ph);
-  cairo_fill (cr);
+  // Cell pixel (x, y) is the mean of the source pixels from
+  // (x_edge[x], y_edge[y]) to (x_edge[x + 1], y_edge[y + 1]), which is
+  // at least one pixel since the scales are at least 1.
+  for (x = 0; x <= pw; x++)
+    inst->x_edge[x] = MIN((int)(x * columns), w);
+  for (y = 0; y <= ph; y++)
+    inst->y_edge[y] = MIN((int)(y * rows), h);
 
-  uint32_t *dst32 = (uint32_t *) dst;
+  if (pw == w && ph == h) {
+    if (dst != src)
+      memcpy (dst, src, (size_t)w * h * sizeof(uint32_t));
+    return;
+  }
 
-  for (y = 0; y < h; y++) {
-    for (x = 0; x < w; x++) {
-	dst32[y*w+x] = dst32[(y % ph) * w + (x % pw)];
-    }
+  // Scale into the first cell. The source rows of a cell row start at or
+  // below it, so this works in place as well.
+  int n = 4 * inst->x_edge[pw];
+  for (y = 0; y < ph; y++) {
+    int y0 = inst->y_edge[y], y1 = inst->y_edge[y + 1];
+    memset (inst->sums, 0, n * sizeof(uint16_t));
+    for (sy = y0; sy < y1; sy++)
+      add_row (inst->sums, (const uint8_t*)(src + (size_t)sy*w), n);
+    for (x = 0; x < pw; x++)
+      dst[(size_t)y*w + x] = box_pixel (inst->sums, inst->x_edge[x],
+        inst->x_edge[x + 1], (inst->x_edge[x + 1] - inst->x_edge[x]) * (y1 - y0));
   }
 
-  cairo_pattern_destroy (pattern);
-  cairo_surface_destroy (image);
-  cairo_surface_destroy (dest_image);
-  cairo_destroy (cr);
+  // Repeat the first cell over the frame, pixel (x, y) is pixel
+  // (x % pw, y % ph) of the first cell.
+  for (y = 0; y < ph && y < h; y++) {
+    uint32_t *row = dst + (size_t)y*w;
+    for (x = pw; x < w; x += pw)
+      memcpy (row + x, row, MIN(pw, w - x) * sizeof(uint32_t));
+  }
+  for (y = ph; y < h; y++)
+    memcpy (dst + (size_t)y*w, dst + (size_t)(y % ph)*w, w * sizeof(uint32_t));
 }
 
 void f0r_update(f0r_instance_t instance, double time,
@@ -183,9 +259,17 @@ void f0r_update(f0r_instance_t instance, double time,
 {
   assert(instance);
   cairo_imagegrid_instance_t* inst = (cairo_imagegrid_instance_t*) instance;
-  const unsigned char* src = (unsigned char*)inframe;
-  unsigned char* dst = (unsigned char*)outframe;
-
-  draw_grid(inst, dst, src);
+  draw_grid(inst, outframe, inframe);
 }
 
+int f0r_resize(f0r_instance_t instance, unsigned int width, unsigned int height)
+{
+  assert(instance);
+  cairo_imagegrid_instance_t* inst = (cairo_imagegrid_instance_t*)instance;
+  inst->width = width;
+  inst->height = height;
+  inst->x_edge = (int*)realloc(inst->x_edge, (width + 1) * sizeof(int));
+  inst->y_edge = (int*)realloc(inst->y_edge, (height + 1) * sizeof(int));
+  inst->sums = (uint16_t*)realloc(inst->sums, (4 * width + 15) * sizeof(uint16_t));
+  return 1;
+}
@@ -27,26 +27,16 @@
 
 #include <frei0r.hpp>
 
+#include "frei0r_neighbourhood.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define RED(n)  ((n>>16) & 0x000000FF)
 #define GREEN(n) ((n>>8) & 0x000000FF)
 #define BLUE(n)  (n & 0x000000FF)
-#define RGB(r,g,b) ((r<<16) + (g <<8) + (b))
-
-#define BOOST(n) { \
-if((*p = *p<<4)<0)>>n; \
-*(p+1) = (*(p+1)<<4)>>n; \
-*(p+2) = (*(p+2)<<4)>>n; }
-
-/* setup some data to identify the plugin */
-
-typedef struct {
-  int16_t w;
-  int16_t h;
-  uint8_t bpp;
-  uint32_t size;
-} ScreenGeometry;
 
-#define PIXELAT(x1,y1,s) ((s)+(x1)+ yprecal[y1])// (y1)*(geo->w)))
 #define GMERROR(cc1,cc2) ((((RED(cc1)-RED(cc2))*(RED(cc1)-RED(cc2))) +	\
    			((GREEN(cc1)-GREEN(cc2)) *(GREEN(cc1)-GREEN(cc2))) + \
 			((BLUE(cc1)-BLUE(cc2))*(BLUE(cc1)-BLUE(cc2)))))
@@ -58,124 +48,132 @@ public:
   double diffspace;
 
   Cartoon(unsigned int width, unsigned int height) {
-    int c;
     register_param(triplevel, "triplevel", "level of trip: mapped to [0,1] asymptotical");
     register_param(diffspace, "diffspace", "difference space: a value from 0 to 256 (mapped to [0,1])");
 
-    geo = new ScreenGeometry();
-    geo->w = width;
-    geo->h = height;
-    geo->size =  width*height*sizeof(uint32_t);
-
-    if ( geo->size > 0 ) {
-        prePixBuffer = (int32_t*)malloc(geo->size);
-        conBuffer = (int32_t*)malloc(geo->size);
-
-        yprecal = (int*)malloc(geo->h*2*sizeof(int));
-    }
-    for(c=0;c<geo->h*2;c++)
-      yprecal[c] = geo->w*c;
-    for(c=0;c<256;c++) 
-      powprecal[c] = c*c;
-    black = 0xFF000000;
-
     triplevel = 1 - 1 / (1000 + 1);
     diffspace = 1 / 256.;
 
   }
-  
-  ~Cartoon() {
-    if ( geo->size > 0 ) {
-        free(prePixBuffer);
-        free(conBuffer);
-        free(yprecal);
-    }
-    delete geo;
-  }
 
   virtual void update(double time,
                       uint32_t* out,
                       const uint32_t* in) {
     // Cartoonify picture, do a form of edge detect 
-    int x, y, t;
-
     m_diffspace = diffspace * 256;
-
-    for (x=m_diffspace;x<geo->w-(1+m_diffspace);x++) {
-
-      for (y=m_diffspace;y<geo->h-(1+m_diffspace);y++) {
-	
-	t = GetMaxContrast((int32_t*)in,x,y);
-	if (t > 1 / (1 - triplevel) - 1) {
-	  
-	  //  Make a border pixel 
-	  *(out+x+yprecal[y]) = black;
-	  
-	} else {
-	  
-	  //   Copy original color 
-	  *(out+x+yprecal[y]) = *(in+x+yprecal[y]);
-	  FlattenColor((int32_t*)out+x+yprecal[y]);
-	  
-	}
-      }
-    }
+    if (m_diffspace < 0)
+      m_diffspace = 0;
+
+    // A pixel is a border if its contrast t > 1 / (1 - triplevel) - 1;
+    // t is an integer of at most 3 * 255 * 255, so that is t > m_trip.
+    double trip = 1 / (1 - triplevel) - 1;
+    if (!(trip < 3 * 255 * 255))
+      m_trip = 3 * 255 * 255;
+    else if (trip < 0)
+      m_trip = -1;
+    else
+      m_trip = (int)trip;
+
+    m_in = in;
+    m_out = out;
+    if (m_diffspace >= (int)width / 2 || m_diffspace >= (int)height / 2)
+      return;
+    frei0r_neighbourhood_run(in, width, height, 4, m_diffspace, row, this, 0);
   }
 
 private:
-  ScreenGeometry *geo;
-  /* buffer where to copy the screen
-     a pointer to it is being given back by process() */
-  
-  int32_t *prePixBuffer;
-  int32_t *conBuffer;
-  int *yprecal;
-  uint16_t powprecal[256];
-  int32_t black;
+  const uint32_t *m_in;
+  uint32_t *m_out;
   int m_diffspace;
-  
-  void FlattenColor(int32_t *c);
-  long GetMaxContrast(int32_t *src,int x,int y);
-};
+  int m_trip;
 
+  static void row(void* user, const uint8_t* const* rows, int y, void*);
+};
 
-void Cartoon::FlattenColor(int32_t *c) {
-  // (*c) = RGB(40*(RED(*c)/40),40*(GREEN(*c)/40),40*(BLUE(*c)/40)); */
-  uint8_t *p;
-  p = (uint8_t*)c;
-  (*p) = ((*p)>>5)<<5; p++;
-  (*p) = ((*p)>>5)<<5; p++;
-  (*p) = ((*p)>>5)<<5;
+#if defined(__SSE2__)
+/* squared colour distances of the 4 pixels at a and the 4 at b */
+static inline __m128i cartoon_error(const uint32_t* a, const uint32_t* b) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i p = _mm_loadu_si128((const __m128i*)a);
+  __m128i q = _mm_loadu_si128((const __m128i*)b);
+  __m128i e = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(p, q), _mm_subs_epu8(q, p)),
+                            _mm_set1_epi32(0x00FFFFFF));
+  __m128i lo = _mm_unpacklo_epi8(e, zero);
+  __m128i hi = _mm_unpackhi_epi8(e, zero);
+
+  // r*r + g*g and b*b of each pixel, added up
+  lo = _mm_madd_epi16(lo, lo);
+  hi = _mm_madd_epi16(hi, hi);
+  return _mm_add_epi32(
+    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                    _MM_SHUFFLE(2, 0, 2, 0))),
+    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                    _MM_SHUFFLE(3, 1, 3, 1))));
 }
-
-
-
-long Cartoon::GetMaxContrast(int32_t *src,int x,int y) {
-  int32_t c1,c2;
-  long error,max=0;
-  
-  /* Assumes PrePixelModify has been run */
-  c1 = *PIXELAT(x-m_diffspace,y,src);
-  c2 = *PIXELAT(x+m_diffspace,y,src);
-  error = GMERROR(c1,c2);
-  if (error>max) max = error;
-  
-  c1 = *PIXELAT(x,y-m_diffspace,src);
-  c2 = *PIXELAT(x,y+m_diffspace,src);
-  error = GMERROR(c1,c2);
-  if (error>max) max = error;
-  
-  c1 = *PIXELAT(x-m_diffspace,y-m_diffspace,src);
-  c2 = *PIXELAT(x+m_diffspace,y+m_diffspace,src);
-  error = GMERROR(c1,c2);
-  if (error>max) max = error;
-  
-  c1 = *PIXELAT(x+m_diffspace,y-m_diffspace,src);
-  c2 = *PIXELAT(x-m_diffspace,y+m_diffspace,src);
-  error = GMERROR(c1,c2);
-  if (error>max) max = error;
-  
-  return(max);
+#endif
+
+/* Row y, columns d to width-2-d, from rows y-d to y+d. The contrast of a
+   pixel is the largest squared colour distance between opposite pixels d
+   away horizontally, vertically or diagonally; pixels below the trip
+   level keep their colour on 3 bits per channel. */
+void Cartoon::row(void* user, const uint8_t* const* rows, int y, void*) {
+  const Cartoon* c = (const Cartoon*)user;
+  const int d = c->m_diffspace;
+  const int x1 = c->width - 1 - d;
+  const uint32_t black = 0xFF000000;
+
+  if (y < d || y >= (int)c->height - 1 - d)
+    return;
+
+  const uint32_t* up = (const uint32_t*)rows[0];
+  const uint32_t* mid = (const uint32_t*)rows[d];
+  const uint32_t* down = (const uint32_t*)rows[2 * d];
+  uint32_t* dst = c->m_out + (size_t)y * c->width;
+  int x = d;
+
+#if defined(__SSE2__)
+  const __m128i vblack = _mm_set1_epi32((int)black);
+  const __m128i flat = _mm_set1_epi32((int)0xFFE0E0E0);
+  const __m128i trip = _mm_set1_epi32(c->m_trip);
+
+  for (; x + 4 <= x1; x += 4) {
+    __m128i t = cartoon_error(mid + x - d, mid + x + d);
+    __m128i e = cartoon_error(up + x, down + x);
+    __m128i gt = _mm_cmpgt_epi32(e, t);
+    t = _mm_or_si128(_mm_and_si128(gt, e), _mm_andnot_si128(gt, t));
+    e = cartoon_error(up + x - d, down + x + d);
+    gt = _mm_cmpgt_epi32(e, t);
+    t = _mm_or_si128(_mm_and_si128(gt, e), _mm_andnot_si128(gt, t));
+    e = cartoon_error(up + x + d, down + x - d);
+    gt = _mm_cmpgt_epi32(e, t);
+    t = _mm_or_si128(_mm_and_si128(gt, e), _mm_andnot_si128(gt, t));
+
+    __m128i border = _mm_cmpgt_epi32(t, trip);
+    __m128i p = _mm_and_si128(_mm_loadu_si128((const __m128i*)(mid + x)), flat);
+    _mm_storeu_si128((__m128i*)(dst + x),
+                     _mm_or_si128(_mm_and_si128(border, vblack),
+                                  _mm_andnot_si128(border, p)));
+  }
+#endif
+
+  for (; x < x1; x++) {
+    long t = 0, e;
+    e = GMERROR(mid[x - d], mid[x + d]);
+    if (e > t) t = e;
+    e = GMERROR(up[x], down[x]);
+    if (e > t) t = e;
+    e = GMERROR(up[x - d], down[x + d]);
+    if (e > t) t = e;
+    e = GMERROR(up[x + d], down[x - d]);
+    if (e > t) t = e;
+
+    if (t > c->m_trip)
+      //  Make a border pixel 
+      dst[x] = black;
+    else
+      //   Copy original color, flattened
+      dst[x] = mid[x] & 0xFFE0E0E0;
+  }
 }
 
 frei0r::construct<Cartoon> plugin("Cartoon",
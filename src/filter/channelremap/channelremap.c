@@ -0,0 +1,198 @@
+/* channelremap.c
+ * Routes the channels of each pixel: swaps, copies, constants
+ * This file is a Frei0r plugin.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "frei0r.h"
+#include "frei0r_swizzle.h"
+#include "frei0r_thread.h"
+
+typedef struct channelremap_instance
+{
+  unsigned int width;
+  unsigned int height;
+  char map[5];          /* the red, green, blue and alpha sources */
+  frei0r_swizzle_t swizzle;
+} channelremap_instance_t;
+
+typedef struct channelremap_job
+{
+  f0r_instance_t instance;
+  const uint32_t* inframe;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} channelremap_job_t;
+
+static frei0r_swizzle_fn swizzle_row = frei0r_swizzle_row;
+
+int f0r_init()
+{
+  swizzle_row = frei0r_swizzle_select();
+  return 1;
+}
+
+void f0r_deinit()
+{ /* no initialization required */ }
+
+void f0r_get_plugin_info(f0r_plugin_info_t* info)
+{
+  info->name = "Channel remap";
+  info->author = "frei0r";
+  info->plugin_type = F0R_PLUGIN_TYPE_FILTER;
+  info->color_model = F0R_COLOR_MODEL_RGBA8888;
+  info->frei0r_version = FREI0R_MAJOR_VERSION;
+  info->major_version = 0;
+  info->minor_version = 1;
+  info->num_params = 1;
+  info->explanation = "Takes each channel from any channel of the source, or sets it to 0 or full";
+}
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
+void f0r_get_param_info(f0r_param_info_t* info, int param_index)
+{
+  switch(param_index)
+  {
+  case 0:
+    info->name = "Map";
+    info->type = F0R_PARAM_STRING;
+    info->explanation = "Sources of red, green, blue and alpha, four of r, g, b, a, 0 and 1: bgra swaps red and blue, rrr1 shows red as opaque gray, aaa1 shows the alpha";
+    break;
+  }
+}
+
+f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
+{
+  channelremap_instance_t* inst =
+    (channelremap_instance_t*)calloc(1, sizeof(*inst));
+  inst->width = width; inst->height = height;
+  strcpy(inst->map, "rgba");
+  frei0r_swizzle_parse(&inst->swizzle, inst->map);
+  return (f0r_instance_t)inst;
+}
+
+void f0r_destruct(f0r_instance_t instance)
+{
+  free(instance);
+}
+
+void f0r_set_param_value(f0r_instance_t instance,
+                         f0r_param_t param, int param_index)
+{
+  assert(instance);
+  channelremap_instance_t* inst = (channelremap_instance_t*)instance;
+
+  switch(param_index)
+  {
+    char* sval;
+  case 0:
+    /* maps that don't parse leave the current one */
+    sval = (*(char**)param);
+    if (frei0r_swizzle_parse(&inst->swizzle, sval))
+      strcpy(inst->map, sval);
+    break;
+  }
+}
+
+void f0r_get_param_value(f0r_instance_t instance,
+                         f0r_param_t param, int param_index)
+{
+  assert(instance);
+  channelremap_instance_t* inst = (channelremap_instance_t*)instance;
+
+  switch(param_index)
+  {
+  case 0:
+    *((f0r_param_string*)param) = inst->map;
+    break;
+  }
+}
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  channelremap_instance_t* inst = (channelremap_instance_t*)instance;
+  const unsigned long offset = (unsigned long)inst->width * row_begin;
+  unsigned int len = inst->width * (row_end - row_begin);
+
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+  if (frei0r_swizzle_is_identity(&inst->swizzle))
+  {
+    if (outframe != inframe)
+      memcpy(outframe + offset, inframe + offset, len * sizeof(uint32_t));
+    return 1;
+  }
+  swizzle_row(&inst->swizzle, outframe + offset, inframe + offset, len);
+  return 1;
+}
+
+static void* channelremap_rows(void* arg)
+{
+  channelremap_job_t* job = (channelremap_job_t*)arg;
+  f0r_update_slice(job->instance, 0.0, job->inframe, 0, 0, job->outframe,
+                   job->row_begin, job->row_end, 0);
+  return 0;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  channelremap_instance_t* inst = (channelremap_instance_t*)instance;
+  channelremap_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].instance = instance;
+    jobs[i].inframe = inframe;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(channelremap_rows, jobs, sizeof(channelremap_job_t), n);
+}
+
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return frei0r_swizzle_is_identity(
+    &((channelremap_instance_t*)instance)->swizzle);
+}
+
+/* the routing doesn't depend on the size */
+int f0r_resize(f0r_instance_t instance,
+               unsigned int width, unsigned int height)
+{
+  assert(instance);
+  channelremap_instance_t* inst = (channelremap_instance_t*)instance;
+  inst->width = width; inst->height = height;
+  return 1;
+}
@@ -20,14 +20,25 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include <stdio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_thread.h"
 
 #define MAXNUM 40
 
+/* Pixels are assigned in tiles of TILE x TILE. Each tile only compares
+ * its pixels with the clusters that can be the nearest to one of them,
+ * see tile_candidates(). */
+#define TILE 16
+
 struct cluster_center
 {
     int x;
@@ -40,14 +51,14 @@ struct cluster_center
 
 
     /// aggregate color and positions
-    float aggr_r;
-    float aggr_g;
-    float aggr_b;
-    float aggr_x;
-    float aggr_y;
+    uint64_t aggr_r;
+    uint64_t aggr_g;
+    uint64_t aggr_b;
+    uint64_t aggr_x;
+    uint64_t aggr_y;
 
     /// number of pixels in the cluster
-    float numpix;
+    uint64_t numpix;
 };
 
 typedef struct cluster_instance
@@ -60,9 +71,27 @@ typedef struct cluster_instance
     float dist_weight;
     //float color_weight;
 
+    /// whether the cluster colors have been taken from a frame yet
+    int seeded;
+
     struct cluster_center clusters[MAXNUM];
 } cluster_instance_t;
 
+/// pixel sums of the clusters over the tiles of one thread
+typedef struct cluster_sums
+{
+    uint64_t r, g, b, x, y, n;
+} cluster_sums_t;
+
+typedef struct cluster_job
+{
+    const cluster_instance_t* inst;
+    const uint32_t* in;
+    uint32_t* out;
+    unsigned int ty0, ty1; /* rows of tiles */
+    cluster_sums_t sums[MAXNUM];
+} cluster_job_t;
+
 
 int f0r_init()
 {
@@ -80,11 +109,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* inverterInfo)
     inverterInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
     inverterInfo->frei0r_version = FREI0R_MAJOR_VERSION;
     inverterInfo->major_version = 0;
-    inverterInfo->minor_version = 1;
+    inverterInfo->minor_version = 2;
     inverterInfo->num_params =  2;
     inverterInfo->explanation = "Clusters of a source image by color and spatial distance";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+    f0r_get_plugin_info(&info->info);
+    info->capabilities = F0R_CAP_TEMPORAL | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
     switch(param_index)
@@ -109,6 +144,23 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
     }
 }
 
+/* The centers start out spread evenly over the frame, whatever the number
+   of clusters used (a 2D golden ratio sequence), and take the colors of
+   the next frame. */
+static void place_centers(cluster_instance_t* inst)
+{
+    int k;
+    for (k = 0; k < MAXNUM; k++) {
+        struct cluster_center* cc = &inst->clusters[k];
+        double fx = 0.5 + k*0.7548776662466927;
+        double fy = 0.5 + k*0.5698402909980532;
+
+        cc->x = (int)((fx - (int)fx)*inst->width);
+        cc->y = (int)((fy - (int)fy)*inst->height);
+    }
+    inst->seeded = 0;
+}
+
 f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 {
     cluster_instance_t* inst = (cluster_instance_t*)calloc(1, sizeof(*inst));
@@ -119,34 +171,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
     inst->dist_weight = 0.5;
     //inst->color_weight = 1.0;
 
-    int k;
-    for (k = 0; k < MAXNUM; k++) {
-        struct cluster_center* cc = &inst->clusters[k];
-
-        int x = rand()%inst->width;
-        int y = rand()%inst->height;
-
-        cc->x = x;
-        cc->y = y;
-
-/*
-        const unsigned char* src2 = (unsigned char*)(&inframe[x+inst->width*y]);
-
-        inst->clusters[k].r = src2[0];
-        inst->clusters[k].g = src2[1];
-        inst->clusters[k].b = src2[2];
-*/
-        inst->clusters[k].r = rand()%255;
-        inst->clusters[k].g = rand()%255;
-        inst->clusters[k].b = rand()%255;
-
-        cc->numpix = 0;
-        cc->aggr_x = 0;
-        cc->aggr_y = 0;
-        cc->aggr_r = 0;
-        cc->aggr_g = 0;
-        cc->aggr_b = 0;
-    }
+    place_centers(inst);
 
     return (f0r_instance_t)inst;
 }
@@ -156,6 +181,14 @@ void f0r_destruct(f0r_instance_t instance)
     free(instance);
 }
 
+/* The centers move as they follow the frames, they start over. */
+int f0r_reset(f0r_instance_t instance)
+{
+    assert(instance);
+    place_centers((cluster_instance_t*)instance);
+    return 1;
+}
+
 void f0r_set_param_value(f0r_instance_t instance,
                          f0r_param_t param, int param_index)
 {
@@ -224,104 +257,284 @@ void f0r_get_param_value(f0r_instance_t instance,
     }
 }
 
-float find_dist(int r1, int g1, int b1, int x1, int y1,
-                int r2, int g2, int b2, int x2, int y2,
-                float max_space_dist, float dist_weight) //, float color_weight)
+/* Squared distance of pixel and cluster, in the scale of
+ *
+ *   (1 - dist_weight) * color_dist^2 + dist_weight * space_dist^2
+ *
+ * with both distances normalized to 0..1 by the largest color and space
+ * distance. Its square root would be the distance proper, but the
+ * nearest cluster is the same without it. */
+typedef struct cluster_metric
 {
-    /// make this a define?
-    float max_color_dist = sqrtf(255*255*3);
-
-    int dr = r1-r2;
-    int dg = g1-g2;
-    int db = b1-b2;
+    float color; /* (1 - dist_weight) / max_color_dist^2 */
+    float space; /* dist_weight / max_space_dist^2 */
+} cluster_metric_t;
 
-    float color_dist = sqrtf(dr*dr + dg*dg + db*db)/max_color_dist;
+/* the candidates of a tile, structure of arrays padded to a multiple of 4 */
+typedef struct tile_candidates
+{
+    int n;
+    float r[MAXNUM+3], g[MAXNUM+3], b[MAXNUM+3], x[MAXNUM+3], y[MAXNUM+3];
+    int k[MAXNUM+3];
+} tile_candidates_t;
 
-    int dx = x1-x2;
-    int dy = y1-y2;
-    float space_dist = sqrtf(dx*dx + dy*dy)/max_space_dist;
+static inline float sqr_outside(float v, float lo, float hi)
+{
+    float d = v < lo ? lo - v : v > hi ? v - hi : 0;
+    return d*d;
+}
 
-    /// add parameter weighting later
-    //return sqrtf(color_weight*color_dist*color_dist + dist_weight*space_dist*space_dist);
-    return sqrtf((1.0-dist_weight)*color_dist*color_dist + dist_weight*space_dist*space_dist);
+static inline float sqr_farthest(float v, float lo, float hi)
+{
+    float d = v - lo > hi - v ? v - lo : hi - v;
+    return d*d;
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+/* The clusters that may be the nearest one of some pixel of the tile
+ * [x0,x1) x [y0,y1): for each cluster, the distance to the pixels of the
+ * tile lies between a lower bound, from the tile's rectangle and its
+ * range of colors, and an upper bound. A cluster whose lower bound is
+ * above the smallest upper bound is farther from every pixel than that
+ * cluster. */
+static void tile_candidates(tile_candidates_t* tc, const cluster_instance_t* inst,
+                            cluster_metric_t m, const uint32_t* in,
+                            unsigned int x0, unsigned int x1,
+                            unsigned int y0, unsigned int y1)
 {
-    assert(instance);
-    cluster_instance_t* inst = (cluster_instance_t*)instance;
-  
-    unsigned int x,y,k;
- 
-    float max_space_dist = sqrtf(inst->width*inst->width + inst->height*inst->height);
-
-    /*
-    if (inst->has_initted) {
-        inst->has_initted = true;
+    float lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    float lower[MAXNUM], upper = INFINITY;
+    unsigned int x, y, k;
+    int c;
+
+    for (y = y0; y < y1; ++y) {
+        const unsigned char* src = (const unsigned char*)(in + (size_t)inst->width*y);
+        for (x = x0; x < x1; ++x)
+            for (c = 0; c < 3; ++c) {
+                if (src[4*x+c] < lo[c]) lo[c] = src[4*x+c];
+                if (src[4*x+c] > hi[c]) hi[c] = src[4*x+c];
+            }
     }
-    */
-
-    for (y=0; y < inst->height; ++y) {
-        for (x=0; x < inst->width; ++x) {
-
-            const unsigned char* src2 = (unsigned char*)( &inframe[x+inst->width*y]);
-            unsigned char* dst2 = (unsigned char*)(&outframe[x+inst->width*y]);
 
-            float dist = max_space_dist;
-            int dist_ind = 0;
+    for (k = 0; k < inst->num; ++k) {
+        const struct cluster_center* cc = &inst->clusters[k];
+        float col_lo = sqr_outside(cc->r, lo[0], hi[0]) + sqr_outside(cc->g, lo[1], hi[1])
+            + sqr_outside(cc->b, lo[2], hi[2]);
+        float col_hi = sqr_farthest(cc->r, lo[0], hi[0]) + sqr_farthest(cc->g, lo[1], hi[1])
+            + sqr_farthest(cc->b, lo[2], hi[2]);
+        float spc_lo = sqr_outside(cc->x, x0, x1 - 1) + sqr_outside(cc->y, y0, y1 - 1);
+        float spc_hi = sqr_farthest(cc->x, x0, x1 - 1) + sqr_farthest(cc->y, y0, y1 - 1);
+        float u = m.color*col_hi + m.space*spc_hi;
+
+        lower[k] = m.color*col_lo + m.space*spc_lo;
+        if (u < upper)
+            upper = u;
+    }
 
-            for (k = 0; k < inst->num; k++) {
-                struct cluster_center *cc = &inst->clusters[k];
+    /* a little slack for the rounding of the bounds */
+    upper += upper*1e-5f + 1e-30f;
+    tc->n = 0;
+    for (k = 0; k < inst->num; ++k)
+        if (lower[k] <= upper) {
+            const struct cluster_center* cc = &inst->clusters[k];
+            tc->r[tc->n] = cc->r;
+            tc->g[tc->n] = cc->g;
+            tc->b[tc->n] = cc->b;
+            tc->x[tc->n] = cc->x;
+            tc->y[tc->n] = cc->y;
+            tc->k[tc->n] = k;
+            tc->n++;
+        }
+    /* padded with the last candidate, which never wins a tie with itself */
+    for (c = tc->n; c % 4; ++c) {
+        tc->r[c] = tc->r[c-1];
+        tc->g[c] = tc->g[c-1];
+        tc->b[c] = tc->b[c-1];
+        tc->x[c] = tc->x[c-1];
+        tc->y[c] = tc->y[c-1];
+        tc->k[c] = tc->k[c-1];
+    }
+}
 
-                float kdist = find_dist(src2[0], src2[1], src2[2], x,y, 
-                    cc->r, cc->g, cc->b, cc->x, cc->y,
-                    max_space_dist, inst->dist_weight); //, inst->color_weight);
+/* the nearest candidate, the first one of equally near ones */
+static inline int nearest(const tile_candidates_t* tc, cluster_metric_t m,
+                          float r, float g, float b, float x, float y)
+{
+    int j;
+#if defined(__SSE2__)
+    __m128 pr = _mm_set1_ps(r), pg = _mm_set1_ps(g), pb = _mm_set1_ps(b);
+    __m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y);
+    __m128 mc = _mm_set1_ps(m.color), ms = _mm_set1_ps(m.space);
+    __m128 best = _mm_set1_ps(INFINITY);
+    __m128i besti = _mm_setzero_si128();
+    float d[4];
+    int i[4], l, bl;
+
+    for (j = 0; j < tc->n; j += 4) {
+        __m128 dr = _mm_sub_ps(pr, _mm_loadu_ps(tc->r + j));
+        __m128 dg = _mm_sub_ps(pg, _mm_loadu_ps(tc->g + j));
+        __m128 db = _mm_sub_ps(pb, _mm_loadu_ps(tc->b + j));
+        __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(tc->x + j));
+        __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(tc->y + j));
+        __m128 col = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+                                _mm_mul_ps(db, db));
+        __m128 spc = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 dist = _mm_add_ps(_mm_mul_ps(mc, col), _mm_mul_ps(ms, spc));
+        __m128i nearer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+
+        best = _mm_min_ps(dist, best);
+        besti = _mm_or_si128(_mm_and_si128(nearer, _mm_set1_epi32(j)),
+                             _mm_andnot_si128(nearer, besti));
+    }
+    _mm_storeu_ps(d, best);
+    _mm_storeu_si128((__m128i*)i, besti);
+    /* lane l holds candidates l, l+4, ... */
+    bl = 0;
+    for (l = 1; l < 4; ++l)
+        if (d[l] < d[bl] || (d[l] == d[bl] && i[l] + l < i[bl] + bl))
+            bl = l;
+    return tc->k[i[bl] + bl];
+#else
+    float best = INFINITY;
+    int bj = 0;
+
+    for (j = 0; j < tc->n; ++j) {
+        float dr = r - tc->r[j], dg = g - tc->g[j], db = b - tc->b[j];
+        float dx = x - tc->x[j], dy = y - tc->y[j];
+        float dist = m.color*(dr*dr + dg*dg + db*db) + m.space*(dx*dx + dy*dy);
+
+        if (dist < best) {
+            best = dist;
+            bj = j;
+        }
+    }
+    return tc->k[bj];
+#endif
+}
 
-                if (kdist < dist) {
-                    dist = kdist;
-                    dist_ind = k;
+static void* cluster_tiles(void* arg)
+{
+    cluster_job_t* job = (cluster_job_t*)arg;
+    const cluster_instance_t* inst = job->inst;
+    const unsigned int width = inst->width, height = inst->height;
+    float max_color_dist = 255*255*3;
+    float max_space_dist = (float)width*width + (float)height*height;
+    cluster_metric_t m;
+    tile_candidates_t tc;
+    unsigned int tx, ty, x, y, x1, y1;
+
+    m.color = (1.0 - inst->dist_weight)/max_color_dist;
+    m.space = inst->dist_weight/max_space_dist;
+    memset(job->sums, 0, sizeof(job->sums));
+
+    for (ty = job->ty0; ty < job->ty1; ++ty) {
+        y1 = (ty + 1)*TILE < height ? (ty + 1)*TILE : height;
+        for (tx = 0; tx*TILE < width; ++tx) {
+            x1 = (tx + 1)*TILE < width ? (tx + 1)*TILE : width;
+            tile_candidates(&tc, inst, m, job->in, tx*TILE, x1, ty*TILE, y1);
+
+            for (y = ty*TILE; y < y1; ++y) {
+                for (x = tx*TILE; x < x1; ++x) {
+                    const unsigned char* src2 = (const unsigned char*)(&job->in[x+width*y]);
+                    unsigned char* dst2 = (unsigned char*)(&job->out[x+width*y]);
+                    int k = tc.n == 1 ? tc.k[0]
+                        : nearest(&tc, m, src2[0], src2[1], src2[2], x, y);
+                    const struct cluster_center* cc = &inst->clusters[k];
+                    cluster_sums_t* s = &job->sums[k];
+
+                    s->x += x;
+                    s->y += y;
+                    s->r += src2[0];
+                    s->g += src2[1];
+                    s->b += src2[2];
+                    s->n++;
+
+                    dst2[0] = cc->r;
+                    dst2[1] = cc->g;
+                    dst2[2] = cc->b;
+                    dst2[3] = src2[3];
                 }
             }
+        }
+    }
+    return 0;
+}
 
-            struct cluster_center* cc = &inst->clusters[dist_ind];
-            cc->aggr_x += x;
-            cc->aggr_y += y;
-            cc->aggr_r += src2[0];
-            cc->aggr_g += src2[1];
-            cc->aggr_b += src2[2];
-            cc->numpix += 1.0;
-
-            dst2[0] = cc->r;
-            dst2[1] = cc->g;
-            dst2[2] = cc->b;
-            dst2[3] = src2[3];
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+    assert(instance);
+    cluster_instance_t* inst = (cluster_instance_t*)instance;
+    cluster_job_t* jobs;
+    unsigned int x, y, k;
+    unsigned int tiles_y = (inst->height + TILE - 1)/TILE;
+    int i, n = frei0r_thread_count((long)inst->width*inst->height);
+
+    if (!inst->seeded) {
+        for (k = 0; k < MAXNUM; k++) {
+            struct cluster_center* cc = &inst->clusters[k];
+            const unsigned char* src2 = (const unsigned char*)(&inframe[cc->x+inst->width*cc->y]);
+
+            cc->r = src2[0];
+            cc->g = src2[1];
+            cc->b = src2[2];
         }
+        inst->seeded = 1;
+    }
+
+    if (inst->num == 0) {
+        /* no clusters to update, everything is the color of the first one */
+        const struct cluster_center* cc = &inst->clusters[0];
+        for (y = 0; y < inst->height; ++y)
+            for (x = 0; x < inst->width; ++x) {
+                const unsigned char* src2 = (const unsigned char*)(&inframe[x+inst->width*y]);
+                unsigned char* dst2 = (unsigned char*)(&outframe[x+inst->width*y]);
+                dst2[0] = cc->r;
+                dst2[1] = cc->g;
+                dst2[2] = cc->b;
+                dst2[3] = src2[3];
+            }
+        return;
+    }
+
+    jobs = (cluster_job_t*)malloc(n*sizeof(cluster_job_t));
+    if (!jobs)
+        return;
+    for (i = 0; i < n; i++) {
+        jobs[i].inst = inst;
+        jobs[i].in = inframe;
+        jobs[i].out = outframe;
+        jobs[i].ty0 = tiles_y*i/n;
+        jobs[i].ty1 = tiles_y*(i+1)/n;
     }
+    frei0r_thread_run(cluster_tiles, jobs, sizeof(cluster_job_t), n);
 
     /// update cluster_centers
     for (k = 0; k < inst->num; k++) {
 
         struct cluster_center* cc = &inst->clusters[k];
 
+        cc->numpix = 0;
+        cc->aggr_x = 0;
+        cc->aggr_y = 0;
+        cc->aggr_r = 0;
+        cc->aggr_g = 0;
+        cc->aggr_b = 0;
+        for (i = 0; i < n; i++) {
+            cc->numpix += jobs[i].sums[k].n;
+            cc->aggr_x += jobs[i].sums[k].x;
+            cc->aggr_y += jobs[i].sums[k].y;
+            cc->aggr_r += jobs[i].sums[k].r;
+            cc->aggr_g += jobs[i].sums[k].g;
+            cc->aggr_b += jobs[i].sums[k].b;
+        }
+
         if (cc->numpix > 0) {
             cc->x = (int)  (cc->aggr_x/cc->numpix);
             cc->y = (int)  (cc->aggr_y/cc->numpix);
             cc->r = (unsigned char) (cc->aggr_r/cc->numpix);
             cc->g = (unsigned char) (cc->aggr_g/cc->numpix);
             cc->b = (unsigned char) (cc->aggr_b/cc->numpix);
-
-            //printf("%d, %d %d %d\t", k, (unsigned int)cc->r, (unsigned int)cc->g, (unsigned int)cc->b);
-            //printf("%g, %g %g %g\n", cc->numpix, cc->aggr_r, cc->aggr_g, cc->aggr_b);
         }
-
-        cc->numpix = 0;
-        cc->aggr_x = 0;
-        cc->aggr_y = 0;
-        cc->aggr_r = 0;
-        cc->aggr_g = 0;
-        cc->aggr_b = 0;
     }
-    //printf("\n");
+    free(jobs);
 }
-
@@ -89,6 +89,7 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_thread.h"
 
 enum ParamIndex {
 	NEUTRAL_COLOR,
@@ -426,7 +427,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t *colordistance_info)
 	colordistance_info->color_model = F0R_COLOR_MODEL_RGBA8888;
 	colordistance_info->frei0r_version = FREI0R_MAJOR_VERSION;
 	colordistance_info->major_version = 0;
-	colordistance_info->minor_version = 1;
+	colordistance_info->minor_version = 2;
 	colordistance_info->num_params = 2;
 	colordistance_info->explanation = "Do simple color correction, in a physically meaningful way";
 }
@@ -506,22 +507,36 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 	}
 }
 
-void f0r_update(f0r_instance_t instance, double time, const uint32_t *inframe, uint32_t *outframe)
+typedef struct colgate_job
 {
-	assert(instance);
-	colgate_instance_t *inst = (colgate_instance_t *)instance;
-	unsigned len = inst->width * inst->height;
-	unsigned char *dst = (unsigned char *)outframe;
-	const unsigned char *src = (unsigned char *)inframe;
-	unsigned i;
+	const colgate_instance_t *inst;
+	const uint32_t *src;
+	uint32_t *dst;
+	unsigned i0, i1;
+} colgate_job_t;
+
+// Pixels i0 to i1 of the job.
+static void *colgate_pixels(void *arg)
+{
+	colgate_job_t *job = (colgate_job_t *)arg;
+	const colgate_instance_t *inst = job->inst;
+	const uint32_t *src = job->src;
+	uint32_t *dst = job->dst;
+	unsigned i, end = job->i1;
 
 #ifdef __SSE2__
 	__m128i zero = _mm_setzero_si128();
 	__m128i max = _mm_set1_epi16(REVERSE_LUT_SIZE - 1);
-	for (i = 0; i < len; ++i) {
-		__m128i l1 = inst->premult_r[*src++];
-		__m128i l2 = inst->premult_g[*src++];
-		__m128i l3 = inst->premult_b[*src++];
+
+	const unsigned char *bs = (const unsigned char *)(src + job->i0);
+	unsigned char *bd = (unsigned char *)(dst + job->i0);
+
+	// The bytes of a pixel are loaded one by one; taking them apart
+	// from one 32-bit load measured a lot slower.
+	for (i = job->i0; i < end; ++i) {
+		__m128i l1 = inst->premult_r[*bs++];
+		__m128i l2 = inst->premult_g[*bs++];
+		__m128i l3 = inst->premult_b[*bs++];
 		__m128i result = _mm_add_epi32(l3, _mm_add_epi32(l1, l2));
 
 		// Shift into the right range, and then clamp to [min, max].
@@ -537,25 +552,47 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t *inframe, u
 		result = _mm_srli_si128(result, 4);
 		unsigned new_b = _mm_cvtsi128_si32(result);
 
-		*dst++ = linear_rgb_to_srgb_lut[new_rg & 0xffff];
-		*dst++ = linear_rgb_to_srgb_lut[new_rg >> 16];
-		*dst++ = linear_rgb_to_srgb_lut[new_b];
-		*dst++ = *src++;  // Copy alpha.
+		*bd++ = linear_rgb_to_srgb_lut[new_rg & 0xffff];
+		*bd++ = linear_rgb_to_srgb_lut[new_rg >> 16];
+		*bd++ = linear_rgb_to_srgb_lut[new_b];
+		*bd++ = *bs++;  // Copy alpha.
 	}
 #else
-	for (i = 0; i < len; ++i) {
-		unsigned old_r = *src++;
-		unsigned old_g = *src++;
-		unsigned old_b = *src++;
+	const unsigned char *bs = (const unsigned char *)(src + job->i0);
+	unsigned char *bd = (unsigned char *)(dst + job->i0);
+
+	for (i = job->i0; i < end; ++i) {
+		unsigned old_r = *bs++;
+		unsigned old_g = *bs++;
+		unsigned old_b = *bs++;
 
 		int new_r = inst->premult_r[old_r][0] + inst->premult_g[old_g][0] + inst->premult_b[old_b][0];
 		int new_g = inst->premult_r[old_r][1] + inst->premult_g[old_g][1] + inst->premult_b[old_b][1];
 		int new_b = inst->premult_r[old_r][2] + inst->premult_g[old_g][2] + inst->premult_b[old_b][2];
 
-		*dst++ = convert_linear_rgb_to_srgb_fp(new_r);
-		*dst++ = convert_linear_rgb_to_srgb_fp(new_g);
-		*dst++ = convert_linear_rgb_to_srgb_fp(new_b);
-		*dst++ = *src++;  // Copy alpha.
+		*bd++ = convert_linear_rgb_to_srgb_fp(new_r);
+		*bd++ = convert_linear_rgb_to_srgb_fp(new_g);
+		*bd++ = convert_linear_rgb_to_srgb_fp(new_b);
+		*bd++ = *bs++;  // Copy alpha.
 	}
 #endif
+	return 0;
+}
+
+void f0r_update(f0r_instance_t instance, double time, const uint32_t *inframe, uint32_t *outframe)
+{
+	assert(instance);
+	colgate_instance_t *inst = (colgate_instance_t *)instance;
+	unsigned len = inst->width * inst->height;
+	colgate_job_t jobs[FREI0R_MAX_THREADS];
+	int i, n = frei0r_thread_count(len);
+
+	for (i = 0; i < n; ++i) {
+		jobs[i].inst = inst;
+		jobs[i].src = inframe;
+		jobs[i].dst = outframe;
+		jobs[i].i0 = (unsigned)((unsigned long)len * i / n);
+		jobs[i].i1 = (unsigned)((unsigned long)len * (i + 1) / n);
+	}
+	frei0r_thread_run(colgate_pixels, jobs, sizeof(colgate_job_t), n);
 }
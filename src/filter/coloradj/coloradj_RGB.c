@@ -33,6 +33,8 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 #include <assert.h>
 
 #include <frei0r.h>
+#include "frei0r_lut.h"
+#include "frei0r_thread.h"
 
 //------------------------------------------------------
 //computes x to the power p
@@ -241,13 +243,8 @@ uint32_t r,g,b,a;
 
 if (ac==0)
 	{
-	for (i=0;i<size;i++)
-		{
-		outframe[i] = lut->r[inframe[i]&255];
-		outframe[i] = outframe[i] + ((lut->g[(inframe[i]>>8)&255])<<8);
-		outframe[i] = outframe[i] + ((lut->b[(inframe[i]>>16)&255])<<16);
-		outframe[i] = outframe[i] + (inframe[i]&0xFF000000);
-		}
+	//r, g and b are the three tables of frei0r_lut_rgb3
+	frei0r_lut_rgb3((const uint8_t (*)[256])lut->r,outframe,inframe,size);
 	}
 else		//alpha controlled
 	{
@@ -257,8 +254,7 @@ else		//alpha controlled
 		r = (255-a)*(inframe[i]&255) + a*lut->r[inframe[i]&255];
 		g = (255-a)*((inframe[i]>>8)&255) + a*lut->g[(inframe[i]>>8)&255];
 		b = (255-a)*((inframe[i]>>16)&255) + a*lut->b[(inframe[i]>>16)&255];
-		outframe[i] = r/255 + ((g/255)<<8) + ((b/255)<<16);
-		outframe[i] = outframe[i] + (inframe[i]&0xFF000000);
+		outframe[i] = r/255 + ((g/255)<<8) + ((b/255)<<16) + (a<<24);
 		}
 	}
 }
@@ -291,6 +287,14 @@ int cm;
 lut_s *lut;
 } inst;
 
+typedef struct
+{
+inst *in;
+const uint32_t *inframe;
+uint32_t *outframe;
+int y0,y1;
+} job_s;
+
 //***********************************************
 // OBVEZNE FREI0R FUNKCIJE
 
@@ -320,6 +324,12 @@ info->num_params=7;
 info->explanation="Simple color adjustment";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+f0r_get_plugin_info(&info->info);
+info->capabilities=F0R_CAP_REENTRANT|F0R_CAP_INPLACE|F0R_CAP_SLICE;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -496,15 +506,53 @@ switch(param_index)
 }
 
 //-------------------------------------------------
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
 inst *in;
+long o;
 
 assert(instance);
 in=(inst*)instance;
+if (row_begin>row_end || row_end>(unsigned int)in->h) return 0;
+
+o=(long)in->w*row_begin;
+apply_lut(inframe+o,outframe+o,in->w*(row_end-row_begin), in->lut, in->ac);
+return 1;
+}
 
-apply_lut(inframe,outframe,in->w*in->h, in->lut, in->ac);
+//-------------------------------------------------
+static void *coloradj_rows(void *arg)
+{
+job_s *job=(job_s*)arg;
+
+f0r_update_slice(job->in,0.0,job->inframe,0,0,job->outframe,job->y0,job->y1,0);
+return 0;
+}
+
+//-------------------------------------------------
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+inst *in;
+job_s jobs[FREI0R_MAX_THREADS];
+int i,n;
 
+assert(instance);
+in=(inst*)instance;
+
+n=frei0r_thread_count((long)in->w*in->h);
+for (i=0;i<n;i++)
+	{
+	jobs[i].in=in;
+	jobs[i].inframe=inframe;
+	jobs[i].outframe=outframe;
+	jobs[i].y0=in->h*i/n;
+	jobs[i].y1=in->h*(i+1)/n;
+	}
+frei0r_thread_run(coloradj_rows,jobs,sizeof(job_s),n);
 }
 
 //**********************************************************
@@ -20,10 +20,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
-#include <stdio.h>
 
 #include "frei0r.h"
-#include "frei0r_math.h"
+#include "frei0r_key.h"
 
 typedef struct colordistance_instance
 {
@@ -53,6 +52,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* colordistance_info)
 	colordistance_info->explanation = "Calculates the distance between the selected color and the current pixel and uses that value as new pixel value";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch(param_index)
@@ -109,44 +114,32 @@ void f0r_get_param_value(f0r_instance_t instance,
 
 }
 
-#if defined(_MSC_VER)
-__inline const int rint(float x){
-	return (int)(x+0.5);
+int f0r_update_slice(f0r_instance_t instance, double time,
+		const uint32_t* inframe, const uint32_t* inframe2,
+		const uint32_t* inframe3, uint32_t* outframe,
+		unsigned int row_begin, unsigned int row_end,
+		unsigned int thread_index)
+{
+	assert(instance);
+	colordistance_instance_t* inst = (colordistance_instance_t*)instance;
+	if (row_begin > row_end || row_end > inst->height)
+		return 0;
+
+	unsigned int len = inst->width * (row_end - row_begin);
+	inframe += inst->width * row_begin;
+	outframe += inst->width * row_begin;
+
+	/* Hint 0.705724361914764 == 255.0 / sqrt( (255)**2 + (255)**2 + (255)*2 ) */
+	frei0r_key_gray_row(inst->color.r * 255.0, inst->color.g * 255.0,
+			inst->color.b * 255.0, 0.705724361914764, outframe, inframe, len);
+	return 1;
 }
-#endif
 
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
 	assert(instance);
 	colordistance_instance_t* inst = (colordistance_instance_t*)instance;
-	unsigned int len = inst->width * inst->height;
-
-
-	unsigned char* dst = (unsigned char*)outframe;
-	const unsigned char* src = (unsigned char*)inframe;
-
-	float r1 = inst->color.r * 255.0;
-	float g1 = inst->color.g * 255.0;
-	float b1 = inst->color.b * 255.0;
-	float r2, g2, b2;
-	int l;
-	while (len--) {
-		r2 = *src++;
-		g2 = *src++;
-		b2 = *src++;
-		l = (int)rint( sqrtf( powf( r1 - r2, 2 ) + powf( g1 - g2, 2 ) + powf( b1 - b2, 2 ) ) * 0.705724361914764  );
-		/* Hint 0.35320727852735 == 255.0 / sqrt( (255)**2 + (255)**2 + (255)*2 )*/
-		if ( r1 < 0 || r1 > 255 ||  g1 < 0 || g1 > 255 ||  b1 < 0 || b1	> 255 || r2 < 0 || r2 > 255 ||  g2 < 0 || g2 > 255 || b2 < 0 || b2 > 255 ) {
-			printf ("%f %f %f\n", r2, g2, b2 );
-		}
-
-
-		*dst++ = (unsigned char) (l);
-		*dst++ = (unsigned char) (l);
-		*dst++ = (unsigned char) (l);
-
-		*dst++ = *src++;  // copy alpha
-	}
+	f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+			0, inst->height, 0);
 }
-
@@ -28,9 +28,27 @@
 #include <math.h>
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_thread.h"
 
 double PI=3.14159265358979;
 
+/*
+ * The dots of a channel sit on a grid of cells of gridSize in screen space,
+ * the image rotated by the screen angle. A dot only depends on the input
+ * pixel under the centre of its cell, so its radius is worked out once per
+ * cell into a table, which the pixels then look up. Tracking where a pixel
+ * is in its cell as x steps along a row takes two additions, and a pixel
+ * is inside, outside or on the antialiased edge of a dot by comparing its
+ * squared distance to the centre with the squared radii: the square root
+ * is only taken on the edge.
+ */
+typedef struct halftone_cell
+{
+  double l;       // dot radius
+  double inner;   // (l - 1)^2, inside it the dot is solid, -1 if l < 1
+  double outer;   // l^2, outside it the dot doesn't reach
+} halftone_cell_t;
+
 typedef struct colorhalftone_instance
 {
   unsigned int width;
@@ -39,6 +57,8 @@ typedef struct colorhalftone_instance
   double cyan_angle;
   double magenta_angle;
   double yellow_angle;
+  halftone_cell_t* cells;  // dot radii of the cells of the three screens
+  size_t cells_size;
 } colorhalftone_instance_t;
 
 static inline double degreeToRadian(double degree)
@@ -47,16 +67,6 @@ static inline double degreeToRadian(double degree)
 	return radian;
 }
 
-static inline double modjhlabs(double a, double b) 
-{
-		int n = (int)(a/b);
-		
-		a -= n*b;
-		if (a < 0)
-			return a + b;
-		return a;
-}
-
 static inline double smoothStep(double a, double b, double x) 
 {
 		if (x < a)
@@ -66,6 +76,154 @@ static inline double smoothStep(double a, double b, double x)
 		x = (x - a) / (b - a);
 		return x*x * (3 - 2*x);
 }
+
+typedef struct halftone_screen
+{
+  double sin_val, cos_val;
+  int kx0, ky0;          // the first cell
+  int nkx, nky;          // cells across and down
+  halftone_cell_t* cells;
+} halftone_screen_t;
+
+typedef struct halftone_job
+{
+  const colorhalftone_instance_t* inst;
+  const halftone_screen_t* screens;
+  double gridSize;
+  const uint32_t* src;
+  uint32_t* dst;
+  int y0, y1;            // rows, or rows of cells of every screen
+} halftone_job_t;
+
+/* the cell whose centre is nearest to screen coordinate t, and t relative
+   to that centre in [-gridSize/2, gridSize/2) */
+static inline int halftone_cell_of(double t, double gridSize, double* u)
+{
+  int k = (int)floor(t / gridSize + 0.5);
+
+  *u = t - k * gridSize;
+  return k;
+}
+
+static void* halftone_sample(void* arg)
+{
+  halftone_job_t* job = (halftone_job_t*)arg;
+  int width = job->inst->width;
+  int height = job->inst->height;
+  double halfGridSize = job->gridSize / 2;
+  int channel, kx, ky;
+
+  for (channel = 0; channel < 3; channel++)
+  {
+    const halftone_screen_t* s = &job->screens[channel];
+    int shift = 16-8*channel;
+    int ky1 = job->y1 < s->nky ? job->y1 : s->nky;
+
+    for (ky = job->y0; ky < ky1; ky++)
+    {
+      halftone_cell_t* cell = s->cells + (long)ky * s->nkx;
+      double tty = (s->ky0 + ky) * job->gridSize;
+
+      for (kx = 0; kx < s->nkx; kx++, cell++)
+      {
+        double ttx = (s->kx0 + kx) * job->gridSize;
+        // Transform back into image space
+        double ntx = ttx*s->cos_val - tty*s->sin_val;
+        double nty = ttx*s->sin_val + tty*s->cos_val;
+        // Clamp to the image
+        int nx = CLAMP( (int)ntx, 0, width - 1);
+        int ny = CLAMP( (int)nty, 0, height - 1);
+        int nr = (job->src[ny*width+nx] >> shift) & 0xff;
+        double l = nr/255.0f;
+
+        l = 1-l*l;
+        l *= halfGridSize * 1.414;
+        cell->l = l;
+        cell->inner = l < 1 ? -1 : (l - 1) * (l - 1);
+        cell->outer = l * l;
+      }
+    }
+  }
+  return 0;
+}
+
+/* how far the dot of cell reaches past a pixel at squared distance r2
+   from its centre, into d; 1 if that is a pixel or more */
+static inline int halftone_reach(const halftone_cell_t* cell, double r2,
+                                 double* d)
+{
+  if (r2 >= cell->outer)
+    return 0;
+  if (r2 <= cell->inner)
+    return 1;
+  r2 = cell->l - sqrt(r2);
+  if (r2 > *d)
+    *d = r2;
+  return 0;
+}
+
+static void* halftone_render(void* arg)
+{
+  halftone_job_t* job = (halftone_job_t*)arg;
+  int width = job->inst->width;
+  double gridSize = job->gridSize;
+  double halfGridSize = gridSize / 2;
+  int x, y, channel;
+
+  for (y = job->y0; y < job->y1; y++)
+  {
+    const uint32_t* src = job->src + (long)y * width;
+    uint32_t* dst = job->dst + (long)y * width;
+
+    for (x = 0; x < width; x++)
+      dst[x] = src[x] | 0x00ffffff;
+
+    for (channel = 0; channel < 3; channel++)
+    {
+      const halftone_screen_t* s = &job->screens[channel];
+      int shift = 16-8*channel;
+      uint32_t mask = 0x000000ffu << shift;
+      double u, w;
+      // Transform 0,y into halftone screen coordinate space
+      int kx = halftone_cell_of(y*s->sin_val, gridSize, &u);
+      int ky = halftone_cell_of(y*s->cos_val, gridSize, &w);
+
+      for (x = 0; x < width; x++)
+      {
+        const halftone_cell_t* cell;
+        double du, dw, d = 0;
+        int hit;
+
+        if (x)
+        {
+          // Step to x,y, and into the next cell if it leaves this one
+          u += s->cos_val;
+          w -= s->sin_val;
+          if (u >= halfGridSize) { u -= gridSize; kx++; }
+          else if (u < -halfGridSize) { u += gridSize; kx--; }
+          if (w >= halfGridSize) { w -= gridSize; ky++; }
+          else if (w < -halfGridSize) { w += gridSize; ky--; }
+        }
+
+        // Dots overlap into the neighbouring cells, but only those of the
+        // cells next to the half of this one the pixel is in can reach it
+        cell = s->cells + (long)(ky - s->ky0) * s->nkx + (kx - s->kx0);
+        du = u < 0 ? u + gridSize : u - gridSize;
+        dw = w < 0 ? w + gridSize : w - gridSize;
+        hit = halftone_reach(cell, u*u + w*w, &d)
+          || halftone_reach(cell + (u < 0 ? -1 : 1), du*du + w*w, &d)
+          || halftone_reach(cell + (w < 0 ? -s->nkx : s->nkx), u*u + dw*dw, &d);
+
+        if (hit)
+          dst[x] &= ~mask;
+        else if (d > 0)
+          dst[x] &= ((uint32_t)(int)(255 * (1 - smoothStep(0, 1, d))) << shift) | ~mask;
+      }
+    }
+  }
+  return 0;
+}
+
 void color_halftone(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
@@ -76,83 +234,84 @@ void color_halftone(f0r_instance_t instance, double time,
 
   double dotRadius = inst->dot_radius * 9.99;
   dotRadius = ceil(dotRadius);
+  if (dotRadius < 1)
+    dotRadius = 1;
   double cyanScreenAngle = degreeToRadian(inst->cyan_angle * 360.0);
   double magentaScreenAngle = degreeToRadian(inst->magenta_angle * 360.0);
   double yellowScreenAngle = degreeToRadian(inst->yellow_angle * 360.0);
 
   double gridSize = 2 * dotRadius * 1.414f;
   double angles[] = {cyanScreenAngle, magentaScreenAngle, yellowScreenAngle};
-  double mx[] = {0, -1, 1,  0, 0};
-  double my[] = {0, 0, 0, -1, 1};
-  double halfGridSize = (double)gridSize / 2;
+  halftone_screen_t screens[3];
+  halftone_job_t jobs[FREI0R_MAX_THREADS];
+  size_t cells = 0;
+  int channel, i, c, nky = 0;
+  int n = frei0r_thread_count((long)width * height);
 
-  const uint32_t* inPixels = (const uint32_t*)inframe;
-  uint32_t* dst = outframe;
-  int x, y, channel, v, nr, shift, mask, i, nx,  argb, ny;
-
-  double angle, sin_val, cos_val, tx, ty , ttx, tty, ntx, nty, l, dx , dy , dx2 , dy2 , R , f, f2;
-
-  for (y = 0; y < height; y++)
+  for (channel = 0; channel < 3; channel++)
   {
+    halftone_screen_t* s = &screens[channel];
+    int corners[4][2] = {{0, 0}, {width - 1, 0}, {0, height - 1},
+                         {width - 1, height - 1}};
+    int k0[2] = {0, 0}, k1[2] = {0, 0};
+    double u;
 
-    for (channel = 0; channel < 3; channel++ )
+    s->sin_val = sin(angles[channel]);
+    s->cos_val = cos(angles[channel]);
+    // The cells the frame covers in screen space, and their neighbours
+    for (c = 0; c < 4; c++)
     {
-      shift = 16-8*channel;
-      mask = 0x000000ff << shift;
-      angle = angles[channel];
-      sin_val = sin(angle);
-      cos_val = cos(angle);
-
-      for (x = 0; x < width; x++)
-      {
-        // Transform x,y into halftone screen coordinate space
-        tx = x*cos_val + y*sin_val;
-        ty = -x*sin_val + y*cos_val;
-        
-        // Find the nearest grid point
-        tx = tx - modjhlabs(tx-halfGridSize, gridSize) + halfGridSize;
-        ty = ty - modjhlabs(ty-halfGridSize, gridSize) + halfGridSize;
-
-        f = 1;
-
-        // TODO: Efficiency warning: Because the dots overlap, we need to check neighbouring grid squares.
-        // We check all four neighbours, but in practice only one can ever overlap any given point.
-        for (i = 0; i < 5; i++) 
-        {
-          // Find neigbouring grid point
-          ttx = tx + mx[i]*gridSize;
-          tty = ty + my[i]*gridSize;
-          // Transform back into image space
-          ntx = ttx*cos_val - tty*sin_val;
-          nty = ttx*sin_val + tty*cos_val;
-          // Clamp to the image
-          nx = CLAMP( (int)ntx, 0, width - 1);
-          ny = CLAMP( (int)nty, 0, height - 1);
-          argb = inPixels[ny*width+nx];
-          nr = (argb >> shift) & 0xff;
-          l = nr/255.0f;
-          l = 1-l*l;
-          l *= halfGridSize * 1.414;
-          dx = x - ntx;
-          dy = y - nty;
-          dx2 = dx * dx;
-          dy2 = dy * dy;
-          R = sqrt(dx2 + dy2);
-          f2 = 1 - smoothStep(R, R+1, l);
-          f = MIN(f, f2);
-        }
+      double x = corners[c][0], y = corners[c][1];
+      int kx = halftone_cell_of(x*s->cos_val + y*s->sin_val, gridSize, &u);
+      int ky = halftone_cell_of(-x*s->sin_val + y*s->cos_val, gridSize, &u);
 
-        v = (int)(255 * f);
-        v <<= shift;
-        v ^= ~mask;
-				v |= 0xff000000;
-        *dst++ &= v;
-      }
-      if (channel != 2)
-        dst = dst - width;// we're starting row again for next channel, unless this was last channel
+      if (c == 0 || kx < k0[0]) k0[0] = kx;
+      if (c == 0 || kx > k1[0]) k1[0] = kx;
+      if (c == 0 || ky < k0[1]) k0[1] = ky;
+      if (c == 0 || ky > k1[1]) k1[1] = ky;
     }
+    // one more for pixels that a rounding puts past the last cell
+    s->kx0 = k0[0] - 2;
+    s->ky0 = k0[1] - 2;
+    s->nkx = k1[0] - k0[0] + 5;
+    s->nky = k1[1] - k0[1] + 5;
+    cells += (size_t)s->nkx * s->nky;
+    if (s->nky > nky)
+      nky = s->nky;
+  }
+
+  if (cells > inst->cells_size)
+  {
+    free(inst->cells);
+    inst->cells = (halftone_cell_t*)malloc(cells * sizeof(halftone_cell_t));
+    inst->cells_size = inst->cells ? cells : 0;
+    if (!inst->cells)
+      return;
+  }
+  screens[0].cells = inst->cells;
+  for (channel = 1; channel < 3; channel++)
+    screens[channel].cells = screens[channel - 1].cells
+      + (size_t)screens[channel - 1].nkx * screens[channel - 1].nky;
 
+  // The cells first, then the pixels, as the pixels of a band read cells
+  // that sample rows of other bands, and outframe may be inframe
+  for (i = 0; i < n; i++)
+  {
+    jobs[i].inst = inst;
+    jobs[i].screens = screens;
+    jobs[i].gridSize = gridSize;
+    jobs[i].src = inframe;
+    jobs[i].dst = outframe;
+    jobs[i].y0 = nky * i / n;
+    jobs[i].y1 = nky * (i + 1) / n;
+  }
+  frei0r_thread_run(halftone_sample, jobs, sizeof(halftone_job_t), n);
+  for (i = 0; i < n; i++)
+  {
+    jobs[i].y0 = height * i / n;
+    jobs[i].y1 = height * (i + 1) / n;
   }
+  frei0r_thread_run(halftone_render, jobs, sizeof(halftone_job_t), n);
 }
 
 int f0r_init()
@@ -171,7 +330,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* colorhalftoneInfo)
   colorhalftoneInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
   colorhalftoneInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   colorhalftoneInfo->major_version = 0; 
-  colorhalftoneInfo->minor_version = 9; 
+  colorhalftoneInfo->minor_version = 10; 
   colorhalftoneInfo->num_params =  4; 
   colorhalftoneInfo->explanation = "Filters image to resemble a halftone print in which tones are represented as variable sized dots";
 }
@@ -216,6 +375,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  colorhalftone_instance_t* inst = (colorhalftone_instance_t*)instance;
+  free(inst->cells);
   free(instance);
 }
 
@@ -33,6 +33,7 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_lut.h"
 
 #define GIMP_RGB_LUMINANCE_RED    (0.2126)
 #define GIMP_RGB_LUMINANCE_GREEN  (0.7152)
@@ -49,6 +50,8 @@ typedef struct colorize_instance
   double hue;
   double saturation;
   double lightness;
+  /* the color of each luma, see update_palette() */
+  uint32_t palette[256];
 } colorize_instance_t;
 
 typedef struct _GimpRGB  GimpRGB;
@@ -118,6 +121,43 @@ gimp_hsl_to_rgb (const GimpHSL *hsl,
   rgb->a = hsl->a;
 }
 
+/* The output only depends on the luma of a pixel, so the colors of all
+   256 lumas are computed once per parameter change; updates look them
+   up by the luma of frei0r_lut_luma(). */
+static void update_palette(colorize_instance_t* inst)
+{
+  GimpHSL hsl;
+  GimpRGB rgb;
+  double lightness = inst->lightness - 0.5;
+  double lum;
+  int i;
+
+  hsl.h = inst->hue;
+  hsl.s = inst->saturation;
+  hsl.a = 1.0;
+  for (i = 0; i < 256; ++i)
+  {
+    lum = i / 255.0;
+
+    if (lightness > 0)
+    {
+      lum = lum * (1.0 - lightness);
+      lum += 1.0 - (1.0 - lightness);
+    }
+    else if (lightness < 0)
+    {
+      lum = lum * (lightness + 1.0);
+    }
+
+    hsl.l = lum;
+    gimp_hsl_to_rgb (&hsl, &rgb);
+
+    inst->palette[i] = (uint32_t)(unsigned char) (rgb.r * 255.0)
+      | (uint32_t)(unsigned char) (rgb.g * 255.0) << 8
+      | (uint32_t)(unsigned char) (rgb.b * 255.0) << 16;
+  }
+}
+
 
 int f0r_init()
 {
@@ -140,6 +180,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* colorize_info)
   colorize_info->explanation = "Colorizes image to selected hue, saturation and lightness";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -170,6 +216,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	inst->hue = 0.5;
 	inst->saturation = 0.5;
 	inst->lightness = 0.5;
+	update_palette(inst);
 	return (f0r_instance_t)inst;
 }
 
@@ -196,6 +243,7 @@ void f0r_set_param_value(f0r_instance_t instance,
     inst->lightness = *((double*)param);
     break;
   }
+  update_palette(inst);
 }
 
 void f0r_get_param_value(f0r_instance_t instance,
@@ -223,44 +271,18 @@ void f0r_update(f0r_instance_t instance, double time,
 {
   assert(instance);
   colorize_instance_t* inst = (colorize_instance_t*)instance;
+  static const frei0r_luma_t rec709 = FREI0R_LUMA_REC709;
   unsigned int len = inst->width * inst->height;
-  
-  GimpHSL hsl;
-  GimpRGB rgb;
+  unsigned int n;
+  uint8_t luma[FREI0R_LUT_CHUNK];
 
-  hsl.h = inst->hue;
-  hsl.s = inst->saturation;
-
-  double lightness = inst->lightness - 0.5;
-
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  double lum, r, g, b = 0;
-  while (len--)
+  while (len)
   {
-    r = *src++ / 255.0;
-    g = *src++ / 255.0;
-    b = *src++ / 255.0;
-
-    lum = GIMP_RGB_LUMINANCE (r, g, b);
-
-    if (lightness > 0)
-    {
-      lum = lum * (1.0 - lightness);
-      lum += 1.0 - (1.0 - lightness);
-    }
-    else if (lightness < 0)
-    {
-      lum = lum * (lightness + 1.0);
-    }
-
-    hsl.l = lum;
-    gimp_hsl_to_rgb (&hsl, &rgb);
-
-    *dst++ = (unsigned char) (rgb.r * 255.0);
-    *dst++ = (unsigned char) (rgb.g * 255.0);
-    *dst++ = (unsigned char) (rgb.b * 255.0);
-    *dst++ = *src++;//copy alpha
+    n = len < FREI0R_LUT_CHUNK ? len : FREI0R_LUT_CHUNK;
+    frei0r_lut_luma(luma, inframe, n, &rec709);
+    frei0r_lut_palette(inst->palette, outframe, luma, inframe, n);
+    inframe += n;
+    outframe += n;
+    len -= n;
   }
 }
-
@@ -26,6 +26,8 @@
 #include <stdio.h>
 #include <string.h>
 #include "frei0r.h"
+#include "frei0r_lut.h"
+#include "frei0r_thread.h"
 
 
 /*
@@ -300,8 +302,62 @@ typedef struct colortap_instance
   unsigned int width;
   unsigned int height;
   char *table;//accepted values: "xpro","sepia","heat","red_green","old_photo","xray","esses","yellow_blue", default "xpro"
+  uint8_t lut[3][256]; // the red, green and blue columns of the table
 } colortap_instance_t;
 
+typedef struct colortap_job
+{
+  f0r_instance_t instance;
+  const uint32_t* inframe;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} colortap_job_t;
+
+// Looks the table up by name and splits it into the tables of the colors,
+// once per parameter change rather than per frame.
+static void select_table(colortap_instance_t* inst)
+{
+  const uint8_t* table;
+  int i, c;
+
+  if (strcmp(inst->table, "sepia")==0)
+  {
+    table = sepia_table;
+  }
+  else if (strcmp(inst->table, "heat")==0)
+  {
+    table = heat_table;
+  }
+  else if (strcmp(inst->table, "red_green")==0)
+  {
+    table = red_green_table;
+  }
+  else if (strcmp(inst->table, "old_photo")==0)
+  {
+    table = old_photo_table;
+  }
+  else if (strcmp(inst->table, "xray")==0)
+  {
+    table = xray_table;
+  }
+  else if (strcmp(inst->table, "esses")==0)
+  {
+    table = esses_table;
+  }
+  else if (strcmp(inst->table, "yellow_blue")==0)
+  {
+    table = yellowblue_table;
+  }
+  else
+  {
+    table = xpro_table;
+  }
+
+  for (i = 0; i < 256; ++i)
+    for (c = 0; c < 3; ++c)
+      inst->lut[c][i] = table[i * 3 + c];
+}
+
 int f0r_init()
 {
   return 1;
@@ -323,6 +379,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* colortapInfo)
   colortapInfo->explanation = "Applies a pre-made color effect to image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -343,11 +405,14 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	const char* sval = "esses";
 	inst->table = (char*)malloc( strlen(sval) + 1 );
 	strcpy( inst->table, sval );
+  select_table(inst);
   return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  colortap_instance_t* inst = (colortap_instance_t*)instance;
+  free(inst->table);
   free(instance);
 }
 
@@ -362,6 +427,7 @@ void f0r_set_param_value(f0r_instance_t instance,
 			char* sval = (*(char**)param);
 			inst->table = (char*)realloc( inst->table, strlen(sval) + 1 );
 			strcpy( inst->table, sval );
+			select_table(inst);
 			break;
     }
   }
@@ -381,63 +447,47 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  colortap_instance_t* inst = (colortap_instance_t*)instance;
+  const unsigned long offset = (unsigned long)inst->width * row_begin;
+
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+  frei0r_lut_rgb3((const uint8_t (*)[256])inst->lut, outframe + offset,
+                  inframe + offset, inst->width * (row_end - row_begin));
+  return 1;
+}
+
+static void* colortap_rows(void* arg)
+{
+  colortap_job_t* job = (colortap_job_t*)arg;
+  f0r_update_slice(job->instance, 0.0, job->inframe, 0, 0, job->outframe,
+                   job->row_begin, job->row_end, 0);
+  return 0;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
   // Check and cast instance
   assert(instance);
   colortap_instance_t* inst = (colortap_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
-
-  const uint8_t* table;
-  if (strcmp(inst->table, "sepia")==0)
-  {
-    table = sepia_table;
-  }
-  else if (strcmp(inst->table, "heat")==0)
-  {
-    table = heat_table;
-  }
-  else if (strcmp(inst->table, "red_green")==0)
-  {
-    table = red_green_table;
-  }
-  else if (strcmp(inst->table, "old_photo")==0)
-  {
-    table = old_photo_table;
-  }
-  else if (strcmp(inst->table, "xray")==0)
-  {
-    table = xray_table;
-  }
-  else if (strcmp(inst->table, "esses")==0)
-  {
-    table = esses_table;
-  }
-  else if (strcmp(inst->table, "yellow_blue")==0)
-  {
-    table = yellowblue_table;
-  }
-  else
-  {
-    table = xpro_table;
-  }
-
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  unsigned char r,g, b = 0;
+  colortap_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
 
-  while (len--)
+  for (i = 0; i < n; ++i)
   {
-    r = *src++;
-    g = *src++;
-    b = *src++;
-
-    *dst++ = table[r * 3];
-    *dst++ = table[g * 3 + 1];
-    *dst++ = table[b * 3 + 2];
-    *dst++ = *src++;
+    jobs[i].instance = instance;
+    jobs[i].inframe = inframe;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
   }
+  frei0r_thread_run(colortap_rows, jobs, sizeof(colortap_job_t), n);
 }
-
-
@@ -19,10 +19,12 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include <stdio.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_grade.h"
 
 typedef struct contrast0r_instance
 {
@@ -30,18 +32,14 @@ typedef struct contrast0r_instance
   unsigned int height;
   int contrast; /* the contrast [-256, 256] */
   unsigned char lut[256]; /* look-up table */
+  int identity; /* the look-up table changes nothing */
 } contrast0r_instance_t;
 
 /* Updates the look-up-table. */
 void update_lut(contrast0r_instance_t *inst)
 {
-  int i;
-  unsigned char *lut = inst->lut;
-  int contrast = inst->contrast;
-  for (i=0; i<128; ++i)
-    lut[i] = CLAMP0255(i - (((128 - i)*contrast)>>8));
-  for (i=128; i<256; ++i)
-    lut[i] = CLAMP0255(i + (((i - 128)*contrast)>>8));
+  frei0r_grade_contrast_lut(inst->lut, inst->contrast);
+  inst->identity = frei0r_grade_lut_is_identity(inst->lut);
 }
 
 int f0r_init()
@@ -65,6 +63,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* contrast0r_info)
   contrast0r_info->explanation = "Adjusts the contrast of a source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -125,12 +130,27 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   contrast0r_instance_t* inst = (contrast0r_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  unsigned int len = inst->width * (row_end - row_begin);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
+
+  if (inst->identity)
+  {
+    if (outframe != inframe)
+      memcpy(outframe, inframe, len * sizeof(uint32_t));
+    return 1;
+  }
   
   unsigned char* lut = inst->lut;
   unsigned char* dst = (unsigned char*)outframe;
@@ -142,5 +162,20 @@ void f0r_update(f0r_instance_t instance, double time,
     *dst++ = lut[*src++];
     *dst++ = *src++; // copy alpha
   }
+  return 1;
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  contrast0r_instance_t* inst = (contrast0r_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
+
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return ((contrast0r_instance_t*)instance)->identity;
+}
@@ -29,6 +29,7 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_overlay.h"
 
 #define MAX3(a, b, c) ( ( a > b && a > c) ? a : (b > c ? b : c) )
 #define MIN3(a, b, c) ( ( a < b && a < c) ? a : (b < c ? b : c) )
@@ -68,8 +69,24 @@ typedef struct curves_instance
   double *bsplineMap;
   double *csplineMap;
   float *curveMap;
+  double sortedPoints[10];
+  int mapIsDirty;
+  uint32_t *graph;   // the graph overlay, scale x scale, see frei0r_overlay.h
+  int graphIsDirty;  // the map changed since the graph was drawn
+
+  // tables derived from the map, rebuilt together with it
+  unsigned char lut[256];
+  unsigned char lumaLut[256][256]; // by luma, then channel value
+  int hueSector[361];              // mapped hue
+  int hueFrac[361];
+  int satFix[256];                 // mapped saturation
+  unsigned char grey[256][3];      // saturation mode result for r = g = b
 } curves_instance_t;
 
+// fixed point precision of the hue and saturation modes
+#define FRAC_BITS 15
+#define FRAC_ONE (1 << FRAC_BITS)
+
 
 // color conversion functions taken from:
 // http://www.cs.rit.edu/~ncs/color/t_convert.html
@@ -198,6 +215,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* curves_info)
   curves_info->explanation = "Adjust luminance or color channel intensity with curve level mapping";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE;
+}
+
 char *get_param_name(int param_index) {
   return param_names[param_index];
 }
@@ -258,6 +281,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->bsplineMap = malloc(sizeof(double));
   inst->csplineMap = malloc(sizeof(double));
   inst->curveMap = malloc(sizeof(float));
+  inst->mapIsDirty = 1;
   inst->points[0] = 0;
   inst->points[1] = 0;
   inst->points[2] = 1;
@@ -278,6 +302,7 @@ void f0r_destruct(f0r_instance_t instance)
   free(((curves_instance_t*)instance)->bsplineMap);
   free(((curves_instance_t*)instance)->csplineMap);
   free(((curves_instance_t*)instance)->curveMap);
+  free(((curves_instance_t*)instance)->graph);
   free(instance);
 }
 
@@ -299,38 +324,37 @@ void f0r_set_param_value(f0r_instance_t instance,
               if (tmp == 3) {
                   if (inst->channel != CHANNEL_LUMA) {
                     inst->channel = CHANNEL_LUMA;
-                    if (strlen(inst->bspline))
-                        updateBsplineMap(instance);
-                    else
-                        updateCsplineMap(instance);
+                    inst->mapIsDirty = 1;
                   }
               } else {
                   if ((int)inst->channel != (int)tmp) {
                     inst->channel = (enum CHANNELS)((int)tmp);
-                    if (strlen(inst->bspline))
-                        updateBsplineMap(instance);
-                    else
-                        updateCsplineMap(instance);
+                    inst->mapIsDirty = 1;
                   }
               }
           } else {
               if ((int)inst->channel != (int)(tmp * 10)) {
                 inst->channel = (enum CHANNELS)(tmp * 10);
-                if (strlen(inst->bspline))
-                    updateBsplineMap(instance);
-                else
-                    updateCsplineMap(instance);
+                inst->mapIsDirty = 1;
               }
           }
 	  break;
 	case 1:
-	  inst->drawCurves =  *((f0r_param_double *)param);
+	  tmp = *((f0r_param_double *)param);
+	  if (inst->drawCurves != tmp) {
+	      inst->drawCurves = tmp;
+	      inst->mapIsDirty = 1;
+	  }
 	  break;
 	case 2:
 	  inst->curvesPosition =  floor(*((f0r_param_double *)param) * 10);
 	  break;
 	case 3:
-	  inst->pointNumber = floor(*((f0r_param_double *)param) * 10);
+	  tmp = floor(*((f0r_param_double *)param) * 10);
+	  if (inst->pointNumber != tmp) {
+	      inst->pointNumber = tmp;
+	      inst->mapIsDirty = 1;
+	  }
 	  break;
         case 4:
           inst->formula = *((f0r_param_double *)param);
@@ -340,13 +364,16 @@ void f0r_set_param_value(f0r_instance_t instance,
           if (strcmp(inst->bspline, bspline) != 0) {
               free(inst->bspline);
               inst->bspline = strdup(bspline);
-              updateBsplineMap(instance);
+              inst->mapIsDirty = 1;
           }
           break;
 	default:
     if (param_index > 5){
-        inst->points[param_index - 6] = *((f0r_param_double *)param); //Assigning value to curve point
-      updateCsplineMap(instance);
+        tmp = *((f0r_param_double *)param);
+        if (inst->points[param_index - 6] != tmp) {
+            inst->points[param_index - 6] = tmp; //Assigning value to curve point
+            inst->mapIsDirty = 1;
+        }
     }
 
 	  break;
@@ -666,7 +693,8 @@ void updateBsplineMap(f0r_instance_t instance)
             c = 1;
         }
         step = 1 / (double)c;
-        position curve[c];
+        // t = 0, step, ..., 1 gives up to c + 1 points
+        position curve[c + 1];
         while (t <= 1) {
             curve[pn++] = pointOnBezier(t, p);
             t += step;
@@ -753,8 +781,11 @@ void updateCsplineMap(f0r_instance_t instance)
         else
             inst->csplineMap[j] = CLAMP0255(ROUND(y * 255));
     }
+    if (inst->pointNumber <= 5)
+        memcpy(inst->sortedPoints, points, inst->pointNumber * 2 * sizeof(double));
     if (inst->drawCurves) {
         int scale = inst->height / 2;
+        free(inst->curveMap);
         inst->curveMap = malloc(scale * sizeof(float));
         for(i = 0; i < scale; i++)
             inst->curveMap[i] = spline((float)i / scale, points, (size_t)inst->pointNumber, coeffs) * scale;
@@ -764,6 +795,181 @@ void updateCsplineMap(f0r_instance_t instance)
     free(points);
 }
 
+/**
+ * Updates the tables used by f0r_update from \param map, so that the pixels
+ * can be processed without per-pixel floating point math.
+ */
+void updateLuts(f0r_instance_t instance, double *map)
+{
+    assert(instance);
+    curves_instance_t* inst = (curves_instance_t*)instance;
+    double rf, gf, bf;
+
+    switch ((int)inst->channel) {
+    case CHANNEL_LUMA:
+        for (int l = 0; l < 256; ++l)
+            for (int c = 0; c < 256; ++c)
+                inst->lumaLut[l][c] = l == 0 ? map[0] : CLAMP0255((int)(c * map[l]));
+        break;
+    case CHANNEL_HUE:
+        for (int j = 0; j < 361; ++j) {
+            double h = map[j] / 60;
+            int i = (int)h;
+            // 360 degrees is the same hue as 0
+            if (i >= 6)
+                h = i = 0;
+            inst->hueSector[j] = i;
+            inst->hueFrac[j] = ROUND((h - i) * FRAC_ONE);
+        }
+        break;
+    case CHANNEL_SATURATION:
+        for (int j = 0; j < 256; ++j)
+            inst->satFix[j] = ROUND(map[j] * FRAC_ONE);
+        // grey pixels have no hue, HSVtoRGB treats it as -1
+        for (int v = 0; v < 256; ++v) {
+            HSVtoRGB(&rf, &gf, &bf, -1, map[0], v / 255.);
+            inst->grey[v][0] = rf * 255;
+            inst->grey[v][1] = gf * 255;
+            inst->grey[v][2] = bf * 255;
+        }
+        break;
+    default:
+        for (int j = 0; j < 256; ++j)
+            inst->lut[j] = map[j];
+        break;
+    }
+}
+
+/**
+ * Rounded luma of r, g, b as computed in double precision, using integer
+ * weights. Only values exactly halfway between two integers depend on the
+ * rounding of the double weights, those are computed like before.
+ */
+static inline int lumaIndex(int r, int g, int b, int rec709)
+{
+    if (rec709) {
+        int l = 2126 * r + 7152 * g + 722 * b;
+        if (l % 10000 != 5000)
+            return (l + 5000) / 10000;
+        return ROUND(.2126 * r + .7152 * g + .0722 * b);
+    } else {
+        int l = 299 * r + 587 * g + 114 * b;
+        if (l % 1000 != 500)
+            return (l + 500) / 1000;
+        return ROUND(.299 * r + .587 * g + .114 * b);
+    }
+}
+
+/**
+ * Hue of r, g, b in units of 1/delta of a 60 degree sector, in [0, 6 * delta).
+ */
+static inline int hueSectors(int r, int g, int b, int max, int delta)
+{
+    int h;
+    if (r == max)
+        h = g - b;
+    else if (g == max)
+        h = 2 * delta + b - r;
+    else
+        h = 4 * delta + r - g;
+    return h < 0 ? h + 6 * delta : h;
+}
+
+/**
+ * HSVtoRGB for v = max / 255, writing 8 bit values to dst. \param d is
+ * v * s * 255 and \param f the fraction of the sector, both in FRAC_BITS
+ * fixed point.
+ */
+static inline void sectorToRGB(unsigned char *dst, int sector, int f,
+                               int max, int d)
+{
+    const int64_t one2 = (int64_t)FRAC_ONE * FRAC_ONE;
+    int min = max - ((d + FRAC_ONE - 1) >> FRAC_BITS);
+    int q = max - (int)(((int64_t)d * f + one2 - 1) >> (2 * FRAC_BITS));
+    int t = max - (int)(((int64_t)d * (FRAC_ONE - f) + one2 - 1) >> (2 * FRAC_BITS));
+
+    switch (sector) {
+    case 0: dst[0] = max; dst[1] = t;   dst[2] = min; break;
+    case 1: dst[0] = q;   dst[1] = max; dst[2] = min; break;
+    case 2: dst[0] = min; dst[1] = max; dst[2] = t;   break;
+    case 3: dst[0] = min; dst[1] = q;   dst[2] = max; break;
+    case 4: dst[0] = t;   dst[1] = min; dst[2] = max; break;
+    default: dst[0] = max; dst[1] = min; dst[2] = q;  break;
+    }
+}
+
+/**
+ * Draws the graph of the curve into the overlay tile, which is put over
+ * each frame until the map changes again.
+ */
+static void drawGraph(curves_instance_t* inst)
+{
+  int i;
+  int scale = inst->height / 2;
+  double *points = inst->sortedPoints;
+  uint32_t *graph;
+  unsigned char color[] = {0, 0, 0};
+  if (inst->channel == CHANNEL_RED || inst->channel == CHANNEL_GREEN || inst->channel == CHANNEL_BLUE)
+	color[(int)inst->channel] = 255;
+  uint32_t paint = FREI0R_OVERLAY_PAINT(color[0] | color[1] << 8 | color[2] << 16);
+  int maxYvalue = scale - 1;
+  if (!inst->graph)
+	inst->graph = (uint32_t*)malloc(scale * scale * sizeof(uint32_t));
+  graph = inst->graph;
+  float lineWidth = scale / 254.;
+  int cellSize = floor(lineWidth * 32);
+  //filling up background and drawing grid
+  for(i = 0; i < scale; i++) {
+	uint32_t *row = graph + (maxYvalue - i) * scale;
+	for(int j = 0; j < scale; j++)
+	  //point doesn't aly on the grid
+	  row[j] = i % cellSize > lineWidth && j % cellSize > lineWidth ? FREI0R_OVERLAY_TINT : FREI0R_OVERLAY_KEEP;
+  }
+  float doubleLineWidth = 4 * lineWidth;
+  //drawing points on the graph
+  for(i = 0; i < inst->pointNumber; i++) {
+	int pointOffset = i * 2;
+	int xPoint = points[pointOffset++] * maxYvalue;
+	int yPoint = points[pointOffset] * maxYvalue;
+	for(int x = (int)floor(xPoint - doubleLineWidth); x <= xPoint + doubleLineWidth; x++) {
+	  if (x >= 0 && x < scale) {
+		for(int y = (int)floor(yPoint - doubleLineWidth); y <= yPoint + doubleLineWidth; y++) {
+		  if (y >= 0 && y < scale)
+			graph[(maxYvalue - y) * scale + x] = paint;
+		}
+	  }
+	}
+  }
+  //drawing curve on the graph
+  float halfLineWidth = lineWidth * .5;
+  float prevY = 0;
+  for(int j = 0; j < scale; j++) {
+	float y = inst->curveMap[j];
+	if (j == 0 || y == prevY) {
+	  for(i = (int)floor(y - halfLineWidth); i <= ceil(y + halfLineWidth); i++) {
+		int clampedI = i < 0?0:i >= scale?scale - 1:i;
+		graph[(maxYvalue - clampedI) * scale + j] = paint;
+	  }
+	} else {
+	  int factor = prevY > y?-1:1;
+	  float gap = halfLineWidth * factor;
+	  //medium value between previous value and current value
+	  float mid = (y - prevY) * .5 + prevY;
+	  //drawing line from previous value to mid point
+	  for(i = ROUND(prevY - gap); factor * i < factor * (mid + gap); i += factor) {
+		int clampedI = i < 0?0:i >= scale?scale - 1:i;
+		graph[(maxYvalue - clampedI) * scale + j - 1] = paint;
+	  }
+		//drawing line from mid point to current value
+	  for(i = ROUND(mid - gap); factor * i < factor * ceil(y + gap); i += factor) {
+		int clampedI = i < 0?0:i >= scale?scale - 1:i;
+		graph[(maxYvalue - clampedI) * scale + j] = paint;
+	  }
+	}
+	prevY = y;
+  }
+}
+
 void f0r_update(f0r_instance_t instance, double time,
                 const uint32_t* inframe, uint32_t* outframe)
 {
@@ -774,215 +980,134 @@ void f0r_update(f0r_instance_t instance, double time,
   unsigned char* dst = (unsigned char*)outframe;
   const unsigned char* src = (unsigned char*)inframe;
 
-  int i = 0;
-  double *map = NULL;
   int scale = inst->height / 2;
-  double *points = NULL;
-  if (strlen(inst->bspline) == 0) {
-      points = (double*)calloc(inst->pointNumber * 2, sizeof(double));
-      i = inst->pointNumber * 2;
-      //copy point values
-      while(--i > 0)
-          points[i] = inst->points[i];
-      //sort point values by X component
-      for(i = 1; i < inst->pointNumber; i++)
-          for(int j = i; j > 0 && points[j * 2] < points[(j - 1) * 2]; j--)
-              swap(points, j, j - 1);
-
-      map = inst->csplineMap;
-  } else {
-      map = inst->bsplineMap;
+  if (inst->mapIsDirty) {
+      if (strlen(inst->bspline) == 0) {
+          updateCsplineMap(instance);
+          updateLuts(instance, inst->csplineMap);
+      } else {
+          updateBsplineMap(instance);
+          updateLuts(instance, inst->bsplineMap);
+      }
+      inst->mapIsDirty = 0;
+      inst->graphIsDirty = 1;
   }
+  const unsigned char *lut = inst->lut;
 
-  int r, g, b, luma;
-  double factorR, factorG, factorB, lumaValue;
-  double rf, gf, bf, hue, sat, val;
+  int r, g, b, max, delta, formula = inst->formula != 0;
 
   switch ((int)inst->channel) {
   case CHANNEL_RGB:
       while (len--) {
-          *dst++ = map[*src++];        // r
-          *dst++ = map[*src++];        // g
-          *dst++ = map[*src++];        // b
+          *dst++ = lut[*src++];        // r
+          *dst++ = lut[*src++];        // g
+          *dst++ = lut[*src++];        // b
           *dst++ = *src++;              // a
       }
       break;
   case CHANNEL_RED:
-      memcpy(outframe, inframe, len*sizeof(uint32_t));
+      if (outframe != inframe)
+          memcpy(outframe, inframe, len*sizeof(uint32_t));
       while (len--) {
-          *dst = map[*dst];
+          *dst = lut[*dst];
           dst += 4;
       }
       break;
   case CHANNEL_GREEN:
-      memcpy(outframe, inframe, len*sizeof(uint32_t));
+      if (outframe != inframe)
+          memcpy(outframe, inframe, len*sizeof(uint32_t));
       dst += 1;
       while (len--) {
-          *dst = map[*dst];
+          *dst = lut[*dst];
           dst += 4;
       }
       break;
   case CHANNEL_BLUE:
-      memcpy(outframe, inframe, len*sizeof(uint32_t));
+      if (outframe != inframe)
+          memcpy(outframe, inframe, len*sizeof(uint32_t));
       dst += 2;
       while (len--) {
-          *dst = map[*dst];
+          *dst = lut[*dst];
           dst += 4;
       }
       break;
   case CHANNEL_ALPHA:
-      memcpy(outframe, inframe, len*sizeof(uint32_t));
+      if (outframe != inframe)
+          memcpy(outframe, inframe, len*sizeof(uint32_t));
       dst += 3;
       while (len--) {
-          *dst = map[*dst];
+          *dst = lut[*dst];
           dst += 4;
       }
       break;
   case CHANNEL_LUMA:
-      if (inst->formula) {      // Rec.709
-          factorR = .2126;
-          factorG = .7152;
-          factorB = .0722;
-      } else {                  // Rec. 601
-          factorR = .299;
-          factorG = .587;
-          factorB = .114;
-      }
       while (len--) {
           r = *src++;
           g = *src++;
           b = *src++;
-          luma = ROUND(factorR * r + factorG * g + factorB * b);
-          lumaValue = map[luma];
-          if (luma == 0) {
-              *dst++ = lumaValue;
-              *dst++ = lumaValue;
-              *dst++ = lumaValue;
-          } else {
-              *dst++ = CLAMP0255((int)(r * lumaValue));
-              *dst++ = CLAMP0255((int)(g * lumaValue));
-              *dst++ = CLAMP0255((int)(b * lumaValue));
-          }
+          const unsigned char *l = inst->lumaLut[lumaIndex(r, g, b, formula)];
+          *dst++ = l[r];
+          *dst++ = l[g];
+          *dst++ = l[b];
           *dst++ = *src++;
       }
       break;
   case CHANNEL_HUE:
       while (len--) {
-          rf = *src++;
-          gf = *src++;
-          bf = *src++;
-          RGBtoHSV(rf, gf, bf, &hue, &sat, &val);
-          if (hue != -1) {
-              HSVtoRGB(&rf, &gf, &bf, map[(int)hue], sat, val);
-              *dst++ = rf * 255;
-              *dst++ = gf * 255;
-              *dst++ = bf * 255;
+          r = src[0];
+          g = src[1];
+          b = src[2];
+          max = MAX3(r, g, b);
+          delta = max - MIN3(r, g, b);
+          if (delta == 0) {
+              dst[0] = r;
+              dst[1] = g;
+              dst[2] = b;
           } else {
-              *dst++ = rf;
-              *dst++ = gf;
-              *dst++ = bf;
+              // the hue in degrees indexes the map
+              int j = hueSectors(r, g, b, max, delta) * 60 / delta;
+              sectorToRGB(dst, inst->hueSector[j], inst->hueFrac[j],
+                          max, delta << FRAC_BITS);
           }
-          *dst++ = *src++;
+          dst[3] = src[3];
+          src += 4;
+          dst += 4;
       }
       break;
   case CHANNEL_SATURATION:
       while (len--) {
-          rf = *src++;
-          gf = *src++;
-          bf = *src++;
-          RGBtoHSV(rf, gf, bf, &hue, &sat, &val);
-          HSVtoRGB(&rf, &gf, &bf, hue, map[(int)(sat * 255)], val);
-          *dst++ = rf * 255;
-          *dst++ = gf * 255;
-          *dst++ = bf * 255;
-          *dst++ = *src++;
+          r = src[0];
+          g = src[1];
+          b = src[2];
+          max = MAX3(r, g, b);
+          delta = max - MIN3(r, g, b);
+          if (delta == 0) {
+              dst[0] = inst->grey[max][0];
+              dst[1] = inst->grey[max][1];
+              dst[2] = inst->grey[max][2];
+          } else {
+              int h = hueSectors(r, g, b, max, delta);
+              int sector = h / delta;
+              int f = ((h - sector * delta) << FRAC_BITS) / delta;
+              sectorToRGB(dst, sector, f,
+                          max, max * inst->satFix[255 * delta / max]);
+          }
+          dst[3] = src[3];
+          src += 4;
+          dst += 4;
       }
   }
 
 
   if (inst->drawCurves && !strlen(inst->bspline)) {
-	unsigned char color[] = {0, 0, 0};
-	if (inst->channel == CHANNEL_RED || inst->channel == CHANNEL_GREEN || inst->channel == CHANNEL_BLUE)
-	  color[(int)inst->channel] = 255;
 	//calculating graph offset by given position values
 	int graphXOffset = inst->curvesPosition == POS_TOP_LEFT || inst->curvesPosition == POS_BOTTOM_LEFT?0:inst->width - scale;
 	int graphYOffset = inst->curvesPosition == POS_TOP_LEFT || inst->curvesPosition == POS_TOP_RIGHT?0:inst->height - scale;
-	int maxYvalue = scale - 1;
-	int stride = inst->width;
-	dst = (unsigned char*)outframe;
-	float lineWidth = scale / 254.;
-	int cellSize = floor(lineWidth * 32);
-	//filling up background and drawing grid
-	for(i = 0; i < scale; i++) {
-	  if (i % cellSize > lineWidth) //point doesn't aly on the grid
-		for(int j = 0; j < scale; j++) {
-		  if (j % cellSize > lineWidth) { //point doesn't aly on the grid
-			int offset = ((maxYvalue - i + graphYOffset) * stride + j + graphXOffset) * 4;
-			dst[offset] = (dst[offset] >> 1) + 0x7F;
-			offset++;
-			dst[offset] = (dst[offset] >> 1) + 0x7F;
-			offset++;
-			dst[offset] = (dst[offset] >> 1) + 0x7F;
-			offset++;
-		  }
-		}
-	}
-	float doubleLineWidth = 4 * lineWidth;
-	//drawing points on the graph
-	for(i = 0; i < inst->pointNumber; i++) {
-	  int pointOffset = i * 2;
-	  int xPoint = points[pointOffset++] * maxYvalue;
-	  int yPoint = points[pointOffset] * maxYvalue;
-	  for(int x = (int)floor(xPoint - doubleLineWidth); x <= xPoint + doubleLineWidth; x++) {
-		if (x >= 0 && x < scale) {
-		  for(int y = (int)floor(yPoint - doubleLineWidth); y <= yPoint + doubleLineWidth; y++) {
-			if (y >= 0 && y < scale) {
-			  int offset = ((maxYvalue - y + graphYOffset) * stride + x + graphXOffset) * 4;
-			  dst[offset++] = color[0];
-			  dst[offset++] = color[1];
-			  dst[offset++] = color[2];
-			}
-		  }
-		}
-	  }
-	}
-	free(points);
-	//drawing curve on the graph
-	float halfLineWidth = lineWidth * .5;
-	float prevY = 0;
-	for(int j = 0; j < scale; j++) {
-	  float y = inst->curveMap[j];
-	  if (j == 0 || y == prevY) {
-		for(i = (int)floor(y - halfLineWidth); i <= ceil(y + halfLineWidth); i++) {
-		  int clampedI = i < 0?0:i >= scale?scale - 1:i;
-		  int offset = ((maxYvalue - clampedI + graphYOffset) * stride + j + graphXOffset) * 4;
-		  dst[offset++] = color[0];
-		  dst[offset++] = color[1];
-		  dst[offset++] = color[2];
-		}
-	  } else {
-		int factor = prevY > y?-1:1;
-		float gap = halfLineWidth * factor;
-		//medium value between previous value and current value
-		float mid = (y - prevY) * .5 + prevY;
-		//drawing line from previous value to mid point
-		for(i = ROUND(prevY - gap); factor * i < factor * (mid + gap); i += factor) {
-		  int clampedI = i < 0?0:i >= scale?scale - 1:i;
-		  int offset = ((maxYvalue - clampedI + graphYOffset) * stride + j - 1 + graphXOffset) * 4;
-		  dst[offset++] = color[0];
-		  dst[offset++] = color[1];
-		  dst[offset++] = color[2];
-		}
-		  //drawing line from mid point to current value
-		for(i = ROUND(mid - gap); factor * i < factor * ceil(y + gap); i += factor) {
-		  int clampedI = i < 0?0:i >= scale?scale - 1:i;
-		  int offset = ((maxYvalue - clampedI + graphYOffset) * stride + j + graphXOffset) * 4;
-		  dst[offset++] = color[0];
-		  dst[offset++] = color[1];
-		  dst[offset++] = color[2];
-		}
-	  }
-	  prevY = y;
+	if (inst->graphIsDirty) {
+	  drawGraph(inst);
+	  inst->graphIsDirty = 0;
 	}
+	frei0r_overlay_draw(outframe + graphYOffset * inst->width + graphXOffset,
+	                    inst->width, inst->graph, scale, scale);
   }
 }
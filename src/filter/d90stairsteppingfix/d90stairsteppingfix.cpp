@@ -101,9 +101,15 @@
  */
 
 #include "frei0r.hpp"
+#include "frei0r_thread.h"
 
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 static int slices720p[] = {7,9,9,8,9,9,9,9,9,8,9,9,9,9,8,9,9,9,9,9,8,9,9,9,9,
                     9,8,9,9,9,9,9,8,9,9,9,9,9,8,9,9,9,9,8,9,9,9,9,9,8,
@@ -118,6 +124,7 @@ public:
     D90StairsteppingFix(unsigned int width, unsigned int height)
     {
         m_mesh = new float[height];
+        m_lines = new Line[height];
         
         if (height == 720) {
             
@@ -147,7 +154,7 @@ public:
                     index++;
                     
                 }
-                if (count < newHeight) {
+                if (i < sliceLinesNumber) {
                     filled[index] = count - 0.5;
                     index++;
                 }
@@ -184,6 +191,16 @@ public:
                 m_mesh[i] = (1-offset)*filled[index] + offset*filled[index+1];
 //              printf("%f at %d with weights %f and %f\n", m_mesh[i], i, (1-offset)*downScaling[i], offset*downScaling[i+1]);
             }
+
+            /**
+             * Step 4 for every frame only needs the lower line and 
+             * its factor of each mesh value, as integers.
+             */
+            for (unsigned int i = 0; i < height; i++) {
+                index = floor(m_mesh[i]);
+                m_lines[i].index = index;
+                m_lines[i].weight = (int) (((float) m_mesh[i] - index) * LERP_ONE + 0.5f);
+            }
             
         } else {
             // Not a 720p file.
@@ -193,6 +210,7 @@ public:
     ~D90StairsteppingFix()
     {
         delete[] m_mesh;
+        delete[] m_lines;
     }
 
     virtual void update(double time,
@@ -203,42 +221,101 @@ public:
         if (height == 720) {
 //          printf("Converting.\n");
 
-            float factor;
-            int index;
-            unsigned char *cvA, *cvB, *cvOut;
-            
-            
-            for (unsigned int line = 0; line < height; line++) {
-                index = floor(m_mesh[line]);
-                factor = (float) m_mesh[line] - index;
-                
-                cvA = (unsigned char*) &in[width*index];
-                cvB = (unsigned char*) &in[width*(index+1)];
-                cvOut = (unsigned char*) &out[width*line];
-                    
-                for (unsigned int pixel = 0; pixel < width*4; pixel++) {
-                    // Use linear interpolation on the colours
-                    
-                    // Use pointer arithmetics. Colour values are stored 
-                    // as AABBGGRR in the uint32_t values.
-                    // Convert each colour separately.
-                    
-                    *cvOut = floor((float)(1-factor)*(*cvA) + (factor)*(*cvB));
-                    cvA++;
-                    cvB++;
-                    cvOut++;
-                }
+            // Each output line only reads input lines, which is fine
+            // for any split of the lines over threads unless out is in.
+            if (in == out) {
+                m_copy.assign(in, in + width*height);
+                in = &m_copy[0];
+            }
+            m_in = in;
+            m_out = out;
+
+            Job jobs[FREI0R_MAX_THREADS];
+            int n = frei0r_thread_count((long)width*height);
+            for (int i = 0; i < n; i++) {
+                jobs[i].self = this;
+                jobs[i].y0 = (height-1)*i/n;
+                jobs[i].y1 = (height-1)*(i+1)/n;
             }
+            frei0r_thread_run(lines, jobs, sizeof(Job), n);
             std::copy(in + width*(height-1), in+width*height, out + width*(height-1));
         } else {
             // Not a 720p file -> Cannot work, do nothing.
 //          printf("Just copying. Height is %d.\n", height);
-            std::copy(in, in + width*height, out);
+            if (in != out)
+                std::copy(in, in + width*height, out);
         }
     }
     
 private:
+    /** Factors of the upper line are of LERP_ONE, so that 2 of them fit 16 bits. */
+    enum { LERP_SHIFT = 14, LERP_ONE = 1 << LERP_SHIFT };
+
+    struct Line {
+        int index;  ///< The lower input line
+        int weight; ///< Factor of line index+1, of LERP_ONE
+    };
+
+    struct Job {
+        D90StairsteppingFix *self;
+        unsigned int y0, y1;
+    };
+
     float *m_mesh;
+    Line *m_lines;
+    const uint32_t *m_in;
+    uint32_t *m_out;
+    std::vector<uint32_t> m_copy;
+
+    static void* lines(void *arg)
+    {
+        Job *job = (Job*)arg;
+        for (unsigned int line = job->y0; line < job->y1; line++) {
+            job->self->lerpLine(line);
+        }
+        return 0;
+    }
+
+    /**
+     * Use linear interpolation on the colours of the two lines of the
+     * mesh value. Colour values are stored as AABBGGRR in the uint32_t
+     * values, each colour is converted separately.
+     */
+    void lerpLine(unsigned int line)
+    {
+        const Line &l = m_lines[line];
+        const unsigned char *cvA = (const unsigned char*) &m_in[width*l.index];
+        const unsigned char *cvB = (const unsigned char*) &m_in[width*(l.index+1)];
+        unsigned char *cvOut = (unsigned char*) &m_out[width*line];
+        unsigned int n = width*4;
+        unsigned int i = 0;
+
+        if (l.weight == 0) {
+            memcpy(cvOut, cvA, n);
+            return;
+        }
+#if defined(__SSE2__)
+        // Interleaved bytes of both lines times the interleaved factors
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i factors = _mm_set1_epi32((l.weight << 16) | (LERP_ONE - l.weight));
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(cvA + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(cvB + i));
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+            __m128i r0 = _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), factors);
+            __m128i r1 = _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), factors);
+            __m128i r2 = _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), factors);
+            __m128i r3 = _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), factors);
+            r0 = _mm_packs_epi32(_mm_srli_epi32(r0, LERP_SHIFT), _mm_srli_epi32(r1, LERP_SHIFT));
+            r2 = _mm_packs_epi32(_mm_srli_epi32(r2, LERP_SHIFT), _mm_srli_epi32(r3, LERP_SHIFT));
+            _mm_storeu_si128((__m128i*)(cvOut + i), _mm_packus_epi16(r0, r2));
+        }
+#endif
+        for (; i < n; i++) {
+            cvOut[i] = (cvA[i]*(LERP_ONE - l.weight) + cvB[i]*l.weight) >> LERP_SHIFT;
+        }
+    }
 
 };
 
@@ -247,5 +324,6 @@ private:
 frei0r::construct<D90StairsteppingFix> plugin("Nikon D90 Stairstepping fix",
                 "Removes the Stairstepping from Nikon D90 videos (720p only) by interpolation",
                 "Simon A. Eugster (Granjow)",
-                0,2,
-                F0R_COLOR_MODEL_RGBA8888);
+                0,3,
+                F0R_COLOR_MODEL_RGBA8888,
+                F0R_CAP_RB_SYMMETRIC);
@@ -28,11 +28,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include <frei0r.h>
 
-#include "interp.h"
+#include "frei0r_remap.h"
+#include "frei0r_mapcache.h"
+#include "frei0r_deadline.h"
+
+//version 1 of the maps, see frei0r_mapcache.h
+#define MAP_NAME "defish0r-1"
 
 
 double PI=3.14159265358979;
@@ -142,21 +148,29 @@ float defish(int n, float r, float f, float mr)
 #endif
 
 //----------------------------------------------------------------
-//nafila array map s polozaji pikslov
-//locena funkcija, da jo poklicem samo enkrat na zacetku,
-//array map[] potem uporablja funkcija remap()
-//tako ni treba za vsak frame znova racunat teh sinusov itd...
-//wi,hi,wo ho = input.output image width/height
-//n = 0..3	function select
-//f = focal ratio (amount of distortion)
-//scal = scaling factor
-//pari, paro = pixel aspect ratio (input / output)
-//dx, dy   offset on input (for non-cosited chroma subsampling)
-void fishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float pari, float paro, float dx, float dy, float *map
-	, float stretchFactor, float yScale)
+//arguments of fishmap() / defishmap() for one band of rows
+typedef struct
+{
+	int wi, hi, wo, ho, n;
+	float f, scal, pari, paro, dx, dy;
+	float *map;
+	float stretchFactor, yScale;
+	int k0, k1;	//distances from the middle row
+} mapjob;
+
+//The map is symmetric about the middle row: rows hiMid+k and hiMid-k
+//have the same radius and opposite angles, so the trigonometry of
+//both is done once (atan2f and sinf are odd, the results are exactly
+//those of computing each row on its own).
+static void* fishmap_rows(void *arg)
 {
-	float rmax,maxr,r,kot,x,y,imax;
-	int i, j, ww;
+	mapjob *jb = (mapjob*)arg;
+	int wi = jb->wi, hi = jb->hi, wo = jb->wo, ho = jb->ho, n = jb->n;
+	float f = jb->f, scal = jb->scal, pari = jb->pari, paro = jb->paro;
+	float dx = jb->dx, dy = jb->dy, *map = jb->map;
+	float stretchFactor = jb->stretchFactor, yScale = jb->yScale;
+	float rmax,maxr,r,kot,x,xs,y,ys,imax,s;
+	int i, j, k, m, ww;
 	float ii,jj,sc;
 	int wiMid = wi/2;
 	int hiMid = hi/2;
@@ -166,32 +180,36 @@ void fishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float p
 	imax=hypotf(hi/2.0f,wi/2.0f*pari);
 	sc=imax/maxr;
 
-	//printf("Fishmap: F=%5.2f  Rmax= %7.2f  Maxr=%6.2f  sc=%6.2f  scal=%6.2f\n",f,rmax,maxr,sc,scal);
-
-	for (i=0;i<hi;i++)
+	for (k=jb->k0;k<jb->k1;k++)
 	{
-		ii=(float)(i-hiMid)*yScale; //add Y scale
+		i=hiMid+k;	//row below the middle, may be past the end
+		m=hiMid-k;	//its mirror, the same row for k=0
+		ii=(float)k*yScale; //add Y scale
 		for (j=0;j<wi;j++)
 		{
 			jj=(j-wiMid)*paro;
 			r=hypotf(ii,jj);
 			kot=atan2f(ii,jj);
 			r=fish(n,r/rmax*scal,f)*sc;
-			ww=2*(wo*i+j);
 			if (r<0.0)
 			{
-				map[ww]=-1;
-				map[ww+1]=-1;
+				if (i<hi) { ww=2*(wo*i+j); map[ww]=-1; map[ww+1]=-1; }
+				if (k>0) { ww=2*(wo*m+j); map[ww]=-1; map[ww+1]=-1; }
+				continue;
 			}
-			else
+			x=wiMid+r*cosf(kot)/pari;
+			s=sinf(kot);
+			y=hiMid+r*s;
+			ys=hiMid+r*(-s);
+			xs=x;
+			if ((stretchFactor != 0.0f) && (x>0) && (x<(wi-1)))
+				xs += stretchWidth(wo, wiMid, x, stretchFactor);	//add stretch
+			if (i<hi)
 			{
-				x=wiMid+r*cosf(kot)/pari;
-				y=hiMid+r*sinf(kot);
+				ww=2*(wo*i+j);
 				if ((x>0)&(x<(wi-1))&(y>0)&(y<(hi-1)))
 				{
-					if (stretchFactor != 0.0f)
-						x += stretchWidth(wo, wiMid, x, stretchFactor);	//add stretch
-					map[ww]=x+dx;
+					map[ww]=xs+dx;
 					map[ww+1]=y+dy;
 				}
 				else
@@ -200,30 +218,33 @@ void fishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float p
 					map[ww+1]=-1;
 				}
 			}
+			if (k==0) continue;
+			ww=2*(wo*m+j);
+			if ((x>0)&(x<(wi-1))&(ys>0)&(ys<(hi-1)))
+			{
+				map[ww]=xs+dx;
+				map[ww+1]=ys+dy;
+			}
+			else
+			{
+				map[ww]=-1;
+				map[ww+1]=-1;
+			}
 		}
 	}
+	return 0;
 }
 
-
-//----------------------------------------------------------------
-//nafila array map s polozaji pikslov
-//locena funkcija, da jo poklicem samo enkrat na zacetku,
-//array map[] potem uporablja funkcija remap()
-//tako ni treba za vsak frame znova racunat teh sinusov itd...
-//wi,hi,wo ho = input.output image width/height
-//n = 0..3	function select
-//f = focal ratio (amount of distortion)
-//scal = scaling factor
-//pari,paro = pixel aspect ratio (input / output)
-//dx, dy   offset on input (for non-cosited chroma subsampling)
-//lbox = letterbox
-//stretch = dymanic stretch, convert between 4:3 and 16:9
-//yScale = -0.5.. 0.5 change aspect ratio on y acess only
-void defishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float pari, float paro, float dx, float dy, float *map
-	, int lbox, float stretchFactor, float yScale)
+//same for defishmap(), without the letterbox
+static void* defishmap_rows(void *arg)
 {
-	float rmax,maxr,r,kot,x,y,imax;
-	int i,j,ww;
+	mapjob *jb = (mapjob*)arg;
+	int wi = jb->wi, hi = jb->hi, wo = jb->wo, ho = jb->ho, n = jb->n;
+	float f = jb->f, scal = jb->scal, pari = jb->pari, paro = jb->paro;
+	float *map = jb->map;
+	float stretchFactor = jb->stretchFactor, yScale = jb->yScale;
+	float rmax,maxr,r,kot,x,xs,y,ys,imax,s;
+	int i, j, k, m, ww;
 	float ii,jj,sc;
 	int wiMid = wi/2;
 	int hiMid = hi/2;
@@ -232,35 +253,38 @@ void defishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float
 	maxr=fish(n,1.0,f);
 	imax=hypotf(hi/2.0f,wi/2.0f*pari);
 	sc=imax/maxr;
+	(void)rmax;
 
-	//printf("Defishmap: F=%f  rmax= %f  Maxr=%f   sc=%6.2f  scal=%6.2f\n",f,rmax,maxr,sc,scal);
-
-	for (i=0;i<hi;i++)
+	for (k=jb->k0;k<jb->k1;k++)
 	{
-		ii = (float)(i-hiMid)*yScale; //add Y scale
+		i=hiMid+k;
+		m=hiMid-k;
+		ii=(float)k*yScale; //add Y scale
 		for (j=0;j<wi;j++)
 		{
 			jj=(j-wiMid)*paro; //aspect....
 			r=hypotf(ii,jj)/scal;
 			kot=atan2f(ii,jj);
-			ww=2*(wi*i+j);
 			r=defish(n,r/sc,f,1.0)*imax;
 			if (r<0.0)
 			{
-				map[ww]=-1;
-				map[ww+1]=-1;
+				if (i<hi) { ww=2*(wi*i+j); map[ww]=-1; map[ww+1]=-1; }
+				if (k>0) { ww=2*(wi*m+j); map[ww]=-1; map[ww+1]=-1; }
+				continue;
 			}
-			else
+			x=wiMid+r*cosf(kot)/pari;
+			s=sinf(kot);
+			y=hiMid+r*s;
+			ys=hiMid+r*(-s);
+			xs=x;
+			if ((stretchFactor != 0.0f) && (x>0) && (x<(wi-1)))
+				xs += stretchWidth(wi, wiMid, x, stretchFactor);	//add stretch
+			if (i<hi)
 			{
-				x=wiMid+r*cosf(kot)/pari;
-				y=hiMid+r*sinf(kot);
-
+				ww=2*(wi*i+j);
 				if ((x>0)&&(x<(wi-1))&&(y>0)&&(y<(hi-1)))
 				{
-					if (stretchFactor != 0.0f)
-						x += stretchWidth(wi, wiMid, x, stretchFactor);	//add stretch
-
-					map[ww]=x;
+					map[ww]=xs;
 					map[ww+1]=y;
 				}
 				else
@@ -269,8 +293,85 @@ void defishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float
 					map[ww+1]=-1;
 				}
 			}
+			if (k==0) continue;
+			ww=2*(wi*m+j);
+			if ((x>0)&&(x<(wi-1))&&(ys>0)&&(ys<(hi-1)))
+			{
+				map[ww]=xs;
+				map[ww+1]=ys;
+			}
+			else
+			{
+				map[ww]=-1;
+				map[ww+1]=-1;
+			}
 		}
 	}
+	return 0;
+}
+
+//splits the rows of a map into bands over threads
+static void run_mapjobs(void* (*rows)(void*), mapjob *jb)
+{
+	mapjob jobs[FREI0R_MAX_THREADS];
+	int t, nt = frei0r_thread_count((long)jb->wi * jb->hi);
+	int kmax = jb->hi/2 + 1;	//k = 0 ... hiMid
+
+	if (nt > kmax) nt = kmax;
+	for (t=0;t<nt;t++)
+	{
+		jobs[t] = *jb;
+		jobs[t].k0 = kmax * t / nt;
+		jobs[t].k1 = kmax * (t+1) / nt;
+	}
+	frei0r_thread_run(rows, jobs, sizeof(mapjob), nt);
+}
+
+//----------------------------------------------------------------
+//nafila array map s polozaji pikslov
+//locena funkcija, da jo poklicem samo enkrat na zacetku,
+//array map[] potem uporablja funkcija remap()
+//tako ni treba za vsak frame znova racunat teh sinusov itd...
+//wi,hi,wo ho = input.output image width/height
+//n = 0..3	function select
+//f = focal ratio (amount of distortion)
+//scal = scaling factor
+//pari, paro = pixel aspect ratio (input / output)
+//dx, dy   offset on input (for non-cosited chroma subsampling)
+void fishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float pari, float paro, float dx, float dy, float *map
+	, float stretchFactor, float yScale)
+{
+	mapjob jb = { wi, hi, wo, ho, n, f, scal, pari, paro, dx, dy, map,
+	              stretchFactor, yScale, 0, 0 };
+
+	run_mapjobs(fishmap_rows, &jb);
+}
+
+
+//----------------------------------------------------------------
+//nafila array map s polozaji pikslov
+//locena funkcija, da jo poklicem samo enkrat na zacetku,
+//array map[] potem uporablja funkcija remap()
+//tako ni treba za vsak frame znova racunat teh sinusov itd...
+//wi,hi,wo ho = input.output image width/height
+//n = 0..3	function select
+//f = focal ratio (amount of distortion)
+//scal = scaling factor
+//pari,paro = pixel aspect ratio (input / output)
+//dx, dy   offset on input (for non-cosited chroma subsampling)
+//lbox = letterbox
+//stretch = dymanic stretch, convert between 4:3 and 16:9
+//yScale = -0.5.. 0.5 change aspect ratio on y acess only
+void defishmap(int wi, int hi, int wo, int ho, int n, float f, float scal, float pari, float paro, float dx, float dy, float *map
+	, int lbox, float stretchFactor, float yScale)
+{
+	mapjob jb = { wi, hi, wo, ho, n, f, scal, pari, paro, dx, dy, map,
+	              stretchFactor, yScale, 0, 0 };
+	int i,j,ww;
+	int wiMid = wi/2;
+	int hiMid = hi/2;
+
+	run_mapjobs(defishmap_rows, &jb);
 
 	//crop all 4 borders
 	if (lbox)
@@ -331,10 +432,17 @@ typedef struct
 	float mpar;
 	float par;
 	float *map;
+	const float *mapp;	//the map in use: map, or one from the cache
+	frei0r_mapcache_t cache;
 	int lbox;
 	float stretch;
 	float yScale;
 	interpp interpol;
+	frei0r_remap_t remap;
+	int mapIsDirty;		//geometry changed, make_map() before the next frame
+	int intpIsDirty;	//only the interpolator changed
+	int quality;		//F0R_QUALITY_*, see f0r_set_quality
+	frei0r_deadline_t deadline;	//see f0r_set_deadline
 } param;
 
 
@@ -342,6 +450,9 @@ typedef struct
 //-------------------------------------------------------
 interpp set_intp(param p)
 {
+	//drafts use bilinear instead of the slower interpolators
+	if ((p.quality==F0R_QUALITY_DRAFT)&&(p.intp>1))
+		return interpBL_b32;
 	switch (p.intp)	//katero interpolacijo bo uporabil
 	{
 		//	case -1:return interpNNpr_b;	//nearest neighbor+print
@@ -403,6 +514,42 @@ void make_map(param p)
 
 }
 
+//everything make_map() depends on, for the map cache
+typedef struct
+{
+	int w;
+	int h;
+	float f;
+	int dir;
+	int type;
+	int scal;
+	float mscale;
+	float par;
+	int lbox;
+	float stretch;
+	float yScale;
+} mapkey;
+
+//--------------------------------------------------------
+//the map of p->map, or the same from the cache in p->mapp
+void load_map(param *p)
+{
+	size_t bytes=sizeof(float)*p->w*p->h*2;
+	mapkey k;
+
+	memset(&k, 0, sizeof(k));
+	k.w=p->w; k.h=p->h; k.f=p->f;
+	k.dir=p->dir; k.type=p->type; k.scal=p->scal;
+	k.mscale=p->mscale; k.par=p->par; k.lbox=p->lbox;
+	k.stretch=p->stretch; k.yScale=p->yScale;
+
+	p->mapp=(const float*)frei0r_mapcache_get(&p->cache, MAP_NAME, &k, sizeof(k), bytes);
+	if (p->mapp) return;
+	make_map(*p);
+	frei0r_mapcache_put(MAP_NAME, &k, sizeof(k), p->map, bytes);
+	p->mapp=p->map;
+}
+
 //*********************************************************
 // OBVEZNE FREI0R FUNKCIJE
 
@@ -432,6 +579,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
 	info->explanation="Non rectilinear lens mappings";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -518,11 +671,15 @@ f0r_instance_t  f0r_construct(unsigned int width, unsigned int height)
 	p->lbox=0;			//letterbox
 	p->stretch = 0.0f;	//dynamic stretch
 	p->yScale = 1.0f;	//seperate Y stretch
+	p->quality=F0R_QUALITY_NORMAL;
+	frei0r_deadline_init(&p->deadline);
 
 	p->map=(float*)calloc(1, sizeof(float)*(p->w*p->h*2+2));
 	p->interpol=set_intp(*p);
 
-	make_map(*p);
+	frei0r_remap_init(&p->remap);
+	frei0r_mapcache_init(&p->cache);
+	p->mapIsDirty=1;
 
 	//printf("Construct, w=%d h=%d\n",width,height);
 
@@ -536,6 +693,8 @@ void f0r_destruct(f0r_instance_t instance)
 	p=(param*)instance;
 
 	free(p->map);
+	frei0r_remap_free(&p->remap);
+	frei0r_mapcache_release(&p->cache);
 	free(instance);
 }
 
@@ -558,7 +717,7 @@ void change_param(param *p, int w, int h, float f, int dir, int type, int scal,
 	}
 
 	p->interpol=set_intp(*p);
-	make_map(*p);
+	p->mapIsDirty=1;
 }
 
 //-----------------------------------------------------
@@ -666,8 +825,12 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 		break;
 	case 5:	//interpolator
 		tmpi=map_value_forward(*((double*)parm), 0.0, 6.999);
-		if (p->intp != tmpi) chg=1;
-		p->intp=tmpi;
+		if (p->intp != tmpi)
+		{
+			p->intp=tmpi;
+			p->interpol=set_intp(*p);
+			p->intpIsDirty=1;	//the map stays
+		}
 		break;
 	case 6:	//aspect type
 		tmpi=map_value_forward(*((double*)parm), 0.0, 4.999);
@@ -706,8 +869,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 		case 3: p->par=1.333;break;		//HDV
 		case 4: p->par=p->mpar;break;	//manual
 		}
-		p->interpol=set_intp(*p);
-		make_map(*p);
+		p->mapIsDirty=1;	//rebuilt once in f0r_update()
 	}
 
 	//print_param(*p);
@@ -761,13 +923,63 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 	}
 }
 
+//-------------------------------------------------
+//the interpolator of a quality, prepared with the next frame
+static void use_quality(param *p, int quality)
+{
+	if (p->quality!=quality)
+	{
+		p->quality=quality;
+		p->interpol=set_intp(*p);
+		p->intpIsDirty=1;
+	}
+}
+
 //-------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
 	param *p;
 
 	p=(param*)instance;
+	if (frei0r_deadline_begin(&p->deadline))
+		use_quality(p, p->deadline.current);
 
-	remap32(p->w, p->h, p->w, p->h, (unsigned char*) inframe, (unsigned char*) outframe, p->map, 0, p->interpol);
+	if (p->mapIsDirty)
+	{
+		load_map(p);
+		p->mapIsDirty=0;
+		p->intpIsDirty=1;
+	}
+	if (p->intpIsDirty)
+	{
+		frei0r_remap_prepare(&p->remap, p->w, p->h, p->w, p->h, p->mapp, p->interpol);
+		p->intpIsDirty=0;
+	}
+	frei0r_remap_run(&p->remap, inframe, outframe, 0);
+	frei0r_deadline_end(&p->deadline);
+}
+
+//-------------------------------------------------
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+	param *p;
+
+	p=(param*)instance;
+	frei0r_deadline_request(&p->deadline, quality);
+	use_quality(p, p->deadline.current);
+	return 1;
+}
+
+//-------------------------------------------------
+//drafts interpolate bilinearly instead of with the slower interpolators
+int f0r_set_deadline(f0r_instance_t instance, double seconds)
+{
+	frei0r_deadline_set(&((param*)instance)->deadline, seconds);
+	return 1;
+}
 
+//-------------------------------------------------
+int f0r_get_quality(f0r_instance_t instance)
+{
+	return ((param*)instance)->deadline.current;
 }
@@ -5,10 +5,14 @@
 #include <utility>
 #include <cassert>
 
+// Keeps the frames of the last delay seconds in a ring, oldest first, and
+// outputs the oldest one. The ring only grows until it holds enough frames
+// for the delay at the host's frame rate; after that frames are recycled.
 class delay0r : public frei0r::filter
 {
 public:
   delay0r(unsigned int width, unsigned int height)
+    : head(0), count(0)
   {
     delay = 0.0;
     register_param(delay,"DelayTime","the delay time");
@@ -16,66 +20,140 @@ public:
   
   ~delay0r()
   {
-    for (std::list< std::pair< double, unsigned int* > >::iterator i=buffer.begin(); i != buffer.end(); ++i)
-    {
-       delete[] i->second;
-       i=buffer.erase(i);
-    }
+    for (std::vector<slot>::iterator i=ring.begin(); i != ring.end(); ++i)
+      delete i->pixels;
   }
   
   virtual void update(double time,
                       uint32_t* out,
                       const uint32_t* in)
   {
-    unsigned int* reusable = 0;
-    // remove old frames
-    for (std::list< std::pair< double, unsigned int* > >::iterator i=buffer.begin(); i != buffer.end(); ++i)
+    const uint32_t* best = push(time, in);
+    std::copy(best, best+width*height, out);
+  }
+
+  // copies the stored frames, oldest first
+  virtual bool clone_state(const frei0r::fx& other)
+  {
+    const delay0r& o = static_cast<const delay0r&>(other);
+    if (&o == this)
+      return true;
+    for (std::vector<slot>::iterator i=ring.begin(); i != ring.end(); ++i)
+      delete i->pixels;
+    ring.resize(o.ring.size());
+    for (std::size_t i = 0; i < ring.size(); ++i)
       {
-	if (i->first < (time - delay) || i->first >= time)
-	  {
-	    // remove me
-	    if (reusable != 0)
-	      delete[] i->second;
-	    else
-	      reusable = i->second;
-
-	    i=buffer.erase(i);
-	  }
+        ring[i].time = 0.0;
+        ring[i].pixels = new frame;
+        if (i < o.count)
+          {
+            const slot& s = o.ring[(o.head + i) % o.ring.size()];
+            ring[i].time = s.time;
+            ring[i].pixels->assign(*s.pixels);
+          }
+        else
+          ring[i].pixels->resize_deferred(width, height);
       }
-    
-    // add new frame
-    if (reusable == 0)
-      reusable = new unsigned int[width*height];
+    head = 0;
+    count = o.count;
+    return true;
+  }
+
+  // the ring keeps its frames for the next ones
+  virtual bool reset()
+  {
+    head = 0;
+    count = 0;
+    return true;
+  }
+
+  // an update writes the newest frame and reads the oldest one
+  virtual void memory_usage(std::size_t& resident, std::size_t& touched)
+  {
+    for (std::vector<slot>::iterator i=ring.begin(); i != ring.end(); ++i)
+      resident += i->pixels->bytes();
+    touched += 2 * size * sizeof(uint32_t);
+  }
+
+  virtual const uint32_t* update_view(double time,
+                                      const uint32_t* in1,
+                                      const uint32_t* in2,
+                                      const uint32_t* in3)
+  {
+    return push(time, in1);
+  }
+  
+private:
+  typedef frei0r::aligned_frame<uint32_t> frame;
 
-    std::copy(in, in+width*height,reusable);
-    buffer.push_back(std::make_pair(time,reusable));
+  struct slot
+  {
+    double time;
+    frame* pixels;
+  };
 
-    // copy best
-    unsigned int* best_data=0;
-    double best_time=0;
+  // i-th frame counted from the oldest one
+  slot& at(unsigned int i)
+  {
+    return ring[(head + i) % ring.size()];
+  }
 
-    assert (buffer.size() >0);
-    for (std::list< std::pair< double, unsigned int* > >::iterator i=buffer.begin(); i != buffer.end(); ++i)
+  // Adds in as the newest frame and returns the oldest one that is still
+  // within the delay.
+  const uint32_t* push(double time, const uint32_t* in)
+  {
+    // The ring is sorted by time, so frames that are too old are at the
+    // front, and after a jump back in time the frames that are now in
+    // the future are at the back.
+    while (count > 0 && at(0).time < time - delay)
       {
-	if (best_data==0 || (i->first < best_time))
-	  {
-	    best_time=i->first;
-	    best_data=i->second;
-	  }
+        head = (head + 1) % ring.size();
+        --count;
       }
+    while (count > 0 && at(count - 1).time >= time)
+      --count;
 
-    assert(best_data != 0);
-    std::copy(best_data,best_data+width*height,out);
+    if (count == ring.size())
+      grow();
+
+    slot& newest = at(count++);
+    newest.time = time;
+    std::copy(in, in+width*height, newest.pixels->data());
+
+    assert(count > 0);
+    return at(0).pixels->data();
   }
-  
-private:
+
+  // doubles the capacity, keeping the stored frames in order
+  void grow()
+  {
+    std::rotate(ring.begin(), ring.begin() + head, ring.end());
+    head = 0;
+
+    const std::size_t capacity = ring.empty() ? 4 : 2 * ring.size();
+    while (ring.size() < capacity)
+      {
+        slot s;
+        s.time = 0.0;
+        // push() writes a frame before it is read, so it need not be
+        // zeroed
+        s.pixels = new frame;
+        s.pixels->resize_deferred(width, height);
+        ring.push_back(s);
+      }
+  }
+
   double delay;
-  std::list< std::pair< double, unsigned int* > > buffer;
+  std::vector<slot> ring;
+  unsigned int head;  // index of the oldest frame
+  unsigned int count; // number of stored frames
 };
 
 
 frei0r::construct<delay0r> plugin("delay0r",
 				  "video delay",
 				  "Martin Bayer",
-				  0,2);
+				  0,2,
+				  F0R_COLOR_MODEL_PACKED32,
+				  F0R_CAP_TEMPORAL | F0R_CAP_CLONE);
 
@@ -35,6 +35,7 @@
 #include <inttypes.h>
 
 #include <frei0r.hpp>
+#include <frei0r_thread.h>
 
 
 
@@ -63,6 +64,8 @@ public:
                       uint32_t* out,
                       const uint32_t* in);
 
+  // the queue, all it keeps, is forgotten by the wrapper
+  virtual bool reset() { return true; }
 
 private:
 
@@ -79,12 +82,19 @@ private:
   uint32_t fastrand() { return (randval=randval*1103515245+12345); };
   void fastsrand(uint32_t seed) { randval = seed; };
 
-  int x,y,i,xyoff,v;
-  uint8_t *imagequeue,*curqueue;
-  int curqueuenum;
+  // the block rows row_begin to row_end of a frame, from the frames of
+  // each delay
+  struct job {
+    const DelayGrab* dg;
+    const uint32_t* const* frames;
+    uint32_t* out;
+    int row_begin, row_end;
+  };
+  static void* copy_rows(void* arg);
+
+  int x,y,v;
+  frei0r::frame_history imagequeue;
   uint32_t *curdelaymap;
-  uint8_t *curpos,*curimage;
-  int curposnum;
   void *delaymap;
 
 /* initialized from the init */
@@ -112,27 +122,24 @@ void DelayGrab::_init(int wdt, int hgt) {
 
 
 
-DelayGrab::DelayGrab(int wdt, int hgt) {
+DelayGrab::DelayGrab(int wdt, int hgt)
+  : imagequeue(wdt, hgt, QUEUEDEPTH) {
 
   delaymap = NULL;
   _init(wdt, hgt);
 
-  imagequeue = (uint8_t *) malloc(QUEUEDEPTH*(geo.size));
+  register_history(imagequeue);
 
   /* starting mode */
   current_mode = 4;
   /* starting blocksize */
   set_blocksize(2);
-  
-  curqueue=imagequeue;
-  curqueuenum=0;
 
   fastsrand(::time(NULL));
 }
 
 DelayGrab::~DelayGrab() {
   if(delaymap) free(delaymap);
-  free(imagequeue);
 }
 
 
@@ -141,44 +148,60 @@ void DelayGrab::update(double time,
                        uint32_t* out,
                        const uint32_t* in) {
 
-  /* Update queue pointer */
-  if (curqueuenum==0) {
-    curqueuenum=QUEUEDEPTH-1;
-    curqueue = imagequeue;
-    curqueue += (geo.size*(QUEUEDEPTH-1));
-  } else {
-    curqueuenum--;
-    curqueue -= geo.size;
+   /* Add image to queue */
+  imagequeue.push(time, in);
+
+  /* the frame of each delay, looked up once: the history may be the
+     host's, which is only asked from this thread */
+  const uint32_t* frames[QUEUEDEPTH];
+  for (int d = 0; d < QUEUEDEPTH; ++d)
+    frames[d] = imagequeue.at(d);
+
+     /* Copy image blockwise to screenbuffer, block rows on threads */
+  job jobs[FREI0R_MAX_THREADS];
+  int n = frei0r_thread_count((long)geo.w * geo.h);
+  if (n > delaymapheight)
+    n = delaymapheight > 0 ? delaymapheight : 1;
+  for (int t = 0; t < n; ++t) {
+    jobs[t].dg = this;
+    jobs[t].frames = frames;
+    jobs[t].out = out;
+    jobs[t].row_begin = delaymapheight * t / n;
+    jobs[t].row_end = delaymapheight * (t + 1) / n;
   }
+  frei0r_thread_run(copy_rows, jobs, sizeof(job), n);
+}
 
-   /* Copy image to queue */
-  memcpy(curqueue,in,geo.size);
-
-     /* Copy image blockwise to screenbuffer */
-  curdelaymap= (uint32_t *)delaymap;
-  for (y=0; y<delaymapheight; y++) {
-    for (x=0; x<delaymapwidth; x++) {
-
-      curposnum=((curqueuenum + (*curdelaymap)) % QUEUEDEPTH);
-      
-      xyoff= (x*block_per_bytespp) + (y*block_per_pitch);
-      /* source */
-      curpos= imagequeue;
-      curpos += (geo.size*curposnum);
-      curpos += xyoff;
-      /* target */
-      curimage = (uint8_t *)out;
-      curimage += xyoff;
-      /* copy block */
-      for (i=0; i<blocksize; i++) {
-	memcpy(curimage,curpos,block_per_res);
-	curpos += geo.pitch;
-	curimage += geo.pitch;
+void* DelayGrab::copy_rows(void* arg) {
+  const job* jb = (const job*)arg;
+  const DelayGrab* dg = jb->dg;
+  const uint32_t* map = (const uint32_t*)dg->delaymap;
+
+  for (int by = jb->row_begin; by < jb->row_end; ++by) {
+    const uint32_t* row = map + by * dg->delaymapwidth;
+    int bx = 0;
+    while (bx < dg->delaymapwidth) {
+      /* neighbouring blocks of the same delay are copied together, one
+         memcpy per line of pixels */
+      const uint32_t delay = row[bx];
+      int run = 1;
+      while (bx + run < dg->delaymapwidth && row[bx + run] == delay)
+        ++run;
+
+      const size_t xyoff = (size_t)bx * dg->block_per_bytespp
+        + (size_t)by * dg->block_per_pitch;
+      const uint8_t* src = (const uint8_t*)jb->frames[delay % QUEUEDEPTH] + xyoff;
+      uint8_t* dst = (uint8_t*)jb->out + xyoff;
+      const size_t len = (size_t)run * dg->block_per_res;
+      for (int i = 0; i < dg->blocksize; ++i) {
+        memcpy(dst, src, len);
+        src += dg->geo.pitch;
+        dst += dg->geo.pitch;
       }
-      curdelaymap++;
+      bx += run;
     }
   }
-
+  return 0;
 }
 
 // int kbd_input(char key) {
@@ -290,4 +313,6 @@ int DelayGrab::isqrt(unsigned int x) {
 frei0r::construct<DelayGrab> plugin("Delaygrab",
 				  "delayed frame blitting mapped on a time bitmap",
 				  "Bill Spinhover, Andreas Schiffler, Jaromil",
-				  3,1);
+				  3,1,
+				  F0R_COLOR_MODEL_PACKED32,
+				  F0R_CAP_TEMPORAL);
@@ -31,6 +31,11 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 
 //#include <stdio.h>
 #include <frei0r.h>
+#include <frei0r_cpu.h>
+#include <frei0r_thread.h>
+#include <frei0r_async.h>
+#include <frei0r_state.h>
+#include <frei0r_pages.h>
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
@@ -44,7 +49,7 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 typedef struct {
         int Coefs[4][512*16];
         unsigned int *Line;
-	unsigned short *Frame[3];
+	unsigned short *Frame;
 }vf_priv_s;
 
 //----------------------------------------
@@ -57,7 +62,12 @@ int w;
 double LumSpac,LumTmp;
 vf_priv_s vps;
 
-unsigned char *Rplani,*Gplani,*Bplani,*Rplano,*Gplano,*Bplano;
+unsigned int *Hor;	//horizontal pass, one row per thread or the whole frame
+int threads;
+int quality;	//F0R_QUALITY_*, drafts are only filtered spatially
+int restart;	//the next frame is taken as the previous one, see f0r_reset
+
+frei0r_async_t async;	//frames of f0r_update_async
 } inst;
 
 
@@ -65,6 +75,15 @@ unsigned char *Rplani,*Gplani,*Bplani,*Rplano,*Gplano,*Bplano;
 //functions LowPassMul, deNoiseTemporal, deNoiseSpacial,
 //deNoise and PrecalaCoefs  are from Mplayer "hqdn3d" filter
 //by Daniel Moreno <comac@comac.darktech.org>
+//
+//The recursion of deNoiseSpacial runs along the rows (PixelAnt) and
+//down the columns (LineAnt), and the column filter only sees the output
+//of the row filter. It is therefore split into a horizontal pass, which
+//is serial along a row but independent between rows, and a vertical and
+//temporal pass, which is independent between columns. The latter works
+//on all three colors of a whole row at once, so it reads and writes the
+//packed frames directly and vectorizes with the table lookups done as
+//gathers.
 
 static inline unsigned int LowPassMul(unsigned int PrevMul, unsigned int CurrMul, int* Coef){
 //    int dMul= (PrevMul&0xFFFFFF)-(CurrMul&0xFFFFFF);
@@ -73,139 +92,256 @@ static inline unsigned int LowPassMul(unsigned int PrevMul, unsigned int CurrMul
     return CurrMul + Coef[d];
 }
 
-void deNoiseTemporal(
-                    unsigned char *Frame,        // mpi->planes[x]
-                    unsigned char *FrameDest,    // dmpi->planes[x]
-                    unsigned short *FrameAnt,
-                    int W, int H, int sStride, int dStride,
-                    int *Temporal)
+//horizontal pass of deNoiseSpacial for one packed row, gives one row
+//of 16.16 pixels per color. The Mplayer deNoiseSpacial filters the first
+//line against its first pixel only (PixelAnt isn't updated there), Fixed
+//keeps that for the spatial only mode
+static void deNoiseHorizontal(
+                    const uint32_t *Frame,
+                    unsigned int *Hor,           // 3 * W
+                    int W, int *Horizontal, int Fixed)
 {
-    long X, Y;
-    unsigned int PixelDst;
+    long X;
+    unsigned int R, G, B;
+
+    /* First pixel has no left neighbor. */
+    Hor[0]     = R = (Frame[0]&255)<<16;
+    Hor[W]     = G = ((Frame[0]>>8)&255)<<16;
+    Hor[2*W]   = B = ((Frame[0]>>16)&255)<<16;
 
-    for (Y = 0; Y < H; Y++){
-        for (X = 0; X < W; X++){
-            PixelDst = LowPassMul(FrameAnt[X]<<8, Frame[X]<<16, Temporal);
-            FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
-            FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+    if (Fixed){
+        for (X = 1; X < W; X++){
+            Hor[X]     = LowPassMul(R, (Frame[X]&255)<<16, Horizontal);
+            Hor[W+X]   = LowPassMul(G, ((Frame[X]>>8)&255)<<16, Horizontal);
+            Hor[2*W+X] = LowPassMul(B, ((Frame[X]>>16)&255)<<16, Horizontal);
         }
-        Frame += sStride;
-        FrameDest += dStride;
-        FrameAnt += W;
+        return;
+    }
+
+    for (X = 1; X < W; X++){
+        Hor[X]     = R = LowPassMul(R, (Frame[X]&255)<<16, Horizontal);
+        Hor[W+X]   = G = LowPassMul(G, ((Frame[X]>>8)&255)<<16, Horizontal);
+        Hor[2*W+X] = B = LowPassMul(B, ((Frame[X]>>16)&255)<<16, Horizontal);
     }
 }
 
-void deNoiseSpacial(
-                    unsigned char *Frame,        // mpi->planes[x]
-                    unsigned char *FrameDest,    // dmpi->planes[x]
-                    unsigned int *LineAnt,       // vf->priv->Line (width bytes)
-                    int W, int H, int sStride, int dStride,
-                    int *Horizontal, int *Vertical)
+//vertical and temporal filter for one color of one pixel
+static FREI0R_ALWAYS_INLINE unsigned int deNoisePixel(
+                    unsigned int PixelAnt,       // 16.16 input or row filtered
+                    unsigned int *LineAnt,
+                    unsigned short *FrameAnt,
+                    int FirstLine, int *Vertical, int *Temporal,
+                    const int Spacial, const int Temp)
 {
-    long X, Y;
-    long sLineOffs = 0, dLineOffs = 0;
-    unsigned int PixelAnt;
-    unsigned int PixelDst;
+    unsigned int PixelDst = PixelAnt;
 
-    /* First pixel has no left nor top neighbor. */
-    PixelDst = LineAnt[0] = PixelAnt = Frame[0]<<16;
-    FrameDest[0]= ((PixelDst+0x10007FFF)>>16);
-
-    /* First line has no top neighbor, only left. */
-    for (X = 1; X < W; X++){
-        PixelDst = LineAnt[X] = LowPassMul(PixelAnt, Frame[X]<<16, Horizontal);
-        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+    if (Spacial){
+        /* First line has no top neighbor, only left. */
+        if (!FirstLine)
+            PixelAnt = LowPassMul(*LineAnt, PixelAnt, Vertical);
+        PixelDst = *LineAnt = PixelAnt;
     }
+    if (Temp){
+        PixelDst = LowPassMul(*FrameAnt<<8, PixelAnt, Temporal);
+        *FrameAnt = ((PixelDst+0x1000007F)>>8);
+    }
+    return ((PixelDst+0x10007FFF)>>16)&255;
+}
 
-    for (Y = 1; Y < H; Y++){
-	unsigned int PixelAnt;
-	sLineOffs += sStride, dLineOffs += dStride;
-        /* First pixel on each line doesn't have previous pixel */
-        PixelAnt = Frame[sLineOffs]<<16;
-        PixelDst = LineAnt[0] = LowPassMul(LineAnt[0], PixelAnt, Vertical);
-        FrameDest[dLineOffs]= ((PixelDst+0x10007FFF)>>16);
-
-        for (X = 1; X < W; X++){
-            unsigned int PixelDst;
-            /* The rest are normal */
-            PixelAnt = LowPassMul(PixelAnt, Frame[sLineOffs+X]<<16, Horizontal);
-            PixelDst = LineAnt[X] = LowPassMul(LineAnt[X], PixelAnt, Vertical);
-            FrameDest[dLineOffs+X]= ((PixelDst+0x10007FFF)>>16);
+static FREI0R_ALWAYS_INLINE void deNoiseRow_mode(
+                    const uint32_t *Frame,
+                    uint32_t *FrameDest,
+                    const unsigned int *Hor,     // 3 * W, unused if !Spacial
+                    unsigned int *LineAnt,       // 3 * W
+                    unsigned short *FrameAnt,    // 3 * W, this row
+                    int W, long X0, long X1, int FirstLine,
+                    int *Vertical, int *Temporal,
+                    const int Spacial, const int Temp)
+{
+    long X;
+
+    for (X = X0; X < X1; X++){
+        unsigned int R, G, B;
+
+        if (Spacial){
+            R = Hor[X];
+            G = Hor[W+X];
+            B = Hor[2*W+X];
+        } else {
+            R = (Frame[X]&255)<<16;
+            G = ((Frame[X]>>8)&255)<<16;
+            B = ((Frame[X]>>16)&255)<<16;
         }
+        R = deNoisePixel(R, &LineAnt[X], &FrameAnt[X], FirstLine,
+                         Vertical, Temporal, Spacial, Temp);
+        G = deNoisePixel(G, &LineAnt[W+X], &FrameAnt[W+X], FirstLine,
+                         Vertical, Temporal, Spacial, Temp);
+        B = deNoisePixel(B, &LineAnt[2*W+X], &FrameAnt[2*W+X], FirstLine,
+                         Vertical, Temporal, Spacial, Temp);
+        FrameDest[X] = R|(G<<8)|(B<<16)|(Frame[X]&0xFF000000);
     }
 }
 
-void deNoise(unsigned char *Frame,        // mpi->planes[x]
-                    unsigned char *FrameDest,    // dmpi->planes[x]
-                    unsigned int *LineAnt,      // vf->priv->Line (width bytes)
-		    unsigned short **FrameAntPtr,
-                    int W, int H, int sStride, int dStride,
-                    int *Horizontal, int *Vertical, int *Temporal)
-{
-    long X, Y;
-    long sLineOffs = 0, dLineOffs = 0;
-    unsigned int PixelAnt;
-    unsigned int PixelDst;
-    unsigned short* FrameAnt=(*FrameAntPtr);
-
-    if(!FrameAnt){
-	(*FrameAntPtr)=FrameAnt=malloc(W*H*sizeof(unsigned short));
-	for (Y = 0; Y < H; Y++){
-	    unsigned short* dst=&FrameAnt[Y*W];
-	    unsigned char* src=Frame+Y*sStride;
-	    for (X = 0; X < W; X++) dst[X]=src[X]<<8;
-	}
-    }
+//same choice of filters as the Mplayer deNoise: spatial only when the
+//temporal strength is 0, temporal only when the spatial one is
+#define DENOISE_SPACIAL  1
+#define DENOISE_TEMPORAL 2
 
-    if(!Horizontal[0] && !Vertical[0]){
-        deNoiseTemporal(Frame, FrameDest, FrameAnt,
-                        W, H, sStride, dStride, Temporal);
-        return;
-    }
-    if(!Temporal[0]){
-        deNoiseSpacial(Frame, FrameDest, LineAnt,
-                       W, H, sStride, dStride, Horizontal, Vertical);
-        return;
+static int deNoiseMode(int *Horizontal, int *Temporal)
+{
+    if (!Horizontal[0])
+        return DENOISE_TEMPORAL;
+    if (!Temporal[0])
+        return DENOISE_SPACIAL;
+    return DENOISE_SPACIAL|DENOISE_TEMPORAL;
+}
+
+static FREI0R_ALWAYS_INLINE void deNoiseRow_impl(
+                    const uint32_t *Frame, uint32_t *FrameDest,
+                    const unsigned int *Hor, unsigned int *LineAnt,
+                    unsigned short *FrameAnt,
+                    int W, long X0, long X1, int FirstLine,
+                    int *Vertical, int *Temporal, int Mode)
+{
+    switch (Mode){
+    case DENOISE_SPACIAL:
+        deNoiseRow_mode(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                        FirstLine, Vertical, Temporal, 1, 0);
+        break;
+    case DENOISE_TEMPORAL:
+        deNoiseRow_mode(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                        FirstLine, Vertical, Temporal, 0, 1);
+        break;
+    default:
+        deNoiseRow_mode(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                        FirstLine, Vertical, Temporal, 1, 1);
+        break;
     }
+}
 
-    /* First pixel has no left nor top neighbor. Only previous frame */
-    LineAnt[0] = PixelAnt = Frame[0]<<16;
-    PixelDst = LowPassMul(FrameAnt[0]<<8, PixelAnt, Temporal);
-    FrameAnt[0] = ((PixelDst+0x1000007F)>>8);
-    FrameDest[0]= ((PixelDst+0x10007FFF)>>16);
+static void deNoiseRow_generic(const uint32_t *Frame, uint32_t *FrameDest,
+                 const unsigned int *Hor, unsigned int *LineAnt,
+                 unsigned short *FrameAnt,
+                 int W, long X0, long X1, int FirstLine,
+                 int *Vertical, int *Temporal, int Mode)
+{
+    deNoiseRow_impl(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                    FirstLine, Vertical, Temporal, Mode);
+}
 
-    /* First line has no top neighbor. Only left one for each pixel and
-     * last frame */
-    for (X = 1; X < W; X++){
-        LineAnt[X] = PixelAnt = LowPassMul(PixelAnt, Frame[X]<<16, Horizontal);
-        PixelDst = LowPassMul(FrameAnt[X]<<8, PixelAnt, Temporal);
-        FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
-        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
-    }
+#ifdef FREI0R_CPU_DISPATCH
 
-    for (Y = 1; Y < H; Y++){
-	unsigned int PixelAnt;
-	unsigned short* LinePrev=&FrameAnt[Y*W];
-	sLineOffs += sStride, dLineOffs += dStride;
-        /* First pixel on each line doesn't have previous pixel */
-        PixelAnt = Frame[sLineOffs]<<16;
-        LineAnt[0] = LowPassMul(LineAnt[0], PixelAnt, Vertical);
-	PixelDst = LowPassMul(LinePrev[0]<<8, LineAnt[0], Temporal);
-        LinePrev[0] = ((PixelDst+0x1000007F)>>8);
-        FrameDest[dLineOffs]= ((PixelDst+0x10007FFF)>>16);
+#include <immintrin.h>
 
-        for (X = 1; X < W; X++){
-            unsigned int PixelDst;
-            /* The rest are normal */
-            PixelAnt = LowPassMul(PixelAnt, Frame[sLineOffs+X]<<16, Horizontal);
-            LineAnt[X] = LowPassMul(LineAnt[X], PixelAnt, Vertical);
-	    PixelDst = LowPassMul(LinePrev[X]<<8, LineAnt[X], Temporal);
-            LinePrev[X] = ((PixelDst+0x1000007F)>>8);
-            FrameDest[dLineOffs+X]= ((PixelDst+0x10007FFF)>>16);
+//LowPassMul on 8 pixels, the table lookup is a gather
+FREI0R_TARGET_AVX2 static inline __m256i LowPassMul_avx2(__m256i PrevMul, __m256i CurrMul, int* Coef){
+    __m256i d = _mm256_srli_epi32(_mm256_add_epi32(_mm256_sub_epi32(PrevMul, CurrMul),
+                                  _mm256_set1_epi32(0x10007FF)), 12);
+    return _mm256_add_epi32(CurrMul, _mm256_i32gather_epi32(Coef, d, 4));
+}
+
+//deNoisePixel on one color of 8 pixels, gives the 8 bit results
+FREI0R_TARGET_AVX2 static inline __m256i deNoisePixel_avx2(
+                    __m256i PixelAnt, unsigned int *LineAnt,
+                    unsigned short *FrameAnt,
+                    int FirstLine, int *Vertical, int *Temporal,
+                    const int Spacial, const int Temp)
+{
+    __m256i PixelDst = PixelAnt;
+
+    if (Spacial){
+        if (!FirstLine)
+            PixelAnt = LowPassMul_avx2(_mm256_loadu_si256((__m256i*)LineAnt),
+                                       PixelAnt, Vertical);
+        _mm256_storeu_si256((__m256i*)LineAnt, PixelAnt);
+        PixelDst = PixelAnt;
+    }
+    if (Temp){
+        __m256i Ant = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)FrameAnt));
+        PixelDst = LowPassMul_avx2(_mm256_slli_epi32(Ant, 8), PixelAnt, Temporal);
+        Ant = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(PixelDst,
+                               _mm256_set1_epi32(0x1000007F)), 8),
+                               _mm256_set1_epi32(0xFFFF));
+        Ant = _mm256_permute4x64_epi64(_mm256_packus_epi32(Ant, Ant), 0xD8);
+        _mm_storeu_si128((__m128i*)FrameAnt, _mm256_castsi256_si128(Ant));
+    }
+    return _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(PixelDst,
+                            _mm256_set1_epi32(0x10007FFF)), 16),
+                            _mm256_set1_epi32(255));
+}
+
+FREI0R_TARGET_AVX2 static inline long deNoiseRow_mode_avx2(
+                    const uint32_t *Frame, uint32_t *FrameDest,
+                    const unsigned int *Hor, unsigned int *LineAnt,
+                    unsigned short *FrameAnt,
+                    int W, long X0, long X1, int FirstLine,
+                    int *Vertical, int *Temporal,
+                    const int Spacial, const int Temp)
+{
+    const __m256i Byte = _mm256_set1_epi32(255);
+    long X;
+
+    for (X = X0; X + 8 <= X1; X += 8){
+        __m256i Px = _mm256_loadu_si256((__m256i*)&Frame[X]);
+        __m256i R, G, B;
+
+        if (Spacial){
+            R = _mm256_loadu_si256((__m256i*)&Hor[X]);
+            G = _mm256_loadu_si256((__m256i*)&Hor[W+X]);
+            B = _mm256_loadu_si256((__m256i*)&Hor[2*W+X]);
+        } else {
+            R = _mm256_slli_epi32(_mm256_and_si256(Px, Byte), 16);
+            G = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(Px, 8), Byte), 16);
+            B = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(Px, 16), Byte), 16);
         }
+        R = deNoisePixel_avx2(R, &LineAnt[X], &FrameAnt[X], FirstLine,
+                              Vertical, Temporal, Spacial, Temp);
+        G = deNoisePixel_avx2(G, &LineAnt[W+X], &FrameAnt[W+X], FirstLine,
+                              Vertical, Temporal, Spacial, Temp);
+        B = deNoisePixel_avx2(B, &LineAnt[2*W+X], &FrameAnt[2*W+X], FirstLine,
+                              Vertical, Temporal, Spacial, Temp);
+        Px = _mm256_and_si256(Px, _mm256_set1_epi32(0xFF000000));
+        Px = _mm256_or_si256(Px, _mm256_or_si256(R, _mm256_or_si256(
+                             _mm256_slli_epi32(G, 8), _mm256_slli_epi32(B, 16))));
+        _mm256_storeu_si256((__m256i*)&FrameDest[X], Px);
     }
+    return X;
 }
 
+//8 pixels at a time, the rest of the row with the scalar code.
+//Also used with AVX-512, which gathers no faster per pixel
+FREI0R_TARGET_AVX2 static void deNoiseRow_avx2(const uint32_t *Frame, uint32_t *FrameDest,
+                 const unsigned int *Hor, unsigned int *LineAnt,
+                 unsigned short *FrameAnt,
+                 int W, long X0, long X1, int FirstLine,
+                 int *Vertical, int *Temporal, int Mode)
+{
+    long X;
+
+    switch (Mode){
+    case DENOISE_SPACIAL:
+        X = deNoiseRow_mode_avx2(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                                 FirstLine, Vertical, Temporal, 1, 0);
+        break;
+    case DENOISE_TEMPORAL:
+        X = deNoiseRow_mode_avx2(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                                 FirstLine, Vertical, Temporal, 0, 1);
+        break;
+    default:
+        X = deNoiseRow_mode_avx2(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X0, X1,
+                                 FirstLine, Vertical, Temporal, 1, 1);
+        break;
+    }
+    deNoiseRow_impl(Frame, FrameDest, Hor, LineAnt, FrameAnt, W, X, X1,
+                    FirstLine, Vertical, Temporal, Mode);
+}
+
+#endif
+
+static void (*deNoiseRow)(const uint32_t*, uint32_t*, const unsigned int*,
+                          unsigned int*, unsigned short*, int, long, long, int,
+                          int*, int*, int) = deNoiseRow_generic;
+
 #define ABS(A) ( (A) > 0 ? (A) : -(A) )
 
 static void PrecalcCoefs(int *Ct, double Dist25)
@@ -244,12 +380,112 @@ double map_value_backward(float v, float min, float max)
 return (v-min)/(max-min);
 }
 
+//-----------------------------------------------------
+//vertical and temporal pass over the columns [x0,x1) of all rows.
+//In->Hor holds either the horizontal pass of the whole frame or,
+//single threaded, just the row at hand
+static void hqdn3d_rows(inst *in, int mode, const uint32_t* inframe, uint32_t* outframe, int x0, int x1)
+{
+int y,w=in->w;
+int whole=(in->threads>1);
+unsigned int *hor=in->Hor;
+
+for (y=0;y<in->h;y++)
+	{
+	if (mode&DENOISE_SPACIAL)
+		{
+		if (whole)
+			hor=&in->Hor[3*y*w];
+		else
+			deNoiseHorizontal(&inframe[y*w],hor,w,in->vps.Coefs[0],
+				y==0 && mode==DENOISE_SPACIAL);
+		}
+	deNoiseRow(&inframe[y*w],&outframe[y*w],hor,in->vps.Line,
+		&in->vps.Frame[3*y*w],w,x0,x1,y==0,
+		in->vps.Coefs[0],in->vps.Coefs[1],mode);
+	}
+}
+
+typedef struct
+{
+inst *in;
+int mode;
+const uint32_t *inframe;
+uint32_t *outframe;
+int y0,y1;	//rows of the horizontal pass
+int x0,x1;	//columns of the vertical and temporal pass
+} hqdn3d_job;
+
+static void *hqdn3d_horizontal_job(void *arg)
+{
+hqdn3d_job *job=(hqdn3d_job*)arg;
+int y,w=job->in->w;
+
+for (y=job->y0;y<job->y1;y++)
+	deNoiseHorizontal(&job->inframe[y*w],&job->in->Hor[3*y*w],w,job->in->vps.Coefs[0],
+		y==0 && job->mode==DENOISE_SPACIAL);
+return NULL;
+}
+
+static void *hqdn3d_rows_job(void *arg)
+{
+hqdn3d_job *job=(hqdn3d_job*)arg;
+
+hqdn3d_rows(job->in,job->mode,job->inframe,job->outframe,job->x0,job->x1);
+return NULL;
+}
+
+//the horizontal pass of the whole frame is split into bands of rows,
+//after it the vertical and temporal pass into bands of columns
+static void hqdn3d_update_threaded(inst *in, int mode, const uint32_t* inframe, uint32_t* outframe)
+{
+hqdn3d_job jobs[FREI0R_MAX_THREADS];
+int i,n=in->threads;
+int cols=((in->w+n-1)/n+15)&~15;	//whole cache lines of a row
+
+for (i=0;i<n;i++)
+	{
+	jobs[i].in=in;
+	jobs[i].mode=mode;
+	jobs[i].inframe=inframe;
+	jobs[i].outframe=outframe;
+	jobs[i].y0=in->h*i/n;
+	jobs[i].y1=in->h*(i+1)/n;
+	jobs[i].x0=i*cols<in->w ? i*cols : in->w;
+	jobs[i].x1=(i+1)*cols<in->w ? (i+1)*cols : in->w;
+	}
+
+if (mode&DENOISE_SPACIAL)
+	frei0r_thread_run(hqdn3d_horizontal_job,jobs,sizeof(hqdn3d_job),n);
+frei0r_thread_run(hqdn3d_rows_job,jobs,sizeof(hqdn3d_job),n);
+}
+
+//at least 16 columns per thread
+static int hqdn3d_threads(int w, int h)
+{
+int n=frei0r_thread_count((long)w*h);
+
+if (n>w/16)
+	n=w/16;
+return n>1 ? n : 1;
+}
+
+static void hqdn3d_update(f0r_instance_t instance, double time,
+                          const uint32_t* inframe, const uint32_t* inframe2,
+                          const uint32_t* inframe3, uint32_t* outframe);
+static void hqdn3d_set_param(f0r_instance_t instance, f0r_param_t parm, int param_index);
+
 //***********************************************
 // OBVEZNE FREI0R FUNKCIJE
 
 //-----------------------------------------------
 int f0r_init()
 {
+#ifdef FREI0R_CPU_DISPATCH
+unsigned int cpu = frei0r_cpu_features();
+if (cpu & FREI0R_CPU_AVX2)
+	deNoiseRow = deNoiseRow_avx2;
+#endif
 return 1;
 }
 
@@ -273,6 +509,16 @@ info->num_params=2;
 info->explanation="High quality 3D denoiser from Mplayer";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_TEMPORAL | F0R_CAP_CLONE
+    | F0R_CAP_STATE | F0R_CAP_RB_SYMMETRIC;
+#ifdef FREI0R_HAVE_PTHREAD
+  info->capabilities |= F0R_CAP_ASYNC;
+#endif
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -302,17 +548,14 @@ in->h=height;
 
 in->LumSpac=4;
 in->LumTmp=6;
-in->vps.Line=calloc(width,sizeof(int));
-in->Rplani=calloc(width*height,sizeof(unsigned char));
-in->Gplani=calloc(width*height,sizeof(unsigned char));
-in->Bplani=calloc(width*height,sizeof(unsigned char));
-in->Rplano=calloc(width*height,sizeof(unsigned char));
-in->Gplano=calloc(width*height,sizeof(unsigned char));
-in->Bplano=calloc(width*height,sizeof(unsigned char));
+in->threads=hqdn3d_threads(width,height);
+in->quality=F0R_QUALITY_NORMAL;
 
 PrecalcCoefs(in->vps.Coefs[0],in->LumSpac);
 PrecalcCoefs(in->vps.Coefs[1],in->LumTmp);
 
+frei0r_async_init(&in->async,in,hqdn3d_update,hqdn3d_set_param);
+
 return (f0r_instance_t)in;
 }
 
@@ -323,19 +566,90 @@ inst *in;
 
 in=(inst*)instance;
 
+frei0r_async_destroy(&in->async);
 free(in->vps.Line);
-free(in->Rplani);
-free(in->Gplani);
-free(in->Bplani);
-free(in->Rplano);
-free(in->Gplano);
-free(in->Bplano);
+free(in->vps.Frame);
+free(in->Hor);
 
 free(instance);
 }
 
 //-----------------------------------------------------
-void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_index)
+//The buffers are allocated by the first update rather than in
+//f0r_construct, so that the thread that renders the instance touches
+//them first; Line and Hor are written before they are read.
+static void hqdn3d_buffers(inst *in)
+{
+int w=in->w;
+
+if (!in->vps.Line)
+	in->vps.Line=malloc(3*w*sizeof(int));
+if (!in->Hor)
+	in->Hor=frei0r_pages_alloc((in->threads>1 ? 3*w*in->h : 3*w)*sizeof(unsigned int));
+if (!in->vps.Frame)
+	in->vps.Frame=frei0r_pages_alloc(3*w*in->h*sizeof(unsigned short));
+}
+
+//the previous frame is the state, Line and Hor are scratch
+f0r_instance_t f0r_clone(f0r_instance_t instance)
+{
+inst *in,*copy;
+
+in=(inst*)instance;
+frei0r_async_wait(&in->async);
+
+copy=(inst*)f0r_construct(in->w,in->h);
+copy->LumSpac=in->LumSpac;
+copy->LumTmp=in->LumTmp;
+copy->quality=in->quality;
+memcpy(copy->vps.Coefs,in->vps.Coefs,sizeof(in->vps.Coefs));
+if (in->vps.Frame && !in->restart)
+	{
+	hqdn3d_buffers(copy);
+	memcpy(copy->vps.Frame,in->vps.Frame,3*in->w*in->h*sizeof(unsigned short));
+	}
+
+return (f0r_instance_t)copy;
+}
+
+//for f0r_save_state and f0r_load_state, version 1
+static int hqdn3d_state(inst *in, frei0r_state_t *s)
+{
+frei0r_async_wait(&in->async);
+//a reset instance has no previous frame, like a new one
+if (in->restart)
+	{
+	free(in->vps.Frame);
+	in->vps.Frame=NULL;
+	in->restart=0;
+	}
+frei0r_state_buffer(s,(void**)&in->vps.Frame,3*in->w*in->h*sizeof(unsigned short));
+if (in->vps.Frame)
+	hqdn3d_buffers(in);
+return frei0r_state_ok(s);
+}
+
+size_t f0r_save_state(f0r_instance_t instance, void* buffer, size_t size)
+{
+inst *in=(inst*)instance;
+frei0r_state_t s;
+
+frei0r_state_save(&s,buffer,size,1,in->w,in->h);
+return hqdn3d_state(in,&s) ? frei0r_state_size(&s) : 0;
+}
+
+int f0r_load_state(f0r_instance_t instance, const void* buffer, size_t size)
+{
+inst *in=(inst*)instance;
+frei0r_state_t s;
+
+frei0r_state_load(&s,buffer,size,1,in->w,in->h);
+return hqdn3d_state(in,&s) && frei0r_state_end(&s);
+}
+
+//-----------------------------------------------------
+//after the frames in flight, see f0r_set_param_value
+static void hqdn3d_set_param(f0r_instance_t instance, f0r_param_t parm, int param_index)
 {
 inst *p;
 double tmpf;
@@ -365,12 +679,18 @@ PrecalcCoefs(p->vps.Coefs[1],p->LumTmp);
 
 }
 
+void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_index)
+{
+frei0r_async_set_param(&((inst*)instance)->async,parm,param_index,F0R_PARAM_DOUBLE);
+}
+
 //--------------------------------------------------
 void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_index)
 {
 inst *p;
 
 p=(inst*)instance;
+frei0r_async_wait(&p->async);
 
 switch(param_index)
 	{
@@ -384,35 +704,163 @@ switch(param_index)
 }
 
 //-------------------------------------------------
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+static void hqdn3d_update(f0r_instance_t instance, double time,
+                          const uint32_t* inframe, const uint32_t* inframe2,
+                          const uint32_t* inframe3, uint32_t* outframe)
 {
 inst *in;
-int i;
+int mode;
 
 assert(instance);
 in=(inst*)instance;
 
-//Frei0r works with packed color, Mplayer with planar color
-//I decided to copy data rather than modify the hqdn3d functions
-//this takes some time, but future inmprovements in hqdn3d
-//functions can be simply copied here without modification
+//Frei0r works with packed color, Mplayer with planar color.
+//The passes read and write the packed frames, each row of the
+//previous frame is kept as three planar rows of 8.8 pixels
+if (!in->vps.Frame || in->restart)
+	{
+	int x,y,w=in->w;
+	hqdn3d_buffers(in);
+	in->restart=0;
+	for (y=0;y<in->h;y++)
+		{
+		unsigned short *dst=&in->vps.Frame[3*y*w];
+		const uint32_t *src=&inframe[y*w];
+		for (x=0;x<w;x++)
+			{
+			dst[x]=(src[x]&255)<<8;
+			dst[w+x]=((src[x]>>8)&255)<<8;
+			dst[2*w+x]=((src[x]>>16)&255)<<8;
+			}
+		}
+	}
 
-for (i=0;i<(in->w*in->h);i++)	//copy to planar
+mode=deNoiseMode(in->vps.Coefs[0],in->vps.Coefs[1]);
+if ((in->quality==F0R_QUALITY_DRAFT)&&(mode&DENOISE_SPACIAL))
+	mode=DENOISE_SPACIAL;
+
+if (in->threads>1)
 	{
-	in->Rplani[i]=inframe[i]&255;
-	in->Gplani[i]=(inframe[i]>>8)&255;
-	in->Bplani[i]=(inframe[i]>>16)&255;
+	hqdn3d_update_threaded(in,mode,inframe,outframe);
+	return;
 	}
 
-deNoise(in->Rplani, in->Rplano, in->vps.Line, &in->vps.Frame[0], in->w, in->h, in->w, in->w, in->vps.Coefs[0], in->vps.Coefs[0], in->vps.Coefs[1]);
-deNoise(in->Gplani, in->Gplano, in->vps.Line, &in->vps.Frame[1], in->w, in->h, in->w, in->w, in->vps.Coefs[0], in->vps.Coefs[0], in->vps.Coefs[1]);
-deNoise(in->Bplani, in->Bplano, in->vps.Line, &in->vps.Frame[2], in->w, in->h, in->w, in->w, in->vps.Coefs[0], in->vps.Coefs[0], in->vps.Coefs[1]);
+hqdn3d_rows(in,mode,inframe,outframe,0,in->w);
+}
+
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+assert(instance);
+frei0r_async_wait(&((inst*)instance)->async);
+hqdn3d_update(instance,time,inframe,0,0,outframe);
+}
+
+//-------------------------------------------------
+//Drafts don't keep the previous frame, so the temporal filter starts
+//again from the next frame when they end
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+inst *in;
 
-for (i=0;i<(in->w*in->h);i++)	//copy to packed, preserve alpha
+assert(instance);
+in=(inst*)instance;
+frei0r_async_wait(&in->async);
+if ((in->quality==F0R_QUALITY_DRAFT)&&(quality!=F0R_QUALITY_DRAFT))
 	{
-	outframe[i]=((uint32_t)in->Rplano[i])|((uint32_t)in->Gplano[i]<<8)|((uint32_t)in->Bplano[i]<<16)|(inframe[i]&0xFF000000);
+	free(in->vps.Frame);
+	in->vps.Frame=NULL;
 	}
+in->quality=quality;
+return 1;
+}
 
+//-------------------------------------------------
+//the next update allocates the buffers again and starts over from its
+//frame, like the first one
+int f0r_trim(f0r_instance_t instance)
+{
+inst *in;
+int had;
+
+assert(instance);
+in=(inst*)instance;
+frei0r_async_wait(&in->async);
+had=(in->vps.Frame!=NULL)||(in->Hor!=NULL);
+free(in->vps.Line);
+free(in->vps.Frame);
+free(in->Hor);
+in->vps.Line=NULL;
+in->vps.Frame=NULL;
+in->Hor=NULL;
+return had;
+}
+
+//-------------------------------------------------
+//the buffers are kept, the next update starts over from its frame
+int f0r_reset(f0r_instance_t instance)
+{
+inst *in;
 
+assert(instance);
+in=(inst*)instance;
+frei0r_async_wait(&in->async);
+in->restart=1;
+return 1;
 }
 
+//-------------------------------------------------
+//the coefficient tables are kept, the buffers go like with f0r_trim
+int f0r_resize(f0r_instance_t instance, unsigned int width, unsigned int height)
+{
+inst *in;
+
+assert(instance);
+in=(inst*)instance;
+f0r_trim(instance);
+in->w=width;
+in->h=height;
+in->threads=hqdn3d_threads(width,height);
+return 1;
+}
+
+//-------------------------------------------------
+//the coefficient tables are part of the instance; updates go over the
+//row buffers and, unless they are drafts, over the previous frame
+int f0r_get_memory_usage(f0r_instance_t instance, f0r_memory_usage_t* usage)
+{
+inst *in;
+size_t np,line,hor,frame;
+
+assert(instance);
+in=(inst*)instance;
+frei0r_async_wait(&in->async);
+np=(size_t)in->w*in->h;
+line=3*(size_t)in->w*sizeof(int);
+hor=(in->threads>1 ? 3*np : 3*(size_t)in->w)*sizeof(unsigned int);
+frame=3*np*sizeof(unsigned short);
+usage->resident=(in->vps.Line ? line : 0)+(in->Hor ? hor : 0)
+	+(in->vps.Frame ? frame : 0);
+usage->touched=2*np*sizeof(uint32_t)+line+hor
+	+((in->quality==F0R_QUALITY_DRAFT) ? 0 : frame);
+return 1;
+}
+
+//-------------------------------------------------
+int f0r_set_async_depth(f0r_instance_t instance, int depth)
+{
+return frei0r_async_set_depth(&((inst*)instance)->async,depth);
+}
+
+int f0r_update_async(f0r_instance_t instance, double time,
+                     const uint32_t* inframe1, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     f0r_async_done_t done, void* user)
+{
+return frei0r_async_submit(&((inst*)instance)->async,time,inframe1,
+                           inframe2,inframe3,outframe,done,user);
+}
+
+void f0r_wait_async(f0r_instance_t instance)
+{
+frei0r_async_wait(&((inst*)instance)->async);
+}
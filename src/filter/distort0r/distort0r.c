@@ -6,6 +6,7 @@
 #include <math.h>
 
 #include "frei0r.h"
+#include "frei0r_thread.h"
 
 
 #define GRID_SIZE_LOG 3
@@ -23,6 +24,11 @@ typedef struct distorter_instance
   unsigned int width, height;
   double amplitude, frequency, change_speed;
   grid_point_t* grid;
+  /* the factors of the grid columns and rows, see plasmaGrid() */
+  double* col_d;
+  double* col_sin;
+  double* row_d;
+  double* row_sin;
   double time_stack;
   double mode;
 } distorter_instance_t;
@@ -32,7 +38,8 @@ const double FREQUENCY_SCALE = 200.0;
 const double SPEED_SCALE = 2.0;
 
 void interpolateGrid(grid_point_t* grid, unsigned int w, unsigned int h,
-		     const uint32_t* src, uint32_t* dst);
+		     const uint32_t* src, uint32_t* dst,
+		     unsigned int row_begin, unsigned int row_end);
 
 int f0r_init()
 {
@@ -55,6 +62,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* distorterInfo)
   distorterInfo->explanation = "Plasma";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_TEMPORAL;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -89,6 +102,11 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->grid = 
     (grid_point_t*)malloc(sizeof(grid_point_t)*
 			  ((width/GRID_SIZE)+1)*((height/GRID_SIZE)+1));
+  inst->col_d =
+    (double*)malloc(sizeof(double)*2*((width/GRID_SIZE)+(height/GRID_SIZE)+2));
+  inst->col_sin = inst->col_d + (width/GRID_SIZE)+1;
+  inst->row_d = inst->col_sin + (width/GRID_SIZE)+1;
+  inst->row_sin = inst->row_d + (height/GRID_SIZE)+1;
   inst->amplitude = 1.0;
   inst->frequency = 1.0;
   inst->change_speed = 1.0;
@@ -101,9 +119,18 @@ void f0r_destruct(f0r_instance_t instance)
 {
   distorter_instance_t* inst = (distorter_instance_t*)instance;
   free(inst->grid);
+  free(inst->col_d);
   free(inst);
 }
 
+/* The time the grid moves by in the time stack mode starts over. */
+int f0r_reset(f0r_instance_t instance)
+{
+  assert(instance);
+  ((distorter_instance_t*)instance)->time_stack = 0.0;
+  return 1;
+}
+
 void f0r_set_param_value(f0r_instance_t instance, 
 			 f0r_param_t param, int param_index)
 {
@@ -162,21 +189,58 @@ void f0r_get_param_value(f0r_instance_t instance,
 
 }
 
-/* this will compute a displacement value such that 
-   0<=x_retval<xsize and 0<=y_retval<ysize. */ 
-static inline void plasmaFunction
-(int32_t* x_retval, int32_t* y_retval, 
- unsigned int x, unsigned int y,
- unsigned int w, unsigned int h,
- double amp, double freq, double t)
+/* this will compute the displacement values of the grid points such
+   that 0<=x_retval<xsize and 0<=y_retval<ysize:
+   x + amp*(w/4)*dx(x)*sin(freq*y/h + time) and
+   y + amp*(h/4)*dy(y)*sin(freq*x/w + time) in 16.16 fixed point.
+   Each factor depends on the column or the row alone, so they are
+   computed once per column and row of the grid. */
+static void plasmaGrid(distorter_instance_t* inst, double t)
 {
+  unsigned int w = inst->width;
+  unsigned int h = inst->height;
+  double amp = inst->amplitude;
+  double freq = inst->frequency;
   double time = fmod(t, 2*M_PI);
   double h_ = (double)h -1; double w_ = (double)w-1;
-  double dx = (-4./(w_*w_)*x + 4./w_)*x;
-  double dy = (-4./(h_*h_)*y + 4./h_)*y;
-  *x_retval = (int32_t)(65536.0*((double)x+amp*(w/4)*dx*sin(freq*y/h + time)));
-  *y_retval = (int32_t)(65536.0*((double)y+amp*(h/4)*dy*sin(freq*x/w + time)));
+  grid_point_t* pt = inst->grid;
+  unsigned int x, y, i, j;
+
+  for(x=0, i=0; x<=w; x+=GRID_SIZE, ++i)
+    {
+      inst->col_d[i] = (-4./(w_*w_)*x + 4./w_)*x;
+      inst->col_sin[i] = sin(freq*x/w + time);
+    }
+  for(y=0, j=0; y<=h; y+=GRID_SIZE, ++j)
+    {
+      inst->row_d[j] = (-4./(h_*h_)*y + 4./h_)*y;
+      inst->row_sin[j] = sin(freq*y/h + time);
+    }
+
+  for(y=0, j=0; y<=h; y+=GRID_SIZE, ++j)
+    for(x=0, i=0; x<=w; x+=GRID_SIZE, ++i, ++pt)
+      {
+	pt->u = (int32_t)(65536.0*((double)x+amp*(w/4)*inst->col_d[i]*inst->row_sin[j]));
+	pt->v = (int32_t)(65536.0*((double)y+amp*(h/4)*inst->row_d[j]*inst->col_sin[i]));
+      }
+}
+
+typedef struct distorter_job
+{
+  grid_point_t* grid;
+  unsigned int w, h;
+  const uint32_t* src;
+  uint32_t* dst;
+  unsigned int row_begin, row_end; /* of grid cells */
+} distorter_job_t;
 
+static void* distorter_rows(void* arg)
+{
+  distorter_job_t* job = (distorter_job_t*)arg;
+
+  interpolateGrid(job->grid, job->w, job->h, job->src, job->dst,
+		  job->row_begin, job->row_end);
+  return 0;
 }
 
 void f0r_update(f0r_instance_t instance, double time,
@@ -186,29 +250,36 @@ void f0r_update(f0r_instance_t instance, double time,
   distorter_instance_t* inst = (distorter_instance_t*)instance;
   unsigned int w = inst->width;
   unsigned int h = inst->height;
-  unsigned int x,y;
+  unsigned int grid_y = h / GRID_SIZE;
+  distorter_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)w * h);
 
   inst->time_stack+=inst->change_speed;
 
-  grid_point_t* pt = inst->grid;
-  for(y=0;y<=h;y+= GRID_SIZE)    
-      for(x=0;x<=w;x+=GRID_SIZE,++pt)
-	{
-	  plasmaFunction(&pt->u, &pt->v, x, y, w, h, 
-	                 inst->amplitude, inst->frequency, inst->mode?inst->time_stack:time);
-	}
+  plasmaGrid(inst, inst->mode?inst->time_stack:time);
 
-  interpolateGrid(inst->grid, w, h, inframe, outframe);
+  for (i = 0; i < n; ++i)
+    {
+      jobs[i].grid = inst->grid;
+      jobs[i].w = w;
+      jobs[i].h = h;
+      jobs[i].src = inframe;
+      jobs[i].dst = outframe;
+      jobs[i].row_begin = grid_y * i / n;
+      jobs[i].row_end = grid_y * (i + 1) / n;
+    }
+  frei0r_thread_run(distorter_rows, jobs, sizeof(distorter_job_t), n);
 }
 
+/* fills the cells of the grid rows [row_begin, row_end) */
 void interpolateGrid(grid_point_t* grid, unsigned int w, unsigned int h,
-		     const uint32_t* src, uint32_t* dst)
+		     const uint32_t* src, uint32_t* dst,
+		     unsigned int row_begin, unsigned int row_end)
 {
   unsigned int x, y, block_x, block_y;
   unsigned int tex_x = 0, tex_y = 0;
   unsigned int grid_x = (w / GRID_SIZE);
-  unsigned int grid_y = (h / GRID_SIZE);
-  for(y=0, tex_y=0; y < grid_y; y++)
+  for(y=row_begin, tex_y=0; y < row_end; y++)
     {
       for(x=0, tex_x=0; x < grid_x; x++)
 	{
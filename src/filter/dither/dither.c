@@ -28,6 +28,20 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(FREI0R_HAVE_PTHREAD)
+#include <sched.h>
+/* the rows of the error diffusion run on several threads */
+#define DITHER_WAVEFRONT 1
+#endif
+
+/* pixels of a row between the checks of the row above, see dither_fs_rows */
+#define DITHER_FS_BLOCK 64
 
 int ditherMagic2x2Matrix[] = {
 	 	 0, 2,
@@ -140,8 +154,36 @@ typedef struct dither_instance
   unsigned int height;
   double levels;
   double matrixid;
+  double errordiffusion;
+  int* error;         /* two rows of weighted errors, see dither_fs_rows */
+  int* progress;      /* pixels done per row in the error diffusion */
+  unsigned int next_row;
 } dither_instance_t;
 
+/* the look-ups of a frame */
+typedef struct dither_tables
+{
+  int levels;
+  int rows, cols;
+  const int* matrix;
+  int rc;
+  int map[50];
+  int div[256];
+  int mod[256];
+  /* map[d] is mulhi(255 * d, map_mul) >> map_shift, or 255 * d for two
+     levels; map_mul is 0 if no such multiplier was found */
+  int map_mul, map_shift;
+} dither_tables_t;
+
+typedef struct dither_job
+{
+  dither_instance_t* inst;
+  const dither_tables_t* tables;
+  const uint32_t* inframe;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} dither_job_t;
+
 int f0r_init()
 {
   return 1;
@@ -158,11 +200,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* dither_info)
   dither_info->color_model = F0R_COLOR_MODEL_RGBA8888;
   dither_info->frei0r_version = FREI0R_MAJOR_VERSION;
   dither_info->major_version = 0; 
-  dither_info->minor_version = 1; 
-  dither_info->num_params =  2; 
+  dither_info->minor_version = 2; 
+  dither_info->num_params =  3; 
   dither_info->explanation = "Dithers the image and reduces the number of available colors";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -177,6 +225,11 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
     info->type = F0R_PARAM_DOUBLE;
     info->explanation = "Id of matrix used for dithering";
     break;
+  case 2:
+    info->name = "errordiffusion";
+    info->type = F0R_PARAM_BOOL;
+    info->explanation = "Diffuse the error (Floyd-Steinberg) instead of using the matrix";
+    break;
   }
 }
 
@@ -194,6 +247,9 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  dither_instance_t* inst = (dither_instance_t*)instance;
+  free(inst->error);
+  free(inst->progress);
   free(instance);
 }
 
@@ -211,6 +267,9 @@ void f0r_set_param_value(f0r_instance_t instance,
   case 1:
     inst->matrixid = *((double*)param);
     break;
+  case 2:
+    inst->errordiffusion = *((double*)param);
+    break;
   }
 }
 
@@ -228,18 +287,14 @@ void f0r_get_param_value(f0r_instance_t instance,
   case 1:
     *((double*)param) = inst->matrixid;
     break;
+  case 2:
+    *((double*)param) = inst->errordiffusion;
+    break;
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+static void dither_init_tables(const dither_instance_t* inst, dither_tables_t* t)
 {
-  //init and get params
-  assert(instance);
-  dither_instance_t* inst = (dither_instance_t*)instance;
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-
   double levelsInput = inst->levels * 48.0;
   levelsInput = CLAMP(levelsInput, 0.0, 48.0) + 2.0;
   int levels = (int)levelsInput;
@@ -247,56 +302,258 @@ void f0r_update(f0r_instance_t instance, double time,
   double matrixIdInput = inst->matrixid * 9.0;
   matrixIdInput = CLAMP(matrixIdInput, 0.0, 9.0);
   int matrixid = (int)matrixIdInput;
-  int* matrix = matrixes[matrixid];
-  int matrixLength = matrixSizes[matrixid];
-
-  // init look-ups
-	int rows, cols;
-  rows = cols = (int)sqrt(matrixLength);
-  int map[levels];
-  int i,v;
-	for (i = 0; i < levels; i++)
+  int i, s;
+
+  t->levels = levels;
+  t->matrix = matrixes[matrixid];
+  t->rows = t->cols = (int)sqrt(matrixSizes[matrixid]);
+  t->rc = t->rows * t->cols + 1;
+  for (i = 0; i < levels; i++)
+    t->map[i] = 255 * i / (levels-1);
+  for (i = 0; i < 256; i++)
   {
-		v = 255 * i / (levels-1);
-		map[i] = v;
-	}
-
-	int div[256];
-	int mod[256];
-	int rc = (rows * cols + 1);
-	for (i = 0; i < 256; i++)
+    t->div[i] = (levels-1) * i / 256;
+    t->mod[i] = i * t->rc / 256;
+  }
+
+  /* the division of map by a multiplication, with the most precise
+     multiplier that fits 16 bits and is exact for all levels */
+  t->map_mul = levels == 2 ? 1 : 0;
+  t->map_shift = 0;
+  for (s = 8; s >= 0 && !t->map_mul; s--)
   {
-		div[i] = (levels-1) * i / 256;
-		mod[i] = i * rc /256;
-	}
-
-  // filter image
-  unsigned int width = inst->width;
-  unsigned int height = inst->height;
-  unsigned int x,y,col,row;
+    int m = ((1 << (16 + s)) + levels - 2) / (levels - 1);
+    if (m > 65535)
+      continue;
+    for (i = 0; i < levels; i++)
+      if ((((255 * i * m) >> 16) >> s) != t->map[i])
+        break;
+    if (i == levels)
+    {
+      t->map_mul = m;
+      t->map_shift = s;
+    }
+  }
+}
+
+/* one row of the ordered dither: each channel goes to the level below
+   or above it, depending on the threshold of the matrix */
+static void dither_row(const dither_tables_t* t, const uint32_t* in,
+                       uint32_t* out, unsigned int width, unsigned int y)
+{
+  const unsigned char* src = (const unsigned char*)in;
+  unsigned char* dst = (unsigned char*)out;
+  const int* thresholds = t->matrix + (y % t->rows) * t->cols;
+  unsigned int x = 0, col;
   unsigned char r, g, b;
-  for (y = 0; y < height; ++y)
+  int v;
+
+#if defined(__SSE2__)
+  if (t->map_mul && t->cols % 2 == 0)
+  {
+    /* the thresholds of the pixel pairs of the row, repeating every
+       cols / 2 pairs, in the 16 bit lanes of the colors; alpha is never
+       above its threshold and replaced anyway */
+    __m128i tv[8];
+    const int pairs = t->cols / 2;
+    const __m128i z = _mm_setzero_si128();
+    const __m128i rc = _mm_set1_epi16((short)t->rc);
+    const __m128i lm1 = _mm_set1_epi16((short)(t->levels - 1));
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i mul = _mm_set1_epi16((short)t->map_mul);
+    const __m128i shift = _mm_cvtsi32_si128(t->map_shift);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    __m128i p, c[2], m, d;
+    int k, h;
+
+    for (k = 0; k < pairs; k++)
+    {
+      const short t0 = (short)thresholds[2*k], t1 = (short)thresholds[2*k + 1];
+      tv[k] = _mm_set_epi16(32767, t1, t1, t1, 32767, t0, t0, t0);
+    }
+    for (k = 0; x + 4 <= width; x += 4)
+    {
+      p = _mm_loadu_si128((const __m128i*)(in + x));
+      c[0] = _mm_unpacklo_epi8(p, z);
+      c[1] = _mm_unpackhi_epi8(p, z);
+      for (h = 0; h < 2; h++)
+      {
+        m = _mm_srli_epi16(_mm_mullo_epi16(c[h], rc), 8);
+        d = _mm_srli_epi16(_mm_mullo_epi16(c[h], lm1), 8);
+        d = _mm_sub_epi16(d, _mm_cmpgt_epi16(m, tv[k]));
+        c[h] = _mm_mullo_epi16(d, c255);
+        if (t->levels > 2)
+          c[h] = _mm_srl_epi16(_mm_mulhi_epu16(c[h], mul), shift);
+        if (++k == pairs)
+          k = 0;
+      }
+      p = _mm_or_si128(_mm_andnot_si128(alpha, _mm_packus_epi16(c[0], c[1])),
+                       _mm_and_si128(p, alpha));
+      _mm_storeu_si128((__m128i*)(out + x), p);
+    }
+  }
+#endif
+
+  src += 4 * x;
+  dst += 4 * x;
+  for (; x < width; ++x)
   {
-      for (x=0; x < width; ++x)
+    r = *src++;
+    g = *src++;
+    b = *src++;
+
+    col = x % t->cols;
+    v = thresholds[col];
+    r = t->map[t->mod[r] > v ? t->div[r] + 1 : t->div[r]];
+    g = t->map[t->mod[g] > v ? t->div[g] + 1 : t->div[g]];
+    b = t->map[t->mod[b] > v ? t->div[b] + 1 : t->div[b]];
+
+    *dst++ = r;
+    *dst++ = g;
+    *dst++ = b;
+    *dst++ = *src++;//copy alpha
+  }
+}
+
+static void* dither_rows(void* arg)
+{
+  dither_job_t* job = (dither_job_t*)arg;
+  unsigned int width = job->inst->width;
+  unsigned int y;
+
+  for (y = job->row_begin; y < job->row_end; ++y)
+    dither_row(job->tables, job->inframe + width * y,
+               job->outframe + width * y, width, y);
+  return 0;
+}
+
+#if defined(DITHER_WAVEFRONT)
+#define DITHER_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define DITHER_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define DITHER_NEXT_ROW(p) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#else
+#define DITHER_LOAD(p) (*(p))
+#define DITHER_STORE(p, v) (*(p) = (v))
+#define DITHER_NEXT_ROW(p) ((*(p))++)
+#endif
+
+/* Floyd-Steinberg error diffusion. Pixel (x, y) needs the errors of
+   (x - 1, y) and of x - 1 to x + 1 in row y - 1, so each row can follow
+   the row above it as soon as that is two pixels ahead: the threads take
+   the rows in turn and run along them as a wavefront, in blocks of
+   DITHER_FS_BLOCK pixels, waiting for progress[y - 1] where needed. As
+   the threads only wait for rows taken before theirs, which are being
+   worked on, they can't wait for each other in a circle, whether they
+   run at the same time or not.
+
+   The errors times 16 for row y are in slot x + 1 of error row y & 1,
+   per channel, and for row y + 1 in the other one. Pixel x of row y
+   reads slot x + 1 of its row and is the first to write slot x + 2 of
+   the next, so the rows need no clearing: the next but one row only
+   writes a slot after this row has read it. */
+static void* dither_fs_rows(void* arg)
+{
+  dither_job_t* job = (dither_job_t*)arg;
+  dither_instance_t* inst = job->inst;
+  const dither_tables_t* t = job->tables;
+  const unsigned int width = inst->width, height = inst->height;
+  const int lm1 = t->levels - 1;
+  const size_t stride = 3 * (width + 2);
+  unsigned int y, x, x0, x1;
+  int k;
+
+  while ((y = DITHER_NEXT_ROW(&inst->next_row)) < height)
+  {
+    const unsigned char* src = (const unsigned char*)(job->inframe + width * y);
+    unsigned char* dst = (unsigned char*)(job->outframe + width * y);
+    const int* cur = inst->error + (y & 1) * stride;
+    int* next = inst->error + ((y + 1) & 1) * stride;
+    int carry[3] = { 0, 0, 0 };
+
+    for (x0 = 0; x0 < width; x0 = x1)
+    {
+      x1 = MIN(width, x0 + DITHER_FS_BLOCK);
+      if (y > 0)
+        while (DITHER_LOAD(&inst->progress[y - 1]) < (int)MIN(width, x1 + 1))
+        {
+#if defined(DITHER_WAVEFRONT)
+          sched_yield();
+#endif
+        }
+      /* the row above is done with the first two slots */
+      if (x0 == 0)
+        for (k = 0; k < 6; k++)
+          next[k] = 0;
+
+      for (x = x0; x < x1; x++)
       {
-        r = *src++;
-        g = *src++;
-        b = *src++;
-
-	      col = x % cols;
-	      row = y % rows;
-
-	      v = matrix[ row * cols + col];
-	      r = map[mod[r] > v ? div[r] + 1 : div[r]];
-		    g = map[mod[g] > v ? div[g] + 1 : div[g]];
-		    b = map[mod[b] > v ? div[b] + 1 : div[b]];
-
-        *dst++ = r;
-        *dst++ = g;
-        *dst++ = b;
-        *dst++ = *src++;//copy alpha
+        for (k = 0; k < 3; k++)
+        {
+          int v = src[4*x + k] + ((cur[3*(x + 1) + k] + carry[k] + 8) >> 4);
+          int level, e;
+
+          v = CLAMP(v, 0, 255);
+          level = t->map[(v * lm1 * 2 + 255) / 510];
+          e = v - level;
+          dst[4*x + k] = (unsigned char)level;
+          carry[k] = 7 * e;
+          next[3*x + k] += 3 * e;
+          next[3*(x + 1) + k] += 5 * e;
+          next[3*(x + 2) + k] = e;
+        }
+        dst[4*x + 3] = src[4*x + 3];
       }
+      DITHER_STORE(&inst->progress[y], (int)x1);
+    }
   }
+  return 0;
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  dither_instance_t* inst = (dither_instance_t*)instance;
+  dither_tables_t tables;
+  dither_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+  dither_init_tables(inst, &tables);
 
+  if (inst->errordiffusion >= 0.5)
+  {
+    if (!inst->error)
+    {
+      inst->error = (int*)calloc(6 * (inst->width + 2), sizeof(int));
+      inst->progress = (int*)malloc(inst->height * sizeof(int));
+      if (!inst->error || !inst->progress)
+      {
+        free(inst->error);
+        free(inst->progress);
+        inst->error = inst->progress = 0;
+        return;
+      }
+    }
+    /* the first row reads no errors */
+    for (i = 0; i < 3 * ((int)inst->width + 2); i++)
+      inst->error[i] = 0;
+    for (i = 0; i < (int)inst->height; i++)
+      inst->progress[i] = 0;
+    inst->next_row = 0;
+#if !defined(DITHER_WAVEFRONT)
+    n = 1;
+#endif
+  }
+
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].inst = inst;
+    jobs[i].tables = &tables;
+    jobs[i].inframe = inframe;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(inst->errordiffusion >= 0.5 ? dither_fs_rows : dither_rows,
+                    jobs, sizeof(dither_job_t), n);
+}
@@ -19,8 +19,13 @@
 
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_neighbourhood.h"
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 class edgeglow : public frei0r::filter
 {
 public:
@@ -32,6 +37,7 @@ public:
 
   edgeglow(unsigned int width, unsigned int height)
   {
+    memoize = true;
     lthresh = 0.0;
     lupscale = 0.0;
     lredscale = 0.0;
@@ -44,138 +50,154 @@ public:
                       uint32_t* out,
                       const uint32_t* in)
   {
-    std::copy(in, in + width*height, out);
-    for (unsigned int y=1; y<height-1; ++y)
+    m_in = in;
+    m_out = out;
+    if (width < 3 || height < 3 ||
+        !frei0r_neighbourhood_run(in, width, height, 4, 1, row, this,
+                                  2*4*width*sizeof(int16_t)))
+      std::copy(in, in + width*height, out);
+  }
+
+private:
+  const uint32_t* m_in;
+  uint32_t* m_out;
+
+  // The border pixels keep their input color.
+  static void row(void* user, const uint8_t* const* rows, int y,
+                  void* scratch)
+  {
+    static const int16_t kx[9] = {  1,  2,  1,
+                                    0,  0,  0,
+                                   -1, -2, -1 };
+    static const int16_t ky[9] = { -1,  0,  1,
+                                   -2,  0,  2,
+                                   -1,  0,  1 };
+    edgeglow* f = (edgeglow*)user;
+    const unsigned int width = f->width;
+    const uint32_t* in = f->m_in + (size_t)y*width;
+    uint32_t* out = f->m_out + (size_t)y*width;
+    int16_t* gx = (int16_t*)scratch;
+    int16_t* gy = gx + 4*width;
+
+    if (y == 0 || y == (int)f->height-1)
+    {
+      std::copy(in, in + width, out);
+      return;
+    }
+
+    // the sobel edges
+    frei0r_neighbourhood_conv(gx, rows, 4*width, 4, 1, kx);
+    frei0r_neighbourhood_conv(gy, rows, 4*width, 4, 1, ky);
+    frei0r_neighbourhood_abs_sum((uint8_t*)out, gx, gy, 4*width);
+    out[0] = in[0];
+    out[width-1] = in[width-1];
+
+    f->glow(out + 1, in + 1, width - 2);
+  }
+
+  // Each of the n edge pixels in g is the sobel edge of its input pixel
+  // in p, and becomes the output pixel. The lightness of the edge, the
+  // average of its largest and smallest color, decides the new lightness
+  // L of the pixel: above the threshold it is added to that of the pixel,
+  // else lredscale darkens the pixel. The colors then keep their distances
+  // from the lightness l of the pixel, scaled by (L - 1) / (l - 1). That
+  // is what the former per pixel conversion to HSL and back came to, with
+  // lightness in 0..255 and saturation from the 0..1 formula, save for
+  // the hue that it rounded to whole degrees and for l = 1, where it
+  // divided by zero and which is now gray. With SSE2 four pixels are done
+  // per step, in floats.
+  void glow(uint32_t* g, const uint32_t* p, unsigned int n)
+  {
+    const float lt = lthresh*255.;
+    const float up = lupscale;
+    const float red = 1. - lredscale;
+    const bool reduce = lredscale > 0.;
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i byte = _mm_set1_epi32(0xff);
+    const __m128 vlt = _mm_set1_ps(lt), vup = _mm_set1_ps(up);
+    const __m128 vred = _mm_set1_ps(red);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+    const __m128 half = _mm_set1_ps(.5f), c255 = _mm_set1_ps(255.f);
+    const __m128 vreduce = _mm_castsi128_ps(_mm_set1_epi32(reduce ? -1 : 0));
+
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128i e = _mm_loadu_si128((const __m128i*)(g + i));
+      __m128i s = _mm_loadu_si128((const __m128i*)(p + i));
+      __m128 c[3], le, l0, mx, mn, L, apply, k, keep;
+
+      for (int b = 0; b < 3; ++b)
+        c[b] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(e, 8*b), byte));
+      mx = _mm_max_ps(_mm_max_ps(c[0], c[1]), c[2]);
+      mn = _mm_min_ps(_mm_min_ps(c[0], c[1]), c[2]);
+      le = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(mx, mn), half)));
+
+      for (int b = 0; b < 3; ++b)
+        c[b] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(s, 8*b), byte));
+      mx = _mm_max_ps(_mm_max_ps(c[0], c[1]), c[2]);
+      mn = _mm_min_ps(_mm_min_ps(c[0], c[1]), c[2]);
+      l0 = _mm_mul_ps(_mm_add_ps(mx, mn), half);
+
+      // the new lightness, whole numbers in 0..255
+      __m128 edge = _mm_cmpgt_ps(le, vlt);
+      __m128 lup = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(le, vup), l0),
+                                         zero), c255);
+      __m128 lred = _mm_min_ps(_mm_max_ps(_mm_mul_ps(l0, vred), zero), c255);
+      L = _mm_or_ps(_mm_and_ps(edge, lup),
+                    _mm_andnot_ps(edge, _mm_or_ps(_mm_and_ps(vreduce, lred),
+                                                  _mm_andnot_ps(vreduce, le))));
+      L = _mm_cvtepi32_ps(_mm_cvttps_epi32(L));
+      apply = _mm_or_ps(vreduce, _mm_cmpgt_ps(L, vlt));
+
+      // the scale, 0 for the one lightness where it is undefined
+      k = _mm_sub_ps(l0, one);
+      k = _mm_and_ps(_mm_cmpneq_ps(k, zero), _mm_div_ps(_mm_sub_ps(L, one), k));
+      // a lightness of 0 is black
+      keep = _mm_cmpneq_ps(L, zero);
+
+      __m128i o = _mm_and_si128(s, _mm_set1_epi32((int)0xff000000));
+      for (int b = 0; b < 3; ++b)
+      {
+        __m128 v = _mm_add_ps(L, _mm_mul_ps(_mm_sub_ps(c[b], l0), k));
+        v = _mm_and_ps(keep, _mm_min_ps(_mm_max_ps(v, zero), c255));
+        v = _mm_or_ps(_mm_and_ps(apply, v), _mm_andnot_ps(apply, c[b]));
+        o = _mm_or_si128(o, _mm_slli_epi32(_mm_cvttps_epi32(v), 8*b));
+      }
+      _mm_storeu_si128((__m128i*)(g + i), o);
+    }
+#endif
+
+    for (; i < n; ++i)
     {
-      for (unsigned int x=1; x<width-1; ++x)
+      const unsigned char* e = (const unsigned char*)(g + i);
+      const unsigned char* s = (const unsigned char*)(p + i);
+      unsigned char mx = MAX(MAX(e[0], e[1]), e[2]);
+      unsigned char mn = MIN(MIN(e[0], e[1]), e[2]);
+      float le = (int)((mx + mn)*.5f);
+      float l0, L, k;
+      unsigned char o[4];
+
+      mx = MAX(MAX(s[0], s[1]), s[2]);
+      mn = MIN(MIN(s[0], s[1]), s[2]);
+      l0 = (mx + mn)*.5f;
+      if (le > lt)
+        L = (int)CLAMP(le*up + l0, 0.f, 255.f);
+      else if (reduce)
+        L = (int)CLAMP(l0*red, 0.f, 255.f);
+      else
+        L = le;
+      if (!reduce && !(L > lt))
       {
-        // XXX faut eviter le * width en y allant par rangee
-        unsigned char *p1 = (unsigned char *)&in[(y-1)*width+(x-1)];
-        unsigned char *p2 = (unsigned char *)&in[(y-1)*width+x];
-        unsigned char *p3 = (unsigned char *)&in[(y-1)*width+(x+1)];
-        unsigned char *p4 = (unsigned char *)&in[y*width+(x-1)];
-        unsigned char *p6 = (unsigned char *)&in[y*width+(x+1)];
-        unsigned char *p7 = (unsigned char *)&in[(y+1)*width+(x-1)];
-        unsigned char *p8 = (unsigned char *)&in[(y+1)*width+x];
-        unsigned char *p9 = (unsigned char *)&in[(y+1)*width+(x+1)];
-        
-        unsigned char *g = (unsigned char *)&out[y*width+x];
-        
-        for (int i=0; i<3; ++i)
-          g[i] = CLAMP0255(
-                           abs(p1[i] + p2[i]*2 + p3[i] - p7[i] - p8[i]*2 - p9[i]) +
-                           abs(p3[i] + p6[i]*2 + p9[i] - p1[i] - p4[i]*2 - p7[i]) );
-
-
-	unsigned char *p5 = (unsigned char *)&in[y*width+x];
-
-        g[3] = p5[3]; // copy alpha
-
-	float lt;
-
-	// calculate "lightness"
-	unsigned char R=g[0];
-	unsigned char G=g[1];
-	unsigned char B=g[2];
-
-	unsigned char max=R;
-	if (G>max) max=G;
-	if (B>max) max=B;
-
-	unsigned char min=R;
-	if (G<min) min=G;
-	if (B<min) min=B;
-
-	unsigned char l=(unsigned char) (((float)max+(float)min)/2.);
-
-
-
-	// convert in and out to HSL, add L value of out
-	
-	unsigned int h;
-	float s;
-	
-	R=p5[0];
-	G=p5[1];
-	B=p5[2];
-	
-	max=R;
-	if (G>max) max=G;
-	if (B>max) max=B;
-	
-	min=R;
-	if (G<min) min=G;
-	if (B<min) min=B;
-	
-
-	if (l>(lt=lthresh*255.)) {
-	  // if lightness > threshold, we add it to the lightness of the original
-	  l=CLAMP0255((int32_t)((float)l*lupscale+((float)max+(float)min)/2.));
-	}
-	// otherwise reduce
-	else if (lredscale>0.) {
-	  l=((float)max+(float)min)/2.*(1.-lredscale);
-	}
-
-	if (lredscale>0.||l>lt) {
-	  if (max==min) {
-	    h=0;
-	    s=0.;
-	  }
-	  else {
-	    if (max==R) {
-	      h=(unsigned int)(60.*((float)G-(float)B)/((float)max-(float)min));
-	      if (G<B) h+=360;
-	    }
-	    else {
-	      if (max==G) h=(unsigned int)(60.*((float)B-(float)R)/((float)max-(float)min)+120.);
-	      else h=(unsigned int)(60.*(float)(R-G)/float(max-min)+240.);
-	    }
-	    
-	    if (l<=0.5) s=((float)max-(float)min)/((float)max+(float)min);
-	    else s=((float)max-(float)min)/(2.-((float)max+(float)min));
-	  }
-	  
-	  
-	  // convert back to RGB
-	  
-	  float q;
-	  
-	  if (l<0.5) q=l*(1.+s);
-	  else q=l+s-(l*s);
-	  
-	  float p=2.*l-q;
-	  
-	  float hk=(float)h/360.;
-	  
-	  float tr=hk+1./3.;
-	  float tg=hk;
-	  float tb=hk-1./3.;
-	  
-	  if (tr>1.) tr-=1.;
-	  if (tb<0.) tb+=1.;
-	  
-	  if (tr<1./6.) g[0]=CLAMP0255(p+((q-p)*6.*tr));
-	  else if (tr<0.5) g[0]=CLAMP0255((int32_t)q);
-	  else if (tr<2./3.) g[0]=CLAMP0255(p+((q-p)*6.*(2./3.-tr)));
-	  else g[0]=CLAMP0255((int32_t)p);
-	  
-	  if (tg<1./6.) g[1]=CLAMP0255(p+((q-p)*6.*tg));
-	  else if (tg<0.5) g[1]=CLAMP0255((int32_t)q);
-	  else if (tg<2./3.) g[1]=CLAMP0255(p+((q-p)*6.*(2./3.-tg)));
-	  else g[1]=CLAMP0255((int32_t)p);
-	  
-	  if (tb<1./6.) g[2]=CLAMP0255(p+((q-p)*6.*tb));
-	  else if (tb<0.5) g[2]=CLAMP0255((int32_t)q);
-	  else if (tb<2./3.) g[2]=CLAMP0255(p+((q-p)*6.*(2./3.-tb)));
-	  else g[2]=CLAMP0255((int32_t)p);
-	}
-	else {
-	  g[0]=p5[0];
-	  g[1]=p5[1];
-	  g[2]=p5[2];
-	}
+        g[i] = p[i];
+        continue;
       }
+      k = l0 != 1.f ? (L - 1.f) / (l0 - 1.f) : 0.f;
+      for (int b = 0; b < 3; ++b)
+        o[b] = L != 0.f ? (int)CLAMP(L + (s[b] - l0)*k, 0.f, 255.f) : 0;
+      o[3] = s[3];
+      memcpy(g + i, o, 4);
     }
   }
 };
@@ -25,6 +25,10 @@
 // pow() and other mathematical functions
 #include <cmath>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define PI 3.141592654
 
 /**
@@ -36,10 +40,20 @@ to 16:9 and maintain the original aspect ratio in the center part of the image.
 typedef struct {
     unsigned int higherXPos;
     unsigned int lowerXPos;
-    double lowerWeight;
-    double higherWeight;
+    // the share of the lower and the higher pixel in 15 fractional bits,
+    // once for each channel
+    uint16_t lowerFactor[4];
+    uint16_t higherFactor[4];
 } TransformationElem;
 
+// the share factor of c, c * factor / 32768 truncated, in each 16 bit lane
+#if defined(__SSE2__)
+static inline __m128i shareOf(__m128i c, __m128i factor)
+{
+    return _mm_mulhi_epu16(_mm_slli_epi16(c, 1), factor);
+}
+#endif
+
 
 class ElasticScale : public frei0r::filter
 {
@@ -51,6 +65,7 @@ public:
     {
         this->width = width;
         this->height = height;
+        memoize = true;
 
         register_param(m_scaleCenter,"Center","Horizontal center position of the linear area");
         register_param(m_linearScaleArea,"Linear Width","Width of the linear area");
@@ -73,54 +88,23 @@ public:
         delete[] m_transformationCalculations;
     }
 
-    virtual void update(double time,
-	                    uint32_t* out,
-                        const uint32_t* in)
+    virtual void on_params_changed()
     {
+        updateScalingFactors();
+        calcTransformationFactors();
+    }
 
-        if (m_prev_scaleCenter != m_scaleCenter || m_prev_linearScaleArea != m_linearScaleArea || m_prev_linearScaleFactor != m_linearScaleFactor || m_prev_nonLinearScaleFactor != m_nonLinearScaleFactor)
-        {
-            updateScalingFactors();
-            calcTransformationFactors();
-        }
-
-        // pad the rowWidth to be a multiple of 8
-        unsigned int paddedRowWidth = width;
-        if (paddedRowWidth % 8 != 0)
-        {
-            paddedRowWidth = (unsigned int)(ceil((double)width/8)*8);
-        }
-
-        for (unsigned int colIdx = 0; colIdx < width; colIdx++)
+    virtual bool update_slice(double time,
+                              uint32_t* out,
+                              const uint32_t* in,
+                              unsigned int row_begin,
+                              unsigned int row_end)
+    {
+        for (unsigned int rowIdx = row_begin; rowIdx < row_end; rowIdx++)
         {
-            double lowerWeight = m_transformationCalculations[colIdx].lowerWeight;
-            double higherWeight = m_transformationCalculations[colIdx].higherWeight;
-
-            for (unsigned int rowIdx = 0; rowIdx < height; rowIdx++)
-            {
-                uint32_t newValue = 0;
-                unsigned int lowerXPos = paddedRowWidth * rowIdx + m_transformationCalculations[colIdx].lowerXPos;
-                unsigned int higherXPos = paddedRowWidth * rowIdx + m_transformationCalculations[colIdx].higherXPos;
-                unsigned int curPosDst = paddedRowWidth * rowIdx + colIdx;
-
-                if (higherXPos == lowerXPos) {
-                    newValue = in[higherXPos];
-                } else {
-                    for (int i=0; i<4; i++)
-                    {
-                        uint16_t cFold = uint8_t(in[lowerXPos] >> 8*i);
-                        uint16_t cCold = uint8_t(in[higherXPos] >> 8*i);
-                        cFold = (uint16_t)((double)cFold*(1-lowerWeight));
-                        cCold = (uint16_t)((double)cCold*(1-higherWeight));
-                        newValue |= ((uint8_t)((cFold + cCold)) << 8*i);
-                    }
-                }
-
-                out[curPosDst] = newValue;
-            }
-
+            scaleRow(out + width * rowIdx, in + width * rowIdx);
         }
-
+        return true;
     }
 
 private:
@@ -131,12 +115,6 @@ private:
     double m_linearScaleFactor;
     double m_nonLinearScaleFactor;
 
-    // remember the input params to detect any changes during runtime
-    double m_prev_scaleCenter;
-    double m_prev_linearScaleArea;
-    double m_prev_linearScaleFactor;
-    double m_prev_nonLinearScaleFactor;
-
     // intern params for mapping the input parameters
     double m_intern_scaleCenter;
     double m_intern_linearScaleArea;
@@ -153,12 +131,6 @@ private:
 
     void updateScalingFactors()
     {
-        // update changed parameters
-        m_prev_scaleCenter = m_scaleCenter;
-        m_prev_linearScaleArea = m_linearScaleArea;
-        m_prev_linearScaleFactor = m_linearScaleFactor;
-        m_prev_nonLinearScaleFactor = m_nonLinearScaleFactor;
-
         // write to internal parameters
         m_intern_scaleCenter = m_scaleCenter;
         m_intern_linearScaleArea = m_linearScaleArea;
@@ -292,11 +264,72 @@ private:
                 higherWeight = (double)higherXPos - relativeSrcXPos;
             }
 
-            m_transformationCalculations[colIdx].higherXPos = higherXPos + offsetSrcX;
-            m_transformationCalculations[colIdx].lowerXPos = lowerXPos + offsetSrcX;
-            m_transformationCalculations[colIdx].higherWeight = higherWeight;
-            m_transformationCalculations[colIdx].lowerWeight = lowerWeight;
+            // a pixel of its own is copied
+            uint16_t lowerFactor = 32768, higherFactor = 0;
+            if (higherXPos != lowerXPos)
+            {
+                lowerFactor = (uint16_t)((1 - lowerWeight) * 32768 + 0.5);
+                higherFactor = (uint16_t)((1 - higherWeight) * 32768 + 0.5);
+            }
+
+            TransformationElem& elem = m_transformationCalculations[colIdx];
+            elem.higherXPos = higherXPos + offsetSrcX;
+            elem.lowerXPos = lowerXPos + offsetSrcX;
+            for (int i = 0; i < 4; i++)
+            {
+                elem.lowerFactor[i] = lowerFactor;
+                elem.higherFactor[i] = higherFactor;
+            }
+
+        }
+    }
+
 
+    // blends each pixel of a row from its two source pixels, in fixed
+    // point: the share of each channel of both is truncated
+    void scaleRow(uint32_t* dst, const uint32_t* src)
+    {
+        const TransformationElem* elem = m_transformationCalculations;
+        unsigned int colIdx = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; colIdx + 4 <= width; colIdx += 4, elem += 4)
+        {
+            __m128i lower = _mm_set_epi32(src[elem[3].lowerXPos], src[elem[2].lowerXPos],
+                                          src[elem[1].lowerXPos], src[elem[0].lowerXPos]);
+            __m128i higher = _mm_set_epi32(src[elem[3].higherXPos], src[elem[2].higherXPos],
+                                           src[elem[1].higherXPos], src[elem[0].higherXPos]);
+            __m128i result[2];
+            for (int half = 0; half < 2; half++)
+            {
+                const TransformationElem* e = elem + 2 * half;
+                __m128i lowerFactor = _mm_unpacklo_epi64(
+                    _mm_loadl_epi64((const __m128i*)e[0].lowerFactor),
+                    _mm_loadl_epi64((const __m128i*)e[1].lowerFactor));
+                __m128i higherFactor = _mm_unpacklo_epi64(
+                    _mm_loadl_epi64((const __m128i*)e[0].higherFactor),
+                    _mm_loadl_epi64((const __m128i*)e[1].higherFactor));
+                __m128i l = half ? _mm_unpackhi_epi8(lower, zero) : _mm_unpacklo_epi8(lower, zero);
+                __m128i h = half ? _mm_unpackhi_epi8(higher, zero) : _mm_unpacklo_epi8(higher, zero);
+                result[half] = _mm_add_epi16(shareOf(l, lowerFactor), shareOf(h, higherFactor));
+            }
+            _mm_storeu_si128((__m128i*)(dst + colIdx), _mm_packus_epi16(result[0], result[1]));
+        }
+#endif
+
+        for (; colIdx < width; colIdx++, elem++)
+        {
+            uint32_t lower = src[elem->lowerXPos];
+            uint32_t higher = src[elem->higherXPos];
+            uint32_t newValue = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                unsigned int c = ((uint8_t)(lower >> 8*i) * 2 * elem->lowerFactor[i] >> 16)
+                    + ((uint8_t)(higher >> 8*i) * 2 * elem->higherFactor[i] >> 16);
+                newValue |= (uint32_t)(c > 255 ? 255 : c) << 8*i;
+            }
+            dst[colIdx] = newValue;
         }
     }
 
@@ -306,4 +339,5 @@ frei0r::construct<ElasticScale> plugin("Elastic scale filter",
                 "This is a frei0r filter which allows one to scale video footage non-linearly.",
                 "Matthias Schnoell",
                 0,2,
-                F0R_COLOR_MODEL_RGBA8888);
+                F0R_COLOR_MODEL_RGBA8888,
+                F0R_CAP_RB_SYMMETRIC);
@@ -28,10 +28,24 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_arena.h"
+#include "frei0r_neighbourhood.h"
+#include "frei0r_thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 double PI = 3.14159; 
 double pixelScale = 255.9;
 
+/* the light, derived from the parameters */
+typedef struct emboss_light
+{
+  int Lx, Ly, Nz2, NzLz;
+  unsigned char background;
+} emboss_light_t;
+
 typedef struct emboss_instance
 {
   unsigned int width;
@@ -39,6 +53,9 @@ typedef struct emboss_instance
 	double azimuth;
   double elevation;
 	double width45;
+  emboss_light_t light;
+  int light_valid; // light is up to date with the parameters
+  frei0r_arena_t arena; // per-frame scratch buffers
 } emboss_instance_t;
 
 int f0r_init()
@@ -62,6 +79,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* emposs_info)
   emposs_info->explanation = "Creates embossed relief image of source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -92,20 +115,32 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->azimuth = 135.0 / 360.0; //input range 0 - 1 will be interpreted as angle 0 - 360
   inst->elevation = 30.0 / 90.0;//input range 0 - 1 will be interpreted as lighness value 0 - 90
   inst->width45 = 10.0 / 40.0;//input range 0 - 1 will be interpreted as bump height value 1 - 40
+  frei0r_arena_init(&inst->arena);
 	return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  emboss_instance_t* inst = (emboss_instance_t*)instance;
+  frei0r_arena_release(&inst->arena);
   free(instance);
 }
 
+void f0r_set_allocator(f0r_instance_t instance,
+                       const f0r_allocator_t* allocator)
+{
+  assert(instance);
+  emboss_instance_t* inst = (emboss_instance_t*)instance;
+  frei0r_arena_set_allocator(&inst->arena, allocator);
+}
+
 void f0r_set_param_value(f0r_instance_t instance, 
                          f0r_param_t param, int param_index)
 {
   assert(instance);
   emboss_instance_t* inst = (emboss_instance_t*)instance;
 
+  inst->light_valid = 0;
   switch(param_index)
   {
   case 0:
@@ -140,13 +175,17 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+/* what the rows of the embossed image need */
+typedef struct emboss_frame
+{
+  const uint32_t* in;
+  uint32_t* out;
+  int width, height;
+  emboss_light_t light;
+} emboss_frame_t;
+
+static void emboss_update_light(emboss_instance_t* inst)
 {
-  // Check and cast instance
-  assert(instance);
-  emboss_instance_t* inst = (emboss_instance_t*)instance;
- 
   // Get render params values 0.0-1.0 in range used by filter
   double azimuthInput = inst->azimuth * 360.0;
   double elevationInput = inst->elevation * 90.0;
@@ -162,73 +201,191 @@ void f0r_update(f0r_instance_t instance, double time,
   double elevation = elevationInput * PI / 180.0;
 	double width45 = widthInput;
 
-  // Create brightness image
-  unsigned int len = inst->width * inst->height;
-  unsigned char *bumpPixels=malloc(len);
-  unsigned char *alphaVals=malloc(len);
-  unsigned int index = 0, r = 0, g = 0, b = 0, a = 0;
-  const unsigned char* src = (unsigned char*)inframe;
-  while (len--)
-  {
-    r = *src++;
-    g = *src++;
-    b = *src++;
-    a = *src++;
+  emboss_light_t* l = &inst->light;
+  int Nz, Lz;
+
+  l->Lx = (int)(cos(azimuth) * cos(elevation) * pixelScale);
+  l->Ly = (int)(sin(azimuth) * cos(elevation) * pixelScale);
+  Lz = (int)(sin(elevation) * pixelScale);
+
+  Nz = (int)(6 * 255 / width45);
+  l->Nz2 = Nz * Nz;
+  l->NzLz = Nz * Lz;
+
+  l->background = Lz;
+  inst->light_valid = 1;
+}
+
+typedef struct emboss_luma_job
+{
+  const uint32_t* in;
+  unsigned char* bump;
+  size_t begin, end;
+} emboss_luma_job_t;
+
+/* brightness (r + g + b) / 3 of the pixels [begin, end) */
+static void* emboss_luma(void* arg)
+{
+  emboss_luma_job_t* job = (emboss_luma_job_t*)arg;
+  const unsigned char* src = (const unsigned char*)job->in;
+  size_t i = job->begin;
 
-    bumpPixels[index++] = (r + g + b)/3;
-    alphaVals[index - 1] = a;
+#if defined(__SSE2__)
+  // x / 3 == (x * 0xAAAB) >> 17 for all sums of three bytes
+  const __m128i third = _mm_set1_epi16((short)0xAAAB);
+  const __m128i lo8 = _mm_set1_epi32(0xFF);
+  for (; i + 8 <= job->end; i += 8)
+  {
+    __m128i p0 = _mm_loadu_si128((const __m128i*)(src + 4*i));
+    __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4*i + 16));
+    __m128i s0 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p0, lo8),
+                                             _mm_and_si128(_mm_srli_epi32(p0, 8), lo8)),
+                               _mm_and_si128(_mm_srli_epi32(p0, 16), lo8));
+    __m128i s1 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p1, lo8),
+                                             _mm_and_si128(_mm_srli_epi32(p1, 8), lo8)),
+                               _mm_and_si128(_mm_srli_epi32(p1, 16), lo8));
+    __m128i l = _mm_srli_epi16(_mm_mulhi_epu16(_mm_packs_epi32(s0, s1), third), 1);
+    _mm_storel_epi64((__m128i*)(job->bump + i), _mm_packus_epi16(l, l));
   }
+#endif
+  for (; i < job->end; i++)
+    job->bump[i] = (src[4*i] + src[4*i+1] + src[4*i+2])/3;
+  return 0;
+}
 
-  // Create embossed image from brightness image
-  unsigned char* dst = (unsigned char*)outframe;
-  unsigned char shade, background = 0;
-  int Nx, Ny, Nz, Lx, Ly, Lz, Nz2, NzLz, NdotL;
+/* Output row y-1 from the brightness rows y-1 to y+1, for output rows 1
+   to height-3; its columns 1 to width-3 are shaded, the others are
+   background. */
+static void emboss_row(void* user, const uint8_t* const* rows, int y,
+                       void* scratch)
+{
+  static const int16_t kx[9] = {  1,  0, -1,
+                                  1,  0, -1,
+                                  1,  0, -1 };
+  static const int16_t ky[9] = { -1, -1, -1,
+                                  0,  0,  0,
+                                  1,  1,  1 };
+  const emboss_frame_t* f = (const emboss_frame_t*)user;
+  const emboss_light_t* l = &f->light;
+  int16_t* nx = (int16_t*)scratch;
+  int16_t* ny = nx + f->width;
+  int x;
 
-  Lx = (int)(cos(azimuth) * cos(elevation) * pixelScale);
-  Ly = (int)(sin(azimuth) * cos(elevation) * pixelScale);
-  Lz = (int)(sin(elevation) * pixelScale);
+  if (y < 2 || y > f->height-2)
+    return;
 
-  Nz = (int)(6 * 255 / width45);
-  Nz2 = Nz * Nz;
-  NzLz = Nz * Lz;
-
-  background = Lz;
-  int bumpIndex = 0;
-  int width = inst->width;
-  int height = inst->height;
-  int s1, s2, s3 = 0;
-  int x, y = 0;
-  for (y = 0; y < height; y++, bumpIndex += width) 
+  const uint32_t* src = f->in + (size_t)(y-1) * f->width;
+  uint32_t* dst = f->out + (size_t)(y-1) * f->width;
+  const uint32_t background = l->background * 0x010101u;
+  unsigned char shade;
+  int Nx, Ny, NdotL;
+
+  frei0r_neighbourhood_conv(nx, rows, f->width, 1, 1, kx);
+  frei0r_neighbourhood_conv(ny, rows, f->width, 1, 1, ky);
+
+  dst[0] = background | (src[0] & 0xFF000000);
+  x = 1;
+#if defined(__SSE2__)
+  {
+    const __m128i LxLy = _mm_set1_epi32((int)(((uint32_t)l->Ly << 16) | ((uint32_t)l->Lx & 0xFFFF)));
+    const __m128i NzLz = _mm_set1_epi32(l->NzLz);
+    const __m128d Nz2 = _mm_set1_pd(l->Nz2);
+    const __m128i vbackground = _mm_set1_epi32(l->background);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    const __m128i byte = _mm_set1_epi32(0xFF);
+
+    // 4 pixels at a time, the same double arithmetic as below
+    for (; x + 4 <= f->width-2; x += 4)
+    {
+      __m128i n = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(nx + x)),
+                                     _mm_loadl_epi64((const __m128i*)(ny + x)));
+      __m128i NdotL4 = _mm_add_epi32(_mm_madd_epi16(n, LxLy), NzLz);
+      __m128i NxNy2 = _mm_madd_epi16(n, n);
+      __m128d lo = _mm_div_pd(_mm_cvtepi32_pd(NdotL4),
+                              _mm_sqrt_pd(_mm_add_pd(_mm_cvtepi32_pd(NxNy2), Nz2)));
+      __m128d hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(NdotL4, 8)),
+                              _mm_sqrt_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(NxNy2, 8)), Nz2)));
+      __m128i shade4 = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+      __m128i flat = _mm_cmpeq_epi32(n, zero);
+
+      shade4 = _mm_and_si128(_mm_andnot_si128(_mm_cmplt_epi32(NdotL4, zero), shade4), byte);
+      shade4 = _mm_or_si128(_mm_and_si128(flat, vbackground),
+                            _mm_andnot_si128(flat, shade4));
+      shade4 = _mm_or_si128(shade4, _mm_slli_epi32(shade4, 8));
+      shade4 = _mm_or_si128(_mm_or_si128(shade4, _mm_slli_epi32(shade4, 8)),
+                            _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x)), alpha));
+      _mm_storeu_si128((__m128i*)(dst + x), shade4);
+    }
+  }
+#endif
+  for (; x < f->width; x++)
   {
-    s1 = bumpIndex;
-    s2 = s1 + width;
-    s3 = s2 + width;
-    for (x = 0; x < width; x++, s1++, s2++, s3++) 
+    if (x < f->width-2)
     {
-	    if (y != 0 && y < height-2 && x != 0 && x < width-2) 
-      {
-		    Nx = bumpPixels[s1-1] + bumpPixels[s2-1] + bumpPixels[s3-1] - bumpPixels[s1+1] - bumpPixels[s2+1] - bumpPixels[s3+1];
-		    Ny = bumpPixels[s3-1] + bumpPixels[s3] + bumpPixels[s3+1] - bumpPixels[s1-1] - bumpPixels[s1] - bumpPixels[s1+1];
-		    if (Nx == 0 && Ny == 0)
-			    shade = background;
-		    else if ((NdotL = Nx*Lx + Ny*Ly + NzLz) < 0)
-			    shade = 0;
-		    else
-			    shade = (int)(NdotL / sqrt(Nx*Nx + Ny*Ny + Nz2));
-	    } 
+      Nx = nx[x];
+      Ny = ny[x];
+      if (Nx == 0 && Ny == 0)
+        shade = l->background;
+      else if ((NdotL = Nx*l->Lx + Ny*l->Ly + l->NzLz) < 0)
+        shade = 0;
       else
-      {
-		    shade = background;
-      }
-
-      // Write value
-      *dst++ = shade;
-      *dst++ = shade;
-      *dst++ = shade;
-      *dst++ = alphaVals[s1]; //copy alpha
-    }  
+        shade = (int)(NdotL / sqrt(Nx*Nx + Ny*Ny + l->Nz2));
+      dst[x] = shade * 0x010101u | (src[x] & 0xFF000000);
+    }
+    else
+    {
+      dst[x] = background | (src[x] & 0xFF000000);
+    }
   }
-  free(alphaVals);
-  free(bumpPixels);
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  // Check and cast instance
+  assert(instance);
+  emboss_instance_t* inst = (emboss_instance_t*)instance;
+
+  if (!inst->light_valid)
+    emboss_update_light(inst);
+
+  // Create brightness image
+  size_t len = (size_t)inst->width * inst->height;
+  frei0r_arena_reset(&inst->arena);
+  unsigned char *bumpPixels=(unsigned char*)frei0r_arena_alloc(&inst->arena, len);
+  emboss_luma_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)len);
+  for (i = 0; i < n; i++)
+  {
+    jobs[i].in = inframe;
+    jobs[i].bump = bumpPixels;
+    jobs[i].begin = len * i / n;
+    jobs[i].end = len * (i + 1) / n;
+  }
+  frei0r_thread_run(emboss_luma, jobs, sizeof(emboss_luma_job_t), n);
+
+  // Create embossed image from brightness image
+  emboss_frame_t f;
+  f.light = inst->light;
+  f.in = inframe;
+  f.out = outframe;
+  f.width = inst->width;
+  f.height = inst->height;
+
+  // The rows that aren't shaded at all: the first and the last two.
+  const uint32_t background = f.light.background * 0x010101u;
+  int x, y;
+  for (y = 0; y < f.height; y++)
+  {
+    if (y != 0 && y < f.height-2)
+      continue;
+    const uint32_t* s = inframe + (size_t)y * f.width;
+    uint32_t* dst = outframe + (size_t)y * f.width;
+    for (x = 0; x < f.width; x++)
+      dst[x] = background | (s[x] & 0xFF000000); //copy alpha
+  }
+
+  frei0r_neighbourhood_run(bumpPixels, f.width, f.height, 1, 1, emboss_row,
+                           &f, 2 * f.width * sizeof(int16_t));
+}
@@ -19,46 +19,30 @@
 
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_histogram.h"
 #include <string.h>
 
 #include <cstring>
 
 class equaliz0r : public frei0r::filter
 {
-  // Look-up tables for equaliz0r values.
-  unsigned char rlut[256];
-  unsigned char glut[256];
-  unsigned char blut[256];
+  // Look-up tables for equaliz0r values, per channel.
+  uint8_t lut[3][256];
   
   // Intensity histograms.
-  unsigned int rhist[256];
-  unsigned int ghist[256];
-  unsigned int bhist[256];
+  frei0r_histogram_t hist;
 
-  void updateLookUpTables(const uint32_t* in)
-  {
-    unsigned int size = width*height;
-    
-    // First pass : build histograms.
-    
-    // Reset histograms.
-    memset(rhist, 0, 256*sizeof(unsigned int));
-    memset(ghist, 0, 256*sizeof(unsigned int));
-    memset(bhist, 0, 256*sizeof(unsigned int));
-
-    // Update histograms.
-    const unsigned char *in_ptr = (const unsigned char*) in;
-    for (unsigned int i=0; i<size; ++i)
-    {
-      // update 'em
-      rhist[*in_ptr++]++;
-      ghist[*in_ptr++]++;
-      bhist[*in_ptr++]++;
-      in_ptr++; // skip alpha
-    }
+  // Statistics from every subsampling-th pixel of every subsampling-th row.
+  double subsampling;
+
+  // Equalize with the histograms of the previous frame, counted while it
+  // was mapped, so each frame is read once.
+  bool lagged;
+  bool have_hist;
 
-    // Second pass : update look-up tables.
-    in_ptr = (const unsigned char*) in;
+  void updateLookUpTables()
+  {
+    unsigned int size = hist.pixels;
 
     // Cumulative intensities of histograms.
     unsigned int
@@ -69,16 +53,14 @@ class equaliz0r : public frei0r::filter
     for (int i=0; i<256; ++i)
     {
       // update cumulatives
-      rcum += rhist[i];
-      gcum += ghist[i];
-      bcum += bhist[i];
+      rcum += hist.count[0][i];
+      gcum += hist.count[1][i];
+      bcum += hist.count[2][i];
       
       // update 'em
-      rlut[i] = CLAMP0255( (rcum << 8) / size ); // = 256 * rcum / size
-      glut[i] = CLAMP0255( (gcum << 8) / size ); // = 256 * gcum / size
-      blut[i] = CLAMP0255( (bcum << 8) / size ); // = 256 * bcum / size
-      
-      in_ptr++; // skip alpha
+      lut[0][i] = CLAMP0255( (rcum << 8) / size ); // = 256 * rcum / size
+      lut[1][i] = CLAMP0255( (gcum << 8) / size ); // = 256 * gcum / size
+      lut[2][i] = CLAMP0255( (bcum << 8) / size ); // = 256 * bcum / size
     }
 
   }
@@ -86,24 +68,60 @@ class equaliz0r : public frei0r::filter
 public:
   equaliz0r(unsigned int width, unsigned int height)
   {
+    subsampling = 1;
+    register_param(subsampling, "subsampling", "build the histograms from every n-th pixel of every n-th row, 1 uses all pixels");
+    lagged = false;
+    register_param(lagged, "lagged", "equalize with the histograms of the previous frame, reading each frame once");
+    have_hist = false;
+  }
+
+  virtual bool uses_proxy() const
+  {
+    return true;
+  }
+
+  // The histograms of the last frame are all that the lagged mode keeps.
+  virtual bool reset()
+  {
+    have_hist = false;
+    return true;
+  }
+
+  virtual bool clone_state(const frei0r::fx& other)
+  {
+    const equaliz0r& o = static_cast<const equaliz0r&>(other);
+    hist = o.hist;
+    have_hist = o.have_hist;
+    return true;
+  }
+
+  virtual bool serialize(frei0r::state& s)
+  {
+    s.value(have_hist);
+    s.value(hist);
+    return true;
   }
   
   virtual void update(double time,
                       uint32_t* out,
                       const uint32_t* in)
   {
-    std::copy(in, in + width*height, out);
-    updateLookUpTables(in);
-    unsigned int size = width*height;
-    const unsigned char *in_ptr = (const unsigned char*) in;
-    unsigned char *out_ptr = (unsigned char*) out;
-    for (unsigned int i=0; i<size; ++i)
+    // First pass : build histograms, unless the last frame left them,
+    // from all pixels of the proxy if the host gave one.
+    if (proxy)
+      frei0r_histogram(&hist, proxy, proxy_width, proxy_height, 1);
+    else if (!lagged || !have_hist)
     {
-      *out_ptr++ = rlut[*in_ptr++];
-      *out_ptr++ = glut[*in_ptr++];
-      *out_ptr++ = blut[*in_ptr++];
-      *out_ptr++ = *in_ptr++; // copy alpha
+      unsigned int step = (unsigned int)CLAMP(subsampling, 1.0, 16.0);
+      frei0r_histogram(&hist, in, width, height, step);
     }
+
+    // Second pass : update look-up tables and map, counting the
+    // histograms for the next frame on the way when lagged.
+    updateLookUpTables();
+    frei0r_histogram_map(lagged && !proxy ? &hist : 0,
+                         out, in, width, height, lut);
+    have_hist = lagged && !proxy;
   }
 };
 
@@ -111,6 +129,8 @@ public:
 frei0r::construct<equaliz0r> plugin("Equaliz0r",
                                     "Equalizes the intensity histograms",
                                     "Jean-Sebastien Senecal (Drone)",
-                                    0,2,
-                                    F0R_COLOR_MODEL_RGBA8888);
+                                    0,4,
+                                    F0R_COLOR_MODEL_RGBA8888,
+                                    F0R_CAP_TEMPORAL | F0R_CAP_CLONE
+                                    | F0R_CAP_STATE | F0R_CAP_RB_SYMMETRIC);
 
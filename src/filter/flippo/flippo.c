@@ -8,8 +8,11 @@
  */
 
 #include "frei0r.h"
+#include "frei0r_simd.h"
+#include "frei0r_stream.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -41,6 +44,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* flippoInfo)
   flippoInfo->explanation = "Flipping in x and y axis";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -110,60 +119,118 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance,double time,
-                const uint32_t *inframe, uint32_t *outframe)
+// Swaps the rows a and b of n pixels, in chunks that stay in the cache.
+static void swap_rows(uint32_t* a, uint32_t* b, unsigned int n)
+{
+  uint32_t tmp[FREI0R_STREAM_CHUNK];
+  unsigned int k;
+
+  while (n)
+  {
+    k = n < FREI0R_STREAM_CHUNK ? n : FREI0R_STREAM_CHUNK;
+    memcpy(tmp, a, k*sizeof(uint32_t));
+    memcpy(a, b, k*sizeof(uint32_t));
+    memcpy(b, tmp, k*sizeof(uint32_t));
+    a += k;
+    b += k;
+    n -= k;
+  }
+}
+
+// in place, the rows are mirrored where they are and swapped top to bottom
+static void flip_inplace(flippo_instance_t* inst, uint32_t* frame, int stride)
+{
+  unsigned int w=inst->width;
+  unsigned int h=inst->height;
+  unsigned int y;
+
+  for (y = 0; y < h; y++)
+  {
+    uint32_t* row = (uint32_t*)((char*)frame + (ptrdiff_t)stride * y);
+    uint32_t* other = (uint32_t*)((char*)frame
+                                  + (ptrdiff_t)stride * (h - 1 - y));
+
+    if (inst->flippoy && other < row)
+      break;
+    if (inst->flippox)
+    {
+      frei0r_simd_reverse(row, row, w);
+      if (inst->flippoy && other != row)
+        frei0r_simd_reverse(other, other, w);
+    }
+    if (inst->flippoy && other != row)
+      swap_rows(row, other, w);
+  }
+}
+
+int f0r_update_stride(f0r_instance_t instance, double time,
+                      const uint32_t* inframe1, int inframe1_stride,
+                      const uint32_t* inframe2, int inframe2_stride,
+                      const uint32_t* inframe3, int inframe3_stride,
+                      uint32_t* outframe, int outframe_stride)
 {
   assert(instance);
-  
+
   flippo_instance_t* inst=(flippo_instance_t*)instance;
   unsigned int w=inst->width;
   unsigned int h=inst->height;
-  unsigned int len=w*h;
-  unsigned int twice_w = 2*w;
   unsigned int rowsize = w*sizeof(uint32_t);
-  unsigned int i;
+  unsigned int y;
+  int stream = !inst->flippox && frei0r_stream_wanted((size_t)rowsize*h);
 
-  if (inst->flippox)
+  if (inframe1 == outframe && inframe1_stride == outframe_stride)
   {
-    if (inst->flippoy)
-    {
-      // flip and flop
-      inframe += len-1; // point to the end
-      while (len--)
-        *outframe++ = *inframe--;
-    }
-    else
-    {
-      // flip only
-      inframe += w-1; // point to the end of current row
-      while (h--)
-      {
-        i=w;
-        while (i--)
-          *outframe++ = *inframe--;
-        inframe += twice_w;
-      }
-    }
+    flip_inplace(inst, outframe, outframe_stride);
+    return 1;
   }
-  else
+
+  for (y = 0; y < h; y++)
   {
-    if (inst->flippoy)
-    {
-      // flop only
-      inframe += len - w - 1; // point to start of last row
-      while (h--)
-      {
-        memcpy(outframe, inframe, rowsize);
-        outframe += w;
-        inframe -= w;
-      }
-    }
+    // flop picks the rows bottom-up
+    unsigned int src_y = inst->flippoy ? h - 1 - y : y;
+    const uint32_t* in = (const uint32_t*)((const char*)inframe1
+                                           + (ptrdiff_t)inframe1_stride * src_y);
+    uint32_t* out = (uint32_t*)((char*)outframe
+                                + (ptrdiff_t)outframe_stride * y);
+
+    if (inst->flippox)
+      frei0r_simd_reverse(out, in, w);
+    else if (stream)
+      frei0r_stream_copy(out, in, w);
     else
-    {
-      // no flip, no flop
-      memcpy(outframe, inframe, len*sizeof(uint32_t));
-    }
+      memcpy(out, in, rowsize);
   }
-  
+  if (stream)
+    frei0r_stream_end();
+
+  return 1;
+}
+
+void f0r_update(f0r_instance_t instance,double time,
+                const uint32_t *inframe, uint32_t *outframe)
+{
+  assert(instance);
+
+  flippo_instance_t* inst=(flippo_instance_t*)instance;
+  int stride = inst->width*sizeof(uint32_t);
+
+  f0r_update_stride(instance, time, inframe, stride, 0, 0, 0, 0,
+                    outframe, stride);
 }
 
+// without a horizontal flip the rows are only moved, so that applications
+// can flip vertically by reading the frame bottom-up (a negative stride)
+int f0r_get_row_map(f0r_instance_t instance, unsigned int* rows)
+{
+  assert(instance);
+
+  flippo_instance_t* inst=(flippo_instance_t*)instance;
+  unsigned int h=inst->height;
+  unsigned int y;
+
+  if (inst->flippox)
+    return 0;
+  for (y = 0; y < h; y++)
+    rows[y] = inst->flippoy ? h - 1 - y : y;
+  return 1;
+}
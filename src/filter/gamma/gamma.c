@@ -20,11 +20,11 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
-
-#define MAX_GAMMA 4.0
+#include "frei0r_grade.h"
 
 typedef struct gamma_instance
 {
@@ -32,18 +32,15 @@ typedef struct gamma_instance
   unsigned int height;
   double gamma; /* the gamma value [0, 1] */
   unsigned char lut[256]; /* look-up table */
+  int identity; /* the look-up table changes nothing */
 } gamma_instance_t;
 
 /* Updates the look-up-table. */
 void update_lut(gamma_instance_t *inst)
 {
-  int i;
-  unsigned char *lut = inst->lut;
-  double inv_gamma = 1.0 / (inst->gamma * MAX_GAMMA); /* set gamma in the range [0,MAX_GAMMA] and take its inverse */
-
-  lut[0] = 0;
-  for (i=1; i<256; ++i)
-    lut[i] = CLAMP0255( ROUND(255.0 * pow( (double)i / 255.0, inv_gamma ) ) );
+  /* gamma in the range [0,FREI0R_GRADE_MAX_GAMMA], its inverse as exponent */
+  frei0r_grade_gamma_lut(inst->lut, inst->gamma);
+  inst->identity = frei0r_grade_lut_is_identity(inst->lut);
 }
 
 int f0r_init()
@@ -67,6 +64,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* gamma_info)
   gamma_info->explanation = "Adjusts the gamma value of a source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -129,12 +133,27 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   gamma_instance_t* inst = (gamma_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  unsigned int len = inst->width * (row_end - row_begin);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
+
+  if (inst->identity)
+  {
+    if (outframe != inframe)
+      memcpy(outframe, inframe, len * sizeof(uint32_t));
+    return 1;
+  }
   
   unsigned char* lut = inst->lut;
   unsigned char* dst = (unsigned char*)outframe;
@@ -146,5 +165,20 @@ void f0r_update(f0r_instance_t instance, double time,
     *dst++ = lut[*src++];
     *dst++ = *src++;// copy alpha
   }
+  return 1;
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  gamma_instance_t* inst = (gamma_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
+
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return ((gamma_instance_t*)instance)->identity;
+}
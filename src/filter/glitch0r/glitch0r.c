@@ -22,21 +22,22 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
-#include <time.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_random.h"
+#include "frei0r_thread.h"
 
-/* cheap & fast randomizer (by Fukuchi Kentarou) */
-static uint32_t randval;
-inline static uint32_t fastrand() { return (randval=randval*1103515245+12345); };
-static void fastsrand(uint32_t seed) { randval = seed; };
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-struct glitch0r_state // helps to save time when allocating in a loop
+struct glitch0r_state // the block the current row belongs to
 {
+    frei0r_random_t random;
+
     unsigned int currentBlock;
     unsigned int currentPos;
-    unsigned int currentY;
     unsigned int blkShift;
 
     uint32_t distortionSeed1;
@@ -45,7 +46,7 @@ struct glitch0r_state // helps to save time when allocating in a loop
     short int howToDistort1;
     short int howToDistort2;
     short int passThisLine;
-} g0r_state;
+};
 
 typedef struct glitch0r_instance
 {
@@ -58,67 +59,89 @@ typedef struct glitch0r_instance
     short int colorGlitchIntensity;
     short int doColorDistortion;
     short int glitchChance;
+
+    // the random numbers of a frame only depend on the seed and its time
+    double seed;
 } glitch0r_instance_t;
 
+typedef struct glitch0r_job
+{
+    f0r_instance_t instance;
+    double time;
+    const uint32_t* inframe;
+    uint32_t* outframe;
+    unsigned int row_begin, row_end;
+} glitch0r_job_t;
+
 
-inline static unsigned int rnd (unsigned int min, unsigned int max)
+inline static unsigned int rnd (struct glitch0r_state *g0r_state,
+                                unsigned int min, unsigned int max)
 {
-    return fastrand() % (max - min + 1) + min;
+    return frei0r_random_below(&g0r_state->random, max - min + 1) + min;
 }
 
-inline static void glitch0r_state_reset(glitch0r_instance_t *inst)
+inline static void glitch0r_state_reset(glitch0r_instance_t *inst,
+                                        struct glitch0r_state *g0r_state)
 {
-    g0r_state.currentPos = 0;
-    g0r_state.currentBlock = rnd(1, inst->maxBlockSize);
-    g0r_state.blkShift = rnd(1, inst->maxBlockShift);
-    g0r_state.passThisLine = (inst->glitchChance < rnd(1, 101)) ? 1 : 0;
+    g0r_state->currentPos = 0;
+    g0r_state->currentBlock = rnd(g0r_state, 1, inst->maxBlockSize);
+    g0r_state->blkShift = rnd(g0r_state, 1, inst->maxBlockShift);
+    g0r_state->passThisLine = (inst->glitchChance < rnd(g0r_state, 1, 101)) ? 1 : 0;
 
     if (inst->doColorDistortion)
     {
-        g0r_state.distortionSeed1 = rnd(0x00000000, 0xfffffffe);
-        g0r_state.distortionSeed2 = rnd(0x00000000, 0xfffffffe);
-        g0r_state.howToDistort1 = rnd (0, inst->colorGlitchIntensity);
-        g0r_state.howToDistort2 = rnd (0, inst->colorGlitchIntensity);
+        g0r_state->distortionSeed1 = rnd(g0r_state, 0x00000000, 0xfffffffe);
+        g0r_state->distortionSeed2 = rnd(g0r_state, 0x00000000, 0xfffffffe);
+        g0r_state->howToDistort1 = rnd (g0r_state, 0, inst->colorGlitchIntensity);
+        g0r_state->howToDistort2 = rnd (g0r_state, 0, inst->colorGlitchIntensity);
     }
 }
 
-inline static void glitch0r_pixel_dist0rt (uint32_t *pixel,
-            uint32_t distortionSeed, short int howToDistort)
+// Copies n pixels and distorts their colors, alpha is kept. Each of the
+// five levels of madness is ((pixel & keep) | set) ^ flip:
+//   0: ok, let this pixel live (just shift)
+//   1: lightest distortion: just invert
+//   2: add some unneeded colors
+//   3: change some colors
+//   4: oh shi...
+static void glitch0r_dist0rt (uint32_t *dst, const uint32_t *src,
+            unsigned int n, uint32_t distortionSeed, short int howToDistort)
 {
+    uint32_t keep = 0xffffffff, set = 0, flip = 0;
+    unsigned int i = 0;
 
-    // Save alpha
-    uint8_t *px = (uint8_t *)pixel;
-    uint8_t alpha = px[3];
-
-    // Choose from five levels of madness:
     switch (howToDistort)
     {
-        case 0 : return; // ok, let this pixel live (just shift)
-
-        case 1 : // lightest distortion: just invert
-            *(pixel) = ~*(pixel);
-            break;
-
-        case 2 : // add some unneeded colors
-            *(pixel) = distortionSeed | *(pixel);
-            break;
+        case 1 : flip = 0x00ffffff; break;
+        case 2 : set = distortionSeed & 0x00ffffff; break;
+        case 3 : flip = distortionSeed & 0x00ffffff; break;
+        case 4 : keep = distortionSeed | 0xff000000; break;
+        default :
+            memcpy(dst, src, n * sizeof(uint32_t));
+            return;
+    }
 
-        case 3 : // change some colors
-            *(pixel) = distortionSeed ^ *(pixel);
-             break;
+#if defined(__SSE2__)
+    {
+        const __m128i k = _mm_set1_epi32((int)keep);
+        const __m128i s = _mm_set1_epi32((int)set);
+        const __m128i f = _mm_set1_epi32((int)flip);
 
-        case 4 : // oh shi...
-            *(pixel) = distortionSeed & *(pixel);
-            break;
-    }  
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+            p = _mm_xor_si128(_mm_or_si128(_mm_and_si128(p, k), s), f);
+            _mm_storeu_si128((__m128i *)(dst + i), p);
+        }
+    }
+#endif
 
-    // Restore alpha
-    px[3] = alpha;
+    for (; i < n; i++)
+        dst[i] = ((src[i] & keep) | set) ^ flip;
 }
 
 int f0r_init()
 {
-    fastsrand((uint32_t)time(0));
     return 1;
 }
 
@@ -133,11 +156,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* glitch0rInfo)
     glitch0rInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
     glitch0rInfo->frei0r_version = FREI0R_MAJOR_VERSION;
     glitch0rInfo->major_version = 0; 
-    glitch0rInfo->minor_version = 1; 
-    glitch0rInfo->num_params =  4; 
+    glitch0rInfo->minor_version = 3; 
+    glitch0rInfo->num_params =  5; 
     glitch0rInfo->explanation = "Adds glitches and block shifting";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+    f0r_get_plugin_info(&info->info);
+    info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
     switch(param_index) {
@@ -172,6 +201,14 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
             info->explanation = "How intensive should be color distortion";
             break;
         }
+
+        case 4:
+        {
+            info->name = "Seed";
+            info->type = F0R_PARAM_DOUBLE;
+            info->explanation = "Seed of the glitches, the same seed and time always give the same frame";
+            break;
+        }
     }
 }
 
@@ -184,8 +221,6 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
     inst->colorGlitchIntensity = 3;
     inst->doColorDistortion = 1;
 
-    glitch0r_state_reset(inst);
-
     return (f0r_instance_t)inst;
 }
 
@@ -254,6 +289,12 @@ void f0r_set_param_value(f0r_instance_t instance,
 
             break;
         }
+
+        case 4 : // seed
+        {
+            inst->seed = *((double*)param);
+            break;
+        }
     }
 }
 
@@ -291,66 +332,102 @@ void f0r_get_param_value(f0r_instance_t instance,
             *((double*)param) = (inst->colorGlitchIntensity) / 5; // 5 levels of madness
             break;
         }
+
+        case 4 : // seed
+        {
+            *((double*)param) = inst->seed;
+            break;
+        }
     }
 
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-		const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
     assert(instance);
     glitch0r_instance_t* inst = (glitch0r_instance_t*)instance;
-    unsigned int x, y;
+    struct glitch0r_state g0r_state;
+    unsigned int y;
 
-    uint32_t* dst = outframe;
-    const uint32_t* src = inframe;
-    uint32_t *pixel; 
+    if (row_begin > row_end || row_end > inst->height)
+        return 0;
 
-    g0r_state.currentBlock = rnd(1, inst->maxBlockSize);
+    // every frame starts with a new block, so that it can be rendered
+    // again in any order; the blocks above the slice are drawn again
+    // from the same numbers, which only takes a few per block
+    frei0r_random_init(&g0r_state.random, frei0r_random_frame_seed(inst->seed, time), 0);
+    glitch0r_state_reset(inst, &g0r_state);
 
-    for (y = 0; y < inst->height; y++)
+    for (y = 0; y < row_end; y++)
     {
+        const uint32_t *src = inframe + y*inst->width;
+        uint32_t *dst = outframe + y*inst->width;
+        unsigned int blkShift;
 
         if (g0r_state.currentPos > g0r_state.currentBlock)
         {
-            glitch0r_state_reset(inst);
+            glitch0r_state_reset(inst, &g0r_state);
         }
         else
             g0r_state.currentPos++;
 
-        g0r_state.currentY = y*inst->width;
-        pixel = dst + g0r_state.currentY;
+        if (y < row_begin)
+            continue;
 
         if (g0r_state.passThisLine)
         {
-            memcpy((uint32_t *)(dst + g0r_state.currentY),
-                   (uint32_t *)(src + g0r_state.currentY),
-                   (inst->width) * sizeof(uint32_t));
+            memcpy(dst, src, inst->width * sizeof(uint32_t));
             continue;
         }
 
-        for (x = g0r_state.blkShift; x < (inst->width); x++)
+        // the row shifted left by blkShift, wrapping around
+        blkShift = MIN(g0r_state.blkShift, inst->width);
+        if (inst->doColorDistortion)
         {
-            *(pixel) = *(src + g0r_state.currentY + x);
-
-            if (inst->doColorDistortion)
-                    glitch0r_pixel_dist0rt(pixel,
-                        g0r_state.distortionSeed1, g0r_state.howToDistort1);
-
-            pixel++;
+            glitch0r_dist0rt(dst, src + blkShift, inst->width - blkShift,
+                             g0r_state.distortionSeed1, g0r_state.howToDistort1);
+            glitch0r_dist0rt(dst + inst->width - blkShift, src, blkShift,
+                             g0r_state.distortionSeed2, g0r_state.howToDistort2);
         }
-
-        for (x = 0; x < g0r_state.blkShift; x++)
+        else
         {
-            *(pixel) = *(src + g0r_state.currentY + x);
+            memcpy(dst, src + blkShift,
+                   (inst->width - blkShift) * sizeof(uint32_t));
+            memcpy(dst + inst->width - blkShift, src,
+                   blkShift * sizeof(uint32_t));
+        }
+    }
+    return 1;
+}
 
-            if (inst->doColorDistortion)
-                    glitch0r_pixel_dist0rt(pixel,
-                        g0r_state.distortionSeed2, g0r_state.howToDistort2);
+static void* glitch0r_rows(void* arg)
+{
+    glitch0r_job_t* job = (glitch0r_job_t*)arg;
+    f0r_update_slice(job->instance, job->time, job->inframe, 0, 0,
+                     job->outframe, job->row_begin, job->row_end, 0);
+    return 0;
+}
 
-            pixel++;
-        }
+void f0r_update(f0r_instance_t instance, double time,
+		const uint32_t* inframe, uint32_t* outframe)
+{
+    assert(instance);
+    glitch0r_instance_t* inst = (glitch0r_instance_t*)instance;
+    glitch0r_job_t jobs[FREI0R_MAX_THREADS];
+    int i, n = frei0r_thread_count((long)inst->width * inst->height);
 
+    for (i = 0; i < n; ++i)
+    {
+        jobs[i].instance = instance;
+        jobs[i].time = time;
+        jobs[i].inframe = inframe;
+        jobs[i].outframe = outframe;
+        jobs[i].row_begin = inst->height * i / n;
+        jobs[i].row_end = inst->height * (i + 1) / n;
     }
+    frei0r_thread_run(glitch0r_rows, jobs, sizeof(glitch0r_job_t), n);
 }
-
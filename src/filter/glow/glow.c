@@ -20,13 +20,13 @@
 #include <math.h>
 #include "frei0r.h"
 #include <stdlib.h>
-#include "blur.h"
+#include "frei0r_pyramid.h"
 
 typedef struct glow_instance {
 	double blur;
 	int w, h;
 	uint32_t* blurred;
-	f0r_instance_t* blur_instance;
+	frei0r_pyramid_t pyramid;
 } glow_instance_t;
 
 int f0r_init()
@@ -44,11 +44,17 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->color_model = F0R_COLOR_MODEL_RGBA8888;
 	info->frei0r_version = FREI0R_MAJOR_VERSION;
 	info->major_version = 0; 
-	info->minor_version = 1; 
+	info->minor_version = 2; 
 	info->num_params =  1; 
 	info->explanation = "Creates a Glamorous Glow";
 
 }
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
 void f0r_get_param_info( f0r_param_info_t* info, int param_index )
 {
 	switch ( param_index ) {
@@ -66,14 +72,13 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	inst->w = width;
 	inst->h = height;
 	inst->blurred = (uint32_t*)malloc( width * height * sizeof(uint32_t) );
-	inst->blur_instance = (f0r_instance_t *)blur_construct( width, height );
-	blur_set_param_value(inst->blur_instance, &inst->blur, 0 );
+	frei0r_pyramid_init(&inst->pyramid, width, height);
 	return (f0r_instance_t)inst;
 }
 void f0r_destruct(f0r_instance_t instance)
 {
 	glow_instance_t* inst = (glow_instance_t*)instance;
-	blur_destruct(inst->blur_instance);
+	frei0r_pyramid_free(&inst->pyramid);
 	free(inst->blurred);
 	free(instance);
 }
@@ -84,7 +89,6 @@ void f0r_set_param_value(f0r_instance_t instance,
 	switch ( param_index ) {
 		case 0:
 			inst->blur = (*((double*)param)) / 20.0;
-			blur_set_param_value(inst->blur_instance, &inst->blur, 0 );
 			break;
 	}
 }
@@ -108,8 +112,10 @@ void f0r_update(f0r_instance_t instance, double time,
 	const uint8_t* blur = (uint8_t*)inst->blurred;
 
 	int len = inst->w * inst->h * 4;
+	int max = inst->w > inst->h ? inst->w : inst->h;
 
-	blur_update(inst->blur_instance, 0.0, inframe, inst->blurred );
+	// the kernel is a proportion of the larger side, as in blur.h
+	frei0r_pyramid_blur(&inst->pyramid, inst->blurred, inframe, (int)(inst->blur * max / 2.0));
 	
 	int i;
 	for ( i = 0; i < len; i++ ) {
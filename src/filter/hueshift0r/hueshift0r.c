@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "frei0r.h"
+#include "frei0r_colormatrix.h"
 #include "matrix.h"
 
 typedef struct hueshift0r_instance
@@ -34,6 +35,7 @@ typedef struct hueshift0r_instance
   unsigned int height;
   int hueshift; /* the shift [0, 360] */
   float mat[4][4];
+  frei0r_colormatrix_t cm; /* mat in fixed point */
 } hueshift0r_instance_t;
 
 /* Updates the shift matrix. */
@@ -41,6 +43,7 @@ void update_mat(hueshift0r_instance_t *inst)
 {
   identmat((float*)inst->mat);
   huerotatemat(inst->mat, (float)inst->hueshift);
+  frei0r_colormatrix_set(&inst->cm, inst->mat);
 }
 
 int f0r_init()
@@ -133,8 +136,7 @@ void f0r_update(f0r_instance_t instance, double time,
   hueshift0r_instance_t* inst = (hueshift0r_instance_t*)instance;
   unsigned int len = inst->width * inst->height;
   
-  memcpy(outframe, inframe, len*sizeof(uint32_t));
-  applymatrix((unsigned long*)outframe, inst->mat, len);
+  frei0r_colormatrix_apply(&inst->cm, outframe, inframe, len);
 }
 
 
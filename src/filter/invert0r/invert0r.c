@@ -30,6 +30,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* inverterInfo)
   inverterInfo->explanation = "Inverts all colors of a source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_TILE | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   /* no params */
@@ -55,19 +62,66 @@ void f0r_get_param_value(f0r_instance_t instance,
 			 f0r_param_t param, int param_index)
 { /* no params */ }
 
-void f0r_update(f0r_instance_t instance, double time,
-		const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   inverter_instance_t* inst = (inverter_instance_t*)instance;
   unsigned int w = inst->width;
-  unsigned int h = inst->height;
   unsigned int x,y;
   
-  uint32_t* dst = outframe;
-  const uint32_t* src = inframe;
-  for(y=0;y<h;++y)
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  uint32_t* dst = outframe + w*row_begin;
+  const uint32_t* src = inframe + w*row_begin;
+  for(y=row_begin;y<row_end;++y)
       for(x=0;x<w;++x,++src)
 	  *dst++ = 0x00ffffff^(*src); 
+  return 1;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+		const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  inverter_instance_t* inst = (inverter_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
+
+int f0r_get_footprint(f0r_instance_t instance)
+{
+  return 0;
 }
 
+int f0r_update_tile(f0r_instance_t instance, double time,
+                    const uint32_t* inframe, int inframe_stride,
+                    const f0r_rect_t* inrect,
+                    uint32_t* outframe, int outframe_stride,
+                    const f0r_rect_t* outrect)
+{
+  assert(instance);
+  inverter_instance_t* inst = (inverter_instance_t*)instance;
+  if (outrect->width <= 0 || outrect->height <= 0
+      || outrect->x < inrect->x || outrect->y < inrect->y
+      || outrect->x + outrect->width > inrect->x + inrect->width
+      || outrect->y + outrect->height > inrect->y + inrect->height
+      || outrect->x + outrect->width > (int)inst->width
+      || outrect->y + outrect->height > (int)inst->height)
+    return 0;
+
+  const uint8_t* src = (const uint8_t*)inframe
+    + (outrect->y - inrect->y) * inframe_stride
+    + (outrect->x - inrect->x) * 4;
+  uint8_t* dst = (uint8_t*)outframe;
+  int x,y;
+
+  for(y=0;y<outrect->height;++y, src+=inframe_stride, dst+=outframe_stride)
+      for(x=0;x<outrect->width;++x)
+	  ((uint32_t*)dst)[x] = 0x00ffffff^((const uint32_t*)src)[x];
+  return 1;
+}
@@ -34,6 +34,12 @@ Copyright (C) 2012  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 #include <stdio.h>
 #include <math.h>
 #include <frei0r.h>
+#include "frei0r_stats.h"
+#include "frei0r_arena.h"
+#include "frei0r_fibe.h"
+#include "frei0r_cfc.h"
+#include "frei0r_thread.h"
+#include "frei0r_deadline.h"
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
@@ -41,49 +47,6 @@ Copyright (C) 2012  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 
 double PI=3.14159265358979;
 
-typedef struct
-{
-	float r;
-	float g;
-	float b;
-	float a;
-} float_rgba;
-
-//----------------------------------------------------
-void RGBA8888_2_float(const uint32_t* in, float_rgba *out, int w, int h)
-{
-	uint8_t *cin;
-	int i;
-	float f1;
-	
-	cin=(uint8_t *)in;
-	f1=1.0/255.0;
-	for (i=0;i<w*h;i++)
-	{
-		out[i].r=f1*(float)*cin++;
-		out[i].g=f1*(float)*cin++;
-		out[i].b=f1*(float)*cin++;
-		out[i].a=f1*(float)*cin++;
-	}
-}
-
-//------------------------------------------------------------------
-void float_2_RGBA8888(const float_rgba *in, uint32_t* out, int w, int h)
-{
-	uint8_t *cout;
-	int i;
-	
-	cout=(uint8_t *)out;
-	
-	for (i=0;i<w*h;i++)
-	{
-		*cout++=(uint8_t)(in[i].r*255.0);
-		*cout++=(uint8_t)(in[i].g*255.0);
-		*cout++=(uint8_t)(in[i].b*255.0);
-		*cout++=(uint8_t)(in[i].a*255.0);
-	}
-}
-
 //------------------------------------------------
 //color coeffs according to rec 601 or rec 701
 void cocos(int cm, float *kr, float *kg, float *kb)
@@ -109,355 +72,167 @@ void cocos(int cm, float *kr, float *kg, float *kb)
 	}
 }
 
+//-------------------------------------------------
+//The mask and the operations work on one pixel at a time, so
+//f0r_update() runs all of them on a band of rows in one pass
+//(ks_rows below) instead of one full frame pass per stage.
+//Only the edge masks need the whole frame, for the blur.
+//
+//Everything that is constant over a frame is computed once by
+//ks_setup(), in the same precision as it was per stage.
+
+typedef struct
+{
+	int type;		//mask type
+	int fo;			//foreground only
+	float_rgba k;		//key
+	float t,p,ip,tr;	//color distance mask
+	float ia;		//transparency mask
+	float lim;		//edge mask
+	float gt,gp,gip,k32,gkh,ipi2;	//hue gate
+	float st1,st2,sip;	//saturation threshold
+	int showmask,m2a;
+} ks_mask;
+
+typedef struct
+{
+	int type;		//0=none 1=de-key 2=target 3=desaturate 4=luma
+	float am;		//amount
+	float_rgba k,tgt;
+	float kr,kg,kb,ikg;	//desaturate and luma
+	float m;		//luma
+} ks_op;
+
+//-------------------------------------------------
+static inline void clip_rgb(float_rgba *s)
+{
+	if (s->r<0.0) s->r=0.0;
+	if (s->g<0.0) s->g=0.0;
+	if (s->b<0.0) s->b=0.0;
+	if (s->r>1.0) s->r=1.0;
+	if (s->g>1.0) s->g=1.0;
+	if (s->b>1.0) s->b=1.0;
+}
+
 //-------------------------------------------------
 //premakne barvo radialno stran od key
 //sorazmerno maski
-//*mask=float maska [0...1]
+//mask=float maska [0...1]
 //k=key
 //am=amount  [0...1]
-void clean_rad_m(float_rgba *s, int w, int h, float_rgba k, float *mask, float am)
+static inline void clean_rad_m(float_rgba *s, float_rgba k, float mask, float am)
 {
-	int i;
 	float aa,min;
 	min=0.5;	//min aa = max color change
 	
-	for (i=0;i<w*h;i++)
-	{
-		if (mask[i]==0.0) continue;
-		aa=1.0-am*(1.0-min)*mask[i];
-		s[i].r=(s[i].r-(1.0-aa)*k.r)/aa;
-		s[i].g=(s[i].g-(1.0-aa)*k.g)/aa;
-		s[i].b=(s[i].b-(1.0-aa)*k.b)/aa;
-		if (s[i].r<0.0) s[i].r=0.0;
-		if (s[i].g<0.0) s[i].g=0.0;
-		if (s[i].b<0.0) s[i].b=0.0;
-		if (s[i].r>1.0) s[i].r=1.0;
-		if (s[i].g>1.0) s[i].g=1.0;
-		if (s[i].b>1.0) s[i].b=1.0;
-	}
+	if (mask==0.0) return;
+	aa=1.0-am*(1.0-min)*mask;
+	s->r=(s->r-(1.0-aa)*k.r)/aa;
+	s->g=(s->g-(1.0-aa)*k.g)/aa;
+	s->b=(s->b-(1.0-aa)*k.b)/aa;
+	clip_rgb(s);
 }
 
 //-------------------------------------------------
 //premakne barvo proti target
 //sorazmerno maski
-//*mask=float maska [0...1]
-//k=key
+//mask=float maska [0...1]
 //am=amount  [0...1]
-void clean_tgt_m(float_rgba *s, int w, int h, float_rgba k, float *mask, float am, float_rgba tgt)
+static inline void clean_tgt_m(float_rgba *s, float mask, float am, float_rgba tgt)
 {
-	int i;
-	float a,aa,min;
-	
-	min=0.5;	//min aa = max color change
+	float aa;
 	
-	for (i=0;i<w*h;i++)
-	{
-		if (mask[i]==0.0) continue;
-		
-		a=mask[i];
-		aa=a*am;
-		s[i].r=s[i].r+(tgt.r-s[i].r)*aa;
-		s[i].g=s[i].g+(tgt.g-s[i].g)*aa;
-		s[i].b=s[i].b+(tgt.b-s[i].b)*aa;
-		if (s[i].r<0.0) s[i].r=0.0;
-		if (s[i].g<0.0) s[i].g=0.0;
-		if (s[i].b<0.0) s[i].b=0.0;
-		if (s[i].r>1.0) s[i].r=1.0;
-		if (s[i].g>1.0) s[i].g=1.0;
-		if (s[i].b>1.0) s[i].b=1.0;
-	}
+	if (mask==0.0) return;
+	aa=mask*am;
+	s->r=s->r+(tgt.r-s->r)*aa;
+	s->g=s->g+(tgt.g-s->g)*aa;
+	s->b=s->b+(tgt.b-s->b)*aa;
+	clip_rgb(s);
 }
 
 //----------------------------------------------------------
 //desaturate colors according to mask
-void desat_m(float_rgba *s, int w, int h, float *mask, float des, int cm)
+static inline void desat_m(float_rgba *s, float mask, const ks_op *o)
 {
-	float a,y,cr,cb,kr,kg,kb,ikg;
-	int i;
+	float y,cr,cb;
 	float ds;
 	
-	cocos(cm,&kr,&kg,&kb);    
-	ikg=1.0/kg;
-	
-	for (i=0;i<w*h;i++)
-	{
-		if (mask[i]==0.0) continue;
-		
-		a=mask[i];
-		//separate luma/chroma
-		y=kr*s[i].r+kg*s[i].g+kb*s[i].b;
-		cr=s[i].r-y;	// +-
-		cb=s[i].b-y;	// +-
-		//desaturate
-		ds=1.0-des*a;
-		ds=ds*ds;
-		cr=cr*ds; cb=cb*ds;
-		//back to RGB
-		s[i].r=cr+y;
-		s[i].b=cb+y;
-		s[i].g=(y-kr*s[i].r-kb*s[i].b)*ikg;
-		
-		if (s[i].r<0.0) s[i].r=0.0;
-		if (s[i].g<0.0) s[i].g=0.0;
-		if (s[i].b<0.0) s[i].b=0.0;
-		if (s[i].r>1.0) s[i].r=1.0;
-		if (s[i].g>1.0) s[i].g=1.0;
-		if (s[i].b>1.0) s[i].b=1.0;
-	}
+	if (mask==0.0) return;
+	//separate luma/chroma
+	y=o->kr*s->r+o->kg*s->g+o->kb*s->b;
+	cr=s->r-y;	// +-
+	cb=s->b-y;	// +-
+	//desaturate
+	ds=1.0-o->am*mask;
+	ds=ds*ds;
+	cr=cr*ds; cb=cb*ds;
+	//back to RGB
+	s->r=cr+y;
+	s->b=cb+y;
+	s->g=(y-o->kr*s->r-o->kb*s->b)*o->ikg;
+	clip_rgb(s);
 }
 
 //----------------------------------------------------------
 //adjust luma according to mask
-void luma_m(float_rgba *s, int w, int h, float *mask, float lad, int cm)
+static inline void luma_m(float_rgba *s, float mask, const ks_op *o)
 {
-	float a,m,mm,y,cr,cb,kr,kg,kb,ikg;
-	int i;
-	
-	cocos(cm,&kr,&kg,&kb);    
-	ikg=1.0/kg;
-	m=2.0*lad;
+	float mm,y,cr,cb;
 	
-	for (i=0;i<w*h;i++)
-	{
-		if (mask[i]==0.0) continue;
-		
-		a=mask[i];
-		//separate luma/chroma
-		y=kr*s[i].r+kg*s[i].g+kb*s[i].b;
-		cr=s[i].r-y;	// +-
-		cb=s[i].b-y;	// +-
-		//adjust luma
-		mm=(m-1.0)*a+1.0;
-		if (m>=1.0) y=mm-1.0+y*(2.0-mm); else y=mm*y;
-		//back to RGB
-		s[i].r=cr+y;
-		s[i].b=cb+y;
-		s[i].g=(y-kr*s[i].r-kb*s[i].b)*ikg;
-		
-		if (s[i].r<0.0) s[i].r=0.0;
-		if (s[i].g<0.0) s[i].g=0.0;
-		if (s[i].b<0.0) s[i].b=0.0;
-		if (s[i].r>1.0) s[i].r=1.0;
-		if (s[i].g>1.0) s[i].g=1.0;
-		if (s[i].b>1.0) s[i].b=1.0;
-	}
+	if (mask==0.0) return;
+	//separate luma/chroma
+	y=o->kr*s->r+o->kg*s->g+o->kb*s->b;
+	cr=s->r-y;	// +-
+	cb=s->b-y;	// +-
+	//adjust luma
+	mm=(o->m-1.0)*mask+1.0;
+	if (o->m>=1.0) y=mm-1.0+y*(2.0-mm); else y=mm*y;
+	//back to RGB
+	s->r=cr+y;
+	s->b=cb+y;
+	s->g=(y-o->kr*s->r-o->kb*s->b)*o->ikg;
+	clip_rgb(s);
 }
 
-//---------------------------------------------------------
-//do the blur for edge mask
-//This is the fibe1o_8 function from the IIRblur plugin
-//converted to scalar float (for planar color)
-// 1-tap IIR v 4 smereh
-//optimized for speed
-//loops rearanged for more locality (better cache hit ratio)
-//outer (vertical) loop 2x unroll to break dependency chain
-//simplified indexes
-void fibe1o_f(float *s, int w, int h, float a, int ec)
+//----------------------------------------------------------
+static inline void operation(float_rgba *s, float mask, const ks_op *o)
 {
-	int i,j;
-	float b,g,g4,avg,avg1,cr,g4a,g4b;
-	int p,pw,pj,pwj,pww,pmw;
-	
-	avg=8;	//koliko vzorcev za povprecje pri edge comp
-	avg1=1.0/avg;
-	
-	g=1.0/(1.0-a);
-	g4=1.0/g/g/g/g;
-	
-	//predpostavimo, da je "zunaj" crnina (nicle)
-	b=1.0/(1.0-a)/(1.0+a);
-	
-	//prvih avg vrstic
-	for (i=0;i<avg;i++)
-	{
-		p=i*w;pw=p+w;
-		if (ec!=0)
-		{
-			cr=0.0;
-			for (j=0;j<avg;j++)
-				cr=cr+s[p+j];
-			cr=cr*avg1;
-			s[p]=cr*g+b*(s[p]-cr);
-		}
-		
-		for (j=1;j<w;j++)	//tja
-			s[p+j]=s[p+j]+a*s[p+j-1];
-		
-		if (ec!=0)
-		{
-			cr=0.0;
-			for (j=w-avg;j<w;j++)
-				cr=cr+s[p+j];
-			cr=cr*avg1;
-			s[pw-1]=cr*g+b*(s[pw-1]-cr);
-		}
-		else
-			s[pw-1]=b*s[pw-1];
-		
-		for (j=w-2;j>=0;j--)	//nazaj
-			s[p+j]=a*s[p+j+1]+s[p+j];
-	}
-	
-	//prvih avg vrstic samo navzdol (nazaj so ze)
-	for (i=0;i<w;i++)
-	{
-		if (ec!=0)
-		{
-			cr=0.0;
-			for (j=0;j<avg;j++)
-				cr=cr+s[i+w*j];
-			cr=cr*avg1;
-			s[i]=cr*g+b*(s[i]-cr);
-		}
-		for (j=1;j<avg;j++)	//dol
-			s[i+j*w]=s[i+j*w]+a*s[i+w*(j-1)];
-	}
-	
-	for (i=avg;i<h-1;i=i+2)	//po vrsticah navzdol
-	{
-		p=i*w; pw=p+w; pww=pw+w; pmw=p-w;
-		if (ec!=0)
-		{
-			cr=0.0;
-			for (j=0;j<avg;j++)
-				cr=cr+s[p+j];
-			cr=cr*avg1;
-			s[p]=cr*g+b*(s[p]-cr);
-			cr=0.0;
-			for (j=0;j<avg;j++)
-				cr=cr+s[pw+j];
-			cr=cr*avg1;
-			s[pw]=cr*g+b*(s[pw]-cr);
-		}
-		for (j=1;j<w;j++)	//tja
-		{
-			pj=p+j;pwj=pw+j;
-			s[pj]=s[pj]+a*s[pj-1];
-			s[pwj]=s[pwj]+a*s[pwj-1];
-		}
-		
-		if (ec!=0)
-		{
-			cr=0.0;
-			for (j=w-avg;j<w;j++)
-				cr=cr+s[p+j];
-			cr=cr*avg1;
-			s[pw-1]=cr*g+b*(s[pw-1]-cr);
-			cr=0.0;
-			for (j=w-avg;j<w;j++)
-				cr=cr+s[pw+j];
-			cr=cr*avg1;
-			s[pww-1]=cr*g+b*(s[pww-1]-cr);
-		}
-		else
-		{
-			s[pw-1]=b*s[pw-1];	//rep H
-			s[pww-1]=b*s[pww-1];
-		}
-		
-		//zacetek na desni
-		s[pw-2]=s[pw-2]+a*s[pw-1];	//nazaj
-		s[pw-1]=s[pw-1]+a*s[p-1];	//dol
-		
-		for (j=w-2;j>=1;j--)	//nazaj
-		{
-			pj=p+j;pwj=pw+j;
-			s[pj-1]=a*s[pj]+s[pj-1];
-			s[pwj]=a*s[pwj+1]+s[pwj];
-			//zdaj naredi se en piksel vertikalno dol, za vse stolpce
-			//dva nazaj, da ne vpliva na H nazaj
-			s[pj]=s[pj]+a*s[pmw+j];
-			s[pwj+1]=s[pwj+1]+a*s[pj+1];
-		}
-		//konec levo
-		s[pw]=s[pw]+a*s[pw+1];		//nazaj
-		s[p]=s[p]+a*s[pmw];		//dol
-		s[pw+1]=s[pw+1]+a*s[p+1];	//dol
-		s[pw]=s[pw]+a*s[p];		//dol
-	}
-	
-	//ce je sodo stevilo vrstic, moras zadnjo posebej
-	if (i!=h)
+	switch(o->type)
 	{
-		p=i*w; pw=p+w;
-		for (j=1;j<w;j++)	//tja
-			s[p+j]=s[p+j]+a*s[p+j-1];
-		
-		s[pw-1]=b*s[pw-1];	//rep H
-		
-		for (j=w-2;j>=0;j--)	//nazaj in dol
-		{
-			s[p+j]=a*s[p+j+1]+s[p+j];
-			//zdaj naredi se en piksel vertikalno dol, za vse stolpce
-			//dva nazaj, da ne vpliva na H nazaj
-			s[p+j+1]=s[p+j+1]+a*s[p-w+j+1];
-		}
-		//levi piksel vert
-		s[p]=s[p]+a*s[p-w];
-	}
-	
-	//zadnja vrstica (h-1)
-	g4b=g4*b;
-	g4a=g4/(1.0-a);
-	p=(h-1)*w;
-	if (ec!=0)
-	{
-		for (i=0;i<w;i++)	//po stolpcih
-		{
-			cr=0.0;
-			for (j=h-avg;j<h;j++)
-				cr=cr+s[i+w*j];
-			cr=cr*avg1;
-			s[i+p]=g4a*cr+g4b*(s[i+p]-cr);
-		}
-	}
-	else
-	{
-		for (j=0;j<w;j++)	//po stolpcih
-			s[j+p]=g4b*s[j+p];	//rep V
-	}
-	
-	for (i=h-2;i>=0;i--)	//po vrsticah navzgor
-	{
-		p=i*w; pw=p+w;
-		for (j=0;j<w;j++)	//po stolpcih
-			s[p+j]=a*s[pw+j]+g4*s[p+j];
+	case 0: break;
+	case 1:	clean_rad_m(s, o->k, mask, o->am); break;	//De-Key
+	case 2:	clean_tgt_m(s, mask, o->am, o->tgt); break;	//Target
+	case 3:	desat_m(s, mask, o); break;	//Desaturate
+	case 4:	luma_m(s, mask, o); break;	//Luma adjust
 	}
-	
 }
 
 //----------------------------------------------------------
 //mask based on euclidean RGB distance  (alpha independent)
 //mask values [0...1]
 //fo=1 foreground only (alpha>0.005)
-void rgb_mask(float_rgba *s, int w, int h, float *mask, float_rgba k, float t, float p, int fo)
+static inline float rgb_mask(const float_rgba *s, const ks_mask *m)
 {
-	int i;
-	float dr,dg,db,d,ip,tr,a,de;
+	float dr,dg,db,d,a,de;
 	
-	ip = (p>0.000001) ? 1.0/p : 1000000.0;
-	tr=1.0/3.0;
-	for (i=0;i<w*h;i++)
-	{
-		if ((fo==1)&&(s[i].a<0.005)) {mask[i]=0.0; continue;}
-		
-		//euclidean RGB distance
-		dr=s[i].r-k.r;
-		dg=s[i].g-k.g;
-		db=s[i].b-k.b;
-		de=dr*dr+dg*dg+db*db;
-		de=de*tr;	//max mozno=1.0
-		
-		d=de;
-		
-		if (d>(t+p))
-			a=1.0;		//notranjost (alfa=1)
-		else
-			a=(d-t)*ip;
-		if (d<t) a=0.0;		//blizu key, max efekt
-		
-		mask[i]=1.0-a;
-	}
+	if ((m->fo==1)&&(s->a<0.005)) return 0.0;
+	
+	//euclidean RGB distance
+	dr=s->r-m->k.r;
+	dg=s->g-m->k.g;
+	db=s->b-m->k.b;
+	de=dr*dr+dg*dg+db*db;
+	de=de*m->tr;	//max mozno=1.0
+	
+	d=de;
+	
+	if (d>(m->t+m->p))
+		a=1.0;		//notranjost (alfa=1)
+	else
+		a=(d-m->t)*m->ip;
+	if (d<m->t) a=0.0;		//blizu key, max efekt
+	
+	return 1.0-a;
 }
 
 //----------------------------------------------------------
@@ -506,147 +281,227 @@ void hue_mask(float_rgba *s, int w, int h, float *mask, float_rgba k, float t, f
 	}
 }
 
+//----------------------------------------------------------
+//edge mask, fully opaque areas
+//they are blurred by the caller, then edge_mask() selects the edge
+static inline float opaque_mask(const float_rgba *s)
+{
+	return (s->a>0.996) ? 1.0 : 0.0;
+}
+
 //----------------------------------------------------------
 //mask values [0...1]
-void edge_mask(float_rgba *s, int w, int h, float *mask, float wd, int io)
+//mask = blurred opaque_mask()
+//io=-1 inside, io=1 outside
+static inline float edge_mask(float mask, int io, float lim)
 {
-	int i;
-	float a;
-	float lim;
-	
-	lim=0.05;	//clear mask below this value (good for speed)
-	
-	//fully opaque areas
-	for (i=0;i<w*h;i++)
-		if (s[i].a>0.996) mask[i]=1.0; else mask[i]=0.0;
-	
-	//blur mask
-	a=expf(logf(lim)/wd);
-	fibe1o_f(mask, w, h, a, 1);
-	
 	//select edge
 	if (io==-1)	//inside
-		for (i=0;i<w*h;i++)
-		{
-			if (mask[i]>0.5) mask[i]=2.0*(1.0-mask[i]); else mask[i]=0.0;  //inside only
-			if (mask[i]<lim) mask[i]=0.0;
-		}
+	{
+		if (mask>0.5) mask=2.0*(1.0-mask); else mask=0.0;  //inside only
+		if (mask<lim) mask=0.0;
+	}
 	
 	if (io==1)	//outside
-		for (i=0;i<w*h;i++)
-		{
-			if (mask[i]<0.5) mask[i]=2.0*mask[i]; else mask[i]=0.0;  //outside only AURA
-			if (mask[i]<lim) mask[i]=0.0;
-		}
-	
+	{
+		if (mask<0.5) mask=2.0*mask; else mask=0.0;  //outside only AURA
+		if (mask<lim) mask=0.0;
+	}
+	return mask;
 }
 
 //----------------------------------------------------------
 //mask values [0...1]
 //partially transparent areas
 //useful as additional clean after key or edge
-//amp=amplify mask for lower transparencies [0...1]
-void trans_mask(float_rgba *s, int w, int h, float *mask, float amp)
+static inline float trans_mask(const float_rgba *s, const ks_mask *m)
 {
-	int i;
-	float ia;
-	//partially transparent areas
-	ia=1.0-amp;
-	for (i=0;i<w*h;i++)
-		if ((s[i].a<0.996)&&(s[i].a>0.004))
-			mask[i]=1.0-ia*s[i].a;
-		else
-			mask[i]=0.0;
+	if ((s->a<0.996)&&(s->a>0.004))
+		return 1.0-m->ia*s->a;
+	else
+		return 0.0;
 }
 
 //------------------------------------------------
 //gate the mask based on similarity of hue to key
-void hue_gate(float_rgba *s, int w, int h, float *mask, float_rgba k, float t, float p)
+static inline float hue_gate(const float_rgba *s, float mask, const ks_mask *m)
 {
-	float k32,ka,kb,kh,ipi2,a,b,hh,d,aa,ip;
-	int i;
+	float a,b,hh,d,aa;
 	
-	k32=sqrtf(3.0)/2.0;
-	ipi2=0.5/PI;
-	ip = (p>0.000001) ? 1.0/p : 1000000.0;
+	if (mask==0.0) return mask;
 	
-	ka=k.r-0.5*k.g-0.5*k.b;
-	kb=k32*(k.g-k.b);
-	kh=atan2f(kb,ka)*ipi2;		//  +- 1.0
+	a=s->r-0.5*s->g-0.5*s->b;
+	b=m->k32*(s->g-s->b);
+	hh=atan2f(b,a)*m->ipi2;
 	
-	for (i=0;i<w*h;i++)
-	{
-		if (mask[i]==0.0) continue;
-		
-		a=s[i].r-0.5*s[i].g-0.5*s[i].b;
-		b=k32*(s[i].g-s[i].b);
-		hh=atan2f(b,a)*ipi2;
-		
-		d = (hh>kh) ? hh-kh : kh-hh;	//  [0...2]
-		d = (d>1.0) ? 2.0-d : d;
-		
-		if (d>(t+p)) {mask[i]=0.0; continue;}
-		if (d<t) continue;
-		
-		aa=1.0-(d-t)*ip;
-		mask[i]=mask[i]*aa;
-	}
+	d = (hh>m->gkh) ? hh-m->gkh : m->gkh-hh;	//  [0...2]
+	d = (d>1.0) ? 2.0-d : d;
+	
+	if (d>(m->gt+m->gp)) return 0.0;
+	if (d<m->gt) return mask;
+	
+	aa=1.0-(d-m->gt)*m->gip;
+	return mask*aa;
 }
 
 //------------------------------------------------
 //reduce the mask based on a saturation threshold
 //intensity normalized saturation
-void sat_thres(float_rgba *s, int w, int h, float *mask,  float th)
+static inline float sat_thres(const float_rgba *s, float mask, const ks_mask *m)
 {
-	float k32,ipi2,a,b,ip,sa;
-	float t1,t2;
-	int i;
-	float p=0.1;	//sirina prehodnega pasu
+	float a,b,sa;
 	
-	t2=(1.0+p)*th;	//above this, no mask change
-	t1=t2-p;	//below this, mask=0
+	if (mask==0.0) return mask;
 	
-	k32=sqrtf(3.0)/2.0;
-	ipi2=0.5/PI;
-	ip = (p>0.000001) ? 1.0/p : 1000000.0;
+	a=s->r-0.5*s->g-0.5*s->b;
+	b=m->k32*(s->g-s->b);
+	sa=hypotf(b,a)/(s->r+s->g+s->b+1.0E-6);
 	
-	for (i=0;i<w*h;i++)
+	if (sa>m->st2) return mask;
+	if (sa<m->st1) return 0.0;
+	return mask*(sa-m->st1)*m->sip;
+}
+
+//------------------------------------------------
+//operation parameters, was done by each operation
+static void op_setup(ks_op *o, int type, float am, float_rgba k, float_rgba tgt, int cm)
+{
+	o->type=type;
+	o->am=am;
+	o->k=k;
+	o->tgt=tgt;
+	o->kr=o->kg=o->kb=o->ikg=0.0;
+	if ((type==3)||(type==4))
 	{
-		if (mask[i]==0.0) continue;
-		
-		a=s[i].r-0.5*s[i].g-0.5*s[i].b;
-		b=k32*(s[i].g-s[i].b);
-		sa=hypotf(b,a)/(s[i].r+s[i].g+s[i].b+1.0E-6);
-		
-		if (sa>t2) continue;
-		if (sa<t1) {mask[i]=0.0; continue;}
-		mask[i]=mask[i]*(sa-t1)*ip;
+		cocos(cm,&o->kr,&o->kg,&o->kb);
+		o->ikg=1.0/o->kg;
 	}
+	o->m=2.0*am;
 }
 
-//--------------------------------------------------
-void copy_mask_i(float_rgba *sl, int w, int h, float *mask)
+//------------------------------------------------
+//mask parameters, was done by each mask and gate stage
+//t,p=tolerance and slope, gt=hue gate, th=saturation threshold
+static void mask_setup(ks_mask *m, int type, int fo, float_rgba k, float t, float p, float gt, float th)
 {
-	int i;
+	float ka,kb,sp;
 	
-	for (i=0;i<w*h;i++)
+	m->type=type;
+	m->fo=fo;
+	m->k=k;
+	
+	m->t=t;
+	m->p=p;
+	m->ip = (p>0.000001) ? 1.0/p : 1000000.0;
+	m->tr=1.0/3.0;
+	
+	m->ia=1.0-t;	//for trans mask tolerance is the amplification
+	m->lim=0.05;	//clear mask below this value (good for speed)
+	
+	m->k32=sqrtf(3.0)/2.0;
+	m->ipi2=0.5/PI;
+	m->gt=gt;
+	m->gp=0.5*gt;
+	m->gip = (m->gp>0.000001) ? 1.0/m->gp : 1000000.0;
+	ka=k.r-0.5*k.g-0.5*k.b;
+	kb=m->k32*(k.g-k.b);
+	m->gkh=atan2f(kb,ka)*m->ipi2;		//  +- 1.0
+	
+	sp=0.1;		//sirina prehodnega pasu
+	m->st2=(1.0+sp)*th;	//above this, no mask change
+	m->st1=m->st2-sp;	//below this, mask=0
+	m->sip = (sp>0.000001) ? 1.0/sp : 1000000.0;
+}
+
+//------------------------------------------------
+//one band of rows, all stages
+typedef struct
+{
+	const uint32_t *in;
+	uint32_t *out;
+	const float_rgba *fin;	//float frames instead of in and out
+	float_rgba *fout;
+	float *mask;		//blurred opaque mask for the edge masks
+	float_rgba *row;	//one row of scratch space
+	int w,y0,y1;
+	int draft;		//the mask of every second pixel only
+	const ks_mask *m;
+	const ks_op *op;	//two operations
+} ks_job;
+
+static void* ks_rows(void *arg)
+{
+	ks_job *j=(ks_job*)arg;
+	const ks_mask *m=j->m;
+	float_rgba *row,*s;
+	float a;
+	int x,y;
+	
+	for (y=j->y0;y<j->y1;y++)
 	{
-		sl[i].r=mask[i];
-		sl[i].g=mask[i];
-		sl[i].b=mask[i];
-		sl[i].a=1.0;
+		if (j->fin!=NULL)	//float frames are processed in the output row
+		{
+			row=j->fout+y*j->w;
+			if (row!=j->fin+y*j->w)
+				memcpy(row, j->fin+y*j->w, j->w*sizeof(float_rgba));
+		}
+		else
+		{
+			row=j->row;
+			RGBA8_2_float_lin(j->in+y*j->w, row, j->w, 1, 1.0/255.0, 0);
+		}
+		a=0.0;
+		for (x=0;x<j->w;x++)
+		{
+			s=&row[x];
+			if (!j->draft || !(x&1))	//drafts keep the mask of the left pixel
+			{
+				switch(m->type)		//GENERATE MASK
+				{
+				case 0: a=rgb_mask(s, m); break;	//Color distance
+				case 1: a=trans_mask(s, m); break;	//Transparency
+				case 2: a=edge_mask(j->mask[y*j->w+x], -1, m->lim); break;	//Edge inwards
+				case 3: a=edge_mask(j->mask[y*j->w+x], 1, m->lim); break;	//Edge outwards
+				default: a=0.0; break;
+				}
+				a=hue_gate(s, a, m);
+				a=sat_thres(s, a, m);
+			}
+			operation(s, a, &j->op[0]);
+			operation(s, a, &j->op[1]);
+			if (m->showmask)	//REPLACE IMAGE WITH THE MASK
+			{
+				s->r=a; s->g=a; s->b=a; s->a=1.0;
+			}
+			if (m->m2a)		//REPLACE ALPHA WITH THE MASK
+				s->a=a;
+		}
+		if (j->fin==NULL)
+			float_2_RGBA8_lin(row, j->out+y*j->w, j->w, 1);
 	}
+	return 0;
 }
 
-//--------------------------------------------------
-void copy_mask_a(float_rgba *sl, int w, int h, float *mask)
+//------------------------------------------------
+//opaque_mask() of a band of rows, for the edge masks
+static void* opaque_rows(void *arg)
 {
-	int i;
+	ks_job *j=(ks_job*)arg;
+	int x,y;
 	
-	for (i=0;i<w*h;i++)
+	for (y=j->y0;y<j->y1;y++)
 	{
-		sl[i].a=mask[i];
+		if (j->fin!=NULL)
+		{
+			for (x=0;x<j->w;x++)
+				j->mask[y*j->w+x]=opaque_mask(&j->fin[y*j->w+x]);
+			continue;
+		}
+		RGBA8_2_float_lin(j->in+y*j->w, j->row, j->w, 1, 1.0/255.0, 0);
+		for (x=0;x<j->w;x++)
+			j->mask[y*j->w+x]=opaque_mask(&j->row[x]);
 	}
+	return 0;
 }
 
 //***********************************************************
@@ -675,14 +530,23 @@ typedef struct
 	int m2a;
 	int fo;		//foreground only (speed)
 	int cm;		//color model 0=rec601  1=rec 709
+	int quality;	//F0R_QUALITY_*, see f0r_set_quality
+	frei0r_deadline_t deadline;	//see f0r_set_deadline
 	
 	//internal variables
 	float_rgba krgb;
 	float_rgba trgb;
 	char *liststr;
+	frei0r_arena_t arena;	//per-frame scratch buffers
 	
+#ifdef FREI0R_ENABLE_STATS
+	frei0r_stats_t stats;
+#endif
 } inst;
 
+//stages reported by f0r_get_stats, in registration order
+enum {STAGE_EDGE, STAGE_PIXELS};
+
 //-----------------------------------------------------
 //stretch [0...1] to parameter range [min...max] linear
 float map_value_forward(double v, float min, float max)
@@ -726,6 +590,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
 	info->explanation="Reduces the visibility of key color spill in chroma keying";
 }
 
+//-----------------------------------------------
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities=F0R_CAP_FLOAT;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -828,17 +699,31 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	in->m2a=0;
 	in->fo=1;
 	in->cm=1;
+	in->quality=F0R_QUALITY_NORMAL;
+	frei0r_deadline_init(&in->deadline);
 	
 	const char* sval = "0";
 	in->liststr = (char*)malloc( strlen(sval) + 1 );
 	strcpy( in->liststr, sval );
 	
+	frei0r_arena_init(&in->arena);
+	
+#ifdef FREI0R_ENABLE_STATS
+	frei0r_stats_register(&in->stats, "edge blur");
+	frei0r_stats_register(&in->stats, "mask and operations");
+#endif
+	
 	return (f0r_instance_t)in;
 }
 
 //---------------------------------------------------
 void f0r_destruct(f0r_instance_t instance)
 {
+	inst *in;
+	
+	in=(inst*)instance;
+	frei0r_arena_release(&in->arena);
+	free(in->liststr);
 	free(instance);
 }
 
@@ -1016,110 +901,127 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 }
 
 //==============================================================
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+//either the 8 bit frames or the float frames are given
+static void ks_update(inst *in, const uint32_t* inframe, uint32_t* outframe, const float_rgba *fin, float_rgba *fout)
 {
-	inst *in;
-	//video buffers
+	ks_mask m;
+	ks_op op[2];
+	ks_job jobs[FREI0R_MAX_THREADS];
+	float_rgba *rows;
 	float *mask;
-	float_rgba *sl;
-	
-	assert(instance);
-	in=(inst*)instance;
+	float a,lim,wd;
+	int t,nt;
 	
-	sl = calloc(in->w * in->h, sizeof(float_rgba));
-	mask = calloc(in->w * in->h, sizeof(float));
+	mask_setup(&m, in->maskType, in->fo, in->krgb, in->tol, in->slope, in->Hgate, in->Sthresh);
+	m.showmask=in->showmask;
+	m.m2a=in->m2a;
+	op_setup(&op[0], in->op1, in->am1, in->krgb, in->trgb, in->cm);
+	op_setup(&op[1], in->op2, in->am2, in->krgb, in->trgb, in->cm);
 	
-	RGBA8888_2_float(inframe, sl, in->w, in->h);
+	nt=frei0r_thread_count(in->w * in->h);
+	frei0r_arena_reset(&in->arena);
+	rows = NULL;
+	if (fin==NULL)
+		rows = frei0r_arena_calloc(&in->arena, nt * in->w, sizeof(float_rgba));
+	mask = NULL;
+	if ((in->maskType==2)||(in->maskType==3))
+		mask = frei0r_arena_calloc(&in->arena, in->w * in->h, sizeof(float));
 	
-	switch(in->maskType)		//GENERATE MASK
-	{
-	case 0:		//Color distance based mask
-	{
-		rgb_mask(sl, in->w, in->h, mask, in->krgb, in->tol, in->slope, in->fo);
-		break;
-	}
-	case 1:		//Transparency based mask
+	for (t=0;t<nt;t++)
 	{
-		trans_mask(sl, in->w, in->h, mask, in->tol);
-		break;
-	}
-	case 2:		//Edge based mask inwards
-	{
-		edge_mask(sl, in->w, in->h, mask, in->tol*200.0, -1);
-		break;
-	}
-	case 3:		//Edge based mask outwards
-	{
-		edge_mask(sl, in->w, in->h, mask, in->tol*200.0, 1);
-		break;
-	}
-	}
-	
-	hue_gate(sl, in->w, in->h, mask, in->krgb, in->Hgate, 0.5*in->Hgate);
-	sat_thres(sl, in->w, in->h, mask, in->Sthresh);
-	
-	switch(in->op1)		//OPERATION 1
-	{
-	case 0: break;
-	case 1:	//De-Key
-	{
-		clean_rad_m(sl, in->w, in->h, in->krgb, mask, in->am1);
-		break;
-	}
-	case 2:	//Target
-	{
-		clean_tgt_m(sl, in->w, in->h, in->krgb, mask, in->am1, in->trgb);
-		break;
-	}
-	case 3:	//Desaturate
-	{
-		desat_m(sl, in->w, in->h, mask, in->am1, in->cm);
-		break;
-	}
-	case 4:	//Luma adjust
-	{
-		luma_m(sl, in->w, in->h, mask, in->am1, in->cm);
-		break;
-	}
+		jobs[t].in=inframe;
+		jobs[t].out=outframe;
+		jobs[t].fin=fin;
+		jobs[t].fout=fout;
+		jobs[t].mask=mask;
+		jobs[t].row = rows!=NULL ? rows+t*in->w : NULL;
+		jobs[t].w=in->w;
+		jobs[t].y0=in->h*t/nt;
+		jobs[t].y1=in->h*(t+1)/nt;
+		jobs[t].draft=(in->quality==F0R_QUALITY_DRAFT);
+		jobs[t].m=&m;
+		jobs[t].op=op;
 	}
 	
-	switch(in->op2)		//OPERATION 2
+	//the edge masks blur the opaque areas of the whole frame first
+	if (mask!=NULL)
 	{
-	case 0: break;
-	case 1:	//De-Key
-	{
-		clean_rad_m(sl, in->w, in->h, in->krgb, mask, in->am2);
-		break;
-	}
-	case 2:	//Target
-	{
-		clean_tgt_m(sl, in->w, in->h, in->krgb, mask, in->am2, in->trgb);
-		break;
-	}
-	case 3:	//Desaturate
-	{
-		desat_m(sl, in->w, in->h, mask, in->am2, in->cm);
-		break;
-	}
-	case 4:	//Luma adjust
-	{
-		luma_m(sl, in->w, in->h, mask, in->am2, in->cm);
-		break;
-	}
-	}
-	
-	if (in->showmask)	//REPLACE IMAGE WITH THE MASK
-	{
-		copy_mask_i(sl, in->w, in->h, mask);
+		FREI0R_STAT_BEGIN(t_edge);
+		frei0r_thread_run(opaque_rows, jobs, sizeof(ks_job), nt);
+		lim=0.05;
+		wd=in->tol*200.0;
+		a=expf(logf(lim)/wd);
+		fibe1o_f(mask, in->w, in->h, a, 1);
+		FREI0R_STAT_END(&in->stats, STAGE_EDGE, t_edge);
 	}
 	
-	if (in->m2a)		//REPLACE ALPHA WITH THE MASK
-	{
-		copy_mask_a(sl, in->w, in->h, mask);
-	}      
+	//mask, gates, operations and output, one pass per band of rows
+	FREI0R_STAT_BEGIN(t_pixels);
+	frei0r_thread_run(ks_rows, jobs, sizeof(ks_job), nt);
+	FREI0R_STAT_END(&in->stats, STAGE_PIXELS, t_pixels);
+}
+
+//-----------------------------------------------------
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+	inst *in;
 	
+	assert(instance);
+	in=(inst*)instance;
+	if (frei0r_deadline_begin(&in->deadline))
+		in->quality=in->deadline.current;
+	ks_update(in, inframe, outframe, NULL, NULL);
+	frei0r_deadline_end(&in->deadline);
+}
+
+//-----------------------------------------------------
+//works in float anyway, so float frames skip the 8 bit conversions
+int f0r_update_float(f0r_instance_t instance, double time, const float* inframe1, const float* inframe2, const float* inframe3, float* outframe)
+{
+	assert(instance);
+	ks_update((inst*)instance, NULL, NULL, (const float_rgba*)inframe1, (float_rgba*)outframe);
+	return 1;
+}
+
+//-----------------------------------------------------
+void f0r_set_allocator(f0r_instance_t instance, const f0r_allocator_t* allocator)
+{
+	assert(instance);
+	frei0r_arena_set_allocator(&((inst*)instance)->arena, allocator);
+}
+
+//-----------------------------------------------------
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+	inst *in;
 	
-	float_2_RGBA8888(sl, outframe, in->w, in->h);
-	free(mask);
-	free(sl);
+	assert(instance);
+	in=(inst*)instance;
+	frei0r_deadline_request(&in->deadline, quality);
+	in->quality=in->deadline.current;
+	return 1;
+}
+
+//-----------------------------------------------------
+int f0r_set_deadline(f0r_instance_t instance, double seconds)
+{
+	assert(instance);
+	frei0r_deadline_set(&((inst*)instance)->deadline, seconds);
+	return 1;
+}
+
+//-----------------------------------------------------
+int f0r_get_quality(f0r_instance_t instance)
+{
+	assert(instance);
+	return ((inst*)instance)->deadline.current;
+}
+
+#ifdef FREI0R_ENABLE_STATS
+//-----------------------------------------------------
+int f0r_get_stats(f0r_instance_t instance, f0r_stat_info_t* stats, int count)
+{
+	assert(instance);
+	return frei0r_stats_get(&((inst*)instance)->stats, stats, count);
 }
+#endif
@@ -18,11 +18,29 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <float.h>
 #include <assert.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_remap.h"
+#include "frei0r_mapcache.h"
+
+/* the table of version 1 of the distortion, see frei0r_mapcache.h */
+#define MAP_NAME "lenscorrection-1"
+
+typedef struct map_key
+{
+  unsigned int width;
+  unsigned int height;
+  double xcenter;
+  double ycenter;
+  double correctionnearcenter;
+  double correctionnearedges;
+  int bilinear;
+} map_key_t;
 
 typedef struct lenscorrection_instance
 {
@@ -33,6 +51,12 @@ typedef struct lenscorrection_instance
   double correctionnearcenter;
   double correctionnearedges;
   double brightness;
+  int bilinear;
+  frei0r_remap_t remap; /* where each output pixel comes from */
+  float* map;           /* the source coordinates for bilinear remaps */
+  frei0r_mapcache_t cache; /* the table of remap, if it was cached */
+  int mapIsDirty;
+  int identity;         /* the table takes each pixel from where it is */
 } lenscorrection_instance_t;
 
 
@@ -52,11 +76,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* lenscorrection_info)
   lenscorrection_info->color_model = F0R_COLOR_MODEL_RGBA8888;
   lenscorrection_info->frei0r_version = FREI0R_MAJOR_VERSION;
   lenscorrection_info->major_version = 0; 
-  lenscorrection_info->minor_version = 2; 
-  lenscorrection_info->num_params =  5; 
+  lenscorrection_info->minor_version = 3; 
+  lenscorrection_info->num_params =  6; 
   lenscorrection_info->explanation = "Allows compensation of lens distortion";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch(param_index)
@@ -86,6 +116,11 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 			info->type = F0R_PARAM_DOUBLE;
 			info->explanation = "";
 			break;
+		case 5:
+			info->name = "Bilinear";
+			info->type = F0R_PARAM_BOOL;
+			info->explanation = "Interpolate between source pixels instead of taking the nearest one";
+			break;
 	}
 }
 
@@ -99,11 +134,18 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->correctionnearcenter = 0.5;
   inst->correctionnearedges = 0.5;
   inst->brightness = 0.5;
+  frei0r_remap_init(&inst->remap);
+  frei0r_mapcache_init(&inst->cache);
+  inst->mapIsDirty = 1;
   return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  lenscorrection_instance_t* inst = (lenscorrection_instance_t*)instance;
+  frei0r_remap_free(&inst->remap);
+  frei0r_mapcache_release(&inst->cache);
+  free(inst->map);
   free(instance);
 }
 
@@ -113,29 +155,39 @@ void f0r_set_param_value(f0r_instance_t instance,
 	assert(instance);
 	lenscorrection_instance_t* inst = (lenscorrection_instance_t*)instance;
 
+	double* value = 0;
+	double val = *((double*)param);
+
 	switch(param_index)
 	{
-		double val;
 		case 0:
-			val = *((double*)param);
-			inst->xcenter = val;
+			value = &inst->xcenter;
 			break;
 		case 1:
-			val = *((double*)param);
-			inst->ycenter = val;
+			value = &inst->ycenter;
 			break;
 		case 2:
-			val = *((double*)param);
-			inst->correctionnearcenter = val;
+			value = &inst->correctionnearcenter;
 			break;
 		case 3:
-			val = *((double*)param);
-			inst->correctionnearedges = val;
+			value = &inst->correctionnearedges;
 			break;
 		case 4:
-			val = *((double*)param);
+			/* not used by the map */
 			inst->brightness = val;
 			break;
+		case 5:
+			if ( (val >= 0.5) != inst->bilinear ) {
+				inst->bilinear = (val >= 0.5);
+				inst->mapIsDirty = 1;
+			}
+			break;
+	}
+	/* hosts set all parameters for each frame, the map is only made
+	   again when one of them changed */
+	if ( value && *value != val ) {
+		*value = val;
+		inst->mapIsDirty = 1;
 	}
 }
 
@@ -162,16 +214,28 @@ void f0r_get_param_value(f0r_instance_t instance,
 		case 4:
 			*((double*)param) = inst->brightness;
 			break;
+		case 5:
+			*((double*)param) = inst->bilinear ? 1.0 : 0.0;
+			break;
 	}
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-		const uint32_t* inframe, uint32_t* outframe)
+/* the rows of the map of one thread */
+typedef struct map_job
+{
+	const lenscorrection_instance_t* inst;
+	int32_t* idx;   /* nearest neighbour: the source pixel indices */
+	float* map;     /* bilinear: the source coordinates, see remap32() */
+	int y0, y1;
+} map_job_t;
+
+static void* map_rows(void* arg)
 {
 	//Algorithm fetched from Krita
+	const map_job_t* job = (const map_job_t*)arg;
+	const lenscorrection_instance_t* inst = job->inst;
+	int w = inst->width, h = inst->height;
 	int x, y;
-	assert(instance);
-	lenscorrection_instance_t* inst = (lenscorrection_instance_t*)instance;
 
 	double xcenter = inst->xcenter;
 	double ycenter = inst->ycenter;
@@ -185,8 +249,8 @@ void f0r_update(f0r_instance_t instance, double time,
 	double mult_sq = ( correctionnearcenter - 0.5 );
 	double mult_qd = ( correctionnearedges - 0.5);
 
-	for ( y = 0; y < inst->height; y++ ) {
-		for ( x = 0; x < inst->width; x++ ) {
+	for ( y = job->y0; y < job->y1; y++ ) {
+		for ( x = 0; x < w; x++ ) {
 			double off_x = x - xcenter;
 			double off_y = y - ycenter;
 			double radius_sq = ( (off_x * off_x) + (off_y * off_y) ) * normallise_radius_sq;
@@ -199,51 +263,134 @@ void f0r_update(f0r_instance_t instance, double time,
 
 			/* double brighten = 1.0 + mag * brightness; */
 				// Disabled to avoid compiler warnings
-			
+
+			if ( job->map ) {
+				float* m = job->map + 2 * (x + y * w);
+				/* the neighbours to the right and below are inside */
+				if ( !(srcX >= 0.0 && srcY >= 0.0 && srcX <= w - 1 && srcY <= h - 1) ) {
+					m[0] = -1;
+					m[1] = -1;
+					continue;
+				}
+				/* remap32() takes x <= 0 for the background: the first
+				   column is moved off 0 by a fraction too small to
+				   change its value */
+				m[0] = srcX > FLT_MIN ? (float)srcX : FLT_MIN;
+				m[1] = srcY;
+				continue;
+			}
+
 			int sx;
 			int sy;
 			sx = srcX;
 			sy = srcY;
-			if ( sx < 0 || sy < 0 || sx >= inst->width || sy >= inst->height ) {
-				outframe[x + y * inst->width] =	0x00000000;
+			if ( sx < 0 || sy < 0 || sx >= w || sy >= h ) {
+				job->idx[x + y * w] = -1;
 				continue;
 			}
-			//FIXME: interpolate pixel!!
-			outframe[x + y * inst->width] = inframe[sx + sy * inst->width];
+			job->idx[x + y * w] = sx + sy * w;
 		}
 	}
+	return 0;
 }
 
-uint32_t interpolate_pixel( uint8_t* frame, int w, int h, double x, double y ) {
-/*
-	+--+--+
-	|  |  |
-	+--+--+
-	|  |  |
-	+--+--+
-
-
-	0.5 is full pixel value
-
-	0.25 interpolate to left pixel
-	0.75 interpolate to right pixel
-*/
-
-/*  //Disabled to avoid warnings when compiling
-double xoff = x - floor(x);
-
-int xc = (int)floor(x);
-int yc = (int)floor(y);
+/* whether the table in use takes each pixel from where it is */
+static int is_identity(const lenscorrection_instance_t* inst, const void* table)
+{
+	unsigned int i, n = inst->width * inst->height;
+
+	if ( inst->bilinear ) {
+		const float* map = (const float*)table;
+		for ( i = 0; i < n; i++ ) {
+			float x = (float)(i % inst->width), y = (float)(i / inst->width);
+			if ( map[2*i] != (x > FLT_MIN ? x : FLT_MIN) || map[2*i+1] != y )
+				return 0;
+		}
+		return 1;
+	}
+	const int32_t* idx = (const int32_t*)table;
+	for ( i = 0; i < n; i++ )
+		if ( idx[i] != (int32_t)i )
+			return 0;
+	return 1;
+}
 
-int i = (xc+yc*w)*4;
-uint8_t color1_r = (uint8_t)( xoff * frame[i] + ( 1.0 - xoff ) * frame[i] );
-uint8_t color1_g = (uint8_t)( xoff * frame[i+1] + ( 1.0 - xoff ) * frame[i+1] );
-uint8_t color1_b = (uint8_t)( xoff * frame[i+2] + ( 1.0 - xoff ) * frame[i+2] );
-uint8_t color1_a = (uint8_t)( xoff * frame[i+3] + ( 1.0 - xoff ) * frame[i+3] );
-*/
+/* The distortion only depends on the parameters, so where each output
+   pixel comes from is computed once, in bands of rows over threads, and
+   the frames are remapped with it; or it is taken from the disk cache.
+   With the nearest neighbour the table is the source pixel of each
+   output pixel, bilinear remaps prepare the source coordinates. */
+static void make_map(lenscorrection_instance_t* inst)
+{
+	map_job_t jobs[FREI0R_MAX_THREADS];
+	int w = inst->width, h = inst->height;
+	int k, n = frei0r_thread_count((long)w * h);
+	size_t bytes = (size_t)w * h * (inst->bilinear ? 2 * sizeof(float) : sizeof(int32_t));
+	const void* cached;
+	map_job_t job;
+	map_key_t key;
+
+	memset(&key, 0, sizeof(key));
+	key.width = inst->width;
+	key.height = inst->height;
+	key.xcenter = inst->xcenter;
+	key.ycenter = inst->ycenter;
+	key.correctionnearcenter = inst->correctionnearcenter;
+	key.correctionnearedges = inst->correctionnearedges;
+	key.bilinear = inst->bilinear;
+	/* unmaps a cached table the remap may still point to; the remap gets
+	   a new table either way below */
+	cached = frei0r_mapcache_get(&inst->cache, MAP_NAME, &key, sizeof(key), bytes);
+	if (cached) {
+		if ( inst->bilinear )
+			frei0r_remap_prepare(&inst->remap, w, h, w, h, (const float*)cached, interpBL_b32);
+		else
+			frei0r_remap_use_index(&inst->remap, w, h, w, h, (const int32_t*)cached);
+		inst->identity = is_identity(inst, cached);
+		return;
+	}
 
+	memset(&job, 0, sizeof(job));
+	job.inst = inst;
+	if ( inst->bilinear ) {
+		if ( !inst->map )
+			inst->map = (float*)malloc(bytes);
+		job.map = inst->map;
+	} else {
+		job.idx = frei0r_remap_index(&inst->remap, w, h, w, h);
+	}
+	if (n > h)
+		n = h;
+	for (k = 0; k < n; k++) {
+		jobs[k] = job;
+		jobs[k].y0 = h * k / n;
+		jobs[k].y1 = h * (k + 1) / n;
+	}
+	frei0r_thread_run(map_rows, jobs, sizeof(map_job_t), n);
+
+	if ( inst->bilinear ) {
+		frei0r_remap_prepare(&inst->remap, w, h, w, h, inst->map, interpBL_b32);
+		frei0r_mapcache_put(MAP_NAME, &key, sizeof(key), inst->map, bytes);
+		inst->identity = is_identity(inst, inst->map);
+	} else {
+		frei0r_mapcache_put(MAP_NAME, &key, sizeof(key), job.idx, bytes);
+		inst->identity = is_identity(inst, job.idx);
+	}
+}
 
+void f0r_update(f0r_instance_t instance, double time,
+		const uint32_t* inframe, uint32_t* outframe)
+{
+	assert(instance);
+	lenscorrection_instance_t* inst = (lenscorrection_instance_t*)instance;
 
-return 0;
+	if ( inst->mapIsDirty ) {
+		make_map(inst);
+		inst->mapIsDirty = 0;
+	}
+	if ( inst->identity ) {
+		memcpy(outframe, inframe, (size_t)inst->width * inst->height * sizeof(uint32_t));
+		return;
+	}
+	frei0r_remap_run(&inst->remap, inframe, outframe, 0x00000000);
 }
-
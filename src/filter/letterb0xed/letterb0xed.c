@@ -19,8 +19,11 @@
 
 #include <math.h>
 #include "frei0r.h"
+#include "frei0r_stream.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 typedef struct letterb0xed_instance {
 	double value;
@@ -51,6 +54,12 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->explanation = "Adds Black Borders at top and bottom for Cinema Look";
 
 }
+void f0r_get_plugin_info2( f0r_plugin_info2_t* info )
+{
+	f0r_get_plugin_info( &info->info );
+	info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE
+	  | F0R_CAP_RB_SYMMETRIC;
+}
 void f0r_get_param_info( f0r_param_info_t* info, int param_index )
 {
 	switch ( param_index ) {
@@ -123,20 +132,128 @@ void f0r_get_param_value(f0r_instance_t instance,
 			break;
 	}
 }
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+/* the rows of the picture, top to bottom */
+static void bands( const letterb0xed_instance_t* inst, int* top, int* bottom )
 {
-	letterb0xed_instance_t* inst = (letterb0xed_instance_t*)instance;
-	int i;
-	for ( i = 0; i < inst->top; i++ ) {
-		outframe[i] = inst->background;
+	*top = inst->top / inst->w;
+	*bottom = inst->bottom / inst->w;
+	if ( *top < 0 ) {
+		*top = 0;
+	}
+	if ( *top > inst->h ) {
+		*top = inst->h;
+	}
+	if ( *bottom > inst->h ) {
+		*bottom = inst->h;
+	}
+	if ( *bottom < *top ) {
+		*bottom = *top;
+	}
+}
+
+/* The borders are transparent or opaque black, 0 bytes but for alpha.
+ * Frames larger than the cache are streamed around it, see
+ * frei0r_stream.h. */
+static void fill_pixels( uint32_t* out, uint32_t background, size_t n, int stream )
+{
+	size_t i;
+	if ( stream ) {
+		frei0r_stream_fill( out, background, n );
+		return;
+	}
+	if ( background == 0 ) {
+		memset( out, 0, n * sizeof(uint32_t) );
+		return;
 	}
-	for ( i = inst->top; i < inst->bottom; i++ ) {
-		outframe[i] = inframe[i];
+	for ( i = 0; i < n; i++ ) {
+		out[i] = background;
 	}
-	for ( i = inst->bottom; i < inst->len; i++ ) {
-		outframe[i] = inst->background;
+}
+
+static void copy_pixels( uint32_t* out, const uint32_t* in, size_t n, int stream )
+{
+	if ( stream ) {
+		frei0r_stream_copy( out, in, n );
+	} else {
+		memcpy( out, in, n * sizeof(uint32_t) );
 	}
-	
 }
 
+/* Fills rows y0 to y1 of the output, or copies them from the input. Rows
+ * that are contiguous in both frames go in one piece, and nothing is
+ * copied when updating in place. */
+static void rows( letterb0xed_instance_t* inst, int y0, int y1, int copy, int stream,
+                  const uint32_t* inframe1, int inframe1_stride,
+                  uint32_t* outframe, int outframe_stride )
+{
+	size_t row = inst->w * sizeof(uint32_t);
+	int y;
+	if ( y0 >= y1 ) {
+		return;
+	}
+	inframe1 = (const uint32_t*)( (const char*)inframe1 + (ptrdiff_t)inframe1_stride * y0 );
+	outframe = (uint32_t*)( (char*)outframe + (ptrdiff_t)outframe_stride * y0 );
+	if ( copy && inframe1 == outframe && inframe1_stride == outframe_stride ) {
+		return;
+	}
+	if ( (size_t)outframe_stride == row && ( !copy || (size_t)inframe1_stride == row ) ) {
+		if ( copy ) {
+			copy_pixels( outframe, inframe1, (size_t)inst->w * ( y1 - y0 ), stream );
+		} else {
+			fill_pixels( outframe, inst->background, (size_t)inst->w * ( y1 - y0 ), stream );
+		}
+		return;
+	}
+	for ( y = y0; y < y1; y++ ) {
+		if ( copy ) {
+			copy_pixels( outframe, inframe1, inst->w, stream );
+		} else {
+			fill_pixels( outframe, inst->background, inst->w, stream );
+		}
+		inframe1 = (const uint32_t*)( (const char*)inframe1 + inframe1_stride );
+		outframe = (uint32_t*)( (char*)outframe + outframe_stride );
+	}
+}
+
+int f0r_update_stride(f0r_instance_t instance, double time,
+                      const uint32_t* inframe1, int inframe1_stride,
+                      const uint32_t* inframe2, int inframe2_stride,
+                      const uint32_t* inframe3, int inframe3_stride,
+                      uint32_t* outframe, int outframe_stride)
+{
+	letterb0xed_instance_t* inst = (letterb0xed_instance_t*)instance;
+	int stream = frei0r_stream_wanted( (size_t)inst->len * sizeof(uint32_t) );
+	int top, bottom;
+	bands( inst, &top, &bottom );
+	rows( inst, 0, top, 0, stream, inframe1, inframe1_stride, outframe, outframe_stride );
+	rows( inst, top, bottom, 1, stream, inframe1, inframe1_stride, outframe, outframe_stride );
+	rows( inst, bottom, inst->h, 0, stream, inframe1, inframe1_stride, outframe, outframe_stride );
+	if ( stream ) {
+		frei0r_stream_end();
+	}
+	return 1;
+}
+
+/* The picture is the rows between the borders. */
+int f0r_get_active_rect(f0r_instance_t instance, f0r_rect_t* rect,
+                        uint32_t* fill)
+{
+	letterb0xed_instance_t* inst = (letterb0xed_instance_t*)instance;
+	int top, bottom;
+	bands( inst, &top, &bottom );
+	rect->x = 0;
+	rect->y = top;
+	rect->width = inst->w;
+	rect->height = bottom - top;
+	*fill = inst->background;
+	return 1;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+	letterb0xed_instance_t* inst = (letterb0xed_instance_t*)instance;
+	int stride = inst->w * sizeof(uint32_t);
+	f0r_update_stride(instance, time, inframe, stride, 0, 0, 0, 0,
+	                  outframe, stride);
+}
@@ -22,9 +22,13 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_histogram.h"
+#include "frei0r_overlay.h"
+#include "frei0r_thread.h"
 
 enum ChannelChoice
 {
@@ -68,8 +72,40 @@ typedef struct levels_instance
   enum ChannelChoice channel;
   char showHistogram;
   enum HistogramPosChoice histogramPosition;
+  unsigned char* histoBackground; // input under the histogram when in-place
+  uint32_t* histoRow; // overlay of one row of the histogram
+  double* histoRatio; // height of each of its columns, 0 - 1
+  uint32_t* sliders; // overlay of the sliders and the gradient under it
+  int slidersAreDirty; // a level or the channel changed since
+  enum ChannelChoice slidersChannel; // the channel they were drawn for
+  unsigned int map[256]; // look-up table, rebuilt when a level changes
+  int identity; // the look-up table changes nothing
+  const uint32_t* proxy; // downscaled input of f0r_set_proxy, or NULL
+  unsigned int proxyWidth;
+  unsigned int proxyHeight;
 } levels_instance_t;
 
+static void update_map(levels_instance_t* inst)
+{
+  double inScale = inst->inputMax != inst->inputMin?inst->inputMax - inst->inputMin:1;
+  double exp = inst->gamma == 0?1:1/inst->gamma;
+  double outScale = inst->outputMax - inst->outputMin;
+
+  for(int i = 0; i < 256; i++) {
+	double v = i / 255. - inst->inputMin;
+	if (v < 0.0) {
+		v = 0.0;
+	}
+	double w = pow(v / inScale, exp) * outScale + inst->outputMin;
+	inst->map[i] = CLAMP0255(lrintf(w * 255.0));
+  }
+  inst->slidersAreDirty = 1;
+  inst->identity = 1;
+  for(int i = 0; i < 256; i++)
+	if (inst->map[i] != (unsigned int)i)
+	  inst->identity = 0;
+}
+
 int f0r_init()
 {
   return 1;
@@ -86,11 +122,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* levels_instance_t)
   levels_instance_t->color_model = F0R_COLOR_MODEL_RGBA8888;
   levels_instance_t->frei0r_version = FREI0R_MAJOR_VERSION;
   levels_instance_t->major_version = 0;
-  levels_instance_t->minor_version = 4;
+  levels_instance_t->minor_version = 5;
   levels_instance_t->num_params = PARAMETER_COUNT;
   levels_instance_t->explanation = "Adjust luminance or color channel intensity";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -151,11 +193,17 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->channel = CHANNEL_LUMA;
   inst->showHistogram = 1;
   inst->histogramPosition = POS_BOTTOM_RIGHT;
+  update_map(inst);
   return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  levels_instance_t* inst = (levels_instance_t*)instance;
+  free(inst->histoBackground);
+  free(inst->histoRow);
+  free(inst->histoRatio);
+  free(inst->sliders);
   free(instance);
 }
 
@@ -164,6 +212,7 @@ void f0r_set_param_value(f0r_instance_t instance,
 {
   assert(instance);
   levels_instance_t* inst = (levels_instance_t*)instance;
+  double val;
 
   switch(param_index)
   {
@@ -173,19 +222,39 @@ void f0r_set_param_value(f0r_instance_t instance,
             CHANNEL_RED, CHANNEL_LUMA);
     break;
   case PARAM_INPUT_MIN:
-    inst->inputMin =  *((f0r_param_double *)param);
+    val = *((f0r_param_double *)param);
+    if (val != inst->inputMin) {
+      inst->inputMin = val;
+      update_map(inst);
+    }
     break;
   case PARAM_INPUT_MAX:
-    inst->inputMax =  *((f0r_param_double *)param);
+    val = *((f0r_param_double *)param);
+    if (val != inst->inputMax) {
+      inst->inputMax = val;
+      update_map(inst);
+    }
     break;
   case PARAM_GAMMA:
-    inst->gamma = *((f0r_param_double *)param) * 4;
+    val = *((f0r_param_double *)param) * 4;
+    if (val != inst->gamma) {
+      inst->gamma = val;
+      update_map(inst);
+    }
     break;
   case PARAM_OUTPUT_MIN:
-    inst->outputMin = *((f0r_param_double *)param);
+    val = *((f0r_param_double *)param);
+    if (val != inst->outputMin) {
+      inst->outputMin = val;
+      update_map(inst);
+    }
     break;
   case PARAM_OUTPUT_MAX:
-    inst->outputMax = *((f0r_param_double *)param);
+    val = *((f0r_param_double *)param);
+    if (val != inst->outputMax) {
+      inst->outputMax = val;
+      update_map(inst);
+    }
     break;
   case PARAM_SHOW_HISTOGRAM:
     inst->showHistogram = *((f0r_param_bool *)param);
@@ -233,6 +302,157 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
+// counts of the luma of a band of rows
+typedef struct luma_job
+{
+  const unsigned char* src;
+  unsigned int len;
+  uint32_t count[256];
+} luma_job_t;
+
+static void* luma_rows(void* arg)
+{
+  luma_job_t* job = (luma_job_t*)arg;
+  const unsigned char* src = job->src;
+  unsigned int len = job->len;
+  int i;
+
+  // the products of the luma weights, summed in the same order as
+  // b * .114 + g * .587 + r * .299
+  double wr[256], wg[256], wb[256];
+  for(i = 0; i < 256; i++) {
+	wr[i] = i * .299;
+	wg[i] = i * .587;
+	wb[i] = i * .114;
+  }
+  memset(job->count, 0, sizeof(job->count));
+  while (len--) {
+	job->count[CLAMP0255(wb[src[2]] + wg[src[1]] + wr[src[0]])]++;
+	src += 4;
+  }
+  return 0;
+}
+
+// The histogram of the channel shown in frame, the input or its proxy,
+// counted before the input is overwritten when working in-place. Both
+// are counted over threads.
+static void histogram(levels_instance_t* inst, const uint32_t* frame,
+                      unsigned int width, unsigned int height,
+                      double levels[256])
+{
+  int i, k;
+
+  if (inst->channel != CHANNEL_LUMA) {
+	frei0r_histogram_t hist;
+	frei0r_histogram(&hist, frame, width, height, 1);
+	for(i = 0; i < 256; i++)
+	  levels[i] = hist.count[inst->channel][i];
+	return;
+  }
+
+  luma_job_t jobs[FREI0R_MAX_THREADS];
+  int n = frei0r_thread_count((long)width * height);
+  if (n > (int)height)
+	n = height;
+  for(k = 0; k < n; k++) {
+	unsigned int y0 = height * k / n, y1 = height * (k + 1) / n;
+	jobs[k].src = (const unsigned char*)(frame + y0 * width);
+	jobs[k].len = (y1 - y0) * width;
+  }
+  frei0r_thread_run(luma_rows, jobs, sizeof(luma_job_t), n);
+  for(i = 0; i < 256; i++) {
+	levels[i] = 0;
+	for(k = 0; k < n; k++)
+	  levels[i] += jobs[k].count[i];
+  }
+}
+
+// Draws the sliders of the levels, the gradient between them and the
+// bands around them into the overlay tile of thirdX x 3 * barHeight
+// pixels, which is put over each frame until a level changes.
+static void draw_sliders(levels_instance_t* inst, int thirdX, int barHeight)
+{
+  int rows = 3 * barHeight;
+  uint32_t* tile;
+
+  if (!inst->sliders)
+	inst->sliders = (uint32_t*)malloc(thirdX * rows * sizeof(uint32_t));
+  tile = inst->sliders;
+
+  int posInMin = inst->inputMin * thirdX;
+  int posInMax = inst->inputMax * thirdX;
+  int posOutMin = inst->outputMin * thirdX;
+  int posOutMax = inst->outputMax * thirdX;
+  int posGamma = posInMin + (posInMax - posInMin) * pow(inst->gamma, .5) *.5;
+  int color[3];
+  color[0] = CHANNEL_RED == inst->channel || CHANNEL_LUMA == inst->channel?255:0;
+  color[1] = CHANNEL_GREEN == inst->channel || CHANNEL_LUMA == inst->channel?255:0;
+  color[2] = CHANNEL_BLUE == inst->channel || CHANNEL_LUMA == inst->channel?255:0;
+  uint32_t paint = FREI0R_OVERLAY_PAINT(color[0] | color[1] << 8 | color[2] << 16);
+  uint32_t midPaint = FREI0R_OVERLAY_PAINT(color[0] >> 1 | (color[1] >> 1) << 8 | (color[2] >> 1) << 16);
+  uint32_t black = FREI0R_OVERLAY_PAINT(0);
+  for(int y = 0; y < barHeight; y++) {
+	uint32_t* upper = tile + y * thirdX;
+	uint32_t* lower = tile + (y + barHeight * 2) * thirdX;
+	for(int x = 0; x < thirdX; x++) {
+	  upper[x] = FREI0R_OVERLAY_TINT;
+	  lower[x] = FREI0R_OVERLAY_TINT;
+	}
+	int delta = y/2;
+
+	for(int x = -delta; x < delta; x++) {
+	  int xInMin = x + posInMin;
+	  int xInMax = x + posInMax;
+	  int xOutMin = x + posOutMin;
+	  int xOutMax = x + posOutMax;
+	  int xGamma = x + posGamma;
+	  if (xInMin >= 0 && xInMin < thirdX)
+		upper[xInMin] = black;
+	  if (xInMax >= 0 && xInMax < thirdX)
+		upper[xInMax] = paint;
+	  if (xGamma >= 0 && xGamma < thirdX)
+		upper[xGamma] = midPaint;
+	  if (xOutMin >= 0 && xOutMin < thirdX)
+		lower[xOutMin] = black;
+	  if (xOutMax >= 0 && xOutMax < thirdX)
+		lower[xOutMax] = paint;
+	}
+  }
+  for(int y = barHeight; y < barHeight * 2; y++) {
+	for(int x = 0; x < thirdX; x++) {
+	  int pointValue = CLAMP0255(x * 255 / thirdX);
+	  tile[y * thirdX + x] = FREI0R_OVERLAY_PAINT(
+		(inst->channel == CHANNEL_RED || inst->channel == CHANNEL_LUMA?pointValue:0)
+		| (inst->channel == CHANNEL_GREEN || inst->channel == CHANNEL_LUMA?pointValue:0) << 8
+		| (inst->channel == CHANNEL_BLUE || inst->channel == CHANNEL_LUMA?pointValue:0) << 16);
+	}
+  }
+}
+
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  levels_instance_t* inst = (levels_instance_t*)instance;
+  return inst->identity && !inst->showHistogram;
+}
+
+// Only the histogram is counted from the proxy; its columns are scaled
+// to the largest one, so a proxy draws nearly the same.
+int f0r_set_proxy(f0r_instance_t instance, const uint32_t* proxy,
+                  unsigned int width, unsigned int height)
+{
+  assert(instance);
+  levels_instance_t* inst = (levels_instance_t*)instance;
+  inst->proxy = NULL;
+  if (!proxy || !width || !height
+      || width > inst->width || height > inst->height)
+	return 0;
+  inst->proxy = proxy;
+  inst->proxyWidth = width;
+  inst->proxyHeight = height;
+  return 1;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
                 const uint32_t* inframe, uint32_t* outframe)
 {
@@ -241,29 +461,54 @@ void f0r_update(f0r_instance_t instance, double time,
   unsigned int len = inst->width * inst->height;
   unsigned int maxHisto = 0;
 
+  if (f0r_is_identity(instance)) {
+	if (outframe != inframe)
+	  memcpy(outframe, inframe, len * sizeof(uint32_t));
+	inst->proxy = NULL;
+	return;
+  }
+
   unsigned char* dst = (unsigned char*)outframe;
   const unsigned char* src = (unsigned char*)inframe;
   int r, g, b;
 
-  double levels[256];
-  unsigned int map[256];
-
-  double inScale = inst->inputMax != inst->inputMin?inst->inputMax - inst->inputMin:1;
-  double exp = inst->gamma == 0?1:1/inst->gamma;
-  double outScale = inst->outputMax - inst->outputMin;
+  int thirdY = inst->height / 3;
+  int thirdX = inst->width / 3;
+  int barHeight = inst->height / 27;
+  int histoHeight = thirdY - barHeight * 3;
+  int xOffset = 0;
+  int yOffset = 0;
+  if (inst->histogramPosition == POS_BOTTOM_RIGHT || inst->histogramPosition == POS_BOTTOM_LEFT)
+    yOffset += 2 * thirdY;
+  if (inst->histogramPosition == POS_BOTTOM_RIGHT || inst->histogramPosition == POS_TOP_RIGHT)
+    xOffset += 2 * thirdX;
 
-  for(int i = 0; i < 256; i++) {
-	double v = i / 255. - inst->inputMin;
-	if (v < 0.0) {
-		v = 0.0;
-	}
-	double w = pow(v / inScale, exp) * outScale + inst->outputMin;
-	map[i] = CLAMP0255(lrintf(w * 255.0));
+  // The histogram is drawn over the unmodified input. When working
+  // in-place that part of the input is overwritten below, so keep a copy.
+  const unsigned char* bg = src + (yOffset * inst->width + xOffset) * 4;
+  int bgStride = inst->width * 4;
+  if (inst->showHistogram && inframe == outframe) {
+	if (!inst->histoBackground)
+	  inst->histoBackground = (unsigned char*)malloc(thirdX * thirdY * 4);
+	for(int y = 0; y < histoHeight; y++)
+	  memcpy(inst->histoBackground + y * thirdX * 4, bg + y * bgStride, thirdX * 4);
+	bg = inst->histoBackground;
+	bgStride = thirdX * 4;
   }
 
-  if (inst->showHistogram)
+  double levels[256];
+  const unsigned int* map = inst->map;
+
+  if (inst->showHistogram) {
+	if (inst->proxy)
+	  histogram(inst, inst->proxy, inst->proxyWidth, inst->proxyHeight, levels);
+	else
+	  histogram(inst, inframe, inst->width, inst->height, levels);
 	for(int i = 0; i < 256; i++)
-	  levels[i] = 0;
+	  if (levels[i] > maxHisto)
+		maxHisto = levels[i];
+  }
+  inst->proxy = NULL;
 
   while (len--)
   {
@@ -271,18 +516,6 @@ void f0r_update(f0r_instance_t instance, double time,
 	g = *src++;
 	b = *src++;
 
-	if (inst->showHistogram) {
-	  int intensity =
-	    inst->channel == CHANNEL_RED?r:
-	    inst->channel == CHANNEL_GREEN?g:
-	    inst->channel == CHANNEL_BLUE?b:
-	        CLAMP0255(b * .114 + g * .587 + r * .299);
-	  int index = CLAMP0255(intensity);
-	  levels[index]++;
-	  if (levels[index] > maxHisto)
-		maxHisto = levels[index];
-	}
-
 	switch (inst->channel) {
 	case CHANNEL_RED:
 	  *dst++ = map[r];
@@ -309,103 +542,34 @@ void f0r_update(f0r_instance_t instance, double time,
 	*dst++ = *src++;  // copy alpha
   }
   if (inst->showHistogram) {
-	dst = (unsigned char *)outframe;
-	src = (unsigned char *)inframe;
-	int thirdY = inst->height / 3;
-	int thirdX = inst->width / 3;
-	int barHeight = inst->height / 27;
-	int histoHeight = thirdY - barHeight * 3;
-	int xOffset = 0;
-	int yOffset = 0;
-	if (inst->histogramPosition == POS_BOTTOM_RIGHT || inst->histogramPosition == POS_BOTTOM_LEFT)
-	  yOffset += 2 * thirdY;
-	if (inst->histogramPosition == POS_BOTTOM_RIGHT || inst->histogramPosition == POS_TOP_RIGHT)
-	  xOffset += 2 * thirdX;
+	// the histogram over the input, a row of overlay at a time
+	uint32_t paint = FREI0R_OVERLAY_PAINT(
+	  (CHANNEL_RED != inst->channel || CHANNEL_LUMA == inst->channel?0:255)
+	  | (CHANNEL_GREEN != inst->channel || CHANNEL_LUMA == inst->channel?0:255) << 8
+	  | (CHANNEL_BLUE != inst->channel || CHANNEL_LUMA == inst->channel?0:255) << 16);
+	uint32_t* out = outframe + yOffset * inst->width + xOffset;
+	if (!inst->histoRow) {
+	  inst->histoRow = (uint32_t*)malloc(thirdX * sizeof(uint32_t));
+	  inst->histoRatio = (double*)malloc(thirdX * sizeof(double));
+	}
+	double* ratio = inst->histoRatio;
+	for(int x = 0; x < thirdX; x++)
+	  ratio[x] = (double)levels[CLAMP0255(x * 255 / thirdX)] / maxHisto;
 	for(int y = 0; y < histoHeight; y++) {
 	  double pointValue = (double)(histoHeight - y) / histoHeight;
-	  for(int x = 0; x < thirdX; x++) {
-		int offset = ((y + yOffset) * inst->width + x + xOffset) * 4;
-		int drawPoint = pointValue < (double)levels[CLAMP0255(x * 255 / thirdX)] / maxHisto;
-		dst[offset] = drawPoint?(CHANNEL_RED != inst->channel || CHANNEL_LUMA == inst->channel?0:255):127 + src[offset]/2;
-		dst[offset + 1] = drawPoint?(CHANNEL_GREEN != inst->channel || CHANNEL_LUMA == inst->channel?0:255):127 + src[offset + 1]/2;
-		dst[offset + 2] = drawPoint?(CHANNEL_BLUE != inst->channel || CHANNEL_LUMA == inst->channel?0:255):127 + src[offset + 2]/2;
-		dst[offset + 3] = src[offset + 3];
-	  }
-	}
-	int posInMin = inst->inputMin * thirdX;
-	int posInMax = inst->inputMax * thirdX;
-	int posOutMin = inst->outputMin * thirdX;
-	int posOutMax = inst->outputMax * thirdX;
-	int posGamma = posInMin + (posInMax - posInMin) * pow(inst->gamma, .5) *.5;
-	int color[3];
-	color[0] = CHANNEL_RED == inst->channel || CHANNEL_LUMA == inst->channel?255:0;
-	color[1] = CHANNEL_GREEN == inst->channel || CHANNEL_LUMA == inst->channel?255:0;
-	color[2] = CHANNEL_BLUE == inst->channel || CHANNEL_LUMA == inst->channel?255:0;
-	int midColor[3];
-	midColor[0] = color[0]>>1;
-	midColor[1] = color[1]>>1;
-	midColor[2] = color[2]>>1;
-	for(int y = histoHeight; y < thirdY - barHeight * 2; y++) {
-	  int offsettedY = (y + yOffset) * inst->width;
-	  int offsettedYlower = (y + yOffset + barHeight * 2) * inst->width;
-	  for(int x = 0; x < thirdX; x++) {
-		int offset = (offsettedY + x + xOffset) * 4;
-		dst[offset] = 127 + dst[offset]/2;
-		dst[offset + 1] = 127 + dst[offset + 1]/2;
-		dst[offset + 2] = 127 + dst[offset + 2]/2;
-		offset = (offsettedYlower + x + xOffset) * 4;
-		dst[offset] = 127 + dst[offset]/2;
-		dst[offset + 1] = 127 + dst[offset + 1]/2;
-		dst[offset + 2] = 127 + dst[offset + 2]/2;
-	  }
-	  int delta = (y - histoHeight)/2;
-
-	  for(int x = -delta; x < delta; x++) {
-		int xInMin = x + posInMin;
-		int xInMax = x + posInMax;
-		int xOutMin = x + posOutMin;
-		int xOutMax = x + posOutMax;
-		int xGamma = x + posGamma;
-		if (xInMin >= 0 && xInMin < thirdX) {
-		  int offset = (offsettedY + xInMin + xOffset) * 4;
-		  dst[offset] = 0;
-		  dst[offset + 1] = 0;
-		  dst[offset + 2] = 0;
-		}
-		if (xInMax >= 0 && xInMax < thirdX) {
-		  int offset = (offsettedY + xInMax + xOffset) * 4;
-		  dst[offset] = color[0];
-		  dst[offset + 1] = color[1];
-		  dst[offset + 2] = color[2];
-		}
-		if (xGamma >= 0 && xGamma < thirdX) {
-		  int offset = (offsettedY + xGamma + xOffset) * 4;
-		  dst[offset] = midColor[0];
-		  dst[offset + 1] = midColor[1];
-		  dst[offset + 2] = midColor[2];
-		}
-		if (xOutMin >= 0 && xOutMin < thirdX) {
-		  int offset = (offsettedYlower + xOutMin + xOffset) * 4;
-		  dst[offset] = 0;
-		  dst[offset + 1] = 0;
-		  dst[offset + 2] = 0;
-		}
-		if (xOutMax >= 0 && xOutMax < thirdX) {
-		  int offset = (offsettedYlower + xOutMax + xOffset) * 4;
-		  dst[offset] = color[0];
-		  dst[offset + 1] = color[1];
-		  dst[offset + 2] = color[2];
-		}
-	  }
+	  for(int x = 0; x < thirdX; x++)
+		inst->histoRow[x] = pointValue < ratio[x] ? paint : FREI0R_OVERLAY_TINT;
+	  frei0r_overlay_row(out + y * inst->width,
+	                     (const uint32_t*)(const void*)(bg + y * bgStride),
+	                     inst->histoRow, thirdX);
 	}
-	for(int y = thirdY - barHeight * 2; y < thirdY - barHeight; y++) {
-	  for(int x = 0; x < thirdX; x++) {
-		int offset = ((y + yOffset) * inst->width + x + xOffset) * 4;
-		int pointValue = CLAMP0255(x * 255 / thirdX);
-		dst[offset] = inst->channel == CHANNEL_RED || inst->channel == CHANNEL_LUMA?pointValue:0;
-		dst[offset + 1] = inst->channel == CHANNEL_GREEN || inst->channel == CHANNEL_LUMA?pointValue:0;
-		dst[offset + 2] = inst->channel == CHANNEL_BLUE || inst->channel == CHANNEL_LUMA?pointValue:0;
-	  }
+	// the sliders over the output
+	if (inst->slidersAreDirty || inst->slidersChannel != inst->channel) {
+	  draw_sliders(inst, thirdX, barHeight);
+	  inst->slidersAreDirty = 0;
+	  inst->slidersChannel = inst->channel;
 	}
+	frei0r_overlay_draw(out + histoHeight * inst->width, inst->width,
+	                    inst->sliders, thirdX, 3 * barHeight);
   }
 }
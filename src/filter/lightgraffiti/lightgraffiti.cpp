@@ -65,12 +65,17 @@
 
   */
 #include "frei0r.hpp"
+#include "frei0r_accum.h"
 
 #include <cmath>
 #include <cstdio>
 #include <climits>
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define LG_ADV
 //#define LG_NO_OVERLAY // Not really working yet
 //#define LG_DEBUG
@@ -107,45 +112,24 @@
 // Luma calculation. Refer to the SOP/Sat filter.
 #define REC709Y(r,g,b) (.2126*(r) + .7152*(g) + .0722*(b))
 
-  struct RGBFloat {
-                      float r;
-                      float g;
-                      float b;
-                  };
-
 class LightGraffiti : public frei0r::filter
 {
 
 public:
 
     LightGraffiti(unsigned int width, unsigned int height) :
-            m_lightMask(width*height, 0),
-            m_alphaMap(4*width*height, 0),
             m_meanInitialized(false)
 
     {
         m_mode = Graffiti_LongAvgAlphaCumC;
         m_dimMode = Dim_Mult;
 
-#ifdef LG_ADV
-        RGBFloat rgb0;
-        rgb0.r = 0;
-        rgb0.g = 0;
-        rgb0.b = 0;
-        m_rgbLightMask = std::vector<RGBFloat>(width*height, rgb0);
-
-#ifdef LG_DEBUG
-        for (int i = 0; i < width*height; i++) {
-            if (m_rgbLightMask[i].r != 0 || m_rgbLightMask[i].g != 0 || m_rgbLightMask[i].b != 0) {
-                std::cout << "ERROR: " << m_rgbLightMask[i].r;
-            }
-        }
-#endif
-#endif
+        // The planes and masks are allocated by the first update, see
+        // allocate().
 
-#ifdef LG_NO_OVERLAY
-        m_prevMask = std::vector<RGBFloat>(width*height, rgb0);
-#endif
+        m_stageBackground = register_stage("background");
+        m_stageDim = register_stage("dim");
+        m_stageLights = register_stage("lights");
 
         register_param(m_pSensitivity, "sensitivity", "Sensitivity of the effect for light (higher sensitivity will lead to brighter lights)");
         register_param(m_pBackgroundWeight, "backgroundWeight", "Describes how strong the (accumulated) background should shine through");
@@ -197,6 +181,98 @@ public:
                         Graffiti_LongAvgAlphaCumC };
     enum DimMode { Dim_Mult, Dim_Sin };
 
+    virtual bool clone_state(const frei0r::fx& other)
+    {
+        const LightGraffiti& o = static_cast<const LightGraffiti&>(other);
+        if (&o == this) {
+            return true;
+        }
+        m_lightMask = o.m_lightMask;
+        m_alphaMap = o.m_alphaMap;
+        m_longMean.assign(o.m_longMean);
+        for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+            m_rgbLightMask[c].assign(o.m_rgbLightMask[c]);
+#endif
+#ifdef LG_NO_OVERLAY
+            m_prevMask[c].assign(o.m_prevMask[c]);
+#endif
+        }
+        m_meanInitialized = o.m_meanInitialized;
+        m_mode = o.m_mode;
+        m_dimMode = o.m_dimMode;
+        return true;
+    }
+
+    virtual bool trim()
+    {
+        bool had = m_longMean.width() != 0 || !m_lightMask.empty();
+        std::vector<uint32_t>().swap(m_lightMask);
+        std::vector<float>().swap(m_alphaMap);
+        m_longMean.release();
+        for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+            m_rgbLightMask[c].release();
+#endif
+#ifdef LG_NO_OVERLAY
+            m_prevMask[c].release();
+#endif
+        }
+        m_meanInitialized = false;
+        return had;
+    }
+
+    // the masks are zeroed where they are, the background mean is taken
+    // from the next frame again
+    virtual bool reset()
+    {
+        std::fill(m_lightMask.begin(), m_lightMask.end(), 0);
+        std::fill(m_alphaMap.begin(), m_alphaMap.end(), 0.0f);
+        for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+            m_rgbLightMask[c].clear();
+#endif
+#ifdef LG_NO_OVERLAY
+            m_prevMask[c].clear();
+#endif
+        }
+        m_meanInitialized = false;
+        return true;
+    }
+
+    // every update goes over all of its buffers
+    virtual void memory_usage(std::size_t& resident, std::size_t& touched)
+    {
+        std::size_t n = m_lightMask.capacity() * sizeof(uint32_t)
+            + m_alphaMap.capacity() * sizeof(float) + m_longMean.bytes();
+        for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+            n += m_rgbLightMask[c].bytes();
+#endif
+#ifdef LG_NO_OVERLAY
+            n += m_prevMask[c].bytes();
+#endif
+        }
+        resident += n;
+        touched += n;
+    }
+
+    virtual bool serialize(frei0r::state& s)
+    {
+        s.vector(m_lightMask);
+        s.vector(m_alphaMap);
+        m_longMean.serialize(s);
+        for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+            m_rgbLightMask[c].serialize(s);
+#endif
+#ifdef LG_NO_OVERLAY
+            m_prevMask[c].serialize(s);
+#endif
+        }
+        s.value(m_meanInitialized);
+        return true;
+    }
 
 
 
@@ -214,14 +290,10 @@ public:
 
         // Copy everything to the output image.
         // Most of the image will very likely not change at all.
-        std::copy(in, in + width*height, out);
-
-#ifdef LG_ADV
-        RGBFloat rgb0;
-        rgb0.r = 0;
-        rgb0.g = 0;
-        rgb0.b = 0;
-#endif
+        // (The light graffiti mode writes every pixel itself.)
+        if (m_mode != Graffiti_LongAvgAlphaCumC) {
+            std::copy(in, in + width*height, out);
+        }
 
         if (m_pNonlinearDim) {
             m_dimMode = Dim_Sin;
@@ -229,41 +301,65 @@ public:
             m_dimMode = Dim_Mult;
         }
 
+        allocate();
+#ifdef LG_ADV
+        // Only the testing modes use these.
+        if (m_mode != Graffiti_LongAvgAlphaCumC && m_lightMask.empty()) {
+#else
+        if (m_lightMask.empty()) {
+#endif
+            m_lightMask.assign(width*height, 0);
+            m_alphaMap.assign(4*width*height, 0);
+        }
+
 
         /*
          Refresh the background image
          */
+        frei0r::stage_timer backgroundTimer(*this, m_stageBackground);
         if (!m_meanInitialized || m_pReset) {
             if (m_pBlackReference) {
                 // Do not use the first frame from the movie as background image but plain black
                 // to calculate the added light. Useful e.g. when dealing with still images.
-                m_longMeanImage = std::vector<float>(width*height*3, 0);
+                m_longMean.clear();
             } else {
-                m_longMeanImage = std::vector<float>(width*height*3);
-                for (unsigned int pixel = 0; pixel < width*height; pixel++) {
-                    m_longMeanImage[3*pixel+0] = GETR(in[pixel]);
-                    m_longMeanImage[3*pixel+1] = GETG(in[pixel]);
-                    m_longMeanImage[3*pixel+2] = GETB(in[pixel]);
-                }
+                frei0r_accum_run(frei0r_accum_load, m_longMean.data(), in, 0, width*height);
             }
             m_meanInitialized = true;
         } else {
             // Calculate the mean image to estimate the background. If alpha is set > 0, bright light sources
             // moving into the image and standing still will eventually be treated as background.
             if (m_pLongAlpha > 0) {
-                for (unsigned int pixel = 0; pixel < width*height; pixel++) {
-                    m_longMeanImage[3*pixel+0] = (1-m_pLongAlpha) * m_longMeanImage[3*pixel+0] + m_pLongAlpha * GETR(in[pixel]);
-                    m_longMeanImage[3*pixel+1] = (1-m_pLongAlpha) * m_longMeanImage[3*pixel+1] + m_pLongAlpha * GETG(in[pixel]);
-                    m_longMeanImage[3*pixel+2] = (1-m_pLongAlpha) * m_longMeanImage[3*pixel+2] + m_pLongAlpha * GETB(in[pixel]);
-                }
+                frei0r_accum_run(frei0r_accum_ema, m_longMean.data(), in,
+                                 frei0r_accum_weight(m_pLongAlpha), width*height);
             }
         }
+        backgroundTimer.stop();
+
+
+        /*
+         Reset all masks if desired
+         (mainly for parameter adjustments when working in the NLE)
+         */
+        if (m_pReset) {
+#ifdef LG_ADV
+            for (int c = 0; c < 3; c++) {
+                m_rgbLightMask[c].clear();
+            }
+#else
+            std::fill(&m_lightMask[0], &m_lightMask[width*height - 1], 0);
+            std::fill(&m_alphaMap[0], &m_alphaMap[width*height*4 - 1], 0);
+#endif
+            // m_longMean has been handled above already (set to the current image).
+        }
 
 
         /*
          Light mask dimming
+         (There is nothing to dim right after a reset.)
          */
-        if (m_pDim > 0) {
+        frei0r::stage_timer dimTimer(*this, m_stageDim);
+        if (m_pDim > 0 && !m_pReset) {
             // Dims the light mask. Lights will leave fainting trails.
 
             float factor = 1-m_pDim;
@@ -279,10 +375,8 @@ public:
 
                 case Dim_Mult:
 #ifdef LG_ADV
-                    for (size_t i = 0; i < m_rgbLightMask.size(); i++) {
-                        m_rgbLightMask[i].r *= factor;
-                        m_rgbLightMask[i].g *= factor;
-                        m_rgbLightMask[i].b *= factor;
+                    for (int c = 0; c < 3; c++) {
+                        dimMult(m_rgbLightMask[c].data(), factor);
                     }
 #else
                     for (unsigned int i = 0; i < width*height; i++) {
@@ -297,30 +391,20 @@ public:
 
                 case Dim_Sin:
 #ifdef LG_ADV
-                    for (size_t i = 0; i < m_rgbLightMask.size(); i++) {
-                        // Red
-                        if (m_rgbLightMask[i].r < 1) {
-                            m_rgbLightMask[i].r *= pow(sin(m_rgbLightMask[i].r * M_PI/2), m_pDim) - .01;
-                        } else {
-                            m_rgbLightMask[i].r *= factor;
-                        }
-                        if (m_rgbLightMask[i].r < 0) { m_rgbLightMask[i].r = 0; }
-
-                        // Green
-                        if (m_rgbLightMask[i].g < 1) {
-                            m_rgbLightMask[i].g *= pow(sin(m_rgbLightMask[i].g * M_PI/2), m_pDim) - .01;
-                        } else {
-                            m_rgbLightMask[i].g *= factor;
-                        }
-                        if (m_rgbLightMask[i].g < 0) { m_rgbLightMask[i].g = 0; }
-
-                        // Blue
-                        if (m_rgbLightMask[i].b < 1) {
-                            m_rgbLightMask[i].b *= pow(sin(m_rgbLightMask[i].b * M_PI/2), m_pDim) - .01;
-                        } else {
-                            m_rgbLightMask[i].b *= factor;
+                    for (int c = 0; c < 3; c++) {
+                        float* light = m_rgbLightMask[c].data();
+                        for (unsigned int i = 0; i < width*height; i++) {
+                            // Most of the mask is dark, and dark stays dark.
+                            if (light[i] == 0) {
+                                continue;
+                            }
+                            if (light[i] < 1) {
+                                light[i] *= pow(sin(light[i] * M_PI/2), m_pDim) - .01;
+                            } else {
+                                light[i] *= factor;
+                            }
+                            if (light[i] < 0) { light[i] = 0; }
                         }
-                        if (m_rgbLightMask[i].b < 0) { m_rgbLightMask[i].b = 0; }
                     }
 #else
                     // Attention: Since Graffiti_LongAvgAlphaCumC only makes use of the first alpha channel
@@ -339,36 +423,17 @@ public:
             }
 
         }
-
-
-
-        /*
-         Reset all masks if desired
-         (mainly for parameter adjustments when working in the NLE)
-         */
-        if (m_pReset) {
-#ifdef LG_ADV
-            m_rgbLightMask = std::vector<RGBFloat>(width*height, rgb0);
-#else
-            std::fill(&m_lightMask[0], &m_lightMask[width*height - 1], 0);
-            std::fill(&m_alphaMap[0], &m_alphaMap[width*height*4 - 1], 0);
-#endif
-            // m_longMeanImage has been handled above already (set to the current image).
-        }
+        dimTimer.stop();
 
 
         int r, g, b;
-        int maxDiff, temp, sum;
+        int maxDiff, temp;
         unsigned int min;
         unsigned int max;
         float f;
-        float fr, fg, fb, sr, sg, sb, fy, fsat;
-
-#ifdef LG_DEBUG
-        int deCount = 0;
-#endif
 
 
+        frei0r::stage_timer lightsTimer(*this, m_stageLights);
         switch (m_mode) {
             /*
              Lots of testing modes here!
@@ -488,12 +553,12 @@ public:
                         temp = CLAMP(temp);
                         sat = RGBA(temp, temp, temp, 0xFF);
                     }
-                    min = m_longMeanImage[3*pixel+0];
-                    max = m_longMeanImage[3*pixel+0];
-                    if (m_longMeanImage[3*pixel+1] < min) min = m_longMeanImage[3*pixel+1];
-                    if (m_longMeanImage[3*pixel+1] > max) max = m_longMeanImage[3*pixel+1];
-                    if (m_longMeanImage[3*pixel+2] < min) min = m_longMeanImage[3*pixel+2];
-                    if (m_longMeanImage[3*pixel+2] > max) max = m_longMeanImage[3*pixel+2];
+                    min = mean(pixel, 0);
+                    max = mean(pixel, 0);
+                    if (mean(pixel, 1) < min) min = mean(pixel, 1);
+                    if (mean(pixel, 1) > max) max = mean(pixel, 1);
+                    if (mean(pixel, 2) < min) min = mean(pixel, 2);
+                    if (mean(pixel, 2) > max) max = mean(pixel, 2);
                     if (min == 0) { out[pixel] = 0; }
                     else {
                         temp = 255.0*(max-min)/(float)max;
@@ -523,12 +588,12 @@ public:
                     if (max < 0x80) {
                         out[pixel] = RGBA(0,0,0,0xFF);
                     } else {
-                        min = m_longMeanImage[3*pixel+0];
-                        max = m_longMeanImage[3*pixel+0];
-                        if (m_longMeanImage[3*pixel+1] < min) min = m_longMeanImage[3*pixel+1];
-                        if (m_longMeanImage[3*pixel+1] > max) max = m_longMeanImage[3*pixel+1];
-                        if (m_longMeanImage[3*pixel+2] < min) min = m_longMeanImage[3*pixel+2];
-                        if (m_longMeanImage[3*pixel+2] > max) max = m_longMeanImage[3*pixel+2];
+                        min = mean(pixel, 0);
+                        max = mean(pixel, 0);
+                        if (mean(pixel, 1) < min) min = mean(pixel, 1);
+                        if (mean(pixel, 1) > max) max = mean(pixel, 1);
+                        if (mean(pixel, 2) < min) min = mean(pixel, 2);
+                        if (mean(pixel, 2) > max) max = mean(pixel, 2);
                         if (min == 0) { out[pixel] = 0; }
                         else {
                             temp = 255.0*(max-min)/(float)max;
@@ -561,11 +626,11 @@ public:
                 maxDiff = 0;
                 temp = 0;
                 for (unsigned int pixel = 0; pixel < width*height; pixel++) {
-                    r = 0x7f + (GETR(out[pixel]) - m_longMeanImage[3*pixel+0])/2;
+                    r = 0x7f + (GETR(out[pixel]) - mean(pixel, 0))/2;
                     r = CLAMP(r);
-                    g = 0x7f + (GETG(out[pixel]) - m_longMeanImage[3*pixel+1])/2;
+                    g = 0x7f + (GETG(out[pixel]) - mean(pixel, 1))/2;
                     g = CLAMP(g);
-                    b = 0x7f + (GETB(out[pixel]) - m_longMeanImage[3*pixel+2])/2;
+                    b = 0x7f + (GETB(out[pixel]) - mean(pixel, 2))/2;
                     b = CLAMP(b);
 
                     out[pixel] = RGBA(r,g,b,0xFF);
@@ -574,19 +639,19 @@ public:
             case Graffiti_LongAvg:
                 for (unsigned int pixel = 0; pixel < width*height; pixel++) {
 
-                    r = 0x7f + (GETR(out[pixel]) - m_longMeanImage[3*pixel+0]);
+                    r = 0x7f + (GETR(out[pixel]) - mean(pixel, 0));
                     r = CLAMP(r);
                     max = GETR(out[pixel]);
                     maxDiff = r;
                     temp = r;
 
-                    g = 0x7f + (GETG(out[pixel]) - m_longMeanImage[3*pixel+1]);
+                    g = 0x7f + (GETG(out[pixel]) - mean(pixel, 1));
                     g = CLAMP(g);
                     if (maxDiff < g) maxDiff = g;
                     if (max < GETG(out[pixel])) max = GETG(out[pixel]);
                     temp += g;
 
-                    b = 0x7f + (GETB(out[pixel]) - m_longMeanImage[3*pixel+2]);
+                    b = 0x7f + (GETB(out[pixel]) - mean(pixel, 2));
                     b = CLAMP(b);
                     if (maxDiff < b) maxDiff = b;
                     if (max < GETB(out[pixel])) max = GETB(out[pixel]);
@@ -595,13 +660,13 @@ public:
                     if (maxDiff > 0xe0 && temp > 0xe0 + 0xd0 + 0x80) {
                         m_lightMask[pixel] = MAX(m_lightMask[pixel], out[pixel]);
 
-                        m_alphaMap[4*pixel+0] = 2*(GETR(out[pixel])-m_longMeanImage[3*pixel+0]);
+                        m_alphaMap[4*pixel+0] = 2*(GETR(out[pixel])-mean(pixel, 0));
                         m_alphaMap[4*pixel+0] = CLAMP(m_alphaMap[4*pixel+0])/255.0;
 
-                        m_alphaMap[4*pixel+1] = 2*(GETG(out[pixel])-m_longMeanImage[3*pixel+1]);
+                        m_alphaMap[4*pixel+1] = 2*(GETG(out[pixel])-mean(pixel, 1));
                         m_alphaMap[4*pixel+1] = CLAMP(m_alphaMap[4*pixel+1])/255.0;
 
-                        m_alphaMap[4*pixel+2] = 2*(GETB(out[pixel])-m_longMeanImage[3*pixel+2]);
+                        m_alphaMap[4*pixel+2] = 2*(GETB(out[pixel])-mean(pixel, 2));
                         m_alphaMap[4*pixel+2] = CLAMP(m_alphaMap[4*pixel+2])/255.0;
 
                         m_alphaMap[4*pixel+3] = 1;
@@ -621,19 +686,19 @@ public:
             case Graffiti_LongAvgAlpha_Stat:
                 for (unsigned int pixel = 0; pixel < width*height; pixel++) {
 
-                    r = 0x7f + (GETR(out[pixel]) - m_longMeanImage[3*pixel+0]);
+                    r = 0x7f + (GETR(out[pixel]) - mean(pixel, 0));
                     r = CLAMP(r);
                     max = GETR(out[pixel]);
                     maxDiff = r;
                     temp = r;
 
-                    g = 0x7f + (GETG(out[pixel]) - m_longMeanImage[3*pixel+1]);
+                    g = 0x7f + (GETG(out[pixel]) - mean(pixel, 1));
                     g = CLAMP(g);
                     if (maxDiff < g) maxDiff = g;
                     if (max < GETG(out[pixel])) max = GETG(out[pixel]);
                     temp += g;
 
-                    b = 0x7f + (GETB(out[pixel]) - m_longMeanImage[3*pixel+2]);
+                    b = 0x7f + (GETB(out[pixel]) - mean(pixel, 2));
                     b = CLAMP(b);
                     if (maxDiff < b) maxDiff = b;
                     if (max < GETB(out[pixel])) max = GETB(out[pixel]);
@@ -642,15 +707,15 @@ public:
                     if (maxDiff > 0xe0 && temp > 0xe0 + 0xd0 + 0x80) {
                         m_lightMask[pixel] = MAX(m_lightMask[pixel], out[pixel]);
 
-                        f = 2*(GETR(out[pixel])-m_longMeanImage[3*pixel+0]);
+                        f = 2*(GETR(out[pixel])-mean(pixel, 0));
                         f = CLAMP(f)/255.0;
                         if (f > m_alphaMap[4*pixel+0]) m_alphaMap[4*pixel+0] = f;
 
-                        f = 2*(GETG(out[pixel])-m_longMeanImage[3*pixel+1]);
+                        f = 2*(GETG(out[pixel])-mean(pixel, 1));
                         f = CLAMP(f)/255.0;
                         if (f > m_alphaMap[4*pixel+1]) m_alphaMap[4*pixel+1] = f;
 
-                        f = 2*(GETB(out[pixel])-m_longMeanImage[3*pixel+2]);
+                        f = 2*(GETB(out[pixel])-mean(pixel, 2));
                         f = CLAMP(f)/255.0;
                         if (f > m_alphaMap[4*pixel+2]) m_alphaMap[4*pixel+2] = f;
 
@@ -665,19 +730,19 @@ public:
             case Graffiti_LongAvgAlpha:
                 for (unsigned int pixel = 0; pixel < width*height; pixel++) {
 
-                    r = 0x7f + (GETR(out[pixel]) - m_longMeanImage[3*pixel+0]);
+                    r = 0x7f + (GETR(out[pixel]) - mean(pixel, 0));
                     r = CLAMP(r);
                     max = GETR(out[pixel]);
                     maxDiff = r;
                     temp = r;
 
-                    g = 0x7f + (GETG(out[pixel]) - m_longMeanImage[3*pixel+1]);
+                    g = 0x7f + (GETG(out[pixel]) - mean(pixel, 1));
                     g = CLAMP(g);
                     if (maxDiff < g) maxDiff = g;
                     if (max < GETG(out[pixel])) max = GETG(out[pixel]);
                     temp += g;
 
-                    b = 0x7f + (GETB(out[pixel]) - m_longMeanImage[3*pixel+2]);
+                    b = 0x7f + (GETB(out[pixel]) - mean(pixel, 2));
                     b = CLAMP(b);
                     if (maxDiff < b) maxDiff = b;
                     if (max < GETB(out[pixel])) max = GETB(out[pixel]);
@@ -686,17 +751,17 @@ public:
                     if (maxDiff > 0xe0 && temp > 0xe0 + 0xd0 + 0x80) {
                         m_lightMask[pixel] = MAX(m_lightMask[pixel], out[pixel]);
 
-                        f = 2*(GETR(out[pixel])-m_longMeanImage[3*pixel+0]);
+                        f = 2*(GETR(out[pixel])-mean(pixel, 0));
                         f = CLAMP(f)/255.0;
                         f *= f;
                         if (f > m_alphaMap[4*pixel+0]) m_alphaMap[4*pixel+0] = f;
 
-                        f = 2*(GETG(out[pixel])-m_longMeanImage[3*pixel+1]);
+                        f = 2*(GETG(out[pixel])-mean(pixel, 1));
                         f = CLAMP(f)/255.0;
                         f *= f;
                         if (f > m_alphaMap[4*pixel+1]) m_alphaMap[4*pixel+1] = f;
 
-                        f = 2*(GETB(out[pixel])-m_longMeanImage[3*pixel+2]);
+                        f = 2*(GETB(out[pixel])-mean(pixel, 2));
                         f = CLAMP(f)/255.0;
                         f *= f;
                         if (f > m_alphaMap[4*pixel+2]) m_alphaMap[4*pixel+2] = f;
@@ -724,318 +789,480 @@ public:
                     Maybe: Logarithmic scale? → Overexposure becomes harder
                     log(alpha/factor + 1) or sqrt(alpha/factor)
                   */
-                for (unsigned int pixel = 0; pixel < width*height; pixel++) {
+
+                // Row by row, each step over the whole row. Steps the parameters
+                // switch off are skipped for the whole frame.
+                for (unsigned int y = 0; y < height; y++) {
+                    const uint32_t* src = in + (size_t)y*width;
+                    uint32_t* dst = out + (size_t)y*width;
 
                     /*
                      Light detection
                      */
+                    detectLights(y, src, sensitivity, thresholdBrightness, thresholdDifference, thresholdDiffSum);
 
-                    // maxDiff: Maximum difference to the mean image
-                    //          {-255,...,255}
-                    // max:     Maximum pixel value
-                    //          {0,...,255}
-                    // temp:    Sum of all differences
-                    //          {-3*255,...,3*255}
-                    // sum:     Sum of all pixel values
-                    //          {0,...,3*255}
-
-                    r = GETR(out[pixel]) - m_longMeanImage[3*pixel+0];
-                    maxDiff = r;
-                    max = GETR(out[pixel]);
-                    temp = r;
-
-                    g = GETG(out[pixel]) - m_longMeanImage[3*pixel+1];
-                    if (max < GETG(out[pixel])) {
-                        max = GETG(out[pixel]);
+                    if (m_pStatsBrightness || m_pStatsDiff || m_pStatsDiffSum) {
+                        // The statistics replace the whole image.
+                        stats(y, src, dst, thresholdBrightness, thresholdDifference, thresholdDiffSum);
+                        continue;
                     }
-                    if (maxDiff < g) {
-                        maxDiff = g;
-                    }
-                    temp += g;
 
-                    b = GETB(out[pixel]) - m_longMeanImage[3*pixel+2];
-                    if (max < GETB(out[pixel])) {
-                        max = GETB(out[pixel]);
-                    }
-                    if (maxDiff < b) {
-                        maxDiff = b;
+                    /*
+                     Background weight
+                     */
+                    if (m_pBackgroundWeight > 0) {
+                        // Use part of the background mean. This allows one to have only lights appearing in the video
+                        // if people or other objects walk into the video after the first frame (darker, therefore not in the light mask).
+                        for (unsigned int x = 0; x < width; x++) {
+                            size_t pixel = (size_t)y*width + x;
+                            dst[x] = RGBA((int) (m_pBackgroundWeight*mean(pixel, 0) + (1-m_pBackgroundWeight)*GETR(src[x])),
+                                          (int) (m_pBackgroundWeight*mean(pixel, 1) + (1-m_pBackgroundWeight)*GETG(src[x])),
+                                          (int) (m_pBackgroundWeight*mean(pixel, 2) + (1-m_pBackgroundWeight)*GETB(src[x])),
+                                          0xFF);
+                        }
+                    } else if (dst != src) {
+                        std::copy(src, src + width, dst);
                     }
-                    temp += b;
 
-                    sum = GETR(out[pixel]) + GETG(out[pixel]) + GETB(out[pixel]);
+                    /*
+                     Adding light mask
+                     */
+                    addLights(y, dst, saturation, lowerOverexposure);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+private:
 
-                    if (
-                            maxDiff > thresholdDifference
-                            && temp > thresholdDiffSum
-                            && sum > thresholdBrightness
-                            // If all requirements are met, then this should be a light source.
-                        )
-                    {
+    // The background mean of channel c (0 to 2 for R, G and B) of a pixel.
+    // Means of whole numbers are whole numbers again.
+    float mean(size_t pixel, int c) const
+    {
+        return m_longMean.data()[4*pixel + c] / 257.f;
+    }
+
+#if defined(__SSE2__)
+    // The same for the pixels pixel to pixel+3, a register per channel
+    void means4(size_t pixel, __m128& r, __m128& g, __m128& b) const
+    {
+        const __m128i* m = (const __m128i*)(m_longMean.data() + 4*pixel);
+        const __m128i lo = _mm_set1_epi32(0xFFFF);
+        const __m128 d = _mm_set1_ps(257);
+        __m128 p01 = _mm_castsi128_ps(_mm_loadu_si128(m));
+        __m128 p23 = _mm_castsi128_ps(_mm_loadu_si128(m + 1));
+        // R and G, B and A of each pixel in 32 bits
+        __m128i rg = _mm_castps_si128(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i ba = _mm_castps_si128(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1)));
+        r = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(rg, lo)), d);
+        g = _mm_div_ps(_mm_cvtepi32_ps(_mm_srli_epi32(rg, 16)), d);
+        b = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(ba, lo)), d);
+    }
+#endif
+
+    void dimMult(float* light, float factor)
+    {
+        unsigned int i = 0;
+#if defined(__SSE2__)
+        const __m128 f = _mm_set1_ps(factor);
+        for (; i + 4 <= width*height; i += 4) {
+            _mm_store_ps(light + i, _mm_mul_ps(_mm_load_ps(light + i), f));
+        }
+#endif
+        for (; i < width*height; i++) {
+            light[i] *= factor;
+        }
+    }
+
+    /*
+     Light detection for row y: pixels that differ enough from the background,
+     and are bright enough, add their light to the light mask.
+     */
+    void detectLights(unsigned int y, const uint32_t* src, double sensitivity,
+                      double thresholdBrightness, double thresholdDifference, double thresholdDiffSum)
+    {
+        const size_t row = (size_t)y*width;
+        unsigned int x = 0;
+
+#if defined(LG_ADV) && !defined(LG_NO_OVERLAY)
+        float* lr = m_rgbLightMask[0].data() + row;
+        float* lg = m_rgbLightMask[1].data() + row;
+        float* lb = m_rgbLightMask[2].data() + row;
+
+#if defined(__SSE2__)
+        // The differences and sums are integers, so comparing them to the
+        // thresholds rounded down is the same as comparing them to the thresholds.
+        const __m128i tDiff = _mm_set1_epi32(threshold(thresholdDifference));
+        const __m128i tDiffSum = _mm_set1_epi32(threshold(thresholdDiffSum));
+        const __m128i tBrightness = _mm_set1_epi32(threshold(thresholdBrightness));
+        const __m128i lo = _mm_set1_epi32(0xFF);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 full = _mm_set1_ps(255);
+        const __m128 third = _mm_set1_ps(3);
+        const __m128d sens = _mm_set1_pd(sensitivity);
+        for (; x + 4 <= width; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src + x));
+            __m128i pr = _mm_and_si128(p, lo);
+            __m128i pg = _mm_and_si128(_mm_srli_epi32(p, 8), lo);
+            __m128i pb = _mm_and_si128(_mm_srli_epi32(p, 16), lo);
+
+            // Differences to the background, truncated like an int assignment
+            __m128 mr, mg, mb;
+            means4(row + x, mr, mg, mb);
+            __m128i r = _mm_cvttps_epi32(_mm_sub_ps(_mm_cvtepi32_ps(pr), mr));
+            __m128i g = _mm_cvttps_epi32(_mm_sub_ps(_mm_cvtepi32_ps(pg), mg));
+            __m128i b = _mm_cvttps_epi32(_mm_sub_ps(_mm_cvtepi32_ps(pb), mb));
+
+            __m128i maxDiff = maxEpi32(maxEpi32(r, g), b);
+            __m128i temp = _mm_add_epi32(_mm_add_epi32(r, g), b);
+            __m128i sum = _mm_add_epi32(_mm_add_epi32(pr, pg), pb);
+            __m128 light = _mm_castsi128_ps(_mm_and_si128(_mm_and_si128(
+                _mm_cmpgt_epi32(maxDiff, tDiff), _mm_cmpgt_epi32(temp, tDiffSum)),
+                _mm_cmpgt_epi32(sum, tBrightness)));
+
+            __m128 fr = _mm_div_ps(_mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(r), zero), full), full);
+            __m128 fg = _mm_div_ps(_mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(g), zero), full), full);
+            __m128 fb = _mm_div_ps(_mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(b), zero), full), full);
+            __m128 f = _mm_div_ps(_mm_add_ps(_mm_add_ps(fr, fg), fb), third);
+            f = _mm_movelh_ps(_mm_cvtpd_ps(_mm_mul_pd(_mm_cvtps_pd(f), sens)),
+                              _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f)), sens)));
+            f = _mm_and_ps(f, light);
+
+            _mm_storeu_ps(lr + x, _mm_add_ps(_mm_loadu_ps(lr + x), _mm_mul_ps(fr, f)));
+            _mm_storeu_ps(lg + x, _mm_add_ps(_mm_loadu_ps(lg + x), _mm_mul_ps(fg, f)));
+            _mm_storeu_ps(lb + x, _mm_add_ps(_mm_loadu_ps(lb + x), _mm_mul_ps(fb, f)));
+        }
+#endif
+#endif
+
+        for (; x < width; x++) {
+
+            // maxDiff: Maximum difference to the mean image
+            //          {-255,...,255}
+            // temp:    Sum of all differences
+            //          {-3*255,...,3*255}
+            // sum:     Sum of all pixel values
+            //          {0,...,3*255}
+
+            int r = GETR(src[x]) - mean(row+x, 0);
+            int g = GETG(src[x]) - mean(row+x, 1);
+            int b = GETB(src[x]) - mean(row+x, 2);
+            int maxDiff = std::max(r, std::max(g, b));
+            int temp = r + g + b;
+            int sum = GETR(src[x]) + GETG(src[x]) + GETB(src[x]);
+
+            if (
+                    maxDiff > thresholdDifference
+                    && temp > thresholdDiffSum
+                    && sum > thresholdBrightness
+                    // If all requirements are met, then this should be a light source.
+                )
+            {
 #ifdef LG_ADV
-                        // Just add values as float. Overflows are highly unlikely (3.4E38+ frames ...).
-                        fr = CLAMP(r)/255.0;
-                        fg = CLAMP(g)/255.0;
-                        fb = CLAMP(b)/255.0;
+                // Just add values as float. Overflows are highly unlikely (3.4E38+ frames ...).
+                float fr = CLAMP(r)/255.0;
+                float fg = CLAMP(g)/255.0;
+                float fb = CLAMP(b)/255.0;
 
-                        f = (fr + fg + fb) / 3 * sensitivity;
-                        fr *= f;
-                        fg *= f;
-                        fb *= f;
+                float f = (fr + fg + fb) / 3 * sensitivity;
+                fr *= f;
+                fg *= f;
+                fb *= f;
 
 #ifdef LG_NO_OVERLAY
-//                        std::cout << "fr: " << fr << "; fg: " << fg << "; fb: " << fb << "\n";
-                        fr -= m_prevMask[pixel].r;
-                        fg -= m_prevMask[pixel].g;
-                        fb -= m_prevMask[pixel].b;
-                        m_prevMask[pixel].r += fr;
-                        m_prevMask[pixel].g += fg;
-                        m_prevMask[pixel].b += fb;
-//                        std::cout << "fr2: " << fr << "; fg2: " << fg << "; fb2: " << fb << "\n";
-                        if (fr < 0) { fr = 0; }
-                        if (fg < 0) { fg = 0; }
-                        if (fb < 0) { fb = 0; }
+                fr -= m_prevMask[0][row+x];
+                fg -= m_prevMask[1][row+x];
+                fb -= m_prevMask[2][row+x];
+                m_prevMask[0][row+x] += fr;
+                m_prevMask[1][row+x] += fg;
+                m_prevMask[2][row+x] += fb;
+                if (fr < 0) { fr = 0; }
+                if (fg < 0) { fg = 0; }
+                if (fb < 0) { fb = 0; }
 #endif
 
-                        m_rgbLightMask[pixel].r += fr;
-                        m_rgbLightMask[pixel].g += fg;
-                        m_rgbLightMask[pixel].b += fb;
+                m_rgbLightMask[0][row+x] += fr;
+                m_rgbLightMask[1][row+x] += fg;
+                m_rgbLightMask[2][row+x] += fb;
 
 #else
-                        // Store the «additional» light delivered by the light source in the light mask.
-                        color = RGBA(CLAMP(r), CLAMP(g), CLAMP(b),0xFF);
-                        m_lightMask[pixel] = MAX(m_lightMask[pixel], color);
-
-                        // Add the brightness of the light source to the brightness map (alpha map)
-                        y = REC709Y(CLAMP(r), CLAMP(g), CLAMP(b)) / 255.0;
-                        y = y * sensitivity;
-                        m_alphaMap[4*pixel] += y;
+                // Store the «additional» light delivered by the light source in the light mask.
+                uint32_t color = RGBA(CLAMP(r), CLAMP(g), CLAMP(b),0xFF);
+                m_lightMask[row+x] = MAX(m_lightMask[row+x], color);
+
+                // Add the brightness of the light source to the brightness map (alpha map)
+                float y = REC709Y(CLAMP(r), CLAMP(g), CLAMP(b)) / 255.0;
+                y = y * sensitivity;
+                m_alphaMap[4*(row+x)] += y;
 #endif
-                    } else {
+            } else {
 #ifdef LG_NO_OVERLAY
-                        m_prevMask[pixel] = rgb0;
+                m_prevMask[0][row+x] = 0;
+                m_prevMask[1][row+x] = 0;
+                m_prevMask[2][row+x] = 0;
 #endif
-                    }
-
-
-
-                    /*
-                     Background weight
-                     */
-                    if (m_pBackgroundWeight > 0) {
-                        // Use part of the background mean. This allows one to have only lights appearing in the video
-                        // if people or other objects walk into the video after the first frame (darker, therefore not in the light mask).
-                        out[pixel] = RGBA((int) (m_pBackgroundWeight*m_longMeanImage[3*pixel+0] + (1-m_pBackgroundWeight)*GETR(out[pixel])),
-                                          (int) (m_pBackgroundWeight*m_longMeanImage[3*pixel+1] + (1-m_pBackgroundWeight)*GETG(out[pixel])),
-                                          (int) (m_pBackgroundWeight*m_longMeanImage[3*pixel+2] + (1-m_pBackgroundWeight)*GETB(out[pixel])),
-                                          0xFF);
-                    }
+            }
+        }
+    }
 
+    /*
+     Paints the light mask of row y over dst. Pixels without light keep their
+     colour, or become transparent if the background is to be transparent.
+     */
+    void addLights(unsigned int y, uint32_t* dst, double saturation, double lowerOverexposure)
+    {
+        const size_t row = (size_t)y*width;
 
-                    /*
-                     Adding light mask
-                     */
+        for (unsigned int x = 0; x < width; x++) {
 #ifdef LG_ADV
-                    if (
-                            (m_rgbLightMask[pixel].r != 0 || m_rgbLightMask[pixel].g != 0 || m_rgbLightMask[pixel].b != 0)
-                            && !m_pStatsBrightness && !m_pStatsDiff && !m_pStatsDiffSum
-                       )
-                    {
-
-                        fr = m_rgbLightMask[pixel].r;
-                        fg = m_rgbLightMask[pixel].g;
-                        fb = m_rgbLightMask[pixel].b;
-
-                        if (lowerOverexposure > 0) {
-                            // Comparisation of plots with octave:
-                            // clf;hold on;plot([0 1],[0 1],'k');plot(range,ones(length(range),1),'k');plot(range,sqrt(range));plot(range,log(1+range),'k');plot(range,log(1+range),'g');plot(range,(log(1+range)/3).^.5,'r');axis equal
-                            fr = pow( log(1+fr)/lowerOverexposure, .5 );
-                            fg = pow( log(1+fg)/lowerOverexposure, .5 );
-                            fb = pow( log(1+fb)/lowerOverexposure, .5 );
-                        }
+            float fr = m_rgbLightMask[0][row+x];
+            float fg = m_rgbLightMask[1][row+x];
+            float fb = m_rgbLightMask[2][row+x];
+
+            if (fr != 0 || fg != 0 || fb != 0) {
+
+                if (lowerOverexposure > 0) {
+                    // Comparisation of plots with octave:
+                    // clf;hold on;plot([0 1],[0 1],'k');plot(range,ones(length(range),1),'k');plot(range,sqrt(range));plot(range,log(1+range),'k');plot(range,log(1+range),'g');plot(range,(log(1+range)/3).^.5,'r');axis equal
+                    fr = pow( log(1+fr)/lowerOverexposure, .5 );
+                    fg = pow( log(1+fg)/lowerOverexposure, .5 );
+                    fb = pow( log(1+fb)/lowerOverexposure, .5 );
+                }
 
 
-                        // Calculate overflow between different colours:
-                        // A very bright red light source will eventually overflow into other channels.
-                        sr = 0;
-                        sg = 0;
-                        sb = 0;
-                        if (fr > 1) {
-                            sr += fr - 1;
-                        }
-                        if (fg > 1) {
-                            sg += fg - 1;
-                        }
-                        if (fb > 1) {
-                            sb += fb - 1;
-                        }
-                        fr += (sg + sb)/2;
-                        fg += (sr + sb)/2;
-                        fb += (sg + sb)/2;
-                        if (fr > 1) {
-                            fr = 1;
-                        }
-                        if (fg > 1) {
-                            fg = 1;
-                        }
-                        if (fb > 1) {
-                            fb = 1;
-                        }
+                // Calculate overflow between different colours:
+                // A very bright red light source will eventually overflow into other channels.
+                float sr = 0;
+                float sg = 0;
+                float sb = 0;
+                if (fr > 1) {
+                    sr += fr - 1;
+                }
+                if (fg > 1) {
+                    sg += fg - 1;
+                }
+                if (fb > 1) {
+                    sb += fb - 1;
+                }
+                fr += (sg + sb)/2;
+                fg += (sr + sb)/2;
+                fb += (sg + sb)/2;
+                if (fr > 1) {
+                    fr = 1;
+                }
+                if (fg > 1) {
+                    fg = 1;
+                }
+                if (fb > 1) {
+                    fb = 1;
+                }
 
-                        // Increase the saturation if the average brightness is below a certain level
-                        // Do not use Rec709 Luma since we want to consider all colours to equal parts.
-                        fy = (fr + fg + fb) / 3;
-                        if (fy < 1 && saturation > 0) {
-                            fsat = 1 + saturation*(1-fy);
+                // Increase the saturation if the average brightness is below a certain level
+                // Do not use Rec709 Luma since we want to consider all colours to equal parts.
+                float fy = (fr + fg + fb) / 3;
+                if (fy < 1 && saturation > 0) {
+                    float fsat = 1 + saturation*(1-fy);
 
-                            fr = fy + fsat * (fr-fy);
-                            fg = fy + fsat * (fg-fy);
-                            fb = fy + fsat * (fb-fy);
-                        }
+                    fr = fy + fsat * (fr-fy);
+                    fg = fy + fsat * (fg-fy);
+                    fb = fy + fsat * (fb-fy);
+                }
 
-                        // Paint the light on top of the image using addition
-                        // Since brightness is equidistant in sRGB, this works fine.
-                        r = 255*fr + GETR(out[pixel]);
-                        g = 255*fg + GETG(out[pixel]);
-                        b = 255*fb + GETB(out[pixel]);
-                        r = CLAMP(r);
-                        g = CLAMP(g);
-                        b = CLAMP(b);
-                        out[pixel] = RGBA(r,g,b,0xFF);
+                // Paint the light on top of the image using addition
+                // Since brightness is equidistant in sRGB, this works fine.
+                int r = 255*fr + GETR(dst[x]);
+                int g = 255*fg + GETG(dst[x]);
+                int b = 255*fb + GETB(dst[x]);
+                r = CLAMP(r);
+                g = CLAMP(g);
+                b = CLAMP(b);
+                dst[x] = RGBA(r,g,b,0xFF);
+
+            } else if (m_pTransparentBackground) {
+                // Transparent background
+                dst[x] &= RGBA(0xFF, 0xFF, 0xFF, 0);
+            }
+#else
+            if (m_lightMask[row+x] != 0  && m_alphaMap[4*(row+x) + 0] != 0) {
 
-#ifdef LG_DEBUG
-                        deCount++;
-                        if (deCount < 10) {
-                            std::cout << "r: " << m_rgbLightMask[pixel].r << ", fy: " << fy << ", fr: " << fr << ", sr: " << sr << ", R: " << r << ", inR: " << GETR(in[pixel]) << "\n";
-                        }
-#endif
+                float f = sqrt(m_alphaMap[4*(row+x)]);
+
+                int r = f * GETR(m_lightMask[row+x]);
+                int g = f * GETG(m_lightMask[row+x]);
+                int b = f * GETB(m_lightMask[row+x]);
 
-                    } else if (m_pTransparentBackground) {
-                        // Transparent background
-                        out[pixel] &= RGBA(0xFF, 0xFF, 0xFF, 0);
+                if (f > 1) {
+                    // Simulate overexposure
+                    int sum = 0;
+                    if (r > 255) {
+                        sum += r-255;
+                    }
+                    if (g > 255) {
+                        sum += g-255;
+                    }
+                    if (b > 255) {
+                        sum += g-255;
                     }
-#else
-                    if (
-                            m_lightMask[pixel] != 0  && m_alphaMap[4*pixel + 0] != 0
-                            && !m_pStatsBrightness && !m_pStatsDiff && !m_pStatsDiffSum
-                        )
-                    {
-
-                        f = sqrt(m_alphaMap[4*pixel]);
-
-                        r = f * GETR(m_lightMask[pixel]);
-                        g = f * GETG(m_lightMask[pixel]);
-                        b = f * GETB(m_lightMask[pixel]);
-
-                        if (f > 1) {
-                            // Simulate overexposure
-                            sum = 0;
-                            if (r > 255) {
-                                sum += r-255;
-                            }
-                            if (g > 255) {
-                                sum += g-255;
-                            }
-                            if (b > 255) {
-                                sum += g-255;
-                            }
 
-                            if (sum > 0) {
-                                sum = sum/10.0;
-                                r += sum;
-                                g += sum;
-                                b += sum;
-                            }
-                        } else if (f < 1) {
-                            // Lower exposure: Stronger colors
-                            y = REC709Y(r,g,b);
-                            float sat = 2.0;
-
-                            r = y + sat * (r-y);
-                            g = y + sat * (g-y);
-                            b = y + sat * (b-y);
-                        }
+                    if (sum > 0) {
+                        sum = sum/10.0;
+                        r += sum;
+                        g += sum;
+                        b += sum;
+                    }
+                } else if (f < 1) {
+                    // Lower exposure: Stronger colors
+                    float y = REC709Y(r,g,b);
+                    float sat = 2.0;
+
+                    r = y + sat * (r-y);
+                    g = y + sat * (g-y);
+                    b = y + sat * (b-y);
+                }
 
 
-                        // Add the light map as additional light to the image
-                        r += GETR(out[pixel]);
-                        g += GETG(out[pixel]);
-                        b += GETB(out[pixel]);
-                        r = CLAMP(r);
-                        g = CLAMP(g);
-                        b = CLAMP(b);
-                        out[pixel] = RGBA(r,g,b,0xFF);
-                    } else if (m_pTransparentBackground) {
-                        // Transparent background
-                        out[pixel] &= RGBA(0xFF, 0xFF, 0xFF, 0);
-                    }
+                // Add the light map as additional light to the image
+                r += GETR(dst[x]);
+                g += GETG(dst[x]);
+                b += GETB(dst[x]);
+                r = CLAMP(r);
+                g = CLAMP(g);
+                b = CLAMP(b);
+                dst[x] = RGBA(r,g,b,0xFF);
+            } else if (m_pTransparentBackground) {
+                // Transparent background
+                dst[x] &= RGBA(0xFF, 0xFF, 0xFF, 0);
+            }
 #endif
+        }
+    }
 
+    /*
+     In-video statistics for easier parameter adjustment (thresholds)
+     */
+    void stats(unsigned int y, const uint32_t* src, uint32_t* dst,
+               double thresholdBrightness, double thresholdDifference, double thresholdDiffSum)
+    {
+        const size_t row = (size_t)y*width;
+        int r = 0, g = 0, b = 0;
+
+        for (unsigned int x = 0; x < width; x++) {
+            int maxDiff = std::max((int) (GETR(src[x]) - mean(row+x, 0)),
+                                   std::max((int) (GETG(src[x]) - mean(row+x, 1)),
+                                            (int) (GETB(src[x]) - mean(row+x, 2))));
+            int temp = (int) (GETR(src[x]) - mean(row+x, 0))
+                + (int) (GETG(src[x]) - mean(row+x, 1))
+                + (int) (GETB(src[x]) - mean(row+x, 2));
+            int sum = GETR(src[x]) + GETG(src[x]) + GETB(src[x]);
+
+            if (m_pStatsBrightness) {
+                // Show the image's brightness and highlight the threshold set by the user
+
+                // Limit maximum brightness to 80% for still being able to distinguish
+                // between «bright spot» (light grey) and «over the threshold» (blue)
+                r = .8*sum/3;
+                g = .8*sum/3;
+                b = .8*sum/3;
+                if (sum > thresholdBrightness) {
+                    b = 255;
+                }
+                dst[x] = RGBA(r,g,b,0xFF);
+            }
 
-                    /*
-                     In-video statistics for easier parameter adjustment (thresholds)
-                     */
-                    if (m_pStatsBrightness) {
-                        // Show the image's brightness and highlight the threshold set by the user
-
-                        // Limit maximum brightness to 80% for still being able to distinguish
-                        // between «bright spot» (light grey) and «over the threshold» (blue)
-                        r = .8*sum/3;
-                        g = .8*sum/3;
-                        b = .8*sum/3;
-                        if (sum > thresholdBrightness) {
-                            b = 255;
-                        }
-                        out[pixel] = RGBA(r,g,b,0xFF);
-                    }
-
-                    if (m_pStatsDiff) {
-                        // As above, but for the brightness difference relative to the background.
-                        r = .8*CLAMP(maxDiff);
-                        g = r;
-                        if (!m_pStatsBrightness) {
-                            b = r;
-                        }
+            if (m_pStatsDiff) {
+                // As above, but for the brightness difference relative to the background.
+                r = .8*CLAMP(maxDiff);
+                g = r;
+                if (!m_pStatsBrightness) {
+                    b = r;
+                }
 
-                        if (maxDiff > thresholdDifference) {
-                            g = 255;
-                        }
-                        out[pixel] = RGBA(r,g,b,0xFF);
-                    }
+                if (maxDiff > thresholdDifference) {
+                    g = 255;
+                }
+                dst[x] = RGBA(r,g,b,0xFF);
+            }
 
-                    if (m_pStatsDiffSum) {
-                        // As above, for the sum of the differences in each color channel.
-                        r = .8*CLAMP(temp/3.0);
-                        if (!m_pStatsDiff) {
-                            g = r;
-                        }
-                        if (!m_pStatsBrightness) {
-                            b = r;
-                        }
-                        if (temp > thresholdDiffSum) {
-                            r = 255;
-                        }
-                        out[pixel] = RGBA(r,g,b,0xFF);
-                    }
+            if (m_pStatsDiffSum) {
+                // As above, for the sum of the differences in each color channel.
+                r = .8*CLAMP(temp/3.0);
+                if (!m_pStatsDiff) {
+                    g = r;
                 }
-                break;
-            default:
-                break;
+                if (!m_pStatsBrightness) {
+                    b = r;
+                }
+                if (temp > thresholdDiffSum) {
+                    r = 255;
+                }
+                dst[x] = RGBA(r,g,b,0xFF);
+            }
         }
     }
 
-private:
+    // One plane per colour, so that the per-pixel arithmetic can work on
+    // several pixels at a time; the background mean is a running buffer
+    // with the channels of each pixel side by side. All start out zero;
+    // they are allocated and zeroed by the first update, and again after
+    // trim(), so that the thread that renders the instance touches them
+    // first.
+    void allocate()
+    {
+        if (m_longMean.width() == 0) {
+            m_longMean.resize_deferred(4*width, height);
+            for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+                m_rgbLightMask[c].resize_deferred(width, height);
+#endif
+#ifdef LG_NO_OVERLAY
+                m_prevMask[c].resize_deferred(width, height);
+#endif
+            }
+        }
+        m_longMean.touch();
+        for (int c = 0; c < 3; c++) {
+#ifdef LG_ADV
+            m_rgbLightMask[c].touch();
+#endif
+#ifdef LG_NO_OVERLAY
+            m_prevMask[c].touch();
+#endif
+        }
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i maxEpi32(__m128i a, __m128i b)
+    {
+        __m128i gt = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+    }
+
+    // The largest int that is not above t
+    static inline int threshold(double t)
+    {
+        if (t < INT_MIN) return INT_MIN;
+        if (t > INT_MAX) return INT_MAX;
+        return (int) floor(t);
+    }
+#endif
+
     std::vector<uint32_t> m_lightMask;
-    std::vector<float> m_longMeanImage;
     std::vector<float> m_alphaMap;
+    frei0r::aligned_frame<uint16_t> m_longMean; // running buffer of frei0r_accum.h
     bool m_meanInitialized;
     GraffitiMode m_mode;
     DimMode m_dimMode;
+    int m_stageBackground;
+    int m_stageDim;
+    int m_stageLights;
 
 #ifdef LG_ADV
-    std::vector<RGBFloat> m_rgbLightMask;
+    frei0r::aligned_frame<float> m_rgbLightMask[3]; // R, G and B planes
 #endif
 #ifdef LG_NO_OVERLAY
-    std::vector<RGBFloat> m_prevMask;
+    frei0r::aligned_frame<float> m_prevMask[3];
 #endif
 
     double m_pLongAlpha;
@@ -1062,5 +1289,6 @@ private:
 frei0r::construct<LightGraffiti> plugin("Light Graffiti",
                 "Creates light graffitis from a video by keeping the brightest spots.",
                 "Simon A. Eugster (Granjow)",
-                0,3,
-                F0R_COLOR_MODEL_RGBA8888);
+                0,4,
+                F0R_COLOR_MODEL_RGBA8888,
+                F0R_CAP_TEMPORAL | F0R_CAP_CLONE | F0R_CAP_STATE);
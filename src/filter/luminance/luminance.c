@@ -23,6 +23,8 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_planar.h"
+#include "frei0r_lut.h"
 
 #define MAX_SATURATION 8.0
 
@@ -53,6 +55,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* luminance_info)
   luminance_info->explanation = "Creates a luminance map of the image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_PLANAR;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 }
@@ -79,31 +88,48 @@ void f0r_get_param_value(f0r_instance_t instance,
 {
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+/* the Rec. 601 luma, the same as the luma plane of YUV frames */
+static const frei0r_luma_t luminance_luma = FREI0R_LUMA_REC601;
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   luminance_instance_t* inst = (luminance_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
 
+  frei0r_lut_gray(outframe + inst->width * row_begin,
+                  inframe + inst->width * row_begin,
+                  inst->width * (row_end - row_begin), &luminance_luma);
+  return 1;
+}
 
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-
-  int b, g, r, l;
-  while (len--)
-  {
-	  r = *src++;
-	  g = *src++;
-	  b = *src++;
-	  l = ( 30 * r + 59 * g + 11 * b ) / 100;
-
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  luminance_instance_t* inst = (luminance_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
 
-	  *dst++ = (unsigned char) (l);
-	  *dst++ = (unsigned char) (l);
-	  *dst++ = (unsigned char) (l);
+/* the luminance map of a YUV frame is its luma plane */
+int f0r_update_planar(f0r_instance_t instance, double time,
+                      const f0r_planar_frame_t* inframe,
+                      const f0r_planar_frame_t* outframe)
+{
+  assert(instance);
+  luminance_instance_t* inst = (luminance_instance_t*)instance;
 
-	  *dst++ = *src++;  // copy alpha
-  }
+  if (!frei0r_planar_check(inframe, outframe))
+    return 0;
+  frei0r_planar_copy(inframe->planes[0], inframe->strides[0],
+                     outframe->planes[0], outframe->strides[0],
+                     inst->width, inst->height);
+  frei0r_planar_gray(outframe, inst->width, inst->height);
+  return 1;
 }
-
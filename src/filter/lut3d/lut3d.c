@@ -0,0 +1,212 @@
+/* lut3d.c
+ * Applies a 3D colour lookup table loaded from a .cube file
+ * This file is a Frei0r plugin.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "frei0r.h"
+#include "frei0r_lut3d.h"
+#include "frei0r_thread.h"
+
+typedef struct lut3d_instance
+{
+  unsigned int width;
+  unsigned int height;
+  char* file;          /* path of the loaded .cube file */
+  int tetrahedral;     /* tetrahedral (1) or trilinear (0) interpolation */
+  frei0r_lut3d_t lut;  /* empty until a file could be loaded */
+} lut3d_instance_t;
+
+typedef struct lut3d_job
+{
+  f0r_instance_t instance;
+  const uint32_t* inframe;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} lut3d_job_t;
+
+int f0r_init()
+{
+  return 1;
+}
+
+void f0r_deinit()
+{ /* no initialization required */ }
+
+void f0r_get_plugin_info(f0r_plugin_info_t* info)
+{
+  info->name = "3D LUT";
+  info->author = "frei0r";
+  info->plugin_type = F0R_PLUGIN_TYPE_FILTER;
+  info->color_model = F0R_COLOR_MODEL_RGBA8888;
+  info->frei0r_version = FREI0R_MAJOR_VERSION;
+  info->major_version = 0;
+  info->minor_version = 1;
+  info->num_params = 2;
+  info->explanation = "Maps the colours through a 3D lookup table from a .cube file";
+}
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
+void f0r_get_param_info(f0r_param_info_t* info, int param_index)
+{
+  switch(param_index)
+  {
+  case 0:
+    info->name = "File";
+    info->type = F0R_PARAM_STRING;
+    info->explanation = "Path of a .cube 3D LUT file, the image is passed through unchanged without one";
+    break;
+  case 1:
+    info->name = "Tetrahedral";
+    info->type = F0R_PARAM_BOOL;
+    info->explanation = "Use tetrahedral (true) or trilinear (false) interpolation";
+    break;
+  }
+}
+
+f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
+{
+  lut3d_instance_t* inst = (lut3d_instance_t*)calloc(1, sizeof(*inst));
+  inst->width = width; inst->height = height;
+  inst->file = calloc(1, sizeof(char));
+  inst->tetrahedral = 1;
+  frei0r_lut3d_init(&inst->lut);
+  return (f0r_instance_t)inst;
+}
+
+void f0r_destruct(f0r_instance_t instance)
+{
+  lut3d_instance_t* inst = (lut3d_instance_t*)instance;
+  frei0r_lut3d_free(&inst->lut);
+  free(inst->file);
+  free(instance);
+}
+
+void f0r_set_param_value(f0r_instance_t instance,
+                         f0r_param_t param, int param_index)
+{
+  assert(instance);
+  lut3d_instance_t* inst = (lut3d_instance_t*)instance;
+
+  switch(param_index)
+  {
+    char* sval;
+  case 0:
+    /* file, only reloaded when the path changes */
+    sval = (*(char**)param);
+    if (strcmp(inst->file, sval))
+    {
+      inst->file = (char*)realloc(inst->file, strlen(sval) + 1);
+      strcpy(inst->file, sval);
+      if (*sval == 0)
+        frei0r_lut3d_free(&inst->lut);
+      else if (frei0r_lut3d_load_cube(&inst->lut, sval) != 0)
+      {
+        fprintf(stderr, "lut3d: cannot load %s\n", sval);
+        frei0r_lut3d_free(&inst->lut);
+      }
+    }
+    break;
+  case 1:
+    /* tetrahedral */
+    inst->tetrahedral = (*((double*)param) >= 0.5);
+    break;
+  }
+}
+
+void f0r_get_param_value(f0r_instance_t instance,
+                         f0r_param_t param, int param_index)
+{
+  assert(instance);
+  lut3d_instance_t* inst = (lut3d_instance_t*)instance;
+
+  switch(param_index)
+  {
+  case 0:
+    *((f0r_param_string*)param) = inst->file;
+    break;
+  case 1:
+    *((double*)param) = inst->tetrahedral ? 1.0 : 0.0;
+    break;
+  }
+}
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  lut3d_instance_t* inst = (lut3d_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  frei0r_lut3d_apply(&inst->lut,
+                     inst->tetrahedral ? FREI0R_LUT3D_TETRAHEDRAL
+                                       : FREI0R_LUT3D_TRILINEAR,
+                     inframe + inst->width * row_begin,
+                     outframe + inst->width * row_begin,
+                     (long)inst->width * (row_end - row_begin));
+  return 1;
+}
+
+static void* lut3d_rows(void* arg)
+{
+  lut3d_job_t* job = (lut3d_job_t*)arg;
+  f0r_update_slice(job->instance, 0.0, job->inframe, 0, 0, job->outframe,
+                   job->row_begin, job->row_end, 0);
+  return 0;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  lut3d_instance_t* inst = (lut3d_instance_t*)instance;
+  lut3d_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].instance = instance;
+    jobs[i].inframe = inframe;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(lut3d_rows, jobs, sizeof(lut3d_job_t), n);
+}
+
+/* the lattice loaded from the file is kept */
+int f0r_resize(f0r_instance_t instance,
+               unsigned int width, unsigned int height)
+{
+  assert(instance);
+  lut3d_instance_t* inst = (lut3d_instance_t*)instance;
+  inst->width = width; inst->height = height;
+  return 1;
+}
@@ -20,16 +20,16 @@
 #include <math.h>
 #include "frei0r.h"
 #include <stdlib.h>
-#include "blur.h"
+#include "frei0r_simd.h"
 
 typedef struct mask0mate_instance {
 	double left, top, right, bottom;
 	double blur;
 	int invert;
 	int w, h;
-	uint32_t* mask;
 	uint32_t* mask_blurred;
-	f0r_instance_t* blur_instance;
+	int changed; /* parameters set since the last update */
+	int made[6]; /* l, r, t, b, invert and kernel of mask_blurred */
 } mask0mate_instance_t;
 
 void update_mask( mask0mate_instance_t* i ){
@@ -52,31 +52,61 @@ void update_mask( mask0mate_instance_t* i ){
 	if ( l > r ) { int c = l; l = r; r = c; }
 	if ( t > b ) { int c = t; t = b; b = c; }
 
-	int len = i->w * i->h;
-	int j;
-	uint32_t v;
+	/* hosts set all parameters for every frame, the mask and its
+	   blur are only made again when they have changed */
+	int kernel = (int)(i->blur * MAX(i->w, i->h) / 2.0);
+	if ( i->made[0] == l && i->made[1] == r && i->made[2] == t &&
+	     i->made[3] == b && i->made[4] == i->invert && i->made[5] == kernel ) {
+		return;
+	}
+	i->made[0] = l; i->made[1] = r; i->made[2] = t;
+	i->made[3] = b; i->made[4] = i->invert; i->made[5] = kernel;
+
+	/* The blur is the box filter of blur.h, the mean of the mask over
+	   the kernel, clipped to the frame. Of a rectangle that is the
+	   share of the kernel's columns inside it times that of its rows,
+	   so only the band within the kernel of the edges is computed, the
+	   rest of the frame is inside or outside. */
+	uint32_t inside, outside;
 	if ( i->invert ) {
-		v = 0x00ffffff;
+		inside = 0xffffffff;
+		outside = 0x00ffffff;
 	} else {
-		v = 0xffffffff;
+		inside = 0x00ffffff;
+		outside = 0xffffffff;
 	}
+	int len = i->w * i->h;
+	int j;
 	for ( j = 0; j < len; j++ ) {
-		i->mask[j] = v;
+		i->mask_blurred[j] = outside;
 	}
-	if ( !i->invert ) {
-		v = 0x00ffffff;
-	} else {
-		v = 0xffffffff;
+	if ( l == r || t == b ) {
+		return;
+	}
+	if ( kernel < 0 ) {
+		kernel = 0;
 	}
 	int y, x;
-	for ( y = t; y < b; y++ ) {
-		for ( x = l; x < r; x++ ) {
-			i->mask[y*i->w + x] = v;
+	for ( y = MAX( t - kernel, 0 ); y < MIN( b + kernel, i->h ); y++ ) {
+		int y0 = MAX( y - kernel, 0 ), y1 = MIN( y + kernel + 1, i->h );
+		int ny = y1 - y0, cy = MIN( y1, b ) - MAX( y0, t );
+		uint32_t* row = i->mask_blurred + y*i->w;
+		for ( x = MAX( l - kernel, 0 ); x < MIN( r + kernel, i->w ); x++ ) {
+			int x0 = MAX( x - kernel, 0 ), x1 = MIN( x + kernel + 1, i->w );
+			int nx = x1 - x0, cx = MIN( x1, r ) - MAX( x0, l );
+			uint64_t area = (uint64_t)nx * ny, in = (uint64_t)cx * cy;
+			uint32_t a;
+			if ( in == area ) {
+				row[x] = inside;
+				continue;
+			}
+			if ( !i->invert ) {
+				in = area - in;
+			}
+			a = (uint32_t)( 255 * in / area );
+			row[x] = ( a << 24 ) | 0x00ffffff;
 		}
 	}
-
-	blur_set_param_value(i->blur_instance, &i->blur, 0 );
-	blur_update(i->blur_instance, 0.0, i->mask, i->mask_blurred);
 }
 int f0r_init()
 {
@@ -98,6 +128,12 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->explanation = "Creates an square alpha-channel mask";
 
 }
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
 void f0r_get_param_info( f0r_param_info_t* info, int param_index )
 {
 	switch ( param_index ) {
@@ -143,17 +179,14 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	inst->right = 0.2;
 	inst->top = 0.2;
 	inst->bottom = 0.2;
-	inst->mask = (uint32_t*)malloc( width * height * sizeof(uint32_t) );
 	inst->mask_blurred = (uint32_t*)malloc( width * height * sizeof(uint32_t) );
-	inst->blur_instance = (f0r_instance_t*)blur_construct( width, height );
+	inst->made[0] = -1;
 	update_mask( inst );
 	return (f0r_instance_t)inst;
 }
 void f0r_destruct(f0r_instance_t instance)
 {
 	mask0mate_instance_t* inst = (mask0mate_instance_t*)instance;
-	blur_destruct(inst->blur_instance);
-	free(inst->mask);
 	free(inst->mask_blurred);
 	free(instance);
 }
@@ -185,7 +218,7 @@ void f0r_set_param_value(f0r_instance_t instance,
 			inst->blur = *((double*)param);
 			break;
 	}
-	update_mask( inst );
+	inst->changed = 1;
 }
 void f0r_get_param_value(f0r_instance_t instance,
                          f0r_param_t param, int param_index)
@@ -217,19 +250,83 @@ void f0r_update(f0r_instance_t instance, double time,
 {
 	mask0mate_instance_t* inst = (mask0mate_instance_t*)instance;
 
-	uint32_t* dst = outframe;
-	const uint32_t* src = inframe;
-	const uint32_t* alpha = inst->mask_blurred;
-
-	int len = inst->w * inst->h;
-	
-	int i;
-	for ( i = 0; i < len; i++ ) {
-		*dst = *src & (*alpha | 0x00ffffff);
-		dst++;
-		src++;
-		alpha++;
+	if ( inst->changed ) {
+		update_mask( inst );
+		inst->changed = 0;
+	}
+
+	frei0r_simd_and( outframe, inframe, inst->mask_blurred, inst->w * inst->h );
+}
+
+
+/* Outside of the rectangle grown by the blur the mask is opaque, unless
+   inverted, and the frame passes through. */
+int f0r_get_region(f0r_instance_t instance, f0r_rect_t* rect)
+{
+	mask0mate_instance_t* inst = (mask0mate_instance_t*)instance;
+
+	if ( inst->changed ) {
+		update_mask( inst );
+		inst->changed = 0;
+	}
+	if ( inst->invert ) {
+		return 0;
+	}
+
+	int k = inst->made[5] + 1;
+	int l = inst->made[0], r = inst->made[1];
+	int t = inst->made[2], b = inst->made[3];
+	if ( l == r || t == b ) {
+		l = r = t = b = 0;
+	} else {
+		l = MAX( l - k, 0 );
+		r = MIN( r + k, inst->w );
+		t = MAX( t - k, 0 );
+		b = MIN( b + k, inst->h );
 	}
+	rect->x = l;
+	rect->y = t;
+	rect->width = r - l;
+	rect->height = b - t;
+	return 1;
+}
 
+int f0r_get_footprint(f0r_instance_t instance)
+{
+	return 0;
 }
 
+/* The mask is made by f0r_update or f0r_get_region, tiles may run on
+   several threads and can't make it. */
+int f0r_update_tile(f0r_instance_t instance, double time,
+                    const uint32_t* inframe, int inframe_stride,
+                    const f0r_rect_t* inrect,
+                    uint32_t* outframe, int outframe_stride,
+                    const f0r_rect_t* outrect)
+{
+	mask0mate_instance_t* inst = (mask0mate_instance_t*)instance;
+
+	if ( inst->changed
+	     || outrect->x < inrect->x || outrect->y < inrect->y
+	     || outrect->x + outrect->width > inrect->x + inrect->width
+	     || outrect->y + outrect->height > inrect->y + inrect->height
+	     || outrect->x < 0 || outrect->y < 0
+	     || outrect->x + outrect->width > inst->w
+	     || outrect->y + outrect->height > inst->h ) {
+		return 0;
+	}
+
+	const uint8_t* src = (const uint8_t*)inframe
+		+ (outrect->y - inrect->y) * inframe_stride
+		+ 4 * (outrect->x - inrect->x);
+	uint8_t* dst = (uint8_t*)outframe;
+	int y;
+	for ( y = 0; y < outrect->height; y++ ) {
+		frei0r_simd_and( (uint32_t*)dst, (const uint32_t*)src,
+		                 inst->mask_blurred + (outrect->y + y) * inst->w + outrect->x,
+		                 outrect->width );
+		src += inframe_stride;
+		dst += outframe_stride;
+	}
+	return 1;
+}
@@ -24,15 +24,21 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 
 */
 
-//measurement functions for direct inclusion in pr0be.c, pr0file.c
+//measurement functions for direct inclusion in pr0be.c, pr0file.c,
+//sc0pe.c
 
-typedef struct		//float pixel
-	{
-	float r;
-	float g;
-	float b;
-	float a;
-	} float_rgba;
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_cfc.h"	//float pixel
+#include "frei0r_thread.h"
 
 typedef struct		//statistics
 	{
@@ -260,6 +266,24 @@ v->rms=sqrtf((v->rms-nf*v->avg*v->avg)/nf);
 
 }
 
+//--------------------------------------------------------
+//appends the statistics of a channel to the string str of
+//size n, as "key.avg=... key.rms=... key.min=... key.max=...",
+//for programs that read the measurements instead of
+//looking at them
+//u=units    0=0.0-1.0    1=0-255
+void stat_str(char *str, int n, const char *key, stat s, int u)
+{
+int l;
+float k;
+
+k = (u==1) ? 255.0 : 1.0;
+l=strlen(str);
+if (l>=n-1) return;
+snprintf(str+l, n-l, "%s%s.avg=%.4f %s.rms=%.4f %s.min=%.4f %s.max=%.4f",
+	(l>0) ? " " : "", key, k*s.avg, key, k*s.rms, key, k*s.min, key, k*s.max);
+}
+
 //------------------------------------------------------------
 //statistics of a float_rgba pixel profile
 //color:
@@ -396,3 +420,421 @@ p->sv.rms=sqrtf((p->sv.rms-nf*p->sv.avg*p->sv.avg)/nf);
 
 }
 
+//=========================================================
+//whole frame statistics of Frei0r rgba8888 pixels
+//
+//the meri_* functions above measure small probes of a float
+//image; scopes look at every pixel of every frame, so this
+//works on the 8 bit pixels directly and only counts them into
+//histograms (and the per column luma histograms of a waveform),
+//from which hist8_stat() gives the same avg/rms/min/max.
+//columns are split over threads (see frei0r_thread.h), luma
+//is computed four pixels at a time with SSE2
+
+#define MERI_STRIP 64	//columns of a waveform strip, 32K of counts
+
+typedef struct		//histograms of a frame
+	{
+	uint32_t r[256];
+	uint32_t g[256];
+	uint32_t b[256];
+	uint32_t a[256];
+	uint32_t y[256];
+	uint32_t n;	//number of pixels counted
+	} hist8;
+
+typedef struct
+	{
+	const uint32_t *s;
+	uint16_t *wave;
+	int w,h,x0,x1,y0,step;
+	int wt[3];
+	hist8 hi;
+	} meri_job;
+
+//-----------------------------------------------------
+//15 bit fixed point luma weights, adding up to 1<<15
+//so that white stays 255
+static inline void luma_weights8(int color, int *wt)
+{
+if (color==1)	//CCIR rec 709
+	{wt[0]=6966;wt[1]=23436;wt[2]=2366;}
+else		//CCIR rec 601
+	{wt[0]=9798;wt[1]=19235;wt[2]=3735;}
+}
+
+//-----------------------------------------------------
+//luma of n rgba8888 pixels
+static inline void luma8(const uint8_t *p, uint8_t *l, int n, const int *wt)
+{
+int i=0;
+
+#if defined(__SSE2__)
+__m128i z=_mm_setzero_si128();
+__m128i k=_mm_set_epi16(0,wt[2],wt[1],wt[0],0,wt[2],wt[1],wt[0]);
+__m128i rnd=_mm_set1_epi32(1<<14);
+__m128i v,lo,hi,e,o;
+
+for (;i+4<=n;i+=4)
+	{
+	v=_mm_loadu_si128((const __m128i*)(p+4*i));
+	lo=_mm_madd_epi16(_mm_unpacklo_epi8(v,z),k);	//r*wr+g*wg, b*wb per pixel
+	hi=_mm_madd_epi16(_mm_unpackhi_epi8(v,z),k);
+	e=_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo),_mm_castsi128_ps(hi),_MM_SHUFFLE(2,0,2,0)));
+	o=_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo),_mm_castsi128_ps(hi),_MM_SHUFFLE(3,1,3,1)));
+	v=_mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(e,o),rnd),15);
+	v=_mm_packs_epi32(v,v);
+	v=_mm_packus_epi16(v,v);
+	*(int*)(l+i)=_mm_cvtsi128_si32(v);
+	}
+#endif
+for (;i<n;i++)
+	l[i]=(p[4*i]*wt[0]+p[4*i+1]*wt[1]+p[4*i+2]*wt[2]+(1<<14))>>15;
+}
+
+//-----------------------------------------------------
+//the columns x0...x1 of one job
+//even and odd pixels count into separate, interleaved
+//histograms, so that in flat areas an increment doesn't
+//wait for the one before it
+static inline void* meri_columns8(void *arg)
+{
+meri_job *j=(meri_job*)arg;
+uint32_t sub[5][256][2];
+uint8_t l[MERI_STRIP];
+const uint8_t *p,*q;
+int xs,xe,x,y,c,v;
+
+memset(sub,0,sizeof(sub));
+for (xs=j->x0;xs<j->x1;xs=xe)
+	{
+	xe = j->wave ? xs+MERI_STRIP : j->x1;
+	if (xe>j->x1) xe=j->x1;
+	if (j->wave)
+		for (v=0;v<256;v++)
+			memset(j->wave+v*j->w+xs,0,(xe-xs)*sizeof(uint16_t));
+	for (y=j->y0;y<j->h;y+=j->step)
+		{
+		p=(const uint8_t*)(j->s+y*j->w);
+		for (x=xs;x<xe;x+=c)
+			{
+			c = xe-x<MERI_STRIP ? xe-x : MERI_STRIP;
+			luma8(p+4*x,l,c,j->wt);
+			q=p+4*x;
+			for (v=0;v+2<=c;v+=2,q+=8)
+				{
+				sub[0][q[0]][0]++;
+				sub[0][q[4]][1]++;
+				sub[1][q[1]][0]++;
+				sub[1][q[5]][1]++;
+				sub[2][q[2]][0]++;
+				sub[2][q[6]][1]++;
+				sub[3][q[3]][0]++;
+				sub[3][q[7]][1]++;
+				sub[4][l[v]][0]++;
+				sub[4][l[v+1]][1]++;
+				}
+			if (v<c)
+				{
+				sub[0][q[0]][0]++;
+				sub[1][q[1]][0]++;
+				sub[2][q[2]][0]++;
+				sub[3][q[3]][0]++;
+				sub[4][l[v]][0]++;
+				}
+			if (j->wave)
+				for (v=0;v<c;v++)
+					j->wave[l[v]*j->w+x+v]++;
+			}
+		}
+	}
+for (v=0;v<256;v++)
+	{
+	j->hi.r[v]=sub[0][v][0]+sub[0][v][1];
+	j->hi.g[v]=sub[1][v][0]+sub[1][v][1];
+	j->hi.b[v]=sub[2][v][0]+sub[2][v][1];
+	j->hi.a[v]=sub[3][v][0]+sub[3][v][1];
+	j->hi.y[v]=sub[4][v][0]+sub[4][v][1];
+	}
+return 0;
+}
+
+//-----------------------------------------------------
+//histograms of a rgba8888 frame
+//color:
+//0=use rec 601
+//1=use rec 709
+//w,h=size of image, h<65536
+//step=only count every step-th row, starting with row y0
+//wave=NULL, or 256*w per column luma counts, the count of
+//     luma v in column x is wave[v*w+x]
+static inline void meri_hist8(const uint32_t *s, int w, int h, int color, int step, int y0, hist8 *hi, uint16_t *wave)
+{
+meri_job jobs[FREI0R_MAX_THREADS];
+int i,n,v;
+
+if (step<1) step=1;
+y0=y0%step;
+n=frei0r_thread_count((long)w*h/step);
+if (n>w/MERI_STRIP) n = w/MERI_STRIP>1 ? w/MERI_STRIP : 1;
+for (i=0;i<n;i++)
+	{
+	jobs[i].s=s;
+	jobs[i].wave=wave;
+	jobs[i].w=w;
+	jobs[i].h=h;
+	//bands start on whole strips, threads don't share the
+	//cache lines of the counts
+	jobs[i].x0=(w/MERI_STRIP*i/n)*MERI_STRIP;
+	jobs[i].x1= i==n-1 ? w : (w/MERI_STRIP*(i+1)/n)*MERI_STRIP;
+	jobs[i].y0=y0;
+	jobs[i].step=step;
+	luma_weights8(color,jobs[i].wt);
+	}
+frei0r_thread_run(meri_columns8, jobs, sizeof(meri_job), n);
+
+*hi=jobs[0].hi;
+for (i=1;i<n;i++)
+	for (v=0;v<256;v++)
+		{
+		hi->r[v]+=jobs[i].hi.r[v];
+		hi->g[v]+=jobs[i].hi.g[v];
+		hi->b[v]+=jobs[i].hi.b[v];
+		hi->a[v]+=jobs[i].hi.a[v];
+		hi->y[v]+=jobs[i].hi.y[v];
+		}
+hi->n=(uint32_t)w*((h-y0+step-1)/step);
+}
+
+//-----------------------------------------------------
+//AVG, RMS, MIN, MAX of a histogram, in the 0.0-1.0 scale
+//of the meri_* functions
+static inline void hist8_stat(const uint32_t *hist, uint32_t n, stat *st)
+{
+double s=0.0,s2=0.0;
+int v;
+
+st->avg=0.0; st->rms=0.0; st->min=0.0; st->max=0.0;
+if (n==0) return;
+for (v=0;v<256;v++)
+	{
+	s=s+(double)v*hist[v];
+	s2=s2+(double)v*v*hist[v];
+	}
+for (v=0;v<255;v++)
+	if (hist[v]!=0) break;
+st->min=v/255.0;
+for (v=255;v>0;v--)
+	if (hist[v]!=0) break;
+st->max=v/255.0;
+s=s/n;
+st->avg=s/255.0;
+st->rms=sqrt(fmax(s2/n-s*s,0.0))/255.0;
+}
+
+//=========================================================
+//summed area tables
+//
+//sums of the channels of rgba8888 pixels, their squares and
+//products over any rectangle in O(1), for probes too many or
+//too big to loop over. Only the rows where rectangles start
+//and end are kept, so that a grid of probes takes a few rows
+//of sums instead of a table the size of the frame, and the
+//frame is read once, from the first of these rows to the
+//last
+
+#define SAT_N 11	//r,g,b,a, r*r,g*g,b*b,a*a, r*g,r*b,g*b
+
+typedef struct
+	{
+	int w;		//width of image
+	int n;		//number of rows kept
+	int *y;		//the rows kept, ascending
+	uint64_t *t;	//n*(w+1)*SAT_N sums, row k, column x holds
+			//the sums over rows y[0]...y[k]-1, columns 0...x-1
+	} sat_tab;
+
+//-----------------------------------------------------
+//allocates a table of up to n rows, the caller sets t->n
+//and the rows t->y[] (ascending, 0...h) before sat_build()
+//returns 0 if out of memory
+int sat_init(sat_tab *t, int w, int n)
+{
+t->w=w;
+t->n=n;
+t->y=(int*)calloc(n,sizeof(int));
+t->t=(uint64_t*)malloc((size_t)n*(w+1)*SAT_N*sizeof(uint64_t));
+if ((t->y==NULL)||(t->t==NULL))
+	{
+	free(t->y); free(t->t);
+	t->y=NULL; t->t=NULL;
+	return 0;
+	}
+return 1;
+}
+
+//-----------------------------------------------------
+void sat_free(sat_tab *t)
+{
+free(t->y);
+free(t->t);
+t->y=NULL; t->t=NULL;
+}
+
+//-----------------------------------------------------
+//fills the kept rows from the frame s
+//rows are added up per column first, 32 bits are enough up
+//to 66051 rows between kept rows; only kept rows are summed
+//along x
+void sat_build(sat_tab *t, const uint32_t *s)
+{
+uint64_t *row,q[SAT_N];
+uint32_t *col;
+const uint8_t *p;
+int x,y,k,c,w;
+#if defined(__SSE2__)
+__m128i z=_mm_setzero_si128();
+__m128i m3=_mm_set_epi16(0,-1,-1,-1,0,-1,-1,-1);
+__m128i v,sq,cr,*a;
+#endif
+
+w=t->w;
+row=t->t;	//the first kept row is all zero
+memset(row,0,(w+1)*SAT_N*sizeof(uint64_t));
+//per column r,g,b,a, their squares, r*g,r*b,g*b and a 0
+col=(uint32_t*)malloc((size_t)w*12*sizeof(uint32_t));
+if (col==NULL) return;
+for (k=1;k<t->n;k++)
+	{
+	memset(col,0,(size_t)w*12*sizeof(uint32_t));
+	for (y=t->y[k-1];y<t->y[k];y++)
+		{
+		p=(const uint8_t*)(s+y*w);
+		x=0;
+#if defined(__SSE2__)
+		//two pixels at a time, the products fit 16 bits
+		for (;x+2<=w;x+=2)
+			{
+			v=_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p+4*x)),z);
+			sq=_mm_mullo_epi16(v,v);
+			cr=_mm_mullo_epi16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(v,_MM_SHUFFLE(3,1,0,0)),_MM_SHUFFLE(3,1,0,0)),
+				_mm_shufflehi_epi16(_mm_shufflelo_epi16(v,_MM_SHUFFLE(3,2,2,1)),_MM_SHUFFLE(3,2,2,1)));
+			cr=_mm_and_si128(cr,m3);
+			a=(__m128i*)(col+12*x);
+			_mm_storeu_si128(a,_mm_add_epi32(_mm_loadu_si128(a),_mm_unpacklo_epi16(v,z)));
+			_mm_storeu_si128(a+1,_mm_add_epi32(_mm_loadu_si128(a+1),_mm_unpacklo_epi16(sq,z)));
+			_mm_storeu_si128(a+2,_mm_add_epi32(_mm_loadu_si128(a+2),_mm_unpacklo_epi16(cr,z)));
+			_mm_storeu_si128(a+3,_mm_add_epi32(_mm_loadu_si128(a+3),_mm_unpackhi_epi16(v,z)));
+			_mm_storeu_si128(a+4,_mm_add_epi32(_mm_loadu_si128(a+4),_mm_unpackhi_epi16(sq,z)));
+			_mm_storeu_si128(a+5,_mm_add_epi32(_mm_loadu_si128(a+5),_mm_unpackhi_epi16(cr,z)));
+			}
+#endif
+		for (;x<w;x++)
+			{
+			uint32_t *a=col+12*x;
+			uint32_t r=p[4*x],g=p[4*x+1],b=p[4*x+2],al=p[4*x+3];
+			a[0]+=r; a[1]+=g; a[2]+=b; a[3]+=al;
+			a[4]+=r*r; a[5]+=g*g; a[6]+=b*b; a[7]+=al*al;
+			a[8]+=r*g; a[9]+=r*b; a[10]+=g*b;
+			}
+		}
+	//the row before plus the prefix sums of the columns
+	row=row+(w+1)*SAT_N;
+	memset(q,0,sizeof(q));
+	for (c=0;c<SAT_N;c++)
+		row[c]=row[c-(w+1)*SAT_N];
+	for (x=0;x<w;x++)
+		for (c=0;c<SAT_N;c++)
+			{
+			q[c]+=col[12*x+c];
+			row[(x+1)*SAT_N+c]=row[(x+1)*SAT_N+c-(w+1)*SAT_N]+q[c];
+			}
+	}
+free(col);
+}
+
+//-----------------------------------------------------
+//sums over rows y[k0]...y[k1]-1, columns x0...x1-1
+void sat_sums(const sat_tab *t, int k0, int k1, int x0, int x1, uint64_t *m)
+{
+const uint64_t *a,*b;
+int c;
+
+a=t->t+(size_t)k0*(t->w+1)*SAT_N;
+b=t->t+(size_t)k1*(t->w+1)*SAT_N;
+for (c=0;c<SAT_N;c++)
+	m[c]=b[x1*SAT_N+c]-b[x0*SAT_N+c]-a[x1*SAT_N+c]+a[x0*SAT_N+c];
+}
+
+//-----------------------------------------------------
+//avg and rms of c[0]*r+c[1]*g+c[2]*b from the means e and
+//the means of the products e2
+void sat_comb(const double *e, const double e2[3][3], const double *c, stat *s)
+{
+double m,m2;
+int i,j;
+
+m=0.0; m2=0.0;
+for (i=0;i<3;i++)
+	{
+	m=m+c[i]*e[i];
+	for (j=0;j<3;j++)
+		m2=m2+c[i]*c[j]*e2[i][j];
+	}
+s->avg=m;
+s->rms=sqrt(fmax(m2-m*m,0.0));
+s->min=0.0; s->max=0.0;
+}
+
+//-----------------------------------------------------
+//avg and rms of the channels from the sums of np pixels,
+//in the 0.0-1.0 scale of the meri_* functions, min and max
+//can't be had from sums and are set to 0.0
+//Y', Pr, Pb are combinations of r,g,b, their rms follows from
+//the products
+//color:
+//0=use rec 601
+//1=use rec 709
+//any pointer may be NULL
+void sat_stat(const uint64_t *m, long np, int color, stat *r, stat *g, stat *b, stat *a, stat *y, stat *u, stat *v)
+{
+double e[3],e2[3][3],k,wr,wg,wb,cy[3],cu[3],cv[3];
+stat *rgb[3];
+int i;
+
+if (color==1)	//CCIR rec 709
+	{wr=0.2126;wg=0.7152;wb=0.0722;}
+else		//CCIR rec 601
+	{wr=0.299;wg=0.587;wb=0.114;}
+cy[0]=wr;      cy[1]=wg;  cy[2]=wb;
+cu[0]=1.0-wr;  cu[1]=-wg; cu[2]=-wb;
+cv[0]=-wr;     cv[1]=-wg; cv[2]=1.0-wb;
+
+k=0.00392157;	//as the float conversion of pr0be, pr0file
+for (i=0;i<3;i++)
+	{
+	e[i]=k*m[i]/np;
+	e2[i][i]=k*k*m[4+i]/np;
+	}
+e2[0][1]=e2[1][0]=k*k*m[8]/np;
+e2[0][2]=e2[2][0]=k*k*m[9]/np;
+e2[1][2]=e2[2][1]=k*k*m[10]/np;
+
+rgb[0]=r; rgb[1]=g; rgb[2]=b;
+for (i=0;i<3;i++)
+	if (rgb[i]!=NULL)
+		{
+		rgb[i]->avg=e[i];
+		rgb[i]->rms=sqrt(fmax(e2[i][i]-e[i]*e[i],0.0));
+		rgb[i]->min=0.0; rgb[i]->max=0.0;
+		}
+if (a!=NULL)
+	{
+	a->avg=k*m[3]/np;
+	a->rms=sqrt(fmax(k*k*m[7]/np-a->avg*a->avg,0.0));
+	a->min=0.0; a->max=0.0;
+	}
+if (y!=NULL) sat_comb(e, e2, cy, y);
+if (u!=NULL) sat_comb(e, e2, cu, u);
+if (v!=NULL) sat_comb(e, e2, cv, v);
+}
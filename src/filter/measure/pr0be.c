@@ -30,6 +30,7 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 #include <frei0r.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
 #include "font2.h"
@@ -268,6 +269,158 @@ if (sy>np)
 
 }
 
+//--------------------------------------------------------------
+//hue, HSV saturation and value, HSL saturation and lightness
+//of an average color
+void hsvl(float r, float g, float b, float *hue, float *hsv_sat, float *val, float *hsl_sat, float *lgt)
+{
+float al,be,h2,c1,va,li;
+
+al=(r+g+b)/2.0;
+be=sqrtf(3.0)/2.0*(g-b);
+h2=atan2f(be,al);
+va=r;
+if (g>va) va=g; if (b>va) va=b;
+li=r;
+if (g<li) li=g; if (b<li) li=b;
+c1=va-li;
+if (c1==0.0) *hsv_sat=0.0; else *hsv_sat=c1/va;
+li=(li+va)/2.0;
+if (c1==0.0)
+  *hsl_sat=0.0;
+else
+  {
+  if (li<=0.5) *hsl_sat=c1/2.0/li; else *hsl_sat=c1/(2.0-2.0*li);
+  }
+h2=h2*180.0/PI; if (h2<0.0) h2=h2+180.0;
+*hue=h2;
+*val=va;
+*lgt=li;
+}
+
+//--------------------------------------------------------------
+//keep probe inside
+void probe_inside(int w, int h, int *x, int *y, int sx, int sy)
+{
+if (*x<sx/2) *x=sx/2;
+if (*x>=(w-sx/2)) *x=w-sx/2-1;
+if (*y<sy/2) *y=sy/2;
+if (*y>=(h-sy/2)) *y=h-sy/2-1;
+}
+
+//--------------------------------------------------------------
+//the i-th of n grid probes along a side of size sz, covering
+//the fraction f of its cell, at least one pixel: [*z,*k)
+void probe_span(int sz, int n, int i, float f, int *z, int *k)
+{
+int c0,c1,d;
+
+c0=sz*i/n;
+c1=sz*(i+1)/n;
+d=f*(c1-c0);
+if (d<1) d=1;
+*z=c0+(c1-c0-d)/2;
+*k=*z+d;
+}
+
+//--------------------------------------------------------------
+//all measurements of the probe as "name=value" text, the
+//"Measurements" parameter, for programs that read them
+//instead of looking at the info window
+//sx,sy=size of probe   (must be odd)
+//m=type of measurement, selects rec 709 Y'PrPb for m=2
+//u=units    0=0.0-1.0    1=0-255
+void rezultat(float_rgba *s, int w, int h, int x, int y, int sx, int sy, int m, int u, char *str, int n)
+{
+stat yy,rr,gg,bb,aa,uu,vv;
+float hue,hsv_sat,val,hsl_sat,lgt;
+int l;
+
+probe_inside(w, h, &x, &y, sx, sy);
+
+meri_rgb(s, &rr, &gg, &bb, x, y, w, sx, sy);
+meri_a(s, &aa, x, y, w, sx, sy);
+meri_y(s, &yy, (m==2) ? 1 : 0, x, y, w, sx, sy);
+meri_uv(s, &uu, &vv, (m==2) ? 1 : 0, x, y, w, sx, sy);
+hsvl(rr.avg, gg.avg, bb.avg, &hue, &hsv_sat, &val, &hsl_sat, &lgt);
+
+snprintf(str, n, "x=%d y=%d", x, y);
+stat_str(str, n, "r", rr, u);
+stat_str(str, n, "g", gg, u);
+stat_str(str, n, "b", bb, u);
+stat_str(str, n, "a", aa, u);
+stat_str(str, n, "y", yy, u);
+stat_str(str, n, "pr", uu, u);
+stat_str(str, n, "pb", vv, u);
+l=strlen(str);
+snprintf(str+l, n-l, " hue=%.1f hsv.sat=%.4f val=%.4f hsl.sat=%.4f lgt=%.4f", hue, hsv_sat, val, hsl_sat, lgt);
+}
+
+//--------------------------------------------------------------
+//grid of n x n probes for uniformity measurements, each
+//covering the fraction f of its grid cell, measured from the
+//8 bit frame with a summed area table, so that the grid costs
+//one pass over the frame whatever the size of the probes
+//c=0 rec 601, c=1 rec 709
+//u=units    0=0.0-1.0    1=0-255
+//the avg and rms of each probe are appended to str, and the
+//ratio of the darkest to the brightest probe as y.uniformity
+void mreza(const uint32_t *s, int w, int h, int n, float f, sat_tab *t, int c, int u, char *str, int sn)
+{
+uint64_t m[SAT_N];
+stat rr,gg,bb,yy;
+int i,j,l,x0,x1;
+float k,ymin,ymax;
+
+if (n>w) n=w;	//cells of at least a pixel, the kept rows ascend
+if (n>h) n=h;
+for (j=0;j<n;j++)
+	probe_span(h, n, j, f, &t->y[2*j], &t->y[2*j+1]);
+t->n=2*n;
+sat_build(t, s);
+
+k = (u==1) ? 255.0 : 1.0;
+ymin=1.0E9; ymax=-1.0E9;
+l=strlen(str);
+snprintf(str+l, sn-l, " grid=%dx%d", n, n);
+for (j=0;j<n;j++)
+	for (i=0;i<n;i++)
+		{
+		probe_span(w, n, i, f, &x0, &x1);
+		sat_sums(t, 2*j, 2*j+1, x0, x1, m);
+		sat_stat(m, (long)(x1-x0)*(t->y[2*j+1]-t->y[2*j]), c, &rr, &gg, &bb, NULL, &yy, NULL, NULL);
+		if (yy.avg<ymin) ymin=yy.avg;
+		if (yy.avg>ymax) ymax=yy.avg;
+		l=strlen(str);
+		if (l>=sn-1) return;
+		snprintf(str+l, sn-l, " p%d.%d.y.avg=%.4f p%d.%d.y.rms=%.4f p%d.%d.r.avg=%.4f p%d.%d.g.avg=%.4f p%d.%d.b.avg=%.4f",
+			j, i, k*yy.avg, j, i, k*yy.rms, j, i, k*rr.avg, j, i, k*gg.avg, j, i, k*bb.avg);
+		}
+l=strlen(str);
+snprintf(str+l, sn-l, " y.uniformity=%.4f", (ymax>0.0) ? ymin/ymax : 1.0);
+}
+
+//--------------------------------------------------------------
+//outlines of the grid probes
+void mreza_draw(float_rgba *s, int w, int h, int n, float f)
+{
+float_rgba white={1.0,1.0,1.0,1.0};
+int i,j,x0,x1,y0,y1;
+
+if (n>w) n=w;
+if (n>h) n=h;
+for (j=0;j<n;j++)
+	for (i=0;i<n;i++)
+		{
+		probe_span(w, n, i, f, &x0, &x1);
+		probe_span(h, n, j, f, &y0, &y1);
+		draw_rectangle(s, w, h, x0, y0, x1-x0, 1, white);
+		draw_rectangle(s, w, h, x0, y1-1, x1-x0, 1, white);
+		draw_rectangle(s, w, h, x0, y0, 1, y1-y0, white);
+		draw_rectangle(s, w, h, x1-1, y0, 1, y1-y0, white);
+		}
+}
+
 //--------------------------------------------------------------
 //draw info window
 //sx,sy=size of probe   (must be odd)
@@ -282,7 +435,7 @@ int x0,y0,vx,vy,vp,np,np2,xn,yn;
 int i,j,xp,yp;
 char string[256];
 stat yy,rr,gg,bb,aa,uu,vv;
-float al,be,h2,c1,c2,ss,va,li;
+float h2,c1,ss,va,li;
 
 float_rgba white={1.0,1.0,1.0,1.0};
 float_rgba gray={0.5,0.5,0.5,1.0};
@@ -320,10 +473,7 @@ np2=np/2+1;
 if (sha==1) vy=vy+20;
 
 //keep probe inside
-if (x<sx/2) x=sx/2;
-if (x>=(w-sx/2)) x=w-sx/2-1;
-if (y<sy/2) y=sy/2;
-if (y>=(h-sy/2)) y=h-sy/2-1;
+probe_inside(w, h, &x, &y, sx, sy);
 
 //info window background
 darken_rectangle(s, w, h, x0, y0, vx, vy, 0.4);
@@ -395,17 +545,7 @@ switch (m)
     break;
   case 3:	//display HSV
     meri_rgb(s, &rr, &gg, &bb, x, y, w, sx, sy);
-    al=(rr.avg+gg.avg+bb.avg)/2.0;
-    be=sqrtf(3.0)/2.0*(gg.avg-bb.avg);
-    h2=atan2f(be,al);
-    c2=sqrtf(al*al+be*be);
-    va=rr.avg;
-    if (gg.avg>va) va=gg.avg; if (bb.avg>va) va=bb.avg;
-    li=rr.avg;
-    if (gg.avg<li) li=gg.avg; if (bb.avg<li) li=bb.avg;
-    c1=va-li;
-    if (c1==0.0) ss=0.0; else ss=c1/va;
-    h2=h2*180.0/PI; if (h2<0.0) h2=h2+180.0;
+    hsvl(rr.avg, gg.avg, bb.avg, &h2, &ss, &va, &c1, &li);
     sprintf(string," Hue = %5.1f",h2);
     draw_string(s, w, h, xn, yn+5, string, white);
     sprintf(string," Sat = %5.3f",ss);
@@ -421,23 +561,7 @@ switch (m)
     break;
   case 4:	//display HSL
     meri_rgb(s, &rr, &gg, &bb, x, y, w, sx, sy);
-    al=(rr.avg+gg.avg+bb.avg)/2.0;
-    be=sqrtf(3.0)/2.0*(gg.avg-bb.avg);
-    h2=atan2f(be,al);
-    c2=sqrtf(al*al+be*be);
-    va=rr.avg;
-    if (gg.avg>va) va=gg.avg; if (bb.avg>va) va=bb.avg;
-    li=rr.avg;
-    if (gg.avg<li) li=gg.avg; if (bb.avg<li) li=bb.avg;
-    c1=va-li;
-    li=(li+va)/2.0;
-    if (c1==0.0)
-      ss=0.0;
-    else
-      {
-      if (li<=0.5) ss=c1/2.0/li; else ss=c1/(2.0-2.0*li);
-      }
-    h2=h2*180.0/PI; if (h2<0.0) h2=h2+180.0;
+    hsvl(rr.avg, gg.avg, bb.avg, &h2, &c1, &va, &ss, &li);
     sprintf(string," Hue = %5.1f",h2);
     draw_string(s, w, h, xn, yn+5, string, white);
     sprintf(string," Sat = %5.3f",ss);
@@ -462,17 +586,7 @@ switch (m)
 //Frei0r rgba8888 color
 void floatrgba2color(float_rgba *sl, uint32_t* outframe, int w , int h)
 {
-int i;
-uint32_t p;
-
-for (i=0;i<w*h;i++)
-	{
-	p=(uint32_t)(255.0*sl[i].a) & 0xFF;
-	p=(p<<8) + ((uint32_t)(255.0*sl[i].b) & 0xFF);
-	p=(p<<8) + ((uint32_t)(255.0*sl[i].g) & 0xFF);
-	p=(p<<8) + ((uint32_t)(255.0*sl[i].r) & 0xFF);
-	outframe[i]=p;
-	}
+float_2_RGBA8_lin(sl, outframe, w, h);
 }
 
 //-----------------------------------------------------
@@ -481,14 +595,12 @@ for (i=0;i<w*h;i++)
 void color2floatrgba(const uint32_t* inframe, float_rgba *sl, int w , int h)
 {
 int i;
+float tab[256];
 
-for (i=0;i<w*h;i++)
-	{
-	sl[i].r=((float)(inframe[i] & 0x000000FF))*0.00392157;
-	sl[i].g=((float)((inframe[i] & 0x0000FF00)>>8))*0.00392157;
-	sl[i].b=((float)((inframe[i] & 0x00FF0000)>>16))*0.00392157;
-	sl[i].a=((float)((inframe[i] & 0xFF000000)>>24))*0.00392157;
-	}
+//the scale is a double, so the product is rounded from double
+for (i=0;i<256;i++)
+	tab[i]=((float)i)*0.00392157;
+RGBA8_2_float(inframe, sl, w, h, tab, tab);
 }
 
 //-----------------------------------------------------
@@ -520,9 +632,14 @@ int sy;
 int un;
 int sha;
 int bw;
+int mo;		//measure only, don't draw	BOOL
+int grid;	//n x n grid of probes, 1=off
+float gsz;	//fraction of the grid cell a probe covers
 
 int poz;
 float_rgba *sl;
+sat_tab sat;	//summed area table for the grid
+char res[16384];	//measurements, as text
 } inst;
 
 //***********************************************
@@ -549,8 +666,8 @@ info->plugin_type=F0R_PLUGIN_TYPE_FILTER;
 info->color_model=F0R_COLOR_MODEL_RGBA8888;
 info->frei0r_version=FREI0R_MAJOR_VERSION;
 info->major_version=0;
-info->minor_version=1;
-info->num_params=8;
+info->minor_version=2;
+info->num_params=12;
 info->explanation="Measure video values";
 }
 
@@ -599,6 +716,26 @@ switch(param_index)
 		info->type = F0R_PARAM_BOOL;
 		info->explanation = "Display more data";
 		break;
+	case 8:
+		info->name = "Measure only";
+		info->type = F0R_PARAM_BOOL;
+		info->explanation = "Don't draw, pass the video through";
+		break;
+	case 9:
+		info->name = "Measurements";
+		info->type = F0R_PARAM_STRING;
+		info->explanation = "Read only, all measurements of the last frame as name=value pairs";
+		break;
+	case 10:
+		info->name = "Grid";
+		info->type = F0R_PARAM_DOUBLE;
+		info->explanation = "Also measure a grid of 1x1 (off) to 8x8 probes, for uniformity";
+		break;
+	case 11:
+		info->name = "Grid probe size";
+		info->type = F0R_PARAM_DOUBLE;
+		info->explanation = "Part of its grid cell a probe covers";
+		break;
 	}
 }
 
@@ -619,6 +756,9 @@ in->sy=3;
 in->un=0;
 in->sha=0;
 in->bw=0;
+in->mo=0;
+in->grid=1;
+in->gsz=0.5;
 
 in->poz=0;
 in->sl=(float_rgba*)calloc(width*height,sizeof(float_rgba));
@@ -634,6 +774,7 @@ inst *in;
 in=(inst*)instance;
 
 free(in->sl);
+sat_free(&in->sat);
 free(instance);
 }
 
@@ -688,6 +829,23 @@ switch(param_index)
                 if (p->bw != tmpi) chg=1;
                 p->bw=tmpi;
                 break;
+	case 8:
+                tmpi=map_value_forward(*((double*)parm), 0.0, 1.0); //BOOL!!
+                if (p->mo != tmpi) chg=1;
+                p->mo=tmpi;
+                break;
+	case 9:		//read only
+                break;
+	case 10:
+                tmpi=map_value_forward(*((double*)parm), 1.0, 8.9999);
+                if (tmpi != p->grid) chg=1;
+                p->grid=tmpi;
+                break;
+	case 11:
+                p->gsz=*((double*)parm);
+                if (p->gsz<0.0) p->gsz=0.0;
+                if (p->gsz>1.0) p->gsz=1.0;
+                break;
 	}
 
 if (chg==0) return;
@@ -727,6 +885,18 @@ switch(param_index)
 	case 7:
                 *((double*)param)=map_value_backward(p->bw, 0.0, 1.0);//BOOL!!
 		break;
+	case 8:
+                *((double*)param)=map_value_backward(p->mo, 0.0, 1.0);//BOOL!!
+		break;
+	case 9:
+		*((f0r_param_string*)param)=p->res;
+		break;
+	case 10:
+		*((double*)param)=map_value_backward(p->grid, 1.0, 8.9999);
+		break;
+	case 11:
+		*((double*)param)=p->gsz;
+		break;
 	}
 }
 
@@ -734,12 +904,41 @@ switch(param_index)
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
 inst *in;
+int x,y,y0,y1;
 
 assert(instance);
 in=(inst*)instance;
 
+//the summed area table, 2 rows per grid row, when first needed
+if ((in->grid>1)&&(in->sat.t==NULL))
+	sat_init(&in->sat, in->w, 16);
+
+//measure only: just the rows of the probe are needed, and
+//the video passes through
+if (in->mo==1)
+	{
+	x=in->x; y=in->y;
+	probe_inside(in->w, in->h, &x, &y, 2*in->sx+1, 2*in->sy+1);
+	y0=y-in->sy; if (y0<0) y0=0;
+	y1=y+in->sy+1; if (y1>in->h) y1=in->h;
+	if (y1>y0)
+		color2floatrgba(inframe+y0*in->w, in->sl+y0*in->w, in->w, y1-y0);
+	rezultat(in->sl, in->w, in->h, in->x, in->y, 2*in->sx+1, 2*in->sy+1, in->mer, in->un, in->res, sizeof(in->res));
+	if ((in->grid>1)&&(in->sat.t!=NULL))
+		mreza(inframe, in->w, in->h, in->grid, in->gsz, &in->sat, (in->mer==2) ? 1 : 0, in->un, in->res, sizeof(in->res));
+	if (outframe!=inframe)
+		memcpy(outframe, inframe, in->w*in->h*sizeof(uint32_t));
+	return;
+	}
+
 color2floatrgba(inframe, in->sl, in->w , in->h);
 
+rezultat(in->sl, in->w, in->h, in->x, in->y, 2*in->sx+1, 2*in->sy+1, in->mer, in->un, in->res, sizeof(in->res));
+if ((in->grid>1)&&(in->sat.t!=NULL))
+	{
+	mreza(inframe, in->w, in->h, in->grid, in->gsz, &in->sat, (in->mer==2) ? 1 : 0, in->un, in->res, sizeof(in->res));
+	mreza_draw(in->sl, in->w, in->h, in->grid, in->gsz);
+	}
 sonda(in->sl, in->w, in->h, in->x, in->y, 2*in->sx+1, 2*in->sy+1, &in->poz, in->mer, in->un, in->sha, in->bw);
 crosshair(in->sl, in->w, in->h, in->x, in->y, 2*in->sx+1, 2*in->sy+1, 15);
 
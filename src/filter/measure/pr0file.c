@@ -374,6 +374,16 @@ if ((dit&0x00000100)!=0)	//MAX of profile
   }
 }
 
+//-----------------------------------------------------
+//end points of the profile
+void prof_ends(int x, int y, float tilt, int len, int *xz, int *yz, int *xk, int *yk)
+{
+*xz=x-len/2.0*cosf(tilt);
+*xk=x+len/2.0*cosf(tilt);
+*yz=y-len/2.0*sinf(tilt);
+*yk=y+len/2.0*sinf(tilt);
+}
+
 //--------------------------------------------------------------
 //draw info window
 //sx,sy=size of probe   (must be odd)
@@ -412,10 +422,7 @@ vy = h*6/16;
 y0 = (*poz==0) ? h/20 : h-h/20-vy;
 
 //end points of profile
-xz=x-len/2.0*cosf(tilt);
-xk=x+len/2.0*cosf(tilt);
-yz=y-len/2.0*sinf(tilt);
-yk=y+len/2.0*sinf(tilt);
+prof_ends(x, y, tilt, len, &xz, &yz, &xk, &yk);
 
 //measure
 meriprof(s, w, h, xz, yz, xk, yk, sir, p);
@@ -521,22 +528,43 @@ switch (m>>24)	//which channel data under the scope
 
 }
 
+//-----------------------------------------------------
+//all statistics of the profile and the values at the
+//markers as "name=value" text, the "Measurements" parameter,
+//for programs that read them instead of looking at the scope
+//u=units    0=0.0-1.0    1=0-255
+void rezultat(profdata *p, int m1, int m2, int u, char *str, int n)
+{
+int i,l,mk[2];
+float k;
+
+k = (u==1) ? 255.0 : 1.0;
+snprintf(str, n, "n=%d", p->n);
+stat_str(str, n, "r", p->sr, u);
+stat_str(str, n, "g", p->sg, u);
+stat_str(str, n, "b", p->sb, u);
+stat_str(str, n, "a", p->sa, u);
+stat_str(str, n, "y", p->sy, u);
+stat_str(str, n, "pr", p->su, u);
+stat_str(str, n, "pb", p->sv, u);
+mk[0]=m1; mk[1]=m2;
+for (i=0;i<2;i++)
+	{
+	if ((mk[i]<0)||(mk[i]>=p->n)) continue;
+	l=strlen(str);
+	if (l>=n-1) return;
+	snprintf(str+l, n-l, " m%d=%d m%d.r=%.4f m%d.g=%.4f m%d.b=%.4f m%d.a=%.4f m%d.y=%.4f m%d.pr=%.4f m%d.pb=%.4f",
+		i+1, mk[i], i+1, k*p->r[mk[i]], i+1, k*p->g[mk[i]], i+1, k*p->b[mk[i]], i+1, k*p->a[mk[i]],
+		i+1, k*p->y[mk[i]], i+1, k*p->u[mk[i]], i+1, k*p->v[mk[i]]);
+	}
+}
+
 //-----------------------------------------------------
 //converts the internal RGBA float image into
 //Frei0r rgba8888 color
 void floatrgba2color(float_rgba *sl, uint32_t* outframe, int w , int h)
 {
-int i;
-uint32_t p;
-
-for (i=0;i<w*h;i++)
-	{
-	p=(uint32_t)(255.0*sl[i].a) & 0xFF;
-	p=(p<<8) + ((uint32_t)(255.0*sl[i].b) & 0xFF);
-	p=(p<<8) + ((uint32_t)(255.0*sl[i].g) & 0xFF);
-	p=(p<<8) + ((uint32_t)(255.0*sl[i].r) & 0xFF);
-	outframe[i]=p;
-	}
+float_2_RGBA8_lin(sl, outframe, w, h);
 }
 
 //-----------------------------------------------------
@@ -545,14 +573,12 @@ for (i=0;i<w*h;i++)
 void color2floatrgba(const uint32_t* inframe, float_rgba *sl, int w , int h)
 {
 int i;
+float tab[256];
 
-for (i=0;i<w*h;i++)
-	{
-	sl[i].r=((float)(inframe[i] & 0x000000FF))*0.00392157;
-	sl[i].g=((float)((inframe[i] & 0x0000FF00)>>8))*0.00392157;
-	sl[i].b=((float)((inframe[i] & 0x00FF0000)>>16))*0.00392157;
-	sl[i].a=((float)((inframe[i] & 0xFF000000)>>24))*0.00392157;
-	}
+//the scale is a double, so the product is rounded from double
+for (i=0;i<256;i++)
+	tab[i]=((float)i)*0.00392157;
+RGBA8_2_float(inframe, sl, w, h, tab, tab);
 }
 
 //-----------------------------------------------------
@@ -597,6 +623,7 @@ int dmax;	//display maximum	BOOL
 int un;		//0...255 units		BOOL
 int col;	//color, rec 601 or rec 709
 int chc;	//crosshair color  [0...7]
+int mo;		//measure only, don't draw	BOOL
 
 int poz;
 int mer;	//display channel + trace flags
@@ -604,6 +631,7 @@ int dit;	//numeric display items flags
 
 float_rgba *sl;
 profdata *p;
+char res[2048];	//measurements, as text
 
 } inst;
 
@@ -631,8 +659,8 @@ info->plugin_type=F0R_PLUGIN_TYPE_FILTER;
 info->color_model=F0R_COLOR_MODEL_RGBA8888;
 info->frei0r_version=FREI0R_MAJOR_VERSION;
 info->major_version=0;
-info->minor_version=2;
-info->num_params=21;
+info->minor_version=3;
+info->num_params=23;
 info->explanation="2D video oscilloscope";
 }
 
@@ -747,6 +775,16 @@ switch(param_index)
 		info->type = F0R_PARAM_DOUBLE;
 		info->explanation = "Color of the profile marker";
 		break;
+	case 21:
+		info->name = "Measure only";
+		info->type = F0R_PARAM_BOOL;
+		info->explanation = "Don't draw, pass the video through";
+		break;
+	case 22:
+		info->name = "Measurements";
+		info->type = F0R_PARAM_STRING;
+		info->explanation = "Read only, all measurements of the last frame as name=value pairs";
+		break;
 	}
 }
 
@@ -780,6 +818,7 @@ in->dmax=0;
 in->un=0;
 in->col=0;
 in->chc=0;
+in->mo=0;
 
 in->poz=1;
 in->mer=(3<<24)+7;	//Y display + R,G,B traces
@@ -922,6 +961,13 @@ switch(param_index)
                 if (p->chc != tmpi) chg=1;
                 p->chc=tmpi;
                 break;
+	case 21:	//measure only
+                tmpi=map_value_forward(*((double*)parm), 0.0, 1.0); //BOOL!!
+                if (p->mo != tmpi) chg=1;
+                p->mo=tmpi;
+                break;
+	case 22:	//read only
+                break;
 	}
 
 if (chg==0) return;
@@ -1018,6 +1064,12 @@ switch(param_index)
 	case 20:
                 *((double*)param)=map_value_backward(p->chc, 0.0, 7.9999);
 		break;
+	case 21:
+                *((double*)param)=map_value_backward(p->mo, 0.0, 1.0);//BOOL!!
+		break;
+	case 22:
+		*((f0r_param_string*)param)=p->res;
+		break;
 	}
 }
 
@@ -1025,13 +1077,33 @@ switch(param_index)
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
 inst *in;
+int xz,yz,xk,yk,y0,y1;
 
 assert(instance);
 in=(inst*)instance;
 
+//measure only: just the rows the profile crosses are
+//needed, and the video passes through
+if (in->mo==1)
+	{
+	prof_ends(in->x, in->y, in->tilt, in->len, &xz, &yz, &xk, &yk);
+	y0 = (yz<yk) ? yz : yk;  if (y0<0) y0=0;
+	y1 = (yz<yk) ? yk+1 : yz+1;  if (y1>in->h) y1=in->h;
+	if (y1>y0)
+		color2floatrgba(inframe+y0*in->w, in->sl+y0*in->w, in->w, y1-y0);
+	meriprof(in->sl, in->w, in->h, xz, yz, xk, yk, 1, in->p);
+	prof_yuv(in->p, in->col);
+	prof_stat(in->p);
+	rezultat(in->p, in->m1, in->m2, in->un, in->res, sizeof(in->res));
+	if (outframe!=inframe)
+		memcpy(outframe, inframe, in->w*in->h*sizeof(uint32_t));
+	return;
+	}
+
 color2floatrgba(inframe, in->sl, in->w , in->h);
 
 prof(in->sl, in->w, in->h, &in->poz, in->x, in->y, in->tilt, in->len, 1, in->mer, in->un, 0, in->m1, in->m2, in->dit, in->chc, in->col, in->p);
+rezultat(in->p, in->m1, in->m2, in->un, in->res, sizeof(in->res));
 
 floatrgba2color(in->sl, outframe, in->w , in->h);
 }
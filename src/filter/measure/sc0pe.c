@@ -0,0 +1,456 @@
+/*
+sc0pe.c
+
+This frei0r plugin shows a luma waveform and RGB histograms
+of the video, using the statistics of measure.h
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+#include <stdio.h>
+#include <frei0r.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#include "measure.h"
+
+//a column whose pixels all have one luma is this many times
+//brighter than white in the waveform
+#define WAVE_GAIN 32
+
+//luma levels of the waveform graticule lines
+static const int grid_levels[5]={0,64,128,192,255};
+
+//----------------------------------------
+//instance of the effect
+typedef struct
+{
+int h;
+int w;
+
+int disp;	//0=waveform 1=histogram 2=both
+int color;	//0=rec 601 1=rec 709
+int dec;	//count every dec-th row
+float mix;	//brightness of the video under the scope
+int mo;		//measure only, don't draw	BOOL
+
+int phase;	//first row counted in the current frame
+hist8 hi;
+stat ys;
+uint16_t *wave;	//per column luma counts
+int *la,*lb;	//luma range shown in a waveform row
+int *bars;	//histogram bar heights, 3*w
+char res[1024];	//measurements, as text
+} inst;
+
+typedef struct
+{
+const inst *in;
+const uint32_t *s;
+uint32_t *d;
+int y0,y1;
+} rjob;
+
+//-----------------------------------------------------
+//stretch [0...1] to parameter range [min...max] linear
+float map_value_forward(double v, float min, float max)
+{
+return min+(max-min)*v;
+}
+
+//-----------------------------------------------------
+//collapse from parameter range [min...max] to [0...1] linear
+double map_value_backward(float v, float min, float max)
+{
+return (v-min)/(max-min);
+}
+
+//-----------------------------------------------------
+static inline uint8_t sat_add(int a, int b)
+{
+return a+b>255 ? 255 : a+b;
+}
+
+//-----------------------------------------------------
+//waveform and histogram rectangles
+//wh=rows of the waveform, from the top
+//the histogram takes the rest of the frame
+static int wave_rows(const inst *in)
+{
+switch (in->disp)
+	{
+	case 0:  return in->h;
+	case 1:  return 0;
+	default: return in->h/2;
+	}
+}
+
+//-----------------------------------------------------
+//luma range of each waveform row, level 255 at the top
+static void wave_levels(inst *in, int wh)
+{
+int r,a,b;
+
+for (r=0;r<wh;r++)
+	{
+	a=r*256/wh;
+	b=(r+1)*256/wh-1;
+	if (b<a) b=a;
+	in->la[r]=255-b;
+	in->lb[r]=255-a;
+	}
+}
+
+//-----------------------------------------------------
+//histogram bars, scaled to the largest bin of the three
+static void hist_bars(inst *in, int hh)
+{
+const uint32_t *ch[3];
+uint32_t m,v;
+int c,x,i,b0,b1;
+
+ch[0]=in->hi.r; ch[1]=in->hi.g; ch[2]=in->hi.b;
+m=1;
+for (c=0;c<3;c++)
+	for (i=0;i<256;i++)
+		if (ch[c][i]>m) m=ch[c][i];
+
+for (c=0;c<3;c++)
+	for (x=0;x<in->w;x++)
+		{
+		b0=x*256/in->w;
+		b1=(x+1)*256/in->w-1;
+		if (b1<b0) b1=b0;
+		v=0;
+		for (i=b0;i<=b1;i++)
+			if (ch[c][i]>v) v=ch[c][i];
+		in->bars[c*in->w+x]=(int)((double)v*hh/m+0.5);
+		}
+}
+
+//-----------------------------------------------------
+//frame statistics as "name=value" text, the "Measurements"
+//parameter, for programs that read them
+void rezultat(inst *in)
+{
+stat st;
+int n=sizeof(in->res);
+
+snprintf(in->res, n, "n=%u", in->hi.n);
+stat_str(in->res, n, "y", in->ys, 0);
+hist8_stat(in->hi.r, in->hi.n, &st);
+stat_str(in->res, n, "r", st, 0);
+hist8_stat(in->hi.g, in->hi.n, &st);
+stat_str(in->res, n, "g", st, 0);
+hist8_stat(in->hi.b, in->hi.n, &st);
+stat_str(in->res, n, "b", st, 0);
+hist8_stat(in->hi.a, in->hi.n, &st);
+stat_str(in->res, n, "a", st, 0);
+}
+
+//-----------------------------------------------------
+//draws the rows y0...y1 of the output
+static void* draw_rows(void *arg)
+{
+rjob *j=(rjob*)arg;
+const inst *in=j->in;
+const int w=in->w;
+const int wh=wave_rows(in);
+const int m=in->mix*256.0+0.5;
+const int avg=in->ys.avg*255.0+0.5;
+uint32_t rows,gain,sum;
+const uint8_t *s;
+uint8_t *d;
+int x,y,r,t,v,l,grid;
+
+rows=(in->h-in->phase+in->dec-1)/in->dec;
+gain=(uint32_t)(255.0*WAVE_GAIN*65536.0/rows);
+
+for (y=j->y0;y<j->y1;y++)
+	{
+	s=(const uint8_t*)(j->s+y*w);
+	d=(uint8_t*)(j->d+y*w);
+	for (x=0;x<w;x++)
+		{
+		d[4*x]=(s[4*x]*m)>>8;
+		d[4*x+1]=(s[4*x+1]*m)>>8;
+		d[4*x+2]=(s[4*x+2]*m)>>8;
+		d[4*x+3]=s[4*x+3];
+		}
+
+	if (y<wh)	//waveform
+		{
+		r=y;
+		grid=0;
+		for (l=0;l<5;l++)
+			if (grid_levels[l]>=in->la[r] && grid_levels[l]<=in->lb[r]) grid=1;
+		if (grid)
+			for (x=0;x<w;x++)
+				{
+				d[4*x]=sat_add(d[4*x],48);
+				d[4*x+1]=sat_add(d[4*x+1],48);
+				d[4*x+2]=sat_add(d[4*x+2],48);
+				}
+		if (avg>=in->la[r] && avg<=in->lb[r])
+			for (x=0;x<w;x+=2)
+				{
+				d[4*x]=sat_add(d[4*x],128);
+				d[4*x+1]=sat_add(d[4*x+1],80);
+				}
+		for (x=0;x<w;x++)
+			{
+			sum=0;
+			for (l=in->la[r];l<=in->lb[r];l++)
+				sum+=in->wave[l*w+x];
+			if (sum==0) continue;
+			v = sum>=rows ? 255 : (sum*gain)>>16;
+			if (v>255) v=255;
+			d[4*x]=sat_add(d[4*x],v>>2);
+			d[4*x+1]=sat_add(d[4*x+1],v);
+			d[4*x+2]=sat_add(d[4*x+2],v>>2);
+			}
+		}
+	else		//histogram
+		{
+		t=in->h-1-y;
+		for (x=0;x<w;x++)
+			{
+			if (t<in->bars[x]) d[4*x]=sat_add(d[4*x],160);
+			if (t<in->bars[w+x]) d[4*x+1]=sat_add(d[4*x+1],160);
+			if (t<in->bars[2*w+x]) d[4*x+2]=sat_add(d[4*x+2],160);
+			}
+		}
+	}
+return 0;
+}
+
+//***********************************************
+// OBVEZNE FREI0R FUNKCIJE
+
+//-----------------------------------------------
+int f0r_init()
+{
+return 1;
+}
+
+//------------------------------------------------
+void f0r_deinit()
+{
+}
+
+//-----------------------------------------------
+void f0r_get_plugin_info(f0r_plugin_info_t* info)
+{
+
+info->name="sc0pe";
+info->author="frei0r";
+info->plugin_type=F0R_PLUGIN_TYPE_FILTER;
+info->color_model=F0R_COLOR_MODEL_RGBA8888;
+info->frei0r_version=FREI0R_MAJOR_VERSION;
+info->major_version=0;
+info->minor_version=1;
+info->num_params=6;
+info->explanation="Luma waveform and RGB histogram";
+}
+
+//--------------------------------------------------
+void f0r_get_param_info(f0r_param_info_t* info, int param_index)
+{
+switch(param_index)
+	{
+	case 0:
+		info->name = "Display";
+		info->type = F0R_PARAM_DOUBLE;
+		info->explanation = "Waveform, histogram or both";
+		break;
+	case 1:
+		info->name = "Rec 709";
+		info->type = F0R_PARAM_BOOL;
+		info->explanation = "Use rec 709 luma instead of rec 601";
+		break;
+	case 2:
+		info->name = "Decimation";
+		info->type = F0R_PARAM_DOUBLE;
+		info->explanation = "Only measure every Nth row, 1 to 16";
+		break;
+	case 3:
+		info->name = "Mix";
+		info->type = F0R_PARAM_DOUBLE;
+		info->explanation = "Brightness of the video under the scope";
+		break;
+	case 4:
+		info->name = "Measure only";
+		info->type = F0R_PARAM_BOOL;
+		info->explanation = "Don't draw, pass the video through";
+		break;
+	case 5:
+		info->name = "Measurements";
+		info->type = F0R_PARAM_STRING;
+		info->explanation = "Read only, statistics of the last frame as name=value pairs";
+		break;
+	}
+}
+
+//----------------------------------------------
+f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
+{
+inst *in;
+
+in=(inst*)calloc(1,sizeof(inst));
+in->w=width;
+in->h=height;
+
+in->disp=2;
+in->color=0;
+in->dec=1;
+in->mix=0.25;
+
+in->wave=(uint16_t*)malloc(256*width*sizeof(uint16_t));
+in->la=(int*)malloc(height*sizeof(int));
+in->lb=(int*)malloc(height*sizeof(int));
+in->bars=(int*)malloc(3*width*sizeof(int));
+if (!in->wave || !in->la || !in->lb || !in->bars || height>=65536)
+	{
+	free(in->wave); free(in->la); free(in->lb); free(in->bars);
+	free(in);
+	return 0;
+	}
+
+return (f0r_instance_t)in;
+}
+
+//---------------------------------------------------
+void f0r_destruct(f0r_instance_t instance)
+{
+inst *in;
+
+in=(inst*)instance;
+
+free(in->wave);
+free(in->la);
+free(in->lb);
+free(in->bars);
+free(instance);
+}
+
+//-----------------------------------------------------
+void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_index)
+{
+inst *p;
+
+p=(inst*)instance;
+
+switch(param_index)
+	{
+	case 0:
+		p->disp=map_value_forward(*((double*)parm), 0.0, 2.9999);
+		break;
+	case 1:
+		p->color=map_value_forward(*((double*)parm), 0.0, 1.0); //BOOL!!
+		break;
+	case 2:
+		p->dec=map_value_forward(*((double*)parm), 1.0, 16.9999);
+		if (p->dec<1) p->dec=1;
+		if (p->dec>16) p->dec=16;
+		p->phase=0;
+		break;
+	case 3:
+		p->mix=*((double*)parm);
+		if (p->mix<0.0) p->mix=0.0;
+		if (p->mix>1.0) p->mix=1.0;
+		break;
+	case 4:
+		p->mo=map_value_forward(*((double*)parm), 0.0, 1.0); //BOOL!!
+		break;
+	case 5:		//read only
+		break;
+	}
+}
+
+//--------------------------------------------------
+void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_index)
+{
+inst *p;
+
+p=(inst*)instance;
+
+switch(param_index)
+	{
+	case 0:
+		*((double*)param)=map_value_backward(p->disp, 0.0, 2.9999);
+		break;
+	case 1:
+		*((double*)param)=map_value_backward(p->color, 0.0, 1.0);//BOOL!!
+		break;
+	case 2:
+		*((double*)param)=map_value_backward(p->dec, 1.0, 16.9999);
+		break;
+	case 3:
+		*((double*)param)=p->mix;
+		break;
+	case 4:
+		*((double*)param)=map_value_backward(p->mo, 0.0, 1.0);//BOOL!!
+		break;
+	case 5:
+		*((f0r_param_string*)param)=p->res;
+		break;
+	}
+}
+
+//-------------------------------------------------
+//the decimated rows move down by one row each frame,
+//so that over dec frames every row is measured once
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+inst *in;
+rjob jobs[FREI0R_MAX_THREADS];
+int i,n,wh;
+
+assert(instance);
+in=(inst*)instance;
+
+wh = in->mo ? 0 : wave_rows(in);
+in->phase=in->phase%in->dec;
+meri_hist8(inframe, in->w, in->h, in->color, in->dec, in->phase, &in->hi, wh>0 ? in->wave : NULL);
+hist8_stat(in->hi.y, in->hi.n, &in->ys);
+rezultat(in);
+
+if (in->mo)
+	{
+	if (outframe!=inframe)
+		memcpy(outframe, inframe, in->w*in->h*sizeof(uint32_t));
+	in->phase++;
+	return;
+	}
+
+if (wh>0) wave_levels(in, wh);
+if (wh<in->h) hist_bars(in, in->h-wh);
+
+n=frei0r_thread_count((long)in->w*in->h);
+for (i=0;i<n;i++)
+	{
+	jobs[i].in=in;
+	jobs[i].s=inframe;
+	jobs[i].d=outframe;
+	jobs[i].y0=in->h*i/n;
+	jobs[i].y1=in->h*(i+1)/n;
+	}
+frei0r_thread_run(draw_rows, jobs, sizeof(rjob), n);
+
+in->phase++;
+}
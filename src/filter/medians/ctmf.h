@@ -48,18 +48,20 @@ typedef UINT32 uint32_t;
 #include <stdint.h>
 #endif
 
+#include "frei0r_cpu.h"
+#include "frei0r_arena.h"
+#include "frei0r_thread.h"
+
 /* Intrinsic declarations */
+#if defined(FREI0R_CPU_DISPATCH)
+#include <immintrin.h>
+#endif
 #if defined(__SSE2__) || defined(__MMX__)
 #if defined(__SSE2__)
 #include <emmintrin.h>
 #elif defined(__MMX__)
 #include <mmintrin.h>
 #endif
-#if defined(__GNUC__)
-#include <mm_malloc.h>
-#elif defined(_MSC_VER)
-#include <malloc.h>
-#endif
 #elif defined(__ALTIVEC__)
 #include <altivec.h>
 #endif
@@ -190,12 +192,16 @@ static inline void histogram_muladd( const uint16_t a, const uint16_t x[16],
     }
 }
 
-static void ctmf_helper(
+typedef void (*histogram_op)( const uint16_t x[16], uint16_t y[16] );
+
+static FREI0R_ALWAYS_INLINE void ctmf_helper_impl(
         const unsigned char* const src, unsigned char* const dst,
         const int width, const int height,
         const int src_step, const int dst_step,
-        const int r, const int cn,
-        const int pad_left, const int pad_right
+        const int r, const int cn, const int ps,
+        const int pad_left, const int pad_right,
+        uint16_t* const h_coarse, uint16_t* const h_fine,
+        const histogram_op hadd, const histogram_op hsub
         )
 {
     const int m = height, n = width;
@@ -203,7 +209,7 @@ static void ctmf_helper(
     const unsigned char *p, *q;
 
     Histogram H[4];
-    uint16_t *h_coarse, *h_fine, luc[4][16];
+    uint16_t luc[4][16];
 
     assert( src );
     assert( dst );
@@ -213,27 +219,19 @@ static void ctmf_helper(
     assert( src_step != 0 );
     assert( dst_step != 0 );
 
-    /* SSE2 and MMX need aligned memory, provided by _mm_malloc(). */
-#if defined(__SSE2__) || defined(__MMX__)
-    h_coarse = (uint16_t*) _mm_malloc(  1 * 16 * n * cn * sizeof(uint16_t), 16 );
-    h_fine   = (uint16_t*) _mm_malloc( 16 * 16 * n * cn * sizeof(uint16_t), 16 );
     memset( h_coarse, 0,  1 * 16 * n * cn * sizeof(uint16_t) );
     memset( h_fine,   0, 16 * 16 * n * cn * sizeof(uint16_t) );
-#else
-    h_coarse = (uint16_t*) calloc(  1 * 16 * n * cn, sizeof(uint16_t) );
-    h_fine   = (uint16_t*) calloc( 16 * 16 * n * cn, sizeof(uint16_t) );
-#endif
 
     /* First row initialization */
     for ( j = 0; j < n; ++j ) {
         for ( c = 0; c < cn; ++c ) {
-            COP( c, j, src[cn*j+c], += r+1 );
+            COP( c, j, src[ps*j+c], += r+1 );
         }
     }
     for ( i = 0; i < r; ++i ) {
         for ( j = 0; j < n; ++j ) {
             for ( c = 0; c < cn; ++c ) {
-                COP( c, j, src[src_step*i+cn*j+c], ++ );
+                COP( c, j, src[src_step*i+ps*j+c], ++ );
             }
         }
     }
@@ -242,18 +240,11 @@ static void ctmf_helper(
 
         /* Update column histograms for entire row. */
         p = src + src_step * MAX( 0, i-r-1 );
-        q = p + cn * n;
-        for ( j = 0; p != q; ++j ) {
-            for ( c = 0; c < cn; ++c, ++p ) {
-                COP( c, j, *p, -- );
-            }
-        }
-
-        p = src + src_step * MIN( m-1, i+r );
-        q = p + cn * n;
-        for ( j = 0; p != q; ++j ) {
-            for ( c = 0; c < cn; ++c, ++p ) {
-                COP( c, j, *p, ++ );
+        q = src + src_step * MIN( m-1, i+r );
+        for ( j = 0; j < n; ++j, p += ps, q += ps ) {
+            for ( c = 0; c < cn; ++c ) {
+                COP( c, j, p[c], -- );
+                COP( c, j, q[c], ++ );
             }
         }
 
@@ -267,7 +258,7 @@ static void ctmf_helper(
         }
         for ( j = 0; j < (pad_left ? r : 2*r); ++j ) {
             for ( c = 0; c < cn; ++c ) {
-                histogram_add( &h_coarse[16*(n*c+j)], H[c].coarse );
+                hadd( &h_coarse[16*(n*c+j)], H[c].coarse );
             }
         }
         for ( c = 0; c < cn; ++c ) {
@@ -282,7 +273,7 @@ static void ctmf_helper(
                 uint16_t sum = 0, *segment;
                 int b;
 
-                histogram_add( &h_coarse[16*(n*c + MIN(j+r,n-1))], H[c].coarse );
+                hadd( &h_coarse[16*(n*c + MIN(j+r,n-1))], H[c].coarse );
 
                 /* Find median at coarse level */
                 for ( k = 0; k < 16 ; ++k ) {
@@ -298,7 +289,7 @@ static void ctmf_helper(
                 if ( luc[c][k] <= j-r ) {
                     memset( &H[c].fine[k], 0, 16 * sizeof(uint16_t) );
                     for ( luc[c][k] = j-r; luc[c][k] < MIN(j+r+1,n); ++luc[c][k] ) {
-                        histogram_add( &h_fine[16*(n*(16*c+k)+luc[c][k])], H[c].fine[k] );
+                        hadd( &h_fine[16*(n*(16*c+k)+luc[c][k])], H[c].fine[k] );
                     }
                     if ( luc[c][k] < j+r+1 ) {
                         histogram_muladd( j+r+1 - n, &h_fine[16*(n*(16*c+k)+(n-1))], &H[c].fine[k][0] );
@@ -307,19 +298,19 @@ static void ctmf_helper(
                 }
                 else {
                     for ( ; luc[c][k] < j+r+1; ++luc[c][k] ) {
-                        histogram_sub( &h_fine[16*(n*(16*c+k)+MAX(luc[c][k]-2*r-1,0))], H[c].fine[k] );
-                        histogram_add( &h_fine[16*(n*(16*c+k)+MIN(luc[c][k],n-1))], H[c].fine[k] );
+                        hsub( &h_fine[16*(n*(16*c+k)+MAX(luc[c][k]-2*r-1,0))], H[c].fine[k] );
+                        hadd( &h_fine[16*(n*(16*c+k)+MIN(luc[c][k],n-1))], H[c].fine[k] );
                     }
                 }
 
-                histogram_sub( &h_coarse[16*(n*c+MAX(j-r,0))], H[c].coarse );
+                hsub( &h_coarse[16*(n*c+MAX(j-r,0))], H[c].coarse );
 
                 /* Find median in segment */
                 segment = H[c].fine[k];
                 for ( b = 0; b < 16 ; ++b ) {
                     sum += segment[b];
                     if ( sum > t ) {
-                        dst[dst_step*i+cn*j+c] = 16*k + b;
+                        dst[dst_step*i+ps*j+c] = 16*k + b;
                         break;
                     }
                 }
@@ -330,14 +321,94 @@ static void ctmf_helper(
 
 #if defined(__SSE2__) || defined(__MMX__)
     _mm_empty();
-    _mm_free(h_coarse);
-    _mm_free(h_fine);
-#else
-    free(h_coarse);
-    free(h_fine);
 #endif
 }
 
+/**
+ * One ctmf_helper() per instruction set, with the histogram operations
+ * inlined. ctmf_init() picks the best one for the running CPU.
+ */
+#define CTMF_HELPER_VARIANT(name, add, sub) \
+static void name( \
+        const unsigned char* const src, unsigned char* const dst, \
+        const int width, const int height, \
+        const int src_step, const int dst_step, \
+        const int r, const int cn, const int ps, \
+        const int pad_left, const int pad_right, \
+        uint16_t* const h_coarse, uint16_t* const h_fine \
+        ) \
+{ \
+    ctmf_helper_impl( src, dst, width, height, src_step, dst_step, r, cn, ps, \
+            pad_left, pad_right, h_coarse, h_fine, add, sub ); \
+}
+
+CTMF_HELPER_VARIANT( ctmf_helper_generic, histogram_add, histogram_sub )
+
+#if defined(FREI0R_CPU_DISPATCH)
+FREI0R_TARGET_AVX2 static inline void histogram_add_avx2( const uint16_t x[16], uint16_t y[16] )
+{
+    _mm256_storeu_si256( (__m256i*) y, _mm256_add_epi16( _mm256_loadu_si256( (const __m256i*) y ), _mm256_loadu_si256( (const __m256i*) x ) ) );
+}
+
+FREI0R_TARGET_AVX2 static inline void histogram_sub_avx2( const uint16_t x[16], uint16_t y[16] )
+{
+    _mm256_storeu_si256( (__m256i*) y, _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*) y ), _mm256_loadu_si256( (const __m256i*) x ) ) );
+}
+
+FREI0R_TARGET_AVX2 CTMF_HELPER_VARIANT( ctmf_helper_avx2, histogram_add_avx2, histogram_sub_avx2 )
+#endif
+
+static void (*ctmf_helper)( const unsigned char* const, unsigned char* const,
+        const int, const int, const int, const int, const int, const int,
+        const int, const int, const int, uint16_t* const, uint16_t* const )
+    = ctmf_helper_generic;
+
+/**
+ * Selects the ctmf_helper() variant for the running CPU. Call it once
+ * before the first ctmf(), e.g. from f0r_init().
+ */
+void ctmf_init()
+{
+#if defined(FREI0R_CPU_DISPATCH)
+    if ( frei0r_cpu_features() & FREI0R_CPU_AVX2 ) {
+        ctmf_helper = ctmf_helper_avx2;
+    }
+#endif
+}
+
+/**
+ * Stripes [first,last) of the count stripes starting at x, for one thread.
+ */
+typedef struct
+{
+    const unsigned char* src;
+    unsigned char* dst;
+    int width, height;
+    int src_step, dst_step;
+    int r, cn, ps;
+    const int* x;
+    int count, first, last;
+    int stripe_size;
+    uint16_t* h_coarse;
+    uint16_t* h_fine;
+} ctmf_job;
+
+static void* ctmf_stripes( void* arg )
+{
+    const ctmf_job* job = (const ctmf_job*) arg;
+    int k;
+
+    for ( k = job->first; k < job->last; ++k ) {
+        const int i = job->x[k];
+        const int stripe = k == job->count-1 ? job->width - i : job->stripe_size;
+
+        ctmf_helper( job->src + job->ps*i, job->dst + job->ps*i, stripe, job->height,
+                job->src_step, job->dst_step, job->r, job->cn, job->ps,
+                i == 0, k == job->count-1, job->h_coarse, job->h_fine );
+    }
+    return NULL;
+}
+
 /**
  * \brief Constant-time median filtering
  *
@@ -345,16 +416,18 @@ static void ctmf_helper(
  * processed as if it was padded with zeros. The median kernel is square with
  * odd dimensions. Images of arbitrary size may be processed.
  *
- * To process multi-channel images, you must call this function multiple times,
- * changing the source and destination adresses and steps such that each channel
- * is processed as an independent single-channel image.
+ * Multi-channel images are processed in one pass, all channels of a pixel at
+ * once. Channels at the end of a pixel can be left out (\a cn < \a ps), e.g.
+ * the alpha of RGBA images; they are not written in \a dst.
  *
  * Processing images of arbitrary bit depth is not supported.
  *
  * The computing time is O(1) per pixel, independent of the radius of the
  * filter. The algorithm's initialization is O(r*width), but it is negligible.
  * Memory usage is simple: it will be as big as the cache size, or smaller if
- * the image is small. For efficiency, the histograms' bins are 16-bit wide.
+ * the image is small, per thread. Big images are split into at least as many
+ * stripes as there are threads (see frei0r_thread.h), which are processed in
+ * parallel. For efficiency, the histograms' bins are 16-bit wide.
  * This may become too small and lead to overflow as \a r increases.
  *
  * \param src           Source image data.
@@ -369,17 +442,23 @@ static void ctmf_helper(
  *                      2*r+1 square.
  * \param cn            Number of channels. For example, a grayscale image would
  *                      have cn=1 while an RGB image would have cn=3.
+ * \param ps            Distance between adjacent pixels on the same row, in
+ *                      bytes. At least cn; cn=3 with ps=4 filters the color of
+ *                      RGBA images.
  * \param memsize       Maximum amount of memory to use, in bytes. Set this to
  *                      the size of the L2 cache, then vary it slightly and
  *                      measure the processing time to find the optimal value.
  *                      For example, a 512 kB L2 cache would have
  *                      memsize=512*1024 initially.
+ * \param arena         Arena for the histograms, which take up to memsize
+ *                      bytes per thread.
  */
 void ctmf(
         const unsigned char* const src, unsigned char* const dst,
         const int width, const int height,
         const int src_step, const int dst_step,
-        const int r, const int cn, const long unsigned int memsize
+        const int r, const int cn, const int ps,
+        const long unsigned int memsize, frei0r_arena_t* const arena
         )
 {
     /*
@@ -395,7 +474,7 @@ void ctmf(
      * thrashing to RAM happens.
      *
      * To solve this problem, I figure out the maximum number of histograms
-     * that can fit in cache. From this is determined the number of stripes in
+     * that can fit in cache, one per column and channel. From this is determined the number of stripes in
      * an image. The formulas below make the stripes all the same size and use
      * as few stripes as possible.
      *
@@ -411,23 +490,56 @@ void ctmf(
      * A flag is passed to ctmf_helper() so that it treats these cases as if the
      * image was zero-padded.
      */
-    int stripes = (int) ceil( (double) (width - 2*r) / (memsize / sizeof(Histogram) - 2*r) );
-    int stripe_size = (int) ceil( (double) ( width + stripes*2*r - 2*r ) / stripes );
-
-    int i;
-
-    for ( i = 0; i < width; i += stripe_size - 2*r ) {
-        int stripe = stripe_size;
+    int stripes = (int) ceil( (double) (width - 2*r) / (memsize / (cn*sizeof(Histogram)) - 2*r) );
+    int stripe_size;
+    int threads = frei0r_thread_count( (long) width * height );
+    ctmf_job jobs[FREI0R_MAX_THREADS];
+    int* x;
+    int i, count;
+
+    /* Every thread needs a stripe of its own, as long as the stripes stay
+     * wider than their overlap. */
+    threads = MIN( threads, ( width - 2*r ) / ( 4*r + 2 ) );
+    threads = MAX( threads, 1 );
+    stripes = MAX( stripes, threads );
+    stripe_size = (int) ceil( (double) ( width + stripes*2*r - 2*r ) / stripes );
+
+    /* Left edges of the stripes */
+    x = (int*) frei0r_arena_alloc( arena, ( width / ( stripe_size - 2*r ) + 1 ) * sizeof(int) );
+    for ( i = 0, count = 0; i < width; i += stripe_size - 2*r ) {
+        x[count++] = i;
         /* Make sure that the filter kernel fits into one stripe. */
         if ( i + stripe_size - 2*r >= width || width - (i + stripe_size - 2*r) < 2*r+1 ) {
-            stripe = width - i;
-        }
-
-        ctmf_helper( src + cn*i, dst + cn*i, stripe, height, src_step, dst_step, r, cn,
-                i == 0, stripe == width - i );
-
-        if ( stripe == width - i ) {
             break;
         }
     }
+    threads = MIN( threads, count );
+
+    for ( i = 0; i < threads; ++i ) {
+        ctmf_job* job = &jobs[i];
+
+        job->src = src;
+        job->dst = dst;
+        job->width = width;
+        job->height = height;
+        job->src_step = src_step;
+        job->dst_step = dst_step;
+        job->r = r;
+        job->cn = cn;
+        job->ps = ps;
+        job->x = x;
+        job->count = count;
+        job->first = count * i / threads;
+        job->last = count * (i+1) / threads;
+        job->stripe_size = stripe_size;
+        /* Histograms for the widest stripe, reused for all of the job's
+         * stripes. SSE2 and MMX need aligned memory, which the arena
+         * provides. */
+        job->h_coarse = (uint16_t*) frei0r_arena_alloc( arena,
+                 1 * 16 * stripe_size * cn * sizeof(uint16_t) );
+        job->h_fine   = (uint16_t*) frei0r_arena_alloc( arena,
+                16 * 16 * stripe_size * cn * sizeof(uint16_t) );
+    }
+
+    frei0r_thread_run( ctmf_stripes, jobs, sizeof(ctmf_job), threads );
 }
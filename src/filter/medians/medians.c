@@ -39,6 +39,7 @@ Copyright (C) 2013  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 
 #include "small_medians.h"
 #include "ctmf.h"
+#include "frei0r_deadline.h"
 
 
 /* ******************************************
@@ -73,6 +74,12 @@ ML3DEX:		multilevel spatio-temporal, see [1]
 
 ****************************************** */
 
+//------------------------------------------------------------
+//The filters below run the vector medians of small_medians.h
+//on SMED_N neighbouring pixels at once where the vector code
+//is available, the rest of each row goes through the scalar
+//medians. Both give the same results.
+
 //------------------------------------------------------------
 //cross5	packed char RGB image (uint32_t)
 //vs = input image
@@ -81,16 +88,33 @@ void cross5(const uint32_t *vs, int w, int h, uint32_t *is)
 {
 int i,j,p;
 uint32_t m[8];
+#ifdef SMED_N
+smed_v v[8];
+#endif
 
 for (i=1;i<h-1;i++)
-    for (j=1;j<w-1;j++)
 	{
-	p=i*w+j;
-
-	m[0]=vs[p-w]; m[1]=vs[p-1]; m[2]=vs[p];
-	m[3]=vs[p+1]; m[4]=vs[p+w];
-
-	is[p]=median5(m);
+	j=1;
+#ifdef SMED_N
+	for (;j+SMED_N<w;j+=SMED_N)
+		{
+		p=i*w+j;
+
+		v[0]=smed_ld(vs+p-w); v[1]=smed_ld(vs+p-1); v[2]=smed_ld(vs+p);
+		v[3]=smed_ld(vs+p+1); v[4]=smed_ld(vs+p+w);
+
+		smed_st(is+p,median5_v(v));
+		}
+#endif
+	for (;j<w-1;j++)
+		{
+		p=i*w+j;
+
+		m[0]=vs[p-w]; m[1]=vs[p-1]; m[2]=vs[p];
+		m[3]=vs[p+1]; m[4]=vs[p+w];
+
+		is[p]=median5(m);
+		}
 	}
 }
 
@@ -98,21 +122,65 @@ for (i=1;i<h-1;i++)
 //square 3x3		packed char RGB image (uint32_t)
 //vs = input image
 //is = output image
+//The vector version sorts each column of three pixels once into
+//lo, mid and hi, for a tile of SQ3_TILE pixels of the row. The
+//median of nine is then the median of the max of lo, the median
+//of mid and the min of hi of three neighbouring columns, which a
+//pixel shares with its neighbours instead of sorting them again.
+#define SQ3_TILE 64
 void sq3x3(const uint32_t *vs, int w, int h, uint32_t *is)
 {
 int i,j,p;
 uint32_t m[16];
+#ifdef SMED_N
+int k,n;
+uint32_t lo[SQ3_TILE+SMED_N],mid[SQ3_TILE+SMED_N],hi[SQ3_TILE+SMED_N];
+smed_v a,b,c,t;
+#endif
 
 for (i=1;i<h-1;i++)
-    for (j=1;j<w-1;j++)
 	{
-	p=i*w+j;
-
-	m[0]=vs[p-w-1]; m[1]=vs[p-w]; m[2]=vs[p-w+1];
-	m[3]=vs[p-1];   m[4]=vs[p];   m[5]=vs[p+1];
-	m[6]=vs[p+w-1]; m[7]=vs[p+w]; m[8]=vs[p+w+1];
-
-	is[p]=median9(m);
+	j=1;
+#ifdef SMED_N
+	while (j+SMED_N<w)
+		{
+//the columns j-1...j+n+SMED_N-2 have to be inside the row
+		n=w-1-j;
+		if (n>SQ3_TILE) n=SQ3_TILE;
+		n-=n%SMED_N;
+		if (j+n+SMED_N-1>w) n-=SMED_N;
+		if (n<=0) break;
+
+		for (k=0;k<=n;k+=SMED_N)
+			{
+			p=i*w+j-1+k;
+			a=smed_ld(vs+p-w); b=smed_ld(vs+p); c=smed_ld(vs+p+w);
+			t=smed_min(a,b); b=smed_max(a,b); a=t;
+			t=smed_min(b,c); c=smed_max(b,c); b=t;
+			t=smed_min(a,b); b=smed_max(a,b); a=t;
+			smed_st(lo+k,a); smed_st(mid+k,b); smed_st(hi+k,c);
+			}
+		for (k=0;k<n;k+=SMED_N)
+			{
+			p=i*w+j+k;
+			a=smed_max(smed_max(smed_ld(lo+k),smed_ld(lo+k+1)),smed_ld(lo+k+2));
+			b=smed_med3(smed_ld(mid+k),smed_ld(mid+k+1),smed_ld(mid+k+2));
+			c=smed_min(smed_min(smed_ld(hi+k),smed_ld(hi+k+1)),smed_ld(hi+k+2));
+			smed_st(is+p,smed_alpha(smed_med3(a,b,c),smed_ld(vs+p)));
+			}
+		j+=n;
+		}
+#endif
+	for (;j<w-1;j++)
+		{
+		p=i*w+j;
+
+		m[0]=vs[p-w-1]; m[1]=vs[p-w]; m[2]=vs[p-w+1];
+		m[3]=vs[p-1];   m[4]=vs[p];   m[5]=vs[p+1];
+		m[6]=vs[p+w-1]; m[7]=vs[p+w]; m[8]=vs[p+w+1];
+
+		is[p]=median9(m);
+		}
 	}
 }
 
@@ -124,21 +192,43 @@ void bilevel(const uint32_t *vs, int w, int h, uint32_t *is)
 {
 int i,j,p;
 uint32_t m[8],mm[4];
+#ifdef SMED_N
+smed_v v[8],vv[4];
+#endif
 
 for (i=1;i<h-1;i++)
-    for (j=1;j<w-1;j++)
 	{
-	p=i*w+j;
-
-	m[0]=vs[p-w-1]; m[1]=vs[p-w+1]; m[2]=vs[p];
-	m[3]=vs[p+w-1]; m[4]=vs[p+w+1];
-	mm[0]=median5(m);
-	mm[1]=vs[p];
-	m[0]=vs[p-w]; m[1]=vs[p-1]; m[2]=vs[p];
-	m[3]=vs[p+1]; m[4]=vs[p+w];
-	mm[2]=median5(m);
-
-	is[p]=median3(mm);
+	j=1;
+#ifdef SMED_N
+	for (;j+SMED_N<w;j+=SMED_N)
+		{
+		p=i*w+j;
+
+		v[0]=smed_ld(vs+p-w-1); v[1]=smed_ld(vs+p-w+1); v[2]=smed_ld(vs+p);
+		v[3]=smed_ld(vs+p+w-1); v[4]=smed_ld(vs+p+w+1);
+		vv[0]=median5_v(v);
+		vv[1]=smed_ld(vs+p);
+		v[0]=smed_ld(vs+p-w); v[1]=smed_ld(vs+p-1); v[2]=smed_ld(vs+p);
+		v[3]=smed_ld(vs+p+1); v[4]=smed_ld(vs+p+w);
+		vv[2]=median5_v(v);
+
+		smed_st(is+p,median3_v(vv));
+		}
+#endif
+	for (;j<w-1;j++)
+		{
+		p=i*w+j;
+
+		m[0]=vs[p-w-1]; m[1]=vs[p-w+1]; m[2]=vs[p];
+		m[3]=vs[p+w-1]; m[4]=vs[p+w+1];
+		mm[0]=median5(m);
+		mm[1]=vs[p];
+		m[0]=vs[p-w]; m[1]=vs[p-1]; m[2]=vs[p];
+		m[3]=vs[p+1]; m[4]=vs[p+w];
+		mm[2]=median5(m);
+
+		is[p]=median3(mm);
+		}
 	}
 }
 
@@ -150,18 +240,37 @@ void dia3x3(const uint32_t *vs, int w, int h, uint32_t *is)
 {
 int i,j,p;
 uint32_t m[16];
+#ifdef SMED_N
+smed_v v[16];
+#endif
 
 for (i=2;i<h-2;i++)
-    for (j=2;j<w-2;j++)
 	{
-	p=i*w+j;
-	m[0]=vs[p-2*w]; m[1]=vs[p-w-1]; m[2]=vs[p-w];
-	m[3]=vs[p-w+1]; m[4]=vs[p-2]; m[5]=vs[p-1];
-	m[6]=vs[p]; m[7]=vs[p+1]; m[8]=vs[p+2];
-	m[9]=vs[p+w-1]; m[10]=vs[p+w]; m[11]=vs[p+w+1];
-	m[12]=vs[p+2*w];
-
-	is[p]=median13(m);
+	j=2;
+#ifdef SMED_N
+	for (;j+SMED_N<w-1;j+=SMED_N)
+		{
+		p=i*w+j;
+		v[0]=smed_ld(vs+p-2*w); v[1]=smed_ld(vs+p-w-1); v[2]=smed_ld(vs+p-w);
+		v[3]=smed_ld(vs+p-w+1); v[4]=smed_ld(vs+p-2); v[5]=smed_ld(vs+p-1);
+		v[6]=smed_ld(vs+p); v[7]=smed_ld(vs+p+1); v[8]=smed_ld(vs+p+2);
+		v[9]=smed_ld(vs+p+w-1); v[10]=smed_ld(vs+p+w); v[11]=smed_ld(vs+p+w+1);
+		v[12]=smed_ld(vs+p+2*w);
+
+		smed_st(is+p,median13_v(v));
+		}
+#endif
+	for (;j<w-2;j++)
+		{
+		p=i*w+j;
+		m[0]=vs[p-2*w]; m[1]=vs[p-w-1]; m[2]=vs[p-w];
+		m[3]=vs[p-w+1]; m[4]=vs[p-2]; m[5]=vs[p-1];
+		m[6]=vs[p]; m[7]=vs[p+1]; m[8]=vs[p+2];
+		m[9]=vs[p+w-1]; m[10]=vs[p+w]; m[11]=vs[p+w+1];
+		m[12]=vs[p+2*w];
+
+		is[p]=median13(m);
+		}
 	}
 }
 
@@ -173,23 +282,41 @@ void sq5x5(const uint32_t *vs, int w, int h, uint32_t *is)
 {
 int i,j,p;
 uint32_t m[32];
+#ifdef SMED_N
+int k;
+smed_v v[32];
+#endif
 
 for (i=2;i<h-2;i++)
-    for (j=2;j<w-2;j++)
 	{
-	p=i*w+j;
-
-	m[0]=vs[p-2*w-2]; m[1]=vs[p-2*w-1]; m[2]=vs[p-2*w];
-	m[3]=vs[p-2*w+1]; m[4]=vs[p-2*w+2]; m[5]=vs[p-w-2];
-	m[6]=vs[p-w-1];   m[7]=vs[p-w];     m[8]=vs[p-w+1];
-	m[9]=vs[p-w+2];	  m[10]=vs[p-2];    m[11]=vs[p-1];
-	m[12]=vs[p];      m[13]=vs[p+1];    m[14]=vs[p+2];
-	m[15]=vs[p+w-2];  m[16]=vs[p+w-1];  m[17]=vs[p+w];
-	m[18]=vs[p+w+1];  m[19]=vs[p+w+2];  m[20]=vs[p+2*w-2];
-	m[21]=vs[p+2*w-1];m[22]=vs[p+2*w];  m[23]=vs[p+2*w+1];
-	m[24]=vs[p+2*w+2];
-
-	is[p]=median25(m);
+	j=2;
+#ifdef SMED_N
+	for (;j+SMED_N<w-1;j+=SMED_N)
+		{
+		p=i*w+j;
+
+		for (k=0;k<25;k++)
+			v[k]=smed_ld(vs+p+(k/5-2)*w+k%5-2);
+
+		smed_st(is+p,median25_v(v));
+		}
+#endif
+	for (;j<w-2;j++)
+		{
+		p=i*w+j;
+
+		m[0]=vs[p-2*w-2]; m[1]=vs[p-2*w-1]; m[2]=vs[p-2*w];
+		m[3]=vs[p-2*w+1]; m[4]=vs[p-2*w+2]; m[5]=vs[p-w-2];
+		m[6]=vs[p-w-1];   m[7]=vs[p-w];     m[8]=vs[p-w+1];
+		m[9]=vs[p-w+2];	  m[10]=vs[p-2];    m[11]=vs[p-1];
+		m[12]=vs[p];      m[13]=vs[p+1];    m[14]=vs[p+2];
+		m[15]=vs[p+w-2];  m[16]=vs[p+w-1];  m[17]=vs[p+w];
+		m[18]=vs[p+w+1];  m[19]=vs[p+w+2];  m[20]=vs[p+2*w-2];
+		m[21]=vs[p+2*w-1];m[22]=vs[p+2*w];  m[23]=vs[p+2*w+1];
+		m[24]=vs[p+2*w+2];
+
+		is[p]=median25(m);
+		}
 	}
 }
 
@@ -200,8 +327,19 @@ void temp3(uint32_t *s1, uint32_t *s2, uint32_t *s3, int w, int h, uint32_t *is)
 {
 int i;
 uint32_t m[32];
+#ifdef SMED_N
+smed_v v[4];
+#endif
 
-for (i=0;i<w*h;i++)
+i=0;
+#ifdef SMED_N
+for (;i+SMED_N<=w*h;i+=SMED_N)
+    {
+    v[0]=smed_ld(s1+i); v[1]=smed_ld(s2+i); v[2]=smed_ld(s3+i);
+    smed_st(is+i,median3_v(v));
+    }
+#endif
+for (;i<w*h;i++)
     {
     m[0]=s1[i]; m[1]=s2[i]; m[2]=s3[i];
     is[i]=median3(m);
@@ -215,8 +353,20 @@ void temp5(uint32_t *s1, uint32_t *s2, uint32_t *s3, uint32_t *s4, uint32_t *s5,
 {
 int i;
 uint32_t m[32];
+#ifdef SMED_N
+smed_v v[8];
+#endif
 
-for (i=0;i<w*h;i++)
+i=0;
+#ifdef SMED_N
+for (;i+SMED_N<=w*h;i+=SMED_N)
+    {
+    v[0]=smed_ld(s1+i); v[1]=smed_ld(s2+i); v[2]=smed_ld(s3+i);
+    v[3]=smed_ld(s4+i); v[4]=smed_ld(s5+i);
+    smed_st(is+i,median5_v(v));
+    }
+#endif
+for (;i<w*h;i++)
     {
     m[0]=s1[i]; m[1]=s2[i]; m[2]=s3[i]; m[3]=s4[i]; m[4]=s5[i];
     is[i]=median5(m);
@@ -224,6 +374,100 @@ for (i=0;i<w*h;i++)
   
 }
 
+//--------------------------------------------------------
+//temporal N frames
+//The median of each byte over n frames (n odd, at most TEMPN_MAX) is
+//found bit by bit from the top: it is the largest value r for which
+//at most n/2 of the bytes are below r. That takes 8*n compares for
+//any n, without sorting, and SSE2 does them on 16 bytes at once.
+//Both paths give the same results.
+#define TEMPN_MAX 25
+
+static void tempn_run(const uint32_t * const *fr, int n, long b, long e, uint32_t *is)
+{
+uint8_t *d=(uint8_t*)is;
+long i=4*b;
+int f,bit,cnt;
+uint8_t r,c;
+#if defined(__SSE2__)
+const __m128i sign=_mm_set1_epi8((char)0x80);
+const __m128i half=_mm_set1_epi8((char)(n/2));
+__m128i v[TEMPN_MAX],rv,cv,cs,b0,b1,keep;
+
+for (;i+16<=4*e;i+=16)
+	{
+//signed compares only, so the bytes are offset by 128
+	for (f=0;f<n;f++)
+		v[f]=_mm_xor_si128(_mm_loadu_si128((const __m128i*)((const uint8_t*)fr[f]+i)),sign);
+	rv=_mm_setzero_si128();
+	for (bit=0x80;bit>0;bit>>=1)
+		{
+		cv=_mm_or_si128(rv,_mm_set1_epi8((char)bit));
+		cs=_mm_xor_si128(cv,sign);
+//two counts, so that the subtractions don't wait for each other
+		b0=_mm_setzero_si128();
+		b1=_mm_setzero_si128();
+		for (f=0;f+2<=n;f+=2)
+			{
+			b0=_mm_sub_epi8(b0,_mm_cmplt_epi8(v[f],cs));
+			b1=_mm_sub_epi8(b1,_mm_cmplt_epi8(v[f+1],cs));
+			}
+		if (f<n)
+			b0=_mm_sub_epi8(b0,_mm_cmplt_epi8(v[f],cs));
+		keep=_mm_cmpgt_epi8(_mm_add_epi8(b0,b1),half);
+		rv=_mm_or_si128(_mm_and_si128(keep,rv),_mm_andnot_si128(keep,cv));
+		}
+	_mm_storeu_si128((__m128i*)(d+i),rv);
+	}
+#endif
+for (;i<4*e;i++)
+	{
+	r=0;
+	for (bit=0x80;bit>0;bit>>=1)
+		{
+		c=r|bit;
+		cnt=0;
+		for (f=0;f<n;f++)
+			cnt+=((const uint8_t*)fr[f])[i]<c;
+		if (cnt<=n/2) r=c;
+		}
+	d[i]=r;
+	}
+}
+
+typedef struct
+{
+const uint32_t * const *fr;
+int n;
+long b,e;
+uint32_t *is;
+} tempn_job;
+
+static void* tempn_rows(void *arg)
+{
+tempn_job *j=(tempn_job*)arg;
+tempn_run(j->fr,j->n,j->b,j->e,j->is);
+return 0;
+}
+
+//fr = the n frames, in any order
+//is = output image
+void tempn(const uint32_t * const *fr, int n, int w, int h, uint32_t *is)
+{
+tempn_job jobs[FREI0R_MAX_THREADS];
+int t,nt=frei0r_thread_count((long)w*h);
+
+for (t=0;t<nt;t++)
+	{
+	jobs[t].fr=fr;
+	jobs[t].n=n;
+	jobs[t].b=(long)w*(h*t/nt);
+	jobs[t].e=(long)w*(h*(t+1)/nt);
+	jobs[t].is=is;
+	}
+frei0r_thread_run(tempn_rows,jobs,sizeof(tempn_job),nt);
+}
+
 
 //------------------------------------------------------------
 //Arce BI	packed char RGB image (uint32_t)
@@ -233,39 +477,74 @@ void ArceBI(uint32_t *s1, uint32_t *s2, uint32_t *s3, int w, int h, uint32_t *is
 {
 int i,j,p;
 uint32_t mm[8],m[16];
+#ifdef SMED_N
+smed_v vv[8],v[16];
+#endif
 
 for (i=1;i<h-1;i++)
-    for (j=1;j<w-1;j++)
 	{
-	p=i*w+j;
+	j=1;
+#ifdef SMED_N
+	for (;j+SMED_N<w;j+=SMED_N)
+		{
+		p=i*w+j;
+//grupa C
+		vv[0]=smed_ld(s1+p);
+//GRUPA W1
+		v[0]=vv[0]; v[1]=smed_ld(s2+p-w-1); v[2]=smed_ld(s2+p);
+		v[3]=smed_ld(s2+p+w+1); v[4]=smed_ld(s3+p);
+		vv[3]=median5_v(v);
+//grupa W2
+		v[0]=vv[0]; v[1]=smed_ld(s2+p-w); v[2]=smed_ld(s2+p);
+		v[3]=smed_ld(s2+p+w); v[4]=smed_ld(s3+p);
+		vv[4]=median5_v(v);
+//grupa W3
+		v[0]=vv[0]; v[1]=smed_ld(s2+p-1); v[2]=smed_ld(s2+p);
+		v[3]=smed_ld(s2+p+1); v[4]=smed_ld(s3+p);
+		vv[5]=median5_v(v);
+//grupa W4
+		v[0]=vv[0]; v[1]=smed_ld(s2+p-w+1); v[2]=smed_ld(s2+p);
+		v[3]=smed_ld(s2+p+w-1); v[4]=smed_ld(s3+p);
+		vv[6]=median5_v(v);
+//max, min (of the whole words, like the scalar code)
+		vv[1]=smed_max32(smed_max32(vv[3],vv[4]),smed_max32(vv[5],vv[6]));
+		vv[2]=smed_min32(smed_min32(vv[3],vv[4]),smed_min32(vv[5],vv[6]));
+//izhod
+		smed_st(is+p,median3_v(vv));
+		}
+#endif
+	for (;j<w-1;j++)
+		{
+		p=i*w+j;
 //grupa C
-	mm[0]=s1[p];
+		mm[0]=s1[p];
 //GRUPA W1
-	m[0]=s1[p]; m[1]=s2[p-w-1]; m[2]=s2[p];
-	m[3]=s2[p+w+1]; m[4]=s3[p];
-	mm[3]=median5(m);
+		m[0]=s1[p]; m[1]=s2[p-w-1]; m[2]=s2[p];
+		m[3]=s2[p+w+1]; m[4]=s3[p];
+		mm[3]=median5(m);
 //grupa W2
-	m[0]=s1[p]; m[1]=s2[p-w]; m[2]=s2[p];
-	m[3]=s2[p+w]; m[4]=s3[p];
-	mm[4]=median5(m);
+		m[0]=s1[p]; m[1]=s2[p-w]; m[2]=s2[p];
+		m[3]=s2[p+w]; m[4]=s3[p];
+		mm[4]=median5(m);
 //grupa W3
-	m[0]=s1[p]; m[1]=s2[p-1]; m[2]=s2[p];
-	m[3]=s2[p+1]; m[4]=s3[p];
-	mm[5]=median5(m);
+		m[0]=s1[p]; m[1]=s2[p-1]; m[2]=s2[p];
+		m[3]=s2[p+1]; m[4]=s3[p];
+		mm[5]=median5(m);
 //grupa W4
-	m[0]=s1[p]; m[1]=s2[p-w+1]; m[2]=s2[p];
-	m[3]=s2[p+w-1]; m[4]=s3[p];
-	mm[6]=median5(m);
+		m[0]=s1[p]; m[1]=s2[p-w+1]; m[2]=s2[p];
+		m[3]=s2[p+w-1]; m[4]=s3[p];
+		mm[6]=median5(m);
 //max
-	mm[1]=mm[3]; if (mm[4]>mm[1]) mm[1]=mm[4];
-	if (mm[5]>mm[1]) mm[1]=mm[5];
-	if (mm[6]>mm[1]) mm[1]=mm[6];
+		mm[1]=mm[3]; if (mm[4]>mm[1]) mm[1]=mm[4];
+		if (mm[5]>mm[1]) mm[1]=mm[5];
+		if (mm[6]>mm[1]) mm[1]=mm[6];
 //min
-	mm[2]=mm[3]; if (mm[4]<mm[2]) mm[2]=mm[4];
-	if (mm[5]<mm[2]) mm[2]=mm[5];
-	if (mm[6]<mm[2]) mm[2]=mm[6];
+		mm[2]=mm[3]; if (mm[4]<mm[2]) mm[2]=mm[4];
+		if (mm[5]<mm[2]) mm[2]=mm[5];
+		if (mm[6]<mm[2]) mm[2]=mm[6];
 //izhod
-	is[p]=median3(mm);
+		is[p]=median3(mm);
+		}
 	}
 }
 
@@ -278,25 +557,51 @@ void ml3d(uint32_t *s1, uint32_t *s2, uint32_t *s3, int w, int h, uint32_t *is)
 {
 int i,j,p;
 uint32_t mm[8],m[16];
+#ifdef SMED_N
+smed_v vv[8],v[16];
+#endif
 
 for (i=1;i<h-1;i++)
-    for (j=1;j<w-1;j++)
 	{
-	p=i*w+j;
+	j=1;
+#ifdef SMED_N
+	for (;j+SMED_N<w;j+=SMED_N)
+		{
+		p=i*w+j;
+//grupa C
+		vv[0]=smed_ld(s1+p);
+//grupa W6
+		v[0]=vv[0]; v[1]=smed_ld(s2+p-w-1); v[2]=smed_ld(s2+p-w+1);
+		v[3]=smed_ld(s2+p); v[4]=smed_ld(s2+p+w-1); v[5]=smed_ld(s2+p+w+1);
+		v[6]=smed_ld(s3+p);
+		vv[1]=median7_v(v);
+//grupa W5
+		v[0]=vv[0]; v[1]=smed_ld(s2+p-w); v[2]=smed_ld(s2+p-1);
+		v[3]=smed_ld(s2+p); v[4]=smed_ld(s2+p+1); v[5]=smed_ld(s2+p+w);
+		v[6]=smed_ld(s3+p);
+		vv[2]=median7_v(v);
+//izhod = median medianov
+		smed_st(is+p,median3_v(vv));
+		}
+#endif
+	for (;j<w-1;j++)
+		{
+		p=i*w+j;
 //grupa C
-	mm[0]=s1[p];
+		mm[0]=s1[p];
 //grupa W6
-	m[0]=s1[p]; m[1]=s2[p-w-1]; m[2]=s2[p-w+1];
-	m[3]=s2[p]; m[4]=s2[p+w-1]; m[5]=s2[p+w+1];
-	m[6]=s3[p];
-	mm[1]=median7(m);
+		m[0]=s1[p]; m[1]=s2[p-w-1]; m[2]=s2[p-w+1];
+		m[3]=s2[p]; m[4]=s2[p+w-1]; m[5]=s2[p+w+1];
+		m[6]=s3[p];
+		mm[1]=median7(m);
 //grupa W5
-	m[0]=s1[p]; m[1]=s2[p-w]; m[2]=s2[p-1];
-	m[3]=s2[p]; m[4]=s2[p+1]; m[5]=s2[p+w];
-	m[6]=s3[p];
-	mm[2]=median7(m);
+		m[0]=s1[p]; m[1]=s2[p-w]; m[2]=s2[p-1];
+		m[3]=s2[p]; m[4]=s2[p+1]; m[5]=s2[p+w];
+		m[6]=s3[p];
+		mm[2]=median7(m);
 //izhod = median medianov
-	is[p]=median3(mm);
+		is[p]=median3(mm);
+		}
 	}
 }
 
@@ -308,43 +613,85 @@ void ml3dex(uint32_t *s1, uint32_t *s2, uint32_t *s3, int w, int h, uint32_t *is
 {
 int i,j,p;
 uint32_t mm[8],m[16];
+#ifdef SMED_N
+smed_v vv[8],v[16];
+#endif
 
 for (i=1;i<h-1;i++)
-    for (j=1;j<w-1;j++)
 	{
-	p=i*w+j;
+	j=1;
+#ifdef SMED_N
+	for (;j+SMED_N<w;j+=SMED_N)
+		{
+		p=i*w+j;
 //grupa W9
-	m[0]=s1[p-w-1]; m[1]=s1[p-w+1]; m[2]=s1[p];
-	m[3]=s1[p+w-1]; m[4]=s1[p+w+1]; m[5]=s2[p];
-	m[6]=s3[p-w-1]; m[7]=s3[p-w+1]; m[8]=s3[p];
-	m[9]=s3[p+w-1]; m[10]=s3[p+w+1];
-	mm[0]=median11(m);
+		v[0]=smed_ld(s1+p-w-1); v[1]=smed_ld(s1+p-w+1); v[2]=smed_ld(s1+p);
+		v[3]=smed_ld(s1+p+w-1); v[4]=smed_ld(s1+p+w+1); v[5]=smed_ld(s2+p);
+		v[6]=smed_ld(s3+p-w-1); v[7]=smed_ld(s3+p-w+1); v[8]=smed_ld(s3+p);
+		v[9]=smed_ld(s3+p+w-1); v[10]=smed_ld(s3+p+w+1);
+		vv[0]=median11_v(v);
 //grupa W8
-	m[0]=s1[p-w]; m[1]=s1[p-1]; m[2]=s1[p];
-	m[3]=s1[p+w]; m[4]=s1[p+1]; m[5]=s2[p];
-	m[6]=s3[p-w]; m[7]=s3[p-1]; m[8]=s3[p];
-	m[9]=s3[p+w]; m[10]=s3[p+1];
-	mm[1]=median11(m);
+		v[0]=smed_ld(s1+p-w); v[1]=smed_ld(s1+p-1); v[2]=smed_ld(s1+p);
+		v[3]=smed_ld(s1+p+w); v[4]=smed_ld(s1+p+1); v[5]=smed_ld(s2+p);
+		v[6]=smed_ld(s3+p-w); v[7]=smed_ld(s3+p-1); v[8]=smed_ld(s3+p);
+		v[9]=smed_ld(s3+p+w); v[10]=smed_ld(s3+p+1);
+		vv[1]=median11_v(v);
 //grupa W7
-	m[0]=s1[p]; m[1]=s2[p]; m[2]=s3[p];
-	mm[2]=median3(m);
+		v[0]=smed_ld(s1+p); v[1]=smed_ld(s2+p); v[2]=smed_ld(s3+p);
+		vv[2]=median3_v(v);
 //grupa W6
-	m[0]=s1[p]; m[1]=s2[p-w-1]; m[2]=s2[p-w+1];
-	m[3]=s2[p]; m[4]=s2[p+w-1]; m[5]=s2[p+w+1];
-	m[6]=s3[p];
-	mm[3]=median7(m);
+		v[0]=smed_ld(s1+p); v[1]=smed_ld(s2+p-w-1); v[2]=smed_ld(s2+p-w+1);
+		v[3]=smed_ld(s2+p); v[4]=smed_ld(s2+p+w-1); v[5]=smed_ld(s2+p+w+1);
+		v[6]=smed_ld(s3+p);
+		vv[3]=median7_v(v);
 //grupa W5
-	m[0]=s1[p]; m[1]=s2[p-w]; m[2]=s2[p-1];
-	m[3]=s2[p]; m[4]=s2[p+1]; m[5]=s2[p+w];
-	m[6]=s3[p];
-	mm[4]=median7(m);
+		v[0]=smed_ld(s1+p); v[1]=smed_ld(s2+p-w); v[2]=smed_ld(s2+p-1);
+		v[3]=smed_ld(s2+p); v[4]=smed_ld(s2+p+1); v[5]=smed_ld(s2+p+w);
+		v[6]=smed_ld(s3+p);
+		vv[4]=median7_v(v);
 //izhod = median medianov
-	is[p]=median5(mm);
+		smed_st(is+p,median5_v(vv));
+		}
+#endif
+	for (;j<w-1;j++)
+		{
+		p=i*w+j;
+//grupa W9
+		m[0]=s1[p-w-1]; m[1]=s1[p-w+1]; m[2]=s1[p];
+		m[3]=s1[p+w-1]; m[4]=s1[p+w+1]; m[5]=s2[p];
+		m[6]=s3[p-w-1]; m[7]=s3[p-w+1]; m[8]=s3[p];
+		m[9]=s3[p+w-1]; m[10]=s3[p+w+1];
+		mm[0]=median11(m);
+//grupa W8
+		m[0]=s1[p-w]; m[1]=s1[p-1]; m[2]=s1[p];
+		m[3]=s1[p+w]; m[4]=s1[p+1]; m[5]=s2[p];
+		m[6]=s3[p-w]; m[7]=s3[p-1]; m[8]=s3[p];
+		m[9]=s3[p+w]; m[10]=s3[p+1];
+		mm[1]=median11(m);
+//grupa W7
+		m[0]=s1[p]; m[1]=s2[p]; m[2]=s3[p];
+		mm[2]=median3(m);
+//grupa W6
+		m[0]=s1[p]; m[1]=s2[p-w-1]; m[2]=s2[p-w+1];
+		m[3]=s2[p]; m[4]=s2[p+w-1]; m[5]=s2[p+w+1];
+		m[6]=s3[p];
+		mm[3]=median7(m);
+//grupa W5
+		m[0]=s1[p]; m[1]=s2[p-w]; m[2]=s2[p-1];
+		m[3]=s2[p]; m[4]=s2[p+1]; m[5]=s2[p+w];
+		m[6]=s3[p];
+		mm[4]=median7(m);
+//izhod = median medianov
+		is[p]=median5(mm);
+		}
 	}
 }
 
 //****************************************************
 
+//smallest 'var size' that drafts filter at half size
+#define MEDIANS_DRAFT_SIZE 4
+
 //----------------------------------------
 //struktura za instanco efekta
 typedef struct
@@ -355,17 +702,29 @@ int w;
 //parameters
 int type;
 int size;
+int quality;	//F0R_QUALITY_*, see varsize_draft
+frei0r_deadline_t deadline;	//see f0r_set_deadline
 
 //internal variables
 uint32_t *ppf,*pf,*cf,*nf,*nnf;
 
-//image buffers
+//image buffers, allocated by the first update so that the thread
+//that renders the instance touches them first
 uint32_t *f1;
 uint32_t *f2;
 uint32_t *f3;
 uint32_t *f4;
 uint32_t *f5;
 
+//ring of the last frames for TempN, allocated for tempn_n frames;
+//the next one goes to tempn_pos
+uint32_t *tempn_ring;
+int tempn_n;
+int tempn_count;
+int tempn_pos;
+
+//scratch memory for the histograms of VarSize
+frei0r_arena_t arena;
 
 char *liststr;
 } inst;
@@ -391,6 +750,7 @@ return (v-min)/(max-min);
 //-----------------------------------------------
 int f0r_init()
 {
+ctmf_init();
 return 1;
 }
 
@@ -414,6 +774,12 @@ info->num_params=2;
 info->explanation="Implements several median-type filters";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -422,12 +788,12 @@ switch(param_index)
 	case 0:
 		info->name = "Type";
 		info->type = F0R_PARAM_STRING;
-		info->explanation = "Choose type of median: Cross5, Square3x3, Bilevel, Diamond3x3, Square5x5, Temp3, Temp5, ArceBI, ML3D, ML3dEX, VarSize";
+		info->explanation = "Choose type of median: Cross5, Square3x3, Bilevel, Diamond3x3, Square5x5, Temp3, Temp5, ArceBI, ML3D, ML3dEX, VarSize, TempN";
 		break;
 	case 1:
 		info->name = "Size";
 		info->type = F0R_PARAM_DOUBLE;
-		info->explanation = "Size for 'var size' type filter";
+		info->explanation = "Size for 'var size' type filter, number of frames for 'TempN'";
 		break;
 	case 2:
 		info->name = "";
@@ -450,18 +816,10 @@ in->type=1;
 in->liststr=calloc(1,strlen("Square3x3")+1);
 strcpy(in->liststr,"Square3x3");
 in->size=5;
+in->quality=F0R_QUALITY_NORMAL;
+frei0r_deadline_init(&in->deadline);
 
-in->f1=calloc(in->w*in->h,sizeof(uint32_t));
-in->f2=calloc(in->w*in->h,sizeof(uint32_t));
-in->f3=calloc(in->w*in->h,sizeof(uint32_t));
-in->f4=calloc(in->w*in->h,sizeof(uint32_t));
-in->f5=calloc(in->w*in->h,sizeof(uint32_t));
-
-in->ppf=in->f1;
-in->pf=in->f2;
-in->cf=in->f3;
-in->nf=in->f4;
-in->nnf=in->f5;
+frei0r_arena_init(&in->arena);
 
 return (f0r_instance_t)in;
 }
@@ -478,7 +836,9 @@ free(in->f2);
 free(in->f3);
 free(in->f4);
 free(in->f5);
+free(in->tempn_ring);
 
+frei0r_arena_release(&in->arena);
 free(in->liststr);
 free(instance);
 }
@@ -490,7 +850,7 @@ inst *p;
 double tmpf;
 int chg;
 char *tmpch;
-char list1[][11]={"Cross5", "Square3x3", "Bilevel", "Diamond3x3", "Square5x5", "Temp3", "Temp5", "ArceBI", "ML3D", "ML3dEX", "VarSize"};
+char list1[][11]={"Cross5", "Square3x3", "Bilevel", "Diamond3x3", "Square5x5", "Temp3", "Temp5", "ArceBI", "ML3D", "ML3dEX", "VarSize", "TempN"};
 
 p=(inst*)instance;
 
@@ -502,7 +862,8 @@ switch(param_index)
 		p->liststr = (char*)realloc( p->liststr, strlen(tmpch) + 1 );
 		strcpy( p->liststr, tmpch );
 		p->type=0;
-		while ((strcmp(p->liststr,list1[p->type])!=0)&&(p->type<10)) p->type++;
+		while ((strcmp(p->liststr,list1[p->type])!=0)&&(p->type<12)) p->type++;
+		if (p->type==12) p->type=10;	//unknown names stay VarSize
 		break;
 	case 1:
                 tmpf=map_value_forward(*((double*)parm), 0.0, 50); 
@@ -533,6 +894,65 @@ switch(param_index)
 	}
 }
 
+//-------------------------------------------------
+//Drafts of 'var size' filter every second pixel of every second row
+//with half the radius, which takes about a quarter of the time, and
+//spread the result over 2x2 pixels. The arena has been reset.
+static int varsize_draft(inst *in, const uint32_t *inframe, uint32_t *outframe)
+{
+int hw=(in->w+1)/2,hh=(in->h+1)/2;
+int x,y;
+uint32_t *half,*med;
+
+half=(uint32_t*)frei0r_arena_alloc(&in->arena,hw*hh*sizeof(uint32_t));
+med=(uint32_t*)frei0r_arena_alloc(&in->arena,hw*hh*sizeof(uint32_t));
+if (!half || !med)
+	return 0;
+for (y=0;y<hh;y++)
+	for (x=0;x<hw;x++)
+		half[y*hw+x]=inframe[2*y*in->w+2*x];
+ctmf((uint8_t*)half,(uint8_t*)med,hw,hh,hw*4,hw*4,in->size/2,3,4,512*1024,&in->arena);
+for (y=0;y<in->h;y++)
+	for (x=0;x<in->w;x++)
+		outframe[y*in->w+x]=med[(y/2)*hw+x/2];
+return 1;
+}
+
+//-------------------------------------------------
+//Temporal median over the last size frames (odd, 3 to TEMPN_MAX),
+//fewer while the ring fills after a start or a size change
+static void tempn_update(inst *in, const uint32_t *inframe, uint32_t *outframe)
+{
+const uint32_t *fr[TEMPN_MAX];
+long np=(long)in->w*in->h;
+int n,i;
+
+n=in->size|1;
+if (n<3) n=3;
+if (n>TEMPN_MAX) n=TEMPN_MAX;
+if (n!=in->tempn_n)
+	{
+	free(in->tempn_ring);
+	in->tempn_ring=malloc(n*np*sizeof(uint32_t));
+	in->tempn_n=in->tempn_ring ? n : 0;
+	in->tempn_count=0;
+	in->tempn_pos=0;
+	}
+if (!in->tempn_ring)
+	{
+	memcpy(outframe,inframe,np*sizeof(uint32_t));
+	return;
+	}
+
+memcpy(in->tempn_ring+in->tempn_pos*np,inframe,np*sizeof(uint32_t));
+in->tempn_pos=(in->tempn_pos+1)%n;
+if (in->tempn_count<n) in->tempn_count++;
+
+for (i=0;i<in->tempn_count;i++)
+	fr[i]=in->tempn_ring+i*np;
+tempn(fr,in->tempn_count,in->w,in->h,outframe);
+}
+
 //-------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
@@ -544,6 +964,23 @@ uint32_t *tmpp;
 uint8_t *cin,*cout;
 int step,i;
 
+if (frei0r_deadline_begin(&in->deadline))
+	in->quality=in->deadline.current;
+
+if (!in->f1)
+	{
+	in->f1=calloc(in->w*in->h,sizeof(uint32_t));
+	in->f2=calloc(in->w*in->h,sizeof(uint32_t));
+	in->f3=calloc(in->w*in->h,sizeof(uint32_t));
+	in->f4=calloc(in->w*in->h,sizeof(uint32_t));
+	in->f5=calloc(in->w*in->h,sizeof(uint32_t));
+	in->ppf=in->f1;
+	in->pf=in->f2;
+	in->cf=in->f3;
+	in->nf=in->f4;
+	in->nnf=in->f5;
+	}
+
 memcpy(in->ppf, inframe, 4*in->w*in->h);
 tmpp=in->nnf;
 in->nnf=in->ppf;
@@ -590,14 +1027,138 @@ switch (in->type)
 	case 10:
 		//varsize
 		step=in->w*4;
-		ctmf(cin,cout,in->w,in->h,step,step,in->size,4,512*1024);
+		frei0r_arena_reset(&in->arena);
+		if ((in->quality!=F0R_QUALITY_DRAFT)||(in->size<MEDIANS_DRAFT_SIZE)
+			|| !varsize_draft(in,inframe,outframe))
+			ctmf(cin,cout,in->w,in->h,step,step,in->size,3,4,512*1024,&in->arena);
+		break;
+	case 11:
+		tempn_update(in, inframe, outframe);
 		break;
 	default:
 		break;
 	}
+//the ring starts over when TempN is selected again
+if (in->type!=11)
+	{
+	in->tempn_count=0;
+	in->tempn_pos=0;
+	}
+
 //COPY ALPHA
 for (i = 3; i < 4 * in->w * in->h; i += 4)
 	cout[i]=cin[i];
 
+frei0r_deadline_end(&in->deadline);
+}
+
+//-------------------------------------------------
+void f0r_set_allocator(f0r_instance_t instance, const f0r_allocator_t* allocator)
+{
+assert(instance);
+frei0r_arena_set_allocator(&((inst*)instance)->arena, allocator);
+}
+
+//-------------------------------------------------
+//the next update allocates the frames again and starts over
+int f0r_trim(f0r_instance_t instance)
+{
+inst *in;
+int had;
+
+assert(instance);
+in=(inst*)instance;
+had=(in->f1!=NULL)||(in->tempn_ring!=NULL);
+
+free(in->f1);
+free(in->f2);
+free(in->f3);
+free(in->f4);
+free(in->f5);
+in->f1=in->f2=in->f3=in->f4=in->f5=NULL;
+free(in->tempn_ring);
+in->tempn_ring=NULL;
+in->tempn_n=0;
+
+frei0r_arena_release(&in->arena);
+return had;
+}
+
+//-------------------------------------------------
+//every update copies its frame to the five frames, the temporal types
+//read three or five of them, TempN its ring and VarSize the arena
+int f0r_get_memory_usage(f0r_instance_t instance, f0r_memory_usage_t* usage)
+{
+inst *in;
+size_t fr;
+int n;
+
+assert(instance);
+in=(inst*)instance;
+fr=(size_t)in->w*in->h*sizeof(uint32_t);
+usage->resident=(in->f1 ? 5*fr : 0)+in->tempn_n*fr+frei0r_arena_bytes(&in->arena);
+usage->touched=3*fr;
+switch (in->type)
+	{
+	case 5: case 7: case 8: case 9:
+		usage->touched+=3*fr;
+		break;
+	case 6:
+		usage->touched+=5*fr;
+		break;
+	case 10:
+		usage->touched+=frei0r_arena_bytes(&in->arena);
+		break;
+	case 11:
+		n=in->size|1;
+		if (n<3) n=3;
+		if (n>TEMPN_MAX) n=TEMPN_MAX;
+		usage->touched+=n*fr;
+		break;
+	default:
+		break;
+	}
+return 1;
+}
+
+//-------------------------------------------------
+//the frames are of the old size, they go like with f0r_trim
+int f0r_resize(f0r_instance_t instance, unsigned int width, unsigned int height)
+{
+inst *in;
+
+assert(instance);
+in=(inst*)instance;
+f0r_trim(instance);
+in->w=width;
+in->h=height;
+return 1;
 }
 
+//-------------------------------------------------
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+inst *in;
+
+assert(instance);
+in=(inst*)instance;
+frei0r_deadline_request(&in->deadline, quality);
+in->quality=in->deadline.current;
+return 1;
+}
+
+//-------------------------------------------------
+//only the large VarSize radii get faster in drafts
+int f0r_set_deadline(f0r_instance_t instance, double seconds)
+{
+assert(instance);
+frei0r_deadline_set(&((inst*)instance)->deadline, seconds);
+return 1;
+}
+
+//-------------------------------------------------
+int f0r_get_quality(f0r_instance_t instance)
+{
+assert(instance);
+return ((inst*)instance)->deadline.current;
+}
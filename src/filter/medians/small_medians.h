@@ -1,4 +1,3 @@
- 
 //----------------------------------------------------------
 typedef uint8_t pixelvalue;
 #define P_SO(a,b) { if ((a)>(b)) P_SWAP((a),(b)); }
@@ -6,6 +5,78 @@ typedef uint8_t pixelvalue;
 #define P_MA(a,b) { if ((a)>(b)) (b)=(a); }
 #define P_MI(a,b) { if ((a)>(b)) (a)=(b); }
 
+//------------------------------------------------------------
+//The sorting networks, as lists of compare-exchange steps on
+//element indices:
+//SO(a,b) sorts a,b   MA(a,b) b=max(a,b)   MI(a,b) a=min(a,b)
+//The scalar medianN() and the vector medianN_v() below are
+//both generated from them.
+
+//median of 3, the result is element 1
+#define MEDIAN3_NET(SO,MA,MI) \
+  SO(0,1) MI(1,2) MA(0,1)
+
+//median of 5, the result is element 2
+#define MEDIAN5_NET(SO,MA,MI) \
+  SO(0,1) SO(3,4) MI(1,4) MA(0,3) SO(1,2) MI(2,3) \
+  MA(1,2)
+
+//median of 7, the result is element 3
+#define MEDIAN7_NET(SO,MA,MI) \
+  SO(0,5) SO(2,4) SO(0,3) SO(1,6) SO(3,5) MA(0,1) \
+  SO(2,6) MA(2,3) MI(4,5) MI(3,6) SO(1,4) MA(1,3) \
+  MI(3,4)
+
+//median of 9, the result is element 4
+#define MEDIAN9_NET(SO,MA,MI) \
+  SO(1,2) SO(4,5) SO(7,8) SO(0,1) SO(3,4) SO(6,7) \
+  SO(1,2) SO(4,5) SO(7,8) MA(0,3) MI(5,8) SO(4,7) \
+  MA(3,6) MA(1,4) MI(2,5) MI(4,7) SO(4,2) MA(6,4) \
+  MI(4,2)
+
+//median of 11, the result is element 5
+#define MEDIAN11_NET(SO,MA,MI) \
+  SO(3,7) SO(0,10) SO(7,10) SO(4,9) SO(0,3) SO(8,3) \
+  SO(1,6) SO(3,9) SO(5,6) MI(6,10) SO(2,6) SO(1,5) \
+  MA(0,1) SO(8,4) SO(4,1) MA(4,8) MI(6,1) MI(5,9) \
+  MA(2,8) SO(8,3) SO(7,5) MI(5,3) MA(7,8) SO(8,6) \
+  MA(8,5) MI(5,6)
+
+//median of 13, the result is element 6
+#define MEDIAN13_NET(SO,MA,MI) \
+  SO(10,3) SO(6,10) SO(11,1) SO(5,4) SO(0,8) SO(1,3) \
+  SO(5,0) SO(7,1) SO(8,10) SO(8,12) SO(4,12) SO(3,12) \
+  SO(7,11) SO(9,2) SO(0,2) SO(4,1) SO(11,0) SO(4,9) \
+  MA(7,5) MI(2,1) MA(4,6) SO(5,9) SO(9,0) MI(3,0) \
+  MA(5,6) SO(2,3) MA(11,6) SO(9,2) MA(8,9) MI(10,2) \
+  SO(9,10) MA(9,6) MI(10,3) MI(6,10)
+
+//median of 25, the result is element 12
+#define MEDIAN25_NET(SO,MA,MI) \
+  SO(0,1) SO(3,4) SO(2,4) SO(2,3) SO(6,7) SO(5,7) \
+  SO(5,6) SO(9,10) SO(8,10) SO(8,9) SO(12,13) SO(11,13) \
+  SO(11,12) SO(15,16) SO(14,16) SO(14,15) SO(18,19) SO(17,19) \
+  SO(17,18) SO(21,22) SO(20,22) SO(20,21) SO(23,24) SO(2,5) \
+  SO(3,6) SO(0,6) SO(0,3) SO(4,7) SO(1,7) SO(1,4) \
+  SO(11,14) SO(8,14) SO(8,11) SO(12,15) SO(9,15) SO(9,12) \
+  SO(13,16) SO(10,16) SO(10,13) SO(20,23) SO(17,23) SO(17,20) \
+  SO(21,24) SO(18,24) SO(18,21) SO(19,22) MA(8,17) SO(9,18) \
+  SO(0,18) MA(0,9) SO(10,19) SO(1,19) SO(1,10) SO(11,20) \
+  SO(2,20) MA(2,11) SO(12,21) SO(3,21) SO(3,12) SO(13,22) \
+  MI(4,22) SO(4,13) SO(14,23) SO(5,23) SO(5,14) SO(15,24) \
+  MI(6,24) SO(6,15) MI(7,16) MI(7,19) MI(13,21) MI(15,23) \
+  MI(7,13) MI(7,15) MA(1,9) MA(3,11) MA(5,17) MA(11,17) \
+  MA(9,17) SO(4,10) SO(6,12) SO(7,14) SO(4,6) MA(4,7) \
+  SO(12,14) MI(10,14) SO(6,7) SO(10,12) SO(6,10) MA(6,17) \
+  SO(12,17) MI(7,17) SO(7,10) SO(12,18) MA(7,12) MI(10,18) \
+  SO(12,20) MI(10,20) MA(10,12)
+
+//------------------------------------------------------------
+//one network step on the R,G,B bytes of packed pixels
+#define P_SO3(a,b) { P_SO(m[4*(a)],m[4*(b)]); P_SO(m[4*(a)+1],m[4*(b)+1]); P_SO(m[4*(a)+2],m[4*(b)+2]); }
+#define P_MA3(a,b) { P_MA(m[4*(a)],m[4*(b)]); P_MA(m[4*(a)+1],m[4*(b)+1]); P_MA(m[4*(a)+2],m[4*(b)+2]); }
+#define P_MI3(a,b) { P_MI(m[4*(a)],m[4*(b)]); P_MI(m[4*(a)+1],m[4*(b)+1]); P_MI(m[4*(a)+2],m[4*(b)+2]); }
+
 //------------------------------------------------------------
 //packed char RGB image (uint32_t)
 //does separate medians on R,G,B
@@ -13,10 +84,7 @@ typedef uint8_t pixelvalue;
 static inline uint32_t median3(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-P_SO(m[0],m[4]); P_SO(m[1],m[5]); P_SO(m[2],m[6]);
-P_MI(m[4],m[8]); P_MI(m[5],m[9]); P_MI(m[6],m[10]);
-P_MA(m[0],m[4]); P_MA(m[1],m[5]); P_MA(m[2],m[6]);
+MEDIAN3_NET(P_SO3,P_MA3,P_MI3)
 return mm[1];
 }
 
@@ -27,14 +95,7 @@ return mm[1];
 static inline uint32_t median5(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-P_SO(m[0],m[4]);   P_SO(m[1],m[5]);   P_SO(m[2],m[6]);
-P_SO(m[12],m[16]); P_SO(m[13],m[17]); P_SO(m[14],m[18]);
-P_MI(m[4],m[16]);  P_MI(m[5],m[17]);  P_MI(m[6],m[18]);
-P_MA(m[0],m[12]);  P_MA(m[1],m[13]);  P_MA(m[2],m[14]);
-P_SO(m[4],m[8]);   P_SO(m[5],m[9]);   P_SO(m[6],m[10]);
-P_MI(m[8],m[12]);  P_MI(m[9],m[13]);  P_MI(m[10],m[14]);
-P_MA(m[4],m[8]);   P_MA(m[5],m[9]);   P_MA(m[6],m[10]);
+MEDIAN5_NET(P_SO3,P_MA3,P_MI3)
 return mm[2];
 }
 
@@ -45,20 +106,7 @@ return mm[2];
 static inline uint32_t median7(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-P_SO(m[0],m[20]);  P_SO(m[1],m[21]);  P_SO(m[2],m[22]);
-P_SO(m[8],m[16]);  P_SO(m[9],m[17]);  P_SO(m[10],m[18]);
-P_SO(m[0],m[12]);  P_SO(m[1],m[13]);  P_SO(m[2],m[14]);
-P_SO(m[4],m[24]);  P_SO(m[5],m[25]);  P_SO(m[6],m[26]);
-P_SO(m[12],m[20]); P_SO(m[13],m[21]); P_SO(m[14],m[22]);
-P_MA(m[0],m[4]);   P_MA(m[1],m[5]);   P_MA(m[2],m[6]);
-P_SO(m[8],m[24]);  P_SO(m[9],m[25]);  P_SO(m[10],m[26]);
-P_MA(m[8],m[12]);  P_MA(m[9],m[13]);  P_MA(m[10],m[14]);
-P_MI(m[16],m[20]); P_MI(m[17],m[21]); P_MI(m[18],m[22]);
-P_MI(m[12],m[24]); P_MI(m[13],m[25]); P_MI(m[14],m[26]);
-P_SO(m[4],m[16]);  P_SO(m[5],m[17]);  P_SO(m[6],m[18]);
-P_MA(m[4],m[12]);  P_MA(m[5],m[13]);  P_MA(m[6],m[14]);
-P_MI(m[12],m[16]); P_MI(m[13],m[17]); P_MI(m[14],m[18]);
+MEDIAN7_NET(P_SO3,P_MA3,P_MI3)
 return mm[3];
 }
 
@@ -69,27 +117,8 @@ return mm[3];
 static inline uint32_t median9(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-P_SO(m[4],m[8]);   P_SO(m[5],m[9]);   P_SO(m[6],m[10]);
-P_SO(m[16],m[20]); P_SO(m[17],m[21]); P_SO(m[18],m[22]);
-P_SO(m[28],m[32]); P_SO(m[29],m[33]); P_SO(m[30],m[34]);
-P_SO(m[0],m[4]);   P_SO(m[1],m[5]);   P_SO(m[2],m[6]);
-P_SO(m[12],m[16]); P_SO(m[13],m[17]); P_SO(m[14],m[18]);
-P_SO(m[24],m[28]); P_SO(m[25],m[29]); P_SO(m[26],m[30]);
-P_SO(m[4],m[8]);   P_SO(m[5],m[9]);   P_SO(m[6],m[10]);
-P_SO(m[16],m[20]); P_SO(m[17],m[21]); P_SO(m[18],m[22]);
-P_SO(m[28],m[32]); P_SO(m[29],m[33]); P_SO(m[30],m[34]);
-P_MA(m[0],m[12]);  P_MA(m[1],m[13]);  P_MA(m[2],m[14]);
-P_MI(m[20],m[32]); P_MI(m[21],m[33]); P_MI(m[22],m[34]);
-P_SO(m[16],m[28]); P_SO(m[17],m[29]); P_SO(m[18],m[30]);
-P_MA(m[12],m[24]); P_MA(m[13],m[25]); P_MA(m[14],m[26]);
-P_MA(m[4],m[16]);  P_MA(m[5],m[17]);  P_MA(m[6],m[18]);
-P_MI(m[8],m[20]);  P_MI(m[9],m[21]);  P_MI(m[10],m[22]);
-P_MI(m[16],m[28]); P_MI(m[17],m[29]); P_MI(m[18],m[30]);
-P_SO(m[16],m[8]);  P_SO(m[17],m[9]);  P_SO(m[18],m[10]);
-P_MA(m[24],m[16]); P_MA(m[25],m[17]); P_MA(m[26],m[18]);
-P_MI(m[16],m[8]);  P_MI(m[17],m[9]);  P_MI(m[18],m[10]);
-return(mm[4]);
+MEDIAN9_NET(P_SO3,P_MA3,P_MI3)
+return mm[4];
 }
 
 //------------------------------------------------------------
@@ -99,33 +128,7 @@ return(mm[4]);
 static inline uint32_t median11(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-P_SO(m[12],m[28]); P_SO(m[13],m[29]); P_SO(m[14],m[30]);
-P_SO(m[0],m[40]);  P_SO(m[1],m[41]);  P_SO(m[2],m[42]);
-P_SO(m[28],m[40]); P_SO(m[29],m[41]); P_SO(m[30],m[42]);
-P_SO(m[16],m[36]); P_SO(m[17],m[37]); P_SO(m[18],m[38]);
-P_SO(m[0],m[12]);  P_SO(m[1],m[13]);  P_SO(m[2],m[14]);
-P_SO(m[32],m[12]); P_SO(m[33],m[13]); P_SO(m[34],m[14]);
-P_SO(m[4],m[24]);  P_SO(m[5],m[25]);  P_SO(m[6],m[26]);
-P_SO(m[12],m[36]); P_SO(m[13],m[37]); P_SO(m[14],m[38]);
-P_SO(m[20],m[24]); P_SO(m[21],m[25]); P_SO(m[22],m[26]);
-P_MI(m[24],m[40]); P_MI(m[25],m[41]); P_MI(m[26],m[42]);
-P_SO(m[8],m[24]);  P_SO(m[9],m[25]);  P_SO(m[10],m[26]);
-P_SO(m[4],m[20]);  P_SO(m[5],m[21]);  P_SO(m[6],m[22]);
-P_MA(m[0],m[4]);   P_MA(m[1],m[5]);   P_MA(m[2],m[6]);
-P_SO(m[32],m[16]); P_SO(m[33],m[17]); P_SO(m[34],m[18]);
-P_SO(m[16],m[4]);  P_SO(m[17],m[5]);  P_SO(m[18],m[6]);
-P_MA(m[16],m[32]); P_MA(m[17],m[33]); P_MA(m[18],m[34]);
-P_MI(m[24],m[4]);  P_MI(m[25],m[5]);  P_MI(m[26],m[6]);
-P_MI(m[20],m[36]); P_MI(m[21],m[37]); P_MI(m[22],m[38]);
-P_MA(m[8],m[32]);  P_MA(m[9],m[33]);  P_MA(m[10],m[34]);
-P_SO(m[32],m[12]); P_SO(m[33],m[13]); P_SO(m[34],m[14]);
-P_SO(m[28],m[20]); P_SO(m[29],m[21]); P_SO(m[30],m[22]);
-P_MI(m[20],m[12]); P_MI(m[21],m[13]); P_MI(m[22],m[14]);
-P_MA(m[28],m[32]); P_MA(m[29],m[33]); P_MA(m[30],m[34]);
-P_SO(m[32],m[24]); P_SO(m[33],m[25]); P_SO(m[34],m[26]);
-P_MA(m[32],m[20]); P_MA(m[33],m[21]); P_MA(m[34],m[22]);
-P_MI(m[20],m[24]); P_MI(m[21],m[25]); P_MI(m[22],m[26]);
+MEDIAN11_NET(P_SO3,P_MA3,P_MI3)
 return mm[5];
 }
 
@@ -136,41 +139,7 @@ return mm[5];
 static inline uint32_t median13(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-    P_SO(m[40],m[12]); P_SO(m[41],m[13]); P_SO(m[42],m[14]);
-    P_SO(m[24],m[40]); P_SO(m[25],m[41]); P_SO(m[26],m[42]);
-    P_SO(m[44],m[4]);  P_SO(m[45],m[5]);  P_SO(m[46],m[6]);
-    P_SO(m[20],m[16]); P_SO(m[21],m[17]); P_SO(m[22],m[18]);
-    P_SO(m[0],m[32]);  P_SO(m[1],m[33]);  P_SO(m[2],m[34]);
-    P_SO(m[4],m[12]);  P_SO(m[5],m[13]);  P_SO(m[6],m[14]);
-    P_SO(m[20],m[0]);  P_SO(m[21],m[1]);  P_SO(m[22],m[2]);
-    P_SO(m[28],m[4]);  P_SO(m[29],m[5]);  P_SO(m[30],m[6]);
-    P_SO(m[32],m[40]); P_SO(m[33],m[41]); P_SO(m[34],m[42]);
-    P_SO(m[32],m[48]); P_SO(m[33],m[49]); P_SO(m[34],m[50]);
-    P_SO(m[16],m[48]); P_SO(m[17],m[49]); P_SO(m[18],m[50]);
-    P_SO(m[12],m[48]); P_SO(m[13],m[49]); P_SO(m[14],m[50]);
-    P_SO(m[28],m[44]); P_SO(m[29],m[45]); P_SO(m[30],m[46]);
-    P_SO(m[36],m[8]);  P_SO(m[37],m[9]);  P_SO(m[38],m[10]);
-    P_SO(m[0],m[8]);   P_SO(m[1],m[9]);   P_SO(m[2],m[10]);
-    P_SO(m[16],m[4]);  P_SO(m[17],m[5]);  P_SO(m[18],m[6]);
-    P_SO(m[44],m[0]);  P_SO(m[45],m[1]);  P_SO(m[46],m[2]);
-    P_SO(m[16],m[36]); P_SO(m[17],m[37]); P_SO(m[18],m[38]);
-    P_MA(m[28],m[20]); P_MA(m[29],m[21]); P_MA(m[30],m[22]);
-    P_MI(m[8],m[4]);   P_MI(m[9],m[5]);   P_MI(m[10],m[6]);
-    P_MA(m[16],m[24]); P_MA(m[17],m[25]); P_MA(m[18],m[26]);
-    P_SO(m[20],m[36]); P_SO(m[21],m[37]); P_SO(m[22],m[38]);
-    P_SO(m[36],m[0]);  P_SO(m[37],m[1]);  P_SO(m[38],m[2]);
-    P_MI(m[12],m[0]);  P_MI(m[13],m[1]);  P_MI(m[14],m[2]);
-    P_MA(m[20],m[24]); P_MA(m[21],m[25]); P_MA(m[22],m[26]);
-    P_SO(m[8],m[12]);  P_SO(m[9],m[13]);  P_SO(m[10],m[14]);
-    P_MA(m[44],m[24]); P_MA(m[45],m[25]); P_MA(m[46],m[26]);
-    P_SO(m[36],m[8]);  P_SO(m[37],m[9]);  P_SO(m[38],m[10]);
-    P_MA(m[32],m[36]); P_MA(m[33],m[37]); P_MA(m[34],m[38]);
-    P_MI(m[40],m[8]);  P_MI(m[41],m[9]);  P_MI(m[42],m[10]);
-    P_SO(m[36],m[40]); P_SO(m[37],m[41]); P_SO(m[38],m[42]);
-    P_MA(m[36],m[24]); P_MA(m[37],m[25]); P_MA(m[38],m[26]);
-    P_MI(m[40],m[12]); P_MI(m[41],m[13]); P_MI(m[42],m[14]);
-    P_MI(m[24],m[40]); P_MI(m[25],m[41]); P_MI(m[26],m[42]);
+MEDIAN13_NET(P_SO3,P_MA3,P_MI3)
 return mm[6];
 }
 
@@ -181,112 +150,188 @@ return mm[6];
 static inline uint32_t median25(uint32_t *mm)
 {
 uint8_t *m=(uint8_t*)mm;
-//     -R-              -G-              -B-
-P_SO(m[0],m[4]);   P_SO(m[1],m[5]);   P_SO(m[2],m[6]);
-P_SO(m[12],m[16]); P_SO(m[13],m[17]); P_SO(m[14],m[18]);
-P_SO(m[8],m[16]);  P_SO(m[9],m[17]);  P_SO(m[10],m[18]);
-P_SO(m[8],m[12]);  P_SO(m[9],m[13]);  P_SO(m[10],m[14]);
-P_SO(m[24],m[28]); P_SO(m[25],m[29]); P_SO(m[26],m[30]);
-P_SO(m[20],m[28]); P_SO(m[21],m[29]); P_SO(m[22],m[30]);
-P_SO(m[20],m[24]); P_SO(m[21],m[25]); P_SO(m[22],m[26]);
-P_SO(m[36],m[40]); P_SO(m[37],m[41]); P_SO(m[38],m[42]);
-P_SO(m[32],m[40]); P_SO(m[33],m[41]); P_SO(m[34],m[42]);
-P_SO(m[32],m[36]); P_SO(m[33],m[37]); P_SO(m[34],m[38]);
-P_SO(m[48],m[52]); P_SO(m[49],m[53]); P_SO(m[50],m[54]);
-P_SO(m[44],m[52]); P_SO(m[45],m[53]); P_SO(m[46],m[54]);
-P_SO(m[44],m[48]); P_SO(m[45],m[49]); P_SO(m[46],m[50]);
-P_SO(m[60],m[64]); P_SO(m[61],m[65]); P_SO(m[62],m[66]);
-P_SO(m[56],m[64]); P_SO(m[57],m[65]); P_SO(m[58],m[66]);
-P_SO(m[56],m[60]); P_SO(m[57],m[61]); P_SO(m[58],m[62]);
-P_SO(m[72],m[76]); P_SO(m[73],m[77]); P_SO(m[74],m[78]);
-P_SO(m[68],m[76]); P_SO(m[69],m[77]); P_SO(m[70],m[78]);
-P_SO(m[68],m[72]); P_SO(m[69],m[73]); P_SO(m[70],m[74]);
-P_SO(m[84],m[88]); P_SO(m[85],m[89]); P_SO(m[86],m[90]);
-P_SO(m[80],m[88]); P_SO(m[81],m[89]); P_SO(m[82],m[90]);
-P_SO(m[80],m[84]); P_SO(m[81],m[85]); P_SO(m[82],m[86]);
-P_SO(m[92],m[96]); P_SO(m[93],m[97]); P_SO(m[94],m[98]);
-P_SO(m[8],m[20]);  P_SO(m[9],m[21]);  P_SO(m[10],m[22]);
-P_SO(m[12],m[24]); P_SO(m[13],m[25]); P_SO(m[14],m[26]);
-P_SO(m[0],m[24]);  P_SO(m[1],m[25]);  P_SO(m[2],m[26]);
-P_SO(m[0],m[12]);  P_SO(m[1],m[13]);  P_SO(m[2],m[14]);
-P_SO(m[16],m[28]); P_SO(m[17],m[29]); P_SO(m[18],m[30]);
-P_SO(m[4],m[28]);  P_SO(m[5],m[29]);  P_SO(m[6],m[30]);
-P_SO(m[4],m[16]);  P_SO(m[5],m[17]);  P_SO(m[6],m[18]);
-P_SO(m[44],m[56]); P_SO(m[45],m[57]); P_SO(m[46],m[58]);
-P_SO(m[32],m[56]); P_SO(m[33],m[57]); P_SO(m[34],m[58]);
-P_SO(m[32],m[44]); P_SO(m[33],m[45]); P_SO(m[34],m[46]);
-P_SO(m[48],m[60]); P_SO(m[49],m[61]); P_SO(m[50],m[62]);
-P_SO(m[36],m[60]); P_SO(m[37],m[61]); P_SO(m[38],m[62]);
-P_SO(m[36],m[48]); P_SO(m[37],m[49]); P_SO(m[38],m[50]);
-P_SO(m[52],m[64]); P_SO(m[53],m[65]); P_SO(m[54],m[66]);
-P_SO(m[40],m[64]); P_SO(m[41],m[65]); P_SO(m[42],m[66]);
-P_SO(m[40],m[52]); P_SO(m[41],m[53]); P_SO(m[42],m[54]);
-P_SO(m[80],m[92]); P_SO(m[81],m[93]); P_SO(m[82],m[94]);
-P_SO(m[68],m[92]); P_SO(m[69],m[93]); P_SO(m[70],m[94]);
-P_SO(m[68],m[80]); P_SO(m[69],m[81]); P_SO(m[70],m[82]);
-P_SO(m[84],m[96]); P_SO(m[85],m[97]); P_SO(m[86],m[98]);
-P_SO(m[72],m[96]); P_SO(m[73],m[97]); P_SO(m[74],m[98]);
-P_SO(m[72],m[84]); P_SO(m[73],m[85]); P_SO(m[74],m[86]);
-P_SO(m[76],m[88]); P_SO(m[77],m[89]); P_SO(m[78],m[90]);
-P_MA(m[32],m[68]); P_MA(m[33],m[69]); P_MA(m[34],m[70]);
-P_SO(m[36],m[72]); P_SO(m[37],m[73]); P_SO(m[38],m[74]);
-P_SO(m[0],m[72]);  P_SO(m[1],m[73]);  P_SO(m[2],m[74]);
-P_MA(m[0],m[36]);  P_MA(m[1],m[37]);  P_MA(m[2],m[38]);
-P_SO(m[40],m[76]); P_SO(m[41],m[77]); P_SO(m[42],m[78]);
-P_SO(m[4],m[76]);  P_SO(m[5],m[77]);  P_SO(m[6],m[78]);
-P_SO(m[4],m[40]);  P_SO(m[5],m[41]);  P_SO(m[6],m[42]);
-P_SO(m[44],m[80]); P_SO(m[45],m[81]); P_SO(m[46],m[82]);
-P_SO(m[8],m[80]);  P_SO(m[9],m[81]);  P_SO(m[10],m[82]);
-P_MA(m[8],m[44]);  P_MA(m[9],m[45]);  P_MA(m[10],m[46]);
-P_SO(m[48],m[84]); P_SO(m[49],m[85]); P_SO(m[50],m[86]);
-P_SO(m[12],m[84]); P_SO(m[13],m[85]); P_SO(m[14],m[86]);
-P_SO(m[12],m[48]); P_SO(m[13],m[49]); P_SO(m[14],m[50]);
-P_SO(m[52],m[88]); P_SO(m[53],m[89]); P_SO(m[54],m[90]);
-P_MI(m[16],m[88]); P_MI(m[17],m[89]); P_MI(m[18],m[90]);
-P_SO(m[16],m[52]); P_SO(m[17],m[53]); P_SO(m[18],m[54]);
-P_SO(m[56],m[92]); P_SO(m[57],m[93]); P_SO(m[58],m[94]);
-P_SO(m[20],m[92]); P_SO(m[21],m[93]); P_SO(m[22],m[94]);
-P_SO(m[20],m[56]); P_SO(m[21],m[57]); P_SO(m[22],m[58]);
-P_SO(m[60],m[96]); P_SO(m[61],m[97]); P_SO(m[62],m[98]);
-P_MI(m[24],m[96]); P_MI(m[25],m[97]); P_MI(m[26],m[98]);
-P_SO(m[24],m[60]); P_SO(m[25],m[61]); P_SO(m[26],m[62]);
-P_MI(m[28],m[64]); P_MI(m[29],m[65]); P_MI(m[30],m[66]);
-P_MI(m[28],m[76]); P_MI(m[29],m[77]); P_MI(m[30],m[78]);
-P_MI(m[52],m[84]); P_MI(m[53],m[85]); P_MI(m[54],m[86]);
-P_MI(m[60],m[92]); P_MI(m[61],m[93]); P_MI(m[62],m[94]);
-P_MI(m[28],m[52]); P_MI(m[29],m[53]); P_MI(m[30],m[54]);
-P_MI(m[28],m[60]); P_MI(m[29],m[61]); P_MI(m[30],m[62]);
-P_MA(m[4],m[36]);  P_MA(m[5],m[37]);  P_MA(m[6],m[38]);
-P_MA(m[12],m[44]); P_MA(m[13],m[45]); P_MA(m[14],m[46]);
-P_MA(m[20],m[68]); P_MA(m[21],m[69]); P_MA(m[22],m[70]);
-P_MA(m[44],m[68]); P_MA(m[45],m[69]); P_MA(m[46],m[70]);
-P_MA(m[36],m[68]); P_MA(m[37],m[69]); P_MA(m[38],m[70]);
-P_SO(m[16],m[40]); P_SO(m[17],m[41]); P_SO(m[18],m[42]);
-P_SO(m[24],m[48]); P_SO(m[25],m[49]); P_SO(m[26],m[50]);
-P_SO(m[28],m[56]); P_SO(m[29],m[57]); P_SO(m[30],m[58]);
-P_SO(m[16],m[24]); P_SO(m[17],m[25]); P_SO(m[18],m[26]);
-P_MA(m[16],m[28]); P_MA(m[17],m[29]); P_MA(m[18],m[30]);
-P_SO(m[48],m[56]); P_SO(m[49],m[57]); P_SO(m[50],m[58]);
-P_MI(m[40],m[56]); P_MI(m[41],m[57]); P_MI(m[42],m[58]);
-P_SO(m[24],m[28]); P_SO(m[25],m[29]); P_SO(m[26],m[30]);
-P_SO(m[40],m[48]); P_SO(m[41],m[49]); P_SO(m[42],m[50]);
-P_SO(m[24],m[40]); P_SO(m[25],m[41]); P_SO(m[26],m[42]);
-P_MA(m[24],m[68]); P_MA(m[25],m[69]); P_MA(m[26],m[70]);
-P_SO(m[48],m[68]); P_SO(m[49],m[69]); P_SO(m[50],m[70]);
-P_MI(m[28],m[68]); P_MI(m[29],m[69]); P_MI(m[30],m[70]);
-P_SO(m[28],m[40]); P_SO(m[29],m[41]); P_SO(m[30],m[42]);
-P_SO(m[48],m[72]); P_SO(m[49],m[73]); P_SO(m[50],m[74]);
-P_MA(m[28],m[48]); P_MA(m[29],m[49]); P_MA(m[30],m[50]);
-P_MI(m[40],m[72]); P_MI(m[41],m[73]); P_MI(m[42],m[74]);
-P_SO(m[48],m[80]); P_SO(m[49],m[81]); P_SO(m[50],m[82]);
-P_MI(m[40],m[80]); P_MI(m[41],m[81]); P_MI(m[42],m[82]);
-P_MA(m[40],m[48]); P_MA(m[41],m[49]); P_MA(m[42],m[50]);
+MEDIAN25_NET(P_SO3,P_MA3,P_MI3)
 return mm[12];
 }
 
+//------------------------------------------------------------
+//Vector versions: every element is a vector of SMED_N packed
+//pixels, the median of each byte is taken with the unsigned byte
+//min/max instructions, SMED_N pixels at once.
+//Like the scalar versions they keep the alpha of the result
+//element (the alpha bytes are sorted too, and then replaced),
+//which matters where packed results are compared as words.
+//The vector code is chosen at compile time (AVX2, SSE2 or NEON),
+//on other architectures SMED_N is not defined and only the
+//scalar versions exist.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SMED_N 8
+typedef __m256i smed_v;
+
+static inline smed_v smed_ld(const uint32_t *p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void smed_st(uint32_t *p, smed_v a) { _mm256_storeu_si256((__m256i*)p,a); }
+static inline smed_v smed_min(smed_v a, smed_v b) { return _mm256_min_epu8(a,b); }
+static inline smed_v smed_max(smed_v a, smed_v b) { return _mm256_max_epu8(a,b); }
+//color of c, alpha of a
+static inline smed_v smed_alpha(smed_v c, smed_v a)
+{
+return _mm256_blendv_epi8(c,a,_mm256_set1_epi32((int)0xFF000000));
+}
+//packed pixels compared as unsigned words
+static inline smed_v smed_max32(smed_v a, smed_v b) { return _mm256_max_epu32(a,b); }
+static inline smed_v smed_min32(smed_v a, smed_v b) { return _mm256_min_epu32(a,b); }
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define SMED_N 4
+typedef __m128i smed_v;
+
+static inline smed_v smed_ld(const uint32_t *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void smed_st(uint32_t *p, smed_v a) { _mm_storeu_si128((__m128i*)p,a); }
+static inline smed_v smed_min(smed_v a, smed_v b) { return _mm_min_epu8(a,b); }
+static inline smed_v smed_max(smed_v a, smed_v b) { return _mm_max_epu8(a,b); }
+//color of c, alpha of a
+static inline smed_v smed_alpha(smed_v c, smed_v a)
+{
+smed_v m=_mm_set1_epi32((int)0xFF000000);
+return _mm_or_si128(_mm_andnot_si128(m,c),_mm_and_si128(m,a));
+}
+//packed pixels compared as unsigned words (SSE2 only compares
+//signed words, so the sign bits are flipped first)
+static inline smed_v smed_gt32(smed_v a, smed_v b)
+{
+smed_v s=_mm_set1_epi32((int)0x80000000);
+return _mm_cmpgt_epi32(_mm_xor_si128(a,s),_mm_xor_si128(b,s));
+}
+static inline smed_v smed_max32(smed_v a, smed_v b)
+{
+smed_v g=smed_gt32(a,b);
+return _mm_or_si128(_mm_and_si128(g,a),_mm_andnot_si128(g,b));
+}
+static inline smed_v smed_min32(smed_v a, smed_v b)
+{
+smed_v g=smed_gt32(a,b);
+return _mm_or_si128(_mm_and_si128(g,b),_mm_andnot_si128(g,a));
+}
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+#define SMED_N 4
+typedef uint8x16_t smed_v;
+
+static inline smed_v smed_ld(const uint32_t *p) { return vreinterpretq_u8_u32(vld1q_u32(p)); }
+static inline void smed_st(uint32_t *p, smed_v a) { vst1q_u32(p,vreinterpretq_u32_u8(a)); }
+static inline smed_v smed_min(smed_v a, smed_v b) { return vminq_u8(a,b); }
+static inline smed_v smed_max(smed_v a, smed_v b) { return vmaxq_u8(a,b); }
+//color of c, alpha of a
+static inline smed_v smed_alpha(smed_v c, smed_v a)
+{
+return vbslq_u8(vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000)),a,c);
+}
+//packed pixels compared as unsigned words
+static inline smed_v smed_max32(smed_v a, smed_v b)
+{
+return vreinterpretq_u8_u32(vmaxq_u32(vreinterpretq_u32_u8(a),vreinterpretq_u32_u8(b)));
+}
+static inline smed_v smed_min32(smed_v a, smed_v b)
+{
+return vreinterpretq_u8_u32(vminq_u32(vreinterpretq_u32_u8(a),vreinterpretq_u32_u8(b)));
+}
+
+#endif
+
+#ifdef SMED_N
+
+//one network step on vectors of packed pixels
+#define V_SO(a,b) { smed_v t=smed_min(v[a],v[b]); v[b]=smed_max(v[a],v[b]); v[a]=t; }
+#define V_MA(a,b) { v[b]=smed_max(v[a],v[b]); }
+#define V_MI(a,b) { v[a]=smed_min(v[a],v[b]); }
+
+//------------------------------------------------------------
+//SMED_N medians of 3, scrambles the input array!
+static inline smed_v median3_v(smed_v *v)
+{
+smed_v a=v[1];
+MEDIAN3_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[1],a);
+}
+
+//------------------------------------------------------------
+//SMED_N medians of 5, scrambles the input array!
+static inline smed_v median5_v(smed_v *v)
+{
+smed_v a=v[2];
+MEDIAN5_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[2],a);
+}
+
+//------------------------------------------------------------
+//SMED_N medians of 7, scrambles the input array!
+static inline smed_v median7_v(smed_v *v)
+{
+smed_v a=v[3];
+MEDIAN7_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[3],a);
+}
+
+//------------------------------------------------------------
+//SMED_N medians of 9, scrambles the input array!
+static inline smed_v median9_v(smed_v *v)
+{
+smed_v a=v[4];
+MEDIAN9_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[4],a);
+}
+
+//------------------------------------------------------------
+//SMED_N medians of 11, scrambles the input array!
+static inline smed_v median11_v(smed_v *v)
+{
+smed_v a=v[5];
+MEDIAN11_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[5],a);
+}
+
+//------------------------------------------------------------
+//SMED_N medians of 13, scrambles the input array!
+static inline smed_v median13_v(smed_v *v)
+{
+smed_v a=v[6];
+MEDIAN13_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[6],a);
+}
+
+//------------------------------------------------------------
+//SMED_N medians of 25, scrambles the input array!
+static inline smed_v median25_v(smed_v *v)
+{
+smed_v a=v[12];
+MEDIAN25_NET(V_SO,V_MA,V_MI)
+return smed_alpha(v[12],a);
+}
+
+//------------------------------------------------------------
+//per byte median of three vectors (the alpha is not kept)
+static inline smed_v smed_med3(smed_v a, smed_v b, smed_v c)
+{
+return smed_max(smed_min(a,b),smed_min(smed_max(a,b),c));
+}
+
+#undef V_SO
+#undef V_MA
+#undef V_MI
+
+#endif	//SMED_N
+
+#undef P_SO3
+#undef P_MA3
+#undef P_MI3
 #undef P_SO
 #undef P_SWAP
 #undef P_MA
 #undef P_MI
-
-
@@ -35,6 +35,8 @@ public:
     void fillRange(double startPos, const Color& startColor,
                    double endPos, const Color& endColor);
     const Color& operator[](double pos) const;
+    unsigned int index(double pos) const;
+    const Color& color(unsigned int index) const { return lut[index]; }
     void print() const;
 
 private:
@@ -78,13 +80,20 @@ void GradientLut::fillRange( double startPos, const GradientLut::Color& startCol
  * LUT.
  */
 const GradientLut::Color& GradientLut::operator[](double pos) const {
+    return lut[index(pos)];
+};
+
+/**
+ * Get the index in the table for a given position, see operator[].
+ */
+unsigned int GradientLut::index(double pos) const {
     unsigned int size = lut.size();
     unsigned int index = (double)size * pos;
     if(index >= size) {
         index = size - 1;
     }
-    return lut[index];
-};
+    return index;
+}
 
 /**
  * Debug print function.
@@ -21,7 +21,12 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 #include "gradientlut.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 #include <stdlib.h>
 
 /**
@@ -45,6 +50,86 @@ static unsigned int ColorIndex(const std::string& str) {
     }
 }
 
+static void fillGradient(GradientLut& gradient, const std::string& colorMap) {
+    if(colorMap == "earth") {
+        GradientLut::Color water   = {0x30, 0x70, 0xd0};
+        GradientLut::Color desert  = {0xd0, 0xc0, 0x90};
+        GradientLut::Color grass   = {0x00, 0xc0, 0x20};
+        GradientLut::Color forrest = {0x00, 0x30, 0x00};
+        gradient.fillRange( N2P(-1.0), water,  N2P(-0.2), water  );
+        gradient.fillRange( N2P(-0.2), water,  N2P(-0.1), desert );
+        gradient.fillRange( N2P(-0.1), desert, N2P( 0.1), desert );
+        gradient.fillRange( N2P( 0.1), desert, N2P( 0.4), grass );
+        gradient.fillRange( N2P( 0.4), grass,  N2P( 1.0), forrest );
+    } else if(colorMap == "heat") {
+        GradientLut::Color n10 = {0x00, 0x00, 0x00};
+        GradientLut::Color n08 = {0x10, 0x10, 0x70};
+        GradientLut::Color n06 = {0x10, 0x20, 0xf0};
+        GradientLut::Color n04 = {0x10, 0x60, 0xf0};
+        GradientLut::Color n02 = {0x20, 0xa0, 0xc0};
+        GradientLut::Color zer = {0x20, 0xb0, 0x20};
+        GradientLut::Color p02 = {0x90, 0xf0, 0x10};
+        GradientLut::Color p04 = {0xf0, 0xb0, 0x10};
+        GradientLut::Color p06 = {0xf0, 0xa0, 0x10};
+        GradientLut::Color p08 = {0xf0, 0x50, 0x10};
+        GradientLut::Color p10 = {0xff, 0x00, 0x00};
+        gradient.fillRange( N2P(-1.0), n10, N2P(-0.8), n08 );
+        gradient.fillRange( N2P(-0.8), n08, N2P(-0.6), n06 );
+        gradient.fillRange( N2P(-0.6), n06, N2P(-0.4), n04 );
+        gradient.fillRange( N2P(-0.4), n04, N2P(-0.2), n02 );
+        gradient.fillRange( N2P(-0.2), n02, N2P( 0.0), zer );
+        gradient.fillRange( N2P( 0.0), zer, N2P( 0.2), p02 );
+        gradient.fillRange( N2P( 0.2), p02, N2P( 0.4), p04 );
+        gradient.fillRange( N2P( 0.4), p04, N2P( 0.6), p06 );
+        gradient.fillRange( N2P( 0.6), p06, N2P( 0.8), p08 );
+        gradient.fillRange( N2P( 0.8), p08, N2P( 1.0), p10 );
+    } else if(colorMap == "rainbow") {
+        GradientLut::Color violet = {0x7f, 0x00, 0xff};
+        GradientLut::Color blue   = {0x00, 0x00, 0xff};
+        GradientLut::Color green  = {0x00, 0xff, 0x00};
+        GradientLut::Color yellow = {0xff, 0xff, 0x00};
+        GradientLut::Color orange = {0xff, 0x7f, 0x00};
+        GradientLut::Color red    = {0xff, 0x00, 0x00};
+        gradient.fillRange( N2P(-1.0), violet, N2P(-0.6), blue   );
+        gradient.fillRange( N2P(-0.6), blue,   N2P(-0.2), green   );
+        gradient.fillRange( N2P(-0.2), green,   N2P( 0.2), yellow  );
+        gradient.fillRange( N2P( 0.2), yellow,  N2P( 0.6), orange );
+        gradient.fillRange( N2P( 0.6), orange, N2P( 1.0), red    );
+    } else { // grayscale
+        GradientLut::Color black = {0x00, 0x00, 0x00};
+        GradientLut::Color white = {0xff, 0xff, 0xff};
+        gradient.fillRange( N2P(-1.0), black, N2P( 1.0), white );
+    }
+}
+
+/**
+ * The gradient of a color map with a number of levels, shared by all
+ * instances: each is built once and kept as long as an instance uses it.
+ */
+static std::shared_ptr<const GradientLut> sharedGradient(const std::string& colorMap,
+                                                         unsigned int levels) {
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, unsigned int>,
+                    std::weak_ptr<const GradientLut> > cache;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // unknown names are grayscale, see fillGradient()
+    std::string name = colorMap;
+    if (name != "earth" && name != "heat" && name != "rainbow") {
+        name = "grayscale";
+    }
+    std::weak_ptr<const GradientLut>& entry = cache[std::make_pair(name, levels)];
+    std::shared_ptr<const GradientLut> gradient = entry.lock();
+    if (!gradient) {
+        std::shared_ptr<GradientLut> built = std::make_shared<GradientLut>();
+        built->setDepth(levels);
+        fillGradient(*built, name);
+        entry = built;
+        gradient = built;
+    }
+    return gradient;
+}
+
 class Ndvi : public frei0r::filter
 {
 public:
@@ -55,8 +140,9 @@ public:
 
 private:
     void initLut();
-    double getComponent(uint8_t *sample, unsigned int chan, double offset, double scale);
-    void setColor(uint8_t *sample, double index);
+    void initIndexLut(double visScale, double visOffset,
+                      double nirScale, double nirOffset, bool vi);
+    double getComponent(unsigned int value, double offset, double scale);
     void drawLegend(uint32_t *out);
     void drawRect( uint32_t* out, uint8_t r, uint8_t g, uint8_t b, unsigned int x, unsigned int y, unsigned int w, unsigned int h );
     void drawGradient( uint32_t* out, unsigned int x, unsigned int y, unsigned int w, unsigned int h );
@@ -74,7 +160,15 @@ private:
     std::string paramLegend;
     unsigned int lutLevels;
     std::string colorMap;
-    GradientLut gradient;
+    std::shared_ptr<const GradientLut> gradient;
+    // the gradient index of each visible and near-infrared value, 8 bits each
+    std::vector<uint16_t> indexLut;
+    const GradientLut* indexGradient;
+    double indexVisScale;
+    double indexVisOffset;
+    double indexNirScale;
+    double indexNirOffset;
+    bool indexVi;
 };
 
 Ndvi::Ndvi(unsigned int width, unsigned int height)
@@ -91,6 +185,12 @@ Ndvi::Ndvi(unsigned int width, unsigned int height)
  , lutLevels(0)
  , colorMap("")
  , gradient()
+ , indexGradient(nullptr)
+ , indexVisScale(0.0)
+ , indexVisOffset(0.0)
+ , indexNirScale(0.0)
+ , indexNirOffset(0.0)
+ , indexVi(false)
 {
     register_param(paramColorMap,  "Color Map",
             "The color map to use. One of 'earth', 'grayscale', 'heat' or 'rainbow'.");
@@ -127,25 +227,18 @@ void Ndvi::update(double time,
     unsigned int nirChan = ColorIndex(paramNirChan);
 
     initLut();
+    initIndexLut(visScale, visOffset, nirScale, nirOffset, paramIndex == "vi");
 
-    if (paramIndex == "vi") {
-        for (unsigned int i = 0; i < size; i++) {
-            double vis =  getComponent(inP, visChan, visOffset, visScale);
-            double nir =  getComponent(inP, nirChan, nirOffset, nirScale);
-            double vi = (nir - vis) / 255.0;
-            setColor(outP, vi);
-            inP += 4;
-            outP += 4;
-        }
-    } else { // ndvi
-        for (unsigned int i = 0; i < size; i++) {
-            double vis =  getComponent(inP, visChan, visOffset, visScale);
-            double nir =  getComponent(inP, nirChan, nirOffset, nirScale);
-            double ndvi = (nir - vis) / (nir + vis);
-            setColor(outP, ndvi);
-            inP += 4;
-            outP += 4;
-        }
+    const uint16_t* index = &indexLut[0];
+    for (unsigned int i = 0; i < size; i++) {
+        const GradientLut::Color& falseColor =
+            gradient->color(index[(inP[visChan] << 8) | inP[nirChan]]);
+        outP[0] = falseColor.r;
+        outP[1] = falseColor.g;
+        outP[2] = falseColor.b;
+        outP[3] = 0xff;
+        inP += 4;
+        outP += 4;
     }
 
     if( paramLegend == "bottom" ) {
@@ -158,85 +251,50 @@ void Ndvi::initLut() {
     unsigned int paramLutLevelsInt = paramLutLevels * 1000.0 + 0.5;
     if (paramLutLevelsInt < 2) paramLutLevelsInt = 2;
     if (paramLutLevelsInt > 1000) paramLutLevelsInt = 1000;
-    if (lutLevels == paramLutLevelsInt &&
+    if (gradient != nullptr && lutLevels == paramLutLevelsInt &&
         colorMap == paramColorMap) {
         return;
-    } else {
-        lutLevels = paramLutLevelsInt;
-        colorMap = paramColorMap;
     }
+    lutLevels = paramLutLevelsInt;
+    colorMap = paramColorMap;
+    gradient = sharedGradient(colorMap, lutLevels);
+}
 
-    gradient.setDepth(lutLevels);
+void Ndvi::initIndexLut(double visScale, double visOffset,
+                        double nirScale, double nirOffset, bool vi) {
+    // Only update the table if the gradient or a parameter has changed.
+    if (indexGradient == gradient.get() &&
+        indexVisScale == visScale && indexVisOffset == visOffset &&
+        indexNirScale == nirScale && indexNirOffset == nirOffset &&
+        indexVi == vi) {
+        return;
+    }
+    indexGradient = gradient.get();
+    indexVisScale = visScale;
+    indexVisOffset = visOffset;
+    indexNirScale = nirScale;
+    indexNirOffset = nirOffset;
+    indexVi = vi;
 
-    if(colorMap == "earth") {
-        GradientLut::Color water   = {0x30, 0x70, 0xd0};
-        GradientLut::Color desert  = {0xd0, 0xc0, 0x90};
-        GradientLut::Color grass   = {0x00, 0xc0, 0x20};
-        GradientLut::Color forrest = {0x00, 0x30, 0x00};
-        gradient.fillRange( N2P(-1.0), water,  N2P(-0.2), water  );
-        gradient.fillRange( N2P(-0.2), water,  N2P(-0.1), desert );
-        gradient.fillRange( N2P(-0.1), desert, N2P( 0.1), desert );
-        gradient.fillRange( N2P( 0.1), desert, N2P( 0.4), grass );
-        gradient.fillRange( N2P( 0.4), grass,  N2P( 1.0), forrest );
-    } else if(colorMap == "heat") {
-        GradientLut::Color n10 = {0x00, 0x00, 0x00};
-        GradientLut::Color n08 = {0x10, 0x10, 0x70};
-        GradientLut::Color n06 = {0x10, 0x20, 0xf0};
-        GradientLut::Color n04 = {0x10, 0x60, 0xf0};
-        GradientLut::Color n02 = {0x20, 0xa0, 0xc0};
-        GradientLut::Color zer = {0x20, 0xb0, 0x20};
-        GradientLut::Color p02 = {0x90, 0xf0, 0x10};
-        GradientLut::Color p04 = {0xf0, 0xb0, 0x10};
-        GradientLut::Color p06 = {0xf0, 0xa0, 0x10};
-        GradientLut::Color p08 = {0xf0, 0x50, 0x10};
-        GradientLut::Color p10 = {0xff, 0x00, 0x00};
-        gradient.fillRange( N2P(-1.0), n10, N2P(-0.8), n08 );
-        gradient.fillRange( N2P(-0.8), n08, N2P(-0.6), n06 );
-        gradient.fillRange( N2P(-0.6), n06, N2P(-0.4), n04 );
-        gradient.fillRange( N2P(-0.4), n04, N2P(-0.2), n02 );
-        gradient.fillRange( N2P(-0.2), n02, N2P( 0.0), zer );
-        gradient.fillRange( N2P( 0.0), zer, N2P( 0.2), p02 );
-        gradient.fillRange( N2P( 0.2), p02, N2P( 0.4), p04 );
-        gradient.fillRange( N2P( 0.4), p04, N2P( 0.6), p06 );
-        gradient.fillRange( N2P( 0.6), p06, N2P( 0.8), p08 );
-        gradient.fillRange( N2P( 0.8), p08, N2P( 1.0), p10 );
-    } else if(colorMap == "rainbow") {
-        GradientLut::Color violet = {0x7f, 0x00, 0xff};
-        GradientLut::Color blue   = {0x00, 0x00, 0xff};
-        GradientLut::Color green  = {0x00, 0xff, 0x00};
-        GradientLut::Color yellow = {0xff, 0xff, 0x00};
-        GradientLut::Color orange = {0xff, 0x7f, 0x00};
-        GradientLut::Color red    = {0xff, 0x00, 0x00};
-        gradient.fillRange( N2P(-1.0), violet, N2P(-0.6), blue   );
-        gradient.fillRange( N2P(-0.6), blue,   N2P(-0.2), green   );
-        gradient.fillRange( N2P(-0.2), green,   N2P( 0.2), yellow  );
-        gradient.fillRange( N2P( 0.2), yellow,  N2P( 0.6), orange );
-        gradient.fillRange( N2P( 0.6), orange, N2P( 1.0), red    );
-    } else { // grayscale
-        GradientLut::Color black = {0x00, 0x00, 0x00};
-        GradientLut::Color white = {0xff, 0xff, 0xff};
-        gradient.fillRange( N2P(-1.0), black, N2P( 1.0), white );
+    indexLut.resize(256 * 256);
+    for (unsigned int v = 0; v < 256; v++) {
+        double vis = getComponent(v, visOffset, visScale);
+        for (unsigned int n = 0; n < 256; n++) {
+            double nir = getComponent(n, nirOffset, nirScale);
+            double index = vi ? (nir - vis) / 255.0 : (nir - vis) / (nir + vis);
+            indexLut[(v << 8) | n] = gradient->index(N2P(index));
+        }
     }
 }
 
-inline double Ndvi::getComponent(uint8_t *sample, unsigned int chan, double offset, double scale)
+inline double Ndvi::getComponent(unsigned int value, double offset, double scale)
 {
-    double c =  sample[chan];
+    double c =  value;
     c = (c + offset) * scale;
     c = CLAMP(c, 0.0, 255.0);
     return c;
 }
 
-inline void Ndvi::setColor(uint8_t *sample, double index)
-{
-    double pos = N2P(index);
-    const GradientLut::Color& falseColor = gradient[pos];
-    sample[0] = falseColor.r;
-    sample[1] = falseColor.g;
-    sample[2] = falseColor.b;
-    sample[3] = 0xff;
-}
-
 void Ndvi::drawLegend(uint32_t* out)
 {
     unsigned int legendHeight = height / 20;
@@ -283,7 +341,7 @@ void Ndvi::drawGradient( uint32_t* out, unsigned int x, unsigned int y, unsigned
 {
     for (unsigned int i = 0; i < w; i++) {
         double pos = (double)i / (double)w;
-        const GradientLut::Color& falseColor = gradient[pos];
+        const GradientLut::Color& falseColor = (*gradient)[pos];
         uint8_t *sample = (uint8_t*)(out + (y * width) + x + i);
         for (unsigned int j = 0; j < h; j++) {
             sample[0] = falseColor.r;
@@ -31,10 +31,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
 #include <math.h>
 #include <string.h>
 
 #include <frei0r.hpp>
+#include <frei0r_random.h>
 
 
 #define PLANES 32
@@ -61,15 +63,19 @@ public:
                       uint32_t* out,
                       const uint32_t* in);
 
+  virtual bool clone_state(const frei0r::fx& other);
+  virtual bool reset();
+
 private:
 
   ScreenGeometry geo;
 
   void _init(int wdt, int hgt);
-  int32_t *buffer;
-  int32_t *planetable[PLANES];
+  frei0r::frame_history history;
   int mode;
   int plane, stock, timer, stride, readplane;
+  double seed;
+  bool deterministic;
 
   /* cheap & fast randomizer (by Fukuchi Kentarou) */
   uint32_t randval;
@@ -78,28 +84,48 @@ private:
 
 };
 
-Nervous::Nervous(int wdt, int hgt) {
-    int c;
+Nervous::Nervous(int wdt, int hgt)
+  : history(wdt, hgt, PLANES) {
     _init(wdt, hgt);
+    register_history(history);
     
-    buffer = (int32_t*) calloc(geo.size, PLANES);
-    if(!buffer) {
-      fprintf(stderr,"ERROR: nervous plugin can't allocate needed memory: %u bytes\n",
-	      geo.size*PLANES);
-      return;
-    }
-    for(c=0;c<PLANES;c++)
-      planetable[c] = &buffer[geo.w*geo.h*c];
-    
+    fastsrand(::time(NULL));
     plane = 0;
     stock = 0;
     timer = 0;
     readplane = 0;
     mode = 1;
+
+    seed = 0.0;
+    deterministic = false;
+    register_param(seed, "seed", "seed of the random frame choice in deterministic mode");
+    register_param(deterministic, "deterministic", "pick the frame from the seed and the time alone, so that frames can be rendered in any order");
 }
 
 Nervous::~Nervous() {
-  if(buffer) free(buffer);
+}
+
+// the frames are copied along with the history
+bool Nervous::clone_state(const frei0r::fx& other) {
+  const Nervous& o = static_cast<const Nervous&>(other);
+  mode = o.mode;
+  plane = o.plane;
+  stock = o.stock;
+  timer = o.timer;
+  stride = o.stride;
+  readplane = o.readplane;
+  randval = o.randval;
+  return true;
+}
+
+// the history forgets its frames itself
+bool Nervous::reset() {
+  mode = 1;
+  plane = 0;
+  stock = 0;
+  timer = 0;
+  readplane = 0;
+  return true;
 }
 
 void Nervous::_init(int wdt, int hgt) {
@@ -115,10 +141,20 @@ void Nervous::_init(int wdt, int hgt) {
 void Nervous::update(double time,
                      uint32_t* out,
                      const uint32_t* in) {
-  memcpy(planetable[plane],in,geo.size);
+  history.push(time, in);
 
   if(stock<PLANES) stock++;
 
+  if(deterministic) {
+    // The stride walk depends on the frames before, so here every frame
+    // picks its own age. With a host history the past frames are there
+    // after a seek too.
+    frei0r_random_t r;
+    frei0r_random_init(&r, frei0r_random_frame_seed(seed, time), 0);
+    memcpy(out, history.at(frei0r_random_below(&r, history.size())), geo.size);
+    return;
+  }
+
   if(mode) {
     if(timer) {
       readplane = readplane + stride;
@@ -135,10 +171,14 @@ void Nervous::update(double time,
     if(stock > 0)
       readplane = fastrand() % stock;
   
+  // plane and readplane are slots of a ring of PLANES frames, plane is
+  // the one the current frame went to
+  const uint32_t* src = history.at((plane + PLANES - readplane) % PLANES);
+
   plane++;
   if(plane==PLANES) plane=0;
 
-  memcpy(out,planetable[readplane],geo.size);
+  memcpy(out,src,geo.size);
 
 }
 
@@ -147,4 +187,6 @@ void Nervous::update(double time,
 frei0r::construct<Nervous> plugin("Nervous",
 				"flushes frames in time in a nervous way",
 				"Tannenbaum, Kentaro, Jaromil",
-				3,1);
+				3,2,
+				F0R_COLOR_MODEL_PACKED32,
+				F0R_CAP_TEMPORAL | F0R_CAP_CLONE);
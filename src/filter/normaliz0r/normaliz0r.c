@@ -67,6 +67,11 @@
  *              a rather expensive no-op.  Values in between can give a gentle
  *              boost to low-contrast video without creating an artificial
  *              over-processed look.  The default is full strength.
+ *
+ *   Lagged     Take the input range from the previous frame, whose histogram
+ *              is counted while it is mapped, so that each frame is read only
+ *              once instead of twice.  The range then trails the video by a
+ *              frame, which smoothing hides anyway.  Defaults to off.
  */
 
 #include <assert.h>
@@ -75,12 +80,14 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_histogram.h"
+#include "frei0r_state.h"
 
 #define MAX_HISTORY_LEN     128
 
 typedef struct
 {
-  int num_pixels;     // Number of pixels in a frame.
+  unsigned int width, height;
   int frame_num;      // Increments on each frame, starting from 0.
 
   // Per-extrema, per-channel fri0r params
@@ -96,6 +103,14 @@ typedef struct
                         // temporal smoothing.  [1,MAX_HISTORY_LEN].
   float independence;   // Ratio of independent vs linked normalization [0,1].
   float strength;       // Mixing strength for the normalization [0,1].
+  int lagged;           // Input range from the previous frame.
+
+  frei0r_histogram_t hist;  // Histogram of the previous frame, if have_hist.
+  int have_hist;
+
+  // Downscaled input of f0r_set_proxy for the next frame's range, or NULL.
+  const uint32_t* proxy;
+  unsigned int proxy_width, proxy_height;
 } normaliz0r_instance_t;
 
 int
@@ -118,11 +133,18 @@ f0r_get_plugin_info (f0r_plugin_info_t* info)
   info->color_model = F0R_COLOR_MODEL_RGBA8888;
   info->frei0r_version = FREI0R_MAJOR_VERSION;
   info->major_version = 0;
-  info->minor_version = 1;
-  info->num_params = 5;
+  info->minor_version = 3;
+  info->num_params = 6;
   info->explanation = "Normalize (aka histogram stretch, contrast stretch)";
 }
 
+void
+f0r_get_plugin_info2 (f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info (&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_TEMPORAL | F0R_CAP_STATE;
+}
+
 static char *param_infos[] =
 {
   "BlackPt",      "Output color to which darkest input color is mapped (default black)",
@@ -130,13 +152,15 @@ static char *param_infos[] =
   "Smoothing",    "Amount of temporal smoothing of the input range, to reduce flicker (default 0.0)",
   "Independence", "Proportion of independent to linked channel normalization (default 1.0)",
   "Strength",     "Strength of filter, from no effect to full normalization (default 1.0)",
+  "Lagged",       "Take the input range from the previous frame, reading each frame once (default off)",
 };
 
 void
 f0r_get_param_info (f0r_param_info_t* info, int param_index)
 {
   info->name = param_infos[param_index * 2];
-  info->type = (param_index <= 1) ? F0R_PARAM_COLOR : F0R_PARAM_DOUBLE;
+  info->type = (param_index <= 1) ? F0R_PARAM_COLOR
+      : (param_index == 5) ? F0R_PARAM_BOOL : F0R_PARAM_DOUBLE;
   info->explanation = param_infos[param_index * 2 + 1];
 }
 
@@ -145,7 +169,8 @@ f0r_construct (unsigned int width, unsigned int height)
 {
   normaliz0r_instance_t* inst = (normaliz0r_instance_t*)calloc(1, sizeof(*inst));
   int c;
-  inst->num_pixels = width * height;
+  inst->width = width;
+  inst->height = height;
   inst->frame_num = 0;
   for (c = 0; c < 3; c++)
   {
@@ -159,6 +184,7 @@ f0r_construct (unsigned int width, unsigned int height)
   inst->history_len = 1;        // [1,MAX_HISTORY_LEN]; default is no smoothing
   inst->independence = 1.0;     // [0,1]; default is fully independent
   inst->strength = 1.0;         // [0,1]; default is full strength
+  inst->lagged = 0;             // default is the range of the current frame
   return (f0r_instance_t)inst;
 }
 
@@ -201,6 +227,9 @@ f0r_set_param_value (f0r_instance_t instance, f0r_param_t param,
       val = (float)CLAMP(*((double* )param), 0.0, 1.0);
       inst->strength = val;
       break;
+    case 5:
+      inst->lagged = *((double*)param) >= 0.5;
+      break;
     }
 }
 
@@ -232,9 +261,86 @@ f0r_get_param_value (f0r_instance_t instance, f0r_param_t param,
     case 4:
       *((double*)param) = inst->strength;
       break;
+    case 5:
+      *((double*)param) = inst->lagged ? 1.0 : 0.0;
+      break;
     }
 }
 
+// The history need not be cleared, entries are written before they are
+// summed again.
+int
+f0r_reset (f0r_instance_t instance)
+{
+  normaliz0r_instance_t* inst = (normaliz0r_instance_t*)instance;
+  int c;
+
+  inst->frame_num = 0;
+  for (c = 0; c < 3; c++)
+  {
+    inst->min[c].history_sum = 0;
+    inst->max[c].history_sum = 0;
+  }
+  inst->have_hist = 0;
+  return 1;
+}
+
+// The smoothing history and the histogram of the lagged range, for
+// f0r_save_state and f0r_load_state, version 1.
+static int
+normaliz0r_state (normaliz0r_instance_t* inst, frei0r_state_t* s)
+{
+  int c;
+
+  frei0r_state_value (s, inst->frame_num);
+  for (c = 0; c < 3; c++)
+  {
+    frei0r_state_value (s, inst->min[c].history);
+    frei0r_state_value (s, inst->min[c].history_sum);
+    frei0r_state_value (s, inst->max[c].history);
+    frei0r_state_value (s, inst->max[c].history_sum);
+  }
+  frei0r_state_value (s, inst->have_hist);
+  frei0r_state_value (s, inst->hist);
+  return frei0r_state_ok (s);
+}
+
+size_t
+f0r_save_state (f0r_instance_t instance, void* buffer, size_t size)
+{
+  normaliz0r_instance_t* inst = (normaliz0r_instance_t*)instance;
+  frei0r_state_t s;
+
+  frei0r_state_save (&s, buffer, size, 1, inst->width, inst->height);
+  return normaliz0r_state (inst, &s) ? frei0r_state_size (&s) : 0;
+}
+
+int
+f0r_load_state (f0r_instance_t instance, const void* buffer, size_t size)
+{
+  normaliz0r_instance_t* inst = (normaliz0r_instance_t*)instance;
+  frei0r_state_t s;
+
+  frei0r_state_load (&s, buffer, size, 1, inst->width, inst->height);
+  return normaliz0r_state (inst, &s) && frei0r_state_end (&s);
+}
+
+int
+f0r_set_proxy (f0r_instance_t instance, const uint32_t* proxy,
+               unsigned int width, unsigned int height)
+{
+  normaliz0r_instance_t* inst = (normaliz0r_instance_t*)instance;
+
+  inst->proxy = NULL;
+  if (!proxy || !width || !height
+      || width > inst->width || height > inst->height)
+    return 0;
+  inst->proxy = proxy;
+  inst->proxy_width = width;
+  inst->proxy_height = height;
+  return 1;
+}
+
 void
 f0r_update (f0r_instance_t instance, double time, const uint32_t* inframe,
             uint32_t* outframe)
@@ -252,25 +358,43 @@ f0r_update (f0r_instance_t instance, double time, const uint32_t* inframe,
   } min[3], max[3];             // Min and max for each channel in {R,G,B}.
 
   // First, scan the input frame to find, for each channel, the minimum
-  // (min.in) and maximum (max.in) values present in the channel.
+  // (min.in) and maximum (max.in) values present in the channel.  With a
+  // proxy they are those of the proxy.  Lagged, they are the first and last
+  // used bins of the previous frame's histogram.
+  if (inst->proxy)
   {
-    const uint8_t *in = (const uint8_t*)inframe;
-
-#define INIT(c)     (min[c].in = max[c].in = in[c])
-#define EXTEND(c)   (min[c].in = MIN(min[c].in, in[c])), \
-                    (max[c].in = MAX(max[c].in, in[c]))
-    INIT(0);
-    INIT(1);
-    INIT(2);
-    in += 4;
-    // Process (num_pixels - 1), as we used the first pixel to initialize
-    unsigned int num_pixels = inst->num_pixels - 1;
-    while (num_pixels--)
+    frei0r_minmax_t mm;
+
+    frei0r_minmax(&mm, inst->proxy, inst->proxy_width, inst->proxy_height);
+    for (c = 0; c < 3; c++)
+    {
+      min[c].in = mm.min[c];
+      max[c].in = mm.max[c];
+    }
+  }
+  else if (inst->lagged && inst->have_hist)
+  {
+    for (c = 0; c < 3; c++)
+    {
+      int v = 0;
+      while (v < 255 && !inst->hist.count[c][v])
+        v++;
+      min[c].in = v;
+      v = 255;
+      while (v > min[c].in && !inst->hist.count[c][v])
+        v--;
+      max[c].in = v;
+    }
+  }
+  else
+  {
+    frei0r_minmax_t mm;
+
+    frei0r_minmax(&mm, inframe, inst->width, inst->height);
+    for (c = 0; c < 3; c++)
     {
-      EXTEND(0);
-      EXTEND(1);
-      EXTEND(2);
-      in += 4;
+      min[c].in = mm.min[c];
+      max[c].in = mm.max[c];
     }
   }
 
@@ -342,18 +466,20 @@ f0r_update (f0r_instance_t instance, double time, const uint32_t* inframe,
     {
       // There is no dynamic range to expand.  No mapping for this channel.
       int in_val;
-      for (in_val = min[c].in; in_val <= max[c].in; in_val++)
+      for (in_val = 0; in_val <= 255; in_val++)
         lut[c][in_val] = min[c].out;
     }
     else
     {
       // We must set lookup values for all values in the original input range
-      // [min.in,max.in].  Since the original input range may be larger than
-      // [min.smoothed,max.smoothed], some output values may fall outside the
-      // [0,255] dynamic range.  We need to CLAMP() them.
+      // [min.in,max.in], and when lagged for the values of this frame outside
+      // the range of the last one, so the whole table is filled.  Since the
+      // input range may be larger than [min.smoothed,max.smoothed], some
+      // output values may fall outside the [0,255] dynamic range.  We need to
+      // CLAMP() them.
       float scale = (max[c].out - min[c].out) / (max[c].smoothed - min[c].smoothed);
       int in_val;
-      for (in_val = min[c].in; in_val <= max[c].in; in_val++)
+      for (in_val = 0; in_val <= 255; in_val++)
       {
         int out_val = ROUND((in_val - min[c].smoothed) * scale + min[c].out);
         lut[c][in_val] = CLAMP(out_val, 0, 255);
@@ -361,25 +487,17 @@ f0r_update (f0r_instance_t instance, double time, const uint32_t* inframe,
     }
   }
 
-  // Finally, process the pixels of the input frame using the lookup tables.
-  // Copy alpha as-is.
+  // Finally, process the pixels of the input frame using the lookup tables,
+  // copying alpha as-is.  Lagged, count the histogram for the next frame on
+  // the way, unless the proxy gave the range.
   {
-    const uint8_t *in = (const uint8_t*)inframe;
-    uint8_t *out = (uint8_t*)outframe;
-
-#define MAP(c)      (out[c] = lut[c][in[c]])
-
-    unsigned int num_pixels = inst->num_pixels;
-    while (num_pixels--)
-    {
-      MAP(0);
-      MAP(1);
-      MAP(2);
-      out[3] = in[3];  // copy alpha
-      in += 4;
-      out += 4;
-    }
+    int count = inst->lagged && !inst->proxy;
+    frei0r_histogram_map(count ? &inst->hist : NULL, outframe, inframe,
+                         inst->width, inst->height,
+                         (const uint8_t (*)[256])lut);
+    inst->have_hist = count;
   }
+  inst->proxy = NULL;
 
   inst->frame_num++;
 }
@@ -1,7 +1,7 @@
 #include "frei0r.hpp"
 
-#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 class nosync0r : public frei0r::filter
 {
@@ -16,20 +16,41 @@ public:
                       uint32_t* out,
                       const uint32_t* in)
   {
-    unsigned int
-      first_line=static_cast<unsigned int>(height*std::fmod(hsync,1.0));
+    unsigned int first_line=this->first_line();
     
-    std::copy(in+width*first_line, in+width*height, out);
-    std::copy(in, in+width*first_line, out+width*(height-first_line));
+    // the frame rolled up by first_line rows, in two blocks
+    std::memcpy(out, in+width*first_line,
+                width*(height-first_line)*sizeof(uint32_t));
+    std::memcpy(out+width*(height-first_line), in,
+                width*first_line*sizeof(uint32_t));
+  }
+
+  virtual bool row_map(unsigned int* rows)
+  {
+    unsigned int first_line=this->first_line();
+
+    for (unsigned int y=0; y<height; ++y)
+      rows[y] = y<height-first_line ? y+first_line : y-(height-first_line);
+    return true;
   }
   
 private:
   double hsync;
+
+  // the input row shown at the top, rolling back in for negative offsets
+  unsigned int first_line() const
+  {
+    double offset=std::fmod(hsync,1.0);
+    if (offset<0.0)
+      offset+=1.0;
+    return static_cast<unsigned int>(height*offset);
+  }
 };
 
 
 frei0r::construct<nosync0r> plugin("nosync0r",
 				   "broken tv",
 				   "Martin Bayer",
-				   0,2);
+				   0,2,
+				   F0R_COLOR_MODEL_PACKED32);
 
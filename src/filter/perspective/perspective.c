@@ -19,6 +19,7 @@
 
 
 #include "frei0r.h"
+#include "frei0r_remap.h"
 
 
 void sub_vec2( f0r_param_position_t* r, f0r_param_position_t* a, f0r_param_position_t* b ) 
@@ -66,6 +67,8 @@ typedef struct perspective_instance {
 	f0r_param_position_t tr;
 	f0r_param_position_t bl;
 	f0r_param_position_t br;
+	frei0r_remap_t remap; /* where each output pixel comes from */
+	int mapIsDirty;
 } perspective_instance_t;
 
 
@@ -89,6 +92,12 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->explanation = "Distorts the image for a pseudo perspective";
 
 }
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
 void f0r_get_param_info( f0r_param_info_t* info, int param_index )
 {
 	switch ( param_index ) {
@@ -128,11 +137,14 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	inst->bl.y = 1.0;
 	inst->br.x = 1.0;
 	inst->br.y = 1.0;
+	frei0r_remap_init(&inst->remap);
+	inst->mapIsDirty = 1;
 	return (f0r_instance_t)inst;
 }
 void f0r_destruct(f0r_instance_t instance)
 {
 	perspective_instance_t* inst = (perspective_instance_t*)instance;
+	frei0r_remap_free(&inst->remap);
 	free(inst);
 }
 void f0r_set_param_value(f0r_instance_t instance, 
@@ -153,6 +165,7 @@ void f0r_set_param_value(f0r_instance_t instance,
 			inst->br = *((f0r_param_position_t*)param);
 			break;
 		}
+	inst->mapIsDirty = 1;
 }
 void f0r_get_param_value(f0r_instance_t instance,
                          f0r_param_t param, int param_index)
@@ -180,25 +193,22 @@ __inline const long lrint(double x){
 }
 #endif
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+/* Each input pixel is moved to its place in the output, pixels further
+   down and right overwrite the ones before them. The same is done as a
+   gather: the remap takes each output pixel from the last input pixel
+   that lands on it, the others are background. */
+void make_map(perspective_instance_t* inst)
 {
-	perspective_instance_t* inst = (perspective_instance_t*)instance;
-
-	uint32_t* dst = outframe;
-	const uint32_t* src = inframe;
-	int len = inst->w * inst->h;
+	int w = inst->w;
+	int h = inst->h;
+	int32_t* idx = frei0r_remap_index(&inst->remap, w, h, w, h);
+	int len = w * h;
 	
 	int i;
 	for ( i = 0; i < len; i++ ) {
-		*dst = 0x00000000;
-		dst++;
+		idx[i] = -1;
 	}
-	dst = outframe;
 
-	int w = inst->w;
-	int h = inst->h;
-	
 	int rx;
 	int ry;
 	int x;
@@ -217,13 +227,21 @@ void f0r_update(f0r_instance_t instance, double time,
 			rx = lrint(r.x * (float)w);
 			ry = lrint(r.y * (float)h);
 			if ( rx < 0 || rx >= w || ry < 0 || ry >= h ) {
-				src++;
 				continue;
 			}
-			dst[rx + w * ry] = *src;
-			src++;
+			idx[rx + w * ry] = x + w * y;
 		}
 	}
-
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+	perspective_instance_t* inst = (perspective_instance_t*)instance;
+
+	if ( inst->mapIsDirty ) {
+		make_map( inst );
+		inst->mapIsDirty = 0;
+	}
+	frei0r_remap_run( &inst->remap, inframe, outframe, 0x00000000 );
+}
@@ -1,18 +1,21 @@
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_thread.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
-static uint32_t average(const uint32_t* start,
-                       int bxsize,
-                       int bysize, int xsize);
-
-static void fill_block(uint32_t* start,
-                       int bxsize,
-                       int bysize,
-                       int xsize, uint32_t col);
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
+/* The frame is done in bands of block_size_y rows (the last one may be
+   shorter): the channels of each column are summed over the band, the
+   column sums of each block give its average, and the first row of the
+   band is filled with the averages and copied to the other rows. So the
+   input is read once in row order and every output row is written by
+   one memcpy, the partial blocks at the right and bottom edge included.
+   Bands are split over threads. */
 
 typedef struct pixelizer_instance
 {
@@ -20,8 +23,25 @@ typedef struct pixelizer_instance
   unsigned int height;
   unsigned int block_size_x;
   unsigned int block_size_y;
+  uint32_t* sums; /* 4 channel sums per column, per thread */
 } pixelizer_instance_t;
 
+typedef struct pixelizer_job
+{
+  pixelizer_instance_t* inst;
+  const uint32_t* src;
+  uint32_t* dst;
+  unsigned int band_begin, band_end;
+  uint32_t* sums;
+} pixelizer_job_t;
+
+static void column_sums(uint32_t* sums, const uint32_t* src,
+                        unsigned int xsize, unsigned int rows);
+
+static void fill_band(uint32_t* dst, const uint32_t* sums,
+                      unsigned int xsize, unsigned int rows,
+                      unsigned int bsizex);
+
 int f0r_init()
 {
   return 1;
@@ -38,7 +58,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* pixelizerInfo)
   pixelizerInfo->color_model = F0R_COLOR_MODEL_PACKED32;
   pixelizerInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   pixelizerInfo->major_version = 1; 
-  pixelizerInfo->minor_version = 0; 
+  pixelizerInfo->minor_version = 1; 
   pixelizerInfo->num_params =  2; 
   pixelizerInfo->explanation = "Pixelize input image.";
 }
@@ -65,11 +85,15 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   pixelizer_instance_t* inst = (pixelizer_instance_t*)calloc(1, sizeof(*inst));
   inst->width = width; inst->height = height;
   inst->block_size_x = 8; inst->block_size_y = 8;
+  inst->sums = (uint32_t*)malloc(sizeof(uint32_t) * 4 * width
+                                 * FREI0R_MAX_THREADS);
   return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  pixelizer_instance_t* inst = (pixelizer_instance_t*)instance;
+  free(inst->sums);
   free(instance);
 }
 
@@ -111,6 +135,25 @@ void f0r_get_param_value(f0r_instance_t instance,
     }  
 }
 
+static void* pixelize_bands(void* arg)
+{
+  pixelizer_job_t* job = (pixelizer_job_t*)arg;
+  unsigned int xsize = job->inst->width;
+  unsigned int ysize = job->inst->height;
+  unsigned int bsizey = job->inst->block_size_y;
+  unsigned int band, y, rows;
+
+  for (band = job->band_begin; band < job->band_end; ++band)
+    {
+      y = band * bsizey;
+      rows = MIN(bsizey, ysize - y);
+      column_sums(job->sums, job->src + y*xsize, xsize, rows);
+      fill_band(job->dst + y*xsize, job->sums, xsize, rows,
+                job->inst->block_size_x);
+    }
+  return 0;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
@@ -118,110 +161,106 @@ void f0r_update(f0r_instance_t instance, double time,
   pixelizer_instance_t* inst = (pixelizer_instance_t*)instance;
   unsigned int xsize = inst->width;
   unsigned int ysize = inst->height;
-  unsigned int bsizex = inst->block_size_x;
-  unsigned int bsizey = inst->block_size_y;
-  unsigned int offset = 0;
-  unsigned int blocks_x, blocks_y, xrest, yrest, xi, yi;
-
-
-  blocks_x = xsize / bsizex;
-  blocks_y = ysize / bsizey;
-  xrest = xsize - blocks_x*bsizex;
-  yrest = ysize - blocks_y*bsizey;
+  unsigned int bands;
+  pixelizer_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n;
 
-  uint32_t* dst = outframe;
-  const uint32_t* src = inframe;
-
-
-  if (bsizex == 1 && bsizey == 1)
+  if (inst->block_size_x == 1 && inst->block_size_y == 1)
     {
-      memcpy(dst, src, xsize*ysize*sizeof(uint32_t));
+      if (outframe != inframe)
+        memcpy(outframe, inframe, xsize*ysize*sizeof(uint32_t));
+      return;
     }
 
-  
-  // now get average for every block and write the average color to the output
-  for (yi = 0; yi < blocks_y; ++yi)
-    {	  
-      offset = yi*bsizey*xsize;
-      for (xi = 0; xi < blocks_x; ++xi)
-	{
-	  uint32_t col = average(src + offset, bsizex, bsizey, xsize);
-	  fill_block(dst + offset, bsizex, bsizey, xsize, col);
-	  offset += bsizex;
-	}
-      if (xrest > 0)
-	{
-	  uint32_t col = average(src + offset, xrest, bsizey, xsize);
-	  fill_block(dst + offset, xrest, bsizey, xsize, col);
-	}
-    }
-  // check for last line
-  if (yrest > 0)
+  bands = (ysize + inst->block_size_y - 1) / inst->block_size_y;
+  n = frei0r_thread_count((long)xsize * ysize);
+  if (n > (int)bands)
+    n = bands;
+  for (i = 0; i < n; ++i)
     {
-      offset = blocks_y*bsizey*xsize;
-      for (xi = 0; xi < blocks_x; ++xi)
-	{
-	  uint32_t col = average(src + offset, bsizex, yrest, xsize);
-	  fill_block(dst + offset, bsizex, yrest, xsize, col);
-	  offset += bsizex;
-	}
-      if (xrest > 0)
-	{
-	  uint32_t col = average(src + offset, xrest, yrest, xsize);
-	  fill_block(dst + offset, xrest, yrest, xsize, col);
-	}
-    } 
+      jobs[i].inst = inst;
+      jobs[i].src = inframe;
+      jobs[i].dst = outframe;
+      jobs[i].band_begin = bands * i / n;
+      jobs[i].band_end = bands * (i + 1) / n;
+      jobs[i].sums = inst->sums + 4 * xsize * i;
+    }
+  frei0r_thread_run(pixelize_bands, jobs, sizeof(pixelizer_job_t), n);
 }
 
 
-static uint32_t average(const uint32_t* start, 
-			int bxsize, int bysize, int xsize)
+/* sums[4*x + c] = sum of byte c of column x over rows rows */
+static void column_sums(uint32_t* sums, const uint32_t* src,
+                        unsigned int xsize, unsigned int rows)
 {
-  const uint32_t* p = start;
-  uint32_t alpha = 0, red = 0, green = 0, blue = 0;
-  uint32_t avg_alpha, avg_red, avg_green, avg_blue;
-  int x, y;
-  const uint32_t* pp;
-  uint32_t c;
-  
-  for (y = 0; y < bysize; ++y)
+  const uint8_t* p;
+  unsigned int x, y;
+
+  memset(sums, 0, sizeof(uint32_t) * 4 * xsize);
+  for (y = 0; y < rows; ++y)
     {
-      pp = p;
-      for (x = 0; x < bxsize; ++x)
-	{
-	  c = *(pp++);
-          alpha += (c & 0xff000000) >> 24;
-	  red   += (c & 0x00ff0000) >> 16;
-	  green += (c & 0x0000ff00) >> 8;
-	  blue  += (c & 0x000000ff);
-	}
-      p += xsize;
+      p = (const uint8_t*)(src + y*xsize);
+      x = 0;
+#if defined(__SSE2__)
+      {
+        const __m128i z = _mm_setzero_si128();
+        __m128i v, lo, hi;
+        __m128i* s;
+
+        for (; x + 4 <= xsize; x += 4)
+          {
+            s = (__m128i*)(sums + 4*x);
+            v = _mm_loadu_si128((const __m128i*)(p + 4*x));
+            lo = _mm_unpacklo_epi8(v, z);
+            hi = _mm_unpackhi_epi8(v, z);
+            _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s),
+                                              _mm_unpacklo_epi16(lo, z)));
+            _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1),
+                                                  _mm_unpackhi_epi16(lo, z)));
+            _mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2),
+                                                  _mm_unpacklo_epi16(hi, z)));
+            _mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3),
+                                                  _mm_unpackhi_epi16(hi, z)));
+          }
+      }
+#endif
+      for (x *= 4; x < 4*xsize; ++x)
+        sums[x] += p[x];
     }
-  
-  avg_alpha = (alpha / (bxsize*bysize)) & 0xff;
-  avg_red   = (red   / (bxsize*bysize)) & 0xff;
-  avg_green = (green / (bxsize*bysize)) & 0xff;
-  avg_blue  = (blue  / (bxsize*bysize)) & 0xff;
-  
-  return (avg_alpha << 24) + (avg_red << 16) + (avg_green << 8) + avg_blue;
 }
 
-static void fill_block(uint32_t* start, int bxsize, int bysize,
-                       int xsize, uint32_t col)
+/* Averages the blocks of a band from its column sums and writes them to
+   the rows of the band. */
+static void fill_band(uint32_t* dst, const uint32_t* sums,
+                      unsigned int xsize, unsigned int rows,
+                      unsigned int bsizex)
 {
-	uint32_t* p = start;
-	int x, y;
-	uint32_t* pp;
-
-	for (y = 0; y < bysize; ++y)
-	{
-		pp = p;
-		for (x = 0; x < bxsize; ++x)
-		{
-			*(pp++) = col;
-		}
-		p += xsize;
-	}
+  unsigned int x0, x1, x, y, c, count;
+  uint32_t total[4], col;
 
-}
+  for (x0 = 0; x0 < xsize; x0 = x1)
+    {
+      x1 = MIN(x0 + bsizex, xsize);
+      total[0] = total[1] = total[2] = total[3] = 0;
+      for (x = x0; x < x1; ++x)
+        for (c = 0; c < 4; ++c)
+          total[c] += sums[4*x + c];
+      count = (x1 - x0) * rows;
+      col = 0;
+      for (c = 0; c < 4; ++c)
+        col |= ((total[c] / count) & 0xff) << (8*c);
 
+      x = x0;
+#if defined(__SSE2__)
+      {
+        const __m128i v = _mm_set1_epi32((int)col);
+        for (; x + 4 <= x1; x += 4)
+          _mm_storeu_si128((__m128i*)(dst + x), v);
+      }
+#endif
+      for (; x < x1; ++x)
+        dst[x] = col;
+    }
+  for (y = 1; y < rows; ++y)
+    memcpy(dst + y*xsize, dst, xsize*sizeof(uint32_t));
+}
@@ -27,6 +27,7 @@
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_lut.h"
 
 typedef struct posterize_instance
 {
@@ -56,6 +57,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* posterize_info)
   posterize_info->explanation = "Posterizes image by reducing the number of colors used in image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -110,12 +118,16 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   posterize_instance_t* inst = (posterize_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
 
   // convert input value 0.0-1.0 to int value 2-50
   double levelsInput = inst->levels * 48.0;
@@ -123,30 +135,24 @@ void f0r_update(f0r_instance_t instance, double time,
   int numLevels = (int)levelsInput;
 
   // create levels table
-  unsigned char levels[256];
+  uint8_t levels[256];
   int i;
   for (i = 0; i < 256; i++)
   {
 		  levels[i] = 255 * (numLevels*i / 256) / (numLevels-1);
   }
 
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  unsigned char r,g,b = 0;
-  while (len--)
-  {
-    r = *src++;
-    g = *src++;
-    b = *src++;
-
-    r = levels[r];
-    g = levels[g];
-    b = levels[b];
-
-    *dst++ = r;
-    *dst++ = g;
-    *dst++ = b;
-    *dst++ = *src++;//copy alpha
-  }
+  frei0r_lut_rgb(levels, outframe + inst->width * row_begin,
+                 inframe + inst->width * row_begin,
+                 inst->width * (row_end - row_begin));
+  return 1;
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  posterize_instance_t* inst = (posterize_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
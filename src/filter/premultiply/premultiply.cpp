@@ -19,6 +19,10 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 class Premultiply : public frei0r::filter
 {
 
@@ -28,6 +32,20 @@ public:
         : m_unpremultiply(0)
     {
         register_param(m_unpremultiply, "unpremultiply", "Whether to unpremultiply instead");
+
+        // (c << 8) / a is (c * m_recip[a]) >> 16 for all 8 bit c and a,
+        // with 2^24 / a rounded up; alpha 0 and 255 keep the colors
+        for (unsigned int a = 0; a < 256; ++a) {
+            uint32_t m = (a > 0 && a < 255) ? ((1u << 24) + a - 1) / a : 1u << 16;
+            m_recip[a] = m;
+#if defined(__SSE2__)
+            // the 16 bit halves of m for the three colors, 1 << 16 for
+            // alpha, as the lanes of a pixel
+            uint64_t hi = m >> 16, lo = m & 0xffff;
+            m_recip_hi[a] = hi | hi << 16 | hi << 32 | (uint64_t)1 << 48;
+            m_recip_lo[a] = lo | lo << 16 | lo << 32;
+#endif
+        }
     }
 
     ~Premultiply()
@@ -38,42 +56,95 @@ public:
                         uint32_t* out,
                         const uint32_t* in)
     {
-        uint8_t *src = (uint8_t*) in;
-        uint8_t *dst = (uint8_t*) out;
-        unsigned int n = width * height + 1;
-        if (!m_unpremultiply) {
-            // premultiply
-            while (--n) {
-                uint8_t a = src[3];
-                dst[0] = (src[0] * a) >> 8;
-                dst[1] = (src[1] * a) >> 8;
-                dst[2] = (src[2] * a) >> 8;
-                dst[3] =  a;
-                src += 4;
-                dst += 4;
-            }
-        } else {
-            // unpremultiply
-            while (--n) {
-                uint8_t a = src[3];
-                if (a > 0 && a < 255) {
-                    dst[0] = MIN((src[0] << 8) / a, 255);
-                    dst[1] = MIN((src[1] << 8) / a, 255);
-                    dst[2] = MIN((src[2] << 8) / a, 255);
-                } else {
-                    dst[0] = src[0];
-                    dst[1] = src[1];
-                    dst[2] = src[2];
-                }
-                dst[3] = a;
-                src += 4;
-                dst += 4;
-            }
-        }
+        if (!m_unpremultiply)
+            premultiply((const uint8_t*) in, (uint8_t*) out, width * height);
+        else
+            unpremultiply((const uint8_t*) in, (uint8_t*) out, width * height);
     }
 
 private:
     bool m_unpremultiply;
+    uint32_t m_recip[256];
+#if defined(__SSE2__)
+    uint64_t m_recip_hi[256];
+    uint64_t m_recip_lo[256];
+#endif
+
+    static void premultiply(const uint8_t* src, uint8_t* dst, unsigned int n)
+    {
+        unsigned int i = 0;
+#if defined(__SSE2__)
+        // four pixels in 16 bit lanes, the colors times alpha and alpha
+        // times 256, shifted down by 8
+        const __m128i z = _mm_setzero_si128();
+        const __m128i colors = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        const __m128i alpha = _mm_set_epi16(256, 0, 0, 0, 256, 0, 0, 0);
+        for (; i + 4 <= n; i += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+            __m128i lo = _mm_unpacklo_epi8(p, z);
+            __m128i hi = _mm_unpackhi_epi8(p, z);
+            __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+            __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+            alo = _mm_or_si128(_mm_and_si128(alo, colors), alpha);
+            ahi = _mm_or_si128(_mm_and_si128(ahi, colors), alpha);
+            lo = _mm_srli_epi16(_mm_mullo_epi16(lo, alo), 8);
+            hi = _mm_srli_epi16(_mm_mullo_epi16(hi, ahi), 8);
+            _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (src += 4 * i, dst += 4 * i; i < n; ++i) {
+            uint8_t a = src[3];
+            dst[0] = (src[0] * a) >> 8;
+            dst[1] = (src[1] * a) >> 8;
+            dst[2] = (src[2] * a) >> 8;
+            dst[3] =  a;
+            src += 4;
+            dst += 4;
+        }
+    }
+
+    void unpremultiply(const uint8_t* src, uint8_t* dst, unsigned int n)
+    {
+        unsigned int i = 0;
+#if defined(__SSE2__)
+        // c * m >> 16 is c * (m >> 16) + (c * (m & 0xffff) >> 16), which
+        // fits 16 bit lanes, then clamped to 255
+        const __m128i z = _mm_setzero_si128();
+        const __m128i c255 = _mm_set1_epi16(255);
+        for (; i + 4 <= n; i += 4) {
+            const uint8_t* s = src + 4 * i;
+            __m128i p = _mm_loadu_si128((const __m128i*)s);
+            __m128i lo = _mm_unpacklo_epi8(p, z);
+            __m128i hi = _mm_unpackhi_epi8(p, z);
+            __m128i mhlo = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((const __m128i*)&m_recip_hi[s[3]]),
+                _mm_loadl_epi64((const __m128i*)&m_recip_hi[s[7]]));
+            __m128i mllo = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((const __m128i*)&m_recip_lo[s[3]]),
+                _mm_loadl_epi64((const __m128i*)&m_recip_lo[s[7]]));
+            __m128i mhhi = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((const __m128i*)&m_recip_hi[s[11]]),
+                _mm_loadl_epi64((const __m128i*)&m_recip_hi[s[15]]));
+            __m128i mlhi = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((const __m128i*)&m_recip_lo[s[11]]),
+                _mm_loadl_epi64((const __m128i*)&m_recip_lo[s[15]]));
+            lo = _mm_add_epi16(_mm_mullo_epi16(lo, mhlo), _mm_mulhi_epu16(lo, mllo));
+            hi = _mm_add_epi16(_mm_mullo_epi16(hi, mhhi), _mm_mulhi_epu16(hi, mlhi));
+            lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, c255));
+            hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, c255));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (src += 4 * i, dst += 4 * i; i < n; ++i) {
+            uint32_t m = m_recip[src[3]];
+            dst[0] = MIN((src[0] * m) >> 16, 255);
+            dst[1] = MIN((src[1] * m) >> 16, 255);
+            dst[2] = MIN((src[2] * m) >> 16, 255);
+            dst[3] = src[3];
+            src += 4;
+            dst += 4;
+        }
+    }
 
 };
 
@@ -81,4 +152,5 @@ frei0r::construct<Premultiply> plugin("Premultiply or Unpremultiply",
                 "Multiply (or divide) each color component by the pixel's alpha value",
                 "Dan Dennedy",
                 0, 2,
-                F0R_COLOR_MODEL_RGBA8888);
+                F0R_COLOR_MODEL_RGBA8888,
+                F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
@@ -26,6 +26,10 @@
 
 #include <iostream>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 union px_t {
 	uint32_t u;
 	unsigned char c[4]; // 0=B, 1=G,2=R,3=A ? i think :P
@@ -34,29 +38,69 @@ union px_t {
 class primaries : public frei0r::filter {
 private:
 	double factor;
+
+	int f;
+	int factor127;
+	int factorTot;
 	
 public:
 	primaries(unsigned int width, unsigned int height) {
 		factor = 1;
+		pointwise = true;
 		register_param(factor, "Factor", "influence of mean px value. > 32 = 0");
+		on_params_changed();
 	}
 	~primaries() {
 	}
 
-	virtual void update(double time,
-	                    uint32_t* out,
-                        const uint32_t* in) {
-		unsigned char mean = 0;
-		
-		int f = factor+1; // f = [2,inf)
-		int factor127 = (f*f-3)*127;
-		int factorTot = f*f;
+	virtual void on_params_changed() {
+		f = factor+1; // f = [2,inf)
+		factor127 = (f*f-3)*127;
+		factorTot = f*f;
 		if (factor127 < 0) {
 			factor127 = 0;
 			factorTot = 3;
 		}
+	}
+
+	virtual bool update_slice(double time,
+	                          uint32_t* out,
+	                          const uint32_t* in,
+	                          unsigned int row_begin,
+	                          unsigned int row_end) {
+		unsigned char mean = 0;
+		unsigned int i = width*row_begin;
+		unsigned int end = width*row_end;
+		
+#if defined(__SSE2__)
+		// the mean is a truncated quotient of at most 255, so c > mean
+		// is c*factorTot > sum + factor127, which needs no division
+		int mul = f > 32 ? 1 : factorTot;
+		if (mul <= 32767) {
+			const __m128i c255 = _mm_set1_epi32(255);
+			const __m128i vmul = _mm_set1_epi32(mul);
+			const __m128i vsum = _mm_set1_epi32(f > 32 ? 0 : 1);
+			const __m128i vadd = _mm_set1_epi32(f > 32 ? 127 : factor127);
+			for (; i + 4 <= end; i += 4) {
+				__m128i p = _mm_loadu_si128((const __m128i*)(in + i));
+				__m128i c0 = _mm_and_si128(p, c255);
+				__m128i c1 = _mm_and_si128(_mm_srli_epi32(p, 8), c255);
+				__m128i c2 = _mm_and_si128(_mm_srli_epi32(p, 16), c255);
+				__m128i m = _mm_add_epi32(_mm_madd_epi16(
+					_mm_add_epi32(_mm_add_epi32(c0, c1), c2), vsum), vadd);
+				__m128i o = _mm_and_si128(p, _mm_set1_epi32((int)0xff000000));
+				o = _mm_or_si128(o, _mm_and_si128(_mm_cmpgt_epi32(_mm_madd_epi16(c0, vmul), m),
+				                                  _mm_set1_epi32(0x000000ff)));
+				o = _mm_or_si128(o, _mm_and_si128(_mm_cmpgt_epi32(_mm_madd_epi16(c1, vmul), m),
+				                                  _mm_set1_epi32(0x0000ff00)));
+				o = _mm_or_si128(o, _mm_and_si128(_mm_cmpgt_epi32(_mm_madd_epi16(c2, vmul), m),
+				                                  _mm_set1_epi32(0x00ff0000)));
+				_mm_storeu_si128((__m128i*)(out + i), o);
+			}
+		}
+#endif
 		
-		for (unsigned int i = 0; i < size; i++) {
+		for (; i < end; i++) {
 			px_t pi;
 			pi.u = in[i];
 			
@@ -70,6 +114,7 @@ public:
 			
 			out[i] = pi.u;
 		}
+		return true;
 	}
 };
 
@@ -28,20 +28,41 @@
 #include <math.h>
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_random.h"
+#include "frei0r_thread.h"
 
-static int MY_MAX_RAND = 32767;// I assume RAND_MAX to be at least this big.
-static double gaussian_lookup[32767];
+#define GAUSS_TABLE_BITS 12
+#define GAUSS_TABLE_SIZE (1 << GAUSS_TABLE_BITS)
+/* pixels per batch of random numbers */
+#define NOISE_CHUNK 256
+
+/* filled once by init_gaussian_lookup() and only read after that */
+static double gaussian_lookup[GAUSS_TABLE_SIZE];
+#ifdef FREI0R_HAVE_PTHREAD
+static pthread_once_t gaussian_once = PTHREAD_ONCE_INIT;
+#else
 static int TABLE_INITED = 0;
-static int next_gaussian_index = 0;
-static int last_in_range = 32766;
+#endif
 
 typedef struct rgbnoise_instance
 {
   unsigned int width;
   unsigned int height;
   double noise;
+  double seed;
+  /* gaussian_lookup scaled by noise */
+  short noise_lookup[GAUSS_TABLE_SIZE];
 } rgbnoise_instance_t;
 
+typedef struct rgbnoise_job
+{
+  f0r_instance_t instance;
+  double time;
+  const uint32_t* inframe;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} rgbnoise_job_t;
+
 
 
 void f0r_deinit()
@@ -55,11 +76,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* rgbnoiseInfo)
   rgbnoiseInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
   rgbnoiseInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   rgbnoiseInfo->major_version = 0; 
-  rgbnoiseInfo->minor_version = 9; 
-  rgbnoiseInfo->num_params =  1; 
+  rgbnoiseInfo->minor_version = 11; 
+  rgbnoiseInfo->num_params =  2; 
   rgbnoiseInfo->explanation = "Adds RGB noise to image.";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch ( param_index ) {
@@ -68,15 +95,29 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 			info->type = F0R_PARAM_DOUBLE;
 			info->explanation = "Amount of noise added";
 			break;
+		case 1:
+			info->name = "seed";
+			info->type = F0R_PARAM_DOUBLE;
+			info->explanation = "Seed of the noise, the same seed and time always give the same frame";
+			break;
 	}
 }
 
+static void scale_lookup(rgbnoise_instance_t* inst)
+{
+  int i;
+  for (i = 0; i < GAUSS_TABLE_SIZE; i++)
+    inst->noise_lookup[i] = (short) CLAMP(inst->noise * gaussian_lookup[i],
+                                          -255.0, 255.0);
+}
+
 f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 {
   rgbnoise_instance_t* inst = (rgbnoise_instance_t*)calloc(1, sizeof(*inst));
   inst->width = width; 
   inst->height = height;
   inst->noise = 0.2;
+  scale_lookup(inst);
   return (f0r_instance_t)inst;
 }
 
@@ -92,7 +133,14 @@ void f0r_set_param_value(f0r_instance_t instance,
 	switch (param_index)
   {
 		case 0:
-			inst->noise = *((double*)param);
+			if (inst->noise != *((double*)param))
+			{
+				inst->noise = *((double*)param);
+				scale_lookup(inst);
+			}
+			break;
+		case 1:
+			inst->seed = *((double*)param);
 			break;
   }
 }
@@ -106,24 +154,27 @@ void f0r_get_param_value(f0r_instance_t instance,
 		case 0:
 			*((double*)param) = inst->noise;
 			break;
+		case 1:
+			*((double*)param) = inst->seed;
+			break;
   }
 }
 
 //-------------------------------------------------------- filter methods
-static inline double nextDouble()
+static inline double nextDouble(frei0r_random_t* r)
 {
-  double val = ((double) rand()) / ((double) RAND_MAX);
+  double val = ((double) frei0r_random_next(r)) / 4294967295.0;
 	return val;
 }
 
-static inline double gauss()
+static inline double gauss(frei0r_random_t* r)
 {
   double u, v, x;
   do
   {
-		  v = nextDouble();
+		  v = nextDouble(r);
 
-		  do u = nextDouble();
+		  do u = nextDouble(r);
 		  while (u == 0);
 
 		  x = 1.71552776992141359295 * (v - 0.5) / u;
@@ -133,84 +184,119 @@ static inline double gauss()
   return x;
 }
 
-static void create_new_lookup_range()
+static inline int addNoise(int sample, int byteNoise)
 {
-    int first, last, tmp;
-    first = rand() % (MY_MAX_RAND - 1);
-    last = rand() % (MY_MAX_RAND - 1);
-    if (first > last)
-    {
-      tmp = last;
-      last = first;
-      first = tmp;
-    }
-    next_gaussian_index = first;
-    last_in_range = last;
-}
+  int noiseSample = sample + byteNoise;
+  noiseSample = CLAMP(noiseSample, 0, 255);
+  return noiseSample;
+}	
 
-static inline double next_gauss()
+static void init_gaussian_lookup(void)
 {
-  next_gaussian_index++;
-  if (next_gaussian_index >= last_in_range)
+  frei0r_random_t r;
+  int i;
+
+  frei0r_random_init(&r, 0, 0);
+  for( i = 0; i < GAUSS_TABLE_SIZE; i++)
   {
-    create_new_lookup_range(); 
+    gaussian_lookup[i] = gauss(&r) * 127.0;
   }
-  return gaussian_lookup[next_gaussian_index];
 }
 
-static inline int addNoise(int sample, double noise)
-{
-  int byteNoise = 0;
-  int noiseSample = 0;
-
-  byteNoise = (int) (noise * next_gauss());
-  noiseSample = sample + byteNoise;
-  noiseSample = CLAMP(noiseSample, 0, 255);
-  return noiseSample;
-}	
-
 int f0r_init()
 {
+#ifdef FREI0R_HAVE_PTHREAD
+  pthread_once(&gaussian_once, init_gaussian_lookup);
+#else
   if (TABLE_INITED == 0)
   {
-    int i;
-    for( i = 0; i < MY_MAX_RAND; i++)
-    {
-      gaussian_lookup[i] = gauss() * 127.0;
-    }
+    init_gaussian_lookup();
     TABLE_INITED = 1;
   }
+#endif
   return 1;
 }
 
-void rgb_noise(f0r_instance_t instance, double time,
-		const uint32_t* inframe, uint32_t* outframe)
+/* Each row takes its noise from its own random stream keyed by the seed
+ * and the time,
+ * two random numbers per pixel give the three table indices from their
+ * upper bits. */
+static void rgb_noise(rgbnoise_instance_t* inst, double time,
+                      const uint32_t* inframe, uint32_t* outframe,
+                      unsigned int row_begin, unsigned int row_end)
 {
-  rgbnoise_instance_t* inst = (rgbnoise_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  const short* lookup = inst->noise_lookup;
+  const uint32_t seed = frei0r_random_frame_seed(inst->seed, time);
+  const uint32_t mask = GAUSS_TABLE_SIZE - 1;
+  uint32_t rnd[2 * NOISE_CHUNK];
+  unsigned int y, x, i, n;
 
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-
-  int sample;
-  double noise = inst->noise;
-  while (len--)
+  for (y = row_begin; y < row_end; y++)
   {
-    sample = *src++;
-    *dst++ = addNoise(sample, noise);
-    sample = *src++;
-    *dst++ = addNoise(sample, noise);
-    sample = *src++;
-    *dst++ = addNoise(sample, noise);
-    *dst++ = *src++;
+    const unsigned char* src = (const unsigned char*)(inframe + inst->width * y);
+    unsigned char* dst = (unsigned char*)(outframe + inst->width * y);
+    frei0r_random_t r;
+
+    frei0r_random_init(&r, seed, y);
+    for (x = 0; x < inst->width; x += NOISE_CHUNK)
+    {
+      n = MIN(inst->width - x, NOISE_CHUNK);
+      frei0r_random_fill(&r, rnd, 2 * n);
+      for (i = 0; i < n; i++)
+      {
+        uint32_t r0 = rnd[2 * i], r1 = rnd[2 * i + 1];
+        dst[0] = addNoise(src[0], lookup[r0 >> (32 - GAUSS_TABLE_BITS)]);
+        dst[1] = addNoise(src[1], lookup[(r0 >> 2) & mask]);
+        dst[2] = addNoise(src[2], lookup[r1 >> (32 - GAUSS_TABLE_BITS)]);
+        dst[3] = src[3];
+        src += 4;
+        dst += 4;
+      }
+    }
   }
 }
 
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  rgbnoise_instance_t* inst = (rgbnoise_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  rgb_noise(inst, time, inframe, outframe, row_begin, row_end);
+  return 1;
+}
+
+static void* rgbnoise_rows(void* arg)
+{
+  rgbnoise_job_t* job = (rgbnoise_job_t*)arg;
+  f0r_update_slice(job->instance, job->time, job->inframe, 0, 0,
+                   job->outframe, job->row_begin, job->row_end, 0);
+  return 0;
+}
+
 //---------------------------------------------------- update
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
   assert(instance);
-  rgb_noise(instance, time, inframe, outframe);
+  rgbnoise_instance_t* inst = (rgbnoise_instance_t*)instance;
+  rgbnoise_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].instance = instance;
+    jobs[i].time = time;
+    jobs[i].inframe = inframe;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(rgbnoise_rows, jobs, sizeof(rgbnoise_job_t), n);
 }
 
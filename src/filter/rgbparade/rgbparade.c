@@ -22,11 +22,17 @@
 #include <math.h>
 #include <assert.h>
 #include "frei0r.h"
+#include "frei0r_math.h"
 
 #include <gavl/gavl.h>
 
+#include "frei0r_scope.h"
+#include "frei0r_thread.h"
 #include "rgbparade_image.h"
 
+/* the graticule, decoded while there are instances */
+static frei0r_rle_shared_t background = { &rgbparade_image };
+
 #define OFFSET_R        0
 #define OFFSET_G        8
 #define OFFSET_B        16
@@ -34,21 +40,33 @@
 
 #define PARADE_HEIGHT	256
 #define PARADE_STEP	5
-
-typedef struct {
-	double red, green, blue;
-} rgb_t;
+#define PARADE_STRIP	192	/* image columns accumulated at a time */
 
 typedef struct rgbparade {
 	int w, h;
 	unsigned char* scala;
-	gavl_video_scaler_t* parade_scaler;
-	gavl_video_frame_t* parade_frame_src;
-	gavl_video_frame_t* parade_frame_dst;
+	frei0r_scope_mask_t mask;         /* where scala isn't transparent */
+	int parade_x, parade_y, parade_w, parade_h; /* where the parade is drawn */
+	frei0r_scope_tap_t* taps_x;
+	frei0r_scope_tap_t* taps_y;
+	uint8_t* parade;                  /* w x PARADE_HEIGHT, a plane per channel */
+	int threads;
+	uint16_t* cols;                   /* the parade resampled to parade_w */
+	uint8_t* rows;                    /* three rows of the parade per thread */
 	double mix;
 	double overlay_sides;
 } rgbparade_t;
 
+typedef struct rgbparade_job {
+	rgbparade_t* inst;
+	const uint32_t* src;
+	uint32_t* dst;
+	uint8_t* rows;
+	int x0, x1;                       /* columns of the frame */
+	int j0, j1;                       /* rows of the parade */
+	int y0, y1;                       /* rows of the frame */
+} rgbparade_job_t;
+
 int f0r_init()
 {
 	return 1;
@@ -64,7 +82,7 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->color_model = F0R_COLOR_MODEL_RGBA8888;
 	info->frei0r_version = FREI0R_MAJOR_VERSION;
 	info->major_version = 0; 
-	info->minor_version = 2; 
+	info->minor_version = 3; 
 	info->num_params =  2; 
 	info->explanation = "Displays a histogram of R, G and B of the video-data";
 }
@@ -91,6 +109,11 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	rgbparade_t* inst = (rgbparade_t*)calloc(1, sizeof(*inst));
 	inst->w = width;
 	inst->h = height;
+	const uint8_t* image = frei0r_rle_acquire( &background );
+	if ( !image ) {
+		free(inst);
+		return NULL;
+	}
 	
 	inst->mix = 0.0;
 	inst->overlay_sides = 1.0;
@@ -147,7 +170,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	gavl_video_options_set_rectangles( options, &src_rect, &dst_rect );
 	gavl_video_scaler_init( video_scaler, &format_src, &format_dst );
 	
-	frame_src->planes[0] = (uint8_t *)rgbparade_image.pixel_data;
+	frame_src->planes[0] = (uint8_t *)image;
 	frame_dst->planes[0] = (uint8_t *)inst->scala;
 	
 	/* Pad the source image to make the stride a multiple of 16. */
@@ -166,38 +189,20 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	gavl_video_frame_destroy( frame_dst );
 	gavl_video_frame_destroy( padded );
 	
-	options = gavl_video_scaler_get_options( inst->parade_scaler );
-	
-	inst->parade_scaler = gavl_video_scaler_create();
-	inst->parade_frame_src = gavl_video_frame_create(0);
-	inst->parade_frame_dst = gavl_video_frame_create(0);
-	inst->parade_frame_src->strides[0] = width * 4;
-	inst->parade_frame_dst->strides[0] = width * 4;
-	options = gavl_video_scaler_get_options( inst->parade_scaler );
-	
-	format_src.frame_width  = width;
-	format_src.frame_height = PARADE_HEIGHT;
-	format_src.image_width  = width;
-	format_src.image_height = PARADE_HEIGHT;
-	format_src.pixel_width = 1;
-	format_src.pixel_height = 1;
-	format_src.pixelformat = GAVL_RGBA_32;
-	format_dst.frame_width  = width;
-	format_dst.frame_height = height;
-	format_dst.image_width  = width;
-	format_dst.image_height = height;
-	format_dst.pixel_width = 1;
-	format_dst.pixel_height = 1;
-	format_dst.pixelformat = GAVL_RGBA_32;
-	
-	gavl_rectangle_f_set_all( &src_rect, &format_src );
-	dst_rect.x = width * 0.05;
-	dst_rect.y = height * 0.011;
-	dst_rect.w = width * 0.9;
-	dst_rect.h = height * 0.978;
-	
-	gavl_video_options_set_rectangles( options, &src_rect, &dst_rect );
-	gavl_video_scaler_init( inst->parade_scaler, &format_src, &format_dst );
+	frei0r_scope_mask_init( &inst->mask, inst->scala, width, height );
+	
+	inst->parade_x = width * 0.05;
+	inst->parade_y = height * 0.011;
+	inst->parade_w = width * 0.9;
+	inst->parade_h = height * 0.978;
+	inst->taps_x = (frei0r_scope_tap_t*)malloc( inst->parade_w * sizeof(frei0r_scope_tap_t) );
+	inst->taps_y = (frei0r_scope_tap_t*)malloc( inst->parade_h * sizeof(frei0r_scope_tap_t) );
+	frei0r_scope_taps( inst->taps_x, inst->parade_w, width );
+	frei0r_scope_taps( inst->taps_y, inst->parade_h, PARADE_HEIGHT );
+	inst->parade = (uint8_t*)malloc( 3 * width * PARADE_HEIGHT );
+	inst->threads = frei0r_thread_count( width * height );
+	inst->cols = (uint16_t*)malloc( 3 * PARADE_HEIGHT * inst->parade_w * sizeof(uint16_t) );
+	inst->rows = (uint8_t*)malloc( inst->threads * 3 * inst->parade_w );
 	
 	return (f0r_instance_t)inst;
 }
@@ -205,11 +210,14 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 void f0r_destruct(f0r_instance_t instance)
 {
 	rgbparade_t* inst = (rgbparade_t*)instance;
-	gavl_video_scaler_destroy( inst->parade_scaler );
-	gavl_video_frame_null( inst->parade_frame_src );
-	gavl_video_frame_destroy( inst->parade_frame_src );
-	gavl_video_frame_null( inst->parade_frame_dst );
-	gavl_video_frame_destroy( inst->parade_frame_dst );
+	frei0r_rle_release( &background );
+	free(inst->scala);
+	frei0r_scope_mask_free(&inst->mask);
+	free(inst->taps_x);
+	free(inst->taps_y);
+	free(inst->parade);
+	free(inst->cols);
+	free(inst->rows);
 	free(inst);
 }
 
@@ -268,111 +276,133 @@ void draw_grid(unsigned char* scope, double width, double height)
 	}
 }
 
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+/* Adds the pixels of the columns of a job to the parade, each channel in
+ * its third. A column of the parade takes three columns of the image, the
+ * columns of a job are whole triples so that the jobs don't share any.
+ * The image is read in strips of PARADE_STRIP columns, whose columns of
+ * the parade stay in the cache. The values of the parade are multiples of
+ * PARADE_STEP, so adding it up to the limit is taking the minimum. */
+static void* accumulate(void* arg)
 {
-	assert(instance);
-	rgbparade_t* inst = (rgbparade_t*)instance;
-	
-	int width = inst->w;
-	int height = inst->h;
-	double mix = inst->mix;
-	int len = inst->w * inst->h;
-	int parade_len = width * PARADE_HEIGHT;
-	
-	uint32_t* dst = outframe;
-	uint32_t* dst_end;
-	const uint32_t* src = inframe;
-	const uint32_t* src_end;
-	uint32_t* parade = (uint32_t*)malloc( parade_len * 4 );
-	uint32_t* parade_end;
-	
-	long src_x, src_y;
-	long x, y;
-	rgb_t rgb;
+	rgbparade_job_t* job = (rgbparade_job_t*)arg;
+	int width = job->inst->w;
+	int height = job->inst->h;
+	int third = width / 3;
+	uint8_t* red = job->inst->parade;
+	uint8_t* green = red + width * PARADE_HEIGHT + third;
+	uint8_t* blue = green + width * PARADE_HEIGHT + third;
+	const uint32_t* src;
 	uint8_t* pixel;
-	
-	dst_end = dst + len;
-	src_end = src + len;
-	parade_end = parade + parade_len;
-	
-	if ( inst->overlay_sides > 0.5) {
-		while ( dst < dst_end ) {
-			*(dst++) = 0xFF000000;
-		}
-	} else {
-		while ( dst < dst_end ) {
-			*(dst++) = *(src++);
-		}
-		src -= len;
-	}
-	
-	dst = outframe;
-	while ( parade < parade_end ) {
-		*(parade++) = 0xFF000000;
-	}
-	parade -= parade_len;
-	
-	for ( src_y = 0; src_y < height; src_y++ ) {
-		for ( src_x = 0; src_x < width; src_x++ ) {
-			rgb.red = (((*src) & 0x000000FF) >> OFFSET_R);
-			rgb.green = (((*src) & 0x0000FF00) >> OFFSET_G);
-			rgb.blue = (((*src) & 0x00FF0000) >> OFFSET_B);
-			src++;		
-			x = src_x / 3;
-			y = PARADE_HEIGHT - rgb.red - 1;
-			if ( x >= 0 && x < width && y >= 0 && y < PARADE_HEIGHT ) {
-				pixel = (uint8_t*)&parade[x+width*y];
-				if ( pixel[0] < (255-PARADE_STEP) ) pixel[0] += PARADE_STEP;
-			}
-			x += width / 3;
-			y = PARADE_HEIGHT - rgb.green - 1;
-			if ( x >= 0 && x < width && y >= 0 && y < PARADE_HEIGHT ) {
-				pixel = (uint8_t*)&parade[x+width*y];
-				if ( pixel[1] < (255-PARADE_STEP) ) pixel[1] += PARADE_STEP;
-			}
-			x += width / 3;
-			y = PARADE_HEIGHT - rgb.blue - 1;
-			if ( x >= 0 && x < width && y >= 0 && y < PARADE_HEIGHT ) {
-				pixel = (uint8_t*)&parade[x+width*y];
-				if ( pixel[2] < (255-PARADE_STEP) ) pixel[2] += PARADE_STEP;
+	int src_x, src_y, strip, strip_end;
+	long x;
+	
+	for ( strip = job->x0; strip < job->x1; strip += PARADE_STRIP ) {
+		strip_end = MIN(strip + PARADE_STRIP, job->x1);
+		for ( src_y = 0; src_y < height; src_y++ ) {
+			src = job->src + (long)src_y * width;
+			for ( src_x = strip; src_x < strip_end; src_x++ ) {
+				x = src_x / 3 + width * (PARADE_HEIGHT - 1);
+				pixel = &red[x - width * (((src[src_x]) & 0x000000FF) >> OFFSET_R)];
+				*pixel = MIN(*pixel + PARADE_STEP, 255-PARADE_STEP);
+				pixel = &green[x - width * (((src[src_x]) & 0x0000FF00) >> OFFSET_G)];
+				*pixel = MIN(*pixel + PARADE_STEP, 255-PARADE_STEP);
+				pixel = &blue[x - width * (((src[src_x]) & 0x00FF0000) >> OFFSET_B)];
+				*pixel = MIN(*pixel + PARADE_STEP, 255-PARADE_STEP);
 			}
 		}
 	}
-	
-	inst->parade_frame_src->planes[0] = (uint8_t *)parade;
-	inst->parade_frame_dst->planes[0] = (uint8_t *)dst;
-	
-	gavl_video_scaler_scale( inst->parade_scaler, inst->parade_frame_src, inst->parade_frame_dst );
-	
-	unsigned char *scala8, *dst8, *dst8_end, *src8;
-	
-	scala8 = inst->scala;
-	src8 = (unsigned char*)inframe;
-	dst8 = (unsigned char*)outframe;
-	dst8_end = dst8 + ( len * 4 );
-	if (mix > 0.001 ) { // to not lose performance for non-mixing users
-		while ( dst8 < dst8_end ) {
-			dst8[0] = ( ( ( scala8[0] - dst8[0] ) * 255 * scala8[3] ) >> 16 ) + dst8[0];
-			dst8[1] = ( ( ( scala8[1] - dst8[1] ) * 255 * scala8[3] ) >> 16 ) + dst8[1];
-			dst8[2] = ( ( ( scala8[2] - dst8[2] ) * 255 * scala8[3] ) >> 16 ) + dst8[2];
-			if (dst8[0] == 0 && dst8[1] == 0 && dst8[2] == 0){
-				dst8[0] = src8[0] * mix;
-				dst8[1] = src8[1] * mix;
-				dst8[2] = src8[2] * mix;
-			}
-			scala8 += 4;
-			dst8 += 4;
-			src8 += 4;
+	return 0;
+}
+
+/* Resamples the rows of the parade of a job to parade_w. */
+static void* columns(void* arg)
+{
+	rgbparade_job_t* job = (rgbparade_job_t*)arg;
+	rgbparade_t* inst = job->inst;
+	int c;
+	for ( c = 0; c < 3; c++ )
+		frei0r_scope_columns( inst->cols + c * PARADE_HEIGHT * inst->parade_w,
+		                      inst->parade + c * inst->w * PARADE_HEIGHT, inst->w,
+		                      job->j0, job->j1, inst->taps_x, inst->parade_w );
+	return 0;
+}
+
+/* Draws the sides, the parade and the graticule into the rows of a job. */
+static void* render(void* arg)
+{
+	rgbparade_job_t* job = (rgbparade_job_t*)arg;
+	rgbparade_t* inst = job->inst;
+	int width = inst->w;
+	int x0 = inst->parade_x, x1 = inst->parade_x + inst->parade_w;
+	int y0 = inst->parade_y, y1 = inst->parade_y + inst->parade_h;
+	uint8_t* red = job->rows;
+	uint8_t* green = red + inst->parade_w;
+	uint8_t* blue = green + inst->parade_w;
+	double mix = inst->mix;
+	int x, y, c;
+	
+	for ( y = job->y0; y < job->y1; y++ ) {
+		const uint32_t* src = job->src + (long)y * width;
+		uint32_t* dst = job->dst + (long)y * width;
+		
+		if ( inst->overlay_sides > 0.5) {
+			for ( x = 0; x < width; x++ )
+				dst[x] = 0xFF000000;
+		} else if ( dst != src ) {
+			memcpy( dst, src, width * sizeof(uint32_t) );
+		}
+		if ( y >= y0 && y < y1 ) {
+			for ( c = 0; c < 3; c++ )
+				frei0r_scope_sample( job->rows + c * inst->parade_w,
+				                     inst->cols + c * PARADE_HEIGHT * inst->parade_w,
+				                     inst->parade_w, inst->taps_y[y - y0] );
+			for ( x = x0; x < x1; x++ )
+				dst[x] = 0xFF000000 | (red[x - x0] << OFFSET_R)
+					| (green[x - x0] << OFFSET_G) | (blue[x - x0] << OFFSET_B);
 		}
-	} else {
-		while ( dst8 < dst8_end ) {
-			dst8[0] = ( ( ( scala8[0] - dst8[0] ) * 255 * scala8[3] ) >> 16 ) + dst8[0];
-			dst8[1] = ( ( ( scala8[1] - dst8[1] ) * 255 * scala8[3] ) >> 16 ) + dst8[1];
-			dst8[2] = ( ( ( scala8[2] - dst8[2] ) * 255 * scala8[3] ) >> 16 ) + dst8[2];
-			scala8 += 4;
-			dst8 += 4;
+		frei0r_scope_over( dst, inst->scala, &inst->mask, y, width );
+		
+		if (mix > 0.001 ) { // to not lose performance for non-mixing users
+			const unsigned char* src8 = (const unsigned char*)src;
+			unsigned char* dst8 = (unsigned char*)dst;
+			for ( x = 0; x < width; x++, src8 += 4, dst8 += 4 ) {
+				if (dst8[0] == 0 && dst8[1] == 0 && dst8[2] == 0){
+					dst8[0] = src8[0] * mix;
+					dst8[1] = src8[1] * mix;
+					dst8[2] = src8[2] * mix;
+				}
+			}
 		}
 	}
-	free(parade);
+	return 0;
 }
 
+/* The parade is accumulated into a grid of the width of the image and
+ * PARADE_HEIGHT, split over threads by columns, resampled to the width it
+ * is drawn at and drawn straight into the output together with the
+ * background, in one pass over the output rows. */
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+	assert(instance);
+	rgbparade_t* inst = (rgbparade_t*)instance;
+	rgbparade_job_t jobs[FREI0R_MAX_THREADS];
+	int i, n = inst->threads;
+	int triples = (inst->w + 2) / 3;
+	
+	memset( inst->parade, 0, 3 * inst->w * PARADE_HEIGHT );
+	for ( i = 0; i < n; i++ ) {
+		jobs[i].inst = inst;
+		jobs[i].src = inframe;
+		jobs[i].dst = outframe;
+		jobs[i].rows = inst->rows + i * 3 * inst->parade_w;
+		jobs[i].x0 = 3 * (triples * i / n);
+		jobs[i].x1 = MIN(3 * (triples * (i + 1) / n), inst->w);
+		jobs[i].j0 = PARADE_HEIGHT * i / n;
+		jobs[i].j1 = PARADE_HEIGHT * (i + 1) / n;
+		jobs[i].y0 = inst->h * i / n;
+		jobs[i].y1 = inst->h * (i + 1) / n;
+	}
+	frei0r_thread_run( accumulate, jobs, sizeof(rgbparade_job_t), n );
+	frei0r_thread_run( columns, jobs, sizeof(rgbparade_job_t), n );
+	frei0r_thread_run( render, jobs, sizeof(rgbparade_job_t), n );
+}
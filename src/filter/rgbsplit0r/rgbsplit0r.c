@@ -19,10 +19,17 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
 
 #include "frei0r.h"
+#include "frei0r_math.h"
+#include "frei0r_thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 typedef struct rgbsplit0r_instance
 {
@@ -34,33 +41,91 @@ typedef struct rgbsplit0r_instance
 } rgbsplit0r_instance_t;
 
 
-inline static void rgbsplit0r_extract_color(uint32_t *pixelIn, uint32_t *pixelOut,
-                                            short int colorIndex)
+typedef struct rgbsplit0r_job
+{
+    f0r_instance_t instance;
+    const uint32_t* inframe;
+    uint32_t* outframe;
+    unsigned int row_begin, row_end;
+} rgbsplit0r_job_t;
+
+// n pixels with the green of g, the blue of b and the red of r, each
+// layer with its alpha, which are or-ed; b and r may be 0 where their
+// layers are shifted out of the frame
+static void rgbsplit0r_merge(uint32_t* dst, const uint32_t* g,
+                             const uint32_t* b, const uint32_t* r,
+                             unsigned int n)
 {
-    uint8_t *pxIn  = (uint8_t *)pixelIn,
-            *pxOut = (uint8_t *)pixelOut;
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i maskG = _mm_set1_epi32((int)0xff00ff00);
+    const __m128i maskB = _mm_set1_epi32((int)0xffff0000);
+    const __m128i maskR = _mm_set1_epi32((int)0xff0000ff);
 
-    switch (colorIndex)
+    for (; i + 4 <= n; i += 4)
     {
-        case 0 :
-            pxOut[0] = pxIn[0];
-            pxOut[1] = 0;
-            pxOut[2] = 0;
-            break;
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(g + i)),
+                                  maskG);
+        if (b)
+            v = _mm_or_si128(v, _mm_and_si128(
+                    _mm_loadu_si128((const __m128i*)(b + i)), maskB));
+        if (r)
+            v = _mm_or_si128(v, _mm_and_si128(
+                    _mm_loadu_si128((const __m128i*)(r + i)), maskR));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#endif
 
-        case 1 :
-            pxOut[1] = pxIn[1];
-            pxOut[0] = 0;
-            pxOut[2] = 0;
-            break;
+    for (; i < n; i++)
+        dst[i] = (g[i] & 0xff00ff00)
+            | (b ? b[i] & 0xffff0000 : 0)
+            | (r ? r[i] & 0xff0000ff : 0);
+}
 
-        case 2 :
-            pxOut[2] = pxIn[2];
-            pxOut[1] = 0;
-            pxOut[0] = 0;
-            break;
+// Row y: the blue layer is shifted back, the red one forward and the
+// green one is on its place. The row is cut where the shifted layers
+// begin and end, so each segment merges whole runs of the rows.
+static void rgbsplit0r_row(const rgbsplit0r_instance_t* inst,
+                           const char* src, int src_stride,
+                           uint32_t* dst, unsigned int y)
+{
+    const int w = inst->width, h = inst->height;
+    const int sx = (int)inst->shiftX, sy = (int)inst->shiftY;
+    const int yb = (int)y - sy, yr = (int)y + sy;
+    const uint32_t* g = (const uint32_t*)(src + (ptrdiff_t)src_stride * y);
+    const uint32_t* rowB = (yb >= 0 && yb < h) ?
+        (const uint32_t*)(src + (ptrdiff_t)src_stride * yb) : 0;
+    const uint32_t* rowR = (yr >= 0 && yr < h) ?
+        (const uint32_t*)(src + (ptrdiff_t)src_stride * yr) : 0;
+    // where x - sx and x + sx are inside the frame
+    const int beginB = MAX(0, sx), endB = MIN(w, w + sx);
+    const int beginR = MAX(0, -sx), endR = MIN(w, w - sx);
+    int cut[6] = { 0, w, CLAMP(beginB, 0, w), CLAMP(endB, 0, w),
+                   CLAMP(beginR, 0, w), CLAMP(endR, 0, w) };
+    int i, j;
+
+    for (i = 1; i < 6; i++)
+        for (j = i; j > 0 && cut[j - 1] > cut[j]; j--)
+        {
+            int t = cut[j];
+            cut[j] = cut[j - 1];
+            cut[j - 1] = t;
+        }
+
+    for (i = 0; i < 5; i++)
+    {
+        const int x0 = cut[i], x1 = cut[i + 1];
+
+        if (x0 == x1)
+            continue;
+        rgbsplit0r_merge(dst + x0, g + x0,
+                         (rowB && x0 >= beginB && x0 < endB) ?
+                             rowB + (x0 - sx) : 0,
+                         (rowR && x0 >= beginR && x0 < endR) ?
+                             rowR + (x0 + sx) : 0,
+                         x1 - x0);
     }
-    pxOut[3] = pxIn[3];
 }
 
 int f0r_init()
@@ -84,6 +149,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* rgbsplit0rInfo)
     rgbsplit0rInfo->explanation = "RGB splitting and shifting";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+    f0r_get_plugin_info(&info->info);
+    info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
     switch(param_index) {
@@ -182,43 +253,67 @@ void f0r_get_param_value(f0r_instance_t instance,
 }
 
 
-void f0r_update(f0r_instance_t instance, double time,
-		const uint32_t* src, uint32_t* dst)
+int f0r_update_stride(f0r_instance_t instance, double time,
+                      const uint32_t* inframe1, int inframe1_stride,
+                      const uint32_t* inframe2, int inframe2_stride,
+                      const uint32_t* inframe3, int inframe3_stride,
+                      uint32_t* outframe, int outframe_stride)
 {
     assert(instance);
     rgbsplit0r_instance_t* inst = (rgbsplit0r_instance_t*)instance;
-    unsigned int x, y;
+    unsigned int y;
 
     for (y = 0; y < inst->height; y++)
-        for (x = 0; x < inst->width; x++)
-        {
-            uint32_t pxR = 0, pxG = 0, pxB = 0;
-
-            // First make a blue layer shifted back
-            if (((x - inst->shiftX) < inst->width) &&
-                ((y - inst->shiftY) < inst->height))
-            {
-                rgbsplit0r_extract_color((uint32_t *)(src +
-                    (x - inst->shiftX) +
-                    (y - inst->shiftY)*inst->width),
-                    &pxB, 2);
-            }
-
-            // The red layer is shifted forward
-            if ((x + inst->shiftX < inst->width) &&
-                (y + inst->shiftY < inst->height))
-            {
-                rgbsplit0r_extract_color((uint32_t *)(src +
-                    (x + inst->shiftX) +
-                    (y + inst->shiftY)*inst->width),
-                    &pxR, 0);
-            }
-
-            // Green layer is on its place
-            rgbsplit0r_extract_color((uint32_t *)(src + x + (y*inst->width)),
-                    &pxG, 1);
-
-            *(dst + x + (y*inst->width)) = (pxG | pxB | pxR);
-        }
+        rgbsplit0r_row(inst, (const char*)inframe1, inframe1_stride,
+                       (uint32_t*)((char*)outframe +
+                                   (ptrdiff_t)outframe_stride * y), y);
+
+    return 1;
 }
 
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+    assert(instance);
+    rgbsplit0r_instance_t* inst = (rgbsplit0r_instance_t*)instance;
+    unsigned int y;
+
+    if (row_begin > row_end || row_end > inst->height)
+        return 0;
+
+    for (y = row_begin; y < row_end; y++)
+        rgbsplit0r_row(inst, (const char*)inframe,
+                       inst->width * sizeof(uint32_t),
+                       outframe + inst->width * y, y);
+    return 1;
+}
+
+static void* rgbsplit0r_rows(void* arg)
+{
+    rgbsplit0r_job_t* job = (rgbsplit0r_job_t*)arg;
+    f0r_update_slice(job->instance, 0, job->inframe, 0, 0,
+                     job->outframe, job->row_begin, job->row_end, 0);
+    return 0;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+		const uint32_t* src, uint32_t* dst)
+{
+    assert(instance);
+    rgbsplit0r_instance_t* inst = (rgbsplit0r_instance_t*)instance;
+    rgbsplit0r_job_t jobs[FREI0R_MAX_THREADS];
+    int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+    for (i = 0; i < n; ++i)
+    {
+        jobs[i].instance = instance;
+        jobs[i].inframe = src;
+        jobs[i].outframe = dst;
+        jobs[i].row_begin = inst->height * i / n;
+        jobs[i].row_end = inst->height * (i + 1) / n;
+    }
+    frei0r_thread_run(rgbsplit0r_rows, jobs, sizeof(rgbsplit0r_job_t), n);
+}
@@ -19,19 +19,27 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
-
-#define MAX_SATURATION 8.0
+#include "frei0r_grade.h"
 
 typedef struct saturat0r_instance
 {
   unsigned int width;
   unsigned int height;
   double saturation; /* the saturation value [0, 1] */
+  frei0r_colormatrix_t cm;
+  int identity; /* the matrix changes nothing */
 } saturat0r_instance_t;
 
+static void update_matrix(saturat0r_instance_t *inst)
+{
+  frei0r_grade_saturation(&inst->cm, inst->saturation);
+  inst->identity = frei0r_colormatrix_is_identity(&inst->cm);
+}
+
 int f0r_init()
 {
   return 1;
@@ -53,6 +61,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* saturat0r_info)
   saturat0r_info->explanation = "Adjusts the saturation of a source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -69,7 +83,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 {
   saturat0r_instance_t* inst = (saturat0r_instance_t*)calloc(1, sizeof(*inst));
   inst->width = width; inst->height = height;
-  inst->saturation=1.0/MAX_SATURATION;
+  inst->saturation=1.0/FREI0R_GRADE_MAX_SATURATION;
+  update_matrix(inst);
   return (f0r_instance_t)inst;
 }
 
@@ -89,6 +104,7 @@ void f0r_set_param_value(f0r_instance_t instance,
   case 0:
     /* saturations */
     inst->saturation =  *((double*)param);
+    update_matrix(inst);
     break;
   }
 }
@@ -107,57 +123,42 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   saturat0r_instance_t* inst = (saturat0r_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
-  double saturation = inst->saturation * MAX_SATURATION;
-  
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-
-  double one_minus_saturation = 1.0-saturation;
-  int bwgt = (int)(7471.0  * one_minus_saturation);
-  int gwgt = (int)(38470.0 * one_minus_saturation);
-  int rwgt = (int)(19595.0 * one_minus_saturation);
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
 
-  int b, g, r, bw;
+  unsigned int len = inst->width * (row_end - row_begin);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
 
-  if (0 <= saturation && saturation <=1) // optimisation: no clamping needed
-  {
-    while (len--)
-    {
-      b = *src++;
-      g = *src++;
-      r = *src++;
-      
-      bw = (b*bwgt + g*gwgt + r*rwgt) >> 16;
-      
-      *dst++ = (unsigned char) (bw + b*saturation);
-      *dst++ = (unsigned char) (bw + g*saturation);
-      *dst++ = (unsigned char) (bw + r*saturation);
-
-      *dst++ = *src++;  // copy alpha
-    }
-  }
-  else
+  if (inst->identity)
   {
-    while (len--)
-    {
-      b = *src++;
-      g = *src++;
-      r = *src++;
-
-      bw = (b*bwgt + g*gwgt + r*rwgt) >> 16;
-      
-      *dst++ = CLAMP0255((int) (bw + b*saturation));
-      *dst++ = CLAMP0255((int) (bw + g*saturation));
-      *dst++ = CLAMP0255((int) (bw + r*saturation));
-
-      *dst++ = *src++;  // copy alpha
-    }
+    if (outframe != inframe)
+      memcpy(outframe, inframe, len * sizeof(uint32_t));
+    return 1;
   }
+  frei0r_colormatrix_apply(&inst->cm, outframe, inframe, len);
+  return 1;
+}
+
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  saturat0r_instance_t* inst = (saturat0r_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
 }
 
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return ((saturat0r_instance_t*)instance)->identity;
+}
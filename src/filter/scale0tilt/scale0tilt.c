@@ -17,27 +17,337 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+/* Scales with its own separable scaler: a horizontal and a vertical pass
+ * of a triangle filter, as wide as a source pixel when enlarging and as
+ * a destination pixel when shrinking. The taps and their weights for each
+ * destination column and row are computed when the rectangles change and
+ * kept, the passes are SSE2 and split over threads by bands of rows.
+ * Built with SCALE0TILT_GAVL (the CMake option SCALE0TILT_GAVL), gavl's
+ * scaler is used instead, as before.
+ */
+
 #include <math.h>
 #include "frei0r.h"
-#include <gavl/gavl.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef SCALE0TILT_GAVL
+#include <gavl/gavl.h>
+#else
+#include <stdint.h>
+#include "frei0r_thread.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
 
 #define EPSILON 1e-6
 
+#ifndef SCALE0TILT_GAVL
+
+/* fractional bits of the weights and of the result of the horizontal pass */
+#define COEF_BITS 14
+#define MID_BITS 6
+/* destination rows per band of the vertical pass */
+#define BAND 32
+
+/* The taps of one axis: destination pixel i is the sum of coef[i*taps+k]
+ * times source pixel lo + start[i] + k, for k < taps. Source pixels
+ * outside first..last are those at the edge. */
+typedef struct scaler_axis {
+	/* what the table was made for */
+	float src_pos, src_size;
+	int dst_size, frame_size;
+	int first, last;
+	int lo;         /* source pixel of start 0, may be outside the frame */
+	int span;       /* source pixels from lo on the taps read */
+	int taps;       /* per destination pixel, even */
+	int copy;       /* destination pixel i is source pixel first + i */
+	int* start;
+	int16_t* coef;
+} scaler_axis_t;
+
+#endif
+
 typedef struct scale0tilt_instance {
 	double cl, ct, cr, cb;
 	double sx, sy;
 	double tx, ty;
 	int w, h;
+	int do_scale;
+#ifdef SCALE0TILT_GAVL
 	gavl_video_scaler_t* video_scaler;
 	gavl_video_frame_t* frame_src;
 	gavl_video_frame_t* frame_dst;
-	int do_scale;
 	gavl_video_format_t format_src;
 	gavl_video_frame_t* padded;
+	gavl_rectangle_f_t src_rect;
+	gavl_rectangle_i_t dst_rect;
+#else
+	int dst_x, dst_y;
+	scaler_axis_t ax, ay;
+	int band_span;  /* source rows of the most a band reads */
+	/* per thread: the horizontal results of a band, a padded source row */
+	void* scratch;
+	size_t scratch_size;
+#endif
 } scale0tilt_instance_t;
 
+#ifndef SCALE0TILT_GAVL
+
+/* Makes the taps of the axis for the source pixels pos to pos + size of a
+ * frame of frame_size pixels shown on dst_size pixels, unless it was made
+ * for those already. Returns 0 if out of memory. */
+static int axis_prepare(scaler_axis_t* a, float pos, float size,
+                        int dst_size, int frame_size)
+{
+	double scale = (double)size / dst_size;
+	double r = scale > 1.0 ? scale : 1.0;
+	int i, k, taps, hi = 0;
+	double w[512];
+	int* start;
+	int16_t* coef;
+
+	if (a->start && a->src_pos == pos && a->src_size == size &&
+	    a->dst_size == dst_size && a->frame_size == frame_size)
+		return 1;
+
+	taps = ((int)ceil(2.0 * r) + 2) & ~1;
+	if (taps > (int)(sizeof(w) / sizeof(w[0])))
+		taps = sizeof(w) / sizeof(w[0]);
+	start = (int*)malloc(dst_size * sizeof(int));
+	coef = (int16_t*)malloc((size_t)dst_size * taps * sizeof(int16_t));
+	if (!start || !coef) {
+		free(start);
+		free(coef);
+		return 0;
+	}
+	free(a->start);
+	free(a->coef);
+	a->start = start;
+	a->coef = coef;
+	a->src_pos = pos;
+	a->src_size = size;
+	a->dst_size = dst_size;
+	a->frame_size = frame_size;
+	a->taps = taps;
+
+	a->first = (int)floor(pos);
+	a->last = (int)ceil(pos + size) - 1;
+	if (a->first < 0)
+		a->first = 0;
+	if (a->last > frame_size - 1)
+		a->last = frame_size - 1;
+	if (a->first > a->last)
+		a->first = a->last;
+
+	for (i = 0; i < dst_size; i++) {
+		/* the centre of destination pixel i in source pixels */
+		double c = pos + (i + 0.5) * scale - 0.5;
+		int first = (int)floor(c - r) + 1;
+		double sum = 0.0;
+		int total = 0, big = 0;
+
+		if (i == 0)
+			a->lo = hi = first;
+
+		for (k = 0; k < taps; k++) {
+			double d = fabs(first + k - c) / r;
+			w[k] = d < 1.0 ? 1.0 - d : 0.0;
+			sum += w[k];
+		}
+		for (k = 0; k < taps; k++) {
+			coef[i * taps + k] = (int16_t)lrint(w[k] / sum * (1 << COEF_BITS));
+			total += coef[i * taps + k];
+			if (coef[i * taps + k] > coef[i * taps + big])
+				big = k;
+		}
+		/* the weights add up to one exactly */
+		coef[i * taps + big] += (1 << COEF_BITS) - total;
+		start[i] = first - a->lo;
+		if (first + taps > hi)
+			hi = first + taps;
+	}
+	a->span = hi - a->lo;
+	a->copy = size == dst_size && pos == a->first &&
+		a->first + dst_size - 1 <= a->last;
+	return 1;
+}
+
+static void axis_free(scaler_axis_t* a)
+{
+	free(a->start);
+	free(a->coef);
+	a->start = 0;
+	a->coef = 0;
+}
+
+static inline int axis_source(const scaler_axis_t* a, int j)
+{
+	j += a->lo;
+	return j < a->first ? a->first : j > a->last ? a->last : j;
+}
+
+/* the horizontal pass over one source row, to 16 bit channels with
+ * MID_BITS fractional bits */
+static void scale_row(const scaler_axis_t* a, int16_t* dst, const uint32_t* row)
+{
+	const int taps = a->taps;
+	int i, k;
+
+	for (i = 0; i < a->dst_size; i++) {
+		const uint32_t* p = row + a->start[i];
+		const int16_t* c = a->coef + i * taps;
+#if defined(__SSE2__)
+		const __m128i z = _mm_setzero_si128();
+		__m128i acc = _mm_setzero_si128();
+
+		for (k = 0; k < taps; k += 2) {
+			/* the channels of two pixels side by side, times their weights */
+			__m128i px = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i*)(p + k)), z);
+			int32_t cc;
+
+			memcpy(&cc, c + k, sizeof(cc));
+			px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_set1_epi32(cc)));
+		}
+		acc = _mm_srai_epi32(_mm_add_epi32(acc,
+			_mm_set1_epi32(1 << (COEF_BITS - MID_BITS - 1))),
+			COEF_BITS - MID_BITS);
+		_mm_storel_epi64((__m128i*)(dst + 4 * i), _mm_packs_epi32(acc, acc));
+#else
+		int ch;
+
+		for (ch = 0; ch < 4; ch++) {
+			int32_t acc = 0;
+
+			for (k = 0; k < taps; k++)
+				acc += c[k] * (int32_t)((p[k] >> (8 * ch)) & 0xff);
+			dst[4 * i + ch] = (int16_t)((acc +
+				(1 << (COEF_BITS - MID_BITS - 1))) >> (COEF_BITS - MID_BITS));
+		}
+#endif
+	}
+}
+
+/* the vertical pass: one destination row from taps rows of the horizontal
+ * pass, stride channels apart */
+static void scale_column(const int16_t* c, int taps, uint32_t* dst,
+                         const int16_t* rows, int stride, int n)
+{
+	const int shift = COEF_BITS + MID_BITS;
+	int x = 0, k;
+
+#if defined(__SSE2__)
+	const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+
+	for (; x + 2 <= n; x += 2) {
+		__m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+		for (k = 0; k < taps; k += 2) {
+			const int16_t* r = rows + k * stride + 4 * x;
+			__m128i a = _mm_loadu_si128((const __m128i*)r);
+			__m128i b = _mm_loadu_si128((const __m128i*)(r + stride));
+			__m128i cc;
+			int32_t pair;
+
+			memcpy(&pair, c + k, sizeof(pair));
+			cc = _mm_set1_epi32(pair);
+			lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), cc));
+			hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), cc));
+		}
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, round), shift);
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, round), shift);
+		lo = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(lo, lo));
+	}
+#endif
+
+	for (; x < n; x++) {
+		uint32_t p = 0;
+		int ch;
+
+		for (ch = 0; ch < 4; ch++) {
+			int32_t acc = 1 << (shift - 1);
+
+			for (k = 0; k < taps; k++)
+				acc += c[k] * rows[k * stride + 4 * x + ch];
+			acc >>= shift;
+			p |= (uint32_t)(acc < 0 ? 0 : acc > 255 ? 255 : acc) << (8 * ch);
+		}
+		dst[x] = p;
+	}
+}
+
+typedef struct scale_job {
+	const scale0tilt_instance_t* inst;
+	const uint32_t* src;
+	uint32_t* dst;
+	int y0, y1;     /* destination rows, relative to dst_y */
+	int16_t* mid;   /* band_span rows of the horizontal pass */
+	uint32_t* row;  /* a source row padded with its edge pixels */
+} scale_job_t;
+
+static void* scale_rows(void* arg)
+{
+	scale_job_t* job = (scale_job_t*)arg;
+	const scale0tilt_instance_t* inst = job->inst;
+	const scaler_axis_t* ax = &inst->ax;
+	const scaler_axis_t* ay = &inst->ay;
+	const int stride = 4 * ax->dst_size;
+	/* the columns lo..lo+span of a source row are inside the frame */
+	const int direct = ax->lo >= 0 && ax->lo + ax->span <= inst->w &&
+		ax->lo >= ax->first && ax->lo + ax->span - 1 <= ax->last;
+	int y, y0, j, j0, j1;
+
+	if (ax->copy && ay->copy) {
+		for (y = job->y0; y < job->y1; y++) {
+			uint32_t* d = job->dst + (size_t)(inst->dst_y + y) * inst->w;
+
+			memset(d, 0, inst->dst_x * sizeof(uint32_t));
+			memcpy(d + inst->dst_x,
+			       job->src + (size_t)(ay->first + y) * inst->w + ax->first,
+			       ax->dst_size * sizeof(uint32_t));
+			memset(d + inst->dst_x + ax->dst_size, 0,
+			       (inst->w - inst->dst_x - ax->dst_size) * sizeof(uint32_t));
+		}
+		return 0;
+	}
+	for (y0 = job->y0; y0 < job->y1; y0 += BAND) {
+		int y1 = y0 + BAND < job->y1 ? y0 + BAND : job->y1;
+
+		j0 = ay->start[y0];
+		j1 = ay->start[y1 - 1] + ay->taps;
+		for (j = j0; j < j1; j++) {
+			const uint32_t* s = job->src + (size_t)axis_source(ay, j) * inst->w;
+
+			if (direct)
+				s += ax->lo;
+			else {
+				int x;
+
+				for (x = 0; x < ax->span; x++)
+					job->row[x] = s[axis_source(ax, x)];
+				s = job->row;
+			}
+			scale_row(ax, job->mid + (size_t)(j - j0) * stride, s);
+		}
+		for (y = y0; y < y1; y++) {
+			uint32_t* d = job->dst + (size_t)(inst->dst_y + y) * inst->w;
+
+			memset(d, 0, inst->dst_x * sizeof(uint32_t));
+			scale_column(ay->coef + y * ay->taps, ay->taps, d + inst->dst_x,
+			             job->mid + (size_t)(ay->start[y] - j0) * stride,
+			             stride, ax->dst_size);
+			memset(d + inst->dst_x + ax->dst_size, 0,
+			       (inst->w - inst->dst_x - ax->dst_size) * sizeof(uint32_t));
+		}
+	}
+	return 0;
+}
+
+#endif
+
 void update_scaler( scale0tilt_instance_t* inst )
 {
 	float dst_x, dst_y, dst_w, dst_h;
@@ -87,9 +397,30 @@ void update_scaler( scale0tilt_instance_t* inst )
 		return;
 	}
 
+#ifdef SCALE0TILT_GAVL
 	gavl_video_options_t* options = gavl_video_scaler_get_options( inst->video_scaler );
 
 	gavl_video_format_t format_dst;
+	gavl_rectangle_f_t src_rect;
+	gavl_rectangle_i_t dst_rect;
+
+	src_rect.x = src_x;
+	src_rect.y = src_y;
+	src_rect.w = src_w;
+	src_rect.h = src_h;
+
+	dst_rect.x = lroundf(dst_x);
+	dst_rect.y = lroundf(dst_y);
+	dst_rect.w = lroundf(dst_w);
+	dst_rect.h = lroundf(dst_h);
+
+	/* the scaler is still set up for these */
+	if ( inst->format_src.pixelformat == GAVL_RGBA_32 &&
+	     !memcmp( &src_rect, &inst->src_rect, sizeof(src_rect) ) &&
+	     !memcmp( &dst_rect, &inst->dst_rect, sizeof(dst_rect) ) )
+		return;
+	inst->src_rect = src_rect;
+	inst->dst_rect = dst_rect;
 
 	memset(&inst->format_src, 0, sizeof(inst->format_src));
 	memset(&format_dst, 0, sizeof(format_dst));
@@ -110,21 +441,36 @@ void update_scaler( scale0tilt_instance_t* inst )
 	inst->format_src.pixel_height = 1;
 	inst->format_src.pixelformat = GAVL_RGBA_32;
 
-	gavl_rectangle_f_t src_rect;
-	gavl_rectangle_i_t dst_rect;
-
-	src_rect.x = src_x;
-	src_rect.y = src_y;
-	src_rect.w = src_w;
-	src_rect.h = src_h;
-
-	dst_rect.x = lroundf(dst_x);
-	dst_rect.y = lroundf(dst_y);
-	dst_rect.w = lroundf(dst_w);
-	dst_rect.h = lroundf(dst_h);
-	
 	gavl_video_options_set_rectangles( options, &src_rect, &dst_rect );
 	gavl_video_scaler_init( inst->video_scaler, &inst->format_src, &format_dst );
+#else
+	int x = lroundf(dst_x), y = lroundf(dst_y);
+	int w = lroundf(dst_w), h = lroundf(dst_h);
+	int y0, span;
+
+	/* rounding may have moved the rectangle past the frame by a pixel */
+	if ( x + w > inst->w )
+		w = inst->w - x;
+	if ( y + h > inst->h )
+		h = inst->h - y;
+	if ( w < 1 || h < 1 ||
+	     !axis_prepare( &inst->ax, src_x, src_w, w, inst->w ) ||
+	     !axis_prepare( &inst->ay, src_y, src_h, h, inst->h ) ) {
+		inst->do_scale = 0;
+		return;
+	}
+	inst->dst_x = x;
+	inst->dst_y = y;
+
+	inst->band_span = 0;
+	for ( y0 = 0; y0 < h; y0 += BAND ) {
+		int y1 = y0 + BAND < h ? y0 + BAND : h;
+
+		span = inst->ay.start[y1 - 1] + inst->ay.taps - inst->ay.start[y0];
+		if ( span > inst->band_span )
+			inst->band_span = span;
+	}
+#endif
 }
 
 int f0r_init()
@@ -147,6 +493,12 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->explanation = "Scales, Tilts and Crops an Image";
 
 }
+
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
 void f0r_get_param_info( f0r_param_info_t* info, int param_index )
 {
 	switch ( param_index ) {
@@ -200,6 +552,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	inst->h = height;
 	inst->sx = 1.0;
 	inst->sy = 1.0;
+#ifdef SCALE0TILT_GAVL
 	inst->video_scaler = gavl_video_scaler_create();
 	inst->frame_src = gavl_video_frame_create( 0 );
 	inst->frame_dst = gavl_video_frame_create( 0 );
@@ -208,11 +561,15 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	update_scaler(inst);
 	if ( inst->frame_src->strides[0] % 16 )
 		inst->padded = gavl_video_frame_create( &inst->format_src );
+#else
+	update_scaler(inst);
+#endif
 	return (f0r_instance_t)inst;
 }
 void f0r_destruct(f0r_instance_t instance)
 {
 	scale0tilt_instance_t* inst = (scale0tilt_instance_t*)instance;
+#ifdef SCALE0TILT_GAVL
 	gavl_video_scaler_destroy(inst->video_scaler);
 	gavl_video_frame_null( inst->frame_src );
 	gavl_video_frame_destroy( inst->frame_src );
@@ -220,6 +577,11 @@ void f0r_destruct(f0r_instance_t instance)
 	gavl_video_frame_destroy( inst->frame_dst );
 	if ( inst->padded )
 		gavl_video_frame_destroy( inst->padded );
+#else
+	axis_free( &inst->ax );
+	axis_free( &inst->ay );
+	free( inst->scratch );
+#endif
 	free(instance);
 }
 void f0r_set_param_value(f0r_instance_t instance, 
@@ -289,6 +651,7 @@ void f0r_update(f0r_instance_t instance, double time,
                 const uint32_t* inframe, uint32_t* outframe)
 {
 	scale0tilt_instance_t* inst = (scale0tilt_instance_t*)instance;
+#ifdef SCALE0TILT_GAVL
 	gavl_video_frame_t* frame_src = inst->frame_src;
 	inst->frame_src->planes[0] = (uint8_t *)inframe;
 	inst->frame_dst->planes[0] = (uint8_t *)outframe;
@@ -304,5 +667,52 @@ void f0r_update(f0r_instance_t instance, double time,
 		}
 		gavl_video_scaler_scale( inst->video_scaler, frame_src, inst->frame_dst );
 	}
-}
+#else
+	scale_job_t jobs[FREI0R_MAX_THREADS];
+	size_t mid, row, size;
+	int i, n, h;
 
+	if ( !inst->do_scale ) {
+		memset( outframe, 0, (size_t)inst->w * inst->h * sizeof(uint32_t) );
+		return;
+	}
+
+	/* the scratch memory of each thread, 16 byte aligned */
+	h = inst->ay.dst_size;
+	n = frei0r_thread_count( (long)inst->ax.dst_size * h );
+	if ( n > (h + BAND - 1) / BAND )
+		n = (h + BAND - 1) / BAND;
+	mid = ( (size_t)inst->band_span * inst->ax.dst_size * 8 + 15 ) & ~(size_t)15;
+	row = ( (size_t)inst->ax.span * 4 + 15 ) & ~(size_t)15;
+	size = n * ( mid + row ) + 15;
+	if ( size > inst->scratch_size ) {
+		free( inst->scratch );
+		inst->scratch = malloc( size );
+		inst->scratch_size = inst->scratch ? size : 0;
+		if ( !inst->scratch ) {
+			memset( outframe, 0, (size_t)inst->w * inst->h * sizeof(uint32_t) );
+			return;
+		}
+	}
+
+	memset( outframe, 0, (size_t)inst->dst_y * inst->w * sizeof(uint32_t) );
+	memset( outframe + (size_t)( inst->dst_y + h ) * inst->w, 0,
+	        (size_t)( inst->h - inst->dst_y - h ) * inst->w * sizeof(uint32_t) );
+	for ( i = 0; i < n; i++ ) {
+		char* p = (char*)( ( (uintptr_t)inst->scratch + 15 ) & ~(uintptr_t)15 )
+			+ i * ( mid + row );
+
+		jobs[i].inst = inst;
+		jobs[i].src = inframe;
+		jobs[i].dst = outframe;
+		/* whole bands per thread */
+		jobs[i].y0 = (int)( (long)( (h + BAND - 1) / BAND ) * i / n ) * BAND;
+		jobs[i].y1 = (int)( (long)( (h + BAND - 1) / BAND ) * ( i + 1 ) / n ) * BAND;
+		if ( jobs[i].y1 > h )
+			jobs[i].y1 = h;
+		jobs[i].mid = (int16_t*)p;
+		jobs[i].row = (uint32_t*)( p + mid );
+	}
+	frei0r_thread_run( scale_rows, jobs, sizeof(scale_job_t), n );
+#endif
+}
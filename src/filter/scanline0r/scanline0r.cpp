@@ -1,26 +1,29 @@
 #include "frei0r.hpp"
 
-#include <algorithm>
+#include <cstring>
 
-static inline uint8_t
-scale(uint8_t value, uint8_t factor)
-{
-  return std::min((uint16_t)((uint16_t)value * (uint16_t)factor / 128), (uint16_t)value);
-}
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
+// Halves each channel of a line, alpha included: the odd lines were
+// scaled by 64 / 128, the even ones by 150 / 128 limited to the value
+// itself, which leaves them as they are.
 static inline void
-scale_scanline(uint32_t *dst_begin, const uint32_t *src_begin, const uint32_t *src_end, uint8_t factor)
+halve_scanline(uint32_t *dst, const uint32_t *src, unsigned int n)
 {
-  union { uint32_t u32; uint8_t u8[4]; } v;
-
-  while (src_begin < src_end) {
-    v.u32 = *src_begin++;
-    v.u8[0] = scale(v.u8[0], factor);
-    v.u8[1] = scale(v.u8[1], factor);
-    v.u8[2] = scale(v.u8[2], factor);
-    v.u8[3] = scale(v.u8[3], factor);
-    *dst_begin++ = v.u32;
-  }
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi32(0x7f7f7f7f);
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i*)(dst + i),
+                     _mm_and_si128(_mm_srli_epi32(
+                       _mm_loadu_si128((const __m128i*)(src + i)), 1), mask));
+#endif
+
+  for (; i < n; ++i)
+    dst[i] = (src[i] >> 1) & 0x7f7f7f7f;
 }
 
 class scanline0r : public frei0r::filter
@@ -31,24 +34,46 @@ public:
     //register_param(hsync,"HSync","the hsync offset");
   }
   
-  virtual void update(double time,
-                      uint32_t* out,
-                      const uint32_t* in)
+  virtual bool update_slice(double time,
+                            uint32_t* out,
+                            const uint32_t* in,
+                            unsigned int row_begin,
+                            unsigned int row_end)
   {
-    for (unsigned int line=0; line < height; line+=2)
-      {
-        scale_scanline(out+line*width, in+line*width, in+(line+1)*width, 150);
-        scale_scanline(out+(line+1)*width, in+(line+1)*width, in+(line+2)*width, 64);
-      }
+    const int stride = width*sizeof(uint32_t);
+    for (unsigned int line=row_begin; line < row_end; ++line)
+      scanline(frei0r::frame_row(out, stride, line),
+               frei0r::frame_row(in, stride, line), line);
+    return true;
+  }
+
+  virtual bool update_stride(double time,
+                             uint32_t* out, int out_stride,
+                             const uint32_t* in, int in_stride)
+  {
+    for (unsigned int line=0; line < height; ++line)
+      scanline(frei0r::frame_row(out, out_stride, line),
+               frei0r::frame_row(in, in_stride, line), line);
+    return true;
   }
   
 private:
   //double hsync;
+
+  void scanline(uint32_t* dst, const uint32_t* src, unsigned int line)
+  {
+    if (line % 2)
+      halve_scanline(dst, src, width);
+    else if (dst != src)
+      std::memcpy(dst, src, width*sizeof(uint32_t));
+  }
 };
 
 
 frei0r::construct<scanline0r> plugin("scanline0r",
 				     "interlaced dark lines",
 				     "Martin Bayer",
-				     0,3);
+				     0,3,
+				     F0R_COLOR_MODEL_BGRA8888,
+				     F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -30,18 +30,16 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 
 //#include <stdio.h>	/* for debug printf only +/
 #include <frei0r.h>
+#include "frei0r_stats.h"
+#include "frei0r_cfc.h"
+#include "frei0r_thread.h"
+#include "frei0r_deadline.h"
+#include "frei0r_arena.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 
-typedef struct
-{
-	float r;
-	float g;
-	float b;
-	float a;
-} float_rgba;
-
 typedef struct
 {
 	float x;
@@ -666,8 +664,20 @@ typedef struct
 	int soft;
 	int inv;
 	int op;
+	int selIsDirty;	//selection parameters changed since the last frame
+	uint16_t *lut;	//selection cache, 0x100|alpha for each RGB, 0=not known yet
+	int lutIsDirty;	//lut belongs to older selection parameters
+	int quality;	//F0R_QUALITY_*, drafts select every second pixel
+	frei0r_deadline_t deadline;	//see f0r_set_deadline
+	frei0r_arena_t arena;	//per-frame scratch buffers
+#ifdef FREI0R_ENABLE_STATS
+	frei0r_stats_t stats;
+#endif
 } inst;
 
+//stages reported by f0r_get_stats, in registration order
+enum {STAGE_SELECT};
+
 //-----------------------------------------------------
 //stretch [0...1] to parameter range [min...max] linear
 float map_value_forward(double v, float min, float max)
@@ -711,6 +721,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* info)
 	info->explanation="Color based alpha selection";
 }
 
+//-----------------------------------------------
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+	f0r_get_plugin_info(&info->info);
+	info->capabilities=F0R_CAP_FLOAT;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -790,6 +807,14 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	in->soft=0;
 	in->inv=0;
 	in->op=0;
+	in->selIsDirty=1;
+	in->quality=F0R_QUALITY_NORMAL;
+	frei0r_deadline_init(&in->deadline);
+	frei0r_arena_init(&in->arena);
+	
+#ifdef FREI0R_ENABLE_STATS
+	frei0r_stats_register(&in->stats, "select");
+#endif
 	
 	return (f0r_instance_t)in;
 }
@@ -801,6 +826,8 @@ void f0r_destruct(f0r_instance_t instance)
 	
 	in=(inst*)instance;
 	
+	free(in->lut);
+	frei0r_arena_release(&in->arena);
 	free(instance);
 }
 
@@ -872,6 +899,8 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 	
 	if (chg==0) return;
 	
+	if (param_index!=9)	//all but the operation change the selection
+		p->selIsDirty=1;
 }
 
 //--------------------------------------------------
@@ -908,7 +937,7 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 		*((double*)param)=map_value_backward(p->sshape, 0.0, 2.9999);
 		break;
 	case 8:
-		*((double*)param)=map_value_backward(p->soft, 0.0, 3.9999);
+		*((double*)param)=map_value_backward(p->soft, 0.0, 4.9999);
 		break;
 	case 9:
 		*((double*)param)=map_value_backward(p->op, 0.0, 4.9999);
@@ -917,21 +946,13 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 }
 
 //-------------------------------------------------
-//RGBA8888 little endian
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+//selection of n float pixels, into their alpha
+//(inverted if required)
+static void select_px(const inst *in, float_rgba *sl, int n)
 {
-	inst *in;
 	float_rgba key;
-	triplet d,n;
+	triplet d,nu;
 	int i;
-	uint32_t t;
-	uint8_t *cin, *cout;
-	float f1=1.0/256.0;
-	uint8_t a1,a2;
-	float_rgba *sl;
-
-	assert(instance);
-	in=(inst*)instance;
 	
 	key.r=in->col.r;
 	key.g=in->col.g;
@@ -940,32 +961,24 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 	d.x=in->del1;
 	d.y=in->del2;
 	d.z=in->del3;
-	n.x=in->nud1;
-	n.y=in->nud2;
-	n.z=in->nud3;
+	nu.x=in->nud1;
+	nu.y=in->nud2;
+	nu.z=in->nud3;
 	
-	//convert to float
-	sl = calloc(in->w * in->h, sizeof(float_rgba));
-	cin=(uint8_t *)inframe;
-	for (i=0;i<in->h*in->w;i++)
-	{
-		sl[i].r=f1*(float)*cin++;
-		sl[i].g=f1*(float)*cin++;
-		sl[i].b=f1*(float)*cin++;
-		cin++;
-	}
+	//unknown subspace, shape or edge mode select nothing
+	for (i=0;i<n;i++)
+		sl[i].a=0.0;
 	
-	//make the selection
 	switch (in->subsp)
 	{
 	case 0:
-		sel_rgb(sl, in->w, in->h, key, d, n, in->slp, in->sshape, in->soft);
+		sel_rgb(sl, n, 1, key, d, nu, in->slp, in->sshape, in->soft);
 		break;
 	case 1:
-		sel_abi(sl, in->w, in->h, key, d, n, in->slp, in->sshape, in->soft);
+		sel_abi(sl, n, 1, key, d, nu, in->slp, in->sshape, in->soft);
 		break;
 	case 2:
-		sel_hci(sl, in->w, in->h, key, d, n, in->slp, in->sshape, in->soft);
+		sel_hci(sl, n, 1, key, d, nu, in->slp, in->sshape, in->soft);
 		break;
 	default:
 		break;
@@ -973,73 +986,480 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
 	
 	//invert selection if required
 	if (in->inv==1)
-		for (i=0;i<in->h*in->w;i++)
+		for (i=0;i<n;i++)
 			sl[i].a = 1.0 - sl[i].a;
+}
+
+//-------------------------------------------------
+//one band of rows: selection and alpha operation
+//
+//With a lut, the selection of each RGB value is only computed the
+//first time it is seen. While the threads select they only read the
+//lut: the rows with colors that are not in it yet are put aside with
+//these colors. Then each thread computes and stores the new colors it
+//owns, so no entry is written by two threads, and the rows put aside
+//are selected again.
+typedef struct seljob
+{
+	const inst *in;
+	const uint32_t *inframe;
+	uint32_t *outframe;
+	const float_rgba *fin;	//float frames instead of inframe and outframe
+	float_rgba *fout;
+	uint16_t *lut;
+	float_rgba *sl;	//one row of pixels
+	uint8_t *sel;	//one row of selection alphas
+	uint32_t *pend;	//one row of colors to store in the lut
+	uint32_t *miss;	//colors of the band not in the lut
+	int nmiss;
+	int *rows;	//rows of the band put aside
+	int nrows;
+	int y0,y1;
+	int t,nt;	//this thread stores the colors c with c%nt==t
+	const struct seljob *all;	//the jobs of all threads
+} seljob;
+
+//one row of float frames, without the lut and without rounding the
+//selection to 8 bits
+static void select_float_row(const seljob *j, int y)
+{
+	const inst *in=j->in;
+	const float_rgba *src=j->fin+y*in->w;
+	float_rgba *dst=j->fout+y*in->w;
+	float f1=255.0/256.0;	//the scale of the 8 bit input
+	float a1,a2;
+	int x;
+	
+	if ((in->op<0)||(in->op>4))
+		return;
+	for (x=0;x<in->w;x++)
+	{
+		j->sl[x].r=f1*src[x].r;
+		j->sl[x].g=f1*src[x].g;
+		j->sl[x].b=f1*src[x].b;
+	}
+	select_px(in, j->sl, in->w);
+	for (x=0;x<in->w;x++)
+	{
+		a1=src[x].a;
+		a2=j->sl[x].a;
+		switch (in->op)
+		{
+		case 1: a2 = (a1>a2) ? a1 : a2; break;		//max
+		case 2: a2 = (a1<a2) ? a1 : a2; break;		//min
+		case 3: a2 = (a1+a2<=1.0) ? a1+a2 : 1.0; break;	//add
+		case 4: a2 = (a1>a2) ? a1-a2 : 0.0; break;	//subtract
+		default: break;					//write on clear
+		}
+		dst[x].r=src[x].r;
+		dst[x].g=src[x].g;
+		dst[x].b=src[x].b;
+		dst[x].a=a2;
+	}
+}
+
+//the selection of one row of 8 bit pixels into sel; returns 0 if
+//colors of it are not in the lut, they are added to miss then
+static int select_row(seljob *j, const uint32_t *src)
+{
+	const inst *in=j->in;
+	const uint8_t *c;
+	uint16_t e;
+	uint32_t idx, last;
+	float f1=1.0/256.0;
+	int x,nm,known;
+	
+	if (j->lut!=NULL)
+	{
+		known=1;
+		last=0xffffffff;
+		for (x=0;x<in->w;x++)
+		{
+			c=(const uint8_t*)(src+x);
+			idx=c[0]|(c[1]<<8)|(c[2]<<16);
+			e=j->lut[idx];
+			j->sel[x]=(uint8_t)e;
+			if (e&0x100)
+				continue;
+			known=0;
+			if (idx!=last)
+				j->miss[j->nmiss++]=idx;
+			last=idx;
+		}
+		return known;
+	}
+	if (in->quality==F0R_QUALITY_DRAFT)
+	{
+		//every second pixel, its right neighbour gets the same
+		nm=0;
+		for (x=0;x<in->w;x+=2)
+		{
+			c=(const uint8_t*)(src+x);
+			j->sl[nm].r=f1*(float)c[0];
+			j->sl[nm].g=f1*(float)c[1];
+			j->sl[nm].b=f1*(float)c[2];
+			nm++;
+		}
+		select_px(in, j->sl, nm);
+		for (x=0;x<in->w;x++)
+			j->sel[x] = (uint8_t)(j->sl[x/2].a*255.0);
+	}
+	else
+	{
+		RGBA8_2_float_lin(src, j->sl, in->w, 1, f1, 1);
+		select_px(in, j->sl, in->w);
+		for (x=0;x<in->w;x++)
+			j->sel[x] = (uint8_t)(j->sl[x].a*255.0);
+	}
+	
+	return 1;
+}
+
+//the alpha operation of one row, with the selection in sel
+static void apply_row(const seljob *j, const uint32_t *src, uint32_t *dst)
+{
+	const inst *in=j->in;
+	const uint8_t *cin=(const uint8_t *)src;
+	uint8_t *cout=(uint8_t *)dst;
+	uint8_t a1,a2;
+	uint32_t t;
+	int x;
 	
-	//apply alpha
-	cin=(uint8_t *)inframe;
-	cout=(uint8_t *)outframe;
 	switch (in->op)
 	{
 	case 0:		//write on clear
-		for (i=0;i<in->h*in->w;i++)
+		for (x=0;x<in->w;x++)
 		{
 			*cout++ = *cin++;	//copy R
 			*cout++ = *cin++;	//copy G
 			*cout++ = *cin++;	//copy B
-			*cout++ = (uint8_t)(sl[i].a*255.0);
+			*cout++ = j->sel[x];
 			cin++;
 		}
 		break;
 	case 1:		//max
-		for (i=0;i<in->h*in->w;i++)
+		for (x=0;x<in->w;x++)
 		{
 			*cout++ = *cin++;	//copy R
 			*cout++ = *cin++;	//copy G
 			*cout++ = *cin++;	//copy B
 			a1 = *cin++;
-			a2 = (uint8_t)(sl[i].a*255.0);
+			a2 = j->sel[x];
 			*cout++ = (a1>a2) ? a1 : a2;
 		}
 		break;
 	case 2:		//min
-		for (i=0;i<in->h*in->w;i++)
+		for (x=0;x<in->w;x++)
 		{
 			*cout++ = *cin++;	//copy R
 			*cout++ = *cin++;	//copy G
 			*cout++ = *cin++;	//copy B
 			a1 = *cin++;
-			a2 = (uint8_t)(sl[i].a*255.0);
+			a2 = j->sel[x];
 			*cout++ = (a1<a2) ? a1 : a2;
 		}
 		break;
 	case 3:		//add
-		for (i=0;i<in->h*in->w;i++)
+		for (x=0;x<in->w;x++)
 		{
 			*cout++ = *cin++;	//copy R
 			*cout++ = *cin++;	//copy G
 			*cout++ = *cin++;	//copy B
 			a1 = *cin++;
-			a2 = (uint8_t)(sl[i].a*255.0);
+			a2 = j->sel[x];
 			t=(uint32_t)a1+(uint32_t)a2;
 			*cout++ = (t<=255) ? (uint8_t)t : 255;
 		}
 		break;
 	case 4:		//subtract
-		for (i=0;i<in->h*in->w;i++)
+		for (x=0;x<in->w;x++)
 		{
 			*cout++ = *cin++;	//copy R
 			*cout++ = *cin++;	//copy G
 			*cout++ = *cin++;	//copy B
 			a1 = *cin++;
-			a2 = (uint8_t)(sl[i].a*255.0);
+			a2 = j->sel[x];
 			*cout++ = (a1>a2) ? a1-a2 : 0;
 		}
 		break;
 	default:
 		break;
 	}
-	free(sl);
 }
 
+static void* select_rows(void *arg)
+{
+	seljob *j=(seljob*)arg;
+	const inst *in=j->in;
+	int y;
+	
+	j->nmiss=0;
+	j->nrows=0;
+	for (y=j->y0;y<j->y1;y++)
+	{
+		if (j->fin!=NULL)
+			select_float_row(j, y);
+		else if (select_row(j, j->inframe+y*in->w))
+			apply_row(j, j->inframe+y*in->w, j->outframe+y*in->w);
+		else
+			j->rows[j->nrows++]=y;
+	}
+	return 0;
+}
+
+//the selection of the n colors of pend, into the lut
+static void store_colors(seljob *j, int n)
+{
+	float f1=1.0/256.0;
+	int k;
+	
+	for (k=0;k<n;k++)
+	{
+		j->sl[k].r=f1*(float)(j->pend[k]&0xff);
+		j->sl[k].g=f1*(float)((j->pend[k]>>8)&0xff);
+		j->sl[k].b=f1*(float)(j->pend[k]>>16);
+	}
+	select_px(j->in, j->sl, n);
+	for (k=0;k<n;k++)
+		j->lut[j->pend[k]] = 0x100|(uint8_t)(j->sl[k].a*255.0);
+}
+
+//the new colors of all bands this thread owns; the first time one is
+//met it is marked 0x200, so it is computed once
+static void* fill_colors(void *arg)
+{
+	seljob *j=(seljob*)arg;
+	uint32_t idx;
+	int i,k,n;
+	
+	n=0;
+	for (i=0;i<j->nt;i++)
+		for (k=0;k<j->all[i].nmiss;k++)
+		{
+			idx=j->all[i].miss[k];
+			if (((int)(idx%j->nt)!=j->t) || (j->lut[idx]!=0))
+				continue;
+			j->lut[idx]=0x200;
+			j->pend[n++]=idx;
+			if (n==j->in->w)
+			{
+				store_colors(j, n);
+				n=0;
+			}
+		}
+	if (n>0)
+		store_colors(j, n);
+	return 0;
+}
+
+//the rows put aside, now that all their colors are in the lut
+static void* select_aside(void *arg)
+{
+	seljob *j=(seljob*)arg;
+	const inst *in=j->in;
+	int i,y;
+	
+	for (i=0;i<j->nrows;i++)
+	{
+		y=j->rows[i];
+		select_row(j, j->inframe+y*in->w);
+		apply_row(j, j->inframe+y*in->w, j->outframe+y*in->w);
+	}
+	return 0;
+}
+
+//-------------------------------------------------
+//either the RGBA8888 (little endian) or the float frames are given
+static void select_update(inst *in, const uint32_t* inframe, uint32_t* outframe, const float_rgba *fin, float_rgba *fout)
+{
+	seljob jobs[FREI0R_MAX_THREADS];
+	float_rgba *sl;
+	uint8_t *sel;
+	uint32_t *pend, *miss;
+	uint16_t *lut;
+	int *rows;
+	int i,n,nt;
+	
+	//the lut pays off once the selection stays the same for more
+	//than one frame, and only for HCI, where atan2() and hypot()
+	//cost more than the cache misses of a 32 MB table
+	if (in->selIsDirty)
+	{
+		in->selIsDirty=0;
+		in->lutIsDirty=1;
+	}
+	else if (in->lutIsDirty && (in->subsp==2))
+	{
+		if (in->lut==NULL)
+			in->lut=calloc(1<<24, sizeof(uint16_t));
+		else
+			memset(in->lut, 0, (1<<24)*sizeof(uint16_t));
+		in->lutIsDirty = (in->lut==NULL);
+	}
+	
+	FREI0R_STAT_BEGIN(t_select);
+	nt=frei0r_thread_count(in->w * in->h);
+	lut = (in->lutIsDirty || (in->subsp!=2) || (fin!=NULL)) ? NULL : in->lut;
+	frei0r_arena_reset(&in->arena);
+	sl = frei0r_arena_alloc(&in->arena, nt * in->w * sizeof(float_rgba));
+	sel = frei0r_arena_alloc(&in->arena, nt * in->w * sizeof(uint8_t));
+	pend = miss = NULL;
+	rows = NULL;
+	if (lut!=NULL)
+	{
+		pend = frei0r_arena_alloc(&in->arena, nt * in->w * sizeof(uint32_t));
+		miss = frei0r_arena_alloc(&in->arena, in->w * in->h * sizeof(uint32_t));
+		rows = frei0r_arena_alloc(&in->arena, in->h * sizeof(int));
+	}
+	if ((sl==NULL) || (sel==NULL)
+		|| ((lut!=NULL) && ((pend==NULL) || (miss==NULL) || (rows==NULL))))
+	{
+		//out of memory, the frame passes unchanged
+		if (fin!=NULL)
+			memmove(fout, fin, in->w * in->h * sizeof(float_rgba));
+		else
+			memmove(outframe, inframe, in->w * in->h * sizeof(uint32_t));
+		FREI0R_STAT_END(&in->stats, STAGE_SELECT, t_select);
+		return;
+	}
+	for (i=0;i<nt;i++)
+	{
+		jobs[i].in=in;
+		jobs[i].inframe=inframe;
+		jobs[i].outframe=outframe;
+		jobs[i].fin=fin;
+		jobs[i].fout=fout;
+		jobs[i].lut=lut;
+		jobs[i].sl=sl+i*in->w;
+		jobs[i].sel=sel+i*in->w;
+		jobs[i].y0=in->h*i/nt;
+		jobs[i].y1=in->h*(i+1)/nt;
+		jobs[i].pend = (pend!=NULL) ? pend+i*in->w : NULL;
+		jobs[i].miss = (miss!=NULL) ? miss+jobs[i].y0*in->w : NULL;
+		jobs[i].rows = (rows!=NULL) ? rows+jobs[i].y0 : NULL;
+		jobs[i].t=i;
+		jobs[i].nt=nt;
+		jobs[i].all=jobs;
+	}
+	frei0r_thread_run(select_rows, jobs, sizeof(seljob), nt);
+	
+	//new colors of the lut, once all threads are done reading it
+	n=0;
+	for (i=0;i<nt;i++)
+		n+=jobs[i].nmiss;
+	if (n>0)
+	{
+		frei0r_thread_run(fill_colors, jobs, sizeof(seljob), nt);
+		frei0r_thread_run(select_aside, jobs, sizeof(seljob), nt);
+	}
+	FREI0R_STAT_END(&in->stats, STAGE_SELECT, t_select);
+}
+
+//-------------------------------------------------
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+	inst *in;
+	
+	assert(instance);
+	in=(inst*)instance;
+	if (frei0r_deadline_begin(&in->deadline))
+		in->quality=in->deadline.current;
+	select_update(in, inframe, outframe, NULL, NULL);
+	frei0r_deadline_end(&in->deadline);
+}
+
+//-------------------------------------------------
+//works in float anyway, so float frames skip the 8 bit conversions
+int f0r_update_float(f0r_instance_t instance, double time, const float* inframe1, const float* inframe2, const float* inframe3, float* outframe)
+{
+	assert(instance);
+	select_update((inst*)instance, NULL, NULL, (const float_rgba*)inframe1, (float_rgba*)outframe);
+	return 1;
+}
+
+//-------------------------------------------------
+//float frames and the lut of HCI stay exact in drafts
+int f0r_set_quality(f0r_instance_t instance, int quality)
+{
+	inst *in;
+	
+	assert(instance);
+	in=(inst*)instance;
+	frei0r_deadline_request(&in->deadline, quality);
+	in->quality=in->deadline.current;
+	return 1;
+}
+
+//-------------------------------------------------
+//drafts take about half the time of the selection
+int f0r_set_deadline(f0r_instance_t instance, double seconds)
+{
+	assert(instance);
+	frei0r_deadline_set(&((inst*)instance)->deadline, seconds);
+	return 1;
+}
+
+//-------------------------------------------------
+int f0r_get_quality(f0r_instance_t instance)
+{
+	assert(instance);
+	return ((inst*)instance)->deadline.current;
+}
+
+//-------------------------------------------------
+//the lut and the scratch rows are the large buffers; both come back
+//with the next frames
+int f0r_trim(f0r_instance_t instance)
+{
+	inst *in;
+	
+	assert(instance);
+	in=(inst*)instance;
+	if ((in->lut==NULL) && (frei0r_arena_bytes(&in->arena)==0))
+		return 0;
+	free(in->lut);
+	in->lut=NULL;
+	in->lutIsDirty=1;
+	frei0r_arena_release(&in->arena);
+	return 1;
+}
+
+//-------------------------------------------------
+//besides the frames, the lut, of which updates may read any part, its
+//list of new colors and a few rows per thread
+int f0r_get_memory_usage(f0r_instance_t instance, f0r_memory_usage_t* usage)
+{
+	inst *in;
+	size_t rows;
+	
+	assert(instance);
+	in=(inst*)instance;
+	rows=(size_t)frei0r_thread_count(in->w * in->h) * in->w
+		* (sizeof(float_rgba) + sizeof(uint8_t));
+	usage->resident = ((in->lut!=NULL) ? (1<<24)*sizeof(uint16_t) : 0)
+		+ frei0r_arena_bytes(&in->arena);
+	usage->touched = 2*(size_t)in->w*in->h*sizeof(uint32_t) + rows;
+	if (in->lut!=NULL)
+		usage->touched += (1<<24)*sizeof(uint16_t)
+			+ ((size_t)in->w*in->h + rows/(sizeof(float_rgba)+sizeof(uint8_t)))
+			* sizeof(uint32_t);
+	return 1;
+}
+
+//-------------------------------------------------
+void f0r_set_allocator(f0r_instance_t instance, const f0r_allocator_t* allocator)
+{
+	assert(instance);
+	frei0r_arena_set_allocator(&((inst*)instance)->arena, allocator);
+}
+
+#ifdef FREI0R_ENABLE_STATS
+//-----------------------------------------------------
+int f0r_get_stats(f0r_instance_t instance, f0r_stat_info_t* stats, int count)
+{
+	assert(instance);
+	return frei0r_stats_get(&((inst*)instance)->stats, stats, count);
+}
+#endif
+
 //**********************************************************
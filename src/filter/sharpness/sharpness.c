@@ -36,13 +36,18 @@ Copyright (C) 2010  Marko Cebokli    http://lea.hamradio.si/~s57uuu
 #include <assert.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frei0r_thread.h"
+
 #define MIN_MATRIX_SIZE 3
 #define MAX_MATRIX_SIZE 63
 
 typedef struct FilterParam {
     int msizeX, msizeY;
     double amount;
-    uint32_t *SC[MAX_MATRIX_SIZE-1];
 } FilterParam;
 
 
@@ -55,7 +60,9 @@ int w;
 
 FilterParam fp;
 int size,ac;
-unsigned char *Rplani,*Gplani,*Bplani,*Rplano,*Gplano,*Bplano;
+uint32_t *state;	//row and column state of the threads, kept across frames
+size_t state_size;
+uint32_t *copy;		//input copy for in place updates on several threads
 
 } inst;
 
@@ -74,62 +81,136 @@ Originally published Boston, Nov 98
 
 */
 
-void unsharp( uint8_t *dst, uint8_t *src, int dstStride, int srcStride, int width, int height, FilterParam *fp ) {
-
-    uint32_t **SC = fp->SC;
-    uint32_t SR[MAX_MATRIX_SIZE-1], Tmp1, Tmp2;
-    uint8_t* src2 = src; // avoid gcc warning
-
-    int32_t res;
-    int x, y, z;
-    int amount = fp->amount * 65536.0;
-    int stepsX = fp->msizeX/2;
-    int stepsY = fp->msizeY/2;
-    int scalebits = (stepsX+stepsY)*2;
-    int32_t halfscale = 1 << ((stepsX+stepsY)*2-1);
-
-    if( !fp->amount ) {
-	if( src == dst )
-	    return;
-	if( dstStride == srcStride )
-//	    fast_memcpy( dst, src, srcStride*height );
-	    memcpy( dst, src, srcStride*height );
-	else
-	    for( y=0; y<height; y++, dst+=dstStride, src+=srcStride )
-//		fast_memcpy( dst, src, width );
-		memcpy( dst, src, width );
-	return;
-    }
+/* The finite-state machine of Mplayer's filter is a binomial blur of
+   2*stepsX+1 by 2*stepsY+1 pixels with the borders repeated. Here it
+   works on packed pixels, all channels of a pixel at once: each row is
+   blurred horizontally by stepsX passes of (1 2 1) over a copy padded by
+   stepsX pixels on both sides, then goes through the 2*stepsY column
+   stages of the machine, which keep their state per column.
+
+   A band of rows starts 2*stepsY rows early; the state the stages start
+   from only shows in those rows, so it's never cleared. */
+
+typedef struct {
+    const uint32_t *src;
+    uint32_t *dst;
+    int width, height, y0, y1;
+    int stepsX, stepsY, amount;
+    uint32_t *state;	// (width+2*stepsX)*4 row, width*2*stepsY*4 column stages
+} unsharp_job;
+
+static size_t unsharp_state_size( int width, int stepsX, int stepsY ) {
+    return ((size_t)(width+2*stepsX) + (size_t)width*2*stepsY) * 4;
+}
 
-    for( y=0; y<2*stepsY; y++ )
-	memset( SC[y], 0, sizeof(SC[y][0]) * (width+2*stepsX) );
-
-    for( y=-stepsY; y<height+stepsY; y++ ) {
-	if( y < height ) src2 = src;
-	memset( SR, 0, sizeof(SR[0]) * (2*stepsX-1) );
-	for( x=-stepsX; x<width+stepsX; x++ ) {
-	    Tmp1 = x<=0 ? src2[0] : x>=width ? src2[width-1] : src2[x];
-	    for( z=0; z<stepsX*2; z+=2 ) {
-		Tmp2 = SR[z+0] + Tmp1; SR[z+0] = Tmp1;
-		Tmp1 = SR[z+1] + Tmp2; SR[z+1] = Tmp2;
-	    }
-	    for( z=0; z<stepsY*2; z+=2 ) {
-		Tmp2 = SC[z+0][x+stepsX] + Tmp1; SC[z+0][x+stepsX] = Tmp1;
-		Tmp1 = SC[z+1][x+stepsX] + Tmp2; SC[z+1][x+stepsX] = Tmp2;
-	    }
-	    if( x>=stepsX && y>=stepsY ) {
-		uint8_t* srx = src - stepsY*srcStride + x - stepsX;
-		uint8_t* dsx = dst - stepsY*dstStride + x - stepsX;
+#if defined(__SSE2__)
+// one pixel sharpened from its blur sum; (d*amount)>>16 in 16 bit halves
+static inline __m128i unsharp_pixel( __m128i s, __m128i sum, __m128i half, __m128i bits,
+                                     __m128i a0, __m128i a1 ) {
+    __m128i d = _mm_sub_epi32( s, _mm_srl_epi32( _mm_add_epi32( sum, half ), bits ) );
+    __m128i d16 = _mm_packs_epi32( d, d );
+    __m128i p0 = _mm_unpacklo_epi16( _mm_mullo_epi16( d16, a0 ), _mm_mulhi_epi16( d16, a0 ) );
+    __m128i p1 = _mm_unpacklo_epi16( _mm_mullo_epi16( d16, a1 ), _mm_mulhi_epi16( d16, a1 ) );
+    return _mm_add_epi32( s, _mm_srai_epi32( _mm_add_epi32( _mm_slli_epi32( p1, 8 ), p0 ), 16 ) );
+}
+#endif
+
+static void* unsharp( void *arg ) {
+
+    unsharp_job *job = (unsharp_job*)arg;
+    const int width = job->width, height = job->height;
+    const int stepsX = job->stepsX, stepsY = job->stepsY;
+    const int stages = 2*stepsY;
+    const int scalebits = (stepsX+stepsY)*2;
+    const uint32_t halfscale = 1u << (scalebits-1);
+    const int amount = job->amount;
+    uint32_t *SR = job->state;
+    uint32_t *SC = SR + (size_t)(width+2*stepsX)*4;
+    int x, y, z, k, t, n;
+
+    for( y=job->y0-stepsY; y<job->y1+stepsY; y++ ) {
+	const uint8_t *src2 = (const uint8_t*)(job->src + (size_t)(y<0 ? 0 : y>=height ? height-1 : y)*width);
+	const int out = y >= job->y0+stepsY;
+	const int yo = out ? y-stepsY : 0;
+	const uint8_t *srx = (const uint8_t*)(job->src + (size_t)yo*width);
+	uint32_t *dsx = job->dst + (size_t)yo*width;
+
+	// the row with its borders repeated stepsX times
+	for( k=0; k<width+2*stepsX; k++ ) {
+	    const uint8_t *p = src2 + 4*(k<stepsX ? 0 : k>=width+stepsX ? width-1 : k-stepsX);
+	    SR[4*k+0] = p[0];
+	    SR[4*k+1] = p[1];
+	    SR[4*k+2] = p[2];
+	    SR[4*k+3] = p[3];
+	}
 
-		res = (int32_t)*srx + ( ( ( (int32_t)*srx - (int32_t)((Tmp1+halfscale) >> scalebits) ) * amount ) >> 16 );
-		*dsx = res>255 ? 255 : res<0 ? 0 : (uint8_t)res;
+#if defined(__SSE2__)
+	{
+	    __m128i *r = (__m128i*)SR;
+	    __m128i *c = (__m128i*)SC;
+	    const __m128i half = _mm_set1_epi32( (int)halfscale );
+	    const __m128i bits = _mm_cvtsi32_si128( scalebits );
+	    const __m128i a0 = _mm_set1_epi16( (short)(amount & 255) );
+	    const __m128i a1 = _mm_set1_epi16( (short)((amount - (amount & 255)) / 256) );
+	    const __m128i zero = _mm_setzero_si128();
+	    __m128i Tmp1, Tmp2, a, b;
+
+	    for( t=0; t<stepsX; t++ ) {
+		n = width + 2*stepsX - 2*t - 2;
+		a = _mm_loadu_si128( r+0 );
+		b = _mm_loadu_si128( r+1 );
+		for( k=0; k<n; k++ ) {
+		    __m128i cc = _mm_loadu_si128( r+k+2 );
+		    _mm_storeu_si128( r+k, _mm_add_epi32( _mm_add_epi32( a, cc ), _mm_slli_epi32( b, 1 ) ) );
+		    a = b;
+		    b = cc;
+		}
+	    }
+	    for( x=0; x<width; x++, c+=stages ) {
+		Tmp1 = _mm_loadu_si128( r+x );
+		for( z=0; z<stages; z+=2 ) {
+		    Tmp2 = _mm_add_epi32( _mm_loadu_si128( c+z+0 ), Tmp1 ); _mm_storeu_si128( c+z+0, Tmp1 );
+		    Tmp1 = _mm_add_epi32( _mm_loadu_si128( c+z+1 ), Tmp2 ); _mm_storeu_si128( c+z+1, Tmp2 );
+		}
+		if( out ) {
+		    __m128i s = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( *(const int*)(srx+4*x) ), zero ), zero );
+		    __m128i res = unsharp_pixel( s, Tmp1, half, bits, a0, a1 );
+		    res = _mm_packus_epi16( _mm_packs_epi32( res, res ), zero );
+		    dsx[x] = ((uint32_t)_mm_cvtsi128_si32( res ) & 0x00FFFFFF) | (((const uint32_t*)srx)[x] & 0xFF000000);
+		}
 	    }
 	}
-	if( y >= 0 ) {
-	    dst += dstStride;
-	    src += srcStride;
+#else
+	{
+	    uint32_t *c = SC;
+	    uint32_t Tmp1, Tmp2;
+	    int32_t res;
+
+	    for( t=0; t<stepsX; t++ ) {
+		n = width + 2*stepsX - 2*t - 2;
+		for( k=0; k<4*n; k++ )
+		    SR[k] = SR[k] + 2*SR[k+4] + SR[k+8];
+	    }
+	    for( x=0; x<width; x++, c+=4*stages ) {
+		uint32_t pixel = 0;
+		for( k=0; k<3; k++ ) {
+		    Tmp1 = SR[4*x+k];
+		    for( z=0; z<stages; z+=2 ) {
+			Tmp2 = c[4*z+k] + Tmp1; c[4*z+k] = Tmp1;
+			Tmp1 = c[4*z+4+k] + Tmp2; c[4*z+4+k] = Tmp2;
+		    }
+		    if( out ) {
+			res = (int32_t)srx[4*x+k] + ( ( ( (int32_t)srx[4*x+k] - (int32_t)((Tmp1+halfscale) >> scalebits) ) * amount ) >> 16 );
+			pixel |= (uint32_t)(res>255 ? 255 : res<0 ? 0 : res) << (8*k);
+		    }
+		}
+		if( out )
+		    dsx[x] = pixel | (((const uint32_t*)srx)[x] & 0xFF000000);
+	    }
 	}
+#endif
     }
+    return 0;
 }
 
 
@@ -177,6 +258,12 @@ info->num_params=2;
 info->explanation="Unsharp masking (port from Mplayer)";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 //--------------------------------------------------
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
@@ -199,19 +286,11 @@ switch(param_index)
 f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 {
 inst *in;
-int z;
 
 in=calloc(1,sizeof(inst));
 in->w=width;
 in->h=height;
 
-in->Rplani=calloc(width*height,sizeof(unsigned char));
-in->Gplani=calloc(width*height,sizeof(unsigned char));
-in->Bplani=calloc(width*height,sizeof(unsigned char));
-in->Rplano=calloc(width*height,sizeof(unsigned char));
-in->Gplano=calloc(width*height,sizeof(unsigned char));
-in->Bplano=calloc(width*height,sizeof(unsigned char));
-
 //defaults
 in->fp.amount=0.0;
 in->size=3;
@@ -219,10 +298,6 @@ in->fp.msizeX=3;
 in->fp.msizeY=3;
 in->ac=0;
 
-memset(in->fp.SC,0,sizeof(in->fp.SC));
-for( z=0; z<in->fp.msizeY; z++ )
-    in->fp.SC[z] = calloc(in->w+in->fp.msizeX , sizeof(*(in->fp.SC[z])));
-
 return (f0r_instance_t)in;
 }
 
@@ -230,17 +305,11 @@ return (f0r_instance_t)in;
 void f0r_destruct(f0r_instance_t instance)
 {
 inst *in;
-int i;
 
 in=(inst*)instance;
 
-free(in->Rplani);
-free(in->Gplani);
-free(in->Bplani);
-free(in->Rplano);
-free(in->Gplano);
-free(in->Bplano);
-for (i=0;i<in->fp.msizeY;i++) free(in->fp.SC[i]);
+free(in->state);
+free(in->copy);
 
 free(instance);
 }
@@ -250,7 +319,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t parm, int param_in
 {
 inst *p;
 double tmpf;
-int tmpi,chg,z;
+int tmpi,chg;
 
 p=(inst*)instance;
 
@@ -271,17 +340,9 @@ switch(param_index)
 
 if (chg==0) return;
 
-
-for( z=0; z<p->fp.msizeY; z++ )
-    free(p->fp.SC[z]);
-
+//the state buffers grow in f0r_update if the new size needs more
 p->fp.msizeX=p->size;
 p->fp.msizeY=p->size;
-
-memset(p->fp.SC,0,sizeof(p->fp.SC));
-for( z=0; z<p->fp.msizeY; z++ )
-    p->fp.SC[z] = calloc(p->w+p->fp.msizeX , sizeof(*(p->fp.SC[z])));
-
 }
 
 //--------------------------------------------------
@@ -306,28 +367,53 @@ switch(param_index)
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
 inst *in;
-int i;
+unsharp_job jobs[FREI0R_MAX_THREADS];
+size_t per_thread;
+int i,n;
 
 assert(instance);
 in=(inst*)instance;
 
-//Frei0r works with packed color, Mplayer with planar color
-for (i=0;i<(in->w*in->h);i++)	//copy to planar
+if (in->w<=0 || in->h<=0) return;
+if (!in->fp.amount)
 	{
-	in->Rplani[i]=inframe[i]&255;
-	in->Gplani[i]=(inframe[i]>>8)&255;
-	in->Bplani[i]=(inframe[i]>>16)&255;
+	if (inframe!=outframe) memcpy(outframe,inframe,(size_t)in->w*in->h*sizeof(uint32_t));
+	return;
 	}
 
-unsharp(in->Rplano, in->Rplani, in->w, in->w, in->w, in->h, &in->fp);
-unsharp(in->Gplano, in->Gplani, in->w, in->w, in->w, in->h, &in->fp);
-unsharp(in->Bplano, in->Bplani, in->w, in->w, in->w, in->h, &in->fp);
-
-for (i=0;i<(in->w*in->h);i++)	//copy to packed, preserve alpha
+//Frei0r works with packed color; the channels are blurred together
+n=frei0r_thread_count((long)in->w*in->h);
+per_thread=unsharp_state_size(in->w,in->fp.msizeX/2,in->fp.msizeY/2);
+if (in->state_size<n*per_thread)
 	{
-	outframe[i]=((uint32_t)in->Rplano[i])|((uint32_t)in->Gplano[i]<<8)|((uint32_t)in->Bplano[i]<<16)|(inframe[i]&0xFF000000);
+	free(in->state);
+	in->state_size=n*per_thread;
+	in->state=(uint32_t*)calloc(in->state_size,sizeof(uint32_t));
+	if (in->state==NULL) {in->state_size=0; return;}
 	}
 
+//bands read the rows around them, which the neighbouring bands write
+if (inframe==outframe && n>1)
+	{
+	if (in->copy==NULL) in->copy=(uint32_t*)malloc((size_t)in->w*in->h*sizeof(uint32_t));
+	if (in->copy==NULL) return;
+	memcpy(in->copy,inframe,(size_t)in->w*in->h*sizeof(uint32_t));
+	inframe=in->copy;
+	}
 
+for (i=0;i<n;i++)
+	{
+	jobs[i].src=inframe;
+	jobs[i].dst=outframe;
+	jobs[i].width=in->w;
+	jobs[i].height=in->h;
+	jobs[i].y0=in->h*i/n;
+	jobs[i].y1=in->h*(i+1)/n;
+	jobs[i].stepsX=in->fp.msizeX/2;
+	jobs[i].stepsY=in->fp.msizeY/2;
+	jobs[i].amount=in->fp.amount*65536.0;
+	jobs[i].state=in->state+i*per_thread;
+	}
+frei0r_thread_run(unsharp,jobs,sizeof(unsharp_job),n);
 }
 
@@ -23,10 +23,10 @@
 
 #include <stdlib.h>
 #include <assert.h>
-#include <stdio.h>
 #include <math.h>
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_lut.h"
 
 #define SIGMOIDAL_BASE   2
 #define SIGMOIDAL_RANGE 20
@@ -39,60 +39,27 @@ typedef struct sigmoidal_instance
   double sharpness;
 } sigmoidal_instance_t;
 
-static inline int gimp_rgb_to_l_int (int red,
-                   int green,
-                   int blue)
+/* The gray of each lightness, computed per call instead of per pixel.
+   The lightness of the GIMP, ROUND((max + min) / 2.0), is what
+   frei0r_lut_lightness() gives. */
+static void sigmoidal_palette(const sigmoidal_instance_t* inst,
+                              uint32_t* palette)
 {
-  int min, max;
-
-  if (red > green)
-    {
-      max = MAX (red,   blue);
-      min = MIN (green, blue);
-    }
-  else
-    {
-      max = MAX (green, blue);
-      min = MIN (red,   blue);
-    }
-
-  return ROUND ((max + min) / 2.0);
-}
-
-void sigmoidal_transfer(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
-{
-  assert(instance);
-  sigmoidal_instance_t* inst = (sigmoidal_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
-
   double brightness = inst->brightness;
   double sharpness = inst->sharpness;
-
-  const unsigned char* src = (unsigned char*)inframe;
-  unsigned char* dst = (unsigned char*)outframe;
-
-  unsigned char luma, r, g, b;
+  unsigned char luma;
   double val;
-  while (len--)
-  {
-    r = *src++;
-    g = *src++;
-    b = *src++;
-
-    //desaturate 
-    luma = (unsigned char) gimp_rgb_to_l_int (r, g, b);
+  int i;
 
+  for (i = 0; i < 256; ++i)
+  {
     //compute sigmoidal transfer
-    val = luma / 255.0;
+    val = i / 255.0;
     val = 255.0 / (1 + exp (-(SIGMOIDAL_BASE + (sharpness * SIGMOIDAL_RANGE)) * (val - 0.5)));
     val = val * brightness;
     luma = (unsigned char) CLAMP (val, 0, 255);
 
-    *dst++ = luma;
-    *dst++ = luma;
-    *dst++ = luma;
-    *dst++ = *src++;
+    palette[i] = luma * 0x010101u;
   }
 }
 
@@ -118,6 +85,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* sigmoidalInfo)
   sigmoidalInfo->explanation = "Desaturates image and creates a particular look that could be called Stamp, Newspaper or Photocopy";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch ( param_index ) {
@@ -179,9 +153,40 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  sigmoidal_instance_t* inst = (sigmoidal_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  uint32_t palette[256];
+  uint8_t luma[FREI0R_LUT_CHUNK];
+  unsigned int len = inst->width * (row_end - row_begin);
+  unsigned int i, n;
+
+  sigmoidal_palette(inst, palette);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
+  for (i = 0; i < len; i += n)
+  {
+    //desaturate
+    n = MIN(len - i, FREI0R_LUT_CHUNK);
+    frei0r_lut_lightness(luma, inframe + i, n);
+    frei0r_lut_palette(palette, outframe + i, luma, inframe + i, n);
+  }
+  return 1;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
-  sigmoidal_transfer(instance, time, inframe, outframe);
+  assert(instance);
+  sigmoidal_instance_t* inst = (sigmoidal_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
 }
-
@@ -19,6 +19,7 @@
 
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_neighbourhood.h"
 #include <stdlib.h>
 
 class sobel : public frei0r::filter
@@ -26,44 +27,113 @@ class sobel : public frei0r::filter
 public:
   sobel(unsigned int width, unsigned int height)
   {
+    memoize = true;
   }
   
   virtual void update(double time,
                       uint32_t* out,
                       const uint32_t* in)
   {
-    std::copy(in, in + width*height, out);
-    for (unsigned int y=1; y<height-1; ++y)
+    m_in = in;
+    m_out = out;
+    if (width < 3 || height < 3 ||
+        !frei0r_neighbourhood_run(in, width, height, 4, 1, row, this,
+                                  2*4*width*sizeof(int16_t)))
+      std::copy(in, in + width*height, out);
+  }
+
+  virtual int footprint()
+  {
+    return 1;
+  }
+
+  // The same as row() for the pixels of a tile, with the neighbours
+  // taken from the input tile, in chunks of the scratch on the stack
+  // since tiles may run on several threads.
+  virtual bool update_tile(double time,
+                           uint32_t* out, int out_stride,
+                           const f0r_rect_t& outrect,
+                           const uint32_t* in, int in_stride,
+                           const f0r_rect_t& inrect)
+  {
+    static const int chunk = 64;
+    int16_t gx[4*chunk], gy[4*chunk];
+    // the pixels that aren't on the left or right border
+    const int x0 = std::max(outrect.x, 1);
+    const int x1 = std::min(outrect.x + outrect.width, (int)width - 1);
+
+    (void)time; // unused
+    for (int y = 0; y < outrect.height; ++y)
     {
-      for (unsigned int x=1; x<width-1; ++x)
+      const int fy = outrect.y + y;
+      const uint32_t* src = frei0r::frame_row(in, in_stride, fy - inrect.y)
+        + (outrect.x - inrect.x);
+      uint32_t* dst = frei0r::frame_row(out, out_stride, y);
+
+      std::copy(src, src + outrect.width, dst);
+      if (width < 3 || height < 3 || fy == 0 || fy == (int)height-1)
+        continue;
+      for (int x = x0; x < x1; x += chunk)
       {
-        // XXX faut eviter le * width en y allant par rangee
-        unsigned char *p1 = (unsigned char *)&in[(y-1)*width+(x-1)];
-        unsigned char *p2 = (unsigned char *)&in[(y-1)*width+x];
-        unsigned char *p3 = (unsigned char *)&in[(y-1)*width+(x+1)];
-        unsigned char *p4 = (unsigned char *)&in[y*width+(x-1)];
-        unsigned char *p6 = (unsigned char *)&in[y*width+(x+1)];
-        unsigned char *p7 = (unsigned char *)&in[(y+1)*width+(x-1)];
-        unsigned char *p8 = (unsigned char *)&in[(y+1)*width+x];
-        unsigned char *p9 = (unsigned char *)&in[(y+1)*width+(x+1)];
-        
-        unsigned char *g = (unsigned char *)&out[y*width+x];
-        
-        for (int i=0; i<3; ++i)
-          g[i] = CLAMP0255(
-                           abs(p1[i] + p2[i]*2 + p3[i] - p7[i] - p8[i]*2 - p9[i]) +
-                           abs(p3[i] + p6[i]*2 + p9[i] - p1[i] - p4[i]*2 - p7[i]) );
+        const int n = std::min(chunk, x1 - x);
+        const uint8_t* here = (const uint8_t*)(src + (x - outrect.x));
+        const uint8_t* rows[3] = { here - in_stride, here, here + in_stride };
+        uint32_t* d = dst + (x - outrect.x);
 
-        g[3] = ((unsigned char*)&in[y*width+x])[3]; // copy alpha
+        frei0r_neighbourhood_conv(gx, rows, 4*n, 4, 1, kx);
+        frei0r_neighbourhood_conv(gy, rows, 4*n, 4, 1, ky);
+        frei0r_neighbourhood_abs_sum((uint8_t*)d, gx, gy, 4*n);
+        for (int i = 0; i < n; ++i)
+          d[i] = (d[i] & 0x00ffffff) | (src[x - outrect.x + i] & 0xff000000);
       }
     }
+    return true;
+  }
+
+private:
+  static const int16_t kx[9];
+  static const int16_t ky[9];
+
+  const uint32_t* m_in;
+  uint32_t* m_out;
+
+  // The border pixels keep their input color.
+  static void row(void* user, const uint8_t* const* rows, int y,
+                  void* scratch)
+  {
+    sobel* f = (sobel*)user;
+    const unsigned int width = f->width;
+    const uint32_t* in = f->m_in + (size_t)y*width;
+    uint32_t* out = f->m_out + (size_t)y*width;
+    int16_t* gx = (int16_t*)scratch;
+    int16_t* gy = gx + 4*width;
+
+    if (y == 0 || y == (int)f->height-1)
+    {
+      std::copy(in, in + width, out);
+      return;
+    }
+
+    frei0r_neighbourhood_conv(gx, rows, 4*width, 4, 1, kx);
+    frei0r_neighbourhood_conv(gy, rows, 4*width, 4, 1, ky);
+    frei0r_neighbourhood_abs_sum((uint8_t*)out, gx, gy, 4*width);
+    for (unsigned int x=0; x<width; ++x)
+      out[x] = (out[x] & 0x00ffffff) | (in[x] & 0xff000000); // copy alpha
+    out[0] = in[0];
+    out[width-1] = in[width-1];
   }
 };
 
+const int16_t sobel::kx[9] = {  1,  2,  1,
+                                0,  0,  0,
+                               -1, -2, -1 };
+const int16_t sobel::ky[9] = { -1,  0,  1,
+                               -2,  0,  2,
+                               -1,  0,  1 };
 
 frei0r::construct<sobel> plugin("Sobel",
                                 "Sobel filter",
                                 "Jean-Sebastien Senecal (Drone)",
                                 0,2,
-                                F0R_COLOR_MODEL_RGBA8888);
-
+                                F0R_COLOR_MODEL_RGBA8888,
+                                F0R_CAP_TILE | F0R_CAP_RB_SYMMETRIC);
@@ -24,11 +24,13 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 #include "frei0r.h"
-#include "blur.h"
+#include "frei0r_pyramid.h"
 #include "frei0r_math.h"
+#include "frei0r_lut.h"
 
 #define SIGMOIDAL_BASE   2
 #define SIGMOIDAL_RANGE 20
@@ -45,7 +47,7 @@ typedef struct softglow_instance
   double brightness;
   double sharpness;
 	double blendtype;
-	f0r_instance_t* blur_instance;
+	frei0r_pyramid_t pyramid;
   uint32_t* sigm_frame;
 	uint32_t* blurred;
 } softglow_instance_t;
@@ -118,27 +120,6 @@ void add(const uint32_t* source1, const uint32_t* source2, uint32_t* out, unsign
       }
   }
 
-int
-gimp_rgb_to_l_int (int red,
-                   int green,
-                   int blue)
-{
-  int min, max;
-
-  if (red > green)
-    {
-      max = MAX (red,   blue);
-      min = MIN (green, blue);
-    }
-  else
-    {
-      max = MAX (green, blue);
-      min = MIN (red,   blue);
-    }
-
-  return ROUND ((max + min) / 2.0);
-}
-
 int f0r_init()
 {
   return 1;
@@ -155,11 +136,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* softglowInfo)
   softglowInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
   softglowInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   softglowInfo->major_version = 0; 
-  softglowInfo->minor_version = 9; 
+  softglowInfo->minor_version = 10; 
   softglowInfo->num_params =  4; 
   softglowInfo->explanation = "Does softglow effect on highlights";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch ( param_index ) {
@@ -195,7 +182,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->brightness = 0.75;
   inst->sharpness = 0.85;
 	inst->blendtype = 0.0;
-	inst->blur_instance = (f0r_instance_t *)blur_construct(width, height);
+	frei0r_pyramid_init(&inst->pyramid, width, height);
   inst->sigm_frame = (uint32_t*)malloc(width * height * sizeof(uint32_t));
 	inst->blurred = (uint32_t*)malloc(width * height * sizeof(uint32_t));
   return (f0r_instance_t)inst;
@@ -204,7 +191,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 void f0r_destruct(f0r_instance_t instance)
 {
 	softglow_instance_t* inst = (softglow_instance_t*)instance;
-	blur_destruct(inst->blur_instance);
+	frei0r_pyramid_free(&inst->pyramid);
   free(inst->sigm_frame);
   free(inst->blurred);
   free(instance);
@@ -218,7 +205,6 @@ void f0r_set_param_value(f0r_instance_t instance,
   {
 		case 0:
 			inst->blur = *((double*)param);
-			blur_set_param_value(inst->blur_instance, &inst->blur, 0 );
 			break;
     case 1:
       inst->brightness = *((double*)param);
@@ -264,35 +250,32 @@ void f0r_update(f0r_instance_t instance, double time,
   double brightness = inst->brightness;
   double sharpness = inst->sharpness;
 
-  const unsigned char* src = (unsigned char*)inframe;
-
-  memcpy(inst->sigm_frame, inframe, len*sizeof(uint32_t));
-  unsigned char* dst = (unsigned char*)inst->sigm_frame;
-
-  unsigned char luma, r, g, b;
+  // the sigmoidal transfer of each lightness, as gray
+  uint32_t transfer[256];
+  uint8_t luma[FREI0R_LUT_CHUNK];
+  unsigned char l;
   double val;
-  while (len--)
+  unsigned int i, n;
+  for (i = 0; i < 256; i++)
   {
-    r = *src++;
-    g = *src++;
-    b = *src++;
-
-    //desaturate 
-    luma = (unsigned char) gimp_rgb_to_l_int (r, g, b);
-
-    //compute sigmoidal transfer
-    val = luma / 255.0;
+    val = i / 255.0;
     val = 255.0 / (1 + exp (-(SIGMOIDAL_BASE + (sharpness * SIGMOIDAL_RANGE)) * (val - 0.5)));
     val = val * brightness;
-    luma = (unsigned char) CLAMP (val, 0, 255);
+    l = (unsigned char) CLAMP (val, 0, 255);
+    transfer[i] = l * 0x010101u;
+  }
 
-    *dst++ = luma;
-    *dst++ = luma;
-    *dst++ = luma;
-    *dst++ = *src++;
+  for (i = 0; i < len; i += n)
+  {
+    //desaturate to the lightness of the GIMP, ROUND((max + min) / 2.0)
+    n = MIN(len - i, FREI0R_LUT_CHUNK);
+    frei0r_lut_lightness(luma, inframe + i, n);
+    frei0r_lut_palette(transfer, inst->sigm_frame + i, luma, inframe + i, n);
   }
 
-	blur_update(inst->blur_instance, 0.0, inst->sigm_frame, inst->blurred);
+	// the kernel is a proportion of the larger side, as in blur.h
+	unsigned int max = MAX(inst->width, inst->height);
+	frei0r_pyramid_blur(&inst->pyramid, inst->blurred, inst->sigm_frame, (int)(inst->blur * max / 2.0));
 
   if (inst->blendtype <= 0.33)
     screen(inst->blurred, inframe, outframe, inst->width * inst->height);
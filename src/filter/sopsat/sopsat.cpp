@@ -22,6 +22,10 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /**
   This filter implements a standard way of color correction proposed by
   the American Society of Cinematographers: The Color Decision List, also
@@ -105,6 +109,7 @@ public:
         bPower = 1 / 20.;
         aPower = 1 / 20.;
         saturation = 1 / 10.;
+        pointwise = true;
 
         // Pre-build the lookup table.
         // For 1080p, rendering a 5-second video took
@@ -128,31 +133,31 @@ public:
         free(m_lutA);
     }
 
-    virtual void update(double time,
-	                    uint32_t* out,
-                        const uint32_t* in)
+    virtual void on_params_changed()
     {
-        // Rebuild the lookup table in case the prarameters have changed.
         updateLUT();
+    }
 
-        unsigned char *pixel = (unsigned char *) in;
-        unsigned char *dest = (unsigned char *) out;
+    virtual bool update_slice(double time,
+                              uint32_t* out,
+                              const uint32_t* in,
+                              unsigned int row_begin,
+                              unsigned int row_end)
+    {
+        const unsigned char *pixel = (const unsigned char *) (in + width*row_begin);
+        unsigned char *dest = (unsigned char *) (out + width*row_begin);
+        unsigned int n = width*(row_end - row_begin);
 
         if (fabs(m_sat-1) < 0.001) {
             // Calculating the saturation is expensive. So first check whether
             // we really need to do it.
-            // Keeping the if/else outside of the loop gives a little speed gain.
-            // Worth the duplicate code, as only 4 lines so far :)
-
-            for (unsigned int i = 0; i < size; i++) {
-                *dest++ = m_lutR[*pixel++];
-                *dest++ = m_lutG[*pixel++];
-                *dest++ = m_lutB[*pixel++];
-                *dest++ = m_lutA[*pixel++];
-            }
+            applyLUT(pixel, dest, n);
+        } else if (m_satQ >= 0) {
+            applyLUT(pixel, dest, n);
+            saturate((uint32_t *) dest, n);
         } else {
             double luma;
-            for (unsigned int i = 0; i < size; i++) {
+            for (unsigned int i = 0; i < n; i++) {
                 luma =   0.2126 * m_lutR[*(pixel+0)]
                        + 0.7152 * m_lutG[*(pixel+1)]
                        + 0.0722 * m_lutB[*(pixel+2)];
@@ -162,6 +167,7 @@ public:
                 *dest++ = m_lutA[*pixel++];
             }
         }
+        return true;
     }
 
 private:
@@ -171,6 +177,74 @@ private:
     unsigned char *m_lutA;
 
     double m_sat;
+    // m_sat in 5.11 fixed point for saturate(), -1 if it does not fit
+    int m_satQ;
+
+    // Rec. 709 luma weights in 2.14 fixed point, summing up to 1 << 14
+    enum { WR = 3483, WG = 11718, WB = 1183 };
+
+    void applyLUT(const unsigned char *pixel, unsigned char *dest, unsigned int n)
+    {
+        for (unsigned int i = 0; i < n; i++) {
+            *dest++ = m_lutR[*pixel++];
+            *dest++ = m_lutG[*pixel++];
+            *dest++ = m_lutB[*pixel++];
+            *dest++ = m_lutA[*pixel++];
+        }
+    }
+
+    // luma + sat*(c-luma) in fixed point: luma in 14 fractional bits,
+    // the difference rounded to 7, which times the 11 of m_satQ fits
+    // into 16 bit lanes and the sum into 32 bits
+    static inline int saturateChannel(int c, int luma, int sat)
+    {
+        int d = ((c << 14) - luma + 64) >> 7;
+        return CLAMP0255(((luma << 4) + d * sat) >> 18);
+    }
+
+    void saturate(uint32_t *px, unsigned int n)
+    {
+        unsigned int i = 0;
+#if defined(__SSE2__)
+        const __m128i c255 = _mm_set1_epi32(255);
+        const __m128i wr = _mm_set1_epi32(WR);
+        const __m128i wg = _mm_set1_epi32(WG);
+        const __m128i wb = _mm_set1_epi32(WB);
+        const __m128i sat = _mm_set1_epi32(m_satQ);
+        const __m128i round = _mm_set1_epi32(64);
+        for (; i + 4 <= n; i += 4) {
+            // one pixel per 32 bit lane, each channel in the low 16 bits
+            __m128i p = _mm_loadu_si128((const __m128i *) (px + i));
+            __m128i c[3], luma;
+            c[0] = _mm_and_si128(p, c255);
+            c[1] = _mm_and_si128(_mm_srli_epi32(p, 8), c255);
+            c[2] = _mm_and_si128(_mm_srli_epi32(p, 16), c255);
+            luma = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(c[0], wr),
+                                               _mm_madd_epi16(c[1], wg)),
+                                 _mm_madd_epi16(c[2], wb));
+            __m128i l4 = _mm_slli_epi32(luma, 4);
+            p = _mm_and_si128(p, _mm_set1_epi32((int) 0xff000000));
+            for (int k = 0; k < 3; k++) {
+                __m128i d = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(
+                                _mm_slli_epi32(c[k], 14), luma), round), 7);
+                __m128i v = _mm_srai_epi32(_mm_add_epi32(l4, _mm_madd_epi16(d, sat)), 18);
+                v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+                v = _mm_and_si128(_mm_or_si128(v, _mm_cmpgt_epi32(v, c255)), c255);
+                p = _mm_or_si128(p, _mm_slli_epi32(v, 8*k));
+            }
+            _mm_storeu_si128((__m128i *) (px + i), p);
+        }
+#endif
+        for (; i < n; i++) {
+            uint32_t p = px[i];
+            int r = p & 0xff, g = (p >> 8) & 0xff, b = (p >> 16) & 0xff;
+            int luma = WR*r + WG*g + WB*b;
+            px[i] = (p & 0xff000000)
+                | saturateChannel(r, luma, m_satQ)
+                | saturateChannel(g, luma, m_satQ) << 8
+                | saturateChannel(b, luma, m_satQ) << 16;
+        }
+    }
 
     void updateLUT() {
         double rS = rSlope * 20;
@@ -189,6 +263,9 @@ private:
         double aP = aPower * 20;
 
         m_sat = saturation * 10;
+        m_satQ = (m_sat >= 0 && m_sat < 16) ? (int) (m_sat * 2048 + 0.5) : -1;
+        if (m_satQ > 32767)
+            m_satQ = -1;
 
         for (int i = 0; i < 256; i++) {
             // above0 avoids overflows for negative numbers.
@@ -24,68 +24,7 @@
 #include <string.h>
 
 #include "frei0r.h"
-
-void green_limited_by_blue(unsigned int len, const uint32_t* inframe, uint32_t* outframe)
-{
-
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  unsigned char b = 0;
-  unsigned char g = 0;
-
-  while (len--)
-  {
-    *dst++ = *src++;
-    g = *src++;
-    dst++;
-    b = *src++;
-    dst++;
-    *dst++ = *src++;
-
-    if( g > b )
-    {
-      *(dst - 3) = b;
-      *(dst - 2) = b;
-    }
-    else
-    {
-      *(dst - 3) = g;
-      *(dst - 2) = b;
-    }
-  
-  }
-}
-
-void blue_limited_by_green(unsigned int len, const uint32_t* inframe, uint32_t* outframe)
-{
-
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  unsigned char b = 0;
-  unsigned char g = 0;
-
-  while (len--)
-  {
-    *dst++ = *src++;
-    g = *src++;
-    dst++;
-    b = *src++;
-    dst++;
-    *dst++ = *src++;
-
-    if( b > g )
-    {
-      *(dst - 3) = g;
-      *(dst - 2) = g;
-    }
-    else
-    {
-      *(dst - 3) = g;
-      *(dst - 2) = b;
-    }
-  
-  }
-}
+#include "frei0r_key.h"
 
 typedef struct spillsupress_instance
 {
@@ -117,6 +56,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* spillsupress_info)
   spillsupress_info->explanation = "Remove green or blue spill light from subjects shot in front of green or blue screen";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -171,20 +116,32 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
 {
   assert(instance);
   spillsupress_instance_t* inst = (spillsupress_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
 
-  if (inst->supress_type > 0.5)
-  {
-    blue_limited_by_green(len, inframe, outframe);
-  }
-  else
-  {
-    green_limited_by_blue(len, inframe, outframe);
-  }
+  unsigned int len = inst->width * (row_end - row_begin);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
+
+  frei0r_key_spill_row(inst->supress_type > 0.5 ? FREI0R_KEY_SPILL_BLUE
+                                                : FREI0R_KEY_SPILL_GREEN,
+                       outframe, inframe, len);
+  return 1;
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  spillsupress_instance_t* inst = (spillsupress_instance_t*)instance;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
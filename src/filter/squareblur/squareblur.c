@@ -47,6 +47,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* squareblur_info)
   squareblur_info->explanation = "Variable-size square blur";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   blur_get_param_info(info, param_index);
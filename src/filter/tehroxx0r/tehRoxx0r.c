@@ -1,4 +1,5 @@
 #include "frei0r.h"
+#include "frei0r_thread.h"
 #include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
@@ -20,9 +21,19 @@ typedef struct teh_roxx0r
   double time_stack;
 
   uint32_t* small_block;    // buffer to write downscaled frame
+  unsigned int* middle_x;   // source column of each column of the middle
   
 } tehRoxx0r_instance_t;
 
+/* rows y0 to y1 of the middle block */
+typedef struct tehRoxx0r_job
+{
+  const tehRoxx0r_instance_t* inst;
+  const uint32_t* src;
+  uint32_t* dst;
+  unsigned int y0, y1;
+} tehRoxx0r_job_t;
+
 
 // returns greatest common divisor of to int numbers
 int gcd(int a, int b);
@@ -43,7 +54,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tehRoxx0rInfo)
   tehRoxx0rInfo->color_model = F0R_COLOR_MODEL_PACKED32;
   tehRoxx0rInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   tehRoxx0rInfo->major_version = 0; 
-  tehRoxx0rInfo->minor_version = 9; 
+  tehRoxx0rInfo->minor_version = 10; 
   tehRoxx0rInfo->num_params =  1; 
   tehRoxx0rInfo->explanation = "Something videowall-ish";
 }
@@ -74,6 +85,17 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->small_block = 
     (uint32_t*)malloc(sizeof(uint32_t)*inst->block_size*inst->block_size);
 
+  // the columns of the downscaled middle only depend on the size
+  if(width > 2*inst->block_size)
+    {
+      unsigned int x, small_w = width - 2*inst->block_size;
+      double step_x = (double)width / (double)small_w;
+
+      inst->middle_x = (unsigned int*)malloc(sizeof(unsigned int)*small_w);
+      for(x=0;x<small_w;x++)
+	inst->middle_x[x] = (int)(x*step_x);
+    }
+
   return (f0r_instance_t)inst;
 }
 
@@ -81,6 +103,7 @@ void f0r_destruct(f0r_instance_t instance)
 {
   tehRoxx0r_instance_t* inst = (tehRoxx0r_instance_t*)instance;
   free(inst->small_block);
+  free(inst->middle_x);
   free(inst);
 }
 
@@ -113,6 +136,33 @@ void f0r_get_param_value(f0r_instance_t instance,
 }
 
 
+/* Rows of the middle, a downscaled version of the frame, with the
+   black border left and right of them. */
+static void* tehRoxx0r_middle(void* arg)
+{
+  tehRoxx0r_job_t* job = (tehRoxx0r_job_t*)arg;
+  const tehRoxx0r_instance_t* inst = job->inst;
+  unsigned int w = inst->width;
+  unsigned int bs = inst->block_size;
+  unsigned int small_w = w-2*bs;
+  double step_y = (double)inst->height / (double)(inst->height-2*bs);
+  const unsigned int* middle_x = inst->middle_x;
+  unsigned int x, small_y;
+
+  for(small_y=job->y0; small_y<job->y1; small_y++)
+    {
+      const uint32_t* src = job->src + (unsigned int)(step_y*(small_y-bs))*w;
+      uint32_t* dst = job->dst + small_y*w;
+
+      memset(dst, 0, bs*sizeof(uint32_t));
+      memset(dst + w - bs, 0, bs*sizeof(uint32_t));
+      dst += bs;
+      for(x=0;x<small_w;x++)
+	dst[x] = src[middle_x[x]];
+    }
+  return 0;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
 		const uint32_t* inframe, uint32_t* outframe)
 {
@@ -133,24 +183,28 @@ void f0r_update(f0r_instance_t instance, double time,
   small_w = w-2*inst->block_size;
   small_h = h-2*inst->block_size;
   
-  // get interpolation step for that
-  step_x = (double)w / (double)small_w;
-  step_y = (double)h / (double)small_h;
-  
-  // make background black transparent
-  memset(outframe, 0, w * h * sizeof(uint32_t));
-  
-  // copy a downscaled version into the middle of the result frame 
-  // (blocksize to x-blocksize and blocksize to y-blocksize)
-  for(y = 0, small_y=inst->block_size;small_y<h-inst->block_size;small_y++,
-	y=step_y*(small_y-inst->block_size))
+  // make the background black transparent, and copy a downscaled
+  // version into the middle of the result frame (blocksize to
+  // x-blocksize and blocksize to y-blocksize)
+  if((int)small_w <= 0 || (int)small_h <= 0)
+    memset(outframe, 0, w * h * sizeof(uint32_t));
+  else
     {
-      src = inframe + y*w;
-      dst = outframe + small_y*w + inst->block_size;
-      for(x=0;x<w-2*inst->block_size;x++)
+      tehRoxx0r_job_t jobs[FREI0R_MAX_THREADS];
+      int i, n = frei0r_thread_count((long)w * h);
+
+      memset(outframe, 0, inst->block_size * w * sizeof(uint32_t));
+      memset(outframe + (h-inst->block_size) * w, 0,
+	     inst->block_size * w * sizeof(uint32_t));
+      for(i = 0; i < n; i++)
 	{
-	  *dst++ = *(src + (int)(x*step_x));
+	  jobs[i].inst = inst;
+	  jobs[i].src = inframe;
+	  jobs[i].dst = outframe;
+	  jobs[i].y0 = inst->block_size + small_h * i / n;
+	  jobs[i].y1 = inst->block_size + small_h * (i + 1) / n;
 	}
+      frei0r_thread_run(tehRoxx0r_middle, jobs, sizeof(tehRoxx0r_job_t), n);
     }
 
   // add elapsed time to timestack
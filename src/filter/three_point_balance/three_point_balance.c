@@ -35,8 +35,15 @@ typedef struct three_point_balance_instance
   f0r_param_color_t whiteColor;
   double splitPreview;
   double srcPosition;
+  // look-up tables of the channels, rebuilt when a color changes; each
+  // holds its values at the bits of its channel in a pixel
+  uint32_t mapRed[256];
+  uint32_t mapGreen[256];
+  uint32_t mapBlue[256];
 } three_point_balance_instance_t;
 
+static void update_maps(three_point_balance_instance_t* inst);
+
 int f0r_init()
 {
   return 1;
@@ -53,7 +60,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* three_point_balance_info)
   three_point_balance_info->color_model = F0R_COLOR_MODEL_RGBA8888;
   three_point_balance_info->frei0r_version = FREI0R_MAJOR_VERSION;
   three_point_balance_info->major_version = 0; 
-  three_point_balance_info->minor_version = 1; 
+  three_point_balance_info->minor_version = 2; 
   three_point_balance_info->num_params = 5; 
   three_point_balance_info->explanation = "Adjust color balance with 3 color points";
 }
@@ -105,6 +112,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->whiteColor.b = 1;
   inst->splitPreview = 1;
   inst->srcPosition = 1;
+  update_maps(inst);
   return (f0r_instance_t)inst;
 }
 
@@ -123,12 +131,15 @@ void f0r_set_param_value(f0r_instance_t instance,
   {
 	case 0:
 	  inst->blackColor = *((f0r_param_color_t *)param);
+	  update_maps(inst);
 	  break;
 	case 1:
 	  inst->grayColor = *((f0r_param_color_t *)param);
+	  update_maps(inst);
 	  break;
 	case 2:
 	  inst->whiteColor = *((f0r_param_color_t *)param);
+	  update_maps(inst);
 	  break;
 	case 3:
 	  inst->splitPreview = *((double *)param);
@@ -221,19 +232,8 @@ double parabola(double x, double* coeffs) {
   return (coeffs[0] * x + coeffs[1]) * x + coeffs[2];
 }
 
-void f0r_update(f0r_instance_t instance, double time,
-                const uint32_t* inframe, uint32_t* outframe)
+static void update_maps(three_point_balance_instance_t* inst)
 {
-  assert(instance);
-  three_point_balance_instance_t* inst = (three_point_balance_instance_t*)instance;
-  
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-
-  int mapRed[256];
-  int mapGreen[256];
-  int mapBlue[256];
-
   double redPoints[6] = {inst->blackColor.r, 0, inst->grayColor.r, 0.5, inst->whiteColor.r, 1};
   double greenPoints[6] = {inst->blackColor.g, 0, inst->grayColor.g, 0.5, inst->whiteColor.g, 1};
   double bluePoints[6] = {inst->blackColor.b, 0, inst->grayColor.b, 0.5, inst->whiteColor.b, 1};
@@ -244,39 +244,54 @@ void f0r_update(f0r_instance_t instance, double time,
   //building map for values from 0 to 255
   for(int i = 0; i < 256; i++) {
 	double w = parabola(i / 255., redCoeffs);
-	mapRed[i] = CLAMP(w, 0, 1) * 255;
+	inst->mapRed[i] = (uint32_t)(CLAMP(w, 0, 1) * 255);
 	w = parabola(i / 255., greenCoeffs);
-	mapGreen[i] = CLAMP(w, 0, 1) * 255;
+	inst->mapGreen[i] = (uint32_t)(CLAMP(w, 0, 1) * 255) << 8;
 	w = parabola(i / 255., blueCoeffs);
-	mapBlue[i] = CLAMP(w, 0, 1) * 255;
+	inst->mapBlue[i] = (uint32_t)(CLAMP(w, 0, 1) * 255) << 16;
   }
   free(redCoeffs);
   free(greenCoeffs);
   free(blueCoeffs);
+}
 
-  for(int j = 0; j < inst->width; j++) {
-	int copyPixel = inst->splitPreview && ((inst->srcPosition && j < inst->width / 2) || (!inst->srcPosition && j >= inst->width / 2));
-	for(int i = 0; i < inst->height; i++) {
-	  int offset = (i * inst->width + j) * 4;
-	  if (copyPixel) {
-		dst[offset] = src[offset];
-		offset++;
-		dst[offset] = src[offset];
-		offset++;
-		dst[offset] = src[offset];
-		offset++;
-	  } else {
-		dst[offset] = mapRed[src[offset]];
-		offset++;
-		dst[offset] = mapGreen[src[offset]];
-		offset++;
-		dst[offset] = mapBlue[src[offset]];
-		offset++;
-	  }
-	  dst[offset] = src[offset]; // copy alpha
-	  offset++;
-	}
+/* n pixels through the maps, alpha is copied */
+static void map_pixels(const three_point_balance_instance_t* inst,
+                       uint32_t* dst, const uint32_t* src, int n)
+{
+  for(int i = 0; i < n; i++) {
+	uint32_t p = src[i];
+	dst[i] = inst->mapRed[p & 0xff]
+	  | inst->mapGreen[(p >> 8) & 0xff]
+	  | inst->mapBlue[(p >> 16) & 0xff]
+	  | (p & 0xff000000);
   }
-  
 }
 
+void f0r_update(f0r_instance_t instance, double time,
+                const uint32_t* inframe, uint32_t* outframe)
+{
+  assert(instance);
+  three_point_balance_instance_t* inst = (three_point_balance_instance_t*)instance;
+  
+  int half = inst->width / 2;
+  int copyLeft = inst->splitPreview && inst->srcPosition;
+  int copyRight = inst->splitPreview && !inst->srcPosition;
+
+  // row by row, the left and the right half each copied or mapped
+  for(int i = 0; i < inst->height; i++) {
+	const uint32_t* src = inframe + i * inst->width;
+	uint32_t* dst = outframe + i * inst->width;
+
+	if (copyLeft) {
+	  if (dst != src)
+		memcpy(dst, src, half * sizeof(uint32_t));
+	} else
+	  map_pixels(inst, dst, src, half);
+	if (copyRight) {
+	  if (dst != src)
+		memcpy(dst + half, src + half, (inst->width - half) * sizeof(uint32_t));
+	} else
+	  map_pixels(inst, dst + half, src + half, inst->width - half);
+  }
+}
@@ -18,6 +18,7 @@
  *
  */
 #include "frei0r.hpp"
+#include "frei0r_lut.h"
 
 #include <algorithm>
 #include <vector>
@@ -30,10 +31,10 @@
 class threelay0r : public frei0r::filter
 {
 private:
-	static unsigned char grey(unsigned int value) {
-		unsigned char* rgba = reinterpret_cast<unsigned char*>(&value);
-		unsigned char gw= (rgba[0] + rgba[1] + 2*rgba[2])/4;
-		return gw;
+	// (r + g + 2*b) / 4 of n pixels
+	static void grey(unsigned char* gw, const uint32_t* in, unsigned int n) {
+		static const frei0r_luma_t w = { 1, 1, 2, 2, 0 };
+		frei0r_lut_luma(gw, in, n, &w);
 	}
 	
 	struct histogram {
@@ -41,8 +42,9 @@ private:
 			std::fill(hist.begin(),hist.end(),0);
 		}
 		
-		void operator()(uint32_t value)	{
-			++hist[grey(value)];
+		void operator()(const unsigned char* gw, unsigned int n)	{
+			for (unsigned int i = 0; i != n; ++i)
+				++hist[gw[i]];
 		}
 		
 		std::vector<unsigned int> hist;
@@ -55,10 +57,15 @@ public:
 	                    uint32_t* out,
                         const uint32_t* in) {
 		histogram h;
+		unsigned char gw[FREI0R_LUT_CHUNK];
+		unsigned int n;
 		
 		// create histogramm
-		for (const unsigned int* i=in; i != in + (width*height);++i)
-			h(*i);
+		for (unsigned int i = 0; i < size; i += n) {
+			n = std::min(size - i, (unsigned int)FREI0R_LUT_CHUNK);
+			grey(gw, in + i, n);
+			h(gw, n);
+		}
 
 		// calc th
 		int th1 = 1;
@@ -74,18 +81,19 @@ public:
 		}
 		
 		// create the 3 level image
-		uint32_t* outpixel= out;
-		const uint32_t* pixel=in;
-		while(pixel != in+size) // size = defined in frei0r.hpp
-		{
-			if ( grey(*pixel) < th1 )
-				*outpixel=0xFF000000;
-			else if ( grey(*pixel) < th2)
-				*outpixel=0xFF808080;
+		uint32_t palette[256];
+		for (int i = 0; i < 256; i++) {
+			if ( i < th1 )
+				palette[i]=0xFF000000;
+			else if ( i < th2)
+				palette[i]=0xFF808080;
 			else
-				*outpixel=0xFFFFFFFF;
-			++outpixel;
-			++pixel;
+				palette[i]=0xFFFFFFFF;
+		}
+		for (unsigned int i = 0; i < size; i += n) { // size = defined in frei0r.hpp
+			n = std::min(size - i, (unsigned int)FREI0R_LUT_CHUNK);
+			grey(gw, in + i, n);
+			frei0r_lut_palette(palette, out + i, gw, in + i, n);
 		}
 	}
 };
@@ -94,5 +102,5 @@ public:
 frei0r::construct<threelay0r> plugin("threelay0r",
 									"dynamic 3 level thresholding",
 									"Hedde Bosman",
-									0,2);
+									0,2,F0R_COLOR_MODEL_BGRA8888,F0R_CAP_INPLACE);
 
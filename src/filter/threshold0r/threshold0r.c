@@ -22,6 +22,8 @@
 #include <assert.h>
 
 #include "frei0r.h"
+#include "frei0r_planar.h"
+#include "frei0r_lut.h"
 
 typedef struct threshold0r_instance
 {
@@ -71,6 +73,13 @@ void f0r_get_plugin_info(f0r_plugin_info_t* threshold0r_info)
   threshold0r_info->explanation = "Thresholds a source image";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE
+    | F0R_CAP_PLANAR | F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -132,22 +141,49 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  threshold0r_instance_t* inst = (threshold0r_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  frei0r_lut_rgb(inst->lut, outframe + inst->width * row_begin,
+                 inframe + inst->width * row_begin,
+                 inst->width * (row_end - row_begin));
+  return 1;
+}
+
 void f0r_update(f0r_instance_t instance, double time,
                 const uint32_t* inframe, uint32_t* outframe)
 {
   assert(instance);
   threshold0r_instance_t* inst = (threshold0r_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
+}
+
+/* YUV frames are thresholded on luma, to black and white */
+int f0r_update_planar(f0r_instance_t instance, double time,
+                      const f0r_planar_frame_t* inframe,
+                      const f0r_planar_frame_t* outframe)
+{
+  assert(instance);
+  threshold0r_instance_t* inst = (threshold0r_instance_t*)instance;
+  unsigned int y;
 
-  unsigned char* lut = inst->lut;
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  while (len--)
+  if (!frei0r_planar_check(inframe, outframe))
+    return 0;
+  for (y = 0; y < inst->height; ++y)
   {
-    *dst++ = lut[*src++];
-    *dst++ = lut[*src++];
-    *dst++ = lut[*src++];
-    *dst++ = *src++; // copy alpha
+    const unsigned char* src = inframe->planes[0] + (size_t)y * inframe->strides[0];
+    unsigned char* dst = outframe->planes[0] + (size_t)y * outframe->strides[0];
+    frei0r_lut_bytes(inst->lut, dst, src, inst->width);
   }
+  frei0r_planar_gray(outframe, inst->width, inst->height);
+  return 1;
 }
-
@@ -18,6 +18,7 @@
  */
 
 #include "frei0r.hpp"
+#include <algorithm>
 #include <iostream>
 
 //#define DEBUG
@@ -64,6 +65,8 @@ public:
 
         x0 = width-2*W;
         y0 = height-H;
+
+        on_params_changed();
     }
 
     ~Timeout()
@@ -71,47 +74,81 @@ public:
         // Delete member variables if necessary.
     }
 
-    virtual void update(double time,
-	                    uint32_t* out,
-                        const uint32_t* in)
+    // The colour and its weight only change with the parameters.
+    virtual void on_params_changed()
     {
-        std::copy(in, in + width*height, out);
-
-
         ABGR col;
         col.r = 255*m_color.r;
         col.g = 255*m_color.g;
         col.b = 255*m_color.b;
         col.a = 255;
 
-        float yt = y0 - (1-m_time)*H;
-        ABGR *outAsABGR = (ABGR*) out;
-
-#ifdef DEBUG
-#define printcol(x) std::cout << #x ": [ " << (int) x.r << " | " << (int) x.g << " | " << (int) x.b << " ]" << std::endl;
-
-        std::cout << "r = " << m_color.r << ", g = " << m_color.g << std::endl;
-        ABGR blended = col.blend(outAsABGR[0], .5);
-        printcol(col);
-        printcol(outAsABGR[0]);
-        printcol(blended);
-#undef printcol
-#endif
+        m_opacity = 1-m_transparency;
+        m_rest = 1-m_opacity;
+        m_col[0] = m_opacity*col.r;
+        m_col[1] = m_opacity*col.g;
+        m_col[2] = m_opacity*col.b;
+    }
 
+    // Only the indicator changes, the rest of the frame is the input.
+    virtual void update(double time,
+	                    uint32_t* out,
+                        const uint32_t* in)
+    {
+        f0r_rect_t r;
+
+        (void)time; // unused
+        if (out != in)
+            std::copy(in, in + width*height, out);
+        if (indicator(r))
+            for (int y = r.y; y < r.y+r.height; y++)
+                blend(out + width*y + r.x, r.width);
+    }
 
-        for (int y = y0; y > int(yt); y--) {
+    virtual bool region(f0r_rect_t& rect)
+    {
+        if (!indicator(rect))
+            rect.x = rect.y = rect.width = rect.height = 0;
+        return true;
+    }
 
-            float factor = 1-m_transparency;
-            if (y == int(yt)) {
-                factor *= 1 - (yt-int(yt));
-            }
+    virtual bool identity()
+    {
+        f0r_rect_t r;
+        return !indicator(r);
+    }
 
-            for (int x = x0; x < x0+W; x++) {
+    virtual int footprint()
+    {
+        return 0;
+    }
 
-                outAsABGR[width*y + x] = col.blend(outAsABGR[width*y + x], factor);
-            }
+    // The tile is the input with the part of the indicator in it blended.
+    virtual bool update_tile(double time,
+                             uint32_t* out, int out_stride,
+                             const f0r_rect_t& outrect,
+                             const uint32_t* in, int in_stride,
+                             const f0r_rect_t& inrect)
+    {
+        f0r_rect_t r = { 0, 0, 0, 0 };
+        const bool draw = indicator(r);
+        const int x1 = std::max(r.x, outrect.x);
+        const int x2 = std::min(r.x+r.width, outrect.x+outrect.width);
+
+        (void)time; // unused
+        for (int y = 0; y < outrect.height; y++)
+        {
+            const int fy = outrect.y + y;
+            const uint32_t* src = frei0r::frame_row(in, in_stride, fy - inrect.y)
+                + (outrect.x - inrect.x);
+            uint32_t* dst = frei0r::frame_row(out, out_stride, y);
+
+            if (dst != src)
+                std::copy(src, src + outrect.width, dst);
+            if (draw && fy >= r.y && fy < r.y+r.height && x1 < x2)
+                blend(dst + (x1 - outrect.x), x2 - x1);
         }
-
+        return true;
     }
 
 private:
@@ -123,6 +160,38 @@ private:
     unsigned int x0, y0;
     unsigned int W , H ;
 
+    // the colour times its opacity, and the weight of the input
+    float m_col[3];
+    float m_opacity, m_rest;
+
+    // The rows from y0 up to the time, W pixels from x0; false if there
+    // is nothing to draw.
+    bool indicator(f0r_rect_t& r)
+    {
+        const float yt = y0 - (1-m_time)*H;
+        const int top = std::max(int(yt) + 1, 0);
+
+        if (m_opacity == 0 || W == 0 || top > int(y0))
+            return false;
+        r.x = x0;
+        r.y = top;
+        r.width = W;
+        r.height = y0 + 1 - top;
+        return true;
+    }
+
+    // ABGR::blend of the colour over n pixels
+    void blend(uint32_t* px, int n)
+    {
+        ABGR* p = (ABGR*) px;
+
+        for (int x = 0; x < n; x++) {
+            p[x].r = m_col[0] + m_rest*p[x].r;
+            p[x].g = m_col[1] + m_rest*p[x].g;
+            p[x].b = m_col[2] + m_rest*p[x].b;
+        }
+    }
+
 };
 
 
@@ -131,4 +200,5 @@ frei0r::construct<Timeout> plugin("Timeout indicator",
                 "Timeout indicators e.g. for slides.",
                 "Simon A. Eugster",
                 0,2,
-                F0R_COLOR_MODEL_RGBA8888);
+                F0R_COLOR_MODEL_RGBA8888,
+                F0R_CAP_TILE);
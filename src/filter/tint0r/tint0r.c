@@ -19,9 +19,11 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_grade.h"
 
 typedef struct tint0r_instance
 {
@@ -30,8 +32,15 @@ typedef struct tint0r_instance
   f0r_param_color_t blackColor;
   f0r_param_color_t whiteColor;
   double amount; /* the amount value [0, 1] */
+  frei0r_colormatrix_t cm;
 } tint0r_instance_t;
 
+static void update_matrix(tint0r_instance_t *inst)
+{
+  frei0r_grade_tint(&inst->cm, &inst->blackColor, &inst->whiteColor,
+                    inst->amount);
+}
+
 int f0r_init()
 {
   return 1;
@@ -48,11 +57,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tint0r_instance_t)
   tint0r_instance_t->color_model = F0R_COLOR_MODEL_RGBA8888;
   tint0r_instance_t->frei0r_version = FREI0R_MAJOR_VERSION;
   tint0r_instance_t->major_version = 0; 
-  tint0r_instance_t->minor_version = 1; 
+  tint0r_instance_t->minor_version = 2; 
   tint0r_instance_t->num_params = 3; 
   tint0r_instance_t->explanation = "Tint a source image with specified color";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -86,6 +101,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->blackColor.r = 0.0;
   inst->blackColor.g = 0.0;
   inst->blackColor.b = 0.0;
+  update_matrix(inst);
   return (f0r_instance_t)inst;
 }
 
@@ -115,6 +131,7 @@ void f0r_set_param_value(f0r_instance_t instance,
 	  inst->amount = *((double *)param);
 	  break;
   }
+  update_matrix(inst);
 }
 
 void f0r_get_param_value(f0r_instance_t instance,
@@ -137,9 +154,29 @@ void f0r_get_param_value(f0r_instance_t instance,
   }
 }
 
-unsigned char map_color(double amount, double comp_amount, float color, float luma, float minColor, float maxColor) {
-  double val = (comp_amount * color) + amount * (luma * (maxColor - minColor) + minColor);
-  return (unsigned char)(255*CLAMP(val, 0, 1));
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  tint0r_instance_t* inst = (tint0r_instance_t*)instance;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  unsigned int len = inst->width * (row_end - row_begin);
+  inframe += inst->width * row_begin;
+  outframe += inst->width * row_begin;
+
+  if (inst->amount == 0.0)
+  {
+    if (outframe != inframe)
+      memcpy(outframe, inframe, len * sizeof(uint32_t));
+    return 1;
+  }
+  frei0r_colormatrix_apply(&inst->cm, outframe, inframe, len);
+  return 1;
 }
 
 void f0r_update(f0r_instance_t instance, double time,
@@ -147,28 +184,12 @@ void f0r_update(f0r_instance_t instance, double time,
 {
   assert(instance);
   tint0r_instance_t* inst = (tint0r_instance_t*)instance;
-  unsigned int len = inst->width * inst->height;
-  double amount = inst->amount;
-  double comp_amount = 1.0 - inst->amount;
-  
-  unsigned char* dst = (unsigned char*)outframe;
-  const unsigned char* src = (unsigned char*)inframe;
-  float b, g, r;
-  float luma;
-
-  while (len--)
-  {
-	r = *src++ / 255.;
-	g = *src++ / 255.;
-	b = *src++ / 255.;
-	
-	luma = (b * .114 + g * .587 + r * .299);
-	
-	*dst++ = map_color(amount, comp_amount, r, luma, inst->blackColor.r, inst->whiteColor.r);
-	*dst++ = map_color(amount, comp_amount, g, luma, inst->blackColor.g, inst->whiteColor.g);
-	*dst++ = map_color(amount, comp_amount, b, luma, inst->blackColor.b, inst->whiteColor.b);
-
-	*dst++ = *src++;  // copy alpha
-  }
+  f0r_update_slice(instance, time, inframe, 0, 0, outframe,
+                   0, inst->height, 0);
 }
 
+int f0r_is_identity(f0r_instance_t instance)
+{
+  assert(instance);
+  return ((tint0r_instance_t*)instance)->amount == 0.0;
+}
@@ -1,5 +1,6 @@
 #include "frei0r.h"
 #include "frei0r_math.h"
+#include "frei0r_simd.h"
 #include <stdlib.h>
 #include <assert.h>
 
@@ -8,6 +9,7 @@ typedef struct transparency_instance
   unsigned int width;
   unsigned int height;
   double transparency;
+  uint32_t* row; /* a row of pixels of the alpha, for the alpha kernel */
 } transparency_instance_t;
 
 int f0r_init()
@@ -31,6 +33,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* transparencyInfo)
   transparencyInfo->explanation = "Tunes the alpha channel.";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_RB_SYMMETRIC;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
 	switch(param_index)
@@ -48,11 +56,14 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   transparency_instance_t* inst = (transparency_instance_t*)calloc(1, sizeof(*inst));
   inst->width = width; inst->height = height;
   inst->transparency = 0.0;
+  inst->row = (uint32_t*)malloc(width * sizeof(uint32_t));
   return (f0r_instance_t)inst;
 }
 
 void f0r_destruct(f0r_instance_t instance)
 {
+  transparency_instance_t* inst = (transparency_instance_t*)instance;
+  free(inst->row);
   free(instance);
 }
 
@@ -101,14 +112,10 @@ void f0r_update(f0r_instance_t instance, double time,
   
   uint32_t* dst = outframe;
   const uint32_t* src = inframe;
-  uint8_t alpha  = (uint8_t)( inst->transparency * 255 );
-  for(y=h;y>0;--y)
-      for(x=w;x>0;--x,++src,++dst)
-	{
-	  uint8_t tmpalpha;
-	  uint8_t* tmpc = (uint8_t*)src;
-	  tmpalpha = MIN(alpha, tmpc[3]);
-	  *dst = (tmpalpha << 24) | (tmpc[2] << 16) | (tmpc[1] << 8) | tmpc[0];
-	}
+  uint32_t alpha  = (uint8_t)( inst->transparency * 255 );
+  for(x=0;x<w;++x)
+    inst->row[x] = alpha << 24;
+  for(y=h;y>0;--y,src+=w,dst+=w)
+    frei0r_simd_alpha_min(dst, src, inst->row, w);
 }
 
@@ -1,4 +1,5 @@
 #include "frei0r.hpp"
+#include "frei0r_lut.h"
 
 #include <algorithm>
 #include <vector>
@@ -9,11 +10,11 @@
 
 class twolay0r : public frei0r::filter
 {
-  static unsigned char grey(unsigned int value)
+  // (r + g + 2*b) / 4 of n pixels
+  static void grey(unsigned char* gw, const uint32_t* in, unsigned int n)
   {
-    unsigned char* rgba = reinterpret_cast<unsigned char*>(&value);
-    unsigned char gw= (rgba[0] + rgba[1] + 2*rgba[2])/4;
-    return gw;
+    static const frei0r_luma_t w = { 1, 1, 2, 2, 0 };
+    frei0r_lut_luma(gw, in, n, &w);
   }
   
   struct histogram
@@ -24,9 +25,10 @@ class twolay0r : public frei0r::filter
       std::fill(hist.begin(),hist.end(),0);
     }
     
-    void operator()(uint32_t value)
+    void operator()(const unsigned char* gw, unsigned int n)
     {
-      ++hist[grey(value)];
+      for (unsigned int i=0; i!=n; ++i)
+        ++hist[gw[i]];
     }
     
     std::vector<unsigned int> hist;
@@ -42,10 +44,16 @@ public:
                       const uint32_t* in)
   {
     histogram h;
+    unsigned char gw[FREI0R_LUT_CHUNK];
+    unsigned int n;
     
     // create histogramm
-    for (const unsigned int* i=in; i != in + (width*height);++i)
-      h(*i);
+    for (unsigned int i=0; i < size; i+=n)
+      {
+	n = std::min(size-i, (unsigned int)FREI0R_LUT_CHUNK);
+	grey(gw, in+i, n);
+	h(gw, n);
+      }
 
     // calc th
     int th=127;
@@ -81,16 +89,14 @@ public:
     
     // create b/w image with the th value
     {
-      uint32_t* outpixel= out;
-      const uint32_t* pixel=in;
-      while(pixel != in+(width*height))
+      uint32_t palette[256];
+      for (int i=0; i!=256; ++i)
+	palette[i] = i<th ? 0xFF000000 : 0xFFFFFFFF;
+      for (unsigned int i=0; i < size; i+=n)
 	{
-	  if ( grey(*pixel)<th )
-	    *outpixel=0xFF000000;
-	  else
-	    *outpixel=0xFFFFFFFF;
-	  ++outpixel;
-	  ++pixel;
+	  n = std::min(size-i, (unsigned int)FREI0R_LUT_CHUNK);
+	  grey(gw, in+i, n);
+	  frei0r_lut_palette(palette, out+i, gw, in+i, n);
 	}
     }  
   }
@@ -100,5 +106,5 @@ public:
 frei0r::construct<twolay0r> plugin("Twolay0r",
 				  "dynamic thresholding",
 				  "Martin Bayer",
-				  0,2);
+				  0,2,F0R_COLOR_MODEL_BGRA8888,F0R_CAP_INPLACE);
 
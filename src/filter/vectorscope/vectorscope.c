@@ -27,8 +27,13 @@
 
 #include <gavl/gavl.h>
 
+#include "frei0r_scope.h"
+#include "frei0r_thread.h"
 #include "vectorscope_image.h"
 
+/* the graticule, decoded while there are instances */
+static frei0r_rle_shared_t background = { &vectorscope_image };
+
 #define OFFSET_R        0
 #define OFFSET_G        8
 #define OFFSET_B        16
@@ -43,26 +48,54 @@
 #define M_PI            3.14159265358979323846
 #endif
 
-typedef struct {
-	double Y, Cb, Cr;
-} YCbCr_t;
-
-typedef struct {
-	double red, green, blue;
-} rgb_t;
-
 typedef struct vectorscope_instance {
 	int w, h;
 	unsigned char* scala;
-	gavl_video_scaler_t* scope_scaler;
-	gavl_video_frame_t* scope_frame_src;
-	gavl_video_frame_t* scope_frame_dst;
+	frei0r_scope_mask_t mask;         /* where scala isn't transparent */
+	int scope_x, scope_y, scope_size; /* the square the scope is drawn in */
+	frei0r_scope_tap_t* taps;         /* of its rows and columns */
+	int threads;
+	uint8_t* bins;                    /* a scope grid per thread */
+	uint16_t* cols;                   /* the grid resampled to the square's width */
+	uint8_t* rows;                    /* a row of the square per thread */
 	double mix;
 	double overlay_sides;
 } vectorscope_instance_t;
 
+typedef struct vectorscope_job {
+	vectorscope_instance_t* inst;
+	const uint32_t* src;
+	uint32_t* dst;
+	uint8_t* bins;
+	uint8_t* row;
+	int j0, j1;                       /* rows of the grid */
+	int y0, y1;                       /* rows of the frame */
+} vectorscope_job_t;
+
+/* The terms of Cb and Cr, 128 + (float)(r * kr + g * kg + b * kb), of
+ * each channel value. Adding them up in the order of the formula gives
+ * the same values as computing it. */
+static double terms[3][256][2];
+
+/* The terms of Cb and 255 - Cr in 16.16 fixed point. Their sums are
+ * within 3 / 65536 of the exact values, so they give the same integer
+ * parts unless they are that close to an integer. */
+static int32_t fixed[2][3][256];
+
 int f0r_init()
 {
+	static const double k[3][2] = {
+		{ -0.16874, 0.5 }, { -0.33126, -0.41869 }, { 0.5, -0.08131 }
+	};
+	int c, i;
+	for (c = 0; c < 3; c++) {
+		for (i = 0; i < 256; i++) {
+			terms[c][i][0] = k[c][0] * (float)i;
+			terms[c][i][1] = k[c][1] * (float)i;
+			fixed[0][c][i] = (int32_t)floor(((c == 0 ? 128 : 0) + k[c][0] * i) * 65536 + 0.5);
+			fixed[1][c][i] = (int32_t)floor(((c == 0 ? 127 : 0) - k[c][1] * i) * 65536 + 0.5);
+		}
+	}
 	return 1;
 }
 void f0r_deinit()
@@ -76,7 +109,7 @@ void f0r_get_plugin_info( f0r_plugin_info_t* info )
 	info->color_model = F0R_COLOR_MODEL_RGBA8888;
 	info->frei0r_version = FREI0R_MAJOR_VERSION;
 	info->major_version = 0; 
-	info->minor_version = 2; 
+	info->minor_version = 3; 
 	info->num_params =  2; 
 	info->explanation = "Displays the vectorscope of the video-data";
 }
@@ -107,6 +140,11 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 		free(inst);
 		return NULL;
 	}
+	const uint8_t* image = frei0r_rle_acquire( &background );
+	if ( !image ) {
+		free(inst);
+		return NULL;
+	}
 	
 	inst->mix = 0.0;
 	inst->overlay_sides = 1.0;
@@ -176,7 +214,7 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	gavl_video_options_set_rectangles( options, &src_rect, &dst_rect );
 	gavl_video_scaler_init( video_scaler, &format_src, &format_dst );
 	
-	frame_src->planes[0] = (uint8_t *)vectorscope_image.pixel_data;
+	frame_src->planes[0] = (uint8_t *)image;
 	frame_dst->planes[0] = (uint8_t *)inst->scala;
 	
 	/* Pad the source image to make the stride a multiple of 16. */
@@ -195,43 +233,23 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 	gavl_video_frame_destroy( frame_dst );
 	gavl_video_frame_destroy( padded );
 	
-	inst->scope_scaler = gavl_video_scaler_create();
-	inst->scope_frame_src = gavl_video_frame_create(0);
-	inst->scope_frame_dst = gavl_video_frame_create(0);
-	inst->scope_frame_src->strides[0] = SCOPE_WIDTH * 4;
-	inst->scope_frame_dst->strides[0] = width * 4;
-	options = gavl_video_scaler_get_options( inst->scope_scaler );
-	
-	format_src.frame_width  = SCOPE_WIDTH;
-	format_src.frame_height = SCOPE_HEIGHT;
-	format_src.image_width  = SCOPE_WIDTH;
-	format_src.image_height = SCOPE_HEIGHT;
-	format_src.pixel_width = 1;
-	format_src.pixel_height = 1;
-	format_src.pixelformat = GAVL_RGBA_32;
-	format_dst.frame_width  = width;
-	format_dst.frame_height = height;
-	format_dst.image_width  = width;
-	format_dst.image_height = height;
-	format_dst.pixel_width = 1;
-	format_dst.pixel_height = 1;
-	format_dst.pixelformat = GAVL_RGBA_32;
-	
-	gavl_rectangle_f_set_all( &src_rect, &format_src );
 	if (width > height) {
-		dst_rect.x = (width-height)/2;
-		dst_rect.y = 0;
-		dst_rect.w = height;
-		dst_rect.h = height;	
+		inst->scope_x = (width-height)/2;
+		inst->scope_y = 0;
+		inst->scope_size = height;
 	}
 	else {
-		dst_rect.x = 0;
-		dst_rect.y = (height-width)/2;
-		dst_rect.w = width;
-		dst_rect.h = width;
+		inst->scope_x = 0;
+		inst->scope_y = (height-width)/2;
+		inst->scope_size = width;
 	}
-	gavl_video_options_set_rectangles( options, &src_rect, &dst_rect );
-	gavl_video_scaler_init( inst->scope_scaler, &format_src, &format_dst );
+	inst->taps = (frei0r_scope_tap_t*)malloc( inst->scope_size * sizeof(frei0r_scope_tap_t) );
+	frei0r_scope_taps( inst->taps, inst->scope_size, SCOPE_WIDTH );
+	frei0r_scope_mask_init( &inst->mask, inst->scala, width, height );
+	inst->threads = frei0r_thread_count( width * height );
+	inst->bins = (uint8_t*)malloc( inst->threads * SCOPE_WIDTH * SCOPE_HEIGHT );
+	inst->cols = (uint16_t*)malloc( SCOPE_HEIGHT * inst->scope_size * sizeof(uint16_t) );
+	inst->rows = (uint8_t*)malloc( inst->threads * inst->scope_size );
 	
 	return (f0r_instance_t)inst;
 }
@@ -239,16 +257,13 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 void f0r_destruct(f0r_instance_t instance)
 {
 	vectorscope_instance_t* inst = (vectorscope_instance_t*)instance;
-	if ( inst->w == 0 || inst->h == 0 ) {
-		free(instance);
-		return;
-	}
+	frei0r_rle_release( &background );
 	free(inst->scala);
-	gavl_video_scaler_destroy( inst->scope_scaler );
-	gavl_video_frame_null( inst->scope_frame_src );
-	gavl_video_frame_destroy( inst->scope_frame_src );
-	gavl_video_frame_null( inst->scope_frame_dst );
-	gavl_video_frame_destroy( inst->scope_frame_dst );
+	frei0r_scope_mask_free(&inst->mask);
+	free(inst->taps);
+	free(inst->bins);
+	free(inst->cols);
+	free(inst->rows);
 	free(instance);
 }
 
@@ -284,111 +299,131 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 	}
 }
 
-/* RGB to YCbCr range 0-255 */
-YCbCr_t rgb_to_YCbCr(rgb_t rgb)
+/* Counts the pixels of the rows of a job at their Cb, 255 - Cr, up to 255. */
+static void* accumulate(void* arg)
 {
-	YCbCr_t dest;
-	dest.Y = (float)((0.299 * (float)rgb.red + 0.587 * (float)rgb.green + 0.114 * (float)rgb.blue));
-	dest.Cb = 128 + (float)((-0.16874 * (float)rgb.red - 0.33126 * (float)rgb.green + 0.5 * (float)rgb.blue));
-	dest.Cr = 128 + (float)((0.5 * (float)rgb.red - 0.41869 * (float)rgb.green - 0.08131 * (float)rgb.blue));
-	return dest;
+	vectorscope_job_t* job = (vectorscope_job_t*)arg;
+	const uint32_t* src = job->src + (long)job->y0 * job->inst->w;
+	const uint32_t* src_end = job->src + (long)job->y1 * job->inst->w;
+	uint8_t* bins = job->bins;
+	unsigned int r, g, b;
+	int32_t cb, cr;
+	int x, y;
+	
+	memset(bins, 0, SCOPE_WIDTH * SCOPE_HEIGHT);
+	for ( ; src < src_end; src++ ) {
+		r = ((*src) & 0x000000FF) >> OFFSET_R;
+		g = ((*src) & 0x0000FF00) >> OFFSET_G;
+		b = ((*src) & 0x00FF0000) >> OFFSET_B;
+		cb = fixed[0][0][r] + fixed[0][1][g] + fixed[0][2][b];
+		cr = fixed[1][0][r] + fixed[1][1][g] + fixed[1][2][b];
+		if ( ((cb + 8) & 0xFFFF) >= 16 && ((cr + 8) & 0xFFFF) >= 16 && cr >= 8 ) {
+			x = cb >> 16;
+			y = cr >> 16;
+		} else {
+			x = (double)(128 + (float)(terms[0][r][0] + terms[1][g][0] + terms[2][b][0]));
+			y = 255 - (double)(128 + (float)(terms[0][r][1] + terms[1][g][1] + terms[2][b][1]));
+		}
+		if ( x >= 0 && x < SCOPE_WIDTH && y >= 0 && y < SCOPE_HEIGHT )
+			bins[x+SCOPE_WIDTH*y] += bins[x+SCOPE_WIDTH*y] < 255;
+	}
+	return 0;
 }
 
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+/* Adds the grids of the other threads to the first one, up to 255. */
+static void merge(uint8_t* bins, int threads)
 {
-	assert(instance);
-	vectorscope_instance_t* inst = (vectorscope_instance_t*)instance;
-	
+	int t, i;
+	for (t = 1; t < threads; t++) {
+		const uint8_t* other = bins + t * SCOPE_WIDTH * SCOPE_HEIGHT;
+		for (i = 0; i < SCOPE_WIDTH * SCOPE_HEIGHT; i++) {
+			int v = bins[i] + other[i];
+			bins[i] = v < 255 ? v : 255;
+		}
+	}
+}
+
+/* Resamples the rows of the grid of a job to the width of the square. */
+static void* columns(void* arg)
+{
+	vectorscope_job_t* job = (vectorscope_job_t*)arg;
+	vectorscope_instance_t* inst = job->inst;
+	frei0r_scope_columns( inst->cols, job->bins, SCOPE_WIDTH, job->j0, job->j1,
+	                      inst->taps, inst->scope_size );
+	return 0;
+}
+
+/* Draws the sides, the scope and the graticule into the rows of a job. */
+static void* render(void* arg)
+{
+	vectorscope_job_t* job = (vectorscope_job_t*)arg;
+	vectorscope_instance_t* inst = job->inst;
 	int width = inst->w;
-	int height = inst->h;
+	int x0 = inst->scope_x, x1 = inst->scope_x + inst->scope_size;
+	int y0 = inst->scope_y, y1 = inst->scope_y + inst->scope_size;
 	double mix = inst->mix;
-	int len = inst->w * inst->h;
-	int scope_len = SCOPE_WIDTH * SCOPE_HEIGHT;
-	
-	uint32_t* dst = outframe;
-	uint32_t* dst_end;
-	const uint32_t* src = inframe;
-	const uint32_t* src_end;
-	uint32_t* scope = (uint32_t*)malloc( scope_len * 4 );
-	uint32_t* scope_end;
-	
-	YCbCr_t YCbCr;
-	rgb_t rgb;
-	uint8_t* pixel;
 	int x, y;
-	dst_end = dst + len;
-	src_end = src + len;
-	scope_end = scope + scope_len;
 	
-	if ( inst->overlay_sides > 0.5) {
-		while ( dst < dst_end ) {
-			*(dst++) = 0xFF000000;
-		}
-	} else {
-		while ( dst < dst_end ) {
-			*(dst++) = *(src++);
+	for ( y = job->y0; y < job->y1; y++ ) {
+		const uint32_t* src = job->src + (long)y * width;
+		uint32_t* dst = job->dst + (long)y * width;
+		
+		if ( inst->overlay_sides > 0.5) {
+			for ( x = 0; x < width; x++ )
+				dst[x] = 0xFF000000;
+		} else if ( dst != src ) {
+			memcpy( dst, src, width * sizeof(uint32_t) );
 		}
-		src -= len;
-	}
-	
-	dst = outframe;
-	while ( scope < scope_end ) {
-		*(scope++) = 0xFF000000;
-	}
-	scope -= scope_len;
-	
-	while ( src < src_end ) {
-		rgb.red = (((*src) & 0x000000FF) >> OFFSET_R);
-		rgb.green = (((*src) & 0x0000FF00) >> OFFSET_G);
-		rgb.blue = (((*src) & 0x00FF0000) >> OFFSET_B);
-		src++;
-		YCbCr = rgb_to_YCbCr(rgb);
-		x = YCbCr.Cb;
-		y = 255-YCbCr.Cr;
-		if ( x >= 0 && x < SCOPE_WIDTH && y >= 0 && y < SCOPE_HEIGHT ) {
-			pixel = (uint8_t*)&scope[x+SCOPE_WIDTH*y];
-			if ( pixel[0] < 255 ) {
-				pixel[0]++;
-				pixel[1]++;
-				pixel[2]++;
-			}
+		if ( y >= y0 && y < y1 ) {
+			frei0r_scope_sample( job->row, inst->cols, inst->scope_size,
+			                     inst->taps[y - y0] );
+			for ( x = x0; x < x1; x++ )
+				dst[x] = 0xFF000000 | job->row[x - x0] * 0x010101;
 		}
-	}
-	
-	inst->scope_frame_src->planes[0] = (uint8_t *)scope;
-	inst->scope_frame_dst->planes[0] = (uint8_t *)dst;
-	
-	gavl_video_scaler_scale( inst->scope_scaler, inst->scope_frame_src, inst->scope_frame_dst );
-	
-	unsigned char *scala8, *dst8, *dst8_end, *src8;
-	
-	scala8 = inst->scala;
-	src8 = (unsigned char*)inframe;
-	dst8 = (unsigned char*)outframe;
-	dst8_end = dst8 + ( len * 4 );
-	if (mix > 0.001 ) { // to not lose performance for non-mixing users
-		while ( dst8 < dst8_end ) {
-			dst8[0] = ( ( ( scala8[0] - dst8[0] ) * 255 * scala8[3] ) >> 16 ) + dst8[0];
-			dst8[1] = ( ( ( scala8[1] - dst8[1] ) * 255 * scala8[3] ) >> 16 ) + dst8[1];
-			dst8[2] = ( ( ( scala8[2] - dst8[2] ) * 255 * scala8[3] ) >> 16 ) + dst8[2];
-			if (dst8[0] == 0) {
-				dst8[0] = src8[0] * mix;
-				dst8[1] = src8[1] * mix;
-				dst8[2] = src8[2] * mix;
+		frei0r_scope_over( dst, inst->scala, &inst->mask, y, width );
+		
+		if (mix > 0.001 ) { // to not lose performance for non-mixing users
+			const unsigned char* src8 = (const unsigned char*)src;
+			unsigned char* dst8 = (unsigned char*)dst;
+			for ( x = 0; x < width; x++, src8 += 4, dst8 += 4 ) {
+				if (dst8[0] == 0) {
+					dst8[0] = src8[0] * mix;
+					dst8[1] = src8[1] * mix;
+					dst8[2] = src8[2] * mix;
+				}
 			}
-			scala8 += 4;
-			dst8 += 4;
-			src8 += 4;
-		}
-	} else {
-		while ( dst8 < dst8_end ) {
-			dst8[0] = ( ( ( scala8[0] - dst8[0] ) * 255 * scala8[3] ) >> 16 ) + dst8[0];
-			dst8[1] = ( ( ( scala8[1] - dst8[1] ) * 255 * scala8[3] ) >> 16 ) + dst8[1];
-			dst8[2] = ( ( ( scala8[2] - dst8[2] ) * 255 * scala8[3] ) >> 16 ) + dst8[2];
-			scala8 += 4;
-			dst8 += 4;
 		}
 	}
-	free(scope);
+	return 0;
 }
 
+/* The scope is accumulated into a grid of SCOPE_WIDTH x SCOPE_HEIGHT per
+ * thread, the grids are added up, resampled to the width of the square and
+ * drawn straight into the output together with the background, in one pass
+ * over the output rows. */
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+	assert(instance);
+	vectorscope_instance_t* inst = (vectorscope_instance_t*)instance;
+	vectorscope_job_t jobs[FREI0R_MAX_THREADS];
+	int i, n = inst->threads;
+	
+	for ( i = 0; i < n; i++ ) {
+		jobs[i].inst = inst;
+		jobs[i].src = inframe;
+		jobs[i].dst = outframe;
+		jobs[i].bins = inst->bins + i * SCOPE_WIDTH * SCOPE_HEIGHT;
+		jobs[i].row = inst->rows + i * inst->scope_size;
+		jobs[i].j0 = SCOPE_HEIGHT * i / n;
+		jobs[i].j1 = SCOPE_HEIGHT * (i + 1) / n;
+		jobs[i].y0 = inst->h * i / n;
+		jobs[i].y1 = inst->h * (i + 1) / n;
+	}
+	frei0r_thread_run( accumulate, jobs, sizeof(vectorscope_job_t), n );
+	merge( inst->bins, n );
+	
+	for ( i = 0; i < n; i++ )
+		jobs[i].bins = inst->bins;
+	frei0r_thread_run( columns, jobs, sizeof(vectorscope_job_t), n );
+	frei0r_thread_run( render, jobs, sizeof(vectorscope_job_t), n );
+}
@@ -22,11 +22,16 @@
 
 
 #include "frei0r.h"
+#include "frei0r_thread.h"
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 typedef struct vertigo_instance
 {
@@ -44,8 +49,19 @@ typedef struct vertigo_instance
   
   int pixels;
   double phase;
+  int bilinear;
 } vertigo_instance_t;
 
+/* A band of rows; row y starts at sx - y*dy, sy + y*dx. */
+typedef struct vertigo_job
+{
+  const vertigo_instance_t* inst;
+  const uint32_t* src;
+  uint32_t* dst;
+  uint32_t* alt;
+  unsigned int y0, y1;
+} vertigo_job_t;
+
 
 
 int f0r_init()
@@ -66,11 +82,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* vertigoInfo)
   vertigoInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
   vertigoInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   vertigoInfo->major_version = 1;
-  vertigoInfo->minor_version = 2;
-  vertigoInfo->num_params =  2;
+  vertigoInfo->minor_version = 3;
+  vertigoInfo->num_params =  3;
   vertigoInfo->explanation = "alpha blending with zoomed and rotated images";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_TEMPORAL;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch(param_index)
@@ -85,6 +107,11 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
     info->type = F0R_PARAM_DOUBLE;
     info->explanation = "Zoomrate";
     break;
+  case 2:
+    info->name = "Bilinear";
+    info->type = F0R_PARAM_BOOL;
+    info->explanation = "Sample the previous frame bilinearly instead of the nearest pixel";
+    break;
   }
 }
 
@@ -129,6 +156,19 @@ void f0r_destruct(f0r_instance_t instance)
   free(instance);
 }
 
+/* The phase starts over and the previous frame is black again, as after
+   f0r_construct. */
+int f0r_reset(f0r_instance_t instance)
+{
+  vertigo_instance_t* inst = (vertigo_instance_t*)instance;
+  assert(instance);
+  memset(inst->buffer, 0, inst->pixels*2*sizeof(uint32_t));
+  inst->current_buffer = inst->buffer;
+  inst->alt_buffer = inst->buffer + inst->pixels;
+  inst->phase = 0.0;
+  return 1;
+}
+
 void f0r_set_param_value(f0r_instance_t instance, 
 			 f0r_param_t param, int param_index)
 { 
@@ -146,6 +186,10 @@ void f0r_set_param_value(f0r_instance_t instance,
     inst->zoomrate = *((double*)param) * 5;
     inst->tfactor = (inst->xc+inst->yc) * inst->zoomrate;
     break;
+  case 2:
+    /* bilinear */
+    inst->bilinear = *((double*)param) >= 0.5;
+    break;
   }
 }
 
@@ -165,7 +209,126 @@ void f0r_get_param_value(f0r_instance_t instance,
     /* zoomrate */
     *((double*)param) = (double) (inst->zoomrate) / 5.;
     break;
+  case 2:
+    /* bilinear */
+    *((double*)param) = inst->bilinear ? 1.0 : 0.0;
+    break;
+  }
+}
+
+/* the blend of a feedback pixel with a source pixel, into the feedback */
+static inline uint32_t vertigo_blend(uint32_t v, uint32_t src)
+{
+  return ((v & 0xfcfcff) * 3 + (src & 0xfcfcff)) >> 2;
+}
+
+/* The previous frame at 16.16 fixed point ox, oy, bilinearly filtered.
+   Pixels outside the frame are those of the nearest border pixel. */
+static inline uint32_t vertigo_bilinear(const vertigo_instance_t* inst,
+                                        int ox, int oy)
+{
+  const uint32_t* b = inst->current_buffer;
+  int w = inst->width, h = inst->height;
+  int x0 = ox >> 16, y0 = oy >> 16;
+  int fx = (ox >> 8) & 0xff, fy = (oy >> 8) & 0xff;
+  int x1, y1;
+
+  if(x0 < 0) { x0 = 0; fx = 0; }
+  if(x0 >= w - 1) { x0 = w - 1; fx = 0; }
+  if(y0 < 0) { y0 = 0; fy = 0; }
+  if(y0 >= h - 1) { y0 = h - 1; fy = 0; }
+  x1 = x0 + (fx != 0);
+  y1 = y0 + (fy != 0);
+
+#if defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(
+      _mm_unpacklo_epi32(_mm_cvtsi32_si128(b[y0*w + x0]),
+                         _mm_cvtsi32_si128(b[y0*w + x1])), zero);
+    __m128i bottom = _mm_unpacklo_epi8(
+      _mm_unpacklo_epi32(_mm_cvtsi32_si128(b[y1*w + x0]),
+                         _mm_cvtsi32_si128(b[y1*w + x1])), zero);
+    __m128i v, u;
+
+    /* top + (bottom - top) * fy, then the same across between the pair */
+    v = _mm_add_epi16(_mm_slli_epi16(top, 8),
+                      _mm_mullo_epi16(_mm_sub_epi16(bottom, top),
+                                      _mm_set1_epi16((short)fy)));
+    v = _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(128)), 8);
+    u = _mm_unpackhi_epi64(v, v);
+    v = _mm_add_epi16(_mm_slli_epi16(v, 8),
+                      _mm_mullo_epi16(_mm_sub_epi16(u, v),
+                                      _mm_set1_epi16((short)fx)));
+    v = _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(128)), 8);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(v, zero));
   }
+#else
+  {
+    uint32_t p00 = b[y0*w + x0], p01 = b[y0*w + x1];
+    uint32_t p10 = b[y1*w + x0], p11 = b[y1*w + x1];
+    uint32_t v = 0;
+    int c;
+
+    for(c = 0; c < 32; c += 8)
+    {
+      int t = (((p00 >> c) & 0xff) << 8) + (((p10 >> c) & 0xff) - ((p00 >> c) & 0xff)) * fy;
+      int u = (((p01 >> c) & 0xff) << 8) + (((p11 >> c) & 0xff) - ((p01 >> c) & 0xff)) * fy;
+      t = (t + 128) >> 8;
+      u = (u + 128) >> 8;
+      v |= (uint32_t)((((t << 8) + (u - t) * fx + 128) >> 8) & 0xff) << c;
+    }
+    return v;
+  }
+#endif
+}
+
+static void* vertigo_rows(void* arg)
+{
+  vertigo_job_t* job = (vertigo_job_t*)arg;
+  const vertigo_instance_t* inst = job->inst;
+  const uint32_t* cur = inst->current_buffer;
+  unsigned int w = inst->width;
+  int pixels = inst->pixels;
+  unsigned int x, y;
+
+  for(y = job->y0; y < job->y1; y++)
+  {
+    const uint32_t* src = job->src + (size_t)y*w;
+    uint32_t* dst = job->dst + (size_t)y*w;
+    uint32_t* p = job->alt + (size_t)y*w;
+    /* the same wrap around as adding dx, dy up row by row */
+    int ox = (int)((unsigned int)inst->sx - y*(unsigned int)inst->dy);
+    int oy = (int)((unsigned int)inst->sy + y*(unsigned int)inst->dx);
+
+    x = 0;
+    if(inst->bilinear)
+    {
+      for(; x < w; x++)
+      {
+        uint32_t v = vertigo_blend(vertigo_bilinear(inst, ox, oy), src[x]);
+        dst[x] = v | (src[x] & 0xff000000);
+        p[x] = v;
+        ox += inst->dx;
+        oy += inst->dy;
+      }
+      continue;
+    }
+
+    for(; x < w; x++)
+    {
+      int i = (oy>>16)*(int)w + (ox>>16);
+      uint32_t v;
+      if(i<0) i = 0;
+      if(i>=pixels) i = pixels - 1;
+      v = vertigo_blend(cur[i], src[x]);
+      dst[x] = v | (src[x] & 0xff000000);
+      p[x] = v;
+      ox += inst->dx;
+      oy += inst->dy;
+    }
+  }
+  return 0;
 }
 
 void f0r_update(f0r_instance_t instance, double time,
@@ -180,13 +343,9 @@ void f0r_update(f0r_instance_t instance, double time,
   int yc = inst->yc;
   double tfactor = inst->tfactor;
 
-  uint32_t* dst = outframe;
-  const uint32_t* src = inframe;
   uint32_t *p;
-  uint32_t v;
-  uint32_t alpha;
-  int ox, oy;
-  int i;
+  vertigo_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->pixels);
 
   double vx, vy;
   double dizz;
@@ -229,28 +388,16 @@ void f0r_update(f0r_instance_t instance, double time,
   if(inst->phase > 5700000) inst->phase = 0;
 
 
-  p = inst->alt_buffer;
-
-  for(y=h; y>0; y--) 
+  for(i = 0; i < n; i++)
   {
-    ox = inst->sx;
-    oy = inst->sy;
-    for(x=w; x>0; x--) 
-    {
-      i = (oy>>16)*w + (ox>>16);
-      if(i<0) i = 0;
-      if(i>=inst->pixels) i = inst->pixels;
-      v = inst->current_buffer[i] & 0xfcfcff;
-      alpha = *src & 0xff000000;
-      v = (v * 3) + ((*src++) & 0xfcfcff);
-      *dst++ = (v>>2) | alpha;
-      *p++ = (v>>2);
-      ox += inst->dx;
-      oy += inst->dy;
-    }
-    inst->sx -= inst->dy;
-    inst->sy += inst->dx;
+    jobs[i].inst = inst;
+    jobs[i].src = inframe;
+    jobs[i].dst = outframe;
+    jobs[i].alt = inst->alt_buffer;
+    jobs[i].y0 = h * i / n;
+    jobs[i].y1 = h * (i + 1) / n;
   }
+  frei0r_thread_run(vertigo_rows, jobs, sizeof(vertigo_job_t), n);
 
   p = inst->current_buffer;
   inst->current_buffer = inst->alt_buffer;
@@ -33,6 +33,11 @@
 #include <time.h>
 
 #include <frei0r.hpp>
+#include "frei0r_thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 #define CLIP_EDGES \
@@ -76,6 +81,7 @@ public:
 
   Water(unsigned int width, unsigned int height) {
     physics = 0.0;
+    rain = distort = smooth = surfer = randomize_swirl = false;
     register_param(physics, "physics", "water density: from 1 to 4");
     register_param(rain, "rain", "rain drops all over");
     register_param(distort, "distort", "distort all surface like dropping a bucket to the floor");
@@ -144,14 +150,41 @@ public:
     //    free(buffer);
   }
 
-  virtual void update() {
-
-    memcpy(BkGdImage, in, width*height*sizeof(uint32_t));
+  virtual void update(double time,
+                      uint32_t* out,
+                      const uint32_t* in) {
+    (void)time; // unused
+
+    /* DrawWater reads the background all around the pixel it writes */
+    if(in == out) {
+      memcpy(BkGdImage, in, width*height*sizeof(uint32_t));
+      background = BkGdImage;
+    } else
+      background = in;
+    output = out;
     
     water_update();
 
   }
-  
+
+  /* the surface calms down and the swirl and the surfer start again,
+     as in the constructor */
+  virtual bool reset() {
+    if(Height[0]) {
+      memset(Height[0], 0, water_surfacesize);
+      memset(Height[1], 0, water_surfacesize);
+    }
+    Hpage = 0;
+    ox = 80;
+    oy = 80;
+    raincount = 0;
+    fastsrand(::time(NULL));
+    xang = fastrand()%2048;
+    yang = fastrand()%2048;
+    swirlangle = fastrand()%2048;
+    return true;
+  }
+
 private:
   ScreenGeometry *geo;
 
@@ -161,6 +194,8 @@ private:
   uint32_t *BkGdImagePre;
   uint32_t *BkGdImage;
   uint32_t *BkGdImagePost;
+  const uint32_t *background;
+  uint32_t *output;
   
   //  uint32_t *buffer;
   
@@ -202,6 +237,25 @@ private:
   void CalcWaterBigFilter(int npage, int density);
   
   void SmoothWater(int npage);
+
+  /* the physics and the drawing go over the rows between the borders,
+     split over threads */
+  enum Pass { DRAW, CALC, SMOOTH, BIG };
+
+  struct Job {
+    Water *self;
+    Pass pass;
+    int page, density;
+    int y0, y1;
+  };
+
+  void run(Pass pass, int page, int density, int y0, int y1);
+  static void* rows(void *arg);
+
+  void DrawRow(int y, int page);
+  void CalcRow(int y, int npage, int density);
+  void SmoothRow(int y, int npage);
+  void BigFilterRow(int y, int npage, int density);
   
   void HeightBlob(int x, int y, int radius, int height, int page);
   void HeightBox (int x, int y, int radius, int height, int page);
@@ -458,130 +512,201 @@ void Water::water_3swirls() {
 }
 
 /* internal physics routines */
+void Water::run(Pass pass, int page, int density, int y0, int y1) {
+  Job jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)geo->w * geo->h);
+
+  if(y1 <= y0) return;
+  for(i = 0; i < n; i++) {
+    jobs[i].self = this;
+    jobs[i].pass = pass;
+    jobs[i].page = page;
+    jobs[i].density = density;
+    jobs[i].y0 = y0 + (y1 - y0) * i / n;
+    jobs[i].y1 = y0 + (y1 - y0) * (i + 1) / n;
+  }
+  frei0r_thread_run(rows, jobs, sizeof(Job), n);
+}
+
+void* Water::rows(void *arg) {
+  Job *job = (Job*)arg;
+  int y;
+
+  for(y = job->y0; y < job->y1; y++) {
+    switch(job->pass) {
+    case DRAW: job->self->DrawRow(y, job->page); break;
+    case CALC: job->self->CalcRow(y, job->page, job->density); break;
+    case SMOOTH: job->self->SmoothRow(y, job->page); break;
+    case BIG: job->self->BigFilterRow(y, job->page, job->density); break;
+    }
+  }
+  return 0;
+}
+
 void Water::DrawWater(int page) {
+  int last = (geo->h - 1)*geo->w;
+
+  /* the border has no slope, it shows the background */
+  if(geo->h > 0) {
+    memcpy(output, background, geo->w*sizeof(uint32_t));
+    memcpy(output + last, background + last, geo->w*sizeof(uint32_t));
+  }
+  run(DRAW, page, 0, 1, geo->h - 1);
+}
+
+/* the background displaced by the slope of the surface */
+void Water::DrawRow(int y, int page) {
   int dx, dy;
-  int x, y;
-  int c;
-  int offset=geo->w + 1;
+  int x, i;
+  int offset = y*geo->w + 1;
+  int last = geo->w*geo->h - 1;
   int *ptr = (int*)&Height[page][0];
-  
-  for (y = calc_optimization; offset < y; offset += 2) {
-    for (x = offset+geo->w-2; offset < x; offset++) {
-      dx = ptr[offset] - ptr[offset+1];
-      dy = ptr[offset] - ptr[offset+geo->w];
-      c = BkGdImage[offset + geo->w*(dy>>3) + (dx>>3)];
-      
-      out[offset] = c;
 
-      offset++;
-      dx = ptr[offset] - ptr[offset+1];
-      dy = ptr[offset] - ptr[offset+geo->w];
-      c = BkGdImage[offset + geo->w*(dy>>3) + (dx>>3)];
-
-      out[offset] = c;      
-    }
+  output[offset - 1] = background[offset - 1];
+  output[offset + geo->w - 2] = background[offset + geo->w - 2];
+  for (x = 1; x < geo->w - 1; x++, offset++) {
+    dx = ptr[offset] - ptr[offset+1];
+    dy = ptr[offset] - ptr[offset+geo->w];
+    i = offset + geo->w*(dy>>3) + (dx>>3);
+    if(i < 0) i = 0;
+    if(i > last) i = last;
+    output[offset] = background[i];
   }
 }
 
+#if defined(__SSE2__)
+/* the 8 pixels around 4 at p in a surface of width w */
+static inline __m128i water_sum8(const int *p, int w) {
+  __m128i s = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(p - w - 1)),
+                            _mm_loadu_si128((const __m128i*)(p - w)));
+  s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(p - w + 1)));
+  s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(p - 1)));
+  s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(p + 1)));
+  s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(p + w - 1)));
+  s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(p + w)));
+  return _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(p + w + 1)));
+}
+#endif
+
 void Water::CalcWater(int npage, int density) {
+  run(CALC, npage, density, 1, geo->h - 1);
+}
+
+void Water::CalcRow(int y, int npage, int density) {
   int newh;
-  int count = geo->w + 1;
+  int count = y*geo->w + 1;
   int *newptr = (int*) &Height[npage][0];
   int *oldptr = (int*) &Height[npage^1][0];
-  int x, y;
+  int x = 1;
 
-  for (y = calc_optimization; count < y; count += 2) {
-    for (x = count+geo->w-2; count < x; count++) {
-      /* eight pixels */
-      newh = ((oldptr[count + geo->w]
-	       + oldptr[count - geo->w]
-	       + oldptr[count + 1]
-	       + oldptr[count - 1]
-	       + oldptr[count - geo->w - 1]
-	       + oldptr[count - geo->w + 1]
-	       + oldptr[count + geo->w - 1]
-	       + oldptr[count + geo->w + 1]
-	       ) >> 2 )
-	- newptr[count];
-      newptr[count] =  newh - (newh >> density);
-    }
+#if defined(__SSE2__)
+  const __m128i shift = _mm_cvtsi32_si128(density);
+
+  for (; x + 4 <= geo->w - 1; x += 4, count += 4) {
+    __m128i h = _mm_sub_epi32(_mm_srai_epi32(water_sum8(oldptr + count, geo->w), 2),
+                              _mm_loadu_si128((const __m128i*)(newptr + count)));
+    _mm_storeu_si128((__m128i*)(newptr + count),
+                     _mm_sub_epi32(h, _mm_sra_epi32(h, shift)));
+  }
+#endif
+  for (; x < geo->w - 1; x++, count++) {
+    /* eight pixels */
+    newh = ((oldptr[count + geo->w]
+	     + oldptr[count - geo->w]
+	     + oldptr[count + 1]
+	     + oldptr[count - 1]
+	     + oldptr[count - geo->w - 1]
+	     + oldptr[count - geo->w + 1]
+	     + oldptr[count + geo->w - 1]
+	     + oldptr[count + geo->w + 1]
+	     ) >> 2 )
+      - newptr[count];
+    newptr[count] =  newh - (newh >> density);
   }
 }
 
 void Water::SmoothWater(int npage) {
+  run(SMOOTH, npage, 0, 1, geo->h - 1);
+}
+
+void Water::SmoothRow(int y, int npage) {
   int newh;
-  int count = geo->w + 1;
+  int count = y*geo->w + 1;
   int *newptr = (int*) &Height[npage][0];
   int *oldptr = (int*) &Height[npage^1][0];
-  int x, y;
-
-  for(y=1; y<geo->h-1; y++) {
-    for(x=1; x<geo->w-1; x++) {
-      /* eight pixel */
-      newh          = ((oldptr[count + geo->w]
-			+ oldptr[count - geo->w]
-			+ oldptr[count + 1]
-			+ oldptr[count - 1]
-			+ oldptr[count - geo->w - 1]
-			+ oldptr[count - geo->w + 1]
-			+ oldptr[count + geo->w - 1]
-			+ oldptr[count + geo->w + 1]
-			) >> 3 )
-	+ newptr[count];
-      
-      
-      newptr[count] =  newh>>1;
-      count++;
-    }
-    count += 2;
+  int x = 1;
+
+#if defined(__SSE2__)
+  for (; x + 4 <= geo->w - 1; x += 4, count += 4) {
+    __m128i h = _mm_add_epi32(_mm_srai_epi32(water_sum8(oldptr + count, geo->w), 3),
+                              _mm_loadu_si128((const __m128i*)(newptr + count)));
+    _mm_storeu_si128((__m128i*)(newptr + count), _mm_srai_epi32(h, 1));
+  }
+#endif
+  for (; x < geo->w - 1; x++, count++) {
+    /* eight pixel */
+    newh          = ((oldptr[count + geo->w]
+		      + oldptr[count - geo->w]
+		      + oldptr[count + 1]
+		      + oldptr[count - 1]
+		      + oldptr[count - geo->w - 1]
+		      + oldptr[count - geo->w + 1]
+		      + oldptr[count + geo->w - 1]
+		      + oldptr[count + geo->w + 1]
+		      ) >> 3 )
+      + newptr[count];
+    
+    
+    newptr[count] =  newh>>1;
   }
 }
 
 void Water::CalcWaterBigFilter(int npage, int density) {
+  run(BIG, npage, density, 2, geo->h - 2);
+}
+
+void Water::BigFilterRow(int y, int npage, int density) {
   int newh;
-  int count = (geo->w<<1) + 2;
+  int count = y*geo->w + 2;
   int *newptr = (int*) &Height[npage][0];
   int *oldptr = (int*) &Height[npage^1][0];
-  int x, y;
+  int x;
   
-  for(y=2; y<geo->h-2; y++) {
-    for(x=2; x<geo->w-2; x++) {
-      /* 25 pixels */
-      newh = (
-	      (
-	       (
-		(oldptr[count + geo->w]
-		 + oldptr[count - geo->w]
-		 + oldptr[count + 1]
-		 + oldptr[count - 1]
-		 )<<1)
-	       + ((oldptr[count - geo->w - 1]
-		   + oldptr[count - geo->w + 1]
-		   + oldptr[count + geo->w - 1]
-		   + oldptr[count + geo->w + 1]))
-	       + ( (
-		    oldptr[count - (geo->w<<1)]
-		    + oldptr[count + (geo->w<<1)]
-		    + oldptr[count - 2]
-		    + oldptr[count + 2]
-		    ) >> 1 )
-	       + ( (
-		    oldptr[count - (geo->w<<1) - 1]
-		    + oldptr[count - (geo->w<<1) + 1]
-		    + oldptr[count + (geo->w<<1) - 1]
-		    + oldptr[count + (geo->w<<1) + 1]
-		    + oldptr[count - 2 - geo->w]
-		    + oldptr[count - 2 + geo->w]
-		    + oldptr[count + 2 - geo->w]
-		    + oldptr[count + 2 + geo->w]
-		    ) >> 2 )
-	       )
-	      >> 3)
-	- (newptr[count]);
-      newptr[count] =  newh - (newh >> density);
-      count++;
-    }
-    count += 4;
+  for(x=2; x<geo->w-2; x++) {
+    /* 25 pixels */
+    newh = (
+	    (
+	     (
+	      (oldptr[count + geo->w]
+	       + oldptr[count - geo->w]
+	       + oldptr[count + 1]
+	       + oldptr[count - 1]
+	       )<<1)
+	     + ((oldptr[count - geo->w - 1]
+		 + oldptr[count - geo->w + 1]
+		 + oldptr[count + geo->w - 1]
+		 + oldptr[count + geo->w + 1]))
+	     + ( (
+		  oldptr[count - (geo->w<<1)]
+		  + oldptr[count + (geo->w<<1)]
+		  + oldptr[count - 2]
+		  + oldptr[count + 2]
+		  ) >> 1 )
+	     + ( (
+		  oldptr[count - (geo->w<<1) - 1]
+		  + oldptr[count - (geo->w<<1) + 1]
+		  + oldptr[count + (geo->w<<1) - 1]
+		  + oldptr[count + (geo->w<<1) + 1]
+		  + oldptr[count - 2 - geo->w]
+		  + oldptr[count - 2 + geo->w]
+		  + oldptr[count + 2 - geo->w]
+		  + oldptr[count + 2 + geo->w]
+		  ) >> 2 )
+	     )
+	    >> 3)
+      - (newptr[count]);
+    newptr[count] =  newh - (newh >> density);
+    count++;
   }
 }
 
@@ -602,11 +727,17 @@ void Water::HeightBlob(int x, int y, int radius, int height, int page) {
   CLIP_EDGES
 
   for(cy = top; cy < bottom; cy++) {
+    int span, x0, x1;
+    uint32_t *row = Height[page] + geo->w*(cy+y) + x;
+
+    /* the row of the disc is -span .. span */
     cyq = cy*cy;
-    for(cx = left; cx < right; cx++) {
-      if(cx*cx + cyq < rquad)
-        Height[page][geo->w*(cy+y) + (cx+x)] += height;
-    }
+    if(cyq >= rquad) continue;
+    span = isqrt(rquad - cyq - 1);
+    x0 = left > -span ? left : -span;
+    x1 = right < span + 1 ? right : span + 1;
+    for(cx = x0; cx < x1; cx++)
+      row[cx] += height;
   }
 }
 
@@ -687,5 +818,7 @@ void Water::SineBlob(int x, int y, int radius, int height, int page) {
 frei0r::construct<Water> plugin("Water",
 				"water drops on a video surface",
 				"Jaromil",
-				3,0);
+				3,1,
+				F0R_COLOR_MODEL_BGRA8888,
+				F0R_CAP_INPLACE | F0R_CAP_TEMPORAL);
 
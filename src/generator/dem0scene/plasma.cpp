@@ -27,7 +27,15 @@
 #include <string.h>
 #include <inttypes.h>
 
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include <frei0r.hpp>
+#include <frei0r_thread.h>
+#include <frei0r_stream.h>
 
 
 typedef struct {
@@ -54,6 +62,8 @@ public:
 
   virtual void update(double time, uint32_t* out);
 
+  virtual bool reset();
+
 private:
 
   ScreenGeometry geo;
@@ -70,6 +80,26 @@ private:
 
   uint32_t palette2rgb(uint8_t idx);
 
+  // colors as packed pixels
+  uint32_t palette[256];
+
+  // Sum of the two sines of each column and of each row. The row
+  // positions restart at the same value on every row, so the sum of all
+  // four sines of a pixel is col_sum[x] + row_sum[y].
+  std::vector<int32_t> col_sum;
+  std::vector<int32_t> row_sum;
+
+  struct job {
+    const Plasma* plasma;
+    uint32_t* out;
+    unsigned int row_begin, row_end;
+    bool stream;
+  };
+
+  static void render(const uint32_t* palette, uint32_t* image,
+                     const int32_t* col, int32_t r, unsigned int n);
+  static void* render_rows(void* arg);
+
   // vectors (exposed parameters from 0 to 1)
   double speed1; // 5
   double speed2; // 3
@@ -112,7 +142,9 @@ Plasma::Plasma(int wdt, int hgt) {
 
   _init(wdt, hgt);
 
- 
+  col_sum.resize(geo.w);
+  row_sum.resize(geo.h);
+
   /*create sin lookup table */
   for (i = 0; i < 512; i++)
     {
@@ -128,6 +160,7 @@ Plasma::Plasma(int wdt, int hgt) {
     }
   
   /* create palette */
+  memset(colors, 0, sizeof(colors));
   for (i = 0; i < 64; ++i)
     {
       colors[i].r = i << 2;
@@ -138,6 +171,8 @@ Plasma::Plasma(int wdt, int hgt) {
       colors[i+128].g = 255 - ((i << 2) + 1);
       colors[i+192].g = (i << 2) + 1; 
     } 
+  for (i = 0; i < 256; ++i)
+    palette[i] = palette2rgb(i);
 
   speed1 = 1.;
   speed2 = 1.;
@@ -145,14 +180,22 @@ Plasma::Plasma(int wdt, int hgt) {
   speed4 = 1.;
   move1  = 1.;
   move2  = 1.;
-  
+
+  reset();
+}
+
+// the positions and the speeds, which are multiplied by the parameters
+// on every frame, start over
+bool Plasma::reset() {
+  pos1 = pos2 = pos3 = pos4 = 0;
+
   _speed1 = 5;
   _speed2 = 3;
   _speed3 = 3;
   _speed4 = 1;
   _move1  = 9;
   _move2  = 8;
-
+  return true;
 }
 
 Plasma::~Plasma() {
@@ -160,11 +203,7 @@ Plasma::~Plasma() {
 }
 
 void Plasma::update(double time, uint32_t* out) {
-  uint16_t i, j;
-  uint8_t index;
-  int x;
-
-  uint32_t *image = (uint32_t*)out;
+  unsigned int i, j;
 
   // number parameters are not good in frei0r
   // we need types defining multipliers and min/max values
@@ -182,37 +221,36 @@ void Plasma::update(double time, uint32_t* out) {
   _move1 = _move1 * move1;
   _move2 = _move2 * move2;
 
-  tpos4 = pos4;
-  tpos3 = pos3;
-  
+  /* the positions wrap at 512, so unsigned sums give the same table
+     indices as the 16 bit positions */
+  const unsigned int s1 = (int)_speed1, s2 = (int)_speed2;
+  const unsigned int s3 = (int)_speed3, s4 = (int)_speed4;
+  unsigned int tp1 = pos1, tp2 = pos2, tp3 = pos3, tp4 = pos4;
+
+  for (j = 0; j < geo.w; ++j) {
+    tp1 += s1;
+    tp2 += s2;
+    col_sum[j] = aSin[tp1 & 511] + aSin[tp2 & 511];
+  }
   for (i = 0; i < geo.h; ++i) {
-    tpos1 = pos1 + (int)_speed1;
-    tpos2 = pos2 + (int)_speed2;
-    
-    tpos3 &= 511;
-    tpos4 &= 511;
-    
-    for (j = 0; j < geo.w; ++j) {
-      tpos1 &= 511;
-      tpos2 &= 511;
-      
-      x = aSin[tpos1] + aSin[tpos2] + aSin[tpos3] + aSin[tpos4];
-      /*actual plasma calculation*/
-      
-      index = 128 + (x >> 4);
-      /* fixed point multiplication but optimized so basically
-	 it  says (x  * (64  * 1024)  / (1024  * 1024)),  x is
-	 already multiplied by 1024*/
-      
-      *image++ = palette2rgb(index);
-      
-      tpos1 += (int)_speed1; 
-      tpos2 += (int)_speed2; 
-    }
-    
-    tpos4 += (int)_speed3;
-    tpos3 += (int)_speed4;
+    row_sum[i] = aSin[tp3 & 511] + aSin[tp4 & 511];
+    tp4 += s3;
+    tp3 += s4;
   }
+
+  job jobs[FREI0R_MAX_THREADS];
+  int n = frei0r_thread_count((long)geo.w * geo.h);
+  // frames larger than the cache are streamed around it
+  bool stream = frei0r_stream_wanted((size_t)geo.w * geo.h * sizeof(uint32_t));
+
+  for (int t = 0; t < n; ++t) {
+    jobs[t].plasma = this;
+    jobs[t].out = out;
+    jobs[t].row_begin = geo.h * t / n;
+    jobs[t].row_end = geo.h * (t + 1) / n;
+    jobs[t].stream = stream;
+  }
+  frei0r_thread_run(render_rows, jobs, sizeof(job), n);
   
   /* move plasma */
   
@@ -220,6 +258,56 @@ void Plasma::update(double time, uint32_t* out) {
   pos3 += (int)_move2;
 }
 
+void Plasma::render(const uint32_t* palette, uint32_t* image,
+                    const int32_t* col, int32_t r, unsigned int n) {
+  unsigned int j = 0;
+
+  /*actual plasma calculation: index = 128 + (x >> 4) is a fixed
+    point multiplication but optimized so basically it says
+    (x * (64 * 1024) / (1024 * 1024)), x is already multiplied by
+    1024*/
+#if defined(__AVX2__)
+  const __m256i rv = _mm256_set1_epi32(r);
+  const __m256i c128 = _mm256_set1_epi32(128);
+  const __m256i c255 = _mm256_set1_epi32(255);
+
+  for (; j + 8 <= n; j += 8) {
+    __m256i x = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(col + j)), rv);
+    __m256i idx = _mm256_and_si256(_mm256_add_epi32(_mm256_srai_epi32(x, 4), c128), c255);
+    _mm256_storeu_si256((__m256i*)(image + j),
+                        _mm256_i32gather_epi32((const int*)palette, idx, 4));
+  }
+#endif
+  for (; j < n; ++j)
+    image[j] = palette[(uint8_t)(128 + ((col[j] + r) >> 4))];
+}
+
+void* Plasma::render_rows(void* arg) {
+  const job* jb = (const job*)arg;
+  const Plasma* p = jb->plasma;
+  const unsigned int w = p->geo.w;
+  const int32_t* col = &p->col_sum[0];
+  uint32_t chunk[FREI0R_STREAM_CHUNK];
+
+  for (unsigned int i = jb->row_begin; i < jb->row_end; ++i) {
+    const int32_t r = p->row_sum[i];
+    uint32_t* image = jb->out + w * i;
+
+    if (!jb->stream) {
+      render(p->palette, image, col, r, w);
+      continue;
+    }
+    for (unsigned int j = 0; j < w; j += FREI0R_STREAM_CHUNK) {
+      unsigned int n = w - j < FREI0R_STREAM_CHUNK ? w - j : FREI0R_STREAM_CHUNK;
+      render(p->palette, chunk, col + j, r, n);
+      frei0r_stream_copy(image + j, chunk, n);
+    }
+  }
+  if (jb->stream)
+    frei0r_stream_end();
+  return 0;
+}
+
 uint32_t Plasma::palette2rgb(uint8_t idx) {
   uint32_t rgba;
   // just for little endian
@@ -235,4 +323,6 @@ uint32_t Plasma::palette2rgb(uint8_t idx) {
 frei0r::construct<Plasma> plugin("Plasma",
 				   "Demo scene 8bit plasma",
 				   "Jaromil",
-				   0,3);
+				   0,4,
+				   F0R_COLOR_MODEL_BGRA8888,
+				   F0R_CAP_TEMPORAL);
@@ -25,7 +25,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #if defined(_MSC_VER)
 #define __STDC_LIMIT_MACROS
 #endif /* _MSC_VER */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "frei0r.h"
+#include "frei0r_thread.h"
 
 //-------------------------------------------------------------------------
 
@@ -33,28 +37,30 @@ struct IsingField {
   char* s;
   int xsize;
   int ysize;
+  uint32_t rnd; /* state of my_rand(), so that a field can be replayed */
 };
 
 static void set_bf(uint32_t bf[3], double t, double b, double s);
 static void init_field(struct IsingField* f, int xsize, int ysize);
+static void reset_field(struct IsingField* f);
 static void destroy_field(struct IsingField* f);
 static void do_step(struct IsingField* f, uint32_t bf[3]);
 static void copy_field(const struct IsingField* f, uint32_t* framebuffer);
+static void do_step_checkerboard(struct IsingField* f, uint32_t bf[3],
+                                 uint32_t sweep, uint32_t* framebuffer);
 
 //-------------------------------------------------------------------------
 
 #define MY_RAND_MAX UINT32_MAX
 
-static uint32_t rnd_lcg1_xn = 1;
-
-inline static uint32_t rnd_lcg1()
+inline static uint32_t rnd_lcg1(uint32_t* xn)
 {
-  rnd_lcg1_xn *= 3039177861U;
+  *xn *= 3039177861U;
 
-  return rnd_lcg1_xn;
+  return *xn;
 }
 
-#define my_rand() rnd_lcg1()
+#define my_rand() rnd_lcg1(&f->rnd)
 
 
 typedef struct ising0r_instance
@@ -66,6 +72,10 @@ typedef struct ising0r_instance
   double border_growth;
   double spont_growth;
 
+  int checkerboard;
+  uint32_t sweep; /* seeds the random streams of the checkerboard sweeps */
+  uint64_t frame; /* the number of the next update, see f0r_seek */
+
   struct IsingField f;
   uint32_t bf[3];
 } ising0r_instance_t;
@@ -86,11 +96,17 @@ void f0r_get_plugin_info(f0r_plugin_info_t* nois0rInfo)
   nois0rInfo->color_model    = F0R_COLOR_MODEL_PACKED32;
   nois0rInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   nois0rInfo->major_version  = 0;
-  nois0rInfo->minor_version  = 9;
-  nois0rInfo->num_params     = 3;
+  nois0rInfo->minor_version  = 10;
+  nois0rInfo->num_params     = 4;
   nois0rInfo->explanation    = "Generates ising noise";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_TEMPORAL | F0R_CAP_SEEK;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   switch (param_index)
@@ -107,6 +123,10 @@ void f0r_get_param_info(f0r_param_info_t* info, int param_index)
       info->name        = "Spontaneous Growth";
       info->type        = F0R_PARAM_DOUBLE;
       info->explanation = "Spontaneous Growth"; break;
+    case 3:
+      info->name        = "Checkerboard";
+      info->type        = F0R_PARAM_BOOL;
+      info->explanation = "Update the two colours of a checkerboard in turn, in parallel"; break;
     }
 }
 
@@ -143,6 +163,8 @@ void f0r_set_param_value(f0r_instance_t instance,
       inst->border_growth = (1.0 - *p)*100; break;
     case 2:
       inst->spont_growth  = (1.0 - *p)*100; break;
+    case 3:
+      inst->checkerboard  = (*p >= 0.5); break;
     }
 }
 
@@ -161,6 +183,8 @@ void f0r_get_param_value(f0r_instance_t instance,
       *p = 1.0 - inst->border_growth / 100; break;
     case 2:
       *p = 1.0 - inst->spont_growth / 100; break;
+    case 3:
+      *p = inst->checkerboard ? 1.0 : 0.0; break;
     }
 }
 
@@ -172,12 +196,45 @@ void f0r_update(f0r_instance_t instance, double time,
   ising0r_instance_t* inst = (ising0r_instance_t*)instance;
   
   set_bf(inst->bf, inst->temp, inst->border_growth, inst->spont_growth);
+  inst->frame++;
   
+  if (inst->checkerboard)
+    {
+      do_step_checkerboard(&inst->f, inst->bf, inst->sweep++, outframe);
+      return;
+    }
+
   do_step(&inst->f, inst->bf);
 
   copy_field(&inst->f, outframe);  
 }
 
+/* Starts again from the first field when going back, then runs the
+ * steps up to frame without drawing them. */
+int f0r_seek(f0r_instance_t instance, double time, uint64_t frame)
+{
+  assert(instance);
+  ising0r_instance_t* inst = (ising0r_instance_t*)instance;
+
+  if (frame < inst->frame)
+    {
+      reset_field(&inst->f);
+      inst->sweep = 0;
+      inst->frame = 0;
+    }
+
+  set_bf(inst->bf, inst->temp, inst->border_growth, inst->spont_growth);
+
+  for (; inst->frame < frame; inst->frame++)
+    {
+      if (inst->checkerboard)
+        do_step_checkerboard(&inst->f, inst->bf, inst->sweep++, 0);
+      else
+        do_step(&inst->f, inst->bf);
+    }
+  return 1;
+}
+
 //-------------------------------------------------------------------------
 
 static void set_bf(uint32_t bf[3], double t, double b, double s)
@@ -207,13 +264,21 @@ static void set_bf(uint32_t bf[3], double t, double b, double s)
 
 static void init_field(struct IsingField* f, int xsize, int ysize)
 {
-  int x, y;
   f->s = (char*) malloc(xsize*ysize);
 
   f->xsize = xsize;
   f->ysize = ysize;
 
-  //  memset(
+  reset_field(f);
+}
+
+static void reset_field(struct IsingField* f)
+{
+  int x, y;
+  int xsize = f->xsize;
+  int ysize = f->ysize;
+
+  f->rnd = 1;
 
   for (y = 1; y < ysize-1; ++y)
     {
@@ -285,5 +350,177 @@ static void copy_field(const struct IsingField* f, uint32_t* framebuffer)
     }
 }
 
-//-------------------------------------------------------------------------
+/* Checkerboard sweep: a cell only depends on its four neighbours, which
+ * all have the other colour, so all cells of one colour can be updated at
+ * the same time. The rows are split over threads, and each row draws its
+ * random numbers from its own xorshift32 streams seeded from the sweep,
+ * the row and the colour, so the result doesn't depend on the number of
+ * threads. */
+
+typedef struct ising0r_job
+{
+  struct IsingField* f;
+  const uint32_t* bf;
+  uint32_t sweep;
+  int colour;
+  uint32_t* framebuffer; /* set for the second colour */
+  int row_begin, row_end;
+} ising0r_job_t;
+
+static uint32_t mix32(uint32_t x)
+{
+  x ^= x >> 16; x *= 0x7feb352dU;
+  x ^= x >> 15; x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline uint32_t xorshift32(uint32_t* x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
 
+/* updates the cells of row y whose x + y has the parity of colour */
+static void do_row_checkerboard(struct IsingField* f, const uint32_t bf[3],
+                                int y, int colour, uint32_t seed)
+{
+  int xsize = f->xsize;
+  char* current = f->s + y*xsize;
+  uint32_t rnd[8];
+  int x = 1, i;
+
+  for (i = 0; i < 8; ++i)
+    rnd[i] = mix32(seed + 0x9e3779b9U*(uint32_t)i) | 1;
+
+#if defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sign = _mm_set1_epi32((int)0x80000000U);
+    const __m128i bf0 = _mm_set1_epi32((int)(bf[0] ^ 0x80000000U));
+    const __m128i bf1 = _mm_set1_epi32((int)(bf[1] ^ 0x80000000U));
+    const __m128i bf2 = _mm_set1_epi32((int)(bf[2] ^ 0x80000000U));
+    const __m128i two = _mm_set1_epi32(2), four = _mm_set1_epi32(4);
+    /* Byte k of a block is a cell of this colour when x + k + y has the
+     * parity of colour. x stays odd, so these are the odd or the even
+     * bytes, the 8 cells of a block are done in 16 bit lanes. */
+    const int odd = (1 + y + colour) & 1;
+    const __m128i cells = _mm_set1_epi16(odd ? (short)0xff00 : 0x00ff);
+    /* one random stream per lane */
+    __m128i r[2];
+    /* the block before x, so that the left neighbours needn't be loaded
+     * from where the last block was just stored */
+    __m128i prev = _mm_loadu_si128((const __m128i*)(current + x - 16));
+
+    for (i = 0; i < 2; ++i)
+      r[i] = _mm_loadu_si128((const __m128i*)(rnd + 4*i));
+
+    for (; x + 16 <= xsize - 1; x += 16)
+      {
+        __m128i s = _mm_loadu_si128((const __m128i*)(current + x));
+        __m128i left = _mm_or_si128(_mm_slli_si128(s, 1),
+                                    _mm_srli_si128(prev, 15));
+        __m128i sum = _mm_add_epi8(
+          _mm_add_epi8(_mm_loadu_si128((const __m128i*)(current + x - xsize)),
+                       _mm_loadu_si128((const __m128i*)(current + x + xsize))),
+          _mm_add_epi8(left,
+                       _mm_loadu_si128((const __m128i*)(current + x + 1))));
+        /* e = s * sum, s is -1 or 1 */
+        __m128i m = _mm_cmplt_epi8(s, zero);
+        __m128i e = _mm_sub_epi8(_mm_xor_si128(sum, m), m);
+        __m128i e16 = odd ? _mm_srai_epi16(e, 8)
+                          : _mm_srai_epi16(_mm_slli_epi16(e, 8), 8);
+        __m128i e32[2], accept[2], flip;
+
+        e32[0] = _mm_srai_epi32(_mm_unpacklo_epi16(e16, e16), 16);
+        e32[1] = _mm_srai_epi32(_mm_unpackhi_epi16(e16, e16), 16);
+        for (i = 0; i < 2; ++i)
+          {
+            /* e < 0 leaves thr at 0, those cells flip anyway */
+            __m128i thr = _mm_or_si128(
+              _mm_and_si128(_mm_cmpeq_epi32(e32[i], zero), bf0),
+              _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi32(e32[i], two), bf1),
+                           _mm_and_si128(_mm_cmpeq_epi32(e32[i], four), bf2)));
+            r[i] = _mm_xor_si128(r[i], _mm_slli_epi32(r[i], 13));
+            r[i] = _mm_xor_si128(r[i], _mm_srli_epi32(r[i], 17));
+            r[i] = _mm_xor_si128(r[i], _mm_slli_epi32(r[i], 5));
+            accept[i] = _mm_cmpgt_epi32(thr, _mm_xor_si128(r[i], sign));
+          }
+        flip = _mm_or_si128(_mm_cmplt_epi16(e16, zero),
+                            _mm_packs_epi32(accept[0], accept[1]));
+        flip = _mm_and_si128(flip, cells);
+        prev = _mm_sub_epi8(_mm_xor_si128(s, flip), flip);
+        _mm_storeu_si128((__m128i*)(current + x), prev);
+      }
+    for (i = 0; i < 2; ++i)
+      _mm_storeu_si128((__m128i*)(rnd + 4*i), r[i]);
+  }
+#endif
+
+  /* the first cell of the colour at or after x */
+  x += (x + y + colour) & 1;
+  for (; x < xsize - 1; x += 2)
+    {
+      int sum =
+        current[x - xsize] + current[x + xsize] +
+        current[x - 1] + current[x + 1];
+
+      int e = current[x] * sum;
+
+      if (e < 0 || xorshift32(&rnd[(x >> 1) & 7]) < bf[e>>1])
+        {
+          current[x] *= -1;
+        }
+    }
+}
+
+static void* do_rows_checkerboard(void* arg)
+{
+  ising0r_job_t* job = (ising0r_job_t*)arg;
+  struct IsingField* f = job->f;
+  int y;
+
+  for (y = job->row_begin; y < job->row_end; ++y)
+    if (y > 0 && y < f->ysize - 1)
+      do_row_checkerboard(f, job->bf, y, job->colour,
+                          mix32(job->sweep*2 + job->colour)
+                          ^ (uint32_t)y*0x85ebca6bU);
+
+  /* after the second colour the rows of this job are done */
+  if (job->framebuffer)
+    {
+      const char* s = f->s + job->row_begin*f->xsize;
+      uint32_t* fr = job->framebuffer + job->row_begin*f->xsize;
+      int i;
+
+      for (i = (job->row_end - job->row_begin)*f->xsize; i > 0; --i)
+        *(fr++) = *(s++);
+    }
+  return 0;
+}
+
+static void do_step_checkerboard(struct IsingField* f, uint32_t bf[3],
+                                 uint32_t sweep, uint32_t* framebuffer)
+{
+  ising0r_job_t jobs[FREI0R_MAX_THREADS];
+  int i, colour, n = frei0r_thread_count((long)f->xsize*f->ysize);
+
+  for (colour = 0; colour < 2; ++colour)
+    {
+      for (i = 0; i < n; ++i)
+        {
+          jobs[i].f = f;
+          jobs[i].bf = bf;
+          jobs[i].sweep = sweep;
+          jobs[i].colour = colour;
+          jobs[i].framebuffer = colour ? framebuffer : 0;
+          jobs[i].row_begin = f->ysize*i/n;
+          jobs[i].row_end = f->ysize*(i + 1)/n;
+        }
+      frei0r_thread_run(do_rows_checkerboard, jobs, sizeof(ising0r_job_t), n);
+    }
+}
+
+//-------------------------------------------------------------------------
@@ -29,28 +29,41 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define M_PI 3.14159265358979323846
 #endif
 
+// Plots the figure as points, or with "lines" as anti-aliased lines
+// (Xiaolin Wu) between samples taken with sine and cosine recurrences.
+// The lines only erase the box of the previous figure when the host
+// passes the same buffer again, which it then must have left alone.
 class lissajous0r: public frei0r::source
 {
 public:
   lissajous0r(unsigned int width, unsigned int height)
   {
     r_x = r_y = 0.0;
+    lines = false;
+    last_out = 0;
     register_param(r_x,"ratiox","x-ratio");
     register_param(r_y,"ratioy","y-ratio");
+    register_param(lines,"lines","connect the samples with anti-aliased lines");
   }
 
   
   virtual void update(double time,
                       uint32_t* out)
   {
-    std::fill(out, out+width*height, 0x00000000);
-
     double rx=1.0/(0.999999-r_x);
     double ry=1.0/(0.999999-r_y);
     
     double w = 0.5*(width-1);
     double h = 0.5*(height-1);
     
+    if (lines)
+      {
+        draw_lines(out, rx, ry, w, h);
+        return;
+      }
+    last_out = 0;
+    std::fill(out, out+width*height, 0x00000000);
+
     const unsigned int samples = 15*(width+height);
 
     double deltax = (rx*2*M_PI) / (double) samples;
@@ -65,14 +78,126 @@ public:
 	out[width*y + x]=0xffffffff;	
       }
   }
+  // the figure only depends on the parameters, every frame can come first
+  virtual bool seek(double time, uint64_t frame)
+  {
+    return true;
+  }
+
 private:
+  // samples of a batch, the last one starts the next batch
+  static const int batch = 256;
+
+  void draw_lines(uint32_t* out, double rx, double ry, double w, double h)
+  {
+    // the samples are about 2 pixels apart, at most as many as the points;
+    // a ratio of 1 turns its frequency negative
+    double length = 2*M_PI*(fabs(rx)*w + fabs(ry)*h);
+    unsigned int samples = 15*(width+height);
+    if (length/2 < samples)
+      samples = std::max(64u, static_cast<unsigned int>(length/2));
+
+    if (out == last_out)
+      for (int y = box_y0; y < box_y1; ++y)
+        std::fill(out + width*y + box_x0, out + width*y + box_x1, 0x00000000);
+    else
+      std::fill(out, out+width*height, 0x00000000);
+
+    // sin(tx) and cos(ty) are rotated by the angle of a step
+    double cdx = cos((rx*2*M_PI) / samples), sdx = sin((rx*2*M_PI) / samples);
+    double cdy = cos((ry*2*M_PI) / samples), sdy = sin((ry*2*M_PI) / samples);
+    double sx = 0, cx = 1, sy = 0, cy = 1, t;
+    float px[batch], py[batch];
+    float xmin = w, xmax = w, ymin = 2*h, ymax = 2*h;
+
+    px[0] = w;
+    py[0] = 2*h;
+    for (unsigned int i = 0; i < samples; )
+      {
+        int n = 1;
+        for (; n < batch && i < samples; ++n, ++i)
+          {
+            t = sx*cdx + cx*sdx; cx = cx*cdx - sx*sdx; sx = t;
+            t = sy*cdy + cy*sdy; cy = cy*cdy - sy*sdy; sy = t;
+            px[n] = w*(1.0+sx);
+            py[n] = h*(1.0+cy);
+            xmin = std::min(xmin, px[n]); xmax = std::max(xmax, px[n]);
+            ymin = std::min(ymin, py[n]); ymax = std::max(ymax, py[n]);
+          }
+        for (int k = 1; k < n; ++k)
+          line(out, px[k-1], py[k-1], px[k], py[k]);
+        px[0] = px[n-1];
+        py[0] = py[n-1];
+      }
+
+    // the steps of a line start up to half a pixel before its ends, and
+    // touch the pixel after them on the minor axis
+    last_out = out;
+    box_x0 = std::max(0, static_cast<int>(xmin) - 1);
+    box_y0 = std::max(0, static_cast<int>(ymin) - 1);
+    box_x1 = std::min(static_cast<int>(width), static_cast<int>(xmax) + 2);
+    box_y1 = std::min(static_cast<int>(height), static_cast<int>(ymax) + 2);
+  }
+
+  // white of coverage c, over what is there
+  void plot(uint32_t* out, int x, int y, float c)
+  {
+    if (x < 0 || y < 0 || x >= (int)width || y >= (int)height)
+      return;
+    uint32_t v = static_cast<uint32_t>(c*255.0f + 0.5f) * 0x01010101;
+    uint32_t& p = out[width*y + x];
+    if (v > p)
+      p = v;
+  }
+
+  // one step per pixel of the major axis, each covering the two pixels
+  // around the line on the minor axis by their distance to it
+  void line(uint32_t* out, float x0, float y0, float x1, float y1)
+  {
+    bool steep = fabsf(y1 - y0) > fabsf(x1 - x0);
+    if (steep)
+      {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+      }
+    if (x0 > x1)
+      {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+      }
+    float dx = x1 - x0;
+    float gradient = dx > 0 ? (y1 - y0) / dx : 0;
+    int xa = static_cast<int>(x0 + 0.5f), xb = static_cast<int>(x1 + 0.5f);
+    float y = y0 + gradient * (xa - x0);
+    for (int x = xa; x <= xb; ++x, y += gradient)
+      {
+        int yi = static_cast<int>(floorf(y));
+        float f = y - yi;
+        if (steep)
+          {
+            plot(out, yi, x, 1.0f - f);
+            plot(out, yi + 1, x, f);
+          }
+        else
+          {
+            plot(out, x, yi, 1.0f - f);
+            plot(out, x, yi + 1, f);
+          }
+      }
+  }
+
   double r_x;
   double r_y;
+  bool lines;
+  uint32_t* last_out; // the buffer of the previous figure of lines
+  int box_x0, box_y0, box_x1, box_y1; // and the pixels it touched
 };
 
 
 frei0r::construct<lissajous0r> plugin("Lissajous0r",
 				   "Generates Lissajous0r images",
 				   "Martin Bayer",
-				   0,3);
+				   0,4,
+				   F0R_COLOR_MODEL_BGRA8888,
+				   F0R_CAP_SEEK);
 
@@ -19,46 +19,62 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include "frei0r.hpp"
-
-#include <algorithm>
-
-struct wnoise
-{
-  wnoise(unsigned int s)
-    : seed(s) {}
-  
-  unsigned int seed;
-
-  unsigned int operator()()
-  {
-    seed *= 3039177861U; // parameter for LCG
-    unsigned char rd = seed >> 24;
-    return (rd | rd << 8 | rd << 16 | 0xff000000);
-  }
-
-
-};
+#include "frei0r_random.h"
+#include "frei0r_stream.h"
 
 class nois0r : public frei0r::source
 {
 public:
   nois0r(unsigned int width, unsigned int height)
   {
+    seed = 0.0;
+    register_param(seed, "seed", "seed of the noise, the same seed and time always give the same frame");
   }
 
-  
-  virtual void update(double time,
-                      uint32_t* out)
+  // Every row is its own random stream keyed by the seed and the time, so
+  // rows can be made on any thread and a frame is the same each time it
+  // is made.
+  virtual bool update_slice(double time,
+                            uint32_t* out,
+                            unsigned int row_begin,
+                            unsigned int row_end)
   {
-    wnoise wn(0x0f0f0f0f ^ (unsigned int)(time*100000.0));
-    
-    std::generate(out, out+width*height, wn);
+    const uint32_t frame_seed = frei0r_random_frame_seed(seed, time);
+    // frames larger than the cache are made in chunks and streamed around
+    // it; chunks of a multiple of 8 values keep the random stream the same
+    const bool stream = frei0r_stream_wanted(width*height*sizeof(uint32_t));
+    uint32_t chunk[FREI0R_STREAM_CHUNK];
+
+    for (unsigned int y = row_begin; y < row_end; ++y)
+      {
+        uint32_t* row = out + width*y;
+        frei0r_random_t r;
+        frei0r_random_init(&r, frame_seed, y);
+        for (unsigned int x0 = 0; x0 < width; x0 += FREI0R_STREAM_CHUNK)
+          {
+            const unsigned int n = std::min(width - x0, (unsigned int)FREI0R_STREAM_CHUNK);
+            uint32_t* p = stream ? chunk : row + x0;
+            frei0r_random_fill(&r, p, n);
+            for (unsigned int x = 0; x < n; ++x)
+              {
+                const uint32_t g = p[x] >> 24;
+                p[x] = g | g << 8 | g << 16 | 0xff000000;
+              }
+            if (stream)
+              frei0r_stream_copy(row + x0, chunk, n);
+          }
+      }
+    if (stream)
+      frei0r_stream_end();
+    return true;
   }
+
+private:
+  double seed;
 };
 
 
 frei0r::construct<nois0r> plugin("Nois0r",
 				   "Generates white noise images",
 				   "Martin Bayer",
-				   0,3);
-
+				   0,4);
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include "frei0r.hpp"
+#include "frei0r_stream.h"
 
 #include <algorithm>
 
@@ -29,29 +30,53 @@ public:
   {
     register_param(color,"Color","the color of the image");
     color.r = color.g = color.b = 0;
+    on_params_changed();
   }
-  
-  virtual void update(double time,
-                      uint32_t* out)
+
+  virtual void on_params_changed()
   {
-    unsigned int col;
     unsigned char* c = reinterpret_cast<unsigned char*>(&col);
 
     c[0]=static_cast<unsigned char>(color.b*255);
     c[1]=static_cast<unsigned char>(color.g*255);
     c[2]=static_cast<unsigned char>(color.r*255);
     c[3]=255;
-    
-    std::fill(out, out+width*height, col);
+    frame_valid = false;
+  }
+  
+  virtual void update(double time,
+                      uint32_t* out)
+  {
+    frei0r_stream_frame_fill(out, col, width*height);
+  }
+
+  // The image only changes with the color, so it is filled once and then
+  // handed out until the color changes.
+  virtual const uint32_t* update_view(double time,
+                                      const uint32_t* in1,
+                                      const uint32_t* in2,
+                                      const uint32_t* in3)
+  {
+    if (!frame_valid)
+      {
+        if (!frame.data())
+          frame.resize(width, height);
+        std::fill(frame.data(), frame.data()+width*height, col);
+        frame_valid = true;
+      }
+    return frame.data();
   }
   
 private:
   f0r_param_color color;
+  uint32_t col;
+  frei0r::aligned_frame<uint32_t> frame;
+  bool frame_valid;
 };
 
 
 frei0r::construct<onecol0r> plugin("onecol0r",
 				   "image with just one color",
 				   "Martin Bayer",
-				   0,3);
+				   0,4);
 
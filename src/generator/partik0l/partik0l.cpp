@@ -26,11 +26,13 @@
 
 
 #include "frei0r.hpp"
+#include "frei0r_random.h"
 
 #include <stdlib.h>
 #include <string.h>
 
 #include <algorithm>
+#include <vector>
 #if defined(_MSC_VER)
 #define _USE_MATH_DEFINES
 #endif /* _MSC_VER */
@@ -40,12 +42,20 @@
 #include <inttypes.h>
 #include <limits.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* defines for blob size and roundness */
 #define LIM 8 // 25
 #define NB_BLOB 16 // 25
 
 #define PRIMES 11
 
+/* particles are splatted tile by tile, so that the part of the frame
+   being drawn stays in the cache however many particles there are */
+#define TILE_SHIFT 6
+
 class Partik0l: public frei0r::source {
 public:
 
@@ -55,10 +65,17 @@ public:
   void update(double time,
               uint32_t* out);
 
+  bool seek(double time, uint64_t frame);
+
+  bool reset();
+
   int w, h;
 
   double up;
   double down;
+  double seed;
+  bool deterministic;
+  double density;
 
 private:
 
@@ -75,6 +92,10 @@ private:
   float blossom_r;
   float blossom_a;
 
+  /* the seed the blossom was last made from in deterministic mode */
+  double blossom_seed;
+  bool blossom_seeded;
+
   /* primes */
   int prime[11];
 
@@ -82,10 +103,27 @@ private:
   double wd, hd;
 
 
-  void blob(uint32_t* out, int x, int y);
+  void blob(uint32_t* out, uint32_t offset);
   void blossom(uint32_t* out);
   void blob_init(int ray);
   void blossom_recal(bool r);
+  void blossom_table();
+
+  /* The particles of the blossom as structure of arrays. The position
+     of particle p at angle A is
+
+     x = wd * (0.47 + (xs[p] * cos(A) + xc[p] * sin(A)) / 2.2)
+     y = hd * (0.47 + (yc[p] * cos(A) - ys[p] * sin(A)) / 2.2)
+
+     which is the blossom formula with the sines and cosines of the sums
+     expanded, so a frame needs no trig per particle. */
+  std::vector<float> xs, xc, yc, ys;
+  double table_density;
+  bool table_valid;
+
+  /* offsets of the visible blobs, in the order they are splatted */
+  std::vector<uint32_t> offset, sorted, tile;
+  std::vector<unsigned int> tile_start;
 
   /* surface buffer */
   //  uint32_t *pixels;
@@ -102,6 +140,9 @@ Partik0l::Partik0l(unsigned int width, unsigned int height) {
 
   register_param(up, "up", "blossom on a higher prime number");
   register_param(down, "down", "blossom on a lower prime number");
+  register_param(seed, "seed", "seed of the blossom in deterministic mode");
+  register_param(deterministic, "deterministic", "make the blossom from the seed and move it with the time, so that frames can be rendered in any order");
+  register_param(density, "density", "particles per turn of the blossom, 1 is 1257 particles");
 
   /* initialize prime numbers */
   prime[0] = 2;
@@ -129,6 +170,13 @@ Partik0l::Partik0l(unsigned int width, unsigned int height) {
 
   up = 0;
   down = 0;
+  seed = 0;
+  deterministic = false;
+  density = 1.0;
+  table_density = 1.0;
+  table_valid = false;
+  blossom_seed = 0;
+  blossom_seeded = false;
 
   pi2 = 2.0*M_PI;
   
@@ -175,17 +223,60 @@ void Partik0l::update(double time,
     down = false;
   }
 
-  blossom_a += 0.01;
-  if( blossom_a > pi2 )
-    blossom_a -= pi2;
+  if(deterministic) {
+    /* the same blossom for the same seed, turning by 0.01 per frame
+       at 25 frames per second */
+    if(!blossom_seeded || blossom_seed != seed) {
+      fastsrand( frei0r_random_frame_seed(seed, 0.0) );
+      blossom_recal(true);
+      blossom_seed = seed;
+      blossom_seeded = true;
+    }
+    blossom_a = fmod(time * 0.25, pi2);
+  } else {
+    blossom_seeded = false;
+    blossom_a += 0.01;
+    if( blossom_a > pi2 )
+      blossom_a -= pi2;
+  }
 
 
+  if(!table_valid || table_density != density)
+    blossom_table();
+
   memset(out,0,size);
 
   blossom(out);
 
 }
 
+/* The angle is all that moves from frame to frame, in deterministic mode
+   it comes from the time anyway. Otherwise the steps are taken without
+   drawing, so that the float angle is the same as after the updates. */
+bool Partik0l::seek(double time, uint64_t frame) {
+  if(deterministic)
+    return true;
+
+  blossom_a = 0;
+  for(uint64_t i = 0; i < frame; ++i) {
+    blossom_a += 0.01;
+    if( blossom_a > pi2 )
+      blossom_a -= pi2;
+  }
+  return true;
+}
+
+/* The blossom and its angle start over as in the constructor, in
+   deterministic mode the blossom of the seed is made again. */
+bool Partik0l::reset() {
+  fastsrand( ::time(NULL) );
+  blossom_r = 1;
+  blossom_recal(true);
+  blossom_seeded = false;
+  blossom_a = 0;
+  return true;
+}
+
 void Partik0l::blossom_recal(bool r) {
 
   float z = ((PRIMES-2)*fastrand()/INT_MAX)+1;
@@ -201,28 +292,64 @@ void Partik0l::blossom_recal(bool r) {
     blossom_r = (blossom_r>=1.0)?1.0:blossom_r+0.1;
   else
     blossom_r = (blossom_r<=0.1)?0.1:blossom_r-0.1;
+  table_valid = false;
 }  
 
-void Partik0l::blossom(uint32_t* out) {
-  
-  float	a;
-  int x, y;
+void Partik0l::blossom_table() {
+
+  float a;
   double zx, zy;
+  double step = 0.005 / std::min(std::max(density, 0.01), 1000.0);
 
-  /* here place a formula that draws on the screen
-     the surface being drawed at this point is always blank */
-  for( a=0.0 ; a<pi2; a+=0.005 ) {
+  xs.clear(); xc.clear(); yc.clear(); ys.clear();
+  for( a=0.0 ; a<pi2; a+=step ) {
     zx = blossom_m*a;
     zy = blossom_n*a;
-    x = (int)(wd*(0.47+ (blossom_r*sin(blossom_i*zx+blossom_a)+
-			 (1.0-blossom_r)*sin(blossom_k*zy+blossom_a)) /2.2 ));
-    
-    y = (int)(hd*(0.47+ (blossom_r*cos(blossom_j*zx+blossom_a)+
-			 (1.0-blossom_r)*cos(blossom_l*zy+blossom_a)) /2.2 ));
-    
-    blob(out, x,y);
-    
-  } 
+    xs.push_back(blossom_r*sin(blossom_i*zx) + (1.0-blossom_r)*sin(blossom_k*zy));
+    xc.push_back(blossom_r*cos(blossom_i*zx) + (1.0-blossom_r)*cos(blossom_k*zy));
+    yc.push_back(blossom_r*cos(blossom_j*zx) + (1.0-blossom_r)*cos(blossom_l*zy));
+    ys.push_back(blossom_r*sin(blossom_j*zx) + (1.0-blossom_r)*sin(blossom_l*zy));
+  }
+  table_density = density;
+  table_valid = true;
+}
+
+void Partik0l::blossom(uint32_t* out) {
+
+  const unsigned int n = xs.size();
+  const unsigned int tiles_x = (w >> TILE_SHIFT) + 1;
+  const unsigned int tiles = tiles_x * ((h >> TILE_SHIFT) + 1);
+  const float sa = sin(blossom_a), ca = cos(blossom_a);
+  const float fw = wd / 2.2, fh = hd / 2.2;
+  const float x0 = wd * 0.47, y0 = hd * 0.47;
+  unsigned int p, m = 0;
+  int x, y;
+
+  /* positions, the blobs that are in the frame and their tiles */
+  offset.resize(n);
+  tile.resize(n);
+  for( p=0 ; p<n ; p++ ) {
+    x = (int)(x0 + fw*(xs[p]*ca + xc[p]*sa));
+    y = (int)(y0 + fh*(yc[p]*ca - ys[p]*sa));
+    if( x<0 || y<0 || x+blob_size>w || y+blob_size>h )
+      continue;
+    offset[m] = (x + y*w)>>1;
+    tile[m] = (y >> TILE_SHIFT)*tiles_x + (x >> TILE_SHIFT);
+    m++;
+  }
+
+  /* counting sort by tile */
+  tile_start.assign(tiles + 1, 0);
+  for( p=0 ; p<m ; p++ )
+    tile_start[tile[p] + 1]++;
+  for( p=0 ; p<tiles ; p++ )
+    tile_start[p + 1] += tile_start[p];
+  sorted.resize(m);
+  for( p=0 ; p<m ; p++ )
+    sorted[tile_start[tile[p]]++] = offset[p];
+
+  for( p=0 ; p<m ; p++ )
+    blob(out, sorted[p]);
 
 }
 
@@ -265,61 +392,41 @@ void Partik0l::blob_init(int ray) {
 }
   
 
-void Partik0l::blob(uint32_t* out, int x, int y) {
-  //  if(y>h-blob_size) return;
-  //  if(x>w-blob_size) return;
+/* Adds the blob to the frame at offset, in pairs of pixels. The sum is
+   saturated per byte with MMX enabled, otherwise it is done on 64 bit
+   words as it always was, carries included. */
+void Partik0l::blob(uint32_t* out, uint32_t offset) {
 
   int i, j;
   int stride = (w-blob_size)>>1;
 
-  uint64_t *tmp_scr = (uint64_t*)out + ((x + y*w)>>1);
+  uint64_t *tmp_scr = (uint64_t*)out + offset;
   uint64_t *tmp_blob = (uint64_t*)blob_buf;
 
-#ifdef HAVE_MMX
-  /* using mmx packed unsaturated addition on bytes
-     for cleaner and shiny result */
+#if defined(__SSE2__)
   for(j=blob_size; j>0; j--) {
-    for(i=blob_size>>4; i>0; i--) {
-      
-      asm volatile("movq (%1),%%mm0;"
-		   "movq 8(%1),%%mm1;"
-		   "movq 16(%1),%%mm2;"
-		   "movq 24(%1),%%mm3;"
-		   "movq 32(%1),%%mm4;"
-		   "movq 40(%1),%%mm5;"
-		   "movq 48(%1),%%mm6;"
-		   "movq 56(%1),%%mm7;"
-
-		   "paddusb (%0),%%mm0;" // packed add unsaturated on bytes
-		   "paddusb 8(%0),%%mm1;" // addizione clippata
-		   "paddusb 16(%0),%%mm2;"
-		   "paddusb 24(%0),%%mm3;"
-		   "paddusb 32(%0),%%mm4;"
-		   "paddusb 40(%0),%%mm5;"
-		   "paddusb 48(%0),%%mm6;"
-		   "paddusb 56(%0),%%mm7;"
-
-		   "movq %%mm0,(%0);"	  
-		   "movq %%mm1,8(%0);"	  
-		   "movq %%mm2,16(%0);"	  
-		   "movq %%mm3,24(%0);"	  
-		   "movq %%mm4,32(%0);"	  
-		   "movq %%mm5,40(%0);"	  
-		   "movq %%mm6,48(%0);"	 
-		   "movq %%mm7,56(%0);"
-		   //	  "paddsw %0, %%mm0;"// halo violetto?
-		   :
-		   :"r"(tmp_scr),"r"(tmp_blob)
-		   :"memory");
-      tmp_scr+=8;
-      tmp_blob+=8;
+    for(i=blob_size>>2; i>0; i--) {
+      __m128i s = _mm_loadu_si128((__m128i*)tmp_scr);
+      __m128i b = _mm_loadu_si128((__m128i*)tmp_blob);
+#ifdef HAVE_MMX
+      _mm_storeu_si128((__m128i*)tmp_scr, _mm_adds_epu8(s, b));
+#else
+      _mm_storeu_si128((__m128i*)tmp_scr, _mm_add_epi64(s, b));
+#endif
+      tmp_scr+=2;
+      tmp_blob+=2;
     }
     tmp_scr += stride;
   }
-  asm("emms;");
-
-
-#else // ! HAVE_MMX
+#elif defined(HAVE_MMX)
+  uint8_t *scr8, *blob8 = (uint8_t*)blob_buf;
+  for(j=blob_size; j>0; j--) {
+    scr8 = (uint8_t*)tmp_scr;
+    for(i=blob_size*4; i>0; i--, scr8++, blob8++)
+      *scr8 = std::min(*scr8 + *blob8, 255);
+    tmp_scr += (blob_size>>1) + stride;
+  }
+#else
   for(j=blob_size; j>0; j--) {
     for(i=blob_size>>1; i>0; i--) {
       *(tmp_scr++) += *(tmp_blob++);
@@ -370,4 +477,6 @@ bool Partik0l::keypress(int key) {
 frei0r::construct<Partik0l> plugin("Partik0l",
 				 "Particles generated on prime number sinusoidal blossoming",
 				 "Jaromil",
-				 0,3);
+				 0,5,
+				 F0R_COLOR_MODEL_BGRA8888,
+				 F0R_CAP_TEMPORAL | F0R_CAP_SEEK);
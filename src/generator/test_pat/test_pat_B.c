@@ -44,8 +44,11 @@ needs to care about color models, endianness, DV legality etc.
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "frei0r.h"
+#include "frei0r_raster.h"
+#include "frei0r_stream.h"
 
 
 
@@ -77,12 +80,12 @@ for (i=zy;i<ky;i++)
 }
 
 //-----------------------------------------------------------
-//pocasna za velike kroge.....
 void draw_circle(float_rgba *sl, int w, int h, float ar, int x, int y, int rn, int rz, float_rgba c)
 {
-int i,j;
+int i,j,k,n;
 int zx,kx,zy,ky;
-float rr,rmin,rmax;
+int spans[4];
+float rmin,rmax;
 
 zx=x-rz/ar-1;  if (zx<0) zx=0;
 zy=y-rz-1;  if (zy<0) zy=0;
@@ -91,11 +94,12 @@ ky=y+rz+1;  if (ky>h) ky=h;
 rmin=(float)rn;
 rmax=(float)rz;
 for (i=zy;i<ky;i++)
-	for (j=zx;j<kx;j++)
-		{
-		rr=sqrtf((i-y)*(i-y)+(j-x)*(j-x)*ar*ar);
-		if ((rr>=rmin)&&(rr<=rmax)) sl[w*i+j]=c;
-		}
+	{
+	n=frei0r_raster_ring_spans(i,x,y,ar,rmin,rmax,zx,kx,spans);
+	for (k=0;k<n;k++)
+		for (j=spans[2*k];j<spans[2*k+1];j++)
+			sl[w*i+j]=c;
+	}
 
 }
 
@@ -704,6 +708,9 @@ typedef struct
   float par;
   float_rgba *sl;
 
+  uint32_t *frame;	//the pattern as pixels, made again after a change
+  int frame_valid;
+
 } tp_inst_t;
 
 //----------------------------------------------------
@@ -726,7 +733,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tp_info)
   tp_info->color_model    = F0R_COLOR_MODEL_RGBA8888;
   tp_info->frei0r_version = FREI0R_MAJOR_VERSION;
   tp_info->major_version  = 0;
-  tp_info->minor_version  = 1;
+  tp_info->minor_version  = 2;
   tp_info->num_params     = 3;
   tp_info->explanation    = "Generates test card lookalikes";
 }
@@ -766,6 +773,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 
   inst->par=1.0;
   inst->sl=(float_rgba*)calloc(width*height,sizeof(float_rgba));
+  inst->frame=(uint32_t*)calloc(width*height,sizeof(uint32_t));
+  inst->frame_valid=0;
 
   bars_simple(inst->sl, inst->w, inst->h, 0, 0);
 
@@ -778,6 +787,7 @@ void f0r_destruct(f0r_instance_t instance)
   tp_inst_t* inst = (tp_inst_t*)instance;
 
   free(inst->sl);
+  free(inst->frame);
   free(inst);
 }
 
@@ -833,6 +843,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 
   if (chg==0) return;
+  inst->frame_valid=0;
 
   switch (inst->type)
     {
@@ -887,6 +898,19 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 }
 
+//---------------------------------------------------
+//the pattern only changes with the parameters, so it is converted to
+//pixels once and then copied, or handed out by f0r_update_view
+static const uint32_t* pattern_frame(tp_inst_t* inst)
+{
+  if (!inst->frame_valid)
+    {
+      floatrgba2color(inst->sl, inst->frame, inst->w , inst->h);
+      inst->frame_valid=1;
+    }
+  return inst->frame;
+}
+
 //---------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
@@ -894,6 +918,19 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
   assert(instance);
   tp_inst_t* inst = (tp_inst_t*)instance;
 
-  floatrgba2color(inst->sl, outframe, inst->w , inst->h);
+  frei0r_stream_frame_copy(outframe, pattern_frame(inst), inst->w*inst->h);
 
 }
+
+//---------------------------------------------------
+const uint32_t* f0r_update_view(f0r_instance_t instance, double time,
+                                const uint32_t* inframe1,
+                                const uint32_t* inframe2,
+                                const uint32_t* inframe3)
+{
+
+  assert(instance);
+  return pattern_frame((tp_inst_t*)instance);
+
+}
+
@@ -33,8 +33,10 @@ Test patterns: cross sections of color spaces
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "frei0r.h"
+#include "frei0r_stream.h"
 
 
 
@@ -483,6 +485,9 @@ typedef struct
 
   float_rgba *sl;
 
+  uint32_t *frame;	//the pattern as pixels, made again after a change
+  int frame_valid;
+
 } tp_inst_t;
 
 //----------------------------------------------------
@@ -505,7 +510,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tp_info)
   tp_info->color_model    = F0R_COLOR_MODEL_RGBA8888;
   tp_info->frei0r_version = FREI0R_MAJOR_VERSION;
   tp_info->major_version  = 0;
-  tp_info->minor_version  = 1;
+  tp_info->minor_version  = 2;
   tp_info->num_params     = 4;
   tp_info->explanation    = "Generates cross sections of color spaces";
 }
@@ -553,6 +558,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->fs=0;
 
   inst->sl=(float_rgba*)calloc(width*height,sizeof(float_rgba));
+  inst->frame=(uint32_t*)calloc(width*height,sizeof(uint32_t));
+  inst->frame_valid=0;
 
   x0=(inst->w-3*inst->h/4)/2;
   y0=inst->h/8;
@@ -573,6 +580,7 @@ void f0r_destruct(f0r_instance_t instance)
   tp_inst_t* inst = (tp_inst_t*)instance;
 
   free(inst->sl);
+  free(inst->frame);
   free(inst);
 }
 
@@ -621,6 +629,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 
   if (chg==0) return;
+  inst->frame_valid=0;
 
   if (inst->fs==0)
     {
@@ -686,6 +695,19 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 }
 
+//---------------------------------------------------
+//the pattern only changes with the parameters, so it is converted to
+//pixels once and then copied, or handed out by f0r_update_view
+static const uint32_t* pattern_frame(tp_inst_t* inst)
+{
+  if (!inst->frame_valid)
+    {
+      floatrgba2color(inst->sl, inst->frame, inst->w , inst->h);
+      inst->frame_valid=1;
+    }
+  return inst->frame;
+}
+
 //---------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
@@ -693,6 +715,19 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
   assert(instance);
   tp_inst_t* inst = (tp_inst_t*)instance;
 
-  floatrgba2color(inst->sl, outframe, inst->w , inst->h);
+  frei0r_stream_frame_copy(outframe, pattern_frame(inst), inst->w*inst->h);
 
 }
+
+//---------------------------------------------------
+const uint32_t* f0r_update_view(f0r_instance_t instance, double time,
+                                const uint32_t* inframe1,
+                                const uint32_t* inframe2,
+                                const uint32_t* inframe3)
+{
+
+  assert(instance);
+  return pattern_frame((tp_inst_t*)instance);
+
+}
+
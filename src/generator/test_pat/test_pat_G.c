@@ -44,33 +44,33 @@ DV legality etc.
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "frei0r.h"
+#include "frei0r_raster.h"
+#include "frei0r_stream.h"
 
 
 //----------------------------------------------------------
 void draw_rectangle(unsigned char *sl, int w, int h, int x, int y, int wr, int hr, unsigned char gray)
 {
-int i,j;
+int i;
 int zx,kx,zy,ky;
 
-zx=x;  if (zx<0) zx=0;
-zy=y;  if (zy<0) zy=0;
-kx=x+wr;  if (kx>w) kx=w;
-ky=y+hr;  if (ky>h) ky=h;
+zx=x; zy=y; kx=x+wr; ky=y+hr;
+if (!frei0r_raster_clip(w, h, &zx, &zy, &kx, &ky)) return;
 for (i=zy;i<ky;i++)
-	for (j=zx;j<kx;j++)
-		sl[w*i+j]=gray;
+	memset(sl+w*i+zx, gray, kx-zx);
 
 }
 
 //-----------------------------------------------------------
-//pocasna za velike kroge.....
 void draw_circle(unsigned char *sl, int w, int h, float ar, int x, int y, int rn, int rz, unsigned char gray)
 {
-int i,j;
+int i,k,n;
 int zx,kx,zy,ky;
-float rr,rmin,rmax;
+int spans[4];
+float rmin,rmax;
 
 zx=x-rz/ar-1;  if (zx<0) zx=0;
 zy=y-rz-1;  if (zy<0) zy=0;
@@ -79,11 +79,11 @@ ky=y+rz+1;  if (ky>=h) ky=h-1;
 rmin=(float)rn;
 rmax=(float)rz;
 for (i=zy;i<ky;i++)
-	for (j=zx;j<kx;j++)
-		{
-		rr=sqrtf((i-y)*(i-y)+(j-x)*(j-x)*ar*ar);
-		if ((rr>=rmin)&&(rr<=rmax)) sl[w*i+j]=gray;
-		}
+	{
+	n=frei0r_raster_ring_spans(i,x,y,ar,rmin,rmax,zx,kx,spans);
+	for (k=0;k<n;k++)
+		memset(sl+w*i+spans[2*k], gray, spans[2*k+1]-spans[2*k]);
+	}
 
 }
 
@@ -585,6 +585,9 @@ typedef struct
   unsigned char *alpha;
   uint32_t *c2c;
 
+  uint32_t *frame;	//the pattern as pixels, made again after a change
+  int frame_valid;
+
 } tp_inst_t;
 
 //----------------------------------------------------
@@ -607,7 +610,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tp_info)
   tp_info->color_model    = F0R_COLOR_MODEL_RGBA8888;
   tp_info->frei0r_version = FREI0R_MAJOR_VERSION;
   tp_info->major_version  = 0;
-  tp_info->minor_version  = 2;
+  tp_info->minor_version  = 3;
   tp_info->num_params     = 6;
   tp_info->explanation    = "Generates geometry test pattern images";
 }
@@ -662,6 +665,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 
   inst->par=1.0;
   inst->sl=(unsigned char*)calloc(width*height,1);
+  inst->frame=(uint32_t*)calloc(width*height,sizeof(uint32_t));
+  inst->frame_valid=0;
   inst->alpha=(unsigned char*)calloc(width*height,1);
   inst->c2c=(uint32_t *)calloc(256,sizeof(uint32_t));
 
@@ -677,6 +682,7 @@ void f0r_destruct(f0r_instance_t instance)
   tp_inst_t* inst = (tp_inst_t*)instance;
 
   free(inst->sl);
+  free(inst->frame);
   free(inst->alpha);
   free(inst->c2c);
   free(inst);
@@ -750,6 +756,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 
   if (chg==0) return;
+  inst->frame_valid=0;
 
   switch (inst->type)
     {
@@ -825,38 +832,65 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
 
 //---------------------------------------------------
 //COLOR MODEL DEPENDENT
-void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+//the pattern only changes with the parameters, so it is converted to
+//pixels once and then copied, or handed out by f0r_update_view
+static const uint32_t* pattern_frame(tp_inst_t* inst)
 {
   int i;
 
+  if (!inst->frame_valid)
+    {
+      switch (inst->type)
+        {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 9:
+        case 10:
+          for (i=0;i<(inst->h*inst->w);i++)
+            inst->frame[i]=0xFF000000|inst->c2c[inst->sl[i]];
+          break;
+        case 8:
+          kvadranti(inst->frame,inst->w,inst->h,inst->neg);
+          break;
+        case 11:
+        case 12:
+          for (i=0;i<(inst->h*inst->w);i++)
+            inst->frame[i]=((uint32_t)inst->alpha[i])<<24|inst->c2c[inst->sl[i]];
+          break;
+        default:
+          break;
+        }
+      inst->frame_valid=1;
+    }
+  return inst->frame;
+}
+
+//---------------------------------------------------
+void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
+{
+
   assert(instance);
   tp_inst_t* inst = (tp_inst_t*)instance;
 
-  switch (inst->type)
-    {
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 9:
-    case 10:
-      for (i=0;i<(inst->h*inst->w);i++)
-        outframe[i]=0xFF000000|inst->c2c[inst->sl[i]];
-      break;
-    case 8:
-      kvadranti(outframe,inst->w,inst->h,inst->neg);
-      break;
-    case 11:
-    case 12:
-      for (i=0;i<(inst->h*inst->w);i++)
-        outframe[i]=((uint32_t)inst->alpha[i])<<24|inst->c2c[inst->sl[i]];
-      break;
-    default:
-      break;
-    }
+  frei0r_stream_frame_copy(outframe, pattern_frame(inst), inst->w*inst->h);
+
+}
+
+//---------------------------------------------------
+const uint32_t* f0r_update_view(f0r_instance_t instance, double time,
+                                const uint32_t* inframe1,
+                                const uint32_t* inframe2,
+                                const uint32_t* inframe3)
+{
+
+  assert(instance);
+  return pattern_frame((tp_inst_t*)instance);
 
 }
+
@@ -47,8 +47,11 @@ needs to care about color models, endianness, DV legality etc.
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "frei0r.h"
+#include "frei0r_raster.h"
+#include "frei0r_stream.h"
 
 
 double PI=3.14159265358979;
@@ -57,17 +60,7 @@ double PI=3.14159265358979;
 //----------------------------------------------------------
 void draw_rectangle(float *sl, int w, int h, int x, int y, int wr, int hr, float gray)
 {
-int i,j;
-int zx,kx,zy,ky;
-
-zx=x;  if (zx<0) zx=0;
-zy=y;  if (zy<0) zy=0;
-kx=x+wr;  if (kx>w) kx=w;
-ky=y+hr;  if (ky>h) ky=h;
-for (i=zy;i<ky;i++)
-	for (j=zx;j<kx;j++)
-		sl[w*i+j]=gray;
-
+frei0r_raster_rect(sl, w, h, x, y, wr, hr, gray);
 }
 
 //----------------------------------------------------------
@@ -92,18 +85,18 @@ switch (dir)
 		g=gray1;
 		for (j=zx;j<kx;j++)
 			{
-			for (i=zy;i<ky;i++)
-				sl[w*i+j]=g;
+			sl[w*zy+j]=g;
 			g=g+dg;
 			}
+		for (i=zy+1;i<ky;i++)
+			memcpy(sl+w*i+zx, sl+w*zy+zx, (kx-zx)*sizeof(float));
 		break;
 	case 1:
 		dg=(gray2-gray1)/(hr-1);
 		g=gray1;
 		for (i=zy;i<ky;i++)
 			{
-			for (j=zx;j<kx;j++)
-				sl[w*i+j]=g;
+			frei0r_raster_span(sl+w*i+zx, kx-zx, g);
 			g=g+dg;
 			}
 		break;
@@ -112,18 +105,18 @@ switch (dir)
 		g=gray2;
 		for (j=zx;j<kx;j++)
 			{
-			for (i=zy;i<ky;i++)
-				sl[w*i+j]=g;
+			sl[w*zy+j]=g;
 			g=g+dg;
 			}
+		for (i=zy+1;i<ky;i++)
+			memcpy(sl+w*i+zx, sl+w*zy+zx, (kx-zx)*sizeof(float));
 		break;
 	case 3:
 		dg=(gray1-gray2)/(hr-1);
 		g=gray2;
 		for (i=zy;i<ky;i++)
 			{
-			for (j=zx;j<kx;j++)
-				sl[w*i+j]=g;
+			frei0r_raster_span(sl+w*i+zx, kx-zx, g);
 			g=g+dg;
 			}
 	default:
@@ -133,25 +126,15 @@ switch (dir)
 }
 
 //-----------------------------------------------------------
-//pocasna za velike kroge.....
 void draw_circle(float *sl, int w, int h, float ar, int x, int y, int rn, int rz, float gray)
 {
-int i,j;
 int zx,kx,zy,ky;
-float rr,rmin,rmax;
 
 zx=x-rz/ar-1;  if (zx<0) zx=0;
 zy=y-rz-1;  if (zy<0) zy=0;
 kx=x+rz/ar+1;  if (kx>w) kx=w;
 ky=y+rz+1;  if (ky>h) ky=h;
-rmin=(float)rn;
-rmax=(float)rz;
-for (i=zy;i<ky;i++)
-	for (j=zx;j<kx;j++)
-		{
-		rr=sqrtf((i-y)*(i-y)+(j-x)*(j-x)*ar*ar);
-		if ((rr>=rmin)&&(rr<=rmax)) sl[w*i+j]=gray;
-		}
+frei0r_raster_ring(sl, w, zx, zy, kx, ky, ar, x, y, (float)rn, (float)rz, gray);
 
 }
 
@@ -535,6 +518,9 @@ typedef struct
 
   float *sl;
 
+  uint32_t *frame;	//the pattern as pixels, made again after a change
+  int frame_valid;
+
 } tp_inst_t;
 
 //----------------------------------------------------
@@ -557,7 +543,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tp_info)
   tp_info->color_model    = F0R_COLOR_MODEL_RGBA8888;
   tp_info->frei0r_version = FREI0R_MAJOR_VERSION;
   tp_info->major_version  = 0;
-  tp_info->minor_version  = 1;
+  tp_info->minor_version  = 2;
   tp_info->num_params     = 2;
   tp_info->explanation    = "Generates linearity checking patterns";
 }
@@ -590,6 +576,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
   inst->chan=0;
 
   inst->sl=(float*)calloc(width*height,sizeof(float));
+  inst->frame=(uint32_t*)calloc(width*height,sizeof(uint32_t));
+  inst->frame_valid=0;
 
   stopnice(inst->sl, inst->w, inst->h);
 
@@ -602,6 +590,7 @@ void f0r_destruct(f0r_instance_t instance)
   tp_inst_t* inst = (tp_inst_t*)instance;
 
   free(inst->sl);
+  free(inst->frame);
   free(inst);
 }
 
@@ -640,6 +629,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 
   if (chg==0) return;
+  inst->frame_valid=0;
 
   switch (inst->type)
     {
@@ -688,6 +678,19 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 }
 
+//---------------------------------------------------
+//the pattern only changes with the parameters, so it is converted to
+//pixels once and then copied, or handed out by f0r_update_view
+static const uint32_t* pattern_frame(tp_inst_t* inst)
+{
+  if (!inst->frame_valid)
+    {
+      float2color(inst->sl, inst->frame, inst->w , inst->h, inst->chan);
+      inst->frame_valid=1;
+    }
+  return inst->frame;
+}
+
 //---------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
@@ -695,6 +698,19 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
   assert(instance);
   tp_inst_t* inst = (tp_inst_t*)instance;
 
-  float2color(inst->sl, outframe, inst->w , inst->h, inst->chan);
+  frei0r_stream_frame_copy(outframe, pattern_frame(inst), inst->w*inst->h);
 
 }
+
+//---------------------------------------------------
+const uint32_t* f0r_update_view(f0r_instance_t instance, double time,
+                                const uint32_t* inframe1,
+                                const uint32_t* inframe2,
+                                const uint32_t* inframe3)
+{
+
+  assert(instance);
+  return pattern_frame((tp_inst_t*)instance);
+
+}
+
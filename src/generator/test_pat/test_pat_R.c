@@ -42,8 +42,11 @@ needs to care about color models, endianness, DV legality etc.
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "frei0r.h"
+#include "frei0r_raster.h"
+#include "frei0r_stream.h"
 
 
 
@@ -61,17 +64,7 @@ typedef struct
 //----------------------------------------------------------
 void draw_rectangle(float *sl, int w, int h, int x, int y, int wr, int hr, float gray)
 {
-int i,j;
-int zx,kx,zy,ky;
-
-zx=x;  if (zx<0) zx=0;
-zy=y;  if (zy<0) zy=0;
-kx=x+wr;  if (kx>w) kx=w;
-ky=y+hr;  if (ky>h) ky=h;
-for (i=zy;i<ky;i++)
-	for (j=zx;j<kx;j++)
-		sl[w*i+j]=gray;
-
+frei0r_raster_rect(sl, w, h, x, y, wr, hr, gray);
 }
 
 //-------------------------------------------------------
@@ -125,7 +118,8 @@ while (str[i]!=0)
 //linp:   0=linear frequency sweep   1=linear period sweep
 void draw_sweep_1(float *sl, int w, int h, int x, int y, int wr, int hr, float f1, float f2, float a, int dir, int linp)
 {
-int i,j;
+int i,j,k,n;
+float col[FREI0R_RASTER_BLOCK];
 int zx,kx,zy,ky;
 double p,dp,dp1,dp2,dt,dt1,dt2;
 
@@ -154,11 +148,7 @@ if (dir==0)
 			}
 		//zacetna faza tako, da bo v sredini 0
 		p=-(double)wr/2.0*dp;
-		for (j=zx;j<kx;j++)
-			{
-			sl[w*i+j]=0.5+a*cos(p);
-			p=p+dp;
-			}
+		frei0r_raster_wave(sl+w*i+zx, kx-zx, p, dp, 0.5, a);
 		}
 	}
 else
@@ -174,10 +164,13 @@ else
 			}
 		//zacetna faza tako, da bo v sredini 0
 		p=-(double)hr/2.0*dp;
-		for (i=zy;i<ky;i++)
+		//po blokih v stolpec
+		for (i=zy;i<ky;i+=FREI0R_RASTER_BLOCK)
 			{
-			sl[w*i+j]=0.5+a*cos(p);
-			p=p+dp;
+			n=ky-i; if (n>FREI0R_RASTER_BLOCK) n=FREI0R_RASTER_BLOCK;
+			frei0r_raster_wave(col, n, p+(i-zy)*dp, dp, 0.5, a);
+			for (k=0;k<n;k++)
+				sl[w*(i+k)+j]=col[k];
 			}
 		}
 	}
@@ -222,8 +215,7 @@ if (dir==0)
 			}
 		p=p+dp;
 		s=0.5+a*cos(p);
-		for (j=zx;j<kx;j++)
-			sl[w*i+j]=s;
+		frei0r_raster_span(sl+w*i+zx, kx-zx, s);
 		}
 	}
 else
@@ -238,10 +230,10 @@ else
 			dp=1.0/dt;
 			}
 		p=p+dp;
-		s=0.5+a*cos(p);
-		for (i=zy;i<ky;i++)
-			sl[w*i+j]=s;
+		sl[w*zy+j]=0.5+a*cos(p);
 		}
+	for (i=zy+1;i<ky;i++)
+		memcpy(sl+w*i+zx, sl+w*zy+zx, (kx-zx)*sizeof(float));
 	}
 }
 
@@ -459,7 +451,8 @@ for (an=0.0; an<2.0*PI; an=an+da)
 void rings(float *sl, int w, int h, float a, float ar, int linp, float sf, float ef)
 {
 float k,m,g,p,da,r,rmax;
-int x,y;
+float *row;
+int x,y,xa,n;
 
 da=PI/2000.0;
 
@@ -476,17 +469,24 @@ if (linp==0)
 	g=0.5+a*cosf(p);
 	for (x=0;x<w*h;x++) sl[x]=g; //match background to outer rim
 
-	for (x=-rmax;x<rmax;x++)
-		for (y=-rmax;y<rmax;y++)
+	for (y=-rmax;y<rmax;y++)
+		{
+		//faze v vrstico, nato kosinus cez vse naenkrat
+		row=sl+(y+h/2)*w+w/2;
+		xa=0; n=0;
+		for (x=-rmax;x<rmax;x++)
 			{
 			r=sqrtf(x*x+y*y);
 			if (r<rmax)
 				{
 				p=(k*r+m)*r;
-				g=0.5+a*cosf(p);
-				sl[(y+h/2)*w+x+w/2]=g;
+				if (n==0) xa=x;
+				row[x]=p;
+				n++;
 				}
 			}
+		frei0r_raster_cos(row+xa, row+xa, n, 0.5, a);
+		}
 	}
 else
 	{
@@ -497,17 +497,24 @@ else
 	g=0.5+a*cosf(p);
 	for (x=0;x<w*h;x++) sl[x]=g; //match background to outer rim
 
-	for (x=-rmax;x<rmax;x++)
-		for (y=-rmax;y<rmax;y++)
+	for (y=-rmax;y<rmax;y++)
+		{
+		//faze v vrstico, nato kosinus cez vse naenkrat
+		row=sl+(y+h/2)*w+w/2;
+		xa=0; n=0;
+		for (x=-rmax;x<rmax;x++)
 			{
 			r=sqrtf(x*x+y*y);
 			if (r<rmax)
 				{
 				p=PI/k*logf(fabsf(m+k*r));
-				g=0.5+a*cosf(p);
-				sl[(y+h/2)*w+x+w/2]=g;
+				if (n==0) xa=x;
+				row[x]=p;
+				n++;
 				}
 			}
+		frei0r_raster_cos(row+xa, row+xa, n, 0.5, a);
+		}
 	}
 
 }
@@ -528,8 +535,9 @@ for (y=0;y<h;y++)
 	for (x=0;x<w;x++)
 		{
 		p=p+PI*fh;
-		sl[y*w+x]=0.5+a*cosf(p);
+		sl[y*w+x]=p;
 		}
+	frei0r_raster_cos(sl+y*w, sl+y*w, w, 0.5, a);
 	p1=p1+PI*fv;
 	}
 }
@@ -777,6 +785,9 @@ typedef struct
   float par;
   float *sl;
 
+  uint32_t *frame;	//the pattern as pixels, made again after a change
+  int frame_valid;
+
 } tp_inst_t;
 
 //----------------------------------------------------
@@ -799,7 +810,7 @@ void f0r_get_plugin_info(f0r_plugin_info_t* tp_info)
   tp_info->color_model    = F0R_COLOR_MODEL_RGBA8888;
   tp_info->frei0r_version = FREI0R_MAJOR_VERSION;
   tp_info->major_version  = 0;
-  tp_info->minor_version  = 2;
+  tp_info->minor_version  = 3;
   tp_info->num_params     = 8;
   tp_info->explanation    = "Generates resolution test patterns";
 }
@@ -869,6 +880,8 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 
   inst->par=1.0;
   inst->sl=(float*)calloc(width*height,sizeof(float));
+  inst->frame=(uint32_t*)calloc(width*height,sizeof(uint32_t));
+  inst->frame_valid=0;
 
   sweep_v(inst->sl, inst->w, inst->h, 0, inst->amp, inst->linp, inst->par, 0.05, 0.7);
 
@@ -881,6 +894,7 @@ void f0r_destruct(f0r_instance_t instance)
   tp_inst_t* inst = (tp_inst_t*)instance;
 
   free(inst->sl);
+  free(inst->frame);
   free(inst);
 }
 
@@ -965,6 +979,7 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 
   if (chg==0) return;
+  inst->frame_valid=0;
 
   switch (inst->type)
     {
@@ -1040,6 +1055,19 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int param_i
     }
 }
 
+//---------------------------------------------------
+//the pattern only changes with the parameters, so it is converted to
+//pixels once and then copied, or handed out by f0r_update_view
+static const uint32_t* pattern_frame(tp_inst_t* inst)
+{
+  if (!inst->frame_valid)
+    {
+      float2color(inst->sl, inst->frame, inst->w , inst->h, inst->chan);
+      inst->frame_valid=1;
+    }
+  return inst->frame;
+}
+
 //---------------------------------------------------
 void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, uint32_t* outframe)
 {
@@ -1047,6 +1075,19 @@ void f0r_update(f0r_instance_t instance, double time, const uint32_t* inframe, u
   assert(instance);
   tp_inst_t* inst = (tp_inst_t*)instance;
 
-  float2color(inst->sl, outframe, inst->w , inst->h, inst->chan);
+  frei0r_stream_frame_copy(outframe, pattern_frame(inst), inst->w*inst->h);
 
 }
+
+//---------------------------------------------------
+const uint32_t* f0r_update_view(f0r_instance_t instance, double time,
+                                const uint32_t* inframe1,
+                                const uint32_t* inframe2,
+                                const uint32_t* inframe3)
+{
+
+  assert(instance);
+  return pattern_frame((tp_inst_t*)instance);
+
+}
+
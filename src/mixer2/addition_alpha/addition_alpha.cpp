@@ -21,15 +21,20 @@
 
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_simd.h"
+
+#include <algorithm>
 
 #define NBYTES 4
 #define ALPHA 3
+#define TILE_SIZE 256
 
 class addition_alpha : public frei0r::mixer2
 {
 public:
   addition_alpha(unsigned int width, unsigned int height)
   {
+    pointwise = true;
     // initialize look-up table
     for (int i = 0; i < 256; i++)
       add_lut[i] = i;
@@ -46,16 +51,41 @@ public:
    * second channel only if its alpha channel is not 0.
    *
    **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  bool update_slice(double time,
+                    uint32_t* out,
+                    const uint32_t* in1,
+                    const uint32_t* in2,
+                    unsigned int row_begin,
+                    unsigned int row_end)
+  {
+    const unsigned int offset = width * row_begin;
+    const unsigned int n = width * (row_end - row_begin);
+
+    // Tiles where in2 is fully transparent add nothing, they only make
+    // in1 opaque.
+    for (unsigned int i = 0; i < n; i += TILE_SIZE)
+      {
+        const unsigned int m = std::min(n - i, (unsigned int)TILE_SIZE);
+        uint32_t *D = out + offset + i;
+        const uint32_t *A = in1 + offset + i;
+        const uint32_t *B = in2 + offset + i;
+
+        if (frei0r_simd_alpha_class(B, m) != FREI0R_SIMD_ALPHA_CLEAR)
+          add(reinterpret_cast<uint8_t*>(D),
+              reinterpret_cast<const uint8_t*>(A),
+              reinterpret_cast<const uint8_t*>(B), m);
+        else if (D != A
+                 || frei0r_simd_alpha_class(A, m) != FREI0R_SIMD_ALPHA_OPAQUE)
+          for (unsigned int j = 0; j < m; ++j)
+            D[j] = A[j] | FREI0R_SIMD_ALPHA_MASK;
+      }
+    return true;
+  }
+  
+private:
+  static void add(uint8_t* D, const uint8_t* A, const uint8_t* B,
+                  uint32_t sizeCounter)
   {
-    const uint8_t *A = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *B = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *D = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
     uint32_t b;
   
     while (sizeCounter--)
@@ -69,8 +99,7 @@ public:
         D += NBYTES;
       }
   }
-  
-private:
+
   static uint8_t add_lut[511]; // look-up table storing values to do a quick MAX of two values when you know you add two unsigned chars
 };
 
@@ -80,5 +109,6 @@ frei0r::construct<addition_alpha> plugin("addition_alpha",
                                   "Perform an RGB[A] addition_alpha operation of the pixel sources.",
                                   "Jean-Sebastien Senecal",
                                   0,2,
-                                  F0R_COLOR_MODEL_RGBA8888);
+                                  F0R_COLOR_MODEL_RGBA8888,
+                                  F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -19,6 +19,7 @@
 
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_porterduff.h"
 
 #include <algorithm>
 
@@ -27,18 +28,34 @@ class alphain : public frei0r::mixer2
 public:
   alphain(unsigned int width, unsigned int height)
   {
+    pointwise = true;
+    premultiplied = false;
+    register_param(premultiplied, "premultiplied",
+                   "Inputs and output are premultiplied by alpha");
   }
 
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  bool update_slice(double time,
+                    uint32_t* out,
+                    const uint32_t* in1,
+                    const uint32_t* in2,
+                    unsigned int row_begin,
+                    unsigned int row_end)
   {
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
+    if (premultiplied)
+    {
+      frei0r_porterduff_row(FREI0R_PORTERDUFF_IN,
+                            out + width*row_begin,
+                            in1 + width*row_begin,
+                            in2 + width*row_begin,
+                            width*(row_end-row_begin));
+      return true;
+    }
+
+    uint8_t *dst = reinterpret_cast<uint8_t*>(out + width*row_begin);
+    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1 + width*row_begin);
+    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2 + width*row_begin);
     
-    for (unsigned int i=0; i<size; ++i)
+    for (unsigned int i=0; i<width*(row_end-row_begin); ++i)
     {
       uint32_t tmp;
       uint8_t alpha_src1 = src1[3];
@@ -60,8 +77,11 @@ public:
       src2 += 4;
       dst += 4;
     }
+    return true;
   }
-  
+
+private:
+  bool premultiplied;
 };
 
 
@@ -69,5 +89,6 @@ frei0r::construct<alphain> plugin("alphain",
                                   "the alpha IN operation",
                                   "Jean-Sebastien Senecal",
                                   0,2,
-                                  F0R_COLOR_MODEL_RGBA8888);
+                                  F0R_COLOR_MODEL_RGBA8888,
+                                  F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -19,26 +19,91 @@
 
 #include "frei0r.hpp"
 #include "frei0r_math.h"
+#include "frei0r_porterduff.h"
+#include "frei0r_simd.h"
 
 #include <algorithm>
+#include <cstring>
+
+#define TILE_SIZE 256
 
 class alphaover : public frei0r::mixer2
 {
 public:
   alphaover(unsigned int width, unsigned int height)
   {
+    pointwise = true;
+    premultiplied = false;
+    register_param(premultiplied, "premultiplied",
+                   "Inputs and output are premultiplied by alpha");
+  }
+
+  bool update_slice(double time,
+                    uint32_t* out,
+                    const uint32_t* in1,
+                    const uint32_t* in2,
+                    unsigned int row_begin,
+                    unsigned int row_end)
+  {
+    const unsigned int offset = width*row_begin;
+    const unsigned int n = width*(row_end-row_begin);
+
+    // Overlay graphics are mostly transparent, so tiles where in1 is
+    // fully transparent or fully opaque are copied instead of blended.
+    for (unsigned int i=0; i<n; i+=TILE_SIZE)
+    {
+      const unsigned int m = std::min(n-i, (unsigned int)TILE_SIZE);
+      uint32_t *dst = out + offset + i;
+      const uint32_t *src1 = in1 + offset + i;
+      const uint32_t *src2 = in2 + offset + i;
+      const int top = frei0r_simd_alpha_class(src1, m);
+
+      if (top == FREI0R_SIMD_ALPHA_OPAQUE)
+      {
+        copy(dst, src1, m);
+        continue;
+      }
+      if (top == FREI0R_SIMD_ALPHA_CLEAR)
+      {
+        // premultiplied in2 shows through unchanged, the straight formula
+        // squares the alpha of in2, so only its opaque tiles are copied
+        const int bottom = premultiplied ? FREI0R_SIMD_ALPHA_OPAQUE
+                                         : frei0r_simd_alpha_class(src2, m);
+        if (bottom == FREI0R_SIMD_ALPHA_OPAQUE)
+        {
+          copy(dst, src2, m);
+          continue;
+        }
+        if (bottom == FREI0R_SIMD_ALPHA_CLEAR)
+        {
+          std::memset(dst, 0, m*sizeof(uint32_t));
+          continue;
+        }
+      }
+
+      if (premultiplied)
+        frei0r_porterduff_row(FREI0R_PORTERDUFF_OVER, dst, src1, src2, m);
+      else
+        over(reinterpret_cast<uint8_t*>(dst),
+             reinterpret_cast<const uint8_t*>(src1),
+             reinterpret_cast<const uint8_t*>(src2), m);
+    }
+    return true;
+  }
+
+private:
+  bool premultiplied;
+
+  static void copy(uint32_t* dst, const uint32_t* src, unsigned int n)
+  {
+    if (dst != src)
+      std::memcpy(dst, src, n*sizeof(uint32_t));
   }
 
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  static void over(uint8_t* dst, const uint8_t* src1, const uint8_t* src2,
+                   unsigned int n)
   {
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    
-    for (unsigned int i=0; i<size; ++i)
+    for (unsigned int i=0; i<n; ++i)
     {
       uint32_t tmp1, tmp2;
       uint8_t alpha_src1 = src1[3];
@@ -62,7 +127,6 @@ public:
       dst += 4;
     }
   }
-  
 };
 
 
@@ -70,5 +134,6 @@ frei0r::construct<alphaover> plugin("alphaover",
                                     "the alpha OVER operation",
                                     "Jean-Sebastien Senecal",
                                     0,2,
-                                    F0R_COLOR_MODEL_RGBA8888);
+                                    F0R_COLOR_MODEL_RGBA8888,
+                                    F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
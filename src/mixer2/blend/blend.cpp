@@ -19,18 +19,29 @@
  */
 
 #include "frei0r.hpp"
-#include "frei0r_math.h"
-
-#define NBYTES 4
-#define ALPHA 3
+#include "frei0r_simd.h"
+#include "frei0r_transition.h"
 
 class blend : public frei0r::mixer2
 {
 public:
   blend(unsigned int width, unsigned int height)
   {
+  	pointwise = true;
   	blend_factor = 0.5;
   	register_param(blend_factor,"blend","blend factor");
+  	start = 0.0;
+  	duration = 0.0;
+  	curve = "linear";
+  	register_param(start,"start","time in seconds at which the blend factor starts to rise from 0");
+  	register_param(duration,"duration","seconds until the blend factor reaches 1, 0 uses the blend parameter");
+  	register_param(curve,"curve","shape of the transition: linear, smooth, ease-in or ease-out");
+  	on_params_changed();
+  }
+
+  virtual void on_params_changed()
+  {
+    curve_index = frei0r_transition_curve(curve.c_str());
   }
 
   /**
@@ -40,32 +51,29 @@ public:
    *
    * The result is left in out
    **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  bool update_slice(double time,
+                    uint32_t* out,
+                    const uint32_t* in1,
+                    const uint32_t* in2,
+                    unsigned int row_begin,
+                    unsigned int row_end)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    const uint8_t bf = (const uint8_t) (255 * blend_factor);
-    const uint8_t one_minus_bf = (255 - bf);
-    uint32_t w = size;
-    uint32_t b;
-  
-    while (w--)
-      {
-        for (b = 0; b < NBYTES; b++)
-          dst[b] = (src1[b] * one_minus_bf + src2[b] * bf) / 255;
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
+    const unsigned int offset = width*row_begin;
+    const double f = duration > 0.0
+      ? frei0r_transition_position(time, start, duration, curve_index)
+      : blend_factor;
+    const uint8_t bf = (const uint8_t) (255 * f);
+    frei0r_simd_lerp(out + offset, in1 + offset, in2 + offset,
+                     width * (row_end - row_begin), bf);
+    return true;
   }
   
 private:
   double blend_factor;
+  double start;
+  double duration;
+  std::string curve;
+  frei0r_transition_curve_t curve_index;
     
 };
 
@@ -73,6 +81,7 @@ private:
 frei0r::construct<blend> plugin("blend",
                                 "Perform a blend operation between two sources",
                                 "Jean-Sebastien Senecal",
-                                0,2,
-                                F0R_COLOR_MODEL_RGBA8888);
+                                0,3,
+                                F0R_COLOR_MODEL_RGBA8888,
+                                F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -21,58 +21,34 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class burn : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] dodge operation between the pixel sources
+ * in1 and in2, using the generalised algorithm:
+ *
+ * D = saturation of 255 or depletion of 0, of ((255 - A) * 256) / (B + 1)
+ *
+ **/
+struct burn_op : frei0r::blend_op<burn_op>
 {
-public:
-  burn(unsigned int width, unsigned int height)
-  {
-  }
-
-  /**
-   *
-   * Perform an RGB[A] dodge operation between the pixel sources
-   * in1 and in2, using the generalised algorithm:
-   *
-   * D = saturation of 255 or depletion of 0, of ((255 - A) * 256) / (B + 1)
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  static uint8_t channel(int a, int b)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b;
-  
     /* FIXME: Is the burn effect supposed to be dependant on the sign of this
      * temporary variable? */
     int tmp;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            tmp = (255 - src1[b]) << 8;
-            tmp /= src2[b] + 1;
-            dst[b] = (uint8_t) CLAMP0255(255 - tmp);
-          }
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
+
+    tmp = (255 - a) << 8;
+    tmp /= b + 1;
+    return CLAMP0255(255 - tmp);
+  }
+};
+
+class burn : public frei0r::blend_mixer<burn_op>
+{
+public:
+  burn(unsigned int width, unsigned int height)
+  {
   }
-  
-  
-    
 };
 
 
@@ -81,5 +57,6 @@ frei0r::construct<burn> plugin("burn",
 							   "D = saturation of 255 or depletion of 0, of ((255 - A) * 256) / (B + 1)",
                                "Jean-Sebastien Senecal",
                                0,2,
-                               F0R_COLOR_MODEL_RGBA8888);
+                               F0R_COLOR_MODEL_RGBA8888,
+                               F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
                                
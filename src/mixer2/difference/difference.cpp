@@ -19,59 +19,229 @@
  */
 
 #include "frei0r.hpp"
-#include "frei0r_math.h"
+#include "frei0r_simd.h"
+#include "frei0r_thread.h"
 
-#define NBYTES 4
-#define ALPHA 3
+#include <cstdio>
+#include <cstring>
 
-class difference : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] difference operation between the pixel sources
+ * in1 and in2.
+ *
+ **/
+struct difference_op : frei0r::blend_op<difference_op>
+{
+  static void init()
+  {
+  }
+
+  static void row(uint32_t* dst, const uint32_t* src1,
+                  const uint32_t* src2, unsigned int n)
+  {
+    frei0r_simd_difference(dst, src1, src2, n);
+  }
+};
+
+// With measure set, updates of whole frames also sum up how much the
+// sources differ, in the same pass, and leave the sums of the frame in
+// the read only measurements parameter as name=value pairs, like those
+// of pr0be: the sum and mean of the color differences, the largest one,
+// and the number of pixels changed by more than the threshold, in all
+// and per cell of a grid. Slices don't measure, they may run on several
+// threads of the host at once. With measure only, the first source passes
+// through to the output, as the video does in pr0be and sc0pe.
+class difference : public frei0r::blend_mixer<difference_op>
 {
 public:
   difference(unsigned int width, unsigned int height)
   {
+    measure = false;
+    threshold = 0.1;
+    grid = 0.0;
+    measure_only = false;
+    register_param(measure, "measure", "also measure how much the sources differ, see measurements");
+    register_param(threshold, "threshold", "difference of a color channel above which a pixel counts as changed");
+    register_param(grid, "grid", "also count the changed pixels in a grid of 1x1 (off) to 8x8 cells");
+    register_param(measure_only, "measure only", "only measure, pass the first source through");
+    register_param(measurements, "measurements", "read only, statistics of the last frame as name=value pairs");
+  }
+
+  virtual void update(double time, uint32_t* out,
+                      const uint32_t* in1, const uint32_t* in2)
+  {
+    const int stride = static_cast<int>(width * sizeof(uint32_t));
+    if (!measure && !measure_only)
+      mixer2::update(time, out, in1, in2);
+    else
+      {
+        measure_frame(measure_only ? 0 : out, stride,
+                      in1, stride, in2, stride);
+        if (measure_only)
+          pass_through(out, stride, in1, stride);
+      }
+  }
+
+  virtual bool update_stride(double time, uint32_t* out, int out_stride,
+                             const uint32_t* in1, int in1_stride,
+                             const uint32_t* in2, int in2_stride)
+  {
+    if (!measure && !measure_only)
+      return mixer2::update_stride(time, out, out_stride,
+                                   in1, in1_stride, in2, in2_stride);
+    (void)time; // unused
+    measure_frame(measure_only ? 0 : out, out_stride,
+                  in1, in1_stride, in2, in2_stride);
+    if (measure_only)
+      pass_through(out, out_stride, in1, in1_stride);
+    return true;
+  }
+
+  virtual bool update_slice(double time, uint32_t* out,
+                            const uint32_t* in1, const uint32_t* in2,
+                            unsigned int row_begin, unsigned int row_end)
+  {
+    if (!measure_only)
+      return blend_mixer<difference_op>::update_slice(time, out, in1, in2,
+                                                      row_begin, row_end);
+    const unsigned int offset = width * row_begin;
+    if (out != in1)
+      std::memcpy(out + offset, in1 + offset,
+                  width * (row_end - row_begin) * sizeof(uint32_t));
+    return true;
   }
 
-  /**
-   *
-   * Perform an RGB[A] difference operation between the pixel sources
-   * in1 and in2.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+private:
+  enum { MAX_GRID = 8 };
+
+  // the rows [y0, y1) of a frame, with the sums of each grid cell
+  struct band
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b;
-    int diff;
-  
-    while (sizeCounter--)
+    const difference* self;
+    uint32_t* out;
+    const uint32_t* in1;
+    const uint32_t* in2;
+    int out_stride, in1_stride, in2_stride;
+    unsigned int y0, y1, cells;
+    unsigned int t;
+    frei0r_simd_diff_stats_t st[MAX_GRID * MAX_GRID];
+  };
+
+  static void* measure_band(void* arg)
+  {
+    band* b = static_cast<band*>(arg);
+    const unsigned int w = b->self->width, h = b->self->height;
+    const unsigned int n = b->cells;
+    unsigned int j = b->y0 * n / h;
+
+    for (unsigned int y = b->y0; y < b->y1; ++y)
       {
-        for (b = 0; b < ALPHA; b++)
+        while (y >= h * (j + 1) / n)
+          ++j;
+        uint32_t* out = b->out ? frei0r::frame_row(b->out, b->out_stride, y)
+                               : 0;
+        const uint32_t* in1 = frei0r::frame_row(b->in1, b->in1_stride, y);
+        const uint32_t* in2 = frei0r::frame_row(b->in2, b->in2_stride, y);
+        for (unsigned int i = 0; i < n; ++i)
           {
-            diff = src1[b] - src2[b];
-            dst[b] = (diff < 0) ? -diff : diff;
+            const unsigned int x0 = w * i / n, x1 = w * (i + 1) / n;
+            frei0r_simd_difference_stats(out ? out + x0 : 0,
+                                         in1 + x0, in2 + x0, x1 - x0,
+                                         b->t, &b->st[j * n + i]);
           }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
       }
+    return 0;
+  }
+
+  // after the measuring, since out may be in2
+  void pass_through(uint32_t* out, int out_stride,
+                    const uint32_t* in1, int in1_stride)
+  {
+    if (out == in1)
+      return;
+    for (unsigned int y = 0; y < height; ++y)
+      std::memcpy(frei0r::frame_row(out, out_stride, y),
+                  frei0r::frame_row(in1, in1_stride, y),
+                  width * sizeof(uint32_t));
+  }
+
+  void measure_frame(uint32_t* out, int out_stride,
+                     const uint32_t* in1, int in1_stride,
+                     const uint32_t* in2, int in2_stride)
+  {
+    band bands[FREI0R_MAX_THREADS];
+    // cells of at least a pixel
+    const unsigned int n = std::max(1u, std::min(
+      std::min(width, height), static_cast<unsigned int>(
+        std::min(std::max(1.0 + grid * 7.9999, 1.0),
+                 static_cast<double>(MAX_GRID)))));
+    const double t = std::min(std::max(threshold, 0.0), 1.0);
+    const int k = frei0r_thread_count(size);
+
+    for (int i = 0; i < k; ++i)
+      {
+        band& b = bands[i];
+        b.self = this;
+        b.out = out;
+        b.in1 = in1;
+        b.in2 = in2;
+        b.out_stride = out_stride;
+        b.in1_stride = in1_stride;
+        b.in2_stride = in2_stride;
+        b.y0 = height * i / k;
+        b.y1 = height * (i + 1) / k;
+        b.cells = n;
+        b.t = static_cast<unsigned int>(t * 255.0 + 0.5);
+        std::memset(b.st, 0, sizeof(b.st));
+      }
+    if (height)
+      frei0r_thread_run(measure_band, bands, sizeof(band), k);
+
+    frei0r_simd_diff_stats_t all = { 0, 0, 0 };
+    uint32_t changed[MAX_GRID * MAX_GRID] = { 0 };
+    for (int i = 0; i < k; ++i)
+      for (unsigned int c = 0; c < n * n; ++c)
+        {
+          const frei0r_simd_diff_stats_t& st = bands[i].st[c];
+          all.sad += st.sad;
+          all.max = std::max(all.max, st.max);
+          all.changed += st.changed;
+          changed[c] += st.changed;
+        }
+
+    char text[64 + MAX_GRID * MAX_GRID * 20];
+    int l = std::snprintf(text, sizeof(text),
+                          "sad=%llu mean=%.4f max=%u changed=%u"
+                          " changed.part=%.4f",
+                          static_cast<unsigned long long>(all.sad),
+                          size ? all.sad / (765.0 * size) : 0.0,
+                          static_cast<unsigned int>(all.max),
+                          static_cast<unsigned int>(all.changed),
+                          size ? static_cast<double>(all.changed) / size
+                               : 0.0);
+    if (n > 1)
+      {
+        l += std::snprintf(text + l, sizeof(text) - l, " grid=%ux%u", n, n);
+        for (unsigned int c = 0; c < n * n; ++c)
+          l += std::snprintf(text + l, sizeof(text) - l, " c%u.%u=%u",
+                             c / n, c % n,
+                             static_cast<unsigned int>(changed[c]));
+      }
+    measurements = text;
   }
-    
+
+  bool measure;
+  double threshold;
+  double grid;
+  bool measure_only;
+  std::string measurements;
 };
 
 
 frei0r::construct<difference> plugin("difference",
                                      "Perform an RGB[A] difference operation between the pixel sources.",
                                      "Jean-Sebastien Senecal",
-                                     0,2,
-                                     F0R_COLOR_MODEL_RGBA8888);
-
+                                     0,3,
+                                     F0R_COLOR_MODEL_RGBA8888,
+                                     F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
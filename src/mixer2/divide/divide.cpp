@@ -21,52 +21,27 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class divide : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] divide operation between the pixel sources in1
+ * and in2.  in1 is the numerator, in2 the denominator.
+ *
+ **/
+struct divide_op : frei0r::blend_op<divide_op>
 {
-public:
-  divide(unsigned int width, unsigned int height)
+  static uint8_t channel(int a, int b)
   {
+    uint32_t result = ((a * 256) / (1 + b));
+    return MIN(result, 255u);
   }
+};
 
-  /**
-   *
-   * Perform an RGB[A] divide operation between the pixel sources in1
-   * and in2.  in1 is the numerator, in2 the denominator.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class divide : public frei0r::blend_mixer<divide_op>
+{
+public:
+  divide(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, result;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            result = ((src1[b] * 256) / (1 + src2[b]));
-            dst[b] = MIN(result, 255u);
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-  
-    
 };
 
 
@@ -74,5 +49,6 @@ frei0r::construct<divide> plugin("divide",
                                  "Perform an RGB[A] divide operation between the pixel sources: input1 is the numerator, input2 the denominator",
                                  "Jean-Sebastien Senecal",
                                  0,2,
-                                 F0R_COLOR_MODEL_RGBA8888);
+                                 F0R_COLOR_MODEL_RGBA8888,
+                                 F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
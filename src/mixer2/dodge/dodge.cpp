@@ -21,59 +21,40 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class dodge : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] dodge operation between the pixel sources
+ * in1 and in2, using the generalised algorithm:
+ *
+ * D = saturation of 255 or (A * 256) / (256 - B)
+ *
+ **/
+struct dodge_op : frei0r::blend_op<dodge_op>
 {
-public:
-  dodge(unsigned int width, unsigned int height)
+  static uint8_t channel(int a, int b)
   {
+    uint32_t tmp;
+
+    tmp = a << 8;
+    tmp /= 256 - b;
+    return MAX255(tmp);
   }
+};
 
-  /**
-   *
-   * Perform an RGB[A] dodge operation between the pixel sources
-   * in1 and in2, using the generalised algorithm:
-   *
-   * D = saturation of 255 or (A * 256) / (256 - B)
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class dodge : public frei0r::blend_mixer<dodge_op>
+{
+public:
+  dodge(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, tmp;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            tmp = src1[b] << 8;
-            tmp /= 256 - src2[b];
-            dst[b] = MAX255(tmp);
-          }
-  
-        dst[ALPHA] = MIN (src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-
 };
 
+
 frei0r::construct<dodge> plugin("dodge",
                                 "Perform an RGB[A] dodge operation between the pixel sources, using the generalised algorithm:\n"
                                 "D = saturation of 255 or (A * 256) / (256 - B)",
                                 "Jean-Sebastien Senecal",
                                 0,2,
-                                F0R_COLOR_MODEL_RGBA8888);
+                                F0R_COLOR_MODEL_RGBA8888,
+                                F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -21,53 +21,27 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class grain_extract : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] grain-extract operation between the pixel sources
+ * in1 and in2.
+ *
+ **/
+struct grain_extract_op : frei0r::blend_op<grain_extract_op>
 {
-public:
-  grain_extract(unsigned int width, unsigned int height)
+  static uint8_t channel(int a, int b)
   {
+    int diff = a - b + 128;
+    return CLAMP0255(diff);
   }
+};
 
-  /**
-   *
-   * Perform an RGB[A] grain-extract operation between the pixel sources
-   * in1 and in2.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class grain_extract : public frei0r::blend_mixer<grain_extract_op>
+{
+public:
+  grain_extract(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b;
-    int diff;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            diff = src1[b] - src2[b] + 128;
-            dst[b] = (uint8_t) CLAMP0255(diff);
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-  
-    
 };
 
 
@@ -75,5 +49,6 @@ frei0r::construct<grain_extract> plugin("grain_extract",
                                         "Perform an RGB[A] grain-extract operation between the pixel sources.",
                                         "Jean-Sebastien Senecal",
                                         0,2,
-                                        F0R_COLOR_MODEL_RGBA8888);
+                                        F0R_COLOR_MODEL_RGBA8888,
+                                        F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
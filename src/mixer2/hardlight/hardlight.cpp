@@ -21,60 +21,34 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class hardlight : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] hardlight operation between the pixel sources
+ * in1 and in2.
+ *
+ **/
+struct hardlight_op : frei0r::blend_op<hardlight_op>
 {
-public:
-  hardlight(unsigned int width, unsigned int height)
+  static uint8_t channel(int a, int b)
   {
-  }
+    uint32_t tmp;
 
-  /**
-   *
-   * Perform an RGB[A] hardlight operation between the pixel sources
-   * in1 and in2.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
-  {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, tmp;
-  
-    while (sizeCounter--)
+    if (b > 128)
       {
-        for (b = 0; b < ALPHA; b++)
-          {
-            if (src2[b] > 128)
-              {
-                tmp = ((int) 255 - src1[b]) * ((int) 255 - ((src2[b] - 128) << 1));
-                dst[b] = (uint8_t) MAX255 (255 - (tmp >> 8));
-              }
-            else
-              {
-                tmp = (int) src1[b] * ((int) src2[b] << 1);
-                dst[b] = (uint8_t) MAX255 (tmp >> 8);
-              }
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
+        tmp = ((int) 255 - a) * ((int) 255 - ((b - 128) << 1));
+        return MAX255 (255 - (tmp >> 8));
       }
+    tmp = (int) a * ((int) b << 1);
+    return MAX255 (tmp >> 8);
+  }
+};
+
+class hardlight : public frei0r::blend_mixer<hardlight_op>
+{
+public:
+  hardlight(unsigned int width, unsigned int height)
+  {
   }
-  
-  
-    
 };
 
 
@@ -82,5 +56,6 @@ frei0r::construct<hardlight> plugin("hardlight",
                                     "Perform an RGB[A] hardlight operation between the pixel sources",
                                     "Jean-Sebastien Senecal",
                                     0,2,
-                                    F0R_COLOR_MODEL_RGBA8888);
+                                    F0R_COLOR_MODEL_RGBA8888,
+                                    F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
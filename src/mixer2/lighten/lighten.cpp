@@ -19,60 +19,37 @@
  */
 
 #include "frei0r.hpp"
-#include "frei0r_math.h"
+#include "frei0r_simd.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class lighten : public frei0r::mixer2
+/**
+ *
+ * Perform a lighten operation between sources in1 and in2, using the
+ * generalised algorithm:
+ * D_r = max(A_r, B_r);
+ * D_g = max(A_g, B_g);
+ * D_b = max(A_b, B_b);
+ * D_a = min(A_a, B_a);
+ *
+ **/
+struct lighten_op : frei0r::blend_op<lighten_op>
 {
-public:
-  lighten(unsigned int width, unsigned int height)
+  static void init()
+  {
+  }
+
+  static void row(uint32_t* dst, const uint32_t* src1,
+                  const uint32_t* src2, unsigned int n)
   {
+    frei0r_simd_lighten(dst, src1, src2, n);
   }
+};
 
-  /**
-   *
-   * Perform a lighten operation between sources in1 and in2, using the
-   * generalised algorithm:
-   * D_r = max(A_r, B_r);
-   * D_g = max(A_g, B_g);
-   * D_b = max(A_b, B_b);
-   * D_a = min(A_a, B_a);
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class lighten : public frei0r::blend_mixer<lighten_op>
+{
+public:
+  lighten(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b;
-    uint8_t s1, s2;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            s1 = src1[b];
-            s2 = src2[b];
-            dst[b] = MAX(s1,s2);
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-  
-    
 };
 
 
@@ -80,5 +57,6 @@ frei0r::construct<lighten> plugin("lighten",
                                   "Perform a lighten operation between two sources (maximum value of both sources).",
                                   "Jean-Sebastien Senecal",
                                   0,2,
-                                  F0R_COLOR_MODEL_RGBA8888);
+                                  F0R_COLOR_MODEL_RGBA8888,
+                                  F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -19,51 +19,33 @@
  */
 
 #include "frei0r.hpp"
-#include "frei0r_math.h"
+#include "frei0r_simd.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class multiply : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] multiply operation between the pixel sources
+ * in1 and in2.
+ *
+ **/
+struct multiply_op : frei0r::blend_op<multiply_op>
 {
-public:
-  multiply(unsigned int width, unsigned int height)
+  static void init()
   {
   }
 
-  /**
-   *
-   * Perform an RGB[A] multiply operation between the pixel sources
-   * in1 and in2.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  static void row(uint32_t* dst, const uint32_t* src1,
+                  const uint32_t* src2, unsigned int n)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, tmp;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          dst[b] = INT_MULT(src1[b], src2[b], tmp);
-
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
+    frei0r_simd_multiply(dst, src1, src2, n);
+  }
+};
 
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
+class multiply : public frei0r::blend_mixer<multiply_op>
+{
+public:
+  multiply(unsigned int width, unsigned int height)
+  {
   }
-  
-  
-    
 };
 
 
@@ -71,5 +53,6 @@ frei0r::construct<multiply> plugin("multiply",
                                    "Perform an RGB[A] multiply operation between the pixel sources.",
                                    "Jean-Sebastien Senecal",
                                    0,2,
-                                   F0R_COLOR_MODEL_RGBA8888);
+                                   F0R_COLOR_MODEL_RGBA8888,
+                                   F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -21,53 +21,29 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class overlay : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] overlay operation between the pixel sources
+ * in1 and in2, using the generalised algorithm:
+ *
+ * D =  A * (B + (2 * B) * (255 - A))
+ *
+ **/
+struct overlay_op : frei0r::blend_op<overlay_op>
 {
-public:
-  overlay(unsigned int width, unsigned int height)
+  static uint8_t channel(int a, int b)
   {
+    uint32_t tmp, tmpM;
+    return INT_MULT(a, a + INT_MULT(2 * b, 255 - a, tmpM), tmp);
   }
+};
 
-  /**
-   *
-   * Perform an RGB[A] overlay operation between the pixel sources
-   * in1 and in2, using the generalised algorithm:
-   *
-   * D =  A * (B + (2 * B) * (255 - A))
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class overlay : public frei0r::blend_mixer<overlay_op>
+{
+public:
+  overlay(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, tmp, tmpM;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            dst[b] = INT_MULT(src1[b], src1[b] + INT_MULT(2 * src2[b], 255 - src1[b], tmpM), tmp);
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-  
-    
 };
 
 
@@ -76,5 +52,6 @@ frei0r::construct<overlay> plugin("overlay",
 								  "D =  A * (B + (2 * B) * (255 - A))",
                                   "Jean-Sebastien Senecal",
                                   0,2,
-                                  F0R_COLOR_MODEL_RGBA8888);
+                                  F0R_COLOR_MODEL_RGBA8888,
+                                  F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -19,53 +19,35 @@
  */
 
 #include "frei0r.hpp"
-#include "frei0r_math.h"
+#include "frei0r_simd.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class screen : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] screen operation between the pixel sources
+ * in1 and in2, using the generalised algorithm:
+ *
+ * D = 255 - (255 - A) * (255 - B)
+ *
+ **/
+struct screen_op : frei0r::blend_op<screen_op>
 {
-public:
-  screen(unsigned int width, unsigned int height)
+  static void init()
   {
   }
 
-  /**
-   *
-   * Perform an RGB[A] screen operation between the pixel sources
-   * in1 and in2, using the generalised algorithm:
-   *
-   * D = 255 - (255 - A) * (255 - B)
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  static void row(uint32_t* dst, const uint32_t* src1,
+                  const uint32_t* src2, unsigned int n)
+  {
+    frei0r_simd_screen(dst, src1, src2, n);
+  }
+};
+
+class screen : public frei0r::blend_mixer<screen_op>
+{
+public:
+  screen(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, tmp;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          dst[b] = 255 - INT_MULT((255 - src1[b]), (255 - src2[b]), tmp);
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-  
-    
 };
 
 
@@ -74,5 +56,6 @@ frei0r::construct<screen> plugin("screen",
 								 "D = 255 - (255 - A) * (255 - B)",
                                  "Jean-Sebastien Senecal",
                                  0,2,
-                                 F0R_COLOR_MODEL_RGBA8888);
+                                 F0R_COLOR_MODEL_RGBA8888,
+                                 F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
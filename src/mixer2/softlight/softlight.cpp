@@ -21,53 +21,31 @@
 #include "frei0r.hpp"
 #include "frei0r_math.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class softlight : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] softlight operation between the pixel sources
+ * in1 and in2.
+ *
+ **/
+struct softlight_op : frei0r::blend_op<softlight_op>
 {
-public:
-  softlight(unsigned int width, unsigned int height)
+  static uint8_t channel(int a, int b)
   {
+    uint32_t tmpS, tmpM, tmp1, tmp2, tmp3;
+
+    /* Mix multiply and screen */
+    tmpM = INT_MULT(a, b, tmpM);
+    tmpS = 255 - INT_MULT((255 - a), (255 - b), tmp1);
+    return INT_MULT((255 - a), tmpM, tmp2) + INT_MULT(a, tmpS, tmp3);
   }
+};
 
-  /**
-   *
-   * Perform an RGB[A] softlight operation between the pixel sources
-   * in1 and in2.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class softlight : public frei0r::blend_mixer<softlight_op>
+{
+public:
+  softlight(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b, tmpS, tmpM, tmp1, tmp2, tmp3;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            /* Mix multiply and screen */
-            tmpM = INT_MULT(src1[b], src2[b], tmpM);
-            tmpS = 255 - INT_MULT((255 - src1[b]), (255 - src2[b]), tmp1);
-            dst[b] = INT_MULT((255 - src1[b]), tmpM, tmp2) + INT_MULT(src1[b], tmpS, tmp3);
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-    
 };
 
 
@@ -75,5 +53,6 @@ frei0r::construct<softlight> plugin("softlight",
                                     "Perform an RGB[A] softlight operation between the pixel sources.",
                                     "Jean-Sebastien Senecal",
                                     0,2,
-                                    F0R_COLOR_MODEL_RGBA8888);
+                                    F0R_COLOR_MODEL_RGBA8888,
+                                    F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -19,55 +19,33 @@
  */
 
 #include "frei0r.hpp"
-#include "frei0r_math.h"
+#include "frei0r_simd.h"
 
-#define NBYTES 4
-#define ALPHA 3
-
-class subtract : public frei0r::mixer2
+/**
+ *
+ * Perform an RGB[A] subtract operation of the pixel source
+ * ctx-B from in1.
+ *
+ **/
+struct subtract_op : frei0r::blend_op<subtract_op>
 {
-public:
-  subtract(unsigned int width, unsigned int height)
+  static void init()
+  {
+  }
+
+  static void row(uint32_t* dst, const uint32_t* src1,
+                  const uint32_t* src2, unsigned int n)
   {
+    frei0r_simd_subtract(dst, src1, src2, n);
   }
+};
 
-  /**
-   *
-   * Perform an RGB[A] subtract operation of the pixel source
-   * ctx-B from in1.
-   *
-   **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+class subtract : public frei0r::blend_mixer<subtract_op>
+{
+public:
+  subtract(unsigned int width, unsigned int height)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-            
-    uint32_t b;
-    int diff;
-  
-    while (sizeCounter--)
-      {
-        for (b = 0; b < ALPHA; b++)
-          {
-            diff = src1[b] - src2[b];
-            dst[b] = MAX(diff, 0);
-          }
-  
-        dst[ALPHA] = MIN(src1[ALPHA], src2[ALPHA]);
-  
-        src1 += NBYTES;
-        src2 += NBYTES;
-        dst += NBYTES;
-      }
   }
-  
-  
-    
 };
 
 
@@ -75,5 +53,6 @@ frei0r::construct<subtract> plugin("subtract",
                                    "Perform an RGB[A] subtract operation of the pixel source input2 from input1.",
                                    "Jean-Sebastien Senecal",
                                    0,2,
-                                   F0R_COLOR_MODEL_RGBA8888);
+                                   F0R_COLOR_MODEL_RGBA8888,
+                                   F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
@@ -22,13 +22,40 @@
 #include <math.h>
 
 #include "frei0r.h"
+#include "frei0r_thread.h"
 
+#if defined(_MSC_VER)
+__inline const long int lrintf(float x){
+	return (long int)(x+0.5);
+}
+#endif /* _MSC_VER */
+
+/* The coordinates are bytes, so every value of R and G is decoded once
+ * into a column and a row offset of the source when the instance is made.
+ */
 typedef struct uvmap_instance
 {
   unsigned int width;
   unsigned int height;
+  int bilinear;
+  /* nearest: source column of R, offset of the source row of G */
+  unsigned int x[256];
+  unsigned int row[256];
+  /* bilinear: the two columns and rows around the position and the
+   * weight of the second one in 0..256 */
+  unsigned int x0[256], x1[256], fx[256];
+  unsigned int row0[256], row1[256], fy[256];
 } uvmap_instance_t;
 
+typedef struct uvmap_job
+{
+  f0r_instance_t instance;
+  const uint32_t* uvmap;
+  const uint32_t* src;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} uvmap_job_t;
+
 int f0r_init()
 {
   return 1;
@@ -45,20 +72,89 @@ void f0r_get_plugin_info(f0r_plugin_info_t* uvmapInfo)
   uvmapInfo->color_model = F0R_COLOR_MODEL_RGBA8888;
   uvmapInfo->frei0r_version = FREI0R_MAJOR_VERSION;
   uvmapInfo->major_version = 0; 
-  uvmapInfo->minor_version = 9; 
-  uvmapInfo->num_params =  0; 
+  uvmapInfo->minor_version = 10; 
+  uvmapInfo->num_params =  1; 
   uvmapInfo->explanation = "Uses Input 1 as UV Map to distort Input 2";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  /* not F0R_CAP_INPLACE: any pixel of inframe2 may be sampled after the
+     output of its position was written */
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
-  /* no params */
+  switch(param_index)
+  {
+  case 0:
+    info->name = "Bilinear";
+    info->type = F0R_PARAM_BOOL;
+    info->explanation = "Interpolate between the four nearest source pixels";
+    break;
+  }
+}
+
+/* position p in [0, size - 1] split into two neighbours and a weight */
+static void uvmap_split(float p, unsigned int size, unsigned int* p0,
+                        unsigned int* p1, unsigned int* f)
+{
+  unsigned int i;
+  long fr;
+
+  if (p < 0.0f)
+    p = 0.0f;
+  if (p > (float)(size - 1))
+    p = (float)(size - 1);
+  i = (unsigned int)p;
+  fr = lrintf((p - (float)i) * 256.0f);
+  if (fr >= 256)
+  {
+    ++i;
+    fr = 0;
+  }
+  *p0 = i;
+  *p1 = i + 1 < size ? i + 1 : i;
+  *f = (unsigned int)fr;
 }
 
 f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
 {
   uvmap_instance_t* inst = (uvmap_instance_t*)calloc(1, sizeof(*inst));
+  unsigned int c, y0, y1;
+  float fx, fy;
+  long px, py;
+
   inst->width = width; inst->height = height;
+  for (c = 0; c < 256; ++c)
+  {
+    /* The coordinates start in the lower left corner:
+     *
+     * ^ +-------------+
+     * | |             |
+     * G |             |
+     *  0+-------------+
+     *   0  R ->
+     *
+     * R = 255 and G = 0 round to one past the last column and row, those
+     * are clamped to the image.
+     */
+    fx = ((float)c) / 255.0;
+    fy = ((float)c) / 255.0;
+    fy = 1.0 - fy;
+
+    px = lrintf( width * fx );
+    py = lrintf( height * fy );
+    inst->x[c] = px < (long)width ? px : width - 1;
+    inst->row[c] = width * (py < (long)height ? py : height - 1);
+
+    uvmap_split(width * fx, width, &inst->x0[c], &inst->x1[c], &inst->fx[c]);
+    uvmap_split(height * fy, height, &y0, &y1, &inst->fy[c]);
+    inst->row0[c] = width * y0;
+    inst->row1[c] = width * y1;
+  }
   return (f0r_instance_t)inst;
 }
 
@@ -69,17 +165,103 @@ void f0r_destruct(f0r_instance_t instance)
 
 void f0r_set_param_value(f0r_instance_t instance, 
 			 f0r_param_t param, int param_index)
-{ /* no params */ }
+{
+  assert(instance);
+  uvmap_instance_t* inst = (uvmap_instance_t*)instance;
+
+  switch(param_index)
+  {
+  case 0:
+    inst->bilinear = (*((double*)param) >= 0.5);
+    break;
+  }
+}
 
 void f0r_get_param_value(f0r_instance_t instance,
 			 f0r_param_t param, int param_index)
-{ /* no params */ }
+{
+  assert(instance);
+  uvmap_instance_t* inst = (uvmap_instance_t*)instance;
 
-#if defined(_MSC_VER)
-__inline const long int lrintf(float x){
-	return (long int)(x+0.5);
+  switch(param_index)
+  {
+  case 0:
+    *((double*)param) = inst->bilinear ? 1.0 : 0.0;
+    break;
+  }
+}
+
+/* a + (b - a) * f / 256 for all four bytes, two bytes per multiply */
+static inline uint32_t uvmap_lerp(uint32_t a, uint32_t b, unsigned int f)
+{
+  unsigned int g = 256 - f;
+  uint32_t rb = ((a & 0xff00ff) * g + (b & 0xff00ff) * f + 0x800080) >> 8;
+  uint32_t ag = ((a >> 8) & 0xff00ff) * g + ((b >> 8) & 0xff00ff) * f
+    + 0x800080;
+  return (rb & 0xff00ff) | (ag & 0xff00ff00);
+}
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe1, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  uvmap_instance_t* inst = (uvmap_instance_t*)instance;
+  const uint32_t* uvmap = inframe1 + inst->width * row_begin;
+  const uint32_t* src = inframe2;
+  uint32_t* dst = outframe + inst->width * row_begin;
+  unsigned long i, n;
+
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  /* each map pixel is read before its output pixel is written, so the
+   * output may be the map */
+  n = (unsigned long)inst->width * (row_end - row_begin);
+  if (inst->bilinear)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      const unsigned char* tmpc = (const unsigned char*)(uvmap + i);
+      unsigned int r = tmpc[0], g = tmpc[1];
+      const uint32_t* s0;
+      const uint32_t* s1;
+
+      if (tmpc[2] <= 128)
+      {
+        dst[i] = 0x00000000;
+        continue;
+      }
+      s0 = src + inst->row0[g];
+      s1 = src + inst->row1[g];
+      dst[i] = uvmap_lerp(uvmap_lerp(s0[inst->x0[r]], s0[inst->x1[r]],
+                                     inst->fx[r]),
+                          uvmap_lerp(s1[inst->x0[r]], s1[inst->x1[r]],
+                                     inst->fx[r]),
+                          inst->fy[g]);
+    }
+  }
+  else
+  {
+    for (i = 0; i < n; ++i)
+    {
+      const unsigned char* tmpc = (const unsigned char*)(uvmap + i);
+      dst[i] = tmpc[2] > 128 ? src[inst->x[tmpc[0]] + inst->row[tmpc[1]]]
+                             : 0x00000000;
+    }
+  }
+  return 1;
+}
+
+static void* uvmap_rows(void* arg)
+{
+  uvmap_job_t* job = (uvmap_job_t*)arg;
+  f0r_update_slice(job->instance, 0.0, job->uvmap, job->src, 0,
+                   job->outframe, job->row_begin, job->row_end, 0);
+  return 0;
 }
-#endif /* _MSC_VER */
 
 void f0r_update2(f0r_instance_t instance,
 		 double time,
@@ -88,42 +270,19 @@ void f0r_update2(f0r_instance_t instance,
 		 const uint32_t* inframe3,
 		 uint32_t* outframe)
 {
-	assert(instance);
-	uvmap_instance_t* inst = (uvmap_instance_t*)instance;
-	unsigned int w = inst->width;
-	unsigned int h = inst->height;
-	unsigned int x,y;
-
-	uint32_t* dst = outframe;
-	const uint32_t* uvmap = inframe1;
-	const uint32_t* src = inframe2;
-	float fx, fy;
-	long px, py;
-	for( y = 0; y < h; ++y )
-		for( x = 0; x < w; ++x ) {
-			/* The coordinates start in the lower left corner:
-			 *
-			 * ^ +-------------+
-			 * | |             |
-			 * G |             |
-			 *  0+-------------+
-			 *   0  R ->
-			 *
-			 */
-			unsigned char* tmpc = (unsigned char*)uvmap;
-			fx = ((float)tmpc[0]) / 255.0;
-			fy = ((float)tmpc[1]) / 255.0;
-			fy = 1.0 - fy;
-
-			px = lrintf( w * fx );
-			py = lrintf( h * fy );
-			if ( tmpc[2] > 128 ) {
-				*dst++ = src[px+w*py];
-			} else {
-				*dst++ = 0x00000000;
-			}
-			uvmap++;
-		}
-}
-
+  assert(instance);
+  uvmap_instance_t* inst = (uvmap_instance_t*)instance;
+  uvmap_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
 
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].instance = instance;
+    jobs[i].uvmap = inframe1;
+    jobs[i].src = inframe2;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(uvmap_rows, jobs, sizeof(uvmap_job_t), n);
+}
@@ -22,13 +22,12 @@
 #include "frei0r_math.h"
 #include "frei0r_colorspace.h"
 
-#define NBYTES 4
-
 class value : public frei0r::mixer2
 {
 public:
   value(unsigned int width, unsigned int height)
   {
+    pointwise = true;
   }
 
   /**
@@ -37,46 +36,19 @@ public:
    * the value of in2.
    *
    **/
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  bool update_slice(double time,
+                    uint32_t* out,
+                    const uint32_t* in1,
+                    const uint32_t* in2,
+                    unsigned int row_begin,
+                    unsigned int row_end)
   {
-    const uint8_t *src1 = reinterpret_cast<const uint8_t*>(in1);
-    const uint8_t *src2 = reinterpret_cast<const uint8_t*>(in2);
-    uint8_t *dst = reinterpret_cast<uint8_t*>(out);
-    uint32_t sizeCounter = size;
-    int r1, g1, b1;
-    int r2, g2, b2;
-  
-      /*  assumes inputs are only 4 byte RGBA pixels  */
-      /*  assumes inputs are only 4 byte RGBA pixels  */
-      while (sizeCounter--)
-        {
-          r1 = src1[0];
-          g1 = src1[1];
-          b1 = src1[2];
-          r2 = src2[0];
-          g2 = src2[1];
-          b2 = src2[2];
-          rgb_to_hsv_int(&r1, &g1, &b1);
-          rgb_to_hsv_int(&r2, &g2, &b2);
-  
-          b1 = b2;
-  
-          /*  set the dstination  */
-          hsv_to_rgb_int(&r1, &g1, &b1);
-  
-          dst[0] = r1;
-          dst[1] = g1;
-          dst[2] = b1;
-  
-          dst[3] = MIN(src1[3], src2[3]);
-  
-          src1 += NBYTES;
-          src2 += NBYTES;
-          dst += NBYTES;
-        }
+    frei0r_cs_mix_row(reinterpret_cast<const uint8_t*>(in1 + width*row_begin),
+                      reinterpret_cast<const uint8_t*>(in2 + width*row_begin),
+                      reinterpret_cast<uint8_t*>(out + width*row_begin),
+                      width * (row_end - row_begin),
+                      FREI0R_CS_VALUE);
+    return true;
   }  
   
     
@@ -87,5 +59,6 @@ frei0r::construct<value> plugin("value",
                                 "Perform a conversion to value only of the source input1 using the value of input2.",
                                 "Jean-Sebastien Senecal",
                                 0,2,
-                                F0R_COLOR_MODEL_RGBA8888);
+                                F0R_COLOR_MODEL_RGBA8888,
+                                F0R_CAP_INPLACE);
 
@@ -1,4 +1,6 @@
 #include "frei0r.hpp"
+#include "frei0r_simd.h"
+#include "frei0r_transition.h"
 
 #include <algorithm>
 
@@ -7,44 +9,53 @@ class xfade0r : public frei0r::mixer2
 public:
   xfade0r(unsigned int width, unsigned int height)
   {
+    pointwise = true;
     fader = 0.0;
     register_param(fader,"fader","the fader position");
+    start = 0.0;
+    duration = 0.0;
+    curve = "linear";
+    register_param(start,"start","time in seconds at which the fader starts to move from 0");
+    register_param(duration,"duration","seconds until the fader reaches 1, 0 uses the fader parameter");
+    register_param(curve,"curve","shape of the transition: linear, smooth, ease-in or ease-out");
+    on_params_changed();
   }
 
-  struct fade_fun
+  virtual void on_params_changed()
   {
-    fade_fun(double pos)
-    {
-      fader_pos=uint8_t(std::max(0.,std::min(255.,pos*255.)));
-    }
-
-    uint8_t operator()(uint8_t in1,uint8_t in2)
-    {
-      return ((255-fader_pos)*in1 + fader_pos*in2) / 256;
-    }
-    
-    uint8_t fader_pos;
-  };
+    curve_index = frei0r_transition_curve(curve.c_str());
+  }
   
-  void update(double time,
-              uint32_t* out,
-              const uint32_t* in1,
-              const uint32_t* in2)
+  bool update_slice(double time,
+                    uint32_t* out,
+                    const uint32_t* in1,
+                    const uint32_t* in2,
+                    unsigned int row_begin,
+                    unsigned int row_end)
   {
-    std::transform(reinterpret_cast<const uint8_t*>(in1),
-		   reinterpret_cast<const uint8_t*>(in1)+(width*height*4),
-		   reinterpret_cast<const uint8_t*>(in2),
-		   reinterpret_cast<uint8_t*>(out),
-		   fade_fun(fader));
+    const double pos = duration > 0.0
+      ? frei0r_transition_position(time, start, duration, curve_index)
+      : fader;
+    const uint8_t fader_pos = uint8_t(std::max(0.,std::min(255.,pos*255.)));
+    frei0r_simd_lerp(out+width*row_begin, in1+width*row_begin,
+                     in2+width*row_begin, width*(row_end-row_begin),
+                     fader_pos);
+    return true;
   }
   
 private:
   double fader;
+  double start;
+  double duration;
+  std::string curve;
+  frei0r_transition_curve_t curve_index;
 };
 
 
 frei0r::construct<xfade0r> plugin("xfade0r",
 				  "a simple xfader",
 				  "Martin Bayer",
-				  0,2);
+				  0,3,
+				  F0R_COLOR_MODEL_BGRA8888,
+				  F0R_CAP_INPLACE | F0R_CAP_RB_SYMMETRIC);
 
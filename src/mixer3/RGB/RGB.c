@@ -20,7 +20,12 @@
 #include <stdlib.h>
 #include <assert.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "frei0r.h"
+#include "frei0r_thread.h"
 
 typedef struct RGB_instance
 {
@@ -28,6 +33,16 @@ typedef struct RGB_instance
   unsigned int height;
 } RGB_instance_t;
 
+typedef struct RGB_job
+{
+  f0r_instance_t instance;
+  const uint32_t* inframe1;
+  const uint32_t* inframe2;
+  const uint32_t* inframe3;
+  uint32_t* outframe;
+  unsigned int row_begin, row_end;
+} RGB_job_t;
+
 int f0r_init()
 {
   return 1;
@@ -49,6 +64,12 @@ void f0r_get_plugin_info(f0r_plugin_info_t* RGBInfo)
   RGBInfo->explanation = "Averages each Input and uses each as R, G or B channel of the Output";
 }
 
+void f0r_get_plugin_info2(f0r_plugin_info2_t* info)
+{
+  f0r_get_plugin_info(&info->info);
+  info->capabilities = F0R_CAP_REENTRANT | F0R_CAP_INPLACE | F0R_CAP_SLICE;
+}
+
 void f0r_get_param_info(f0r_param_info_t* info, int param_index)
 {
   /* no params */
@@ -74,6 +95,89 @@ void f0r_get_param_value(f0r_instance_t instance,
 			 f0r_param_t param, int param_index)
 { /* no params */ }
 
+#if defined(__SSE2__)
+
+/* (c0 + c1 + c2) / 3 of the 8 pixels in p0 and p1, in 16 bit lanes */
+static inline __m128i RGB_average(__m128i p0, __m128i p1)
+{
+  const __m128i mask = _mm_set1_epi32(0xff);
+  __m128i s0 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p0, mask),
+                              _mm_and_si128(_mm_srli_epi32(p0, 8), mask)),
+                             _mm_and_si128(_mm_srli_epi32(p0, 16), mask));
+  __m128i s1 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p1, mask),
+                              _mm_and_si128(_mm_srli_epi32(p1, 8), mask)),
+                             _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+  /* x / 3 = (x * 0xaaab) >> 17 for all 16 bit x */
+  return _mm_srli_epi16(_mm_mulhi_epu16(_mm_packs_epi32(s0, s1),
+                                        _mm_set1_epi16((short)0xaaab)), 1);
+}
+
+#endif
+
+/* dst may be the same buffer as any of the sources */
+static void RGB_row(uint32_t* dst, const uint32_t* src1,
+                    const uint32_t* src2, const uint32_t* src3,
+                    unsigned long n)
+{
+  unsigned long i = 0;
+
+#if defined(__SSE2__)
+  const __m128i alpha = _mm_set1_epi16((short)0xff00);
+  __m128i c1, c2, c3, lo, hi;
+
+  for (; i + 8 <= n; i += 8)
+  {
+    c1 = RGB_average(_mm_loadu_si128((const __m128i*)(src1 + i)),
+                     _mm_loadu_si128((const __m128i*)(src1 + i + 4)));
+    c2 = RGB_average(_mm_loadu_si128((const __m128i*)(src2 + i)),
+                     _mm_loadu_si128((const __m128i*)(src2 + i + 4)));
+    c3 = RGB_average(_mm_loadu_si128((const __m128i*)(src3 + i)),
+                     _mm_loadu_si128((const __m128i*)(src3 + i + 4)));
+    lo = _mm_or_si128(c1, _mm_slli_epi16(c2, 8));
+    hi = _mm_or_si128(c3, alpha);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(lo, hi));
+    _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(lo, hi));
+  }
+#endif
+
+  for (; i < n; ++i)
+  {
+    const unsigned char* tmpc1 = (const unsigned char*)(src1 + i);
+    const unsigned char* tmpc2 = (const unsigned char*)(src2 + i);
+    const unsigned char* tmpc3 = (const unsigned char*)(src3 + i);
+    uint32_t tmpbw1 = (tmpc1[0] + tmpc1[1] + tmpc1[2]) / 3;
+    uint32_t tmpbw2 = (tmpc2[0] + tmpc2[1] + tmpc2[2]) / 3;
+    uint32_t tmpbw3 = (tmpc3[0] + tmpc3[1] + tmpc3[2]) / 3;
+
+    dst[i] = ( 0xff000000 ) | (tmpbw3 << 16)| (tmpbw2 << 8)| (tmpbw1);
+  }
+}
+
+int f0r_update_slice(f0r_instance_t instance, double time,
+                     const uint32_t* inframe1, const uint32_t* inframe2,
+                     const uint32_t* inframe3, uint32_t* outframe,
+                     unsigned int row_begin, unsigned int row_end,
+                     unsigned int thread_index)
+{
+  assert(instance);
+  RGB_instance_t* inst = (RGB_instance_t*)instance;
+  const unsigned long offset = (unsigned long)inst->width * row_begin;
+  if (row_begin > row_end || row_end > inst->height)
+    return 0;
+
+  RGB_row(outframe + offset, inframe1 + offset, inframe2 + offset,
+          inframe3 + offset, (unsigned long)inst->width * (row_end - row_begin));
+  return 1;
+}
+
+static void* RGB_rows(void* arg)
+{
+  RGB_job_t* job = (RGB_job_t*)arg;
+  f0r_update_slice(job->instance, 0.0, job->inframe1, job->inframe2,
+                   job->inframe3, job->outframe, job->row_begin, job->row_end,
+                   0);
+  return 0;
+}
 
 void f0r_update2(f0r_instance_t instance,
 		 double time,
@@ -84,32 +188,18 @@ void f0r_update2(f0r_instance_t instance,
 {
   assert(instance);
   RGB_instance_t* inst = (RGB_instance_t*)instance;
-  unsigned int w = inst->width;
-  unsigned int h = inst->height;
-  unsigned int x,y;
-  
-  uint32_t* dst = outframe;
-  const uint32_t* src1 = inframe1;
-  const uint32_t* src2 = inframe2;
-  const uint32_t* src3 = inframe3;
-  for(y=0;y<h;++y)
-      for(x=0;x<w;++x) {
-	  int tmpbw1;
-	  int tmpbw2;
-	  int tmpbw3;
-	  unsigned char* tmpc1 = (unsigned char*)src1;
-	  unsigned char* tmpc2 = (unsigned char*)src2;
-	  unsigned char* tmpc3 = (unsigned char*)src3;
-	  tmpbw1 = (tmpc1[0] + tmpc1[1] + tmpc1[2]) / 3;
-	  tmpbw2 = (tmpc2[0] + tmpc2[1] + tmpc2[2]) / 3;
-	  tmpbw3 = (tmpc3[0] + tmpc3[1] + tmpc3[2]) / 3;
-
-	  *dst++ = ( 0xff000000 ) | (tmpbw3 << 16)| (tmpbw2 << 8)| (tmpbw1); 
-
-	  src1++;
-	  src2++;
-	  src3++;
-      }
+  RGB_job_t jobs[FREI0R_MAX_THREADS];
+  int i, n = frei0r_thread_count((long)inst->width * inst->height);
+
+  for (i = 0; i < n; ++i)
+  {
+    jobs[i].instance = instance;
+    jobs[i].inframe1 = inframe1;
+    jobs[i].inframe2 = inframe2;
+    jobs[i].inframe3 = inframe3;
+    jobs[i].outframe = outframe;
+    jobs[i].row_begin = inst->height * i / n;
+    jobs[i].row_end = inst->height * (i + 1) / n;
+  }
+  frei0r_thread_run(RGB_rows, jobs, sizeof(RGB_job_t), n);
 }
-
-
@@ -0,0 +1,252 @@
+/* layers.cpp
+ * Composites a stack of layers with per-layer blend mode and opacity
+ * This file is a Frei0r plugin.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "frei0r.hpp"
+#include "frei0r_math.h"
+#include "frei0r_simd.h"
+
+#include <cstring>
+#include <cstdio>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Layers above this count are composited with mode "normal" and full
+// opacity.
+#define LAYERS_MAX 16
+
+// Pixels per tile. All layers are composited into one tile of the output
+// while it is in the cache, so each frame is read once and the output is
+// written once, whatever the number of layers.
+#define LAYERS_TILE 512
+
+enum layer_mode
+{
+  MODE_NORMAL,
+  MODE_ADDITION,
+  MODE_SUBTRACT,
+  MODE_MULTIPLY,
+  MODE_SCREEN,
+  MODE_DARKEN,
+  MODE_LIGHTEN,
+  MODE_DIFFERENCE,
+  MODE_COUNT
+};
+
+static const char* const mode_names[MODE_COUNT] =
+{
+  "normal", "addition", "subtract", "multiply",
+  "screen", "darken", "lighten", "difference"
+};
+
+// (255 << 16) / a, so that k * 255 / a is (k * recip[a] + 0x8000) >> 16
+static uint32_t recip[256];
+
+class layers : public frei0r::mixern
+{
+public:
+  layers(unsigned int width, unsigned int height)
+  {
+    pointwise = true;
+    // the first instance is made by construct<> while loading the plugin
+    if (!recip[255])
+      for (unsigned int a = 1; a < 256; ++a)
+        recip[a] = ((255u << 16) + a / 2) / a;
+
+    for (int l = 0; l < LAYERS_MAX; ++l)
+      {
+        char name[32];
+        mode[l] = "normal";
+        opacity[l] = 1.0;
+        std::snprintf(name, sizeof(name), "layer%d_mode", l + 1);
+        register_param(mode[l], name,
+                       "blend mode of the layer: normal, addition, subtract, "
+                       "multiply, screen, darken, lighten or difference");
+        std::snprintf(name, sizeof(name), "layer%d_opacity", l + 1);
+        register_param(opacity[l], name, "opacity of the layer");
+      }
+    on_params_changed();
+  }
+
+  virtual void on_params_changed()
+  {
+    for (int l = 0; l < LAYERS_MAX; ++l)
+      {
+        mode_index[l] = MODE_NORMAL;
+        for (int m = 0; m < MODE_COUNT; ++m)
+          if (mode[l] == mode_names[m])
+            mode_index[l] = m;
+        alpha[l] = static_cast<uint8_t>(CLAMP(opacity[l], 0.0, 1.0) * 255.0
+                                        + 0.5);
+      }
+  }
+
+  virtual bool update_layers(double time,
+                             uint32_t* out,
+                             const uint32_t* const* in,
+                             unsigned int count,
+                             unsigned int row_begin,
+                             unsigned int row_end)
+  {
+    (void)time; // unused
+    const unsigned int end = width * row_end;
+    uint32_t blended[LAYERS_TILE];
+
+    if (!count)
+      return true;
+
+    for (unsigned int i = width * row_begin; i < end; i += LAYERS_TILE)
+      {
+        const unsigned int n = MIN(end - i, LAYERS_TILE);
+
+        bottom(out + i, in[0] + i, n, alpha[0]);
+        for (unsigned int l = 1; l < count; ++l)
+          {
+            const int m = l < LAYERS_MAX ? mode_index[l] : MODE_NORMAL;
+            const uint8_t o = l < LAYERS_MAX ? alpha[l] : 255;
+            const uint32_t* src = in[l] + i;
+
+            if (!o)
+              continue;
+            if (m != MODE_NORMAL)
+              {
+                blend(m, blended, out + i, src, n);
+                compose(out + i, blended, src, n, o);
+              }
+            else
+              compose(out + i, src, src, n, o);
+          }
+      }
+    return true;
+  }
+
+private:
+  std::string mode[LAYERS_MAX];
+  double opacity[LAYERS_MAX];
+  int mode_index[LAYERS_MAX];
+  uint8_t alpha[LAYERS_MAX];
+
+  // the bottom layer with its alpha scaled by the opacity
+  static void bottom(uint32_t* dst, const uint32_t* src, unsigned int n,
+                     uint8_t o)
+  {
+    if (o == 255)
+      {
+        if (dst != src)
+          std::memcpy(dst, src, n * sizeof(uint32_t));
+        return;
+      }
+    for (unsigned int i = 0; i < n; ++i)
+      {
+        uint32_t t;
+        dst[i] = (src[i] & 0xffffff) | (INT_MULT(src[i] >> 24, o, t) << 24);
+      }
+  }
+
+  // the mixer2 formula of mode m
+  static void blend(int m, uint32_t* dst, const uint32_t* src1,
+                    const uint32_t* src2, unsigned int n)
+  {
+    switch (m)
+      {
+      case MODE_ADDITION:   frei0r_simd_add(dst, src1, src2, n); break;
+      case MODE_SUBTRACT:   frei0r_simd_subtract(dst, src1, src2, n); break;
+      case MODE_MULTIPLY:   frei0r_simd_multiply(dst, src1, src2, n); break;
+      case MODE_SCREEN:     frei0r_simd_screen(dst, src1, src2, n); break;
+      case MODE_DARKEN:     frei0r_simd_darken(dst, src1, src2, n); break;
+      case MODE_LIGHTEN:    frei0r_simd_lighten(dst, src1, src2, n); break;
+      case MODE_DIFFERENCE: frei0r_simd_difference(dst, src1, src2, n); break;
+      }
+  }
+
+  // Puts the colors of blended over acc, covering acc by the alpha of
+  // layer times o. The color weight is that coverage divided by the new
+  // alpha, like in alphaover, so a transparent acc takes the colors of
+  // the layer.
+  static void compose(uint32_t* acc, const uint32_t* blended,
+                      const uint32_t* layer, unsigned int n, uint8_t o)
+  {
+    uint32_t w[LAYERS_TILE], a[LAYERS_TILE];
+    unsigned int i = 0;
+
+    for (unsigned int j = 0; j < n; ++j)
+      {
+        uint32_t t, k = INT_MULT(layer[j] >> 24, o, t);
+        uint32_t ad = k + INT_MULT(acc[j] >> 24, 255 - k, t);
+        uint32_t wk = ad ? MIN((k * recip[ad] + 0x8000) >> 16, 255u) : 0;
+        w[j] = wk * 0x01010101u;
+        a[j] = ad << 24;
+      }
+
+#if defined(__SSE2__)
+    const __m128i z = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(0xff);
+    const __m128i c128 = _mm_set1_epi16(0x80);
+    const __m128i cmask = _mm_set1_epi32(0xffffff);
+
+    for (; i + 4 <= n; i += 4)
+      {
+        __m128i d = _mm_loadu_si128((const __m128i*)(acc + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(blended + i));
+        __m128i wv = _mm_loadu_si128((const __m128i*)(w + i));
+        __m128i lo = lerp(_mm_unpacklo_epi8(d, z), _mm_unpacklo_epi8(s, z),
+                          _mm_unpacklo_epi8(wv, z), c255, c128);
+        __m128i hi = lerp(_mm_unpackhi_epi8(d, z), _mm_unpackhi_epi8(s, z),
+                          _mm_unpackhi_epi8(wv, z), c255, c128);
+        __m128i c = _mm_and_si128(_mm_packus_epi16(lo, hi), cmask);
+        c = _mm_or_si128(c, _mm_loadu_si128((const __m128i*)(a + i)));
+        _mm_storeu_si128((__m128i*)(acc + i), c);
+      }
+#endif
+
+    for (; i < n; ++i)
+      {
+        uint32_t c = a[i], wk = w[i] & 0xff;
+        for (int b = 0; b < 24; b += 8)
+          {
+            uint32_t t = ((acc[i] >> b) & 0xff) * (255 - wk)
+              + ((blended[i] >> b) & 0xff) * wk + 0x80;
+            c |= (((t >> 8) + t) >> 8) << b;
+          }
+        acc[i] = c;
+      }
+  }
+
+#if defined(__SSE2__)
+  // (d * (255 - w) + s * w) / 255 in 16 bit lanes, rounded like INT_MULT
+  static inline __m128i lerp(__m128i d, __m128i s, __m128i w,
+                             __m128i c255, __m128i c128)
+  {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(c255, w)),
+                              _mm_mullo_epi16(s, w));
+    t = _mm_add_epi16(t, c128);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  }
+#endif
+};
+
+
+frei0r::construct<layers> plugin("layers",
+                                 "composites a stack of layers with blend "
+                                 "mode and opacity per layer in one pass",
+                                 "frei0r",
+                                 0,1,
+                                 F0R_COLOR_MODEL_RGBA8888,
+                                 F0R_CAP_INPLACE);
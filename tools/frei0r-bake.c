@@ -0,0 +1,262 @@
+/* frei0r-bake.c
+ * Bakes a chain of pointwise colour filters into a .cube 3D LUT.
+ *
+ * The filters are run once, in the given order, on a frame holding the
+ * lattice colours of the table; the result can then be applied with the
+ * lut3d filter instead of the whole chain.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frei0r.h"
+#include "frei0r_lut3d.h"
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-s SIZE] -o OUT.cube plugin.so [INDEX=VALUE]... "
+          "[plugin.so [INDEX=VALUE]...]...\n"
+          "\n"
+          "  -s SIZE   lattice points per axis (default 52)\n"
+          "  -o FILE   .cube file to write\n"
+          "\n"
+          "The plugins are applied in the given order, each with its own\n"
+          "parameters: numbers for double and bool parameters, R,G,B for\n"
+          "colours, X,Y for positions and text for strings. Only filters\n"
+          "that map each pixel on its own can be baked.\n",
+          argv0);
+}
+
+/* Sets one INDEX=VALUE parameter, parsed according to its type. */
+static int set_param(void (*get_param_info)(f0r_param_info_t*, int),
+                     void (*set_param_value)(f0r_instance_t, f0r_param_t, int),
+                     f0r_instance_t instance, int num_params, const char* arg)
+{
+  f0r_param_info_t pinfo;
+  const char* value = strchr(arg, '=');
+  char* end;
+  int index = (int)strtol(arg, &end, 10);
+
+  if (!value || end != value || index < 0 || index >= num_params)
+    return 0;
+  ++value;
+  get_param_info(&pinfo, index);
+
+  switch (pinfo.type)
+    {
+    case F0R_PARAM_BOOL:
+    case F0R_PARAM_DOUBLE:
+      {
+        double d = strtod(value, &end);
+        if (*end)
+          return 0;
+        set_param_value(instance, &d, index);
+        break;
+      }
+    case F0R_PARAM_COLOR:
+      {
+        f0r_param_color_t c;
+        if (sscanf(value, "%f,%f,%f", &c.r, &c.g, &c.b) != 3)
+          return 0;
+        set_param_value(instance, &c, index);
+        break;
+      }
+    case F0R_PARAM_POSITION:
+      {
+        f0r_param_position_t p;
+        if (sscanf(value, "%lf,%lf", &p.x, &p.y) != 2)
+          return 0;
+        set_param_value(instance, &p, index);
+        break;
+      }
+    case F0R_PARAM_STRING:
+      {
+        f0r_param_string s = (f0r_param_string)value;
+        set_param_value(instance, &s, index);
+        break;
+      }
+    default:
+      return 0;
+    }
+  return 1;
+}
+
+/* Runs the plugin at path with the parameters in args[0..nargs) on frame,
+   which is width x height pixels, leaving the result in frame. */
+static int apply(const char* path, char** args, int nargs,
+                 uint32_t* frame, uint32_t* scratch,
+                 unsigned int width, unsigned int height)
+{
+  void* handle;
+  int (*init)(void);
+  void (*deinit)(void);
+  void (*get_plugin_info)(f0r_plugin_info_t*);
+  void (*get_plugin_info2)(f0r_plugin_info2_t*);
+  void (*get_param_info)(f0r_param_info_t*, int);
+  f0r_instance_t (*construct)(unsigned int, unsigned int);
+  void (*destruct)(f0r_instance_t);
+  void (*set_param_value)(f0r_instance_t, f0r_param_t, int);
+  void (*update)(f0r_instance_t, double, const uint32_t*, uint32_t*);
+  f0r_plugin_info_t info;
+  f0r_instance_t instance;
+  int i;
+
+  handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle)
+    {
+      fprintf(stderr, "%s\n", dlerror());
+      return 0;
+    }
+  init = (int (*)(void))dlsym(handle, "f0r_init");
+  deinit = (void (*)(void))dlsym(handle, "f0r_deinit");
+  get_plugin_info = (void (*)(f0r_plugin_info_t*))
+    dlsym(handle, "f0r_get_plugin_info");
+  get_plugin_info2 = (void (*)(f0r_plugin_info2_t*))
+    dlsym(handle, "f0r_get_plugin_info2");
+  get_param_info = (void (*)(f0r_param_info_t*, int))
+    dlsym(handle, "f0r_get_param_info");
+  construct = (f0r_instance_t (*)(unsigned int, unsigned int))
+    dlsym(handle, "f0r_construct");
+  destruct = (void (*)(f0r_instance_t))dlsym(handle, "f0r_destruct");
+  set_param_value = (void (*)(f0r_instance_t, f0r_param_t, int))
+    dlsym(handle, "f0r_set_param_value");
+  update = (void (*)(f0r_instance_t, double, const uint32_t*, uint32_t*))
+    dlsym(handle, "f0r_update");
+  if (!init || !get_plugin_info || !get_param_info || !construct
+      || !destruct || !set_param_value || !update)
+    {
+      fprintf(stderr, "%s: not a frei0r plugin\n", path);
+      return 0;
+    }
+
+  if (!init())
+    return 0;
+  get_plugin_info(&info);
+  if (info.plugin_type != F0R_PLUGIN_TYPE_FILTER
+      || info.color_model == F0R_COLOR_MODEL_BGRA8888)
+    {
+      fprintf(stderr, "%s: only RGBA filters can be baked\n", path);
+      return 0;
+    }
+  if (get_plugin_info2)
+    {
+      f0r_plugin_info2_t info2;
+      get_plugin_info2(&info2);
+      if (info2.capabilities & F0R_CAP_TEMPORAL)
+        {
+          fprintf(stderr, "%s: depends on earlier frames, "
+                  "cannot be baked\n", path);
+          return 0;
+        }
+    }
+
+  instance = construct(width, height);
+  if (!instance)
+    return 0;
+  for (i = 0; i < nargs; ++i)
+    if (!set_param(get_param_info, set_param_value, instance,
+                   info.num_params, args[i]))
+      {
+        fprintf(stderr, "%s: invalid parameter %s\n", path, args[i]);
+        destruct(instance);
+        return 0;
+      }
+
+  update(instance, 0.0, frame, scratch);
+  memcpy(frame, scratch, sizeof(uint32_t) * width * height);
+
+  destruct(instance);
+  if (deinit)
+    deinit();
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  const char* out = NULL;
+  int size = 52, opt, i, j;
+  unsigned int width, height;
+  uint32_t* frame;
+  uint32_t* scratch;
+  frei0r_lut3d_t lut;
+
+  while ((opt = getopt(argc, argv, "s:o:h")) != -1)
+    {
+      switch (opt)
+        {
+        case 's':
+          size = atoi(optarg);
+          break;
+        case 'o':
+          out = optarg;
+          break;
+        default:
+          usage(argv[0]);
+          return opt == 'h' ? 0 : 1;
+        }
+    }
+  if (!out || optind == argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  if (size < 2 || size > FREI0R_LUT3D_MAX_SIZE)
+    {
+      fprintf(stderr, "size must be between 2 and %d\n",
+              FREI0R_LUT3D_MAX_SIZE);
+      return 1;
+    }
+
+  width = size;
+  height = size * size;
+  frame = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+  scratch = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+  if (!frame || !scratch)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+  frei0r_lut3d_identity(frame, size);
+
+  /* every argument without '=' starts the next plugin of the chain */
+  for (i = optind; i < argc; i = j)
+    {
+      for (j = i + 1; j < argc && strchr(argv[j], '='); ++j)
+        ;
+      if (!apply(argv[i], argv + i + 1, j - i - 1, frame, scratch,
+                 width, height))
+        return 1;
+    }
+
+  frei0r_lut3d_init(&lut);
+  if (frei0r_lut3d_from_frame(&lut, frame, size) != 0
+      || frei0r_lut3d_save_cube(&lut, out, "frei0r-bake") != 0)
+    {
+      fprintf(stderr, "cannot write %s\n", out);
+      return 1;
+    }
+  frei0r_lut3d_free(&lut);
+  free(scratch);
+  free(frame);
+  return 0;
+}
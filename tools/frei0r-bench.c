@@ -0,0 +1,525 @@
+/* frei0r-bench.c
+ * Measures the throughput of frei0r plugins.
+ *
+ * Every plugin is run in a child process of its own for each resolution,
+ * so that crashing or hanging plugins don't stop the benchmark and the
+ * peak resident set size can be reported per plugin.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frei0r.h"
+
+#ifndef FREI0R_BENCH_PLUGIN_DIR
+#define FREI0R_BENCH_PLUGIN_DIR "src"
+#endif
+
+#define MAX_PLUGINS 1024
+#define MAX_RESOLUTIONS 16
+
+typedef struct resolution
+{
+  unsigned int width;
+  unsigned int height;
+} resolution_t;
+
+/* what a child process reports back to the parent */
+typedef struct bench_result
+{
+  int ok;
+  char name[128];
+  int plugin_type;
+  double seconds;
+  long peak_rss_kb;
+} bench_result_t;
+
+static const char* plugin_paths[MAX_PLUGINS];
+static int plugin_count = 0;
+
+static resolution_t resolutions[MAX_RESOLUTIONS];
+static int resolution_count = 0;
+
+static unsigned int frames = 100;
+static unsigned int warmup = 10;
+static unsigned int timeout = 60;
+static int json = 0;
+static int sweep = 0;
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options] [plugin.so|directory]...\n"
+          "\n"
+          "  -r LIST   resolutions, comma separated: 720p, 1080p, 4k or WxH\n"
+          "            (default 720p,1080p,4k)\n"
+          "  -n N      number of timed frames (default %u)\n"
+          "  -w N      number of warm-up frames (default %u)\n"
+          "  -t SECS   time limit per plugin and resolution (default %u)\n"
+          "  -j        print JSON instead of CSV\n"
+          "  -s        change the parameters every frame, so that more of\n"
+          "            each plugin runs (e.g. to collect profiles for PGO)\n"
+          "\n"
+          "Without plugin arguments all plugins below\n"
+          "%s are measured.\n",
+          argv0, frames, warmup, timeout, FREI0R_BENCH_PLUGIN_DIR);
+}
+
+static int parse_resolutions(char* list)
+{
+  char* token;
+
+  resolution_count = 0;
+  for (token = strtok(list, ","); token; token = strtok(NULL, ","))
+    {
+      resolution_t r;
+
+      if (resolution_count == MAX_RESOLUTIONS)
+        return 0;
+      if (!strcmp(token, "720p"))
+        r.width = 1280, r.height = 720;
+      else if (!strcmp(token, "1080p"))
+        r.width = 1920, r.height = 1080;
+      else if (!strcmp(token, "4k") || !strcmp(token, "2160p"))
+        r.width = 3840, r.height = 2160;
+      else if (sscanf(token, "%ux%u", &r.width, &r.height) != 2
+               || !r.width || !r.height)
+        return 0;
+      resolutions[resolution_count++] = r;
+    }
+  return resolution_count > 0;
+}
+
+static int is_plugin(const char* name)
+{
+  size_t len = strlen(name);
+  return len > 3 && !strcmp(name + len - 3, ".so");
+}
+
+static void add_plugin(const char* path)
+{
+  if (plugin_count < MAX_PLUGINS)
+    plugin_paths[plugin_count++] = strdup(path);
+}
+
+/* adds all plugins below path, in a stable order */
+static void scan(const char* path)
+{
+  struct stat st;
+  struct dirent** entries;
+  int n, i;
+
+  if (stat(path, &st) != 0)
+    {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return;
+    }
+  if (!S_ISDIR(st.st_mode))
+    {
+      add_plugin(path);
+      return;
+    }
+
+  n = scandir(path, &entries, NULL, alphasort);
+  if (n < 0)
+    return;
+  for (i = 0; i < n; ++i)
+    {
+      const char* name = entries[i]->d_name;
+      char child[4096];
+
+      if (name[0] != '.')
+        {
+          snprintf(child, sizeof(child), "%s/%s", path, name);
+          if (stat(child, &st) == 0)
+            {
+              if (S_ISDIR(st.st_mode))
+                scan(child);
+              else if (is_plugin(name))
+                add_plugin(child);
+            }
+        }
+      free(entries[i]);
+    }
+  free(entries);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t* alloc_frame(unsigned int width, unsigned int height,
+                             uint32_t seed)
+{
+  size_t i, size = (size_t)width * height;
+  void* frame = NULL;
+
+  if (posix_memalign(&frame, 16, size * sizeof(uint32_t)) != 0)
+    return NULL;
+  for (i = 0; i < size; ++i)
+    {
+      /* xorshift, so that data dependent plugins see non-trivial input */
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      ((uint32_t*)frame)[i] = seed;
+    }
+  return (uint32_t*)frame;
+}
+
+/* Sets the parameters for frame i of a sweep: each one steps through
+   its range along a golden ratio sequence of its own. */
+static void sweep_params(f0r_instance_t instance, int num_params,
+                         void (*get_param_info)(f0r_param_info_t*, int),
+                         void (*set_param_value)(f0r_instance_t, f0r_param_t,
+                                                 int),
+                         unsigned int i)
+{
+  int k;
+
+  for (k = 0; k < num_params; ++k)
+    {
+      f0r_param_info_t pinfo;
+      double v = (i + 1) * 0.6180339887 + k * 0.4142135624;
+      f0r_param_color_t color;
+      f0r_param_position_t position;
+
+      v -= (unsigned long)v;
+      memset(&pinfo, 0, sizeof(pinfo));
+      get_param_info(&pinfo, k);
+      switch (pinfo.type)
+        {
+        case F0R_PARAM_BOOL:
+        case F0R_PARAM_DOUBLE:
+          set_param_value(instance, &v, k);
+          break;
+        case F0R_PARAM_COLOR:
+          color.r = (float)v;
+          color.g = (float)(1.0 - v);
+          color.b = (float)(v < 0.5 ? v + 0.5 : v - 0.5);
+          set_param_value(instance, &color, k);
+          break;
+        case F0R_PARAM_POSITION:
+          position.x = v;
+          position.y = v < 0.5 ? v + 0.5 : v - 0.5;
+          set_param_value(instance, &position, k);
+          break;
+        }
+    }
+}
+
+/* runs in the child process */
+static void bench(const char* path, resolution_t res, bench_result_t* result)
+{
+  void* handle;
+  int (*init)(void);
+  void (*deinit)(void);
+  void (*get_plugin_info)(f0r_plugin_info_t*);
+  void (*get_param_info)(f0r_param_info_t*, int);
+  void (*set_param_value)(f0r_instance_t, f0r_param_t, int);
+  f0r_instance_t (*construct)(unsigned int, unsigned int);
+  void (*destruct)(f0r_instance_t);
+  void (*update)(f0r_instance_t, double, const uint32_t*, uint32_t*);
+  void (*update2)(f0r_instance_t, double, const uint32_t*,
+                  const uint32_t*, const uint32_t*, uint32_t*);
+  f0r_plugin_info_t info;
+  f0r_instance_t instance;
+  uint32_t* in[3] = { NULL, NULL, NULL };
+  uint32_t* out;
+  unsigned int i, inputs;
+  double start = 0;
+  struct rusage usage;
+
+  memset(result, 0, sizeof(*result));
+
+  handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle)
+    {
+      fprintf(stderr, "%s\n", dlerror());
+      return;
+    }
+  init = (int (*)(void))dlsym(handle, "f0r_init");
+  deinit = (void (*)(void))dlsym(handle, "f0r_deinit");
+  get_plugin_info = (void (*)(f0r_plugin_info_t*))
+    dlsym(handle, "f0r_get_plugin_info");
+  get_param_info = (void (*)(f0r_param_info_t*, int))
+    dlsym(handle, "f0r_get_param_info");
+  set_param_value = (void (*)(f0r_instance_t, f0r_param_t, int))
+    dlsym(handle, "f0r_set_param_value");
+  construct = (f0r_instance_t (*)(unsigned int, unsigned int))
+    dlsym(handle, "f0r_construct");
+  destruct = (void (*)(f0r_instance_t))dlsym(handle, "f0r_destruct");
+  update = (void (*)(f0r_instance_t, double, const uint32_t*, uint32_t*))
+    dlsym(handle, "f0r_update");
+  update2 = (void (*)(f0r_instance_t, double, const uint32_t*,
+                      const uint32_t*, const uint32_t*, uint32_t*))
+    dlsym(handle, "f0r_update2");
+  if (!init || !get_plugin_info || !construct || !destruct
+      || (!update && !update2))
+    {
+      fprintf(stderr, "%s: not a frei0r plugin\n", path);
+      return;
+    }
+
+  if (!init())
+    return;
+  get_plugin_info(&info);
+  snprintf(result->name, sizeof(result->name), "%s", info.name);
+  result->plugin_type = info.plugin_type;
+
+  switch (info.plugin_type)
+    {
+    case F0R_PLUGIN_TYPE_SOURCE: inputs = 0; break;
+    case F0R_PLUGIN_TYPE_MIXER2: inputs = 2; break;
+    case F0R_PLUGIN_TYPE_MIXER3: inputs = 3; break;
+    default: inputs = 1; break;
+    }
+  if (inputs > 1 && !update2)
+    return;
+
+  for (i = 0; i < inputs; ++i)
+    if (!(in[i] = alloc_frame(res.width, res.height, 0x9e3779b9u + i)))
+      return;
+  if (!(out = alloc_frame(res.width, res.height, 1)))
+    return;
+
+  instance = construct(res.width, res.height);
+  if (!instance)
+    return;
+
+  for (i = 0; i < warmup + frames; ++i)
+    {
+      double time = i / 25.0;
+
+      if (i == warmup)
+        start = now();
+      if (sweep && get_param_info && set_param_value)
+        sweep_params(instance, info.num_params, get_param_info,
+                     set_param_value, i);
+      if (update2)
+        update2(instance, time, in[0], in[1], in[2], out);
+      else
+        update(instance, time, in[0], out);
+    }
+  result->seconds = now() - start;
+
+  destruct(instance);
+  if (deinit)
+    deinit();
+
+  getrusage(RUSAGE_SELF, &usage);
+  result->peak_rss_kb = usage.ru_maxrss;
+  result->ok = 1;
+}
+
+static int run(const char* path, resolution_t res, bench_result_t* result)
+{
+  int fds[2];
+  pid_t pid;
+  int status;
+  ssize_t n;
+
+  memset(result, 0, sizeof(*result));
+  if (pipe(fds) != 0)
+    return 0;
+
+  pid = fork();
+  if (pid < 0)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      return 0;
+    }
+  if (pid == 0)
+    {
+      bench_result_t r;
+
+      close(fds[0]);
+      alarm(timeout);
+      bench(path, res, &r);
+      if (write(fds[1], &r, sizeof(r)) != (ssize_t)sizeof(r))
+        _exit(1);
+      /* not _exit(): a plugin built for PGO writes its profile in its
+         destructors, which C++ plugins only run at exit since they are
+         never unloaded; stdout is flushed, so nothing is written twice */
+      exit(0);
+    }
+
+  close(fds[1]);
+  n = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+
+  if (n != (ssize_t)sizeof(*result))
+    {
+      memset(result, 0, sizeof(*result));
+      if (WIFSIGNALED(status))
+        fprintf(stderr, "%s: %s at %ux%u\n", path,
+                WTERMSIG(status) == SIGALRM ? "timed out" : "crashed",
+                res.width, res.height);
+      return 0;
+    }
+  return result->ok;
+}
+
+static const char* type_name(int type)
+{
+  switch (type)
+    {
+    case F0R_PLUGIN_TYPE_SOURCE: return "source";
+    case F0R_PLUGIN_TYPE_FILTER: return "filter";
+    case F0R_PLUGIN_TYPE_MIXER2: return "mixer2";
+    case F0R_PLUGIN_TYPE_MIXER3: return "mixer3";
+    }
+  return "unknown";
+}
+
+/* prints s as JSON string or CSV field */
+static void print_quoted(const char* s)
+{
+  putchar('"');
+  for (; *s; ++s)
+    {
+      if (*s == '"')
+        fputs(json ? "\\\"" : "\"\"", stdout);
+      else if (*s == '\\' && json)
+        fputs("\\\\", stdout);
+      else
+        putchar(*s);
+    }
+  putchar('"');
+}
+
+static void print_result(const char* path, resolution_t res,
+                         const bench_result_t* r, int first)
+{
+  double fps = r->seconds > 0 ? frames / r->seconds : 0;
+  double ns_per_pixel = r->seconds * 1e9
+    / ((double)frames * res.width * res.height);
+
+  if (json)
+    {
+      printf("%s\n  {\"plugin\": ", first ? "" : ",");
+      print_quoted(r->name);
+      printf(", \"path\": ");
+      print_quoted(path);
+      printf(", \"type\": \"%s\", \"width\": %u, \"height\": %u, "
+             "\"frames\": %u, \"seconds\": %.6f, \"fps\": %.3f, "
+             "\"ns_per_pixel\": %.4f, \"peak_rss_kb\": %ld}",
+             type_name(r->plugin_type), res.width, res.height, frames,
+             r->seconds, fps, ns_per_pixel, r->peak_rss_kb);
+    }
+  else
+    {
+      print_quoted(r->name);
+      putchar(',');
+      print_quoted(path);
+      printf(",%s,%u,%u,%u,%.6f,%.3f,%.4f,%ld\n",
+             type_name(r->plugin_type), res.width, res.height, frames,
+             r->seconds, fps, ns_per_pixel, r->peak_rss_kb);
+    }
+  fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+  char default_resolutions[] = "720p,1080p,4k";
+  int opt, i, j, first = 1;
+
+  parse_resolutions(default_resolutions);
+
+  while ((opt = getopt(argc, argv, "r:n:w:t:jsh")) != -1)
+    {
+      switch (opt)
+        {
+        case 'r':
+          if (!parse_resolutions(optarg))
+            {
+              fprintf(stderr, "invalid resolution list: %s\n", optarg);
+              return 1;
+            }
+          break;
+        case 'n':
+          frames = (unsigned int)strtoul(optarg, NULL, 10);
+          break;
+        case 'w':
+          warmup = (unsigned int)strtoul(optarg, NULL, 10);
+          break;
+        case 't':
+          timeout = (unsigned int)strtoul(optarg, NULL, 10);
+          break;
+        case 'j':
+          json = 1;
+          break;
+        case 's':
+          sweep = 1;
+          break;
+        default:
+          usage(argv[0]);
+          return opt == 'h' ? 0 : 1;
+        }
+    }
+  if (frames == 0)
+    {
+      fprintf(stderr, "need at least one timed frame\n");
+      return 1;
+    }
+
+  if (optind == argc)
+    scan(FREI0R_BENCH_PLUGIN_DIR);
+  for (i = optind; i < argc; ++i)
+    scan(argv[i]);
+
+  if (json)
+    printf("[");
+  else
+    printf("plugin,path,type,width,height,frames,seconds,fps,"
+           "ns_per_pixel,peak_rss_kb\n");
+
+  for (i = 0; i < plugin_count; ++i)
+    for (j = 0; j < resolution_count; ++j)
+      {
+        bench_result_t result;
+
+        if (run(plugin_paths[i], resolutions[j], &result))
+          {
+            print_result(plugin_paths[i], resolutions[j], &result, first);
+            first = 0;
+          }
+      }
+
+  if (json)
+    printf("\n]\n");
+  return 0;
+}
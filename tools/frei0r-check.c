@@ -0,0 +1,880 @@
+/* frei0r-check.c
+ * Checks the output of frei0r plugins against golden hashes or against
+ * a reference build, and times them on the way.
+ *
+ * Every plugin is run on a few fixed input frames with its default
+ * parameters, with pseudo-random ones and with all of them at the lowest
+ * and at the highest value, each case in a child process of its own, so that crashing or hanging plugins are reported
+ * instead of stopping the check. With -o the hashes of the output frames
+ * are written to a file, with -c they are compared to such a file, and
+ * with -R the plugins are compared to the plugins of the same file name
+ * below a directory, by PSNR. With -T the instances are trimmed halfway,
+ * after which they have to go on like new ones, and with -i the plugins
+ * that declare F0R_CAP_INPLACE also run with the input as the output,
+ * which has to give the same hash.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frei0r.h"
+
+#ifndef FREI0R_CHECK_PLUGIN_DIR
+#define FREI0R_CHECK_PLUGIN_DIR "src"
+#endif
+
+#define MAX_PLUGINS 1024
+#define MAX_GOLDEN (MAX_PLUGINS * 8)
+
+/* the input frames */
+enum { INPUT_GRADIENT, INPUT_NOISE, INPUT_NATURAL, INPUT_COUNT };
+static const char* input_names[INPUT_COUNT] =
+  { "gradient", "noise", "natural" };
+
+/* the parameter values */
+enum { PARAMS_DEFAULT, PARAMS_RANDOM, PARAMS_MIN, PARAMS_MAX, PARAMS_COUNT };
+static const char* params_names[PARAMS_COUNT] =
+  { "default", "random", "min", "max" };
+
+/* what a child process reports back to the parent */
+typedef struct check_result
+{
+  int ok;
+  uint64_t hash;
+  double seconds;
+  double ref_seconds;
+  double psnr;
+  int trim_ok;  /* with -T: the frames after f0r_trim are those of a new
+                   instance */
+  int inplace_ok;  /* with -i: updates in place give the same hash */
+} check_result_t;
+
+typedef struct golden
+{
+  char key[256];
+  uint64_t hash;
+} golden_t;
+
+/* a loaded plugin */
+typedef struct plugin
+{
+  void* handle;
+  int (*init)(void);
+  void (*deinit)(void);
+  void (*get_plugin_info)(f0r_plugin_info_t*);
+  void (*get_param_info)(f0r_param_info_t*, int);
+  void (*set_param_value)(f0r_instance_t, f0r_param_t, int);
+  void (*get_param_value)(f0r_instance_t, f0r_param_t, int);
+  f0r_instance_t (*construct)(unsigned int, unsigned int);
+  void (*destruct)(f0r_instance_t);
+  void (*update)(f0r_instance_t, double, const uint32_t*, uint32_t*);
+  void (*update2)(f0r_instance_t, double, const uint32_t*,
+                  const uint32_t*, const uint32_t*, uint32_t*);
+  int (*trim)(f0r_instance_t);
+  f0r_plugin_info_t info;
+  unsigned int capabilities;
+} plugin_t;
+
+static const char* plugin_paths[MAX_PLUGINS];
+static int plugin_count = 0;
+
+static const char* reference_paths[MAX_PLUGINS];
+static int reference_count = 0;
+
+static golden_t golden[MAX_GOLDEN];
+static int golden_count = 0;
+
+static unsigned int width = 320;
+static unsigned int height = 240;
+static unsigned int frames = 5;
+static unsigned int timeout = 60;
+static double min_psnr = INFINITY;
+static int check_trim = 0;
+static int check_inplace = 0;
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options] [plugin.so|directory]...\n"
+          "\n"
+          "  -o FILE   write the hashes of the outputs to FILE\n"
+          "  -c FILE   compare the outputs to the hashes in FILE\n"
+          "  -R DIR    compare the outputs to those of the plugins of the\n"
+          "            same file name below DIR\n"
+          "  -p DB     with -R, the lowest PSNR that passes (default: the\n"
+          "            outputs have to be identical)\n"
+          "  -T        trim the instances halfway, with f0r_trim, and check\n"
+          "            that the frames after are those of a new instance\n"
+          "  -i        also update the plugins with F0R_CAP_INPLACE in place\n"
+          "            and check that the outputs stay the same\n"
+          "  -s WxH    frame size (default %ux%u)\n"
+          "  -n N      number of frames per case (default %u)\n"
+          "  -t SECS   time limit per case (default %u)\n"
+          "\n"
+          "Hashes depend on the compiler and the C library, so keep them\n"
+          "per platform, or compare with a reference build using -R.\n"
+          "Without plugin arguments all plugins below\n"
+          "%s are checked. Exits with 1 if a check fails.\n",
+          argv0, width, height, frames, timeout, FREI0R_CHECK_PLUGIN_DIR);
+}
+
+static int is_plugin(const char* name)
+{
+  size_t len = strlen(name);
+  return len > 3 && !strcmp(name + len - 3, ".so");
+}
+
+/* adds all plugins below path to paths, in a stable order */
+static void scan(const char* path, const char** paths, int* count)
+{
+  struct stat st;
+  struct dirent** entries;
+  int n, i;
+
+  if (stat(path, &st) != 0)
+    {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return;
+    }
+  if (!S_ISDIR(st.st_mode))
+    {
+      if (*count < MAX_PLUGINS)
+        paths[(*count)++] = strdup(path);
+      return;
+    }
+
+  n = scandir(path, &entries, NULL, alphasort);
+  if (n < 0)
+    return;
+  for (i = 0; i < n; ++i)
+    {
+      const char* name = entries[i]->d_name;
+      char child[4096];
+
+      if (name[0] != '.')
+        {
+          snprintf(child, sizeof(child), "%s/%s", path, name);
+          if (stat(child, &st) == 0)
+            {
+              if (S_ISDIR(st.st_mode))
+                scan(child, paths, count);
+              else if (is_plugin(name) && *count < MAX_PLUGINS)
+                paths[(*count)++] = strdup(child);
+            }
+        }
+      free(entries[i]);
+    }
+  free(entries);
+}
+
+static const char* base_name(const char* path)
+{
+  const char* slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static const char* find_reference(const char* path)
+{
+  int i;
+
+  for (i = 0; i < reference_count; ++i)
+    if (!strcmp(base_name(reference_paths[i]), base_name(path)))
+      return reference_paths[i];
+  return NULL;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t xorshift(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static uint32_t pixel(unsigned int r, unsigned int g, unsigned int b,
+                      unsigned int a)
+{
+  return (a << 24) | (b << 16) | (g << 8) | r;
+}
+
+static unsigned int clamp8(double v)
+{
+  return v < 0 ? 0 : v > 255 ? 255 : (unsigned int)(v + 0.5);
+}
+
+/* Fills frame with one of the inputs. The natural one is made of what
+   photographs have: smooth shading, a few hard edges and some grain. */
+static void fill_input(uint32_t* frame, int input)
+{
+  uint32_t state = 0x9e3779b9u + input;
+  unsigned int x, y;
+
+  for (y = 0; y < height; ++y)
+    for (x = 0; x < width; ++x)
+      {
+        double u = (double)x / width, v = (double)y / height;
+        uint32_t* p = frame + (size_t)y * width + x;
+
+        switch (input)
+          {
+          case INPUT_GRADIENT:
+            *p = pixel(clamp8(255 * u), clamp8(255 * v),
+                       clamp8(255 * (1 - u)), clamp8(255 * (u + v) / 2));
+            break;
+          case INPUT_NOISE:
+            *p = xorshift(&state);
+            break;
+          default:
+            {
+              double dx = u - 0.6, dy = v - 0.45;
+              double shade = 0.5 + 0.3 * sin(5 * u + 1) * cos(3 * v);
+              double grain = (int)(xorshift(&state) % 17) - 8;
+              double r = 200 * shade, g = 170 * shade, b = 120 * shade;
+
+              if (dx * dx + dy * dy < 0.04)
+                r = 230 - 80 * v, g = 60, b = 40;
+              else if (v > 0.75)
+                r *= 0.4, g *= 0.6, b *= 0.9;
+              *p = pixel(clamp8(r + grain), clamp8(g + grain),
+                         clamp8(b + grain), 255);
+            }
+            break;
+          }
+      }
+}
+
+static int load(const char* path, plugin_t* plugin)
+{
+  void (*get_plugin_info2)(f0r_plugin_info2_t*);
+
+  memset(plugin, 0, sizeof(*plugin));
+  plugin->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!plugin->handle)
+    {
+      fprintf(stderr, "%s\n", dlerror());
+      return 0;
+    }
+  plugin->init = (int (*)(void))dlsym(plugin->handle, "f0r_init");
+  plugin->deinit = (void (*)(void))dlsym(plugin->handle, "f0r_deinit");
+  plugin->get_plugin_info = (void (*)(f0r_plugin_info_t*))
+    dlsym(plugin->handle, "f0r_get_plugin_info");
+  plugin->get_param_info = (void (*)(f0r_param_info_t*, int))
+    dlsym(plugin->handle, "f0r_get_param_info");
+  plugin->set_param_value = (void (*)(f0r_instance_t, f0r_param_t, int))
+    dlsym(plugin->handle, "f0r_set_param_value");
+  plugin->get_param_value = (void (*)(f0r_instance_t, f0r_param_t, int))
+    dlsym(plugin->handle, "f0r_get_param_value");
+  plugin->construct = (f0r_instance_t (*)(unsigned int, unsigned int))
+    dlsym(plugin->handle, "f0r_construct");
+  plugin->destruct = (void (*)(f0r_instance_t))
+    dlsym(plugin->handle, "f0r_destruct");
+  plugin->update = (void (*)(f0r_instance_t, double, const uint32_t*,
+                             uint32_t*))
+    dlsym(plugin->handle, "f0r_update");
+  plugin->update2 = (void (*)(f0r_instance_t, double, const uint32_t*,
+                              const uint32_t*, const uint32_t*, uint32_t*))
+    dlsym(plugin->handle, "f0r_update2");
+  plugin->trim = (int (*)(f0r_instance_t))dlsym(plugin->handle, "f0r_trim");
+  if (!plugin->init || !plugin->get_plugin_info || !plugin->get_param_info
+      || !plugin->set_param_value || !plugin->get_param_value
+      || !plugin->construct || !plugin->destruct
+      || (!plugin->update && !plugin->update2))
+    {
+      fprintf(stderr, "%s: not a frei0r plugin\n", path);
+      return 0;
+    }
+  if (!plugin->init())
+    return 0;
+  plugin->get_plugin_info(&plugin->info);
+  get_plugin_info2 = (void (*)(f0r_plugin_info2_t*))
+    dlsym(plugin->handle, "f0r_get_plugin_info2");
+  if (get_plugin_info2)
+    {
+      f0r_plugin_info2_t info2;
+
+      memset(&info2, 0, sizeof(info2));
+      get_plugin_info2(&info2);
+      plugin->capabilities = info2.capabilities;
+    }
+  return 1;
+}
+
+static unsigned int input_count(const plugin_t* plugin)
+{
+  switch (plugin->info.plugin_type)
+    {
+    case F0R_PLUGIN_TYPE_SOURCE: return 0;
+    case F0R_PLUGIN_TYPE_MIXER2: return 2;
+    case F0R_PLUGIN_TYPE_MIXER3: return 3;
+    }
+  return 1;
+}
+
+/* The next value of a parameter: drawn from a fixed sequence, or the
+   lowest or the highest one. Switches are on at both ends, where the
+   most code runs. */
+static double param_value(int params, uint32_t* state, int is_bool)
+{
+  double v;
+
+  switch (params)
+    {
+    case PARAMS_MIN:
+      return is_bool ? 1.0 : 0.0;
+    case PARAMS_MAX:
+      return 1.0;
+    }
+  v = xorshift(state) / 4294967296.0;
+  return is_bool ? (v < 0.5 ? 0.0 : 1.0) : v;
+}
+
+/* sets all parameters to the values of a case other than the default */
+static void set_params(const plugin_t* plugin, f0r_instance_t instance,
+                       int params)
+{
+  uint32_t state = 12345;
+  int k;
+
+  for (k = 0; k < plugin->info.num_params; ++k)
+    {
+      f0r_param_info_t pinfo;
+      double v;
+      f0r_param_color_t color;
+      f0r_param_position_t position;
+
+      memset(&pinfo, 0, sizeof(pinfo));
+      plugin->get_param_info(&pinfo, k);
+      switch (pinfo.type)
+        {
+        case F0R_PARAM_BOOL:
+          v = param_value(params, &state, 1);
+          plugin->set_param_value(instance, &v, k);
+          break;
+        case F0R_PARAM_DOUBLE:
+          v = param_value(params, &state, 0);
+          plugin->set_param_value(instance, &v, k);
+          break;
+        case F0R_PARAM_COLOR:
+          color.r = (float)param_value(params, &state, 0);
+          color.g = (float)param_value(params, &state, 0);
+          color.b = (float)param_value(params, &state, 0);
+          plugin->set_param_value(instance, &color, k);
+          break;
+        case F0R_PARAM_POSITION:
+          position.x = param_value(params, &state, 0);
+          position.y = param_value(params, &state, 0);
+          plugin->set_param_value(instance, &position, k);
+          break;
+        }
+    }
+}
+
+/* Runs the frames of a case, writing all outputs to out, one after the
+   other. With inplace, the (first) input is copied to the output frame
+   and updated there. Returns the time spent in the updates, or -1 on
+   failure. */
+static double run_case(plugin_t* plugin, int input, int params,
+                       uint32_t* const* in, uint32_t* out, int inplace)
+{
+  size_t size = (size_t)width * height;
+  f0r_instance_t instance;
+  unsigned int i, inputs = input_count(plugin);
+  double seconds = 0;
+
+  if (inputs > 1 && !plugin->update2)
+    return -1;
+  /* plugins that draw from rand() are repeatable as well */
+  srand(1);
+  instance = plugin->construct(width, height);
+  if (!instance)
+    return -1;
+  if (params != PARAMS_DEFAULT)
+    set_params(plugin, instance, params);
+
+  for (i = 0; i < frames; ++i)
+    {
+      /* the other inputs of mixers are the other frames */
+      const uint32_t* in0 = inputs ? in[input] : NULL;
+      const uint32_t* in1 = in[(input + 1) % INPUT_COUNT];
+      const uint32_t* in2 = in[(input + 2) % INPUT_COUNT];
+      double time = i / 25.0, start;
+
+      if (inplace && in0)
+        {
+          memcpy(out + i * size, in0, size * sizeof(uint32_t));
+          in0 = out + i * size;
+        }
+      start = now();
+      if (plugin->update2)
+        plugin->update2(instance, time, in0,
+                        inputs > 1 ? in1 : NULL, inputs > 2 ? in2 : NULL,
+                        out + i * size);
+      else
+        plugin->update(instance, time, in0, out + i * size);
+      seconds += now() - start;
+    }
+  plugin->destruct(instance);
+  return seconds;
+}
+
+/* Runs the first half of the frames of a case and trims the instance,
+   then runs the second half with it and with a new instance that has its
+   parameter values, writing the outputs to out and to ref_out. Both
+   start from black frames, for the effects that read them. Returns 1 if
+   the outputs are the same, 0 if not, -1 on failure. */
+static int run_trim(plugin_t* plugin, int input, int params,
+                    uint32_t* const* in, uint32_t* out, uint32_t* ref_out)
+{
+  size_t size = (size_t)width * height;
+  f0r_instance_t instance, fresh;
+  unsigned int i, half = frames / 2, inputs = input_count(plugin);
+  int k, same;
+
+  if (inputs > 1 && !plugin->update2)
+    return -1;
+  memset(out, 0, size * frames * sizeof(uint32_t));
+  memset(ref_out, 0, size * frames * sizeof(uint32_t));
+  srand(1);
+  instance = plugin->construct(width, height);
+  if (!instance)
+    return -1;
+  if (params != PARAMS_DEFAULT)
+    set_params(plugin, instance, params);
+
+  for (i = 0; i < frames; ++i)
+    {
+      const uint32_t* in0 = inputs ? in[input] : NULL;
+      const uint32_t* in1 = inputs > 1 ? in[(input + 1) % INPUT_COUNT] : NULL;
+      const uint32_t* in2 = inputs > 2 ? in[(input + 2) % INPUT_COUNT] : NULL;
+      double time = i / 25.0;
+
+      if (i == half)
+        {
+          plugin->trim(instance);
+          fresh = plugin->construct(width, height);
+          if (!fresh)
+            {
+              plugin->destruct(instance);
+              return -1;
+            }
+          /* effects may change their own parameters, like triggers */
+          for (k = 0; k < plugin->info.num_params; ++k)
+            {
+              double value[4];
+
+              plugin->get_param_value(instance, value, k);
+              plugin->set_param_value(fresh, value, k);
+            }
+        }
+      if (plugin->update2)
+        {
+          plugin->update2(instance, time, in0, in1, in2, out + i * size);
+          if (i >= half)
+            plugin->update2(fresh, time, in0, in1, in2, ref_out + i * size);
+        }
+      else
+        {
+          plugin->update(instance, time, in0, out + i * size);
+          if (i >= half)
+            plugin->update(fresh, time, in0, ref_out + i * size);
+        }
+    }
+  same = !memcmp(out + half * size, ref_out + half * size,
+                 (frames - half) * size * sizeof(uint32_t));
+  plugin->destruct(fresh);
+  plugin->destruct(instance);
+  return same;
+}
+
+/* FNV-1a */
+static uint64_t hash_frames(const uint32_t* data, size_t count)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  uint64_t h = 0xcbf29ce484222325ull;
+  size_t i;
+
+  for (i = 0; i < count * sizeof(uint32_t); ++i)
+    {
+      h ^= p[i];
+      h *= 0x100000001b3ull;
+    }
+  return h;
+}
+
+/* over all channels, alpha included; INFINITY if a and b are the same */
+static double psnr(const uint32_t* a, const uint32_t* b, size_t count)
+{
+  const unsigned char* p = (const unsigned char*)a;
+  const unsigned char* q = (const unsigned char*)b;
+  double sum = 0;
+  size_t i;
+
+  for (i = 0; i < count * sizeof(uint32_t); ++i)
+    {
+      double d = (double)p[i] - q[i];
+      sum += d * d;
+    }
+  if (sum == 0)
+    return INFINITY;
+  return 10 * log10(255.0 * 255.0 / (sum / (count * sizeof(uint32_t))));
+}
+
+/* runs in the child process */
+static void check(const char* path, const char* reference, int input,
+                  int params, check_result_t* result)
+{
+  size_t size = (size_t)width * height;
+  uint32_t* in[INPUT_COUNT];
+  uint32_t* out;
+  uint32_t* ref_out;
+  plugin_t plugin, ref;
+  int i;
+
+  memset(result, 0, sizeof(*result));
+  for (i = 0; i < INPUT_COUNT; ++i)
+    {
+      if (!(in[i] = malloc(size * sizeof(uint32_t))))
+        return;
+      fill_input(in[i], i);
+    }
+  out = calloc(size * frames, sizeof(uint32_t));
+  ref_out = calloc(size * frames, sizeof(uint32_t));
+  if (!out || !ref_out)
+    return;
+
+  if (!load(path, &plugin))
+    return;
+  result->seconds = run_case(&plugin, input, params, in, out, 0);
+  if (result->seconds < 0)
+    return;
+  result->hash = hash_frames(out, size * frames);
+
+  if (reference)
+    {
+      if (!load(reference, &ref))
+        return;
+      result->ref_seconds = run_case(&ref, input, params, in, ref_out, 0);
+      if (result->ref_seconds < 0)
+        return;
+      result->psnr = psnr(out, ref_out, size * frames);
+    }
+
+  result->trim_ok = 1;
+  if (check_trim && plugin.trim && frames > 1)
+    {
+      result->trim_ok = run_trim(&plugin, input, params, in, out, ref_out);
+      if (result->trim_ok < 0)
+        return;
+    }
+
+  result->inplace_ok = 1;
+  if (check_inplace && (plugin.capabilities & F0R_CAP_INPLACE)
+      && input_count(&plugin))
+    {
+      if (run_case(&plugin, input, params, in, out, 1) < 0)
+        return;
+      result->inplace_ok = hash_frames(out, size * frames) == result->hash;
+    }
+  result->ok = 1;
+}
+
+/* Runs a case in a child process. Returns 0 with a message in status
+   if it crashed, timed out or couldn't be run. */
+static int run(const char* path, const char* reference, int input,
+               int params, check_result_t* result, const char** status)
+{
+  int fds[2], wstatus;
+  pid_t pid;
+  ssize_t n;
+
+  if (pipe(fds) != 0)
+    {
+      *status = "error";
+      return 0;
+    }
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      *status = "error";
+      return 0;
+    }
+  if (pid == 0)
+    {
+      check_result_t r;
+
+      close(fds[0]);
+      alarm(timeout);
+      /* what plugins print mustn't end up in the table */
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+      check(path, reference, input, params, &r);
+      if (write(fds[1], &r, sizeof(r)) != (ssize_t)sizeof(r))
+        _exit(1);
+      _exit(0);
+    }
+
+  close(fds[1]);
+  n = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  waitpid(pid, &wstatus, 0);
+
+  if (n != (ssize_t)sizeof(*result))
+    {
+      *status = WIFSIGNALED(wstatus)
+        ? WTERMSIG(wstatus) == SIGALRM ? "timeout" : "crash" : "error";
+      return 0;
+    }
+  if (!result->ok)
+    *status = "error";
+  return result->ok;
+}
+
+/* Returns the type of a plugin, or -1 if it isn't one. It is loaded in
+   a child as well, plugins may crash in f0r_init. */
+static int probe(const char* path)
+{
+  plugin_t plugin;
+  int wstatus;
+  pid_t pid;
+
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0)
+    {
+      alarm(timeout);
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+      _exit(load(path, &plugin) ? plugin.info.plugin_type : 255);
+    }
+  if (pid < 0 || waitpid(pid, &wstatus, 0) != pid || !WIFEXITED(wstatus)
+      || WEXITSTATUS(wstatus) == 255)
+    return -1;
+  return WEXITSTATUS(wstatus);
+}
+
+static int read_golden(const char* file)
+{
+  FILE* in = fopen(file, "r");
+  char line[512];
+
+  if (!in)
+    {
+      fprintf(stderr, "%s: %s\n", file, strerror(errno));
+      return 0;
+    }
+  while (fgets(line, sizeof(line), in) && golden_count < MAX_GOLDEN)
+    {
+      char name[128], input[16], params[16];
+      unsigned long long hash;
+      golden_t* g = &golden[golden_count];
+
+      if (line[0] == '#'
+          || sscanf(line, "%127s %15s %15s %llx", name, input, params,
+                    &hash) != 4)
+        continue;
+      snprintf(g->key, sizeof(g->key), "%s %s %s", name, input, params);
+      g->hash = hash;
+      ++golden_count;
+    }
+  fclose(in);
+  return 1;
+}
+
+static golden_t* find_golden(const char* key)
+{
+  int i;
+
+  for (i = 0; i < golden_count; ++i)
+    if (!strcmp(golden[i].key, key))
+      return &golden[i];
+  return NULL;
+}
+
+static int parse_size(const char* s)
+{
+  return sscanf(s, "%ux%u", &width, &height) == 2 && width && height;
+}
+
+int main(int argc, char** argv)
+{
+  const char* output = NULL;
+  const char* compare = NULL;
+  FILE* out = NULL;
+  int opt, i, input, params, failed = 0, checked = 0;
+
+  while ((opt = getopt(argc, argv, "o:c:R:p:Tis:n:t:h")) != -1)
+    {
+      switch (opt)
+        {
+        case 'o':
+          output = optarg;
+          break;
+        case 'c':
+          compare = optarg;
+          break;
+        case 'R':
+          scan(optarg, reference_paths, &reference_count);
+          break;
+        case 'p':
+          min_psnr = strtod(optarg, NULL);
+          break;
+        case 'T':
+          check_trim = 1;
+          break;
+        case 'i':
+          check_inplace = 1;
+          break;
+        case 's':
+          if (!parse_size(optarg))
+            {
+              fprintf(stderr, "invalid frame size: %s\n", optarg);
+              return 1;
+            }
+          break;
+        case 'n':
+          frames = (unsigned int)strtoul(optarg, NULL, 10);
+          break;
+        case 't':
+          timeout = (unsigned int)strtoul(optarg, NULL, 10);
+          break;
+        default:
+          usage(argv[0]);
+          return opt == 'h' ? 0 : 1;
+        }
+    }
+  if (frames == 0)
+    {
+      fprintf(stderr, "need at least one frame\n");
+      return 1;
+    }
+  if (compare && !read_golden(compare))
+    return 1;
+
+  if (optind == argc)
+    scan(FREI0R_CHECK_PLUGIN_DIR, plugin_paths, &plugin_count);
+  for (i = optind; i < argc; ++i)
+    scan(argv[i], plugin_paths, &plugin_count);
+
+  if (output)
+    {
+      if (!(out = fopen(output, "w")))
+        {
+          fprintf(stderr, "%s: %s\n", output, strerror(errno));
+          return 1;
+        }
+      fprintf(out, "# frei0r-check %ux%u, %u frames\n",
+              width, height, frames);
+    }
+
+  printf("plugin,input,params,status,hash,ms_per_frame%s\n",
+         reference_count ? ",ref_ms_per_frame,psnr" : "");
+  for (i = 0; i < plugin_count; ++i)
+    {
+      const char* path = plugin_paths[i];
+      const char* reference = NULL;
+      int type = probe(path), inputs;
+
+      if (type < 0)
+        continue;
+      inputs = type == F0R_PLUGIN_TYPE_SOURCE ? 1 : INPUT_COUNT;
+      if (reference_count && !(reference = find_reference(path)))
+        {
+          printf("\"%s\",,,no reference,,\n", base_name(path));
+          continue;
+        }
+      for (input = 0; input < inputs; ++input)
+        for (params = 0; params < PARAMS_COUNT; ++params)
+          {
+            const char* input_name = inputs == 1 ? "none"
+                                                 : input_names[input];
+            const char* params_name = params_names[params];
+            const char* status = "ok";
+            char key[256];
+            check_result_t r;
+
+            snprintf(key, sizeof(key), "%s %s %s",
+                     base_name(path), input_name, params_name);
+            ++checked;
+            if (!run(path, reference, input, params, &r, &status))
+              {
+                printf("\"%s\",%s,%s,%s,,\n", base_name(path), input_name,
+                       params_name, status);
+                ++failed;
+                continue;
+              }
+
+            if (compare)
+              {
+                golden_t* g = find_golden(key);
+
+                if (!g)
+                  status = "new";
+                else if (g->hash != r.hash)
+                  status = "changed";
+              }
+            if (reference && !(r.psnr >= min_psnr))
+              status = "differs";
+            if (!r.trim_ok)
+              status = "differs after trim";
+            if (!r.inplace_ok)
+              status = "differs in place";
+            if (strcmp(status, "ok") && strcmp(status, "new"))
+              ++failed;
+
+            printf("\"%s\",%s,%s,%s,%016llx,%.3f", base_name(path),
+                   input_name, params_name, status, (unsigned long long)r.hash,
+                   r.seconds * 1e3 / frames);
+            if (reference)
+              printf(",%.3f,%.2f", r.ref_seconds * 1e3 / frames, r.psnr);
+            putchar('\n');
+            fflush(stdout);
+            if (out)
+              fprintf(out, "%s %016llx\n", key, (unsigned long long)r.hash);
+          }
+    }
+
+  if (out && fclose(out) != 0)
+    {
+      fprintf(stderr, "%s: %s\n", output, strerror(errno));
+      return 1;
+    }
+  fprintf(stderr, "%d of %d checks failed\n", failed, checked);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,538 @@
+/* frei0r-kernels.c
+ * Measures the inner kernels of the plugins on their own.
+ *
+ * Each kernel runs over whole frames of random pixels, one thread by
+ * default, and the fastest of several runs is reported in nanoseconds
+ * and, on x86, in time stamp counter cycles per pixel. Kernels that
+ * pick their variant at run time (frei0r_cpu.h) are measured once per
+ * variant the machine has; all others come in the variant of the
+ * instruction set the tool is built for (the "level" column), so that
+ * builds with different compiler flags can be compared.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FREI0R_KERNELS_TSC 1
+#endif
+
+#include "frei0r.h"
+#include "frei0r_cpu.h"
+#include "frei0r_thread.h"
+#include "frei0r_interp.h"
+#include "frei0r_remap.h"
+#include "frei0r_fibe.h"
+#include "frei0r_colorspace.h"
+#include "small_medians.h"
+#include "ctmf.h"
+
+#define MAX_RESOLUTIONS 16
+
+#if defined(__AVX2__)
+#define LEVEL "avx2"
+#elif defined(__SSE2__)
+#define LEVEL "sse2"
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define LEVEL "neon"
+#else
+#define LEVEL "c"
+#endif
+
+typedef struct resolution
+{
+  unsigned int width;
+  unsigned int height;
+} resolution_t;
+
+/* the frames and tables the kernels work on, for one resolution */
+typedef struct frame_set
+{
+  int width, height;
+  uint32_t* src;
+  uint32_t* dst;
+  float* map;          /* a rotation by 10 degrees, scaled by 0.9 */
+  frei0r_remap_t remap;
+  fibe_rgba* rgba;
+  float* planes[3];
+  frei0r_arena_t arena;
+} frame_set_t;
+
+typedef struct kernel
+{
+  const char* name;
+  const char* level;
+  void (*run)(frame_set_t* f, const struct kernel* k);
+  int arg;             /* radius, taps, mode, ... */
+  long memsize;        /* ctmf */
+  unsigned int cpu;    /* FREI0R_CPU_* flags it needs */
+} kernel_t;
+
+static resolution_t resolutions[MAX_RESOLUTIONS];
+static int resolution_count = 0;
+
+static unsigned int repeats = 5;
+static int threads = 1;
+static const char* filter = NULL;
+
+/* runs the jobs of the kernels one after the other */
+static void serial_for(void* host, int begin, int end,
+                       void (*fn)(void* ctx, int index), void* ctx)
+{
+  (void)host;
+  for (; begin < end; ++begin)
+    fn(ctx, begin);
+}
+
+static const f0r_executor_t serial = { NULL, 1, serial_for };
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "\n"
+          "  -r LIST   resolutions, comma separated: 720p, 1080p, 4k or WxH\n"
+          "            (default 720p,1080p)\n"
+          "  -n N      number of timed runs, the fastest counts (default %u)\n"
+          "  -k TEXT   only the kernels whose name contains TEXT\n"
+          "  -t        let the kernels use their threads (default one)\n"
+          "\n"
+          "Prints kernel,level,width,height,ns_per_pixel,cycles_per_pixel\n"
+          "as CSV; the cycles are those of the time stamp counter and are\n"
+          "left empty where there is none.\n",
+          argv0, repeats);
+}
+
+static int parse_resolutions(char* list)
+{
+  char* token;
+
+  resolution_count = 0;
+  for (token = strtok(list, ","); token; token = strtok(NULL, ","))
+    {
+      resolution_t r;
+
+      if (resolution_count == MAX_RESOLUTIONS)
+        return 0;
+      if (!strcmp(token, "720p"))
+        r.width = 1280, r.height = 720;
+      else if (!strcmp(token, "1080p"))
+        r.width = 1920, r.height = 1080;
+      else if (!strcmp(token, "4k") || !strcmp(token, "2160p"))
+        r.width = 3840, r.height = 2160;
+      else if (sscanf(token, "%ux%u", &r.width, &r.height) != 2
+               || r.width < 64 || r.height < 64)
+        return 0;
+      resolutions[resolution_count++] = r;
+    }
+  return resolution_count > 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t ticks(void)
+{
+#ifdef FREI0R_KERNELS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* ---- interp.h and frei0r_remap.h ---- */
+
+static const interpp interpolators[] = {
+  interpNN_b32, interpBL_b32, interpBC_b32, interpBC2_b32,
+  interpSP4_b32, interpSP6_b32, interpSC16_b32
+};
+
+/* one call of the interpolator per output pixel, as remap32() */
+static void run_interp(frame_set_t* f, const kernel_t* k)
+{
+  remap32(f->width, f->height, f->width, f->height,
+          (unsigned char*)f->src, (unsigned char*)f->dst, f->map, 0,
+          interpolators[k->arg]);
+}
+
+static void run_remap(frame_set_t* f, const kernel_t* k)
+{
+  (void)k;
+  frei0r_remap_run(&f->remap, f->src, f->dst, 0);
+}
+
+/* the tables of frei0r_remap_run() are made once per resolution */
+static void prepare_remap(frame_set_t* f, const kernel_t* k)
+{
+  frei0r_remap_prepare(&f->remap, f->width, f->height, f->width, f->height,
+                       f->map, interpolators[k->arg]);
+}
+
+/* ---- fibe.h, with the coefficients of IIRblur at about half ---- */
+
+static void run_fibe1o(frame_set_t* f, const kernel_t* k)
+{
+  (void)k;
+  fibe1o_8(f->src, f->dst, f->rgba, f->width, f->height, 0.9f, 1);
+}
+
+static void run_fibe2o(frame_set_t* f, const kernel_t* k)
+{
+  float a0, a1, a2, b0, b1, b2, rd1, rd2, rs1, rs2, rc1, rc2;
+
+  (void)k;
+  calcab_lp1(0.05f, 0.55f, &a0, &a1, &a2, &b0, &b1, &b2);
+  a1 /= a0; a2 /= a0;
+  rep(-0.5, 0.5, 0.0, &rd1, &rd2, 256, a1, a2);
+  rep(1.0, 1.0, 0.0, &rs1, &rs2, 256, a1, a2);
+  rep(0.0, 0.0, 1.0, &rc1, &rc2, 256, a1, a2);
+  fibe2o_8(f->src, f->dst, f->rgba, f->width, f->height, a1, a2,
+           rd1, rd2, rs1, rs2, rc1, rc2, 1);
+}
+
+static void fibe3_coefficients(float* a1, float* a2, float* a3)
+{
+  float a0;
+
+  young_vliet(5.0f, &a0, a1, a2, a3);
+  *a1 = -*a1 / a0;
+  *a2 = -*a2 / a0;
+  *a3 = -*a3 / a0;
+}
+
+static void run_fibe3(frame_set_t* f, const kernel_t* k)
+{
+  float a1, a2, a3;
+
+  fibe3_coefficients(&a1, &a2, &a3);
+  if (k->arg == 0)
+    fibe3_8(f->src, f->dst, f->rgba, f->width, f->height, a1, a2, a3, 1);
+  else
+    fibe3_f(f->planes[0], f->width, f->height, a1, a2, a3, 1);
+}
+
+/* ---- medians: ctmf.h and the networks of small_medians.h ---- */
+
+static void run_ctmf(frame_set_t* f, const kernel_t* k)
+{
+#if defined(FREI0R_CPU_DISPATCH)
+  ctmf_helper = k->cpu & FREI0R_CPU_AVX2 ? ctmf_helper_avx2
+                                         : ctmf_helper_generic;
+#endif
+  frei0r_arena_reset(&f->arena);
+  ctmf((const unsigned char*)f->src, (unsigned char*)f->dst,
+       f->width, f->height, f->width * 4, f->width * 4, k->arg, 3, 4,
+       (unsigned long)k->memsize, &f->arena);
+}
+
+/* the median of each run of arg pixels of a row, which is all the
+   networks see of the neighbourhoods the plugins gather */
+static void run_network(frame_set_t* f, const kernel_t* k)
+{
+  uint32_t m[25];
+  long i, n = (long)f->width * f->height - k->arg;
+
+  for (i = 0; i < n; ++i)
+    {
+      memcpy(m, f->src + i, k->arg * sizeof(uint32_t));
+      switch (k->arg)
+        {
+        case 3: f->dst[i] = median3(m); break;
+        case 5: f->dst[i] = median5(m); break;
+        case 7: f->dst[i] = median7(m); break;
+        case 9: f->dst[i] = median9(m); break;
+        case 25: f->dst[i] = median25(m); break;
+        }
+    }
+}
+
+#ifdef SMED_N
+static void run_network_v(frame_set_t* f, const kernel_t* k)
+{
+  smed_v v[25];
+  long i, n = (long)f->width * f->height - k->arg - SMED_N;
+  int j;
+
+  for (i = 0; i <= n; i += SMED_N)
+    {
+      for (j = 0; j < k->arg; ++j)
+        v[j] = smed_ld(f->src + i + j);
+      switch (k->arg)
+        {
+        case 3: smed_st(f->dst + i, median3_v(v)); break;
+        case 5: smed_st(f->dst + i, median5_v(v)); break;
+        case 7: smed_st(f->dst + i, median7_v(v)); break;
+        case 9: smed_st(f->dst + i, median9_v(v)); break;
+        case 25: smed_st(f->dst + i, median25_v(v)); break;
+        }
+    }
+}
+#endif
+
+/* ---- frei0r_colorspace.h ---- */
+
+static void run_to_hsx(frame_set_t* f, const kernel_t* k)
+{
+  const uint8_t* src = (const uint8_t*)f->src;
+  int n = f->width * f->height;
+
+  if (k->arg)
+    rgba_to_hsl_row(src, f->planes[0], f->planes[1], f->planes[2], n);
+  else
+    rgba_to_hsv_row(src, f->planes[0], f->planes[1], f->planes[2], n);
+}
+
+static void run_from_hsx(frame_set_t* f, const kernel_t* k)
+{
+  uint8_t* dst = (uint8_t*)f->dst;
+  int n = f->width * f->height;
+
+  if (k->arg)
+    hsl_to_rgba_row(f->planes[0], f->planes[1], f->planes[2], dst, n);
+  else
+    hsv_to_rgba_row(f->planes[0], f->planes[1], f->planes[2], dst, n);
+}
+
+static void run_mix(frame_set_t* f, const kernel_t* k)
+{
+  frei0r_cs_mix_row((const uint8_t*)f->src, (const uint8_t*)f->dst,
+                    (uint8_t*)f->dst, f->width * f->height, k->arg);
+}
+
+#define AVX2 FREI0R_CPU_AVX2
+
+static const kernel_t kernels[] = {
+  { "interpNN_b32", LEVEL, run_interp, 0, 0, 0 },
+  { "interpBL_b32", LEVEL, run_interp, 1, 0, 0 },
+  { "interpBC_b32", LEVEL, run_interp, 2, 0, 0 },
+  { "interpBC2_b32", LEVEL, run_interp, 3, 0, 0 },
+  { "interpSP4_b32", LEVEL, run_interp, 4, 0, 0 },
+  { "interpSP6_b32", LEVEL, run_interp, 5, 0, 0 },
+  { "interpSC16_b32", LEVEL, run_interp, 6, 0, 0 },
+  { "remap nearest", LEVEL, run_remap, 0, 0, 0 },
+  { "remap bilinear", LEVEL, run_remap, 1, 0, 0 },
+  { "remap bicubic", LEVEL, run_remap, 2, 0, 0 },
+  { "remap spline6", LEVEL, run_remap, 5, 0, 0 },
+  { "fibe1o_8", LEVEL, run_fibe1o, 0, 0, 0 },
+  { "fibe2o_8", LEVEL, run_fibe2o, 0, 0, 0 },
+  { "fibe3_8", LEVEL, run_fibe3, 0, 0, 0 },
+  { "fibe3_f", LEVEL, run_fibe3, 1, 0, 0 },
+  { "ctmf r=2 mem=512k", "generic", run_ctmf, 2, 512 << 10, 0 },
+  { "ctmf r=8 mem=512k", "generic", run_ctmf, 8, 512 << 10, 0 },
+  { "ctmf r=32 mem=512k", "generic", run_ctmf, 32, 512 << 10, 0 },
+  { "ctmf r=8 mem=128k", "generic", run_ctmf, 8, 128 << 10, 0 },
+  { "ctmf r=8 mem=2m", "generic", run_ctmf, 8, 2048 << 10, 0 },
+#if defined(FREI0R_CPU_DISPATCH)
+  { "ctmf r=2 mem=512k", "avx2", run_ctmf, 2, 512 << 10, AVX2 },
+  { "ctmf r=8 mem=512k", "avx2", run_ctmf, 8, 512 << 10, AVX2 },
+  { "ctmf r=32 mem=512k", "avx2", run_ctmf, 32, 512 << 10, AVX2 },
+  { "ctmf r=8 mem=128k", "avx2", run_ctmf, 8, 128 << 10, AVX2 },
+  { "ctmf r=8 mem=2m", "avx2", run_ctmf, 8, 2048 << 10, AVX2 },
+#endif
+  { "median3", "c", run_network, 3, 0, 0 },
+  { "median5", "c", run_network, 5, 0, 0 },
+  { "median7", "c", run_network, 7, 0, 0 },
+  { "median9", "c", run_network, 9, 0, 0 },
+  { "median25", "c", run_network, 25, 0, 0 },
+#ifdef SMED_N
+  { "median3", LEVEL, run_network_v, 3, 0, 0 },
+  { "median5", LEVEL, run_network_v, 5, 0, 0 },
+  { "median7", LEVEL, run_network_v, 7, 0, 0 },
+  { "median9", LEVEL, run_network_v, 9, 0, 0 },
+  { "median25", LEVEL, run_network_v, 25, 0, 0 },
+#endif
+  { "rgba_to_hsv_row", LEVEL, run_to_hsx, 0, 0, 0 },
+  { "hsv_to_rgba_row", LEVEL, run_from_hsx, 0, 0, 0 },
+  { "rgba_to_hsl_row", LEVEL, run_to_hsx, 1, 0, 0 },
+  { "hsl_to_rgba_row", LEVEL, run_from_hsx, 1, 0, 0 },
+  { "frei0r_cs_mix_row hue", LEVEL, run_mix, FREI0R_CS_HUE, 0, 0 },
+  { "frei0r_cs_mix_row hsv", LEVEL, run_mix,
+    FREI0R_CS_HUE | FREI0R_CS_SATURATION | FREI0R_CS_VALUE, 0, 0 },
+};
+
+#define KERNEL_COUNT (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static int alloc_frames(frame_set_t* f, resolution_t res)
+{
+  size_t i, size = (size_t)res.width * res.height;
+  uint32_t seed = 0x9e3779b9u;
+  float c = cosf(10.0f * (float)M_PI / 180.0f) / 0.9f;
+  float s = sinf(10.0f * (float)M_PI / 180.0f) / 0.9f;
+  int x, y;
+
+  memset(f, 0, sizeof(*f));
+  f->width = (int)res.width;
+  f->height = (int)res.height;
+  f->src = (uint32_t*)malloc(size * sizeof(uint32_t));
+  f->dst = (uint32_t*)malloc(size * sizeof(uint32_t));
+  f->map = (float*)malloc(2 * size * sizeof(float));
+  f->rgba = (fibe_rgba*)malloc(size * sizeof(fibe_rgba));
+  for (i = 0; i < 3; ++i)
+    f->planes[i] = (float*)malloc(size * sizeof(float));
+  if (!f->src || !f->dst || !f->map || !f->rgba
+      || !f->planes[0] || !f->planes[1] || !f->planes[2])
+    return 0;
+
+  for (i = 0; i < size; ++i)
+    {
+      /* xorshift, like frei0r-bench */
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      f->src[i] = f->dst[i] = seed;
+      f->planes[0][i] = (float)(seed & 0xffff) * (360.0f / 65536.0f);
+      f->planes[1][i] = (float)(seed >> 24) / 255.0f;
+      f->planes[2][i] = (float)((seed >> 16) & 0xff) / 255.0f;
+    }
+  /* about the centre, background where it leaves the source */
+  for (y = 0; y < f->height; ++y)
+    for (x = 0; x < f->width; ++x)
+      {
+        float dx = x - f->width / 2.0f, dy = y - f->height / 2.0f;
+        float sx = c * dx - s * dy + f->width / 2.0f;
+        float sy = s * dx + c * dy + f->height / 2.0f;
+
+        i = (size_t)y * f->width + x;
+        if (sx < 0 || sy < 0 || sx > f->width - 1 || sy > f->height - 1)
+          sx = sy = -1;
+        f->map[2 * i] = sx;
+        f->map[2 * i + 1] = sy;
+      }
+  frei0r_remap_init(&f->remap);
+  frei0r_arena_init(&f->arena);
+  return 1;
+}
+
+static void free_frames(frame_set_t* f)
+{
+  int i;
+
+  free(f->src);
+  free(f->dst);
+  free(f->map);
+  free(f->rgba);
+  for (i = 0; i < 3; ++i)
+    free(f->planes[i]);
+  frei0r_remap_free(&f->remap);
+  frei0r_arena_release(&f->arena);
+}
+
+static void measure(frame_set_t* f, const kernel_t* k)
+{
+  double pixels = (double)f->width * f->height;
+  double best = 0, t;
+  uint64_t best_ticks = 0, c;
+  unsigned int i;
+
+  if (k->run == run_remap)
+    prepare_remap(f, k);
+  k->run(f, k);                 /* warm-up */
+  for (i = 0; i < repeats; ++i)
+    {
+      t = now();
+      c = ticks();
+      k->run(f, k);
+      c = ticks() - c;
+      t = now() - t;
+      if (i == 0 || t < best)
+        best = t;
+      if (i == 0 || c < best_ticks)
+        best_ticks = c;
+    }
+
+  printf("\"%s\",%s,%d,%d,%.4f,", k->name, k->level, f->width, f->height,
+         best * 1e9 / pixels);
+#ifdef FREI0R_KERNELS_TSC
+  printf("%.3f", best_ticks / pixels);
+#endif
+  putchar('\n');
+  fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+  char default_resolutions[] = "720p,1080p";
+  unsigned int cpu = frei0r_cpu_features();
+  int opt, i, j;
+
+  parse_resolutions(default_resolutions);
+
+  while ((opt = getopt(argc, argv, "r:n:k:th")) != -1)
+    {
+      switch (opt)
+        {
+        case 'r':
+          if (!parse_resolutions(optarg))
+            {
+              fprintf(stderr, "invalid resolution list: %s\n", optarg);
+              return 1;
+            }
+          break;
+        case 'n':
+          repeats = (unsigned int)strtoul(optarg, NULL, 10);
+          break;
+        case 'k':
+          filter = optarg;
+          break;
+        case 't':
+          threads = 0;
+          break;
+        default:
+          usage(argv[0]);
+          return opt == 'h' ? 0 : 1;
+        }
+    }
+  if (repeats == 0)
+    {
+      fprintf(stderr, "need at least one timed run\n");
+      return 1;
+    }
+  if (threads == 1)
+    f0r_set_executor(&serial);
+
+  printf("kernel,level,width,height,ns_per_pixel,cycles_per_pixel\n");
+  for (j = 0; j < resolution_count; ++j)
+    {
+      frame_set_t f;
+
+      if (!alloc_frames(&f, resolutions[j]))
+        {
+          fprintf(stderr, "out of memory at %ux%u\n",
+                  resolutions[j].width, resolutions[j].height);
+          free_frames(&f);
+          return 1;
+        }
+      for (i = 0; i < KERNEL_COUNT; ++i)
+        if ((kernels[i].cpu & cpu) == kernels[i].cpu
+            && (!filter || strstr(kernels[i].name, filter)))
+          measure(&f, &kernels[i]);
+      free_frames(&f);
+    }
+  return 0;
+}
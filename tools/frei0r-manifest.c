@@ -0,0 +1,273 @@
+/* frei0r-manifest.c
+ * Writes the manifest of a set of frei0r plugins.
+ *
+ * Every plugin is loaded once, and its info and parameter info are
+ * written as JSON (see include/frei0r_manifest.h), so that applications
+ * can list the plugins of a directory without loading them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "frei0r.h"
+#include "frei0r_manifest.h"
+
+#define MAX_PLUGINS 1024
+
+static char* plugin_paths[MAX_PLUGINS];
+static int plugin_count = 0;
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-o FILE] plugin.so|directory...\n"
+          "\n"
+          "  -o FILE   manifest to write (default standard output)\n"
+          "\n"
+          "Directories are searched for plugins recursively. The manifest\n"
+          "names each plugin by its file name only: it is meant to be\n"
+          "installed in the same directory as the plugins.\n",
+          argv0);
+}
+
+static int is_plugin(const char* name)
+{
+  size_t len = strlen(name);
+  return len > 3 && !strcmp(name + len - 3, ".so");
+}
+
+static void add_plugin(const char* path)
+{
+  if (plugin_count < MAX_PLUGINS)
+    plugin_paths[plugin_count++] = strdup(path);
+}
+
+/* adds all plugins below path, in a stable order */
+static void scan(const char* path)
+{
+  struct stat st;
+  struct dirent** entries;
+  int n, i;
+
+  if (stat(path, &st) != 0)
+    {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return;
+    }
+  if (!S_ISDIR(st.st_mode))
+    {
+      add_plugin(path);
+      return;
+    }
+
+  n = scandir(path, &entries, NULL, alphasort);
+  if (n < 0)
+    return;
+  for (i = 0; i < n; ++i)
+    {
+      const char* name = entries[i]->d_name;
+      char child[4096];
+
+      if (name[0] != '.')
+        {
+          snprintf(child, sizeof(child), "%s/%s", path, name);
+          if (stat(child, &st) == 0)
+            {
+              if (S_ISDIR(st.st_mode))
+                scan(child);
+              else if (is_plugin(name))
+                add_plugin(child);
+            }
+        }
+      free(entries[i]);
+    }
+  free(entries);
+}
+
+static const char* base_name(const char* path)
+{
+  const char* slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static int by_file_name(const void* a, const void* b)
+{
+  return strcmp(base_name(*(char* const*)a), base_name(*(char* const*)b));
+}
+
+/* writes s as JSON string */
+static void write_quoted(FILE* out, const char* s)
+{
+  fputc('"', out);
+  for (; s && *s; ++s)
+    {
+      unsigned char c = (unsigned char)*s;
+
+      if (c == '"' || c == '\\')
+        fprintf(out, "\\%c", c);
+      else if (c == '\n')
+        fputs("\\n", out);
+      else if (c == '\t')
+        fputs("\\t", out);
+      else if (c < 0x20)
+        fprintf(out, "\\u%04x", c);
+      else
+        fputc(c, out);
+    }
+  fputc('"', out);
+}
+
+/* Writes the entry of one plugin; returns 0 if it isn't a plugin. */
+static int write_plugin(FILE* out, const char* path, int first)
+{
+  void* handle;
+  int (*init)(void);
+  void (*deinit)(void);
+  void (*get_plugin_info)(f0r_plugin_info_t*);
+  void (*get_plugin_info2)(f0r_plugin_info2_t*);
+  void (*get_param_info)(f0r_param_info_t*, int);
+  f0r_plugin_info_t info;
+  unsigned int capabilities = 0;
+  int i;
+
+  handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle)
+    {
+      fprintf(stderr, "%s\n", dlerror());
+      return 0;
+    }
+  init = (int (*)(void))dlsym(handle, "f0r_init");
+  deinit = (void (*)(void))dlsym(handle, "f0r_deinit");
+  get_plugin_info = (void (*)(f0r_plugin_info_t*))
+    dlsym(handle, "f0r_get_plugin_info");
+  get_plugin_info2 = (void (*)(f0r_plugin_info2_t*))
+    dlsym(handle, "f0r_get_plugin_info2");
+  get_param_info = (void (*)(f0r_param_info_t*, int))
+    dlsym(handle, "f0r_get_param_info");
+  if (!init || !deinit || !get_plugin_info || !get_param_info)
+    {
+      fprintf(stderr, "%s: not a frei0r plugin\n", path);
+      dlclose(handle);
+      return 0;
+    }
+
+  init();
+  memset(&info, 0, sizeof(info));
+  if (get_plugin_info2)
+    {
+      f0r_plugin_info2_t info2;
+
+      memset(&info2, 0, sizeof(info2));
+      get_plugin_info2(&info2);
+      info = info2.info;
+      capabilities = info2.capabilities;
+    }
+  else
+    get_plugin_info(&info);
+
+  fputs(first ? "\n" : ",\n", out);
+  fputs("    { \"file\": ", out);
+  write_quoted(out, base_name(path));
+  fputs(", \"name\": ", out);
+  write_quoted(out, info.name);
+  fputs(", \"author\": ", out);
+  write_quoted(out, info.author);
+  fprintf(out, ",\n      \"plugin_type\": %d, \"color_model\": %d,"
+          " \"frei0r_version\": %d, \"major_version\": %d,"
+          " \"minor_version\": %d, \"capabilities\": %u,\n",
+          info.plugin_type, info.color_model, info.frei0r_version,
+          info.major_version, info.minor_version, capabilities);
+  fputs("      \"explanation\": ", out);
+  write_quoted(out, info.explanation);
+  fputs(",\n      \"params\": [", out);
+  for (i = 0; i < info.num_params; ++i)
+    {
+      f0r_param_info_t param;
+
+      memset(&param, 0, sizeof(param));
+      get_param_info(&param, i);
+      fputs(i ? ",\n        { \"name\": " : "\n        { \"name\": ", out);
+      write_quoted(out, param.name);
+      fprintf(out, ", \"type\": %d, \"explanation\": ", param.type);
+      write_quoted(out, param.explanation);
+      fputs(" }", out);
+    }
+  fputs(info.num_params ? " ] }" : "] }", out);
+
+  deinit();
+  dlclose(handle);
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  const char* output = 0;
+  FILE* out = stdout;
+  int opt, i, first = 1;
+
+  while ((opt = getopt(argc, argv, "o:h")) != -1)
+    {
+      switch (opt)
+        {
+        case 'o':
+          output = optarg;
+          break;
+        default:
+          usage(argv[0]);
+          return opt == 'h' ? 0 : 1;
+        }
+    }
+  if (optind == argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+  for (i = optind; i < argc; ++i)
+    scan(argv[i]);
+  /* in the order of the names they are installed under */
+  qsort(plugin_paths, plugin_count, sizeof(plugin_paths[0]), by_file_name);
+
+  if (output && !(out = fopen(output, "w")))
+    {
+      fprintf(stderr, "%s: %s\n", output, strerror(errno));
+      return 1;
+    }
+  fprintf(out, "{ \"frei0r_manifest\": %d,\n  \"plugins\": [",
+          FREI0R_MANIFEST_VERSION);
+  for (i = 0; i < plugin_count; ++i)
+    if (write_plugin(out, plugin_paths[i], first))
+      first = 0;
+  fputs(first ? "] }\n" : "\n  ] }\n", out);
+
+  if (out != stdout && fclose(out) != 0)
+    {
+      fprintf(stderr, "%s: %s\n", output, strerror(errno));
+      return 1;
+    }
+  return 0;
+}